@@ -773,6 +773,45 @@ fsal_status_t ceph_open_my_fd(struct handle *myself,
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
 
+#ifdef USE_FSAL_CEPH_LL_NONBLOCKING_RW
+/* Signalled when the last asynchronous I/O on a global fd completes */
+static pthread_mutex_t ceph_async_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ceph_async_cv = PTHREAD_COND_INITIALIZER;
+
+/**
+ * @brief Wait for the asynchronous I/O on a global fd to complete
+ *
+ * Called with the object lock held for write, so no new one starts.
+ *
+ * @param[in] myself  The file
+ */
+
+static void ceph_async_wait(struct handle *myself)
+{
+	if (atomic_fetch_uint32_t(&myself->async_ios) == 0)
+		return;
+
+	PTHREAD_MUTEX_lock(&ceph_async_mtx);
+	while (atomic_fetch_uint32_t(&myself->async_ios) != 0)
+		pthread_cond_wait(&ceph_async_cv, &ceph_async_mtx);
+	PTHREAD_MUTEX_unlock(&ceph_async_mtx);
+}
+
+static void ceph_async_put(struct handle *myself)
+{
+	if (atomic_dec_uint32_t(&myself->async_ios) != 0)
+		return;
+
+	PTHREAD_MUTEX_lock(&ceph_async_mtx);
+	pthread_cond_broadcast(&ceph_async_cv);
+	PTHREAD_MUTEX_unlock(&ceph_async_mtx);
+}
+#else
+static inline void ceph_async_wait(struct handle *myself)
+{
+}
+#endif
+
 fsal_status_t ceph_close_my_fd(struct handle *handle, struct ceph_fd *my_fd)
 {
 	int rc = 0;
@@ -823,6 +862,8 @@ static fsal_status_t ceph_open_func(struct fsal_obj_handle *obj_hdl,
 static fsal_status_t ceph_close_func(struct fsal_obj_handle *obj_hdl,
 				     struct fsal_fd *fd)
 {
+	ceph_async_wait(container_of(obj_hdl, struct handle, handle));
+
 	return ceph_close_my_fd(container_of(obj_hdl, struct handle, handle),
 				(struct ceph_fd *)fd);
 }
@@ -849,7 +890,9 @@ static fsal_status_t ceph_fsal_close(struct fsal_obj_handle *obj_hdl)
 	 */
 	PTHREAD_RWLOCK_wrlock(&obj_hdl->lock);
 
+	ceph_async_wait(handle);
 	status = ceph_close_my_fd(handle, &handle->fd);
+	fsal_fd_cache_close(obj_hdl);
 
 	PTHREAD_RWLOCK_unlock(&obj_hdl->lock);
 
@@ -1454,6 +1497,7 @@ fsal_status_t ceph_find_fd(Fh **fd,
 			      (struct fsal_fd *)&myself->fd, &myself->share,
 			      bypass, state, openflags,
 			      ceph_open_func, ceph_close_func,
+			      sizeof(struct ceph_fd),
 			      has_lock, need_fsync,
 			      closefd, open_for_locks);
 
@@ -1463,6 +1507,75 @@ fsal_status_t ceph_find_fd(Fh **fd,
 	return status;
 }
 
+#ifdef USE_FSAL_CEPH_LL_LSEEK
+/**
+ * @brief Read the data or the hole at an offset for READ_PLUS
+ *
+ * A hole is reported up to the next data, or the end of file, without
+ * reading anything; data is read up to the next hole.  If the cluster
+ * cannot seek data, the file reads as if it had no holes.
+ *
+ * @param[in]     cmount         Ceph mount
+ * @param[in]     fd             File to read from
+ * @param[in]     offset         Position from which to read
+ * @param[in]     buffer_size    Amount of data to read
+ * @param[out]    buffer         Buffer to which data are to be copied
+ * @param[out]    read_amount    Amount of data read
+ * @param[out]    end_of_file    true if the end of file has been reached
+ * @param[out]    info           The data or hole found
+ *
+ * @return FSAL status.
+ */
+
+static fsal_status_t ceph_read_plus_fd(struct ceph_mount_info *cmount,
+				       Fh *fd, uint64_t offset,
+				       size_t buffer_size, void *buffer,
+				       size_t *read_amount, bool *end_of_file,
+				       struct io_info *info)
+{
+	int64_t data, hole, size = -1;
+	uint64_t length;
+	int nb_read;
+
+	data = ceph_ll_lseek(cmount, fd, offset, SEEK_DATA);
+	if (data == -ENXIO) {
+		/* No data from offset on */
+		size = ceph_ll_lseek(cmount, fd, 0, SEEK_END);
+		if (size < 0)
+			return ceph2fsal_error(size);
+		data = size;
+	}
+
+	if (data > (int64_t) offset) {
+		length = data - offset;
+		if (length > buffer_size)
+			length = buffer_size;
+
+		io_info_hole(info, offset, length);
+		*read_amount = 0;
+		*end_of_file = size >= 0 && offset + length >= (uint64_t) size;
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+	}
+
+	if (data >= 0) {
+		hole = ceph_ll_lseek(cmount, fd, offset, SEEK_HOLE);
+		if (hole > (int64_t) offset &&
+		    (uint64_t) (hole - offset) < buffer_size)
+			buffer_size = hole - offset;
+	}
+
+	nb_read = ceph_ll_read(cmount, fd, offset, buffer_size, buffer);
+	if (nb_read < 0)
+		return ceph2fsal_error(nb_read);
+
+	io_info_data(info, offset, buffer, nb_read);
+	*read_amount = nb_read;
+	*end_of_file = nb_read == 0;
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+#endif
+
 /**
  * @brief Read data from a file
  *
@@ -1504,10 +1617,12 @@ fsal_status_t ceph_read2(struct fsal_obj_handle *obj_hdl,
 	struct export *export =
 	    container_of(op_ctx->fsal_export, struct export, export);
 
+#ifndef USE_FSAL_CEPH_LL_LSEEK
 	if (info != NULL) {
-		/* Currently we don't support READ_PLUS */
+		/* READ_PLUS needs ceph_ll_lseek to find holes */
 		return fsalstat(ERR_FSAL_NOTSUPP, 0);
 	}
+#endif
 
 	/* Get a usable file descriptor */
 	status = ceph_find_fd(&my_fd, obj_hdl, bypass, state, FSAL_O_READ,
@@ -1516,6 +1631,15 @@ fsal_status_t ceph_read2(struct fsal_obj_handle *obj_hdl,
 	if (FSAL_IS_ERROR(status))
 		goto out;
 
+#ifdef USE_FSAL_CEPH_LL_LSEEK
+	if (info != NULL) {
+		status = ceph_read_plus_fd(export->cmount, my_fd, offset,
+					   buffer_size, buffer, read_amount,
+					   end_of_file, info);
+		goto out;
+	}
+#endif
+
 	nb_read =
 	    ceph_ll_read(export->cmount, my_fd, offset, buffer_size, buffer);
 
@@ -1528,22 +1652,6 @@ fsal_status_t ceph_read2(struct fsal_obj_handle *obj_hdl,
 
 	*end_of_file = nb_read == 0;
 
-#if 0
-	/** @todo
-	 *
-	 * Is this all we really need to do to support READ_PLUS? Will anyone
-	 * ever get upset that we don't return holes, even for blocks of all
-	 * zeroes?
-	 *
-	 */
-	if (info != NULL) {
-		info->io_content.what = NFS4_CONTENT_DATA;
-		info->io_content.data.d_offset = offset + nb_read;
-		info->io_content.data.d_data.data_len = nb_read;
-		info->io_content.data.d_data.data_val = buffer;
-	}
-#endif
-
  out:
 
 	if (closefd)
@@ -1652,6 +1760,484 @@ fsal_status_t ceph_write2(struct fsal_obj_handle *obj_hdl,
 	return status;
 }
 
+#ifdef USE_FSAL_CEPH_LL_NONBLOCKING_RW
+/**
+ * @brief An asynchronous read or write handed to libcephfs
+ */
+struct ceph_async_io {
+	struct ceph_ll_io_info io_info;
+	struct iovec iov;
+	struct fsal_obj_handle *obj_hdl;
+	struct fsal_io_arg *io_arg;
+	fsal_async_cb done_cb;
+	void *caller_arg;
+	/** The I/O is on the global fd, and counted in async_ios */
+	bool global_fd;
+};
+
+/**
+ * @brief Complete an asynchronous read or write
+ *
+ * Called on a libcephfs thread.
+ */
+
+static void ceph_async_done(struct ceph_ll_io_info *io_info)
+{
+	struct ceph_async_io *cio =
+		container_of(io_info, struct ceph_async_io, io_info);
+	struct fsal_io_arg *io_arg = cio->io_arg;
+	fsal_status_t status = fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+	if (io_info->result < 0) {
+		status = ceph2fsal_error(io_info->result);
+	} else {
+		io_arg->io_amount = io_info->result;
+		if (!io_info->write)
+			io_arg->end_of_file = io_info->result == 0;
+	}
+
+	if (cio->global_fd)
+		ceph_async_put(container_of(cio->obj_hdl, struct handle,
+					    handle));
+
+	cio->done_cb(cio->obj_hdl, status, io_arg, cio->caller_arg);
+	gsh_free(cio);
+}
+
+/**
+ * @brief Start a read or write through libcephfs without waiting
+ *
+ * A global fd is only held through the object lock, which can't be
+ * released on another thread; the I/O is counted on the handle
+ * instead, and closing the global fd waits for it.  An fd opened for
+ * this I/O alone would have to be closed from the completion, so the
+ * I/O is then made synchronously.
+ *
+ * @return true if the I/O was started, and done_cb will be called.
+ */
+
+static bool ceph_async_start(struct fsal_obj_handle *obj_hdl, bool bypass,
+			     struct fsal_io_arg *io_arg, bool write,
+			     fsal_async_cb done_cb, void *caller_arg)
+{
+	struct handle *myself = container_of(obj_hdl, struct handle, handle);
+	struct ceph_async_io *cio;
+	fsal_openflags_t openflags = write ? FSAL_O_WRITE : FSAL_O_READ;
+	fsal_status_t status;
+	Fh *my_fd = NULL;
+	bool has_lock = false;
+	bool need_fsync = false;
+	bool closefd = false;
+	int64_t rc;
+
+	if (io_arg->info != NULL)
+		return false;
+
+	if (write && io_arg->fsal_stable)
+		openflags |= FSAL_O_SYNC;
+
+	status = ceph_find_fd(&my_fd, obj_hdl, bypass, io_arg->state,
+			      openflags, &has_lock, &need_fsync, &closefd,
+			      false);
+
+	if (FSAL_IS_ERROR(status)) {
+		done_cb(obj_hdl, status, io_arg, caller_arg);
+		return true;
+	}
+
+	if (closefd) {
+		(void) ceph_ll_close(myself->export->cmount, my_fd);
+		if (has_lock)
+			PTHREAD_RWLOCK_unlock(&obj_hdl->lock);
+		return false;
+	}
+
+	cio = gsh_calloc(1, sizeof(*cio));
+	cio->iov.iov_base = io_arg->buffer;
+	cio->iov.iov_len = io_arg->size;
+	cio->obj_hdl = obj_hdl;
+	cio->io_arg = io_arg;
+	cio->done_cb = done_cb;
+	cio->caller_arg = caller_arg;
+	cio->io_info.callback = ceph_async_done;
+	cio->io_info.fh = my_fd;
+	cio->io_info.iov = &cio->iov;
+	cio->io_info.iovcnt = 1;
+	cio->io_info.off = io_arg->offset;
+	cio->io_info.write = write;
+	/* attempt stability if we aren't using an O_SYNC fd */
+	cio->io_info.fsync = need_fsync;
+	cio->io_info.syncdataonly = true;
+
+	if (has_lock) {
+		cio->global_fd = true;
+		(void) atomic_inc_uint32_t(&myself->async_ios);
+		PTHREAD_RWLOCK_unlock(&obj_hdl->lock);
+	}
+
+	if (write)
+		fsal_set_credentials(op_ctx->creds);
+
+	rc = ceph_ll_nonblocking_readv_writev(myself->export->cmount,
+					      &cio->io_info);
+
+	if (write)
+		fsal_restore_ganesha_credentials();
+
+	if (rc < 0) {
+		/* Not started, the callback won't be called */
+		if (cio->global_fd)
+			ceph_async_put(myself);
+		gsh_free(cio);
+		done_cb(obj_hdl, ceph2fsal_error(rc), io_arg, caller_arg);
+	}
+
+	return true;
+}
+
+/**
+ * @brief Read from a file without waiting for the data
+ *
+ * @param[in]     obj_hdl     File on which to operate
+ * @param[in]     bypass      If state doesn't indicate a share reservation,
+ *                            bypass any deny read
+ * @param[in,out] read_arg    Arguments of the read, and its results
+ * @param[in]     done_cb     Called once the read is done
+ * @param[in]     caller_arg  Passed to done_cb
+ */
+
+static void ceph_read2_async(struct fsal_obj_handle *obj_hdl,
+			     bool bypass,
+			     struct fsal_io_arg *read_arg,
+			     fsal_async_cb done_cb,
+			     void *caller_arg)
+{
+	fsal_status_t status;
+
+	if (ceph_async_start(obj_hdl, bypass, read_arg, false, done_cb,
+			     caller_arg))
+		return;
+
+	status = ceph_read2(obj_hdl, bypass, read_arg->state,
+			    read_arg->offset, read_arg->size,
+			    read_arg->buffer, &read_arg->io_amount,
+			    &read_arg->end_of_file, read_arg->info);
+
+	done_cb(obj_hdl, status, read_arg, caller_arg);
+}
+
+/**
+ * @brief Write to a file without waiting for the write
+ *
+ * @param[in]     obj_hdl     File on which to operate
+ * @param[in]     bypass      If state doesn't indicate a share reservation,
+ *                            bypass any non-mandatory deny write
+ * @param[in,out] write_arg   Arguments of the write, and its results
+ * @param[in]     done_cb     Called once the write is done
+ * @param[in]     caller_arg  Passed to done_cb
+ */
+
+static void ceph_write2_async(struct fsal_obj_handle *obj_hdl,
+			      bool bypass,
+			      struct fsal_io_arg *write_arg,
+			      fsal_async_cb done_cb,
+			      void *caller_arg)
+{
+	fsal_status_t status;
+
+	if (ceph_async_start(obj_hdl, bypass, write_arg, true, done_cb,
+			     caller_arg))
+		return;
+
+	status = ceph_write2(obj_hdl, bypass, write_arg->state,
+			     write_arg->offset, write_arg->size,
+			     write_arg->buffer, &write_arg->io_amount,
+			     &write_arg->fsal_stable, write_arg->info);
+
+	done_cb(obj_hdl, status, write_arg, caller_arg);
+}
+#endif
+
+#ifdef USE_FSAL_CEPH_LL_LSEEK
+/**
+ * @brief Seek to data or hole
+ *
+ * @param[in]     obj_hdl   File on which to operate
+ * @param[in]     state     state_t to use for this operation
+ * @param[in,out] info      Information about the data
+ *
+ * @return FSAL status.
+ */
+
+static fsal_status_t ceph_seek2(struct fsal_obj_handle *obj_hdl,
+				struct state_t *state,
+				struct io_info *info)
+{
+	struct handle *myself = container_of(obj_hdl, struct handle, handle);
+	int64_t offset = info->io_content.hole.di_offset;
+	Fh *my_fd = NULL;
+	fsal_status_t status;
+	bool has_lock = false;
+	bool need_fsync = false;
+	bool closefd = false;
+	int64_t found, size;
+	int whence;
+
+	switch (info->io_content.what) {
+	case NFS4_CONTENT_DATA:
+		whence = SEEK_DATA;
+		break;
+	case NFS4_CONTENT_HOLE:
+		whence = SEEK_HOLE;
+		break;
+	default:
+		return fsalstat(ERR_FSAL_UNION_NOTSUPP, 0);
+	}
+
+	status = ceph_find_fd(&my_fd, obj_hdl, false, state, FSAL_O_READ,
+			      &has_lock, &need_fsync, &closefd, false);
+
+	if (FSAL_IS_ERROR(status))
+		goto out;
+
+	size = ceph_ll_lseek(myself->export->cmount, my_fd, 0, SEEK_END);
+	if (size < 0 || offset >= size) {
+		status = ceph2fsal_error(size < 0 ? size : -ENXIO);
+		goto out;
+	}
+
+	found = ceph_ll_lseek(myself->export->cmount, my_fd, offset, whence);
+	if (found == -ENXIO) {
+		/* No data after offset */
+		found = size;
+	} else if (found < 0) {
+		status = ceph2fsal_error(found);
+		goto out;
+	}
+
+	info->io_eof = found >= size;
+	info->io_content.hole.di_offset = found;
+
+ out:
+
+	if (closefd)
+		(void) ceph_ll_close(myself->export->cmount, my_fd);
+
+	if (has_lock)
+		PTHREAD_RWLOCK_unlock(&obj_hdl->lock);
+
+	return status;
+}
+#endif
+
+#ifdef USE_FSAL_CEPH_LL_IOV
+/**
+ * @brief Read from consecutive positions in a file into several buffers
+ *
+ * @param[in]  obj_hdl      File on which to operate
+ * @param[in]  bypass       If state doesn't indicate a share reservation,
+ *                          bypass any deny read
+ * @param[in]  state        state_t to use for this operation
+ * @param[in]  offset       Position from which to read
+ * @param[in]  iov          The buffers
+ * @param[in]  iovcnt       Number of buffers
+ * @param[out] read_amount  Number of bytes read
+ * @param[out] end_of_file  true if the end of file has been reached
+ *
+ * @return FSAL status.
+ */
+
+static fsal_status_t ceph_read_vec(struct fsal_obj_handle *obj_hdl,
+				   bool bypass,
+				   struct state_t *state,
+				   uint64_t offset,
+				   const struct iovec *iov,
+				   int iovcnt,
+				   size_t *read_amount,
+				   bool *end_of_file)
+{
+	struct handle *myself = container_of(obj_hdl, struct handle, handle);
+	Fh *my_fd = NULL;
+	int64_t nb_read;
+	fsal_status_t status;
+	bool has_lock = false;
+	bool need_fsync = false;
+	bool closefd = false;
+
+	/* Get a usable file descriptor */
+	status = ceph_find_fd(&my_fd, obj_hdl, bypass, state, FSAL_O_READ,
+			      &has_lock, &need_fsync, &closefd, false);
+
+	if (FSAL_IS_ERROR(status))
+		goto out;
+
+	nb_read = ceph_ll_readv(myself->export->cmount, my_fd, iov, iovcnt,
+				offset);
+
+	if (nb_read < 0) {
+		status = ceph2fsal_error(nb_read);
+		goto out;
+	}
+
+	*read_amount = nb_read;
+
+	*end_of_file = nb_read == 0;
+
+ out:
+
+	if (closefd)
+		(void) ceph_ll_close(myself->export->cmount, my_fd);
+
+	if (has_lock)
+		PTHREAD_RWLOCK_unlock(&obj_hdl->lock);
+
+	return status;
+}
+
+/**
+ * @brief Write several buffers to consecutive positions in a file
+ *
+ * @param[in]     obj_hdl       File on which to operate
+ * @param[in]     bypass        If state doesn't indicate a share
+ *                              reservation, bypass any deny write
+ * @param[in]     state         state_t to use for this operation
+ * @param[in]     offset        Position at which to write
+ * @param[in]     iov           The buffers
+ * @param[in]     iovcnt        Number of buffers
+ * @param[out]    wrote_amount  Number of bytes written
+ * @param[in,out] fsal_stable   In, if on, the fsal is requested to
+ *                              write data to stable store. Out, the
+ *                              fsal reports what it did.
+ *
+ * @return FSAL status.
+ */
+
+static fsal_status_t ceph_write_vec(struct fsal_obj_handle *obj_hdl,
+				    bool bypass,
+				    struct state_t *state,
+				    uint64_t offset,
+				    const struct iovec *iov,
+				    int iovcnt,
+				    size_t *wrote_amount,
+				    bool *fsal_stable)
+{
+	struct handle *myself = container_of(obj_hdl, struct handle, handle);
+	Fh *my_fd = NULL;
+	int64_t nb_written;
+	fsal_status_t status;
+	int retval = 0;
+	bool has_lock = false;
+	bool need_fsync = false;
+	bool closefd = false;
+	fsal_openflags_t openflags = FSAL_O_WRITE;
+
+	if (*fsal_stable)
+		openflags |= FSAL_O_SYNC;
+
+	/* Get a usable file descriptor */
+	status = ceph_find_fd(&my_fd, obj_hdl, bypass, state, openflags,
+			      &has_lock, &need_fsync, &closefd, false);
+
+	if (FSAL_IS_ERROR(status)) {
+		LogDebug(COMPONENT_FSAL,
+			 "find_fd failed %s", msg_fsal_err(status.major));
+		goto out;
+	}
+
+	fsal_set_credentials(op_ctx->creds);
+
+	nb_written = ceph_ll_writev(myself->export->cmount, my_fd, iov,
+				    iovcnt, offset);
+
+	if (nb_written < 0) {
+		status = ceph2fsal_error(nb_written);
+		goto out;
+	}
+
+	*wrote_amount = nb_written;
+
+	/* attempt stability if we aren't using an O_SYNC fd */
+	if (need_fsync) {
+		retval = ceph_ll_fsync(myself->export->cmount, my_fd, false);
+
+		if (retval < 0)
+			status = ceph2fsal_error(retval);
+	}
+
+ out:
+
+	if (closefd)
+		(void) ceph_ll_close(myself->export->cmount, my_fd);
+
+	if (has_lock)
+		PTHREAD_RWLOCK_unlock(&obj_hdl->lock);
+
+	fsal_restore_ganesha_credentials();
+	return status;
+}
+#endif
+
+#ifdef USE_FSAL_CEPH_LL_FALLOCATE
+/**
+ * @brief Reserve or release storage for a range of a file
+ *
+ * @param[in] obj_hdl   File on which to operate
+ * @param[in] state     state_t to use for this operation
+ * @param[in] offset    Start of the range
+ * @param[in] length    Length of the range
+ * @param[in] allocate  true to allocate, false to punch a hole
+ *
+ * @return FSAL status.
+ */
+
+static fsal_status_t ceph_fallocate(struct fsal_obj_handle *obj_hdl,
+				    struct state_t *state,
+				    uint64_t offset,
+				    uint64_t length,
+				    bool allocate)
+{
+	struct handle *myself = container_of(obj_hdl, struct handle, handle);
+	Fh *my_fd = NULL;
+	fsal_status_t status;
+	bool has_lock = false;
+	bool need_fsync = false;
+	bool closefd = false;
+	int mode = 0;
+	int retval;
+
+	if (!allocate)
+		mode = FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE;
+
+	status = ceph_find_fd(&my_fd, obj_hdl, false, state, FSAL_O_WRITE,
+			      &has_lock, &need_fsync, &closefd, false);
+
+	if (FSAL_IS_ERROR(status)) {
+		LogDebug(COMPONENT_FSAL,
+			 "find_fd failed %s", msg_fsal_err(status.major));
+		goto out;
+	}
+
+	fsal_set_credentials(op_ctx->creds);
+
+	retval = ceph_ll_fallocate(myself->export->cmount, my_fd, mode,
+				   offset, length);
+
+	if (retval < 0)
+		status = ceph2fsal_error(retval);
+
+ out:
+
+	if (closefd)
+		(void) ceph_ll_close(myself->export->cmount, my_fd);
+
+	if (has_lock)
+		PTHREAD_RWLOCK_unlock(&obj_hdl->lock);
+
+	fsal_restore_ganesha_credentials();
+	return status;
+}
+#endif
+
 /**
  * @brief Commit written data
  *
@@ -1688,6 +2274,7 @@ fsal_status_t ceph_commit2(struct fsal_obj_handle *obj_hdl,
 	status = fsal_reopen_obj(obj_hdl, false, false, FSAL_O_WRITE,
 				 (struct fsal_fd *)&myself->fd, &myself->share,
 				 ceph_open_func, ceph_close_func,
+				 sizeof(struct ceph_fd),
 				 (struct fsal_fd **)&out_fd, &has_lock,
 				 &closefd);
 
@@ -1944,7 +2531,8 @@ fsal_status_t ceph_setattr2(struct fsal_obj_handle *obj_hdl,
 		 */
 		status = fsal_find_fd(NULL, obj_hdl, NULL, &myself->share,
 				      bypass, state, FSAL_O_RDWR, NULL, NULL,
-				      &has_lock, &need_fsync, &closefd, false);
+				      0, &has_lock, &need_fsync, &closefd,
+				      false);
 
 		if (FSAL_IS_ERROR(status)) {
 			LogFullDebug(COMPONENT_FSAL,
@@ -2180,6 +2768,20 @@ void handle_ops_init(struct fsal_obj_ops *ops)
 	ops->reopen2 = ceph_reopen2;
 	ops->read2 = ceph_read2;
 	ops->write2 = ceph_write2;
+#ifdef USE_FSAL_CEPH_LL_NONBLOCKING_RW
+	ops->read2_async = ceph_read2_async;
+	ops->write2_async = ceph_write2_async;
+#endif
+#ifdef USE_FSAL_CEPH_LL_LSEEK
+	ops->seek2 = ceph_seek2;
+#endif
+#ifdef USE_FSAL_CEPH_LL_FALLOCATE
+	ops->fallocate = ceph_fallocate;
+#endif
+#ifdef USE_FSAL_CEPH_LL_IOV
+	ops->read_vec = ceph_read_vec;
+	ops->write_vec = ceph_write_vec;
+#endif
 	ops->commit2 = ceph_commit2;
 #ifdef USE_FSAL_CEPH_SETLK
 	ops->lock_op2 = ceph_lock_op2;
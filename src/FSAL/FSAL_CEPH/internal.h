@@ -88,6 +88,10 @@ struct handle {
 	struct export *export;	/*< The first export this handle belongs to */
 	vinodeno_t vi;		/*< The object identifier */
 	struct fsal_share share;
+#ifdef USE_FSAL_CEPH_LL_NONBLOCKING_RW
+	/** Asynchronous I/O in flight on the global fd */
+	uint32_t async_ios;
+#endif
 #ifdef CEPH_PNFS
 	uint64_t rd_issued;
 	uint64_t rd_serial;
@@ -161,6 +165,7 @@ static inline fsal_status_t ceph2fsal_error(const int ceph_errorcode)
 }
 
 void export_ops_init(struct export_ops *ops);
+void ceph_register_callbacks(struct export *export);
 void handle_ops_init(struct fsal_obj_ops *ops);
 #ifdef CEPH_PNFS
 void pnfs_ds_ops_init(struct fsal_pnfs_ds_ops *ops);
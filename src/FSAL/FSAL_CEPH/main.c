@@ -278,6 +278,9 @@ static fsal_status_t create_export(struct fsal_module *module_in,
 		goto error;
 	}
 
+	/* Only now are there upcalls to drive */
+	ceph_register_callbacks(export);
+
 	return status;
 
  error:
@@ -0,0 +1,132 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file   up.c
+ *
+ * @brief Cache invalidation upcalls for Ceph
+ *
+ * libcephfs calls back when the MDS revokes the caps behind what the
+ * client cached about an inode or a dentry.  The same is then stale in
+ * MDCACHE, so the callbacks are turned into invalidation upcalls.  They
+ * run on a libcephfs thread, so the work is queued by invalidate_close
+ * and done on the general fridge.
+ */
+
+#include "config.h"
+
+#include "fsal.h"
+#include "fsal_up.h"
+#include "internal.h"
+
+#ifdef USE_FSAL_CEPH_LL_REGISTER_CALLBACKS
+
+static void ceph_invalidate(struct export *export, vinodeno_t vi,
+			    uint32_t flags)
+{
+	const struct fsal_up_vector *up_ops = export->export.up_ops;
+	struct gsh_buffdesc key = {
+		.addr = &vi,
+		.len = sizeof(vi)
+	};
+	fsal_status_t status;
+
+	status = up_ops->invalidate_close(up_ops->up_export, &key, flags);
+
+	if (FSAL_IS_ERROR(status) && status.major != ERR_FSAL_NOENT)
+		LogWarn(COMPONENT_FSAL_UP,
+			"Invalidate of inode %"PRIx64" failed: %s",
+			vi.ino.val, msg_fsal_err(status.major));
+}
+
+/**
+ * @brief The cached data or attributes of an inode went stale
+ *
+ * @param[in] handle  The export
+ * @param[in] vi      The inode
+ * @param[in] off     Start of the stale range
+ * @param[in] len     Length of the stale range, 0 for all of it
+ */
+
+static void ceph_ino_cb(void *handle, vinodeno_t vi, int64_t off,
+			int64_t len)
+{
+	LogFullDebug(COMPONENT_FSAL_UP,
+		     "Invalidate inode %"PRIx64" %"PRId64"~%"PRId64,
+		     vi.ino.val, off, len);
+
+	ceph_invalidate(handle, vi, FSAL_UP_INVALIDATE_CACHE);
+}
+
+/**
+ * @brief A dentry went stale
+ *
+ * The directory's entries must be read again, and the inode the dentry
+ * named may have been unlinked or renamed.
+ *
+ * @param[in] handle  The export
+ * @param[in] dirino  The directory
+ * @param[in] ino     The inode the dentry named
+ * @param[in] name    The name of the dentry
+ * @param[in] len     Length of the name
+ */
+
+static void ceph_dentry_cb(void *handle, vinodeno_t dirino, vinodeno_t ino,
+			   const char *name, size_t len)
+{
+	LogFullDebug(COMPONENT_FSAL_UP,
+		     "Invalidate dentry %.*s in %"PRIx64,
+		     (int)len, name, dirino.ino.val);
+
+	ceph_invalidate(handle, dirino,
+			FSAL_UP_INVALIDATE_ATTRS |
+			FSAL_UP_INVALIDATE_CONTENT |
+			FSAL_UP_INVALIDATE_DIR_POPULATED);
+	ceph_invalidate(handle, ino, FSAL_UP_INVALIDATE_ATTRS);
+}
+
+/**
+ * @brief Have libcephfs tell the export what went stale
+ *
+ * Called once MDCACHE is stacked on the export, as the upcalls need
+ * its vector.  ceph_shutdown() ends the callbacks.
+ *
+ * @param[in] export  The export
+ */
+
+void ceph_register_callbacks(struct export *export)
+{
+	struct ceph_client_callback_args args = {
+		.handle = export,
+		.ino_cb = ceph_ino_cb,
+		.dentry_cb = ceph_dentry_cb,
+	};
+
+	ceph_ll_register_callbacks(export->cmount, &args);
+}
+
+#else				/* USE_FSAL_CEPH_LL_REGISTER_CALLBACKS */
+
+void ceph_register_callbacks(struct export *export)
+{
+	LogDebug(COMPONENT_FSAL,
+		 "libcephfs has no invalidation callbacks, attributes are only cached for Attr_Expiration_Time");
+}
+
+#endif				/* USE_FSAL_CEPH_LL_REGISTER_CALLBACKS */
@@ -70,6 +70,10 @@ static void export_release(struct fsal_export *exp_hdl)
 
 	atomic_add_int8_t (&glfs_export->destroy_mode, 1);
 
+	PTHREAD_MUTEX_lock(&glfs_export->up_lock);
+	pthread_cond_signal(&glfs_export->up_cond);
+	PTHREAD_MUTEX_unlock(&glfs_export->up_lock);
+
 	/* Wait for up_thread to exit */
 	err = pthread_join(glfs_export->up_thread, (void **)&retval);
 
@@ -87,6 +91,9 @@ static void export_release(struct fsal_export *exp_hdl)
 	/* Gluster and memory cleanup */
 	glfs_fini(glfs_export->gl_fs);
 	glfs_export->gl_fs = NULL;
+	gsh_free(glfs_export->up_batch.keys);
+	PTHREAD_COND_destroy(&glfs_export->up_cond);
+	PTHREAD_MUTEX_destroy(&glfs_export->up_lock);
 	gsh_free(glfs_export->export_path);
 	glfs_export->export_path = NULL;
 	gsh_free(glfs_export);
@@ -698,6 +705,8 @@ fsal_status_t glusterfs_create_export(struct fsal_module *fsal_hdl,
 	glfsexport->acl_enable =
 		!op_ctx_export_has_option(EXPORT_OPTION_DISABLE_ACL);
 	glfsexport->destroy_mode = 0;
+	PTHREAD_MUTEX_init(&glfsexport->up_lock, NULL);
+	PTHREAD_COND_init(&glfsexport->up_cond, NULL);
 
 	op_ctx->fsal_export = &glfsexport->export;
 
@@ -37,24 +37,30 @@
 #include <utime.h>
 #include <sys/time.h>
 
-int upcall_inode_invalidate(struct glusterfs_export *glfsexport,
-			     struct glfs_object *object)
+/**
+ * @brief Gather the invalidation of an object into a batch
+ *
+ * A handle already in the batch is not added again, so a file changed
+ * over and over between two batches is invalidated once.
+ *
+ * @param[in]     glfsexport  Export the upcall is for
+ * @param[in,out] batch       The batch
+ * @param[in]     object      Object to invalidate, may be NULL
+ */
+
+static void up_batch_add(struct glusterfs_export *glfsexport,
+			 struct gluster_up_batch *batch,
+			 struct glfs_object *object)
 {
-	int	     rc                             = -1;
-	glfs_t          *fs                         = NULL;
-	char            vol_uuid[GLAPI_UUID_LENGTH] = {'\0'};
-	unsigned char   globjhdl[GLAPI_HANDLE_LENGTH];
-	struct gsh_buffdesc         key;
-	const struct fsal_up_vector *event_func;
-	fsal_status_t fsal_status = {0, 0};
+	glfs_t *fs = glfsexport->gl_fs;
+	unsigned char globjhdl[GLAPI_HANDLE_LENGTH];
+	unsigned int i;
+	int rc;
 
-	fs = glfsexport->gl_fs;
-	if (!fs) {
-		LogCrit(COMPONENT_FSAL_UP,
-			"Invalid fs object of the glfsexport(%p)",
-			 glfsexport);
-		goto out;
-	}
+	if (object == NULL)
+		return;
+
+	batch->events++;
 
 	rc = glfs_h_extract_handle(object, globjhdl+GLAPI_UUID_LENGTH,
 				   GFAPI_HANDLE_LENGTH);
@@ -62,43 +68,164 @@ int upcall_inode_invalidate(struct glusterfs_export *glfsexport,
 		LogDebug(COMPONENT_FSAL_UP,
 			 "glfs_h_extract_handle failed %p",
 			 fs);
-		goto out;
+		return;
 	}
 
-	rc = glfs_get_volumeid(fs, vol_uuid,
-			       GLAPI_UUID_LENGTH);
+	rc = glfs_get_volumeid(fs, (char *)globjhdl, GLAPI_UUID_LENGTH);
 	if (rc < 0) {
 		LogDebug(COMPONENT_FSAL_UP,
 			 "glfs_get_volumeid failed %p",
 			 fs);
-		goto out;
+		return;
+	}
+
+	for (i = 0; i < batch->count; i++) {
+		if (memcmp(batch->keys[i], globjhdl, GLAPI_HANDLE_LENGTH) == 0)
+			return;
 	}
 
-	memcpy(globjhdl, vol_uuid, GLAPI_UUID_LENGTH);
-	key.addr = &globjhdl;
-	key.len = GLAPI_HANDLE_LENGTH;
+	if (batch->count == batch->size) {
+		batch->size = batch->size ? batch->size * 2 : GLUSTER_UP_BATCH;
+		batch->keys = gsh_realloc(batch->keys,
+					  batch->size * sizeof(*batch->keys));
+	}
 
-	LogDebug(COMPONENT_FSAL_UP, "Received event to process for %p",
-		 fs);
+	memcpy(batch->keys[batch->count++], globjhdl, GLAPI_HANDLE_LENGTH);
+}
 
-	event_func = glfsexport->export.up_ops;
+/**
+ * @brief Pass the invalidations of a batch up and empty it
+ *
+ * @param[in]     glfsexport  Export the upcalls are for
+ * @param[in,out] batch       The batch
+ */
 
-	fsal_status = event_func->invalidate_close(
-					event_func->up_export,
-					&key,
-					FSAL_UP_INVALIDATE_CACHE);
+static void up_batch_flush(struct glusterfs_export *glfsexport,
+			   struct gluster_up_batch *batch)
+{
+	const struct fsal_up_vector *event_func = glfsexport->export.up_ops;
+	struct gsh_buffdesc key;
+	fsal_status_t fsal_status;
+	unsigned int i;
 
-	rc = fsal_status.major;
-	if (FSAL_IS_ERROR(fsal_status) && fsal_status.major != ERR_FSAL_NOENT) {
-		LogWarn(COMPONENT_FSAL_UP,
-			"Inode_Invalidate event could not be processed for fd %p, rc %d",
-			glfsexport->gl_fs, rc);
+	LogFullDebug(COMPONENT_FSAL_UP,
+		     "Processing %u events for %p as %u invalidates",
+		     batch->events, glfsexport->gl_fs, batch->count);
+
+	for (i = 0; i < batch->count; i++) {
+		key.addr = batch->keys[i];
+		key.len = GLAPI_HANDLE_LENGTH;
+
+		fsal_status = event_func->invalidate_close(
+						event_func->up_export,
+						&key,
+						FSAL_UP_INVALIDATE_CACHE);
+
+		if (FSAL_IS_ERROR(fsal_status) &&
+		    fsal_status.major != ERR_FSAL_NOENT) {
+			LogWarn(COMPONENT_FSAL_UP,
+				"Inode_Invalidate event could not be processed for fd %p, rc %d",
+				glfsexport->gl_fs, fsal_status.major);
+		}
 	}
 
-out:
-	glfs_h_close(object);
-	return rc;
+	batch->count = 0;
+	batch->events = 0;
+}
+
+#ifdef USE_GLUSTER_UPCALL_REGISTER
+/**
+ * @brief Receive an upcall from gfapi
+ *
+ * This runs on a gfapi thread, so the objects are only gathered into
+ * the export's batch for the upcall thread to pass up.
+ *
+ * @param[in] up_arg  The upcall, freed here
+ * @param[in] data    The export
+ */
+
+static void up_register_cbk(struct glfs_upcall *up_arg, void *data)
+{
+	struct glusterfs_export *glfsexport = data;
+	struct glfs_upcall_inode *in_arg;
+	int reason = glfs_upcall_get_reason(up_arg);
+
+	if (reason != GLFS_UPCALL_INODE_INVALIDATE) {
+		LogWarn(COMPONENT_FSAL_UP, "Unknown event: %d", reason);
+		glfs_free(up_arg);
+		return;
+	}
+
+	in_arg = glfs_upcall_get_event(up_arg);
+
+	PTHREAD_MUTEX_lock(&glfsexport->up_lock);
+
+	up_batch_add(glfsexport, &glfsexport->up_batch,
+		     glfs_upcall_inode_get_object(in_arg));
+	up_batch_add(glfsexport, &glfsexport->up_batch,
+		     glfs_upcall_inode_get_pobject(in_arg));
+	up_batch_add(glfsexport, &glfsexport->up_batch,
+		     glfs_upcall_inode_get_oldpobject(in_arg));
+
+	pthread_cond_signal(&glfsexport->up_cond);
+	PTHREAD_MUTEX_unlock(&glfsexport->up_lock);
+
+	/* Closes the objects */
+	glfs_free(up_arg);
+}
+
+/**
+ * @brief Pass up the upcalls gfapi delivers to up_register_cbk
+ *
+ * Whatever arrived while a batch was passed up makes the next batch.
+ *
+ * @param[in] glfsexport  The export
+ *
+ * @retval true once the export is destroyed.
+ * @retval false if gfapi cannot deliver upcalls this way.
+ */
+
+static bool up_register_loop(struct glusterfs_export *glfsexport)
+{
+	struct gluster_up_batch batch = {0}, swap;
+	int rc;
+
+	rc = glfs_upcall_register(glfsexport->gl_fs,
+				  GLFS_EVENT_INODE_INVALIDATE,
+				  up_register_cbk, glfsexport);
+	if (rc != GLFS_EVENT_INODE_INVALIDATE) {
+		LogDebug(COMPONENT_FSAL_UP,
+			 "Upcall registration failed for %p, polling instead",
+			 glfsexport->gl_fs);
+		return false;
+	}
+
+	PTHREAD_MUTEX_lock(&glfsexport->up_lock);
+
+	while (!atomic_fetch_int8_t(&glfsexport->destroy_mode)) {
+		if (glfsexport->up_batch.count == 0) {
+			pthread_cond_wait(&glfsexport->up_cond,
+					  &glfsexport->up_lock);
+			continue;
+		}
+
+		swap = glfsexport->up_batch;
+		glfsexport->up_batch = batch;
+		batch = swap;
+
+		PTHREAD_MUTEX_unlock(&glfsexport->up_lock);
+		up_batch_flush(glfsexport, &batch);
+		PTHREAD_MUTEX_lock(&glfsexport->up_lock);
+	}
+
+	PTHREAD_MUTEX_unlock(&glfsexport->up_lock);
+
+	glfs_upcall_unregister(glfsexport->gl_fs, GLFS_EVENT_INODE_INVALIDATE);
+	gsh_free(batch.keys);
+
+	return true;
 }
+#endif				/* USE_GLUSTER_UPCALL_REGISTER */
 
 void *GLUSTERFSAL_UP_Thread(void *Arg)
 {
@@ -108,6 +235,7 @@ void *GLUSTERFSAL_UP_Thread(void *Arg)
 	int                         rc                          = 0;
 	struct callback_arg         callback;
 	struct callback_inode_arg   *cbk_inode_arg              = NULL;
+	struct gluster_up_batch     batch                       = {0};
 	int                         reason                      = 0;
 	int                         retry                       = 0;
 	int                         errsv                       = 0;
@@ -138,10 +266,17 @@ void *GLUSTERFSAL_UP_Thread(void *Arg)
 		goto out;
 	}
 
+#ifdef USE_GLUSTER_UPCALL_REGISTER
+	if (up_register_loop(glfsexport))
+		goto out;
+#endif
+
 	callback.fs = glfsexport->gl_fs;
 
-	/* Start querying for events and processing. */
-	/** @todo : Do batch processing instead */
+	/* Start querying for events and processing.  Events are drained
+	 * into a batch without waiting, the batch is passed up once no
+	 * more are queued or it is full.
+	 */
 	while (!atomic_fetch_int8_t(&glfsexport->destroy_mode)) {
 		LogFullDebug(COMPONENT_FSAL_UP,
 			     "Requesting event from FSAL Callback interface for %p.",
@@ -154,6 +289,10 @@ void *GLUSTERFSAL_UP_Thread(void *Arg)
 		reason = callback.reason;
 
 		if (rc != 0) {
+			/* Don't sit on what was already gathered */
+			if (batch.count != 0)
+				up_batch_flush(glfsexport, &batch);
+
 			/* if ENOMEM retry for couple of times
 			 * and then exit
 			 */
@@ -180,6 +319,7 @@ void *GLUSTERFSAL_UP_Thread(void *Arg)
 						glfsexport->gl_fs, rc, errsv,
 						strerror(errsv), reason);
 				}
+				gsh_free(batch.keys);
 				return NULL;
 			}
 		}
@@ -194,6 +334,11 @@ void *GLUSTERFSAL_UP_Thread(void *Arg)
 		 * inode update / invalidate? */
 		switch (reason) {
 		case GFAPI_CBK_EVENT_NULL:
+			/* Drained, pass up what was gathered */
+			if (batch.count != 0) {
+				up_batch_flush(glfsexport, &batch);
+				continue;
+			}
 			usleep(10);
 			continue;
 		case GFAPI_INODE_INVALIDATE:
@@ -207,15 +352,19 @@ void *GLUSTERFSAL_UP_Thread(void *Arg)
 				break;
 			}
 
+			up_batch_add(glfsexport, &batch,
+				     cbk_inode_arg->object);
+			up_batch_add(glfsexport, &batch,
+				     cbk_inode_arg->p_object);
+			up_batch_add(glfsexport, &batch,
+				     cbk_inode_arg->oldp_object);
+
 			if (cbk_inode_arg->object)
-				upcall_inode_invalidate(glfsexport,
-							cbk_inode_arg->object);
+				glfs_h_close(cbk_inode_arg->object);
 			if (cbk_inode_arg->p_object)
-				upcall_inode_invalidate(glfsexport,
-						  cbk_inode_arg->p_object);
+				glfs_h_close(cbk_inode_arg->p_object);
 			if (cbk_inode_arg->oldp_object)
-				upcall_inode_invalidate(glfsexport,
-						  cbk_inode_arg->oldp_object);
+				glfs_h_close(cbk_inode_arg->oldp_object);
 			break;
 		default:
 			LogWarn(COMPONENT_FSAL_UP, "Unknown event: %d", reason);
@@ -226,8 +375,12 @@ void *GLUSTERFSAL_UP_Thread(void *Arg)
 			cbk_inode_arg = NULL;
 		}
 		callback.event_arg = NULL;
+
+		if (batch.count >= GLUSTER_UP_BATCH)
+			up_batch_flush(glfsexport, &batch);
 	}
 
 out:
+	gsh_free(batch.keys);
 	return NULL;
 }				/* GLUSTERFSFSAL_UP_Thread */
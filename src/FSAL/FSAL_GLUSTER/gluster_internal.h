@@ -130,6 +130,21 @@ struct glusterfs_fsal_module {
 	struct fsal_module fsal;
 };
 
+/* Upcalls passed up at once when polling */
+#define GLUSTER_UP_BATCH 64
+
+/**
+ * @brief Invalidations gathered from upcalls
+ */
+struct gluster_up_batch {
+	unsigned int count;
+	unsigned int size;
+	/** Handles to invalidate, each once */
+	unsigned char (*keys)[GLAPI_HANDLE_LENGTH];
+	/** Objects named by the upcalls gathered */
+	unsigned int events;
+};
+
 struct glusterfs_export {
 	glfs_t *gl_fs;
 	char *mount_path;
@@ -142,6 +157,10 @@ struct glusterfs_export {
 	bool pnfs_mds_enabled;
 	int8_t destroy_mode;
 	pthread_t up_thread; /* upcall thread */
+	/* Upcalls delivered by gfapi, waiting for up_thread */
+	pthread_mutex_t up_lock;
+	pthread_cond_t up_cond;
+	struct gluster_up_batch up_batch;
 };
 
 struct glusterfs_fd {
@@ -162,6 +181,7 @@ struct glusterfs_handle {
 	struct fsal_obj_handle handle;	/* public FSAL handle */
 	struct attrlist attributes; /* Attributes of this Object. */
 	struct fsal_share share; /* share_reservations */
+	uint32_t async_ios; /* asynchronous I/Os on globalfd */
 
 	/* following added for pNFS support */
 	uint64_t rd_issued;
@@ -277,7 +297,5 @@ nfsstat4 getdeviceinfo(struct fsal_module *fsal_hdl,
 /* UP thread routines */
 void *GLUSTERFSAL_UP_Thread(void *Arg);
 int initiate_up_thread(struct glusterfs_export *glfsexport);
-int upcall_inode_invalidate(struct glusterfs_export *glfsexport,
-			    struct glfs_object *object);
 
 #endif				/* GLUSTER_INTERNAL */
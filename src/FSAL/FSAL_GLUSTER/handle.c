@@ -1212,6 +1212,39 @@ fsal_status_t glusterfs_close_my_fd(struct glusterfs_fd *my_fd)
 	return status;
 }
 
+/* Signalled when the last asynchronous I/O on a globalfd completes */
+static pthread_mutex_t glusterfs_async_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t glusterfs_async_cv = PTHREAD_COND_INITIALIZER;
+
+/**
+ * @brief Wait for the asynchronous I/O on a globalfd to complete
+ *
+ * Called with the object lock held for write, so no new one starts.
+ *
+ * @param[in] myself  The file
+ */
+
+static void glusterfs_async_wait(struct glusterfs_handle *myself)
+{
+	if (atomic_fetch_uint32_t(&myself->async_ios) == 0)
+		return;
+
+	PTHREAD_MUTEX_lock(&glusterfs_async_mtx);
+	while (atomic_fetch_uint32_t(&myself->async_ios) != 0)
+		pthread_cond_wait(&glusterfs_async_cv, &glusterfs_async_mtx);
+	PTHREAD_MUTEX_unlock(&glusterfs_async_mtx);
+}
+
+static void glusterfs_async_put(struct glusterfs_handle *myself)
+{
+	if (atomic_dec_uint32_t(&myself->async_ios) != 0)
+		return;
+
+	PTHREAD_MUTEX_lock(&glusterfs_async_mtx);
+	pthread_cond_broadcast(&glusterfs_async_cv);
+	PTHREAD_MUTEX_unlock(&glusterfs_async_mtx);
+}
+
 /**
  * @brief Implements GLUSTER FSAL objectoperation close
    @todo: close2() could be used to close globalfd as well.
@@ -1235,7 +1268,9 @@ static fsal_status_t file_close(struct fsal_obj_handle *obj_hdl)
 	 */
 	PTHREAD_RWLOCK_wrlock(&obj_hdl->lock);
 
+	glusterfs_async_wait(objhandle);
 	status = glusterfs_close_my_fd(&objhandle->globalfd);
+	fsal_fd_cache_close(obj_hdl);
 
 	PTHREAD_RWLOCK_unlock(&obj_hdl->lock);
 
@@ -1283,6 +1318,9 @@ fsal_status_t glusterfs_open_func(struct fsal_obj_handle *obj_hdl,
 fsal_status_t glusterfs_close_func(struct fsal_obj_handle *obj_hdl,
 				   struct fsal_fd *fd)
 {
+	glusterfs_async_wait(container_of(obj_hdl, struct glusterfs_handle,
+					  handle));
+
 	return glusterfs_close_my_fd((struct glusterfs_fd *)fd);
 }
 
@@ -1322,6 +1360,7 @@ fsal_status_t find_fd(struct glusterfs_fd *my_fd,
 				      &myself->share, bypass, state,
 				      openflags, glusterfs_open_func,
 				      glusterfs_close_func,
+				      sizeof(struct glusterfs_fd),
 				      has_lock, need_fsync,
 				      closefd, open_for_locks);
 
@@ -2001,6 +2040,66 @@ static fsal_status_t glusterfs_reopen2(struct fsal_obj_handle *obj_hdl,
 	return status;
 }
 
+/* read_plus_fd
+ * Report the hole at an offset, up to the next data, or read data up to
+ * the next hole.  A volume that cannot seek data reads as if it had no
+ * holes.
+ */
+
+static fsal_status_t glusterfs_read_plus_fd(struct glfs_fd *glfd,
+					    uint64_t offset,
+					    size_t buffer_size, void *buffer,
+					    size_t *read_amount,
+					    bool *end_of_file,
+					    struct io_info *info)
+{
+	off_t data, hole, size = -1;
+	uint64_t length;
+	ssize_t nb_read;
+	int retval;
+
+	data = glfs_lseek(glfd, offset, SEEK_DATA);
+	if (data == -1 && errno == ENXIO) {
+		/* No data from offset on */
+		size = glfs_lseek(glfd, 0, SEEK_END);
+		if (size == -1) {
+			retval = errno;
+			return fsalstat(posix2fsal_error(retval), retval);
+		}
+		data = size;
+	}
+
+	if (data > (off_t) offset) {
+		length = data - offset;
+		if (length > buffer_size)
+			length = buffer_size;
+
+		io_info_hole(info, offset, length);
+		*read_amount = 0;
+		*end_of_file = size != -1 && offset + length >= (uint64_t) size;
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+	}
+
+	if (data != -1) {
+		hole = glfs_lseek(glfd, offset, SEEK_HOLE);
+		if (hole > (off_t) offset &&
+		    (uint64_t) (hole - offset) < buffer_size)
+			buffer_size = hole - offset;
+	}
+
+	nb_read = glfs_pread(glfd, buffer, buffer_size, offset, 0);
+	if (nb_read == -1) {
+		retval = errno;
+		return fsalstat(posix2fsal_error(retval), retval);
+	}
+
+	io_info_data(info, offset, buffer, nb_read);
+	*read_amount = nb_read;
+	*end_of_file = nb_read < buffer_size;
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
 /* read2
  */
 
@@ -2021,11 +2120,6 @@ static fsal_status_t glusterfs_read2(struct fsal_obj_handle *obj_hdl,
 	bool need_fsync = false;
 	bool closefd = false;
 
-	if (info != NULL) {
-		/* Currently we don't support READ_PLUS */
-		return fsalstat(ERR_FSAL_NOTSUPP, 0);
-	}
-
 #if 0
 	/** @todo: fsid work */
 	if (obj_hdl->fsal != obj_hdl->fs->fsal) {
@@ -2043,6 +2137,14 @@ static fsal_status_t glusterfs_read2(struct fsal_obj_handle *obj_hdl,
 	if (FSAL_IS_ERROR(status))
 		goto out;
 
+	if (info != NULL) {
+		status = glusterfs_read_plus_fd(my_fd.glfd, seek_descriptor,
+						buffer_size, buffer,
+						read_amount, end_of_file,
+						info);
+		goto out;
+	}
+
 	nb_read = glfs_pread(my_fd.glfd, buffer, buffer_size,
 			     seek_descriptor, 0);
 
@@ -2056,21 +2158,6 @@ static fsal_status_t glusterfs_read2(struct fsal_obj_handle *obj_hdl,
 
 	if (nb_read < buffer_size)
 		*end_of_file = true;
-#if 0
-	/** @todo
-	 *
-	 * Is this all we really need to do to support READ_PLUS? Will anyone
-	 * ever get upset that we don't return holes, even for blocks of all
-	 * zeroes?
-	 *
-	 */
-	if (info != NULL) {
-		info->io_content.what = NFS4_CONTENT_DATA;
-		info->io_content.data.d_offset = offset + nb_read;
-		info->io_content.data.d_data.data_len = nb_read;
-		info->io_content.data.d_data.data_val = buffer;
-	}
-#endif
 
  out:
 
@@ -2171,6 +2258,529 @@ static fsal_status_t glusterfs_write2(struct fsal_obj_handle *obj_hdl,
 	return status;
 }
 
+/**
+ * @brief An asynchronous read or write handed to gfapi
+ */
+struct glusterfs_async_io {
+	struct fsal_obj_handle *obj_hdl;
+	struct fsal_io_arg *io_arg;
+	fsal_async_cb done_cb;
+	void *caller_arg;
+	bool write;
+	/** The I/O is on the globalfd, and counted in async_ios */
+	bool global_fd;
+};
+
+/**
+ * @brief Complete an asynchronous read or write
+ *
+ * Called on a gfapi thread.
+ */
+
+static void glusterfs_async_done(struct glfs_fd *glfd, ssize_t ret,
+				 void *data)
+{
+	struct glusterfs_async_io *gio = data;
+	struct fsal_io_arg *io_arg = gio->io_arg;
+	fsal_status_t status = fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+	if (ret < 0) {
+		/* gfapi passes the error back as -errno */
+		status = fsalstat(posix2fsal_error(-ret), -ret);
+	} else {
+		io_arg->io_amount = ret;
+		if (!gio->write)
+			io_arg->end_of_file = ret < io_arg->size;
+	}
+
+	if (gio->global_fd)
+		glusterfs_async_put(container_of(gio->obj_hdl,
+						 struct glusterfs_handle,
+						 handle));
+
+	gio->done_cb(gio->obj_hdl, status, io_arg, gio->caller_arg);
+	gsh_free(gio);
+}
+
+/**
+ * @brief Start a read or write through gfapi without waiting
+ *
+ * The globalfd is only held through the object lock, which can't be
+ * released on another thread; the I/O is counted on the handle
+ * instead, and closing the globalfd waits for it.  An fd opened for
+ * this I/O alone would have to be closed from the completion, so the
+ * I/O is then made synchronously.
+ *
+ * @return true if the I/O was started, and done_cb will be called.
+ */
+
+static bool glusterfs_async_start(struct fsal_obj_handle *obj_hdl,
+				  bool bypass, struct fsal_io_arg *io_arg,
+				  bool write, fsal_async_cb done_cb,
+				  void *caller_arg)
+{
+	struct glusterfs_handle *myself =
+		container_of(obj_hdl, struct glusterfs_handle, handle);
+	struct glusterfs_export *glfs_export =
+	     container_of(op_ctx->fsal_export, struct glusterfs_export, export);
+	struct glusterfs_async_io *gio;
+	struct glusterfs_fd my_fd = {0};
+	fsal_status_t status;
+	bool has_lock = false;
+	bool need_fsync = false;
+	bool closefd = false;
+	int retval;
+
+	if (io_arg->info != NULL)
+		return false;
+
+	status = find_fd(&my_fd, obj_hdl, bypass, io_arg->state,
+			 write ? FSAL_O_WRITE : FSAL_O_READ,
+			 &has_lock, &need_fsync, &closefd, false);
+
+	if (FSAL_IS_ERROR(status)) {
+		done_cb(obj_hdl, status, io_arg, caller_arg);
+		return true;
+	}
+
+	if (closefd) {
+		glusterfs_close_my_fd(&my_fd);
+		if (has_lock)
+			PTHREAD_RWLOCK_unlock(&obj_hdl->lock);
+		return false;
+	}
+
+	gio = gsh_malloc(sizeof(*gio));
+	gio->obj_hdl = obj_hdl;
+	gio->io_arg = io_arg;
+	gio->done_cb = done_cb;
+	gio->caller_arg = caller_arg;
+	gio->write = write;
+	gio->global_fd = has_lock;
+
+	if (has_lock) {
+		(void) atomic_inc_uint32_t(&myself->async_ios);
+		PTHREAD_RWLOCK_unlock(&obj_hdl->lock);
+	}
+
+	if (!write) {
+		retval = glfs_pread_async(my_fd.glfd, io_arg->buffer,
+					  io_arg->size, io_arg->offset, 0,
+					  glusterfs_async_done, gio);
+		goto started;
+	}
+
+	retval = setglustercreds(glfs_export, &op_ctx->creds->caller_uid,
+			&op_ctx->creds->caller_gid,
+			op_ctx->creds->caller_glen,
+			op_ctx->creds->caller_garray);
+	if (retval != 0) {
+		LogFatal(COMPONENT_FSAL, "Could not set Ganesha credentials");
+		errno = EPERM;
+		goto started;
+	}
+
+	retval = glfs_pwrite_async(my_fd.glfd, io_arg->buffer, io_arg->size,
+				   io_arg->offset,
+				   io_arg->fsal_stable ? O_SYNC : 0,
+				   glusterfs_async_done, gio);
+
+	/* restore credentials */
+	if (setglustercreds(glfs_export, NULL, NULL, 0, NULL) != 0)
+		LogFatal(COMPONENT_FSAL, "Could not set Ganesha credentials");
+
+ started:
+	if (retval != 0) {
+		/* Not started, the callback won't be called */
+		retval = errno;
+		if (gio->global_fd)
+			glusterfs_async_put(myself);
+		gsh_free(gio);
+		done_cb(obj_hdl, fsalstat(posix2fsal_error(retval), retval),
+			io_arg, caller_arg);
+	}
+
+	return true;
+}
+
+/* read2_async
+ */
+
+static void glusterfs_read2_async(struct fsal_obj_handle *obj_hdl,
+				  bool bypass,
+				  struct fsal_io_arg *read_arg,
+				  fsal_async_cb done_cb,
+				  void *caller_arg)
+{
+	fsal_status_t status;
+
+	if (glusterfs_async_start(obj_hdl, bypass, read_arg, false, done_cb,
+				  caller_arg))
+		return;
+
+	status = glusterfs_read2(obj_hdl, bypass, read_arg->state,
+				 read_arg->offset, read_arg->size,
+				 read_arg->buffer, &read_arg->io_amount,
+				 &read_arg->end_of_file, read_arg->info);
+
+	done_cb(obj_hdl, status, read_arg, caller_arg);
+}
+
+/* write2_async
+ */
+
+static void glusterfs_write2_async(struct fsal_obj_handle *obj_hdl,
+				   bool bypass,
+				   struct fsal_io_arg *write_arg,
+				   fsal_async_cb done_cb,
+				   void *caller_arg)
+{
+	fsal_status_t status;
+
+	if (glusterfs_async_start(obj_hdl, bypass, write_arg, true, done_cb,
+				  caller_arg))
+		return;
+
+	status = glusterfs_write2(obj_hdl, bypass, write_arg->state,
+				  write_arg->offset, write_arg->size,
+				  write_arg->buffer, &write_arg->io_amount,
+				  &write_arg->fsal_stable, write_arg->info);
+
+	done_cb(obj_hdl, status, write_arg, caller_arg);
+}
+
+/* seek2
+ */
+
+static fsal_status_t glusterfs_seek2(struct fsal_obj_handle *obj_hdl,
+				     struct state_t *state,
+				     struct io_info *info)
+{
+	off_t offset = info->io_content.hole.di_offset;
+	struct glusterfs_fd my_fd = {0};
+	fsal_status_t status;
+	bool has_lock = false;
+	bool need_fsync = false;
+	bool closefd = false;
+	off_t found, size;
+	int whence;
+	int retval;
+
+	switch (info->io_content.what) {
+	case NFS4_CONTENT_DATA:
+		whence = SEEK_DATA;
+		break;
+	case NFS4_CONTENT_HOLE:
+		whence = SEEK_HOLE;
+		break;
+	default:
+		return fsalstat(ERR_FSAL_UNION_NOTSUPP, 0);
+	}
+
+	status = find_fd(&my_fd, obj_hdl, false, state, FSAL_O_READ,
+			 &has_lock, &need_fsync, &closefd, false);
+
+	if (FSAL_IS_ERROR(status))
+		goto out;
+
+	size = glfs_lseek(my_fd.glfd, 0, SEEK_END);
+	if (size == -1 || offset >= size) {
+		retval = size == -1 ? errno : ENXIO;
+		status = fsalstat(posix2fsal_error(retval), retval);
+		goto out;
+	}
+
+	found = glfs_lseek(my_fd.glfd, offset, whence);
+	if (found == -1 && errno == ENXIO) {
+		/* No data after offset */
+		found = size;
+	} else if (found == -1) {
+		retval = errno;
+		status = fsalstat(posix2fsal_error(retval), retval);
+		goto out;
+	}
+
+	info->io_eof = found >= size;
+	info->io_content.hole.di_offset = found;
+
+ out:
+
+	if (closefd)
+		glusterfs_close_my_fd(&my_fd);
+
+	if (has_lock)
+		PTHREAD_RWLOCK_unlock(&obj_hdl->lock);
+
+	return status;
+}
+
+#ifdef USE_GLUSTER_COPY_FILE_RANGE
+/* copy
+ */
+
+static fsal_status_t glusterfs_copy(struct fsal_obj_handle *src_hdl,
+				    struct state_t *src_state,
+				    uint64_t src_offset,
+				    struct fsal_obj_handle *dst_hdl,
+				    struct state_t *dst_state,
+				    uint64_t dst_offset,
+				    uint64_t count,
+				    uint64_t *copied)
+{
+	struct glusterfs_fd src_fd = {0}, dst_fd = {0};
+	bool src_lock = false, dst_lock = false;
+	bool src_close = false, dst_close = false;
+	bool need_fsync = false;
+	off64_t in = src_offset, out = dst_offset;
+	fsal_status_t status;
+	ssize_t nb;
+	int retval = 0;
+	struct glusterfs_export *glfs_export =
+	     container_of(op_ctx->fsal_export, struct glusterfs_export, export);
+
+	*copied = 0;
+
+	status = find_fd(&src_fd, src_hdl, false, src_state, FSAL_O_READ,
+			 &src_lock, &need_fsync, &src_close, false);
+
+	if (FSAL_IS_ERROR(status))
+		goto out;
+
+	status = find_fd(&dst_fd, dst_hdl, false, dst_state, FSAL_O_WRITE,
+			 &dst_lock, &need_fsync, &dst_close, false);
+
+	if (FSAL_IS_ERROR(status))
+		goto out;
+
+	retval = setglustercreds(glfs_export, &op_ctx->creds->caller_uid,
+			&op_ctx->creds->caller_gid,
+			op_ctx->creds->caller_glen,
+			op_ctx->creds->caller_garray);
+	if (retval != 0) {
+		status = gluster2fsal_error(EPERM);
+		LogFatal(COMPONENT_FSAL, "Could not set Ganesha credentials");
+		goto out;
+	}
+
+	/* The bricks copy between themselves, the data do not come
+	 * through here.
+	 */
+	nb = glfs_copy_file_range(src_fd.glfd, &in, dst_fd.glfd, &out,
+				  count, 0, NULL, NULL, NULL);
+
+	if (nb == -1) {
+		retval = errno;
+		status = fsalstat(posix2fsal_error(retval), retval);
+	} else {
+		*copied = nb;
+	}
+
+	/* restore credentials */
+	retval = setglustercreds(glfs_export, NULL, NULL, 0, NULL);
+	if (retval != 0) {
+		status = gluster2fsal_error(EPERM);
+		LogFatal(COMPONENT_FSAL, "Could not set Ganesha credentials");
+	}
+
+ out:
+
+	if (dst_close)
+		glusterfs_close_my_fd(&dst_fd);
+
+	if (dst_lock)
+		PTHREAD_RWLOCK_unlock(&dst_hdl->lock);
+
+	if (src_close)
+		glusterfs_close_my_fd(&src_fd);
+
+	if (src_lock)
+		PTHREAD_RWLOCK_unlock(&src_hdl->lock);
+
+	return status;
+}
+#endif
+
+/* read_vec
+ */
+
+static fsal_status_t glusterfs_read_vec(struct fsal_obj_handle *obj_hdl,
+					bool bypass,
+					struct state_t *state,
+					uint64_t offset,
+					const struct iovec *iov,
+					int iovcnt,
+					size_t *read_amount,
+					bool *end_of_file)
+{
+	struct glusterfs_fd my_fd = {0};
+	ssize_t nb_read;
+	fsal_status_t status;
+	int retval = 0;
+	bool has_lock = false;
+	bool need_fsync = false;
+	bool closefd = false;
+
+	/* Get a usable file descriptor */
+	status = find_fd(&my_fd, obj_hdl, bypass, state, FSAL_O_READ,
+			 &has_lock, &need_fsync, &closefd, false);
+
+	if (FSAL_IS_ERROR(status))
+		goto out;
+
+	nb_read = glfs_preadv(my_fd.glfd, iov, iovcnt, offset, 0);
+
+	if (nb_read == -1) {
+		retval = errno;
+		status = fsalstat(posix2fsal_error(retval), retval);
+		goto out;
+	}
+
+	*read_amount = nb_read;
+
+	*end_of_file = (nb_read == 0);
+
+ out:
+
+	if (closefd)
+		glusterfs_close_my_fd(&my_fd);
+
+	if (has_lock)
+		PTHREAD_RWLOCK_unlock(&obj_hdl->lock);
+
+	return status;
+}
+
+/* write_vec
+ */
+
+static fsal_status_t glusterfs_write_vec(struct fsal_obj_handle *obj_hdl,
+					 bool bypass,
+					 struct state_t *state,
+					 uint64_t offset,
+					 const struct iovec *iov,
+					 int iovcnt,
+					 size_t *write_amount,
+					 bool *fsal_stable)
+{
+	ssize_t nb_written;
+	fsal_status_t status;
+	int retval = 0;
+	struct glusterfs_fd my_fd = {0};
+	bool has_lock = false;
+	bool need_fsync = false;
+	bool closefd = false;
+	struct glusterfs_export *glfs_export =
+	     container_of(op_ctx->fsal_export, struct glusterfs_export, export);
+
+	status = find_fd(&my_fd, obj_hdl, bypass, state, FSAL_O_WRITE,
+			 &has_lock, &need_fsync, &closefd, false);
+
+	if (FSAL_IS_ERROR(status))
+		goto out;
+
+	retval = setglustercreds(glfs_export, &op_ctx->creds->caller_uid,
+			&op_ctx->creds->caller_gid,
+			op_ctx->creds->caller_glen,
+			op_ctx->creds->caller_garray);
+	if (retval != 0) {
+		status = gluster2fsal_error(EPERM);
+		LogFatal(COMPONENT_FSAL, "Could not set Ganesha credentials");
+		goto out;
+	}
+
+	nb_written = glfs_pwritev(my_fd.glfd, iov, iovcnt, offset,
+				  ((*fsal_stable) ? O_SYNC : 0));
+
+	if (nb_written == -1) {
+		retval = errno;
+		status = fsalstat(posix2fsal_error(retval), retval);
+	} else {
+		*write_amount = nb_written;
+	}
+
+	/* restore credentials */
+	retval = setglustercreds(glfs_export, NULL, NULL, 0, NULL);
+	if (retval != 0) {
+		status = gluster2fsal_error(EPERM);
+		LogFatal(COMPONENT_FSAL, "Could not set Ganesha credentials");
+	}
+
+ out:
+
+	if (closefd)
+		glusterfs_close_my_fd(&my_fd);
+
+	if (has_lock)
+		PTHREAD_RWLOCK_unlock(&obj_hdl->lock);
+
+	return status;
+}
+
+/* fallocate
+ */
+
+static fsal_status_t glusterfs_fallocate(struct fsal_obj_handle *obj_hdl,
+					 struct state_t *state,
+					 uint64_t offset,
+					 uint64_t length,
+					 bool allocate)
+{
+	fsal_status_t status;
+	int retval = 0;
+	struct glusterfs_fd my_fd = {0};
+	bool has_lock = false;
+	bool need_fsync = false;
+	bool closefd = false;
+	struct glusterfs_export *glfs_export =
+	     container_of(op_ctx->fsal_export, struct glusterfs_export, export);
+
+	status = find_fd(&my_fd, obj_hdl, false, state, FSAL_O_WRITE,
+			 &has_lock, &need_fsync, &closefd, false);
+
+	if (FSAL_IS_ERROR(status))
+		goto out;
+
+	retval = setglustercreds(glfs_export, &op_ctx->creds->caller_uid,
+			&op_ctx->creds->caller_gid,
+			op_ctx->creds->caller_glen,
+			op_ctx->creds->caller_garray);
+	if (retval != 0) {
+		status = gluster2fsal_error(EPERM);
+		LogFatal(COMPONENT_FSAL, "Could not set Ganesha credentials");
+		goto out;
+	}
+
+	/* Allocation may grow the file, a discard punches a hole and
+	 * keeps the size.
+	 */
+	if (allocate)
+		retval = glfs_fallocate(my_fd.glfd, 0, offset, length);
+	else
+		retval = glfs_discard(my_fd.glfd, offset, length);
+
+	if (retval == -1) {
+		retval = errno;
+		status = fsalstat(posix2fsal_error(retval), retval);
+	}
+
+	/* restore credentials */
+	retval = setglustercreds(glfs_export, NULL, NULL, 0, NULL);
+	if (retval != 0) {
+		status = gluster2fsal_error(EPERM);
+		LogFatal(COMPONENT_FSAL, "Could not set Ganesha credentials");
+	}
+
+ out:
+
+	if (closefd)
+		glusterfs_close_my_fd(&my_fd);
+
+	if (has_lock)
+		PTHREAD_RWLOCK_unlock(&obj_hdl->lock);
+
+	return status;
+}
+
 /* commit2
  */
 
@@ -2197,6 +2807,7 @@ static fsal_status_t glusterfs_commit2(struct fsal_obj_handle *obj_hdl,
 				 (struct fsal_fd *)&myself->globalfd,
 				 &myself->share, glusterfs_open_func,
 				 glusterfs_close_func,
+				 sizeof(struct glusterfs_fd),
 				 (struct fsal_fd **)&out_fd,
 				 &has_lock, &closefd);
 
@@ -2918,6 +3529,15 @@ void handle_ops_init(struct fsal_obj_ops *ops)
 	ops->reopen2 = glusterfs_reopen2;
 	ops->read2 = glusterfs_read2;
 	ops->write2 = glusterfs_write2;
+	ops->read2_async = glusterfs_read2_async;
+	ops->write2_async = glusterfs_write2_async;
+	ops->seek2 = glusterfs_seek2;
+#ifdef USE_GLUSTER_COPY_FILE_RANGE
+	ops->copy = glusterfs_copy;
+#endif
+	ops->fallocate = glusterfs_fallocate;
+	ops->write_vec = glusterfs_write_vec;
+	ops->read_vec = glusterfs_read_vec;
 	ops->commit2 = glusterfs_commit2;
 	ops->lock_op2 = glusterfs_lock_op2;
 	ops->setattr2 = glusterfs_setattr2;
@@ -570,6 +570,8 @@ gpfs_read_plus_fd(int my_fd, uint64_t offset,
 {
 	const fsal_status_t status = {ERR_FSAL_NO_ERROR, 0};
 	struct read_arg rarg = {0};
+	struct io_info next = {0};
+	uint64_t length = buffer_size;
 	ssize_t nb_read;
 	int errsv;
 
@@ -594,28 +596,18 @@ gpfs_read_plus_fd(int my_fd, uint64_t offset,
 		if (errsv != ENODATA)
 			return fsalstat(posix2fsal_error(errsv), errsv);
 
-		/* errsv == ENODATA */
-#if 0
-		/** @todo FSF: figure out how to fix this... */
-		if ((buffer_size + offset) > myself->attributes.filesize) {
-			if (offset >= myself->attributes.filesize)
-				*read_amount = 0;
-			else
-				*read_amount =
-					myself->attributes.filesize - offset;
-			info->io_content.hole.di_length = *read_amount;
-		} else {
-			*read_amount = buffer_size;
-			info->io_content.hole.di_length = buffer_size;
-		}
-#endif
-		info->io_content.what = NFS4_CONTENT_HOLE;
-		info->io_content.hole.di_offset = offset;
+		/* errsv == ENODATA, the hole runs to the next data */
+		next.io_content.what = NFS4_CONTENT_DATA;
+		next.io_content.hole.di_offset = offset;
+		if (!FSAL_IS_ERROR(gpfs_seek_fd(my_fd, &next)) &&
+		    next.io_content.hole.di_offset > offset &&
+		    next.io_content.hole.di_offset - offset < length)
+			length = next.io_content.hole.di_offset - offset;
+
+		io_info_hole(info, offset, length);
+		*read_amount = 0;
 	} else {
-		info->io_content.what = NFS4_CONTENT_DATA;
-		info->io_content.data.d_offset = offset + nb_read;
-		info->io_content.data.d_data.data_len = nb_read;
-		info->io_content.data.d_data.data_val = buffer;
+		io_info_data(info, offset, buffer, nb_read);
 		*read_amount = nb_read;
 	}
 
@@ -783,6 +775,7 @@ fsal_status_t find_fd(int *fd,
 				      &myself->u.file.share,
 				      bypass, state, openflags,
 				      gpfs_open_func, gpfs_close_func,
+				      sizeof(struct gpfs_fd),
 				      has_lock, need_fsync,
 				      closefd, open_for_locks);
 
@@ -1016,6 +1009,7 @@ fsal_status_t gpfs_commit2(struct fsal_obj_handle *obj_hdl,
 				 (struct fsal_fd *)&myself->u.file.fd,
 				 &myself->u.file.share,
 				 gpfs_open_func, gpfs_close_func,
+				 sizeof(struct gpfs_fd),
 				 (struct fsal_fd **)&out_fd, &has_lock,
 				 &closefd);
 
@@ -1306,26 +1300,21 @@ gpfs_write_plus_fd(int my_fd, uint64_t offset,
 }
 
 /**
- *  @brief GPFS seek command
+ *  @brief GPFS seek on a file descriptor
  *
- *  @param obj_hdl FSAL object handle
+ *  @param my_fd File descriptor
  *  @param io_info I/O information
  *  @return FSAL status
  *
  *  default case not supported
  */
-fsal_status_t gpfs_seek(struct fsal_obj_handle *obj_hdl, struct io_info *info)
+fsal_status_t gpfs_seek_fd(int my_fd, struct io_info *info)
 {
-	struct gpfs_fsal_obj_handle *myself =
-		container_of(obj_hdl, struct gpfs_fsal_obj_handle, obj_handle);
 	struct gpfs_io_info io_info = {0};
 	struct fseek_arg arg = {0};
 
-	assert(myself->u.file.fd.fd >= 0 &&
-	       myself->u.file.fd.openflags != FSAL_O_CLOSED);
-
-	arg.mountdirfd = myself->u.file.fd.fd;
-	arg.openfd = myself->u.file.fd.fd;
+	arg.mountdirfd = my_fd;
+	arg.openfd = my_fd;
 	arg.info = &io_info;
 
 	io_info.io_offset = info->io_content.hole.di_offset;
@@ -1353,6 +1342,57 @@ fsal_status_t gpfs_seek(struct fsal_obj_handle *obj_hdl, struct io_info *info)
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
 
+/**
+ *  @brief GPFS seek command
+ *
+ *  @param obj_hdl FSAL object handle
+ *  @param io_info I/O information
+ *  @return FSAL status
+ */
+fsal_status_t gpfs_seek(struct fsal_obj_handle *obj_hdl, struct io_info *info)
+{
+	struct gpfs_fsal_obj_handle *myself =
+		container_of(obj_hdl, struct gpfs_fsal_obj_handle, obj_handle);
+
+	assert(myself->u.file.fd.fd >= 0 &&
+	       myself->u.file.fd.openflags != FSAL_O_CLOSED);
+
+	return gpfs_seek_fd(myself->u.file.fd.fd, info);
+}
+
+/**
+ *  @brief GPFS seek with a state
+ *
+ *  @param obj_hdl FSAL object handle
+ *  @param state state_t to use for this operation
+ *  @param io_info I/O information
+ *  @return FSAL status
+ */
+fsal_status_t gpfs_seek2(struct fsal_obj_handle *obj_hdl,
+			 struct state_t *state,
+			 struct io_info *info)
+{
+	int my_fd = -1;
+	fsal_status_t status;
+	bool has_lock = false;
+	bool need_fsync = false;
+	bool closefd = false;
+
+	status = find_fd(&my_fd, obj_hdl, false, state, FSAL_O_READ,
+			 &has_lock, &need_fsync, &closefd, false);
+
+	if (!FSAL_IS_ERROR(status))
+		status = gpfs_seek_fd(my_fd, info);
+
+	if (closefd)
+		fsal_internal_close(my_fd, NULL, 0);
+
+	if (has_lock)
+		PTHREAD_RWLOCK_unlock(&obj_hdl->lock);
+
+	return status;
+}
+
 /**
  *  @brief GPFS IO advise
  *
@@ -1530,6 +1570,10 @@ fsal_status_t gpfs_close(struct fsal_obj_handle *obj_hdl)
 		myself->u.file.fd.openflags = FSAL_O_CLOSED;
 	}
 
+	PTHREAD_RWLOCK_wrlock(&obj_hdl->lock);
+	fsal_fd_cache_close(obj_hdl);
+	PTHREAD_RWLOCK_unlock(&obj_hdl->lock);
+
 	return status;
 }
 
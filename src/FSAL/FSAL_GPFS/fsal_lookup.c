@@ -36,29 +36,30 @@
 #include "gpfs_methods.h"
 
 /**
- *  @brief Looks up for an object into a directory.
- *
- *        if parent handle and filename are NULL,
- *        this retrieves root's handle.
+ *  @brief Looks up for an object into an open directory.
  *
  *  @param op_ctx Authentication context for the operation (user,...).
  *  @param parent Handle of the parent directory to search the object in.
+ *  @param parent_fd Open file descriptor of the parent directory.
  *  @param filename The name of the object to find.
  *  @param fsal_attr Pointer to the attributes of the object we found.
  *  @param fh The handle of the object corresponding to filename.
  *  @param new_fs New FS
  *
+ *  The caller keeps parent_fd, so that a readdir looks up all its
+ *  entries through the descriptor it reads the directory with.
+ *
  *  @return - ERR_FSAL_NO_ERROR, if no error.
  *          - Another error code else.
  */
 fsal_status_t
-GPFSFSAL_lookup(const struct req_op_context *op_ctx,
-		struct fsal_obj_handle *parent, const char *filename,
-		struct attrlist *fsal_attr, struct gpfs_file_handle *fh,
-		struct fsal_filesystem **new_fs)
+GPFSFSAL_lookup_at(const struct req_op_context *op_ctx,
+		   struct fsal_obj_handle *parent, int parent_fd,
+		   const char *filename, struct attrlist *fsal_attr,
+		   struct gpfs_file_handle *fh,
+		   struct fsal_filesystem **new_fs)
 {
 	fsal_status_t status;
-	int parent_fd;
 	struct gpfs_fsal_obj_handle *parent_hdl;
 	struct gpfs_filesystem *gpfs_fs;
 	struct fsal_fsid__ fsid;
@@ -72,14 +73,6 @@ GPFSFSAL_lookup(const struct req_op_context *op_ctx,
 	    container_of(parent, struct gpfs_fsal_obj_handle, obj_handle);
 	gpfs_fs = parent->fs->private_data;
 
-	status = fsal_internal_handle2fd_at(gpfs_fs->root_fd,
-					    parent_hdl->handle,
-					    &parent_fd,
-					    O_RDONLY,
-					    0);
-	if (FSAL_IS_ERROR(status))
-		return status;
-
 	/* Be careful about junction crossing, symlinks, hardlinks,... */
 	switch (parent->type) {
 	case DIRECTORY:
@@ -89,19 +82,15 @@ GPFSFSAL_lookup(const struct req_op_context *op_ctx,
 	case REGULAR_FILE:
 	case SYMBOLIC_LINK:
 		/* not a directory */
-		close(parent_fd);
 		return fsalstat(ERR_FSAL_NOTDIR, 0);
 
 	default:
-		close(parent_fd);
 		return fsalstat(ERR_FSAL_SERVERFAULT, 0);
 	}
 
 	status = fsal_internal_get_handle_at(parent_fd, filename, fh);
-	if (FSAL_IS_ERROR(status)) {
-		close(parent_fd);
+	if (FSAL_IS_ERROR(status))
 		return status;
-	}
 
 	/* In order to check XDEV, we need to get the fsid from the handle.
 	 * We need to do this before getting attributes in order to have tthe
@@ -141,8 +130,56 @@ GPFSFSAL_lookup(const struct req_op_context *op_ctx,
 	status = GPFSFSAL_getattrs(op_ctx->fsal_export, gpfs_fs,
 				   op_ctx, fh, fsal_attr);
 
+	/* lookup complete ! */
+	return status;
+}
+
+/**
+ *  @brief Looks up for an object into a directory.
+ *
+ *  As GPFSFSAL_lookup_at(), opening the parent directory for the
+ *  lookup.
+ *
+ *  @param op_ctx Authentication context for the operation (user,...).
+ *  @param parent Handle of the parent directory to search the object in.
+ *  @param filename The name of the object to find.
+ *  @param fsal_attr Pointer to the attributes of the object we found.
+ *  @param fh The handle of the object corresponding to filename.
+ *  @param new_fs New FS
+ *
+ *  @return - ERR_FSAL_NO_ERROR, if no error.
+ *          - Another error code else.
+ */
+fsal_status_t
+GPFSFSAL_lookup(const struct req_op_context *op_ctx,
+		struct fsal_obj_handle *parent, const char *filename,
+		struct attrlist *fsal_attr, struct gpfs_file_handle *fh,
+		struct fsal_filesystem **new_fs)
+{
+	fsal_status_t status;
+	int parent_fd;
+	struct gpfs_fsal_obj_handle *parent_hdl;
+	struct gpfs_filesystem *gpfs_fs;
+
+	if (!parent || !filename)
+		return fsalstat(ERR_FSAL_FAULT, 0);
+
+	parent_hdl =
+	    container_of(parent, struct gpfs_fsal_obj_handle, obj_handle);
+	gpfs_fs = parent->fs->private_data;
+
+	status = fsal_internal_handle2fd_at(gpfs_fs->root_fd,
+					    parent_hdl->handle,
+					    &parent_fd,
+					    O_RDONLY,
+					    0);
+	if (FSAL_IS_ERROR(status))
+		return status;
+
+	status = GPFSFSAL_lookup_at(op_ctx, parent, parent_fd, filename,
+				    fsal_attr, fh, new_fs);
+
 	close(parent_fd);
 
-	/* lookup complete ! */
 	return status;
 }
@@ -183,6 +183,10 @@ fsal_status_t gpfs_write_plus_fd(int my_fd,
 			 struct io_info *info);
 fsal_status_t gpfs_seek(struct fsal_obj_handle *obj_hdl,
 			 struct io_info *info);
+fsal_status_t gpfs_seek_fd(int my_fd, struct io_info *info);
+fsal_status_t gpfs_seek2(struct fsal_obj_handle *obj_hdl,
+			 struct state_t *state,
+			 struct io_info *info);
 fsal_status_t gpfs_io_advise(struct fsal_obj_handle *obj_hdl,
 			 struct io_hints *hints);
 fsal_status_t gpfs_commit(struct fsal_obj_handle *obj_hdl,	/* sync */
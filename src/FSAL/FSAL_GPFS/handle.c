@@ -89,12 +89,13 @@ struct gpfs_fsal_obj_handle *alloc_handle(struct gpfs_file_handle *fh,
 	return hdl;
 }
 
-/* lookup
- * deprecated NULL parent && NULL path implies root handle
+/* lookup_at
+ * look up through dirfd, an open descriptor of parent, if not -1
  */
-static fsal_status_t lookup(struct fsal_obj_handle *parent,
-			    const char *path, struct fsal_obj_handle **handle,
-			    struct attrlist *attrs_out)
+static fsal_status_t lookup_at(struct fsal_obj_handle *parent, int dirfd,
+			       const char *path,
+			       struct fsal_obj_handle **handle,
+			       struct attrlist *attrs_out)
 {
 	fsal_errors_t fsal_error = ERR_FSAL_NO_ERROR;
 	int retval = 0;
@@ -129,7 +130,12 @@ static fsal_status_t lookup(struct fsal_obj_handle *parent,
 	if (attrs_out != NULL)
 		attrib.mask |= attrs_out->mask;
 
-	status = GPFSFSAL_lookup(op_ctx, parent, path, &attrib, fh, &fs);
+	if (dirfd < 0)
+		status = GPFSFSAL_lookup(op_ctx, parent, path, &attrib, fh,
+					 &fs);
+	else
+		status = GPFSFSAL_lookup_at(op_ctx, parent, dirfd, path,
+					    &attrib, fh, &fs);
 	if (FSAL_IS_ERROR(status))
 		return status;
 
@@ -152,6 +158,16 @@ static fsal_status_t lookup(struct fsal_obj_handle *parent,
 	return fsalstat(fsal_error, retval);
 }
 
+/* lookup
+ * deprecated NULL parent && NULL path implies root handle
+ */
+static fsal_status_t lookup(struct fsal_obj_handle *parent,
+			    const char *path, struct fsal_obj_handle **handle,
+			    struct attrlist *attrs_out)
+{
+	return lookup_at(parent, -1, path, handle, attrs_out);
+}
+
 /* create
  * create a regular file and set its attributes
  */
@@ -498,11 +514,13 @@ static fsal_status_t linkfile(struct fsal_obj_handle *obj_hdl,
 	return status;
 }
 
-#define BUF_SIZE 1024
+/* Room for a few hundred entries per getdents */
+#define BUF_SIZE (32 * 1024)
 /**
  * read_dirents
  * read the directory and call through the callback function for
- * each entry.
+ * each entry.  The entries are looked up through the descriptor the
+ * directory is read with, rather than reopening it for each one.
  * @param dir_hdl [IN] the directory to read
  * @param whence [IN] where to start (next)
  * @param dir_state [IN] pass thru of state to callback
@@ -522,7 +540,7 @@ static fsal_status_t read_dirents(struct fsal_obj_handle *dir_hdl,
 	off_t seekloc = 0;
 	int bpos, cnt, nread;
 	struct dirent64 *dentry;
-	char buf[BUF_SIZE];
+	char *buf;
 	struct gpfs_filesystem *gpfs_fs;
 
 	if (whence != NULL)
@@ -536,6 +554,8 @@ static fsal_status_t read_dirents(struct fsal_obj_handle *dir_hdl,
 	if (dirfd < 0)
 		return status;
 
+	buf = gsh_malloc(BUF_SIZE);
+
 	seekloc = lseek(dirfd, seekloc, SEEK_SET);
 	if (seekloc < 0) {
 		retval = errno;
@@ -564,7 +584,8 @@ static fsal_status_t read_dirents(struct fsal_obj_handle *dir_hdl,
 
 			fsal_prepare_attrs(&attrs, attrmask);
 
-			status = lookup(dir_hdl, dentry->d_name, &hdl, &attrs);
+			status = lookup_at(dir_hdl, dirfd, dentry->d_name,
+					   &hdl, &attrs);
 			if (FSAL_IS_ERROR(status)) {
 				fsal_error = status.major;
 				goto done;
@@ -586,6 +607,7 @@ static fsal_status_t read_dirents(struct fsal_obj_handle *dir_hdl,
 
 	*eof = true;
  done:
+	gsh_free(buf);
 	close(dirfd);
 
 	return fsalstat(fsal_error, retval);
@@ -1062,6 +1084,7 @@ void gpfs_handle_ops_init(struct fsal_obj_ops *ops)
 	ops->reopen2 = gpfs_reopen2;
 	ops->read2 = gpfs_read2;
 	ops->write2 = gpfs_write2;
+	ops->seek2 = gpfs_seek2;
 	ops->commit2 = gpfs_commit2;
 	ops->setattr2 = gpfs_setattr2;
 	ops->close2 = gpfs_close2;
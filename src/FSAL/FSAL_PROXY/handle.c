@@ -49,20 +49,44 @@
 static clientid4 pxy_clientid;
 static pthread_mutex_t pxy_clientid_mutex = PTHREAD_MUTEX_INITIALIZER;
 static char pxy_hostname[MAXNAMLEN + 1];
-static pthread_t pxy_recv_thread;
 static pthread_t pxy_renewer_thread;
-static struct glist_head rpc_calls;
-static struct glist_head free_contexts;
-static int rpc_sock = -1;
 static uint32_t rpc_xid;
-static pthread_mutex_t listlock = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t sockless = PTHREAD_COND_INITIALIZER;
-static pthread_cond_t need_context = PTHREAD_COND_INITIALIZER;
 
 /*
- * Protects the "free_contexts" list and the "need_context" condition.
+ * A TCP connection to the server.  Calls are spread over all of them,
+ * each has its own receiver thread.
+ *
+ * lock serializes the writes on sock and the changes of it, ready is
+ * signalled when it is connected.
  */
-static pthread_mutex_t context_lock = PTHREAD_MUTEX_INITIALIZER;
+struct pxy_conn {
+	pthread_mutex_t lock;
+	pthread_cond_t ready;
+	pthread_t recv_thread;
+	int sock;
+	int idx;
+};
+
+static struct pxy_conn *pxy_conns;
+static uint32_t pxy_nconns;
+static uint32_t pxy_next_conn;
+static const struct pxy_client_params *pxy_info;
+
+/*
+ * Calls waiting for a reply, hashed on their xid.  A reply only takes
+ * the lock of its bucket.
+ */
+#define PXY_XID_BUCKETS 256
+
+static struct pxy_xid_bucket {
+	pthread_mutex_t lock;
+	struct glist_head calls;
+} pxy_calls[PXY_XID_BUCKETS];
+
+static inline struct pxy_xid_bucket *pxy_xid_bucket(uint32_t xid)
+{
+	return &pxy_calls[xid % PXY_XID_BUCKETS];
+}
 
 /* NB! nfs_prog is just an easy way to get this info into the call
  *     It should really be fetched via export pointer */
@@ -70,6 +94,10 @@ struct pxy_rpc_io_context {
 	pthread_mutex_t iolock;
 	pthread_cond_t iowait;
 	struct glist_head calls;
+	/* The connection the call was last sent on */
+	struct pxy_conn *conn;
+	/* Taken from the pool, see pxy_get_context() */
+	uint32_t busy;
 	uint32_t rpc_xid;
 	int iodone;
 	int ioresult;
@@ -80,6 +108,20 @@ struct pxy_rpc_io_context {
 	char *recvbuf;
 };
 
+/*
+ * The pool of contexts.  A context is taken by setting its busy flag,
+ * context_lock and need_context are only used to wait when all of
+ * them are busy.
+ */
+#define PXY_CONTEXTS_PER_CONN 16
+
+static struct pxy_rpc_io_context **pxy_contexts;
+static uint32_t pxy_ncontexts;
+static uint32_t pxy_context_hint;
+static uint32_t pxy_context_waiters;
+static pthread_mutex_t context_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t need_context = PTHREAD_COND_INITIALIZER;
+
 /* Use this to estimate storage requirements for fattr4 blob */
 struct pxy_fattr_storage {
 	fattr4_type type;
@@ -252,6 +294,22 @@ static struct bitmap4 pxy_bitmap_getattr = {
 	.bitmap4_len = 2
 };
 
+/* Also returns the handle of each entry, saving a LOOKUP per entry */
+static struct bitmap4 pxy_bitmap_readdir = {
+	.map[0] =
+	    (PXY_ATTR_BIT(FATTR4_TYPE) | PXY_ATTR_BIT(FATTR4_CHANGE) |
+	     PXY_ATTR_BIT(FATTR4_SIZE) | PXY_ATTR_BIT(FATTR4_FSID) |
+	     PXY_ATTR_BIT(FATTR4_FILEHANDLE) | PXY_ATTR_BIT(FATTR4_FILEID)),
+	.map[1] =
+	    (PXY_ATTR_BIT2(FATTR4_MODE) | PXY_ATTR_BIT2(FATTR4_NUMLINKS) |
+	     PXY_ATTR_BIT2(FATTR4_OWNER) | PXY_ATTR_BIT2(FATTR4_OWNER_GROUP) |
+	     PXY_ATTR_BIT2(FATTR4_SPACE_USED) |
+	     PXY_ATTR_BIT2(FATTR4_TIME_ACCESS) |
+	     PXY_ATTR_BIT2(FATTR4_TIME_METADATA) |
+	     PXY_ATTR_BIT2(FATTR4_TIME_MODIFY) | PXY_ATTR_BIT2(FATTR4_RAWDEV)),
+	.bitmap4_len = 2
+};
+
 static struct bitmap4 pxy_bitmap_fsinfo = {
 	.map[0] =
 	    (PXY_ATTR_BIT(FATTR4_FILES_AVAIL) | PXY_ATTR_BIT(FATTR4_FILES_FREE)
@@ -371,7 +429,7 @@ static int pxy_got_rpc_reply(struct pxy_rpc_io_context *ctx, int sock, int sz,
 	return size;
 }
 
-static int pxy_rpc_read_reply(int sock)
+static int pxy_rpc_read_reply(struct pxy_conn *conn)
 {
 	struct {
 		uint recmark;
@@ -379,8 +437,10 @@ static int pxy_rpc_read_reply(int sock)
 	} h;
 	char *buf = (char *)&h;
 	struct glist_head *c;
+	struct pxy_xid_bucket *bucket;
 	char sink[256];
 	int cnt = 0;
+	int sock = conn->sock;
 
 	while (cnt < 8) {
 		int bc = read(sock, buf + cnt, 8 - cnt);
@@ -397,18 +457,19 @@ static int pxy_rpc_read_reply(int sock)
 	LogDebug(COMPONENT_FSAL, "Recmark %x, xid %u\n", h.recmark, h.xid);
 	h.recmark &= ~(1U << 31);
 
-	PTHREAD_MUTEX_lock(&listlock);
-	glist_for_each(c, &rpc_calls) {
+	bucket = pxy_xid_bucket(h.xid);
+	PTHREAD_MUTEX_lock(&bucket->lock);
+	glist_for_each(c, &bucket->calls) {
 		struct pxy_rpc_io_context *ctx =
 		    container_of(c, struct pxy_rpc_io_context, calls);
 
 		if (ctx->rpc_xid == h.xid) {
 			glist_del(c);
-			PTHREAD_MUTEX_unlock(&listlock);
+			PTHREAD_MUTEX_unlock(&bucket->lock);
 			return pxy_got_rpc_reply(ctx, sock, h.recmark, h.xid);
 		}
 	}
-	PTHREAD_MUTEX_unlock(&listlock);
+	PTHREAD_MUTEX_unlock(&bucket->lock);
 
 	cnt = h.recmark - 4;
 	LogDebug(COMPONENT_FSAL, "xid %u is not on the list, skip %d bytes\n",
@@ -425,32 +486,42 @@ static int pxy_rpc_read_reply(int sock)
 	return 0;
 }
 
-static void pxy_new_socket_ready(void)
+/* Called with conn->lock held */
+static void pxy_new_socket_ready(struct pxy_conn *conn)
 {
 	struct glist_head *nxt;
 	struct glist_head *c;
+	int i;
 
 	/* If there is anyone waiting for the socket then tell them
 	 * it's ready */
-	pthread_cond_broadcast(&sockless);
+	pthread_cond_broadcast(&conn->ready);
 
-	/* If there are any outstanding calls then tell them to resend */
-	glist_for_each_safe(c, nxt, &rpc_calls) {
-		struct pxy_rpc_io_context *ctx =
-		    container_of(c, struct pxy_rpc_io_context, calls);
+	/* If there are any outstanding calls on this connection then tell
+	 * them to resend */
+	for (i = 0; i < PXY_XID_BUCKETS; i++) {
+		PTHREAD_MUTEX_lock(&pxy_calls[i].lock);
+		glist_for_each_safe(c, nxt, &pxy_calls[i].calls) {
+			struct pxy_rpc_io_context *ctx =
+			    container_of(c, struct pxy_rpc_io_context, calls);
+
+			if (ctx->conn != conn)
+				continue;
 
-		glist_del(c);
+			glist_del(c);
 
-		PTHREAD_MUTEX_lock(&ctx->iolock);
-		ctx->iodone = 1;
-		ctx->ioresult = -EAGAIN;
-		pthread_cond_signal(&ctx->iowait);
-		PTHREAD_MUTEX_unlock(&ctx->iolock);
+			PTHREAD_MUTEX_lock(&ctx->iolock);
+			ctx->iodone = 1;
+			ctx->ioresult = -EAGAIN;
+			pthread_cond_signal(&ctx->iowait);
+			PTHREAD_MUTEX_unlock(&ctx->iolock);
+		}
+		PTHREAD_MUTEX_unlock(&pxy_calls[i].lock);
 	}
 }
 
-static int pxy_connect(struct pxy_client_params *info,
-		       struct sockaddr_in *dest)
+static int pxy_connect(const struct pxy_client_params *info,
+		       struct sockaddr_in *dest, struct pxy_conn *conn)
 {
 	int sock;
 
@@ -473,20 +544,23 @@ static int pxy_connect(struct pxy_client_params *info,
 			close(sock);
 			sock = -1;
 		} else {
-			pxy_new_socket_ready();
+			conn->sock = sock;
+			pxy_new_socket_ready(conn);
 		}
 	}
 	return sock;
 }
 
 /*
- * NB! rpc_sock can be closed by the sending thread but it will not be
- *     changing its value. Only this function will change rpc_sock which
- *     means that it can look at the value without holding the lock.
+ * NB! conn->sock can be closed by the sending thread but it will not be
+ *     changing its value. Only this function will change conn->sock
+ *     which means that it can look at the value without holding the
+ *     lock.
  */
 static void *pxy_rpc_recv(void *arg)
 {
-	struct pxy_client_params *info = arg;
+	struct pxy_conn *conn = arg;
+	const struct pxy_client_params *info = pxy_info;
 	struct sockaddr_in addr_rpc;
 	struct sockaddr_in *info_sock = (struct sockaddr_in *)&info->srv_addr;
 	char addr[INET_ADDRSTRLEN];
@@ -502,10 +576,9 @@ static void *pxy_rpc_recv(void *arg)
 	for (;;) {
 		int nsleeps = 0;
 
-		PTHREAD_MUTEX_lock(&listlock);
+		PTHREAD_MUTEX_lock(&conn->lock);
 		do {
-			rpc_sock = pxy_connect(info, &addr_rpc);
-			if (rpc_sock < 0) {
+			if (pxy_connect(info, &addr_rpc, conn) < 0) {
 				if (nsleeps == 0)
 					LogCrit(COMPONENT_FSAL,
 						"Cannot connect to server %s:%u",
@@ -514,22 +587,22 @@ static void *pxy_rpc_recv(void *arg)
 							  addr,
 							  sizeof(addr)),
 						ntohs(info->srv_port));
-				PTHREAD_MUTEX_unlock(&listlock);
+				PTHREAD_MUTEX_unlock(&conn->lock);
 				sleep(info->retry_sleeptime);
 				nsleeps++;
-				PTHREAD_MUTEX_lock(&listlock);
+				PTHREAD_MUTEX_lock(&conn->lock);
 			} else {
 				LogDebug(COMPONENT_FSAL,
-					 "Connected after %d sleeps, resending outstanding calls",
-					 nsleeps);
+					 "Connection %d connected after %d sleeps, resending outstanding calls",
+					 conn->idx, nsleeps);
 			}
-		} while (rpc_sock < 0);
-		PTHREAD_MUTEX_unlock(&listlock);
+		} while (conn->sock < 0);
+		PTHREAD_MUTEX_unlock(&conn->lock);
 
-		pfd.fd = rpc_sock;
+		pfd.fd = conn->sock;
 		pfd.events = POLLIN | POLLRDHUP;
 
-		while (rpc_sock >= 0) {
+		while (conn->sock >= 0) {
 			switch (poll(&pfd, 1, millisec)) {
 			case 0:
 				LogDebug(COMPONENT_FSAL,
@@ -547,16 +620,16 @@ static void *pxy_rpc_recv(void *arg)
 					LogEvent(COMPONENT_FSAL,
 						 "Socket is closed");
 				} else {
-					if (pxy_rpc_read_reply(rpc_sock) >= 0)
+					if (pxy_rpc_read_reply(conn) >= 0)
 						continue;
 				}
 				break;
 			}
 
-			PTHREAD_MUTEX_lock(&listlock);
-			close(rpc_sock);
-			rpc_sock = -1;
-			PTHREAD_MUTEX_unlock(&listlock);
+			PTHREAD_MUTEX_lock(&conn->lock);
+			close(conn->sock);
+			conn->sock = -1;
+			PTHREAD_MUTEX_unlock(&conn->lock);
 		}
 	}
 
@@ -648,28 +721,49 @@ static enum clnt_stat pxy_process_reply(struct pxy_rpc_io_context *ctx,
 	return rc;
 }
 
-static void pxy_rpc_need_sock(void)
+static void pxy_rpc_need_sock(struct pxy_conn *conn)
 {
-	PTHREAD_MUTEX_lock(&listlock);
-	while (rpc_sock < 0)
-		pthread_cond_wait(&sockless, &listlock);
-	PTHREAD_MUTEX_unlock(&listlock);
+	PTHREAD_MUTEX_lock(&conn->lock);
+	while (conn->sock < 0)
+		pthread_cond_wait(&conn->ready, &conn->lock);
+	PTHREAD_MUTEX_unlock(&conn->lock);
 }
 
+/* The client id is renegotiated when the first connection reconnects */
 static int pxy_rpc_renewer_wait(int timeout)
 {
+	struct pxy_conn *conn = &pxy_conns[0];
 	struct timespec ts;
 	int rc;
 
-	PTHREAD_MUTEX_lock(&listlock);
+	PTHREAD_MUTEX_lock(&conn->lock);
 	ts.tv_sec = time(NULL) + timeout;
 	ts.tv_nsec = 0;
 
-	rc = pthread_cond_timedwait(&sockless, &listlock, &ts);
-	PTHREAD_MUTEX_unlock(&listlock);
+	rc = pthread_cond_timedwait(&conn->ready, &conn->lock, &ts);
+	PTHREAD_MUTEX_unlock(&conn->lock);
 	return (rc == ETIMEDOUT);
 }
 
+/*
+ * Pick the connection for a call, round robin over the connected ones.
+ * If none is, the next one is returned and the send will fail.
+ */
+static struct pxy_conn *pxy_pick_conn(void)
+{
+	uint32_t start = atomic_inc_uint32_t(&pxy_next_conn);
+	uint32_t i;
+
+	for (i = 0; i < pxy_nconns; i++) {
+		struct pxy_conn *conn = &pxy_conns[(start + i) % pxy_nconns];
+
+		if (atomic_fetch_int32_t(&conn->sock) >= 0)
+			return conn;
+	}
+
+	return &pxy_conns[start % pxy_nconns];
+}
+
 static int pxy_compoundv4_call(struct pxy_rpc_io_context *pcontext,
 			       const struct user_cred *cred,
 			       COMPOUND4args *args, COMPOUND4res *res)
@@ -679,9 +773,7 @@ static int pxy_compoundv4_call(struct pxy_rpc_io_context *pcontext,
 	AUTH *au;
 	enum clnt_stat rc;
 
-	PTHREAD_MUTEX_lock(&listlock);
-	rmsg.rm_xid = rpc_xid++;
-	PTHREAD_MUTEX_unlock(&listlock);
+	rmsg.rm_xid = atomic_inc_uint32_t(&rpc_xid);
 	rmsg.rm_direction = CALL;
 
 	rmsg.rm_call.cb_rpcvers = RPC_MSG_VERSION;
@@ -708,9 +800,12 @@ static int pxy_compoundv4_call(struct pxy_rpc_io_context *pcontext,
 	if (xdr_callmsg(&x, &rmsg) && xdr_COMPOUND4args(&x, args)) {
 		u_int pos = xdr_getpos(&x);
 		u_int recmark = ntohl(pos | (1U << 31));
+		struct pxy_xid_bucket *bucket = pxy_xid_bucket(rmsg.rm_xid);
+		struct pxy_conn *conn = pxy_pick_conn();
 		int first_try = 1;
 
 		pcontext->rpc_xid = rmsg.rm_xid;
+		pcontext->conn = conn;
 
 		memcpy(pcontext->sendbuf, &recmark, sizeof(recmark));
 		pos += 4;
@@ -719,32 +814,40 @@ static int pxy_compoundv4_call(struct pxy_rpc_io_context *pcontext,
 			int bc = 0;
 			char *buf = pcontext->sendbuf;
 
-			LogDebug(COMPONENT_FSAL, "%ssend XID %u with %d bytes",
+			LogDebug(COMPONENT_FSAL,
+				 "%ssend XID %u with %d bytes on connection %d",
 				 (first_try ? "First attempt to " : "Re"),
-				 rmsg.rm_xid, pos);
-			PTHREAD_MUTEX_lock(&listlock);
+				 rmsg.rm_xid, pos, conn->idx);
+			PTHREAD_MUTEX_lock(&conn->lock);
+
+			/* The receiver only takes the bucket lock, so the
+			 * call must be waiting before it is sent
+			 */
+			if (first_try) {
+				PTHREAD_MUTEX_lock(&bucket->lock);
+				glist_add_tail(&bucket->calls,
+					       &pcontext->calls);
+				PTHREAD_MUTEX_unlock(&bucket->lock);
+				first_try = 0;
+			}
+
 			while (bc < pos) {
-				int wc = write(rpc_sock, buf, pos - bc);
+				int wc = write(conn->sock, buf, pos - bc);
 
 				if (wc <= 0) {
-					close(rpc_sock);
+					close(conn->sock);
 					break;
 				}
 				bc += wc;
 				buf += wc;
 			}
 
-			if (bc == pos) {
-				if (first_try) {
-					glist_add_tail(&rpc_calls,
-						       &pcontext->calls);
-					first_try = 0;
-				}
-			} else {
-				if (!first_try)
-					glist_del(&pcontext->calls);
+			if (bc != pos) {
+				PTHREAD_MUTEX_lock(&bucket->lock);
+				glist_del(&pcontext->calls);
+				PTHREAD_MUTEX_unlock(&bucket->lock);
 			}
-			PTHREAD_MUTEX_unlock(&listlock);
+			PTHREAD_MUTEX_unlock(&conn->lock);
 
 			if (bc == pos)
 				rc = pxy_process_reply(pcontext, res);
@@ -759,6 +862,56 @@ static int pxy_compoundv4_call(struct pxy_rpc_io_context *pcontext,
 	return rc;
 }
 
+static struct pxy_rpc_io_context *pxy_try_context(void)
+{
+	uint32_t start = atomic_inc_uint32_t(&pxy_context_hint);
+	uint32_t i;
+
+	for (i = 0; i < pxy_ncontexts; i++) {
+		struct pxy_rpc_io_context *ctx =
+			pxy_contexts[(start + i) % pxy_ncontexts];
+
+		if (atomic_cas_uint32_t(&ctx->busy, 0, 1))
+			return ctx;
+	}
+
+	return NULL;
+}
+
+/*
+ * Take a context from the pool, waiting for one if they are all busy.
+ */
+static struct pxy_rpc_io_context *pxy_get_context(void)
+{
+	struct pxy_rpc_io_context *ctx = pxy_try_context();
+
+	if (ctx != NULL)
+		return ctx;
+
+	PTHREAD_MUTEX_lock(&context_lock);
+	(void) atomic_inc_uint32_t(&pxy_context_waiters);
+	/* Once counted as a waiter, a context put back is either seen
+	 * here or signalled
+	 */
+	while ((ctx = pxy_try_context()) == NULL)
+		pthread_cond_wait(&need_context, &context_lock);
+	(void) atomic_dec_uint32_t(&pxy_context_waiters);
+	PTHREAD_MUTEX_unlock(&context_lock);
+
+	return ctx;
+}
+
+static void pxy_put_context(struct pxy_rpc_io_context *ctx)
+{
+	atomic_store_uint32_t(&ctx->busy, 0);
+
+	if (atomic_fetch_uint32_t(&pxy_context_waiters) != 0) {
+		PTHREAD_MUTEX_lock(&context_lock);
+		pthread_cond_signal(&need_context);
+		PTHREAD_MUTEX_unlock(&context_lock);
+	}
+}
+
 int pxy_compoundv4_execute(const char *caller, const struct user_cred *creds,
 			   uint32_t cnt, nfs_argop4 *argoparray,
 			   nfs_resop4 *resoparray)
@@ -774,13 +927,7 @@ int pxy_compoundv4_execute(const char *caller, const struct user_cred *creds,
 		.resarray.resarray_len = cnt
 	};
 
-	PTHREAD_MUTEX_lock(&context_lock);
-	while (glist_empty(&free_contexts))
-		pthread_cond_wait(&need_context, &context_lock);
-	ctx =
-	    glist_first_entry(&free_contexts, struct pxy_rpc_io_context, calls);
-	glist_del(&ctx->calls);
-	PTHREAD_MUTEX_unlock(&context_lock);
+	ctx = pxy_get_context();
 
 	do {
 		rc = pxy_compoundv4_call(ctx, creds, &arg, &res);
@@ -788,14 +935,11 @@ int pxy_compoundv4_execute(const char *caller, const struct user_cred *creds,
 			LogDebug(COMPONENT_FSAL, "%s failed with %d", caller,
 				 rc);
 		if (rc == RPC_CANTSEND)
-			pxy_rpc_need_sock();
+			pxy_rpc_need_sock(ctx->conn);
 	} while ((rc == RPC_CANTRECV && (ctx->ioresult == -EAGAIN))
 		 || (rc == RPC_CANTSEND));
 
-	PTHREAD_MUTEX_lock(&context_lock);
-	pthread_cond_signal(&need_context);
-	glist_add(&free_contexts, &ctx->calls);
-	PTHREAD_MUTEX_unlock(&context_lock);
+	pxy_put_context(ctx);
 
 	if (rc == RPC_SUCCESS)
 		return res.status;
@@ -830,7 +974,7 @@ static int pxy_setclientid(clientid4 *resultclientid, uint32_t *lease_time)
 	LogEvent(COMPONENT_FSAL,
 		 "Negotiating a new ClientId with the remote server");
 
-	if (getsockname(rpc_sock, &sin, &slen))
+	if (getsockname(pxy_conns[0].sock, &sin, &slen))
 		return -errno;
 
 	snprintf(clientid_name, MAXNAMLEN, "%s(%d) - GANESHA NFSv4 Proxy",
@@ -917,7 +1061,7 @@ static void *pxy_clientid_renewer(void *Arg)
 		/* We've either failed to renew or rpc socket has been
 		 * reconnected and we need new client id */
 		LogDebug(COMPONENT_FSAL, "Need %d new client id", needed);
-		pxy_rpc_need_sock();
+		pxy_rpc_need_sock(&pxy_conns[0]);
 		needed = pxy_setclientid(&newcid, &lease_time);
 		if (!needed) {
 			PTHREAD_MUTEX_lock(&pxy_clientid_mutex);
@@ -930,40 +1074,38 @@ static void *pxy_clientid_renewer(void *Arg)
 
 static void free_io_contexts(void)
 {
-	struct glist_head *cur, *n;
-
-	glist_for_each_safe(cur, n, &free_contexts) {
-		struct pxy_rpc_io_context *c =
-		    container_of(cur, struct pxy_rpc_io_context, calls);
+	uint32_t i;
 
-		glist_del(cur);
-		gsh_free(c);
-	}
+	for (i = 0; i < pxy_ncontexts; i++)
+		gsh_free(pxy_contexts[i]);
+	gsh_free(pxy_contexts);
+	pxy_contexts = NULL;
+	pxy_ncontexts = 0;
 }
 
 int pxy_init_rpc(const struct pxy_fsal_module *pm)
 {
 	int rc;
-	int i = 16;
+	uint32_t i;
 
-	glist_init(&rpc_calls);
-	glist_init(&free_contexts);
+	for (i = 0; i < PXY_XID_BUCKETS; i++) {
+		PTHREAD_MUTEX_init(&pxy_calls[i].lock, NULL);
+		glist_init(&pxy_calls[i].calls);
+	}
+
+	pxy_info = &pm->special;
+	pxy_nconns = pm->special.connections;
 
-/**
- * @todo this lock is not really necessary so long as we can
- *       only do one export at a time.  This is a reminder that
- *       there is work to do to get this fnctn to truely be
- *       per export.
- */
-	PTHREAD_MUTEX_lock(&listlock);
 	if (rpc_xid == 0)
 		rpc_xid = getpid() ^ time(NULL);
-	PTHREAD_MUTEX_unlock(&listlock);
 	if (gethostname(pxy_hostname, sizeof(pxy_hostname)))
 		strncpy(pxy_hostname, "NFS-GANESHA/Proxy",
 			sizeof(pxy_hostname));
 
-	for (i = 16; i > 0; i--) {
+	pxy_contexts = gsh_calloc(PXY_CONTEXTS_PER_CONN * pxy_nconns,
+				  sizeof(*pxy_contexts));
+
+	for (i = 0; i < PXY_CONTEXTS_PER_CONN * pxy_nconns; i++) {
 		struct pxy_rpc_io_context *c =
 		    gsh_malloc(sizeof(*c) + pm->special.srv_sendsize +
 			       pm->special.srv_recvsize);
@@ -973,23 +1115,36 @@ int pxy_init_rpc(const struct pxy_fsal_module *pm)
 		}
 		PTHREAD_MUTEX_init(&c->iolock, NULL);
 		PTHREAD_COND_init(&c->iowait, NULL);
+		c->conn = NULL;
+		c->busy = 0;
 		c->nfs_prog = pm->special.srv_prognum;
 		c->sendbuf_sz = pm->special.srv_sendsize;
 		c->recvbuf_sz = pm->special.srv_recvsize;
 		c->sendbuf = (char *)(c + 1);
 		c->recvbuf = c->sendbuf + c->sendbuf_sz;
 
-		glist_add(&free_contexts, &c->calls);
+		pxy_contexts[pxy_ncontexts++] = c;
 	}
 
-	rc = pthread_create(&pxy_recv_thread, NULL, pxy_rpc_recv,
-			    (void *)&pm->special);
-	if (rc) {
-		LogCrit(COMPONENT_FSAL,
-			"Cannot create proxy rpc receiver thread - %s",
-			strerror(rc));
-		free_io_contexts();
-		return rc;
+	pxy_conns = gsh_calloc(pxy_nconns, sizeof(*pxy_conns));
+
+	for (i = 0; i < pxy_nconns; i++) {
+		struct pxy_conn *conn = &pxy_conns[i];
+
+		PTHREAD_MUTEX_init(&conn->lock, NULL);
+		PTHREAD_COND_init(&conn->ready, NULL);
+		conn->sock = -1;
+		conn->idx = i;
+
+		rc = pthread_create(&conn->recv_thread, NULL, pxy_rpc_recv,
+				    conn);
+		if (rc) {
+			LogCrit(COMPONENT_FSAL,
+				"Cannot create proxy rpc receiver thread - %s",
+				strerror(rc));
+			free_io_contexts();
+			return rc;
+		}
 	}
 
 	rc = pthread_create(&pxy_renewer_thread, NULL, pxy_clientid_renewer,
@@ -1019,10 +1174,9 @@ static fsal_status_t pxy_make_object(struct fsal_export *export,
 }
 
 /*
- * NULL parent pointer is only used by lookup_path when it starts
- * from the root handle and has its own export pointer, everybody
- * else is supposed to provide a real parent pointer and matching
- * export
+ * NULL parent pointer starts from the root handle, the caller then
+ * provides its own export pointer, everybody else is supposed to
+ * provide a real parent pointer and matching export
  */
 static fsal_status_t pxy_lookup_impl(struct fsal_obj_handle *parent,
 				     struct fsal_export *export,
@@ -1531,6 +1685,9 @@ static bool xdr_readdirres(XDR *x, nfs_resop4 *rdres)
 	return xdr_nfs_resop4(x, rdres) && xdr_nfs_resop4(x, rdres + 1);
 }
 
+/* Room kept in the reply buffer for the RPC and compound headers */
+#define PXY_READDIR_HEADROOM 512
+
 /*
  * Trying to guess how many entries can fit into a readdir buffer
  * is complicated and usually results in either gross over-allocation
@@ -1549,6 +1706,7 @@ static fsal_status_t pxy_do_readdir(struct pxy_obj_handle *ph,
 #define FSAL_READDIR_NB_OP_ALLOC 2
 	nfs_argop4 argoparray[FSAL_READDIR_NB_OP_ALLOC];
 	nfs_resop4 resoparray[FSAL_READDIR_NB_OP_ALLOC];
+	READDIR4args *rdarg;
 	READDIR4resok *rdok;
 	fsal_status_t st = { ERR_FSAL_NO_ERROR, 0 };
 
@@ -1556,7 +1714,13 @@ static fsal_status_t pxy_do_readdir(struct pxy_obj_handle *ph,
 	rdok = &resoparray[opcnt].nfs_resop4_u.opreaddir.READDIR4res_u.resok4;
 	rdok->reply.entries = NULL;
 	COMPOUNDV4_ARG_ADD_OP_READDIR(opcnt, argoparray, *cookie,
-				      pxy_bitmap_getattr);
+				      pxy_bitmap_readdir);
+	/* Let the server fill as much of the reply buffer as it will */
+	rdarg = &argoparray[opcnt - 1].nfs_argop4_u.opreaddir;
+	if (pxy_info->srv_recvsize - PXY_READDIR_HEADROOM > rdarg->maxcount) {
+		rdarg->maxcount = pxy_info->srv_recvsize - PXY_READDIR_HEADROOM;
+		rdarg->dircount = rdarg->maxcount;
+	}
 
 	rc = pxy_nfsv4_call(ph->obj.export, op_ctx->creds, opcnt, argoparray,
 			    resoparray);
@@ -1569,6 +1733,11 @@ static fsal_status_t pxy_do_readdir(struct pxy_obj_handle *ph,
 		struct attrlist attrs;
 		char name[MAXNAMLEN + 1];
 		struct fsal_obj_handle *handle;
+		char padfilehandle[NFS4_FHSIZE];
+		nfs_fh4 fh4 = {
+			.nfs_fh4_len = 0,
+			.nfs_fh4_val = padfilehandle
+		};
 		bool cb_rc;
 
 		/* UTF8 name does not include trailing 0 */
@@ -1577,20 +1746,25 @@ static fsal_status_t pxy_do_readdir(struct pxy_obj_handle *ph,
 		memcpy(name, e4->name.utf8string_val, e4->name.utf8string_len);
 		name[e4->name.utf8string_len] = '\0';
 
-		if (nfs4_Fattr_To_FSAL_attr(&attrs, &e4->attrs, NULL))
+		if (nfs4_Fattr_To_FSAL_attr_fh(&attrs, &e4->attrs, &fh4, NULL))
 			return fsalstat(ERR_FSAL_FAULT, 0);
 
 		*cookie = e4->cookie;
 
-		/** @todo FSF: this could be handled by getting handle as part
-		 *             of readdir attributes. However, if acl is
-		 *             requested, we might get it separately to
-		 *             avoid over large READDIR response.
+		/* A server may leave out the handle of some entries, such
+		 * as mount points, look those up.
 		 */
-		st = pxy_lookup_impl(&ph->obj, op_ctx->fsal_export,
-				     op_ctx->creds, name, &handle, NULL);
-		if (FSAL_IS_ERROR(st))
+		if (fh4.nfs_fh4_len != 0)
+			st = pxy_make_object(op_ctx->fsal_export, &e4->attrs,
+					     &fh4, &handle, NULL);
+		else
+			st = pxy_lookup_impl(&ph->obj, op_ctx->fsal_export,
+					     op_ctx->creds, name, &handle,
+					     NULL);
+		if (FSAL_IS_ERROR(st)) {
+			fsal_release_attrs(&attrs);
 			break;
+		}
 
 		cb_rc = cb(name, handle, &attrs, cbarg, e4->cookie);
 
@@ -2125,57 +2299,99 @@ static struct pxy_obj_handle *pxy_alloc_handle(struct fsal_export *exp,
 /* export methods that create object handles
  */
 
+/* LOOKUPs sent in one compound when walking a path */
+#define PXY_LOOKUP_BATCH 16
+
 fsal_status_t pxy_lookup_path(struct fsal_export *exp_hdl,
 			      const char *path,
 			      struct fsal_obj_handle **handle,
 			      struct attrlist *attrs_out)
 {
-	struct fsal_obj_handle *next;
-	struct fsal_obj_handle *parent = NULL;
+	int rc;
+	uint32_t opcnt, nlookups;
+	GETATTR4resok *atok = NULL;
+	GETFH4resok *fhok;
+	nfs_argop4 argoparray[PXY_LOOKUP_BATCH + 3];
+	nfs_resop4 resoparray[PXY_LOOKUP_BATCH + 3];
+	char fattr_blob[FATTR_BLOB_SZ];
+	char padfilehandle[NFS4_FHSIZE];
+	char dirfilehandle[NFS4_FHSIZE];
+	nfs_fh4 dirfh = { .nfs_fh4_len = 0, .nfs_fh4_val = dirfilehandle };
+	bool at_root = true;
 	char *saved;
 	char *pcopy;
-	char *p, *pnext;
-	struct user_cred *creds = op_ctx->creds;
+	char *p;
 
 	pcopy = gsh_strdup(path);
 
+	/* The components are looked up PXY_LOOKUP_BATCH at a time, each
+	 * compound starting from the handle the previous one ended on.
+	 * Only the terminal element gets its attributes.
+	 */
 	p = strtok_r(pcopy, "/", &saved);
-	while (p) {
-		if (strcmp(p, "..") == 0) {
-			/* Don't allow lookup of ".." */
-			LogInfo(COMPONENT_FSAL,
-				"Attempt to use \"..\" element in path %s",
-				path);
-			gsh_free(pcopy);
-			return fsalstat(ERR_FSAL_ACCESS, EACCES);
+	do {
+		opcnt = 0;
+		nlookups = 0;
+
+		if (at_root)
+			COMPOUNDV4_ARG_ADD_OP_PUTROOTFH(opcnt, argoparray);
+		else
+			COMPOUNDV4_ARG_ADD_OP_PUTFH(opcnt, argoparray, dirfh);
+
+		while (p && nlookups < PXY_LOOKUP_BATCH) {
+			if (strcmp(p, "..") == 0) {
+				/* Don't allow lookup of ".." */
+				LogInfo(COMPONENT_FSAL,
+					"Attempt to use \"..\" element in path %s",
+					path);
+				gsh_free(pcopy);
+				return fsalstat(ERR_FSAL_ACCESS, EACCES);
+			}
+			/* Note that if any element is a symlink, the LOOKUP
+			 * that follows it fails, thus no security exposure.
+			 */
+			if (strcmp(p, ".") != 0) {
+				COMPOUNDV4_ARG_ADD_OP_LOOKUP(opcnt, argoparray,
+							     p);
+				nlookups++;
+			}
+			p = strtok_r(NULL, "/", &saved);
 		}
-		/* Get the next token now, so we know if we are at the
-		 * terminal token or not.
-		 */
-		pnext = strtok_r(NULL, "/", &saved);
 
-		/* Note that if any element is a symlink, the following will
-		 * fail, thus no security exposure. Only pass back the
-		 * attributes of the terminal lookup.
-		 */
-		fsal_status_t st = pxy_lookup_impl(parent, exp_hdl, creds, p,
-						   &next, pnext == NULL ?
-						   attrs_out : NULL);
-		if (FSAL_IS_ERROR(st)) {
+		fhok = &resoparray[opcnt].nfs_resop4_u.opgetfh.GETFH4res_u
+								.resok4;
+		COMPOUNDV4_ARG_ADD_OP_GETFH(opcnt, argoparray);
+		fhok->object.nfs_fh4_val = (char *)padfilehandle;
+		fhok->object.nfs_fh4_len = sizeof(padfilehandle);
+
+		if (p == NULL) {
+			atok = pxy_fill_getattr_reply(resoparray + opcnt,
+						      fattr_blob,
+						      sizeof(fattr_blob));
+			COMPOUNDV4_ARG_ADD_OP_GETATTR(opcnt, argoparray,
+						      pxy_bitmap_getattr);
+		}
+
+		rc = pxy_nfsv4_call(exp_hdl, op_ctx->creds, opcnt, argoparray,
+				    resoparray);
+		if (rc != NFS4_OK) {
 			gsh_free(pcopy);
-			return st;
+			return nfsstat4_to_fsal(rc);
 		}
 
-		p = pnext;
-		parent = next;
-	}
+		memcpy(dirfilehandle, fhok->object.nfs_fh4_val,
+		       fhok->object.nfs_fh4_len);
+		dirfh.nfs_fh4_len = fhok->object.nfs_fh4_len;
+		at_root = false;
+	} while (p != NULL);
+
 	/* The final element could be a symlink, but either way we are called
 	 * will not work with a symlink, so no security exposure there.
 	 */
 
 	gsh_free(pcopy);
-	*handle = next;
-	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+	return pxy_make_object(exp_hdl, &atok->obj_attributes, &fhok->object,
+			       handle, attrs_out);
 }
 
 /*
@@ -35,6 +35,7 @@
 #include "config.h"
 #include "fsal.h"
 #include "nfs4.h"
+#include "gsh_hash.h"
 #include "handle_mapping.h"
 #include "handle_mapping_db.h"
 #include "handle_mapping_internal.h"
@@ -105,26 +106,21 @@ static void handle_free(handle_pool_entry_t *p_handle)
 static uint32_t hash_digest_idx(hash_parameter_t *p_conf,
 				struct gsh_buffdesc *p_key)
 {
-	uint32_t hash;
 	digest_pool_entry_t *p_digest = (digest_pool_entry_t *) p_key->addr;
 
-	hash = ((unsigned long)p_digest->nfs23_digest.object_id ^
-		(unsigned int)p_digest->nfs23_digest.handle_hash);
-	hash = (743 * hash + 1999) % p_conf->index_size;
-
-	return hash;
+	return gsh_hash_u64_2(p_digest->nfs23_digest.object_id,
+			      p_digest->nfs23_digest.handle_hash, 0) %
+	       p_conf->index_size;
 
 }
 
 static unsigned long hash_digest_rbt(hash_parameter_t *p_conf,
 				     struct gsh_buffdesc *p_key)
 {
-	unsigned long hash;
 	digest_pool_entry_t *p_digest = (digest_pool_entry_t *) p_key->addr;
 
-	hash = (257 * p_digest->nfs23_digest.object_id + 541);
-
-	return hash;
+	return gsh_hash_u64_2(p_digest->nfs23_digest.object_id,
+			      p_digest->nfs23_digest.handle_hash, 0);
 }
 
 static int cmp_digest(struct gsh_buffdesc *p_key1, struct gsh_buffdesc *p_key2)
@@ -52,7 +52,7 @@ typedef struct handle_map_param__ {
 	unsigned int hashtable_size;
 
 	/* synchronous insert mode */
-	int synchronous_insert;
+	bool synchronous_insert;
 
 } handle_map_param_t;
 
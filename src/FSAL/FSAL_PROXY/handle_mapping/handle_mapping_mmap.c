@@ -0,0 +1,616 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file handle_mapping_mmap.c
+ *
+ * @brief Handle map store in memory-mapped, append-only logs
+ *
+ * This implements handle_mapping_db.h without sqlite3.  The map is
+ * sharded over HandleMap_DB_Count log files, a digest always going to
+ * the same one.  A log is a sequence of records written through a
+ * shared mapping: an insert record holds the digest and the handle, a
+ * delete record the digest only.  Each shard keeps an open-addressing
+ * index of its live digests, pointing to their insert records.
+ *
+ * At startup each log is replayed up to its first torn or corrupt
+ * record, and a log holding more dead records than live ones is
+ * rewritten with the live ones only.
+ *
+ * An insert or delete only copies its record into the mapping, under
+ * the lock of its shard.  With synchronous inserts, an insert then
+ * waits for the log to be on disk: inserts arriving while an fdatasync
+ * runs share the next one.  The address space of a whole log is
+ * reserved when it is opened, so the mapping never moves.
+ */
+#include "config.h"
+#include "handle_mapping.h"
+#include "handle_mapping_db.h"
+#include "handle_mapping_internal.h"
+#include "gsh_oa_hash.h"
+#include "city.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <fnmatch.h>
+#include <pthread.h>
+
+#define LOG_FILE_PREFIX "handlemap.log"
+
+/* Largest size of a log, all of it mapped when it is opened */
+#define LOG_MAP_SIZE (1ULL << 30)
+
+/* A log grows by this much at a time */
+#define LOG_GROW_SIZE (1U << 20)
+
+#define REC_INSERT 0x484d4931	/* "HMI1" */
+#define REC_DELETE 0x484d4431	/* "HMD1" */
+
+/* A record of a log, 8 byte aligned */
+struct hdlmap_rec {
+	uint32_t magic;
+	uint32_t fh_len;
+	uint64_t object_id;
+	uint32_t handle_hash;
+	/* Hash of the record with check set to 0 */
+	uint32_t check;
+	char fh_data[];
+};
+
+/* A live digest, in the index of its shard */
+struct hdlmap_ent {
+	uint64_t object_id;
+	uint32_t handle_hash;
+	/* Offset of its insert record */
+	uint64_t off;
+};
+
+struct hdlmap_shard {
+	pthread_mutex_t mtx;
+	pthread_cond_t sync_done;
+	char path[MAXPATHLEN + 1];
+	int fd;
+	char *map;
+	/* Size of the file, and where the next record goes */
+	uint64_t size;
+	uint64_t tail;
+	/* Records a rewrite would drop */
+	uint64_t dead;
+	struct gsh_oa_hash index;
+	/* Records appended and known on disk, and an fdatasync runs */
+	uint64_t appended;
+	uint64_t synced;
+	bool syncing;
+};
+
+static struct hdlmap_shard shards[MAX_DB];
+static unsigned int nb_shards;
+static bool synchronous;
+
+static inline size_t rec_size(uint32_t fh_len)
+{
+	return (sizeof(struct hdlmap_rec) + fh_len + 7) & ~(size_t)7;
+}
+
+static uint32_t rec_check(const struct hdlmap_rec *rec)
+{
+	struct hdlmap_rec hdr = *rec;
+	uint64_t h;
+
+	hdr.check = 0;
+	h = CityHash64WithSeed((const char *)&hdr, sizeof(hdr), 0);
+	return CityHash64WithSeed(rec->fh_data, rec->fh_len, h);
+}
+
+static uint64_t digest_hash(uint64_t object_id, uint32_t handle_hash)
+{
+	return CityHash64WithSeed((const char *)&object_id, sizeof(object_id),
+				  handle_hash);
+}
+
+static bool ent_match(const void *item, const void *key)
+{
+	const struct hdlmap_ent *e = item;
+	const struct hdlmap_ent *k = key;
+
+	return e->object_id == k->object_id && e->handle_hash == k->handle_hash;
+}
+
+static struct hdlmap_ent *index_lookup(struct hdlmap_shard *s, uint64_t hash,
+				       uint64_t object_id, uint32_t handle_hash)
+{
+	struct hdlmap_ent key = {
+		.object_id = object_id,
+		.handle_hash = handle_hash
+	};
+
+	return gsh_oa_lookup(&s->index, hash, ent_match, &key);
+}
+
+static void index_add(struct hdlmap_shard *s, uint64_t hash,
+		      uint64_t object_id, uint32_t handle_hash, uint64_t off)
+{
+	struct hdlmap_ent *e = gsh_malloc(sizeof(*e));
+
+	e->object_id = object_id;
+	e->handle_hash = handle_hash;
+	e->off = off;
+	gsh_oa_insert(&s->index, hash, e);
+}
+
+/* Iterate the live entries of a shard, starting with *ix at 0 */
+static struct hdlmap_ent *next_ent(struct hdlmap_shard *s, uint32_t *ix)
+{
+	while (*ix < (s->index.mask + 1) * GSH_OA_GROUP) {
+		uint32_t cur = (*ix)++;
+
+		if (!(s->index.ctrl[cur] & 0x80))
+			return s->index.slots[cur].item;
+	}
+
+	return NULL;
+}
+
+static int shard_map(struct hdlmap_shard *s)
+{
+	struct stat st;
+
+	s->fd = open(s->path, O_RDWR | O_CREAT, 0600);
+	if (s->fd < 0) {
+		LogCrit(COMPONENT_FSAL, "ERROR: could not open %s: %s",
+			s->path, strerror(errno));
+		return HANDLEMAP_SYSTEM_ERROR;
+	}
+
+	if (fstat(s->fd, &st) != 0 || st.st_size > LOG_MAP_SIZE) {
+		LogCrit(COMPONENT_FSAL, "ERROR: %s is unusable", s->path);
+		close(s->fd);
+		return HANDLEMAP_SYSTEM_ERROR;
+	}
+
+	s->map = mmap(NULL, LOG_MAP_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED,
+		      s->fd, 0);
+	if (s->map == MAP_FAILED) {
+		LogCrit(COMPONENT_FSAL, "ERROR: could not map %s: %s",
+			s->path, strerror(errno));
+		close(s->fd);
+		return HANDLEMAP_SYSTEM_ERROR;
+	}
+
+	s->size = st.st_size;
+	return HANDLEMAP_SUCCESS;
+}
+
+static void shard_unmap(struct hdlmap_shard *s)
+{
+	munmap(s->map, LOG_MAP_SIZE);
+	close(s->fd);
+}
+
+/* Rebuild the index from the log */
+static void shard_replay(struct hdlmap_shard *s)
+{
+	uint64_t off = 0;
+
+	while (off + sizeof(struct hdlmap_rec) <= s->size) {
+		struct hdlmap_rec *rec = (struct hdlmap_rec *)(s->map + off);
+		struct hdlmap_ent *e;
+		uint64_t hash;
+
+		if ((rec->magic != REC_INSERT && rec->magic != REC_DELETE) ||
+		    rec->fh_len > NFS4_FHSIZE ||
+		    off + rec_size(rec->fh_len) > s->size ||
+		    rec->check != rec_check(rec))
+			break;
+
+		hash = digest_hash(rec->object_id, rec->handle_hash);
+		e = index_lookup(s, hash, rec->object_id, rec->handle_hash);
+
+		if (rec->magic == REC_INSERT) {
+			if (e != NULL) {
+				e->off = off;
+				s->dead++;
+			} else {
+				index_add(s, hash, rec->object_id,
+					  rec->handle_hash, off);
+			}
+		} else {
+			s->dead++;
+			if (e != NULL) {
+				gsh_oa_remove(&s->index, hash, e);
+				gsh_free(e);
+				s->dead++;
+			}
+		}
+
+		off += rec_size(rec->fh_len);
+	}
+
+	/* Past the last record is zero filled, unless an append was
+	 * interrupted
+	 */
+	if (off + sizeof(uint32_t) <= s->size &&
+	    *(uint32_t *)(s->map + off) != 0) {
+		LogEvent(COMPONENT_FSAL,
+			 "Dropping %"PRIu64" bytes after the last record of %s",
+			 s->size - off, s->path);
+		memset(s->map + off, 0, s->size - off);
+	}
+
+	s->tail = off;
+}
+
+/* Rewrite a log with its live records only */
+static int shard_compact(struct hdlmap_shard *s)
+{
+	char tmp_path[MAXPATHLEN + 1];
+	struct hdlmap_ent *e;
+	uint64_t off = 0;
+	uint32_t ix;
+	int fd;
+
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", s->path);
+
+	fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0)
+		goto err;
+
+	ix = 0;
+	while ((e = next_ent(s, &ix)) != NULL) {
+		struct hdlmap_rec *rec = (struct hdlmap_rec *)(s->map + e->off);
+
+		if (write(fd, rec, rec_size(rec->fh_len)) !=
+		    rec_size(rec->fh_len))
+			goto err_close;
+	}
+
+	if (fdatasync(fd) != 0)
+		goto err_close;
+
+	if (close(fd) != 0)
+		goto err_unlink;
+
+	if (rename(tmp_path, s->path) != 0)
+		goto err_unlink;
+
+	/* The records were written in index order */
+	ix = 0;
+	while ((e = next_ent(s, &ix)) != NULL) {
+		struct hdlmap_rec *rec = (struct hdlmap_rec *)(s->map + e->off);
+
+		e->off = off;
+		off += rec_size(rec->fh_len);
+	}
+
+	shard_unmap(s);
+	LogInfo(COMPONENT_FSAL, "Rewrote %s, dropping %"PRIu64" records",
+		s->path, s->dead);
+	s->dead = 0;
+	s->tail = off;
+	return shard_map(s);
+
+ err_close:
+	close(fd);
+ err_unlink:
+	unlink(tmp_path);
+ err:
+	/* The log is still whole, keep using it */
+	LogWarn(COMPONENT_FSAL, "Could not rewrite %s: %s", s->path,
+		strerror(errno));
+	return HANDLEMAP_SUCCESS;
+}
+
+/* Append a record, called with the shard locked */
+static int shard_append(struct hdlmap_shard *s, uint32_t magic,
+			const nfs23_map_handle_t *digest, const void *data,
+			uint32_t len, uint64_t *off)
+{
+	size_t size = rec_size(len);
+	struct hdlmap_rec *rec;
+
+	if (s->tail + size > s->size) {
+		uint64_t new_size = s->size + LOG_GROW_SIZE;
+
+		if (s->tail + size > new_size)
+			new_size = s->tail + size;
+
+		if (new_size > LOG_MAP_SIZE) {
+			LogCrit(COMPONENT_FSAL,
+				"ERROR: %s is full, restart to compact it",
+				s->path);
+			return HANDLEMAP_SYSTEM_ERROR;
+		}
+
+		if (ftruncate(s->fd, new_size) != 0) {
+			LogCrit(COMPONENT_FSAL, "ERROR: could not grow %s: %s",
+				s->path, strerror(errno));
+			return HANDLEMAP_SYSTEM_ERROR;
+		}
+		s->size = new_size;
+	}
+
+	rec = (struct hdlmap_rec *)(s->map + s->tail);
+	rec->fh_len = len;
+	rec->object_id = digest->object_id;
+	rec->handle_hash = digest->handle_hash;
+	if (len != 0)
+		memcpy(rec->fh_data, data, len);
+	rec->magic = magic;
+	rec->check = rec_check(rec);
+
+	*off = s->tail;
+	s->tail += size;
+	s->appended++;
+
+	return HANDLEMAP_SUCCESS;
+}
+
+/**
+ * @brief Wait for a log to be on disk up to a record
+ *
+ * Called with the shard locked, which is dropped around the
+ * fdatasync.  The first caller issues it, the ones arriving meanwhile
+ * wait for it and share the next one.
+ *
+ * @param[in] s       The shard
+ * @param[in] record  Count of records that must be on disk
+ */
+static int shard_sync(struct hdlmap_shard *s, uint64_t record)
+{
+	uint64_t target;
+	int rc;
+
+	while (s->synced < record) {
+		if (s->syncing) {
+			pthread_cond_wait(&s->sync_done, &s->mtx);
+			continue;
+		}
+
+		target = s->appended;
+		s->syncing = true;
+		PTHREAD_MUTEX_unlock(&s->mtx);
+
+		rc = fdatasync(s->fd);
+
+		PTHREAD_MUTEX_lock(&s->mtx);
+		s->syncing = false;
+		pthread_cond_broadcast(&s->sync_done);
+
+		if (rc != 0) {
+			LogCrit(COMPONENT_FSAL, "ERROR: could not sync %s: %s",
+				s->path, strerror(errno));
+			return HANDLEMAP_SYSTEM_ERROR;
+		}
+		if (target > s->synced)
+			s->synced = target;
+	}
+
+	return HANDLEMAP_SUCCESS;
+}
+
+static struct hdlmap_shard *digest_shard(const nfs23_map_handle_t *digest,
+					 uint64_t *hash)
+{
+	*hash = digest_hash(digest->object_id, digest->handle_hash);
+	return &shards[*hash % nb_shards];
+}
+
+/**
+ * count the number of logs in a given directory
+ */
+int handlemap_db_count(const char *dir)
+{
+	DIR *dir_hdl;
+	struct dirent *direntry;
+	char db_pattern[MAXPATHLEN + 1];
+	unsigned int count = 0;
+
+	snprintf(db_pattern, MAXPATHLEN, "%s.*[0-9]", LOG_FILE_PREFIX);
+
+	dir_hdl = opendir(dir);
+
+	if (dir_hdl == NULL) {
+		LogCrit(COMPONENT_FSAL,
+			"ERROR: could not access directory %s: %s", dir,
+			strerror(errno));
+		return -HANDLEMAP_SYSTEM_ERROR;
+	}
+
+	while ((direntry = readdir(dir_hdl)) != NULL) {
+		if (!fnmatch(db_pattern, direntry->d_name, FNM_PATHNAME))
+			count++;
+	}
+
+	closedir(dir_hdl);
+
+	return count;
+}
+
+/**
+ * Open, replay and if needed rewrite the logs.
+ * tmp_dir is not used, logs are rewritten next to themselves.
+ */
+int handlemap_db_init(const char *db_dir, const char *tmp_dir,
+		      unsigned int db_count, int synchronous_insert)
+{
+	unsigned int i;
+	int rc;
+
+	if (db_count > MAX_DB)
+		return HANDLEMAP_INVALID_PARAM;
+
+	nb_shards = db_count;
+	synchronous = synchronous_insert;
+
+	for (i = 0; i < nb_shards; i++) {
+		struct hdlmap_shard *s = &shards[i];
+
+		snprintf(s->path, sizeof(s->path), "%s/%s.%u", db_dir,
+			 LOG_FILE_PREFIX, i);
+
+		rc = shard_map(s);
+		if (rc)
+			return rc;
+
+		PTHREAD_MUTEX_init(&s->mtx, NULL);
+		PTHREAD_COND_init(&s->sync_done, NULL);
+		gsh_oa_init(&s->index, 1024);
+
+		shard_replay(s);
+
+		if (s->dead > s->index.size) {
+			rc = shard_compact(s);
+			if (rc)
+				return rc;
+		}
+	}
+
+	return HANDLEMAP_SUCCESS;
+}
+
+/**
+ * Insert the live mappings of all the logs to the hash table.
+ */
+int handlemap_db_reaload_all(hash_table_t *target_hash)
+{
+	unsigned int i;
+
+	for (i = 0; i < nb_shards; i++) {
+		struct hdlmap_shard *s = &shards[i];
+		struct hdlmap_ent *e;
+		unsigned int count = 0;
+		uint32_t ix;
+		int rc;
+
+		ix = 0;
+		while ((e = next_ent(s, &ix)) != NULL) {
+			struct hdlmap_rec *rec =
+			    (struct hdlmap_rec *)(s->map + e->off);
+
+			rc = handle_mapping_hash_add(target_hash,
+						     rec->object_id,
+						     rec->handle_hash,
+						     rec->fh_data,
+						     rec->fh_len);
+			if (rc && rc != HANDLEMAP_EXISTS)
+				return rc;
+			count++;
+		}
+
+		LogEvent(COMPONENT_FSAL, "Reloaded %u items from %s", count,
+			 s->path);
+	}
+
+	return HANDLEMAP_SUCCESS;
+}
+
+/**
+ * Append an insert record, and with synchronous inserts wait for it
+ * to be on disk.
+ */
+int handlemap_db_insert(nfs23_map_handle_t *p_in_nfs23_digest,
+			const void *data, uint32_t len)
+{
+	uint64_t hash, off, mine;
+	struct hdlmap_shard *s = digest_shard(p_in_nfs23_digest, &hash);
+	struct hdlmap_ent *e;
+	int rc;
+
+	if (len > NFS4_FHSIZE)
+		return HANDLEMAP_INVALID_PARAM;
+
+	PTHREAD_MUTEX_lock(&s->mtx);
+
+	rc = shard_append(s, REC_INSERT, p_in_nfs23_digest, data, len, &off);
+	if (rc == HANDLEMAP_SUCCESS) {
+		mine = s->appended;
+		e = index_lookup(s, hash, p_in_nfs23_digest->object_id,
+				 p_in_nfs23_digest->handle_hash);
+		if (e != NULL) {
+			e->off = off;
+			s->dead++;
+		} else {
+			index_add(s, hash, p_in_nfs23_digest->object_id,
+				  p_in_nfs23_digest->handle_hash, off);
+		}
+
+		if (synchronous)
+			rc = shard_sync(s, mine);
+	}
+
+	PTHREAD_MUTEX_unlock(&s->mtx);
+
+	return rc;
+}
+
+/**
+ * Append a delete record (always asynchronous).
+ */
+int handlemap_db_delete(nfs23_map_handle_t *p_in_nfs23_digest)
+{
+	uint64_t hash, off;
+	struct hdlmap_shard *s = digest_shard(p_in_nfs23_digest, &hash);
+	struct hdlmap_ent *e;
+	int rc;
+
+	PTHREAD_MUTEX_lock(&s->mtx);
+
+	rc = shard_append(s, REC_DELETE, p_in_nfs23_digest, NULL, 0, &off);
+	if (rc == HANDLEMAP_SUCCESS) {
+		s->dead++;
+		e = index_lookup(s, hash, p_in_nfs23_digest->object_id,
+				 p_in_nfs23_digest->handle_hash);
+		if (e != NULL) {
+			gsh_oa_remove(&s->index, hash, e);
+			gsh_free(e);
+			s->dead++;
+		}
+	}
+
+	PTHREAD_MUTEX_unlock(&s->mtx);
+
+	return rc;
+}
+
+/**
+ * Wait for all the logs to be on disk.
+ */
+int handlemap_db_flush(void)
+{
+	unsigned int i;
+	int rc = HANDLEMAP_SUCCESS;
+
+	for (i = 0; i < nb_shards; i++) {
+		struct hdlmap_shard *s = &shards[i];
+		int rc2;
+
+		PTHREAD_MUTEX_lock(&s->mtx);
+		rc2 = shard_sync(s, s->appended);
+		PTHREAD_MUTEX_unlock(&s->mtx);
+
+		if (rc2)
+			rc = rc2;
+	}
+
+	return rc;
+}
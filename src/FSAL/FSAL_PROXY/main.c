@@ -91,6 +91,8 @@ static struct config_item proxy_remote_params[] = {
 		       pxy_client_params, use_privileged_client_port),
 	CONF_ITEM_UI32("RPC_Client_Timeout", 1, 60*4, 60,
 		       pxy_client_params, srv_timeout),
+	CONF_ITEM_UI32("Connections", 1, 16, 1,
+		       pxy_client_params, connections),
 #ifdef _USE_GSSRPC
 	CONF_ITEM_STR("Remote_PrincipalName", 0, MAXNAMLEN, NULL,
 		      pxy_client_params, remote_principal),
@@ -116,6 +118,8 @@ static struct config_item proxy_remote_params[] = {
 		       pxy_client_params, hdlmap.database_count),
 	CONF_ITEM_UI32("HandleMap_HashTable_Size", 1, 127, 103,
 		       pxy_client_params, hdlmap.hashtable_size),
+	CONF_ITEM_BOOL("HandleMap_Synchronous_Insert", false,
+		       pxy_client_params, hdlmap.synchronous_insert),
 #endif
 	CONFIG_EOL
 };
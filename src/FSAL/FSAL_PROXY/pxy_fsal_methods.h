@@ -12,6 +12,8 @@ struct pxy_client_params {
 	unsigned int srv_sendsize;
 	unsigned int srv_recvsize;
 	unsigned int srv_timeout;
+	/* Connections to the server, calls are spread over them */
+	unsigned int connections;
 	unsigned short srv_port;
 	unsigned int use_privileged_client_port;
 	char *remote_principal;
@@ -89,6 +89,7 @@ static void release(struct fsal_export *exp_hdl)
 	if (myself->export_path != NULL)
 		gsh_free(myself->export_path);
 
+	PTHREAD_RWLOCK_destroy(&myself->handle_lock);
 	gsh_free(myself);
 }
 
@@ -329,6 +330,7 @@ fsal_status_t pseudofs_create_export(struct fsal_module *fsal_hdl,
 
 	fsal_export_init(&myself->export);
 	pseudofs_export_ops_init(&myself->export.exp_ops);
+	pseudofs_handle_index_init(myself);
 
 	retval = fsal_attach_export(fsal_hdl, &myself->export.exports);
 
@@ -338,6 +340,7 @@ fsal_status_t pseudofs_create_export(struct fsal_module *fsal_hdl,
 			 "Could not attach export");
 		gsh_free(myself->export_path);
 		gsh_free(myself->root_handle);
+		PTHREAD_RWLOCK_destroy(&myself->handle_lock);
 		free_export_ops(&myself->export);
 		gsh_free(myself);	/* elvis has left the building */
 
@@ -77,6 +77,18 @@ pseudofs_i_cmpf(const struct avltree_node *lhs,
 	return 1;
 }
 
+static inline int
+pseudofs_h_cmpf(const struct avltree_node *lhs,
+		const struct avltree_node *rhs)
+{
+	struct pseudo_fsal_obj_handle *lk, *rk;
+
+	lk = avltree_container_of(lhs, struct pseudo_fsal_obj_handle, avl_h);
+	rk = avltree_container_of(rhs, struct pseudo_fsal_obj_handle, avl_h);
+
+	return memcmp(lk->handle, rk->handle, V4_FH_OPAQUE_SIZE);
+}
+
 static inline struct avltree_node *
 avltree_inline_name_lookup(
 	const struct avltree_node *key,
@@ -179,6 +191,50 @@ static int fullpath(struct display_buffer *pathbuf,
 	return b_left;
 }
 
+/**
+ * @brief Initialize the handle index of an export
+ *
+ * @param[in] myself The export
+ */
+void pseudofs_handle_index_init(struct pseudofs_fsal_export *myself)
+{
+	PTHREAD_RWLOCK_init(&myself->handle_lock, NULL);
+	avltree_init(&myself->avl_handle, pseudofs_h_cmpf, 0 /* flags */);
+}
+
+/**
+ * @brief Add a handle to the handle index of its export
+ *
+ * A node made again at the path of one not yet released has the same
+ * wire handle, and takes its place.
+ *
+ * @param[in] hdl     The handle
+ * @param[in] exp_hdl Its export
+ */
+static void pseudofs_index_handle(struct pseudo_fsal_obj_handle *hdl,
+				  struct fsal_export *exp_hdl)
+{
+	struct pseudofs_fsal_export *myself =
+		container_of(exp_hdl, struct pseudofs_fsal_export, export);
+	struct avltree_node *node;
+	struct pseudo_fsal_obj_handle *old;
+
+	hdl->export = myself;
+
+	PTHREAD_RWLOCK_wrlock(&myself->handle_lock);
+
+	node = avltree_insert(&hdl->avl_h, &myself->avl_handle);
+	if (node != NULL) {
+		old = avltree_container_of(node, struct pseudo_fsal_obj_handle,
+					   avl_h);
+		avltree_replace(node, &hdl->avl_h, &myself->avl_handle);
+		old->inhandles = false;
+	}
+	hdl->inhandles = true;
+
+	PTHREAD_RWLOCK_unlock(&myself->handle_lock);
+}
+
 /* alloc_handle
  * allocate and fill in a handle
  */
@@ -279,6 +335,7 @@ static struct pseudo_fsal_obj_handle
 
 	fsal_obj_handle_init(&hdl->obj_handle, exp_hdl, DIRECTORY);
 	pseudofs_handle_ops_init(&hdl->obj_handle.obj_ops);
+	pseudofs_index_handle(hdl, exp_hdl);
 
 	avltree_init(&hdl->avl_name, pseudofs_n_cmpf, 0 /* flags */);
 	avltree_init(&hdl->avl_index, pseudofs_i_cmpf, 0 /* flags */);
@@ -663,6 +720,7 @@ static void handle_to_key(struct fsal_obj_handle *obj_hdl,
 static void release(struct fsal_obj_handle *obj_hdl)
 {
 	struct pseudo_fsal_obj_handle *myself;
+	struct pseudofs_fsal_export *exp;
 
 	myself = container_of(obj_hdl,
 			      struct pseudo_fsal_obj_handle,
@@ -676,6 +734,15 @@ static void release(struct fsal_obj_handle *obj_hdl)
 		return;
 	}
 
+	exp = myself->export;
+
+	PTHREAD_RWLOCK_wrlock(&exp->handle_lock);
+	if (myself->inhandles) {
+		avltree_remove(&myself->avl_h, &exp->avl_handle);
+		myself->inhandles = false;
+	}
+	PTHREAD_RWLOCK_unlock(&exp->handle_lock);
+
 	fsal_obj_handle_fini(obj_hdl);
 
 	LogDebug(COMPONENT_FSAL,
@@ -763,9 +830,9 @@ fsal_status_t pseudofs_create_handle(struct fsal_export *exp_hdl,
 				   struct fsal_obj_handle **handle,
 				   struct attrlist *attrs_out)
 {
-	struct glist_head *glist;
-	struct fsal_obj_handle *hdl;
-	struct pseudo_fsal_obj_handle *my_hdl;
+	struct pseudofs_fsal_export *myself;
+	struct pseudo_fsal_obj_handle *my_hdl, key[1];
+	struct avltree_node *node;
 
 	*handle = NULL;
 
@@ -778,39 +845,34 @@ fsal_status_t pseudofs_create_handle(struct fsal_export *exp_hdl,
 		return fsalstat(ERR_FSAL_BADHANDLE, 0);
 	}
 
-	PTHREAD_RWLOCK_rdlock(&exp_hdl->fsal->lock);
+	myself = container_of(exp_hdl, struct pseudofs_fsal_export, export);
+	key->handle = hdl_desc->addr;
 
-	glist_for_each(glist, &exp_hdl->fsal->handles) {
-		hdl = glist_entry(glist, struct fsal_obj_handle, handles);
+	PTHREAD_RWLOCK_rdlock(&myself->handle_lock);
 
-		my_hdl = container_of(hdl,
-				      struct pseudo_fsal_obj_handle,
-				      obj_handle);
+	node = avltree_lookup(&key->avl_h, &myself->avl_handle);
+	if (node == NULL) {
+		PTHREAD_RWLOCK_unlock(&myself->handle_lock);
 
-		if (memcmp(my_hdl->handle,
-			   hdl_desc->addr,
-			   V4_FH_OPAQUE_SIZE) == 0) {
-			LogDebug(COMPONENT_FSAL,
-				 "Found hdl=%p name=%s",
-				 my_hdl, my_hdl->name);
+		LogDebug(COMPONENT_FSAL,
+			"Could not find handle");
 
-			*handle = hdl;
+		return fsalstat(ERR_FSAL_STALE, ESTALE);
+	}
 
-			PTHREAD_RWLOCK_unlock(&exp_hdl->fsal->lock);
+	my_hdl = avltree_container_of(node, struct pseudo_fsal_obj_handle,
+				      avl_h);
 
-			if (attrs_out != NULL) {
-				fsal_copy_attrs(attrs_out, &my_hdl->attributes,
-						false);
-			}
+	LogDebug(COMPONENT_FSAL,
+		 "Found hdl=%p name=%s",
+		 my_hdl, my_hdl->name);
 
-			return fsalstat(ERR_FSAL_NO_ERROR, 0);
-		}
-	}
+	*handle = &my_hdl->obj_handle;
 
-	LogDebug(COMPONENT_FSAL,
-		"Could not find handle");
+	PTHREAD_RWLOCK_unlock(&myself->handle_lock);
 
-	PTHREAD_RWLOCK_unlock(&exp_hdl->fsal->lock);
+	if (attrs_out != NULL)
+		fsal_copy_attrs(attrs_out, &my_hdl->attributes, false);
 
-	return fsalstat(ERR_FSAL_STALE, ESTALE);
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
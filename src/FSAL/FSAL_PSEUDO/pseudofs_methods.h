@@ -41,8 +41,14 @@ struct pseudofs_fsal_export {
 	struct fsal_export export;
 	char *export_path;
 	struct pseudo_fsal_obj_handle *root_handle;
+	/* The handles of the export by their wire handle, for
+	 * create_handle */
+	pthread_rwlock_t handle_lock;
+	struct avltree avl_handle;
 };
 
+void pseudofs_handle_index_init(struct pseudofs_fsal_export *myself);
+
 fsal_status_t pseudofs_lookup_path(struct fsal_export *exp_hdl,
 				 const char *path,
 				 struct fsal_obj_handle **handle,
@@ -70,11 +76,14 @@ struct pseudo_fsal_obj_handle {
 	struct avltree avl_index;
 	struct avltree_node avl_n;
 	struct avltree_node avl_i;
+	struct avltree_node avl_h; /* in avl_handle of the export */
+	struct pseudofs_fsal_export *export;
 	uint32_t index; /* index in parent */
 	uint32_t next_i; /* next child index */
 	uint32_t numlinks;
 	char *name;
 	bool inavl;
+	bool inhandles; /* in avl_handle of the export */
 };
 
 static inline bool pseudofs_unopenable_type(object_file_type_t type)
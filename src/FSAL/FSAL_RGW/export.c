@@ -108,8 +108,8 @@ static fsal_status_t lookup_path(struct fsal_export *export_pub,
 	 * suspicious, so let RGW figure it out (hopefully, that does not
 	 * leak refs)
 	 */
-	rc = rgw_lookup(export->rgw_fs, export->rgw_fs->root_fh, path,
-			&rgw_fh, RGW_LOOKUP_FLAG_NONE);
+	rc = rgw_fsal_lookup(export->rgw_fs, export->rgw_fs->root_fh, path,
+			     &rgw_fh, NULL, 0, RGW_LOOKUP_FLAG_NONE);
 	if (rc < 0)
 		return rgw2fsal_error(rc);
 
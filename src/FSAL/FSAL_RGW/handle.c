@@ -52,6 +52,8 @@ static void release(struct fsal_obj_handle *obj_hdl)
 	struct rgw_export *export = obj->export;
 
 	if (obj->rgw_fh != export->rgw_fs->root_fh) {
+		rgw_stage_free(obj);
+
 		/* release RGW ref */
 		(void) rgw_fh_rele(export->rgw_fs, obj->rgw_fh,
 				0 /* flags */);
@@ -63,20 +65,23 @@ static void release(struct fsal_obj_handle *obj_hdl)
 }
 
 /**
- * @brief Look up an object by name
- *
- * This function looks up an object by name in a directory.
+ * @brief Look up an object by name, maybe with its listed attributes
  *
  * @param[in]     dir_hdl    The directory in which to look up the object.
  * @param[in]     path       The name to look up.
+ * @param[in]     listed     Attributes from a bucket listing, or NULL
+ * @param[in]     st_mask    Fields of listed that are valid
+ * @param[in]     flags      RGW_LOOKUP_FLAG_* hints
  * @param[in,out] obj_hdl    The looked up object.
  * @param[in,out] attrs_out  Optional attributes for newly created object
  *
  * @return FSAL status codes.
  */
-static fsal_status_t lookup(struct fsal_obj_handle *dir_hdl,
-			const char *path, struct fsal_obj_handle **obj_hdl,
-			struct attrlist *attrs_out)
+static fsal_status_t lookup_int(struct fsal_obj_handle *dir_hdl,
+				const char *path, struct stat *listed,
+				uint32_t st_mask, uint32_t flags,
+				struct fsal_obj_handle **obj_hdl,
+				struct attrlist *attrs_out)
 {
 	int rc;
 	struct stat st;
@@ -92,10 +97,12 @@ static fsal_status_t lookup(struct fsal_obj_handle *dir_hdl,
 	LogFullDebug(COMPONENT_FSAL,
 		"%s enter dir_hdl %p path %s", __func__, dir_hdl, path);
 
-	/* XXX presently, we can only fake attrs--maybe rgw_lookup should
-	 * take struct stat pointer OUT as libcephfs' does */
-	rc = rgw_lookup(export->rgw_fs, dir->rgw_fh, path, &rgw_fh,
-			RGW_LOOKUP_FLAG_NONE);
+	/* A listed object is not looked up in the bucket again, the
+	 * handle takes the listed attributes, and getattr then only reads
+	 * them back.
+	 */
+	rc = rgw_fsal_lookup(export->rgw_fs, dir->rgw_fh, path, &rgw_fh,
+			     listed, st_mask, flags);
 	if (rc < 0)
 		return rgw2fsal_error(rc);
 
@@ -121,6 +128,26 @@ static fsal_status_t lookup(struct fsal_obj_handle *dir_hdl,
 	return fsalstat(0, 0);
 }
 
+/**
+ * @brief Look up an object by name
+ *
+ * This function looks up an object by name in a directory.
+ *
+ * @param[in]     dir_hdl    The directory in which to look up the object.
+ * @param[in]     path       The name to look up.
+ * @param[in,out] obj_hdl    The looked up object.
+ * @param[in,out] attrs_out  Optional attributes for newly created object
+ *
+ * @return FSAL status codes.
+ */
+static fsal_status_t lookup(struct fsal_obj_handle *dir_hdl,
+			const char *path, struct fsal_obj_handle **obj_hdl,
+			struct attrlist *attrs_out)
+{
+	return lookup_int(dir_hdl, path, NULL, 0, RGW_LOOKUP_FLAG_NONE,
+			  obj_hdl, attrs_out);
+}
+
 struct rgw_cb_arg {
 	fsal_readdir_cb cb;
 	void *fsal_arg;
@@ -128,7 +155,12 @@ struct rgw_cb_arg {
 	attrmask_t attrmask;
 };
 
+#ifdef RGW_READDIR_ATTRS
+static bool rgw_cb(const char *name, void *arg, uint64_t offset,
+		   struct stat *st, uint32_t st_mask, uint32_t flags)
+#else
 static bool rgw_cb(const char *name, void *arg, uint64_t offset)
+#endif
 {
 	struct rgw_cb_arg *rgw_cb_arg = arg;
 	struct fsal_obj_handle *obj;
@@ -138,7 +170,18 @@ static bool rgw_cb(const char *name, void *arg, uint64_t offset)
 
 	fsal_prepare_attrs(&attrs, rgw_cb_arg->attrmask);
 
+#ifdef RGW_READDIR_ATTRS
+	/* The size and times came with the listing, so the object need
+	 * not be looked up again.
+	 */
+	status = lookup_int(rgw_cb_arg->dir_hdl, name, st, st_mask,
+			    RGW_LOOKUP_FLAG_RCB |
+			    (flags & (RGW_LOOKUP_FLAG_DIR |
+				      RGW_LOOKUP_FLAG_FILE)),
+			    &obj, &attrs);
+#else
 	status = lookup(rgw_cb_arg->dir_hdl, name, &obj, &attrs);
+#endif
 	if (FSAL_IS_ERROR(status))
 		return false;
 
@@ -367,6 +410,9 @@ static fsal_status_t getattrs(struct fsal_obj_handle *obj_hdl,
 		return rgw2fsal_error(rc);
 	}
 
+	/* Staged writes extend the file already */
+	rgw_stage_size(handle, &st);
+
 	posix2fsal_attributes(&st, attrs);
 
 	/* Make sure ATTR_RDATTR_ERR is cleared on success. */
@@ -443,7 +489,7 @@ fsal_status_t rgw_fsal_setattr2(struct fsal_obj_handle *obj_hdl,
 		 */
 		status = fsal_find_fd(NULL, obj_hdl, NULL, &handle->share,
 				bypass, state, FSAL_O_RDWR, NULL, NULL,
-				&has_lock, &need_fsync, &closefd, false);
+				0, &has_lock, &need_fsync, &closefd, false);
 
 		if (FSAL_IS_ERROR(status)) {
 			LogFullDebug(COMPONENT_FSAL,
@@ -456,6 +502,11 @@ fsal_status_t rgw_fsal_setattr2(struct fsal_obj_handle *obj_hdl,
 	memset(&st, 0, sizeof(struct stat));
 
 	if (FSAL_TEST_MASK(attrib_set->mask, ATTR_SIZE)) {
+		/* Staged writes before the new size */
+		status = rgw_stage_flush(handle, false);
+		if (FSAL_IS_ERROR(status))
+			goto out;
+
 		rc = rgw_truncate(export->rgw_fs, handle->rgw_fh,
 				attrib_set->filesize, RGW_TRUNCATE_FLAG_NONE);
 
@@ -1230,6 +1281,12 @@ fsal_status_t rgw_fsal_read2(struct fsal_obj_handle *obj_hdl,
 		return fsalstat(ERR_FSAL_NOTSUPP, 0);
 	}
 
+	/* Staged writes first */
+	fsal_status_t status = rgw_stage_flush(handle, false);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
 	/* RGW does not support a file descriptor abstraction--so
 	 * reads are handle based */
 
@@ -1298,6 +1355,20 @@ fsal_status_t rgw_fsal_write2(struct fsal_obj_handle *obj_hdl,
 	if (*fsal_stable)
 		openflags |= FSAL_O_SYNC;
 
+	fsal_status_t status;
+
+	if (RGWFSM.write_part_size != 0 && !*fsal_stable) {
+		status = rgw_stage_write(handle, offset, buffer_size, buffer,
+					 wrote_amount);
+		*fsal_stable = false;
+		return status;
+	}
+
+	/* Staged writes first, librgw takes writes in order */
+	status = rgw_stage_flush(handle, false);
+	if (FSAL_IS_ERROR(status))
+		return status;
+
 	/* XXX note no call to fsal_find_fd (or wrapper) */
 
 	int rc = rgw_write(export->rgw_fs, handle->rgw_fh, offset,
@@ -1348,6 +1419,12 @@ fsal_status_t rgw_fsal_commit2(struct fsal_obj_handle *obj_hdl,
 		"%s enter obj_hdl %p offset %"PRIx64" length %zx",
 		__func__, obj_hdl, (uint64_t) offset, length);
 
+	/* The staged writes this COMMIT covers */
+	fsal_status_t status = rgw_stage_flush(handle, false);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
 	rc = rgw_commit(export->rgw_fs, handle->rgw_fh, offset, length,
 			RGW_FSYNC_FLAG_NONE);
 	if (rc < 0)
@@ -1396,6 +1473,7 @@ fsal_status_t rgw_fsal_close2(struct fsal_obj_handle *obj_hdl,
 {
 	int rc;
 	struct rgw_open_state *open_state;
+	fsal_status_t status;
 
 	struct rgw_export *export =
 	    container_of(op_ctx->fsal_export, struct rgw_export, export);
@@ -1428,6 +1506,13 @@ fsal_status_t rgw_fsal_close2(struct fsal_obj_handle *obj_hdl,
 		}
 	}
 
+	/* The upload ends with the staged writes */
+	status = rgw_stage_flush(handle, true);
+	if (FSAL_IS_ERROR(status))
+		LogWarn(COMPONENT_FSAL,
+			"Staged writes of %p failed on close: %s",
+			obj_hdl, fsal_err_txt(status));
+
 	rc = rgw_close(export->rgw_fs, handle->rgw_fh, RGW_CLOSE_FLAG_NONE);
 	if (rc < 0)
 		return rgw2fsal_error(rc);
@@ -48,6 +48,13 @@
 #error rados/rgw_file.h version unsupported (require >= 1.1.0)
 #endif
 
+/* From 1.1.4, readdir hands out the attributes the bucket listing
+ * returned, and lookup can take them instead of a HEAD of the object.
+ */
+#if (LIBRGW_FILE_VER_MINOR > 1) || (LIBRGW_FILE_VER_EXTRA >= 4)
+#define RGW_READDIR_ATTRS 1
+#endif
+
 /**
  * RGW Main (global) module object
  */
@@ -59,6 +66,10 @@ struct rgw_fsal_module {
 	char *name;
 	char *cluster;
 	char *init_args;
+	/** Size of the parts unstable writes are staged in, 0 for none */
+	uint32_t write_part_size;
+	/** Parts staged per file at most */
+	uint32_t write_parts;
 	librgw_t rgw;
 };
 extern struct rgw_fsal_module RGWFSM;
@@ -94,6 +105,7 @@ struct rgw_handle {
 					 *< belongs to */
 	struct fsal_share share;
 	fsal_openflags_t openflags;
+	struct rgw_stage *stage;	/*< Staged writes, see stage.c */
 };
 
 /**
@@ -143,8 +155,29 @@ int construct_handle(struct rgw_export *export,
 		     struct rgw_handle **obj);
 
 fsal_status_t rgw2fsal_error(const int errorcode);
+
+static inline int rgw_fsal_lookup(struct rgw_fs *rgw_fs,
+				  struct rgw_file_handle *parent_fh,
+				  const char *path,
+				  struct rgw_file_handle **fh,
+				  struct stat *st, uint32_t st_mask,
+				  uint32_t flags)
+{
+#ifdef RGW_READDIR_ATTRS
+	return rgw_lookup(rgw_fs, parent_fh, path, fh, st, st_mask, flags);
+#else
+	return rgw_lookup(rgw_fs, parent_fh, path, fh, flags);
+#endif
+}
 void export_ops_init(struct export_ops *ops);
 void handle_ops_init(struct fsal_obj_ops *ops);
+
+fsal_status_t rgw_stage_write(struct rgw_handle *handle, uint64_t offset,
+			      size_t buffer_size, void *buffer,
+			      size_t *wrote_amount);
+fsal_status_t rgw_stage_flush(struct rgw_handle *handle, bool close);
+void rgw_stage_size(struct rgw_handle *handle, struct stat *st);
+void rgw_stage_free(struct rgw_handle *handle);
 struct state_t *alloc_state(struct fsal_export *exp_hdl,
 			enum state_type state_type,
 			struct state_t *related_state);
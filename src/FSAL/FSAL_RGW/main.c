@@ -82,6 +82,11 @@ static struct config_item rgw_items[] = {
 			rgw_fsal_module, fs_info.umask),
 	CONF_ITEM_MODE("xattr_access_rights", 0,
 			rgw_fsal_module, fs_info.xattr_access_rights),
+	CONF_ITEM_UI32("Write_Part_Size", 0, 64 * 1024 * 1024,
+		       4 * 1024 * 1024,
+		       rgw_fsal_module, write_part_size),
+	CONF_ITEM_UI32("Write_Parts", 1, 64, 4,
+		       rgw_fsal_module, write_parts),
 	CONFIG_EOL
 };
 
@@ -0,0 +1,420 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/* stage.c
+ * Staging of unstable writes to RGW objects
+ *
+ * librgw uploads the writes of an object as one stream, in order.
+ * NFS clients send many small WRITEs, several at once and so not
+ * always in order.  An unstable WRITE is copied into a part of up to
+ * Write_Part_Size bytes and returns at once.  A part is handed to
+ * librgw in one rgw_write once it is full and everything before it
+ * was written.  The WRITE that completes a part does so, while the
+ * following WRITEs keep filling the next parts, so the client's
+ * stream and the upload overlap.
+ *
+ * At most Write_Parts parts are staged per file.  A WRITE that would
+ * need another and does not continue staged data waits for a gap to
+ * be filled.  If that takes too long, or a WRITE overlaps what is
+ * staged or written, everything staged is handed over as it is, and
+ * the WRITE goes straight to librgw.
+ *
+ * COMMIT, READ, truncation and close hand over what is staged first.
+ */
+
+#include "config.h"
+
+#include "fsal.h"
+#include "internal.h"
+
+/* Seconds a WRITE waits for a gap before the staged parts */
+#define RGW_STAGE_WAIT 1
+
+/**
+ * @brief Data staged for one rgw_write
+ */
+struct rgw_part {
+	struct glist_head list;
+	uint64_t offset;
+	size_t len;
+	char data[];
+};
+
+/**
+ * @brief Write staging state of a file
+ */
+struct rgw_stage {
+	pthread_mutex_t mtx;
+	pthread_cond_t cv;
+	/** Staged parts, by offset, not overlapping */
+	struct glist_head parts;
+	uint32_t nparts;
+	/** End of the data handed to librgw */
+	uint64_t written;
+	/** A thread is handing parts to librgw */
+	bool writing;
+	/** First error librgw returned, for the next COMMIT */
+	int error;
+};
+
+static struct rgw_stage *stage_get(struct rgw_handle *handle)
+{
+	struct rgw_stage *stage, *old;
+
+	stage = atomic_fetch_voidptr((void **)&handle->stage);
+	if (stage != NULL)
+		return stage;
+
+	stage = gsh_calloc(1, sizeof(*stage));
+	PTHREAD_MUTEX_init(&stage->mtx, NULL);
+	PTHREAD_COND_init(&stage->cv, NULL);
+	glist_init(&stage->parts);
+
+	if (atomic_cas_voidptr((void **)&handle->stage, NULL, stage))
+		return stage;
+
+	/* Another WRITE got there first */
+	old = atomic_fetch_voidptr((void **)&handle->stage);
+	PTHREAD_COND_destroy(&stage->cv);
+	PTHREAD_MUTEX_destroy(&stage->mtx);
+	gsh_free(stage);
+
+	return old;
+}
+
+/**
+ * @brief Find the part staged data at offset would be added to
+ */
+
+static struct rgw_part *stage_tail(struct rgw_stage *stage, uint64_t offset)
+{
+	struct glist_head *node;
+	struct rgw_part *part;
+
+	glist_for_each(node, &stage->parts) {
+		part = glist_entry(node, struct rgw_part, list);
+		if (part->offset + part->len == offset)
+			return part;
+		if (part->offset > offset)
+			break;
+	}
+
+	return NULL;
+}
+
+static bool stage_overlaps(struct rgw_stage *stage, uint64_t offset,
+			   uint64_t end)
+{
+	struct glist_head *node;
+	struct rgw_part *part;
+
+	if (offset < stage->written)
+		return true;
+
+	glist_for_each(node, &stage->parts) {
+		part = glist_entry(node, struct rgw_part, list);
+		if (part->offset >= end)
+			break;
+		if (offset < part->offset + part->len)
+			return true;
+	}
+
+	return false;
+}
+
+/**
+ * @brief Whether the first part can be handed to librgw
+ *
+ * It must follow what was written, and no more can be added to it.
+ */
+
+static bool stage_ready(struct rgw_stage *stage)
+{
+	struct rgw_part *part, *next;
+
+	part = glist_first_entry(&stage->parts, struct rgw_part, list);
+	if (part == NULL || part->offset != stage->written)
+		return false;
+
+	if (part->len == RGWFSM.write_part_size)
+		return true;
+
+	if (part->list.next == &stage->parts)
+		return false;
+
+	next = glist_entry(part->list.next, struct rgw_part, list);
+
+	return next->offset == part->offset + part->len;
+}
+
+static void stage_add(struct rgw_stage *stage, uint64_t offset, size_t len,
+		      char *data)
+{
+	uint32_t part_size = RGWFSM.write_part_size;
+	struct glist_head *node;
+	struct rgw_part *part;
+	size_t n;
+
+	while (len > 0) {
+		part = stage_tail(stage, offset);
+
+		if (part == NULL || part->len == part_size) {
+			part = gsh_malloc(sizeof(*part) + part_size);
+			part->offset = offset;
+			part->len = 0;
+
+			glist_for_each(node, &stage->parts) {
+				if (glist_entry(node, struct rgw_part,
+						list)->offset > offset)
+					break;
+			}
+			glist_add_tail(node, &part->list);
+			stage->nparts++;
+		}
+
+		n = MIN(len, part_size - part->len);
+		memcpy(part->data + part->len, data, n);
+		part->len += n;
+		offset += n;
+		data += n;
+		len -= n;
+	}
+}
+
+/**
+ * @brief Hand staged parts to librgw
+ *
+ * Called with the mutex held and no other thread writing.  The mutex is
+ * dropped around each rgw_write, so WRITEs keep staging meanwhile.
+ *
+ * @param[in] handle  The file
+ * @param[in] stage   Its staging state
+ * @param[in] all     Hand over every part, even behind a gap
+ */
+
+static void stage_drain(struct rgw_handle *handle, struct rgw_stage *stage,
+			bool all)
+{
+	struct rgw_part *part;
+	size_t written;
+	int rc;
+
+	stage->writing = true;
+
+	while (all ? !glist_empty(&stage->parts) : stage_ready(stage)) {
+		part = glist_first_entry(&stage->parts, struct rgw_part, list);
+		glist_del(&part->list);
+		stage->nparts--;
+
+		/* A WRITE arriving meanwhile over this part is a rewrite */
+		stage->written = part->offset + part->len;
+
+		PTHREAD_MUTEX_unlock(&stage->mtx);
+
+		rc = rgw_write(handle->export->rgw_fs, handle->rgw_fh,
+			       part->offset, part->len, &written, part->data,
+			       RGW_WRITE_FLAG_NONE);
+
+		PTHREAD_MUTEX_lock(&stage->mtx);
+
+		if (rc < 0) {
+			LogDebug(COMPONENT_FSAL,
+				 "rgw_write of %zu at %"PRIu64" returned %d",
+				 part->len, part->offset, rc);
+			if (stage->error == 0)
+				stage->error = rc;
+		}
+
+		gsh_free(part);
+
+		/* There is room for a WRITE waiting */
+		pthread_cond_broadcast(&stage->cv);
+	}
+
+	stage->writing = false;
+	pthread_cond_broadcast(&stage->cv);
+}
+
+static void stage_drain_all(struct rgw_handle *handle, struct rgw_stage *stage)
+{
+	while (stage->writing)
+		pthread_cond_wait(&stage->cv, &stage->mtx);
+
+	stage_drain(handle, stage, true);
+}
+
+/**
+ * @brief Stage an unstable write
+ *
+ * @param[in]  handle        File to write
+ * @param[in]  offset        Position at which to write
+ * @param[in]  buffer_size   Amount of data to write
+ * @param[in]  buffer        Data to write
+ * @param[out] wrote_amount  Amount of data written
+ *
+ * @return FSAL status.
+ */
+
+fsal_status_t rgw_stage_write(struct rgw_handle *handle, uint64_t offset,
+			      size_t buffer_size, void *buffer,
+			      size_t *wrote_amount)
+{
+	struct rgw_stage *stage = stage_get(handle);
+	uint64_t end = offset + buffer_size;
+	struct timespec timeout;
+	int rc = 0;
+
+	PTHREAD_MUTEX_lock(&stage->mtx);
+
+	if (stage->error != 0) {
+		rc = stage->error;
+		PTHREAD_MUTEX_unlock(&stage->mtx);
+		return rgw2fsal_error(rc);
+	}
+
+	clock_gettime(CLOCK_REALTIME, &timeout);
+	timeout.tv_sec += RGW_STAGE_WAIT;
+
+	while (stage->nparts >= RGWFSM.write_parts && rc == 0 &&
+	       offset != stage->written && stage_tail(stage, offset) == NULL)
+		rc = pthread_cond_timedwait(&stage->cv, &stage->mtx, &timeout);
+
+	if (stage_overlaps(stage, offset, end) ||
+	    (stage->nparts >= RGWFSM.write_parts &&
+	     offset != stage->written && stage_tail(stage, offset) == NULL)) {
+		/* Whatever is staged goes first, then this write */
+		stage_drain_all(handle, stage);
+
+		rc = rgw_write(handle->export->rgw_fs, handle->rgw_fh, offset,
+			       buffer_size, wrote_amount, buffer,
+			       RGW_WRITE_FLAG_NONE);
+		if (rc >= 0)
+			stage->written = MAX(stage->written,
+					     offset + *wrote_amount);
+
+		PTHREAD_MUTEX_unlock(&stage->mtx);
+
+		if (rc < 0)
+			return rgw2fsal_error(rc);
+
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+	}
+
+	stage_add(stage, offset, buffer_size, buffer);
+	*wrote_amount = buffer_size;
+
+	if (!stage->writing)
+		stage_drain(handle, stage, false);
+
+	PTHREAD_MUTEX_unlock(&stage->mtx);
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+/**
+ * @brief Hand everything staged for a file to librgw
+ *
+ * @param[in] handle  The file
+ * @param[in] close   The upload ends, the next write starts a new one
+ *
+ * @return The first error librgw returned since the last flush.
+ */
+
+fsal_status_t rgw_stage_flush(struct rgw_handle *handle, bool close)
+{
+	struct rgw_stage *stage = atomic_fetch_voidptr((void **)&handle->stage);
+	int rc;
+
+	if (stage == NULL)
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+	PTHREAD_MUTEX_lock(&stage->mtx);
+
+	stage_drain_all(handle, stage);
+
+	rc = stage->error;
+	stage->error = 0;
+	if (close)
+		stage->written = 0;
+
+	PTHREAD_MUTEX_unlock(&stage->mtx);
+
+	if (rc < 0)
+		return rgw2fsal_error(rc);
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+/**
+ * @brief Account for staged data in the size of a file
+ *
+ * @param[in]     handle  The file
+ * @param[in,out] st      Its attributes from librgw
+ */
+
+void rgw_stage_size(struct rgw_handle *handle, struct stat *st)
+{
+	struct rgw_stage *stage = atomic_fetch_voidptr((void **)&handle->stage);
+	struct rgw_part *part;
+	uint64_t end;
+
+	if (stage == NULL)
+		return;
+
+	PTHREAD_MUTEX_lock(&stage->mtx);
+
+	end = stage->written;
+	if (!glist_empty(&stage->parts)) {
+		part = glist_entry(stage->parts.prev, struct rgw_part, list);
+		end = MAX(end, part->offset + part->len);
+	}
+
+	PTHREAD_MUTEX_unlock(&stage->mtx);
+
+	if (end > st->st_size)
+		st->st_size = end;
+}
+
+/**
+ * @brief Free the staging state of a file being released
+ *
+ * @param[in] handle  The file
+ */
+
+void rgw_stage_free(struct rgw_handle *handle)
+{
+	struct rgw_stage *stage = handle->stage;
+	fsal_status_t status;
+
+	if (stage == NULL)
+		return;
+
+	status = rgw_stage_flush(handle, true);
+	if (FSAL_IS_ERROR(status))
+		LogWarn(COMPONENT_FSAL,
+			"Staged writes of a released file failed: %s",
+			fsal_err_txt(status));
+
+	PTHREAD_COND_destroy(&stage->cv);
+	PTHREAD_MUTEX_destroy(&stage->mtx);
+	gsh_free(stage);
+	handle->stage = NULL;
+}
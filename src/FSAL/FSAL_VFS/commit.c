@@ -0,0 +1,200 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ * -------------
+ */
+
+/* commit.c
+ * Group commit of files
+ *
+ * Clients often send several COMMITs for the same file at once, one
+ * per range or one per client.  Rather than each issuing its own
+ * fsync, the COMMITs of a file line up behind each other: the first
+ * issues the fsync and the ones arriving while it runs wait for it to
+ * end.  Their writes completed before they arrived, but maybe after
+ * the running fsync started, so one of them then issues the next
+ * fsync, covering all of them.  A COMMIT that arrives before an fsync
+ * starts shares its result.
+ *
+ * The fsyncs issued, the COMMITs that shared one and the time spent
+ * in both are logged when the module is unloaded.
+ */
+
+#include "config.h"
+
+#include "fsal.h"
+#include "vfs_methods.h"
+
+/**
+ * @brief Group commit state of a file
+ */
+struct vfs_commit {
+	pthread_mutex_t mtx;
+	pthread_cond_t cv;
+	/** An fsync is running */
+	bool running;
+	/** Number of the last fsync started */
+	uint64_t started;
+	/** Number of the last fsync completed */
+	uint64_t completed;
+	/** Number of the last fsync that failed, and how */
+	uint64_t failed;
+	fsal_status_t error;
+};
+
+static struct {
+	uint64_t fsyncs;
+	uint64_t shared;
+	uint64_t fsync_ns;
+	uint64_t wait_ns;
+} commit_stats;
+
+void vfs_commit_shutdown(void)
+{
+	uint64_t fsyncs = atomic_fetch_uint64_t(&commit_stats.fsyncs);
+	uint64_t shared = atomic_fetch_uint64_t(&commit_stats.shared);
+
+	if (fsyncs == 0)
+		return;
+
+	LogInfo(COMPONENT_FSAL,
+		"Commits: %"PRIu64" fsyncs averaging %"PRIu64
+		" usec, %"PRIu64" commits shared one averaging %"PRIu64
+		" usec",
+		fsyncs,
+		atomic_fetch_uint64_t(&commit_stats.fsync_ns) / fsyncs /
+		NS_PER_USEC,
+		shared,
+		shared != 0
+		    ? atomic_fetch_uint64_t(&commit_stats.wait_ns) / shared /
+		      NS_PER_USEC
+		    : 0);
+}
+
+static struct vfs_commit *vfs_commit_get(struct vfs_fsal_obj_handle *myself)
+{
+	struct vfs_commit *commit, *old;
+
+	commit = atomic_fetch_voidptr((void **)&myself->u.file.commit);
+	if (commit != NULL)
+		return commit;
+
+	commit = gsh_calloc(1, sizeof(*commit));
+	PTHREAD_MUTEX_init(&commit->mtx, NULL);
+	PTHREAD_COND_init(&commit->cv, NULL);
+
+	if (atomic_cas_voidptr((void **)&myself->u.file.commit, NULL, commit))
+		return commit;
+
+	/* Another COMMIT got there first */
+	old = atomic_fetch_voidptr((void **)&myself->u.file.commit);
+	PTHREAD_COND_destroy(&commit->cv);
+	PTHREAD_MUTEX_destroy(&commit->mtx);
+	gsh_free(commit);
+
+	return old;
+}
+
+/**
+ * @brief Commit a file, sharing an fsync with concurrent COMMITs
+ *
+ * @param[in] myself   File to commit
+ * @param[in] do_sync  Issues the fsync
+ *
+ * @return FSAL status of the fsync that covered this COMMIT.
+ */
+
+fsal_status_t vfs_group_commit(struct vfs_fsal_obj_handle *myself,
+			       vfs_sync_func do_sync)
+{
+	struct vfs_commit *commit = vfs_commit_get(myself);
+	struct timespec start, sync_start, end;
+	fsal_status_t status = fsalstat(ERR_FSAL_NO_ERROR, 0);
+	uint64_t needed, mine;
+
+	now(&start);
+
+	PTHREAD_MUTEX_lock(&commit->mtx);
+
+	/* The writes being committed are done, only an fsync that has not
+	 * started yet is sure to cover them.
+	 */
+	needed = commit->started + 1;
+
+	while (commit->completed < needed) {
+		if (commit->running) {
+			pthread_cond_wait(&commit->cv, &commit->mtx);
+			continue;
+		}
+
+		mine = ++commit->started;
+		commit->running = true;
+		PTHREAD_MUTEX_unlock(&commit->mtx);
+
+		now(&sync_start);
+		status = do_sync(myself);
+
+		now(&end);
+		(void) atomic_inc_uint64_t(&commit_stats.fsyncs);
+		(void) atomic_add_uint64_t(&commit_stats.fsync_ns,
+					   timespec_diff(&sync_start, &end));
+
+		PTHREAD_MUTEX_lock(&commit->mtx);
+		commit->running = false;
+		commit->completed = mine;
+		if (FSAL_IS_ERROR(status)) {
+			commit->failed = mine;
+			commit->error = status;
+		}
+		pthread_cond_broadcast(&commit->cv);
+		PTHREAD_MUTEX_unlock(&commit->mtx);
+
+		return status;
+	}
+
+	/* An fsync started after we arrived, and may have failed */
+	if (commit->failed >= needed)
+		status = commit->error;
+
+	PTHREAD_MUTEX_unlock(&commit->mtx);
+
+	now(&end);
+	(void) atomic_inc_uint64_t(&commit_stats.shared);
+	(void) atomic_add_uint64_t(&commit_stats.wait_ns,
+				   timespec_diff(&start, &end));
+
+	return status;
+}
+
+/**
+ * @brief Free the group commit state of a file being released
+ *
+ * @param[in] myself  The file
+ */
+
+void vfs_commit_free(struct vfs_fsal_obj_handle *myself)
+{
+	struct vfs_commit *commit = myself->u.file.commit;
+
+	if (commit == NULL)
+		return;
+
+	PTHREAD_COND_destroy(&commit->cv);
+	PTHREAD_MUTEX_destroy(&commit->mtx);
+	gsh_free(commit);
+	myself->u.file.commit = NULL;
+}
@@ -38,11 +38,29 @@
 #include "fsal_convert.h"
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/sysmacros.h>
+#include <os/xattr.h>
 #include "FSAL/fsal_commonlib.h"
 #include "vfs_methods.h"
 #include "os/subr.h"
 #include "sal_data.h"
 
+/* Alignment O_DIRECT wants of offsets, sizes and buffers */
+#define VFS_DIRECT_ALIGN 4096
+
+/* Where an exclusive create keeps its verifier, out of reach of clients */
+#define VFS_VERIFIER_XATTR "trusted.ganesha.verifier"
+
+/**
+ * @brief Whether files are opened for direct I/O in the current export
+ */
+static inline bool vfs_direct_io(struct vfs_fsal_obj_handle *myself)
+{
+	return myself->obj_handle.type == REGULAR_FILE &&
+	       op_ctx != NULL && op_ctx->fsal_export != NULL &&
+	       EXPORT_VFS_FROM_FSAL(op_ctx->fsal_export)->direct_io;
+}
+
 fsal_status_t vfs_open_my_fd(struct vfs_fsal_obj_handle *myself,
 			     fsal_openflags_t openflags,
 			     int posix_flags,
@@ -51,6 +69,7 @@ fsal_status_t vfs_open_my_fd(struct vfs_fsal_obj_handle *myself,
 	int fd;
 	fsal_errors_t fsal_error = ERR_FSAL_NO_ERROR;
 	int retval = 0;
+	bool direct = vfs_direct_io(myself);
 
 	LogFullDebug(COMPONENT_FSAL,
 		     "my_fd->fd = %d openflags = %x, posix_flags = %x",
@@ -63,7 +82,15 @@ fsal_status_t vfs_open_my_fd(struct vfs_fsal_obj_handle *myself,
 		     "openflags = %x, posix_flags = %x",
 		     openflags, posix_flags);
 
-	fd = vfs_fsal_open(myself, posix_flags, &fsal_error);
+	fd = vfs_fsal_open(myself, direct ? posix_flags | O_DIRECT
+						: posix_flags,
+			   &fsal_error);
+
+	if (fd == -EINVAL && direct) {
+		/* The filesystem can't do direct I/O */
+		direct = false;
+		fd = vfs_fsal_open(myself, posix_flags, &fsal_error);
+	}
 
 	if (fd < 0) {
 		retval = -fd;
@@ -80,17 +107,46 @@ fsal_status_t vfs_open_my_fd(struct vfs_fsal_obj_handle *myself,
 				fd, openflags);
 		my_fd->fd = fd;
 		my_fd->openflags = openflags;
+		my_fd->direct = direct;
 	}
 
 	return fsalstat(fsal_error, retval);
 }
 
+/**
+ * @brief Check the exclusive create verifier of an open file
+ *
+ * A file created with native_exclusive_create has its verifier in
+ * VFS_VERIFIER_XATTR.  Others, and those on filesystems without
+ * trusted xattrs, have it in their times.
+ *
+ * @param[in] fd       Open file
+ * @param[in] stat     Its stat
+ * @param[in] verifier Verifier of the create
+ *
+ * @retval true if verifier matches
+ */
+
+static bool vfs_check_verifier_fd(int fd, struct stat *stat,
+				  fsal_verifier_t verifier)
+{
+	char file_verifier[sizeof(fsal_verifier_t)];
+
+	if (fgetxattr(fd, VFS_VERIFIER_XATTR, file_verifier,
+		      sizeof(file_verifier)) == sizeof(file_verifier))
+		return memcmp(file_verifier, verifier,
+			      sizeof(file_verifier)) == 0;
+
+	return check_verifier_stat(stat, verifier);
+}
+
 fsal_status_t vfs_close_my_fd(struct vfs_fd *my_fd)
 {
 	fsal_errors_t fsal_error = ERR_FSAL_NO_ERROR;
 	int retval = 0;
 
 	if (my_fd->fd >= 0 && my_fd->openflags != FSAL_O_CLOSED) {
+		vfs_uring_forget(my_fd->fd);
 		retval = close(my_fd->fd);
 		if (retval < 0) {
 			retval = errno;
@@ -103,6 +159,77 @@ fsal_status_t vfs_close_my_fd(struct vfs_fd *my_fd)
 	return fsalstat(fsal_error, retval);
 }
 
+/**
+ * @brief Close the O_PATH fd of a regular file
+ *
+ * Called with the object lock held for write.
+ *
+ * @param[in] myself  File on which to operate
+ */
+
+void vfs_close_path_fd(struct vfs_fsal_obj_handle *myself)
+{
+	if (myself->u.file.path_fd < 0)
+		return;
+
+	close(myself->u.file.path_fd);
+	myself->u.file.path_fd = -1;
+	(void) atomic_dec_size_t(&open_fd_count);
+}
+
+/**
+ * @brief Find an fd a regular file can be stat'ed by
+ *
+ * When the global fd is closed, getattr would otherwise open the file,
+ * stat it and close it again.  An O_PATH fd is kept for it instead,
+ * counted among the open fds, so the LRU closes it along with the
+ * global fd once the file has not been used for a while.  It is only
+ * good for stat, not for the ioctls of a sub-FSAL's getattrs.
+ *
+ * @param[in] myself  File on which to operate
+ *
+ * @return The fd, with the object lock held, or -1 with no lock held if
+ *         the global fd must be used instead.
+ */
+
+static int vfs_path_fd(struct vfs_fsal_obj_handle *myself)
+{
+	struct fsal_obj_handle *obj_hdl = &myself->obj_handle;
+	fsal_errors_t fsal_error;
+	int fd;
+
+	PTHREAD_RWLOCK_rdlock(&obj_hdl->lock);
+
+	if (myself->u.file.fd.openflags != FSAL_O_CLOSED)
+		goto out;
+
+	if (myself->u.file.path_fd >= 0)
+		return myself->u.file.path_fd;
+
+	PTHREAD_RWLOCK_unlock(&obj_hdl->lock);
+	PTHREAD_RWLOCK_wrlock(&obj_hdl->lock);
+
+	/* Someone may have opened the file or its O_PATH fd meanwhile */
+	if (myself->u.file.fd.openflags != FSAL_O_CLOSED)
+		goto out;
+
+	if (myself->u.file.path_fd >= 0)
+		return myself->u.file.path_fd;
+
+	fd = vfs_fsal_open(myself, O_PATH | O_NOACCESS, &fsal_error);
+	if (fd < 0)
+		goto out;
+
+	myself->u.file.path_fd = fd;
+	(void) atomic_inc_size_t(&open_fd_count);
+
+	return fd;
+
+ out:
+	PTHREAD_RWLOCK_unlock(&obj_hdl->lock);
+	return -1;
+}
+
 /**
  * @brief Function to open an fsal_obj_handle's global file descriptor.
  *
@@ -124,6 +251,10 @@ static fsal_status_t vfs_open_func(struct fsal_obj_handle *obj_hdl,
 
 	fsal2posix_openflags(openflags, &posix_flags);
 
+	/* A shared fd starts out zeroed, see struct fsal_fd_cache */
+	if (fd->openflags == FSAL_O_CLOSED)
+		((struct vfs_fd *)fd)->fd = -1;
+
 	return vfs_open_my_fd(myself, openflags, posix_flags,
 			      (struct vfs_fd *)fd);
 }
@@ -168,6 +299,8 @@ fsal_status_t vfs_close(struct fsal_obj_handle *obj_hdl)
 	PTHREAD_RWLOCK_wrlock(&obj_hdl->lock);
 
 	status = vfs_close_my_fd(&myself->u.file.fd);
+	vfs_close_path_fd(myself);
+	fsal_fd_cache_close(obj_hdl);
 
 	PTHREAD_RWLOCK_unlock(&obj_hdl->lock);
 
@@ -335,6 +468,7 @@ fsal_status_t vfs_open2(struct fsal_obj_handle *obj_hdl,
 	vfs_file_handle_t *fh = NULL;
 	bool truncated;
 	bool created = false;
+	bool native_verifier;
 
 	if (state != NULL)
 		my_fd = (struct vfs_fd *)(state + 1);
@@ -351,7 +485,16 @@ fsal_status_t vfs_open2(struct fsal_obj_handle *obj_hdl,
 	LogFullDebug(COMPONENT_FSAL,
 		     truncated ? "Truncate" : "No truncate");
 
-	if (createmode >= FSAL_EXCLUSIVE) {
+	/* The verifier goes in an xattr with the create if the export
+	 * says so, and otherwise in the times with the other attributes.
+	 */
+	native_verifier = createmode >= FSAL_EXCLUSIVE &&
+			  createmode != FSAL_EXCLUSIVE_9P &&
+			  op_ctx->fsal_export->exp_ops.fs_supports(
+					op_ctx->fsal_export,
+					fso_native_exclusive_create);
+
+	if (createmode >= FSAL_EXCLUSIVE && !native_verifier) {
 		/* Now fixup attrs for verifier if exclusive create */
 		set_common_verifier(attrib_set, verifier);
 	}
@@ -444,7 +587,8 @@ fsal_status_t vfs_open2(struct fsal_obj_handle *obj_hdl,
 			if (!FSAL_IS_ERROR(status) &&
 			    createmode >= FSAL_EXCLUSIVE &&
 			    createmode != FSAL_EXCLUSIVE_9P &&
-			    !check_verifier_stat(&stat, verifier)) {
+			    !vfs_check_verifier_fd(my_fd->fd, &stat,
+						   verifier)) {
 				/* Verifier didn't match, return EEXIST */
 				status =
 				    fsalstat(posix2fsal_error(EEXIST), EEXIST);
@@ -573,11 +717,23 @@ fsal_status_t vfs_open2(struct fsal_obj_handle *obj_hdl,
 	if (createmode != FSAL_NO_CREATE)
 		fsal_set_credentials(op_ctx->creds);
 
+	if (EXPORT_VFS_FROM_FSAL(op_ctx->fsal_export)->direct_io)
+		posix_flags |= O_DIRECT;
+
 	if ((posix_flags & O_CREAT) != 0)
 		fd = openat(dir_fd, name, posix_flags, unix_mode);
 	else
 		fd = openat(dir_fd, name, posix_flags);
 
+	if (fd == -1 && errno == EINVAL && (posix_flags & O_DIRECT) != 0) {
+		/* The filesystem can't do direct I/O */
+		posix_flags &= ~O_DIRECT;
+		if ((posix_flags & O_CREAT) != 0)
+			fd = openat(dir_fd, name, posix_flags, unix_mode);
+		else
+			fd = openat(dir_fd, name, posix_flags);
+	}
+
 	if (fd == -1 && errno == EEXIST && createmode == FSAL_UNCHECKED) {
 		/* We tried to create O_EXCL to set attributes and failed.
 		 * Remove O_EXCL and retry. We still try O_CREAT again just in
@@ -657,9 +813,20 @@ fsal_status_t vfs_open2(struct fsal_obj_handle *obj_hdl,
 
 	my_fd->fd = fd;
 	my_fd->openflags = openflags;
+	my_fd->direct = (posix_flags & O_DIRECT) != 0;
 
 	*new_obj = &hdl->obj_handle;
 
+	if (created && native_verifier &&
+	    fsetxattr(fd, VFS_VERIFIER_XATTR, verifier,
+		      sizeof(fsal_verifier_t), 0) != 0) {
+		/* No trusted xattrs here, fall back to the times */
+		LogDebug(COMPONENT_FSAL,
+			 "Could not keep the verifier of %s in an xattr: %s",
+			 name, strerror(errno));
+		set_common_verifier(attrib_set, verifier);
+	}
+
 	if (created && attrib_set->mask != 0) {
 		/* Set attributes using our newly opened file descriptor as the
 		 * share_fd if there are any left to set (mode and truncate
@@ -741,6 +908,42 @@ fsal_status_t vfs_open2(struct fsal_obj_handle *obj_hdl,
 	return fsalstat(posix2fsal_error(retval), retval);
 }
 
+/**
+ * @brief Check the exclusive create verifier for a file.
+ *
+ * @param[in] obj_hdl     File to check verifier
+ * @param[in] verifier    Verifier to use for exclusive create
+ *
+ * @retval true if verifier matches
+ */
+
+bool vfs_check_verifier(struct fsal_obj_handle *obj_hdl,
+			fsal_verifier_t verifier)
+{
+	struct vfs_fsal_obj_handle *myself;
+	fsal_errors_t fsal_error;
+	struct stat stat;
+	bool result;
+	int fd;
+
+	if (obj_hdl->type != REGULAR_FILE)
+		return false;
+
+	myself = container_of(obj_hdl, struct vfs_fsal_obj_handle, obj_handle);
+
+	fd = vfs_fsal_open(myself, O_RDONLY, &fsal_error);
+
+	if (fd < 0)
+		return false;
+
+	result = fstat(fd, &stat) == 0 &&
+		 vfs_check_verifier_fd(fd, &stat, verifier);
+
+	close(fd);
+
+	return result;
+}
+
 /**
  * @brief Re-open a file that may be already opened
  *
@@ -834,6 +1037,7 @@ fsal_status_t vfs_reopen2(struct fsal_obj_handle *obj_hdl,
 }
 
 fsal_status_t find_fd(int *fd,
+		      bool *direct,
 		      struct fsal_obj_handle *obj_hdl,
 		      bool bypass,
 		      struct state_t *state,
@@ -854,6 +1058,9 @@ fsal_status_t find_fd(int *fd,
 
 	fsal2posix_openflags(openflags, &posix_flags);
 
+	if (direct != NULL)
+		*direct = false;
+
 	/* Handle nom-regular files */
 	switch (obj_hdl->type) {
 	case SOCKET_FILE:
@@ -879,10 +1086,13 @@ fsal_status_t find_fd(int *fd,
 				      &myself->u.file.share,
 				      bypass, state, openflags,
 				      vfs_open_func, vfs_close_func,
+				      sizeof(struct vfs_fd),
 				      has_lock, need_fsync,
 				      closefd, open_for_locks);
 
 		*fd = out_fd->fd;
+		if (direct != NULL)
+			*direct = out_fd->direct;
 		return status;
 
 	case SYMBOLIC_LINK:
@@ -921,6 +1131,251 @@ fsal_status_t find_fd(int *fd,
 	return status;
 }
 
+static bool vfs_direct_aligned(const struct iovec *iov, int iovcnt,
+			       uint64_t offset)
+{
+	int ix;
+
+	if (offset % VFS_DIRECT_ALIGN != 0)
+		return false;
+
+	for (ix = 0; ix < iovcnt; ix++)
+		if ((uintptr_t) iov[ix].iov_base % VFS_DIRECT_ALIGN != 0 ||
+		    iov[ix].iov_len % VFS_DIRECT_ALIGN != 0)
+			return false;
+
+	return true;
+}
+
+static size_t vfs_iov_length(const struct iovec *iov, int iovcnt)
+{
+	size_t len = 0;
+	int ix;
+
+	for (ix = 0; ix < iovcnt; ix++)
+		len += iov[ix].iov_len;
+
+	return len;
+}
+
+/**
+ * @brief Read from a file, through a bounce buffer if direct I/O needs it
+ *
+ * I/O on an fd opened O_DIRECT that is already aligned is made as is.
+ * Otherwise the aligned blocks around it are read into an aligned buffer
+ * and the part asked for is copied out.
+ *
+ * @param[in] fd      File descriptor
+ * @param[in] direct  The fd was opened O_DIRECT
+ * @param[in] iov     The buffers
+ * @param[in] iovcnt  Number of buffers
+ * @param[in] offset  Position from which to read
+ * @param[in] fixed   As for vfs_uring_preadv()
+ *
+ * @return Bytes read, -1 with errno set on error.
+ */
+
+static ssize_t vfs_file_preadv(int fd, bool direct, const struct iovec *iov,
+			       int iovcnt, uint64_t offset, bool fixed)
+{
+	uint64_t start, end;
+	struct iovec biov;
+	ssize_t nb_read;
+	size_t skip, left, len;
+	char *from;
+	int ix;
+
+	if (!direct || vfs_direct_aligned(iov, iovcnt, offset))
+		return vfs_uring_preadv(fd, iov, iovcnt, offset, fixed);
+
+	start = offset - offset % VFS_DIRECT_ALIGN;
+	end = offset + vfs_iov_length(iov, iovcnt);
+	end = (end + VFS_DIRECT_ALIGN - 1) / VFS_DIRECT_ALIGN *
+	      VFS_DIRECT_ALIGN;
+
+	biov.iov_len = end - start;
+	biov.iov_base = gsh_malloc_aligned(VFS_DIRECT_ALIGN, biov.iov_len);
+
+	nb_read = vfs_uring_preadv(fd, &biov, 1, start, fixed);
+
+	if (nb_read > 0) {
+		skip = offset - start;
+		left = (size_t) nb_read > skip ? nb_read - skip : 0;
+		from = (char *) biov.iov_base + skip;
+		nb_read = 0;
+
+		for (ix = 0; ix < iovcnt && left != 0; ix++) {
+			len = iov[ix].iov_len < left ? iov[ix].iov_len : left;
+			memcpy(iov[ix].iov_base, from, len);
+			from += len;
+			left -= len;
+			nb_read += len;
+		}
+	}
+
+	gsh_free(biov.iov_base);
+
+	return nb_read;
+}
+
+/**
+ * @brief Write to a file, working around what direct I/O can't take
+ *
+ * I/O on an fd opened O_DIRECT that is already aligned is made as is.
+ * Aligned blocks in unaligned buffers are gathered into an aligned one.
+ * Writes that don't cover whole blocks go through the page cache on an
+ * fd of their own, since reading in and rewriting the blocks around
+ * them would race with other writes; the kernel keeps the page cache
+ * and direct I/O coherent.
+ *
+ * Called with the user's credentials.
+ *
+ * @param[in] myself  File to write to
+ * @param[in] fd      File descriptor
+ * @param[in] direct  The fd was opened O_DIRECT
+ * @param[in] iov     The buffers
+ * @param[in] iovcnt  Number of buffers
+ * @param[in] offset  Position at which to write
+ * @param[in] sync    The fd was opened O_SYNC
+ * @param[in] fixed   As for vfs_uring_pwritev()
+ *
+ * @return Bytes written, -1 with errno set on error.
+ */
+
+static ssize_t vfs_file_pwritev(struct vfs_fsal_obj_handle *myself, int fd,
+				bool direct, const struct iovec *iov,
+				int iovcnt, uint64_t offset, bool sync,
+				bool fixed)
+{
+	size_t size = vfs_iov_length(iov, iovcnt);
+	fsal_errors_t fsal_error;
+	struct iovec biov;
+	ssize_t nb_written;
+	char *to;
+	int ix, err, bfd;
+
+	if (!direct || vfs_direct_aligned(iov, iovcnt, offset))
+		return vfs_uring_pwritev(fd, iov, iovcnt, offset, fixed);
+
+	if (offset % VFS_DIRECT_ALIGN == 0 && size % VFS_DIRECT_ALIGN == 0) {
+		biov.iov_len = size;
+		biov.iov_base = gsh_malloc_aligned(VFS_DIRECT_ALIGN, size);
+
+		for (to = biov.iov_base, ix = 0; ix < iovcnt; ix++) {
+			memcpy(to, iov[ix].iov_base, iov[ix].iov_len);
+			to += iov[ix].iov_len;
+		}
+
+		nb_written = vfs_uring_pwritev(fd, &biov, 1, offset, fixed);
+
+		err = errno;
+		gsh_free(biov.iov_base);
+		errno = err;
+
+		return nb_written;
+	}
+
+	/* Opening by handle needs our own credentials */
+	fsal_restore_ganesha_credentials();
+	bfd = vfs_fsal_open(myself, O_WRONLY | (sync ? O_SYNC : 0),
+			    &fsal_error);
+	fsal_set_credentials(op_ctx->creds);
+
+	if (bfd < 0) {
+		errno = -bfd;
+		return -1;
+	}
+
+	nb_written = pwritev(bfd, iov, iovcnt, offset);
+
+	err = errno;
+	close(bfd);
+	errno = err;
+
+	return nb_written;
+}
+
+/**
+ * @brief Read the data or the hole at an offset for READ_PLUS
+ *
+ * If SEEK_DATA finds the offset in a hole, the hole is reported up to
+ * the next data, or the end of file, and nothing is read.  Otherwise
+ * data is read up to the next hole, which the client then learns of
+ * with its next READ_PLUS.  A filesystem that cannot seek data is read
+ * as if it had no holes.
+ *
+ * @param[in]     fd             File descriptor to read from
+ * @param[in]     direct         The fd was opened O_DIRECT
+ * @param[in]     offset         Position from which to read
+ * @param[in]     buffer_size    Amount of data to read
+ * @param[out]    buffer         Buffer to which data are to be copied
+ * @param[out]    read_amount    Amount of data read
+ * @param[out]    end_of_file    true if the end of file has been reached
+ * @param[out]    info           The data or hole found
+ *
+ * @return FSAL status.
+ */
+
+static fsal_status_t vfs_read_plus_fd(int fd, bool direct, uint64_t offset,
+				      size_t buffer_size, void *buffer,
+				      size_t *read_amount, bool *end_of_file,
+				      struct io_info *info)
+{
+	off_t data, hole, size = -1;
+	uint64_t length;
+	ssize_t nb_read;
+	struct iovec iov;
+	int retval;
+
+	data = lseek(fd, offset, SEEK_DATA);
+	if (data == -1 && errno == ENXIO) {
+		/* No data from offset on */
+		size = lseek(fd, 0, SEEK_END);
+		if (size == -1) {
+			retval = errno;
+			return fsalstat(posix2fsal_error(retval), retval);
+		}
+		data = size;
+	}
+
+	if (data > (off_t) offset) {
+		length = data - offset;
+		if (length > buffer_size)
+			length = buffer_size;
+
+		io_info_hole(info, offset, length);
+		*read_amount = 0;
+		*end_of_file = size != -1 && offset + length >= (uint64_t) size;
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+	}
+
+	if (data != -1) {
+		/* Stop at the next hole, even the one at end of file */
+		hole = lseek(fd, offset, SEEK_HOLE);
+		if (hole > (off_t) offset &&
+		    (uint64_t) (hole - offset) < buffer_size)
+			buffer_size = hole - offset;
+	}
+
+	if (direct) {
+		iov.iov_base = buffer;
+		iov.iov_len = buffer_size;
+		nb_read = vfs_file_preadv(fd, direct, &iov, 1, offset, false);
+	} else {
+		nb_read = pread(fd, buffer, buffer_size, offset);
+	}
+	if (nb_read == -1) {
+		retval = errno;
+		return fsalstat(posix2fsal_error(retval), retval);
+	}
+
+	io_info_data(info, offset, buffer, nb_read);
+	*read_amount = nb_read;
+	*end_of_file = (nb_read == 0);
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
 /**
  * @brief Read data from a file
  *
@@ -954,16 +1409,13 @@ fsal_status_t vfs_read2(struct fsal_obj_handle *obj_hdl,
 {
 	int my_fd = -1;
 	ssize_t nb_read;
+	struct iovec iov;
 	fsal_status_t status;
 	int retval = 0;
 	bool has_lock = false;
 	bool need_fsync = false;
 	bool closefd = false;
-
-	if (info != NULL) {
-		/* Currently we don't support READ_PLUS */
-		return fsalstat(ERR_FSAL_NOTSUPP, 0);
-	}
+	bool direct;
 
 	if (obj_hdl->fsal != obj_hdl->fs->fsal) {
 		LogDebug(COMPONENT_FSAL,
@@ -973,13 +1425,22 @@ fsal_status_t vfs_read2(struct fsal_obj_handle *obj_hdl,
 	}
 
 	/* Get a usable file descriptor */
-	status = find_fd(&my_fd, obj_hdl, bypass, state, FSAL_O_READ,
+	status = find_fd(&my_fd, &direct, obj_hdl, bypass, state, FSAL_O_READ,
 			 &has_lock, &need_fsync, &closefd, false);
 
 	if (FSAL_IS_ERROR(status))
 		goto out;
 
-	nb_read = pread(my_fd, buffer, buffer_size, offset);
+	if (info != NULL) {
+		status = vfs_read_plus_fd(my_fd, direct, offset, buffer_size,
+					  buffer, read_amount, end_of_file,
+					  info);
+		goto out;
+	}
+
+	iov.iov_base = buffer;
+	iov.iov_len = buffer_size;
+	nb_read = vfs_file_preadv(my_fd, direct, &iov, 1, offset, !closefd);
 
 	if (offset == -1 || nb_read == -1) {
 		retval = errno;
@@ -991,21 +1452,8 @@ fsal_status_t vfs_read2(struct fsal_obj_handle *obj_hdl,
 
 	*end_of_file = (nb_read == 0);
 
-#if 0
-	/** @todo
-	 *
-	 * Is this all we really need to do to support READ_PLUS? Will anyone
-	 * ever get upset that we don't return holes, even for blocks of all
-	 * zeroes?
-	 *
-	 */
-	if (info != NULL) {
-		info->io_content.what = NFS4_CONTENT_DATA;
-		info->io_content.data.d_offset = offset + nb_read;
-		info->io_content.data.d_data.data_len = nb_read;
-		info->io_content.data.d_data.data_val = buffer;
-	}
-#endif
+	vfs_readahead(&OBJ_VFS_FROM_FSAL(obj_hdl)->u.file.ra, my_fd, offset,
+		      nb_read);
 
  out:
 
@@ -1054,12 +1502,14 @@ fsal_status_t vfs_write2(struct fsal_obj_handle *obj_hdl,
 			 struct io_info *info)
 {
 	ssize_t nb_written;
+	struct iovec iov;
 	fsal_status_t status;
 	int retval = 0;
 	int my_fd = -1;
 	bool has_lock = false;
 	bool need_fsync = false;
 	bool closefd = false;
+	bool direct;
 	fsal_openflags_t openflags = FSAL_O_WRITE;
 
 	if (info != NULL) {
@@ -1078,7 +1528,7 @@ fsal_status_t vfs_write2(struct fsal_obj_handle *obj_hdl,
 		openflags |= FSAL_O_SYNC;
 
 	/* Get a usable file descriptor */
-	status = find_fd(&my_fd, obj_hdl, bypass, state, openflags,
+	status = find_fd(&my_fd, &direct, obj_hdl, bypass, state, openflags,
 			 &has_lock, &need_fsync, &closefd, false);
 
 	if (FSAL_IS_ERROR(status)) {
@@ -1089,7 +1539,11 @@ fsal_status_t vfs_write2(struct fsal_obj_handle *obj_hdl,
 
 	fsal_set_credentials(op_ctx->creds);
 
-	nb_written = pwrite(my_fd, buffer, buffer_size, offset);
+	iov.iov_base = buffer;
+	iov.iov_len = buffer_size;
+	nb_written = vfs_file_pwritev(OBJ_VFS_FROM_FSAL(obj_hdl), my_fd,
+				      direct, &iov, 1, offset, *fsal_stable,
+				      !closefd);
 
 	if (nb_written == -1) {
 		retval = errno;
@@ -1101,7 +1555,7 @@ fsal_status_t vfs_write2(struct fsal_obj_handle *obj_hdl,
 
 	/* attempt stability if we aren't using an O_SYNC fd */
 	if (need_fsync) {
-		retval = fsync(my_fd);
+		retval = vfs_uring_fsync(my_fd, !closefd);
 		if (retval == -1) {
 			retval = errno;
 			status = fsalstat(posix2fsal_error(retval), retval);
@@ -1121,61 +1575,74 @@ fsal_status_t vfs_write2(struct fsal_obj_handle *obj_hdl,
 }
 
 /**
- * @brief Commit written data
+ * @brief Seek to data or hole
  *
- * This function flushes possibly buffered data to a file. This method
- * differs from commit due to the need to interact with share reservations
- * and the fact that the FSAL manages the state of "file descriptors". The
- * FSAL must be able to perform this operation without being passed a specific
- * state.
+ * Past the last data, or with no hole before end of file, the seek
+ * lands on end of file and sets io_eof; an offset at or beyond end of
+ * file is an error.
  *
- * @param[in] obj_hdl          File on which to operate
- * @param[in] state            state_t to use for this operation
- * @param[in] offset           Start of range to commit
- * @param[in] len              Length of range to commit
+ * @param[in]     obj_hdl   File on which to operate
+ * @param[in]     state     state_t to use for this operation
+ * @param[in,out] info      Information about the data
  *
  * @return FSAL status.
  */
 
-fsal_status_t vfs_commit2(struct fsal_obj_handle *obj_hdl,
-			  off_t offset,
-			  size_t len)
+fsal_status_t vfs_seek2(struct fsal_obj_handle *obj_hdl,
+			struct state_t *state,
+			struct io_info *info)
 {
-	struct vfs_fsal_obj_handle *myself;
+	off_t offset = info->io_content.hole.di_offset;
+	int my_fd = -1;
 	fsal_status_t status;
-	int retval;
-	struct vfs_fd temp_fd = {0, -1}, *out_fd = &temp_fd;
 	bool has_lock = false;
+	bool need_fsync = false;
 	bool closefd = false;
+	off_t found, size;
+	int whence;
+	int retval;
 
-	myself = container_of(obj_hdl, struct vfs_fsal_obj_handle, obj_handle);
+	switch (info->io_content.what) {
+	case NFS4_CONTENT_DATA:
+		whence = SEEK_DATA;
+		break;
+	case NFS4_CONTENT_HOLE:
+		whence = SEEK_HOLE;
+		break;
+	default:
+		return fsalstat(ERR_FSAL_UNION_NOTSUPP, 0);
+	}
 
-	/* Make sure file is open in appropriate mode.
-	 * Do not check share reservation.
-	 */
-	status = fsal_reopen_obj(obj_hdl, false, false, FSAL_O_WRITE,
-				 (struct fsal_fd *)&myself->u.file.fd,
-				 &myself->u.file.share,
-				 vfs_open_func, vfs_close_func,
-				 (struct fsal_fd **)&out_fd, &has_lock,
-				 &closefd);
+	status = find_fd(&my_fd, NULL, obj_hdl, false, state, FSAL_O_READ,
+			 &has_lock, &need_fsync, &closefd, false);
 
-	if (!FSAL_IS_ERROR(status)) {
+	if (FSAL_IS_ERROR(status))
+		goto out;
 
-		fsal_set_credentials(op_ctx->creds);
+	size = lseek(my_fd, 0, SEEK_END);
+	if (size == -1 || offset >= size) {
+		retval = size == -1 ? errno : ENXIO;
+		status = fsalstat(posix2fsal_error(retval), retval);
+		goto out;
+	}
 
-		retval = fsync(out_fd->fd);
+	found = lseek(my_fd, offset, whence);
+	if (found == -1 && errno == ENXIO) {
+		/* No data after offset */
+		found = size;
+	} else if (found == -1) {
+		retval = errno;
+		status = fsalstat(posix2fsal_error(retval), retval);
+		goto out;
+	}
 
-		if (retval == -1) {
-			retval = errno;
-			status = fsalstat(posix2fsal_error(retval), retval);
-		}
+	info->io_eof = found >= size;
+	info->io_content.hole.di_offset = found;
 
-		fsal_restore_ganesha_credentials();
-	}
+ out:
 
 	if (closefd)
-		close(out_fd->fd);
+		close(my_fd);
 
 	if (has_lock)
 		PTHREAD_RWLOCK_unlock(&obj_hdl->lock);
@@ -1183,20 +1650,556 @@ fsal_status_t vfs_commit2(struct fsal_obj_handle *obj_hdl,
 	return status;
 }
 
-#ifdef F_OFD_GETLK
+#define VFS_COPY_BOUNCE_SIZE (1024 * 1024)
+
 /**
- * @brief Perform a lock operation
- *
- * This function performs a lock operation (lock, unlock, test) on a
- * file. This method assumes the FSAL is able to support lock owners,
- * though it need not support asynchronous blocking locks. Passing the
- * lock state allows the FSAL to associate information with a specific
- * lock owner for each file (which may include use of a "file descriptor".
+ * @brief Copy between two open files
  *
- * For FSAL_VFS etc. we ignore owner, implicitly we have a lock_fd per
- * lock owner (i.e. per state).
+ * Has the kernel copy the range, so the data never come up to user
+ * space and a filesystem that can share or offload it does so.  Where
+ * the kernel can not, one buffer's worth is copied by hand.
  *
- * @param[in]  obj_hdl          File on which to operate
+ * @return Bytes copied or -1 with errno set.
+ */
+
+static ssize_t vfs_copy_fd(int src_fd, off_t src_offset, int dst_fd,
+			   off_t dst_offset, size_t count)
+{
+	size_t size = count < VFS_COPY_BOUNCE_SIZE ? count
+						   : VFS_COPY_BOUNCE_SIZE;
+	ssize_t nb;
+	void *buffer;
+	int err;
+
+	nb = vfs_copy_file_range(src_fd, src_offset, dst_fd, dst_offset,
+				 count);
+
+	if (nb != -1 || (errno != ENOSYS && errno != EXDEV &&
+			 errno != EINVAL && errno != EOPNOTSUPP))
+		return nb;
+
+	buffer = gsh_malloc(size);
+
+	nb = pread(src_fd, buffer, size, src_offset);
+	if (nb > 0)
+		nb = pwrite(dst_fd, buffer, nb, dst_offset);
+
+	err = errno;
+	gsh_free(buffer);
+	errno = err;
+
+	return nb;
+}
+
+/**
+ * @brief Find the descriptors for a copy or clone
+ *
+ * On error any descriptor found is put back.
+ */
+
+static fsal_status_t vfs_find_copy_fds(struct fsal_obj_handle *src_hdl,
+				       struct state_t *src_state,
+				       int *src_fd, bool *src_lock,
+				       bool *src_close,
+				       struct fsal_obj_handle *dst_hdl,
+				       struct state_t *dst_state,
+				       int *dst_fd, bool *dst_lock,
+				       bool *dst_close)
+{
+	bool need_fsync = false;
+	fsal_status_t status;
+
+	if (src_hdl->fs != dst_hdl->fs)
+		return fsalstat(posix2fsal_error(EXDEV), EXDEV);
+
+	status = find_fd(src_fd, NULL, src_hdl, false, src_state, FSAL_O_READ,
+			 src_lock, &need_fsync, src_close, false);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
+	status = find_fd(dst_fd, NULL, dst_hdl, false, dst_state, FSAL_O_WRITE,
+			 dst_lock, &need_fsync, dst_close, false);
+
+	if (FSAL_IS_ERROR(status)) {
+		if (*src_close)
+			close(*src_fd);
+
+		if (*src_lock)
+			PTHREAD_RWLOCK_unlock(&src_hdl->lock);
+	}
+
+	return status;
+}
+
+/**
+ * @brief Copy a range of one file into another
+ *
+ * @param[in]  src_hdl     File to copy from
+ * @param[in]  src_state   state_t to use for reading
+ * @param[in]  src_offset  Position to copy from
+ * @param[in]  dst_hdl     File to copy to
+ * @param[in]  dst_state   state_t to use for writing
+ * @param[in]  dst_offset  Position to copy to
+ * @param[in]  count       Number of bytes to copy
+ * @param[out] copied      Number of bytes copied
+ *
+ * @return FSAL status.
+ */
+
+fsal_status_t vfs_copy(struct fsal_obj_handle *src_hdl,
+		       struct state_t *src_state,
+		       uint64_t src_offset,
+		       struct fsal_obj_handle *dst_hdl,
+		       struct state_t *dst_state,
+		       uint64_t dst_offset,
+		       uint64_t count,
+		       uint64_t *copied)
+{
+	int src_fd = -1, dst_fd = -1;
+	bool src_lock = false, dst_lock = false;
+	bool src_close = false, dst_close = false;
+	fsal_status_t status;
+	ssize_t nb;
+	int retval;
+
+	*copied = 0;
+
+	status = vfs_find_copy_fds(src_hdl, src_state, &src_fd, &src_lock,
+				   &src_close, dst_hdl, dst_state, &dst_fd,
+				   &dst_lock, &dst_close);
+
+	if (FSAL_IS_ERROR(status)) {
+		LogDebug(COMPONENT_FSAL,
+			 "find_fd failed %s", msg_fsal_err(status.major));
+		return status;
+	}
+
+	fsal_set_credentials(op_ctx->creds);
+
+	/* Keep within what one system call can report */
+	if (count > INT32_MAX)
+		count = INT32_MAX;
+
+	nb = vfs_copy_fd(src_fd, src_offset, dst_fd, dst_offset, count);
+
+	if (nb == -1) {
+		retval = errno;
+		status = fsalstat(posix2fsal_error(retval), retval);
+	} else {
+		*copied = nb;
+	}
+
+	fsal_restore_ganesha_credentials();
+
+	if (dst_close)
+		close(dst_fd);
+
+	if (dst_lock)
+		PTHREAD_RWLOCK_unlock(&dst_hdl->lock);
+
+	if (src_close)
+		close(src_fd);
+
+	if (src_lock)
+		PTHREAD_RWLOCK_unlock(&src_hdl->lock);
+
+	return status;
+}
+
+/**
+ * @brief Share a range of one file's blocks with another
+ *
+ * @param[in] src_hdl     File to clone from
+ * @param[in] src_state   state_t to use for reading
+ * @param[in] src_offset  Position to clone from
+ * @param[in] dst_hdl     File to clone into
+ * @param[in] dst_state   state_t to use for writing
+ * @param[in] dst_offset  Position to clone to
+ * @param[in] count       Number of bytes to clone
+ *
+ * @return FSAL status.
+ */
+
+fsal_status_t vfs_clone(struct fsal_obj_handle *src_hdl,
+			struct state_t *src_state,
+			uint64_t src_offset,
+			struct fsal_obj_handle *dst_hdl,
+			struct state_t *dst_state,
+			uint64_t dst_offset,
+			uint64_t count)
+{
+	int src_fd = -1, dst_fd = -1;
+	bool src_lock = false, dst_lock = false;
+	bool src_close = false, dst_close = false;
+	fsal_status_t status;
+	int retval;
+
+	status = vfs_find_copy_fds(src_hdl, src_state, &src_fd, &src_lock,
+				   &src_close, dst_hdl, dst_state, &dst_fd,
+				   &dst_lock, &dst_close);
+
+	if (FSAL_IS_ERROR(status)) {
+		LogDebug(COMPONENT_FSAL,
+			 "find_fd failed %s", msg_fsal_err(status.major));
+		return status;
+	}
+
+	fsal_set_credentials(op_ctx->creds);
+
+	retval = vfs_clone_range(src_fd, src_offset, dst_fd, dst_offset,
+				 count);
+
+	if (retval == -1) {
+		retval = errno;
+		/* ENOTTY from a filesystem without the ioctl */
+		if (retval == ENOTTY)
+			retval = EOPNOTSUPP;
+		status = fsalstat(posix2fsal_error(retval), retval);
+	}
+
+	fsal_restore_ganesha_credentials();
+
+	if (dst_close)
+		close(dst_fd);
+
+	if (dst_lock)
+		PTHREAD_RWLOCK_unlock(&dst_hdl->lock);
+
+	if (src_close)
+		close(src_fd);
+
+	if (src_lock)
+		PTHREAD_RWLOCK_unlock(&src_hdl->lock);
+
+	return status;
+}
+
+/**
+ * @brief Write several buffers to consecutive positions in a file
+ *
+ * @param[in]     obj_hdl       File on which to operate
+ * @param[in]     bypass        If state doesn't indicate a share
+ *                              reservation, bypass any deny write
+ * @param[in]     state         state_t to use for this operation
+ * @param[in]     offset        Position at which to write
+ * @param[in]     iov           The buffers
+ * @param[in]     iovcnt        Number of buffers
+ * @param[out]    wrote_amount  Number of bytes written
+ * @param[in,out] fsal_stable   In, if on, the fsal is requested to
+ *                              write data to stable store. Out, the
+ *                              fsal reports what it did.
+ *
+ * @return FSAL status.
+ */
+
+fsal_status_t vfs_write_vec(struct fsal_obj_handle *obj_hdl,
+			    bool bypass,
+			    struct state_t *state,
+			    uint64_t offset,
+			    const struct iovec *iov,
+			    int iovcnt,
+			    size_t *wrote_amount,
+			    bool *fsal_stable)
+{
+	ssize_t nb_written;
+	fsal_status_t status;
+	int retval = 0;
+	int my_fd = -1;
+	bool has_lock = false;
+	bool need_fsync = false;
+	bool closefd = false;
+	bool direct;
+	fsal_openflags_t openflags = FSAL_O_WRITE;
+
+	if (obj_hdl->fsal != obj_hdl->fs->fsal) {
+		LogDebug(COMPONENT_FSAL,
+			 "FSAL %s operation for handle belonging to FSAL %s, return EXDEV",
+			 obj_hdl->fsal->name, obj_hdl->fs->fsal->name);
+		return fsalstat(posix2fsal_error(EXDEV), EXDEV);
+	}
+
+	if (*fsal_stable)
+		openflags |= FSAL_O_SYNC;
+
+	/* Get a usable file descriptor */
+	status = find_fd(&my_fd, &direct, obj_hdl, bypass, state, openflags,
+			 &has_lock, &need_fsync, &closefd, false);
+
+	if (FSAL_IS_ERROR(status)) {
+		LogDebug(COMPONENT_FSAL,
+			 "find_fd failed %s", msg_fsal_err(status.major));
+		goto out;
+	}
+
+	fsal_set_credentials(op_ctx->creds);
+
+	nb_written = vfs_file_pwritev(OBJ_VFS_FROM_FSAL(obj_hdl), my_fd,
+				      direct, iov, iovcnt, offset,
+				      *fsal_stable, !closefd);
+
+	if (nb_written == -1) {
+		retval = errno;
+		status = fsalstat(posix2fsal_error(retval), retval);
+		goto out;
+	}
+
+	*wrote_amount = nb_written;
+
+	/* attempt stability if we aren't using an O_SYNC fd */
+	if (need_fsync) {
+		retval = vfs_uring_fsync(my_fd, !closefd);
+		if (retval == -1) {
+			retval = errno;
+			status = fsalstat(posix2fsal_error(retval), retval);
+		}
+	}
+
+ out:
+
+	if (closefd)
+		close(my_fd);
+
+	if (has_lock)
+		PTHREAD_RWLOCK_unlock(&obj_hdl->lock);
+
+	fsal_restore_ganesha_credentials();
+	return status;
+}
+
+/**
+ * @brief Read from consecutive positions in a file into several buffers
+ *
+ * @param[in]  obj_hdl      File on which to operate
+ * @param[in]  bypass       If state doesn't indicate a share reservation,
+ *                          bypass any deny read
+ * @param[in]  state        state_t to use for this operation
+ * @param[in]  offset       Position from which to read
+ * @param[in]  iov          The buffers
+ * @param[in]  iovcnt       Number of buffers
+ * @param[out] read_amount  Number of bytes read
+ * @param[out] end_of_file  true if the end of file has been reached
+ *
+ * @return FSAL status.
+ */
+
+fsal_status_t vfs_read_vec(struct fsal_obj_handle *obj_hdl,
+			   bool bypass,
+			   struct state_t *state,
+			   uint64_t offset,
+			   const struct iovec *iov,
+			   int iovcnt,
+			   size_t *read_amount,
+			   bool *end_of_file)
+{
+	int my_fd = -1;
+	ssize_t nb_read;
+	fsal_status_t status;
+	int retval = 0;
+	bool has_lock = false;
+	bool need_fsync = false;
+	bool closefd = false;
+	bool direct;
+
+	if (obj_hdl->fsal != obj_hdl->fs->fsal) {
+		LogDebug(COMPONENT_FSAL,
+			 "FSAL %s operation for handle belonging to FSAL %s, return EXDEV",
+			 obj_hdl->fsal->name, obj_hdl->fs->fsal->name);
+		return fsalstat(posix2fsal_error(EXDEV), EXDEV);
+	}
+
+	/* Get a usable file descriptor */
+	status = find_fd(&my_fd, &direct, obj_hdl, bypass, state, FSAL_O_READ,
+			 &has_lock, &need_fsync, &closefd, false);
+
+	if (FSAL_IS_ERROR(status))
+		goto out;
+
+	nb_read = vfs_file_preadv(my_fd, direct, iov, iovcnt, offset,
+				  !closefd);
+
+	if (nb_read == -1) {
+		retval = errno;
+		status = fsalstat(posix2fsal_error(retval), retval);
+		goto out;
+	}
+
+	*read_amount = nb_read;
+
+	*end_of_file = (nb_read == 0);
+
+	vfs_readahead(&OBJ_VFS_FROM_FSAL(obj_hdl)->u.file.ra, my_fd, offset,
+		      nb_read);
+
+ out:
+
+	if (closefd)
+		close(my_fd);
+
+	if (has_lock)
+		PTHREAD_RWLOCK_unlock(&obj_hdl->lock);
+
+	return status;
+}
+
+/**
+ * @brief Reserve or release storage for a range of a file
+ *
+ * @param[in] obj_hdl   File on which to operate
+ * @param[in] state     state_t to use for this operation
+ * @param[in] offset    Start of the range
+ * @param[in] length    Length of the range
+ * @param[in] allocate  true to allocate, false to punch a hole
+ *
+ * @return FSAL status.
+ */
+
+fsal_status_t vfs_fallocate(struct fsal_obj_handle *obj_hdl,
+			    struct state_t *state,
+			    uint64_t offset,
+			    uint64_t length,
+			    bool allocate)
+{
+	fsal_status_t status;
+	int retval = 0;
+	int my_fd = -1;
+	bool has_lock = false;
+	bool need_fsync = false;
+	bool closefd = false;
+
+	if (obj_hdl->fsal != obj_hdl->fs->fsal) {
+		LogDebug(COMPONENT_FSAL,
+			 "FSAL %s operation for handle belonging to FSAL %s, return EXDEV",
+			 obj_hdl->fsal->name, obj_hdl->fs->fsal->name);
+		return fsalstat(posix2fsal_error(EXDEV), EXDEV);
+	}
+
+	status = find_fd(&my_fd, NULL, obj_hdl, false, state, FSAL_O_WRITE,
+			 &has_lock, &need_fsync, &closefd, false);
+
+	if (FSAL_IS_ERROR(status)) {
+		LogDebug(COMPONENT_FSAL,
+			 "find_fd failed %s", msg_fsal_err(status.major));
+		goto out;
+	}
+
+	fsal_set_credentials(op_ctx->creds);
+
+	retval = vfs_fallocate_range(my_fd, offset, length, !allocate);
+
+	if (retval == -1) {
+		retval = errno;
+		status = fsalstat(posix2fsal_error(retval), retval);
+	}
+
+ out:
+
+	if (closefd)
+		close(my_fd);
+
+	if (has_lock)
+		PTHREAD_RWLOCK_unlock(&obj_hdl->lock);
+
+	fsal_restore_ganesha_credentials();
+	return status;
+}
+
+/**
+ * @brief Sync a file for vfs_commit2()
+ *
+ * @param[in] myself  File on which to operate
+ *
+ * @return FSAL status.
+ */
+
+static fsal_status_t vfs_sync(struct vfs_fsal_obj_handle *myself)
+{
+	struct fsal_obj_handle *obj_hdl = &myself->obj_handle;
+	fsal_status_t status;
+	int retval;
+	struct vfs_fd temp_fd = {0, -1}, *out_fd = &temp_fd;
+	bool has_lock = false;
+	bool closefd = false;
+
+	/* Make sure file is open in appropriate mode.
+	 * Do not check share reservation.
+	 */
+	status = fsal_reopen_obj(obj_hdl, false, false, FSAL_O_WRITE,
+				 (struct fsal_fd *)&myself->u.file.fd,
+				 &myself->u.file.share,
+				 vfs_open_func, vfs_close_func,
+				 sizeof(struct vfs_fd),
+				 (struct fsal_fd **)&out_fd, &has_lock,
+				 &closefd);
+
+	if (!FSAL_IS_ERROR(status)) {
+
+		fsal_set_credentials(op_ctx->creds);
+
+		retval = vfs_uring_fsync(out_fd->fd, !closefd);
+
+		if (retval == -1) {
+			retval = errno;
+			status = fsalstat(posix2fsal_error(retval), retval);
+		}
+
+		fsal_restore_ganesha_credentials();
+	}
+
+	if (closefd)
+		close(out_fd->fd);
+
+	if (has_lock)
+		PTHREAD_RWLOCK_unlock(&obj_hdl->lock);
+
+	return status;
+}
+
+/**
+ * @brief Commit written data
+ *
+ * This function flushes possibly buffered data to a file. This method
+ * differs from commit due to the need to interact with share reservations
+ * and the fact that the FSAL manages the state of "file descriptors". The
+ * FSAL must be able to perform this operation without being passed a specific
+ * state.
+ *
+ * Concurrent commits of the file share fsyncs, see commit.c; the whole
+ * file is synced whatever the range.
+ *
+ * @param[in] obj_hdl          File on which to operate
+ * @param[in] state            state_t to use for this operation
+ * @param[in] offset           Start of range to commit
+ * @param[in] len              Length of range to commit
+ *
+ * @return FSAL status.
+ */
+
+fsal_status_t vfs_commit2(struct fsal_obj_handle *obj_hdl,
+			  off_t offset,
+			  size_t len)
+{
+	struct vfs_fsal_obj_handle *myself;
+
+	myself = container_of(obj_hdl, struct vfs_fsal_obj_handle, obj_handle);
+
+	return vfs_group_commit(myself, vfs_sync);
+}
+
+#ifdef F_OFD_GETLK
+/**
+ * @brief Perform a lock operation
+ *
+ * This function performs a lock operation (lock, unlock, test) on a
+ * file. This method assumes the FSAL is able to support lock owners,
+ * though it need not support asynchronous blocking locks. Passing the
+ * lock state allows the FSAL to associate information with a specific
+ * lock owner for each file (which may include use of a "file descriptor".
+ *
+ * For FSAL_VFS etc. we ignore owner, implicitly we have a lock_fd per
+ * lock owner (i.e. per state).
+ *
+ * @param[in]  obj_hdl          File on which to operate
  * @param[in]  state            state_t to use for this operation
  * @param[in]  owner            Lock owner
  * @param[in]  lock_op          Operation to perform
@@ -1294,7 +2297,7 @@ fsal_status_t vfs_lock_op2(struct fsal_obj_handle *obj_hdl,
 	}
 
 	/* Get a usable file descriptor */
-	status = find_fd(&my_fd, obj_hdl, bypass, state, openflags,
+	status = find_fd(&my_fd, NULL, obj_hdl, bypass, state, openflags,
 			 &has_lock, &need_fsync, &closefd, true);
 
 	if (FSAL_IS_ERROR(status)) {
@@ -1361,14 +2364,184 @@ fsal_status_t vfs_lock_op2(struct fsal_obj_handle *obj_hdl,
 }
 #endif
 
+#ifdef HAVE_STATX
+/* Attributes that never change once the object exists */
+#define VFS_STATIC_ATTRS (ATTR_TYPE | ATTR_FSID | ATTR_FILEID | \
+			  ATTR_RAWDEV | ATTR_CREATION)
+
+/**
+ * @brief The statx fields the requested attributes are made from
+ *
+ * stx_dev and stx_rdev are always filled in, so ATTR_FSID and
+ * ATTR_RAWDEV need no field.
+ *
+ * @param[in] mask  The requested attributes
+ *
+ * @return The statx mask.
+ */
+static unsigned int vfs_statx_mask(attrmask_t mask)
+{
+	unsigned int stx_mask = STATX_TYPE;
+
+	if (FSAL_TEST_MASK(mask, ATTR_SIZE))
+		stx_mask |= STATX_SIZE;
+	if (FSAL_TEST_MASK(mask, ATTR_FILEID))
+		stx_mask |= STATX_INO;
+	if (FSAL_TEST_MASK(mask, ATTR_MODE))
+		stx_mask |= STATX_MODE;
+	if (FSAL_TEST_MASK(mask, ATTR_NUMLINKS))
+		stx_mask |= STATX_NLINK;
+	if (FSAL_TEST_MASK(mask, ATTR_OWNER))
+		stx_mask |= STATX_UID;
+	if (FSAL_TEST_MASK(mask, ATTR_GROUP))
+		stx_mask |= STATX_GID;
+	if (FSAL_TEST_MASK(mask, ATTR_ATIME))
+		stx_mask |= STATX_ATIME;
+	if (FSAL_TEST_MASK(mask, ATTR_CREATION))
+		stx_mask |= STATX_BTIME;
+	if (FSAL_TEST_MASK(mask, ATTR_CTIME))
+		stx_mask |= STATX_CTIME;
+	if (FSAL_TEST_MASK(mask, ATTR_MTIME))
+		stx_mask |= STATX_MTIME;
+	if (FSAL_TEST_MASK(mask, ATTR_CHGTIME | ATTR_CHANGE))
+		stx_mask |= STATX_MTIME | STATX_CTIME;
+	if (FSAL_TEST_MASK(mask, ATTR_SPACEUSED))
+		stx_mask |= STATX_BLOCKS;
+
+	return stx_mask;
+}
+
+static inline struct timespec vfs_statx_time(const struct statx_timestamp *ts)
+{
+	struct timespec t = { .tv_sec = ts->tv_sec, .tv_nsec = ts->tv_nsec };
+
+	return t;
+}
+
+/**
+ * @brief Convert what statx returned to FSAL attributes
+ *
+ * Only the attributes whose fields the kernel filled in are set in the
+ * mask, the same way posix2fsal_attributes() sets ATTRS_POSIX.
+ *
+ * @param[in]     stx    What statx returned
+ * @param[in,out] attrs  The attributes
+ */
+static void vfs_statx_to_attrs(const struct statx *stx, struct attrlist *attrs)
+{
+	unsigned int got = stx->stx_mask;
+
+	attrs->mask |= ATTR_FSID | ATTR_RAWDEV;
+	attrs->fsid = posix2fsal_fsid(makedev(stx->stx_dev_major,
+					      stx->stx_dev_minor));
+	attrs->rawdev = posix2fsal_devt(makedev(stx->stx_rdev_major,
+						stx->stx_rdev_minor));
+
+	if (got & STATX_TYPE) {
+		attrs->mask |= ATTR_TYPE;
+		attrs->type = posix2fsal_type(stx->stx_mode);
+	}
+	if (got & STATX_SIZE) {
+		attrs->mask |= ATTR_SIZE;
+		attrs->filesize = stx->stx_size;
+	}
+	if (got & STATX_INO) {
+		attrs->mask |= ATTR_FILEID;
+		attrs->fileid = stx->stx_ino;
+	}
+	if (got & STATX_MODE) {
+		attrs->mask |= ATTR_MODE;
+		attrs->mode = unix2fsal_mode(stx->stx_mode);
+	}
+	if (got & STATX_NLINK) {
+		attrs->mask |= ATTR_NUMLINKS;
+		attrs->numlinks = stx->stx_nlink;
+	}
+	if (got & STATX_UID) {
+		attrs->mask |= ATTR_OWNER;
+		attrs->owner = stx->stx_uid;
+	}
+	if (got & STATX_GID) {
+		attrs->mask |= ATTR_GROUP;
+		attrs->group = stx->stx_gid;
+	}
+	if (got & STATX_ATIME) {
+		attrs->mask |= ATTR_ATIME;
+		attrs->atime = vfs_statx_time(&stx->stx_atime);
+	}
+	if (got & STATX_BTIME) {
+		attrs->mask |= ATTR_CREATION;
+		attrs->creation = vfs_statx_time(&stx->stx_btime);
+	}
+	if (got & STATX_CTIME) {
+		attrs->mask |= ATTR_CTIME;
+		attrs->ctime = vfs_statx_time(&stx->stx_ctime);
+	}
+	if (got & STATX_MTIME) {
+		attrs->mask |= ATTR_MTIME;
+		attrs->mtime = vfs_statx_time(&stx->stx_mtime);
+	}
+	if ((got & (STATX_MTIME | STATX_CTIME)) ==
+	    (STATX_MTIME | STATX_CTIME)) {
+		attrs->mask |= ATTR_CHGTIME | ATTR_CHANGE;
+		attrs->chgtime =
+		    (gsh_time_cmp(&attrs->mtime, &attrs->ctime) > 0)
+		    ? attrs->mtime : attrs->ctime;
+		attrs->change = timespec_to_nsecs(&attrs->chgtime);
+	}
+	if (got & STATX_BLOCKS) {
+		attrs->mask |= ATTR_SPACEUSED;
+		attrs->spaceused = stx->stx_blocks * S_BLKSIZE;
+	}
+}
+#endif /* HAVE_STATX */
+
 fsal_status_t fetch_attrs(struct vfs_fsal_obj_handle *myself,
 			  int my_fd, struct attrlist *attrs)
 {
+#ifdef HAVE_STATX
+	struct statx stx;
+	int flags = AT_STATX_SYNC_AS_STAT;
+#else
 	struct stat stat;
+#endif
 	int retval = 0;
 	fsal_status_t status = {0, 0};
 	const char *func = "unknown";
 
+#ifdef HAVE_STATX
+	/* Nothing asked for can be stale, so don't bother the backing
+	 * filesystem (network or FUSE backed ones) to revalidate.
+	 */
+	if ((attrs->mask & ~(VFS_STATIC_ATTRS | ATTR_RDATTR_ERR)) == 0)
+		flags = AT_STATX_DONT_SYNC;
+
+	/* Fetch only what was asked for */
+	switch (myself->obj_handle.type) {
+	case SOCKET_FILE:
+	case CHARACTER_FILE:
+	case BLOCK_FILE:
+		retval = statx(my_fd, myself->u.unopenable.name,
+			       flags | AT_SYMLINK_NOFOLLOW,
+			       vfs_statx_mask(attrs->mask), &stx);
+		break;
+
+	case REGULAR_FILE:
+	case SYMBOLIC_LINK:
+	case FIFO_FILE:
+	case DIRECTORY:
+		/* Works for the O_PATH fds too */
+		retval = statx(my_fd, "", flags | AT_EMPTY_PATH,
+			       vfs_statx_mask(attrs->mask), &stx);
+		break;
+
+	case NO_FILE_TYPE:
+	case EXTENDED_ATTR:
+		/* Caught during open with EINVAL */
+		break;
+	}
+	func = "statx";
+#else
 	/* Now stat the file as appropriate */
 	switch (myself->obj_handle.type) {
 	case SOCKET_FILE:
@@ -1380,8 +2553,9 @@ fsal_status_t fetch_attrs(struct vfs_fsal_obj_handle *myself,
 		break;
 
 	case REGULAR_FILE:
-		retval = fstat(my_fd, &stat);
-		func = "fstat";
+		/* May be the O_PATH fd, see vfs_stat_by_handle() */
+		retval = vfs_stat_by_handle(my_fd, &stat);
+		func = "vfs_stat_by_handle";
 		break;
 
 	case SYMBOLIC_LINK:
@@ -1396,6 +2570,7 @@ fsal_status_t fetch_attrs(struct vfs_fsal_obj_handle *myself,
 		/* Caught during open with EINVAL */
 		break;
 	}
+#endif
 
 	if (retval < 0) {
 		if (errno == ENOENT)
@@ -1414,7 +2589,11 @@ fsal_status_t fetch_attrs(struct vfs_fsal_obj_handle *myself,
 		return fsalstat(posix2fsal_error(retval), retval);
 	}
 
+#ifdef HAVE_STATX
+	vfs_statx_to_attrs(&stx, attrs);
+#else
 	posix2fsal_attributes(&stat, attrs);
+#endif
 	attrs->fsid = myself->obj_handle.fs->fsid;
 
 	if (myself->sub_ops && myself->sub_ops->getattrs) {
@@ -1470,10 +2649,23 @@ fsal_status_t vfs_getattr2(struct fsal_obj_handle *obj_hdl,
 		goto out;
 	}
 
+	/* An O_PATH fd is only good for stat, a sub-FSAL getattrs (as
+	 * PanFS's ioctl) needs a real open.
+	 */
+	if (obj_hdl->type == REGULAR_FILE &&
+	    !(myself->sub_ops && myself->sub_ops->getattrs)) {
+		my_fd = vfs_path_fd(myself);
+		if (my_fd >= 0) {
+			has_lock = true;
+			status = fetch_attrs(myself, my_fd, attrs);
+			goto out;
+		}
+	}
+
 	/* Get a usable file descriptor (don't need to bypass - FSAL_O_ANY
 	 * won't conflict with any share reservation).
 	 */
-	status = find_fd(&my_fd, obj_hdl, false, NULL, FSAL_O_ANY,
+	status = find_fd(&my_fd, NULL, obj_hdl, false, NULL, FSAL_O_ANY,
 			 &has_lock, &need_fsync, &closefd, false);
 
 	if (FSAL_IS_ERROR(status)) {
@@ -1507,6 +2699,40 @@ fsal_status_t vfs_getattr2(struct fsal_obj_handle *obj_hdl,
 	return status;
 }
 
+/**
+ * @brief Get the change attribute alone
+ *
+ * The change attribute is made from the mtime and ctime, so only they
+ * are asked of statx, and nothing is fetched past the stat.
+ *
+ * @param[in]  obj_hdl Object to query
+ * @param[out] change  Its change attribute
+ *
+ * @return FSAL status.
+ */
+fsal_status_t vfs_getattr_change(struct fsal_obj_handle *obj_hdl,
+				 uint64_t *change)
+{
+	struct attrlist attrs;
+	fsal_status_t status;
+
+	fsal_prepare_attrs(&attrs, ATTR_CHANGE);
+
+	status = vfs_getattr2(obj_hdl, &attrs);
+
+	/* The mask is left as asked, a change still 0 was not got */
+	if (!FSAL_IS_ERROR(status)) {
+		if (attrs.change != 0)
+			*change = attrs.change;
+		else
+			status = fsalstat(ERR_FSAL_NOTSUPP, 0);
+	}
+
+	fsal_release_attrs(&attrs);
+
+	return status;
+}
+
 /**
  * @brief Set attributes on an object
  *
@@ -1611,7 +2837,7 @@ fsal_status_t vfs_setattr2(struct fsal_obj_handle *obj_hdl,
 	/* Get a usable file descriptor. Share conflict is only possible if
 	 * size is being set.
 	 */
-	status = find_fd(&my_fd, obj_hdl, bypass, state, openflags,
+	status = find_fd(&my_fd, NULL, obj_hdl, bypass, state, openflags,
 			 &has_lock, &need_fsync, &closefd, false);
 
 	if (FSAL_IS_ERROR(status)) {
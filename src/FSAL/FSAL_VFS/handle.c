@@ -95,6 +95,7 @@ struct vfs_fsal_obj_handle *alloc_handle(int dirfd,
 	if (hdl->obj_handle.type == REGULAR_FILE) {
 		hdl->u.file.fd.fd = -1;	/* no open on this yet */
 		hdl->u.file.fd.openflags = FSAL_O_CLOSED;
+		hdl->u.file.path_fd = -1;
 	} else if (hdl->obj_handle.type == SYMBOLIC_LINK) {
 		ssize_t retlink;
 		size_t len = stat->st_size + 1;
@@ -157,53 +158,37 @@ struct vfs_fsal_obj_handle *alloc_handle(int dirfd,
 /* handle methods
  */
 
-/* lookup
- * deprecated NULL parent && NULL path implies root handle
+/**
+ * @brief Look up a name in a directory that is already open
+ *
+ * @param[in]  parent     The directory
+ * @param[in]  dirfd      An fd on it, O_PATH will do
+ * @param[in]  path       The name
+ * @param[out] handle     The object found
+ * @param[out] attrs_out  Its attributes, if not NULL
+ *
+ * @return FSAL status.
  */
 
-static fsal_status_t lookup(struct fsal_obj_handle *parent,
-			    const char *path, struct fsal_obj_handle **handle,
-			    struct attrlist *attrs_out)
+static fsal_status_t lookup_at(struct fsal_obj_handle *parent, int dirfd,
+			       const char *path,
+			       struct fsal_obj_handle **handle,
+			       struct attrlist *attrs_out)
 {
 	struct vfs_fsal_obj_handle *parent_hdl, *hdl;
-	fsal_errors_t fsal_error = ERR_FSAL_NO_ERROR;
-	int retval, dirfd;
+	int retval;
 	struct stat stat;
 	vfs_file_handle_t *fh = NULL;
 	fsal_dev_t dev;
 	struct fsal_filesystem *fs;
 	bool xfsal = false;
-	fsal_status_t status;
 
 	vfs_alloc_handle(fh);
 
 	*handle = NULL;		/* poison it first */
 	parent_hdl =
 	    container_of(parent, struct vfs_fsal_obj_handle, obj_handle);
-	if (!parent->obj_ops.handle_is(parent, DIRECTORY)) {
-		LogCrit(COMPONENT_FSAL,
-			"Parent handle is not a directory. hdl = 0x%p", parent);
-		return fsalstat(ERR_FSAL_NOTDIR, 0);
-	}
-
-	if (parent->fsal != parent->fs->fsal) {
-		LogDebug(COMPONENT_FSAL,
-			 "FSAL %s operation for handle belonging to FSAL %s, return EXDEV",
-			 parent->fsal->name,
-			 parent->fs->fsal != NULL
-				? parent->fs->fsal->name
-				: "(none)");
-		return fsalstat(ERR_FSAL_XDEV, EXDEV);
-	}
-
 	fs = parent->fs;
-	dirfd = vfs_fsal_open(parent_hdl, O_PATH | O_NOACCESS, &fsal_error);
-
-	if (dirfd < 0) {
-		LogDebug(COMPONENT_FSAL, "Failed to open parent: %s",
-			 msg_fsal_err(fsal_error));
-		return fsalstat(fsal_error, -dirfd);
-	}
 
 	retval = fstatat(dirfd, path, &stat, AT_SYMLINK_NOFOLLOW);
 
@@ -211,8 +196,7 @@ static fsal_status_t lookup(struct fsal_obj_handle *parent,
 		retval = errno;
 		LogDebug(COMPONENT_FSAL, "Failed to open stat %s: %s", path,
 			 msg_fsal_err(posix2fsal_error(retval)));
-		status = posix2fsal_status(retval);
-		goto direrr;
+		return posix2fsal_status(retval);
 	}
 
 	dev = posix2fsal_devt(stat.st_dev);
@@ -226,8 +210,7 @@ static fsal_status_t lookup(struct fsal_obj_handle *parent,
 				 "Lookup of %s crosses filesystem boundary to unknown file system dev=%"
 				 PRIu64".%"PRIu64,
 				 path, dev.major, dev.minor);
-			status = fsalstat(ERR_FSAL_XDEV, EXDEV);
-			goto direrr;
+			return fsalstat(ERR_FSAL_XDEV, EXDEV);
 		}
 
 		if (fs->fsal != parent->fsal) {
@@ -272,15 +255,13 @@ static fsal_status_t lookup(struct fsal_obj_handle *parent,
 
 			if (retval < 0) {
 				retval = errno;
-				status = posix2fsal_status(retval);
-				goto direrr;
+				return posix2fsal_status(retval);
 			}
 
 			retval = 0;
 		} else {
 			/* Some other error */
-			status = posix2fsal_status(retval);
-			goto direrr;
+			return posix2fsal_status(retval);
 		}
 	}
 
@@ -288,12 +269,8 @@ static fsal_status_t lookup(struct fsal_obj_handle *parent,
 	hdl = alloc_handle(dirfd, fh, fs, &stat, parent_hdl->handle, path,
 			   op_ctx->fsal_export);
 
-	if (hdl == NULL) {
-		status = fsalstat(ERR_FSAL_NOMEM, ENOMEM);
-		goto direrr;
-	}
-
-	close(dirfd);
+	if (hdl == NULL)
+		return fsalstat(ERR_FSAL_NOMEM, ENOMEM);
 
 	if (attrs_out != NULL) {
 		posix2fsal_attributes(&stat, attrs_out);
@@ -304,9 +281,147 @@ static fsal_status_t lookup(struct fsal_obj_handle *parent,
 
 	*handle = &hdl->obj_handle;
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+/* lookup
+ * deprecated NULL parent && NULL path implies root handle
+ */
+
+static fsal_status_t lookup(struct fsal_obj_handle *parent,
+			    const char *path, struct fsal_obj_handle **handle,
+			    struct attrlist *attrs_out)
+{
+	struct vfs_fsal_obj_handle *parent_hdl;
+	fsal_errors_t fsal_error = ERR_FSAL_NO_ERROR;
+	int dirfd;
+	fsal_status_t status;
+
+	*handle = NULL;		/* poison it first */
+	parent_hdl =
+	    container_of(parent, struct vfs_fsal_obj_handle, obj_handle);
+	if (!parent->obj_ops.handle_is(parent, DIRECTORY)) {
+		LogCrit(COMPONENT_FSAL,
+			"Parent handle is not a directory. hdl = 0x%p", parent);
+		return fsalstat(ERR_FSAL_NOTDIR, 0);
+	}
+
+	if (parent->fsal != parent->fs->fsal) {
+		LogDebug(COMPONENT_FSAL,
+			 "FSAL %s operation for handle belonging to FSAL %s, return EXDEV",
+			 parent->fsal->name,
+			 parent->fs->fsal != NULL
+				? parent->fs->fsal->name
+				: "(none)");
+		return fsalstat(ERR_FSAL_XDEV, EXDEV);
+	}
+
+	dirfd = vfs_fsal_open(parent_hdl, O_PATH | O_NOACCESS, &fsal_error);
+
+	if (dirfd < 0) {
+		LogDebug(COMPONENT_FSAL, "Failed to open parent: %s",
+			 msg_fsal_err(fsal_error));
+		return fsalstat(fsal_error, -dirfd);
+	}
+
+	status = lookup_at(parent, dirfd, path, handle, attrs_out);
+
+	close(dirfd);
+
+	return status;
+}
+
+/* lookup_multi
+ * The parent is opened by handle once, and each directory found is
+ * opened with O_PATH from the one above to look up the next name.
+ */
+
+static fsal_status_t lookup_multi(struct fsal_obj_handle *parent,
+				  const char * const *names,
+				  uint32_t count,
+				  struct fsal_obj_handle **handles,
+				  struct attrlist *attrs_out,
+				  uint32_t *found)
+{
+	struct vfs_fsal_obj_handle *parent_hdl, *hdl;
+	struct fsal_obj_handle *dir = parent;
+	fsal_errors_t fsal_error = ERR_FSAL_NO_ERROR;
+	fsal_status_t status;
+	struct stat stat;
+	int dirfd, fd;
+
+	*found = 0;
+	parent_hdl =
+	    container_of(parent, struct vfs_fsal_obj_handle, obj_handle);
+	if (!parent->obj_ops.handle_is(parent, DIRECTORY)) {
+		LogCrit(COMPONENT_FSAL,
+			"Parent handle is not a directory. hdl = 0x%p", parent);
+		return fsalstat(ERR_FSAL_NOTDIR, 0);
+	}
+
+	if (parent->fsal != parent->fs->fsal) {
+		LogDebug(COMPONENT_FSAL,
+			 "FSAL %s operation for handle belonging to FSAL %s, return EXDEV",
+			 parent->fsal->name,
+			 parent->fs->fsal != NULL
+				? parent->fs->fsal->name
+				: "(none)");
+		return fsalstat(ERR_FSAL_XDEV, EXDEV);
+	}
+
+	dirfd = vfs_fsal_open(parent_hdl, O_PATH | O_NOACCESS, &fsal_error);
+
+	if (dirfd < 0) {
+		LogDebug(COMPONENT_FSAL, "Failed to open parent: %s",
+			 msg_fsal_err(fsal_error));
+		return fsalstat(fsal_error, -dirfd);
+	}
+
+	for (;;) {
+		status = lookup_at(dir, dirfd, names[*found],
+				   &handles[*found],
+				   attrs_out != NULL
+					? &attrs_out[*found]
+					: NULL);
+
+		if (FSAL_IS_ERROR(status))
+			break;
+
+		dir = handles[(*found)++];
+
+		if (*found == count)
+			break;
+
+		if (dir->type != DIRECTORY) {
+			status = fsalstat(ERR_FSAL_NOTDIR, 0);
+			break;
+		}
+
+		/* Leave other filesystems to lookup */
+		if (dir->fs != parent->fs)
+			break;
+
+		fd = openat(dirfd, names[*found - 1],
+			    O_PATH | O_NOACCESS | O_NOFOLLOW | O_DIRECTORY);
+
+		if (fd < 0)
+			break;
+
+		/* The name may have moved since lookup_at found it */
+		hdl = container_of(dir, struct vfs_fsal_obj_handle,
+				   obj_handle);
+		if (fstat(fd, &stat) < 0 || stat.st_ino != dir->fileid ||
+		    posix2fsal_devt(stat.st_dev).major != hdl->dev.major ||
+		    posix2fsal_devt(stat.st_dev).minor != hdl->dev.minor) {
+			close(fd);
+			break;
+		}
+
+		close(dirfd);
+		dirfd = fd;
+	}
 
- direrr:
 	close(dirfd);
+
 	return status;
 }
 
@@ -1043,11 +1158,13 @@ static fsal_status_t linkfile(struct fsal_obj_handle *obj_hdl,
 	return fsalstat(fsal_error, retval);
 }
 
-#define BUF_SIZE 1024
+/* Read a large directory in few getdents calls */
+#define BUF_SIZE (64 * 1024)
 /**
  * read_dirents
  * read the directory and call through the callback function for
- * each entry.
+ * each entry.  Each name is looked up through the fd the directory
+ * is read from, rather than by opening the directory again.
  * @param dir_hdl [IN] the directory to read
  * @param whence [IN] where to start (next)
  * @param dir_state [IN] pass thru of state to callback
@@ -1069,7 +1186,7 @@ static fsal_status_t read_dirents(struct fsal_obj_handle *dir_hdl,
 	unsigned int bpos;
 	int nread;
 	struct vfs_dirent dentry, *dentryp = &dentry;
-	char buf[BUF_SIZE];
+	char *buf = NULL;
 
 	if (whence != NULL)
 		seekloc = (off_t) *whence;
@@ -1097,6 +1214,8 @@ static fsal_status_t read_dirents(struct fsal_obj_handle *dir_hdl,
 		goto done;
 	}
 
+	buf = gsh_malloc(BUF_SIZE);
+
 	do {
 		baseloc = seekloc;
 		nread = vfs_readents(dirfd, buf, BUF_SIZE, &seekloc);
@@ -1119,8 +1238,8 @@ static fsal_status_t read_dirents(struct fsal_obj_handle *dir_hdl,
 
 			fsal_prepare_attrs(&attrs, attrmask);
 
-			status = lookup(dir_hdl, dentryp->vd_name,
-					&hdl, &attrs);
+			status = lookup_at(dir_hdl, dirfd, dentryp->vd_name,
+					   &hdl, &attrs);
 
 			if (FSAL_IS_ERROR(status))
 				goto done;
@@ -1141,6 +1260,7 @@ static fsal_status_t read_dirents(struct fsal_obj_handle *dir_hdl,
 
 	*eof = true;
  done:
+	gsh_free(buf);
 	close(dirfd);
 
  out:
@@ -1493,6 +1613,7 @@ static void release(struct fsal_obj_handle *obj_hdl)
 		PTHREAD_RWLOCK_wrlock(&obj_hdl->lock);
 
 		st = vfs_close_my_fd(&myself->u.file.fd);
+		vfs_close_path_fd(myself);
 
 		PTHREAD_RWLOCK_unlock(&obj_hdl->lock);
 
@@ -1513,6 +1634,7 @@ static void release(struct fsal_obj_handle *obj_hdl)
 
 		handle_to_key(obj_hdl, &key);
 		vfs_state_release(&key);
+		vfs_commit_free(myself);
 	} else if (vfs_unopenable_type(type)) {
 		if (myself->u.unopenable.name != NULL)
 			gsh_free(myself->u.unopenable.name);
@@ -1532,12 +1654,14 @@ void vfs_handle_ops_init(struct fsal_obj_ops *ops)
 	ops->release = release;
 	ops->merge = vfs_merge;
 	ops->lookup = lookup;
+	ops->lookup_multi = lookup_multi;
 	ops->readdir = read_dirents;
 	ops->mkdir = makedir;
 	ops->mknode = makenode;
 	ops->symlink = makesymlink;
 	ops->readlink = readsymlink;
 	ops->getattrs = vfs_getattr2;
+	ops->getattr_change = vfs_getattr_change;
 	ops->link = linkfile;
 	ops->rename = renamefile;
 	ops->unlink = file_unlink;
@@ -1546,8 +1670,15 @@ void vfs_handle_ops_init(struct fsal_obj_ops *ops)
 	ops->handle_to_key = handle_to_key;
 	ops->open2 = vfs_open2;
 	ops->reopen2 = vfs_reopen2;
+	ops->check_verifier = vfs_check_verifier;
 	ops->read2 = vfs_read2;
 	ops->write2 = vfs_write2;
+	ops->seek2 = vfs_seek2;
+	ops->copy = vfs_copy;
+	ops->clone = vfs_clone;
+	ops->fallocate = vfs_fallocate;
+	ops->write_vec = vfs_write_vec;
+	ops->read_vec = vfs_read_vec;
 	ops->commit2 = vfs_commit2;
 	ops->lock_op2 = vfs_lock_op2;
 	ops->setattr2 = vfs_setattr2;
@@ -0,0 +1,132 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ * -------------
+ */
+
+/* readahead.c
+ * Readahead for sequential reads
+ *
+ * When readahead_max is set in the VFS block, each file remembers where
+ * its last read ended.  A read starting there continues a stream: its
+ * window doubles, from the size of the read up to readahead_max, and
+ * the part of the window past what was already advised is handed to
+ * the kernel with posix_fadvise(POSIX_FADV_WILLNEED), which starts
+ * reading it into the page cache without waiting for it.  Clients
+ * reading a file sequentially then find their next READs in memory,
+ * however the requests were spread over the workers and descriptors.
+ * Any other read ends the stream.
+ *
+ * A read on a stream that was entirely advised counts as a hit, any
+ * other as a miss; both are logged when the module is unloaded.  One
+ * stream is followed per file, so clients reading the same file at
+ * different places restart each other's window rather than read ahead
+ * for nothing.
+ */
+
+#include "config.h"
+
+#include <fcntl.h>
+#include "fsal.h"
+#include "vfs_methods.h"
+
+static uint64_t readahead_max;
+
+static struct {
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t advised;
+} readahead_stats;
+
+void vfs_readahead_init(uint64_t max)
+{
+	readahead_max = max;
+
+	if (max != 0)
+		LogInfo(COMPONENT_FSAL,
+			"Reading ahead up to %"PRIu64
+			" bytes of sequential reads", max);
+}
+
+void vfs_readahead_shutdown(void)
+{
+	if (readahead_max == 0)
+		return;
+
+	LogInfo(COMPONENT_FSAL,
+		"Readahead hits %"PRIu64" misses %"PRIu64
+		" bytes advised %"PRIu64,
+		atomic_fetch_uint64_t(&readahead_stats.hits),
+		atomic_fetch_uint64_t(&readahead_stats.misses),
+		atomic_fetch_uint64_t(&readahead_stats.advised));
+}
+
+/**
+ * @brief Follow a read, and read ahead of it if it continues a stream
+ *
+ * Called once the read is done.  Concurrent reads of a file may race on
+ * its state; the worst that comes of it is a window restarted or an
+ * area advised twice.
+ *
+ * @param[in] ra      Readahead state of the file
+ * @param[in] fd      Descriptor the read was made on
+ * @param[in] offset  Where the read started
+ * @param[in] size    Bytes read
+ */
+void vfs_readahead(struct vfs_readahead *ra, int fd, uint64_t offset,
+		   size_t size)
+{
+	uint64_t end = offset + size;
+	uint64_t window, ahead, from;
+
+	if (readahead_max == 0 || size == 0)
+		return;
+
+	if (atomic_fetch_uint64_t(&ra->next) != offset) {
+		/* Not sequential, wait for the next read to tell */
+		atomic_store_uint64_t(&ra->window, 0);
+		atomic_store_uint64_t(&ra->ahead, 0);
+		atomic_store_uint64_t(&ra->next, end);
+		return;
+	}
+
+	window = atomic_fetch_uint64_t(&ra->window);
+	ahead = atomic_fetch_uint64_t(&ra->ahead);
+
+	if (end <= ahead)
+		(void) atomic_inc_uint64_t(&readahead_stats.hits);
+	else
+		(void) atomic_inc_uint64_t(&readahead_stats.misses);
+
+	window = window == 0 ? size : 2 * window;
+	if (window > readahead_max)
+		window = readahead_max;
+
+	from = ahead > end ? ahead : end;
+
+	if (end + window > from) {
+		if (posix_fadvise(fd, from, end + window - from,
+				  POSIX_FADV_WILLNEED) == 0)
+			(void) atomic_add_uint64_t(&readahead_stats.advised,
+						   end + window - from);
+		ahead = end + window;
+	}
+
+	atomic_store_uint64_t(&ra->window, window);
+	atomic_store_uint64_t(&ra->ahead, ahead);
+	atomic_store_uint64_t(&ra->next, end);
+}
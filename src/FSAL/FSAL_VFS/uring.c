@@ -0,0 +1,615 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ * -------------
+ */
+
+/* uring.c
+ * File I/O through io_uring
+ *
+ * When io_uring_rings is set in the VFS block, reads, writes and fsyncs
+ * on file descriptors go to that many io_uring instances instead of
+ * being made as system calls.  A worker picks the ring of the CPU it
+ * runs on, queues its request and sleeps until the reaper thread of the
+ * ring hands it the result, so slow storage shows up as a deeper queue
+ * in the kernel rather than as more blocked system calls, and requests
+ * from all workers on a CPU go down in the same ring.
+ *
+ * Each ring also registers up to io_uring_fixed_files of the long lived
+ * descriptors, those of open states and global fds; the kernel then
+ * skips the file table lookup and reference for each request on them.
+ * A descriptor has one slot, picked from its number; a descriptor that
+ * wants an occupied slot takes it over after missing it
+ * URING_FIXED_STEAL times, so the slots settle on the busiest files.
+ * vfs_uring_forget() must be called before such a descriptor is closed.
+ *
+ * Without kernel support, or if a ring can't be set up, the calls are
+ * made directly as before.
+ */
+
+#include "config.h"
+
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include "fsal.h"
+#include "vfs_methods.h"
+
+#if defined(HAVE_LINUX_IO_URING_H)
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+#if defined(HAVE_LINUX_IO_URING_H) && defined(__NR_io_uring_setup)
+
+/* Misses after which a descriptor takes over an occupied fixed slot */
+#define URING_FIXED_STEAL 16
+
+/**
+ * @brief A request waiting for its completion
+ */
+struct uring_req {
+	pthread_cond_t cv;
+	int32_t res;
+	bool done;
+};
+
+struct uring {
+	int fd;
+	pthread_t reaper;
+	/** Protects submission, in-flight count and fixed slots */
+	pthread_mutex_t mtx;
+	/** Submitters waiting for room */
+	pthread_cond_t room;
+	uint32_t inflight;
+	uint32_t entries;
+	/* Submission queue */
+	void *sq_ring;
+	size_t sq_len;
+	unsigned int *sq_head;
+	unsigned int *sq_tail;
+	unsigned int *sq_mask;
+	unsigned int *sq_array;
+	struct io_uring_sqe *sqes;
+	/* Completion queue */
+	void *cq_ring;
+	size_t cq_len;
+	unsigned int *cq_head;
+	unsigned int *cq_tail;
+	unsigned int *cq_mask;
+	struct io_uring_cqe *cqes;
+	/* Registered descriptors, -1 for a free slot */
+	int32_t *fixed;
+	uint16_t *misses;
+	uint32_t nfixed;
+};
+
+static struct uring *rings;
+static uint32_t nrings;
+
+static inline int sys_io_uring_setup(unsigned int entries,
+				     struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static inline int sys_io_uring_enter(int fd, unsigned int to_submit,
+				     unsigned int min_complete,
+				     unsigned int flags)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+		       flags, NULL, 0);
+}
+
+static inline int sys_io_uring_register(int fd, unsigned int opcode,
+					void *arg, unsigned int nr_args)
+{
+	return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static void *uring_reaper(void *arg)
+{
+	struct uring *ring = arg;
+	struct io_uring_cqe *cqe;
+	struct uring_req *req;
+	unsigned int head, tail;
+	bool stop = false;
+
+	SetNameFunction("vfs_uring");
+
+	while (!stop) {
+		if (sys_io_uring_enter(ring->fd, 0, 1,
+				       IORING_ENTER_GETEVENTS) < 0 &&
+		    errno != EINTR) {
+			LogCrit(COMPONENT_FSAL,
+				"io_uring_enter failed: %s", strerror(errno));
+			break;
+		}
+
+		PTHREAD_MUTEX_lock(&ring->mtx);
+
+		head = *ring->cq_head;
+		tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+
+		for (; head != tail; head++) {
+			cqe = &ring->cqes[head & *ring->cq_mask];
+			req = (struct uring_req *)(uintptr_t) cqe->user_data;
+			if (req == NULL) {
+				/* The NOP queued by vfs_uring_shutdown */
+				stop = true;
+				continue;
+			}
+			req->res = cqe->res;
+			req->done = true;
+			pthread_cond_signal(&req->cv);
+			ring->inflight--;
+		}
+
+		__atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+
+		if (ring->inflight < ring->entries)
+			pthread_cond_broadcast(&ring->room);
+
+		PTHREAD_MUTEX_unlock(&ring->mtx);
+	}
+
+	return NULL;
+}
+
+static void uring_unmap(struct uring *ring)
+{
+	if (ring->sqes != NULL)
+		munmap(ring->sqes, ring->entries * sizeof(struct io_uring_sqe));
+	if (ring->cq_ring != NULL && ring->cq_ring != ring->sq_ring)
+		munmap(ring->cq_ring, ring->cq_len);
+	if (ring->sq_ring != NULL)
+		munmap(ring->sq_ring, ring->sq_len);
+	close(ring->fd);
+	gsh_free(ring->fixed);
+	gsh_free(ring->misses);
+}
+
+static void uring_fixed_init(struct uring *ring, uint32_t nfixed)
+{
+	uint32_t ix;
+
+	if (nfixed == 0)
+		return;
+
+	ring->fixed = gsh_malloc(nfixed * sizeof(*ring->fixed));
+	ring->misses = gsh_calloc(nfixed, sizeof(*ring->misses));
+	for (ix = 0; ix < nfixed; ix++)
+		ring->fixed[ix] = -1;
+
+	/* A table of empty slots needs a 5.5 kernel; older ones simply
+	 * get no fixed files.
+	 */
+	if (sys_io_uring_register(ring->fd, IORING_REGISTER_FILES,
+				  ring->fixed, nfixed) < 0) {
+		LogInfo(COMPONENT_FSAL,
+			"Could not register io_uring files: %s",
+			strerror(errno));
+		gsh_free(ring->fixed);
+		gsh_free(ring->misses);
+		ring->fixed = NULL;
+		ring->misses = NULL;
+		return;
+	}
+
+	ring->nfixed = nfixed;
+}
+
+static int uring_setup(struct uring *ring, uint32_t depth, uint32_t nfixed)
+{
+	struct io_uring_params p;
+	char *sq, *cq;
+	int retval;
+
+	memset(&p, 0, sizeof(p));
+	memset(ring, 0, sizeof(*ring));
+
+	ring->fd = sys_io_uring_setup(depth, &p);
+	if (ring->fd < 0)
+		return errno;
+
+	ring->entries = p.sq_entries;
+	ring->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	ring->cq_len = p.cq_off.cqes +
+		       p.cq_entries * sizeof(struct io_uring_cqe);
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (ring->cq_len > ring->sq_len)
+			ring->sq_len = ring->cq_len;
+		ring->cq_len = ring->sq_len;
+	}
+
+	sq = mmap(NULL, ring->sq_len, PROT_READ | PROT_WRITE,
+		  MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	if (sq == MAP_FAILED)
+		goto err;
+	ring->sq_ring = sq;
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		cq = sq;
+	} else {
+		cq = mmap(NULL, ring->cq_len, PROT_READ | PROT_WRITE,
+			  MAP_SHARED | MAP_POPULATE, ring->fd,
+			  IORING_OFF_CQ_RING);
+		if (cq == MAP_FAILED)
+			goto err;
+	}
+	ring->cq_ring = cq;
+
+	ring->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+			  PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			  ring->fd, IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED) {
+		ring->sqes = NULL;
+		goto err;
+	}
+
+	ring->sq_head = (unsigned int *)(sq + p.sq_off.head);
+	ring->sq_tail = (unsigned int *)(sq + p.sq_off.tail);
+	ring->sq_mask = (unsigned int *)(sq + p.sq_off.ring_mask);
+	ring->sq_array = (unsigned int *)(sq + p.sq_off.array);
+	ring->cq_head = (unsigned int *)(cq + p.cq_off.head);
+	ring->cq_tail = (unsigned int *)(cq + p.cq_off.tail);
+	ring->cq_mask = (unsigned int *)(cq + p.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+	uring_fixed_init(ring, nfixed);
+
+	PTHREAD_MUTEX_init(&ring->mtx, NULL);
+	PTHREAD_COND_init(&ring->room, NULL);
+
+	retval = pthread_create(&ring->reaper, NULL, uring_reaper, ring);
+	if (retval != 0) {
+		PTHREAD_COND_destroy(&ring->room);
+		PTHREAD_MUTEX_destroy(&ring->mtx);
+		uring_unmap(ring);
+		return retval;
+	}
+
+	return 0;
+
+err:
+	retval = errno;
+	uring_unmap(ring);
+	return retval;
+}
+
+/**
+ * @brief Start the io_uring engine
+ *
+ * @param[in] count   Rings, 0 to make system calls as usual
+ * @param[in] depth   Requests in flight per ring
+ * @param[in] nfixed  Fixed file slots per ring
+ */
+void vfs_uring_init(uint32_t count, uint32_t depth, uint32_t nfixed)
+{
+	struct uring *new_rings;
+	uint32_t ix;
+	int retval = 0;
+
+	if (count == 0 || rings != NULL)
+		return;
+
+	new_rings = gsh_calloc(count, sizeof(*new_rings));
+
+	for (ix = 0; ix < count; ix++) {
+		retval = uring_setup(&new_rings[ix], depth, nfixed);
+		if (retval != 0)
+			break;
+	}
+
+	if (ix == 0) {
+		LogWarn(COMPONENT_FSAL,
+			"Could not set up io_uring, using system calls: %s",
+			strerror(retval));
+		gsh_free(new_rings);
+		return;
+	}
+
+	if (ix < count) {
+		LogWarn(COMPONENT_FSAL,
+			"Only set up %"PRIu32" of %"PRIu32" io_urings: %s",
+			ix, count, strerror(retval));
+	}
+
+	LogInfo(COMPONENT_FSAL,
+		"FSAL_VFS I/O through %"PRIu32" io_urings of %"PRIu32
+		" entries, %"PRIu32" fixed files each",
+		ix, new_rings[0].entries, new_rings[0].nfixed);
+
+	nrings = ix;
+	rings = new_rings;
+}
+
+static inline struct uring *uring_mine(void)
+{
+	int cpu = sched_getcpu();
+
+	return &rings[(cpu < 0 ? 0 : cpu) % nrings];
+}
+
+/**
+ * @brief Queue one request, called with the ring's mutex held
+ */
+static void uring_submit_locked(struct uring *ring, struct io_uring_sqe *tmpl)
+{
+	unsigned int tail = *ring->sq_tail;
+	unsigned int idx = tail & *ring->sq_mask;
+
+	ring->sqes[idx] = *tmpl;
+	ring->sq_array[idx] = idx;
+	__atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+	while (sys_io_uring_enter(ring->fd, 1, 0, 0) < 0 &&
+	       (errno == EINTR || errno == EAGAIN || errno == EBUSY))
+		;
+}
+
+/**
+ * @brief Use a fixed slot for a descriptor if it has, or can take, one
+ *
+ * Called with the ring's mutex held.
+ *
+ * @return The slot, or -1 to use fd as is.
+ */
+static int uring_fixed_slot(struct uring *ring, int fd)
+{
+	uint32_t slot;
+	struct io_uring_files_update upd;
+	int32_t newfd = fd;
+
+	if (ring->nfixed == 0)
+		return -1;
+
+	slot = (uint32_t) fd % ring->nfixed;
+
+	if (ring->fixed[slot] == fd)
+		return slot;
+
+	if (ring->fixed[slot] != -1 &&
+	    ++ring->misses[slot] < URING_FIXED_STEAL)
+		return -1;
+
+	memset(&upd, 0, sizeof(upd));
+	upd.offset = slot;
+	upd.fds = (uintptr_t) &newfd;
+
+	if (sys_io_uring_register(ring->fd, IORING_REGISTER_FILES_UPDATE,
+				  &upd, 1) != 1)
+		return -1;
+
+	ring->fixed[slot] = fd;
+	ring->misses[slot] = 0;
+
+	return slot;
+}
+
+/**
+ * @brief Run one request through the ring of this CPU
+ *
+ * @param[in] sqe    The request, without user_data
+ * @param[in] fixed  The descriptor is long lived and may be registered
+ *
+ * @return The result as a system call would return it.
+ */
+static ssize_t uring_run(struct io_uring_sqe *sqe, bool fixed)
+{
+	struct uring *ring = uring_mine();
+	struct uring_req req;
+	int slot;
+
+	req.res = 0;
+	req.done = false;
+	PTHREAD_COND_init(&req.cv, NULL);
+	sqe->user_data = (uintptr_t) &req;
+
+	PTHREAD_MUTEX_lock(&ring->mtx);
+
+	while (ring->inflight >= ring->entries)
+		pthread_cond_wait(&ring->room, &ring->mtx);
+
+	/* The slot is looked up and used under the mutex, so a
+	 * concurrent vfs_uring_forget() can't hand it to another file
+	 * in between.
+	 */
+	slot = fixed ? uring_fixed_slot(ring, sqe->fd) : -1;
+	if (slot >= 0) {
+		sqe->fd = slot;
+		sqe->flags |= IOSQE_FIXED_FILE;
+	}
+
+	ring->inflight++;
+	uring_submit_locked(ring, sqe);
+
+	while (!req.done)
+		pthread_cond_wait(&req.cv, &ring->mtx);
+
+	PTHREAD_MUTEX_unlock(&ring->mtx);
+
+	PTHREAD_COND_destroy(&req.cv);
+
+	if (req.res < 0) {
+		errno = -req.res;
+		return -1;
+	}
+
+	return req.res;
+}
+
+static void uring_prep_rw(struct io_uring_sqe *sqe, int op, int fd,
+			  const struct iovec *iov, int iovcnt, off_t offset)
+{
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = op;
+	sqe->fd = fd;
+	sqe->off = offset;
+	sqe->addr = (uintptr_t) iov;
+	sqe->len = iovcnt;
+}
+
+ssize_t vfs_uring_preadv(int fd, const struct iovec *iov, int iovcnt,
+			 off_t offset, bool fixed)
+{
+	struct io_uring_sqe sqe;
+
+	if (rings == NULL)
+		return preadv(fd, iov, iovcnt, offset);
+
+	uring_prep_rw(&sqe, IORING_OP_READV, fd, iov, iovcnt, offset);
+	return uring_run(&sqe, fixed);
+}
+
+ssize_t vfs_uring_pwritev(int fd, const struct iovec *iov, int iovcnt,
+			  off_t offset, bool fixed)
+{
+	struct io_uring_sqe sqe;
+
+	if (rings == NULL)
+		return pwritev(fd, iov, iovcnt, offset);
+
+	uring_prep_rw(&sqe, IORING_OP_WRITEV, fd, iov, iovcnt, offset);
+	return uring_run(&sqe, fixed);
+}
+
+int vfs_uring_fsync(int fd, bool fixed)
+{
+	struct io_uring_sqe sqe;
+
+	if (rings == NULL)
+		return fsync(fd);
+
+	memset(&sqe, 0, sizeof(sqe));
+	sqe.opcode = IORING_OP_FSYNC;
+	sqe.fd = fd;
+	return uring_run(&sqe, fixed);
+}
+
+/**
+ * @brief Drop a descriptor about to be closed from the fixed slots
+ *
+ * @param[in] fd  The descriptor
+ */
+void vfs_uring_forget(int fd)
+{
+	struct io_uring_files_update upd;
+	int32_t none = -1;
+	struct uring *ring;
+	uint32_t ix, slot;
+
+	if (rings == NULL || fd < 0)
+		return;
+
+	for (ix = 0; ix < nrings; ix++) {
+		ring = &rings[ix];
+		if (ring->nfixed == 0)
+			continue;
+
+		slot = (uint32_t) fd % ring->nfixed;
+
+		PTHREAD_MUTEX_lock(&ring->mtx);
+
+		if (ring->fixed[slot] == fd) {
+			memset(&upd, 0, sizeof(upd));
+			upd.offset = slot;
+			upd.fds = (uintptr_t) &none;
+			(void) sys_io_uring_register(
+				ring->fd, IORING_REGISTER_FILES_UPDATE,
+				&upd, 1);
+			ring->fixed[slot] = -1;
+			ring->misses[slot] = 0;
+		}
+
+		PTHREAD_MUTEX_unlock(&ring->mtx);
+	}
+}
+
+/**
+ * @brief Stop the reapers and tear the rings down
+ */
+void vfs_uring_shutdown(void)
+{
+	struct io_uring_sqe sqe;
+	struct uring *ring;
+	uint32_t ix;
+
+	if (rings == NULL)
+		return;
+
+	for (ix = 0; ix < nrings; ix++) {
+		ring = &rings[ix];
+
+		memset(&sqe, 0, sizeof(sqe));
+		sqe.opcode = IORING_OP_NOP;
+
+		PTHREAD_MUTEX_lock(&ring->mtx);
+		uring_submit_locked(ring, &sqe);
+		PTHREAD_MUTEX_unlock(&ring->mtx);
+
+		pthread_join(ring->reaper, NULL);
+
+		PTHREAD_COND_destroy(&ring->room);
+		PTHREAD_MUTEX_destroy(&ring->mtx);
+		uring_unmap(ring);
+	}
+
+	gsh_free(rings);
+	rings = NULL;
+	nrings = 0;
+}
+
+#else /* HAVE_LINUX_IO_URING_H */
+
+void vfs_uring_init(uint32_t count, uint32_t depth, uint32_t nfixed)
+{
+	if (count != 0)
+		LogWarn(COMPONENT_FSAL,
+			"io_uring is not supported by this build, using system calls");
+}
+
+ssize_t vfs_uring_preadv(int fd, const struct iovec *iov, int iovcnt,
+			 off_t offset, bool fixed)
+{
+	return preadv(fd, iov, iovcnt, offset);
+}
+
+ssize_t vfs_uring_pwritev(int fd, const struct iovec *iov, int iovcnt,
+			  off_t offset, bool fixed)
+{
+	return pwritev(fd, iov, iovcnt, offset);
+}
+
+int vfs_uring_fsync(int fd, bool fixed)
+{
+	return fsync(fd);
+}
+
+void vfs_uring_forget(int fd)
+{
+}
+
+void vfs_uring_shutdown(void)
+{
+}
+
+#endif /* HAVE_LINUX_IO_URING_H */
@@ -40,6 +40,7 @@
 #include "fsal.h"
 #include "FSAL/fsal_init.h"
 #include "fsal_handle_syscalls.h"
+#include "../vfs_methods.h"
 
 /* VFS FSAL module private storage
  */
@@ -56,7 +57,14 @@
 struct vfs_fsal_module {
 	struct fsal_module fsal;
 	struct fsal_staticfsinfo_t fs_info;
-	/* vfsfs_specific_initinfo_t specific_info;  placeholder */
+	/** io_uring instances for file I/O, 0 for none */
+	uint32_t uring_rings;
+	/** Requests in flight per ring */
+	uint32_t uring_depth;
+	/** Registered file descriptors per ring */
+	uint32_t uring_fixed_files;
+	/** Bytes read ahead of sequential reads at most, 0 for none */
+	uint64_t readahead_max;
 };
 
 const char myname[] = "VFS";
@@ -87,21 +95,31 @@ static struct fsal_staticfsinfo_t default_posix_info = {
 
 static struct config_item vfs_params[] = {
 	CONF_ITEM_BOOL("link_support", true,
-		       fsal_staticfsinfo_t, link_support),
+		       vfs_fsal_module, fs_info.link_support),
 	CONF_ITEM_BOOL("symlink_support", true,
-		       fsal_staticfsinfo_t, symlink_support),
+		       vfs_fsal_module, fs_info.symlink_support),
 	CONF_ITEM_BOOL("cansettime", true,
-		       fsal_staticfsinfo_t, cansettime),
+		       vfs_fsal_module, fs_info.cansettime),
 	CONF_ITEM_UI64("maxread", 512, FSAL_MAXIOSIZE, FSAL_MAXIOSIZE,
-		       fsal_staticfsinfo_t, maxread),
+		       vfs_fsal_module, fs_info.maxread),
 	CONF_ITEM_UI64("maxwrite", 512, FSAL_MAXIOSIZE, FSAL_MAXIOSIZE,
-		       fsal_staticfsinfo_t, maxwrite),
+		       vfs_fsal_module, fs_info.maxwrite),
 	CONF_ITEM_MODE("umask", 0,
-		       fsal_staticfsinfo_t, umask),
+		       vfs_fsal_module, fs_info.umask),
 	CONF_ITEM_BOOL("auth_xdev_export", false,
-		       fsal_staticfsinfo_t, auth_exportpath_xdev),
+		       vfs_fsal_module, fs_info.auth_exportpath_xdev),
 	CONF_ITEM_MODE("xattr_access_rights", 0400,
-		       fsal_staticfsinfo_t, xattr_access_rights),
+		       vfs_fsal_module, fs_info.xattr_access_rights),
+	CONF_ITEM_UI32("io_uring_rings", 0, 256, 0,
+		       vfs_fsal_module, uring_rings),
+	CONF_ITEM_UI32("io_uring_depth", 8, 4096, 256,
+		       vfs_fsal_module, uring_depth),
+	CONF_ITEM_UI32("io_uring_fixed_files", 0, 32768, 1024,
+		       vfs_fsal_module, uring_fixed_files),
+	CONF_ITEM_UI64("readahead_max", 0, 1024 * 1024 * 1024, 0,
+		       vfs_fsal_module, readahead_max),
+	CONF_ITEM_BOOL("native_exclusive_create", false,
+		       vfs_fsal_module, fs_info.native_exclusive_create),
 	CONFIG_EOL
 };
 
@@ -184,12 +202,15 @@ static fsal_status_t init_config(struct fsal_module *fsal_hdl,
 
 	(void) load_config_from_parse(config_struct,
 				      &vfs_param,
-				      &vfs_me->fs_info,
+				      vfs_me,
 				      true,
 				      err_type);
 	if (!config_error_is_harmless(err_type))
 		return fsalstat(ERR_FSAL_INVAL, 0);
 	display_fsinfo(&vfs_me->fs_info);
+	vfs_uring_init(vfs_me->uring_rings, vfs_me->uring_depth,
+		       vfs_me->uring_fixed_files);
+	vfs_readahead_init(vfs_me->readahead_max);
 	LogFullDebug(COMPONENT_FSAL,
 		     "Supported attributes constant = 0x%" PRIx64,
 		     (uint64_t) VFS_SUPPORTED_ATTRIBUTES);
@@ -260,4 +281,8 @@ MODULE_FINI void vfs_unload(void)
 		fprintf(stderr, "VFS module failed to unregister");
 		return;
 	}
+
+	vfs_uring_shutdown();
+	vfs_readahead_shutdown();
+	vfs_commit_shutdown();
 }
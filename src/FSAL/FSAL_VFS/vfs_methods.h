@@ -43,6 +43,8 @@ struct vfs_fsal_export {
 	struct fsal_filesystem *root_fs;
 	struct glist_head filesystems;
 	int fsid_type;
+	/** Open files O_DIRECT */
+	bool direct_io;
 };
 
 #define EXPORT_VFS_FROM_FSAL(fsal) \
@@ -121,6 +123,8 @@ struct vfs_fd {
 	fsal_openflags_t openflags;
 	/** The kernel file descriptor. */
 	int fd;
+	/** Opened O_DIRECT, see vfs_file_preadv() */
+	bool direct;
 };
 
 /*
@@ -137,6 +141,16 @@ struct vfs_fd {
  * this, we save the args that were used to mknod or lookup the socket.
  */
 
+/** Readahead state of a file, see readahead.c */
+struct vfs_readahead {
+	/** Where the last read ended */
+	uint64_t next;
+	/** Where the area advised to the kernel ends */
+	uint64_t ahead;
+	/** Bytes to keep advised past the last read, 0 out of a stream */
+	uint64_t window;
+};
+
 struct vfs_fsal_obj_handle {
 	struct fsal_obj_handle obj_handle;
 	fsal_dev_t dev;
@@ -150,6 +164,11 @@ struct vfs_fsal_obj_handle {
 		struct {
 			struct fsal_share share;
 			struct vfs_fd fd;
+			struct vfs_readahead ra;
+			/** O_PATH fd for getattr, see vfs_path_fd() */
+			int path_fd;
+			/** Group commit state, see commit.c */
+			struct vfs_commit *commit;
 		} file;
 		struct {
 			unsigned char *link_content;
@@ -248,6 +267,31 @@ struct state_hdl *vfs_state_locate(struct fsal_obj_handle *obj);
 
 	/* I/O management */
 fsal_status_t vfs_close_my_fd(struct vfs_fd *my_fd);
+void vfs_close_path_fd(struct vfs_fsal_obj_handle *myself);
+
+/* io_uring engine, see uring.c */
+void vfs_uring_init(uint32_t count, uint32_t depth, uint32_t nfixed);
+void vfs_uring_shutdown(void);
+ssize_t vfs_uring_preadv(int fd, const struct iovec *iov, int iovcnt,
+			 off_t offset, bool fixed);
+ssize_t vfs_uring_pwritev(int fd, const struct iovec *iov, int iovcnt,
+			  off_t offset, bool fixed);
+int vfs_uring_fsync(int fd, bool fixed);
+void vfs_uring_forget(int fd);
+
+/* Readahead of sequential reads, see readahead.c */
+void vfs_readahead_init(uint64_t max);
+void vfs_readahead_shutdown(void);
+void vfs_readahead(struct vfs_readahead *ra, int fd, uint64_t offset,
+		   size_t size);
+
+/* Group commit, see commit.c */
+typedef fsal_status_t (*vfs_sync_func)(struct vfs_fsal_obj_handle *myself);
+
+void vfs_commit_shutdown(void);
+fsal_status_t vfs_group_commit(struct vfs_fsal_obj_handle *myself,
+			       vfs_sync_func do_sync);
+void vfs_commit_free(struct vfs_fsal_obj_handle *myself);
 
 fsal_status_t vfs_close(struct fsal_obj_handle *obj_hdl);
 
@@ -270,6 +314,9 @@ fsal_status_t vfs_open2(struct fsal_obj_handle *obj_hdl,
 			struct attrlist *attrs_out,
 			bool *caller_perm_check);
 
+bool vfs_check_verifier(struct fsal_obj_handle *obj_hdl,
+			fsal_verifier_t verifier);
+
 fsal_status_t vfs_reopen2(struct fsal_obj_handle *obj_hdl,
 			  struct state_t *state,
 			  fsal_openflags_t openflags);
@@ -294,6 +341,50 @@ fsal_status_t vfs_write2(struct fsal_obj_handle *obj_hdl,
 			 bool *fsal_stable,
 			 struct io_info *info);
 
+fsal_status_t vfs_seek2(struct fsal_obj_handle *obj_hdl,
+			struct state_t *state,
+			struct io_info *info);
+
+fsal_status_t vfs_copy(struct fsal_obj_handle *src_hdl,
+		       struct state_t *src_state,
+		       uint64_t src_offset,
+		       struct fsal_obj_handle *dst_hdl,
+		       struct state_t *dst_state,
+		       uint64_t dst_offset,
+		       uint64_t count,
+		       uint64_t *copied);
+
+fsal_status_t vfs_clone(struct fsal_obj_handle *src_hdl,
+			struct state_t *src_state,
+			uint64_t src_offset,
+			struct fsal_obj_handle *dst_hdl,
+			struct state_t *dst_state,
+			uint64_t dst_offset,
+			uint64_t count);
+
+fsal_status_t vfs_write_vec(struct fsal_obj_handle *obj_hdl,
+			    bool bypass,
+			    struct state_t *state,
+			    uint64_t offset,
+			    const struct iovec *iov,
+			    int iovcnt,
+			    size_t *wrote_amount,
+			    bool *fsal_stable);
+fsal_status_t vfs_read_vec(struct fsal_obj_handle *obj_hdl,
+			   bool bypass,
+			   struct state_t *state,
+			   uint64_t offset,
+			   const struct iovec *iov,
+			   int iovcnt,
+			   size_t *read_amount,
+			   bool *end_of_file);
+
+fsal_status_t vfs_fallocate(struct fsal_obj_handle *obj_hdl,
+			    struct state_t *state,
+			    uint64_t offset,
+			    uint64_t length,
+			    bool allocate);
+
 fsal_status_t vfs_commit2(struct fsal_obj_handle *obj_hdl,
 			  off_t offset,
 			  size_t len);
@@ -310,6 +401,9 @@ fsal_status_t getattr2(struct fsal_obj_handle *obj_hdl);
 fsal_status_t vfs_getattr2(struct fsal_obj_handle *obj_hdl,
 			   struct attrlist *attrs);
 
+fsal_status_t vfs_getattr_change(struct fsal_obj_handle *obj_hdl,
+				 uint64_t *change);
+
 fsal_status_t vfs_setattr2(struct fsal_obj_handle *obj_hdl,
 			   bool bypass,
 			   struct state_t *state,
@@ -33,6 +33,7 @@
 #include "fsal_handle_syscalls.h"
 #include <sys/types.h>
 #include <sys/syscall.h>
+#include <sys/sysmacros.h>
 #include <xfs/xfs.h>
 #include <xfs/handle.h>
 #include "gsh_list.h"
@@ -125,6 +126,182 @@ static int xfs_fsal_inode2handle(int fd, ino_t ino, vfs_file_handle_t *fh)
 	return 0;
 }
 
+/* Inodes asked of one XFS_IOC_FSBULKSTAT */
+#define XFS_BULKSTAT_BATCH 64
+
+/**
+ * @brief An object of a getattrs_multi, by inode
+ */
+struct xfs_bulk_ent {
+	struct fsal_filesystem *fs;
+	uint64_t ino;
+	uint32_t gen;
+	uint32_t ix;		/*< Index in the handles */
+};
+
+static int xfs_bulk_ent_cmp(const void *a, const void *b)
+{
+	const struct xfs_bulk_ent *ea = a, *eb = b;
+
+	if (ea->fs != eb->fs)
+		return ea->fs < eb->fs ? -1 : 1;
+	if (ea->ino != eb->ino)
+		return ea->ino < eb->ino ? -1 : 1;
+	return 0;
+}
+
+/**
+ * @brief Convert what bulkstat gives to a struct stat
+ *
+ * bs_rdev is in the sysv encoding, and bs_blocks counts filesystem
+ * blocks rather than 512 byte ones.
+ */
+static void xfs_bstat_to_stat(const xfs_bstat_t *bs, struct stat *st)
+{
+	memset(st, 0, sizeof(*st));
+	st->st_ino = bs->bs_ino;
+	st->st_mode = bs->bs_mode;
+	st->st_nlink = bs->bs_nlink;
+	st->st_uid = bs->bs_uid;
+	st->st_gid = bs->bs_gid;
+	st->st_rdev = makedev(bs->bs_rdev >> 18, bs->bs_rdev & 0x3ffff);
+	st->st_size = bs->bs_size;
+	st->st_blksize = bs->bs_blksize;
+	st->st_blocks = bs->bs_blocks * bs->bs_blksize / S_BLKSIZE;
+	st->st_atim.tv_sec = bs->bs_atime.tv_sec;
+	st->st_atim.tv_nsec = bs->bs_atime.tv_nsec;
+	st->st_mtim.tv_sec = bs->bs_mtime.tv_sec;
+	st->st_mtim.tv_nsec = bs->bs_mtime.tv_nsec;
+	st->st_ctim.tv_sec = bs->bs_ctime.tv_sec;
+	st->st_ctim.tv_nsec = bs->bs_ctime.tv_nsec;
+}
+
+/**
+ * @brief Bulkstat a run of the objects of one filesystem
+ *
+ * One XFS_IOC_FSBULKSTAT from just before the first inode of the run
+ * gives the allocated inodes from it on.  Objects whose inode was
+ * skipped, or came back with another generation, are gone or reused
+ * and left to getattrs.
+ *
+ * @param[in]     ents    Objects, sorted
+ * @param[in]     start   First of the run
+ * @param[in]     count   Number of objects
+ * @param[in]     bstat   Buffer of XFS_BULKSTAT_BATCH
+ * @param[in]     handles Objects, as given to getattrs_multi
+ * @param[in,out] attrs   Their attributes
+ *
+ * @return The first object not done.
+ */
+static uint32_t xfs_bulkstat_run(struct xfs_bulk_ent *ents, uint32_t start,
+				 uint32_t count, xfs_bstat_t *bstat,
+				 struct fsal_obj_handle **handles,
+				 struct attrlist *attrs)
+{
+	struct fsal_filesystem *fs = ents[start].fs;
+	struct vfs_filesystem *vfs_fs = fs->private_data;
+	xfs_fsop_bulkreq_t bulkreq;
+	__u64 lastip = ents[start].ino - 1;
+	__s32 ocount = 0;
+	uint32_t i = start;
+	struct attrlist *ap;
+	struct stat st;
+	int k;
+
+	bulkreq.lastip = &lastip;
+	bulkreq.icount = MIN(count - start, XFS_BULKSTAT_BATCH);
+	bulkreq.ubuffer = bstat;
+	bulkreq.ocount = &ocount;
+
+	if (ioctl(vfs_fs->root_fd, XFS_IOC_FSBULKSTAT, &bulkreq) < 0) {
+		LogDebug(COMPONENT_FSAL, "XFS_IOC_FSBULKSTAT on %s failed %s",
+			 fs->path, strerror(errno));
+		ocount = 0;
+	}
+
+	for (k = 0; k < ocount; k++) {
+		for (; i < count && ents[i].fs == fs &&
+		       ents[i].ino <= bstat[k].bs_ino; i++) {
+			ap = &attrs[ents[i].ix];
+			if (ents[i].ino != bstat[k].bs_ino ||
+			    ents[i].gen != bstat[k].bs_gen) {
+				ap->mask = ATTR_RDATTR_ERR;
+				continue;
+			}
+
+			xfs_bstat_to_stat(&bstat[k], &st);
+			posix2fsal_attributes(&st, ap);
+			ap->fsid = handles[ents[i].ix]->fs->fsid;
+			ap->mask &= ~ATTR_RDATTR_ERR;
+		}
+	}
+
+	if (ocount == 0) {
+		/* Past the last inode, or no bulkstat at all */
+		for (; i < count && ents[i].fs == fs; i++)
+			attrs[ents[i].ix].mask = ATTR_RDATTR_ERR;
+	}
+
+	return i;
+}
+
+/**
+ * @brief Get the attributes of several objects by bulkstat
+ *
+ * The objects are sorted by filesystem and inode, and each run of
+ * them is bulkstat'd through the root fd of its filesystem, so a
+ * directory's worth of inodes, which XFS tends to allocate together,
+ * takes a few ioctls rather than a stat each.
+ *
+ * @param[in]     handles Objects to query
+ * @param[in]     count   Number of objects
+ * @param[in,out] attrs   Their attributes, one per handle
+ *
+ * @return FSAL status.
+ */
+fsal_status_t xfs_getattrs_multi(struct fsal_obj_handle **handles,
+				 uint32_t count, struct attrlist *attrs)
+{
+	struct xfs_bulk_ent *ents = gsh_malloc(count * sizeof(*ents));
+	xfs_bstat_t *bstat;
+	struct vfs_fsal_obj_handle *hdl;
+	struct vfs_filesystem *vfs_fs;
+	xfs_handle_t *fh;
+	uint32_t i, n = 0;
+
+	for (i = 0; i < count; i++) {
+		hdl = container_of(handles[i], struct vfs_fsal_obj_handle,
+				   obj_handle);
+		fh = (xfs_handle_t *) hdl->handle->handle_data;
+		vfs_fs = handles[i]->fs->private_data;
+
+		if (handles[i]->fsal != handles[i]->fs->fsal ||
+		    vfs_is_dummy_handle(hdl->handle) ||
+		    vfs_fs == NULL || vfs_fs->root_fd < 0) {
+			attrs[i].mask = ATTR_RDATTR_ERR;
+			continue;
+		}
+
+		ents[n].fs = handles[i]->fs;
+		ents[n].ino = fh->ha_fid.fid_ino;
+		ents[n].gen = fh->ha_fid.fid_gen;
+		ents[n].ix = i;
+		n++;
+	}
+
+	qsort(ents, n, sizeof(*ents), xfs_bulk_ent_cmp);
+
+	bstat = gsh_malloc(XFS_BULKSTAT_BATCH * sizeof(*bstat));
+
+	for (i = 0; i < n;)
+		i = xfs_bulkstat_run(ents, i, n, bstat, handles, attrs);
+
+	gsh_free(bstat);
+	gsh_free(ents);
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
 int vfs_open_by_handle(struct vfs_filesystem *fs,
 		       vfs_file_handle_t *fh, int openflags,
 		       fsal_errors_t *fsal_error)
@@ -400,6 +577,9 @@ int vfs_get_root_handle(struct vfs_filesystem *vfs_fs,
 		return retval;
 	}
 
+	/* Kept for XFS_IOC_FSBULKSTAT, closed with the filesystem */
+	vfs_fs->root_fd = fd;
+
 	retval = vfs_fd_to_handle(fd, vfs_fs->fs, fh);
 
 	if (retval != 0) {
@@ -407,7 +587,7 @@ int vfs_get_root_handle(struct vfs_filesystem *vfs_fs,
 		LogMajor(COMPONENT_FSAL,
 			 "Get root handle for %s failed with %s (%d)",
 			 vfs_fs->fs->path, strerror(retval), retval);
-		goto errout;
+		return retval;
 	}
 
 	/* Extract fsid from the root handle and re-index the filesystem
@@ -425,10 +605,6 @@ int vfs_get_root_handle(struct vfs_filesystem *vfs_fs,
 		retval = -retval;
 	}
 
-errout:
-
-	close(fd);
-
 	return retval;
 }
 
@@ -28,3 +28,6 @@
 /* defined by libhandle but no prototype in xfs/handle.h */
 
 int fd_to_handle(int fd, void **hanp, size_t *hlen);
+
+fsal_status_t xfs_getattrs_multi(struct fsal_obj_handle **handles,
+				 uint32_t count, struct attrlist *attrs);
@@ -32,6 +32,7 @@
 #include "fsal_api.h"
 #include "../vfs_methods.h"
 #include "../subfsal.h"
+#include "handle_syscalls.h"
 
 /* Export */
 
@@ -84,5 +85,7 @@ int vfs_sub_init_handle(struct vfs_fsal_export *myself,
 		struct vfs_fsal_obj_handle *hdl,
 		const char *path)
 {
+	/* Attributes in bulk by XFS_IOC_FSBULKSTAT */
+	hdl->obj_handle.obj_ops.getattrs_multi = xfs_getattrs_multi;
 	return 0;
 }
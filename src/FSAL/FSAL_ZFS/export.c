@@ -32,6 +32,7 @@
 #include "config.h"
 
 #include <string.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include "gsh_list.h"
 #include "fsal.h"
@@ -48,6 +49,96 @@ libzfswrap_handle_t *p_zhd = NULL;
 size_t i_snapshots = 0;
 snapshot_t *p_snapshots = NULL;
 
+/* Mounted zpools, and p_zhd while there are any */
+static pthread_mutex_t zfs_datasets_mtx = PTHREAD_MUTEX_INITIALIZER;
+static struct glist_head zfs_datasets = GLIST_HEAD_INIT(zfs_datasets);
+
+/**
+ * @brief Get the mount of a zpool, mounting it if need be
+ *
+ * Each zpool has a libzfswrap vfs of its own, so that the exports of
+ * different zpools do not share the one context.
+ *
+ * @param[in] zpool Name of the zpool
+ *
+ * @return The dataset, referenced, or NULL.
+ */
+static struct zfs_dataset *zfs_get_dataset(const char *zpool)
+{
+	struct zfs_dataset *ds;
+	struct glist_head *glist;
+	libzfswrap_vfs_t *p_zfs;
+
+	PTHREAD_MUTEX_lock(&zfs_datasets_mtx);
+
+	glist_for_each(glist, &zfs_datasets) {
+		ds = glist_entry(glist, struct zfs_dataset, list);
+		if (strcmp(ds->name, zpool) == 0) {
+			ds->refcount++;
+			goto out;
+		}
+	}
+
+	ds = NULL;
+
+	if (p_zhd == NULL) {
+		/* init libzfs library */
+		p_zhd = libzfswrap_init();
+		if (p_zhd == NULL) {
+			LogMajor(COMPONENT_FSAL,
+				 "Could not init libzfswrap library");
+			goto out;
+		}
+	}
+
+	/* Mount the libs */
+	p_zfs = libzfswrap_mount(zpool, "/tank", "");
+	if (p_zfs == NULL) {
+		LogMajor(COMPONENT_FSAL, "Could not mount libzfswrap for %s",
+			 zpool);
+		if (glist_empty(&zfs_datasets)) {
+			libzfswrap_exit(p_zhd);
+			p_zhd = NULL;
+		}
+		goto out;
+	}
+
+	ds = gsh_calloc(1, sizeof(*ds));
+	ds->name = gsh_strdup(zpool);
+	ds->p_vfs = p_zfs;
+	ds->refcount = 1;
+	glist_add_tail(&zfs_datasets, &ds->list);
+
+out:
+	PTHREAD_MUTEX_unlock(&zfs_datasets_mtx);
+
+	return ds;
+}
+
+/**
+ * @brief Drop a reference to a zpool, unmounting it with the last
+ *
+ * @param[in] ds The dataset
+ */
+static void zfs_put_dataset(struct zfs_dataset *ds)
+{
+	PTHREAD_MUTEX_lock(&zfs_datasets_mtx);
+
+	if (--ds->refcount == 0) {
+		glist_del(&ds->list);
+		libzfswrap_umount(ds->p_vfs, 1);
+		gsh_free(ds->name);
+		gsh_free(ds);
+
+		if (glist_empty(&zfs_datasets)) {
+			libzfswrap_exit(p_zhd);
+			p_zhd = NULL;
+		}
+	}
+
+	PTHREAD_MUTEX_unlock(&zfs_datasets_mtx);
+}
+
 
 /* helpers to/from other ZFS objects
  */
@@ -74,6 +165,8 @@ static void release(struct fsal_export *exp_hdl)
 	fsal_detach_export(exp_hdl->fsal, &exp_hdl->exports);
 	free_export_ops(exp_hdl);
 
+	zfs_put_dataset(myself->dataset);
+
 	gsh_free(myself);		/* elvis has left the building */
 }
 
@@ -300,7 +393,6 @@ fsal_status_t zfs_create_export(struct fsal_module *fsal_hdl,
 	struct zfs_fsal_export *myself = NULL;
 	int retval = 0;
 	fsal_status_t fsal_status = { ERR_FSAL_INVAL, 0 };
-	libzfswrap_vfs_t *p_zfs = NULL;
 
 	myself = gsh_calloc(1, sizeof(struct zfs_fsal_export));
 
@@ -331,35 +423,12 @@ fsal_status_t zfs_create_export(struct fsal_module *fsal_hdl,
 	}
 	myself->export.fsal = fsal_hdl;
 
-	if (p_zhd == NULL) {
-		/* init libzfs library */
-		p_zhd = libzfswrap_init();
-		if (p_zhd == NULL) {
-			LogMajor(COMPONENT_FSAL,
-				 "Could not init libzfswrap library");
-			libzfswrap_exit(p_zhd);
-			goto err_locked;
-		}
-
-	}
-
-	if (p_snapshots == NULL) {
-		/* Mount the libs */
-		p_zfs = libzfswrap_mount(myself->zpool, "/tank", "");
-		if (p_zfs == NULL) {
-			LogMajor(COMPONENT_FSAL, "Could not mount libzfswrap");
-			libzfswrap_exit(p_zhd);
-			p_zhd = NULL;
-			goto err_locked;
-		}
-
-	  /** @todo: Place snapshot management here */
-		p_snapshots = gsh_calloc(1, sizeof(*p_snapshots));
-		p_snapshots[0].p_vfs = p_zfs;
-		i_snapshots = 0;
-	}
+	/** @todo: Place snapshot management here */
+	myself->dataset = zfs_get_dataset(myself->zpool);
+	if (myself->dataset == NULL)
+		goto err_locked;
 
-	myself->p_vfs = p_snapshots[0].p_vfs;
+	myself->p_vfs = myself->dataset->p_vfs;
 	op_ctx->fsal_export = &myself->export;
 
 	/* Stack MDCACHE on top */
@@ -372,6 +441,8 @@ fsal_status_t zfs_create_export(struct fsal_module *fsal_hdl,
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 
 err_locked:
+	if (myself->dataset != NULL)
+		zfs_put_dataset(myself->dataset);
 	if (myself->export.fsal != NULL)
 		fsal_detach_export(fsal_hdl, &myself->export.exports);
 errout:
@@ -57,9 +57,9 @@
  */
 libzfswrap_vfs_t *ZFSFSAL_GetVFS(zfs_file_handle_t *handle)
 {
-	/* Check for the zpool (index == 0) */
+	/* Check for the zpool (index == 0), the export's own */
 	if (handle->i_snap == 0)
-		return p_snapshots[0].p_vfs;
+		return tank_get_root_pvfs(op_ctx->fsal_export);
 
 	/* Handle the indirection */
 	int i;
@@ -175,9 +175,11 @@ static fsal_status_t tank_lookup(struct fsal_obj_handle *parent,
 		int i;
 
 		for (i = 1; i < i_snapshots + 1; i++)
-			if (!strcmp(p_snapshots[i].psz_name, path) &&
-			    (i == i_snapshots + 1))
-				return fsalstat(ERR_FSAL_NOTDIR, 0);
+			if (!strcmp(p_snapshots[i].psz_name, path))
+				break;
+
+		if (i == i_snapshots + 1)
+			return fsalstat(ERR_FSAL_NOENT, 0);
 
 		libzfswrap_getroot(p_snapshots[i].p_vfs, &object);
 		p_vfs = p_snapshots[i].p_vfs;
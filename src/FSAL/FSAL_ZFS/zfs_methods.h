@@ -32,6 +32,17 @@ struct zfs_fsal_module {
 	struct fsal_staticfsinfo_t fs_info;
 };
 
+/*
+ * A mounted zpool, shared by the exports of it
+ */
+
+struct zfs_dataset {
+	struct glist_head list;
+	char *name;
+	libzfswrap_vfs_t *p_vfs;
+	int32_t refcount;
+};
+
 /*
  * ZFS internal export
  */
@@ -39,7 +50,8 @@ struct zfs_fsal_module {
 struct zfs_fsal_export {
 	struct fsal_export export;
 	char *zpool;
-	libzfswrap_vfs_t *p_vfs;
+	struct zfs_dataset *dataset;
+	libzfswrap_vfs_t *p_vfs;	/*< dataset->p_vfs */
 };
 
 /*
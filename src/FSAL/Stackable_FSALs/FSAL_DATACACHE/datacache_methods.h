@@ -0,0 +1,229 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/**
+ * @file datacache_methods.h
+ * @brief DATACACHE FSAL internals
+ *
+ * FSAL_DATACACHE stacks over another FSAL as FSAL_NULL does, and keeps
+ * the blocks read from its files in memory, in one gsh_cache per
+ * export.  A block is keyed by its number, the sub-FSAL's key of the
+ * file and the generation of the file.
+ *
+ * The generations are in a fixed table, dc_gens, indexed by a hash of
+ * the file's key.  Invalidating a file bumps its generation, which
+ * leaves every block cached under the old one unreachable, to be
+ * recycled as the cache fills, and invalidates the few other files of
+ * the same slot with it.  Writes, truncations and the like invalidate
+ * once they are done, as do the upcalls of the sub-FSAL and a change
+ * attribute that moved.
+ *
+ * With Write_Back on, UNSTABLE writes are staged in a local log and
+ * written to the sub-FSAL later, see writeback.c.
+ */
+
+#ifndef DATACACHE_METHODS_H
+#define DATACACHE_METHODS_H
+
+#include "gsh_list.h"
+#include "gsh_cache.h"
+#include "gsh_hash.h"
+#include "common_utils.h"
+#include "abstract_atomic.h"
+#include "fridgethr.h"
+
+/** Slots of the generation table, a power of 2 */
+#define DC_GEN_SLOTS 16384
+
+/** Longest sub-FSAL key of a file whose blocks are cached */
+#define DC_KEY_MAX 128
+
+extern uint64_t dc_gens[DC_GEN_SLOTS];
+
+/**
+ * @brief DATACACHE internal export
+ */
+struct dc_fsal_export {
+	struct fsal_export export;
+	struct fsal_up_vector up_ops;	/*< Given to the sub-FSAL */
+	struct fsal_up_vector super_up_ops;	/*< Given to us */
+	char *path;			/*< Export path, to name the cache */
+	struct gsh_cache *blocks;	/*< The blocks of the files */
+	uint32_t block_size;		/*< Bytes of a block */
+	uint32_t check_interval;	/*< Seconds a change attribute is
+					    trusted, 0 to check every read */
+	uint64_t readahead_max;		/*< Most read ahead of a stream */
+	uint64_t fill_max;		/*< Most read ahead and asked for in
+					    one sub-FSAL read */
+	/* Write-back, what follows write_back under wb_mtx */
+	bool write_back;		/*< UNSTABLE writes are staged */
+	uint64_t staging_size;		/*< Bytes of the staging log */
+	int log_fd;			/*< The staging log, -1 for none */
+	struct fridgethr *destager;
+	uint32_t lost;			/*< Destages failed, atomic */
+	pthread_mutex_t wb_mtx;
+	pthread_cond_t wb_cond;		/*< The destager let a file go */
+	uint64_t log_next;		/*< Where the next write is staged */
+	uint64_t log_used;		/*< Bytes staged, not destaged */
+	struct glist_head dirty;	/*< Stages of files with writes */
+	struct {
+		uint64_t hits;		/*< Blocks read from the cache */
+		uint64_t fills;		/*< Reads of the sub-FSAL to fill */
+		uint64_t filled;	/*< Bytes they read */
+		uint64_t invalidates;	/*< Files invalidated */
+		uint64_t staged;	/*< Bytes of writes staged */
+		uint64_t destaged;	/*< Bytes written from the log */
+	} stats;
+};
+
+/**
+ * @brief DATACACHE internal object handle
+ */
+struct dc_fsal_obj_handle {
+	struct fsal_obj_handle obj_handle; /*< Handle containing dc data.*/
+	struct fsal_obj_handle *sub_handle; /*< Handle of the sub fsal.*/
+	struct gsh_buffdesc key;	/*< Sub-FSAL key of a regular file,
+					    len 0 if its blocks are not
+					    cached */
+	uint32_t slot;			/*< Its generation in dc_gens */
+	bool change_by_getattrs;	/*< The sub-FSAL has no
+					    getattr_change */
+	bool no_change;			/*< Nor a change attribute at all */
+	uint64_t change;		/*< Change attribute last seen */
+	time_t checked;			/*< When, 0 for never */
+	uint64_t ra_next;		/*< Where the stream read ends */
+	uint64_t ra_window;		/*< Bytes to read ahead of it */
+	struct dc_stage *stage;		/*< Its staged writes, if any */
+};
+
+/**
+ * @brief Readdir callback state, to wrap the entries passed up
+ */
+struct dc_readdir_state {
+	fsal_readdir_cb cb; /*< Callback to the upper layer. */
+	struct dc_fsal_export *exp; /*< Export of the current dc fsal. */
+	void *dir_state; /*< State to be sent to the next callback. */
+};
+
+/** Key of a block in the cache */
+struct dc_block_key {
+	uint64_t gen;
+	uint64_t block;
+	char key[DC_KEY_MAX];
+};
+
+/** The export a call was made on */
+static inline struct dc_fsal_export *dc_export(void)
+{
+	return container_of(op_ctx->fsal_export, struct dc_fsal_export,
+			    export);
+}
+
+static inline struct dc_fsal_obj_handle *dc_hdl(struct fsal_obj_handle *hdl)
+{
+	return container_of(hdl, struct dc_fsal_obj_handle, obj_handle);
+}
+
+static inline struct fsal_obj_handle *dc_sub(struct fsal_obj_handle *hdl)
+{
+	return dc_hdl(hdl)->sub_handle;
+}
+
+/** The slot of dc_gens of a sub-FSAL key */
+static inline uint32_t dc_gen_slot(const struct gsh_buffdesc *key)
+{
+	return gsh_hash64(key->addr, key->len, 0) & (DC_GEN_SLOTS - 1);
+}
+
+/** Drop the cached blocks of a slot's files */
+static inline void dc_invalidate_slot(uint32_t slot)
+{
+	(void) atomic_inc_uint64_t(&dc_gens[slot]);
+}
+
+/**
+ * @brief Drop the cached blocks of a file, once it was changed
+ *
+ * Reads that started before the change cache under the generation
+ * they saw, so nothing they read is found afterwards.
+ */
+static inline void dc_invalidate(struct dc_fsal_export *exp,
+				 struct dc_fsal_obj_handle *hdl)
+{
+	if (hdl->key.len == 0)
+		return;
+
+	dc_invalidate_slot(hdl->slot);
+	(void) atomic_inc_uint64_t(&exp->stats.invalidates);
+}
+
+/**
+ * @brief Pass a call down to the sub-FSAL
+ *
+ * The sub-FSAL's export is put in op_ctx for the call, as for
+ * FSAL_NULL.
+ */
+#define dc_pass(exp, call)						\
+	do {								\
+		op_ctx->fsal_export = (exp)->export.sub_export;		\
+		call;							\
+		op_ctx->fsal_export = &(exp)->export;			\
+	} while (0)
+
+fsal_status_t dc_alloc_and_check_handle(struct dc_fsal_export *exp,
+					struct fsal_obj_handle *sub_handle,
+					struct fsal_filesystem *fs,
+					struct fsal_obj_handle **new_handle,
+					fsal_status_t subfsal_status);
+
+void dc_handle_ops_init(struct fsal_obj_ops *ops);
+void dc_file_ops_init(struct fsal_obj_ops *ops);
+void dc_xattr_ops_init(struct fsal_obj_ops *ops);
+void dc_up_ops_init(struct dc_fsal_export *exp,
+		    const struct fsal_up_vector *super_up_ops);
+
+int dc_wb_init(struct dc_fsal_export *exp, const char *dir, uint32_t delay);
+void dc_wb_fini(struct dc_fsal_export *exp);
+bool dc_stage_write(struct dc_fsal_export *exp,
+		    struct dc_fsal_obj_handle *hdl, bool bypass,
+		    struct state_t *state, uint64_t offset, size_t size,
+		    const void *buffer);
+void dc_stage_flush(struct dc_fsal_obj_handle *hdl);
+fsal_status_t dc_stage_commit(struct dc_fsal_obj_handle *hdl);
+void dc_stage_free(struct dc_fsal_obj_handle *hdl);
+void dc_stage_size(struct dc_fsal_obj_handle *hdl, uint64_t *filesize);
+
+fsal_status_t dc_lookup_path(struct fsal_export *exp_hdl,
+			     const char *path,
+			     struct fsal_obj_handle **handle,
+			     struct attrlist *attrs_out);
+
+fsal_status_t dc_create_handle(struct fsal_export *exp_hdl,
+			       struct gsh_buffdesc *hdl_desc,
+			       struct fsal_obj_handle **handle,
+			       struct attrlist *attrs_out);
+
+fsal_status_t dc_create_export(struct fsal_module *fsal_hdl,
+			       void *parse_node,
+			       struct config_error_type *err_type,
+			       const struct fsal_up_vector *up_ops);
+
+#endif				/* DATACACHE_METHODS_H */
@@ -0,0 +1,663 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/* export.c
+ * DATACACHE FSAL export object
+ */
+
+#include "config.h"
+
+#include "fsal.h"
+#include <pthread.h>
+#include <string.h>
+#include <sys/types.h>
+#include "gsh_list.h"
+#include "config_parsing.h"
+#include "FSAL/fsal_commonlib.h"
+#include "FSAL/fsal_config.h"
+#include "datacache_methods.h"
+#include "nfs_exports.h"
+#include "export_mgr.h"
+
+static inline struct dc_fsal_export *dc_exp(struct fsal_export *exp_hdl)
+{
+	return container_of(exp_hdl, struct dc_fsal_export, export);
+}
+
+/* export object methods
+ */
+
+static void release(struct fsal_export *exp_hdl)
+{
+	struct dc_fsal_export *myself = dc_exp(exp_hdl);
+	struct fsal_module *sub_fsal;
+
+	LogInfo(COMPONENT_FSAL,
+		"DATACACHE %s: %"PRIu64" blocks hit, %"PRIu64
+		" fills of %"PRIu64" bytes, %"PRIu64" invalidates",
+		myself->path,
+		atomic_fetch_uint64_t(&myself->stats.hits),
+		atomic_fetch_uint64_t(&myself->stats.fills),
+		atomic_fetch_uint64_t(&myself->stats.filled),
+		atomic_fetch_uint64_t(&myself->stats.invalidates));
+
+	/* What is staged goes to the sub_export before it is released */
+	dc_wb_fini(myself);
+
+	sub_fsal = myself->export.sub_export->fsal;
+
+	/* Release the sub_export */
+	myself->export.sub_export->exp_ops.release(myself->export.sub_export);
+	fsal_put(sub_fsal);
+
+	fsal_detach_export(exp_hdl->fsal, &exp_hdl->exports);
+	free_export_ops(exp_hdl);
+
+	gsh_cache_destroy(myself->blocks);
+	gsh_free(myself->path);
+	gsh_free(myself);
+}
+
+static void dc_unexport(struct fsal_export *exp_hdl)
+{
+	struct dc_fsal_export *exp = dc_exp(exp_hdl);
+
+	dc_pass(exp,
+		exp->export.sub_export->exp_ops.unexport(
+			exp->export.sub_export));
+}
+
+static fsal_status_t get_dynamic_info(struct fsal_export *exp_hdl,
+				      struct fsal_obj_handle *obj_hdl,
+				      fsal_dynamicfsinfo_t *infop)
+{
+	struct dc_fsal_export *exp = dc_exp(exp_hdl);
+	fsal_status_t status;
+
+	dc_pass(exp,
+		status = exp->export.sub_export->exp_ops.get_fs_dynamic_info(
+			exp->export.sub_export, dc_sub(obj_hdl), infop));
+
+	return status;
+}
+
+/**
+ * @brief What the export supports
+ *
+ * Reads are not served from the sub-FSAL's buffers, so that they go
+ * through the cache.
+ */
+static bool fs_supports(struct fsal_export *exp_hdl,
+			fsal_fsinfo_options_t option)
+{
+	struct dc_fsal_export *exp = dc_exp(exp_hdl);
+	bool result;
+
+	if (option == fso_read_buffers)
+		return false;
+
+	dc_pass(exp,
+		result = exp->export.sub_export->exp_ops.fs_supports(
+			exp->export.sub_export, option));
+
+	return result;
+}
+
+static uint64_t fs_maxfilesize(struct fsal_export *exp_hdl)
+{
+	struct dc_fsal_export *exp = dc_exp(exp_hdl);
+	uint64_t result;
+
+	dc_pass(exp,
+		result = exp->export.sub_export->exp_ops.fs_maxfilesize(
+			exp->export.sub_export));
+
+	return result;
+}
+
+static uint32_t fs_maxread(struct fsal_export *exp_hdl)
+{
+	struct dc_fsal_export *exp = dc_exp(exp_hdl);
+	uint32_t result;
+
+	dc_pass(exp,
+		result = exp->export.sub_export->exp_ops.fs_maxread(
+			exp->export.sub_export));
+
+	return result;
+}
+
+static uint32_t fs_maxwrite(struct fsal_export *exp_hdl)
+{
+	struct dc_fsal_export *exp = dc_exp(exp_hdl);
+	uint32_t result;
+
+	dc_pass(exp,
+		result = exp->export.sub_export->exp_ops.fs_maxwrite(
+			exp->export.sub_export));
+
+	return result;
+}
+
+static uint32_t fs_maxlink(struct fsal_export *exp_hdl)
+{
+	struct dc_fsal_export *exp = dc_exp(exp_hdl);
+	uint32_t result;
+
+	dc_pass(exp,
+		result = exp->export.sub_export->exp_ops.fs_maxlink(
+			exp->export.sub_export));
+
+	return result;
+}
+
+static uint32_t fs_maxnamelen(struct fsal_export *exp_hdl)
+{
+	struct dc_fsal_export *exp = dc_exp(exp_hdl);
+	uint32_t result;
+
+	dc_pass(exp,
+		result = exp->export.sub_export->exp_ops.fs_maxnamelen(
+			exp->export.sub_export));
+
+	return result;
+}
+
+static uint32_t fs_maxpathlen(struct fsal_export *exp_hdl)
+{
+	struct dc_fsal_export *exp = dc_exp(exp_hdl);
+	uint32_t result;
+
+	dc_pass(exp,
+		result = exp->export.sub_export->exp_ops.fs_maxpathlen(
+			exp->export.sub_export));
+
+	return result;
+}
+
+static struct timespec fs_lease_time(struct fsal_export *exp_hdl)
+{
+	struct dc_fsal_export *exp = dc_exp(exp_hdl);
+	struct timespec result;
+
+	dc_pass(exp,
+		result = exp->export.sub_export->exp_ops.fs_lease_time(
+			exp->export.sub_export));
+
+	return result;
+}
+
+static fsal_aclsupp_t fs_acl_support(struct fsal_export *exp_hdl)
+{
+	struct dc_fsal_export *exp = dc_exp(exp_hdl);
+	fsal_aclsupp_t result;
+
+	dc_pass(exp,
+		result = exp->export.sub_export->exp_ops.fs_acl_support(
+			exp->export.sub_export));
+
+	return result;
+}
+
+static attrmask_t fs_supported_attrs(struct fsal_export *exp_hdl)
+{
+	struct dc_fsal_export *exp = dc_exp(exp_hdl);
+	attrmask_t result;
+
+	dc_pass(exp,
+		result = exp->export.sub_export->exp_ops.fs_supported_attrs(
+			exp->export.sub_export));
+
+	return result;
+}
+
+static uint32_t fs_umask(struct fsal_export *exp_hdl)
+{
+	struct dc_fsal_export *exp = dc_exp(exp_hdl);
+	uint32_t result;
+
+	dc_pass(exp,
+		result = exp->export.sub_export->exp_ops.fs_umask(
+			exp->export.sub_export));
+
+	return result;
+}
+
+static uint32_t fs_xattr_access_rights(struct fsal_export *exp_hdl)
+{
+	struct dc_fsal_export *exp = dc_exp(exp_hdl);
+	uint32_t result;
+
+	dc_pass(exp,
+		result = exp->export.sub_export->exp_ops.fs_xattr_access_rights(
+			exp->export.sub_export));
+
+	return result;
+}
+
+static fsal_status_t check_quota(struct fsal_export *exp_hdl,
+				 const char *filepath, int quota_type)
+{
+	struct dc_fsal_export *exp = dc_exp(exp_hdl);
+	fsal_status_t status;
+
+	dc_pass(exp,
+		status = exp->export.sub_export->exp_ops.check_quota(
+			exp->export.sub_export, filepath, quota_type));
+
+	return status;
+}
+
+static fsal_status_t get_quota(struct fsal_export *exp_hdl,
+			       const char *filepath, int quota_type,
+			       int quota_id,
+			       fsal_quota_t *pquota)
+{
+	struct dc_fsal_export *exp = dc_exp(exp_hdl);
+	fsal_status_t status;
+
+	dc_pass(exp,
+		status = exp->export.sub_export->exp_ops.get_quota(
+			exp->export.sub_export, filepath, quota_type,
+			quota_id, pquota));
+
+	return status;
+}
+
+static fsal_status_t set_quota(struct fsal_export *exp_hdl,
+			       const char *filepath, int quota_type,
+			       int quota_id,
+			       fsal_quota_t *pquota, fsal_quota_t *presquota)
+{
+	struct dc_fsal_export *exp = dc_exp(exp_hdl);
+	fsal_status_t status;
+
+	dc_pass(exp,
+		status = exp->export.sub_export->exp_ops.set_quota(
+			exp->export.sub_export, filepath, quota_type,
+			quota_id, pquota, presquota));
+
+	return status;
+}
+
+static fsal_status_t extract_handle(struct fsal_export *exp_hdl,
+				    fsal_digesttype_t in_type,
+				    struct gsh_buffdesc *fh_desc,
+				    int flags)
+{
+	struct dc_fsal_export *exp = dc_exp(exp_hdl);
+	fsal_status_t status;
+
+	dc_pass(exp,
+		status = exp->export.sub_export->exp_ops.extract_handle(
+			exp->export.sub_export, in_type, fh_desc, flags));
+
+	return status;
+}
+
+/**
+ * @brief The write verifier, the sub-FSAL's
+ *
+ * With Write_Back on, it also changes each time staged writes were
+ * lost destaging them, so clients resend what they did not commit.
+ */
+static void get_write_verifier(struct fsal_export *exp_hdl,
+			       struct gsh_buffdesc *verf_desc)
+{
+	struct dc_fsal_export *exp = dc_exp(exp_hdl);
+	uint32_t lost;
+
+	dc_pass(exp,
+		exp->export.sub_export->exp_ops.get_write_verifier(
+			exp->export.sub_export, verf_desc));
+
+	if (!exp->write_back || verf_desc->len < sizeof(lost))
+		return;
+
+	lost = atomic_fetch_uint32_t(&exp->lost);
+	*(uint32_t *)verf_desc->addr ^= lost;
+}
+
+/**
+ * @brief Allocate state_t structure
+ *
+ * The state belongs to the sub-FSAL, which is handed it unchanged by
+ * the I/O calls.
+ */
+static struct state_t *alloc_state(struct fsal_export *exp_hdl,
+				   enum state_type state_type,
+				   struct state_t *related_state)
+{
+	struct dc_fsal_export *exp = dc_exp(exp_hdl);
+	struct state_t *state;
+
+	dc_pass(exp,
+		state = exp->export.sub_export->exp_ops.alloc_state(
+			exp->export.sub_export, state_type, related_state));
+
+	return state;
+}
+
+static void free_state(struct state_t *state)
+{
+	struct dc_fsal_export *exp = dc_export();
+
+	dc_pass(exp,
+		exp->export.sub_export->exp_ops.free_state(state));
+}
+
+/* dc_export_ops_init
+ * overwrite vector entries with the methods that we support
+ */
+
+static void dc_export_ops_init(struct export_ops *ops)
+{
+	ops->unexport = dc_unexport;
+	ops->release = release;
+	ops->lookup_path = dc_lookup_path;
+	ops->extract_handle = extract_handle;
+	ops->create_handle = dc_create_handle;
+	ops->get_fs_dynamic_info = get_dynamic_info;
+	ops->fs_supports = fs_supports;
+	ops->fs_maxfilesize = fs_maxfilesize;
+	ops->fs_maxread = fs_maxread;
+	ops->fs_maxwrite = fs_maxwrite;
+	ops->fs_maxlink = fs_maxlink;
+	ops->fs_maxnamelen = fs_maxnamelen;
+	ops->fs_maxpathlen = fs_maxpathlen;
+	ops->fs_lease_time = fs_lease_time;
+	ops->fs_acl_support = fs_acl_support;
+	ops->fs_supported_attrs = fs_supported_attrs;
+	ops->fs_umask = fs_umask;
+	ops->fs_xattr_access_rights = fs_xattr_access_rights;
+	ops->check_quota = check_quota;
+	ops->get_quota = get_quota;
+	ops->set_quota = set_quota;
+	ops->get_write_verifier = get_write_verifier;
+	ops->alloc_state = alloc_state;
+	ops->free_state = free_state;
+}
+
+/**
+ * @brief The export a sub-FSAL's upcall is for
+ *
+ * The sub-FSAL may pass its own export or that of the MDCACHE it
+ * stacked over itself, so the stack is walked up to ours.
+ */
+static struct dc_fsal_export *dc_up_export(struct fsal_export *exp)
+{
+	while (exp != NULL && exp->fsal->m_ops.create_export !=
+	       dc_create_export)
+		exp = exp->super_export;
+
+	return exp == NULL ? NULL : dc_exp(exp);
+}
+
+/**
+ * @brief Invalidate a file's blocks with the rest of its cache entry
+ *
+ * Then passed to the layer above, as to it directly.
+ */
+static fsal_status_t dc_up_invalidate(struct fsal_export *export,
+				      struct gsh_buffdesc *handle,
+				      uint32_t flags)
+{
+	struct dc_fsal_export *exp = dc_up_export(export);
+
+	dc_invalidate_slot(dc_gen_slot(handle));
+
+	if (exp == NULL)
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+	(void) atomic_inc_uint64_t(&exp->stats.invalidates);
+
+	return exp->super_up_ops.invalidate(exp->export.super_export, handle,
+					    flags);
+}
+
+static fsal_status_t dc_up_invalidate_batch(struct fsal_export *export,
+					    struct gsh_buffdesc *objs,
+					    const uint32_t *flags,
+					    uint32_t count)
+{
+	struct dc_fsal_export *exp = dc_up_export(export);
+	uint32_t ix;
+
+	for (ix = 0; ix < count; ix++)
+		dc_invalidate_slot(dc_gen_slot(&objs[ix]));
+
+	if (exp == NULL)
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+	(void) atomic_add_uint64_t(&exp->stats.invalidates, count);
+
+	return exp->super_up_ops.invalidate_batch(exp->export.super_export,
+						  objs, flags, count);
+}
+
+static fsal_status_t dc_up_update(struct fsal_export *export,
+				  struct gsh_buffdesc *handle,
+				  struct attrlist *attr, uint32_t flags)
+{
+	struct dc_fsal_export *exp = dc_up_export(export);
+
+	dc_invalidate_slot(dc_gen_slot(handle));
+
+	if (exp == NULL)
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+	(void) atomic_inc_uint64_t(&exp->stats.invalidates);
+
+	return exp->super_up_ops.update(exp->export.super_export, handle,
+					attr, flags);
+}
+
+static fsal_status_t dc_up_invalidate_close(struct fsal_export *export,
+					    struct gsh_buffdesc *handle,
+					    uint32_t flags)
+{
+	struct dc_fsal_export *exp = dc_up_export(export);
+
+	dc_invalidate_slot(dc_gen_slot(handle));
+
+	if (exp == NULL)
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+	(void) atomic_inc_uint64_t(&exp->stats.invalidates);
+
+	return exp->super_up_ops.invalidate_close(exp->export.super_export,
+						  handle, flags);
+}
+
+/**
+ * @brief Make the upcall vector given to the sub-FSAL
+ *
+ * The calls that may tell of a changed file drop its blocks, the
+ * others go straight up.
+ *
+ * @param[in] exp          The export
+ * @param[in] super_up_ops The vector given to it
+ */
+void dc_up_ops_init(struct dc_fsal_export *exp,
+		    const struct fsal_up_vector *super_up_ops)
+{
+	exp->super_up_ops = *super_up_ops; /* Struct copy */
+	exp->up_ops = *super_up_ops; /* Struct copy */
+
+	exp->up_ops.invalidate = dc_up_invalidate;
+	exp->up_ops.update = dc_up_update;
+	exp->up_ops.invalidate_close = dc_up_invalidate_close;
+	exp->up_ops.invalidate_batch = dc_up_invalidate_batch;
+}
+
+struct dcfsal_args {
+	struct subfsal_args subfsal;
+	uint64_t cache_size;
+	uint32_t block_size;
+	uint32_t expiration;
+	uint32_t change_check_interval;
+	uint64_t readahead_max;
+	bool write_back;
+	char *staging_directory;
+	uint64_t staging_size;
+	uint32_t destage_delay;
+};
+
+static struct config_item sub_fsal_params[] = {
+	CONF_ITEM_STR("name", 1, 10, NULL,
+		      subfsal_args, name),
+	CONFIG_EOL
+};
+
+static struct config_item export_params[] = {
+	CONF_ITEM_NOOP("name"),
+	CONF_ITEM_UI64("Cache_Size", 16 * 1024 * 1024, UINT64_MAX,
+		       256 * 1024 * 1024,
+		       dcfsal_args, cache_size),
+	CONF_ITEM_UI32("Block_Size", 4096, 32768, 32768,
+		       dcfsal_args, block_size),
+	CONF_ITEM_UI32("Expiration", 1, 86400, 60,
+		       dcfsal_args, expiration),
+	CONF_ITEM_UI32("Change_Check_Interval", 0, 3600, 0,
+		       dcfsal_args, change_check_interval),
+	CONF_ITEM_UI64("Readahead_Max", 0, 16 * 1024 * 1024, 256 * 1024,
+		       dcfsal_args, readahead_max),
+	CONF_ITEM_BOOL("Write_Back", false,
+		       dcfsal_args, write_back),
+	CONF_ITEM_PATH("Staging_Directory", 1, MAXPATHLEN, NULL,
+		       dcfsal_args, staging_directory),
+	CONF_ITEM_UI64("Staging_Size", 16 * 1024 * 1024, UINT64_MAX,
+		       1024 * 1024 * 1024,
+		       dcfsal_args, staging_size),
+	CONF_ITEM_UI32("Destage_Delay", 1, 60, 1,
+		       dcfsal_args, destage_delay),
+	CONF_RELAX_BLOCK("FSAL", sub_fsal_params,
+			 noop_conf_init, subfsal_commit,
+			 dcfsal_args, subfsal),
+	CONFIG_EOL
+};
+
+static struct config_block export_param = {
+	.dbus_interface_name =
+		"org.ganesha.nfsd.config.fsal.datacache-export%d",
+	.blk_desc.name = "FSAL",
+	.blk_desc.type = CONFIG_BLOCK,
+	.blk_desc.u.blk.init = noop_conf_init,
+	.blk_desc.u.blk.params = export_params,
+	.blk_desc.u.blk.commit = noop_conf_commit
+};
+
+/* create_export
+ * Create an export point and return a handle to it to be kept
+ * in the export list.
+ * First lookup the fsal, then create the export and then put the fsal back.
+ * returns the export with one reference taken.
+ */
+
+fsal_status_t dc_create_export(struct fsal_module *fsal_hdl,
+			       void *parse_node,
+			       struct config_error_type *err_type,
+			       const struct fsal_up_vector *up_ops)
+{
+	fsal_status_t expres;
+	struct fsal_module *fsal_stack;
+	struct dc_fsal_export *myself;
+	struct dcfsal_args dcfsal;
+	struct gsh_cache_params params = {
+		.key_max = sizeof(struct dc_block_key),
+	};
+	uint32_t maxread;
+	int retval;
+
+	/* process our FSAL block to get the name of the fsal
+	 * underneath us.
+	 */
+	retval = load_config_from_node(parse_node,
+				       &export_param,
+				       &dcfsal,
+				       true,
+				       err_type);
+	if (retval != 0)
+		return fsalstat(ERR_FSAL_INVAL, 0);
+	fsal_stack = lookup_fsal(dcfsal.subfsal.name);
+	if (fsal_stack == NULL) {
+		LogMajor(COMPONENT_FSAL,
+			 "dc_create_export: failed to lookup for FSAL %s",
+			 dcfsal.subfsal.name);
+		return fsalstat(ERR_FSAL_INVAL, EINVAL);
+	}
+
+	myself = gsh_calloc(1, sizeof(struct dc_fsal_export));
+	dc_up_ops_init(myself, up_ops);
+
+	expres = fsal_stack->m_ops.create_export(fsal_stack,
+						 dcfsal.subfsal.fsal_node,
+						 err_type,
+						 &myself->up_ops);
+	fsal_put(fsal_stack);
+	if (FSAL_IS_ERROR(expres)) {
+		LogMajor(COMPONENT_FSAL,
+			 "Failed to call create_export on underlying FSAL %s",
+			 dcfsal.subfsal.name);
+		gsh_free(dcfsal.staging_directory);
+		gsh_free(myself);
+		return expres;
+	}
+
+	fsal_export_stack(op_ctx->fsal_export, &myself->export);
+
+	fsal_export_init(&myself->export);
+	dc_export_ops_init(&myself->export.exp_ops);
+	myself->export.up_ops = &myself->super_up_ops;
+	myself->export.fsal = fsal_hdl;
+
+	myself->path = gsh_strdup(op_ctx->ctx_export->fullpath);
+	myself->block_size = dcfsal.block_size;
+	myself->check_interval = dcfsal.change_check_interval;
+	myself->readahead_max = dcfsal.readahead_max;
+
+	/* Read ahead no more than the sub-FSAL reads at once */
+	dc_pass(myself,
+		maxread = myself->export.sub_export->exp_ops.fs_maxread(
+			myself->export.sub_export));
+	myself->fill_max = maxread - maxread % dcfsal.block_size;
+	if (myself->fill_max < dcfsal.block_size)
+		myself->fill_max = dcfsal.block_size;
+
+	params.name = myself->path;
+	params.value_max = dcfsal.block_size;
+	params.ttl = dcfsal.expiration;
+	params.bytes = dcfsal.cache_size;
+	myself->blocks = gsh_cache_create(&params);
+
+	myself->write_back = dcfsal.write_back;
+	myself->staging_size = dcfsal.staging_size;
+	if (dc_wb_init(myself, dcfsal.staging_directory,
+		       dcfsal.destage_delay) != 0) {
+		LogCrit(COMPONENT_FSAL,
+			"DATACACHE %s: Write_Back turned off", myself->path);
+		myself->write_back = false;
+	}
+	gsh_free(dcfsal.staging_directory);
+
+	op_ctx->fsal_export = &myself->export;
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
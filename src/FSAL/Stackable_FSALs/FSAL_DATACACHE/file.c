@@ -0,0 +1,1169 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/* file.c
+ * DATACACHE FSAL I/O methods
+ */
+
+#include "config.h"
+
+#include "fsal.h"
+#include <string.h>
+#include "FSAL/fsal_commonlib.h"
+#include "datacache_methods.h"
+
+static fsal_status_t dc_open(struct fsal_obj_handle *obj_hdl,
+			     fsal_openflags_t openflags)
+{
+	struct dc_fsal_export *exp = dc_export();
+	struct fsal_obj_handle *sub_handle = dc_sub(obj_hdl);
+	fsal_status_t status;
+
+	dc_pass(exp,
+		status = sub_handle->obj_ops.open(sub_handle, openflags));
+
+	return status;
+}
+
+static fsal_status_t dc_reopen(struct fsal_obj_handle *obj_hdl,
+			       fsal_openflags_t openflags)
+{
+	struct dc_fsal_export *exp = dc_export();
+	struct fsal_obj_handle *sub_handle = dc_sub(obj_hdl);
+	fsal_status_t status;
+
+	dc_pass(exp,
+		status = sub_handle->obj_ops.reopen(sub_handle, openflags));
+
+	return status;
+}
+
+static fsal_openflags_t dc_status(struct fsal_obj_handle *obj_hdl)
+{
+	struct dc_fsal_export *exp = dc_export();
+	struct fsal_obj_handle *sub_handle = dc_sub(obj_hdl);
+	fsal_openflags_t result;
+
+	dc_pass(exp,
+		result = sub_handle->obj_ops.status(sub_handle));
+
+	return result;
+}
+
+static fsal_status_t dc_read(struct fsal_obj_handle *obj_hdl,
+			     uint64_t offset,
+			     size_t buffer_size, void *buffer,
+			     size_t *read_amount, bool *end_of_file)
+{
+	struct dc_fsal_export *exp = dc_export();
+	struct fsal_obj_handle *sub_handle = dc_sub(obj_hdl);
+	fsal_status_t status;
+
+	dc_stage_flush(dc_hdl(obj_hdl));
+
+	dc_pass(exp,
+		status = sub_handle->obj_ops.read(sub_handle, offset,
+						  buffer_size, buffer,
+						  read_amount, end_of_file));
+
+	return status;
+}
+
+static fsal_status_t dc_read_plus(struct fsal_obj_handle *obj_hdl,
+				  uint64_t offset,
+				  size_t buffer_size, void *buffer,
+				  size_t *read_amount, bool *end_of_file,
+				  struct io_info *info)
+{
+	struct dc_fsal_export *exp = dc_export();
+	struct fsal_obj_handle *sub_handle = dc_sub(obj_hdl);
+	fsal_status_t status;
+
+	dc_stage_flush(dc_hdl(obj_hdl));
+
+	dc_pass(exp,
+		status = sub_handle->obj_ops.read_plus(sub_handle, offset,
+						       buffer_size, buffer,
+						       read_amount,
+						       end_of_file, info));
+
+	return status;
+}
+
+static fsal_status_t dc_write(struct fsal_obj_handle *obj_hdl,
+			      uint64_t offset,
+			      size_t buffer_size, void *buffer,
+			      size_t *write_amount, bool *fsal_stable)
+{
+	struct dc_fsal_export *exp = dc_export();
+	struct fsal_obj_handle *sub_handle = dc_sub(obj_hdl);
+	fsal_status_t status;
+
+	dc_stage_flush(dc_hdl(obj_hdl));
+
+	dc_pass(exp,
+		status = sub_handle->obj_ops.write(sub_handle, offset,
+						   buffer_size, buffer,
+						   write_amount, fsal_stable));
+
+	dc_invalidate(exp, dc_hdl(obj_hdl));
+
+	return status;
+}
+
+static fsal_status_t dc_write_plus(struct fsal_obj_handle *obj_hdl,
+				   uint64_t offset,
+				   size_t buffer_size, void *buffer,
+				   size_t *write_amount, bool *fsal_stable,
+				   struct io_info *info)
+{
+	struct dc_fsal_export *exp = dc_export();
+	struct fsal_obj_handle *sub_handle = dc_sub(obj_hdl);
+	fsal_status_t status;
+
+	dc_stage_flush(dc_hdl(obj_hdl));
+
+	dc_pass(exp,
+		status = sub_handle->obj_ops.write_plus(sub_handle, offset,
+							buffer_size, buffer,
+							write_amount,
+							fsal_stable, info));
+
+	dc_invalidate(exp, dc_hdl(obj_hdl));
+
+	return status;
+}
+
+static fsal_status_t dc_seek(struct fsal_obj_handle *obj_hdl,
+			     struct io_info *info)
+{
+	struct dc_fsal_export *exp = dc_export();
+	struct fsal_obj_handle *sub_handle = dc_sub(obj_hdl);
+	fsal_status_t status;
+
+	dc_stage_flush(dc_hdl(obj_hdl));
+
+	dc_pass(exp,
+		status = sub_handle->obj_ops.seek(sub_handle, info));
+
+	return status;
+}
+
+static fsal_status_t dc_io_advise(struct fsal_obj_handle *obj_hdl,
+				  struct io_hints *hints)
+{
+	struct dc_fsal_export *exp = dc_export();
+	struct fsal_obj_handle *sub_handle = dc_sub(obj_hdl);
+	fsal_status_t status;
+
+	dc_pass(exp,
+		status = sub_handle->obj_ops.io_advise(sub_handle, hints));
+
+	return status;
+}
+
+static fsal_status_t dc_commit(struct fsal_obj_handle *obj_hdl,
+			       off_t offset, size_t len)
+{
+	struct dc_fsal_export *exp = dc_export();
+	struct fsal_obj_handle *sub_handle = dc_sub(obj_hdl);
+	fsal_status_t status;
+
+	dc_stage_flush(dc_hdl(obj_hdl));
+
+	dc_pass(exp,
+		status = sub_handle->obj_ops.commit(sub_handle, offset, len));
+
+	return status;
+}
+
+static fsal_status_t dc_lock_op(struct fsal_obj_handle *obj_hdl,
+				void *p_owner,
+				fsal_lock_op_t lock_op,
+				fsal_lock_param_t *request_lock,
+				fsal_lock_param_t *conflicting_lock)
+{
+	struct dc_fsal_export *exp = dc_export();
+	struct fsal_obj_handle *sub_handle = dc_sub(obj_hdl);
+	fsal_status_t status;
+
+	dc_pass(exp,
+		status = sub_handle->obj_ops.lock_op(sub_handle, p_owner,
+						     lock_op, request_lock,
+						     conflicting_lock));
+
+	return status;
+}
+
+static fsal_status_t dc_share_op(struct fsal_obj_handle *obj_hdl,
+				 void *p_owner,
+				 fsal_share_param_t request_share)
+{
+	struct dc_fsal_export *exp = dc_export();
+	struct fsal_obj_handle *sub_handle = dc_sub(obj_hdl);
+	fsal_status_t status;
+
+	dc_pass(exp,
+		status = sub_handle->obj_ops.share_op(sub_handle, p_owner,
+						      request_share));
+
+	return status;
+}
+
+static fsal_status_t dc_close(struct fsal_obj_handle *obj_hdl)
+{
+	struct dc_fsal_export *exp = dc_export();
+	struct fsal_obj_handle *sub_handle = dc_sub(obj_hdl);
+	fsal_status_t status;
+
+	dc_stage_flush(dc_hdl(obj_hdl));
+
+	dc_pass(exp,
+		status = sub_handle->obj_ops.close(sub_handle));
+
+	return status;
+}
+
+/**
+ * @brief Open or create a file
+ *
+ * Opening by handle gives back the handle opened, opening by name a new
+ * handle to wrap.  A truncated file loses its blocks.
+ */
+static fsal_status_t dc_open2(struct fsal_obj_handle *obj_hdl,
+			      struct state_t *state,
+			      fsal_openflags_t openflags,
+			      enum fsal_create_mode createmode,
+			      const char *name,
+			      struct attrlist *attrs_in,
+			      fsal_verifier_t verifier,
+			      struct fsal_obj_handle **new_obj,
+			      struct attrlist *attrs_out,
+			      bool *caller_perm_check)
+{
+	struct dc_fsal_export *exp = dc_export();
+	struct fsal_obj_handle *sub_handle = dc_sub(obj_hdl);
+	struct fsal_obj_handle *sub_new = NULL;
+	fsal_status_t status;
+
+	*new_obj = NULL;
+
+	/* What was staged must not land past a truncation */
+	if (name == NULL && (openflags & FSAL_O_TRUNC))
+		dc_stage_flush(dc_hdl(obj_hdl));
+
+	dc_pass(exp,
+		status = sub_handle->obj_ops.open2(sub_handle, state, openflags,
+						   createmode, name, attrs_in,
+						   verifier, &sub_new,
+						   attrs_out,
+						   caller_perm_check));
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
+	if (name == NULL) {
+		*new_obj = obj_hdl;
+	} else {
+		status = dc_alloc_and_check_handle(exp, sub_new, obj_hdl->fs,
+						   new_obj, status);
+	}
+
+	if (openflags & FSAL_O_TRUNC)
+		dc_invalidate(exp, dc_hdl(*new_obj));
+
+	return status;
+}
+
+static bool dc_check_verifier(struct fsal_obj_handle *obj_hdl,
+			      fsal_verifier_t verifier)
+{
+	struct dc_fsal_export *exp = dc_export();
+	struct fsal_obj_handle *sub_handle = dc_sub(obj_hdl);
+	bool result;
+
+	dc_pass(exp,
+		result = sub_handle->obj_ops.check_verifier(sub_handle,
+							    verifier));
+
+	return result;
+}
+
+static fsal_openflags_t dc_status2(struct fsal_obj_handle *obj_hdl,
+				   struct state_t *state)
+{
+	struct dc_fsal_export *exp = dc_export();
+	struct fsal_obj_handle *sub_handle = dc_sub(obj_hdl);
+	fsal_openflags_t result;
+
+	dc_pass(exp,
+		result = sub_handle->obj_ops.status2(sub_handle, state));
+
+	return result;
+}
+
+static fsal_status_t dc_reopen2(struct fsal_obj_handle *obj_hdl,
+				struct state_t *state,
+				fsal_openflags_t openflags)
+{
+	struct dc_fsal_export *exp = dc_export();
+	struct fsal_obj_handle *sub_handle = dc_sub(obj_hdl);
+	fsal_status_t status;
+
+	dc_stage_flush(dc_hdl(obj_hdl));
+
+	dc_pass(exp,
+		status = sub_handle->obj_ops.reopen2(sub_handle, state,
+						     openflags));
+
+	if (openflags & FSAL_O_TRUNC)
+		dc_invalidate(exp, dc_hdl(obj_hdl));
+
+	return status;
+}
+
+/**
+ * @brief A read filling the cache, or an asynchronous I/O passed down
+ *
+ * A fill reads whole blocks from the sub-FSAL into its own buffer,
+ * from the first block the cache lacked to past the end of the
+ * caller's read and whatever is read ahead of it.
+ */
+struct dc_io {
+	struct fsal_io_arg fill;	/*< The sub-FSAL's read of blocks */
+	struct dc_fsal_obj_handle *hdl;
+	struct dc_fsal_export *exp;
+	uint64_t gen;			/*< Of the file when it started */
+	uint64_t block;			/*< First block of the fill */
+	uint64_t offset;		/*< The caller's read */
+	size_t size;
+	void *buffer;
+	size_t done;			/*< Bytes of it from the cache */
+	/* Asynchronous I/O only */
+	struct req_op_context *ctx;	/*< The caller's context */
+	struct fsal_io_arg *io_arg;	/*< The caller's arguments */
+	fsal_async_cb done_cb;
+	void *caller_arg;
+	bool filling;			/*< A read filling the cache */
+	bool write;			/*< A write, to invalidate after */
+};
+
+/** Whether a read may go through the cache */
+static inline bool dc_cacheable(struct dc_fsal_obj_handle *hdl,
+				size_t size, struct io_info *info)
+{
+	return hdl->key.len != 0 && size != 0 && info == NULL;
+}
+
+/** Whether a write may be staged, see writeback.c */
+static inline bool dc_stageable(struct dc_fsal_export *exp,
+				struct fsal_obj_handle *obj_hdl, size_t size,
+				bool stable, struct io_info *info)
+{
+	return exp->write_back && obj_hdl->type == REGULAR_FILE &&
+	       size != 0 && !stable && info == NULL;
+}
+
+static inline uint32_t dc_key(struct dc_fsal_obj_handle *hdl, uint64_t gen,
+			      uint64_t block, struct dc_block_key *key)
+{
+	key->gen = gen;
+	key->block = block;
+	memcpy(key->key, hdl->key.addr, hdl->key.len);
+
+	return offsetof(struct dc_block_key, key) + hdl->key.len;
+}
+
+/**
+ * @brief The change attribute of a file, from the sub-FSAL
+ *
+ * With getattr_change if the sub-FSAL has it, else with getattrs.
+ */
+static fsal_status_t dc_change(struct dc_fsal_export *exp,
+			       struct dc_fsal_obj_handle *hdl,
+			       uint64_t *change)
+{
+	struct fsal_obj_handle *sub_handle = hdl->sub_handle;
+	struct attrlist attrs;
+	fsal_status_t status;
+
+	if (!hdl->change_by_getattrs) {
+		dc_pass(exp,
+			status = sub_handle->obj_ops.getattr_change(sub_handle,
+								    change));
+		if (status.major != ERR_FSAL_NOTSUPP)
+			return status;
+		hdl->change_by_getattrs = true;
+	}
+
+	fsal_prepare_attrs(&attrs, ATTR_CHANGE);
+
+	dc_pass(exp,
+		status = sub_handle->obj_ops.getattrs(sub_handle, &attrs));
+
+	if (!FSAL_IS_ERROR(status)) {
+		if (FSAL_TEST_MASK(attrs.mask, ATTR_CHANGE))
+			*change = attrs.change;
+		else
+			status = fsalstat(ERR_FSAL_NOTSUPP, 0);
+	}
+
+	fsal_release_attrs(&attrs);
+
+	return status;
+}
+
+/**
+ * @brief Drop a file's blocks if its change attribute moved
+ *
+ * Checked before a read, at most once per Change_Check_Interval.  A
+ * file whose change attribute cannot be had is left to the expiration
+ * of its blocks.  The first check of a handle always invalidates,
+ * since blocks cached through an earlier one may be of any age.
+ *
+ * @param[in] exp The export
+ * @param[in] hdl The file
+ */
+static void dc_revalidate(struct dc_fsal_export *exp,
+			  struct dc_fsal_obj_handle *hdl)
+{
+	time_t t, checked;
+	uint64_t change = 0;
+	fsal_status_t status;
+
+	if (hdl->no_change)
+		return;
+
+	t = time(NULL);
+	checked = atomic_fetch_time_t(&hdl->checked);
+	if (checked != 0 && exp->check_interval != 0 &&
+	    t - checked < exp->check_interval)
+		return;
+
+	status = dc_change(exp, hdl, &change);
+	if (status.major == ERR_FSAL_NOTSUPP) {
+		hdl->no_change = true;
+		return;
+	}
+
+	if (FSAL_IS_ERROR(status) || checked == 0 ||
+	    atomic_fetch_uint64_t(&hdl->change) != change)
+		dc_invalidate(exp, hdl);
+
+	atomic_store_uint64_t(&hdl->change, change);
+	atomic_store_time_t(&hdl->checked, t);
+}
+
+/**
+ * @brief Follow a read, for the readahead of the next fill
+ *
+ * As in FSAL_VFS, a read starting where the last one ended continues
+ * a stream, whose window doubles from the size of the read up to
+ * Readahead_Max.  Any other read ends it.
+ */
+static void dc_stream(struct dc_fsal_export *exp,
+		      struct dc_fsal_obj_handle *hdl, uint64_t offset,
+		      size_t size)
+{
+	uint64_t window;
+
+	if (exp->readahead_max == 0)
+		return;
+
+	if (atomic_fetch_uint64_t(&hdl->ra_next) != offset) {
+		window = 0;
+	} else {
+		window = atomic_fetch_uint64_t(&hdl->ra_window);
+		window = window == 0 ? size : 2 * window;
+		if (window > exp->readahead_max)
+			window = exp->readahead_max;
+	}
+
+	atomic_store_uint64_t(&hdl->ra_window, window);
+	atomic_store_uint64_t(&hdl->ra_next, offset + size);
+}
+
+/**
+ * @brief Read what the cache holds of a read, from its start
+ *
+ * @param[in]  exp         The export
+ * @param[in]  hdl         The file
+ * @param[in]  offset      Where the read starts
+ * @param[in]  size        Bytes asked for
+ * @param[out] buffer      Where they go
+ * @param[out] read_amount Bytes read from the cache
+ * @param[out] end_of_file The read reached the end of the file
+ * @param[out] gen         Generation of the file the blocks were of
+ *
+ * @return Whether the read is done, else the rest is to be filled.
+ */
+static bool dc_read_cached(struct dc_fsal_export *exp,
+			   struct dc_fsal_obj_handle *hdl, uint64_t offset,
+			   size_t size, void *buffer, size_t *read_amount,
+			   bool *end_of_file, uint64_t *gen)
+{
+	uint32_t bs = exp->block_size;
+	struct dc_block_key key;
+	uint32_t key_len, len;
+	uint64_t pos, boff;
+	size_t n, done = 0;
+	void *block = NULL;
+
+	dc_revalidate(exp, hdl);
+	dc_stream(exp, hdl, offset, size);
+
+	*gen = atomic_fetch_uint64_t(&dc_gens[hdl->slot]);
+	*end_of_file = false;
+
+	while (done < size) {
+		pos = offset + done;
+		boff = pos % bs;
+
+		/* A whole block goes straight to the caller */
+		if (block == NULL && (boff != 0 || size - done < bs))
+			block = gsh_malloc(bs);
+
+		key_len = dc_key(hdl, *gen, pos / bs, &key);
+		if (gsh_cache_lookup(exp->blocks, &key, key_len,
+				     block != NULL ? block
+						   : (char *)buffer + done,
+				     &len) != GSH_CACHE_HIT)
+			break;
+
+		(void) atomic_inc_uint64_t(&exp->stats.hits);
+
+		if (len <= boff) {
+			*end_of_file = true;
+			break;
+		}
+
+		n = MIN(len - boff, size - done);
+		if (block != NULL)
+			memcpy((char *)buffer + done, (char *)block + boff, n);
+		done += n;
+
+		if (len < bs && boff + n == len) {
+			/* The last block of the file */
+			*end_of_file = true;
+			break;
+		}
+	}
+
+	gsh_free(block);
+	*read_amount = done;
+
+	return done == size || *end_of_file;
+}
+
+/**
+ * @brief Start filling the cache for the rest of a read
+ *
+ * @param[in] exp      The export
+ * @param[in] hdl      The file
+ * @param[in] state    State of the read
+ * @param[in] offset   Where the read starts
+ * @param[in] size     Bytes asked for
+ * @param[in] buffer   Where they go
+ * @param[in] done     Bytes of them read from the cache
+ * @param[in] gen      Generation they were of
+ *
+ * @return The fill, its read to pass to the sub-FSAL.
+ */
+static struct dc_io *dc_fill_new(struct dc_fsal_export *exp,
+				 struct dc_fsal_obj_handle *hdl,
+				 struct state_t *state, uint64_t offset,
+				 size_t size, void *buffer, size_t done,
+				 uint64_t gen)
+{
+	uint32_t bs = exp->block_size;
+	struct dc_io *io = gsh_calloc(1, sizeof(*io));
+	uint64_t start, end, need, ahead;
+
+	io->hdl = hdl;
+	io->exp = exp;
+	io->gen = gen;
+	io->offset = offset;
+	io->size = size;
+	io->buffer = buffer;
+	io->done = done;
+	io->filling = true;
+
+	io->block = (offset + done) / bs;
+	start = io->block * bs;
+	end = offset + size;
+	end = end + (bs - end % bs) % bs;
+	need = end - start;
+
+	/* The read ahead rides on the fill, as far as one read goes */
+	ahead = atomic_fetch_uint64_t(&hdl->ra_window);
+	ahead = ahead + (bs - ahead % bs) % bs;
+	if (need + ahead > exp->fill_max)
+		ahead = exp->fill_max > need ? exp->fill_max - need : 0;
+
+	io->fill.state = state;
+	io->fill.offset = start;
+	io->fill.size = need + ahead;
+	io->fill.buffer = gsh_malloc(io->fill.size);
+
+	(void) atomic_inc_uint64_t(&exp->stats.fills);
+
+	return io;
+}
+
+/**
+ * @brief Finish a fill, caching its blocks and completing the read
+ *
+ * Only whole blocks are cached, and the last one of the file.  A block
+ * shorter than Block_Size, or empty, marks where the file ended.
+ *
+ * @param[in]  io          The fill, freed
+ * @param[in]  status      Status of the sub-FSAL's read
+ * @param[out] read_amount Bytes of the caller's read
+ * @param[out] end_of_file The read reached the end of the file
+ *
+ * @return Status of the read.
+ */
+static fsal_status_t dc_fill_done(struct dc_io *io, fsal_status_t status,
+				  size_t *read_amount, bool *end_of_file)
+{
+	struct dc_fsal_export *exp = io->exp;
+	uint32_t bs = exp->block_size;
+	size_t amount = io->fill.io_amount;
+	bool eof = io->fill.end_of_file;
+	char *data = io->fill.buffer;
+	struct dc_block_key key;
+	uint64_t pos, skip;
+	size_t n;
+
+	*read_amount = io->done;
+	*end_of_file = false;
+
+	if (FSAL_IS_ERROR(status))
+		goto out;
+
+	(void) atomic_add_uint64_t(&exp->stats.filled, amount);
+
+	for (pos = 0; pos < amount || (eof && pos == amount); pos += bs) {
+		n = MIN(bs, amount - pos);
+		if (n < bs && !eof)
+			break;
+		gsh_cache_insert(exp->blocks, &key,
+				 dc_key(io->hdl, io->gen, io->block + pos / bs,
+					&key),
+				 data + pos, n);
+		if (n < bs)
+			break;
+	}
+
+	skip = io->offset + io->done - io->fill.offset;
+	if (amount > skip) {
+		n = MIN(amount - skip, io->size - io->done);
+		memcpy((char *)io->buffer + io->done, data + skip, n);
+		*read_amount += n;
+		*end_of_file = eof && skip + n == amount;
+	} else {
+		*end_of_file = eof;
+	}
+
+ out:
+	gsh_free(io->fill.buffer);
+	gsh_free(io);
+
+	return status;
+}
+
+/**
+ * @brief Read a file, through the cache
+ *
+ * READ_PLUS, which reports holes, goes straight to the sub-FSAL.
+ */
+static fsal_status_t dc_read2(struct fsal_obj_handle *obj_hdl,
+			      bool bypass,
+			      struct state_t *state,
+			      uint64_t offset,
+			      size_t buffer_size,
+			      void *buffer,
+			      size_t *read_amount,
+			      bool *end_of_file,
+			      struct io_info *info)
+{
+	struct dc_fsal_export *exp = dc_export();
+	struct dc_fsal_obj_handle *hdl = dc_hdl(obj_hdl);
+	struct fsal_obj_handle *sub_handle = hdl->sub_handle;
+	fsal_status_t status;
+	struct dc_io *io;
+	uint64_t gen;
+
+	dc_stage_flush(hdl);
+
+	if (!dc_cacheable(hdl, buffer_size, info)) {
+		dc_pass(exp,
+			status = sub_handle->obj_ops.read2(sub_handle, bypass,
+							   state, offset,
+							   buffer_size, buffer,
+							   read_amount,
+							   end_of_file, info));
+		return status;
+	}
+
+	if (dc_read_cached(exp, hdl, offset, buffer_size, buffer,
+			   read_amount, end_of_file, &gen))
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+	io = dc_fill_new(exp, hdl, state, offset, buffer_size, buffer,
+			 *read_amount, gen);
+
+	dc_pass(exp,
+		status = sub_handle->obj_ops.read2(sub_handle, bypass, state,
+						   io->fill.offset,
+						   io->fill.size,
+						   io->fill.buffer,
+						   &io->fill.io_amount,
+						   &io->fill.end_of_file,
+						   NULL));
+
+	return dc_fill_done(io, status, read_amount, end_of_file);
+}
+
+/**
+ * @brief Write a file, dropping its cached blocks once written
+ *
+ * An UNSTABLE write is staged if it can be.
+ */
+static fsal_status_t dc_write2(struct fsal_obj_handle *obj_hdl,
+			       bool bypass,
+			       struct state_t *state,
+			       uint64_t offset,
+			       size_t buffer_size,
+			       void *buffer,
+			       size_t *wrote_amount,
+			       bool *fsal_stable,
+			       struct io_info *info)
+{
+	struct dc_fsal_export *exp = dc_export();
+	struct dc_fsal_obj_handle *hdl = dc_hdl(obj_hdl);
+	struct fsal_obj_handle *sub_handle = hdl->sub_handle;
+	fsal_status_t status;
+
+	if (dc_stageable(exp, obj_hdl, buffer_size, *fsal_stable, info) &&
+	    dc_stage_write(exp, hdl, bypass, state, offset, buffer_size,
+			   buffer)) {
+		*wrote_amount = buffer_size;
+		dc_invalidate(exp, hdl);
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+	}
+
+	dc_stage_flush(hdl);
+
+	dc_pass(exp,
+		status = sub_handle->obj_ops.write2(sub_handle, bypass, state,
+						    offset, buffer_size,
+						    buffer, wrote_amount,
+						    fsal_stable, info));
+
+	dc_invalidate(exp, hdl);
+
+	return status;
+}
+
+static fsal_status_t dc_seek2(struct fsal_obj_handle *obj_hdl,
+			      struct state_t *state,
+			      struct io_info *info)
+{
+	struct dc_fsal_export *exp = dc_export();
+	struct fsal_obj_handle *sub_handle = dc_sub(obj_hdl);
+	fsal_status_t status;
+
+	dc_stage_flush(dc_hdl(obj_hdl));
+
+	dc_pass(exp,
+		status = sub_handle->obj_ops.seek2(sub_handle, state, info));
+
+	return status;
+}
+
+static fsal_status_t dc_io_advise2(struct fsal_obj_handle *obj_hdl,
+				   struct state_t *state,
+				   struct io_hints *hints)
+{
+	struct dc_fsal_export *exp = dc_export();
+	struct fsal_obj_handle *sub_handle = dc_sub(obj_hdl);
+	fsal_status_t status;
+
+	dc_pass(exp,
+		status = sub_handle->obj_ops.io_advise2(sub_handle, state,
+							hints));
+
+	return status;
+}
+
+/**
+ * @brief Commit a file, once what it staged is written
+ *
+ * All of it is destaged, whatever the range: a COMMIT is rare enough
+ * next to the writes it covers.  An error destaging is returned even
+ * if the sub-FSAL's commit succeeds, so the client resends.
+ */
+static fsal_status_t dc_commit2(struct fsal_obj_handle *obj_hdl,
+				off_t offset, size_t len)
+{
+	struct dc_fsal_export *exp = dc_export();
+	struct fsal_obj_handle *sub_handle = dc_sub(obj_hdl);
+	fsal_status_t staged, status;
+
+	staged = dc_stage_commit(dc_hdl(obj_hdl));
+
+	dc_pass(exp,
+		status = sub_handle->obj_ops.commit2(sub_handle, offset, len));
+
+	if (!FSAL_IS_ERROR(status))
+		status = staged;
+
+	return status;
+}
+
+static fsal_status_t dc_lock_op2(struct fsal_obj_handle *obj_hdl,
+				 struct state_t *state,
+				 void *p_owner,
+				 fsal_lock_op_t lock_op,
+				 fsal_lock_param_t *request_lock,
+				 fsal_lock_param_t *conflicting_lock)
+{
+	struct dc_fsal_export *exp = dc_export();
+	struct fsal_obj_handle *sub_handle = dc_sub(obj_hdl);
+	fsal_status_t status;
+
+	dc_pass(exp,
+		status = sub_handle->obj_ops.lock_op2(sub_handle, state,
+						      p_owner, lock_op,
+						      request_lock,
+						      conflicting_lock));
+
+	return status;
+}
+
+static fsal_status_t dc_setattr2(struct fsal_obj_handle *obj_hdl,
+				 bool bypass,
+				 struct state_t *state,
+				 struct attrlist *attrib_set)
+{
+	struct dc_fsal_export *exp = dc_export();
+	struct fsal_obj_handle *sub_handle = dc_sub(obj_hdl);
+	fsal_status_t status;
+
+	dc_stage_flush(dc_hdl(obj_hdl));
+
+	dc_pass(exp,
+		status = sub_handle->obj_ops.setattr2(sub_handle, bypass,
+						      state, attrib_set));
+
+	if (FSAL_TEST_MASK(attrib_set->mask, ATTR_SIZE))
+		dc_invalidate(exp, dc_hdl(obj_hdl));
+
+	return status;
+}
+
+static fsal_status_t dc_close2(struct fsal_obj_handle *obj_hdl,
+			       struct state_t *state)
+{
+	struct dc_fsal_export *exp = dc_export();
+	struct fsal_obj_handle *sub_handle = dc_sub(obj_hdl);
+	fsal_status_t status;
+
+	dc_stage_flush(dc_hdl(obj_hdl));
+
+	dc_pass(exp,
+		status = sub_handle->obj_ops.close2(sub_handle, state));
+
+	return status;
+}
+
+static fsal_status_t dc_write_vec(struct fsal_obj_handle *obj_hdl,
+				  bool bypass, struct state_t *state,
+				  uint64_t offset,
+				  const struct iovec *iov, int iovcnt,
+				  size_t *wrote_amount, bool *fsal_stable)
+{
+	struct dc_fsal_export *exp = dc_export();
+	struct dc_fsal_obj_handle *hdl = dc_hdl(obj_hdl);
+	struct fsal_obj_handle *sub_handle = hdl->sub_handle;
+	fsal_status_t status = fsalstat(ERR_FSAL_NO_ERROR, 0);
+	size_t staged = 0, wrote = 0;
+	int ix = 0;
+
+	/* Stage what can be, and write the rest through */
+	if (exp->write_back && !*fsal_stable) {
+		while (ix < iovcnt &&
+		       dc_stageable(exp, obj_hdl, iov[ix].iov_len, false,
+				    NULL) &&
+		       dc_stage_write(exp, hdl, bypass, state,
+				      offset + staged, iov[ix].iov_len,
+				      iov[ix].iov_base)) {
+			staged += iov[ix].iov_len;
+			ix++;
+		}
+	}
+
+	if (ix < iovcnt) {
+		dc_stage_flush(hdl);
+
+		dc_pass(exp,
+			status = sub_handle->obj_ops.write_vec(
+				sub_handle, bypass, state, offset + staged,
+				iov + ix, iovcnt - ix, &wrote, fsal_stable));
+	}
+
+	*wrote_amount = staged + wrote;
+
+	dc_invalidate(exp, hdl);
+
+	return status;
+}
+
+/**
+ * @brief Complete an asynchronous read or write made by the sub-FSAL
+ *
+ * May run on a thread of the sub-FSAL.
+ */
+static void dc_io_done(struct fsal_obj_handle *sub_hdl,
+		       fsal_status_t status, struct fsal_io_arg *io_arg,
+		       void *caller_arg)
+{
+	struct dc_io *io = caller_arg;
+	struct fsal_obj_handle *obj_hdl = &io->hdl->obj_handle;
+	struct fsal_io_arg *arg = io->io_arg;
+	fsal_async_cb done_cb = io->done_cb;
+	void *done_arg = io->caller_arg;
+
+	io->ctx->fsal_export = &io->exp->export;
+
+	if (io->filling) {
+		status = dc_fill_done(io, status, &arg->io_amount,
+				      &arg->end_of_file);
+	} else {
+		if (io->write)
+			dc_invalidate(io->exp, io->hdl);
+		gsh_free(io);
+	}
+
+	done_cb(obj_hdl, status, arg, done_arg);
+}
+
+/**
+ * @brief Read a file asynchronously, through the cache
+ *
+ * A read the cache holds completes at once, any other is passed down
+ * asynchronously, to fill the cache as it completes.
+ */
+static void dc_read2_async(struct fsal_obj_handle *obj_hdl,
+			   bool bypass,
+			   struct fsal_io_arg *read_arg,
+			   fsal_async_cb done_cb,
+			   void *caller_arg)
+{
+	struct dc_fsal_export *exp = dc_export();
+	struct dc_fsal_obj_handle *hdl = dc_hdl(obj_hdl);
+	struct fsal_obj_handle *sub_handle = hdl->sub_handle;
+	struct fsal_io_arg *sub_arg = read_arg;
+	struct dc_io *io;
+	uint64_t gen;
+
+	dc_stage_flush(hdl);
+
+	if (!dc_cacheable(hdl, read_arg->size, read_arg->info)) {
+		io = gsh_calloc(1, sizeof(*io));
+		io->hdl = hdl;
+		io->exp = exp;
+	} else if (dc_read_cached(exp, hdl, read_arg->offset,
+				  read_arg->size, read_arg->buffer,
+				  &read_arg->io_amount,
+				  &read_arg->end_of_file, &gen)) {
+		done_cb(obj_hdl, fsalstat(ERR_FSAL_NO_ERROR, 0), read_arg,
+			caller_arg);
+		return;
+	} else {
+		io = dc_fill_new(exp, hdl, read_arg->state, read_arg->offset,
+				 read_arg->size, read_arg->buffer,
+				 read_arg->io_amount, gen);
+		sub_arg = &io->fill;
+	}
+
+	io->ctx = op_ctx;
+	io->io_arg = read_arg;
+	io->done_cb = done_cb;
+	io->caller_arg = caller_arg;
+
+	dc_pass(exp,
+		sub_handle->obj_ops.read2_async(sub_handle, bypass, sub_arg,
+						dc_io_done, io));
+}
+
+/**
+ * @brief Write a file asynchronously
+ *
+ * A write that is staged completes at once.
+ */
+static void dc_write2_async(struct fsal_obj_handle *obj_hdl,
+			    bool bypass,
+			    struct fsal_io_arg *write_arg,
+			    fsal_async_cb done_cb,
+			    void *caller_arg)
+{
+	struct dc_fsal_export *exp = dc_export();
+	struct dc_fsal_obj_handle *hdl = dc_hdl(obj_hdl);
+	struct fsal_obj_handle *sub_handle = hdl->sub_handle;
+	struct dc_io *io;
+
+	if (dc_stageable(exp, obj_hdl, write_arg->size,
+			 write_arg->fsal_stable, write_arg->info) &&
+	    dc_stage_write(exp, hdl, bypass, write_arg->state,
+			   write_arg->offset, write_arg->size,
+			   write_arg->buffer)) {
+		write_arg->io_amount = write_arg->size;
+		dc_invalidate(exp, hdl);
+		done_cb(obj_hdl, fsalstat(ERR_FSAL_NO_ERROR, 0), write_arg,
+			caller_arg);
+		return;
+	}
+
+	dc_stage_flush(hdl);
+
+	io = gsh_calloc(1, sizeof(*io));
+	io->hdl = hdl;
+	io->exp = exp;
+	io->ctx = op_ctx;
+	io->io_arg = write_arg;
+	io->done_cb = done_cb;
+	io->caller_arg = caller_arg;
+	io->write = true;
+
+	dc_pass(exp,
+		sub_handle->obj_ops.write2_async(sub_handle, bypass,
+						 write_arg, dc_io_done, io));
+}
+
+static fsal_status_t dc_copy(struct fsal_obj_handle *src_hdl,
+			     struct state_t *src_state,
+			     uint64_t src_offset,
+			     struct fsal_obj_handle *dst_hdl,
+			     struct state_t *dst_state,
+			     uint64_t dst_offset,
+			     uint64_t count,
+			     uint64_t *copied)
+{
+	struct dc_fsal_export *exp = dc_export();
+	struct fsal_obj_handle *sub_src = dc_sub(src_hdl);
+	fsal_status_t status;
+
+	dc_stage_flush(dc_hdl(src_hdl));
+	dc_stage_flush(dc_hdl(dst_hdl));
+
+	dc_pass(exp,
+		status = sub_src->obj_ops.copy(sub_src, src_state, src_offset,
+					       dc_sub(dst_hdl), dst_state,
+					       dst_offset, count, copied));
+
+	dc_invalidate(exp, dc_hdl(dst_hdl));
+
+	return status;
+}
+
+static fsal_status_t dc_clone(struct fsal_obj_handle *src_hdl,
+			      struct state_t *src_state,
+			      uint64_t src_offset,
+			      struct fsal_obj_handle *dst_hdl,
+			      struct state_t *dst_state,
+			      uint64_t dst_offset,
+			      uint64_t count)
+{
+	struct dc_fsal_export *exp = dc_export();
+	struct fsal_obj_handle *sub_src = dc_sub(src_hdl);
+	fsal_status_t status;
+
+	dc_stage_flush(dc_hdl(src_hdl));
+	dc_stage_flush(dc_hdl(dst_hdl));
+
+	dc_pass(exp,
+		status = sub_src->obj_ops.clone(sub_src, src_state, src_offset,
+						dc_sub(dst_hdl), dst_state,
+						dst_offset, count));
+
+	dc_invalidate(exp, dc_hdl(dst_hdl));
+
+	return status;
+}
+
+static fsal_status_t dc_fallocate(struct fsal_obj_handle *obj_hdl,
+				  struct state_t *state,
+				  uint64_t offset,
+				  uint64_t length,
+				  bool allocate)
+{
+	struct dc_fsal_export *exp = dc_export();
+	struct fsal_obj_handle *sub_handle = dc_sub(obj_hdl);
+	fsal_status_t status;
+
+	dc_stage_flush(dc_hdl(obj_hdl));
+
+	dc_pass(exp,
+		status = sub_handle->obj_ops.fallocate(sub_handle, state,
+						       offset, length,
+						       allocate));
+
+	dc_invalidate(exp, dc_hdl(obj_hdl));
+
+	return status;
+}
+
+void dc_file_ops_init(struct fsal_obj_ops *ops)
+{
+	ops->open = dc_open;
+	ops->reopen = dc_reopen;
+	ops->status = dc_status;
+	ops->read = dc_read;
+	ops->read_plus = dc_read_plus;
+	ops->write = dc_write;
+	ops->write_plus = dc_write_plus;
+	ops->seek = dc_seek;
+	ops->io_advise = dc_io_advise;
+	ops->commit = dc_commit;
+	ops->lock_op = dc_lock_op;
+	ops->share_op = dc_share_op;
+	ops->close = dc_close;
+	ops->open2 = dc_open2;
+	ops->check_verifier = dc_check_verifier;
+	ops->status2 = dc_status2;
+	ops->reopen2 = dc_reopen2;
+	ops->read2 = dc_read2;
+	ops->write2 = dc_write2;
+	ops->seek2 = dc_seek2;
+	ops->io_advise2 = dc_io_advise2;
+	ops->commit2 = dc_commit2;
+	ops->lock_op2 = dc_lock_op2;
+	ops->setattr2 = dc_setattr2;
+	ops->close2 = dc_close2;
+	ops->write_vec = dc_write_vec;
+	ops->read2_async = dc_read2_async;
+	ops->write2_async = dc_write2_async;
+	ops->copy = dc_copy;
+	ops->clone = dc_clone;
+	ops->fallocate = dc_fallocate;
+}
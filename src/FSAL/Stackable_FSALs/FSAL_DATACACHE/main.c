@@ -0,0 +1,88 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/* main.c
+ * Module core functions
+ */
+
+#include "config.h"
+
+#include "fsal.h"
+#include <pthread.h>
+#include <string.h>
+#include "FSAL/fsal_init.h"
+#include "datacache_methods.h"
+
+/* FSAL name determines name of shared library: libfsal<name>.so */
+const char myname[] = "DATACACHE";
+
+/** Generations of the files, shared by the exports */
+uint64_t dc_gens[DC_GEN_SLOTS];
+
+/* Module methods
+ */
+
+/**
+ * @brief Whether the handle's FSAL supports the extended API
+ *
+ * The sub-FSAL's answer, as for MDCACHE.
+ */
+static bool dc_support_ex(struct fsal_obj_handle *obj_hdl)
+{
+	struct fsal_obj_handle *sub_handle = dc_sub(obj_hdl);
+
+	return sub_handle->fsal->m_ops.support_ex(sub_handle);
+}
+
+/* Module initialization.
+ * Called by dlopen() to register the module
+ * keep a private pointer to me in myself
+ */
+
+/* my module private storage
+ */
+
+static struct fsal_module DATACACHE;
+
+MODULE_INIT void dc_init(void)
+{
+	int retval;
+	struct fsal_module *myself = &DATACACHE;
+
+	retval = register_fsal(myself, myname, FSAL_MAJOR_VERSION,
+			       FSAL_MINOR_VERSION, FSAL_ID_NO_PNFS);
+	if (retval != 0) {
+		fprintf(stderr, "DATACACHE module failed to register");
+		return;
+	}
+	myself->m_ops.create_export = dc_create_export;
+	myself->m_ops.support_ex = dc_support_ex;
+}
+
+MODULE_FINI void dc_unload(void)
+{
+	int retval;
+
+	retval = unregister_fsal(&DATACACHE);
+	if (retval != 0) {
+		fprintf(stderr, "DATACACHE module failed to unregister");
+		return;
+	}
+}
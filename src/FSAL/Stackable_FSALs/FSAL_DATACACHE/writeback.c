@@ -0,0 +1,589 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/**
+ * @file writeback.c
+ * @brief Staging of UNSTABLE writes in a local log
+ *
+ * With Write_Back on, an UNSTABLE write to a regular file is appended
+ * to the export's staging log, a file in Staging_Directory, and is
+ * acknowledged once it is there.  The destager thread writes what each
+ * file has staged to the sub-FSAL every Destage_Delay seconds; COMMIT,
+ * and anything else that could see or change the data of a file,
+ * destages the file first.
+ *
+ * Nothing is ever read back from the log after a restart: it is
+ * unlinked as soon as it is made, and never synced.  Staged writes
+ * are UNSTABLE ones, which a server that restarts may lose, since the
+ * write verifier changes with its boot time and clients resend what
+ * they have not seen committed.  A destage that fails is returned by
+ * the next COMMIT of the file, and changes the NFSv4 write verifier of
+ * the export, so clients resend everything not yet committed.
+ *
+ * Space in the log is handed out in order, and reused from the start
+ * once everything staged is destaged.  A write that does not fit is
+ * written through, after what its file has staged.  As for MDCACHE's
+ * gathered writes, the writes staged on a file are those made through
+ * the same state by the same user, and are destaged with them; the
+ * sub-FSAL checks them only then, and what it refuses is returned by
+ * COMMIT as any other error.
+ */
+
+#include "config.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include "fsal.h"
+#include "nfs_core.h"
+#include "fridgethr.h"
+#include "export_mgr.h"
+#include "sal_functions.h"
+#include "datacache_methods.h"
+
+/* Longest run of staged writes merged into one extent */
+#define DC_EXTENT_MAX (1024 * 1024)
+
+/**
+ * @brief Staged data of a file, contiguous in the file and in the log
+ */
+struct dc_extent {
+	struct glist_head list;
+	uint64_t offset;		/*< In the file */
+	uint64_t log_off;		/*< In the staging log */
+	size_t len;
+};
+
+/**
+ * @brief The staged writes of a file
+ *
+ * Everything but dirty and busy is protected by mtx, those by the
+ * export's wb_mtx.
+ */
+struct dc_stage {
+	pthread_mutex_t mtx;
+	struct dc_fsal_export *exp;
+	struct dc_fsal_obj_handle *hdl;
+	struct glist_head extents;	/*< struct dc_extent, as staged */
+	size_t len;			/*< Bytes staged */
+	uint64_t end;			/*< Where the last of them ends */
+	struct glist_head dirty;	/*< On the export's dirty list */
+	uint32_t busy;			/*< Taken by the destager */
+	/** What the staged writes were made with, referenced while staged */
+	bool bypass;
+	struct state_t *state;
+	struct gsh_export *export;
+	uid_t uid;
+	gid_t gid;
+	uint32_t nfs_vers;
+	uint32_t nfs_minorvers;
+	/** First error destaging, returned by COMMIT */
+	fsal_status_t error;
+};
+
+/**
+ * @brief Write what a file has staged to the sub-FSAL
+ *
+ * Called with the stage's mutex held.  The references the staged
+ * writes held are passed back, to be dropped by dc_stage_release()
+ * once the mutex is released: dropping the last reference on a state
+ * closes it, which destages.
+ *
+ * @param[in]  st      The file's stage
+ * @param[out] state   State reference to drop
+ * @param[out] export  Export reference to drop
+ */
+static void dc_destage_locked(struct dc_stage *st, struct state_t **state,
+			      struct gsh_export **export)
+{
+	struct dc_fsal_export *exp = st->exp;
+	struct fsal_obj_handle *sub_handle = st->hdl->sub_handle;
+	struct root_op_context root_op_context;
+	struct dc_extent *ext;
+	fsal_status_t status;
+	size_t wrote;
+	bool stable;
+	ssize_t n;
+	void *buf;
+
+	*state = NULL;
+	*export = NULL;
+
+	if (st->len == 0)
+		return;
+
+	init_root_op_context(&root_op_context, st->export, &exp->export,
+			     st->nfs_vers, st->nfs_minorvers, UNKNOWN_REQUEST);
+	root_op_context.creds.caller_uid = st->uid;
+	root_op_context.creds.caller_gid = st->gid;
+
+	while ((ext = glist_first_entry(&st->extents, struct dc_extent,
+					list)) != NULL) {
+		glist_del(&ext->list);
+
+		buf = gsh_malloc(ext->len);
+		n = pread(exp->log_fd, buf, ext->len, ext->log_off);
+		if (n != (ssize_t) ext->len) {
+			status = fsalstat(ERR_FSAL_IO, n < 0 ? errno : 0);
+		} else {
+			wrote = 0;
+			stable = false;
+			dc_pass(exp,
+				status = sub_handle->obj_ops.write2(
+					sub_handle, st->bypass, st->state,
+					ext->offset, ext->len, buf, &wrote,
+					&stable, NULL));
+			if (!FSAL_IS_ERROR(status) && wrote != ext->len)
+				status = fsalstat(ERR_FSAL_IO, 0);
+		}
+
+		if (FSAL_IS_ERROR(status)) {
+			LogInfo(COMPONENT_FSAL,
+				"Destaging %zu bytes at %"PRIu64" failed: %s",
+				ext->len, ext->offset, fsal_err_txt(status));
+			if (!FSAL_IS_ERROR(st->error))
+				st->error = status;
+			(void) atomic_inc_uint32_t(&exp->lost);
+		} else {
+			(void) atomic_add_uint64_t(&exp->stats.destaged,
+						   ext->len);
+		}
+
+		gsh_free(buf);
+		gsh_free(ext);
+	}
+
+	release_root_op_context();
+
+	PTHREAD_MUTEX_lock(&exp->wb_mtx);
+	if (!glist_null(&st->dirty))
+		glist_del(&st->dirty);
+	exp->log_used -= st->len;
+	if (exp->log_used == 0)
+		exp->log_next = 0;
+	PTHREAD_MUTEX_unlock(&exp->wb_mtx);
+
+	*state = st->state;
+	*export = st->export;
+	st->state = NULL;
+	st->export = NULL;
+	st->len = 0;
+	st->end = 0;
+}
+
+static void dc_stage_release(struct state_t *state, struct gsh_export *export)
+{
+	if (state != NULL)
+		dec_state_t_ref(state);
+	if (export != NULL)
+		put_gsh_export(export);
+}
+
+static struct dc_stage *dc_stage_get(struct dc_fsal_export *exp,
+				     struct dc_fsal_obj_handle *hdl)
+{
+	struct dc_stage *st = atomic_fetch_voidptr((void **)&hdl->stage);
+
+	if (st != NULL)
+		return st;
+
+	PTHREAD_MUTEX_lock(&exp->wb_mtx);
+	st = hdl->stage;
+	if (st == NULL) {
+		st = gsh_calloc(1, sizeof(*st));
+		PTHREAD_MUTEX_init(&st->mtx, NULL);
+		st->exp = exp;
+		st->hdl = hdl;
+		glist_init(&st->extents);
+		atomic_store_voidptr((void **)&hdl->stage, st);
+	}
+	PTHREAD_MUTEX_unlock(&exp->wb_mtx);
+
+	return st;
+}
+
+static bool dc_stage_matches(struct dc_stage *st, bool bypass,
+			     struct state_t *state)
+{
+	return st->len == 0 ||
+	       (st->bypass == bypass && st->state == state &&
+		st->export == op_ctx->ctx_export &&
+		st->uid == op_ctx->creds->caller_uid &&
+		st->gid == op_ctx->creds->caller_gid);
+}
+
+/**
+ * @brief Stage an UNSTABLE write
+ *
+ * @param[in] exp     The export
+ * @param[in] hdl     The file
+ * @param[in] bypass  As for write2
+ * @param[in] state   As for write2
+ * @param[in] offset  As for write2
+ * @param[in] size    As for write2
+ * @param[in] buffer  As for write2
+ *
+ * @retval true if the write was staged.
+ * @retval false if it must be written, everything staged before it
+ *         having been.
+ */
+bool dc_stage_write(struct dc_fsal_export *exp,
+		    struct dc_fsal_obj_handle *hdl, bool bypass,
+		    struct state_t *state, uint64_t offset, size_t size,
+		    const void *buffer)
+{
+	struct dc_stage *st = dc_stage_get(exp, hdl);
+	struct state_t *old_state = NULL;
+	struct gsh_export *old_export = NULL;
+	struct dc_extent *ext = NULL;
+	uint64_t log_off = 0;
+	bool staged = false;
+	ssize_t n;
+
+	PTHREAD_MUTEX_lock(&st->mtx);
+
+	if (!dc_stage_matches(st, bypass, state))
+		dc_destage_locked(st, &old_state, &old_export);
+
+	PTHREAD_MUTEX_lock(&exp->wb_mtx);
+	if (exp->log_next + size <= exp->staging_size) {
+		log_off = exp->log_next;
+		exp->log_next += size;
+		exp->log_used += size;
+		staged = true;
+	}
+	PTHREAD_MUTEX_unlock(&exp->wb_mtx);
+
+	if (staged) {
+		n = pwrite(exp->log_fd, buffer, size, log_off);
+		if (n != (ssize_t) size) {
+			LogInfo(COMPONENT_FSAL,
+				"Staging %zu bytes failed: %s",
+				size, n < 0 ? strerror(errno) : "short write");
+			PTHREAD_MUTEX_lock(&exp->wb_mtx);
+			exp->log_used -= size;
+			if (exp->log_used == 0)
+				exp->log_next = 0;
+			PTHREAD_MUTEX_unlock(&exp->wb_mtx);
+			staged = false;
+		}
+	}
+
+	if (!staged) {
+		/* Only if not destaged above, whose references are kept */
+		if (st->len != 0)
+			dc_destage_locked(st, &old_state, &old_export);
+		goto out;
+	}
+
+	if (!glist_empty(&st->extents))
+		ext = glist_entry(st->extents.prev, struct dc_extent, list);
+
+	if (ext != NULL && ext->offset + ext->len == offset &&
+	    ext->log_off + ext->len == log_off &&
+	    ext->len + size <= DC_EXTENT_MAX) {
+		ext->len += size;
+	} else {
+		ext = gsh_malloc(sizeof(*ext));
+		ext->offset = offset;
+		ext->log_off = log_off;
+		ext->len = size;
+		glist_add_tail(&st->extents, &ext->list);
+	}
+
+	if (st->len == 0) {
+		if (state != NULL)
+			inc_state_t_ref(state);
+		get_gsh_export_ref(op_ctx->ctx_export);
+
+		st->bypass = bypass;
+		st->state = state;
+		st->export = op_ctx->ctx_export;
+		st->uid = op_ctx->creds->caller_uid;
+		st->gid = op_ctx->creds->caller_gid;
+		st->nfs_vers = op_ctx->nfs_vers;
+		st->nfs_minorvers = op_ctx->nfs_minorvers;
+
+		PTHREAD_MUTEX_lock(&exp->wb_mtx);
+		if (glist_null(&st->dirty))
+			glist_add_tail(&exp->dirty, &st->dirty);
+		PTHREAD_MUTEX_unlock(&exp->wb_mtx);
+	}
+
+	st->len += size;
+	if (offset + size > st->end)
+		st->end = offset + size;
+	(void) atomic_add_uint64_t(&exp->stats.staged, size);
+
+ out:
+	PTHREAD_MUTEX_unlock(&st->mtx);
+
+	dc_stage_release(old_state, old_export);
+
+	return staged;
+}
+
+/**
+ * @brief Destage a file
+ *
+ * @param[in] hdl    The file
+ * @param[in] reset  Clear the error held for COMMIT
+ *
+ * @return The first error destaging since the last reset.
+ */
+static fsal_status_t dc_destage(struct dc_fsal_obj_handle *hdl, bool reset)
+{
+	struct dc_stage *st = atomic_fetch_voidptr((void **)&hdl->stage);
+	fsal_status_t status = fsalstat(ERR_FSAL_NO_ERROR, 0);
+	struct state_t *state;
+	struct gsh_export *export;
+
+	if (st == NULL)
+		return status;
+
+	PTHREAD_MUTEX_lock(&st->mtx);
+	dc_destage_locked(st, &state, &export);
+	status = st->error;
+	if (reset)
+		st->error = fsalstat(ERR_FSAL_NO_ERROR, 0);
+	PTHREAD_MUTEX_unlock(&st->mtx);
+
+	dc_stage_release(state, export);
+
+	return status;
+}
+
+void dc_stage_flush(struct dc_fsal_obj_handle *hdl)
+{
+	(void) dc_destage(hdl, false);
+}
+
+fsal_status_t dc_stage_commit(struct dc_fsal_obj_handle *hdl)
+{
+	return dc_destage(hdl, true);
+}
+
+/**
+ * @brief Report the size a file will have once destaged
+ *
+ * Attributes are not a reason to destage, else every WRITE followed
+ * by a GETATTR would be written through.  The times and the change
+ * attribute move when the writes are destaged.
+ *
+ * @param[in]     hdl       The file
+ * @param[in,out] filesize  Its size in the sub-FSAL, then with its
+ *                          staged writes
+ */
+void dc_stage_size(struct dc_fsal_obj_handle *hdl, uint64_t *filesize)
+{
+	struct dc_stage *st = atomic_fetch_voidptr((void **)&hdl->stage);
+
+	if (st == NULL)
+		return;
+
+	PTHREAD_MUTEX_lock(&st->mtx);
+	if (st->end > *filesize)
+		*filesize = st->end;
+	PTHREAD_MUTEX_unlock(&st->mtx);
+}
+
+/**
+ * @brief Destage a file and free its stage, as its handle is released
+ *
+ * @param[in] hdl  The file
+ */
+void dc_stage_free(struct dc_fsal_obj_handle *hdl)
+{
+	struct dc_stage *st = hdl->stage;
+	struct dc_fsal_export *exp;
+
+	if (st == NULL)
+		return;
+
+	exp = st->exp;
+	dc_stage_flush(hdl);
+
+	/* The destager may still hold it */
+	PTHREAD_MUTEX_lock(&exp->wb_mtx);
+	while (st->busy != 0)
+		pthread_cond_wait(&exp->wb_cond, &exp->wb_mtx);
+	PTHREAD_MUTEX_unlock(&exp->wb_mtx);
+
+	PTHREAD_MUTEX_destroy(&st->mtx);
+	gsh_free(st);
+	hdl->stage = NULL;
+}
+
+/**
+ * @brief Destage every file with staged writes
+ *
+ * @param[in] exp  The export
+ */
+static void dc_destage_all(struct dc_fsal_export *exp)
+{
+	struct state_t *state;
+	struct gsh_export *export;
+	struct dc_stage *st;
+
+	PTHREAD_MUTEX_lock(&exp->wb_mtx);
+	while ((st = glist_first_entry(&exp->dirty, struct dc_stage,
+				       dirty)) != NULL) {
+		glist_del(&st->dirty);
+		st->busy++;
+		PTHREAD_MUTEX_unlock(&exp->wb_mtx);
+
+		PTHREAD_MUTEX_lock(&st->mtx);
+		dc_destage_locked(st, &state, &export);
+		PTHREAD_MUTEX_unlock(&st->mtx);
+
+		dc_stage_release(state, export);
+
+		PTHREAD_MUTEX_lock(&exp->wb_mtx);
+		if (--st->busy == 0)
+			pthread_cond_broadcast(&exp->wb_cond);
+	}
+	PTHREAD_MUTEX_unlock(&exp->wb_mtx);
+}
+
+static void dc_destager(struct fridgethr_context *ctx)
+{
+	SetNameFunction("dc_destage");
+
+	dc_destage_all(ctx->arg);
+}
+
+/**
+ * @brief Start the write-back of an export
+ *
+ * @param[in] exp    The export, write_back and staging_size set
+ * @param[in] dir    Where to make the staging log
+ * @param[in] delay  Seconds between destages
+ *
+ * @return 0 or an errno.
+ */
+int dc_wb_init(struct dc_fsal_export *exp, const char *dir, uint32_t delay)
+{
+	struct fridgethr_params frp;
+	char *path;
+	int rc;
+
+	exp->log_fd = -1;
+
+	if (!exp->write_back)
+		return 0;
+
+	if (dir == NULL) {
+		LogCrit(COMPONENT_FSAL,
+			"DATACACHE %s: Write_Back needs a Staging_Directory",
+			exp->path);
+		return EINVAL;
+	}
+
+	path = gsh_malloc(strlen(dir) + sizeof("/ganesha.dcXXXXXX"));
+	sprintf(path, "%s/ganesha.dcXXXXXX", dir);
+
+	exp->log_fd = mkstemp(path);
+	if (exp->log_fd < 0) {
+		rc = errno;
+		LogCrit(COMPONENT_FSAL,
+			"DATACACHE %s: could not make a staging log in %s: %s",
+			exp->path, dir, strerror(rc));
+		gsh_free(path);
+		return rc;
+	}
+
+	/* Nothing is read back from it after a restart */
+	(void) unlink(path);
+	gsh_free(path);
+
+	PTHREAD_MUTEX_init(&exp->wb_mtx, NULL);
+	PTHREAD_COND_init(&exp->wb_cond, NULL);
+	glist_init(&exp->dirty);
+
+	memset(&frp, 0, sizeof(frp));
+	frp.thr_max = 1;
+	frp.thr_min = 1;
+	frp.thread_delay = delay;
+	frp.flavor = fridgethr_flavor_looper;
+
+	rc = fridgethr_init(&exp->destager, "dc_destage", &frp);
+	if (rc == 0) {
+		rc = fridgethr_submit(exp->destager, dc_destager, exp);
+		if (rc != 0)
+			fridgethr_destroy(exp->destager);
+	}
+
+	if (rc != 0) {
+		LogCrit(COMPONENT_FSAL,
+			"DATACACHE %s: could not start the destager: %d",
+			exp->path, rc);
+		exp->destager = NULL;
+		close(exp->log_fd);
+		exp->log_fd = -1;
+		PTHREAD_COND_destroy(&exp->wb_cond);
+		PTHREAD_MUTEX_destroy(&exp->wb_mtx);
+		return rc;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Stop the write-back of an export, destaging what is left
+ *
+ * @param[in] exp  The export
+ */
+void dc_wb_fini(struct dc_fsal_export *exp)
+{
+	int rc;
+
+	if (exp->log_fd < 0)
+		return;
+
+	if (exp->destager != NULL) {
+		rc = fridgethr_sync_command(exp->destager,
+					    fridgethr_comm_stop, 120);
+		if (rc == ETIMEDOUT) {
+			LogMajor(COMPONENT_FSAL,
+				 "Shutdown timed out, cancelling threads.");
+			fridgethr_cancel(exp->destager);
+		} else if (rc != 0) {
+			LogMajor(COMPONENT_FSAL,
+				 "Failed shutting down the destager: %d", rc);
+		}
+		fridgethr_destroy(exp->destager);
+		exp->destager = NULL;
+	}
+
+	dc_destage_all(exp);
+
+	LogInfo(COMPONENT_FSAL,
+		"DATACACHE %s: %"PRIu64" bytes staged, %"PRIu64
+		" destaged, %"PRIu32" destages failed",
+		exp->path,
+		atomic_fetch_uint64_t(&exp->stats.staged),
+		atomic_fetch_uint64_t(&exp->stats.destaged),
+		atomic_fetch_uint32_t(&exp->lost));
+
+	close(exp->log_fd);
+	exp->log_fd = -1;
+	PTHREAD_COND_destroy(&exp->wb_cond);
+	PTHREAD_MUTEX_destroy(&exp->wb_mtx);
+}
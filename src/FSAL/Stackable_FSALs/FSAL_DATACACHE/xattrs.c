@@ -0,0 +1,246 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/* xattrs.c
+ * DATACACHE FSAL extended attribute methods
+ */
+
+#include "config.h"
+
+#include "fsal.h"
+#include "FSAL/fsal_commonlib.h"
+#include "datacache_methods.h"
+
+static fsal_status_t list_ext_attrs(struct fsal_obj_handle *obj_hdl,
+				    unsigned int argcookie,
+				    struct fsal_xattrent *xattrs_tab,
+				    unsigned int xattrs_tabsize,
+				    unsigned int *p_nb_returned,
+				    int *end_of_list)
+{
+	struct dc_fsal_export *exp = dc_export();
+	struct fsal_obj_handle *sub_handle = dc_sub(obj_hdl);
+	fsal_status_t status;
+
+	dc_pass(exp,
+		status = sub_handle->obj_ops.list_ext_attrs(sub_handle,
+							    argcookie,
+							    xattrs_tab,
+							    xattrs_tabsize,
+							    p_nb_returned,
+							    end_of_list));
+
+	return status;
+}
+
+static fsal_status_t getextattr_id_by_name(struct fsal_obj_handle *obj_hdl,
+					   const char *xattr_name,
+					   unsigned int *pxattr_id)
+{
+	struct dc_fsal_export *exp = dc_export();
+	struct fsal_obj_handle *sub_handle = dc_sub(obj_hdl);
+	fsal_status_t status;
+
+	dc_pass(exp,
+		status = sub_handle->obj_ops.getextattr_id_by_name(
+			sub_handle, xattr_name, pxattr_id));
+
+	return status;
+}
+
+static fsal_status_t getextattr_value_by_name(struct fsal_obj_handle *obj_hdl,
+					      const char *xattr_name,
+					      caddr_t buffer_addr,
+					      size_t buffer_size,
+					      size_t *p_output_size)
+{
+	struct dc_fsal_export *exp = dc_export();
+	struct fsal_obj_handle *sub_handle = dc_sub(obj_hdl);
+	fsal_status_t status;
+
+	dc_pass(exp,
+		status = sub_handle->obj_ops.getextattr_value_by_name(
+			sub_handle, xattr_name, buffer_addr, buffer_size,
+			p_output_size));
+
+	return status;
+}
+
+static fsal_status_t getextattr_value_by_id(struct fsal_obj_handle *obj_hdl,
+					    unsigned int xattr_id,
+					    caddr_t buffer_addr,
+					    size_t buffer_size,
+					    size_t *p_output_size)
+{
+	struct dc_fsal_export *exp = dc_export();
+	struct fsal_obj_handle *sub_handle = dc_sub(obj_hdl);
+	fsal_status_t status;
+
+	dc_pass(exp,
+		status = sub_handle->obj_ops.getextattr_value_by_id(
+			sub_handle, xattr_id, buffer_addr, buffer_size,
+			p_output_size));
+
+	return status;
+}
+
+static fsal_status_t setextattr_value(struct fsal_obj_handle *obj_hdl,
+				      const char *xattr_name,
+				      caddr_t buffer_addr, size_t buffer_size,
+				      int create)
+{
+	struct dc_fsal_export *exp = dc_export();
+	struct fsal_obj_handle *sub_handle = dc_sub(obj_hdl);
+	fsal_status_t status;
+
+	dc_pass(exp,
+		status = sub_handle->obj_ops.setextattr_value(
+			sub_handle, xattr_name, buffer_addr, buffer_size,
+			create));
+
+	return status;
+}
+
+static fsal_status_t setextattr_value_by_id(struct fsal_obj_handle *obj_hdl,
+					    unsigned int xattr_id,
+					    caddr_t buffer_addr,
+					    size_t buffer_size)
+{
+	struct dc_fsal_export *exp = dc_export();
+	struct fsal_obj_handle *sub_handle = dc_sub(obj_hdl);
+	fsal_status_t status;
+
+	dc_pass(exp,
+		status = sub_handle->obj_ops.setextattr_value_by_id(
+			sub_handle, xattr_id, buffer_addr, buffer_size));
+
+	return status;
+}
+
+static fsal_status_t remove_extattr_by_id(struct fsal_obj_handle *obj_hdl,
+					  unsigned int xattr_id)
+{
+	struct dc_fsal_export *exp = dc_export();
+	struct fsal_obj_handle *sub_handle = dc_sub(obj_hdl);
+	fsal_status_t status;
+
+	dc_pass(exp,
+		status = sub_handle->obj_ops.remove_extattr_by_id(sub_handle,
+								  xattr_id));
+
+	return status;
+}
+
+static fsal_status_t remove_extattr_by_name(struct fsal_obj_handle *obj_hdl,
+					    const char *xattr_name)
+{
+	struct dc_fsal_export *exp = dc_export();
+	struct fsal_obj_handle *sub_handle = dc_sub(obj_hdl);
+	fsal_status_t status;
+
+	dc_pass(exp,
+		status = sub_handle->obj_ops.remove_extattr_by_name(
+			sub_handle, xattr_name));
+
+	return status;
+}
+
+static fsal_status_t getxattrs(struct fsal_obj_handle *obj_hdl,
+			       xattrname4 *xa_name,
+			       xattrvalue4 *xa_value)
+{
+	struct dc_fsal_export *exp = dc_export();
+	struct fsal_obj_handle *sub_handle = dc_sub(obj_hdl);
+	fsal_status_t status;
+
+	dc_pass(exp,
+		status = sub_handle->obj_ops.getxattrs(sub_handle, xa_name,
+						       xa_value));
+
+	return status;
+}
+
+static fsal_status_t setxattrs(struct fsal_obj_handle *obj_hdl,
+			       setxattr_type4 sa_type,
+			       xattrname4 *xa_name,
+			       xattrvalue4 *xa_value)
+{
+	struct dc_fsal_export *exp = dc_export();
+	struct fsal_obj_handle *sub_handle = dc_sub(obj_hdl);
+	fsal_status_t status;
+
+	dc_pass(exp,
+		status = sub_handle->obj_ops.setxattrs(sub_handle, sa_type,
+						       xa_name, xa_value));
+
+	return status;
+}
+
+static fsal_status_t removexattrs(struct fsal_obj_handle *obj_hdl,
+				  xattrname4 *xa_name)
+{
+	struct dc_fsal_export *exp = dc_export();
+	struct fsal_obj_handle *sub_handle = dc_sub(obj_hdl);
+	fsal_status_t status;
+
+	dc_pass(exp,
+		status = sub_handle->obj_ops.removexattrs(sub_handle,
+							  xa_name));
+
+	return status;
+}
+
+static fsal_status_t listxattrs(struct fsal_obj_handle *obj_hdl,
+				count4 la_maxcount,
+				nfs_cookie4 *la_cookie,
+				verifier4 *la_cookieverf,
+				bool_t *lr_eof,
+				xattrlist4 *lr_names)
+{
+	struct dc_fsal_export *exp = dc_export();
+	struct fsal_obj_handle *sub_handle = dc_sub(obj_hdl);
+	fsal_status_t status;
+
+	dc_pass(exp,
+		status = sub_handle->obj_ops.listxattrs(sub_handle,
+							la_maxcount,
+							la_cookie,
+							la_cookieverf,
+							lr_eof, lr_names));
+
+	return status;
+}
+
+void dc_xattr_ops_init(struct fsal_obj_ops *ops)
+{
+	ops->list_ext_attrs = list_ext_attrs;
+	ops->getextattr_id_by_name = getextattr_id_by_name;
+	ops->getextattr_value_by_name = getextattr_value_by_name;
+	ops->getextattr_value_by_id = getextattr_value_by_id;
+	ops->setextattr_value = setextattr_value;
+	ops->setextattr_value_by_id = setextattr_value_by_id;
+	ops->remove_extattr_by_id = remove_extattr_by_id;
+	ops->remove_extattr_by_name = remove_extattr_by_name;
+	ops->getxattrs = getxattrs;
+	ops->setxattrs = setxattrs;
+	ops->removexattrs = removexattrs;
+	ops->listxattrs = listxattrs;
+}
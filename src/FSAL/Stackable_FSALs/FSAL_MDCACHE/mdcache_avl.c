@@ -43,6 +43,7 @@
 #include "fsal.h"
 #include "mdcache_int.h"
 #include "mdcache_avl.h"
+#include "mdcache_lru.h"
 #include "murmur3.h"
 #include "city.h"
 
@@ -152,8 +153,13 @@ mdcache_avl_insert_impl(mdcache_entry_t *entry, mdcache_dir_entry_t *v,
 		   avltree_container_of(node, mdcache_dir_entry_t, node_hk);
 
 		avltree_remove(node, c);
+		if (dirent->chunk) {
+			/* its cookie no longer leads anywhere */
+			glist_del(&dirent->chunk_list);
+			dirent->chunk->num_entries--;
+		}
 		/* Don't need to free ckey; it was freed when marked deleted */
-		gsh_free(dirent);
+		mdcache_dirent_free(dirent);
 		node = NULL;
 	}
 
@@ -182,6 +188,34 @@ mdcache_avl_insert_impl(mdcache_entry_t *entry, mdcache_dir_entry_t *v,
 
 #define MIN_COOKIE_VAL 3
 
+/**
+ * @brief Hash a name to its first-choice cookie
+ *
+ * @param[in] name The name
+ *
+ * @return The unprobed cookie of name.
+ */
+uint64_t mdcache_avl_name_hash(const char *name)
+{
+	uint64_t k;
+#if AVL_HASH_MURMUR3
+	uint32_t hk[4];
+
+	MurmurHash3_x64_128(name, strlen(name), 67, hk);
+	memcpy(&k, hk, 8);
+#else
+	k = CityHash64WithSeed(name, strlen(name), 67);
+#endif
+
+#ifdef _USE_9P
+	/* tmp hook : it seems like client running v9fs dislike "negative"
+	 * cookies just kill the sign bit, making
+	 * cookies 63 bits... */
+	k &= ~(1ULL << 63);
+#endif
+	return k;
+}
+
 /*
  * Insert with quadatic, linear probing.  A unique k is assured for
  * any k whenever size(t) < max(uint64_t).
@@ -212,10 +246,6 @@ int
 mdcache_avl_qp_insert(mdcache_entry_t *entry, mdcache_dir_entry_t **dirent)
 {
 	mdcache_dir_entry_t *v = *dirent, *v2;
-
-#if AVL_HASH_MURMUR3
-	uint32_t hk[4];
-#endif
 	int j, j2, code = -1;
 
 	LogFullDebug(COMPONENT_CACHE_INODE,
@@ -223,19 +253,7 @@ mdcache_avl_qp_insert(mdcache_entry_t *entry, mdcache_dir_entry_t **dirent)
 		     v, v->name);
 
 	/* don't permit illegal cookies */
-#if AVL_HASH_MURMUR3
-	MurmurHash3_x64_128(v->name, strlen(v->name), 67, hk);
-	memcpy(&v->hk.k, hk, 8);
-#else
-	v->hk.k = CityHash64WithSeed(v->name, strlen(v->name), 67);
-#endif
-
-#ifdef _USE_9P
-	/* tmp hook : it seems like client running v9fs dislike "negative"
-	 * cookies just kill the sign bit, making
-	 * cookies 63 bits... */
-	v->hk.k &= ~(1ULL << 63);
-#endif
+	v->hk.k = mdcache_avl_name_hash(v->name);
 
 	/* XXX would we really wait for UINT64_MAX?  if not, how many
 	 * probes should we attempt? */
@@ -304,7 +322,7 @@ mdcache_avl_qp_insert(mdcache_entry_t *entry, mdcache_dir_entry_t **dirent)
 out:
 
 	mdcache_key_delete(&v->ckey);
-	gsh_free(v);
+	mdcache_dirent_free(v);
 	*dirent = v2;
 
 	return code;
@@ -358,36 +376,48 @@ out:
 	return dirent;
 }
 
+/**
+ * @brief Find the dirent with a cookie, active or deleted
+ *
+ * @param[in] entry The directory
+ * @param[in] k     The cookie
+ *
+ * @return The dirent or NULL.
+ */
+mdcache_dir_entry_t *
+mdcache_avl_lookup_ck(mdcache_entry_t *entry, uint64_t k)
+{
+	mdcache_dir_entry_t dirent_key[1];
+	struct avltree_node *node;
+
+	dirent_key->hk.k = k;
+
+	node = avltree_inline_lookup(&dirent_key->node_hk,
+				     &entry->fsobj.fsdir.avl.t);
+	if (!node)
+		node = avltree_inline_lookup(&dirent_key->node_hk,
+					     &entry->fsobj.fsdir.avl.c);
+	if (!node)
+		return NULL;
+
+	return avltree_container_of(node, mdcache_dir_entry_t, node_hk);
+}
+
 mdcache_dir_entry_t *
 mdcache_avl_qp_lookup_s(mdcache_entry_t *entry, const char *name, int maxj)
 {
 	struct avltree *t = &entry->fsobj.fsdir.avl.t;
 	struct avltree_node *node;
 	mdcache_dir_entry_t *v2;
-#if AVL_HASH_MURMUR3
-	uint32_t hashbuff[4];
-#endif
 	int j;
-	size_t namelen = strlen(name);
 	mdcache_dir_entry_t v;
 
 	LogFullDebug(COMPONENT_CACHE_INODE, "Lookup %s", name);
 
-#if AVL_HASH_MURMUR3
-	MurmurHash3_x64_128(name, namelen, 67, hashbuff);
-	/* This seems to be correct.  The avltree_lookup function looks
-	   as hk.k, but does no namecmp on its own, so there's no need to
-	   allocate space for or copy the name in the key. */
-	memcpy(&v.hk.k, hashbuff, 8);
-#else
-	v.hk.k = CityHash64WithSeed(name, namelen, 67);
-#endif
-
-#ifdef _USE_9P
-	/* tmp hook : it seems like client running v9fs dislike "negative"
-	 * cookies */
-	v.hk.k &= ~(1ULL << 63);
-#endif
+	/* The avltree_lookup function looks at hk.k, but does no namecmp
+	   on its own, so there's no need to allocate space for or copy
+	   the name in the key. */
+	v.hk.k = mdcache_avl_name_hash(name);
 
 	for (j = 0; j < maxj; j++) {
 		v.hk.k = (v.hk.k + (j * 2));
@@ -427,7 +457,7 @@ void mdcache_avl_clean_tree(struct avltree *tree)
 		avltree_remove(dirent_node, tree);
 		if (dirent->ckey.kv.len)
 			mdcache_key_delete(&dirent->ckey);
-		gsh_free(dirent);
+		mdcache_dirent_free(dirent);
 	}
 }
 
@@ -75,6 +75,7 @@ static inline int avl_dirent_hk_cmpf(const struct avltree_node *lhs,
 
 void avl_dirent_set_deleted(mdcache_entry_t *entry, mdcache_dir_entry_t *v);
 void mdcache_avl_init(mdcache_entry_t *entry);
+uint64_t mdcache_avl_name_hash(const char *name);
 int mdcache_avl_qp_insert(mdcache_entry_t *entry, mdcache_dir_entry_t **dirent);
 
 #define MDCACHE_FLAG_NONE        0x0000
@@ -83,10 +84,36 @@ int mdcache_avl_qp_insert(mdcache_entry_t *entry, mdcache_dir_entry_t **dirent);
 
 mdcache_dir_entry_t *mdcache_avl_lookup_k(mdcache_entry_t *entry, uint64_t k,
 					  uint32_t flags);
+mdcache_dir_entry_t *mdcache_avl_lookup_ck(mdcache_entry_t *entry,
+					   uint64_t k);
 mdcache_dir_entry_t *mdcache_avl_qp_lookup_s(mdcache_entry_t *entry,
 					     const char *name, int maxj);
 void mdcache_avl_clean_tree(struct avltree *tree);
 
+/** Largest handle of a packed directory */
+#define MDCACHE_DIRPACK_KEY_MAX 128
+
+/**
+ * @brief A dirent decoded from a packed directory
+ */
+struct mdcache_dirpack_ent {
+	uint64_t cookie;
+	mdcache_key_t ckey;	/*< Its kv.addr is key */
+	char name[NAME_MAX + 1];
+	uint8_t key[MDCACHE_DIRPACK_KEY_MAX];
+};
+
+void mdcache_dirpack_build(mdcache_entry_t *dir);
+void mdcache_dirpack_expand(mdcache_entry_t *dir);
+void mdcache_dirpack_free(mdcache_entry_t *dir);
+bool mdcache_dirpack_lookup_s(mdcache_entry_t *dir, const char *name,
+			      struct mdcache_dirpack_ent *ent);
+bool mdcache_dirpack_seek(mdcache_entry_t *dir, uint64_t cookie,
+			  uint32_t *pos);
+uint32_t mdcache_dirpack_count(mdcache_entry_t *dir);
+void mdcache_dirpack_get(mdcache_entry_t *dir, uint32_t pos,
+			 struct mdcache_dirpack_ent *ent);
+
 #endif				/* MDCACHE_AVL_H */
 
 /** @} */
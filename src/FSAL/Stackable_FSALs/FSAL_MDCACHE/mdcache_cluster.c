@@ -0,0 +1,546 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/**
+ * @addtogroup FSAL_MDCACHE
+ * @{
+ */
+
+/**
+ * @file  mdcache_cluster.c
+ * @brief Invalidate the caches of the other heads of a cluster
+ *
+ * When Cluster_Invalidate_Group is set, the entries changed by writes,
+ * setattrs and namespace operations through this head are multicast
+ * to the group, and the invalidations other heads send are applied as
+ * if the FSAL had made an invalidate upcall.  This only makes sense
+ * for heads exporting the same filesystem with the same export IDs,
+ * through an FSAL whose keys are the same on every head.
+ *
+ * Invalidations are queued, merged per entry, and sent in as few
+ * datagrams as fit by a sender thread.  Datagrams are numbered: a head
+ * missing one from a peer, lost or never sent because the queue was
+ * full, no longer trusts anything it has cached.
+ */
+
+#include "config.h"
+#include <unistd.h>
+#include <limits.h>
+#include <endian.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "fsal.h"
+#include "fridgethr.h"
+#include "export_mgr.h"
+#include "city.h"
+#include "mdcache_int.h"
+
+#define MDC_CLUSTER_MAGIC 0x4d444349	/* "MDCI" */
+/* Fits an Ethernet frame */
+#define MDC_CLUSTER_DGRAM 1400
+/* Longer keys are not sent, peers see a gap instead */
+#define MDC_CLUSTER_KEY_MAX 512
+#define MDC_CLUSTER_PENDING 4096
+#define MDC_CLUSTER_BUCKETS 256
+#define MDC_CLUSTER_PEERS 64
+
+/**
+ * @brief Datagram header, in network order, followed by the records
+ */
+struct mdc_cluster_hdr {
+	uint32_t magic;
+	uint32_t seq;
+	uint64_t sender;
+	uint16_t count;
+	uint16_t reserved;	/*< 0 */
+} __attribute__((__packed__));
+
+/**
+ * @brief Record of one invalidation, in network order, followed by the key
+ */
+struct mdc_cluster_rec {
+	uint16_t export_id;
+	uint16_t key_len;
+	uint32_t flags;		/*< FSAL_UP_INVALIDATE_* */
+} __attribute__((__packed__));
+
+/**
+ * @brief An invalidation waiting to be sent
+ */
+struct mdc_cluster_inval {
+	struct glist_head list;
+	struct mdc_cluster_inval *next;	/*< In its bucket */
+	uint64_t hk;
+	uint16_t export_id;
+	uint16_t key_len;
+	uint32_t flags;
+	char key[];
+};
+
+/**
+ * @brief Last datagram seen from a peer
+ */
+struct mdc_cluster_peer {
+	uint64_t sender;
+	uint32_t seq;
+};
+
+static struct fridgethr *cluster_fridge;
+static int cluster_sock = -1;
+static struct sockaddr_in cluster_addr;
+static uint64_t cluster_sender;
+static uint32_t cluster_seq;
+
+static pthread_mutex_t cluster_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cluster_cv = PTHREAD_COND_INITIALIZER;
+static struct glist_head cluster_pending = GLIST_HEAD_INIT(cluster_pending);
+static struct mdc_cluster_inval *cluster_buckets[MDC_CLUSTER_BUCKETS];
+static uint32_t cluster_npending;
+static bool cluster_dropped;	/*< Invalidations were not queued */
+
+/* Only used by the receiver */
+static struct mdc_cluster_peer cluster_peers[MDC_CLUSTER_PEERS];
+static uint32_t cluster_npeers;
+
+/**
+ * @brief Queue an invalidation of an entry for the other heads
+ *
+ * @note Must be called with op_ctx set, after the change was made.
+ *
+ * @param[in] entry  The entry changed
+ * @param[in] flags  FSAL_UP_INVALIDATE_* the peers should apply
+ */
+void _mdc_cluster_invalidate(mdcache_entry_t *entry, uint32_t flags)
+{
+	mdcache_key_t *key = &entry->fh_hk.key;
+	struct mdc_cluster_inval *inval;
+	uint16_t export_id;
+	uint32_t bucket;
+
+	if (cluster_sock < 0 || op_ctx == NULL || op_ctx->ctx_export == NULL)
+		return;
+
+	export_id = op_ctx->ctx_export->export_id;
+	bucket = (key->hk ^ export_id) % MDC_CLUSTER_BUCKETS;
+
+	PTHREAD_MUTEX_lock(&cluster_mtx);
+
+	for (inval = cluster_buckets[bucket]; inval != NULL;
+	     inval = inval->next) {
+		if (inval->hk == key->hk && inval->export_id == export_id &&
+		    inval->key_len == key->kv.len &&
+		    memcmp(inval->key, key->kv.addr, key->kv.len) == 0) {
+			inval->flags |= flags;
+			PTHREAD_MUTEX_unlock(&cluster_mtx);
+			return;
+		}
+	}
+
+	if (key->kv.len > MDC_CLUSTER_KEY_MAX ||
+	    cluster_npending >= MDC_CLUSTER_PENDING) {
+		cluster_dropped = true;
+		goto wake;
+	}
+
+	inval = gsh_malloc(sizeof(*inval) + key->kv.len);
+	inval->hk = key->hk;
+	inval->export_id = export_id;
+	inval->key_len = key->kv.len;
+	inval->flags = flags;
+	memcpy(inval->key, key->kv.addr, key->kv.len);
+	inval->next = cluster_buckets[bucket];
+	cluster_buckets[bucket] = inval;
+	glist_add_tail(&cluster_pending, &inval->list);
+	cluster_npending++;
+
+ wake:
+	if (cluster_npending == 1 || cluster_dropped)
+		pthread_cond_signal(&cluster_cv);
+	PTHREAD_MUTEX_unlock(&cluster_mtx);
+}
+
+static void cluster_send(char *buf, size_t len, uint16_t count)
+{
+	struct mdc_cluster_hdr *hdr = (struct mdc_cluster_hdr *)buf;
+
+	hdr->magic = htonl(MDC_CLUSTER_MAGIC);
+	hdr->seq = htonl(++cluster_seq);
+	hdr->sender = htobe64(cluster_sender);
+	hdr->count = htons(count);
+	hdr->reserved = 0;
+
+	if (sendto(cluster_sock, buf, len, 0,
+		   (struct sockaddr *)&cluster_addr,
+		   sizeof(cluster_addr)) < 0)
+		LogDebug(COMPONENT_CACHE_INODE,
+			 "Could not send cluster invalidations: %s",
+			 strerror(errno));
+}
+
+/**
+ * @brief Send the queued invalidations, packed into datagrams
+ */
+static void cluster_sender_thread(struct fridgethr_context *ctx)
+{
+	char buf[MDC_CLUSTER_DGRAM];
+	struct glist_head batch;
+	struct mdc_cluster_inval *inval;
+	struct mdc_cluster_rec rec;
+	struct timespec ts;
+	size_t len;
+	uint16_t count;
+	bool dropped;
+
+	SetNameFunction("mdc_clsend");
+	glist_init(&batch);
+
+	while (!fridgethr_you_should_break(ctx)) {
+		PTHREAD_MUTEX_lock(&cluster_mtx);
+		if (cluster_npending == 0 && !cluster_dropped) {
+			clock_gettime(CLOCK_REALTIME, &ts);
+			ts.tv_sec++;
+			(void) pthread_cond_timedwait(&cluster_cv,
+						      &cluster_mtx, &ts);
+		}
+		glist_splice_tail(&batch, &cluster_pending);
+		memset(cluster_buckets, 0, sizeof(cluster_buckets));
+		cluster_npending = 0;
+		dropped = cluster_dropped;
+		cluster_dropped = false;
+		PTHREAD_MUTEX_unlock(&cluster_mtx);
+
+		/* Skipping a number has the peers drop everything */
+		if (dropped)
+			cluster_seq++;
+
+		len = sizeof(struct mdc_cluster_hdr);
+		count = 0;
+		while ((inval = glist_first_entry(&batch,
+						  struct mdc_cluster_inval,
+						  list)) != NULL) {
+			if (len + sizeof(rec) + inval->key_len > sizeof(buf)) {
+				cluster_send(buf, len, count);
+				len = sizeof(struct mdc_cluster_hdr);
+				count = 0;
+			}
+			rec.export_id = htons(inval->export_id);
+			rec.key_len = htons(inval->key_len);
+			rec.flags = htonl(inval->flags);
+			memcpy(buf + len, &rec, sizeof(rec));
+			memcpy(buf + len + sizeof(rec), inval->key,
+			       inval->key_len);
+			len += sizeof(rec) + inval->key_len;
+			count++;
+
+			glist_del(&inval->list);
+			gsh_free(inval);
+		}
+
+		/* An empty one still shows the gap */
+		if (count != 0 || dropped)
+			cluster_send(buf, len, count);
+	}
+}
+
+static bool cluster_untrust_export(struct gsh_export *export, void *state)
+{
+	struct mdcache_fsal_export *exp;
+	struct entry_export_map *expmap;
+	struct glist_head *glist;
+
+	/* A Lazy_Init export not created has nothing cached */
+	if (export->fsal_export == NULL)
+		return true;
+
+	exp = mdc_export(export->fsal_export);
+
+	PTHREAD_RWLOCK_rdlock(&exp->mdc_exp_lock);
+	glist_for_each(glist, &exp->entry_list) {
+		expmap = glist_entry(glist, struct entry_export_map,
+				     entry_per_export);
+		atomic_clear_uint32_t_bits(&expmap->entry->mde_flags,
+					   FSAL_UP_INVALIDATE_CACHE);
+	}
+	PTHREAD_RWLOCK_unlock(&exp->mdc_exp_lock);
+
+	return true;
+}
+
+/**
+ * @brief Check the number of a datagram from a peer
+ *
+ * @return false if datagrams from it were missed.
+ */
+static bool cluster_peer_seq(uint64_t sender, uint32_t seq)
+{
+	struct mdc_cluster_peer *peer;
+	uint32_t ix;
+	bool ok;
+
+	for (ix = 0; ix < cluster_npeers; ix++) {
+		peer = &cluster_peers[ix];
+		if (peer->sender == sender) {
+			ok = seq == peer->seq + 1;
+			peer->seq = seq;
+			return ok;
+		}
+	}
+
+	/* A new peer, or one that restarted; evict the first if full */
+	if (cluster_npeers < MDC_CLUSTER_PEERS)
+		ix = cluster_npeers++;
+	else
+		ix = 0;
+	cluster_peers[ix].sender = sender;
+	cluster_peers[ix].seq = seq;
+	return true;
+}
+
+static void cluster_apply(struct mdc_cluster_rec *rec, char *key)
+{
+	struct gsh_buffdesc desc = { .addr = key, .len = rec->key_len };
+	struct mdcache_fsal_export *exp;
+	struct gsh_export *export;
+
+	export = get_gsh_export(rec->export_id);
+	if (export == NULL)
+		return;
+
+	if (export->fsal_export == NULL) {
+		put_gsh_export(export);
+		return;
+	}
+
+	exp = mdc_export(export->fsal_export);
+	(void) exp->up_ops.invalidate(&exp->export, &desc,
+				      rec->flags & FSAL_UP_INVALIDATE_CACHE);
+	put_gsh_export(export);
+}
+
+/**
+ * @brief Apply the invalidations of the other heads
+ */
+static void cluster_receiver_thread(struct fridgethr_context *ctx)
+{
+	char buf[MDC_CLUSTER_DGRAM];
+	struct mdc_cluster_hdr hdr;
+	struct mdc_cluster_rec rec;
+	ssize_t len;
+	size_t off;
+	uint16_t count;
+
+	SetNameFunction("mdc_clrecv");
+
+	while (!fridgethr_you_should_break(ctx)) {
+		/* Times out every second */
+		len = recv(cluster_sock, buf, sizeof(buf), 0);
+		if (len < (ssize_t)sizeof(hdr))
+			continue;
+
+		memcpy(&hdr, buf, sizeof(hdr));
+		if (ntohl(hdr.magic) != MDC_CLUSTER_MAGIC ||
+		    be64toh(hdr.sender) == cluster_sender)
+			continue;
+
+		if (!cluster_peer_seq(be64toh(hdr.sender), ntohl(hdr.seq))) {
+			LogInfo(COMPONENT_CACHE_INODE,
+				"Missed invalidations from a peer, no longer trusting the cache");
+			(void) foreach_gsh_export(cluster_untrust_export,
+						  NULL);
+		}
+
+		off = sizeof(hdr);
+		for (count = ntohs(hdr.count); count > 0; count--) {
+			if (off + sizeof(rec) > len)
+				break;
+			memcpy(&rec, buf + off, sizeof(rec));
+			rec.export_id = ntohs(rec.export_id);
+			rec.key_len = ntohs(rec.key_len);
+			rec.flags = ntohl(rec.flags);
+			off += sizeof(rec);
+			if (rec.key_len == 0 || off + rec.key_len > len)
+				break;
+			cluster_apply(&rec, buf + off);
+			off += rec.key_len;
+		}
+	}
+}
+
+static int cluster_socket(void)
+{
+	struct ip_mreq mreq;
+	struct timeval tv = { 1, 0 };
+	unsigned char ttl = 1, loop = 0;
+	int one = 1;
+	int fd;
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0)
+		return -errno;
+
+	memset(&mreq, 0, sizeof(mreq));
+	mreq.imr_multiaddr = cluster_addr.sin_addr;
+	mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) ||
+	    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) ||
+	    bind(fd, (struct sockaddr *)&cluster_addr,
+		 sizeof(cluster_addr)) ||
+	    setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq,
+		       sizeof(mreq)) ||
+	    setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) ||
+	    setsockopt(fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop,
+		       sizeof(loop))) {
+		one = errno;
+		close(fd);
+		return -one;
+	}
+
+	return fd;
+}
+
+/**
+ * @brief Join the invalidation group and start its threads
+ *
+ * @return FSAL status
+ */
+fsal_status_t mdcache_cluster_pkginit(void)
+{
+	struct fridgethr_params frp;
+	struct {
+		char host[HOST_NAME_MAX + 1];
+		pid_t pid;
+		struct timespec ts;
+	} seed;
+	int code;
+
+	if (mdcache_param.cluster_group == NULL)
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+	memset(&cluster_addr, 0, sizeof(cluster_addr));
+	cluster_addr.sin_family = AF_INET;
+	cluster_addr.sin_port = htons(mdcache_param.cluster_port);
+	if (inet_pton(AF_INET, mdcache_param.cluster_group,
+		      &cluster_addr.sin_addr) != 1 ||
+	    !IN_MULTICAST(ntohl(cluster_addr.sin_addr.s_addr))) {
+		LogCrit(COMPONENT_CACHE_INODE,
+			"Cluster_Invalidate_Group %s is not an IPv4 multicast address",
+			mdcache_param.cluster_group);
+		return fsalstat(ERR_FSAL_INVAL, EINVAL);
+	}
+
+	/* Tells our datagrams apart from those of other heads */
+	memset(&seed, 0, sizeof(seed));
+	(void) gethostname(seed.host, sizeof(seed.host) - 1);
+	seed.pid = getpid();
+	clock_gettime(CLOCK_REALTIME, &seed.ts);
+	cluster_sender = CityHash64((char *)&seed, sizeof(seed));
+
+	code = cluster_socket();
+	if (code < 0) {
+		LogCrit(COMPONENT_CACHE_INODE,
+			"Unable to join cluster invalidation group %s:%"
+			PRIu16 ": %s", mdcache_param.cluster_group,
+			mdcache_param.cluster_port, strerror(-code));
+		return fsalstat(posix2fsal_error(-code), -code);
+	}
+	cluster_sock = code;
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = 2;
+	frp.deferment = fridgethr_defer_fail;
+
+	code = fridgethr_init(&cluster_fridge, "MDC_cluster", &frp);
+	if (code != 0) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Unable to initialize cluster invalidation fridge, error code %d.",
+			 code);
+		goto fail;
+	}
+
+	code = fridgethr_submit(cluster_fridge, cluster_receiver_thread, NULL);
+	if (code == 0)
+		code = fridgethr_submit(cluster_fridge, cluster_sender_thread,
+					NULL);
+	if (code != 0) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Unable to start cluster invalidation threads, error code %d.",
+			 code);
+		goto fail;
+	}
+
+	LogInfo(COMPONENT_CACHE_INODE,
+		"Sending and receiving invalidations on %s:%" PRIu16,
+		mdcache_param.cluster_group, mdcache_param.cluster_port);
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+ fail:
+	/* Nothing is queued while the socket is closed */
+	close(cluster_sock);
+	cluster_sock = -1;
+	return fsalstat(posix2fsal_error(code), code);
+}
+
+/**
+ * @brief Stop the invalidation threads and leave the group
+ *
+ * @return FSAL status
+ */
+fsal_status_t mdcache_cluster_pkgshutdown(void)
+{
+	struct mdc_cluster_inval *inval;
+	int rc = 0;
+
+	if (cluster_fridge != NULL) {
+		rc = fridgethr_sync_command(cluster_fridge,
+					    fridgethr_comm_stop, 120);
+		if (rc == ETIMEDOUT) {
+			LogMajor(COMPONENT_CACHE_INODE,
+				 "Shutdown timed out, cancelling threads.");
+			fridgethr_cancel(cluster_fridge);
+		} else if (rc != 0) {
+			LogMajor(COMPONENT_CACHE_INODE,
+				 "Failed shutting down cluster invalidation threads: %d",
+				 rc);
+		}
+	}
+
+	if (cluster_sock >= 0) {
+		close(cluster_sock);
+		cluster_sock = -1;
+	}
+
+	PTHREAD_MUTEX_lock(&cluster_mtx);
+	while ((inval = glist_first_entry(&cluster_pending,
+					  struct mdc_cluster_inval,
+					  list)) != NULL) {
+		glist_del(&inval->list);
+		gsh_free(inval);
+	}
+	memset(cluster_buckets, 0, sizeof(cluster_buckets));
+	cluster_npending = 0;
+	PTHREAD_MUTEX_unlock(&cluster_mtx);
+
+	return fsalstat(posix2fsal_error(rc), rc);
+}
+
+/** @} */
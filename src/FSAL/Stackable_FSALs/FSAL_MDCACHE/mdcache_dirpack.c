@@ -0,0 +1,456 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/**
+ * @addtogroup FSAL_MDCACHE
+ * @{
+ */
+
+/**
+ * @file  mdcache_dirpack.c
+ * @brief Packed dirents of large, fully cached directories
+ *
+ * Once a whole directory of at least Dir_Pack_Threshold names has been
+ * read, its dirents are packed: the names and handles are sorted by
+ * name and front coded, each record keeping only what differs from the
+ * one before it, with a full record every DIRPACK_RESTART.  The index
+ * is the sorted array of cookies, each with the number of its record.
+ * Looking a name up hashes it to its cookie, as mdcache_avl_qp_lookup_s
+ * does, then finds the cookie by binary search and decodes at most
+ * DIRPACK_RESTART records; READDIR walks the cookies in order, as it
+ * walks the tree.
+ *
+ * A packed directory is read-only.  Lookups and READDIR are served
+ * from the pack under the content_lock held for read; the first change
+ * to the directory, with the lock held for write, expands it back into
+ * dirents in the trees, with the same cookies.  Directories with a
+ * deleted dirent, cached in chunks, whose handles come from more than
+ * one FSAL, with handles larger than MDCACHE_DIRPACK_KEY_MAX or with a
+ * name whose hash collided, so that one probe finds every name, are
+ * not packed.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include "log.h"
+#include "fsal.h"
+#include "gsh_hash.h"
+#include "mdcache_int.h"
+#include "mdcache_avl.h"
+#include "mdcache_lru.h"
+
+/** Records between full ones */
+#define DIRPACK_RESTART 16
+
+struct mdcache_dirpack {
+	uint32_t count;		/*< Names */
+	uint64_t *cookies;	/*< Their cookies, ascending */
+	uint32_t *rec;		/*< Record of each cookie, by name order */
+	uint32_t *restarts;	/*< Offset of every DIRPACK_RESTART'th */
+	uint8_t *data;		/*< The records, sorted by name */
+	void *fsal;		/*< FSAL of every handle */
+	size_t size;		/*< Bytes charged to lru_state.mem_used */
+};
+
+static inline uint8_t *dirpack_put(uint8_t *p, uint32_t val)
+{
+	while (val >= 0x80) {
+		*p++ = (val & 0x7f) | 0x80;
+		val >>= 7;
+	}
+	*p++ = val;
+	return p;
+}
+
+static inline uint32_t dirpack_get(const uint8_t **pp)
+{
+	const uint8_t *p = *pp;
+	uint32_t val = 0;
+	int shift = 0;
+
+	do {
+		val |= (uint32_t)(*p & 0x7f) << shift;
+		shift += 7;
+	} while (*p++ & 0x80);
+
+	*pp = p;
+	return val;
+}
+
+/** Bytes shared by the start of two strings */
+static inline uint32_t dirpack_shared(const uint8_t *a, uint32_t alen,
+				      const uint8_t *b, uint32_t blen)
+{
+	uint32_t n = 0;
+
+	while (n < alen && n < blen && a[n] == b[n])
+		n++;
+	return n;
+}
+
+/**
+ * @brief Append a record, coded against the previous one
+ */
+static uint8_t *dirpack_encode(uint8_t *p, const mdcache_dir_entry_t *prev,
+			       const mdcache_dir_entry_t *dirent)
+{
+	uint32_t len = strlen(dirent->name);
+	uint32_t shared = 0;
+
+	if (prev != NULL)
+		shared = dirpack_shared((const uint8_t *)prev->name,
+					strlen(prev->name),
+					(const uint8_t *)dirent->name, len);
+	p = dirpack_put(p, shared);
+	p = dirpack_put(p, len - shared);
+	memcpy(p, dirent->name + shared, len - shared);
+	p += len - shared;
+
+	len = dirent->ckey.kv.len;
+	shared = 0;
+	if (prev != NULL)
+		shared = dirpack_shared(prev->ckey.kv.addr, prev->ckey.kv.len,
+					dirent->ckey.kv.addr, len);
+	p = dirpack_put(p, shared);
+	p = dirpack_put(p, len - shared);
+	memcpy(p, (const uint8_t *)dirent->ckey.kv.addr + shared,
+	       len - shared);
+	return p + len - shared;
+}
+
+/**
+ * @brief Decode the record at p over the previous one in ent
+ */
+static const uint8_t *dirpack_decode(const uint8_t *p,
+				     struct mdcache_dirpack_ent *ent)
+{
+	uint32_t shared, rest;
+
+	shared = dirpack_get(&p);
+	rest = dirpack_get(&p);
+	memcpy(ent->name + shared, p, rest);
+	ent->name[shared + rest] = '\0';
+	p += rest;
+
+	shared = dirpack_get(&p);
+	rest = dirpack_get(&p);
+	memcpy(ent->key + shared, p, rest);
+	ent->ckey.kv.len = shared + rest;
+	return p + rest;
+}
+
+/**
+ * @brief Decode a record, by its number in name order
+ */
+static void dirpack_record(const struct mdcache_dirpack *pack, uint32_t r,
+			   struct mdcache_dirpack_ent *ent)
+{
+	const uint8_t *p = pack->data + pack->restarts[r / DIRPACK_RESTART];
+	uint32_t ix;
+
+	for (ix = r - r % DIRPACK_RESTART; ix <= r; ix++)
+		p = dirpack_decode(p, ent);
+
+	ent->ckey.kv.addr = ent->key;
+	ent->ckey.fsal = pack->fsal;
+	/* as cih_hash_key */
+	ent->ckey.hk = gsh_hash64(ent->key, ent->ckey.kv.len, 557);
+}
+
+/**
+ * @brief Find the position of a cookie
+ *
+ * @return true if it is there.
+ */
+static bool dirpack_find(const struct mdcache_dirpack *pack, uint64_t k,
+			 uint32_t *pos)
+{
+	uint32_t lo = 0, hi = pack->count, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (pack->cookies[mid] < k)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	*pos = lo;
+	return lo < pack->count && pack->cookies[lo] == k;
+}
+
+static int dirpack_name_cmpf(const void *lhs, const void *rhs)
+{
+	const mdcache_dir_entry_t *l = *(const mdcache_dir_entry_t **)lhs;
+	const mdcache_dir_entry_t *r = *(const mdcache_dir_entry_t **)rhs;
+
+	return strcmp(l->name, r->name);
+}
+
+/**
+ * @brief Pack the dirents of a directory just read whole
+ *
+ * Does nothing unless the directory qualifies, see the file comment.
+ *
+ * @note The content_lock MUST be held for write
+ *
+ * @param[in] dir The directory
+ */
+void mdcache_dirpack_build(mdcache_entry_t *dir)
+{
+	struct avltree *t = &dir->fsobj.fsdir.avl.t;
+	uint32_t threshold = mdcache_param.dir.pack_threshold;
+	struct mdcache_dirpack *pack;
+	mdcache_dir_entry_t **dirents;
+	struct avltree_node *node;
+	mdcache_dir_entry_t *dirent;
+	size_t cap = 0, before = 0;
+	uint32_t count, ix, pos;
+	uint8_t *p;
+
+	if (threshold == 0 || dir->fsobj.fsdir.pack != NULL ||
+	    dir->fsobj.fsdir.nchunks != 0 ||
+	    avltree_size(&dir->fsobj.fsdir.avl.c) != 0)
+		return;
+
+	count = avltree_size(t);
+	if (count < threshold)
+		return;
+
+	dirents = gsh_malloc(count * sizeof(*dirents));
+
+	ix = 0;
+	for (node = avltree_first(t); node != NULL; node = avltree_next(node)) {
+		dirent = avltree_container_of(node, mdcache_dir_entry_t,
+					      node_hk);
+		dirents[ix] = dirent;
+		if (dirent->ckey.kv.len == 0 ||
+		    dirent->ckey.kv.len > MDCACHE_DIRPACK_KEY_MAX ||
+		    dirent->ckey.fsal != dirents[0]->ckey.fsal ||
+		    dirent->hk.k != mdcache_avl_name_hash(dirent->name) ||
+		    strlen(dirent->name) > NAME_MAX) {
+			LogFullDebug(COMPONENT_CACHE_INODE,
+				     "Not packing %p, dirent %s", dir,
+				     dirent->name);
+			gsh_free(dirents);
+			return;
+		}
+		ix++;
+		/* two varints per string take 10 bytes at most */
+		cap += strlen(dirent->name) + dirent->ckey.kv.len + 20;
+		before += sizeof(mdcache_dir_entry_t) +
+			  strlen(dirent->name) + 1 + dirent->ckey.kv.len;
+	}
+
+	pack = gsh_calloc(1, sizeof(*pack));
+	pack->count = count;
+	pack->fsal = dirents[0]->ckey.fsal;
+	pack->cookies = gsh_malloc(count * sizeof(uint64_t));
+	pack->rec = gsh_malloc(count * sizeof(uint32_t));
+	pack->restarts = gsh_malloc(((count + DIRPACK_RESTART - 1) /
+				     DIRPACK_RESTART) * sizeof(uint32_t));
+	pack->data = gsh_malloc(cap);
+
+	/* the tree is in cookie order */
+	for (ix = 0; ix < count; ix++)
+		pack->cookies[ix] = dirents[ix]->hk.k;
+
+	qsort(dirents, count, sizeof(*dirents), dirpack_name_cmpf);
+
+	p = pack->data;
+	for (ix = 0; ix < count; ix++) {
+		(void) dirpack_find(pack, dirents[ix]->hk.k, &pos);
+		pack->rec[pos] = ix;
+
+		if (ix % DIRPACK_RESTART == 0) {
+			pack->restarts[ix / DIRPACK_RESTART] = p - pack->data;
+			p = dirpack_encode(p, NULL, dirents[ix]);
+		} else {
+			p = dirpack_encode(p, dirents[ix - 1], dirents[ix]);
+		}
+	}
+
+	pack->data = gsh_realloc(pack->data, p - pack->data);
+	pack->size = sizeof(*pack) +
+		     count * (sizeof(uint64_t) + sizeof(uint32_t)) +
+		     ((count + DIRPACK_RESTART - 1) / DIRPACK_RESTART) *
+		     sizeof(uint32_t) + (p - pack->data);
+	gsh_free(dirents);
+
+	/* the dirents go, nbactive stays */
+	mdcache_avl_clean_tree(t);
+	dir->fsobj.fsdir.pack = pack;
+	(void) atomic_add_uint64_t(&lru_state.mem_used, pack->size);
+
+	LogDebug(COMPONENT_CACHE_INODE,
+		 "Packed %" PRIu32 " dirents of %p in %zu bytes, from %zu",
+		 count, dir, pack->size, before);
+}
+
+/**
+ * @brief Free the pack of a directory, if any
+ *
+ * @note The content_lock MUST be held for write
+ *
+ * @param[in] dir The directory
+ */
+void mdcache_dirpack_free(mdcache_entry_t *dir)
+{
+	struct mdcache_dirpack *pack = dir->fsobj.fsdir.pack;
+
+	if (pack == NULL)
+		return;
+
+	dir->fsobj.fsdir.pack = NULL;
+	(void) atomic_sub_uint64_t(&lru_state.mem_used, pack->size);
+	gsh_free(pack->cookies);
+	gsh_free(pack->rec);
+	gsh_free(pack->restarts);
+	gsh_free(pack->data);
+	gsh_free(pack);
+}
+
+/**
+ * @brief Turn a packed directory back into dirents
+ *
+ * The dirents keep their cookies.  Does nothing if dir is not packed.
+ *
+ * @note The content_lock MUST be held for write
+ *
+ * @param[in] dir The directory
+ */
+void mdcache_dirpack_expand(mdcache_entry_t *dir)
+{
+	struct mdcache_dirpack *pack = dir->fsobj.fsdir.pack;
+	struct mdcache_dirpack_ent *ent;
+	mdcache_dir_entry_t *dirent;
+	const uint8_t *p;
+	uint64_t *cookie;
+	uint32_t ix;
+
+	if (pack == NULL)
+		return;
+
+	/* cookies by record, to decode the records in a single pass */
+	cookie = gsh_malloc(pack->count * sizeof(uint64_t));
+	for (ix = 0; ix < pack->count; ix++)
+		cookie[pack->rec[ix]] = pack->cookies[ix];
+
+	ent = gsh_malloc(sizeof(*ent));
+	ent->ckey.kv.addr = ent->key;
+	ent->ckey.fsal = pack->fsal;
+
+	p = pack->data;
+	for (ix = 0; ix < pack->count; ix++) {
+		p = dirpack_decode(p, ent);
+		ent->ckey.hk = gsh_hash64(ent->key, ent->ckey.kv.len, 557);
+
+		dirent = mdcache_dirent_alloc(ent->name);
+		mdcache_key_dup(&dirent->ckey, &ent->ckey);
+		dirent->hk.k = cookie[ix];
+		(void) avltree_insert(&dirent->node_hk,
+				      &dir->fsobj.fsdir.avl.t);
+	}
+
+	LogDebug(COMPONENT_CACHE_INODE,
+		 "Expanded %" PRIu32 " packed dirents of %p",
+		 pack->count, dir);
+
+	gsh_free(ent);
+	gsh_free(cookie);
+	mdcache_dirpack_free(dir);
+}
+
+/**
+ * @brief Look a name up in a packed directory
+ *
+ * Like mdcache_avl_qp_lookup_s with a maxj of 1.
+ *
+ * @note The content_lock MUST be held
+ *
+ * @param[in]  dir  The directory, packed
+ * @param[in]  name The name
+ * @param[out] ent  Its dirent, if found
+ *
+ * @return true if found.
+ */
+bool mdcache_dirpack_lookup_s(mdcache_entry_t *dir, const char *name,
+			      struct mdcache_dirpack_ent *ent)
+{
+	struct mdcache_dirpack *pack = dir->fsobj.fsdir.pack;
+	uint64_t k = mdcache_avl_name_hash(name);
+	uint32_t pos;
+
+	if (!dirpack_find(pack, k, &pos))
+		return false;
+
+	mdcache_dirpack_get(dir, pos, ent);
+	return strcmp(ent->name, name) == 0;
+}
+
+/**
+ * @brief Position of a cookie in a packed directory
+ *
+ * @note The content_lock MUST be held
+ *
+ * @param[in]  dir    The directory, packed
+ * @param[in]  cookie The cookie
+ * @param[out] pos    Its position
+ *
+ * @return true if found.
+ */
+bool mdcache_dirpack_seek(mdcache_entry_t *dir, uint64_t cookie,
+			  uint32_t *pos)
+{
+	return dirpack_find(dir->fsobj.fsdir.pack, cookie, pos);
+}
+
+/**
+ * @brief Number of names of a packed directory
+ */
+uint32_t mdcache_dirpack_count(mdcache_entry_t *dir)
+{
+	return dir->fsobj.fsdir.pack->count;
+}
+
+/**
+ * @brief Get the dirent at a position of a packed directory
+ *
+ * Positions are in cookie order, as the dirents of the tree.
+ *
+ * @note The content_lock MUST be held
+ *
+ * @param[in]  dir The directory, packed
+ * @param[in]  pos Position, less than mdcache_dirpack_count
+ * @param[out] ent The dirent
+ */
+void mdcache_dirpack_get(mdcache_entry_t *dir, uint32_t pos,
+			 struct mdcache_dirpack_ent *ent)
+{
+	struct mdcache_dirpack *pack = dir->fsobj.fsdir.pack;
+
+	dirpack_record(pack, pack->rec[pos], ent);
+	ent->cookie = pack->cookies[pos];
+}
+
+/** @} */
@@ -38,6 +38,14 @@
  * @{
  */
 
+/**
+ * @brief Entry replacement policies
+ */
+enum mdcache_lru_policy {
+	LRU_POLICY_LRU,		/*< Admit to L1, plain LRU with promotion */
+	LRU_POLICY_2Q		/*< Admit to L2 unless remembered, as 2Q */
+};
+
 /**
  * @brief Structure to hold MDCACHE paramaters
  */
@@ -49,20 +57,55 @@ struct mdcache_parameter {
 	/** Per-partition hash table size.  Defaults to 32633,
 	 * settable with Cache_Size. */
 	uint32_t cache_size;
+	/** Look entries up by handle in open-addressing tables
+	    instead of trees.  Defaults to false, settable with
+	    Open_Addressing_Hash. */
+	bool oa_hash;
+	/** Split the LRU lanes and entry memory between the NUMA
+	    nodes.  Defaults to false, settable with NUMA_Partitions. */
+	bool numa;
 	/** Use getattr for directory invalidation.  Defaults to
 	    false.  Settable with Use_Getattr_Directory_Invalidation. */
 	bool getattr_dir_invalidation;
+	/** Keep expired attributes whose change attribute the FSAL
+	    still gives.  Defaults to false, settable with
+	    Revalidate_By_Change. */
+	bool revalidate_change;
 	struct {
 		/** Max size of per-directory cache of removed
 		    entries */
 		uint32_t avl_max_deleted;
+		/** Entries per dirent chunk, 0 to cache whole
+		    directories.  Defaults to 128, settable with
+		    Dir_Chunk. */
+		uint32_t avl_chunk;
+		/** Max chunks cached per directory.  Defaults to
+		    256, settable with Dir_Max_Chunks. */
+		uint32_t avl_max_chunks;
+		/** Names the per-directory negative lookup filter
+		    is sized for, 0 for none.  Defaults to 0, settable
+		    with Dir_Filter_Names. */
+		uint32_t filter_names;
+		/** Names from which a directory read whole is
+		    packed, 0 for never.  Defaults to 0, settable
+		    with Dir_Pack_Threshold. */
+		uint32_t pack_threshold;
 	} dir;
 	/** High water mark for cache entries.  Defaults to 100000,
 	    settable by Entries_HWMark. */
 	uint32_t entries_hwmark;
+	/** Approximate bytes of entries and dirents to cache, 0 for
+	    no limit.  Defaults to 0, settable by Cache_Memory_Limit. */
+	uint64_t mem_limit;
+	/** High water mark for dirent chunks.  Defaults to 1000,
+	    settable by Chunks_HWMark. */
+	uint32_t chunks_hwmark;
 	/** Base interval in seconds between runs of the LRU cleaner
 	    thread. Defaults to 60, settable with LRU_Run_Interval. */
 	time_t lru_run_interval;
+	/** Entry replacement policy, LRU or 2Q.  Defaults to LRU,
+	    settable with LRU_Policy. */
+	uint32_t lru_policy;
 	/** Whether to cache open files.  Defaults to true, settable
 	    with Cache_FDs. */
 	bool use_fd_cache;
@@ -85,6 +128,41 @@ struct mdcache_parameter {
 	    the number of lanes.)  Defaults to 1000, settable with
 	    Reaper_Work. */
 	uint32_t reaper_work;
+	/** Number of LRU threads, each running over its own subset of
+	    the lanes.  Defaults to 1, settable with Reaper_Threads. */
+	uint32_t reaper_threads;
+	/** Threads refreshing stale attributes for readdir, 0 for
+	    none.  Defaults to 0, settable with
+	    Readdir_Prefetch_Threads. */
+	uint32_t prefetch_threads;
+	/** Entries readdir refreshes at once.  Defaults to 32,
+	    settable with Readdir_Prefetch_Window. */
+	uint32_t prefetch_window;
+	/** File the hot set is saved to and reloaded from at startup,
+	    NULL for none.  Settable with Warm_Start_File. */
+	char *warm_file;
+	/** Entries saved to warm_file.  Defaults to 10000, settable
+	    with Warm_Start_Entries. */
+	uint32_t warm_entries;
+	/** Seconds between saves to warm_file.  Defaults to 300,
+	    settable with Warm_Start_Interval. */
+	uint32_t warm_interval;
+	/** Milliseconds an unstable write waits for the writes that
+	    follow it, 0 for none.  Defaults to 0, settable with
+	    Write_Gather_Window. */
+	uint32_t gather_window;
+	/** Most bytes gathered for one file.  Defaults to 4MiB,
+	    settable with Write_Gather_Size. */
+	uint32_t gather_size;
+	/** Memory of the cache of xattr values and lists, 0 for
+	    none.  Defaults to 4MiB, settable with Xattr_Cache_Size. */
+	uint64_t xattr_cache_size;
+	/** Largest xattr value or list cached.  Defaults to 1024,
+	    settable with Xattr_Cache_Value_Max. */
+	uint32_t xattr_value_max;
+	/** Seconds xattrs are cached.  Defaults to 60, settable with
+	    Xattr_Cache_Expiration. */
+	uint32_t xattr_expiration;
 	/** The largest window (as a percentage of the system-imposed
 	    limit on FDs) of work that we will do in extremis.
 	    Defaults to 40, settable with Biggest_Window */
@@ -102,6 +180,13 @@ struct mdcache_parameter {
 	    client a partial reply based on what we have.
 	    Defaults to false, settable with Retry_Readdir */
 	bool retry_readdir;
+	/** IPv4 multicast group the heads of a cluster exchange
+	    cache invalidations on, NULL for none.  Settable with
+	    Cluster_Invalidate_Group. */
+	char *cluster_group;
+	/** UDP port of cluster_group.  Defaults to 20491, settable
+	    with Cluster_Invalidate_Port. */
+	uint16_t cluster_port;
 };
 
 extern struct mdcache_parameter mdcache_param;
@@ -246,9 +246,11 @@ fsal_status_t mdcache_write(struct fsal_obj_handle *obj_hdl, uint64_t offset,
 
 	if (status.major == ERR_FSAL_DELAY)
 		mdcache_kill_entry(entry);
-	else if (!FSAL_IS_ERROR(status))
+	else if (!FSAL_IS_ERROR(status)) {
 		atomic_clear_uint32_t_bits(&entry->mde_flags,
 					MDCACHE_TRUST_ATTRS);
+		mdc_cluster_invalidate(entry, FSAL_UP_INVALIDATE_ATTRS);
+	}
 
 	return status;
 }
@@ -436,6 +438,8 @@ fsal_status_t mdcache_close(struct fsal_obj_handle *obj_hdl)
 		container_of(obj_hdl, mdcache_entry_t, obj_handle);
 	fsal_status_t status;
 
+	mdc_gather_flush(entry);
+
 	/* XXX dang caching FDs?  How does it interact with multi-FD */
 	subcall(
 		status = entry->sub_handle->obj_ops.close(entry->sub_handle)
@@ -515,6 +519,8 @@ static fsal_status_t mdc_open2_by_name(mdcache_entry_t *mdc_parent,
 			/* Invalidate the attributes since we just truncated. */
 			atomic_clear_uint32_t_bits(&entry->mde_flags,
 						   MDCACHE_TRUST_ATTRS);
+			mdc_cluster_invalidate(entry,
+					       FSAL_UP_INVALIDATE_ATTRS);
 		}
 		*new_entry = entry;
 	}
@@ -629,6 +635,8 @@ fsal_status_t mdcache_open2(struct fsal_obj_handle *obj_hdl,
 				 */
 				atomic_clear_uint32_t_bits(
 				    &new_entry->mde_flags, MDCACHE_TRUST_ATTRS);
+				mdc_cluster_invalidate(
+				    new_entry, FSAL_UP_INVALIDATE_ATTRS);
 			}
 
 			return status;
@@ -691,17 +699,13 @@ fsal_status_t mdcache_open2(struct fsal_obj_handle *obj_hdl,
 		return status;
 	}
 
-	PTHREAD_RWLOCK_wrlock(&mdc_parent->content_lock);
-
 	/* We will invalidate parent attrs if we did any form of create. */
 	status = mdcache_alloc_and_check_handle(export, sub_handle,
 						new_obj, false,
 						&attrs, attrs_out,
 						"open2 ", mdc_parent, name,
 						createmode != FSAL_NO_CREATE,
-						state);
-
-	PTHREAD_RWLOCK_unlock(&mdc_parent->content_lock);
+						state, false);
 
 	fsal_release_attrs(&attrs);
 
@@ -775,6 +779,8 @@ fsal_status_t mdcache_reopen2(struct fsal_obj_handle *obj_hdl,
 	fsal_status_t status;
 	bool truncated = openflags & FSAL_O_TRUNC;
 
+	mdc_gather_flush(entry);
+
 	subcall(
 		status = entry->sub_handle->obj_ops.reopen2(
 			entry->sub_handle, state, openflags)
@@ -786,6 +792,7 @@ fsal_status_t mdcache_reopen2(struct fsal_obj_handle *obj_hdl,
 	if (truncated && !FSAL_IS_ERROR(status)) {
 		atomic_clear_uint32_t_bits(&entry->mde_flags,
 					   MDCACHE_TRUST_ATTRS);
+		mdc_cluster_invalidate(entry, FSAL_UP_INVALIDATE_ATTRS);
 	}
 
 	return status;
@@ -821,6 +828,9 @@ fsal_status_t mdcache_read2(struct fsal_obj_handle *obj_hdl,
 		container_of(obj_hdl, mdcache_entry_t, obj_handle);
 	fsal_status_t status;
 
+	mdcache_lru_fd_used(entry);
+	mdc_gather_flush(entry);
+
 	subcall(
 		status = entry->sub_handle->obj_ops.read2(
 			entry->sub_handle, bypass, state, offset, buf_size,
@@ -835,6 +845,48 @@ fsal_status_t mdcache_read2(struct fsal_obj_handle *obj_hdl,
 	return status;
 }
 
+/**
+ * @brief Read from a file into a sub-FSAL buffer
+ *
+ * Delegate to sub-FSAL
+ *
+ * @param[in] obj_hdl	Object owning state
+ * @param[in] bypass	Bypass deny read
+ * @param[in] state	Open file state to read
+ * @param[in] offset	Offset into file
+ * @param[in] buf_size	Amount to read
+ * @param[out] rbuf	Data lent by the sub-FSAL
+ * @param[out] eof	true if End of File was hit
+ * @return FSAL status
+ */
+fsal_status_t mdcache_read_buffer(struct fsal_obj_handle *obj_hdl,
+				  bool bypass,
+				  struct state_t *state,
+				  uint64_t offset,
+				  size_t buf_size,
+				  struct fsal_read_buf *rbuf,
+				  bool *eof)
+{
+	mdcache_entry_t *entry =
+		container_of(obj_hdl, mdcache_entry_t, obj_handle);
+	fsal_status_t status;
+
+	mdc_gather_flush(entry);
+
+	subcall(
+		status = entry->sub_handle->obj_ops.read_buffer(
+			entry->sub_handle, bypass, state, offset, buf_size,
+			rbuf, eof)
+	       );
+
+	if (!FSAL_IS_ERROR(status))
+		mdc_set_time_current(&entry->attrs.atime);
+	else if (status.major == ERR_FSAL_DELAY)
+		mdcache_kill_entry(entry);
+
+	return status;
+}
+
 /**
  * @brief Write to a file (new style)
  *
@@ -864,6 +916,17 @@ fsal_status_t mdcache_write2(struct fsal_obj_handle *obj_hdl,
 	mdcache_entry_t *entry =
 		container_of(obj_hdl, mdcache_entry_t, obj_handle);
 	fsal_status_t status;
+	bool stable = *fsal_stable;
+
+	mdcache_lru_fd_used(entry);
+	if (mdc_gather_write(entry, bypass, state, offset, buf_size, buffer,
+			     stable, info)) {
+		*write_amount = buf_size;
+		*fsal_stable = false;
+		atomic_clear_uint32_t_bits(&entry->mde_flags,
+					   MDCACHE_TRUST_ATTRS);
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+	}
 
 	subcall(
 		status = entry->sub_handle->obj_ops.write2(
@@ -871,11 +934,19 @@ fsal_status_t mdcache_write2(struct fsal_obj_handle *obj_hdl,
 			buffer, write_amount, fsal_stable, info)
 	       );
 
-	if (status.major == ERR_FSAL_STALE)
+	if (status.major == ERR_FSAL_STALE) {
 		mdcache_kill_entry(entry);
-	else
+	} else {
 		atomic_clear_uint32_t_bits(&entry->mde_flags,
 					   MDCACHE_TRUST_ATTRS);
+		mdc_cluster_invalidate(entry, FSAL_UP_INVALIDATE_ATTRS);
+	}
+
+	/* A full unstable write may be followed by more to gather */
+	if (!FSAL_IS_ERROR(status) && mdcache_param.gather_window != 0 &&
+	    !stable && info == NULL && *write_amount == buf_size &&
+	    buf_size != 0)
+		mdc_gather_arm(entry, bypass, state, offset + buf_size);
 
 	return status;
 }
@@ -898,6 +969,8 @@ fsal_status_t mdcache_seek2(struct fsal_obj_handle *obj_hdl,
 		container_of(obj_hdl, mdcache_entry_t, obj_handle);
 	fsal_status_t status;
 
+	mdc_gather_flush(entry);
+
 	subcall(
 		status = entry->sub_handle->obj_ops.seek2(
 			entry->sub_handle, state, info)
@@ -938,10 +1011,184 @@ fsal_status_t mdcache_io_advise2(struct fsal_obj_handle *obj_hdl,
 	return status;
 }
 
+/**
+ * @brief Group commit state of one file
+ *
+ * Only one commit of a file runs in the sub-FSAL at a time.  The
+ * COMMITs that come meanwhile wait, and the first of them then commits
+ * the range they all cover, for all of them, in one call.  Since most
+ * FSALs sync the whole file whatever the range, a storm of COMMITs on
+ * a file costs about two syncs instead of one each.
+ *
+ * Everything but the pointer to it in the entry is protected by mtx.
+ */
+struct mdc_commit {
+	pthread_mutex_t mtx;
+	pthread_cond_t cond;
+	/** A commit is in the sub-FSAL */
+	bool running;
+	/** COMMITs waiting for the next one, mdc_commit_waiter.list */
+	struct glist_head waiting;
+};
+
+/**
+ * @brief A COMMIT waiting on a file, on its caller's stack
+ */
+struct mdc_commit_waiter {
+	struct glist_head list;
+	/** The range to commit, end excluded, UINT64_MAX for the end of
+	 * the file */
+	uint64_t start;
+	uint64_t end;
+	/** The export it came through, only ones of the same are joined */
+	struct gsh_export *export;
+	/** This one is to commit for the waiters */
+	bool lead;
+	/** Committed, with status */
+	bool done;
+	fsal_status_t status;
+};
+
+/**
+ * @brief Commit the waiters of a file, for the one that leads them
+ *
+ * Called with the mutex held, which is dropped around the commit.
+ *
+ * @param[in] entry The file
+ * @param[in] c     Its commit state
+ * @param[in] lead  The waiter that leads
+ */
+static void mdc_commit_batch(mdcache_entry_t *entry, struct mdc_commit *c,
+			     struct mdc_commit_waiter *lead)
+{
+	struct glist_head batch, *glist, *glistn;
+	struct mdc_commit_waiter *w;
+	uint64_t start = lead->start, end = lead->end;
+	fsal_status_t status;
+	uint32_t count = 0;
+
+	glist_init(&batch);
+	glist_for_each_safe(glist, glistn, &c->waiting) {
+		w = glist_entry(glist, struct mdc_commit_waiter, list);
+		if (w->export != lead->export)
+			continue;
+		glist_del(&w->list);
+		glist_add_tail(&batch, &w->list);
+		start = MIN(start, w->start);
+		end = MAX(end, w->end);
+		count++;
+	}
+
+	c->running = true;
+	PTHREAD_MUTEX_unlock(&c->mtx);
+
+	LogFullDebug(COMPONENT_CACHE_INODE,
+		     "Committing %"PRIu32" COMMITs of entry %p",
+		     count, entry);
+
+	subcall(
+		status = entry->sub_handle->obj_ops.commit2(
+			entry->sub_handle, start,
+			end == UINT64_MAX ? 0 : end - start)
+	       );
+
+	PTHREAD_MUTEX_lock(&c->mtx);
+	c->running = false;
+
+	glist_for_each_safe(glist, glistn, &batch) {
+		w = glist_entry(glist, struct mdc_commit_waiter, list);
+		glist_del(&w->list);
+		w->status = status;
+		w->done = true;
+	}
+
+	if (!glist_empty(&c->waiting)) {
+		w = glist_first_entry(&c->waiting, struct mdc_commit_waiter,
+				      list);
+		w->lead = true;
+	}
+
+	pthread_cond_broadcast(&c->cond);
+}
+
+/**
+ * @brief Commit a range of a file, with the COMMITs on it meanwhile
+ *
+ * @param[in] entry  The file
+ * @param[in] offset Offset of the range
+ * @param[in] len    Length of the range, 0 for the end of the file
+ *
+ * @return FSAL status
+ */
+static fsal_status_t mdc_commit_group(mdcache_entry_t *entry, off_t offset,
+				      size_t len)
+{
+	struct mdc_commit *c = atomic_fetch_voidptr((void **)&entry->commit);
+	struct mdc_commit_waiter w = {
+		.start = offset,
+		.end = len == 0 || offset + len < (uint64_t) offset
+			? UINT64_MAX : offset + len,
+		.export = op_ctx->ctx_export,
+	};
+
+	if (c == NULL) {
+		PTHREAD_RWLOCK_wrlock(&entry->attr_lock);
+		c = entry->commit;
+		if (c == NULL) {
+			c = gsh_calloc(1, sizeof(*c));
+			PTHREAD_MUTEX_init(&c->mtx, NULL);
+			PTHREAD_COND_init(&c->cond, NULL);
+			glist_init(&c->waiting);
+			atomic_store_voidptr((void **)&entry->commit, c);
+		}
+		PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+	}
+
+	PTHREAD_MUTEX_lock(&c->mtx);
+
+	glist_add_tail(&c->waiting, &w.list);
+	w.lead = !c->running && glist_first_entry(&c->waiting,
+						  struct mdc_commit_waiter,
+						  list) == &w;
+
+	while (!w.done) {
+		/* The lead is in its own batch, so is done after it */
+		if (w.lead)
+			mdc_commit_batch(entry, c, &w);
+		else
+			pthread_cond_wait(&c->cond, &c->mtx);
+	}
+
+	PTHREAD_MUTEX_unlock(&c->mtx);
+
+	return w.status;
+}
+
+/**
+ * @brief Free a file's group commit state as its entry is cleaned
+ *
+ * No COMMIT can be waiting, since it would hold a reference.
+ *
+ * @param[in] entry  The file
+ */
+void mdc_commit_free(mdcache_entry_t *entry)
+{
+	struct mdc_commit *c = entry->commit;
+
+	if (c == NULL)
+		return;
+
+	PTHREAD_COND_destroy(&c->cond);
+	PTHREAD_MUTEX_destroy(&c->mtx);
+	gsh_free(c);
+	entry->commit = NULL;
+}
+
+
 /**
  * @brief Commit to a file (new style)
  *
- * Delegate to sub-FSAL
+ * Delegate to sub-FSAL, joined with the other COMMITs of the file
  *
  * @param[in] obj_hdl	Object to commit
  * @param[in] offset	Offset into file
@@ -955,10 +1202,11 @@ fsal_status_t mdcache_commit2(struct fsal_obj_handle *obj_hdl, off_t offset,
 		container_of(obj_hdl, mdcache_entry_t, obj_handle);
 	fsal_status_t status;
 
-	subcall(
-		status = entry->sub_handle->obj_ops.commit2(
-			entry->sub_handle, offset, len)
-	       );
+	status = mdc_gather_commit(entry);
+	if (FSAL_IS_ERROR(status))
+		return status;
+
+	status = mdc_commit_group(entry, offset, len);
 
 	if (status.major == ERR_FSAL_STALE)
 		mdcache_kill_entry(entry);
@@ -1016,6 +1264,8 @@ fsal_status_t mdcache_close2(struct fsal_obj_handle *obj_hdl,
 		container_of(obj_hdl, mdcache_entry_t, obj_handle);
 	fsal_status_t status;
 
+	mdc_gather_flush(entry);
+
 	subcall(
 		status = entry->sub_handle->obj_ops.close2(
 			  entry->sub_handle, state)
@@ -1029,3 +1279,411 @@ fsal_status_t mdcache_close2(struct fsal_obj_handle *obj_hdl,
 
 	return status;
 }
+
+/**
+ * @brief Copy a range of one file into another
+ *
+ * @param[in] src_hdl		File to copy from
+ * @param[in] src_state		state_t for src_hdl
+ * @param[in] src_offset	Offset into src_hdl
+ * @param[in] dst_hdl		File to copy to
+ * @param[in] dst_state		state_t for dst_hdl
+ * @param[in] dst_offset	Offset into dst_hdl
+ * @param[in] count		Number of bytes to copy
+ * @param[out] copied		Number of bytes copied
+ * @return FSAL status
+ */
+fsal_status_t mdcache_copy(struct fsal_obj_handle *src_hdl,
+			   struct state_t *src_state,
+			   uint64_t src_offset,
+			   struct fsal_obj_handle *dst_hdl,
+			   struct state_t *dst_state,
+			   uint64_t dst_offset,
+			   uint64_t count,
+			   uint64_t *copied)
+{
+	mdcache_entry_t *src =
+		container_of(src_hdl, mdcache_entry_t, obj_handle);
+	mdcache_entry_t *dst =
+		container_of(dst_hdl, mdcache_entry_t, obj_handle);
+	fsal_status_t status;
+
+	mdc_gather_flush(src);
+	mdc_gather_flush(dst);
+
+	subcall(
+		status = src->sub_handle->obj_ops.copy(
+			src->sub_handle, src_state, src_offset,
+			dst->sub_handle, dst_state, dst_offset, count, copied)
+	       );
+
+	if (status.major == ERR_FSAL_STALE) {
+		mdcache_kill_entry(src);
+		mdcache_kill_entry(dst);
+	} else {
+		atomic_clear_uint32_t_bits(&dst->mde_flags,
+					   MDCACHE_TRUST_ATTRS);
+		mdc_cluster_invalidate(dst, FSAL_UP_INVALIDATE_ATTRS);
+	}
+
+	return status;
+}
+
+/**
+ * @brief Share a range of one file's blocks with another
+ *
+ * @param[in] src_hdl		File to clone from
+ * @param[in] src_state		state_t for src_hdl
+ * @param[in] src_offset	Offset into src_hdl
+ * @param[in] dst_hdl		File to clone into
+ * @param[in] dst_state		state_t for dst_hdl
+ * @param[in] dst_offset	Offset into dst_hdl
+ * @param[in] count		Number of bytes to clone
+ * @return FSAL status
+ */
+fsal_status_t mdcache_clone(struct fsal_obj_handle *src_hdl,
+			    struct state_t *src_state,
+			    uint64_t src_offset,
+			    struct fsal_obj_handle *dst_hdl,
+			    struct state_t *dst_state,
+			    uint64_t dst_offset,
+			    uint64_t count)
+{
+	mdcache_entry_t *src =
+		container_of(src_hdl, mdcache_entry_t, obj_handle);
+	mdcache_entry_t *dst =
+		container_of(dst_hdl, mdcache_entry_t, obj_handle);
+	fsal_status_t status;
+
+	mdc_gather_flush(src);
+	mdc_gather_flush(dst);
+
+	subcall(
+		status = src->sub_handle->obj_ops.clone(
+			src->sub_handle, src_state, src_offset,
+			dst->sub_handle, dst_state, dst_offset, count)
+	       );
+
+	if (status.major == ERR_FSAL_STALE) {
+		mdcache_kill_entry(src);
+		mdcache_kill_entry(dst);
+	} else {
+		atomic_clear_uint32_t_bits(&dst->mde_flags,
+					   MDCACHE_TRUST_ATTRS);
+		mdc_cluster_invalidate(dst, FSAL_UP_INVALIDATE_ATTRS);
+	}
+
+	return status;
+}
+
+/**
+ * @brief Reserve or release storage for a range of a file
+ *
+ * @param[in] obj_hdl		File to operate on
+ * @param[in] state		state_t for obj_hdl
+ * @param[in] offset		Start of the range
+ * @param[in] length		Length of the range
+ * @param[in] allocate		true to allocate, false to punch a hole
+ * @return FSAL status
+ */
+fsal_status_t mdcache_fallocate(struct fsal_obj_handle *obj_hdl,
+				struct state_t *state,
+				uint64_t offset,
+				uint64_t length,
+				bool allocate)
+{
+	mdcache_entry_t *entry =
+		container_of(obj_hdl, mdcache_entry_t, obj_handle);
+	fsal_status_t status;
+
+	mdc_gather_flush(entry);
+
+	subcall(
+		status = entry->sub_handle->obj_ops.fallocate(
+			entry->sub_handle, state, offset, length, allocate)
+	       );
+
+	if (status.major == ERR_FSAL_STALE) {
+		mdcache_kill_entry(entry);
+	} else {
+		atomic_clear_uint32_t_bits(&entry->mde_flags,
+					   MDCACHE_TRUST_ATTRS);
+		mdc_cluster_invalidate(entry, FSAL_UP_INVALIDATE_ATTRS);
+	}
+
+	return status;
+}
+
+/**
+ * @brief Write several buffers to a file
+ *
+ * Delegate to sub-FSAL, after anything gathered ahead of it
+ *
+ * @param[in] obj_hdl	Object owning state
+ * @param[in] bypass	Bypass any non-mandatory deny write
+ * @param[in] state	Open file state to write
+ * @param[in] offset	Offset into file
+ * @param[in] iov	Buffers to write from
+ * @param[in] iovcnt	Number of buffers
+ * @param[out] wrote_amount	Amount written in bytes
+ * @param[in,out] fsal_stable	true if write was to stable storage
+ * @return FSAL status
+ */
+fsal_status_t mdcache_write_vec(struct fsal_obj_handle *obj_hdl,
+				bool bypass,
+				struct state_t *state,
+				uint64_t offset,
+				const struct iovec *iov,
+				int iovcnt,
+				size_t *wrote_amount,
+				bool *fsal_stable)
+{
+	mdcache_entry_t *entry =
+		container_of(obj_hdl, mdcache_entry_t, obj_handle);
+	fsal_status_t status;
+
+	mdcache_lru_fd_used(entry);
+	mdc_gather_flush(entry);
+
+	subcall(
+		status = entry->sub_handle->obj_ops.write_vec(
+			entry->sub_handle, bypass, state, offset, iov, iovcnt,
+			wrote_amount, fsal_stable)
+	       );
+
+	if (status.major == ERR_FSAL_STALE) {
+		mdcache_kill_entry(entry);
+	} else {
+		atomic_clear_uint32_t_bits(&entry->mde_flags,
+					   MDCACHE_TRUST_ATTRS);
+		mdc_cluster_invalidate(entry, FSAL_UP_INVALIDATE_ATTRS);
+	}
+
+	return status;
+}
+
+/**
+ * @brief Read from a file into several buffers
+ *
+ * Delegate to sub-FSAL
+ *
+ * @param[in] obj_hdl	Object owning state
+ * @param[in] bypass	Bypass deny read
+ * @param[in] state	Open file state to read
+ * @param[in] offset	Offset into file
+ * @param[in] iov	Buffers to read into
+ * @param[in] iovcnt	Number of buffers
+ * @param[out] read_amount	Amount read in bytes
+ * @param[out] eof	true if End of File was hit
+ * @return FSAL status
+ */
+fsal_status_t mdcache_read_vec(struct fsal_obj_handle *obj_hdl,
+			       bool bypass,
+			       struct state_t *state,
+			       uint64_t offset,
+			       const struct iovec *iov,
+			       int iovcnt,
+			       size_t *read_amount,
+			       bool *eof)
+{
+	mdcache_entry_t *entry =
+		container_of(obj_hdl, mdcache_entry_t, obj_handle);
+	fsal_status_t status;
+
+	mdcache_lru_fd_used(entry);
+	mdc_gather_flush(entry);
+
+	subcall(
+		status = entry->sub_handle->obj_ops.read_vec(
+			entry->sub_handle, bypass, state, offset, iov, iovcnt,
+			read_amount, eof)
+	       );
+
+	if (!FSAL_IS_ERROR(status))
+		mdc_set_time_current(&entry->attrs.atime);
+	else if (status.major == ERR_FSAL_DELAY)
+		mdcache_kill_entry(entry);
+
+	return status;
+}
+
+/**
+ * @brief What an asynchronous I/O passed to the sub-FSAL must remember
+ */
+struct mdc_async_arg {
+	mdcache_entry_t *entry;
+	/** The caller's context, and MDCACHE's export in it */
+	struct req_op_context *ctx;
+	struct fsal_export *fsal_export;
+	bool bypass;
+	bool stable;
+	fsal_async_cb done_cb;
+	void *caller_arg;
+};
+
+static struct mdc_async_arg *mdc_async_arg_new(mdcache_entry_t *entry,
+					       bool bypass,
+					       fsal_async_cb done_cb,
+					       void *caller_arg)
+{
+	struct mdc_async_arg *arg = gsh_malloc(sizeof(*arg));
+
+	arg->entry = entry;
+	arg->ctx = op_ctx;
+	arg->fsal_export = op_ctx->fsal_export;
+	arg->bypass = bypass;
+	arg->stable = false;
+	arg->done_cb = done_cb;
+	arg->caller_arg = caller_arg;
+
+	return arg;
+}
+
+/**
+ * @brief Complete a read made by the sub-FSAL
+ *
+ * This may run on a thread of the sub-FSAL, so the caller's context is
+ * put in place for our part of the work.  The caller's completion
+ * comes last, since it may finish the request the context belongs to.
+ */
+static void mdc_read2_done(struct fsal_obj_handle *sub_hdl,
+			   fsal_status_t status, struct fsal_io_arg *read_arg,
+			   void *caller_arg)
+{
+	struct mdc_async_arg *arg = caller_arg;
+	mdcache_entry_t *entry = arg->entry;
+	fsal_async_cb done_cb = arg->done_cb;
+	void *done_arg = arg->caller_arg;
+	struct req_op_context *saved_ctx = op_ctx;
+
+	op_ctx = arg->ctx;
+	op_ctx->fsal_export = arg->fsal_export;
+
+	if (!FSAL_IS_ERROR(status))
+		mdc_set_time_current(&entry->attrs.atime);
+	else if (status.major == ERR_FSAL_DELAY)
+		mdcache_kill_entry(entry);
+
+	op_ctx = saved_ctx;
+	gsh_free(arg);
+
+	done_cb(&entry->obj_handle, status, read_arg, done_arg);
+}
+
+/**
+ * @brief Read from a file without waiting for the data
+ *
+ * Delegate to sub-FSAL
+ *
+ * @param[in] obj_hdl		Object owning state
+ * @param[in] bypass		Bypass deny read
+ * @param[in,out] read_arg	Arguments and results of the read
+ * @param[in] done_cb		Completion of the read
+ * @param[in] caller_arg	Passed to done_cb
+ */
+void mdcache_read2_async(struct fsal_obj_handle *obj_hdl,
+			 bool bypass,
+			 struct fsal_io_arg *read_arg,
+			 fsal_async_cb done_cb,
+			 void *caller_arg)
+{
+	mdcache_entry_t *entry =
+		container_of(obj_hdl, mdcache_entry_t, obj_handle);
+	struct mdc_async_arg *arg;
+
+	mdcache_lru_fd_used(entry);
+	mdc_gather_flush(entry);
+
+	arg = mdc_async_arg_new(entry, bypass, done_cb, caller_arg);
+
+	subcall(
+		entry->sub_handle->obj_ops.read2_async(
+			entry->sub_handle, bypass, read_arg, mdc_read2_done,
+			arg)
+	       );
+}
+
+/**
+ * @brief Complete a write made by the sub-FSAL
+ *
+ * As for mdc_read2_done().
+ */
+static void mdc_write2_done(struct fsal_obj_handle *sub_hdl,
+			    fsal_status_t status,
+			    struct fsal_io_arg *write_arg, void *caller_arg)
+{
+	struct mdc_async_arg *arg = caller_arg;
+	mdcache_entry_t *entry = arg->entry;
+	fsal_async_cb done_cb = arg->done_cb;
+	void *done_arg = arg->caller_arg;
+	struct req_op_context *saved_ctx = op_ctx;
+
+	op_ctx = arg->ctx;
+	op_ctx->fsal_export = arg->fsal_export;
+
+	if (status.major == ERR_FSAL_STALE) {
+		mdcache_kill_entry(entry);
+	} else {
+		atomic_clear_uint32_t_bits(&entry->mde_flags,
+					   MDCACHE_TRUST_ATTRS);
+		mdc_cluster_invalidate(entry, FSAL_UP_INVALIDATE_ATTRS);
+	}
+
+	/* A full unstable write may be followed by more to gather */
+	if (!FSAL_IS_ERROR(status) && mdcache_param.gather_window != 0 &&
+	    !arg->stable && write_arg->info == NULL &&
+	    write_arg->io_amount == write_arg->size && write_arg->size != 0)
+		mdc_gather_arm(entry, arg->bypass, write_arg->state,
+			       write_arg->offset + write_arg->size);
+
+	op_ctx = saved_ctx;
+	gsh_free(arg);
+
+	done_cb(&entry->obj_handle, status, write_arg, done_arg);
+}
+
+/**
+ * @brief Write to a file without waiting for the write
+ *
+ * Gather the write if it continues a run, otherwise delegate to
+ * sub-FSAL
+ *
+ * @param[in] obj_hdl		Object owning state
+ * @param[in] bypass		Bypass any non-mandatory deny write
+ * @param[in,out] write_arg	Arguments and results of the write
+ * @param[in] done_cb		Completion of the write
+ * @param[in] caller_arg	Passed to done_cb
+ */
+void mdcache_write2_async(struct fsal_obj_handle *obj_hdl,
+			  bool bypass,
+			  struct fsal_io_arg *write_arg,
+			  fsal_async_cb done_cb,
+			  void *caller_arg)
+{
+	mdcache_entry_t *entry =
+		container_of(obj_hdl, mdcache_entry_t, obj_handle);
+	struct mdc_async_arg *arg;
+
+	mdcache_lru_fd_used(entry);
+	if (mdc_gather_write(entry, bypass, write_arg->state,
+			     write_arg->offset, write_arg->size,
+			     write_arg->buffer, write_arg->fsal_stable,
+			     write_arg->info)) {
+		write_arg->io_amount = write_arg->size;
+		write_arg->fsal_stable = false;
+		atomic_clear_uint32_t_bits(&entry->mde_flags,
+					   MDCACHE_TRUST_ATTRS);
+		done_cb(obj_hdl, fsalstat(ERR_FSAL_NO_ERROR, 0), write_arg,
+			caller_arg);
+		return;
+	}
+
+	arg = mdc_async_arg_new(entry, bypass, done_cb, caller_arg);
+	arg->stable = write_arg->fsal_stable;
+
+	subcall(
+		entry->sub_handle->obj_ops.write2_async(
+			entry->sub_handle, bypass, write_arg, mdc_write2_done,
+			arg)
+	       );
+}
@@ -0,0 +1,387 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/**
+ * @addtogroup FSAL_MDCACHE
+ * @{
+ */
+
+/**
+ * @file  mdcache_gather.c
+ * @brief Gather sequential unstable writes into one vectored write
+ *
+ * When Write_Gather_Window is set, an UNSTABLE write that reaches the
+ * sub-FSAL arms a gather on its file.  Writes that follow it, through
+ * the same state, from the same user and export, and starting where
+ * the previous one ended, are copied aside instead of being written,
+ * until Write_Gather_Size bytes are held or the window expires.  The
+ * run is then handed to the sub-FSAL as a single write_vec call.
+ *
+ * Only the write that armed the gather has been checked by the
+ * sub-FSAL; the ones gathered behind it use the same state and
+ * credentials, so they would pass the same checks.  Anything that
+ * could see or change the file data flushes the run first: reads,
+ * seeks, COMMIT, close, setattr and attribute refreshes among them.
+ * An error writing a run in the background is returned by the next
+ * COMMIT, so the client resends those writes.  Gathered data is lost
+ * if the server dies, which UNSTABLE allows: the write verifier
+ * changes and clients resend everything not yet committed.
+ */
+
+#include "config.h"
+#include <sys/uio.h>
+#include "fsal.h"
+#include "nfs_core.h"
+#include "delayed_exec.h"
+#include "export_mgr.h"
+#include "sal_functions.h"
+#include "mdcache_int.h"
+#include "mdcache_lru.h"
+
+/* Writes gathered into one run, at most */
+#define GATHER_MAX_IOV 128
+
+/**
+ * @brief Gather state of one file
+ *
+ * Everything but the pointer to it in the entry is protected by mtx.
+ */
+struct mdc_gather {
+	pthread_mutex_t mtx;
+	/** The run is open to the next write */
+	bool armed;
+	/** A timer holds a reference on the entry */
+	bool timer;
+	/** Where the first gathered write starts */
+	uint64_t offset;
+	/** Where the next write must start to be gathered */
+	uint64_t next;
+	/** Bytes gathered */
+	size_t len;
+	/** Gathered writes, each in its own copy */
+	struct iovec iov[GATHER_MAX_IOV];
+	int iovcnt;
+	/** What the arming write was made with, referenced while armed */
+	bool bypass;
+	struct state_t *state;
+	struct gsh_export *export;
+	struct fsal_export *fsal_export;
+	uid_t uid;
+	gid_t gid;
+	uint32_t nfs_vers;
+	uint32_t nfs_minorvers;
+	/** First error writing a run, returned by COMMIT */
+	fsal_status_t error;
+};
+
+/**
+ * @brief Write out the run and disarm the gather
+ *
+ * Called with the mutex held.  The references the run held are passed
+ * back, to be dropped by gather_release() once the mutex is released:
+ * dropping the last reference on a state closes it, which flushes.
+ *
+ * @param[in]  entry   The file
+ * @param[in]  g       Its gather state
+ * @param[out] state   State reference to drop
+ * @param[out] export  Export reference to drop
+ */
+static void gather_flush_locked(mdcache_entry_t *entry, struct mdc_gather *g,
+				struct state_t **state,
+				struct gsh_export **export)
+{
+	struct root_op_context root_op_context;
+	fsal_status_t status;
+	size_t wrote = 0;
+	bool stable = false;
+	int ix;
+
+	*state = NULL;
+	*export = NULL;
+
+	if (!g->armed)
+		return;
+
+	if (g->len != 0) {
+		init_root_op_context(&root_op_context, g->export,
+				     g->fsal_export, g->nfs_vers,
+				     g->nfs_minorvers, UNKNOWN_REQUEST);
+		root_op_context.creds.caller_uid = g->uid;
+		root_op_context.creds.caller_gid = g->gid;
+
+		subcall(
+			status = entry->sub_handle->obj_ops.write_vec(
+				entry->sub_handle, g->bypass, g->state,
+				g->offset, g->iov, g->iovcnt, &wrote, &stable)
+		       );
+
+		/* Peers learn of gathered writes once they are written */
+		mdc_cluster_invalidate(entry, FSAL_UP_INVALIDATE_ATTRS);
+
+		release_root_op_context();
+
+		if (!FSAL_IS_ERROR(status) && wrote != g->len)
+			status = fsalstat(ERR_FSAL_IO, 0);
+
+		if (FSAL_IS_ERROR(status)) {
+			LogInfo(COMPONENT_CACHE_INODE,
+				"Writing %zu gathered bytes at %"PRIu64
+				" failed: %s",
+				g->len, g->offset, fsal_err_txt(status));
+			if (!FSAL_IS_ERROR(g->error))
+				g->error = status;
+		}
+
+		for (ix = 0; ix < g->iovcnt; ++ix)
+			gsh_free(g->iov[ix].iov_base);
+	}
+
+	*state = g->state;
+	*export = g->export;
+	g->state = NULL;
+	g->export = NULL;
+	g->iovcnt = 0;
+	g->len = 0;
+	g->armed = false;
+}
+
+static void gather_release(struct state_t *state, struct gsh_export *export)
+{
+	if (state != NULL)
+		dec_state_t_ref(state);
+	if (export != NULL)
+		put_gsh_export(export);
+}
+
+/**
+ * @brief Flush a run whose window has expired
+ *
+ * @param[in] arg  The entry, with a reference for the timer
+ */
+static void gather_timeout(void *arg)
+{
+	mdcache_entry_t *entry = arg;
+	struct mdc_gather *g = entry->gather;
+	struct state_t *state;
+	struct gsh_export *export;
+
+	PTHREAD_MUTEX_lock(&g->mtx);
+	g->timer = false;
+	gather_flush_locked(entry, g, &state, &export);
+	PTHREAD_MUTEX_unlock(&g->mtx);
+
+	gather_release(state, export);
+	mdcache_put(entry);
+}
+
+/**
+ * @brief Write out any gathered run of a file
+ *
+ * @param[in] entry  The file
+ * @param[in] reset  Clear the error held for COMMIT
+ *
+ * @return The first error writing a run since the last reset.
+ */
+static fsal_status_t gather_flush(mdcache_entry_t *entry, bool reset)
+{
+	struct mdc_gather *g = atomic_fetch_voidptr((void **)&entry->gather);
+	fsal_status_t status = fsalstat(ERR_FSAL_NO_ERROR, 0);
+	struct state_t *state;
+	struct gsh_export *export;
+
+	if (g == NULL)
+		return status;
+
+	PTHREAD_MUTEX_lock(&g->mtx);
+	gather_flush_locked(entry, g, &state, &export);
+	status = g->error;
+	if (reset)
+		g->error = fsalstat(ERR_FSAL_NO_ERROR, 0);
+	PTHREAD_MUTEX_unlock(&g->mtx);
+
+	gather_release(state, export);
+
+	return status;
+}
+
+void mdc_gather_flush(mdcache_entry_t *entry)
+{
+	(void) gather_flush(entry, false);
+}
+
+fsal_status_t mdc_gather_commit(mdcache_entry_t *entry)
+{
+	return gather_flush(entry, true);
+}
+
+static bool gather_matches(struct mdc_gather *g, bool bypass,
+			   struct state_t *state, uint64_t offset,
+			   size_t size)
+{
+	return g->armed && g->bypass == bypass && g->state == state &&
+	       g->export == op_ctx->ctx_export &&
+	       g->uid == op_ctx->creds->caller_uid &&
+	       g->gid == op_ctx->creds->caller_gid &&
+	       g->next == offset && g->iovcnt < GATHER_MAX_IOV &&
+	       g->len + size <= mdcache_param.gather_size;
+}
+
+/**
+ * @brief Gather a write into the file's run if it continues it
+ *
+ * A write that does not continue the run flushes it, and must then be
+ * passed to the sub-FSAL.
+ *
+ * @param[in] entry   The file
+ * @param[in] bypass  As for write2
+ * @param[in] state   As for write2
+ * @param[in] offset  As for write2
+ * @param[in] size    As for write2
+ * @param[in] buffer  As for write2
+ * @param[in] stable  The client asked for a stable write
+ * @param[in] info    As for write2
+ *
+ * @retval true if the write was gathered.
+ * @retval false if it must be written.
+ */
+bool mdc_gather_write(mdcache_entry_t *entry, bool bypass,
+		      struct state_t *state, uint64_t offset, size_t size,
+		      void *buffer, bool stable, struct io_info *info)
+{
+	struct mdc_gather *g = atomic_fetch_voidptr((void **)&entry->gather);
+	struct state_t *old_state;
+	struct gsh_export *old_export;
+	void *copy;
+
+	if (g == NULL)
+		return false;
+
+	PTHREAD_MUTEX_lock(&g->mtx);
+
+	if (size == 0 || stable || info != NULL ||
+	    !gather_matches(g, bypass, state, offset, size)) {
+		gather_flush_locked(entry, g, &old_state, &old_export);
+		PTHREAD_MUTEX_unlock(&g->mtx);
+		gather_release(old_state, old_export);
+		return false;
+	}
+
+	copy = gsh_malloc(size);
+	memcpy(copy, buffer, size);
+
+	if (g->len == 0)
+		g->offset = offset;
+	g->iov[g->iovcnt].iov_base = copy;
+	g->iov[g->iovcnt].iov_len = size;
+	g->iovcnt++;
+	g->len += size;
+	g->next = offset + size;
+
+	PTHREAD_MUTEX_unlock(&g->mtx);
+
+	return true;
+}
+
+/**
+ * @brief Open a run after a write that reached the sub-FSAL
+ *
+ * @param[in] entry   The file
+ * @param[in] bypass  As for write2
+ * @param[in] state   As for write2
+ * @param[in] next    Where the write ended
+ */
+void mdc_gather_arm(mdcache_entry_t *entry, bool bypass,
+		    struct state_t *state, uint64_t next)
+{
+	struct mdc_gather *g = atomic_fetch_voidptr((void **)&entry->gather);
+	struct state_t *old_state;
+	struct gsh_export *old_export;
+
+	if (g == NULL) {
+		PTHREAD_RWLOCK_wrlock(&entry->attr_lock);
+		g = entry->gather;
+		if (g == NULL) {
+			g = gsh_calloc(1, sizeof(*g));
+			PTHREAD_MUTEX_init(&g->mtx, NULL);
+			atomic_store_voidptr((void **)&entry->gather, g);
+		}
+		PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+	}
+
+	PTHREAD_MUTEX_lock(&g->mtx);
+
+	/* Another write may have armed it meanwhile */
+	gather_flush_locked(entry, g, &old_state, &old_export);
+
+	if (!g->timer) {
+		if (FSAL_IS_ERROR(mdcache_get(entry)))
+			goto out;
+		if (delayed_submit(gather_timeout, entry,
+				   mdcache_param.gather_window *
+				   NS_PER_MSEC) != 0) {
+			mdcache_put(entry);
+			goto out;
+		}
+		g->timer = true;
+	}
+
+	if (state != NULL)
+		inc_state_t_ref(state);
+	get_gsh_export_ref(op_ctx->ctx_export);
+
+	g->armed = true;
+	g->bypass = bypass;
+	g->state = state;
+	g->export = op_ctx->ctx_export;
+	g->fsal_export = op_ctx->fsal_export;
+	g->uid = op_ctx->creds->caller_uid;
+	g->gid = op_ctx->creds->caller_gid;
+	g->nfs_vers = op_ctx->nfs_vers;
+	g->nfs_minorvers = op_ctx->nfs_minorvers;
+	g->next = next;
+
+out:
+	PTHREAD_MUTEX_unlock(&g->mtx);
+
+	gather_release(old_state, old_export);
+}
+
+/**
+ * @brief Free a file's gather state as its entry is cleaned
+ *
+ * No timer can be pending, since it would hold a reference.
+ *
+ * @param[in] entry  The file
+ */
+void mdc_gather_free(mdcache_entry_t *entry)
+{
+	struct mdc_gather *g = entry->gather;
+
+	if (g == NULL)
+		return;
+
+	mdc_gather_flush(entry);
+	PTHREAD_MUTEX_destroy(&g->mtx);
+	gsh_free(g);
+	entry->gather = NULL;
+}
+
+/** @} */
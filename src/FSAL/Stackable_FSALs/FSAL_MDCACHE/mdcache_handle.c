@@ -52,7 +52,14 @@
  * This function is a wrapper of mdcache_alloc_handle. It adds error checking
  * and logging. It also cleans objects allocated in the subfsal if it fails.
  *
- * @note the caller must hold the content lock on the parent.
+ * Unless @a locked, the entry is made under the name lock of @a name
+ * in @a parent, with no lock on the parent itself, and the parent's
+ * content lock is only taken to add the dirent.  So creates of other
+ * names in the directory go on in parallel, and those of the same
+ * name or a remove of it are kept in order.
+ *
+ * @note With @a locked, the caller holds the content lock on the
+ * parent for write.
  *
  * This does not cause an ABBA lock conflict with the potential getattrs
  * if we lose a race to create the cache entry since our caller CAN NOT hold
@@ -67,8 +74,9 @@
  * @param[in,out] attrs_out      Optional attributes for newly created object.
  * @param[in]     parent         Parent directory to add dirent to.
  * @param[in]     name           Name of the dirent to add.
- * @param[in]     invalidate     Invalidate parent attr.
+ * @param[in]     invalidate     Name was created, invalidate parent attr.
  * @param[in]     state          Optional state_t representing open file.
+ * @param[in]     locked         The parent's content lock is held.
  *
  * @note This returns an INITIAL ref'd entry on success
  *
@@ -85,17 +93,22 @@ fsal_status_t mdcache_alloc_and_check_handle(
 		mdcache_entry_t *parent,
 		const char *name,
 		bool invalidate,
-		struct state_t *state)
+		struct state_t *state,
+		bool locked)
 {
 	fsal_status_t status;
 	mdcache_entry_t *new_entry;
+	pthread_mutex_t *name_lock = NULL;
+
+	if (!locked)
+		name_lock = mdc_name_lock(parent, name);
 
 	status = mdcache_new_entry(export, sub_handle, attrs_in, attrs_out,
 				   new_directory, &new_entry, state);
 
 	if (FSAL_IS_ERROR(status)) {
 		*new_obj = NULL;
-		return status;
+		goto out;
 	}
 
 	LogFullDebug(COMPONENT_CACHE_INODE,
@@ -109,9 +122,22 @@ fsal_status_t mdcache_alloc_and_check_handle(
 		 */
 		atomic_clear_uint32_t_bits(&parent->mde_flags,
 					   MDCACHE_TRUST_ATTRS);
+		mdc_cluster_invalidate(parent, MDC_CLUSTER_NAMESPACE);
+	}
+
+	if (!locked)
+		PTHREAD_RWLOCK_wrlock(&parent->content_lock);
+
+	status = mdcache_dirent_add(parent, name, new_entry, invalidate);
+
+	if (!FSAL_IS_ERROR(status) &&
+	    new_entry->obj_handle.type == DIRECTORY) {
+		/* Insert Parent's key */
+		mdc_dir_add_parent(new_entry, parent);
 	}
 
-	status = mdcache_dirent_add(parent, name, new_entry);
+	if (!locked)
+		PTHREAD_RWLOCK_unlock(&parent->content_lock);
 
 	if (FSAL_IS_ERROR(status)) {
 		LogDebug(COMPONENT_CACHE_INODE,
@@ -120,12 +146,7 @@ fsal_status_t mdcache_alloc_and_check_handle(
 
 		mdcache_put(new_entry);
 		*new_obj = NULL;
-		return status;
-	}
-
-	if (new_entry->obj_handle.type == DIRECTORY) {
-		/* Insert Parent's key */
-		mdc_dir_add_parent(new_entry, parent);
+		goto out;
 	}
 
 	*new_obj = &new_entry->obj_handle;
@@ -135,6 +156,10 @@ fsal_status_t mdcache_alloc_and_check_handle(
 			    tag, attrs_out, true);
 	}
 
+out:
+	if (name_lock != NULL)
+		PTHREAD_MUTEX_unlock(name_lock);
+
 	return status;
 }
 
@@ -170,6 +195,122 @@ static fsal_status_t mdcache_lookup(struct fsal_obj_handle *parent,
 	return status;
 }
 
+/**
+ * @brief Look up a chain of names
+ *
+ * The names already cached are found in the cache.  The rest go to the
+ * sub-FSAL in one lookup_multi, and an entry and a dirent are made for
+ * each level it found.
+ *
+ * @param[in]     dir_hdl   Directory to start from
+ * @param[in]     names     Names to look up, one per level
+ * @param[in]     count     Number of names
+ * @param[out]    handles   Entries found, one per name
+ * @param[in,out] attrs_out Optional attributes, one per name
+ * @param[out]    found     Number of entries found
+ *
+ * @note This returns an INITIAL ref'd entry for each found
+ * @return FSAL status
+ */
+static fsal_status_t mdcache_lookup_multi(struct fsal_obj_handle *dir_hdl,
+					  const char * const *names,
+					  uint32_t count,
+					  struct fsal_obj_handle **handles,
+					  struct attrlist *attrs_out,
+					  uint32_t *found)
+{
+	mdcache_entry_t *dir =
+		container_of(dir_hdl, mdcache_entry_t, obj_handle);
+	struct mdcache_fsal_export *export = mdc_cur_export();
+	struct fsal_obj_handle *sub_handles[FSAL_LOOKUP_MULTI_MAX];
+	struct attrlist attrs[FSAL_LOOKUP_MULTI_MAX];
+	struct fsal_obj_handle *new_obj;
+	mdcache_entry_t *entry;
+	fsal_status_t status, add_status = {0, 0};
+	uint32_t cached, sub_found = 0, i;
+	attrmask_t mask;
+
+	*found = 0;
+
+	if (count > FSAL_LOOKUP_MULTI_MAX)
+		count = FSAL_LOOKUP_MULTI_MAX;
+
+	/* Walk the cache as far as it goes */
+	for (cached = 0; cached < count; cached++) {
+		status = mdc_lookup(dir, names[cached], false, &entry,
+				    attrs_out != NULL
+					? &attrs_out[cached]
+					: NULL);
+
+		if (FSAL_IS_ERROR(status))
+			break;
+
+		handles[(*found)++] = &entry->obj_handle;
+		dir = entry;
+
+		if (cached + 1 < count &&
+		    entry->obj_handle.type != DIRECTORY)
+			return fsalstat(ERR_FSAL_NOTDIR, 0);
+	}
+
+	if (cached == count)
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+	mask = op_ctx->fsal_export->exp_ops.fs_supported_attrs(
+							op_ctx->fsal_export);
+	for (i = 0; i < count - cached; i++)
+		fsal_prepare_attrs(&attrs[i], mask);
+
+	subcall(
+		status = dir->sub_handle->obj_ops.lookup_multi(
+			dir->sub_handle, names + cached, count - cached,
+			sub_handles, attrs, &sub_found)
+	       );
+
+	for (i = 0; i < sub_found; i++) {
+		if (FSAL_IS_ERROR(add_status)) {
+			/* A level above is not cached, drop the rest */
+			subcall(
+				sub_handles[i]->obj_ops.release(sub_handles[i])
+			       );
+			continue;
+		}
+
+		PTHREAD_RWLOCK_wrlock(&dir->content_lock);
+
+		if (!(dir->mde_flags & MDCACHE_TRUST_CONTENT)) {
+			/* As in mdc_lookup, the content is invalid, so empty
+			 * it out before caching the result of the lookup.
+			 */
+			mdcache_dirent_invalidate_all(dir);
+		}
+
+		add_status = mdcache_alloc_and_check_handle(
+				export, sub_handles[i], &new_obj, false,
+				&attrs[i],
+				attrs_out != NULL
+					? &attrs_out[cached + i]
+					: NULL,
+				"lookup_multi ", dir, names[cached + i],
+				false, NULL, true);
+
+		PTHREAD_RWLOCK_unlock(&dir->content_lock);
+
+		if (FSAL_IS_ERROR(add_status)) {
+			status = add_status;
+			continue;
+		}
+
+		handles[(*found)++] = new_obj;
+		dir = container_of(new_obj, mdcache_entry_t, obj_handle);
+	}
+
+	for (i = 0; i < count - cached; i++)
+		fsal_release_attrs(&attrs[i]);
+
+	return status;
+}
+
 /**
  * @brief Create a file
  *
@@ -219,14 +360,10 @@ static fsal_status_t mdcache_create(struct fsal_obj_handle *dir_hdl,
 		return status;
 	}
 
-	PTHREAD_RWLOCK_wrlock(&parent->content_lock);
-
 	status = mdcache_alloc_and_check_handle(export, sub_handle, new_obj,
 						false, &attrs, attrs_out,
 						"create ", parent, name, true,
-						NULL);
-
-	PTHREAD_RWLOCK_unlock(&parent->content_lock);
+						NULL, false);
 
 	fsal_release_attrs(&attrs);
 
@@ -284,14 +421,10 @@ static fsal_status_t mdcache_mkdir(struct fsal_obj_handle *dir_hdl,
 		return status;
 	}
 
-	PTHREAD_RWLOCK_wrlock(&parent->content_lock);
-
 	status = mdcache_alloc_and_check_handle(export, sub_handle, handle,
 						true, &attrs, attrs_out,
 						"mkdir ", parent, name, true,
-						NULL);
-
-	PTHREAD_RWLOCK_unlock(&parent->content_lock);
+						NULL, false);
 
 	fsal_release_attrs(&attrs);
 
@@ -354,14 +487,10 @@ static fsal_status_t mdcache_mknode(struct fsal_obj_handle *dir_hdl,
 		return status;
 	}
 
-	PTHREAD_RWLOCK_wrlock(&parent->content_lock);
-
 	status = mdcache_alloc_and_check_handle(export, sub_handle, handle,
 						false, &attrs, attrs_out,
 						"mknode ", parent, name, true,
-						NULL);
-
-	PTHREAD_RWLOCK_unlock(&parent->content_lock);
+						NULL, false);
 
 	fsal_release_attrs(&attrs);
 
@@ -422,14 +551,10 @@ static fsal_status_t mdcache_symlink(struct fsal_obj_handle *dir_hdl,
 		return status;
 	}
 
-	PTHREAD_RWLOCK_wrlock(&parent->content_lock);
-
 	status = mdcache_alloc_and_check_handle(export, sub_handle, handle,
 						false, &attrs, attrs_out,
 						"symlink ", parent, name, true,
-						NULL);
-
-	PTHREAD_RWLOCK_unlock(&parent->content_lock);
+						NULL, false);
 
 	fsal_release_attrs(&attrs);
 
@@ -494,6 +619,7 @@ static fsal_status_t mdcache_link(struct fsal_obj_handle *obj_hdl,
 		container_of(obj_hdl, mdcache_entry_t, obj_handle);
 	mdcache_entry_t *dest =
 		container_of(destdir_hdl, mdcache_entry_t, obj_handle);
+	pthread_mutex_t *name_lock;
 	fsal_status_t status;
 
 	subcall(
@@ -507,18 +633,158 @@ static fsal_status_t mdcache_link(struct fsal_obj_handle *obj_hdl,
 		return status;
 	}
 
+	name_lock = mdc_name_lock(dest, name);
 	PTHREAD_RWLOCK_wrlock(&dest->content_lock);
 
 	/* Add this entry to the directory (also takes an internal ref)
 	 */
-	status = mdcache_dirent_add(dest, name, entry);
+	status = mdcache_dirent_add(dest, name, entry, true);
 
 	PTHREAD_RWLOCK_unlock(&dest->content_lock);
+	PTHREAD_MUTEX_unlock(name_lock);
 
 	/* Invalidate attributes, so refresh will be forced */
 	atomic_clear_uint32_t_bits(&entry->mde_flags, MDCACHE_TRUST_ATTRS);
 	atomic_clear_uint32_t_bits(&dest->mde_flags, MDCACHE_TRUST_ATTRS);
+	mdc_cluster_invalidate(entry, FSAL_UP_INVALIDATE_ATTRS);
+	mdc_cluster_invalidate(dest, MDC_CLUSTER_NAMESPACE);
+
+	return status;
+}
+
+/**
+ * @brief Refresh the attributes of the next window of dirents
+ *
+ * @param[in] node      The first dirent of the window
+ * @param[in] attrmask  Attributes the caller will hand out
+ *
+ * @return The number of dirents covered.
+ */
+static uint32_t mdc_readdir_prefetch(struct avltree_node *node,
+				     attrmask_t attrmask)
+{
+	struct mdc_prefetch pf;
+	mdcache_dir_entry_t *dirent;
+	uint32_t count;
+
+	mdc_prefetch_init(&pf, attrmask);
+	for (count = 0; node != NULL && count < mdcache_param.prefetch_window;
+	     node = avltree_next(node), count++) {
+		dirent = avltree_container_of(node, mdcache_dir_entry_t,
+					      node_hk);
+		mdc_prefetch_add(&pf, &dirent->ckey);
+	}
+	mdc_prefetch_wait(&pf);
+
+	return count;
+}
+
+/**
+ * @brief Refresh the attributes of the next window of packed dirents
+ *
+ * @param[in] directory The directory, packed
+ * @param[in] pos       Position of the first dirent of the window
+ * @param[in] attrmask  Attributes the caller will hand out
+ *
+ * @return The number of dirents covered.
+ */
+static uint32_t mdc_readdir_packed_prefetch(mdcache_entry_t *directory,
+					    uint32_t pos, attrmask_t attrmask)
+{
+	uint32_t total = mdcache_dirpack_count(directory);
+	struct mdcache_dirpack_ent ent;
+	struct mdc_prefetch pf;
+	uint32_t count;
+
+	mdc_prefetch_init(&pf, attrmask);
+	for (count = 0; pos < total && count < mdcache_param.prefetch_window;
+	     pos++, count++) {
+		mdcache_dirpack_get(directory, pos, &ent);
+		mdc_prefetch_add(&pf, &ent.ckey);
+	}
+	mdc_prefetch_wait(&pf);
+
+	return count;
+}
+
+/**
+ * @brief Read the contents of a packed directory
+ *
+ * As the walk of the dirent tree in mdcache_readdir, the cookies are
+ * the same.
+ *
+ * @note The content_lock MUST be held for read, it is released
+ *
+ * @return FSAL status
+ */
+static fsal_status_t mdcache_readdir_packed(mdcache_entry_t *directory,
+					    fsal_cookie_t whence,
+					    void *dir_state, fsal_readdir_cb cb,
+					    attrmask_t attrmask, bool *eod_met)
+{
+	uint32_t count = mdcache_dirpack_count(directory);
+	struct mdcache_dirpack_ent ent;
+	fsal_status_t status = {0, 0};
+	bool cb_result = true;
+	uint32_t ahead = 0;
+	uint32_t pos = 0;
 
+	*eod_met = false;
+
+	if (whence > 0) {
+		if (whence < 3 ||
+		    !mdcache_dirpack_seek(directory, whence, &pos)) {
+			LogFullDebug(COMPONENT_NFS_READDIR,
+				     "seek to cookie=%" PRIu64 " fail", whence);
+			status = fsalstat(ERR_FSAL_BADCOOKIE, 0);
+			goto unlock_dir;
+		}
+		if (++pos == count) {
+			LogFullDebug(COMPONENT_NFS_READDIR,
+				     "EOD because empty result");
+			*eod_met = true;
+			status = fsalstat(ERR_FSAL_NOENT, 0);
+			goto unlock_dir;
+		}
+	}
+
+	for (; cb_result && pos < count; pos++) {
+		mdcache_entry_t *entry = NULL;
+
+		if (ahead == 0 && mdc_prefetch_enabled(attrmask))
+			ahead = mdc_readdir_packed_prefetch(directory, pos,
+							    attrmask);
+		if (ahead != 0)
+			ahead--;
+
+		mdcache_dirpack_get(directory, pos, &ent);
+		status = mdcache_find_keyed(&ent.ckey, &entry);
+		if (FSAL_IS_ERROR(status)) {
+			status = mdc_lookup_uncached(directory, ent.name,
+						     &entry, NULL);
+		}
+		if (FSAL_IS_ERROR(status)) {
+			if (status.major == ERR_FSAL_STALE) {
+				PTHREAD_RWLOCK_unlock(&directory->content_lock);
+				mdcache_kill_entry(directory);
+				return status;
+			}
+			LogFullDebug(COMPONENT_NFS_READDIR,
+				     "lookup failed status=%s",
+				     fsal_err_txt(status));
+			goto unlock_dir;
+		}
+
+		cb_result = cb(ent.name, &entry->obj_handle, &entry->attrs,
+			       dir_state, ent.cookie);
+
+		mdcache_put(entry);
+	}
+
+	*eod_met = pos >= count && cb_result;
+
+unlock_dir:
+	PTHREAD_RWLOCK_unlock(&directory->content_lock);
 	return status;
 }
 
@@ -526,7 +792,8 @@ static fsal_status_t mdcache_link(struct fsal_obj_handle *obj_hdl,
  * Read the contents of a dirctory
  *
  * If necessary, populate the dirent cache from the underlying FSAL.  Then, walk
- * the dirent cache calling the callback.
+ * the dirent cache calling the callback.  With Dir_Chunk set, directories
+ * not known in full are read and cached a chunk at a time instead.
  *
  * @param dir_hdl [IN] the directory to read
  * @param whence [IN] where to start (next)
@@ -548,10 +815,20 @@ static fsal_status_t mdcache_readdir(struct fsal_obj_handle *dir_hdl,
 	struct avltree_node *dirent_node;
 	fsal_status_t status = {0, 0};
 	bool cb_result = true;
+	uint32_t ahead = 0;
+
+	if (mdcache_param.dir.avl_chunk != 0 &&
+	    !mdc_dircache_trusted(directory))
+		return mdcache_readdir_chunked(directory, *whence, dir_state,
+					       cb, attrmask, eod_met);
 
 	if (!mdc_dircache_trusted(directory)) {
 		PTHREAD_RWLOCK_wrlock(&directory->content_lock);
-		status = mdcache_dirent_populate(directory);
+		/* A caller that hands out no attributes need not wait
+		 * for them
+		 */
+		status = mdcache_dirent_populate(
+				directory, (attrmask & ~ATTR_RDATTR_ERR) == 0);
 		PTHREAD_RWLOCK_unlock(&directory->content_lock);
 		if (FSAL_IS_ERROR(status)) {
 			if (status.major == ERR_FSAL_STALE) {
@@ -567,6 +844,10 @@ static fsal_status_t mdcache_readdir(struct fsal_obj_handle *dir_hdl,
 	}
 
 	PTHREAD_RWLOCK_rdlock(&directory->content_lock);
+	if (directory->fsobj.fsdir.pack != NULL)
+		return mdcache_readdir_packed(directory, *whence, dir_state,
+					      cb, attrmask, eod_met);
+
 	/* Get initial starting position */
 	if (*whence > 0) {
 		/* Not a full directory walk */
@@ -619,6 +900,11 @@ static fsal_status_t mdcache_readdir(struct fsal_obj_handle *dir_hdl,
 					      mdcache_dir_entry_t,
 					      node_hk);
 
+		if (ahead == 0 && mdc_prefetch_enabled(attrmask))
+			ahead = mdc_readdir_prefetch(dirent_node, attrmask);
+		if (ahead != 0)
+			ahead--;
+
 		/* Get actual entry */
 		status = mdc_try_get_cached(directory, dirent->name, &entry);
 
@@ -731,6 +1017,7 @@ static fsal_status_t mdcache_rename(struct fsal_obj_handle *obj_hdl,
 	mdcache_entry_t *mdc_obj =
 		container_of(obj_hdl, mdcache_entry_t, obj_handle);
 	mdcache_entry_t *mdc_lookup_dst = NULL;
+	pthread_mutex_t *name_lock1, *name_lock2;
 	fsal_status_t status;
 
 	status = mdc_try_get_cached(mdc_newdir, new_name, &mdc_lookup_dst);
@@ -758,18 +1045,36 @@ static fsal_status_t mdcache_rename(struct fsal_obj_handle *obj_hdl,
 					   MDCACHE_TRUST_ATTRS);
 	}
 
-	/* Now update cached dirents.  Must take locks in the correct order */
+	mdc_cluster_invalidate(mdc_obj, FSAL_UP_INVALIDATE_ATTRS);
+	mdc_cluster_invalidate(mdc_olddir, MDC_CLUSTER_NAMESPACE);
+	if (olddir_hdl != newdir_hdl)
+		mdc_cluster_invalidate(mdc_newdir, MDC_CLUSTER_NAMESPACE);
+	if (mdc_lookup_dst)
+		mdc_cluster_invalidate(mdc_lookup_dst,
+				       FSAL_UP_INVALIDATE_ATTRS);
+
+	/* Now update cached dirents.  The name locks keep them in order
+	 * with creates and removes of the two names.  Must take locks in
+	 * the correct order.
+	 */
+	mdc_name_lock_pair(mdc_olddir, old_name, mdc_newdir, new_name,
+			   &name_lock1, &name_lock2);
 	mdcache_src_dest_lock(mdc_olddir, mdc_newdir);
 
 	if (mdc_lookup_dst) {
-		/* Remove the entry from parent dir_entries avl */
-		status = mdcache_dirent_remove(mdc_newdir, new_name);
-
-		if (FSAL_IS_ERROR(status)) {
-			LogDebug(COMPONENT_CACHE_INODE,
-				 "remove entry failed with status %s",
-				 fsal_err_txt(status));
-			mdcache_dirent_invalidate_all(mdc_newdir);
+		/* Within one directory, mdcache_dirent_rename reuses the
+		 * dirent of the replaced name.
+		 */
+		if (mdc_olddir != mdc_newdir) {
+			/* Remove the entry from parent dir_entries avl */
+			status = mdcache_dirent_remove(mdc_newdir, new_name);
+
+			if (FSAL_IS_ERROR(status)) {
+				LogDebug(COMPONENT_CACHE_INODE,
+					 "remove entry failed with status %s",
+					 fsal_err_txt(status));
+				mdcache_dirent_invalidate_all(mdc_newdir);
+			}
 		}
 
 		/* Mark unreachable */
@@ -808,7 +1113,8 @@ static fsal_status_t mdcache_rename(struct fsal_obj_handle *obj_hdl,
 			mdcache_dirent_invalidate_all(mdc_newdir);
 		}
 
-		status = mdcache_dirent_add(mdc_newdir, new_name, mdc_obj);
+		status = mdcache_dirent_add(mdc_newdir, new_name, mdc_obj,
+					    true);
 
 		if (FSAL_IS_ERROR(status)) {
 			/* We're obviously out of date.  Throw out the cached
@@ -830,6 +1136,9 @@ static fsal_status_t mdcache_rename(struct fsal_obj_handle *obj_hdl,
 
 	/* unlock entries */
 	mdcache_src_dest_unlock(mdc_olddir, mdc_newdir);
+	if (name_lock2 != NULL)
+		PTHREAD_MUTEX_unlock(name_lock2);
+	PTHREAD_MUTEX_unlock(name_lock1);
 
 out:
 	if (mdc_lookup_dst)
@@ -866,6 +1175,9 @@ fsal_status_t mdcache_refresh_attrs(mdcache_entry_t *entry, bool need_acl)
 		attrs.mask &= ~ATTR_ACL;
 	}
 
+	/* The size and times must include anything gathered */
+	mdc_gather_flush(entry);
+
 	subcall(
 		status = entry->sub_handle->obj_ops.getattrs(
 			entry->sub_handle, &attrs)
@@ -878,6 +1190,25 @@ fsal_status_t mdcache_refresh_attrs(mdcache_entry_t *entry, bool need_acl)
 		return status;
 	}
 
+	mdcache_install_attrs(entry, &attrs, need_acl);
+
+	return status;
+}
+
+/**
+ * @brief Move freshly fetched attributes into an entry
+ *
+ * NOTE: Caller must hold the attribute lock, and must have held it since
+ *       before the attributes were fetched.
+ *
+ * @param[in] entry     The mdcache entry
+ * @param[in] attrs     Its attributes, as the sub-FSAL gave them, consumed
+ * @param[in] need_acl  Whether the ACL was asked for
+ */
+
+void mdcache_install_attrs(mdcache_entry_t *entry, struct attrlist *attrs,
+			   bool need_acl)
+{
 	if (entry->attrs.acl != NULL) {
 		/* We used to have an ACL... */
 		if (need_acl) {
@@ -889,34 +1220,79 @@ fsal_status_t mdcache_refresh_attrs(mdcache_entry_t *entry, bool need_acl)
 			/* The ACL wasn't requested, move it into the
 			 * new attributes so we will retain it.
 			 */
-			attrs.acl = entry->attrs.acl;
-			attrs.mask |= ATTR_ACL;
+			attrs->acl = entry->attrs.acl;
+			attrs->mask |= ATTR_ACL;
 		}
 
 		/* ACL was released or moved to new attributes. */
 		entry->attrs.acl = NULL;
 	}
 
-	if (attrs.expire_time_attr == 0) {
+	if (attrs->expire_time_attr == 0) {
 		/* FSAL did not set this, retain what was in the entry. */
-		attrs.expire_time_attr = entry->attrs.expire_time_attr;
+		attrs->expire_time_attr = entry->attrs.expire_time_attr;
 	}
 
 	/* Now move the new attributes into the entry. */
-	fsal_copy_attrs(&entry->attrs, &attrs, true);
+	fsal_copy_attrs(&entry->attrs, attrs, true);
+	mdcache_lru_recharge(entry);
 
 	/* Done with the attrs (we didn't need to call this since the
 	 * fsal_copy_attrs preceding consumed all the references, but we
 	 * release them anyway to make it easy to scan the code for correctness.
 	 */
-	fsal_release_attrs(&attrs);
+	fsal_release_attrs(attrs);
 
-	mdc_fixup_md(entry, attrs.mask);
+	mdc_fixup_md(entry, attrs->mask);
 
 	LogAttrlist(COMPONENT_CACHE_INODE, NIV_FULL_DEBUG,
 		    "attrs ", &entry->attrs, true);
+}
 
-	return status;
+/**
+ * @brief Keep expired attributes if their change attribute has not moved
+ *
+ * Only attributes that merely expired are kept this way: not the ACL,
+ * nor ones an invalidation dropped.  FSALs that cannot get the change
+ * attribute alone return ERR_FSAL_NOTSUPP, and the attributes are
+ * refreshed as usual.
+ *
+ * @note the caller MUST hold attr_lock for write
+ *
+ * @param[in] entry The entry
+ * @param[in] mask  Attributes asked for
+ *
+ * @return true if the cached attributes are current.
+ */
+static bool mdcache_revalidate_change(mdcache_entry_t *entry,
+				      attrmask_t mask)
+{
+	fsal_status_t status;
+	uint64_t change;
+
+	if (!mdcache_param.revalidate_change || (mask & ATTR_ACL) != 0 ||
+	    !(entry->mde_flags & MDCACHE_TRUST_ATTRS) ||
+	    FSAL_TEST_MASK(entry->attrs.mask, ATTR_RDATTR_ERR) ||
+	    !FSAL_TEST_MASK(entry->attrs.mask, ATTR_CHANGE) ||
+	    (entry->obj_handle.type == DIRECTORY &&
+	     mdcache_param.getattr_dir_invalidation))
+		return false;
+
+	/* What is gathered would move it */
+	mdc_gather_flush(entry);
+
+	subcall(
+		status = entry->sub_handle->obj_ops.getattr_change(
+			entry->sub_handle, &change)
+	       );
+
+	if (FSAL_IS_ERROR(status) || change != entry->attrs.change)
+		return false;
+
+	entry->attr_time = time(NULL);
+	(void) atomic_inc_uint64_t(&cache_stp->inode_change_trust);
+
+	return true;
 }
 
 /**
@@ -939,7 +1315,7 @@ static fsal_status_t mdcache_getattrs(struct fsal_obj_handle *obj_hdl,
 
 	PTHREAD_RWLOCK_rdlock(&entry->attr_lock);
 
-	if (mdcache_is_attrs_valid(entry, attrs_out->mask)) {
+	if (mdcache_attrs_valid_or_refresh(entry, attrs_out->mask)) {
 		/* Up-to-date */
 		goto unlock;
 	}
@@ -948,11 +1324,14 @@ static fsal_status_t mdcache_getattrs(struct fsal_obj_handle *obj_hdl,
 	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
 	PTHREAD_RWLOCK_wrlock(&entry->attr_lock);
 
-	if (mdcache_is_attrs_valid(entry, attrs_out->mask)) {
+	if (mdcache_attrs_valid_or_refresh(entry, attrs_out->mask)) {
 		/* Someone beat us to it */
 		goto unlock;
 	}
 
+	if (mdcache_revalidate_change(entry, attrs_out->mask))
+		goto unlock;
+
 	/* Use this to detect if we should invalidate a directory. */
 	oldmtime = entry->attrs.mtime.tv_sec;
 
@@ -1010,6 +1389,8 @@ static fsal_status_t mdcache_setattrs(struct fsal_obj_handle *obj_hdl,
 	fsal_status_t status;
 	uint64_t change;
 
+	mdc_gather_flush(entry);
+
 	PTHREAD_RWLOCK_wrlock(&entry->attr_lock);
 
 	change = entry->attrs.change;
@@ -1070,6 +1451,8 @@ static fsal_status_t mdcache_setattr2(struct fsal_obj_handle *obj_hdl,
 	fsal_status_t status;
 	uint64_t change;
 
+	mdc_gather_flush(entry);
+
 	PTHREAD_RWLOCK_wrlock(&entry->attr_lock);
 
 	change = entry->attrs.change;
@@ -1082,6 +1465,12 @@ static fsal_status_t mdcache_setattr2(struct fsal_obj_handle *obj_hdl,
 	if (FSAL_IS_ERROR(status))
 		goto unlock;
 
+	/* Modes, owners and ACLs may be kept in xattrs */
+	mdc_xattr_invalidate(entry);
+	mdc_cluster_invalidate(entry, FSAL_UP_INVALIDATE_ATTRS |
+				      FSAL_UP_INVALIDATE_ACL |
+				      FSAL_UP_INVALIDATE_XATTRS);
+
 	status = mdcache_refresh_attrs(entry, (attrs->mask & ATTR_ACL) != 0);
 
 	if (!FSAL_IS_ERROR(status) && change == entry->attrs.change) {
@@ -1120,6 +1509,7 @@ static fsal_status_t mdcache_unlink(struct fsal_obj_handle *dir_hdl,
 		container_of(dir_hdl, mdcache_entry_t, obj_handle);
 	mdcache_entry_t *entry =
 		container_of(obj_hdl, mdcache_entry_t, obj_handle);
+	pthread_mutex_t *name_lock;
 	fsal_status_t status;
 
 	subcall(
@@ -1131,9 +1521,11 @@ static fsal_status_t mdcache_unlink(struct fsal_obj_handle *dir_hdl,
 		     "Unlink %p/%s (%p)",
 		     parent, name, entry);
 
+	name_lock = mdc_name_lock(parent, name);
 	PTHREAD_RWLOCK_wrlock(&parent->content_lock);
 	(void)mdcache_dirent_remove(parent, name);
 	PTHREAD_RWLOCK_unlock(&parent->content_lock);
+	PTHREAD_MUTEX_unlock(name_lock);
 
 
 	if (FSAL_IS_ERROR(status)) {
@@ -1151,6 +1543,8 @@ static fsal_status_t mdcache_unlink(struct fsal_obj_handle *dir_hdl,
 					   MDCACHE_TRUST_ATTRS);
 		atomic_clear_uint32_t_bits(&entry->mde_flags,
 					   MDCACHE_TRUST_ATTRS);
+		mdc_cluster_invalidate(parent, MDC_CLUSTER_NAMESPACE);
+		mdc_cluster_invalidate(entry, FSAL_UP_INVALIDATE_ATTRS);
 	}
 
 	if (entry->obj_handle.type == DIRECTORY)
@@ -1389,6 +1783,33 @@ static nfsstat4 mdcache_layoutcommit(struct fsal_obj_handle *obj_hdl,
 	return status;
 }
 
+/**
+ * @brief Pass a report of layout I/O down
+ *
+ * @param[in] obj_hdl  The object reported on
+ * @param[in] req_ctx  Request context
+ * @param[in] lou_body Layout type-specific report, may be NULL
+ * @param[in] arg      Input arguments of the function
+ *
+ * @return What the sub-FSAL returns.
+ */
+static nfsstat4 mdcache_layout_stats(struct fsal_obj_handle *obj_hdl,
+				     struct req_op_context *req_ctx,
+				     XDR *lou_body,
+				     const struct fsal_layout_stats_arg *arg)
+{
+	mdcache_entry_t *entry =
+		container_of(obj_hdl, mdcache_entry_t, obj_handle);
+	nfsstat4 status;
+
+	subcall(
+		status = entry->sub_handle->obj_ops.layout_stats(
+			entry->sub_handle, req_ctx, lou_body, arg)
+	       );
+
+	return status;
+}
+
 /**
  * @brief Get a reference to the handle
  *
@@ -1504,6 +1925,7 @@ void mdcache_handle_ops_init(struct fsal_obj_ops *ops)
 	ops->layoutget = mdcache_layoutget;
 	ops->layoutreturn = mdcache_layoutreturn;
 	ops->layoutcommit = mdcache_layoutcommit;
+	ops->layout_stats = mdcache_layout_stats;
 
 	/* Multi-FD */
 	ops->open2 = mdcache_open2;
@@ -1511,6 +1933,7 @@ void mdcache_handle_ops_init(struct fsal_obj_ops *ops)
 	ops->status2 = mdcache_status2;
 	ops->reopen2 = mdcache_reopen2;
 	ops->read2 = mdcache_read2;
+	ops->read_buffer = mdcache_read_buffer;
 	ops->write2 = mdcache_write2;
 	ops->seek2 = mdcache_seek2;
 	ops->io_advise2 = mdcache_io_advise2;
@@ -1518,6 +1941,14 @@ void mdcache_handle_ops_init(struct fsal_obj_ops *ops)
 	ops->lock_op2 = mdcache_lock_op2;
 	ops->setattr2 = mdcache_setattr2;
 	ops->close2 = mdcache_close2;
+	ops->copy = mdcache_copy;
+	ops->clone = mdcache_clone;
+	ops->fallocate = mdcache_fallocate;
+	ops->write_vec = mdcache_write_vec;
+	ops->read_vec = mdcache_read_vec;
+	ops->read2_async = mdcache_read2_async;
+	ops->write2_async = mdcache_write2_async;
+	ops->lookup_multi = mdcache_lookup_multi;
 
 	/* xattr related functions */
 	ops->list_ext_attrs = mdcache_list_ext_attrs;
@@ -41,6 +41,7 @@
 #include "log.h"
 #include "mdcache_int.h"
 #include "mdcache_hash.h"
+#include "gsh_numa.h"
 
 /**
  * @addtogroup FSAL_MDCACHE
@@ -71,6 +72,7 @@ cih_pkginit(void)
 {
 	pthread_rwlockattr_t rwlock_attr;
 	cih_partition_t *cp;
+	uint32_t nodes = 1;
 	int ix;
 
 	/* avoid writer starvation */
@@ -84,14 +86,32 @@ cih_pkginit(void)
 	cih_fhcache.partition =
 		gsh_calloc(cih_fhcache.npart, sizeof(cih_partition_t));
 	cih_fhcache.cache_sz = mdcache_param.cache_size;
+	cih_fhcache.oa = mdcache_param.oa_hash;
+
+	/* Lookups by handle come from every node, so the caches are
+	 * spread over the nodes rather than kept on any one.
+	 */
+	if (mdcache_param.numa) {
+		gsh_numa_init();
+		nodes = gsh_numa_nodes();
+	}
+
 	for (ix = 0; ix < cih_fhcache.npart; ++ix) {
 		cp = &cih_fhcache.partition[ix];
 		cp->part_ix = ix;
 		PTHREAD_RWLOCK_init(&cp->lock, &rwlock_attr);
+		if (cih_fhcache.oa) {
+			/* room for a fair share of the high water mark */
+			gsh_oa_init(&cp->oa, mdcache_param.entries_hwmark /
+					     cih_fhcache.npart);
+			continue;
+		}
 		avltree_init(&cp->t, cih_fh_cmpf, 0 /* must be 0 */);
 		cp->cache =
-			gsh_calloc(cih_fhcache.cache_sz,
-				sizeof(struct avltree_node *));
+			gsh_numa_alloc(cih_fhcache.cache_sz *
+				       sizeof(struct avltree_node *),
+				       nodes > 1 ? ix % nodes
+						 : GSH_NUMA_NODE_ANY);
 	}
 	initialized = true;
 }
@@ -107,9 +127,16 @@ cih_pkgdestroy(void)
 
 	/* Destroy the partitions, warning if not empty */
 	for (ix = 0; ix < cih_fhcache.npart; ++ix) {
-		if (avltree_first(&cih_fhcache.partition[ix].t) != NULL)
+		if (cih_fhcache.oa) {
+			if (cih_fhcache.partition[ix].oa.size != 0)
+				LogMajor(COMPONENT_CACHE_INODE,
+					 "Cache inode hash table not empty");
+			gsh_oa_destroy(&cih_fhcache.partition[ix].oa);
+		} else if (avltree_first(&cih_fhcache.partition[ix].t)
+			   != NULL) {
 			LogMajor(COMPONENT_CACHE_INODE,
 				 "Cache inode AVL tree not empty");
+		}
 		PTHREAD_RWLOCK_destroy(&cih_fhcache.partition[ix].lock);
 		gsh_free(cih_fhcache.partition[ix].cache);
 	}
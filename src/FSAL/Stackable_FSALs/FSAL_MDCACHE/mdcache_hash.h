@@ -51,19 +51,22 @@
 #include "gsh_intrinsic.h"
 #include "mdcache_lru.h"
 #include "city.h"
+#include "gsh_oa_hash.h"
 #include <libgen.h>
 
 /**
  * @brief The table partition
  *
  * Each tree is independent, having its own lock, thus reducing thread
- * contention.
+ * contention.  With Open_Addressing_Hash, the open-addressing table oa
+ * replaces both the tree and its cache.
  */
 typedef struct cih_partition {
 	uint32_t part_ix;
 	pthread_rwlock_t lock;
 	struct avltree t;
 	struct avltree_node **cache;
+	struct gsh_oa_hash oa;
 #ifdef ENABLE_LOCKTRACE
 	struct {
 		char *func;
@@ -83,6 +86,7 @@ struct cih_lookup_table {
 	cih_partition_t *partition;
 	uint32_t npart;
 	uint32_t cache_sz;
+	bool oa;		/*< Partitions use open addressing */
 };
 
 /* Support inline lookups */
@@ -187,6 +191,21 @@ cih_fhcache_inline_lookup(const struct avltree *tree,
 	return NULL;
 }
 
+/**
+ * @brief Match an entry in an open-addressing partition
+ *
+ * @param item [in] Entry with the same hash as key
+ * @param key [in] Key being searched for
+ *
+ * @return true if the entry has the key.
+ */
+static inline bool cih_oa_match(const void *item, const void *key)
+{
+	const mdcache_entry_t *entry = item;
+
+	return mdcache_key_cmp(&entry->fh_hk.key, key) == 0;
+}
+
 #define CIH_HASH_NONE           0x0000
 #define CIH_HASH_KEY_PROTOTYPE  0x0001
 
@@ -220,8 +239,7 @@ cih_hash_key(mdcache_key_t *key,
 	}
 
 	/* hash it */
-	key->hk =
-	    CityHash64WithSeed(fh_desc->addr, fh_desc->len, 557);
+	key->hk = CityHash64WithSeed(fh_desc->addr, fh_desc->len, 557);
 
 	return true;
 }
@@ -279,28 +297,31 @@ cih_latch_entry(mdcache_key_t *key, cih_latch_t *latch, uint32_t flags,
 }
 
 /**
- * @brief Lookup cache entry by key
+ * @brief Lookup cache entry by key in its latched partition
  *
- * Lookup cache entry by fh, optionally return with hash partition shared
- * or exclusive locked.  Differs from the fh variant in using the precomputed
- * hash stored with key.
- *
- * @param key [in] Key being searched
- * @param latch [out] Pointer to partition
- * @param flags [in] Flags
+ * @param key [in] Key being searched, of the partition of latch
+ * @param latch [in] Partition, locked
  *
  * @return Pointer to cache entry if found, else NULL
  */
 static inline mdcache_entry_t *
-cih_get_by_key_latch(mdcache_key_t *key, cih_latch_t *latch,
-		       uint32_t flags, const char *func, int line)
+cih_lookup_latched(mdcache_key_t *key, cih_latch_t *latch)
 {
 	mdcache_entry_t k_entry, *entry = NULL;
 	struct avltree_node *node;
 	void **cache_slot;
 
-	if (!cih_latch_entry(key, latch, flags, func, line))
-		return NULL;
+	if (cih_fhcache.oa) {
+		entry = gsh_oa_lookup(&latch->cp->oa, key->hk, cih_oa_match,
+				      key);
+#ifdef USE_LTTNG
+		if (entry)
+			tracepoint(mdcache, cih_hit, key->hk, entry, 0);
+		else
+			tracepoint(mdcache, cih_miss, key->hk);
+#endif
+		return entry;
+	}
 
 	k_entry.fh_hk.key = *key;
 
@@ -314,16 +335,22 @@ cih_get_by_key_latch(mdcache_key_t *key, cih_latch_t *latch,
 			LogDebug(COMPONENT_HASHTABLE_CACHE,
 				 "cih cache hit slot %d",
 				 cih_cache_offsetof(&cih_fhcache, key->hk));
-			goto found;
+			entry = avltree_container_of(node, mdcache_entry_t,
+						     fh_hk.node_k);
+#ifdef USE_LTTNG
+			tracepoint(mdcache, cih_hit, key->hk, entry, 1);
+#endif
+			goto out;
 		}
 	}
 
 	/* check AVL */
 	node = cih_fhcache_inline_lookup(&latch->cp->t, &k_entry.fh_hk.node_k);
 	if (!node) {
-		if (flags & CIH_GET_UNLOCK_ON_MISS)
-			cih_hash_release(latch);
 		LogDebug(COMPONENT_HASHTABLE_CACHE, "fdcache MISS");
+#ifdef USE_LTTNG
+		tracepoint(mdcache, cih_miss, key->hk);
+#endif
 		goto out;
 	}
 
@@ -333,12 +360,43 @@ cih_get_by_key_latch(mdcache_key_t *key, cih_latch_t *latch,
 	LogDebug(COMPONENT_HASHTABLE_CACHE, "cih AVL hit slot %d",
 		 cih_cache_offsetof(&cih_fhcache, key->hk));
 
- found:
 	entry = avltree_container_of(node, mdcache_entry_t, fh_hk.node_k);
+#ifdef USE_LTTNG
+	tracepoint(mdcache, cih_hit, key->hk, entry, 0);
+#endif
  out:
 	return entry;
 }
 
+/**
+ * @brief Lookup cache entry by key
+ *
+ * Lookup cache entry by fh, optionally return with hash partition shared
+ * or exclusive locked.  Differs from the fh variant in using the precomputed
+ * hash stored with key.
+ *
+ * @param key [in] Key being searched
+ * @param latch [out] Pointer to partition
+ * @param flags [in] Flags
+ *
+ * @return Pointer to cache entry if found, else NULL
+ */
+static inline mdcache_entry_t *
+cih_get_by_key_latch(mdcache_key_t *key, cih_latch_t *latch,
+		       uint32_t flags, const char *func, int line)
+{
+	mdcache_entry_t *entry;
+
+	if (!cih_latch_entry(key, latch, flags, func, line))
+		return NULL;
+
+	entry = cih_lookup_latched(key, latch);
+	if (!entry && (flags & CIH_GET_UNLOCK_ON_MISS))
+		cih_hash_release(latch);
+
+	return entry;
+}
+
 #define CIH_SET_NONE     0x0000
 #define CIH_SET_HASHED   0x0001	/* previously hashed entry */
 #define CIH_SET_UNLOCK   0x0002
@@ -369,7 +427,10 @@ cih_set_latched(mdcache_entry_t *entry, cih_latch_t *latch,
 				  fh_desc, CIH_HASH_NONE))
 			return 1;
 
-	(void)avltree_insert(&entry->fh_hk.node_k, &cp->t);
+	if (cih_fhcache.oa)
+		gsh_oa_insert(&cp->oa, entry->fh_hk.key.hk, entry);
+	else
+		(void)avltree_insert(&entry->fh_hk.node_k, &cp->t);
 	entry->fh_hk.inavl = true;
 
 	if (likely(flags & CIH_SET_UNLOCK))
@@ -397,6 +458,16 @@ cih_remove_checked(mdcache_entry_t *entry)
 	bool freed = false;
 
 	PTHREAD_RWLOCK_wrlock(&cp->lock);
+	if (cih_fhcache.oa) {
+		if (entry->fh_hk.inavl &&
+		    gsh_oa_remove(&cp->oa, entry->fh_hk.key.hk, entry)) {
+			entry->fh_hk.inavl = false;
+			/* return sentinel ref */
+			freed = mdcache_lru_unref(entry, LRU_FLAG_NONE);
+		}
+		PTHREAD_RWLOCK_unlock(&cp->lock);
+		return freed;
+	}
 	node = cih_fhcache_inline_lookup(&cp->t, &entry->fh_hk.node_k);
 	if (entry->fh_hk.inavl && node) {
 		avltree_remove(node, &cp->t);
@@ -432,9 +503,15 @@ cih_remove_latched(mdcache_entry_t *entry, cih_latch_t *latch, uint32_t flags)
 	uint32_t lflags = LRU_FLAG_NONE;
 
 	if (entry->fh_hk.inavl) {
-		avltree_remove(&entry->fh_hk.node_k, &cp->t);
-		cp->cache[cih_cache_offsetof(&cih_fhcache,
-					     entry->fh_hk.key.hk)] = NULL;
+		if (cih_fhcache.oa) {
+			(void)gsh_oa_remove(&cp->oa, entry->fh_hk.key.hk,
+					    entry);
+		} else {
+			avltree_remove(&entry->fh_hk.node_k, &cp->t);
+			cp->cache[cih_cache_offsetof(&cih_fhcache,
+						     entry->fh_hk.key.hk)] =
+			    NULL;
+		}
 		entry->fh_hk.inavl = false;
 		if (flags & CIH_REMOVE_QLOCKED)
 			lflags |= LRU_UNREF_QLOCKED;
@@ -49,13 +49,240 @@
 #include "mdcache_lru.h"
 #include "mdcache_hash.h"
 #include "mdcache_avl.h"
+#include "gsh_hash.h"
+#include "gsh_intrinsic.h"
 
-static inline bool trust_negative_cache(mdcache_entry_t *parent)
+/* About 1% false positives */
+#define MDC_FILTER_BITS_PER_NAME 10
+#define MDC_FILTER_PROBES 7
+
+static inline size_t mdc_filter_size(uint32_t nbits)
+{
+	return sizeof(struct dir_filter) + nbits / 8;
+}
+
+/**
+ * @brief Add a name to a directory's filter
+ *
+ * @param[in] filter  The filter
+ * @param[in] name    The name
+ */
+static void mdc_filter_add(struct dir_filter *filter, const char *name)
+{
+	uint64_t h = mdcache_avl_name_hash(name);
+	uint64_t step = (h >> 32) | 1;
+	uint32_t bit, ix;
+
+	if (filter->full)
+		return;
+
+	if (++filter->nnames > filter->nbits / MDC_FILTER_BITS_PER_NAME) {
+		/* Too many false positives to be worth asking */
+		filter->full = true;
+		filter->complete = false;
+		filter->reading = false;
+		return;
+	}
+
+	for (ix = 0; ix < MDC_FILTER_PROBES; ix++, h += step) {
+		bit = h % filter->nbits;
+		filter->bits[bit / 64] |= 1ULL << (bit % 64);
+	}
+}
+
+/**
+ * @brief Check whether a name may be in a directory's filter
+ *
+ * @param[in] filter  The filter
+ * @param[in] name    The name
+ *
+ * @retval false if the name was never added
+ * @retval true if it may have been
+ */
+static bool mdc_filter_has(struct dir_filter *filter, const char *name)
+{
+	uint64_t h = mdcache_avl_name_hash(name);
+	uint64_t step = (h >> 32) | 1;
+	uint32_t bit, ix;
+
+	for (ix = 0; ix < MDC_FILTER_PROBES; ix++, h += step) {
+		bit = h % filter->nbits;
+		if (!(filter->bits[bit / 64] & (1ULL << (bit % 64))))
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * @brief Start feeding a directory's filter from a read of its start
+ *
+ * @note dir MUST have it's content_lock held for writing
+ *
+ * @param[in] dir  The directory
+ *
+ * @return The filter to feed, or NULL if there is nothing to do.
+ */
+static struct dir_filter *mdc_filter_start(mdcache_entry_t *dir)
+{
+	struct dir_filter *filter = dir->fsobj.fsdir.filter;
+	uint32_t nbits;
+
+	if (mdcache_param.dir.filter_names == 0)
+		return NULL;
+
+	if (filter == NULL) {
+		nbits = (mdcache_param.dir.filter_names *
+			 MDC_FILTER_BITS_PER_NAME + 63) & ~63;
+		filter = gsh_malloc(mdc_filter_size(nbits));
+		filter->nbits = nbits;
+		filter->complete = false;
+		filter->full = false;
+		(void) atomic_add_uint64_t(&lru_state.mem_used,
+					   mdc_filter_size(nbits));
+		dir->fsobj.fsdir.filter = filter;
+	} else if (filter->complete || filter->full) {
+		return NULL;
+	}
+
+	memset(filter->bits, 0, filter->nbits / 8);
+	filter->nnames = 0;
+	filter->next_ck = 0;
+	filter->reading = true;
+
+	return filter;
+}
+
+/**
+ * @brief Free a directory's filter
+ *
+ * @note dir MUST have it's content_lock held for writing
+ *
+ * @param[in] dir  The directory
+ */
+static void mdc_filter_free(mdcache_entry_t *dir)
+{
+	struct dir_filter *filter = dir->fsobj.fsdir.filter;
+
+	if (filter == NULL)
+		return;
+
+	(void) atomic_sub_uint64_t(&lru_state.mem_used,
+				   mdc_filter_size(filter->nbits));
+	gsh_free(filter);
+	dir->fsobj.fsdir.filter = NULL;
+}
+
+/* Memory of a directory's cursors, counted whole at allocation */
+#define MDC_CURSORS_SIZE (sizeof(struct dir_cursors) + \
+			  MDC_DIR_CURSORS * sizeof(struct dir_cursor))
+
+/**
+ * @brief Remember where a readdir stopped
+ *
+ * @note dir MUST have it's content_lock held, for reading at least
+ *
+ * @param[in] dir      The directory
+ * @param[in] ck       Cookie of the last entry handed out
+ * @param[in] start_ck FSAL cookie of the chunk it was in
+ */
+static void mdc_cursor_record(mdcache_entry_t *dir, uint64_t ck,
+			      fsal_cookie_t start_ck)
+{
+	void **cursorsp = (void **)&dir->fsobj.fsdir.cursors;
+	struct dir_cursors *cursors = atomic_fetch_voidptr(cursorsp);
+	struct dir_cursor *cursor, *old;
+	void **slotp;
+
+	if (cursors == NULL) {
+		cursors = gsh_calloc(1, sizeof(*cursors));
+		if (atomic_cas_voidptr(cursorsp, NULL, cursors)) {
+			(void) atomic_add_uint64_t(&lru_state.mem_used,
+						   MDC_CURSORS_SIZE);
+		} else {
+			gsh_free(cursors);
+			cursors = atomic_fetch_voidptr(cursorsp);
+		}
+	}
+
+	cursor = gsh_malloc(sizeof(*cursor));
+	cursor->ck = ck;
+	cursor->start_ck = start_ck;
+
+	slotp = (void **)&cursors->slot[atomic_inc_uint32_t(&cursors->hand) %
+					MDC_DIR_CURSORS];
+	do {
+		old = atomic_fetch_voidptr(slotp);
+	} while (!atomic_cas_voidptr(slotp, old, cursor));
+
+	gsh_free(old);
+}
+
+/**
+ * @brief Find where to look for the name of a cookie
+ *
+ * @note dir MUST have it's content_lock held for writing
+ *
+ * @param[in] dir  The directory
+ * @param[in] ck   The client's cookie
+ *
+ * @return The FSAL cookie to read from, or NULL if none is known.
+ */
+static fsal_cookie_t *mdc_cursor_find(mdcache_entry_t *dir, uint64_t ck)
+{
+	struct dir_cursors *cursors = dir->fsobj.fsdir.cursors;
+	uint32_t ix;
+
+	if (cursors == NULL)
+		return NULL;
+
+	for (ix = 0; ix < MDC_DIR_CURSORS; ix++) {
+		if (cursors->slot[ix] != NULL && cursors->slot[ix]->ck == ck)
+			return &cursors->slot[ix]->start_ck;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Free a directory's cursors
+ *
+ * @note dir MUST have it's content_lock held for writing
+ *
+ * @param[in] dir  The directory
+ */
+static void mdc_cursors_free(mdcache_entry_t *dir)
 {
-	return op_ctx_export_has_option(
-				  EXPORT_OPTION_TRUST_READIR_NEGATIVE_CACHE) &&
-		parent->icreate_refcnt == 0 &&
-		(parent->mde_flags & MDCACHE_DIR_POPULATED) != 0;
+	struct dir_cursors *cursors = dir->fsobj.fsdir.cursors;
+	uint32_t ix;
+
+	if (cursors == NULL)
+		return;
+
+	for (ix = 0; ix < MDC_DIR_CURSORS; ix++)
+		gsh_free(cursors->slot[ix]);
+	gsh_free(cursors);
+	(void) atomic_sub_uint64_t(&lru_state.mem_used, MDC_CURSORS_SIZE);
+	dir->fsobj.fsdir.cursors = NULL;
+}
+
+static inline bool trust_negative_cache(mdcache_entry_t *parent,
+					const char *name)
+{
+	struct dir_filter *filter = parent->fsobj.fsdir.filter;
+
+	if (!op_ctx_export_has_option(
+				  EXPORT_OPTION_TRUST_READIR_NEGATIVE_CACHE) ||
+	    parent->icreate_refcnt != 0)
+		return false;
+
+	if (parent->mde_flags & MDCACHE_DIR_POPULATED)
+		return true;
+
+	/* A chunked directory has never read all its names at once, but
+	 * the filter may have seen them all go by. */
+	return filter != NULL && filter->complete &&
+		!mdc_filter_has(filter, name);
 }
 
 /**
@@ -186,6 +413,7 @@ void mdc_clean_entry(mdcache_entry_t *entry)
 
 		/* Clean up dirents */
 		(void) mdcache_dirent_invalidate_all(entry);
+		mdc_cursors_free(entry);
 		/* Clean up parent key */
 		mdcache_key_delete(&entry->fsobj.fsdir.parent);
 
@@ -279,10 +507,25 @@ again:
 
 void mdcache_dirent_invalidate_all(mdcache_entry_t *entry)
 {
+	struct glist_head *glist;
+	struct glist_head *glistn;
+	struct dir_chunk *chunk;
+
 	/* Won't see this */
 	if (entry->obj_handle.type != DIRECTORY)
 		return;
 
+	/* Chunks only order dirents that are in the trees, so drop them
+	 * and let cleaning the trees free the dirents */
+	glist_for_each_safe(glist, glistn, &entry->fsobj.fsdir.chunks) {
+		chunk = glist_entry(glist, struct dir_chunk, chunks);
+		glist_del(&chunk->chunks);
+		mdcache_lru_chunk_remove(chunk);
+		gsh_free(chunk);
+	}
+	entry->fsobj.fsdir.nchunks = 0;
+	entry->fsobj.fsdir.first_chunk = NULL;
+
 	/* First the active tree */
 	mdcache_avl_clean_tree(&entry->fsobj.fsdir.avl.t);
 	entry->fsobj.fsdir.nbactive = 0;
@@ -291,10 +534,37 @@ void mdcache_dirent_invalidate_all(mdcache_entry_t *entry)
 	/* Next the inactive tree */
 	mdcache_avl_clean_tree(&entry->fsobj.fsdir.avl.c);
 
+	mdc_filter_free(entry);
+	mdcache_dirpack_free(entry);
+
 	/* Now we can trust the content */
 	atomic_set_uint32_t_bits(&entry->mde_flags, MDCACHE_TRUST_CONTENT);
 }
 
+/**
+ * @brief Drop the chunks of a directory after a change we made
+ *
+ * Like mdcache_dirent_invalidate_all, but the filter is kept if the
+ * content was trusted, since the caller adds the changed name to it.
+ *
+ * @note Caller MUST hold the content_lock for write
+ *
+ * @param[in] dir  The directory
+ */
+static void mdcache_dirent_invalidate_chunks(mdcache_entry_t *dir)
+{
+	struct dir_filter *filter = NULL;
+
+	if (dir->mde_flags & MDCACHE_TRUST_CONTENT) {
+		filter = dir->fsobj.fsdir.filter;
+		dir->fsobj.fsdir.filter = NULL;
+	}
+
+	mdcache_dirent_invalidate_all(dir);
+
+	dir->fsobj.fsdir.filter = filter;
+}
+
 /**
  * @brief Adds a new entry to the cache
  *
@@ -449,6 +719,12 @@ mdcache_new_entry(struct mdcache_fsal_export *export,
 
 		/* init avl tree */
 		mdcache_avl_init(nentry);
+		glist_init(&nentry->fsobj.fsdir.chunks);
+		nentry->fsobj.fsdir.nchunks = 0;
+		nentry->fsobj.fsdir.first_chunk = NULL;
+		nentry->fsobj.fsdir.filter = NULL;
+		nentry->fsobj.fsdir.cursors = NULL;
+		nentry->fsobj.fsdir.pack = NULL;
 		break;
 
 	case SYMBOLIC_LINK:
@@ -509,6 +785,9 @@ mdcache_new_entry(struct mdcache_fsal_export *export,
 	/* Map this new entry and the active export */
 	mdc_check_mapping(nentry);
 
+	mdcache_lru_recharge(nentry);
+	mdcache_lru_admit(nentry);
+
 	LogDebug(COMPONENT_CACHE_INODE, "New entry %p added", nentry);
 	*entry = nentry;
 	(void)atomic_inc_uint64_t(&cache_stp->inode_added);
@@ -626,6 +905,7 @@ mdcache_find_keyed(mdcache_key_t *key, mdcache_entry_t **entry)
 	*entry = cih_get_by_key_latch(key, &latch,
 					CIH_GET_RLOCK | CIH_GET_UNLOCK_ON_MISS,
 					__func__, __LINE__);
+	(void)atomic_inc_uint64_t(&cache_stp->inode_req);
 	if (likely(*entry)) {
 		fsal_status_t status;
 		/* Initial Ref on entry */
@@ -643,6 +923,7 @@ mdcache_find_keyed(mdcache_key_t *key, mdcache_entry_t **entry)
 		return fsalstat(ERR_FSAL_NO_ERROR, 0);
 	}
 
+	(void)atomic_inc_uint64_t(&cache_stp->inode_miss);
 	return fsalstat(ERR_FSAL_NOENT, 0);
 }
 
@@ -757,7 +1038,7 @@ fsal_status_t mdc_add_cache(mdcache_entry_t *mdc_parent,
 
 	/* Entry was found in the FSAL, add this entry to the
 	   parent directory */
-	status = mdcache_dirent_add(mdc_parent, name, new_entry);
+	status = mdcache_dirent_add(mdc_parent, name, new_entry, false);
 
 	if (status.major == ERR_FSAL_EXIST)
 		status = fsalstat(ERR_FSAL_NO_ERROR, 0);
@@ -806,6 +1087,22 @@ fsal_status_t mdc_try_get_cached(mdcache_entry_t *mdc_parent,
 	if (!(mdc_parent->mde_flags & MDCACHE_TRUST_CONTENT))
 		return fsalstat(ERR_FSAL_STALE, 0);
 
+	if (mdc_parent->fsobj.fsdir.pack != NULL) {
+		struct mdcache_dirpack_ent ent;
+
+		if (!mdcache_dirpack_lookup_s(mdc_parent, name, &ent)) {
+			/* Packed directories are always fully populated */
+			return fsalstat(ERR_FSAL_NOENT, 0);
+		}
+		status = mdcache_find_keyed(&ent.ckey, entry);
+		if (!FSAL_IS_ERROR(status))
+			return status;
+		LogFullDebug(COMPONENT_CACHE_INODE,
+			     "mdcache_find_keyed %s failed %s",
+			     name, fsal_err_txt(status));
+		return fsalstat(ERR_FSAL_STALE, 0);
+	}
+
 	dirent = mdcache_avl_qp_lookup_s(mdc_parent, name, 1);
 	if (dirent) {
 		status = mdcache_find_keyed(&dirent->ckey, entry);
@@ -818,10 +1115,12 @@ fsal_status_t mdc_try_get_cached(mdcache_entry_t *mdc_parent,
 		LogFullDebug(COMPONENT_CACHE_INODE,
 			     "mdcache_avl_qp_lookup_s %s failed trust negative %s",
 			     name,
-			     trust_negative_cache(mdc_parent) ? "yes" : "no");
-		if (trust_negative_cache(mdc_parent)) {
+			     trust_negative_cache(mdc_parent, name)
+					? "yes" : "no");
+		if (trust_negative_cache(mdc_parent, name)) {
 			/* If the dirent cache is both fully populated and
-			 * valid, it can serve negative lookups. */
+			 * valid, or the filter has never seen the name, it
+			 * can serve negative lookups. */
 			return fsalstat(ERR_FSAL_NOENT, 0);
 		}
 	}
@@ -986,7 +1285,7 @@ fsal_status_t mdc_lookup_uncached(mdcache_entry_t *mdc_parent,
 	status = mdcache_alloc_and_check_handle(export, sub_handle, &new_obj,
 						false, &attrs, attrs_out,
 						"lookup ", mdc_parent, name,
-						true, NULL);
+						false, NULL, true);
 
 	fsal_release_attrs(&attrs);
 
@@ -1013,7 +1312,12 @@ fsal_status_t mdc_lookup_uncached(mdcache_entry_t *mdc_parent,
 void
 mdcache_src_dest_lock(mdcache_entry_t *src, mdcache_entry_t *dest)
 {
-	int rc;
+	mdcache_entry_t *first, *second, *busy;
+
+	if (src == dest) {
+		PTHREAD_RWLOCK_wrlock(&src->content_lock);
+		return;
+	}
 
 	/*
 	 * A problem found in this order
@@ -1023,34 +1327,26 @@ mdcache_src_dest_lock(mdcache_entry_t *src, mdcache_entry_t *dest)
 	 * content_lock
 	 * 3. mdcache_rename holds B's content_lock, and tries to grab the
 	 * A's content_lock (which is held by thread 1).
-	 * This change is to avoid this deadlock.
+	 * So we never wait for the second lock while holding the first.
+	 * When the second is busy, we let go and wait for it instead, so
+	 * that we come back when its holder is done rather than after a
+	 * fixed sleep.
 	 */
+	first = src < dest ? src : dest;
+	second = src < dest ? dest : src;
 
-retry_lock:
-	if (src == dest)
-		PTHREAD_RWLOCK_wrlock(&src->content_lock);
-	else if (src < dest) {
-		PTHREAD_RWLOCK_wrlock(&src->content_lock);
-		rc = pthread_rwlock_trywrlock(&dest->content_lock);
-		if (rc) {
-			LogDebug(COMPONENT_CACHE_INODE,
-				 "retry dest %p lock, src %p",
-				 dest, src);
-			PTHREAD_RWLOCK_unlock(&src->content_lock);
-			sleep(1);
-			goto retry_lock;
-		}
-	} else {
-		PTHREAD_RWLOCK_wrlock(&dest->content_lock);
-		rc = pthread_rwlock_trywrlock(&src->content_lock);
-		if (rc) {
-			LogDebug(COMPONENT_CACHE_INODE,
-				 "retry src %p lock, dest %p",
-				 src, dest);
-			PTHREAD_RWLOCK_unlock(&dest->content_lock);
-			sleep(1);
-			goto retry_lock;
-		}
+	for (;;) {
+		PTHREAD_RWLOCK_wrlock(&first->content_lock);
+		if (pthread_rwlock_trywrlock(&second->content_lock) == 0)
+			return;
+
+		LogDebug(COMPONENT_CACHE_INODE,
+			 "retry %p lock, holding %p", second, first);
+		PTHREAD_RWLOCK_unlock(&first->content_lock);
+
+		busy = second;
+		second = first;
+		first = busy;
 	}
 }
 
@@ -1079,6 +1375,90 @@ mdcache_src_dest_unlock(mdcache_entry_t *src, mdcache_entry_t *dest)
 	}
 }
 
+/* Name locks.  The cache updates of one name in a directory are made
+ * under its name lock, the one its hash with the directory falls on.
+ * Creates take it while the new entry is made, without any lock on the
+ * directory, and take the content_lock for write only to add the
+ * dirent; unlinks and links take it around the dirent update.  So the
+ * updates of a name stay in order, and those of different names only
+ * meet on the short tree update.  A name lock is always taken before
+ * the content_lock.  Only rename takes two, with mdc_name_lock_pair.
+ */
+#define MDC_NAME_LOCKS 256
+
+static struct mdc_name_lock {
+	pthread_mutex_t mtx;
+} __attribute__((aligned(GSH_CACHE_LINE_SIZE))) mdc_name_locks[MDC_NAME_LOCKS];
+
+/**
+ * @brief Initialize the name locks
+ */
+void mdc_name_locks_init(void)
+{
+	int i;
+
+	for (i = 0; i < MDC_NAME_LOCKS; i++)
+		PTHREAD_MUTEX_init(&mdc_name_locks[i].mtx, NULL);
+}
+
+static inline pthread_mutex_t *mdc_name_lock_of(mdcache_entry_t *dir,
+						const char *name)
+{
+	uint64_t h = gsh_hash64(name, strlen(name), (uintptr_t)dir);
+
+	return &mdc_name_locks[h & (MDC_NAME_LOCKS - 1)].mtx;
+}
+
+/**
+ * @brief Take the name lock of a name in a directory
+ *
+ * @param[in] dir	Directory
+ * @param[in] name	Name
+ *
+ * @return The lock, to release with PTHREAD_MUTEX_unlock.
+ */
+pthread_mutex_t *mdc_name_lock(mdcache_entry_t *dir, const char *name)
+{
+	pthread_mutex_t *mtx = mdc_name_lock_of(dir, name);
+
+	PTHREAD_MUTEX_lock(mtx);
+
+	return mtx;
+}
+
+/**
+ * @brief Take the name locks of the two names of a rename
+ *
+ * The locks are taken in address order.  When both names fall on one
+ * lock, it is taken once and @a lock2 is set to NULL.
+ *
+ * @param[in]  dir1	First directory
+ * @param[in]  name1	Name in dir1
+ * @param[in]  dir2	Second directory
+ * @param[in]  name2	Name in dir2
+ * @param[out] lock1	First lock taken
+ * @param[out] lock2	Second lock taken, or NULL
+ */
+void mdc_name_lock_pair(mdcache_entry_t *dir1, const char *name1,
+			mdcache_entry_t *dir2, const char *name2,
+			pthread_mutex_t **lock1, pthread_mutex_t **lock2)
+{
+	pthread_mutex_t *a = mdc_name_lock_of(dir1, name1);
+	pthread_mutex_t *b = mdc_name_lock_of(dir2, name2);
+
+	if (a == b) {
+		PTHREAD_MUTEX_lock(a);
+		*lock1 = a;
+		*lock2 = NULL;
+		return;
+	}
+
+	*lock1 = a < b ? a : b;
+	*lock2 = a < b ? b : a;
+	PTHREAD_MUTEX_lock(*lock1);
+	PTHREAD_MUTEX_lock(*lock2);
+}
+
 /**
  * @brief Find a cached directory entry
  *
@@ -1137,19 +1517,19 @@ fsal_status_t mdcache_dirent_find(mdcache_entry_t *dir, const char *name,
  *
  * @note Caller MUST hold the content_lock for write
  *
- * @param[in,out] parent    Cache entry of the directory being updated
- * @param[in]     name      The name to add to the entry
- * @param[in]     entry     The cache entry associated with name
+ * @param[in,out] parent     Cache entry of the directory being updated
+ * @param[in]     name       The name to add to the entry
+ * @param[in]     entry      The cache entry associated with name
+ * @param[in]     invalidate The name is new to the directory
  *
  * @return FSAL status
  */
 
 fsal_status_t
 mdcache_dirent_add(mdcache_entry_t *parent, const char *name,
-		   mdcache_entry_t *entry)
+		   mdcache_entry_t *entry, bool invalidate)
 {
 	mdcache_dir_entry_t *new_dir_entry = NULL;
-	size_t namesize = strlen(name) + 1;
 	int code = 0;
 
 	LogFullDebug(COMPONENT_CACHE_INODE, "Add dir entry %s", name);
@@ -1158,11 +1538,29 @@ mdcache_dirent_add(mdcache_entry_t *parent, const char *name,
 	if (parent->obj_handle.type != DIRECTORY)
 		return fsalstat(ERR_FSAL_NOTDIR, 0);
 
-	/* in cache avl, we always insert on pentry_parent */
-	new_dir_entry = gsh_calloc(1, sizeof(mdcache_dir_entry_t) + namesize);
-	new_dir_entry->flags = DIR_ENTRY_FLAG_NONE;
+	if (invalidate && parent->fsobj.fsdir.nchunks != 0) {
+		/* We don't know which chunk a new name falls in */
+		mdcache_dirent_invalidate_chunks(parent);
+	}
+
+	if (parent->fsobj.fsdir.filter != NULL)
+		mdc_filter_add(parent->fsobj.fsdir.filter, name);
 
-	memcpy(&new_dir_entry->name, name, namesize);
+	if (parent->fsobj.fsdir.pack != NULL) {
+		struct mdcache_dirpack_ent ent;
+
+		/* A lookup under the read lock re-adds a name the pack has,
+		 * keep the pack then */
+		if (mdcache_dirpack_lookup_s(parent, name, &ent)) {
+			if (mdcache_key_cmp(&ent.ckey, &entry->fh_hk.key) == 0)
+				return fsalstat(ERR_FSAL_NO_ERROR, 0);
+			return fsalstat(ERR_FSAL_EXIST, 0);
+		}
+		mdcache_dirpack_expand(parent);
+	}
+
+	/* in cache avl, we always insert on pentry_parent */
+	new_dir_entry = mdcache_dirent_alloc(name);
 	mdcache_key_dup(&new_dir_entry->ckey, &entry->fh_hk.key);
 
 	/* add to avl */
@@ -1198,6 +1596,8 @@ mdcache_dirent_remove(mdcache_entry_t *parent, const char *name)
 
 	LogFullDebug(COMPONENT_CACHE_INODE, "Remove dir entry %s", name);
 
+	mdcache_dirpack_expand(parent);
+
 	status = mdcache_dirent_find(parent, name, &dirent);
 	if (FSAL_IS_ERROR(status)) {
 		if (status.major == ERR_FSAL_NOENT)
@@ -1216,6 +1616,9 @@ mdcache_dirent_remove(mdcache_entry_t *parent, const char *name)
 /**
  * @brief Rename a cached directory entry
  *
+ * If newname is cached, the rename replaced it, and its dirent is
+ * pointed at the renamed entry in place.
+ *
  * @note Caller MUST hold the content_lock for write
  *
  * @param[in] parent	Parent directory
@@ -1237,6 +1640,17 @@ mdcache_dirent_rename(mdcache_entry_t *parent, const char *oldname,
 		     "Rename dir entry %s to %s",
 		     oldname, newname);
 
+	if (parent->fsobj.fsdir.filter != NULL)
+		mdc_filter_add(parent->fsobj.fsdir.filter, newname);
+
+	mdcache_dirpack_expand(parent);
+
+	if (parent->fsobj.fsdir.nchunks != 0) {
+		/* We don't know which chunk the new name falls in */
+		mdcache_dirent_invalidate_chunks(parent);
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+	}
+
 	status = mdcache_dirent_find(parent, oldname, &dirent);
 	if (FSAL_IS_ERROR(status))
 		return status;
@@ -1245,42 +1659,46 @@ mdcache_dirent_rename(mdcache_entry_t *parent, const char *oldname,
 	if (FSAL_IS_ERROR(status) && status.major != ERR_FSAL_NOENT)
 		return status;
 
-	if (dirent2) {
-		/* rename would cause a collision */
-		if (parent->mde_flags & MDCACHE_TRUST_CONTENT) {
-			/* overwrite, replace entry and expire the old */
-			mdcache_entry_t *oldentry;
-
-			(void)mdcache_find_keyed(&dirent2->ckey, &oldentry);
-
-			/* dirent2 (newname) will now point to renamed entry */
-			mdcache_key_delete(&dirent2->ckey);
-			mdcache_key_dup(&dirent2->ckey, &dirent->ckey);
-
-			/* Delete dirent for oldname */
-			avl_dirent_set_deleted(parent, dirent);
-
-			if (oldentry) {
-				/* if it is still around, mark it gone/stale */
-				atomic_clear_uint32_t_bits(
-							&oldentry->mde_flags,
-							MDCACHE_TRUST_ATTRS |
-							MDCACHE_TRUST_CONTENT |
-							MDCACHE_DIR_POPULATED);
-				mdcache_put(oldentry);
-			}
-			return status;
-		} else
-			return fsalstat(ERR_FSAL_EXIST, 0);
+	if (!dirent) {
+		/* The old name was not cached, so whatever newname was
+		 * cached as is gone.
+		 */
+		if (dirent2) {
+			avl_dirent_set_deleted(parent, dirent2);
+			parent->fsobj.fsdir.nbactive--;
+		}
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
 	}
 
-	/* Size (including terminating NULL) of the filename */
-	size_t newnamesize = strlen(newname) + 1;
+	if (dirent2) {
+		/* The rename replaced newname.  Point its dirent at the
+		 * renamed entry, in place, and expire the old one.
+		 */
+		mdcache_entry_t *oldentry;
+
+		(void)mdcache_find_keyed(&dirent2->ckey, &oldentry);
+
+		/* dirent2 (newname) will now point to renamed entry */
+		mdcache_key_delete(&dirent2->ckey);
+		mdcache_key_dup(&dirent2->ckey, &dirent->ckey);
+
+		/* Delete dirent for oldname */
+		avl_dirent_set_deleted(parent, dirent);
+		parent->fsobj.fsdir.nbactive--;
+
+		if (oldentry) {
+			/* if it is still around, mark it gone/stale */
+			atomic_clear_uint32_t_bits(&oldentry->mde_flags,
+						   MDCACHE_TRUST_ATTRS |
+						   MDCACHE_TRUST_CONTENT |
+						   MDCACHE_DIR_POPULATED);
+			mdcache_put(oldentry);
+		}
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+	}
 
 	/* try to rename--no longer in-place */
-	dirent2 = gsh_calloc(1, sizeof(mdcache_dir_entry_t) + newnamesize);
-	memcpy(dirent2->name, newname, newnamesize);
-	dirent2->flags = DIR_ENTRY_FLAG_NONE;
+	dirent2 = mdcache_dirent_alloc(newname);
 	mdcache_key_dup(&dirent2->ckey, &dirent->ckey);
 
 	/* Delete the entry for oldname */
@@ -1312,6 +1730,13 @@ struct mdcache_populate_cb_state {
 	mdcache_entry_t *dir;
 	fsal_status_t *status;
 	uint64_t offset_cookie;
+	struct dir_chunk *chunk;	/*< Chunk being read */
+	struct dir_chunk *prev;		/*< Chunk it follows, if any */
+	const char *skip;		/*< Name not to put in the chunk */
+	char *name;			/*< Name found by a seek */
+	fsal_cookie_t fsal_ck;		/*< FSAL cookie found by a seek */
+	struct dir_filter *filter;	/*< Filter to add names to, if any */
+	bool caught_up;			/*< Stopped at a cached chunk */
 };
 
 /**
@@ -1377,13 +1802,15 @@ mdc_populate_dirent(const char *name, struct fsal_obj_handle *sub_handle,
  *
  * @note dir MUST have it's content_lock held for writing
  *
- * @param[in] dir  Entry for the parent directory to be read
+ * @param[in] dir         Entry for the parent directory to be read
+ * @param[in] names_only  Ask the FSAL for no attributes, the entries
+ *                        fetch them when first needed
  *
  * @return FSAL status
  */
 
 fsal_status_t
-mdcache_dirent_populate(mdcache_entry_t *dir)
+mdcache_dirent_populate(mdcache_entry_t *dir, bool names_only)
 {
 	fsal_status_t fsal_status;
 	fsal_status_t status = {0, 0};
@@ -1414,8 +1841,10 @@ mdcache_dirent_populate(mdcache_entry_t *dir)
 	state.status = &status;
 	state.offset_cookie = 0;
 
-	attrmask = op_ctx->fsal_export->exp_ops.fs_supported_attrs(
-					op_ctx->fsal_export) | ATTR_RDATTR_ERR;
+	attrmask = ATTR_RDATTR_ERR;
+	if (!names_only)
+		attrmask |= op_ctx->fsal_export->exp_ops.fs_supported_attrs(
+							op_ctx->fsal_export);
 
 	subcall_raw(state.export,
 		fsal_status = dir->sub_handle->obj_ops.readdir(
@@ -1439,6 +1868,7 @@ mdcache_dirent_populate(mdcache_entry_t *dir)
 		/* End of work */
 		atomic_set_uint32_t_bits(&dir->mde_flags,
 					 MDCACHE_DIR_POPULATED);
+		mdcache_dirpack_build(dir);
 
 		return fsalstat(ERR_FSAL_NO_ERROR, 0);
 	}
@@ -1450,6 +1880,638 @@ mdcache_dirent_populate(mdcache_entry_t *dir)
 	return status;
 }
 
+/**
+ * @brief Release a dirent chunk and its dirents
+ *
+ * Neighbouring chunks are unlinked, so a walk that reaches the gap reads
+ * it again from the FSAL.
+ *
+ * @note The parent MUST have it's content_lock held for writing
+ *
+ * @param[in] chunk The chunk to release
+ */
+
+void mdcache_chunk_release(struct dir_chunk *chunk)
+{
+	mdcache_entry_t *dir = chunk->parent;
+	mdcache_dir_entry_t *dirent;
+	struct glist_head *glist;
+	struct glist_head *glistn;
+
+	glist_for_each_safe(glist, glistn, &chunk->dirents) {
+		dirent = glist_entry(glist, mdcache_dir_entry_t, chunk_list);
+		glist_del(&dirent->chunk_list);
+		if (dirent->flags & DIR_ENTRY_FLAG_DELETED) {
+			avltree_remove(&dirent->node_hk,
+				       &dir->fsobj.fsdir.avl.c);
+		} else {
+			avltree_remove(&dirent->node_hk,
+				       &dir->fsobj.fsdir.avl.t);
+			dir->fsobj.fsdir.nbactive--;
+		}
+		if (dirent->ckey.kv.len)
+			mdcache_key_delete(&dirent->ckey);
+		mdcache_dirent_free(dirent);
+	}
+
+	if (chunk->prev != NULL)
+		chunk->prev->next = NULL;
+	if (chunk->next != NULL)
+		chunk->next->prev = NULL;
+	if (dir->fsobj.fsdir.first_chunk == chunk)
+		dir->fsobj.fsdir.first_chunk = NULL;
+
+	glist_del(&chunk->chunks);
+	dir->fsobj.fsdir.nchunks--;
+	mdcache_lru_chunk_remove(chunk);
+	gsh_free(chunk);
+}
+
+/**
+ * @brief Add a single dir entry to a chunk
+ *
+ * Names already cached are moved into the chunk rather than duplicated,
+ * since the FSAL is the authority on where they fall.  Reaching the first
+ * entry of a cached chunk that nothing precedes joins the two.
+ *
+ * @param[in]     name       Name of the directory entry
+ * @param[in]     sub_handle Object for entry
+ * @param[in]     attrs_in   Attributes requested for the object
+ * @param[in,out] dir_state  Callback state
+ * @param[in]     cookie     Directory cookie
+ *
+ * @retval true if more entries are requested
+ * @retval false if no more should be sent
+ */
+
+static bool
+mdc_readdir_chunk_object(const char *name, struct fsal_obj_handle *sub_handle,
+			 struct attrlist *attrs_in, void *dir_state,
+			 fsal_cookie_t cookie)
+{
+	struct mdcache_populate_cb_state *state = dir_state;
+	struct dir_chunk *chunk = state->chunk;
+	struct dir_chunk *head;
+	mdcache_entry_t *directory = state->dir;
+	mdcache_entry_t *new_entry = NULL;
+	mdcache_dir_entry_t *dirent;
+	fsal_status_t status = { 0, 0 };
+
+	if (state->filter != NULL)
+		mdc_filter_add(state->filter, name);
+
+	/* This is in the middle of a subcall. Do a supercall */
+	supercall_raw(state->export,
+		status = mdcache_new_entry(state->export, sub_handle, attrs_in,
+					   NULL, false, &new_entry, NULL)
+	);
+
+	if (FSAL_IS_ERROR(status)) {
+		*state->status = status;
+		if (status.major == ERR_FSAL_XDEV) {
+			LogInfo(COMPONENT_NFS_READDIR,
+				"Ignoring XDEV entry %s", name);
+			*state->status = fsalstat(ERR_FSAL_NO_ERROR, 0);
+			return true;
+		}
+		LogInfo(COMPONENT_CACHE_INODE,
+			"Lookup failed on %s in dir %p with %s",
+			name, directory, fsal_err_txt(*state->status));
+		return false;
+	}
+
+	if (state->skip != NULL && strcmp(name, state->skip) == 0) {
+		/* The client already has this one */
+		goto out;
+	}
+
+	dirent = mdcache_avl_qp_lookup_s(directory, name, 1);
+	if (dirent != NULL) {
+		if (dirent->chunk == chunk ||
+		    (dirent->chunk != NULL && dirent->chunk == state->prev)) {
+			/* Some FSALs resume at, not after, the cookie */
+			goto out;
+		}
+
+		if (dirent->chunk != NULL && dirent->chunk->prev == NULL &&
+		    dirent->chunk != directory->fsobj.fsdir.first_chunk &&
+		    glist_first_entry(&dirent->chunk->dirents,
+				      mdcache_dir_entry_t,
+				      chunk_list) == dirent) {
+			for (head = chunk; head->prev != NULL;
+			     head = head->prev)
+				;
+			if (head != dirent->chunk) {
+				/* Caught up with a cached chunk */
+				chunk->next = dirent->chunk;
+				dirent->chunk->prev = chunk;
+				state->caught_up = true;
+				mdcache_put(new_entry);
+				return false;
+			}
+		}
+
+		if (dirent->chunk != NULL) {
+			/* The directory changed under the cached chunk */
+			glist_del(&dirent->chunk_list);
+			dirent->chunk->num_entries--;
+		}
+		if (mdcache_key_cmp(&dirent->ckey, &new_entry->fh_hk.key)) {
+			/* The name now refers to another object */
+			mdcache_key_delete(&dirent->ckey);
+			mdcache_key_dup(&dirent->ckey, &new_entry->fh_hk.key);
+		}
+	} else {
+		dirent = mdcache_dirent_alloc(name);
+		mdcache_key_dup(&dirent->ckey, &new_entry->fh_hk.key);
+
+		if (mdcache_avl_qp_insert(directory, &dirent) < 0) {
+			/* Hash collision, already logged */
+			goto out;
+		}
+		directory->fsobj.fsdir.nbactive++;
+	}
+
+	dirent->chunk = chunk;
+	glist_add_tail(&chunk->dirents, &dirent->chunk_list);
+	chunk->num_entries++;
+	chunk->next_ck = cookie;
+
+	if (new_entry->obj_handle.type == DIRECTORY) {
+		/* Insert Parent's key */
+		mdc_dir_add_parent(new_entry, directory);
+	}
+
+out:
+	mdcache_put(new_entry);
+
+	return chunk->num_entries < mdcache_param.dir.avl_chunk;
+}
+
+/**
+ * @brief Read the next chunk of a directory from the FSAL
+ *
+ * Afterwards the directory is trimmed to Dir_Max_Chunks, and the cache
+ * to Chunks_HWMark.
+ *
+ * @note dir MUST have it's content_lock held for writing
+ *
+ * @param[in]  dir    The directory
+ * @param[in]  prev   Chunk to read on from, or NULL
+ * @param[in]  whence FSAL cookie to read on from if prev is NULL, NULL to
+ *                    read from the start of the directory
+ * @param[in]  skip   Name not to put in the chunk, or NULL
+ * @param[in]  names_only  As for mdcache_dirent_populate()
+ * @param[out] chunkp The chunk, NULL at the end of the directory
+ *
+ * @return FSAL status
+ */
+
+static fsal_status_t
+mdcache_populate_chunk(mdcache_entry_t *dir, struct dir_chunk *prev,
+		       fsal_cookie_t *whence, const char *skip,
+		       bool names_only, struct dir_chunk **chunkp)
+{
+	struct mdcache_populate_cb_state state;
+	struct dir_chunk *chunk, *next, *victim;
+	struct dir_filter *filter = dir->fsobj.fsdir.filter;
+	struct glist_head *glist;
+	fsal_status_t fsal_status;
+	fsal_status_t status = {0, 0};
+	bool first = prev == NULL && whence == NULL;
+	bool eod = false;
+	attrmask_t attrmask;
+
+	*chunkp = NULL;
+
+	chunk = gsh_calloc(1, sizeof(struct dir_chunk));
+	glist_init(&chunk->dirents);
+	chunk->parent = dir;
+	glist_add_tail(&dir->fsobj.fsdir.chunks, &chunk->chunks);
+	dir->fsobj.fsdir.nchunks++;
+	mdcache_lru_chunk_insert(chunk);
+
+	if (prev != NULL) {
+		whence = &prev->next_ck;
+		prev->next = chunk;
+		chunk->prev = prev;
+	} else if (first) {
+		dir->fsobj.fsdir.first_chunk = chunk;
+	}
+	chunk->start_ck = whence != NULL ? *whence : 0;
+
+	/* Only a read that carries on from the start feeds the filter */
+	if (first)
+		filter = mdc_filter_start(dir);
+	else if (filter != NULL &&
+		 (!filter->reading || *whence != filter->next_ck))
+		filter = NULL;
+
+	state.export = mdc_cur_export();
+	state.dir = dir;
+	state.status = &status;
+	state.offset_cookie = 0;
+	state.chunk = chunk;
+	state.prev = prev;
+	state.skip = skip;
+	state.filter = filter;
+	state.caught_up = false;
+
+	attrmask = ATTR_RDATTR_ERR;
+	if (!names_only)
+		attrmask |= op_ctx->fsal_export->exp_ops.fs_supported_attrs(
+							op_ctx->fsal_export);
+
+	subcall_raw(state.export,
+		fsal_status = dir->sub_handle->obj_ops.readdir(
+			dir->sub_handle, whence, (void *)&state,
+			mdc_readdir_chunk_object, attrmask, &eod)
+	       );
+	if (FSAL_IS_ERROR(fsal_status) || FSAL_IS_ERROR(status)) {
+		if (!FSAL_IS_ERROR(fsal_status))
+			fsal_status = status;
+		LogDebug(COMPONENT_NFS_READDIR, "FSAL readdir status=%s",
+			 fsal_err_txt(fsal_status));
+		if (filter != NULL)
+			filter->reading = false;
+		mdcache_chunk_release(chunk);
+		return fsal_status;
+	}
+
+	chunk->eod = eod;
+
+	if (filter != NULL && filter->reading) {
+		if (eod) {
+			filter->complete = true;
+			filter->reading = false;
+		} else if (state.caught_up || chunk->num_entries == 0) {
+			/* The rest is not coming from the FSAL */
+			filter->reading = false;
+		} else {
+			filter->next_ck = chunk->next_ck;
+		}
+	}
+
+	if (chunk->num_entries == 0 && !(first && chunk->next == NULL)) {
+		/* Nothing new here, drop the chunk and close the gap */
+		next = chunk->next;
+		if (next != NULL)
+			next->prev = prev;
+		if (prev != NULL) {
+			prev->next = next;
+			prev->eod = eod;
+		}
+		chunk->prev = NULL;
+		chunk->next = NULL;
+		mdcache_chunk_release(chunk);
+		if (first)
+			dir->fsobj.fsdir.first_chunk = next;
+		chunk = next;
+	}
+
+	/* Trim the directory, oldest first, sparing the walk in progress */
+	while (dir->fsobj.fsdir.nchunks > mdcache_param.dir.avl_max_chunks) {
+		victim = NULL;
+		glist_for_each(glist, &dir->fsobj.fsdir.chunks) {
+			victim = glist_entry(glist, struct dir_chunk, chunks);
+			if (victim != chunk && victim != prev)
+				break;
+			victim = NULL;
+		}
+		if (victim == NULL)
+			break;
+		mdcache_chunk_release(victim);
+	}
+
+	mdcache_lru_chunk_reap(dir);
+
+	*chunkp = chunk;
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+/**
+ * @brief Look for the name of a cookie
+ *
+ * @param[in]     name       Name of the directory entry
+ * @param[in]     sub_handle Object for entry
+ * @param[in]     attrs      Attributes requested for the object
+ * @param[in,out] dir_state  Callback state
+ * @param[in]     cookie     Directory cookie
+ *
+ * @retval true if more entries are requested
+ * @retval false once the name is found
+ */
+
+static bool
+mdc_readdir_chunk_seek(const char *name, struct fsal_obj_handle *sub_handle,
+		       struct attrlist *attrs, void *dir_state,
+		       fsal_cookie_t cookie)
+{
+	struct mdcache_populate_cb_state *state = dir_state;
+
+	sub_handle->obj_ops.release(sub_handle);
+
+	if (mdcache_avl_name_hash(name) != state->offset_cookie)
+		return true;
+
+	state->name = gsh_strdup(name);
+	state->fsal_ck = cookie;
+	return false;
+}
+
+/**
+ * @brief Read the chunk following a cookie that isn't cached
+ *
+ * Cookies are name hashes, so this means finding the name in the FSAL
+ * first: from where the chunk it was handed out in was read, when a
+ * cursor remembers it, else from the start of the directory.
+ *
+ * @note dir MUST have it's content_lock held for writing
+ *
+ * @param[in]  dir    The directory
+ * @param[in]  ck     The client's cookie
+ * @param[in]  names_only  As for mdcache_dirent_populate()
+ * @param[out] chunkp The chunk, NULL at the end of the directory
+ *
+ * @return FSAL status
+ */
+
+static fsal_status_t
+mdcache_seek_chunk(mdcache_entry_t *dir, uint64_t ck, bool names_only,
+		   struct dir_chunk **chunkp)
+{
+	struct mdcache_populate_cb_state state;
+	fsal_status_t fsal_status;
+	fsal_status_t status = {0, 0};
+	fsal_cookie_t *whence = mdc_cursor_find(dir, ck);
+	bool eod = false;
+
+	*chunkp = NULL;
+
+	memset(&state, 0, sizeof(state));
+	state.export = mdc_cur_export();
+	state.dir = dir;
+	state.status = &status;
+	state.offset_cookie = ck;
+
+again:
+	subcall_raw(state.export,
+		fsal_status = dir->sub_handle->obj_ops.readdir(
+			dir->sub_handle, whence, (void *)&state,
+			mdc_readdir_chunk_seek, ATTR_RDATTR_ERR, &eod)
+	       );
+	if (FSAL_IS_ERROR(fsal_status)) {
+		LogDebug(COMPONENT_NFS_READDIR, "FSAL readdir status=%s",
+			 fsal_err_txt(fsal_status));
+		gsh_free(state.name);
+		return fsal_status;
+	}
+
+	if (state.name == NULL && whence != NULL) {
+		LogFullDebug(COMPONENT_NFS_READDIR,
+			     "cursor for cookie=%" PRIu64 " stale", ck);
+		whence = NULL;
+		goto again;
+	}
+
+	if (state.name == NULL) {
+		LogFullDebug(COMPONENT_NFS_READDIR,
+			     "seek to cookie=%" PRIu64 " fail", ck);
+		return fsalstat(ERR_FSAL_BADCOOKIE, 0);
+	}
+
+	status = mdcache_populate_chunk(dir, NULL, &state.fsal_ck, state.name,
+					names_only, chunkp);
+	gsh_free(state.name);
+
+	return status;
+}
+
+/**
+ * @brief Refresh the attributes of the next window of a chunk
+ *
+ * @param[in] chunk     The chunk
+ * @param[in] node      The first dirent of the window
+ * @param[in] attrmask  Attributes the caller will hand out
+ *
+ * @return The number of live dirents covered.
+ */
+static uint32_t mdc_chunk_prefetch(struct dir_chunk *chunk,
+				   struct glist_head *node,
+				   attrmask_t attrmask)
+{
+	struct mdc_prefetch pf;
+	mdcache_dir_entry_t *dirent;
+	uint32_t count = 0;
+
+	mdc_prefetch_init(&pf, attrmask);
+	for (; node != &chunk->dirents &&
+	       count < mdcache_param.prefetch_window; node = node->next) {
+		dirent = glist_entry(node, mdcache_dir_entry_t, chunk_list);
+		if (dirent->flags & DIR_ENTRY_FLAG_DELETED)
+			continue;
+		mdc_prefetch_add(&pf, &dirent->ckey);
+		count++;
+	}
+	mdc_prefetch_wait(&pf);
+
+	return count;
+}
+
+/**
+ * @brief Read a directory through the chunk cache
+ *
+ * Chunks are walked under the read lock.  When a chunk has to be read
+ * from the FSAL, or an entry looked up again, the lock is upgraded and
+ * the walk resumes from the last cookie delivered.
+ *
+ * @param[in]  directory The directory to read
+ * @param[in]  whence    Cookie to read on from, 0 for the start
+ * @param[in]  dir_state Pass thru of state to callback
+ * @param[in]  cb        Callback function
+ * @param[in]  attrmask  Attributes the callback hands out, for prefetch
+ * @param[out] eod_met   End of directory reached
+ *
+ * @return FSAL status
+ */
+
+fsal_status_t mdcache_readdir_chunked(mdcache_entry_t *directory,
+				      fsal_cookie_t whence, void *dir_state,
+				      fsal_readdir_cb cb, attrmask_t attrmask,
+				      bool *eod_met)
+{
+	struct dir_chunk *chunk = NULL;
+	mdcache_dir_entry_t *dirent;
+	mdcache_entry_t *entry = NULL;
+	struct glist_head *node;
+	fsal_cookie_t next_ck = whence;
+	fsal_status_t status = {0, 0};
+	bool has_write = false;
+	/* A caller that hands out no attributes need not wait for them */
+	bool names_only = (attrmask & ~ATTR_RDATTR_ERR) == 0;
+	uint32_t ahead = 0;
+	uint64_t cursor_ck = 0;
+	fsal_cookie_t cursor_start = 0;
+
+	*eod_met = false;
+
+	if (whence > 0 && whence < 3) {
+		/* mdcache always uses 1 and 2 for . and .. */
+		LogFullDebug(COMPONENT_NFS_READDIR, "Bad cookie");
+		return fsalstat(ERR_FSAL_BADCOOKIE, 0);
+	}
+
+	PTHREAD_RWLOCK_rdlock(&directory->content_lock);
+
+again:
+	if (!(directory->mde_flags & MDCACHE_TRUST_CONTENT)) {
+		if (!has_write)
+			goto upgrade;
+		mdcache_dirent_invalidate_all(directory);
+	}
+
+	if (directory->fsobj.fsdir.pack != NULL) {
+		/* Packed before Dir_Chunk was changed */
+		if (!has_write)
+			goto upgrade;
+		mdcache_dirpack_expand(directory);
+	}
+
+	/* Find where the client left off */
+	if (next_ck == 0) {
+		chunk = directory->fsobj.fsdir.first_chunk;
+		if (chunk == NULL) {
+			if (!has_write)
+				goto upgrade;
+			status = mdcache_populate_chunk(directory, NULL, NULL,
+							NULL, names_only,
+							&chunk);
+			if (FSAL_IS_ERROR(status))
+				goto fail;
+		}
+		node = chunk ? &chunk->dirents : NULL;
+	} else {
+		dirent = mdcache_avl_lookup_ck(directory, next_ck);
+		if (dirent == NULL || dirent->chunk == NULL) {
+			if (!has_write)
+				goto upgrade;
+			status = mdcache_seek_chunk(directory, next_ck,
+						    names_only, &chunk);
+			if (FSAL_IS_ERROR(status))
+				goto fail;
+			node = chunk ? &chunk->dirents : NULL;
+		} else {
+			chunk = dirent->chunk;
+			node = &dirent->chunk_list;
+		}
+	}
+
+	if (chunk == NULL) {
+		LogFullDebug(COMPONENT_NFS_READDIR,
+			     "EOD because empty result");
+		*eod_met = true;
+		goto unlock_dir;
+	}
+
+	LogFullDebug(COMPONENT_NFS_READDIR,
+		     "About to readdir chunk %p of directory=%p cookie=%"
+		     PRIu64, chunk, directory, next_ck);
+
+	mdcache_lru_chunk_touch(chunk);
+
+	while (true) {
+		node = node->next;
+		if (node == &chunk->dirents) {
+			/* End of this chunk, on to the next */
+			if (chunk->eod) {
+				*eod_met = true;
+				break;
+			}
+			if (chunk->next == NULL) {
+				if (!has_write)
+					goto upgrade;
+				status = mdcache_populate_chunk(directory,
+								chunk, NULL,
+								NULL,
+								names_only,
+								&chunk);
+				if (FSAL_IS_ERROR(status))
+					goto fail;
+				if (chunk == NULL) {
+					*eod_met = true;
+					break;
+				}
+			} else {
+				chunk = chunk->next;
+			}
+			mdcache_lru_chunk_touch(chunk);
+			node = &chunk->dirents;
+			ahead = 0;
+			continue;
+		}
+
+		dirent = glist_entry(node, mdcache_dir_entry_t, chunk_list);
+		if (dirent->flags & DIR_ENTRY_FLAG_DELETED)
+			continue;
+
+		if (ahead == 0 && mdc_prefetch_enabled(attrmask))
+			ahead = mdc_chunk_prefetch(chunk, node, attrmask);
+		if (ahead != 0)
+			ahead--;
+
+		/* Get actual entry */
+		status = mdcache_find_keyed(&dirent->ckey, &entry);
+		if (FSAL_IS_ERROR(status)) {
+			if (!has_write)
+				goto upgrade;
+			status = mdc_lookup_uncached(directory, dirent->name,
+						     &entry, NULL);
+			if (FSAL_IS_ERROR(status)) {
+				LogFullDebug(COMPONENT_NFS_READDIR,
+					     "lookup failed status=%s",
+					     fsal_err_txt(status));
+				goto fail;
+			}
+		}
+
+		next_ck = dirent->hk.k;
+		if (!cb(dirent->name, &entry->obj_handle, &entry->attrs,
+			dir_state, dirent->hk.k)) {
+			mdcache_put(entry);
+			break;
+		}
+		mdcache_put(entry);
+		cursor_ck = dirent->hk.k;
+		cursor_start = chunk->start_ck;
+	}
+
+	/* The client will be back from here, unless it was the start */
+	if (!*eod_met && cursor_ck != 0 && cursor_start != 0)
+		mdc_cursor_record(directory, cursor_ck, cursor_start);
+
+	LogDebug(COMPONENT_NFS_READDIR,
+		 "chunk = %p, eod = %s", chunk, *eod_met ? "TRUE" : "FALSE");
+
+unlock_dir:
+	PTHREAD_RWLOCK_unlock(&directory->content_lock);
+	return status;
+
+upgrade:
+	PTHREAD_RWLOCK_unlock(&directory->content_lock);
+	PTHREAD_RWLOCK_wrlock(&directory->content_lock);
+	has_write = true;
+	goto again;
+
+fail:
+	PTHREAD_RWLOCK_unlock(&directory->content_lock);
+	if (status.major == ERR_FSAL_STALE) {
+		LogEvent(COMPONENT_NFS_READDIR,
+			 "FSAL returned STALE from readdir.");
+		mdcache_kill_entry(directory);
+	}
+	return status;
+}
+
 /**
  * @brief Forcibly remove an entry from the cache (top half)
  *
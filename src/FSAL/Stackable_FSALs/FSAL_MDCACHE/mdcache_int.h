@@ -39,6 +39,13 @@
 #include "sal_data.h"
 #include "fsal_up.h"
 #include "fsal_convert.h"
+#include "nfs_exports.h"
+#include "export_mgr.h"
+#include "gsh_intrinsic.h"
+
+#ifdef USE_LTTNG
+#include "gsh_lttng/mdcache.h"
+#endif
 
 typedef struct mdcache_fsal_obj_handle mdcache_entry_t;
 
@@ -113,6 +120,10 @@ enum lru_q_id {
 
 #define LRU_CLEANUP 0x00000001 /* Entry is on cleanup queue */
 #define LRU_CLEANED 0x00000002 /* Entry has been cleaned */
+#define LRU_TOUCHED 0x00000004 /* Promotion pending, see lru_promote_touched */
+#define LRU_PROBATION 0x00000008 /* 2Q: admitted to L2, not yet reused */
+#define LRU_FD_REAPED 0x00000010 /* The reaper closed its global fd */
+#define LRU_FD_REOPENED 0x00000020 /* I/O on it since, see lru_run_lane */
 
 typedef struct mdcache_lru__ {
 	struct glist_head q;	/*< Link in the physical deque
@@ -128,6 +139,10 @@ typedef struct mdcache_lru__ {
 				 *< decrement the correct counter when moving
 				 *< or deleting the entry. */
 	uint32_t cf;		/*< Confounder */
+	uint32_t mem;		/*< Bytes charged to lru_state.mem_used */
+	uint32_t node;		/*< NUMA node of its memory, or
+				    GSH_NUMA_NODE_ANY if from
+				    mdcache_entry_pool */
 } mdcache_lru_t;
 
 /**
@@ -140,6 +155,10 @@ struct mdcache_stats {
 	uint64_t inode_conf;
 	uint64_t inode_added;
 	uint64_t inode_mapping;
+	uint64_t inode_ghost_add;	/*< 2Q: reclaimed on probation */
+	uint64_t inode_ghost_hit;	/*< 2Q: admitted from the ghosts */
+	uint64_t inode_upcall_trust;	/*< Refreshes skipped for upcalls */
+	uint64_t inode_change_trust;	/*< Expired attrs kept by change */
 };
 
 extern struct mdcache_stats *cache_stp;
@@ -172,6 +191,8 @@ struct entry_export_map {
 #define MDCACHE_TRUST_CONTENT FSAL_UP_INVALIDATE_CONTENT
 /** The directory has been populated (negative lookups are meaningful) */
 #define MDCACHE_DIR_POPULATED FSAL_UP_INVALIDATE_DIR_POPULATED
+/** Trust the xattrs cached under xattr_gen */
+#define MDCACHE_TRUST_XATTRS FSAL_UP_INVALIDATE_XATTRS
 /** The entry has been removed, but not unhashed due to state */
 static const uint32_t MDCACHE_UNREACHABLE = 0x00000008;
 
@@ -219,14 +240,21 @@ static const uint32_t MDCACHE_UNREACHABLE = 0x00000008;
  */
 
 struct mdcache_fsal_obj_handle {
+	/* Written by every operation on the entry, whether it changes
+	 * anything or not: the references and LRU position, and the
+	 * attribute lock that GETATTR takes for read.  Padded off from the
+	 * fields below so that these writes do not invalidate the lines
+	 * others are reading. */
+
+	/** New style LRU link */
+	mdcache_lru_t lru;
 	/** Reader-writer lock for attributes */
 	pthread_rwlock_t attr_lock;
-	/** MDCache FSAL Handle */
-	struct fsal_obj_handle obj_handle;
-	/** Sub-FSAL handle */
-	struct fsal_obj_handle *sub_handle;
-	/** Cached attributes */
-	struct attrlist attrs;
+	GSH_CACHE_PAD(0);
+
+	/* Read mostly: the key, handles and cached attributes, written
+	 * only when the entry is made or its attributes refreshed. */
+
 	/** FH hash linkage */
 	struct {
 		struct avltree_node node_k;	/*< AVL node in tree */
@@ -235,18 +263,34 @@ struct mdcache_fsal_obj_handle {
 	} fh_hk;
 	/** Flags for this entry */
 	uint32_t mde_flags;
-	/** refcount for number of active icreate */
-	int32_t icreate_refcnt;
+	/** Generation the xattrs of the entry are cached under, valid
+	    while MDCACHE_TRUST_XATTRS is set */
+	uint64_t xattr_gen;
+	/** Sub-FSAL handle */
+	struct fsal_obj_handle *sub_handle;
+	/** Atomic pointer to the first mapped export for fast path */
+	void *first_export;
 	/** Time at which we last refreshed attributes. */
 	time_t attr_time;
 	/** Time at which we last refreshed acl. */
 	time_t acl_time;
-	/** New style LRU link */
-	mdcache_lru_t lru;
+	/** Cached attributes */
+	struct attrlist attrs;
+	/** MDCache FSAL Handle */
+	struct fsal_obj_handle obj_handle;
+	GSH_CACHE_PAD(1);
+
+	/* Taken by the operations on the content of a directory, or by
+	 * creates, writes and export changes. */
+
+	/** refcount for number of active icreate */
+	int32_t icreate_refcnt;
 	/** Exports per entry (protected by attr_lock) */
 	struct glist_head export_list;
-	/** Atomic pointer to the first mapped export for fast path */
-	void *first_export;
+	/** Writes being gathered, allocated by the first one */
+	struct mdc_gather *gather;
+	/** Group commit state, allocated by the first COMMIT */
+	struct mdc_commit *commit;
 	/** Lock on type-specific cached content.  See locking
 	    discipline for details. */
 	pthread_rwlock_t content_lock;
@@ -273,8 +317,20 @@ struct mdcache_fsal_obj_handle {
 			struct state_hdl dhdl; /**< Storage for dir state */
 			/** Number of known active children */
 			uint32_t nbactive;
+			/** Number of cached dirent chunks */
+			uint32_t nchunks;
 			/** The parent of this directory ('..') */
 			mdcache_key_t parent;
+			/** Cached chunks, oldest first */
+			struct glist_head chunks;
+			/** Chunk starting at the beginning of the directory */
+			struct dir_chunk *first_chunk;
+			/** Names seen in the directory, if any */
+			struct dir_filter *filter;
+			/** Where recent readdirs stopped, if any */
+			struct dir_cursors *cursors;
+			/** Packed dirents, instead of the trees, if any */
+			struct mdcache_dirpack *pack;
 			struct {
 				/** Children */
 				struct avltree t;
@@ -303,11 +359,110 @@ typedef struct mdcache_dir_entry__ {
 		uint64_t k;	/*< Integer cookie */
 		uint32_t p;	/*< Number of probes, an efficiency metric */
 	} hk;
+	struct glist_head chunk_list;	/*< Link in chunk, in FSAL order */
+	struct dir_chunk *chunk;	/*< Chunk holding this entry, if any */
 	mdcache_key_t ckey;	/*< Key of cache entry */
 	uint32_t flags;		/*< Flags */
 	char name[];		/*< The NUL-terminated filename */
 } mdcache_dir_entry_t;
 
+/**
+ * @brief A run of directory entries read together from the FSAL
+ *
+ * When Dir_Chunk is set, directories are not read whole.  Instead
+ * each READDIR reads as many chunks of Dir_Chunk entries as it needs,
+ * starting from where the FSAL left off at the end of the previous
+ * chunk.  Chunks point to their neighbours when known, so a client
+ * paging through the directory walks the cache without going to the
+ * FSAL.  Deleted entries stay in their chunk so their cookies still
+ * lead somewhere.
+ *
+ * Chunks are reclaimed individually: each directory keeps at most
+ * Dir_Max_Chunks of them, and all chunks are on one LRU bounded by
+ * Chunks_HWMark.  Everything but the LRU link is protected by the
+ * content_lock of the parent.
+ */
+
+struct dir_chunk {
+	/** Link in the parent's list of chunks */
+	struct glist_head chunks;
+	/** The entries of this chunk, in FSAL order */
+	struct glist_head dirents;
+	/** Link in the chunk LRU, protected by its lock */
+	struct glist_head lru;
+	/** Directory this chunk belongs to */
+	mdcache_entry_t *parent;
+	/** Preceding chunk, if cached */
+	struct dir_chunk *prev;
+	/** Following chunk, if cached */
+	struct dir_chunk *next;
+	/** FSAL cookie this chunk was read from, 0 for the start */
+	fsal_cookie_t start_ck;
+	/** FSAL cookie to continue reading after this chunk */
+	fsal_cookie_t next_ck;
+	/** Number of entries in the chunk */
+	uint32_t num_entries;
+	/** The FSAL reported end of directory after this chunk */
+	bool eod;
+};
+
+/**
+ * @brief Bloom filter of the names in a chunked directory
+ *
+ * Chunks only ever cover part of a directory, so a name missing from
+ * them says nothing.  Instead, every name the FSAL returns while the
+ * directory is read in order from its start is added here, and once
+ * that read reaches the end the filter is complete: a name it does
+ * not contain is not in the directory.  Created and renamed names are
+ * added as they appear; removed names stay, which only costs a trip
+ * to the FSAL.  Protected by the content_lock of the directory.
+ */
+
+struct dir_filter {
+	/** FSAL cookie the read from the start has reached */
+	fsal_cookie_t next_ck;
+	/** Names added */
+	uint32_t nnames;
+	/** Size of bits, in bits */
+	uint32_t nbits;
+	/** A read from the start is feeding the filter */
+	bool reading;
+	/** Every name in the directory has been added */
+	bool complete;
+	/** More names were added than the filter is sized for */
+	bool full;
+	uint64_t bits[];
+};
+
+/**
+ * @brief Where recent READDIRs of a chunked directory stopped
+ *
+ * A client paging slowly through a large directory may find the chunk
+ * of its cookie reclaimed.  Each cursor keeps the FSAL cookie the
+ * chunk of a cookie handed out last was read from, so the name of the
+ * cookie is looked for from there rather than from the start of the
+ * directory.  A cursor that no longer leads to its name is only a
+ * wasted read.
+ *
+ * Slots are replaced by exchange while walkers hold the content_lock
+ * for reading, and only read with it held for writing.
+ */
+
+#define MDC_DIR_CURSORS 8
+
+struct dir_cursor {
+	/** The client's cookie */
+	uint64_t ck;
+	/** FSAL cookie of the chunk it was in */
+	fsal_cookie_t start_ck;
+};
+
+struct dir_cursors {
+	/** Next slot to replace */
+	uint32_t hand;
+	struct dir_cursor *slot[MDC_DIR_CURSORS];
+};
+
 /* Helpers */
 fsal_status_t mdcache_alloc_and_check_handle(
 		struct mdcache_fsal_export *export,
@@ -320,7 +475,8 @@ fsal_status_t mdcache_alloc_and_check_handle(
 		mdcache_entry_t *parent,
 		const char *name,
 		bool invalidate,
-		struct state_t *state);
+		struct state_t *state,
+		bool locked);
 
 fsal_status_t get_optional_attrs(struct fsal_obj_handle *obj_hdl,
 				 struct attrlist *attrs_out);
@@ -345,19 +501,31 @@ fsal_status_t mdc_lookup_uncached(mdcache_entry_t *mdc_parent,
 				  const char *name,
 				  mdcache_entry_t **new_entry,
 				  struct attrlist *attrs_out);
+void mdc_name_locks_init(void);
+pthread_mutex_t *mdc_name_lock(mdcache_entry_t *dir, const char *name);
+void mdc_name_lock_pair(mdcache_entry_t *dir1, const char *name1,
+			mdcache_entry_t *dir2, const char *name2,
+			pthread_mutex_t **lock1, pthread_mutex_t **lock2);
 void mdcache_src_dest_lock(mdcache_entry_t *src, mdcache_entry_t *dest);
 void mdcache_src_dest_unlock(mdcache_entry_t *src, mdcache_entry_t *dest);
 fsal_status_t mdcache_dirent_remove(mdcache_entry_t *parent, const char *name);
 fsal_status_t mdcache_dirent_add(mdcache_entry_t *parent,
 					const char *name,
-					mdcache_entry_t *entry);
+					mdcache_entry_t *entry,
+					bool invalidate);
 fsal_status_t mdcache_dirent_rename(mdcache_entry_t *parent,
 				    const char *oldname,
 				    const char *newname);
 
 void mdcache_dirent_invalidate_all(mdcache_entry_t *entry);
 
-fsal_status_t mdcache_dirent_populate(mdcache_entry_t *dir);
+fsal_status_t mdcache_dirent_populate(mdcache_entry_t *dir, bool names_only);
+
+void mdcache_chunk_release(struct dir_chunk *chunk);
+fsal_status_t mdcache_readdir_chunked(mdcache_entry_t *directory,
+				      fsal_cookie_t whence, void *dir_state,
+				      fsal_readdir_cb cb, attrmask_t attrmask,
+				      bool *eod_met);
 
 static inline bool mdc_dircache_trusted(mdcache_entry_t *dir)
 {
@@ -378,6 +546,90 @@ static inline struct mdcache_fsal_export *mdc_cur_export(void)
 	return mdc_export(op_ctx->fsal_export);
 }
 
+/* Entries refreshed with one getattrs_multi */
+#define MDC_PREFETCH_BULK 64
+
+/**
+ * @brief A window of attribute prefetches
+ */
+struct mdc_prefetch {
+	pthread_mutex_t mtx;
+	pthread_cond_t cv;
+	/** Jobs not yet finished */
+	uint32_t pending;
+	/** Attributes wanted */
+	attrmask_t mask;
+	/** The sub-FSAL has no getattrs_multi */
+	bool nobulk;
+	/** Entries gathered for getattrs_multi, referenced */
+	uint32_t nbulk;
+	mdcache_entry_t *bulk[MDC_PREFETCH_BULK];
+};
+
+static inline bool mdc_prefetch_enabled(attrmask_t mask)
+{
+	return mask != 0 && mdcache_param.prefetch_threads != 0;
+}
+
+void mdc_prefetch_init(struct mdc_prefetch *pf, attrmask_t mask);
+void mdc_prefetch_add(struct mdc_prefetch *pf, mdcache_key_t *key);
+void mdc_prefetch_wait(struct mdc_prefetch *pf);
+fsal_status_t mdcache_prefetch_pkginit(void);
+fsal_status_t mdcache_prefetch_pkgshutdown(void);
+
+bool mdc_gather_write(mdcache_entry_t *entry, bool bypass,
+		      struct state_t *state, uint64_t offset, size_t size,
+		      void *buffer, bool stable, struct io_info *info);
+void mdc_gather_arm(mdcache_entry_t *entry, bool bypass,
+		    struct state_t *state, uint64_t next);
+void mdc_gather_flush(mdcache_entry_t *entry);
+fsal_status_t mdc_gather_commit(mdcache_entry_t *entry);
+void mdc_gather_free(mdcache_entry_t *entry);
+void mdc_commit_free(mdcache_entry_t *entry);
+
+fsal_status_t mdcache_xattr_pkginit(void);
+fsal_status_t mdcache_xattr_pkgshutdown(void);
+
+/**
+ * @brief Drop the cached xattrs of an entry
+ *
+ * @param[in] entry The entry
+ */
+static inline void mdc_xattr_invalidate(mdcache_entry_t *entry)
+{
+	atomic_clear_uint32_t_bits(&entry->mde_flags, MDCACHE_TRUST_XATTRS);
+}
+
+void mdcache_warm_tick(void);
+fsal_status_t mdcache_warm_pkginit(void);
+fsal_status_t mdcache_warm_pkgshutdown(void);
+
+void _mdc_cluster_invalidate(mdcache_entry_t *entry, uint32_t flags);
+fsal_status_t mdcache_cluster_pkginit(void);
+fsal_status_t mdcache_cluster_pkgshutdown(void);
+
+/* What the other heads drop of a directory whose names changed */
+#define MDC_CLUSTER_NAMESPACE (FSAL_UP_INVALIDATE_ATTRS | \
+			       FSAL_UP_INVALIDATE_CONTENT | \
+			       FSAL_UP_INVALIDATE_DIR_POPULATED)
+
+/**
+ * @brief Have the other heads of the cluster invalidate an entry
+ *
+ * @param[in] entry  The entry changed through this head
+ * @param[in] flags  FSAL_UP_INVALIDATE_* the peers should apply
+ */
+static inline void mdc_cluster_invalidate(mdcache_entry_t *entry,
+					  uint32_t flags)
+{
+	if (mdcache_param.cluster_group != NULL)
+		_mdc_cluster_invalidate(entry, flags);
+}
+
+fsal_status_t mdcache_refresh_attrs(mdcache_entry_t *entry, bool need_acl);
+void mdcache_install_attrs(mdcache_entry_t *entry, struct attrlist *attrs,
+			   bool need_acl);
+
 void mdc_clean_entry(mdcache_entry_t *entry);
 void _mdcache_kill_entry(mdcache_entry_t *entry,
 			 char *file, int line, char *function);
@@ -399,11 +651,25 @@ extern struct config_block mdcache_param_blk;
 } while (0)
 
 /* Call a sub-FSAL function using it's export */
+#ifdef USE_LTTNG
+#define subcall_raw(myexp, call) do { \
+	op_ctx->fsal_export = (myexp)->export.sub_export; \
+	op_ctx->fsal_call = __func__; \
+	tracepoint(mdcache, subcall_start, __func__); \
+	call; \
+	tracepoint(mdcache, subcall_end, __func__); \
+	op_ctx->fsal_call = NULL; \
+	op_ctx->fsal_export = &(myexp)->export; \
+} while (0)
+#else
 #define subcall_raw(myexp, call) do { \
 	op_ctx->fsal_export = (myexp)->export.sub_export; \
+	op_ctx->fsal_call = __func__; \
 	call; \
+	op_ctx->fsal_call = NULL; \
 	op_ctx->fsal_export = &(myexp)->export; \
 } while (0)
+#endif
 
 /* Call a sub-FSAL function using it's export */
 #define subcall(call) do { \
@@ -540,9 +806,48 @@ mdc_fixup_md(mdcache_entry_t *entry, attrmask_t mask)
 	atomic_set_uint32_t_bits(&entry->mde_flags, flags);
 }
 
+/**
+ * @brief Check if attributes have outlived Attr_Expiration_Time
+ *
+ * @note the caller MUST hold attr_lock for read
+ *
+ * @param[in] entry     The entry to check
+ */
+
+static inline bool
+mdcache_attrs_expired(const mdcache_entry_t *entry, attrmask_t mask)
+{
+	if ((mask & ~ATTR_ACL) != 0 && entry->attrs.expire_time_attr == 0)
+		return true;
+
+	if ((mask & ~ATTR_ACL) != 0 && entry->attrs.expire_time_attr > 0) {
+		time_t current_time = time(NULL);
+
+		if (current_time - entry->attr_time >
+		    entry->attrs.expire_time_attr)
+			return true;
+	}
+
+	if ((mask & ATTR_ACL) != 0 && entry->attrs.expire_time_attr == 0)
+		return true;
+
+	if ((mask & ATTR_ACL) != 0 && entry->attrs.expire_time_attr > 0) {
+		time_t current_time = time(NULL);
+
+		if (current_time - entry->acl_time >
+		    entry->attrs.expire_time_attr)
+			return true;
+	}
+
+	return false;
+}
+
 /**
  * @brief Check if attributes are valid
  *
+ * On an Attr_Upcall_Coherent export, attributes do not expire; they
+ * stay valid until an upcall clears the trust flags.
+ *
  * @note the caller MUST hold attr_lock for read
  *
  * @param[in] entry     The entry to check
@@ -571,27 +876,39 @@ mdcache_is_attrs_valid(const mdcache_entry_t *entry, attrmask_t mask)
 	    && mdcache_param.getattr_dir_invalidation)
 		return false;
 
-	if ((mask & ~ATTR_ACL) != 0 && entry->attrs.expire_time_attr == 0)
+	if (!mdcache_attrs_expired(entry, mask))
+		return true;
+
+	/* Upcalls without an export, from the FSAL, never keep them. */
+	if (op_ctx == NULL || op_ctx->ctx_export == NULL ||
+	    !op_ctx_export_has_option(EXPORT_OPTION_UPCALL_COHERENT))
 		return false;
 
-	if ((mask & ~ATTR_ACL) != 0 && entry->attrs.expire_time_attr > 0) {
-		time_t current_time = time(NULL);
+	return true;
+}
 
-		if (current_time - entry->attr_time >
-		    entry->attrs.expire_time_attr)
-			return false;
-	}
+/**
+ * @brief Check if attributes are valid, before refreshing them if not
+ *
+ * As mdcache_is_attrs_valid(), for the callers that refresh the
+ * attributes when they are not valid.  The refreshes skipped because an
+ * Attr_Upcall_Coherent export kept expired attributes are counted.
+ *
+ * @note the caller MUST hold attr_lock
+ *
+ * @param[in] entry     The entry to check
+ * @param[in] mask      The attributes wanted
+ */
 
-	if ((mask & ATTR_ACL) != 0 && entry->attrs.expire_time_attr == 0)
+static inline bool
+mdcache_attrs_valid_or_refresh(const mdcache_entry_t *entry,
+			       attrmask_t mask)
+{
+	if (!mdcache_is_attrs_valid(entry, mask))
 		return false;
 
-	if ((mask & ATTR_ACL) != 0 && entry->attrs.expire_time_attr > 0) {
-		time_t current_time = time(NULL);
-
-		if (current_time - entry->acl_time >
-		    entry->attrs.expire_time_attr)
-			return false;
-	}
+	if (mdcache_attrs_expired(entry, mask))
+		(void) atomic_inc_uint64_t(&cache_stp->inode_upcall_trust);
 
 	return true;
 }
@@ -782,6 +1099,13 @@ fsal_status_t mdcache_read2(struct fsal_obj_handle *obj_hdl,
 			   size_t *read_amount,
 			   bool *eof,
 			   struct io_info *info);
+fsal_status_t mdcache_read_buffer(struct fsal_obj_handle *obj_hdl,
+				  bool bypass,
+				  struct state_t *state,
+				  uint64_t offset,
+				  size_t buf_size,
+				  struct fsal_read_buf *rbuf,
+				  bool *eof);
 fsal_status_t mdcache_write2(struct fsal_obj_handle *obj_hdl,
 			     bool bypass,
 			     struct state_t *state,
@@ -807,6 +1131,52 @@ fsal_status_t mdcache_lock_op2(struct fsal_obj_handle *obj_hdl,
 			      fsal_lock_param_t *conflicting_lock);
 fsal_status_t mdcache_close2(struct fsal_obj_handle *obj_hdl,
 			     struct state_t *state);
+fsal_status_t mdcache_copy(struct fsal_obj_handle *src_hdl,
+			   struct state_t *src_state,
+			   uint64_t src_offset,
+			   struct fsal_obj_handle *dst_hdl,
+			   struct state_t *dst_state,
+			   uint64_t dst_offset,
+			   uint64_t count,
+			   uint64_t *copied);
+fsal_status_t mdcache_clone(struct fsal_obj_handle *src_hdl,
+			    struct state_t *src_state,
+			    uint64_t src_offset,
+			    struct fsal_obj_handle *dst_hdl,
+			    struct state_t *dst_state,
+			    uint64_t dst_offset,
+			    uint64_t count);
+fsal_status_t mdcache_fallocate(struct fsal_obj_handle *obj_hdl,
+				struct state_t *state,
+				uint64_t offset,
+				uint64_t length,
+				bool allocate);
+fsal_status_t mdcache_write_vec(struct fsal_obj_handle *obj_hdl,
+				bool bypass,
+				struct state_t *state,
+				uint64_t offset,
+				const struct iovec *iov,
+				int iovcnt,
+				size_t *wrote_amount,
+				bool *fsal_stable);
+fsal_status_t mdcache_read_vec(struct fsal_obj_handle *obj_hdl,
+			       bool bypass,
+			       struct state_t *state,
+			       uint64_t offset,
+			       const struct iovec *iov,
+			       int iovcnt,
+			       size_t *read_amount,
+			       bool *eof);
+void mdcache_read2_async(struct fsal_obj_handle *obj_hdl,
+			 bool bypass,
+			 struct fsal_io_arg *read_arg,
+			 fsal_async_cb done_cb,
+			 void *caller_arg);
+void mdcache_write2_async(struct fsal_obj_handle *obj_hdl,
+			  bool bypass,
+			  struct fsal_io_arg *write_arg,
+			  fsal_async_cb done_cb,
+			  void *caller_arg);
 
 /* extended attributes management */
 fsal_status_t mdcache_list_ext_attrs(struct fsal_obj_handle *obj_hdl,
@@ -54,6 +54,7 @@
 #include "mdcache_hash.h"
 #include "abstract_atomic.h"
 #include "gsh_intrinsic.h"
+#include "gsh_numa.h"
 #include "sal_functions.h"
 #include "nfs_exports.h"
 
@@ -152,6 +153,62 @@ struct lru_q_lane {
 
 static struct lru_q_lane LRU[LRU_N_Q_LANES];
 
+/**
+ * With NUMA_Partitions, the lanes are split between the NUMA nodes:
+ * node n owns lanes n * lru_node_lanes to (n + 1) * lru_node_lanes - 1,
+ * holding the entries whose memory is on it, allocated from its own
+ * slab pool.  A thread recycles entries from its node's lanes first, so
+ * that the entries it uses are local to it.  Otherwise lru_nnodes is 1
+ * and entries come from mdcache_entry_pool.
+ */
+
+static uint32_t lru_nnodes = 1;
+static uint32_t lru_node_lanes = LRU_N_Q_LANES;
+static uint32_t lru_node_next;
+static slab_pool_t **lru_node_pools;
+
+/**
+ * Dirent chunks are on a single queue of their own, since a chunk is
+ * touched at most once per READDIR and holds no references.
+ */
+
+static struct {
+	struct lru_q q;
+	pthread_mutex_t mtx;
+} chunk_lru;
+
+/* Chunks passed over in one reap before giving up */
+#define LRU_CHUNK_REAP_TRIES 16
+
+/* Touched entries promoted in one reap before taking the next anyway */
+#define LRU_TOUCHED_SKIP 8
+
+/**
+ * With LRU_POLICY_2Q, the hashes of entries reclaimed while still on
+ * probation.  Direct mapped and lossy: a ghost only earns a new entry
+ * with its handle admission to L1, so losing one costs little.
+ */
+static uint64_t *lru_ghosts;
+static uint32_t lru_nghosts;
+
+static inline void
+lru_ghost_add(uint64_t hk)
+{
+	atomic_store_uint64_t(&lru_ghosts[hk % lru_nghosts], hk);
+	(void) atomic_inc_uint64_t(&cache_stp->inode_ghost_add);
+}
+
+static inline bool
+lru_ghost_take(uint64_t hk)
+{
+	uint64_t *slot = &lru_ghosts[hk % lru_nghosts];
+
+	if (atomic_fetch_uint64_t(slot) != hk)
+		return false;
+	atomic_store_uint64_t(slot, 0);
+	return true;
+}
+
 /**
  * The refcount mechanism distinguishes 3 key object states:
  *
@@ -247,6 +304,9 @@ lru_init_queues(void)
 		lru_init_queue(&LRU[ix].noscan, LRU_ENTRY_NOSCAN);
 		lru_init_queue(&LRU[ix].cleanup, LRU_ENTRY_CLEANUP);
 	}
+
+	PTHREAD_MUTEX_init(&chunk_lru.mtx, NULL);
+	lru_init_queue(&chunk_lru.q, LRU_ENTRY_NONE);
 }
 
 /**
@@ -301,6 +361,10 @@ lru_queue_of(mdcache_entry_t *entry)
 static inline uint32_t
 lru_lane_of_entry(mdcache_entry_t *entry)
 {
+	if (entry->lru.node != GSH_NUMA_NODE_ANY)
+		return entry->lru.node * lru_node_lanes +
+		       atomic_inc_uint32_t(&lru_node_next) % lru_node_lanes;
+
 	return (uint32_t) ((((uintptr_t) entry) / 2*sizeof(uintptr_t))
 				% LRU_N_Q_LANES);
 }
@@ -395,6 +459,52 @@ cond_noscan_entry(mdcache_entry_t *entry, uint32_t flags)
 	} /* ! NOSCAN */
 }
 
+/**
+ * @brief Apply a deferred promotion
+ *
+ * Initial references only mark an entry LRU_TOUCHED, so that hot
+ * entries never serialize on their lane lock.  The move they would
+ * have made (to MRU of L1 from L1, to LRU of L1 from L2) is made here,
+ * by the reaper or the LRU thread, when the entry reaches the cold
+ * end of its queue.
+ *
+ * @note The caller MUST hold the lane lock
+ *
+ * @param[in] lru  The LRU entry
+ *
+ * @return true if the entry had been touched.
+ */
+static inline bool
+lru_promote_touched(mdcache_lru_t *lru)
+{
+	struct lru_q_lane *qlane = &LRU[lru->lane];
+	struct lru_q *q;
+
+	if (!(atomic_fetch_uint32_t(&lru->flags) & LRU_TOUCHED))
+		return false;
+
+	(void) atomic_clear_uint32_t_bits(&lru->flags, LRU_TOUCHED);
+
+	switch (lru->qid) {
+	case LRU_ENTRY_L1:
+		q = &qlane->L1;
+		LRU_DQ_SAFE(lru, q);
+		lru_insert(lru, q, LRU_MRU);
+		break;
+	case LRU_ENTRY_L2:
+		q = &qlane->L2;
+		LRU_DQ_SAFE(lru, q);
+		lru_insert(lru, &qlane->L1, LRU_LRU);
+		(void) atomic_clear_uint32_t_bits(&lru->flags, LRU_PROBATION);
+		break;
+	default:
+		/* do nothing */
+		break;
+	}
+
+	return true;
+}
+
 /**
  * @brief Clean an entry for recycling.
  *
@@ -407,6 +517,10 @@ mdcache_lru_clean(mdcache_entry_t *entry)
 {
 	fsal_status_t status = {0, 0};
 
+	/* Write out and drop anything gathered */
+	mdc_gather_free(entry);
+	mdc_commit_free(entry);
+
 	/* Make sure any FSAL global file descriptor is closed. */
 	status = fsal_close(&entry->obj_handle);
 
@@ -426,6 +540,8 @@ mdcache_lru_clean(mdcache_entry_t *entry)
 
 	/* Done with the attrs */
 	fsal_release_attrs(&entry->attrs);
+	(void) atomic_sub_uint64_t(&lru_state.mem_used, entry->lru.mem);
+	entry->lru.mem = 0;
 
 	/* Clean our handle */
 	fsal_obj_handle_fini(&entry->obj_handle);
@@ -440,7 +556,7 @@ mdcache_lru_clean(mdcache_entry_t *entry)
 }
 
 /**
- * @brief Try to pull an entry off the queue
+ * @brief Try to pull an entry off the queue of one lane
  *
  * This function examines the end of the specified queue and if the
  * entry found there can be re-used, it returns with the entry
@@ -452,89 +568,127 @@ mdcache_lru_clean(mdcache_entry_t *entry)
  *
  * @note The caller @a MUST @a NOT hold the lane lock
  *
+ * @param[in] lane Lane to reap
  * @param[in] qid  Queue to reap
  * @return Available entry if found, NULL otherwise
  */
 
-static uint32_t reap_lane;
-
 static inline mdcache_lru_t *
-lru_reap_impl(enum lru_q_id qid)
+lru_reap_lane(uint32_t lane, enum lru_q_id qid)
 {
-	uint32_t lane;
-	struct lru_q_lane *qlane;
+	struct lru_q_lane *qlane = &LRU[lane];
 	struct lru_q *lq;
 	mdcache_lru_t *lru;
 	mdcache_entry_t *entry;
 	uint32_t refcnt;
 	cih_latch_t latch;
-	int ix;
+	int tries;
 
-	lane = LRU_NEXT(reap_lane);
-	for (ix = 0; ix < LRU_N_Q_LANES; ++ix, lane = LRU_NEXT(reap_lane)) {
-		qlane = &LRU[lane];
-		lq = (qid == LRU_ENTRY_L1) ? &qlane->L1 : &qlane->L2;
+	lq = (qid == LRU_ENTRY_L1) ? &qlane->L1 : &qlane->L2;
 
-		QLOCK(qlane);
+	QLOCK(qlane);
+	/* give touched entries their promotion, within reason */
+	for (tries = 0;; ++tries) {
 		lru = glist_first_entry(&lq->q, mdcache_lru_t, q);
-		if (!lru)
-			goto next_lane;
-		refcnt = atomic_inc_int32_t(&lru->refcnt);
-		entry = container_of(lru, mdcache_entry_t, lru);
-		if (unlikely(refcnt != (LRU_SENTINEL_REFCOUNT + 1))) {
-			/* cant use it. */
-			mdcache_lru_unref(entry, LRU_UNREF_QLOCKED);
-			goto next_lane;
-		}
-		/* potentially reclaimable */
+		if (!lru || tries == LRU_TOUCHED_SKIP ||
+		    !lru_promote_touched(lru))
+			break;
+	}
+	if (!lru)
+		goto unlock;
+	refcnt = atomic_inc_int32_t(&lru->refcnt);
+	entry = container_of(lru, mdcache_entry_t, lru);
+	if (unlikely(refcnt != (LRU_SENTINEL_REFCOUNT + 1))) {
+		/* cant use it. */
+		mdcache_lru_unref(entry, LRU_UNREF_QLOCKED);
+		goto unlock;
+	}
+	/* potentially reclaimable */
+	QUNLOCK(qlane);
+	/* entry must be unreachable from CIH when recycled */
+	if (!cih_latch_entry(&entry->fh_hk.key, &latch, CIH_GET_WLOCK,
+			     __func__, __LINE__)) {
+		/* ! QLOCKED but needs to be Unref'ed */
+		mdcache_lru_unref(entry, LRU_FLAG_NONE);
+		return NULL;
+	}
+	QLOCK(qlane);
+	refcnt = atomic_fetch_int32_t(&entry->lru.refcnt);
+	/* there are two cases which permit reclaim,
+	 * entry is:
+	 * 1. reachable but unref'd (refcnt==2)
+	 * 2. unreachable, being removed (plus refcnt==0)
+	 *  for safety, take only the former
+	 */
+	if (LRU_ENTRY_RECLAIMABLE(entry, refcnt)) {
+		/* it worked */
+		struct lru_q *q = lru_queue_of(entry);
+
+		if (lru->flags & LRU_PROBATION)
+			lru_ghost_add(entry->fh_hk.key.hk);
+		cih_remove_latched(entry, &latch, CIH_REMOVE_QLOCKED);
+		LRU_DQ_SAFE(lru, q);
+		entry->lru.qid = LRU_ENTRY_NONE;
 		QUNLOCK(qlane);
-		/* entry must be unreachable from CIH when recycled */
-		if (cih_latch_entry(&entry->fh_hk.key, &latch, CIH_GET_WLOCK,
-				    __func__, __LINE__)) {
-			QLOCK(qlane);
-			refcnt = atomic_fetch_int32_t(&entry->lru.refcnt);
-			/* there are two cases which permit reclaim,
-			 * entry is:
-			 * 1. reachable but unref'd (refcnt==2)
-			 * 2. unreachable, being removed (plus refcnt==0)
-			 *  for safety, take only the former
-			 */
-			if (LRU_ENTRY_RECLAIMABLE(entry, refcnt)) {
-				/* it worked */
-				struct lru_q *q = lru_queue_of(entry);
-
-				cih_remove_latched(entry, &latch,
-						   CIH_REMOVE_QLOCKED);
-				LRU_DQ_SAFE(lru, q);
-				entry->lru.qid = LRU_ENTRY_NONE;
-				QUNLOCK(qlane);
-				cih_hash_release(&latch);
-				/* Note, we're not releasing our ref here.
-				 * cih_remove_latched() called
-				 * mdcache_lru_unref(), which released the
-				 * sentinal ref, leaving just the one ref we
-				 * took earlier.  Returning this as is leaves it
-				 * with a ref of 1 (ie, just the sentinal ref)
-				 * */
-				goto out;
-			}
-			cih_hash_release(&latch);
-			/* return the ref we took above--unref deals
-			 * correctly with reclaim case */
-			mdcache_lru_unref(entry, LRU_UNREF_QLOCKED);
-		} else {
-			/* ! QLOCKED but needs to be Unref'ed */
-			mdcache_lru_unref(entry, LRU_FLAG_NONE);
-			continue;
+		cih_hash_release(&latch);
+		/* Note, we're not releasing our ref here.
+		 * cih_remove_latched() called mdcache_lru_unref(), which
+		 * released the sentinal ref, leaving just the one ref we
+		 * took earlier.  Returning this as is leaves it with a ref
+		 * of 1 (ie, just the sentinal ref)
+		 * */
+		return lru;
+	}
+	cih_hash_release(&latch);
+	/* return the ref we took above--unref deals
+	 * correctly with reclaim case */
+	mdcache_lru_unref(entry, LRU_UNREF_QLOCKED);
+	lru = NULL;
+ unlock:
+	QUNLOCK(qlane);
+	return lru;
+}
+
+/**
+ * @brief Try to pull an entry off the queue of any lane
+ *
+ * Lanes are tried round robin, starting after the last one tried.
+ *
+ * @note The caller @a MUST @a NOT hold a lane lock
+ *
+ * @param[in] qid  Queue to reap
+ * @return Available entry if found, NULL otherwise
+ */
+
+static uint32_t reap_lane;
+
+static inline mdcache_lru_t *
+lru_reap_impl(enum lru_q_id qid)
+{
+	mdcache_lru_t *lru;
+	uint32_t base;
+	int ix;
+
+	if (lru_nnodes > 1) {
+		/* this node's lanes first */
+		base = gsh_numa_node() * lru_node_lanes;
+		for (ix = 0; ix < lru_node_lanes; ++ix) {
+			lru = lru_reap_lane(base +
+					    atomic_inc_uint32_t(&reap_lane) %
+					    lru_node_lanes, qid);
+			if (lru)
+				return lru;
 		}
- next_lane:
-		QUNLOCK(qlane);
-	}			/* foreach lane */
+	}
+
+	for (ix = 0; ix < LRU_N_Q_LANES; ++ix) {
+		lru = lru_reap_lane(LRU_NEXT(reap_lane), qid);
+		if (lru)
+			return lru;
+	}
 
 	/* ! reclaimable */
-	lru = NULL;
- out:
-	return lru;
+	return NULL;
 }
 
 static inline mdcache_lru_t *
@@ -542,7 +696,8 @@ lru_try_reap_entry(void)
 {
 	mdcache_lru_t *lru;
 
-	if (lru_state.entries_used < lru_state.entries_hiwat)
+	if (lru_state.entries_used < lru_state.entries_hiwat &&
+	    !mdcache_lru_over_mem())
 		return NULL;
 
 	/* XXX dang why not start with the cleanup list? */
@@ -643,17 +798,99 @@ mdcache_lru_cleanup_try_push(mdcache_entry_t *entry)
 	}
 }
 
+/* Entries taken off a lane before their fds are closed together */
+#define LRU_CLOSE_BATCH 64
+
+/**
+ * @brief Close the global fds of a batch of entries
+ *
+ * Called with the lane unlocked.  The batch holds a reference on each
+ * entry, which the caller drops.
+ *
+ * @param[in]     batch         The entries
+ * @param[in]     nbatch        How many there are
+ * @param[in,out] totalclosed   Track the number of file closes
+ *
+ * @returns the number of files closed.
+ */
+
+static size_t lru_close_batch(mdcache_entry_t **batch, int nbatch,
+			      uint64_t *const totalclosed)
+{
+	size_t closed = 0;
+	fsal_status_t status;
+	mdcache_entry_t *entry;
+	struct mdcache_fsal_export *exp;
+	bool not_support_ex;
+	bool was_open;
+	int ix;
+
+	for (ix = 0; ix < nbatch; ix++) {
+		entry = batch[ix];
+
+		/** @todo FSF: hmm, this looks hairy, we need a reference
+		 *             to the export somehow?
+		 */
+		exp = atomic_fetch_voidptr(&entry->first_export);
+		op_ctx->fsal_export = &exp->export;
+		op_ctx->ctx_export = NULL;
+
+		not_support_ex = !entry->obj_handle.fsal->m_ops.support_ex(
+							&entry->obj_handle);
+
+		if (not_support_ex) {
+			/* Acquire the content lock first; we may need to look
+			 * at fds and close it.
+			 */
+			PTHREAD_RWLOCK_wrlock(&entry->content_lock);
+		}
+
+		was_open = entry->obj_handle.type == REGULAR_FILE &&
+			   entry->obj_handle.obj_ops.status(&entry->obj_handle)
+			   != FSAL_O_CLOSED;
+
+		/* Make sure any FSAL global file descriptor is closed. */
+		status = fsal_close(&entry->obj_handle);
+
+		if (not_support_ex) {
+			/* Release the content lock. */
+			PTHREAD_RWLOCK_unlock(&entry->content_lock);
+		}
+
+		if (FSAL_IS_ERROR(status)) {
+			LogCrit(COMPONENT_CACHE_INODE_LRU,
+				"Error closing file in LRU thread.");
+		} else {
+			++(*totalclosed);
+			++closed;
+			if (was_open)
+				atomic_set_uint32_t_bits(&entry->lru.flags,
+							 LRU_FD_REAPED);
+		}
+	}
+
+	return closed;
+}
+
 /**
  * @brief Function that executes in the lru thread to process one lane
  *
+ * Entries are taken off L1 in batches of LRU_CLOSE_BATCH, and their fds
+ * closed with the lane unlocked.  Past the first batch, the lane is left
+ * as soon as the open FD count is back under the low water mark, rather
+ * than closing fds clients are still about to use.  Short of extremis,
+ * an entry whose fd was reopened after we last closed it is spared once.
+ *
  * @param[in]     lane          The lane to process
+ * @param[in]     extremis      The open FD count is over the high water mark
  * @param[in,out] totalclosed   Track the number of file closes
  *
  * @returns the number of files worked on (workdone)
  *
  */
 
-static inline size_t lru_run_lane(size_t lane, uint64_t *const totalclosed)
+static inline size_t lru_run_lane(size_t lane, bool extremis,
+				  uint64_t *const totalclosed)
 {
 	struct lru_q *q;
 	/* The amount of work done on this lane on this pass. */
@@ -662,18 +899,18 @@ static inline size_t lru_run_lane(size_t lane, uint64_t *const totalclosed)
 	mdcache_lru_t *lru = NULL;
 	/* Number of entries closed in this run. */
 	size_t closed = 0;
-	fsal_status_t status;
 	/* a cache entry */
 	mdcache_entry_t *entry;
+	/* Entries whose fds are to be closed */
+	mdcache_entry_t *batch[LRU_CLOSE_BATCH];
+	int nbatch = 0;
+	int ix;
 	/* Current queue lane */
 	struct lru_q_lane *qlane = &LRU[lane];
 	/* entry refcnt */
 	uint32_t refcnt;
 	struct req_op_context ctx = {0};
 	struct req_op_context *saved_ctx = op_ctx;
-	struct mdcache_fsal_export *exp;
-	struct fsal_export *export;
-	bool not_support_ex;
 
 	op_ctx = &ctx;
 
@@ -698,6 +935,25 @@ static inline size_t lru_run_lane(size_t lane, uint64_t *const totalclosed)
 			goto next_lane;
 
 		lru = glist_entry(qlane->iter.glist, mdcache_lru_t, q);
+
+		/* touched since we last looked, keep it in L1 */
+		if (lru_promote_touched(lru)) {
+			workdone++;
+			continue;
+		}
+
+		/* reopened since we last closed it, give it another turn */
+		if (!extremis &&
+		    (atomic_fetch_uint32_t(&lru->flags) & LRU_FD_REOPENED)) {
+			(void) atomic_clear_uint32_t_bits(&lru->flags,
+							  LRU_FD_REOPENED);
+			q = &qlane->L1;
+			LRU_DQ_SAFE(lru, q);
+			lru_insert(lru, q, LRU_MRU);
+			workdone++;
+			continue;
+		}
+
 		refcnt = atomic_inc_int32_t(&lru->refcnt);
 
 		/* get entry early */
@@ -719,52 +975,40 @@ static inline size_t lru_run_lane(size_t lane, uint64_t *const totalclosed)
 		q = &qlane->L2;
 		lru_insert(lru, q, LRU_MRU);
 		++(q->size);
+		++workdone;
+
+		batch[nbatch++] = entry;
+		if (nbatch < LRU_CLOSE_BATCH)
+			continue;
 
 		/* Drop the lane lock while performing (slow) operations on
-		 * entry */
+		 * entries */
 		QUNLOCK(qlane);
+		closed += lru_close_batch(batch, nbatch, totalclosed);
+		QLOCK(qlane); /* QLOCKED */
 
-		/** @todo FSF: hmm, this looks hairy, we need a reference
-		 *             to the export somehow?
-		 */
-		exp = atomic_fetch_voidptr(&entry->first_export);
-		export = &exp->export;
-		op_ctx->fsal_export = export;
-		op_ctx->ctx_export = NULL;
-
-		not_support_ex = !entry->obj_handle.fsal->m_ops.support_ex(
-							&entry->obj_handle);
-
-		if (not_support_ex) {
-			/* Acquire the content lock first; we may need to look
-			 * at fds and close it.
-			 */
-			PTHREAD_RWLOCK_wrlock(&entry->content_lock);
-		}
-
-		/* Make sure any FSAL global file descriptor is closed. */
-		status = fsal_close(&entry->obj_handle);
-
-		if (not_support_ex) {
-			/* Release the content lock. */
-			PTHREAD_RWLOCK_unlock(&entry->content_lock);
-		}
-
-		if (FSAL_IS_ERROR(status)) {
-			LogCrit(COMPONENT_CACHE_INODE_LRU,
-				"Error closing file in LRU thread.");
-		} else {
-			++(*totalclosed);
-			++closed;
-		}
+		for (ix = 0; ix < nbatch; ix++)
+			mdcache_lru_unref(batch[ix], LRU_UNREF_QLOCKED);
+		nbatch = 0;
 
-		QLOCK(qlane); /* QLOCKED */
-		mdcache_lru_unref(entry, LRU_UNREF_QLOCKED);
-		++workdone;
+		/* back under the low water mark, leave the rest open */
+		if (mdcache_param.use_fd_cache &&
+		    atomic_fetch_size_t(&open_fd_count) < lru_state.fds_lowat)
+			goto next_lane;
 	} /* for_each_safe lru */
 
 next_lane:
 	qlane->iter.active = false; /* !ACTIVE */
+
+	if (nbatch != 0) {
+		QUNLOCK(qlane);
+		closed += lru_close_batch(batch, nbatch, totalclosed);
+		QLOCK(qlane);
+
+		for (ix = 0; ix < nbatch; ix++)
+			mdcache_lru_unref(batch[ix], LRU_UNREF_QLOCKED);
+	}
+
 	QUNLOCK(qlane);
 	LogDebug(COMPONENT_CACHE_INODE_LRU,
 		 "Actually processed %zd entries on lane %zd closing %zd descriptors",
@@ -775,6 +1019,103 @@ next_lane:
 	return workdone;
 }
 
+/**
+ * @brief Run one pass over the lanes of a reaper
+ *
+ * The same pass lru_run makes over lanes me, me + nthreads, ..., so
+ * that the benchmarks can drive lane reaping directly.
+ *
+ * @param[in]     me            Index of the reaper
+ * @param[in]     nthreads      Number of reapers
+ * @param[in]     extremis      The open FD count is over the high water mark
+ * @param[in,out] totalclosed   Track the number of file closes
+ *
+ * @returns the number of files worked on
+ */
+size_t mdcache_lru_run_lanes(uint32_t me, uint32_t nthreads, bool extremis,
+			     uint64_t *totalclosed)
+{
+	size_t lane, workdone = 0;
+
+	for (lane = me; lane < LRU_N_Q_LANES; lane += nthreads)
+		workdone += lru_run_lane(lane, extremis, totalclosed);
+
+	return workdone;
+}
+
+/**
+ * @brief How far the cache is above its high water marks
+ *
+ * @return Excess over Entries_HWMark or Cache_Memory_Limit, whichever
+ *         is greater, in thousandths, capped at 1000.
+ */
+static uint32_t
+lru_excess(void)
+{
+	uint64_t used = atomic_fetch_uint64_t(&lru_state.entries_used);
+	uint64_t excess = 0, mem;
+
+	if (used > lru_state.entries_hiwat)
+		excess = (used - lru_state.entries_hiwat) * 1000 /
+			 lru_state.entries_hiwat;
+
+	mem = atomic_fetch_uint64_t(&lru_state.mem_used);
+	if (lru_state.mem_limit != 0 && mem > lru_state.mem_limit &&
+	    (mem - lru_state.mem_limit) * 1000 / lru_state.mem_limit > excess)
+		excess = (mem - lru_state.mem_limit) * 1000 /
+			 lru_state.mem_limit;
+
+	return (excess < 1000) ? excess : 1000;
+}
+
+/**
+ * @brief Free entries from a reaper's lanes while over a high water mark
+ *
+ * Entries are taken the way mdcache_lru_get() recycles them, L2 first,
+ * but freed rather than reused, so that requests find room without
+ * reaping inline.  Each of the reaper threads does up to its share of
+ * Reaper_Work per run.
+ *
+ * @param[in] me       Index of this reaper thread
+ * @param[in] nthreads Number of reaper threads
+ */
+static void
+lru_reap_excess(uint32_t me, uint32_t nthreads)
+{
+	mdcache_lru_t *lru;
+	uint32_t lane = me;
+	uint32_t reaped = 0, idle = 0;
+	uint32_t nlanes = (LRU_N_Q_LANES - me + nthreads - 1) / nthreads;
+
+	while (reaped < mdcache_param.reaper_work / nthreads &&
+	       idle < nlanes && lru_excess() != 0) {
+		lru = lru_reap_lane(lane, LRU_ENTRY_L2);
+		if (!lru)
+			lru = lru_reap_lane(lane, LRU_ENTRY_L1);
+		lane += nthreads;
+		if (lane >= LRU_N_Q_LANES)
+			lane = me;
+		if (!lru) {
+			/* give up once every lane we own came up empty */
+			++idle;
+			continue;
+		}
+		idle = 0;
+		/* drop the sentinel ref, freeing it */
+		mdcache_lru_unref(container_of(lru, mdcache_entry_t, lru),
+				  LRU_FLAG_NONE);
+		++reaped;
+	}
+
+	if (reaped != 0)
+		LogDebug(COMPONENT_CACHE_INODE_LRU,
+			 "Reaper %" PRIu32 " freed %" PRIu32
+			 " entries, %" PRIu64 " entries and %" PRIu64
+			 " bytes in use", me, reaped,
+			 atomic_fetch_uint64_t(&lru_state.entries_used),
+			 atomic_fetch_uint64_t(&lru_state.mem_used));
+}
+
 /**
  * @brief Function that executes in the lru thread
  *
@@ -819,6 +1160,11 @@ next_lane:
  *  - If we fall below the low water mark and FD caching has been
  *    temporarily disabled, re-enable it.
  *
+ * With Reaper_Threads above 1, each thread runs this over the lanes
+ * congruent to its index modulo the number of threads.  Thread 0 alone
+ * keeps the futility state and sets the pacing, which also shortens
+ * in proportion to how far the cache is over its high water marks.
+ *
  * This function uses the lock discipline for functions accessing LRU
  * entries through a queue partition.
  *
@@ -828,6 +1174,10 @@ next_lane:
 static void
 lru_run(struct fridgethr_context *ctx)
 {
+	/* This reaper, and how many there are */
+	uint32_t me = (uintptr_t) ctx->arg;
+	uint32_t nthreads = mdcache_param.reaper_threads;
+	bool leader = (me == 0);
 	/* Index */
 	size_t lane = 0;
 	/* True if we were explicitly awakened. */
@@ -846,6 +1196,7 @@ lru_run(struct fridgethr_context *ctx)
 	/* The current count (after reaping) of open FDs */
 	size_t currentopen = 0;
 	time_t new_thread_wait;
+	uint32_t excess;
 
 	SetNameFunction("cache_lru");
 
@@ -857,7 +1208,7 @@ lru_run(struct fridgethr_context *ctx)
 
 	LogFullDebug(COMPONENT_CACHE_INODE_LRU, "LRU awakes.");
 
-	if (!woke) {
+	if (!woke && leader) {
 		/* If we make it all the way through a timed sleep
 		   without being woken, we assume we aren't racing
 		   against the impossible. */
@@ -867,6 +1218,8 @@ lru_run(struct fridgethr_context *ctx)
 	LogFullDebug(COMPONENT_CACHE_INODE_LRU, "lru entries: %" PRIu64,
 		     lru_state.entries_used);
 
+	lru_reap_excess(me, nthreads);
+
 	/* Reap file descriptors.  This is a preliminary example of the
 	   L2 functionality rather than something we expect to be
 	   permanent.  (It will have to adapt heavily to the new FSAL
@@ -879,7 +1232,7 @@ lru_run(struct fridgethr_context *ctx)
 			 "FD count is %zd and low water mark is %d: not reaping.",
 			 atomic_fetch_size_t(&open_fd_count),
 			 lru_state.fds_lowat);
-		if (mdcache_param.use_fd_cache
+		if (leader && mdcache_param.use_fd_cache
 		    && !lru_state.caching_fds) {
 			lru_state.caching_fds = true;
 			LogEvent(COMPONENT_CACHE_INODE_LRU,
@@ -912,7 +1265,8 @@ lru_run(struct fridgethr_context *ctx)
 		/* Total fds closed between all lanes and all current runs. */
 		do {
 			workpass = 0;
-			for (lane = 0; lane < LRU_N_Q_LANES; ++lane) {
+			for (lane = me; lane < LRU_N_Q_LANES;
+			     lane += nthreads) {
 				LogDebug(COMPONENT_CACHE_INODE_LRU,
 					 "Reaping up to %d entries from lane %zd",
 					 lru_state.per_lane_work, lane);
@@ -922,14 +1276,15 @@ lru_run(struct fridgethr_context *ctx)
 					     PRIu64, formeropen, totalwork,
 					     workpass, totalclosed);
 
-				workpass += lru_run_lane(lane, &totalclosed);
+				workpass += lru_run_lane(lane, extremis,
+							 &totalclosed);
 			}
 			totalwork += workpass;
 		} while (extremis && (workpass >= lru_state.per_lane_work)
 			 && (totalwork < lru_state.biggest_window));
 
 		currentopen = atomic_fetch_size_t(&open_fd_count);
-		if (extremis
+		if (leader && extremis
 		    && ((currentopen > formeropen)
 			|| (formeropen - currentopen <
 			    (((formeropen -
@@ -945,6 +1300,12 @@ lru_run(struct fridgethr_context *ctx)
 		}
 	}
 
+	/* The rest is pacing, shared by all the reapers */
+	if (!leader)
+		return;
+
+	mdcache_warm_tick();
+
 	/* The following calculation will progressively garbage collect
 	 * more frequently as these two factors increase:
 	 * 1. current number of open file descriptors
@@ -969,6 +1330,15 @@ lru_run(struct fridgethr_context *ctx)
 
 	new_thread_wait = threadwait * fdwait_ratio;
 
+	/* Bursts that take the cache over its high water marks get up to
+	 * ten times the usual attention */
+	excess = lru_excess();
+	if (excess != 0 &&
+	    new_thread_wait > mdcache_param.lru_run_interval * 1000 /
+			      (1000 + 9 * excess))
+		new_thread_wait = mdcache_param.lru_run_interval * 1000 /
+				  (1000 + 9 * excess);
+
 	if (new_thread_wait < mdcache_param.lru_run_interval / 10)
 		new_thread_wait = mdcache_param.lru_run_interval / 10;
 
@@ -987,6 +1357,44 @@ lru_run(struct fridgethr_context *ctx)
 		     lru_state.fds_lowat);
 }
 
+/**
+ * @brief Partition the lanes and entry memory by NUMA node
+ *
+ * Nothing is partitioned on a single node, or with more nodes than
+ * lanes.
+ */
+static void lru_numa_init(void)
+{
+	uint32_t nodes, node;
+	char name[32];
+
+	gsh_numa_init();
+	nodes = gsh_numa_nodes();
+
+	if (nodes == 1 || nodes > LRU_N_Q_LANES) {
+		LogInfo(COMPONENT_CACHE_INODE_LRU,
+			"Not partitioning the cache over %" PRIu32
+			" NUMA nodes", nodes);
+		return;
+	}
+
+	lru_node_pools = gsh_calloc(nodes, sizeof(slab_pool_t *));
+	for (node = 0; node < nodes; ++node) {
+		snprintf(name, sizeof(name), "MDCACHE entries node %" PRIu32,
+			 node);
+		lru_node_pools[node] =
+			slab_pool_init_node(name, sizeof(mdcache_entry_t),
+					    node);
+	}
+
+	lru_nnodes = nodes;
+	lru_node_lanes = LRU_N_Q_LANES / nodes;
+
+	LogInfo(COMPONENT_CACHE_INODE_LRU,
+		"Cache partitioned over %" PRIu32 " NUMA nodes, %" PRIu32
+		" lanes each", lru_nnodes, lru_node_lanes);
+}
+
 /* Public functions */
 
 /**
@@ -1003,10 +1411,11 @@ mdcache_lru_pkginit(void)
 		.rlim_max = RLIM_INFINITY
 	};
 	struct fridgethr_params frp;
+	uint32_t ix;
 
 	memset(&frp, 0, sizeof(struct fridgethr_params));
-	frp.thr_max = 1;
-	frp.thr_min = 1;
+	frp.thr_max = mdcache_param.reaper_threads;
+	frp.thr_min = mdcache_param.reaper_threads;
 	frp.thread_delay = mdcache_param.lru_run_interval;
 	frp.flavor = fridgethr_flavor_looper;
 
@@ -1016,6 +1425,8 @@ mdcache_lru_pkginit(void)
 	   bit fishy, so come back and revisit this. */
 	lru_state.entries_hiwat = mdcache_param.entries_hwmark;
 	lru_state.entries_used = 0;
+	lru_state.mem_limit = mdcache_param.mem_limit;
+	lru_state.mem_used = 0;
 
 	/* Find out the system-imposed file descriptor limit */
 	if (getrlimit(RLIMIT_NOFILE, &rlim) != 0) {
@@ -1109,6 +1520,14 @@ err_open:
 	/* init queue complex */
 	lru_init_queues();
 
+	if (mdcache_param.numa)
+		lru_numa_init();
+
+	if (mdcache_param.lru_policy == LRU_POLICY_2Q) {
+		lru_nghosts = mdcache_param.entries_hwmark / 2 + 1;
+		lru_ghosts = gsh_calloc(lru_nghosts, sizeof(uint64_t));
+	}
+
 	/* spawn LRU background thread */
 	code = fridgethr_init(&lru_fridge, "LRU_fridge", &frp);
 	if (code != 0) {
@@ -1118,11 +1537,15 @@ err_open:
 		return fsalstat(posix2fsal_error(code), code);
 	}
 
-	code = fridgethr_submit(lru_fridge, lru_run, NULL);
-	if (code != 0) {
-		LogMajor(COMPONENT_CACHE_INODE_LRU,
-			 "Unable to start LRU thread, error code %d.", code);
-		return fsalstat(posix2fsal_error(code), code);
+	for (ix = 0; ix < mdcache_param.reaper_threads; ++ix) {
+		code = fridgethr_submit(lru_fridge, lru_run,
+					(void *)(uintptr_t) ix);
+		if (code != 0) {
+			LogMajor(COMPONENT_CACHE_INODE_LRU,
+				 "Unable to start LRU thread, error code %d.",
+				 code);
+			return fsalstat(posix2fsal_error(code), code);
+		}
 	}
 
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
@@ -1136,6 +1559,7 @@ err_open:
 fsal_status_t
 mdcache_lru_pkgshutdown(void)
 {
+	uint32_t ix;
 	int rc = fridgethr_sync_command(lru_fridge,
 					fridgethr_comm_stop,
 					120);
@@ -1148,6 +1572,19 @@ mdcache_lru_pkgshutdown(void)
 		LogMajor(COMPONENT_CACHE_INODE_LRU,
 			 "Failed shutting down LRU thread: %d", rc);
 	}
+
+	gsh_free(lru_ghosts);
+	lru_ghosts = NULL;
+
+	if (lru_node_pools != NULL) {
+		for (ix = 0; ix < lru_nnodes; ++ix)
+			slab_pool_destroy(lru_node_pools[ix]);
+		gsh_free(lru_node_pools);
+		lru_node_pools = NULL;
+		lru_nnodes = 1;
+		lru_node_lanes = LRU_N_Q_LANES;
+	}
+
 	return fsalstat(posix2fsal_error(rc), rc);
 }
 
@@ -1158,12 +1595,28 @@ static inline void init_rw_locks(mdcache_entry_t *entry)
 	PTHREAD_RWLOCK_init(&entry->content_lock, NULL);
 }
 
+static inline void free_cache_entry(mdcache_entry_t *entry)
+{
+	if (entry->lru.node != GSH_NUMA_NODE_ANY)
+		slab_free(lru_node_pools[entry->lru.node], entry);
+	else
+		pool_free(mdcache_entry_pool, entry);
+}
+
 static fsal_status_t
 alloc_cache_entry(mdcache_entry_t **entry)
 {
 	mdcache_entry_t *nentry;
+	uint32_t node;
 
-	nentry = pool_alloc(mdcache_entry_pool);
+	if (lru_node_pools != NULL) {
+		node = gsh_numa_node();
+		nentry = slab_alloc(lru_node_pools[node]);
+		nentry->lru.node = node;
+	} else {
+		nentry = pool_alloc(mdcache_entry_pool);
+		nentry->lru.node = GSH_NUMA_NODE_ANY;
+	}
 
 	/* Initialize the entry locks */
 	init_rw_locks(nentry);
@@ -1198,7 +1651,19 @@ mdcache_lru_get(mdcache_entry_t **entry)
 		nentry = container_of(lru, mdcache_entry_t, lru);
 		LogFullDebug(COMPONENT_CACHE_INODE_LRU,
 			     "Recycling entry at %p.", nentry);
+#ifdef USE_LTTNG
+		tracepoint(mdcache, lru_reap, nentry);
+#endif
 		mdcache_lru_clean(nentry);
+		if (lru_nnodes > 1 && nentry->lru.node != gsh_numa_node()) {
+			/* only another node had one to spare, move its
+			 * memory here rather than use it remotely
+			 */
+			free_cache_entry(nentry);
+			(void) atomic_dec_uint64_t(&lru_state.entries_used);
+			status = alloc_cache_entry(&nentry);
+			goto init;
+		}
 		memset(&nentry->attrs, 0, sizeof(nentry->attrs));
 		init_rw_locks(nentry);
 	} else {
@@ -1206,12 +1671,17 @@ mdcache_lru_get(mdcache_entry_t **entry)
 		status = alloc_cache_entry(&nentry);
 		if (!nentry)
 			goto out;
+#ifdef USE_LTTNG
+		tracepoint(mdcache, lru_alloc, nentry);
+#endif
 	}
 
+ init:
 	/* Since the entry isn't in a queue, nobody can bump refcnt. */
 	nentry->lru.refcnt = 2;
 	nentry->lru.noscan_refcnt = 0;
 	nentry->lru.cf = 0;
+	nentry->lru.flags &= ~(LRU_TOUCHED | LRU_PROBATION);
 	nentry->lru.lane = lru_lane_of_entry(nentry);
 
 	/* Enqueue. */
@@ -1334,7 +1804,8 @@ mdcache_is_noscan(mdcache_entry_t *entry)
  * A flags value of LRU_REQ_INITIAL indicates an ordinary initial reference,
  * and strongly influences LRU.  Essentially, the first ref during a callpath
  * should take an LRU_REQ_INITIAL ref, and all subsequent callpaths should take
- * LRU_FLAG_NONE refs.
+ * LRU_FLAG_NONE refs.  It is lockless too: the entry is only marked touched,
+ * and lru_promote_touched() moves it later.
  *
  * @return FSAL status
  */
@@ -1342,8 +1813,6 @@ fsal_status_t
 mdcache_lru_ref(mdcache_entry_t *entry, uint32_t flags)
 {
 	mdcache_lru_t *lru = &entry->lru;
-	struct lru_q_lane *qlane = &LRU[lru->lane];
-	struct lru_q *q;
 
 	if ((flags & LRU_REQ_INITIAL) == 0)
 		if (lru->flags & LRU_CLEANUP)
@@ -1358,30 +1827,10 @@ mdcache_lru_ref(mdcache_entry_t *entry, uint32_t flags)
 		if ((atomic_inc_int32_t(&entry->lru.cf) % 3) != 0)
 			goto out;
 
-		QLOCK(qlane);
-
-		switch (lru->qid) {
-		case LRU_ENTRY_L1:
-			q = lru_queue_of(entry);
-			/* advance entry to MRU (of L1) */
-			LRU_DQ_SAFE(lru, q);
-			lru_insert(lru, q, LRU_MRU);
-			++(q->size);
-			break;
-		case LRU_ENTRY_L2:
-			q = lru_queue_of(entry);
-			/* move entry to LRU of L1 */
-			glist_del(&lru->q);	/* skip L1 fixups */
-			--(q->size);
-			q = &qlane->L1;
-			lru_insert(lru, q, LRU_LRU);
-			++(q->size);
-			break;
-		default:
-			/* do nothing */
-			break;
-		}		/* switch qid */
-		QUNLOCK(qlane);
+		/* don't dirty the line of an entry already marked */
+		if (!(atomic_fetch_uint32_t(&lru->flags) & LRU_TOUCHED))
+			(void) atomic_set_uint32_t_bits(&lru->flags,
+							LRU_TOUCHED);
 	}			/* initial ref */
  out:
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
@@ -1414,7 +1863,11 @@ mdcache_lru_unref(mdcache_entry_t *entry, uint32_t flags)
 	bool other_lock_held = entry->fsobj.hdl.no_cleanup;
 	bool freed = false;
 
-	if (!qlocked && !other_lock_held) {
+	/* Only a queued-for-cleanup entry needs the lock; the flags are
+	 * rechecked under it. */
+	if (!qlocked && !other_lock_held &&
+	    unlikely(entry->lru.qid == LRU_ENTRY_CLEANUP) &&
+	    !(atomic_fetch_uint32_t(&entry->lru.flags) & LRU_CLEANED)) {
 		QLOCK(qlane);
 		if (((entry->lru.flags & LRU_CLEANED) == 0) &&
 		    (entry->lru.qid == LRU_ENTRY_CLEANUP)) {
@@ -1462,7 +1915,7 @@ mdcache_lru_unref(mdcache_entry_t *entry, uint32_t flags)
 			QUNLOCK(qlane);
 
 		mdcache_lru_clean(entry);
-		pool_free(mdcache_entry_pool, entry);
+		free_cache_entry(entry);
 		freed = true;
 
 		(void) atomic_dec_int64_t(&lru_state.entries_used);
@@ -1502,13 +1955,75 @@ mdcache_lru_putback(mdcache_entry_t *entry, uint32_t flags)
 	}
 
 	/* We do NOT call lru_clean_entry, since it was never initialized. */
-	pool_free(mdcache_entry_pool, entry);
+	(void) atomic_sub_uint64_t(&lru_state.mem_used, entry->lru.mem);
+	free_cache_entry(entry);
 	(void) atomic_dec_int64_t(&lru_state.entries_used);
 
 	if (!qlocked)
 		QUNLOCK(qlane);
 }
 
+/**
+ * @brief Recompute the memory charged for an entry
+ *
+ * An entry is charged for itself, its handle and its ACL; its dirents
+ * are charged as they are allocated.  ACLs may be shared between
+ * entries, and each is charged in full.  Call with the attr_lock held
+ * for write, or before the entry is reachable, after changing its
+ * attributes.
+ *
+ * @param[in] entry  The entry
+ */
+void
+mdcache_lru_recharge(mdcache_entry_t *entry)
+{
+	uint32_t mem = sizeof(mdcache_entry_t) + entry->fh_hk.key.kv.len;
+
+	if (entry->attrs.acl != NULL)
+		mem += sizeof(fsal_acl_t) +
+		       entry->attrs.acl->naces * sizeof(fsal_ace_t);
+
+	(void) atomic_add_uint64_t(&lru_state.mem_used, mem);
+	(void) atomic_sub_uint64_t(&lru_state.mem_used, entry->lru.mem);
+	entry->lru.mem = mem;
+}
+
+/**
+ * @brief Admit a new entry under the configured policy
+ *
+ * New entries start at LRU of L1.  With LRU_POLICY_2Q one whose handle
+ * is not remembered as a ghost moves to MRU of L2 on probation instead,
+ * so that it is reclaimed before the working set unless it's used
+ * again.  Call once the entry is hashed.
+ *
+ * @param[in] entry  The new entry
+ */
+void
+mdcache_lru_admit(mdcache_entry_t *entry)
+{
+	mdcache_lru_t *lru = &entry->lru;
+	struct lru_q_lane *qlane = &LRU[lru->lane];
+	struct lru_q *q;
+
+	if (mdcache_param.lru_policy != LRU_POLICY_2Q)
+		return;
+
+	if (lru_ghost_take(entry->fh_hk.key.hk)) {
+		/* seen again soon after being reclaimed, keep it */
+		(void) atomic_inc_uint64_t(&cache_stp->inode_ghost_hit);
+		return;
+	}
+
+	QLOCK(qlane);
+	if (lru->qid == LRU_ENTRY_L1) {
+		q = &qlane->L1;
+		LRU_DQ_SAFE(lru, q);
+		lru_insert(lru, &qlane->L2, LRU_MRU);
+		(void) atomic_set_uint32_t_bits(&lru->flags, LRU_PROBATION);
+	}
+	QUNLOCK(qlane);
+}
+
 /**
  *
  * @brief Wake the LRU thread to free FDs.
@@ -1523,4 +2038,159 @@ lru_wake_thread(void)
 	fridgethr_wake(lru_fridge);
 }
 
+/**
+ * @brief Collect the hottest cached entries
+ *
+ * Each lane gives up its share of @a max from MRU to LRU of L1, then
+ * of L2, and the lanes are interleaved so that the result runs from
+ * hottest to coldest across the whole cache.
+ *
+ * @param[out] entries  Array of at least @a max entries, each returned
+ *                      with a reference the caller must put
+ * @param[in]  max      Most entries to return
+ *
+ * @return The number of entries returned.
+ */
+uint32_t mdcache_lru_hottest(mdcache_entry_t **entries, uint32_t max)
+{
+	uint32_t share = max / LRU_N_Q_LANES + 1;
+	uint32_t counts[LRU_N_Q_LANES];
+	mdcache_entry_t **found;
+	struct lru_q_lane *qlane;
+	struct glist_head *node;
+	struct lru_q *q;
+	mdcache_entry_t *entry;
+	uint32_t lane, ix, n = 0;
+	int pass;
+
+	found = gsh_calloc(LRU_N_Q_LANES * share, sizeof(mdcache_entry_t *));
+
+	for (lane = 0; lane < LRU_N_Q_LANES; ++lane) {
+		qlane = &LRU[lane];
+		counts[lane] = 0;
+		QLOCK(qlane);
+		for (pass = 0; pass < 2; ++pass) {
+			q = pass == 0 ? &qlane->L1 : &qlane->L2;
+			for (node = q->q.prev;
+			     node != &q->q && counts[lane] < share;
+			     node = node->prev) {
+				entry = container_of(glist_entry(node,
+								 mdcache_lru_t,
+								 q),
+						     mdcache_entry_t, lru);
+				(void) atomic_inc_int32_t(&entry->lru.refcnt);
+				found[lane * share + counts[lane]++] = entry;
+			}
+		}
+		QUNLOCK(qlane);
+	}
+
+	for (ix = 0; ix < share; ++ix) {
+		for (lane = 0; lane < LRU_N_Q_LANES; ++lane) {
+			if (ix >= counts[lane])
+				continue;
+			entry = found[lane * share + ix];
+			if (n < max)
+				entries[n++] = entry;
+			else
+				mdcache_put(entry);
+		}
+	}
+
+	gsh_free(found);
+
+	return n;
+}
+
+/**
+ * @brief Put a new dirent chunk at the MRU end of the chunk LRU
+ *
+ * @param[in] chunk The chunk
+ */
+void mdcache_lru_chunk_insert(struct dir_chunk *chunk)
+{
+	PTHREAD_MUTEX_lock(&chunk_lru.mtx);
+	glist_add_tail(&chunk_lru.q.q, &chunk->lru);
+	++(chunk_lru.q.size);
+	PTHREAD_MUTEX_unlock(&chunk_lru.mtx);
+}
+
+/**
+ * @brief Move a dirent chunk to the MRU end of the chunk LRU
+ *
+ * @note The caller MUST hold the parent's content_lock, for read at least.
+ *
+ * @param[in] chunk The chunk
+ */
+void mdcache_lru_chunk_touch(struct dir_chunk *chunk)
+{
+	PTHREAD_MUTEX_lock(&chunk_lru.mtx);
+	if (chunk->lru.next != NULL) {
+		glist_del(&chunk->lru);
+		glist_add_tail(&chunk_lru.q.q, &chunk->lru);
+	}
+	PTHREAD_MUTEX_unlock(&chunk_lru.mtx);
+}
+
+/**
+ * @brief Take a dirent chunk off the chunk LRU
+ *
+ * Does nothing if the reaper already has.
+ *
+ * @param[in] chunk The chunk
+ */
+void mdcache_lru_chunk_remove(struct dir_chunk *chunk)
+{
+	PTHREAD_MUTEX_lock(&chunk_lru.mtx);
+	if (chunk->lru.next != NULL) {
+		glist_del(&chunk->lru);
+		--(chunk_lru.q.size);
+	}
+	PTHREAD_MUTEX_unlock(&chunk_lru.mtx);
+}
+
+/**
+ * @brief Release least recently used chunks above Chunks_HWMark
+ *
+ * Since the chunk LRU is locked before the content_lock of a chunk's
+ * directory, directories are only try-locked, and busy ones are passed
+ * over.
+ *
+ * @param[in] current Directory whose content_lock the caller holds, its
+ *                    chunks are left alone
+ */
+void mdcache_lru_chunk_reap(mdcache_entry_t *current)
+{
+	struct dir_chunk *chunk;
+	mdcache_entry_t *dir;
+	uint32_t tries;
+
+	PTHREAD_MUTEX_lock(&chunk_lru.mtx);
+	for (tries = 0; chunk_lru.q.size > mdcache_param.chunks_hwmark &&
+	     tries < LRU_CHUNK_REAP_TRIES; ++tries) {
+		chunk = glist_first_entry(&chunk_lru.q.q, struct dir_chunk,
+					  lru);
+		dir = chunk->parent;
+
+		if (dir == current ||
+		    pthread_rwlock_trywrlock(&dir->content_lock) != 0) {
+			/* Busy, look further along the queue */
+			glist_del(&chunk->lru);
+			glist_add_tail(&chunk_lru.q.q, &chunk->lru);
+			continue;
+		}
+
+		glist_del(&chunk->lru);
+		--(chunk_lru.q.size);
+		PTHREAD_MUTEX_unlock(&chunk_lru.mtx);
+
+		/* The content_lock keeps both chunk and dir around */
+		mdcache_chunk_release(chunk);
+		PTHREAD_RWLOCK_unlock(&dir->content_lock);
+
+		PTHREAD_MUTEX_lock(&chunk_lru.mtx);
+	}
+	PTHREAD_MUTEX_unlock(&chunk_lru.mtx);
+}
+
 /** @} */
@@ -67,6 +67,9 @@
 struct lru_state {
 	uint64_t entries_hiwat;
 	uint64_t entries_used;
+	uint64_t mem_limit;	/*< 0 for none */
+	uint64_t mem_used;	/*< Approximate bytes held by entries and
+				    dirents */
 	uint32_t fds_system_imposed;
 	uint32_t fds_hard_limit;
 	uint32_t fds_hiwat;
@@ -148,11 +151,63 @@ void mdcache_lru_cleanup_try_push(mdcache_entry_t *entry);
 
 bool mdcache_lru_unref(mdcache_entry_t *entry, uint32_t flags);
 void mdcache_lru_putback(mdcache_entry_t *entry, uint32_t flags);
+void mdcache_lru_admit(mdcache_entry_t *entry);
+void mdcache_lru_recharge(mdcache_entry_t *entry);
+uint32_t mdcache_lru_hottest(mdcache_entry_t **entries, uint32_t max);
 void lru_wake_thread(void);
+size_t mdcache_lru_run_lanes(uint32_t me, uint32_t nthreads, bool extremis,
+			     uint64_t *totalclosed);
 fsal_status_t mdcache_inc_noscan_ref(mdcache_entry_t *entry);
 void mdcache_dec_noscan_ref(mdcache_entry_t *entry);
 bool mdcache_is_noscan(mdcache_entry_t *entry);
 void mdcache_lru_kill_for_shutdown(mdcache_entry_t *entry);
+void mdcache_lru_chunk_insert(struct dir_chunk *chunk);
+void mdcache_lru_chunk_touch(struct dir_chunk *chunk);
+void mdcache_lru_chunk_remove(struct dir_chunk *chunk);
+void mdcache_lru_chunk_reap(mdcache_entry_t *current);
+
+/**
+ * @brief Whether the cache is over its memory budget
+ */
+static inline bool mdcache_lru_over_mem(void)
+{
+	return lru_state.mem_limit != 0 &&
+	    atomic_fetch_uint64_t(&lru_state.mem_used) > lru_state.mem_limit;
+}
+
+/**
+ * @brief Allocate a dirent, charging it to the cache
+ *
+ * @param[in] name  The name
+ *
+ * @return The dirent, with flags and name set.
+ */
+static inline mdcache_dir_entry_t *mdcache_dirent_alloc(const char *name)
+{
+	size_t namesize = strlen(name) + 1;
+	mdcache_dir_entry_t *dirent;
+
+	dirent = gsh_calloc(1, sizeof(mdcache_dir_entry_t) + namesize);
+	dirent->flags = DIR_ENTRY_FLAG_NONE;
+	memcpy(dirent->name, name, namesize);
+	(void) atomic_add_uint64_t(&lru_state.mem_used,
+				   sizeof(mdcache_dir_entry_t) + namesize);
+
+	return dirent;
+}
+
+/**
+ * @brief Free a dirent allocated by mdcache_dirent_alloc
+ *
+ * @param[in] dirent  The dirent
+ */
+static inline void mdcache_dirent_free(mdcache_dir_entry_t *dirent)
+{
+	(void) atomic_sub_uint64_t(&lru_state.mem_used,
+				   sizeof(mdcache_dir_entry_t) +
+				   strlen(dirent->name) + 1);
+	gsh_free(dirent);
+}
 
 /**
  *
@@ -211,6 +266,22 @@ static inline bool mdcache_lru_fds_available(void)
 	return true;
 }
 
+/**
+ * Note I/O on an entry, which the reaper spares once if it closed the
+ * entry's fd last time.
+ */
+
+static inline void mdcache_lru_fd_used(mdcache_entry_t *entry)
+{
+	if (unlikely(atomic_fetch_uint32_t(&entry->lru.flags) &
+		     LRU_FD_REAPED)) {
+		(void) atomic_clear_uint32_t_bits(&entry->lru.flags,
+						  LRU_FD_REAPED);
+		(void) atomic_set_uint32_t_bits(&entry->lru.flags,
+						LRU_FD_REOPENED);
+	}
+}
+
 /**
  * Return true if we are currently caching file descriptors.
  */
@@ -47,6 +47,7 @@
 #include "FSAL/fsal_commonlib.h"
 #include "mdcache_hash.h"
 #include "mdcache_lru.h"
+#include "gsh_metrics.h"
 
 pool_t *mdcache_entry_pool;
 
@@ -251,6 +252,22 @@ mdcache_fsal_unload(struct fsal_module *fsal_hdl)
 	/* Destroy the cache inode AVL tree */
 	cih_pkgdestroy();
 
+	status = mdcache_xattr_pkgshutdown();
+	if (FSAL_IS_ERROR(status))
+		fprintf(stderr, "MDCACHE xattr cache failed to shut down");
+
+	status = mdcache_cluster_pkgshutdown();
+	if (FSAL_IS_ERROR(status))
+		fprintf(stderr, "MDCACHE cluster invalidation failed to shut down");
+
+	status = mdcache_warm_pkgshutdown();
+	if (FSAL_IS_ERROR(status))
+		fprintf(stderr, "MDCACHE warm start failed to shut down");
+
+	status = mdcache_prefetch_pkgshutdown();
+	if (FSAL_IS_ERROR(status))
+		fprintf(stderr, "MDCACHE prefetch failed to shut down");
+
 	status = mdcache_lru_pkgshutdown();
 	if (FSAL_IS_ERROR(status))
 		fprintf(stderr, "MDCACHE LRU failed to shut down");
@@ -320,6 +337,8 @@ fsal_status_t mdcache_pkginit(void)
 	mdcache_entry_pool = pool_basic_init("MDCACHE Entry Pool",
 					     sizeof(mdcache_entry_t));
 
+	mdc_name_locks_init();
+
 	status = mdcache_lru_pkginit();
 	if (FSAL_IS_ERROR(status)) {
 		pool_destroy(mdcache_entry_pool);
@@ -329,6 +348,20 @@ fsal_status_t mdcache_pkginit(void)
 
 	cih_pkginit();
 
+	status = mdcache_prefetch_pkginit();
+	if (FSAL_IS_ERROR(status))
+		return status;
+
+	status = mdcache_warm_pkginit();
+	if (FSAL_IS_ERROR(status))
+		return status;
+
+	status = mdcache_cluster_pkginit();
+	if (FSAL_IS_ERROR(status))
+		return status;
+
+	status = mdcache_xattr_pkginit();
+
 	return status;
 }
 
@@ -368,9 +401,91 @@ void mdcache_dbus_show(DBusMessageIter *iter)
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
 					&cache_st.inode_mapping);
+	type = "cache_ghost_add";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					&cache_st.inode_ghost_add);
+	type = "cache_ghost_hit";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					&cache_st.inode_ghost_hit);
+	type = "cache_upcall_trust";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					&cache_st.inode_upcall_trust);
+	type = "cache_change_trust";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					&cache_st.inode_change_trust);
+	type = "cache_mem_used";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					&lru_state.mem_used);
+	type = "cache_mem_limit";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					&lru_state.mem_limit);
 
 	dbus_message_iter_close_container(iter, &struct_iter);
 }
 #endif /* USE_DBUS */
 
+/**
+ * @brief Render the cache counters and the LRU state
+ *
+ * @param[in,out] mb Buffer
+ */
+void mdcache_metrics(struct metrics_buf *mb)
+{
+	static const struct {
+		const char *name;
+		uint64_t *v;
+	} counters[] = {
+		{ "requests", &cache_st.inode_req },
+		{ "hits", &cache_st.inode_hit },
+		{ "misses", &cache_st.inode_miss },
+		{ "conflicts", &cache_st.inode_conf },
+		{ "added", &cache_st.inode_added },
+		{ "mappings", &cache_st.inode_mapping },
+		{ "ghost_adds", &cache_st.inode_ghost_add },
+		{ "ghost_hits", &cache_st.inode_ghost_hit },
+		{ "upcall_trusts", &cache_st.inode_upcall_trust },
+		{ "change_trusts", &cache_st.inode_change_trust },
+	};
+	unsigned int i;
+
+	metrics_family(mb, "ganesha_mdcache_events", "counter",
+		       "Cache lookups and their outcomes");
+	for (i = 0; i < sizeof(counters) / sizeof(counters[0]); i++)
+		metrics_printf(mb,
+			       "ganesha_mdcache_events_total{event=\"%s\"} %"
+			       PRIu64 "\n", counters[i].name,
+			       atomic_fetch_uint64_t(counters[i].v));
+
+	metrics_family(mb, "ganesha_mdcache_entries", "gauge",
+		       "Cached entries");
+	metrics_printf(mb, "ganesha_mdcache_entries %" PRIu64 "\n",
+		       atomic_fetch_uint64_t(&lru_state.entries_used));
+	metrics_family(mb, "ganesha_mdcache_entries_hiwat", "gauge",
+		       "Entries the LRU reaps down to");
+	metrics_printf(mb, "ganesha_mdcache_entries_hiwat %" PRIu64 "\n",
+		       lru_state.entries_hiwat);
+	metrics_family(mb, "ganesha_mdcache_mem_bytes", "gauge",
+		       "Approximate memory held by entries and dirents");
+	metrics_printf(mb, "ganesha_mdcache_mem_bytes %" PRIu64 "\n",
+		       atomic_fetch_uint64_t(&lru_state.mem_used));
+	metrics_family(mb, "ganesha_mdcache_open_fds", "gauge",
+		       "File descriptors held open by the cache");
+	metrics_printf(mb, "ganesha_mdcache_open_fds %zu\n",
+		       atomic_fetch_size_t(&open_fd_count));
+	metrics_family(mb, "ganesha_mdcache_fds_hiwat", "gauge",
+		       "Open descriptors the LRU starts closing at");
+	metrics_printf(mb, "ganesha_mdcache_fds_hiwat %" PRIu32 "\n",
+		       lru_state.fds_hiwat);
+	metrics_family(mb, "ganesha_mdcache_caching_fds", "gauge",
+		       "Whether descriptors are kept open, 0 or 1");
+	metrics_printf(mb, "ganesha_mdcache_caching_fds %d\n",
+		       lru_state.caching_fds ? 1 : 0);
+}
+
 /** @} */
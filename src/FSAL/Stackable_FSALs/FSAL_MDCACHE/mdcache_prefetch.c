@@ -0,0 +1,367 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/**
+ * @addtogroup FSAL_MDCACHE
+ * @{
+ */
+
+/**
+ * @file  mdcache_prefetch.c
+ * @brief Refresh the attributes of directory entries in parallel
+ *
+ * READDIR with attributes hands out the cached attributes of every
+ * entry it returns.  Refreshing the stale ones one at a time costs a
+ * round trip to the FSAL per entry, which adds up on FSALs that go
+ * over the network.  Instead, readdir gathers a window of entries
+ * ahead of the one it is returning, and the stale ones are refreshed
+ * at once by a pool of Readdir_Prefetch_Threads threads.  Readdir
+ * waits for the whole window before going on.
+ *
+ * Where the sub-FSAL can get many objects' attributes in one call, as
+ * XFS can by bulkstat, the stale entries of the window are refreshed
+ * with one getattrs_multi instead, and only those it could not do go
+ * to the threads.
+ *
+ * Workers only ever take the attr_lock of the entries they refresh.
+ * A directory whose mtime moved is marked untrusted rather than
+ * having its dirents dropped here, since its content_lock may be held
+ * by a readdir waiting on this very pool.
+ */
+
+#include "config.h"
+#include "fsal.h"
+#include "fridgethr.h"
+#include "mdcache_int.h"
+#include "mdcache_lru.h"
+
+/** Attribute prefetch threads */
+static struct fridgethr *prefetch_fridge;
+
+/**
+ * @brief One entry to refresh
+ */
+struct mdc_prefetch_job {
+	struct mdc_prefetch *pf;	/*< The window this belongs to */
+	mdcache_entry_t *entry;		/*< The entry, referenced */
+	struct req_op_context ctx;	/*< Copy of the caller's context */
+};
+
+/**
+ * @brief Refresh an entry's attributes if they are stale
+ *
+ * @param[in] entry  The entry
+ * @param[in] mask   The attributes wanted
+ */
+static void mdc_prefetch_refresh(mdcache_entry_t *entry, attrmask_t mask)
+{
+	fsal_status_t status = {0, 0};
+	time_t oldmtime;
+
+	PTHREAD_RWLOCK_wrlock(&entry->attr_lock);
+
+	if (!mdcache_attrs_valid_or_refresh(entry, mask)) {
+		oldmtime = entry->attrs.mtime.tv_sec;
+		status = mdcache_refresh_attrs(entry,
+					       (mask & ATTR_ACL) != 0);
+		if (!FSAL_IS_ERROR(status) &&
+		    entry->obj_handle.type == DIRECTORY &&
+		    oldmtime < entry->attrs.mtime.tv_sec)
+			atomic_clear_uint32_t_bits(&entry->mde_flags,
+						   MDCACHE_TRUST_CONTENT);
+	}
+
+	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+
+	if (status.major == ERR_FSAL_STALE)
+		mdcache_kill_entry(entry);
+}
+
+/**
+ * @brief Run one job
+ *
+ * @param[in] job  The job, freed on return
+ */
+static void mdc_prefetch_job_run(struct mdc_prefetch_job *job)
+{
+	struct mdc_prefetch *pf = job->pf;
+	struct req_op_context *saved_ctx = op_ctx;
+
+	op_ctx = &job->ctx;
+	mdc_prefetch_refresh(job->entry, pf->mask);
+	mdcache_put(job->entry);
+	op_ctx = saved_ctx;
+	gsh_free(job);
+
+	PTHREAD_MUTEX_lock(&pf->mtx);
+	if (--pf->pending == 0)
+		pthread_cond_signal(&pf->cv);
+	PTHREAD_MUTEX_unlock(&pf->mtx);
+}
+
+static void mdc_prefetch_thread(struct fridgethr_context *ctx)
+{
+	mdc_prefetch_job_run(ctx->arg);
+}
+
+/**
+ * @brief Hand an entry to the prefetch threads
+ *
+ * @note Must be called with op_ctx set.
+ *
+ * @param[in] pf     The window
+ * @param[in] entry  The entry, whose reference is passed on
+ */
+static void mdc_prefetch_submit(struct mdc_prefetch *pf,
+				mdcache_entry_t *entry)
+{
+	struct mdc_prefetch_job *job;
+
+	job = gsh_malloc(sizeof(*job));
+	job->pf = pf;
+	job->entry = entry;
+	job->ctx = *op_ctx;
+
+	PTHREAD_MUTEX_lock(&pf->mtx);
+	pf->pending++;
+	PTHREAD_MUTEX_unlock(&pf->mtx);
+
+	if (fridgethr_submit(prefetch_fridge, mdc_prefetch_thread, job) != 0)
+		mdc_prefetch_job_run(job);
+}
+
+/**
+ * @brief Refresh the entries gathered with one getattrs_multi
+ *
+ * Each attr_lock is held from before the fetch until the attributes
+ * are in, as mdcache_refresh_attrs holds it.  Only locks that can be
+ * had at once are taken, so holding many does not order them against
+ * anyone else's; the entries whose lock is busy, and those the
+ * sub-FSAL could not do, go to the threads.
+ *
+ * @note Must be called with op_ctx set.
+ *
+ * @param[in] pf  The window
+ */
+static void mdc_prefetch_bulk(struct mdc_prefetch *pf)
+{
+	struct fsal_obj_handle *subs[MDC_PREFETCH_BULK];
+	mdcache_entry_t *locked[MDC_PREFETCH_BULK];
+	struct attrlist *attrs;
+	mdcache_entry_t *entry;
+	fsal_status_t status;
+	attrmask_t mask;
+	time_t oldmtime;
+	uint32_t i, n = 0;
+
+	for (i = 0; i < pf->nbulk; i++) {
+		entry = pf->bulk[i];
+		if (pthread_rwlock_trywrlock(&entry->attr_lock) != 0) {
+			mdc_prefetch_submit(pf, entry);
+			continue;
+		}
+		if (mdcache_attrs_valid_or_refresh(entry, pf->mask)) {
+			PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+			mdcache_put(entry);
+			continue;
+		}
+		/* The size and times must include anything gathered */
+		mdc_gather_flush(entry);
+		locked[n] = entry;
+		subs[n++] = entry->sub_handle;
+	}
+	pf->nbulk = 0;
+
+	if (n == 0)
+		return;
+
+	mask = op_ctx->fsal_export->exp_ops.fs_supported_attrs(
+					op_ctx->fsal_export) | ATTR_RDATTR_ERR;
+	mask &= ~ATTR_ACL;
+
+	attrs = gsh_malloc(n * sizeof(*attrs));
+	for (i = 0; i < n; i++)
+		fsal_prepare_attrs(&attrs[i], mask);
+
+	subcall(
+		status = subs[0]->obj_ops.getattrs_multi(subs, n, attrs)
+	       );
+
+	if (status.major == ERR_FSAL_NOTSUPP)
+		pf->nobulk = true;
+
+	for (i = 0; i < n; i++) {
+		entry = locked[i];
+
+		if (FSAL_IS_ERROR(status) ||
+		    attrs[i].mask == ATTR_RDATTR_ERR) {
+			fsal_release_attrs(&attrs[i]);
+			PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+			mdc_prefetch_submit(pf, entry);
+			continue;
+		}
+
+		oldmtime = entry->attrs.mtime.tv_sec;
+		mdcache_install_attrs(entry, &attrs[i], false);
+		if (entry->obj_handle.type == DIRECTORY &&
+		    oldmtime < entry->attrs.mtime.tv_sec)
+			atomic_clear_uint32_t_bits(&entry->mde_flags,
+						   MDCACHE_TRUST_CONTENT);
+
+		PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+		mdcache_put(entry);
+	}
+
+	gsh_free(attrs);
+}
+
+/**
+ * @brief Start a window of prefetches
+ *
+ * @param[out] pf    The window
+ * @param[in]  mask  Attributes the caller will hand out
+ */
+void mdc_prefetch_init(struct mdc_prefetch *pf, attrmask_t mask)
+{
+	PTHREAD_MUTEX_init(&pf->mtx, NULL);
+	PTHREAD_COND_init(&pf->cv, NULL);
+	pf->pending = 0;
+	pf->mask = mask;
+	/* The ACL is left to getattrs */
+	pf->nobulk = (mask & ATTR_ACL) != 0;
+	pf->nbulk = 0;
+}
+
+/**
+ * @brief Refresh an entry's attributes in the background if stale
+ *
+ * @note Must be called with op_ctx set.
+ *
+ * @param[in] pf   The window
+ * @param[in] key  Key of the entry, as held by its dirent
+ */
+void mdc_prefetch_add(struct mdc_prefetch *pf, mdcache_key_t *key)
+{
+	mdcache_entry_t *entry;
+	fsal_status_t status;
+	bool valid;
+
+	status = mdcache_find_keyed(key, &entry);
+	if (FSAL_IS_ERROR(status)) {
+		/* Readdir will look it up itself */
+		return;
+	}
+
+	PTHREAD_RWLOCK_rdlock(&entry->attr_lock);
+	valid = mdcache_is_attrs_valid(entry, pf->mask);
+	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+
+	if (valid) {
+		mdcache_put(entry);
+		return;
+	}
+
+	if (pf->nobulk) {
+		mdc_prefetch_submit(pf, entry);
+		return;
+	}
+
+	pf->bulk[pf->nbulk++] = entry;
+	if (pf->nbulk == MDC_PREFETCH_BULK)
+		mdc_prefetch_bulk(pf);
+}
+
+/**
+ * @brief Wait for a window of prefetches to finish
+ *
+ * @param[in] pf  The window, which may not be used again without
+ *                mdc_prefetch_init.
+ */
+void mdc_prefetch_wait(struct mdc_prefetch *pf)
+{
+	if (pf->nbulk != 0)
+		mdc_prefetch_bulk(pf);
+
+	PTHREAD_MUTEX_lock(&pf->mtx);
+	while (pf->pending != 0)
+		pthread_cond_wait(&pf->cv, &pf->mtx);
+	PTHREAD_MUTEX_unlock(&pf->mtx);
+
+	PTHREAD_COND_destroy(&pf->cv);
+	PTHREAD_MUTEX_destroy(&pf->mtx);
+}
+
+/**
+ * @brief Start the prefetch threads
+ *
+ * @return FSAL status
+ */
+fsal_status_t mdcache_prefetch_pkginit(void)
+{
+	struct fridgethr_params frp;
+	int code;
+
+	if (mdcache_param.prefetch_threads == 0)
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = mdcache_param.prefetch_threads;
+	frp.thread_delay = 60;
+	frp.deferment = fridgethr_defer_queue;
+
+	code = fridgethr_init(&prefetch_fridge, "MDC_prefetch", &frp);
+	if (code != 0) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Unable to initialize prefetch fridge, error code %d.",
+			 code);
+		return fsalstat(posix2fsal_error(code), code);
+	}
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+/**
+ * @brief Stop the prefetch threads
+ *
+ * @return FSAL status
+ */
+fsal_status_t mdcache_prefetch_pkgshutdown(void)
+{
+	int rc;
+
+	if (prefetch_fridge == NULL)
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+	rc = fridgethr_sync_command(prefetch_fridge, fridgethr_comm_stop, 120);
+
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Shutdown timed out, cancelling threads.");
+		fridgethr_cancel(prefetch_fridge);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Failed shutting down prefetch threads: %d", rc);
+	}
+
+	return fsalstat(posix2fsal_error(rc), rc);
+}
+
+/** @} */
@@ -38,6 +38,7 @@
 #include "hashtable.h"
 #include "fsal.h"
 #include "mdcache_int.h"
+#include "mdcache_lru.h"
 #include "config_parsing.h"
 
 #include <unistd.h>
@@ -46,25 +47,52 @@
 #include <time.h>
 #include <pthread.h>
 #include <string.h>
+#include <netinet/in.h>
 
 /** File cache configuration, settable in the CacheInode
     stanza. */
 
 struct mdcache_parameter mdcache_param;
 
+static struct config_item_list lru_policies[] = {
+	CONFIG_LIST_TOK("LRU", LRU_POLICY_LRU),
+	CONFIG_LIST_TOK("2Q", LRU_POLICY_2Q),
+	CONFIG_LIST_EOL
+};
+
 static struct config_item mdcache_params[] = {
 	CONF_ITEM_UI32("NParts", 1, 32633, 7,
 		       mdcache_parameter, nparts),
 	CONF_ITEM_UI32("Cache_Size", 1, UINT32_MAX, 32633,
 		       mdcache_parameter, cache_size),
+	CONF_ITEM_BOOL("Open_Addressing_Hash", false,
+		       mdcache_parameter, oa_hash),
+	CONF_ITEM_BOOL("NUMA_Partitions", false,
+		       mdcache_parameter, numa),
 	CONF_ITEM_BOOL("Use_Getattr_Directory_Invalidation", false,
 		       mdcache_parameter, getattr_dir_invalidation),
+	CONF_ITEM_BOOL("Revalidate_By_Change", false,
+		       mdcache_parameter, revalidate_change),
 	CONF_ITEM_UI32("Dir_Max_Deleted", 1, UINT32_MAX, 65536,
 		       mdcache_parameter, dir.avl_max_deleted),
+	CONF_ITEM_UI32("Dir_Chunk", 0, UINT32_MAX, 128,
+		       mdcache_parameter, dir.avl_chunk),
+	CONF_ITEM_UI32("Dir_Max_Chunks", 1, UINT32_MAX, 256,
+		       mdcache_parameter, dir.avl_max_chunks),
+	CONF_ITEM_UI32("Dir_Filter_Names", 0, 1 << 24, 0,
+		       mdcache_parameter, dir.filter_names),
+	CONF_ITEM_UI32("Dir_Pack_Threshold", 0, UINT32_MAX, 0,
+		       mdcache_parameter, dir.pack_threshold),
 	CONF_ITEM_UI32("Entries_HWMark", 1, UINT32_MAX, 100000,
 		       mdcache_parameter, entries_hwmark),
+	CONF_ITEM_UI64("Cache_Memory_Limit", 0, UINT64_MAX, 0,
+		       mdcache_parameter, mem_limit),
+	CONF_ITEM_UI32("Chunks_HWMark", 1, UINT32_MAX, 1000,
+		       mdcache_parameter, chunks_hwmark),
 	CONF_ITEM_UI32("LRU_Run_Interval", 1, 24 * 3600, 90,
 		       mdcache_parameter, lru_run_interval),
+	CONF_ITEM_TOKEN("LRU_Policy", LRU_POLICY_LRU, lru_policies,
+			mdcache_parameter, lru_policy),
 	CONF_ITEM_BOOL("Cache_FDs", true,
 		       mdcache_parameter, use_fd_cache),
 	CONF_ITEM_UI32("FD_Limit_Percent", 0, 100, 99,
@@ -75,6 +103,28 @@ static struct config_item mdcache_params[] = {
 		       mdcache_parameter, fd_lwmark_percent),
 	CONF_ITEM_UI32("Reaper_Work", 1, 2000, 1000,
 		       mdcache_parameter, reaper_work),
+	CONF_ITEM_UI32("Reaper_Threads", 1, LRU_N_Q_LANES, 1,
+		       mdcache_parameter, reaper_threads),
+	CONF_ITEM_UI32("Readdir_Prefetch_Threads", 0, 256, 0,
+		       mdcache_parameter, prefetch_threads),
+	CONF_ITEM_UI32("Readdir_Prefetch_Window", 1, 1024, 32,
+		       mdcache_parameter, prefetch_window),
+	CONF_ITEM_PATH("Warm_Start_File", 1, MAXPATHLEN, NULL,
+		       mdcache_parameter, warm_file),
+	CONF_ITEM_UI32("Warm_Start_Entries", 1, UINT32_MAX, 10000,
+		       mdcache_parameter, warm_entries),
+	CONF_ITEM_UI32("Warm_Start_Interval", 1, 24 * 3600, 300,
+		       mdcache_parameter, warm_interval),
+	CONF_ITEM_UI32("Write_Gather_Window", 0, 10000, 0,
+		       mdcache_parameter, gather_window),
+	CONF_ITEM_UI32("Write_Gather_Size", 65536, 64 * 1024 * 1024,
+		       4 * 1024 * 1024, mdcache_parameter, gather_size),
+	CONF_ITEM_UI64("Xattr_Cache_Size", 0, UINT64_MAX, 4 * 1024 * 1024,
+		       mdcache_parameter, xattr_cache_size),
+	CONF_ITEM_UI32("Xattr_Cache_Value_Max", 1, 4096, 1024,
+		       mdcache_parameter, xattr_value_max),
+	CONF_ITEM_UI32("Xattr_Cache_Expiration", 1, 3600, 60,
+		       mdcache_parameter, xattr_expiration),
 	CONF_ITEM_UI32("Biggest_Window", 1, 100, 40,
 		       mdcache_parameter, biggest_window),
 	CONF_ITEM_UI32("Required_Progress", 1, 50, 5,
@@ -83,6 +133,10 @@ static struct config_item mdcache_params[] = {
 		       mdcache_parameter, futility_count),
 	CONF_ITEM_BOOL("Retry_Readdir", false,
 		       mdcache_parameter, retry_readdir),
+	CONF_ITEM_STR("Cluster_Invalidate_Group", 1, INET_ADDRSTRLEN, NULL,
+		      mdcache_parameter, cluster_group),
+	CONF_ITEM_UI16("Cluster_Invalidate_Port", 1, UINT16_MAX, 20491,
+		       mdcache_parameter, cluster_port),
 	CONFIG_EOL
 };
 
@@ -37,6 +37,7 @@
 #include "nfs4_acls.h"
 #include "mdcache_hash.h"
 #include "mdcache_int.h"
+#include "mdcache_lru.h"
 
 static fsal_status_t
 mdc_up_invalidate(struct fsal_export *export, struct gsh_buffdesc *handle,
@@ -59,9 +60,11 @@ mdc_up_invalidate(struct fsal_export *export, struct gsh_buffdesc *handle,
 	status = mdcache_find_keyed(&key, &entry);
 	if (status.major == ERR_FSAL_NOENT) {
 		/* Not cached, so invalidate is a success */
+		op_ctx = save_ctx;
 		return fsalstat(ERR_FSAL_NO_ERROR, 0);
 	} else if (FSAL_IS_ERROR(status)) {
 		/* Real error */
+		op_ctx = save_ctx;
 		return status;
 	}
 
@@ -76,6 +79,102 @@ mdc_up_invalidate(struct fsal_export *export, struct gsh_buffdesc *handle,
 	return status;
 }
 
+struct mdc_up_batch_ent {
+	mdcache_key_t key;
+	uint32_t part;
+	uint32_t flags;
+	mdcache_entry_t *entry;
+};
+
+static int mdc_up_batch_cmpf(const void *lhs, const void *rhs)
+{
+	const struct mdc_up_batch_ent *l = lhs, *r = rhs;
+
+	if (l->part != r->part)
+		return l->part < r->part ? -1 : 1;
+	return 0;
+}
+
+/**
+ * @brief Invalidate several cached entries
+ *
+ * The handles are sorted by partition, and each partition is latched
+ * once to find and ref all of its entries.  They are invalidated once
+ * it is released, as by mdc_up_invalidate.
+ *
+ * @param[in] export MDCACHE Export containing the objects
+ * @param[in] objs   Handles to invalidate
+ * @param[in] flags  FSAL_UP_INVALIDATE_* of each
+ * @param[in] count  Number of handles
+ *
+ * @return FSAL status of the last that failed
+ */
+
+static fsal_status_t
+mdc_up_invalidate_batch(struct fsal_export *export, struct gsh_buffdesc *objs,
+			const uint32_t *flags, uint32_t count)
+{
+	struct mdcache_fsal_export *myself = mdc_export(export);
+	struct req_op_context *save_ctx, req_ctx = {0};
+	fsal_status_t status, ret = {0, 0};
+	struct mdc_up_batch_ent *ents;
+	cih_latch_t latch;
+	uint32_t ix, first, part;
+
+	ents = gsh_malloc(count * sizeof(*ents));
+	for (ix = 0; ix < count; ix++) {
+		(void) cih_hash_key(&ents[ix].key, export->sub_export->fsal,
+				    &objs[ix], CIH_HASH_KEY_PROTOTYPE);
+		ents[ix].part = ents[ix].key.hk % cih_fhcache.npart;
+		ents[ix].flags = flags[ix];
+	}
+
+	qsort(ents, count, sizeof(*ents), mdc_up_batch_cmpf);
+
+	for (first = 0; first < count; first = ix) {
+		part = ents[first].part;
+		(void) cih_latch_entry(&ents[first].key, &latch, CIH_GET_RLOCK,
+				       __func__, __LINE__);
+		for (ix = first; ix < count && ents[ix].part == part; ix++) {
+			ents[ix].entry = cih_lookup_latched(&ents[ix].key,
+							    &latch);
+			if (ents[ix].entry != NULL &&
+			    FSAL_IS_ERROR(mdcache_lru_ref(ents[ix].entry,
+							  LRU_REQ_INITIAL)))
+				ents[ix].entry = NULL;
+		}
+		cih_hash_release(&latch);
+	}
+
+	req_ctx.fsal_export = &myself->export;
+	save_ctx = op_ctx;
+	op_ctx = &req_ctx;
+
+	for (ix = 0; ix < count; ix++) {
+		mdcache_entry_t *entry = ents[ix].entry;
+
+		/* Not cached, so invalidate is a success */
+		if (entry == NULL)
+			continue;
+
+		atomic_clear_uint32_t_bits(&entry->mde_flags,
+					   ents[ix].flags &
+					   FSAL_UP_INVALIDATE_CACHE);
+
+		if (ents[ix].flags & FSAL_UP_INVALIDATE_CLOSE) {
+			status = fsal_close(&entry->obj_handle);
+			if (FSAL_IS_ERROR(status))
+				ret = status;
+		}
+
+		mdcache_put(entry);
+	}
+
+	op_ctx = save_ctx;
+	gsh_free(ents);
+	return ret;
+}
+
 /**
  * @brief Update cached attributes
  *
@@ -195,6 +294,7 @@ mdc_up_update(struct fsal_export *export, struct gsh_buffdesc *handle,
 		nfs4_acl_release_entry(entry->attrs.acl);
 
 		entry->attrs.acl = attr->acl;
+		mdcache_lru_recharge(entry);
 		mutatis_mutandis = true;
 	}
 
@@ -412,6 +512,35 @@ state_status_t mdc_up_layoutrecall(struct fsal_export *export,
 	return rc;
 }
 
+/** Recall layouts in bulk
+ *
+ * Pass to upper layer
+ *
+ * @param[in] export	MDCACHE export owning ops
+ * @param[in] layout_type	The type of layout to recall
+ * @param[in] changed	Whether the layouts have changed
+ * @param[in] all	Recall the layouts on every export
+ */
+state_status_t mdc_up_layoutrecall_bulk(struct fsal_export *export,
+					layouttype4 layout_type, bool changed,
+					bool all)
+{
+	struct mdcache_fsal_export *myself = mdc_export(export);
+	state_status_t rc;
+	struct req_op_context *save_ctx, req_ctx = {0};
+
+	req_ctx.fsal_export = &myself->export;
+	save_ctx = op_ctx;
+	op_ctx = &req_ctx;
+
+	rc = myself->super_up_ops.layoutrecall_bulk(export, layout_type,
+						    changed, all);
+
+	op_ctx = save_ctx;
+
+	return rc;
+}
+
 /** Recall a delegation
  *
  * Pass to upper layer
@@ -448,11 +577,13 @@ mdcache_export_up_ops_init(struct fsal_up_vector *my_up_ops,
 	my_up_ops->invalidate = mdc_up_invalidate;
 	my_up_ops->update = mdc_up_update;
 	my_up_ops->invalidate_close = mdc_up_invalidate_close;
+	my_up_ops->invalidate_batch = mdc_up_invalidate_batch;
 
 	/* These are pass-through calls that set op_ctx */
 	my_up_ops->lock_grant = mdc_up_lock_grant;
 	my_up_ops->lock_avail = mdc_up_lock_avail;
 	my_up_ops->layoutrecall = mdc_up_layoutrecall;
+	my_up_ops->layoutrecall_bulk = mdc_up_layoutrecall_bulk;
 	/* notify_device cannot call into MDCACHE */
 	my_up_ops->delegrecall = mdc_up_delegrecall;
 
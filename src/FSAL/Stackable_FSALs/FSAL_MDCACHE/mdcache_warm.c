@@ -0,0 +1,411 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/**
+ * @addtogroup FSAL_MDCACHE
+ * @{
+ */
+
+/**
+ * @file  mdcache_warm.c
+ * @brief Save the hot set of the cache, and reload it at startup
+ *
+ * When Warm_Start_File is set, the LRU thread writes the keys of the
+ * hottest Warm_Start_Entries entries to it every Warm_Start_Interval
+ * seconds, hottest first, along with the export each came from and,
+ * for directories, the key of their parent.  At startup a background
+ * thread waits for the exports to be up, then creates handles for
+ * those keys in order, so that the burst of LOOKUP and GETATTR after a
+ * restart or failover finds the hot set already cached.
+ *
+ * The file is only meaningful to the same FSALs and exports, on the
+ * same host: keys are written as the FSAL made them.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <unistd.h>
+#include "fsal.h"
+#include "fridgethr.h"
+#include "nfs_core.h"
+#include "export_mgr.h"
+#include "mdcache_int.h"
+#include "mdcache_lru.h"
+#include "mdcache_hash.h"
+
+#define WARM_MAGIC "MDCWARM1"
+/* Larger than any FSAL key */
+#define WARM_MAX_KEY 1024
+
+/**
+ * @brief Record header, followed by the key and parent key
+ */
+struct warm_rec {
+	uint16_t export_id;
+	uint16_t reserved;	/*< 0 */
+	uint32_t key_len;
+	uint32_t parent_len;	/*< 0 unless a directory with a known parent */
+};
+
+/**
+ * @brief Map from FSAL export to export ID, built for each save
+ */
+struct warm_exports {
+	uint32_t count;
+	uint32_t size;
+	struct {
+		struct fsal_export *fsal_export;
+		uint16_t export_id;
+	} *map;
+};
+
+static struct fridgethr *warm_fridge;
+/** Don't overwrite the file with a half-warmed cache */
+static bool warm_loading;
+static time_t warm_saved;
+
+static bool warm_add_export(struct gsh_export *export, void *state)
+{
+	struct warm_exports *exports = state;
+
+	/* A Lazy_Init export not created has nothing cached */
+	if (export->fsal_export == NULL)
+		return true;
+
+	if (exports->count == exports->size) {
+		exports->size = exports->size ? exports->size * 2 : 16;
+		exports->map = gsh_realloc(exports->map, exports->size *
+					   sizeof(*exports->map));
+	}
+	exports->map[exports->count].fsal_export = export->fsal_export;
+	exports->map[exports->count].export_id = export->export_id;
+	exports->count++;
+
+	return true;
+}
+
+/**
+ * @brief Write one entry to the file
+ *
+ * @return false on a write error.
+ */
+static bool warm_write_entry(FILE *f, struct warm_exports *exports,
+			     mdcache_entry_t *entry)
+{
+	struct mdcache_fsal_export *export;
+	struct warm_rec rec;
+	mdcache_key_t *parent = NULL;
+	uint32_t ix;
+	bool ok;
+
+	export = atomic_fetch_voidptr(&entry->first_export);
+	if (export == NULL)
+		return true;
+
+	for (ix = 0; ix < exports->count; ++ix)
+		if (exports->map[ix].fsal_export == &export->export)
+			break;
+	if (ix == exports->count)
+		return true;
+
+	rec.export_id = exports->map[ix].export_id;
+	rec.reserved = 0;
+	rec.key_len = entry->fh_hk.key.kv.len;
+	rec.parent_len = 0;
+
+	if (entry->obj_handle.type == DIRECTORY) {
+		PTHREAD_RWLOCK_rdlock(&entry->content_lock);
+		parent = &entry->fsobj.fsdir.parent;
+		rec.parent_len = parent->kv.len;
+	}
+
+	ok = fwrite(&rec, sizeof(rec), 1, f) == 1 &&
+	     fwrite(entry->fh_hk.key.kv.addr, rec.key_len, 1, f) == 1 &&
+	     (rec.parent_len == 0 ||
+	      fwrite(parent->kv.addr, rec.parent_len, 1, f) == 1);
+
+	if (entry->obj_handle.type == DIRECTORY)
+		PTHREAD_RWLOCK_unlock(&entry->content_lock);
+
+	return ok;
+}
+
+/**
+ * @brief Write the hot set
+ */
+static void warm_save(void)
+{
+	struct warm_exports exports = { 0, 0, NULL };
+	mdcache_entry_t **entries;
+	char *tmp;
+	FILE *f;
+	uint32_t count, ix;
+	bool ok;
+
+	(void) foreach_gsh_export(warm_add_export, &exports);
+
+	entries = gsh_malloc(mdcache_param.warm_entries *
+			     sizeof(mdcache_entry_t *));
+	count = mdcache_lru_hottest(entries, mdcache_param.warm_entries);
+
+	tmp = gsh_malloc(strlen(mdcache_param.warm_file) + 5);
+	sprintf(tmp, "%s.tmp", mdcache_param.warm_file);
+
+	f = fopen(tmp, "w");
+	ok = f != NULL && fwrite(WARM_MAGIC, 8, 1, f) == 1;
+
+	for (ix = 0; ix < count; ++ix) {
+		if (ok)
+			ok = warm_write_entry(f, &exports, entries[ix]);
+		mdcache_put(entries[ix]);
+	}
+
+	if (f != NULL) {
+		ok = fflush(f) == 0 && fsync(fileno(f)) == 0 && ok;
+		ok = fclose(f) == 0 && ok;
+	}
+
+	if (ok && rename(tmp, mdcache_param.warm_file) == 0) {
+		LogDebug(COMPONENT_CACHE_INODE_LRU,
+			 "Saved %" PRIu32 " hot entries to %s", count,
+			 mdcache_param.warm_file);
+	} else {
+		LogWarn(COMPONENT_CACHE_INODE_LRU,
+			"Could not save hot entries to %s: %s", tmp,
+			strerror(errno));
+		(void) unlink(tmp);
+	}
+
+	gsh_free(tmp);
+	gsh_free(entries);
+	gsh_free(exports.map);
+}
+
+/**
+ * @brief Save the hot set if it is time to
+ *
+ * Called from the LRU thread.
+ */
+void mdcache_warm_tick(void)
+{
+	time_t now = time(NULL);
+
+	if (mdcache_param.warm_file == NULL || !init_complete ||
+	    warm_loading)
+		return;
+
+	if (now - warm_saved < mdcache_param.warm_interval)
+		return;
+
+	warm_saved = now;
+	warm_save();
+}
+
+/**
+ * @brief Bring one saved entry into the cache
+ *
+ * @return true if it was created.
+ */
+static bool warm_load_entry(struct warm_rec *rec, char *key, char *parent)
+{
+	struct gsh_export *export;
+	struct root_op_context root_op_context;
+	struct fsal_obj_handle *obj;
+	struct gsh_buffdesc desc = { .addr = key, .len = rec->key_len };
+	struct gsh_buffdesc pdesc = { .addr = parent,
+				      .len = rec->parent_len };
+	mdcache_entry_t *entry;
+	mdcache_key_t *pkey;
+	fsal_status_t status;
+
+	export = get_gsh_export(rec->export_id);
+	if (export == NULL)
+		return false;
+
+	if (export->fsal_export == NULL) {
+		/* Not warmed until a client uses it */
+		put_gsh_export(export);
+		return false;
+	}
+
+	init_root_op_context(&root_op_context, export, export->fsal_export,
+			     0, 0, UNKNOWN_REQUEST);
+
+	status = export->fsal_export->exp_ops.create_handle(
+					export->fsal_export, &desc, &obj, NULL);
+
+	if (!FSAL_IS_ERROR(status)) {
+		entry = container_of(obj, mdcache_entry_t, obj_handle);
+		if (obj->type == DIRECTORY && rec->parent_len != 0) {
+			pkey = &entry->fsobj.fsdir.parent;
+			PTHREAD_RWLOCK_wrlock(&entry->content_lock);
+			if (pkey->kv.len == 0)
+				(void) cih_hash_key(pkey, entry->fh_hk.key.fsal,
+						    &pdesc, CIH_HASH_NONE);
+			PTHREAD_RWLOCK_unlock(&entry->content_lock);
+		}
+		obj->obj_ops.put_ref(obj);
+	}
+
+	release_root_op_context();
+	put_gsh_export(export);
+
+	return !FSAL_IS_ERROR(status);
+}
+
+/**
+ * @brief Reload the hot set, hottest first
+ */
+static void warm_load(struct fridgethr_context *ctx)
+{
+	char magic[8];
+	char *key = gsh_malloc(WARM_MAX_KEY);
+	char *parent = gsh_malloc(WARM_MAX_KEY);
+	struct warm_rec rec;
+	uint32_t loaded = 0, nread = 0;
+	FILE *f;
+
+	SetNameFunction("mdc_warm");
+
+	/* Exports are set up after the cache */
+	while (!init_complete) {
+		if (fridgethr_you_should_break(ctx))
+			goto out;
+		sleep(1);
+	}
+
+	f = fopen(mdcache_param.warm_file, "r");
+	if (f == NULL) {
+		LogInfo(COMPONENT_CACHE_INODE,
+			"No hot entries to load from %s: %s",
+			mdcache_param.warm_file, strerror(errno));
+		goto out;
+	}
+
+	if (fread(magic, sizeof(magic), 1, f) != 1 ||
+	    memcmp(magic, WARM_MAGIC, sizeof(magic)) != 0) {
+		LogWarn(COMPONENT_CACHE_INODE,
+			"%s is not a hot entry file", mdcache_param.warm_file);
+		goto close;
+	}
+
+	while (fread(&rec, sizeof(rec), 1, f) == 1) {
+		if (rec.key_len == 0 || rec.key_len > WARM_MAX_KEY ||
+		    rec.parent_len > WARM_MAX_KEY ||
+		    fread(key, rec.key_len, 1, f) != 1 ||
+		    (rec.parent_len != 0 &&
+		     fread(parent, rec.parent_len, 1, f) != 1)) {
+			LogWarn(COMPONENT_CACHE_INODE,
+				"%s is truncated or corrupt",
+				mdcache_param.warm_file);
+			break;
+		}
+		nread++;
+
+		/* Leave room for the clients */
+		if (lru_state.entries_used >= lru_state.entries_hiwat ||
+		    mdcache_lru_over_mem() ||
+		    fridgethr_you_should_break(ctx))
+			break;
+
+		if (warm_load_entry(&rec, key, parent))
+			loaded++;
+	}
+
+	LogEvent(COMPONENT_CACHE_INODE,
+		 "Loaded %" PRIu32 " of %" PRIu32 " hot entries from %s",
+		 loaded, nread, mdcache_param.warm_file);
+
+close:
+	fclose(f);
+out:
+	gsh_free(key);
+	gsh_free(parent);
+	warm_loading = false;
+}
+
+/**
+ * @brief Start reloading the hot set in the background
+ *
+ * @return FSAL status
+ */
+fsal_status_t mdcache_warm_pkginit(void)
+{
+	struct fridgethr_params frp;
+	int code;
+
+	if (mdcache_param.warm_file == NULL)
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = 1;
+	frp.deferment = fridgethr_defer_fail;
+
+	code = fridgethr_init(&warm_fridge, "MDC_warm", &frp);
+	if (code != 0) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Unable to initialize warm start fridge, error code %d.",
+			 code);
+		return fsalstat(posix2fsal_error(code), code);
+	}
+
+	warm_loading = true;
+	warm_saved = time(NULL);
+
+	code = fridgethr_submit(warm_fridge, warm_load, NULL);
+	if (code != 0) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Unable to start warm start thread, error code %d.",
+			 code);
+		warm_loading = false;
+		return fsalstat(posix2fsal_error(code), code);
+	}
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+/**
+ * @brief Stop reloading the hot set
+ *
+ * @return FSAL status
+ */
+fsal_status_t mdcache_warm_pkgshutdown(void)
+{
+	int rc;
+
+	if (warm_fridge == NULL)
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+	rc = fridgethr_sync_command(warm_fridge, fridgethr_comm_stop, 120);
+
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Shutdown timed out, cancelling threads.");
+		fridgethr_cancel(warm_fridge);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Failed shutting down warm start thread: %d", rc);
+	}
+
+	return fsalstat(posix2fsal_error(rc), rc);
+}
+
+/** @} */
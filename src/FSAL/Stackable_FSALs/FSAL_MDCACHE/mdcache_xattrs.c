@@ -38,8 +38,197 @@
 #include "gsh_list.h"
 #include "fsal_convert.h"
 #include "FSAL/fsal_commonlib.h"
+#include "gsh_cache.h"
 #include "mdcache_int.h"
 
+/*
+ * The NFSv4.2 xattrs of the entries are cached in one gsh_cache, keyed
+ * by the xattr_gen of the entry and the name.  The name list of an
+ * entry is kept under its xattr_gen alone, as no xattr has an empty
+ * name.  Every generation comes from one counter, so dropping the
+ * xattrs of an entry only takes clearing MDCACHE_TRUST_XATTRS: the
+ * next lookup gives the entry a new generation and its old slots are
+ * never matched again.
+ */
+
+/** Longest name cached, longer ones go to the FSAL */
+#define MDC_XATTR_NAME_MAX 255
+/** Largest Xattr_Cache_Value_Max */
+#define MDC_XATTR_VALUE_MAX 4096
+
+struct mdc_xattr_key {
+	uint64_t gen;
+	char name[MDC_XATTR_NAME_MAX];
+};
+
+static struct gsh_cache *mdc_xattr_cache;
+static uint64_t mdc_xattr_gens;
+
+/**
+ * @brief Build the cache key of an xattr of an entry
+ *
+ * Gives the entry a new generation if its cached xattrs were dropped.
+ * The key is built before asking the FSAL, so that an invalidation
+ * racing the call leaves what it returns unreachable.
+ *
+ * @param[in]  entry The entry
+ * @param[in]  name  Name of the xattr, NULL for the name list
+ * @param[out] key   The key
+ *
+ * @return Length of the key.
+ */
+static uint32_t mdc_xattr_key(mdcache_entry_t *entry, xattrname4 *name,
+			      struct mdc_xattr_key *key)
+{
+	if (!(atomic_fetch_uint32_t(&entry->mde_flags) &
+	      MDCACHE_TRUST_XATTRS)) {
+		atomic_store_uint64_t(&entry->xattr_gen,
+				      atomic_inc_uint64_t(&mdc_xattr_gens));
+		atomic_set_uint32_t_bits(&entry->mde_flags,
+					 MDCACHE_TRUST_XATTRS);
+	}
+
+	key->gen = atomic_fetch_uint64_t(&entry->xattr_gen);
+	if (name == NULL)
+		return sizeof(key->gen);
+
+	memcpy(key->name, name->utf8string_val, name->utf8string_len);
+	return sizeof(key->gen) + name->utf8string_len;
+}
+
+/**
+ * @brief Fill a LISTXATTR reply from a cached name list
+ *
+ * The reply is laid out as the FSALs do: the component4s at the start
+ * of the buffer and the names, each with its NUL, @a len bytes in.  The
+ * cookie is the index of the next name.
+ *
+ * @param[in]     list   Verifier, then the names one after the other
+ * @param[in]     size   Length of @a list
+ * @param[in]     len    Room for the component4s and for the names
+ * @param[in,out] cookie cookie for list
+ * @param[out]    verf   cookie verifier
+ * @param[out]    eof    set if no more extended attributes
+ * @param[out]    names  list of extended attribute names
+ *
+ * @return FSAL status
+ */
+static fsal_status_t mdc_xattr_list(const char *list, uint32_t size,
+				    count4 len, nfs_cookie4 *cookie,
+				    verifier4 *verf, bool_t *eof,
+				    xattrlist4 *names)
+{
+	const char *name = list + sizeof(verifier4);
+	const char *end = list + size;
+	component4 *entry = names->entries;
+	char *valstart = (char *)names->entries + len;
+	char *val = valstart;
+	uint32_t count = 0;
+	uint64_t ix = 0;
+	size_t namelen;
+
+	memcpy(verf, list, sizeof(verifier4));
+
+	for (; name < end; name += namelen, ix++) {
+		namelen = strnlen(name, end - name) + 1;
+		if (ix < *cookie)
+			continue;
+
+		if ((char *)(entry + 1) - (char *)names->entries > len ||
+		    (val - valstart) + namelen > len) {
+			if (count == 0)
+				return fsalstat(ERR_FSAL_TOOSMALL, 0);
+			names->entryCount = count;
+			*cookie = ix;
+			*eof = false;
+			return fsalstat(ERR_FSAL_NO_ERROR, 0);
+		}
+
+		entry->utf8string_len = namelen;
+		entry->utf8string_val = val;
+		memcpy(val, name, namelen);
+		val += namelen;
+		entry++;
+		count++;
+	}
+
+	names->entryCount = count;
+	*cookie = 0;
+	*eof = true;
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+/**
+ * @brief Cache the names of a whole LISTXATTR reply
+ *
+ * @param[in] key     Key of the name list
+ * @param[in] key_len Its length
+ * @param[in] verf    cookie verifier
+ * @param[in] names   The names
+ */
+static void mdc_xattr_list_insert(struct mdc_xattr_key *key,
+				  uint32_t key_len, verifier4 *verf,
+				  xattrlist4 *names)
+{
+	char list[MDC_XATTR_VALUE_MAX];
+	uint32_t size = sizeof(verifier4);
+	uint32_t ix, namelen;
+
+	memcpy(list, verf, sizeof(verifier4));
+
+	for (ix = 0; ix < names->entryCount; ix++) {
+		namelen = names->entries[ix].utf8string_len;
+		if (namelen == 0 ||
+		    size + namelen > mdcache_param.xattr_value_max)
+			return;
+
+		memcpy(list + size, names->entries[ix].utf8string_val,
+		       namelen);
+		/* Kept NUL terminated, whatever the FSAL sent */
+		list[size + namelen - 1] = '\0';
+		size += namelen;
+	}
+
+	gsh_cache_insert(mdc_xattr_cache, key, key_len, list, size);
+}
+
+/**
+ * @brief Create the xattr cache
+ *
+ * @return FSAL status
+ */
+fsal_status_t mdcache_xattr_pkginit(void)
+{
+	struct gsh_cache_params params = {
+		.name = "mdcache xattr",
+		.key_max = sizeof(struct mdc_xattr_key),
+		.value_max = mdcache_param.xattr_value_max,
+		.ttl = mdcache_param.xattr_expiration,
+		.negative_ttl = mdcache_param.xattr_expiration,
+		.bytes = mdcache_param.xattr_cache_size,
+	};
+
+	if (params.bytes != 0 && mdc_xattr_cache == NULL)
+		mdc_xattr_cache = gsh_cache_create(&params);
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+/**
+ * @brief Destroy the xattr cache
+ *
+ * @return FSAL status
+ */
+fsal_status_t mdcache_xattr_pkgshutdown(void)
+{
+	if (mdc_xattr_cache != NULL) {
+		gsh_cache_destroy(mdc_xattr_cache);
+		mdc_xattr_cache = NULL;
+	}
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
 /**
  * @brief List extended attributes on a file
  *
@@ -193,6 +382,8 @@ fsal_status_t mdcache_setextattr_value(struct fsal_obj_handle *obj_hdl,
 			buf_size, create)
 	       );
 
+	mdc_xattr_invalidate(handle);
+
 	return status;
 }
 
@@ -223,6 +414,8 @@ fsal_status_t mdcache_setextattr_value_by_id(struct fsal_obj_handle *obj_hdl,
 				buf_size)
 	       );
 
+	mdc_xattr_invalidate(handle);
+
 	return status;
 }
 
@@ -248,6 +441,8 @@ fsal_status_t mdcache_remove_extattr_by_id(struct fsal_obj_handle *obj_hdl,
 			handle->sub_handle, id)
 	       );
 
+	mdc_xattr_invalidate(handle);
+
 	return status;
 }
 
@@ -273,13 +468,17 @@ fsal_status_t mdcache_remove_extattr_by_name(struct fsal_obj_handle *obj_hdl,
 			handle->sub_handle, name)
 	       );
 
+	mdc_xattr_invalidate(handle);
+
 	return status;
 }
 
 /**
  * @brief Get an Extended Attribute
  *
- * Pass through to sub-FSAL
+ * Served from the xattr cache when it can, else passed through to the
+ * sub-FSAL.  Values that fit the cache and names the file does not have
+ * are remembered.
  *
  * @param[in] obj_hdl	File to search
  * @param[in] name	Name of attribute
@@ -293,12 +492,51 @@ fsal_status_t mdcache_getxattrs(struct fsal_obj_handle *obj_hdl,
 		container_of(obj_hdl, struct mdcache_fsal_obj_handle,
 			     obj_handle);
 	fsal_status_t status;
-
+	struct mdc_xattr_key key;
+	char buf[MDC_XATTR_VALUE_MAX];
+	uint32_t key_len = 0, len, size = value->utf8string_len;
+
+	if (mdc_xattr_cache == NULL ||
+	    name->utf8string_len > MDC_XATTR_NAME_MAX)
+		goto subcall;
+
+	key_len = mdc_xattr_key(handle, name, &key);
+
+	switch (gsh_cache_lookup(mdc_xattr_cache, &key, key_len, buf, &len)) {
+	case GSH_CACHE_NEGATIVE:
+		return fsalstat(ERR_FSAL_NOENT, 0);
+	case GSH_CACHE_HIT:
+		/* An empty buffer asks for the size */
+		if (size == 0) {
+			value->utf8string_len = len;
+			return fsalstat(ERR_FSAL_NO_ERROR, 0);
+		}
+		if (size < len)
+			return fsalstat(ERR_FSAL_TOOSMALL, 0);
+		memcpy(value->utf8string_val, buf, len);
+		value->utf8string_len = len;
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+	case GSH_CACHE_MISS:
+		break;
+	}
+
+subcall:
 	subcall(
 		status = handle->sub_handle->obj_ops.getxattrs(
 			handle->sub_handle, name, value)
 	       );
 
+	if (key_len == 0)
+		return status;
+
+	if (status.major == ERR_FSAL_NOENT)
+		gsh_cache_insert_negative(mdc_xattr_cache, &key, key_len);
+	else if (!FSAL_IS_ERROR(status) && size != 0 &&
+		 value->utf8string_len <= mdcache_param.xattr_value_max)
+		gsh_cache_insert(mdc_xattr_cache, &key, key_len,
+				 value->utf8string_val,
+				 value->utf8string_len);
+
 	return status;
 }
 
@@ -327,6 +565,10 @@ fsal_status_t mdcache_setxattrs(struct fsal_obj_handle *obj_hdl,
 			handle->sub_handle, type, name, value)
 	       );
 
+	/* Dropped whatever the outcome, the FSAL may have done part */
+	mdc_xattr_invalidate(handle);
+	mdc_cluster_invalidate(handle, FSAL_UP_INVALIDATE_XATTRS);
+
 	return status;
 }
 
@@ -352,13 +594,18 @@ fsal_status_t mdcache_removexattrs(struct fsal_obj_handle *obj_hdl,
 			handle->sub_handle, name)
 	       );
 
+	mdc_xattr_invalidate(handle);
+	mdc_cluster_invalidate(handle, FSAL_UP_INVALIDATE_XATTRS);
+
 	return status;
 }
 
 /**
  * @brief List Extended Attributes
  *
- * Pass through to sub-FSAL
+ * Served from the xattr cache when it holds the names, else passed
+ * through to the sub-FSAL.  A reply from the first name to the last is
+ * cached if it fits.
  *
  * @param[in] obj_hdl	File to search
  * @param[in] len	Length of names buffer
@@ -377,11 +624,26 @@ fsal_status_t mdcache_listxattrs(struct fsal_obj_handle *obj_hdl,
 		container_of(obj_hdl, struct mdcache_fsal_obj_handle,
 			     obj_handle);
 	fsal_status_t status;
+	struct mdc_xattr_key key;
+	char list[MDC_XATTR_VALUE_MAX];
+	uint32_t key_len = 0, size;
+	bool whole = *cookie == 0;
+
+	if (mdc_xattr_cache != NULL) {
+		key_len = mdc_xattr_key(handle, NULL, &key);
+		if (gsh_cache_lookup(mdc_xattr_cache, &key, key_len, list,
+				     &size) == GSH_CACHE_HIT)
+			return mdc_xattr_list(list, size, len, cookie, verf,
+					      eof, names);
+	}
 
 	subcall(
 		status = handle->sub_handle->obj_ops.listxattrs(
 			handle->sub_handle, len, cookie, verf, eof, names)
 	       );
 
+	if (key_len != 0 && whole && *eof && !FSAL_IS_ERROR(status))
+		mdc_xattr_list_insert(&key, key_len, verf, names);
+
 	return status;
 }
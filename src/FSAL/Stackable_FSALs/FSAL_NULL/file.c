@@ -147,6 +147,73 @@ fsal_status_t nullfs_write(struct fsal_obj_handle *obj_hdl,
 	return status;
 }
 
+/* nullfs_read_vec
+ * read into several buffers
+ */
+
+fsal_status_t nullfs_read_vec(struct fsal_obj_handle *obj_hdl,
+			      bool bypass,
+			      struct state_t *state,
+			      uint64_t offset,
+			      const struct iovec *iov,
+			      int iovcnt,
+			      size_t *read_amount,
+			      bool *end_of_file)
+{
+	struct nullfs_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct nullfs_fsal_obj_handle,
+			     obj_handle);
+
+	struct nullfs_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
+			     export);
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	fsal_status_t status =
+		handle->sub_handle->obj_ops.read_vec(handle->sub_handle,
+						     bypass, state, offset,
+						     iov, iovcnt, read_amount,
+						     end_of_file);
+	op_ctx->fsal_export = &export->export;
+
+	return status;
+}
+
+/* nullfs_write_vec
+ * write from several buffers
+ */
+
+fsal_status_t nullfs_write_vec(struct fsal_obj_handle *obj_hdl,
+			       bool bypass,
+			       struct state_t *state,
+			       uint64_t offset,
+			       const struct iovec *iov,
+			       int iovcnt,
+			       size_t *write_amount,
+			       bool *fsal_stable)
+{
+	struct nullfs_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct nullfs_fsal_obj_handle,
+			     obj_handle);
+
+	struct nullfs_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
+			     export);
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	fsal_status_t status =
+		handle->sub_handle->obj_ops.write_vec(handle->sub_handle,
+						      bypass, state, offset,
+						      iov, iovcnt,
+						      write_amount,
+						      fsal_stable);
+	op_ctx->fsal_export = &export->export;
+
+	return status;
+}
+
 /* nullfs_commit
  * Commit a file range to storage.
  * for right now, fsync will have to do.
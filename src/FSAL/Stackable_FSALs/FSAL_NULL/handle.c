@@ -592,6 +592,8 @@ void nullfs_handle_ops_init(struct fsal_obj_ops *ops)
 	ops->status = nullfs_status;
 	ops->read = nullfs_read;
 	ops->write = nullfs_write;
+	ops->read_vec = nullfs_read_vec;
+	ops->write_vec = nullfs_write_vec;
 	ops->commit = nullfs_commit;
 	ops->lock_op = nullfs_lock_op;
 	ops->close = nullfs_close;
@@ -87,6 +87,16 @@ fsal_status_t nullfs_write(struct fsal_obj_handle *obj_hdl,
 			   uint64_t offset,
 			   size_t buffer_size, void *buffer,
 			   size_t *write_amount, bool *fsal_stable);
+fsal_status_t nullfs_read_vec(struct fsal_obj_handle *obj_hdl,
+			      bool bypass, struct state_t *state,
+			      uint64_t offset,
+			      const struct iovec *iov, int iovcnt,
+			      size_t *read_amount, bool *end_of_file);
+fsal_status_t nullfs_write_vec(struct fsal_obj_handle *obj_hdl,
+			       bool bypass, struct state_t *state,
+			       uint64_t offset,
+			       const struct iovec *iov, int iovcnt,
+			       size_t *write_amount, bool *fsal_stable);
 fsal_status_t nullfs_commit(struct fsal_obj_handle *obj_hdl,	/* sync */
 			    off_t offset, size_t len);
 fsal_status_t nullfs_lock_op(struct fsal_obj_handle *obj_hdl,
@@ -0,0 +1,479 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/* export.c
+ * TRACE FSAL export object
+ */
+
+#include "config.h"
+
+#include "fsal.h"
+#include <pthread.h>
+#include <string.h>
+#include <sys/types.h>
+#include "gsh_list.h"
+#include "config_parsing.h"
+#include "FSAL/fsal_commonlib.h"
+#include "FSAL/fsal_config.h"
+#include "trace_methods.h"
+#include "nfs_exports.h"
+#include "export_mgr.h"
+
+static inline struct trace_fsal_export *trace_exp(struct fsal_export *exp_hdl)
+{
+	return container_of(exp_hdl, struct trace_fsal_export, export);
+}
+
+/* export object methods
+ */
+
+static void release(struct fsal_export *exp_hdl)
+{
+	struct trace_fsal_export *myself = trace_exp(exp_hdl);
+	struct fsal_module *sub_fsal;
+
+	trace_unregister_export(myself);
+
+	sub_fsal = myself->export.sub_export->fsal;
+
+	/* Release the sub_export */
+	myself->export.sub_export->exp_ops.release(myself->export.sub_export);
+	fsal_put(sub_fsal);
+
+	fsal_detach_export(exp_hdl->fsal, &exp_hdl->exports);
+	free_export_ops(exp_hdl);
+
+	gsh_free(myself->path);
+	gsh_free(myself);
+}
+
+static void trace_unexport(struct fsal_export *exp_hdl)
+{
+	struct trace_fsal_export *exp = trace_exp(exp_hdl);
+
+	trace_pass(exp,
+		exp->export.sub_export->exp_ops.unexport(
+			exp->export.sub_export));
+}
+
+static fsal_status_t get_dynamic_info(struct fsal_export *exp_hdl,
+				      struct fsal_obj_handle *obj_hdl,
+				      fsal_dynamicfsinfo_t *infop)
+{
+	struct trace_fsal_export *exp = trace_exp(exp_hdl);
+	fsal_status_t status;
+
+	trace_call(exp, TRACE_DYNAMIC_INFO,
+		status = exp->export.sub_export->exp_ops.get_fs_dynamic_info(
+			exp->export.sub_export, trace_sub(obj_hdl), infop));
+
+	return status;
+}
+
+static bool fs_supports(struct fsal_export *exp_hdl,
+			fsal_fsinfo_options_t option)
+{
+	struct trace_fsal_export *exp = trace_exp(exp_hdl);
+	bool result;
+
+	trace_pass(exp,
+		result = exp->export.sub_export->exp_ops.fs_supports(
+			exp->export.sub_export, option));
+
+	return result;
+}
+
+static uint64_t fs_maxfilesize(struct fsal_export *exp_hdl)
+{
+	struct trace_fsal_export *exp = trace_exp(exp_hdl);
+	uint64_t result;
+
+	trace_pass(exp,
+		result = exp->export.sub_export->exp_ops.fs_maxfilesize(
+			exp->export.sub_export));
+
+	return result;
+}
+
+static uint32_t fs_maxread(struct fsal_export *exp_hdl)
+{
+	struct trace_fsal_export *exp = trace_exp(exp_hdl);
+	uint32_t result;
+
+	trace_pass(exp,
+		result = exp->export.sub_export->exp_ops.fs_maxread(
+			exp->export.sub_export));
+
+	return result;
+}
+
+static uint32_t fs_maxwrite(struct fsal_export *exp_hdl)
+{
+	struct trace_fsal_export *exp = trace_exp(exp_hdl);
+	uint32_t result;
+
+	trace_pass(exp,
+		result = exp->export.sub_export->exp_ops.fs_maxwrite(
+			exp->export.sub_export));
+
+	return result;
+}
+
+static uint32_t fs_maxlink(struct fsal_export *exp_hdl)
+{
+	struct trace_fsal_export *exp = trace_exp(exp_hdl);
+	uint32_t result;
+
+	trace_pass(exp,
+		result = exp->export.sub_export->exp_ops.fs_maxlink(
+			exp->export.sub_export));
+
+	return result;
+}
+
+static uint32_t fs_maxnamelen(struct fsal_export *exp_hdl)
+{
+	struct trace_fsal_export *exp = trace_exp(exp_hdl);
+	uint32_t result;
+
+	trace_pass(exp,
+		result = exp->export.sub_export->exp_ops.fs_maxnamelen(
+			exp->export.sub_export));
+
+	return result;
+}
+
+static uint32_t fs_maxpathlen(struct fsal_export *exp_hdl)
+{
+	struct trace_fsal_export *exp = trace_exp(exp_hdl);
+	uint32_t result;
+
+	trace_pass(exp,
+		result = exp->export.sub_export->exp_ops.fs_maxpathlen(
+			exp->export.sub_export));
+
+	return result;
+}
+
+static struct timespec fs_lease_time(struct fsal_export *exp_hdl)
+{
+	struct trace_fsal_export *exp = trace_exp(exp_hdl);
+	struct timespec result;
+
+	trace_pass(exp,
+		result = exp->export.sub_export->exp_ops.fs_lease_time(
+			exp->export.sub_export));
+
+	return result;
+}
+
+static fsal_aclsupp_t fs_acl_support(struct fsal_export *exp_hdl)
+{
+	struct trace_fsal_export *exp = trace_exp(exp_hdl);
+	fsal_aclsupp_t result;
+
+	trace_pass(exp,
+		result = exp->export.sub_export->exp_ops.fs_acl_support(
+			exp->export.sub_export));
+
+	return result;
+}
+
+static attrmask_t fs_supported_attrs(struct fsal_export *exp_hdl)
+{
+	struct trace_fsal_export *exp = trace_exp(exp_hdl);
+	attrmask_t result;
+
+	trace_pass(exp,
+		result = exp->export.sub_export->exp_ops.fs_supported_attrs(
+			exp->export.sub_export));
+
+	return result;
+}
+
+static uint32_t fs_umask(struct fsal_export *exp_hdl)
+{
+	struct trace_fsal_export *exp = trace_exp(exp_hdl);
+	uint32_t result;
+
+	trace_pass(exp,
+		result = exp->export.sub_export->exp_ops.fs_umask(
+			exp->export.sub_export));
+
+	return result;
+}
+
+static uint32_t fs_xattr_access_rights(struct fsal_export *exp_hdl)
+{
+	struct trace_fsal_export *exp = trace_exp(exp_hdl);
+	uint32_t result;
+
+	trace_pass(exp,
+		result = exp->export.sub_export->exp_ops.fs_xattr_access_rights(
+			exp->export.sub_export));
+
+	return result;
+}
+
+static fsal_status_t check_quota(struct fsal_export *exp_hdl,
+				 const char *filepath, int quota_type)
+{
+	struct trace_fsal_export *exp = trace_exp(exp_hdl);
+	fsal_status_t status;
+
+	trace_call(exp, TRACE_CHECK_QUOTA,
+		status = exp->export.sub_export->exp_ops.check_quota(
+			exp->export.sub_export, filepath, quota_type));
+
+	return status;
+}
+
+static fsal_status_t get_quota(struct fsal_export *exp_hdl,
+			       const char *filepath, int quota_type,
+			       int quota_id,
+			       fsal_quota_t *pquota)
+{
+	struct trace_fsal_export *exp = trace_exp(exp_hdl);
+	fsal_status_t status;
+
+	trace_call(exp, TRACE_GET_QUOTA,
+		status = exp->export.sub_export->exp_ops.get_quota(
+			exp->export.sub_export, filepath, quota_type,
+			quota_id, pquota));
+
+	return status;
+}
+
+static fsal_status_t set_quota(struct fsal_export *exp_hdl,
+			       const char *filepath, int quota_type,
+			       int quota_id,
+			       fsal_quota_t *pquota, fsal_quota_t *presquota)
+{
+	struct trace_fsal_export *exp = trace_exp(exp_hdl);
+	fsal_status_t status;
+
+	trace_call(exp, TRACE_SET_QUOTA,
+		status = exp->export.sub_export->exp_ops.set_quota(
+			exp->export.sub_export, filepath, quota_type,
+			quota_id, pquota, presquota));
+
+	return status;
+}
+
+static fsal_status_t extract_handle(struct fsal_export *exp_hdl,
+				    fsal_digesttype_t in_type,
+				    struct gsh_buffdesc *fh_desc,
+				    int flags)
+{
+	struct trace_fsal_export *exp = trace_exp(exp_hdl);
+	fsal_status_t status;
+
+	trace_pass(exp,
+		status = exp->export.sub_export->exp_ops.extract_handle(
+			exp->export.sub_export, in_type, fh_desc, flags));
+
+	return status;
+}
+
+static void get_write_verifier(struct fsal_export *exp_hdl,
+			       struct gsh_buffdesc *verf_desc)
+{
+	struct trace_fsal_export *exp = trace_exp(exp_hdl);
+
+	trace_pass(exp,
+		exp->export.sub_export->exp_ops.get_write_verifier(
+			exp->export.sub_export, verf_desc));
+}
+
+/**
+ * @brief Allocate state_t structure
+ *
+ * The state belongs to the sub-FSAL, which is handed it unchanged by
+ * the I/O calls.
+ */
+static struct state_t *alloc_state(struct fsal_export *exp_hdl,
+				   enum state_type state_type,
+				   struct state_t *related_state)
+{
+	struct trace_fsal_export *exp = trace_exp(exp_hdl);
+	struct state_t *state;
+
+	trace_pass(exp,
+		state = exp->export.sub_export->exp_ops.alloc_state(
+			exp->export.sub_export, state_type, related_state));
+
+	return state;
+}
+
+static void free_state(struct state_t *state)
+{
+	struct trace_fsal_export *exp = trace_export();
+
+	trace_pass(exp,
+		exp->export.sub_export->exp_ops.free_state(state));
+}
+
+/* trace_export_ops_init
+ * overwrite vector entries with the methods that we support
+ */
+
+static void trace_export_ops_init(struct export_ops *ops)
+{
+	ops->unexport = trace_unexport;
+	ops->release = release;
+	ops->lookup_path = trace_lookup_path;
+	ops->extract_handle = extract_handle;
+	ops->create_handle = trace_create_handle;
+	ops->get_fs_dynamic_info = get_dynamic_info;
+	ops->fs_supports = fs_supports;
+	ops->fs_maxfilesize = fs_maxfilesize;
+	ops->fs_maxread = fs_maxread;
+	ops->fs_maxwrite = fs_maxwrite;
+	ops->fs_maxlink = fs_maxlink;
+	ops->fs_maxnamelen = fs_maxnamelen;
+	ops->fs_maxpathlen = fs_maxpathlen;
+	ops->fs_lease_time = fs_lease_time;
+	ops->fs_acl_support = fs_acl_support;
+	ops->fs_supported_attrs = fs_supported_attrs;
+	ops->fs_umask = fs_umask;
+	ops->fs_xattr_access_rights = fs_xattr_access_rights;
+	ops->check_quota = check_quota;
+	ops->get_quota = get_quota;
+	ops->set_quota = set_quota;
+	ops->get_write_verifier = get_write_verifier;
+	ops->alloc_state = alloc_state;
+	ops->free_state = free_state;
+}
+
+struct tracefsal_args {
+	struct subfsal_args subfsal;
+	uint32_t slow_op_threshold;
+	uint32_t sample_rate;
+	uint32_t report_interval;
+	bool inject_latency;
+};
+
+static struct config_item sub_fsal_params[] = {
+	CONF_ITEM_STR("name", 1, 10, NULL,
+		      subfsal_args, name),
+	CONFIG_EOL
+};
+
+static struct config_item export_params[] = {
+	CONF_ITEM_NOOP("name"),
+	CONF_ITEM_UI32("Slow_Op_Threshold", 0, UINT32_MAX, 0,
+		       tracefsal_args, slow_op_threshold),
+	CONF_ITEM_UI32("Sample_Rate", 1, UINT32_MAX, 1,
+		       tracefsal_args, sample_rate),
+	CONF_ITEM_UI32("Report_Interval", 0, UINT32_MAX, 0,
+		       tracefsal_args, report_interval),
+	CONF_ITEM_BOOL("Inject_Latency", false,
+		       tracefsal_args, inject_latency),
+	CONF_RELAX_BLOCK("FSAL", sub_fsal_params,
+			 noop_conf_init, subfsal_commit,
+			 tracefsal_args, subfsal),
+	CONFIG_EOL
+};
+
+static struct config_block export_param = {
+	.dbus_interface_name = "org.ganesha.nfsd.config.fsal.trace-export%d",
+	.blk_desc.name = "FSAL",
+	.blk_desc.type = CONFIG_BLOCK,
+	.blk_desc.u.blk.init = noop_conf_init,
+	.blk_desc.u.blk.params = export_params,
+	.blk_desc.u.blk.commit = noop_conf_commit
+};
+
+/* create_export
+ * Create an export point and return a handle to it to be kept
+ * in the export list.
+ * First lookup the fsal, then create the export and then put the fsal back.
+ * returns the export with one reference taken.
+ */
+
+fsal_status_t trace_create_export(struct fsal_module *fsal_hdl,
+				  void *parse_node,
+				  struct config_error_type *err_type,
+				  const struct fsal_up_vector *up_ops)
+{
+	fsal_status_t expres;
+	struct fsal_module *fsal_stack;
+	struct trace_fsal_export *myself;
+	struct tracefsal_args tracefsal;
+	int retval;
+
+	/* process our FSAL block to get the name of the fsal
+	 * underneath us.
+	 */
+	retval = load_config_from_node(parse_node,
+				       &export_param,
+				       &tracefsal,
+				       true,
+				       err_type);
+	if (retval != 0)
+		return fsalstat(ERR_FSAL_INVAL, 0);
+	fsal_stack = lookup_fsal(tracefsal.subfsal.name);
+	if (fsal_stack == NULL) {
+		LogMajor(COMPONENT_FSAL,
+			 "trace_create_export: failed to lookup for FSAL %s",
+			 tracefsal.subfsal.name);
+		return fsalstat(ERR_FSAL_INVAL, EINVAL);
+	}
+
+	myself = gsh_calloc(1, sizeof(struct trace_fsal_export));
+	expres = fsal_stack->m_ops.create_export(fsal_stack,
+						 tracefsal.subfsal.fsal_node,
+						 err_type,
+						 up_ops);
+	fsal_put(fsal_stack);
+	if (FSAL_IS_ERROR(expres)) {
+		LogMajor(COMPONENT_FSAL,
+			 "Failed to call create_export on underlying FSAL %s",
+			 tracefsal.subfsal.name);
+		gsh_free(myself);
+		return expres;
+	}
+
+	fsal_export_stack(op_ctx->fsal_export, &myself->export);
+
+	fsal_export_init(&myself->export);
+	trace_export_ops_init(&myself->export.exp_ops);
+	myself->export.up_ops = up_ops;
+	myself->export.fsal = fsal_hdl;
+
+	myself->path = gsh_strdup(op_ctx->ctx_export->fullpath);
+	myself->slow_ns = (uint64_t) tracefsal.slow_op_threshold *
+			  NS_PER_MSEC;
+	myself->sample_rate = tracefsal.sample_rate;
+	myself->report_interval = tracefsal.report_interval;
+#ifdef _ERROR_INJECTION
+	myself->inject = tracefsal.inject_latency;
+#else
+	if (tracefsal.inject_latency)
+		LogWarn(COMPONENT_FSAL,
+			"Inject_Latency ignored on %s, built without error injection",
+			myself->path);
+#endif
+	trace_register_export(myself);
+
+	op_ctx->fsal_export = &myself->export;
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
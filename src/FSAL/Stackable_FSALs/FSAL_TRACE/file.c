@@ -0,0 +1,697 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/* file.c
+ * TRACE FSAL I/O methods
+ */
+
+#include "config.h"
+
+#include "fsal.h"
+#include <string.h>
+#include "FSAL/fsal_commonlib.h"
+#include "trace_methods.h"
+
+static fsal_status_t trace_open(struct fsal_obj_handle *obj_hdl,
+				fsal_openflags_t openflags)
+{
+	struct trace_fsal_export *exp = trace_export();
+	struct fsal_obj_handle *sub_handle = trace_sub(obj_hdl);
+	fsal_status_t status;
+
+	trace_call(exp, TRACE_OPEN,
+		status = sub_handle->obj_ops.open(sub_handle, openflags));
+
+	return status;
+}
+
+static fsal_status_t trace_reopen(struct fsal_obj_handle *obj_hdl,
+				  fsal_openflags_t openflags)
+{
+	struct trace_fsal_export *exp = trace_export();
+	struct fsal_obj_handle *sub_handle = trace_sub(obj_hdl);
+	fsal_status_t status;
+
+	trace_call(exp, TRACE_REOPEN,
+		status = sub_handle->obj_ops.reopen(sub_handle, openflags));
+
+	return status;
+}
+
+static fsal_openflags_t trace_status(struct fsal_obj_handle *obj_hdl)
+{
+	struct trace_fsal_export *exp = trace_export();
+	struct fsal_obj_handle *sub_handle = trace_sub(obj_hdl);
+	fsal_openflags_t result;
+
+	trace_pass(exp,
+		result = sub_handle->obj_ops.status(sub_handle));
+
+	return result;
+}
+
+static fsal_status_t trace_read(struct fsal_obj_handle *obj_hdl,
+				uint64_t offset,
+				size_t buffer_size, void *buffer,
+				size_t *read_amount, bool *end_of_file)
+{
+	struct trace_fsal_export *exp = trace_export();
+	struct fsal_obj_handle *sub_handle = trace_sub(obj_hdl);
+	fsal_status_t status;
+
+	trace_io_call(exp, TRACE_READ, false, buffer_size,
+		status = sub_handle->obj_ops.read(sub_handle, offset,
+						  buffer_size, buffer,
+						  read_amount, end_of_file));
+
+	return status;
+}
+
+static fsal_status_t trace_read_plus(struct fsal_obj_handle *obj_hdl,
+				     uint64_t offset,
+				     size_t buffer_size, void *buffer,
+				     size_t *read_amount, bool *end_of_file,
+				     struct io_info *info)
+{
+	struct trace_fsal_export *exp = trace_export();
+	struct fsal_obj_handle *sub_handle = trace_sub(obj_hdl);
+	fsal_status_t status;
+
+	trace_io_call(exp, TRACE_READ_PLUS, false, buffer_size,
+		status = sub_handle->obj_ops.read_plus(sub_handle, offset,
+						       buffer_size, buffer,
+						       read_amount,
+						       end_of_file, info));
+
+	return status;
+}
+
+static fsal_status_t trace_write(struct fsal_obj_handle *obj_hdl,
+				 uint64_t offset,
+				 size_t buffer_size, void *buffer,
+				 size_t *write_amount, bool *fsal_stable)
+{
+	struct trace_fsal_export *exp = trace_export();
+	struct fsal_obj_handle *sub_handle = trace_sub(obj_hdl);
+	fsal_status_t status;
+
+	trace_io_call(exp, TRACE_WRITE, true, buffer_size,
+		status = sub_handle->obj_ops.write(sub_handle, offset,
+						   buffer_size, buffer,
+						   write_amount, fsal_stable));
+
+	return status;
+}
+
+static fsal_status_t trace_write_plus(struct fsal_obj_handle *obj_hdl,
+				      uint64_t offset,
+				      size_t buffer_size, void *buffer,
+				      size_t *write_amount, bool *fsal_stable,
+				      struct io_info *info)
+{
+	struct trace_fsal_export *exp = trace_export();
+	struct fsal_obj_handle *sub_handle = trace_sub(obj_hdl);
+	fsal_status_t status;
+
+	trace_io_call(exp, TRACE_WRITE_PLUS, true, buffer_size,
+		status = sub_handle->obj_ops.write_plus(sub_handle, offset,
+							buffer_size, buffer,
+							write_amount,
+							fsal_stable, info));
+
+	return status;
+}
+
+static fsal_status_t trace_seek(struct fsal_obj_handle *obj_hdl,
+				struct io_info *info)
+{
+	struct trace_fsal_export *exp = trace_export();
+	struct fsal_obj_handle *sub_handle = trace_sub(obj_hdl);
+	fsal_status_t status;
+
+	trace_call(exp, TRACE_SEEK,
+		status = sub_handle->obj_ops.seek(sub_handle, info));
+
+	return status;
+}
+
+static fsal_status_t trace_io_advise(struct fsal_obj_handle *obj_hdl,
+				     struct io_hints *hints)
+{
+	struct trace_fsal_export *exp = trace_export();
+	struct fsal_obj_handle *sub_handle = trace_sub(obj_hdl);
+	fsal_status_t status;
+
+	trace_call(exp, TRACE_IO_ADVISE,
+		status = sub_handle->obj_ops.io_advise(sub_handle, hints));
+
+	return status;
+}
+
+static fsal_status_t trace_commit(struct fsal_obj_handle *obj_hdl,
+				  off_t offset, size_t len)
+{
+	struct trace_fsal_export *exp = trace_export();
+	struct fsal_obj_handle *sub_handle = trace_sub(obj_hdl);
+	fsal_status_t status;
+
+	trace_call(exp, TRACE_COMMIT,
+		status = sub_handle->obj_ops.commit(sub_handle, offset, len));
+
+	return status;
+}
+
+static fsal_status_t trace_lock_op(struct fsal_obj_handle *obj_hdl,
+				   void *p_owner,
+				   fsal_lock_op_t lock_op,
+				   fsal_lock_param_t *request_lock,
+				   fsal_lock_param_t *conflicting_lock)
+{
+	struct trace_fsal_export *exp = trace_export();
+	struct fsal_obj_handle *sub_handle = trace_sub(obj_hdl);
+	fsal_status_t status;
+
+	trace_call(exp, TRACE_LOCK_OP,
+		status = sub_handle->obj_ops.lock_op(sub_handle, p_owner,
+						     lock_op, request_lock,
+						     conflicting_lock));
+
+	return status;
+}
+
+static fsal_status_t trace_share_op(struct fsal_obj_handle *obj_hdl,
+				    void *p_owner,
+				    fsal_share_param_t request_share)
+{
+	struct trace_fsal_export *exp = trace_export();
+	struct fsal_obj_handle *sub_handle = trace_sub(obj_hdl);
+	fsal_status_t status;
+
+	trace_call(exp, TRACE_SHARE_OP,
+		status = sub_handle->obj_ops.share_op(sub_handle, p_owner,
+						      request_share));
+
+	return status;
+}
+
+static fsal_status_t trace_close(struct fsal_obj_handle *obj_hdl)
+{
+	struct trace_fsal_export *exp = trace_export();
+	struct fsal_obj_handle *sub_handle = trace_sub(obj_hdl);
+	fsal_status_t status;
+
+	trace_call(exp, TRACE_CLOSE,
+		status = sub_handle->obj_ops.close(sub_handle));
+
+	return status;
+}
+
+/**
+ * @brief Open or create a file
+ *
+ * Opening by handle gives back the handle opened, opening by name a new
+ * handle to wrap.
+ */
+static fsal_status_t trace_open2(struct fsal_obj_handle *obj_hdl,
+				 struct state_t *state,
+				 fsal_openflags_t openflags,
+				 enum fsal_create_mode createmode,
+				 const char *name,
+				 struct attrlist *attrs_in,
+				 fsal_verifier_t verifier,
+				 struct fsal_obj_handle **new_obj,
+				 struct attrlist *attrs_out,
+				 bool *caller_perm_check)
+{
+	struct trace_fsal_export *exp = trace_export();
+	struct fsal_obj_handle *sub_handle = trace_sub(obj_hdl);
+	struct fsal_obj_handle *sub_new = NULL;
+	fsal_status_t status;
+
+	*new_obj = NULL;
+
+	trace_call(exp, TRACE_OPEN2,
+		status = sub_handle->obj_ops.open2(sub_handle, state, openflags,
+						   createmode, name, attrs_in,
+						   verifier, &sub_new,
+						   attrs_out,
+						   caller_perm_check));
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
+	if (name == NULL) {
+		*new_obj = obj_hdl;
+		return status;
+	}
+
+	return trace_alloc_and_check_handle(exp, sub_new, obj_hdl->fs,
+					    new_obj, status);
+}
+
+static bool trace_check_verifier(struct fsal_obj_handle *obj_hdl,
+				 fsal_verifier_t verifier)
+{
+	struct trace_fsal_export *exp = trace_export();
+	struct fsal_obj_handle *sub_handle = trace_sub(obj_hdl);
+	bool result;
+
+	trace_pass(exp,
+		result = sub_handle->obj_ops.check_verifier(sub_handle,
+							    verifier));
+
+	return result;
+}
+
+static fsal_openflags_t trace_status2(struct fsal_obj_handle *obj_hdl,
+				      struct state_t *state)
+{
+	struct trace_fsal_export *exp = trace_export();
+	struct fsal_obj_handle *sub_handle = trace_sub(obj_hdl);
+	fsal_openflags_t result;
+
+	trace_pass(exp,
+		result = sub_handle->obj_ops.status2(sub_handle, state));
+
+	return result;
+}
+
+static fsal_status_t trace_reopen2(struct fsal_obj_handle *obj_hdl,
+				   struct state_t *state,
+				   fsal_openflags_t openflags)
+{
+	struct trace_fsal_export *exp = trace_export();
+	struct fsal_obj_handle *sub_handle = trace_sub(obj_hdl);
+	fsal_status_t status;
+
+	trace_call(exp, TRACE_REOPEN2,
+		status = sub_handle->obj_ops.reopen2(sub_handle, state,
+						     openflags));
+
+	return status;
+}
+
+static fsal_status_t trace_read2(struct fsal_obj_handle *obj_hdl,
+				 bool bypass,
+				 struct state_t *state,
+				 uint64_t offset,
+				 size_t buffer_size,
+				 void *buffer,
+				 size_t *read_amount,
+				 bool *end_of_file,
+				 struct io_info *info)
+{
+	struct trace_fsal_export *exp = trace_export();
+	struct fsal_obj_handle *sub_handle = trace_sub(obj_hdl);
+	fsal_status_t status;
+
+	trace_io_call(exp, TRACE_READ2, false, buffer_size,
+		status = sub_handle->obj_ops.read2(sub_handle, bypass, state,
+						   offset, buffer_size, buffer,
+						   read_amount, end_of_file,
+						   info));
+
+	return status;
+}
+
+static fsal_status_t trace_write2(struct fsal_obj_handle *obj_hdl,
+				  bool bypass,
+				  struct state_t *state,
+				  uint64_t offset,
+				  size_t buffer_size,
+				  void *buffer,
+				  size_t *wrote_amount,
+				  bool *fsal_stable,
+				  struct io_info *info)
+{
+	struct trace_fsal_export *exp = trace_export();
+	struct fsal_obj_handle *sub_handle = trace_sub(obj_hdl);
+	fsal_status_t status;
+
+	trace_io_call(exp, TRACE_WRITE2, true, buffer_size,
+		status = sub_handle->obj_ops.write2(sub_handle, bypass, state,
+						    offset, buffer_size,
+						    buffer, wrote_amount,
+						    fsal_stable, info));
+
+	return status;
+}
+
+static fsal_status_t trace_seek2(struct fsal_obj_handle *obj_hdl,
+				 struct state_t *state,
+				 struct io_info *info)
+{
+	struct trace_fsal_export *exp = trace_export();
+	struct fsal_obj_handle *sub_handle = trace_sub(obj_hdl);
+	fsal_status_t status;
+
+	trace_call(exp, TRACE_SEEK2,
+		status = sub_handle->obj_ops.seek2(sub_handle, state, info));
+
+	return status;
+}
+
+static fsal_status_t trace_io_advise2(struct fsal_obj_handle *obj_hdl,
+				      struct state_t *state,
+				      struct io_hints *hints)
+{
+	struct trace_fsal_export *exp = trace_export();
+	struct fsal_obj_handle *sub_handle = trace_sub(obj_hdl);
+	fsal_status_t status;
+
+	trace_call(exp, TRACE_IO_ADVISE2,
+		status = sub_handle->obj_ops.io_advise2(sub_handle, state,
+							hints));
+
+	return status;
+}
+
+static fsal_status_t trace_commit2(struct fsal_obj_handle *obj_hdl,
+				   off_t offset, size_t len)
+{
+	struct trace_fsal_export *exp = trace_export();
+	struct fsal_obj_handle *sub_handle = trace_sub(obj_hdl);
+	fsal_status_t status;
+
+	trace_call(exp, TRACE_COMMIT2,
+		status = sub_handle->obj_ops.commit2(sub_handle, offset, len));
+
+	return status;
+}
+
+static fsal_status_t trace_lock_op2(struct fsal_obj_handle *obj_hdl,
+				    struct state_t *state,
+				    void *p_owner,
+				    fsal_lock_op_t lock_op,
+				    fsal_lock_param_t *request_lock,
+				    fsal_lock_param_t *conflicting_lock)
+{
+	struct trace_fsal_export *exp = trace_export();
+	struct fsal_obj_handle *sub_handle = trace_sub(obj_hdl);
+	fsal_status_t status;
+
+	trace_call(exp, TRACE_LOCK_OP2,
+		status = sub_handle->obj_ops.lock_op2(sub_handle, state,
+						      p_owner, lock_op,
+						      request_lock,
+						      conflicting_lock));
+
+	return status;
+}
+
+static fsal_status_t trace_setattr2(struct fsal_obj_handle *obj_hdl,
+				    bool bypass,
+				    struct state_t *state,
+				    struct attrlist *attrib_set)
+{
+	struct trace_fsal_export *exp = trace_export();
+	struct fsal_obj_handle *sub_handle = trace_sub(obj_hdl);
+	fsal_status_t status;
+
+	trace_call(exp, TRACE_SETATTR2,
+		status = sub_handle->obj_ops.setattr2(sub_handle, bypass,
+						      state, attrib_set));
+
+	return status;
+}
+
+static fsal_status_t trace_close2(struct fsal_obj_handle *obj_hdl,
+				  struct state_t *state)
+{
+	struct trace_fsal_export *exp = trace_export();
+	struct fsal_obj_handle *sub_handle = trace_sub(obj_hdl);
+	fsal_status_t status;
+
+	trace_call(exp, TRACE_CLOSE2,
+		status = sub_handle->obj_ops.close2(sub_handle, state));
+
+	return status;
+}
+
+static fsal_status_t trace_read_buffer(struct fsal_obj_handle *obj_hdl,
+				       bool bypass,
+				       struct state_t *state,
+				       uint64_t offset,
+				       size_t buffer_size,
+				       struct fsal_read_buf *rbuf,
+				       bool *end_of_file)
+{
+	struct trace_fsal_export *exp = trace_export();
+	struct fsal_obj_handle *sub_handle = trace_sub(obj_hdl);
+	fsal_status_t status;
+
+	trace_io_call(exp, TRACE_READ_BUFFER, false, buffer_size,
+		status = sub_handle->obj_ops.read_buffer(sub_handle, bypass,
+							 state, offset,
+							 buffer_size, rbuf,
+							 end_of_file));
+
+	return status;
+}
+
+/** Bytes of a vector, for the throughput caps */
+static uint64_t trace_iov_bytes(const struct iovec *iov, int iovcnt)
+{
+	uint64_t bytes = 0;
+	int i;
+
+	for (i = 0; i < iovcnt; i++)
+		bytes += iov[i].iov_len;
+
+	return bytes;
+}
+
+static fsal_status_t trace_read_vec(struct fsal_obj_handle *obj_hdl,
+				    bool bypass, struct state_t *state,
+				    uint64_t offset,
+				    const struct iovec *iov, int iovcnt,
+				    size_t *read_amount, bool *end_of_file)
+{
+	struct trace_fsal_export *exp = trace_export();
+	struct fsal_obj_handle *sub_handle = trace_sub(obj_hdl);
+	fsal_status_t status;
+
+	trace_io_call(exp, TRACE_READ_VEC, false,
+		      trace_iov_bytes(iov, iovcnt),
+		status = sub_handle->obj_ops.read_vec(sub_handle, bypass,
+						      state, offset, iov,
+						      iovcnt, read_amount,
+						      end_of_file));
+
+	return status;
+}
+
+static fsal_status_t trace_write_vec(struct fsal_obj_handle *obj_hdl,
+				     bool bypass, struct state_t *state,
+				     uint64_t offset,
+				     const struct iovec *iov, int iovcnt,
+				     size_t *wrote_amount, bool *fsal_stable)
+{
+	struct trace_fsal_export *exp = trace_export();
+	struct fsal_obj_handle *sub_handle = trace_sub(obj_hdl);
+	fsal_status_t status;
+
+	trace_io_call(exp, TRACE_WRITE_VEC, true,
+		      trace_iov_bytes(iov, iovcnt),
+		status = sub_handle->obj_ops.write_vec(sub_handle, bypass,
+						       state, offset, iov,
+						       iovcnt, wrote_amount,
+						       fsal_stable));
+
+	return status;
+}
+
+/**
+ * @brief Complete an asynchronous read or write made by the sub-FSAL
+ *
+ * The time recorded runs from the submission to this completion, which
+ * may be on a thread of the sub-FSAL.
+ */
+static void trace_io_done(struct fsal_obj_handle *sub_hdl,
+			  fsal_status_t status, struct fsal_io_arg *io_arg,
+			  void *caller_arg)
+{
+	struct trace_async_arg *arg = caller_arg;
+	struct fsal_obj_handle *obj_hdl = &arg->hdl->obj_handle;
+	fsal_async_cb done_cb = arg->done_cb;
+	void *done_arg = arg->caller_arg;
+
+	trace_done(arg->exp, arg->op, &arg->start);
+	arg->ctx->fsal_export = &arg->exp->export;
+	gsh_free(arg);
+
+	done_cb(obj_hdl, status, io_arg, done_arg);
+}
+
+static struct trace_async_arg *trace_async_arg_new(
+					struct fsal_obj_handle *obj_hdl,
+					enum trace_op op,
+					fsal_async_cb done_cb,
+					void *caller_arg)
+{
+	struct trace_async_arg *arg = gsh_malloc(sizeof(*arg));
+
+	arg->hdl = container_of(obj_hdl, struct trace_fsal_obj_handle,
+				obj_handle);
+	arg->exp = trace_export();
+	arg->ctx = op_ctx;
+	arg->op = op;
+	arg->done_cb = done_cb;
+	arg->caller_arg = caller_arg;
+	trace_start(arg->exp, &arg->start);
+
+	return arg;
+}
+
+static void trace_read2_async(struct fsal_obj_handle *obj_hdl,
+			      bool bypass,
+			      struct fsal_io_arg *read_arg,
+			      fsal_async_cb done_cb,
+			      void *caller_arg)
+{
+	struct trace_fsal_export *exp = trace_export();
+	struct fsal_obj_handle *sub_handle = trace_sub(obj_hdl);
+	struct trace_async_arg *arg;
+
+	arg = trace_async_arg_new(obj_hdl, TRACE_READ2_ASYNC, done_cb,
+				  caller_arg);
+	trace_inject(exp, TRACE_READ2_ASYNC, false, read_arg->size);
+
+	trace_pass(exp,
+		sub_handle->obj_ops.read2_async(sub_handle, bypass, read_arg,
+						trace_io_done, arg));
+}
+
+static void trace_write2_async(struct fsal_obj_handle *obj_hdl,
+			       bool bypass,
+			       struct fsal_io_arg *write_arg,
+			       fsal_async_cb done_cb,
+			       void *caller_arg)
+{
+	struct trace_fsal_export *exp = trace_export();
+	struct fsal_obj_handle *sub_handle = trace_sub(obj_hdl);
+	struct trace_async_arg *arg;
+
+	arg = trace_async_arg_new(obj_hdl, TRACE_WRITE2_ASYNC, done_cb,
+				  caller_arg);
+	trace_inject(exp, TRACE_WRITE2_ASYNC, true, write_arg->size);
+
+	trace_pass(exp,
+		sub_handle->obj_ops.write2_async(sub_handle, bypass,
+						 write_arg, trace_io_done,
+						 arg));
+}
+
+static fsal_status_t trace_copy(struct fsal_obj_handle *src_hdl,
+				struct state_t *src_state,
+				uint64_t src_offset,
+				struct fsal_obj_handle *dst_hdl,
+				struct state_t *dst_state,
+				uint64_t dst_offset,
+				uint64_t count,
+				uint64_t *copied)
+{
+	struct trace_fsal_export *exp = trace_export();
+	struct fsal_obj_handle *sub_src = trace_sub(src_hdl);
+	fsal_status_t status;
+
+	trace_call(exp, TRACE_COPY,
+		status = sub_src->obj_ops.copy(sub_src, src_state, src_offset,
+					       trace_sub(dst_hdl), dst_state,
+					       dst_offset, count, copied));
+
+	return status;
+}
+
+static fsal_status_t trace_clone(struct fsal_obj_handle *src_hdl,
+				 struct state_t *src_state,
+				 uint64_t src_offset,
+				 struct fsal_obj_handle *dst_hdl,
+				 struct state_t *dst_state,
+				 uint64_t dst_offset,
+				 uint64_t count)
+{
+	struct trace_fsal_export *exp = trace_export();
+	struct fsal_obj_handle *sub_src = trace_sub(src_hdl);
+	fsal_status_t status;
+
+	trace_call(exp, TRACE_CLONE,
+		status = sub_src->obj_ops.clone(sub_src, src_state, src_offset,
+						trace_sub(dst_hdl), dst_state,
+						dst_offset, count));
+
+	return status;
+}
+
+static fsal_status_t trace_fallocate(struct fsal_obj_handle *obj_hdl,
+				     struct state_t *state,
+				     uint64_t offset,
+				     uint64_t length,
+				     bool allocate)
+{
+	struct trace_fsal_export *exp = trace_export();
+	struct fsal_obj_handle *sub_handle = trace_sub(obj_hdl);
+	fsal_status_t status;
+
+	trace_call(exp, TRACE_FALLOCATE,
+		status = sub_handle->obj_ops.fallocate(sub_handle, state,
+						       offset, length,
+						       allocate));
+
+	return status;
+}
+
+void trace_file_ops_init(struct fsal_obj_ops *ops)
+{
+	ops->open = trace_open;
+	ops->reopen = trace_reopen;
+	ops->status = trace_status;
+	ops->read = trace_read;
+	ops->read_plus = trace_read_plus;
+	ops->write = trace_write;
+	ops->write_plus = trace_write_plus;
+	ops->seek = trace_seek;
+	ops->io_advise = trace_io_advise;
+	ops->commit = trace_commit;
+	ops->lock_op = trace_lock_op;
+	ops->share_op = trace_share_op;
+	ops->close = trace_close;
+	ops->open2 = trace_open2;
+	ops->check_verifier = trace_check_verifier;
+	ops->status2 = trace_status2;
+	ops->reopen2 = trace_reopen2;
+	ops->read2 = trace_read2;
+	ops->write2 = trace_write2;
+	ops->seek2 = trace_seek2;
+	ops->io_advise2 = trace_io_advise2;
+	ops->commit2 = trace_commit2;
+	ops->lock_op2 = trace_lock_op2;
+	ops->setattr2 = trace_setattr2;
+	ops->close2 = trace_close2;
+	ops->read_buffer = trace_read_buffer;
+	ops->read_vec = trace_read_vec;
+	ops->write_vec = trace_write_vec;
+	ops->read2_async = trace_read2_async;
+	ops->write2_async = trace_write2_async;
+	ops->copy = trace_copy;
+	ops->clone = trace_clone;
+	ops->fallocate = trace_fallocate;
+}
@@ -0,0 +1,475 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/* handle.c
+ * TRACE FSAL namespace and attribute methods
+ */
+
+#include "config.h"
+
+#include "fsal.h"
+#include <pthread.h>
+#include <string.h>
+#include <sys/types.h>
+#include "gsh_list.h"
+#include "FSAL/fsal_commonlib.h"
+#include "trace_methods.h"
+
+/**
+ * @brief Wrap the sub-FSAL's handle of a call that made one
+ *
+ * @param[in]  exp            The trace export
+ * @param[in]  sub_handle     The handle made by the sub-FSAL
+ * @param[in]  fs             The filesystem of the new handle
+ * @param[out] new_handle     The trace handle
+ * @param[in]  subfsal_status Result of the sub-FSAL call
+ *
+ * @return subfsal_status.
+ */
+fsal_status_t trace_alloc_and_check_handle(struct trace_fsal_export *exp,
+					   struct fsal_obj_handle *sub_handle,
+					   struct fsal_filesystem *fs,
+					   struct fsal_obj_handle **new_handle,
+					   fsal_status_t subfsal_status)
+{
+	struct trace_fsal_obj_handle *result;
+
+	if (FSAL_IS_ERROR(subfsal_status))
+		return subfsal_status;
+
+	result = gsh_calloc(1, sizeof(struct trace_fsal_obj_handle));
+
+	fsal_obj_handle_init(&result->obj_handle, &exp->export,
+			     sub_handle->type);
+	trace_handle_ops_init(&result->obj_handle.obj_ops);
+	result->sub_handle = sub_handle;
+	result->obj_handle.fsid = sub_handle->fsid;
+	result->obj_handle.fileid = sub_handle->fileid;
+	result->obj_handle.fs = fs;
+
+	*new_handle = &result->obj_handle;
+
+	return subfsal_status;
+}
+
+static fsal_status_t lookup(struct fsal_obj_handle *parent,
+			    const char *path, struct fsal_obj_handle **handle,
+			    struct attrlist *attrs_out)
+{
+	struct trace_fsal_export *exp = trace_export();
+	struct fsal_obj_handle *sub_parent = trace_sub(parent);
+	struct fsal_obj_handle *sub_handle = NULL;
+	fsal_status_t status;
+
+	*handle = NULL;
+
+	trace_call(exp, TRACE_LOOKUP,
+		status = sub_parent->obj_ops.lookup(sub_parent, path,
+						    &sub_handle, attrs_out));
+
+	return trace_alloc_and_check_handle(exp, sub_handle, parent->fs,
+					    handle, status);
+}
+
+static fsal_status_t create(struct fsal_obj_handle *dir_hdl,
+			    const char *name, struct attrlist *attrs_in,
+			    struct fsal_obj_handle **new_obj,
+			    struct attrlist *attrs_out)
+{
+	struct trace_fsal_export *exp = trace_export();
+	struct fsal_obj_handle *sub_dir = trace_sub(dir_hdl);
+	struct fsal_obj_handle *sub_handle = NULL;
+	fsal_status_t status;
+
+	*new_obj = NULL;
+
+	trace_call(exp, TRACE_CREATE,
+		status = sub_dir->obj_ops.create(sub_dir, name, attrs_in,
+						 &sub_handle, attrs_out));
+
+	return trace_alloc_and_check_handle(exp, sub_handle, dir_hdl->fs,
+					    new_obj, status);
+}
+
+static fsal_status_t makedir(struct fsal_obj_handle *dir_hdl,
+			     const char *name, struct attrlist *attrs_in,
+			     struct fsal_obj_handle **new_obj,
+			     struct attrlist *attrs_out)
+{
+	struct trace_fsal_export *exp = trace_export();
+	struct fsal_obj_handle *sub_dir = trace_sub(dir_hdl);
+	struct fsal_obj_handle *sub_handle = NULL;
+	fsal_status_t status;
+
+	*new_obj = NULL;
+
+	trace_call(exp, TRACE_MKDIR,
+		status = sub_dir->obj_ops.mkdir(sub_dir, name, attrs_in,
+						&sub_handle, attrs_out));
+
+	return trace_alloc_and_check_handle(exp, sub_handle, dir_hdl->fs,
+					    new_obj, status);
+}
+
+static fsal_status_t makenode(struct fsal_obj_handle *dir_hdl,
+			      const char *name,
+			      object_file_type_t nodetype,
+			      fsal_dev_t *dev,
+			      struct attrlist *attrs_in,
+			      struct fsal_obj_handle **new_obj,
+			      struct attrlist *attrs_out)
+{
+	struct trace_fsal_export *exp = trace_export();
+	struct fsal_obj_handle *sub_dir = trace_sub(dir_hdl);
+	struct fsal_obj_handle *sub_handle = NULL;
+	fsal_status_t status;
+
+	*new_obj = NULL;
+
+	trace_call(exp, TRACE_MKNODE,
+		status = sub_dir->obj_ops.mknode(sub_dir, name, nodetype, dev,
+						 attrs_in, &sub_handle,
+						 attrs_out));
+
+	return trace_alloc_and_check_handle(exp, sub_handle, dir_hdl->fs,
+					    new_obj, status);
+}
+
+static fsal_status_t makesymlink(struct fsal_obj_handle *dir_hdl,
+				 const char *name,
+				 const char *link_path,
+				 struct attrlist *attrs_in,
+				 struct fsal_obj_handle **new_obj,
+				 struct attrlist *attrs_out)
+{
+	struct trace_fsal_export *exp = trace_export();
+	struct fsal_obj_handle *sub_dir = trace_sub(dir_hdl);
+	struct fsal_obj_handle *sub_handle = NULL;
+	fsal_status_t status;
+
+	*new_obj = NULL;
+
+	trace_call(exp, TRACE_SYMLINK,
+		status = sub_dir->obj_ops.symlink(sub_dir, name, link_path,
+						  attrs_in, &sub_handle,
+						  attrs_out));
+
+	return trace_alloc_and_check_handle(exp, sub_handle, dir_hdl->fs,
+					    new_obj, status);
+}
+
+static fsal_status_t readsymlink(struct fsal_obj_handle *obj_hdl,
+				 struct gsh_buffdesc *link_content,
+				 bool refresh)
+{
+	struct trace_fsal_export *exp = trace_export();
+	struct fsal_obj_handle *sub_handle = trace_sub(obj_hdl);
+	fsal_status_t status;
+
+	trace_call(exp, TRACE_READLINK,
+		status = sub_handle->obj_ops.readlink(sub_handle, link_content,
+						      refresh));
+
+	return status;
+}
+
+static fsal_status_t test_access(struct fsal_obj_handle *obj_hdl,
+				 fsal_accessflags_t access_type,
+				 fsal_accessflags_t *allowed,
+				 fsal_accessflags_t *denied,
+				 bool owner_skip)
+{
+	struct trace_fsal_export *exp = trace_export();
+	struct fsal_obj_handle *sub_handle = trace_sub(obj_hdl);
+	fsal_status_t status;
+
+	trace_call(exp, TRACE_TEST_ACCESS,
+		status = sub_handle->obj_ops.test_access(sub_handle,
+							 access_type, allowed,
+							 denied, owner_skip));
+
+	return status;
+}
+
+static fsal_status_t linkfile(struct fsal_obj_handle *obj_hdl,
+			      struct fsal_obj_handle *destdir_hdl,
+			      const char *name)
+{
+	struct trace_fsal_export *exp = trace_export();
+	struct fsal_obj_handle *sub_handle = trace_sub(obj_hdl);
+	fsal_status_t status;
+
+	trace_call(exp, TRACE_LINK,
+		status = sub_handle->obj_ops.link(sub_handle,
+						  trace_sub(destdir_hdl),
+						  name));
+
+	return status;
+}
+
+static fsal_status_t fs_locations(struct fsal_obj_handle *obj_hdl,
+				  struct fs_locations4 *fs_locs)
+{
+	struct trace_fsal_export *exp = trace_export();
+	struct fsal_obj_handle *sub_handle = trace_sub(obj_hdl);
+	fsal_status_t status;
+
+	trace_call(exp, TRACE_FS_LOCATIONS,
+		status = sub_handle->obj_ops.fs_locations(sub_handle,
+							  fs_locs));
+
+	return status;
+}
+
+/**
+ * Callback function for read_dirents.
+ *
+ * Wraps the entry's handle and restores the context for the upper
+ * layer.
+ */
+static bool trace_readdir_cb(const char *name, struct fsal_obj_handle *obj,
+			     struct attrlist *attrs,
+			     void *dir_state, fsal_cookie_t cookie)
+{
+	struct trace_readdir_state *state = dir_state;
+	struct fsal_obj_handle *hdl = NULL;
+	bool result;
+
+	(void) trace_alloc_and_check_handle(state->exp, obj, obj->fs, &hdl,
+					    fsalstat(ERR_FSAL_NO_ERROR, 0));
+
+	op_ctx->fsal_export = &state->exp->export;
+	result = state->cb(name, hdl, attrs, state->dir_state, cookie);
+	op_ctx->fsal_export = state->exp->export.sub_export;
+
+	return result;
+}
+
+/**
+ * read_dirents
+ *
+ * The time of the upper layer's callbacks is in the time of the call.
+ */
+static fsal_status_t read_dirents(struct fsal_obj_handle *dir_hdl,
+				  fsal_cookie_t *whence, void *dir_state,
+				  fsal_readdir_cb cb, attrmask_t attrmask,
+				  bool *eof)
+{
+	struct trace_fsal_export *exp = trace_export();
+	struct fsal_obj_handle *sub_dir = trace_sub(dir_hdl);
+	struct trace_readdir_state cb_state = {
+		.cb = cb,
+		.dir_state = dir_state,
+		.exp = exp
+	};
+	fsal_status_t status;
+
+	trace_call(exp, TRACE_READDIR,
+		status = sub_dir->obj_ops.readdir(sub_dir, whence, &cb_state,
+						  trace_readdir_cb, attrmask,
+						  eof));
+
+	return status;
+}
+
+static fsal_status_t renamefile(struct fsal_obj_handle *obj_hdl,
+				struct fsal_obj_handle *olddir_hdl,
+				const char *old_name,
+				struct fsal_obj_handle *newdir_hdl,
+				const char *new_name)
+{
+	struct trace_fsal_export *exp = trace_export();
+	struct fsal_obj_handle *sub_olddir = trace_sub(olddir_hdl);
+	fsal_status_t status;
+
+	trace_call(exp, TRACE_RENAME,
+		status = sub_olddir->obj_ops.rename(trace_sub(obj_hdl),
+						    sub_olddir, old_name,
+						    trace_sub(newdir_hdl),
+						    new_name));
+
+	return status;
+}
+
+static fsal_status_t getattrs(struct fsal_obj_handle *obj_hdl,
+			      struct attrlist *attrib_get)
+{
+	struct trace_fsal_export *exp = trace_export();
+	struct fsal_obj_handle *sub_handle = trace_sub(obj_hdl);
+	fsal_status_t status;
+
+	trace_call(exp, TRACE_GETATTRS,
+		status = sub_handle->obj_ops.getattrs(sub_handle, attrib_get));
+
+	return status;
+}
+
+static fsal_status_t setattrs(struct fsal_obj_handle *obj_hdl,
+			      struct attrlist *attrs)
+{
+	struct trace_fsal_export *exp = trace_export();
+	struct fsal_obj_handle *sub_handle = trace_sub(obj_hdl);
+	fsal_status_t status;
+
+	trace_call(exp, TRACE_SETATTRS,
+		status = sub_handle->obj_ops.setattrs(sub_handle, attrs));
+
+	return status;
+}
+
+static fsal_status_t file_unlink(struct fsal_obj_handle *dir_hdl,
+				 struct fsal_obj_handle *obj_hdl,
+				 const char *name)
+{
+	struct trace_fsal_export *exp = trace_export();
+	struct fsal_obj_handle *sub_dir = trace_sub(dir_hdl);
+	fsal_status_t status;
+
+	trace_call(exp, TRACE_UNLINK,
+		status = sub_dir->obj_ops.unlink(sub_dir, trace_sub(obj_hdl),
+						 name));
+
+	return status;
+}
+
+static fsal_status_t merge(struct fsal_obj_handle *orig_hdl,
+			   struct fsal_obj_handle *dupe_hdl)
+{
+	struct trace_fsal_export *exp = trace_export();
+	struct fsal_obj_handle *sub_orig = trace_sub(orig_hdl);
+	fsal_status_t status;
+
+	trace_pass(exp,
+		status = sub_orig->obj_ops.merge(sub_orig,
+						 trace_sub(dupe_hdl)));
+
+	return status;
+}
+
+static fsal_status_t handle_digest(const struct fsal_obj_handle *obj_hdl,
+				   fsal_digesttype_t output_type,
+				   struct gsh_buffdesc *fh_desc)
+{
+	struct trace_fsal_export *exp = trace_export();
+	struct trace_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct trace_fsal_obj_handle,
+			     obj_handle);
+	fsal_status_t status;
+
+	trace_pass(exp,
+		status = handle->sub_handle->obj_ops.handle_digest(
+			handle->sub_handle, output_type, fh_desc));
+
+	return status;
+}
+
+static void handle_to_key(struct fsal_obj_handle *obj_hdl,
+			  struct gsh_buffdesc *fh_desc)
+{
+	struct trace_fsal_export *exp = trace_export();
+	struct fsal_obj_handle *sub_handle = trace_sub(obj_hdl);
+
+	trace_pass(exp,
+		sub_handle->obj_ops.handle_to_key(sub_handle, fh_desc));
+}
+
+static void release(struct fsal_obj_handle *obj_hdl)
+{
+	struct trace_fsal_obj_handle *hdl =
+		container_of(obj_hdl, struct trace_fsal_obj_handle,
+			     obj_handle);
+	struct trace_fsal_export *exp = trace_export();
+
+	trace_pass(exp,
+		hdl->sub_handle->obj_ops.release(hdl->sub_handle));
+
+	fsal_obj_handle_fini(&hdl->obj_handle);
+	gsh_free(hdl);
+}
+
+void trace_handle_ops_init(struct fsal_obj_ops *ops)
+{
+	ops->release = release;
+	ops->merge = merge;
+	ops->lookup = lookup;
+	ops->readdir = read_dirents;
+	ops->create = create;
+	ops->mkdir = makedir;
+	ops->mknode = makenode;
+	ops->symlink = makesymlink;
+	ops->readlink = readsymlink;
+	ops->test_access = test_access;
+	ops->getattrs = getattrs;
+	ops->setattrs = setattrs;
+	ops->link = linkfile;
+	ops->fs_locations = fs_locations;
+	ops->rename = renamefile;
+	ops->unlink = file_unlink;
+	ops->handle_digest = handle_digest;
+	ops->handle_to_key = handle_to_key;
+
+	trace_file_ops_init(ops);
+	trace_xattr_ops_init(ops);
+}
+
+/* export methods that create object handles
+ */
+
+fsal_status_t trace_lookup_path(struct fsal_export *exp_hdl,
+				const char *path,
+				struct fsal_obj_handle **handle,
+				struct attrlist *attrs_out)
+{
+	struct trace_fsal_export *exp =
+		container_of(exp_hdl, struct trace_fsal_export, export);
+	struct fsal_obj_handle *sub_handle = NULL;
+	fsal_status_t status;
+
+	*handle = NULL;
+
+	trace_call(exp, TRACE_LOOKUP_PATH,
+		status = exp->export.sub_export->exp_ops.lookup_path(
+			exp->export.sub_export, path, &sub_handle, attrs_out));
+
+	return trace_alloc_and_check_handle(exp, sub_handle, NULL, handle,
+					    status);
+}
+
+fsal_status_t trace_create_handle(struct fsal_export *exp_hdl,
+				  struct gsh_buffdesc *hdl_desc,
+				  struct fsal_obj_handle **handle,
+				  struct attrlist *attrs_out)
+{
+	struct trace_fsal_export *exp =
+		container_of(exp_hdl, struct trace_fsal_export, export);
+	struct fsal_obj_handle *sub_handle = NULL;
+	fsal_status_t status;
+
+	*handle = NULL;
+
+	trace_call(exp, TRACE_CREATE_HANDLE,
+		status = exp->export.sub_export->exp_ops.create_handle(
+			exp->export.sub_export, hdl_desc, &sub_handle,
+			attrs_out));
+
+	return trace_alloc_and_check_handle(exp, sub_handle, NULL, handle,
+					    status);
+}
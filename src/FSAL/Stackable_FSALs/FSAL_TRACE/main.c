@@ -0,0 +1,388 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/* main.c
+ * Module core functions, timing and reports
+ */
+
+#include "config.h"
+
+#include "fsal.h"
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include "gsh_list.h"
+#include "fridgethr.h"
+#include "FSAL/fsal_init.h"
+#include "trace_methods.h"
+
+/* FSAL name determines name of shared library: libfsal<name>.so */
+const char myname[] = "TRACE";
+
+const char *trace_op_names[TRACE_OP_COUNT] = {
+	[TRACE_LOOKUP_PATH] = "lookup_path",
+	[TRACE_CREATE_HANDLE] = "create_handle",
+	[TRACE_DYNAMIC_INFO] = "get_fs_dynamic_info",
+	[TRACE_CHECK_QUOTA] = "check_quota",
+	[TRACE_GET_QUOTA] = "get_quota",
+	[TRACE_SET_QUOTA] = "set_quota",
+	[TRACE_LOOKUP] = "lookup",
+	[TRACE_READDIR] = "readdir",
+	[TRACE_CREATE] = "create",
+	[TRACE_MKDIR] = "mkdir",
+	[TRACE_MKNODE] = "mknode",
+	[TRACE_SYMLINK] = "symlink",
+	[TRACE_READLINK] = "readlink",
+	[TRACE_TEST_ACCESS] = "test_access",
+	[TRACE_GETATTRS] = "getattrs",
+	[TRACE_SETATTRS] = "setattrs",
+	[TRACE_LINK] = "link",
+	[TRACE_FS_LOCATIONS] = "fs_locations",
+	[TRACE_RENAME] = "rename",
+	[TRACE_UNLINK] = "unlink",
+	[TRACE_OPEN] = "open",
+	[TRACE_REOPEN] = "reopen",
+	[TRACE_READ] = "read",
+	[TRACE_READ_PLUS] = "read_plus",
+	[TRACE_WRITE] = "write",
+	[TRACE_WRITE_PLUS] = "write_plus",
+	[TRACE_SEEK] = "seek",
+	[TRACE_IO_ADVISE] = "io_advise",
+	[TRACE_COMMIT] = "commit",
+	[TRACE_LOCK_OP] = "lock_op",
+	[TRACE_SHARE_OP] = "share_op",
+	[TRACE_CLOSE] = "close",
+	[TRACE_OPEN2] = "open2",
+	[TRACE_REOPEN2] = "reopen2",
+	[TRACE_READ2] = "read2",
+	[TRACE_WRITE2] = "write2",
+	[TRACE_SEEK2] = "seek2",
+	[TRACE_IO_ADVISE2] = "io_advise2",
+	[TRACE_COMMIT2] = "commit2",
+	[TRACE_LOCK_OP2] = "lock_op2",
+	[TRACE_SETATTR2] = "setattr2",
+	[TRACE_CLOSE2] = "close2",
+	[TRACE_READ_BUFFER] = "read_buffer",
+	[TRACE_READ_VEC] = "read_vec",
+	[TRACE_WRITE_VEC] = "write_vec",
+	[TRACE_READ2_ASYNC] = "read2_async",
+	[TRACE_WRITE2_ASYNC] = "write2_async",
+	[TRACE_COPY] = "copy",
+	[TRACE_CLONE] = "clone",
+	[TRACE_FALLOCATE] = "fallocate",
+	[TRACE_LIST_EXT_ATTRS] = "list_ext_attrs",
+	[TRACE_GETEXTATTR_ID_BY_NAME] = "getextattr_id_by_name",
+	[TRACE_GETEXTATTR_VALUE_BY_NAME] = "getextattr_value_by_name",
+	[TRACE_GETEXTATTR_VALUE_BY_ID] = "getextattr_value_by_id",
+	[TRACE_SETEXTATTR_VALUE] = "setextattr_value",
+	[TRACE_SETEXTATTR_VALUE_BY_ID] = "setextattr_value_by_id",
+	[TRACE_REMOVE_EXTATTR_BY_ID] = "remove_extattr_by_id",
+	[TRACE_REMOVE_EXTATTR_BY_NAME] = "remove_extattr_by_name",
+	[TRACE_GETXATTRS] = "getxattrs",
+	[TRACE_SETXATTRS] = "setxattrs",
+	[TRACE_REMOVEXATTRS] = "removexattrs",
+	[TRACE_LISTXATTRS] = "listxattrs",
+};
+
+#ifdef _ERROR_INJECTION
+/** Latency injected into the calls, shared by the exports asking */
+static struct err_inject_delay trace_delays[TRACE_OP_COUNT];
+
+struct err_inject_points trace_points = {
+	.name = "TRACE",
+	.op_names = trace_op_names,
+	.delays = trace_delays,
+	.count = TRACE_OP_COUNT,
+};
+#endif
+
+/** Calls made by this thread, for sampling */
+static __thread uint32_t trace_tick;
+
+/** Exports to report on, and the thread reporting */
+static struct glist_head trace_exports = GLIST_HEAD_INIT(trace_exports);
+static pthread_mutex_t trace_exports_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct fridgethr *trace_fridge;
+
+/**
+ * @brief Start timing a call
+ *
+ * With a Sample_Rate of N, only one call in N made by a thread is
+ * timed, which keeps the clock reads off the others.
+ *
+ * @param[in]  exp   Export the call is made on
+ * @param[out] start Start of the call, tv_sec 0 if it is not timed
+ */
+void trace_start(struct trace_fsal_export *exp, struct timespec *start)
+{
+	if (exp->sample_rate > 1 && ++trace_tick % exp->sample_rate != 0) {
+		start->tv_sec = 0;
+		return;
+	}
+
+	now(start);
+}
+
+/**
+ * @brief Record a call timed by trace_start
+ *
+ * @param[in] exp   Export the call was made on
+ * @param[in] op    The call
+ * @param[in] start From trace_start
+ */
+void trace_done(struct trace_fsal_export *exp, enum trace_op op,
+		struct timespec *start)
+{
+	struct timespec end;
+	nsecs_elapsed_t ns;
+
+	if (start->tv_sec == 0)
+		return;
+
+	now(&end);
+	ns = timespec_diff(start, &end);
+	gsh_hist_record(&exp->stats[op], ns);
+
+	if (exp->slow_ns == 0 || ns < exp->slow_ns)
+		return;
+
+	(void) atomic_inc_uint64_t(&exp->slow[op]);
+	LogEvent(COMPONENT_FSAL, "Slow %s on %s: %" PRIu64 " us",
+		 trace_op_names[op], exp->path, ns / NS_PER_USEC);
+}
+
+/**
+ * @brief Log the latencies of an export
+ *
+ * One line for each call seen since the export was created, with the
+ * percentiles and maximum as the floors of their histogram buckets.
+ *
+ * @param[in] exp The export
+ */
+void trace_report(struct trace_fsal_export *exp)
+{
+	uint64_t buckets[GSH_HIST_BUCKETS];
+	uint64_t total, seen, sum, p50, p99, max;
+	uint32_t ix;
+	int op;
+
+	for (op = 0; op < TRACE_OP_COUNT; op++) {
+		struct gsh_histogram *h = &exp->stats[op];
+
+		if (atomic_fetch_uint64_t(&h->count) == 0)
+			continue;
+
+		total = 0;
+		for (ix = 0; ix < GSH_HIST_BUCKETS; ix++) {
+			buckets[ix] = atomic_fetch_uint64_t(&h->buckets[ix]);
+			total += buckets[ix];
+		}
+		sum = atomic_fetch_uint64_t(&h->sum);
+
+		seen = 0;
+		p50 = p99 = max = 0;
+		for (ix = 0; ix < GSH_HIST_BUCKETS; ix++) {
+			if (buckets[ix] == 0)
+				continue;
+			if (seen < (total + 1) / 2 &&
+			    seen + buckets[ix] >= (total + 1) / 2)
+				p50 = gsh_hist_bucket_floor(ix);
+			if (seen < total - total / 100 &&
+			    seen + buckets[ix] >= total - total / 100)
+				p99 = gsh_hist_bucket_floor(ix);
+			seen += buckets[ix];
+			max = gsh_hist_bucket_floor(ix);
+		}
+
+		LogEvent(COMPONENT_FSAL,
+			 "%s %s: count %" PRIu64 " mean %" PRIu64 " p50 %"
+			 PRIu64 " p99 %" PRIu64 " max %" PRIu64
+			 " us, %" PRIu64 " slow",
+			 exp->path, trace_op_names[op], total,
+			 sum / total / NS_PER_USEC, p50 / NS_PER_USEC,
+			 p99 / NS_PER_USEC, max / NS_PER_USEC,
+			 atomic_fetch_uint64_t(&exp->slow[op]));
+	}
+}
+
+/**
+ * @brief Report the exports whose Report_Interval has passed
+ */
+static void trace_report_run(struct fridgethr_context *ctx)
+{
+	struct glist_head *glist;
+	struct trace_fsal_export *exp;
+	time_t t = time(NULL);
+
+	SetNameFunction("fsal_trace");
+
+	PTHREAD_MUTEX_lock(&trace_exports_mutex);
+
+	glist_for_each(glist, &trace_exports) {
+		exp = glist_entry(glist, struct trace_fsal_export, exports);
+		if (exp->report_interval == 0 ||
+		    t - exp->last_report < exp->report_interval)
+			continue;
+		exp->last_report = t;
+		trace_report(exp);
+	}
+
+	PTHREAD_MUTEX_unlock(&trace_exports_mutex);
+}
+
+/**
+ * @brief Start the report thread
+ *
+ * Called with trace_exports_mutex held.
+ */
+static void trace_report_start(void)
+{
+	struct fridgethr_params frp;
+	int rc;
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = 1;
+	frp.thr_min = 1;
+	frp.thread_delay = 1;
+	frp.flavor = fridgethr_flavor_looper;
+
+	rc = fridgethr_init(&trace_fridge, "fsal_trace", &frp);
+	if (rc != 0) {
+		LogMajor(COMPONENT_FSAL,
+			 "Unable to initialize TRACE report fridge, error code %d.",
+			 rc);
+		trace_fridge = NULL;
+		return;
+	}
+
+	rc = fridgethr_submit(trace_fridge, trace_report_run, NULL);
+	if (rc != 0) {
+		LogMajor(COMPONENT_FSAL,
+			 "Unable to start TRACE report thread, error code %d.",
+			 rc);
+		fridgethr_destroy(trace_fridge);
+		trace_fridge = NULL;
+	}
+}
+
+/**
+ * @brief Put an export on the report list
+ *
+ * The report thread is started with the first export that asks for
+ * periodic reports.
+ *
+ * @param[in] exp The export
+ */
+void trace_register_export(struct trace_fsal_export *exp)
+{
+	exp->last_report = time(NULL);
+
+	PTHREAD_MUTEX_lock(&trace_exports_mutex);
+
+	glist_add_tail(&trace_exports, &exp->exports);
+
+	if (exp->report_interval != 0 && trace_fridge == NULL)
+		trace_report_start();
+
+	PTHREAD_MUTEX_unlock(&trace_exports_mutex);
+}
+
+/**
+ * @brief Take an export off the report list, reporting it a last time
+ *
+ * @param[in] exp The export
+ */
+void trace_unregister_export(struct trace_fsal_export *exp)
+{
+	PTHREAD_MUTEX_lock(&trace_exports_mutex);
+
+	glist_del(&exp->exports);
+
+	PTHREAD_MUTEX_unlock(&trace_exports_mutex);
+
+	trace_report(exp);
+}
+
+/* Module methods
+ */
+
+/**
+ * @brief Whether the handle's FSAL supports the extended API
+ *
+ * The sub-FSAL's answer, as for MDCACHE.
+ */
+static bool trace_support_ex(struct fsal_obj_handle *obj_hdl)
+{
+	struct fsal_obj_handle *sub_handle = trace_sub(obj_hdl);
+
+	return sub_handle->fsal->m_ops.support_ex(sub_handle);
+}
+
+/* Module initialization.
+ * Called by dlopen() to register the module
+ * keep a private pointer to me in myself
+ */
+
+/* my module private storage
+ */
+
+static struct fsal_module TRACE;
+
+MODULE_INIT void trace_init(void)
+{
+	int retval;
+	struct fsal_module *myself = &TRACE;
+
+	retval = register_fsal(myself, myname, FSAL_MAJOR_VERSION,
+			       FSAL_MINOR_VERSION, FSAL_ID_NO_PNFS);
+	if (retval != 0) {
+		fprintf(stderr, "TRACE module failed to register");
+		return;
+	}
+	myself->m_ops.create_export = trace_create_export;
+	myself->m_ops.support_ex = trace_support_ex;
+#ifdef _ERROR_INJECTION
+	err_inject_register(&trace_points);
+#endif
+}
+
+MODULE_FINI void trace_unload(void)
+{
+	int retval;
+
+	if (trace_fridge != NULL) {
+		retval = fridgethr_sync_command(trace_fridge,
+						fridgethr_comm_stop, 120);
+		if (retval == ETIMEDOUT)
+			fridgethr_cancel(trace_fridge);
+		fridgethr_destroy(trace_fridge);
+		trace_fridge = NULL;
+	}
+
+#ifdef _ERROR_INJECTION
+	err_inject_unregister(&trace_points);
+#endif
+
+	retval = unregister_fsal(&TRACE);
+	if (retval != 0) {
+		fprintf(stderr, "TRACE module failed to unregister");
+		return;
+	}
+}
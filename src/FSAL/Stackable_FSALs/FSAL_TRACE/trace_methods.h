@@ -0,0 +1,268 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/**
+ * @file trace_methods.h
+ * @brief TRACE FSAL internals
+ *
+ * FSAL_TRACE stacks over another FSAL as FSAL_NULL does, and times each
+ * call it passes down.  The latencies go into one histogram per
+ * operation and per export, and are reported to the log.
+ *
+ * Built with error injection, the calls of the exports asking for it
+ * are also the latency injection points of the "TRACE" layer, one per
+ * operation, named as in the reports.
+ */
+
+#ifndef TRACE_METHODS_H
+#define TRACE_METHODS_H
+
+#include "gsh_list.h"
+#include "gsh_histogram.h"
+#include "common_utils.h"
+#include "err_inject.h"
+
+/**
+ * @brief The calls timed
+ *
+ * The cheap accessors (fs_maxread, status, handle_to_key, ...) are
+ * passed down without being timed.
+ */
+enum trace_op {
+	/* export_ops */
+	TRACE_LOOKUP_PATH,
+	TRACE_CREATE_HANDLE,
+	TRACE_DYNAMIC_INFO,
+	TRACE_CHECK_QUOTA,
+	TRACE_GET_QUOTA,
+	TRACE_SET_QUOTA,
+	/* fsal_obj_ops, namespace and attributes */
+	TRACE_LOOKUP,
+	TRACE_READDIR,
+	TRACE_CREATE,
+	TRACE_MKDIR,
+	TRACE_MKNODE,
+	TRACE_SYMLINK,
+	TRACE_READLINK,
+	TRACE_TEST_ACCESS,
+	TRACE_GETATTRS,
+	TRACE_SETATTRS,
+	TRACE_LINK,
+	TRACE_FS_LOCATIONS,
+	TRACE_RENAME,
+	TRACE_UNLINK,
+	/* I/O */
+	TRACE_OPEN,
+	TRACE_REOPEN,
+	TRACE_READ,
+	TRACE_READ_PLUS,
+	TRACE_WRITE,
+	TRACE_WRITE_PLUS,
+	TRACE_SEEK,
+	TRACE_IO_ADVISE,
+	TRACE_COMMIT,
+	TRACE_LOCK_OP,
+	TRACE_SHARE_OP,
+	TRACE_CLOSE,
+	TRACE_OPEN2,
+	TRACE_REOPEN2,
+	TRACE_READ2,
+	TRACE_WRITE2,
+	TRACE_SEEK2,
+	TRACE_IO_ADVISE2,
+	TRACE_COMMIT2,
+	TRACE_LOCK_OP2,
+	TRACE_SETATTR2,
+	TRACE_CLOSE2,
+	TRACE_READ_BUFFER,
+	TRACE_READ_VEC,
+	TRACE_WRITE_VEC,
+	TRACE_READ2_ASYNC,
+	TRACE_WRITE2_ASYNC,
+	TRACE_COPY,
+	TRACE_CLONE,
+	TRACE_FALLOCATE,
+	/* extended attributes */
+	TRACE_LIST_EXT_ATTRS,
+	TRACE_GETEXTATTR_ID_BY_NAME,
+	TRACE_GETEXTATTR_VALUE_BY_NAME,
+	TRACE_GETEXTATTR_VALUE_BY_ID,
+	TRACE_SETEXTATTR_VALUE,
+	TRACE_SETEXTATTR_VALUE_BY_ID,
+	TRACE_REMOVE_EXTATTR_BY_ID,
+	TRACE_REMOVE_EXTATTR_BY_NAME,
+	TRACE_GETXATTRS,
+	TRACE_SETXATTRS,
+	TRACE_REMOVEXATTRS,
+	TRACE_LISTXATTRS,
+	TRACE_OP_COUNT
+};
+
+extern const char *trace_op_names[TRACE_OP_COUNT];
+
+/**
+ * @brief TRACE internal export
+ */
+struct trace_fsal_export {
+	struct fsal_export export;
+	struct glist_head exports;	/*< On the module's list, for reports */
+	char *path;			/*< Export path, to name reports */
+	uint64_t slow_ns;		/*< Log calls slower, 0 for none */
+	uint32_t sample_rate;		/*< Time one call in sample_rate */
+	uint32_t report_interval;	/*< Seconds between reports, 0 for
+					    only when the export goes */
+	time_t last_report;		/*< When it was last reported */
+	bool inject;			/*< Inject latency into the calls */
+	uint64_t slow[TRACE_OP_COUNT];	/*< Calls over slow_ns */
+	struct gsh_histogram stats[TRACE_OP_COUNT];
+};
+
+/**
+ * @brief TRACE internal object handle
+ */
+struct trace_fsal_obj_handle {
+	struct fsal_obj_handle obj_handle; /*< Handle containing trace data.*/
+	struct fsal_obj_handle *sub_handle; /*< Handle of the sub fsal.*/
+};
+
+/**
+ * @brief Readdir callback state, to wrap the entries passed up
+ */
+struct trace_readdir_state {
+	fsal_readdir_cb cb; /*< Callback to the upper layer. */
+	struct trace_fsal_export *exp; /*< Export of the current trace fsal. */
+	void *dir_state; /*< State to be sent to the next callback. */
+};
+
+/**
+ * @brief An asynchronous read or write in flight
+ */
+struct trace_async_arg {
+	struct trace_fsal_obj_handle *hdl;
+	struct trace_fsal_export *exp;
+	struct req_op_context *ctx;	/*< The caller's context */
+	enum trace_op op;
+	struct timespec start;		/*< tv_sec 0 when not sampled */
+	fsal_async_cb done_cb;
+	void *caller_arg;
+};
+
+/** The export a call was made on */
+static inline struct trace_fsal_export *trace_export(void)
+{
+	return container_of(op_ctx->fsal_export, struct trace_fsal_export,
+			    export);
+}
+
+static inline struct fsal_obj_handle *trace_sub(struct fsal_obj_handle *hdl)
+{
+	return container_of(hdl, struct trace_fsal_obj_handle,
+			    obj_handle)->sub_handle;
+}
+
+void trace_start(struct trace_fsal_export *exp, struct timespec *start);
+void trace_done(struct trace_fsal_export *exp, enum trace_op op,
+		struct timespec *start);
+
+#ifdef _ERROR_INJECTION
+extern struct err_inject_points trace_points;
+#endif
+
+/**
+ * @brief Inject the latency set for a call
+ *
+ * @param[in] exp   Export the call is made on
+ * @param[in] op    The call
+ * @param[in] write Whether bytes are written rather than read
+ * @param[in] bytes Bytes of the call, 0 for no data
+ */
+static inline void trace_inject(struct trace_fsal_export *exp,
+				enum trace_op op, bool write, uint64_t bytes)
+{
+#ifdef _ERROR_INJECTION
+	if (!exp->inject)
+		return;
+
+	err_inject_wait(&trace_points, op);
+	err_inject_throttle(&trace_points, write, bytes);
+#endif
+}
+
+/**
+ * @brief Pass a read or write down to the sub-FSAL, timing it
+ *
+ * The sub-FSAL's export is put in op_ctx for the call, as for
+ * FSAL_NULL.  Latency injected is timed as part of the call.
+ */
+#define trace_io_call(exp, op, write, bytes, call)			\
+	do {								\
+		struct timespec __start;				\
+									\
+		trace_start(exp, &__start);				\
+		trace_inject(exp, op, write, bytes);			\
+		op_ctx->fsal_export = (exp)->export.sub_export;		\
+		call;							\
+		op_ctx->fsal_export = &(exp)->export;			\
+		trace_done(exp, op, &__start);				\
+	} while (0)
+
+/** Pass a call down to the sub-FSAL, timing it */
+#define trace_call(exp, op, call)					\
+	trace_io_call(exp, op, false, 0, call)
+
+/** Pass a cheap call down without timing it */
+#define trace_pass(exp, call)						\
+	do {								\
+		op_ctx->fsal_export = (exp)->export.sub_export;		\
+		call;							\
+		op_ctx->fsal_export = &(exp)->export;			\
+	} while (0)
+
+void trace_report(struct trace_fsal_export *exp);
+void trace_register_export(struct trace_fsal_export *exp);
+void trace_unregister_export(struct trace_fsal_export *exp);
+
+fsal_status_t trace_alloc_and_check_handle(struct trace_fsal_export *exp,
+					   struct fsal_obj_handle *sub_handle,
+					   struct fsal_filesystem *fs,
+					   struct fsal_obj_handle **new_handle,
+					   fsal_status_t subfsal_status);
+
+void trace_handle_ops_init(struct fsal_obj_ops *ops);
+void trace_file_ops_init(struct fsal_obj_ops *ops);
+void trace_xattr_ops_init(struct fsal_obj_ops *ops);
+
+fsal_status_t trace_lookup_path(struct fsal_export *exp_hdl,
+				const char *path,
+				struct fsal_obj_handle **handle,
+				struct attrlist *attrs_out);
+
+fsal_status_t trace_create_handle(struct fsal_export *exp_hdl,
+				  struct gsh_buffdesc *hdl_desc,
+				  struct fsal_obj_handle **handle,
+				  struct attrlist *attrs_out);
+
+fsal_status_t trace_create_export(struct fsal_module *fsal_hdl,
+				  void *parse_node,
+				  struct config_error_type *err_type,
+				  const struct fsal_up_vector *up_ops);
+
+#endif				/* TRACE_METHODS_H */
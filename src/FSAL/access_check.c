@@ -20,6 +20,8 @@
 #include <grp.h>
 #include <sys/types.h>
 #include <os/subr.h>
+#include "abstract_atomic.h"
+#include "gsh_hash.h"
 
 static bool fsal_check_ace_owner(uid_t uid, struct user_cred *creds)
 {
@@ -136,6 +138,229 @@ static bool fsal_check_ace_applicable(fsal_ace_t *pace,
 	return is_applicable;
 }
 
+/**
+ * Compiled ACLs
+ *
+ * A shared ACL (one with a fingerprint, see nfs4_acls.c) never
+ * changes, so it is compiled the first time it is checked.  The
+ * compiled form keeps, for files and for directories, the allow and
+ * deny ACEs that apply to them in their order, each with the bit of
+ * its who.  A caller has a mask of the whos it is: OWNER@, GROUP@ and
+ * EVERYONE@, and each named user or group of the ACL it is, found by
+ * a binary search of those.  Checking access is then a walk of the
+ * ACEs that apply, testing one bit each.
+ *
+ * The result of a check is also remembered per thread, keyed by the
+ * ACL and everything about the object and the caller the check used.
+ */
+
+#define ACL_WHO_OWNER		0
+#define ACL_WHO_GROUP		1
+#define ACL_WHO_EVERYONE	2
+#define ACL_WHO_NOBODY		3	/* An unknown special, root only */
+#define ACL_WHO_NAMED		4	/* Bit of the first named who */
+#define ACL_WHO_MAX		64
+
+struct acl_who {
+	uint32_t id;
+	uint32_t bit;
+};
+
+struct acl_compiled_ace {
+	uint32_t index;		/*< Of the ACE in the ACL */
+	uint32_t bit;		/*< Of its who */
+};
+
+struct acl_compiled {
+	bool usable;		/*< False if the ACL names too many whos */
+	uint32_t nusers;
+	uint32_t ngroups;
+	uint32_t naces[2];	/*< Applying to files, and to directories */
+	struct acl_who *users;	/*< Sorted by id */
+	struct acl_who *groups;	/*< Sorted by id */
+	struct acl_compiled_ace *aces[2];
+};
+
+static int acl_who_cmpf(const void *a, const void *b)
+{
+	uint32_t ida = ((const struct acl_who *)a)->id;
+	uint32_t idb = ((const struct acl_who *)b)->id;
+
+	return ida < idb ? -1 : ida > idb;
+}
+
+static struct acl_who *acl_who_find(struct acl_who *whos, uint32_t n,
+				    uint32_t id)
+{
+	struct acl_who key = { .id = id };
+
+	if (n == 0)
+		return NULL;
+
+	return bsearch(&key, whos, n, sizeof(*whos), acl_who_cmpf);
+}
+
+/**
+ * @brief Sort whos, drop the duplicates, and number them from bit
+ *
+ * @return The number of distinct whos.
+ */
+
+static uint32_t acl_who_index(struct acl_who *whos, uint32_t n, uint32_t bit)
+{
+	uint32_t i, j = 0;
+
+	qsort(whos, n, sizeof(*whos), acl_who_cmpf);
+
+	for (i = 0; i < n; i++) {
+		if (j > 0 && whos[j - 1].id == whos[i].id)
+			continue;
+		whos[j].id = whos[i].id;
+		whos[j].bit = bit + j;
+		j++;
+	}
+
+	return j;
+}
+
+static uint32_t acl_ace_bit(struct acl_compiled *comp, fsal_ace_t *pace)
+{
+	if (IS_FSAL_ACE_SPECIAL_ID(*pace)) {
+		switch (pace->who.uid) {
+		case FSAL_ACE_SPECIAL_OWNER:
+			return ACL_WHO_OWNER;
+		case FSAL_ACE_SPECIAL_GROUP:
+			return ACL_WHO_GROUP;
+		case FSAL_ACE_SPECIAL_EVERYONE:
+			return ACL_WHO_EVERYONE;
+		default:
+			return ACL_WHO_NOBODY;
+		}
+	}
+
+	if (IS_FSAL_ACE_GROUP_ID(*pace))
+		return acl_who_find(comp->groups, comp->ngroups,
+				    pace->who.gid)->bit;
+
+	return acl_who_find(comp->users, comp->nusers, pace->who.uid)->bit;
+}
+
+static struct acl_compiled *fsal_acl_compile(fsal_acl_t *acl)
+{
+	struct acl_compiled *comp;
+	struct acl_compiled_ace *cace;
+	fsal_ace_t *pace;
+	uint32_t n = acl->naces;
+	int dir;
+
+	/* One block, that nfs4_acl_free can just free */
+	comp = gsh_calloc(1, sizeof(*comp) +
+			     n * (2 * sizeof(struct acl_who) +
+				  2 * sizeof(struct acl_compiled_ace)));
+	comp->users = (struct acl_who *)(comp + 1);
+	comp->groups = comp->users + n;
+	comp->aces[0] = (struct acl_compiled_ace *)(comp->groups + n);
+	comp->aces[1] = comp->aces[0] + n;
+
+	for (pace = acl->aces; pace < acl->aces + n; pace++) {
+		if (IS_FSAL_ACE_SPECIAL_ID(*pace))
+			continue;
+		if (IS_FSAL_ACE_GROUP_ID(*pace))
+			comp->groups[comp->ngroups++].id = pace->who.gid;
+		else
+			comp->users[comp->nusers++].id = pace->who.uid;
+	}
+
+	comp->nusers = acl_who_index(comp->users, comp->nusers,
+				     ACL_WHO_NAMED);
+	comp->ngroups = acl_who_index(comp->groups, comp->ngroups,
+				      ACL_WHO_NAMED + comp->nusers);
+
+	if (ACL_WHO_NAMED + comp->nusers + comp->ngroups > ACL_WHO_MAX)
+		return comp;
+
+	for (pace = acl->aces; pace < acl->aces + n; pace++) {
+		if (!IS_FSAL_ACE_ALLOW(*pace) && !IS_FSAL_ACE_DENY(*pace))
+			continue;
+		if (IS_FSAL_ACE_INHERIT_ONLY(*pace))
+			continue;
+
+		for (dir = 0; dir < 2; dir++) {
+			if (dir ? !IS_FSAL_DIR_APPLICABLE(*pace)
+				: !IS_FSAL_FILE_APPLICABLE(*pace))
+				continue;
+
+			cace = &comp->aces[dir][comp->naces[dir]++];
+			cace->index = pace - acl->aces;
+			cace->bit = acl_ace_bit(comp, pace);
+		}
+	}
+
+	comp->usable = true;
+
+	return comp;
+}
+
+/**
+ * @brief Get the compiled form of a shared ACL, making it if need be
+ */
+
+static struct acl_compiled *fsal_acl_compiled(fsal_acl_t *acl)
+{
+	struct acl_compiled *comp = atomic_fetch_voidptr(&acl->compiled);
+
+	if (comp != NULL)
+		return comp;
+
+	comp = fsal_acl_compile(acl);
+
+	if (!atomic_cas_voidptr(&acl->compiled, NULL, comp)) {
+		/* Another thread compiled it first */
+		gsh_free(comp);
+		comp = atomic_fetch_voidptr(&acl->compiled);
+	}
+
+	return comp;
+}
+
+/**
+ * @brief The whos of a compiled ACL a caller is
+ */
+
+static uint64_t acl_caller_mask(struct acl_compiled *comp,
+				struct user_cred *creds,
+				bool is_owner, bool is_group)
+{
+	uint64_t mask = 1ULL << ACL_WHO_EVERYONE;
+	struct acl_who *who;
+	unsigned int i;
+
+	if (is_owner)
+		mask |= 1ULL << ACL_WHO_OWNER;
+	if (is_group)
+		mask |= 1ULL << ACL_WHO_GROUP;
+
+	who = acl_who_find(comp->users, comp->nusers, creds->caller_uid);
+	if (who != NULL)
+		mask |= 1ULL << who->bit;
+
+	if (comp->ngroups == 0)
+		return mask;
+
+	who = acl_who_find(comp->groups, comp->ngroups, creds->caller_gid);
+	if (who != NULL)
+		mask |= 1ULL << who->bit;
+
+	for (i = 0; i < creds->caller_glen; i++) {
+		who = acl_who_find(comp->groups, comp->ngroups,
+				   creds->caller_garray[i]);
+		if (who != NULL)
+			mask |= 1ULL << who->bit;
+	}
+
+	return mask;
+}
+
 static const char *fsal_ace_type(fsal_acetype_t type)
 {
 	switch (type) {
@@ -431,11 +656,11 @@ static void fsal_print_access_by_acl(int naces, int ace_number,
  * @return ERR_FSAL_NO_ERROR, ERR_FSAL_ACCESS, or ERR_FSAL_NO_ACE
  */
 
-static fsal_status_t fsal_check_access_acl(struct user_cred *creds,
-					   fsal_aceperm_t v4mask,
-					   fsal_accessflags_t *allowed,
-					   fsal_accessflags_t *denied,
-					   struct attrlist *p_object_attributes)
+static fsal_status_t fsal_eval_access_acl(struct user_cred *creds,
+					  fsal_aceperm_t v4mask,
+					  fsal_accessflags_t *allowed,
+					  fsal_accessflags_t *denied,
+					  struct attrlist *p_object_attributes)
 {
 	fsal_aceperm_t missing_access;
 	fsal_aceperm_t tperm;
@@ -448,6 +673,10 @@ static fsal_status_t fsal_check_access_acl(struct user_cred *creds,
 	bool is_owner = false;
 	bool is_group = false;
 	bool is_root = false;
+	struct acl_compiled *comp = NULL;
+	uint64_t member = 0;
+	uint32_t i;
+	bool applicable;
 
 	if (allowed != NULL)
 		*allowed = 0;
@@ -541,25 +770,60 @@ static fsal_status_t fsal_check_access_acl(struct user_cred *creds,
 	}
 	/** @todo Even if user is admin, audit/alarm checks should be done. */
 
-	for (pace = pacl->aces; pace < pacl->aces + pacl->naces; pace++) {
-		ace_number += 1;
+	if (pacl->fingerprint != 0 && !isFullDebug(COMPONENT_NFS_V4_ACL)) {
+		comp = fsal_acl_compiled(pacl);
+		if (!comp->usable)
+			comp = NULL;
+		else if (is_root)
+			member = ~0ULL;
+		else
+			member = acl_caller_mask(comp, creds, is_owner,
+						 is_group);
+	}
+
+	for (i = 0;; i++) {
+		if (comp != NULL) {
+			/* Only allow and deny ACEs for the type were kept */
+			struct acl_compiled_ace *cace;
 
-		LogFullDebug(COMPONENT_NFS_V4_ACL,
-			     "ace numnber: %d ace type 0x%X perm 0x%X flag 0x%X who %u",
-			     ace_number, pace->type, pace->perm, pace->flag,
-			     GET_FSAL_ACE_WHO(*pace));
+			if (i == comp->naces[is_dir])
+				break;
 
-		/* Process Allow and Deny entries. */
-		if (!IS_FSAL_ACE_ALLOW(*pace) && !IS_FSAL_ACE_DENY(*pace)) {
-			LogFullDebug(COMPONENT_NFS_V4_ACL, "not allow or deny");
-			continue;
-		}
+			cace = &comp->aces[is_dir][i];
+			pace = pacl->aces + cace->index;
+			ace_number = cace->index + 1;
+			applicable = (member & (1ULL << cace->bit)) != 0;
+		} else {
+			if (i == pacl->naces)
+				break;
+
+			pace = pacl->aces + i;
+			ace_number = i + 1;
+
+			LogFullDebug(COMPONENT_NFS_V4_ACL,
+				     "ace numnber: %d ace type 0x%X perm 0x%X flag 0x%X who %u",
+				     ace_number, pace->type, pace->perm,
+				     pace->flag, GET_FSAL_ACE_WHO(*pace));
 
-		LogFullDebug(COMPONENT_NFS_V4_ACL, "allow or deny");
+			/* Process Allow and Deny entries. */
+			if (!IS_FSAL_ACE_ALLOW(*pace) &&
+			    !IS_FSAL_ACE_DENY(*pace)) {
+				LogFullDebug(COMPONENT_NFS_V4_ACL,
+					     "not allow or deny");
+				continue;
+			}
+
+			LogFullDebug(COMPONENT_NFS_V4_ACL, "allow or deny");
+
+			/* Check if this ACE is applicable. */
+			applicable = fsal_check_ace_applicable(pace, creds,
+							       is_dir,
+							       is_owner,
+							       is_group,
+							       is_root);
+		}
 
-		/* Check if this ACE is applicable. */
-		if (fsal_check_ace_applicable(pace, creds, is_dir, is_owner,
-					      is_group, is_root)) {
+		if (applicable) {
 			if (IS_FSAL_ACE_ALLOW(*pace)) {
 				/* Do not set bits which are already denied */
 				if (denied)
@@ -675,6 +939,113 @@ static fsal_status_t fsal_check_access_acl(struct user_cred *creds,
 	}
 }
 
+/**
+ * @brief A remembered ACL access check
+ */
+
+struct acl_access_memo {
+	const fsal_acl_t *acl;
+	uint64_t fingerprint;
+	uint64_t groups;	/*< Hash of the caller's group list */
+	uid_t caller_uid;
+	gid_t caller_gid;
+	unsigned int caller_glen;
+	uid_t owner;
+	gid_t group;
+	fsal_aceperm_t v4mask;
+	uint32_t flags;		/*< ACL_MEMO_* */
+	fsal_errors_t major;
+	fsal_accessflags_t allowed;
+	fsal_accessflags_t denied;
+};
+
+#define ACL_MEMO_VALID		0x01
+#define ACL_MEMO_DIR		0x02
+#define ACL_MEMO_ALLOWED	0x04	/* The caller asked for allowed */
+#define ACL_MEMO_DENIED		0x08	/* The caller asked for denied */
+
+#define ACL_MEMO_SIZE 64
+
+static __thread struct acl_access_memo acl_memo[ACL_MEMO_SIZE];
+
+/**
+ * @brief Check access using v4 ACL list, remembering the result
+ *
+ * Only shared ACLs are remembered, as they never change; a freed one
+ * reused for other ACEs has another fingerprint.
+ *
+ * @return As fsal_eval_access_acl.
+ */
+
+static fsal_status_t fsal_check_access_acl(struct user_cred *creds,
+					   fsal_aceperm_t v4mask,
+					   fsal_accessflags_t *allowed,
+					   fsal_accessflags_t *denied,
+					   struct attrlist *p_object_attributes)
+{
+	fsal_acl_t *pacl = p_object_attributes->acl;
+	struct acl_access_memo *memo;
+	fsal_status_t status;
+	uint64_t groups;
+	uint32_t flags = ACL_MEMO_VALID;
+
+	if (pacl == NULL || pacl->fingerprint == 0 ||
+	    isFullDebug(COMPONENT_NFS_V4_ACL))
+		return fsal_eval_access_acl(creds, v4mask, allowed, denied,
+					    p_object_attributes);
+
+	if (p_object_attributes->type == DIRECTORY)
+		flags |= ACL_MEMO_DIR;
+	if (allowed != NULL)
+		flags |= ACL_MEMO_ALLOWED;
+	if (denied != NULL)
+		flags |= ACL_MEMO_DENIED;
+
+	groups = gsh_hash64(creds->caller_garray,
+			    creds->caller_glen * sizeof(gid_t),
+			    creds->caller_gid);
+
+	memo = &acl_memo[((pacl->fingerprint ^ groups ^ v4mask ^
+			   ((uint64_t)p_object_attributes->owner << 32 |
+			    creds->caller_uid)) *
+			  0x9E3779B97F4A7C15ULL) >> 58];
+
+	if (memo->flags == flags && memo->acl == pacl &&
+	    memo->fingerprint == pacl->fingerprint &&
+	    memo->v4mask == v4mask &&
+	    memo->caller_uid == creds->caller_uid &&
+	    memo->caller_gid == creds->caller_gid &&
+	    memo->caller_glen == creds->caller_glen &&
+	    memo->groups == groups &&
+	    memo->owner == p_object_attributes->owner &&
+	    memo->group == p_object_attributes->group) {
+		if (allowed != NULL)
+			*allowed = memo->allowed;
+		if (denied != NULL)
+			*denied = memo->denied;
+		return fsalstat(memo->major, 0);
+	}
+
+	status = fsal_eval_access_acl(creds, v4mask, allowed, denied,
+				      p_object_attributes);
+
+	memo->acl = pacl;
+	memo->fingerprint = pacl->fingerprint;
+	memo->groups = groups;
+	memo->caller_uid = creds->caller_uid;
+	memo->caller_gid = creds->caller_gid;
+	memo->caller_glen = creds->caller_glen;
+	memo->owner = p_object_attributes->owner;
+	memo->group = p_object_attributes->group;
+	memo->v4mask = v4mask;
+	memo->flags = flags;
+	memo->major = status.major;
+	memo->allowed = allowed != NULL ? *allowed : 0;
+	memo->denied = denied != NULL ? *denied : 0;
+
+	return status;
+}
+
 /**
  * @brief Check access using mode bits only
  *
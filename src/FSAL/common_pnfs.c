@@ -345,6 +345,139 @@ nfsstat4 FSAL_encode_v4_multipath(XDR *xdrs, const uint32_t num_hosts,
 	return NFS4_OK;
 }
 
+/**
+ * @brief Convenience function to encode a flex files loc_body
+ *
+ * This function allows the FSAL to encode an ff_layout4 without
+ * having to allocate and construct all the components of the
+ * structure.  Each mirror holds a full copy of the file, striped
+ * over the same number of data servers; the client writes to every
+ * mirror and reads from any.
+ *
+ * Unlike FSAL_encode_file_layout, the handles are passed through
+ * as is, since the data servers are not Ganesha.  The stateid is the
+ * anonymous one, as loosely coupled data servers know nothing of the
+ * MDS's state.
+ *
+ * To encode a completed ff_layout4 structure, call xdr_ff_layout4.
+ *
+ * @param[out] xdrs        XDR stream
+ * @param[in]  stripe_unit Stripe unit, 0 for no striping
+ * @param[in]  num_mirrors Number of mirrors
+ * @param[in]  stripes     Number of data servers each mirror is
+ *                         striped over
+ * @param[in]  ds          Data servers, the stripes of the first
+ *                         mirror then those of the next
+ *
+ * @return NFS status codes.
+ */
+nfsstat4 FSAL_encode_flex_files_layout(XDR *xdrs, const length4 stripe_unit,
+				       const uint32_t num_mirrors,
+				       const uint32_t stripes,
+				       const fsal_ff_data_server_t *ds)
+{
+	/* Indices over mirrors and their stripes */
+	uint32_t i = 0, j = 0;
+	/* Numeric owner and group, as loosely coupled servers want */
+	char user[16], group[16];
+	length4 *p_unit = (length4 *) &stripe_unit;
+
+	if (!xdr_length4(xdrs, p_unit)) {
+		LogMajor(COMPONENT_PNFS, "Failed encoding stripe unit.");
+		return NFS4ERR_SERVERFAULT;
+	}
+
+	if (!xdr_uint32_t(xdrs, (uint32_t *) &num_mirrors)) {
+		LogMajor(COMPONENT_PNFS, "Failed encoding length of mirrors.");
+		return NFS4ERR_SERVERFAULT;
+	}
+
+	for (i = 0; i < num_mirrors; i++) {
+		if (!xdr_uint32_t(xdrs, (uint32_t *) &stripes)) {
+			LogMajor(COMPONENT_PNFS,
+				 "Failed encoding length of mirror %" PRIu32,
+				 i);
+			return NFS4ERR_SERVERFAULT;
+		}
+
+		for (j = 0; j < stripes; j++) {
+			const fsal_ff_data_server_t *d = ds + i * stripes + j;
+			ff_data_server4 server;
+			nfs_fh4 handle;
+
+			memset(&server, 0, sizeof(server));
+			memcpy(server.ffds_deviceid, &d->deviceid,
+			       NFS4_DEVICEID4_SIZE);
+			server.ffds_efficiency = d->efficiency;
+
+			handle.nfs_fh4_val = d->fh.addr;
+			handle.nfs_fh4_len = d->fh.len;
+			server.ffds_fh_vers.ffds_fh_vers_len = 1;
+			server.ffds_fh_vers.ffds_fh_vers_val = &handle;
+
+			server.ffds_user.utf8string_len =
+			    snprintf(user, sizeof(user), "%" PRIu32, d->uid);
+			server.ffds_user.utf8string_val = user;
+			server.ffds_group.utf8string_len =
+			    snprintf(group, sizeof(group), "%" PRIu32, d->gid);
+			server.ffds_group.utf8string_val = group;
+
+			if (!xdr_ff_data_server4(xdrs, &server)) {
+				LogMajor(COMPONENT_PNFS,
+					 "Failed encoding data server %" PRIu32
+					 " of mirror %" PRIu32, j, i);
+				return NFS4ERR_SERVERFAULT;
+			}
+		}
+	}
+
+	return NFS4_OK;
+}
+
+/**
+ * @brief Convenience function to encode a flex files da_addr_body
+ *
+ * This function writes an ff_device_addr4 for an NFSv3 data server
+ * reached through most IPv4 protocols.
+ *
+ * @param[in,out] xdrs      The XDR stream
+ * @param[in]     num_hosts Number of hosts in array
+ * @param[in]     hosts     Array of hosts
+ * @param[in]     rsize     Largest read the data server takes
+ * @param[in]     wsize     Largest write the data server takes
+ *
+ * @return NFSv4 Status code
+ */
+nfsstat4 FSAL_encode_ff_device_addr(XDR *xdrs, const uint32_t num_hosts,
+				    const fsal_multipath_member_t *hosts,
+				    const uint32_t rsize,
+				    const uint32_t wsize)
+{
+	/* NFS status */
+	nfsstat4 nfs_status = 0;
+	/* The one protocol version we offer */
+	ff_device_versions4 version = {
+		.ffdv_version = NFS_V3,
+		.ffdv_minorversion = 0,
+		.ffdv_rsize = rsize,
+		.ffdv_wsize = wsize,
+		.ffdv_tightly_coupled = false,
+	};
+	uint32_t num_versions = 1;
+
+	nfs_status = FSAL_encode_v4_multipath(xdrs, num_hosts, hosts);
+	if (nfs_status != NFS4_OK)
+		return nfs_status;
+
+	if (!xdr_uint32_t(xdrs, &num_versions) ||
+	    !xdr_ff_device_versions4(xdrs, &version)) {
+		LogMajor(COMPONENT_PNFS, "Failed encoding versions.");
+		return NFS4ERR_SERVERFAULT;
+	}
+
+	return NFS4_OK;
+}
+
 /**
  * @brief Convert POSIX error codes to NFS 4 error codes
  *
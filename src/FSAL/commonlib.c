@@ -171,6 +171,7 @@ void fsal_obj_handle_init(struct fsal_obj_handle *obj, struct fsal_export *exp,
 	memcpy(&obj->obj_ops, &def_handle_ops, sizeof(struct fsal_obj_ops));
 	obj->fsal = exp->fsal;
 	obj->type = type;
+	obj->fd_cache = NULL;
 	pthread_rwlockattr_init(&attrs);
 #ifdef GLIBC
 	pthread_rwlockattr_setkind_np(
@@ -184,8 +185,11 @@ void fsal_obj_handle_init(struct fsal_obj_handle *obj, struct fsal_export *exp,
 	PTHREAD_RWLOCK_unlock(&obj->fsal->lock);
 }
 
+static void fsal_fd_cache_free(struct fsal_obj_handle *obj_hdl);
+
 void fsal_obj_handle_fini(struct fsal_obj_handle *obj)
 {
+	fsal_fd_cache_free(obj);
 	PTHREAD_RWLOCK_wrlock(&obj->fsal->lock);
 	glist_del(&obj->handles);
 	PTHREAD_RWLOCK_unlock(&obj->fsal->lock);
@@ -496,11 +500,10 @@ void log_attrlist(log_components_t component, log_levels_t level,
 	char str[LOG_BUFF_LEN];
 	struct display_buffer dspbuf = {sizeof(str), str, str};
 
-	(void) display_attrlist(&dspbuf, attr, is_obj);
-
 	if (!isLevel(component, level))
 		return;
 
+	(void) display_attrlist(&dspbuf, attr, is_obj);
 
 	DisplayLogComponentLevel(component, file, line, function, level,
 		"%s %s attributes %s",
@@ -2363,6 +2366,166 @@ fsal_status_t merge_share(struct fsal_share *orig_share,
 	return fsalstat(ERR_FSAL_SHARE_DENIED, 0);
 }
 
+/**
+ * @brief Shared file descriptors of an object handle
+ *
+ * When the global fd of a file is open in the wrong mode and busy, so
+ * that it can not be reopened, I/O without a usable state is given one
+ * of these instead of a temporary fd opened and closed for it.  They
+ * are kept, one per mode, for whoever finds the global fd busy next.
+ *
+ * Like the global fd, they are used with the handle's lock held read,
+ * which is the reference that keeps them open, and they are closed
+ * with it held write: when the global fd is closed or reopened, which
+ * is how the LRU reaps them with the global fds, and when the handle
+ * is released.
+ */
+struct fsal_fd_cache {
+	/** Serializes opening a slot between holders of the read lock */
+	pthread_mutex_t mtx;
+	fsal_close_func close_func;
+	/** Indexed by mode - 1, for read, write and read/write */
+	struct fsal_fd *fd[FSAL_O_RDWR];
+};
+
+/**
+ * @brief Get a shared fd usable for a mode
+ *
+ * Called with the handle's lock held read, which must be kept while the
+ * fd is used.
+ *
+ * @param[in]  obj_hdl     File on which to operate
+ * @param[in]  openflags   Mode needed
+ * @param[in]  fd_size     Size of the FSAL's file descriptor structure
+ * @param[in]  open_func   Function to open a file descriptor
+ * @param[in]  close_func  Function to close a file descriptor
+ * @param[out] out_fd      The shared fd
+ *
+ * @return FSAL status.
+ */
+
+static fsal_status_t fsal_fd_cache_get(struct fsal_obj_handle *obj_hdl,
+				       fsal_openflags_t openflags,
+				       size_t fd_size,
+				       fsal_open_func open_func,
+				       fsal_close_func close_func,
+				       struct fsal_fd **out_fd)
+{
+	struct fsal_fd_cache *cache;
+	fsal_openflags_t mode;
+	fsal_status_t status = {ERR_FSAL_NO_ERROR, 0};
+	struct fsal_fd *fd;
+	int ix;
+
+	cache = atomic_fetch_voidptr((void **)&obj_hdl->fd_cache);
+
+	if (cache == NULL) {
+		cache = gsh_calloc(1, sizeof(*cache));
+		PTHREAD_MUTEX_init(&cache->mtx, NULL);
+		cache->close_func = close_func;
+
+		if (!atomic_cas_voidptr((void **)&obj_hdl->fd_cache, NULL,
+					cache)) {
+			PTHREAD_MUTEX_destroy(&cache->mtx);
+			gsh_free(cache);
+			cache = atomic_fetch_voidptr(
+					(void **)&obj_hdl->fd_cache);
+		}
+	}
+
+	PTHREAD_MUTEX_lock(&cache->mtx);
+
+	for (ix = 0; ix < FSAL_O_RDWR; ix++) {
+		fd = cache->fd[ix];
+		if (fd != NULL && !not_open_usable(fd->openflags, openflags))
+			goto out;
+	}
+
+	mode = openflags == FSAL_O_ANY ? FSAL_O_READ : openflags;
+	fd = cache->fd[mode - 1];
+
+	if (fd == NULL) {
+		fd = gsh_calloc(1, fd_size);
+		cache->fd[mode - 1] = fd;
+	}
+
+	status = open_func(obj_hdl, mode, fd);
+
+	if (!FSAL_IS_ERROR(status))
+		(void) atomic_inc_size_t(&open_fd_count);
+
+ out:
+	PTHREAD_MUTEX_unlock(&cache->mtx);
+
+	if (!FSAL_IS_ERROR(status)) {
+		LogFullDebug(COMPONENT_FSAL,
+			     "Use shared fd %p openflags = %x",
+			     fd, fd->openflags);
+		*out_fd = fd;
+	}
+
+	return status;
+}
+
+/**
+ * @brief Close the shared fds of an object handle
+ *
+ * Called with the handle's lock held write, or as it is released.
+ *
+ * @param[in] obj_hdl  File on which to operate
+ */
+
+void fsal_fd_cache_close(struct fsal_obj_handle *obj_hdl)
+{
+	struct fsal_fd_cache *cache = obj_hdl->fd_cache;
+	fsal_status_t status;
+	struct fsal_fd *fd;
+	int ix;
+
+	if (cache == NULL)
+		return;
+
+	for (ix = 0; ix < FSAL_O_RDWR; ix++) {
+		fd = cache->fd[ix];
+		if (fd == NULL || fd->openflags == FSAL_O_CLOSED)
+			continue;
+
+		status = cache->close_func(obj_hdl, fd);
+
+		if (FSAL_IS_ERROR(status))
+			LogDebug(COMPONENT_FSAL,
+				 "close_func failed with %s",
+				 msg_fsal_err(status.major));
+
+		fd->openflags = FSAL_O_CLOSED;
+		(void) atomic_dec_size_t(&open_fd_count);
+	}
+}
+
+/**
+ * @brief Free the shared fds of an object handle as it is released
+ *
+ * @param[in] obj_hdl  File being released
+ */
+
+static void fsal_fd_cache_free(struct fsal_obj_handle *obj_hdl)
+{
+	struct fsal_fd_cache *cache = obj_hdl->fd_cache;
+	int ix;
+
+	if (cache == NULL)
+		return;
+
+	fsal_fd_cache_close(obj_hdl);
+
+	for (ix = 0; ix < FSAL_O_RDWR; ix++)
+		gsh_free(cache->fd[ix]);
+
+	PTHREAD_MUTEX_destroy(&cache->mtx);
+	gsh_free(cache);
+	obj_hdl->fd_cache = NULL;
+}
+
 /**
  * @brief Reopen the fd associated with the object handle.
  *
@@ -2377,6 +2540,10 @@ fsal_status_t merge_share(struct fsal_share *orig_share,
  * file descriptor in a usable mode reducing the use of temporary file
  * descriptors.
  *
+ * If fd_size is not 0 and a plain read, write or any mode is wanted,
+ * such a conflict is instead served by a shared fd of the object (see
+ * struct fsal_fd_cache), returned with the lock held.
+ *
  * On calling, out_fd must point to a temporary fd. On return, out_fd
  * will either still point to the temporary fd, which has now been opened
  * and must be closed when done, or it will point to the object handle's
@@ -2393,6 +2560,8 @@ fsal_status_t merge_share(struct fsal_share *orig_share,
  * @param[in]  share       The fsal_share associated with the object
  * @param[in]  open_func   Function to open a file descriptor
  * @param[in]  close_func  Function to close a file descriptor
+ * @param[in]  fd_size     Size of the FSAL's file descriptor structure,
+ *                         0 for temporary fds only
  * @param[in,out] out_fd   File descriptor that is to be used
  * @param[out] has_lock    Indicates that obj_hdl->lock is held read
  * @param[out] closefd     Indicates that file descriptor must be closed
@@ -2408,6 +2577,7 @@ fsal_status_t fsal_reopen_obj(struct fsal_obj_handle *obj_hdl,
 			      struct fsal_share *share,
 			      fsal_open_func open_func,
 			      fsal_close_func close_func,
+			      size_t fd_size,
 			      struct fsal_fd **out_fd,
 			      bool *has_lock,
 			      bool *closefd)
@@ -2482,7 +2652,44 @@ again:
 		 * I/O request.
 		 */
 		rc = pthread_rwlock_trywrlock(&obj_hdl->lock);
-		if (rc == EBUSY) {
+		if (rc == EBUSY && fd_size != 0 &&
+		    (openflags == FSAL_O_ANY ||
+		     (openflags & ~FSAL_O_RDWR) == 0)) {
+			/* Someone else is using the file descriptor.
+			 * Share an fd with the others who found it busy,
+			 * under the read lock that keeps it open.
+			 */
+			PTHREAD_RWLOCK_rdlock(&obj_hdl->lock);
+
+			if (check_share) {
+				status = check_share_conflict(share,
+							      openflags,
+							      bypass);
+
+				if (FSAL_IS_ERROR(status)) {
+					PTHREAD_RWLOCK_unlock(&obj_hdl->lock);
+					LogDebug(COMPONENT_FSAL,
+						 "check_share_conflict failed with %s",
+						 msg_fsal_err(status.major));
+					*has_lock = false;
+					return status;
+				}
+			}
+
+			status = fsal_fd_cache_get(obj_hdl, openflags, fd_size,
+						   open_func, close_func,
+						   out_fd);
+
+			if (FSAL_IS_ERROR(status)) {
+				PTHREAD_RWLOCK_unlock(&obj_hdl->lock);
+				*has_lock = false;
+				return status;
+			}
+
+			*has_lock = true;
+
+			return status;
+		} else if (rc == EBUSY) {
 			/* Someone else is using the file descriptor.
 			 * Just provide a temporary file descriptor.
 			 * We still take a read lock so we can protect the
@@ -2586,6 +2793,11 @@ again:
 			}
 		}
 
+		/* The global fd is usable again, and holding the lock write
+		 * we know nobody is using the shared ones.
+		 */
+		fsal_fd_cache_close(obj_hdl);
+
 		/* Ok, now we should be in the correct mode.
 		 * Switch back to read lock and try again.
 		 * We don't want to hold the write lock because that would
@@ -2640,6 +2852,8 @@ again:
  * @param[in]     openflags      Mode for open
  * @param[in]     open_func      Function to open a file descriptor
  * @param[in]     close_func     Function to close a file descriptor
+ * @param[in]     fd_size        Size of the FSAL's file descriptor
+ *                               structure, 0 for temporary fds only
  * @param[out]    has_lock       Indicates that obj_hdl->lock is held read
  * @param[out]    need_fsync     Indicates that the file will need fsync
  * @param[out]    closefd        Indicates that file descriptor must be closed
@@ -2657,6 +2871,7 @@ fsal_status_t fsal_find_fd(struct fsal_fd **out_fd,
 			   fsal_openflags_t openflags,
 			   fsal_open_func open_func,
 			   fsal_close_func close_func,
+			   size_t fd_size,
 			   bool *has_lock,
 			   bool *need_fsync,
 			   bool *closefd,
@@ -2773,7 +2988,7 @@ fsal_status_t fsal_find_fd(struct fsal_fd **out_fd,
 	 */
 	return fsal_reopen_obj(obj_hdl, openflags != FSAL_O_ANY, bypass,
 			       openflags, obj_fd, share, open_func, close_func,
-			       out_fd, has_lock, closefd);
+			       fd_size, out_fd, has_lock, closefd);
 }
 
 /**
@@ -1304,6 +1304,25 @@ static nfsstat4 layoutcommit(struct fsal_obj_handle *obj_hdl,
 	return NFS4ERR_NOTSUPP;
 }
 
+/**
+ * @brief Take a report of layout I/O
+ *
+ * The server keeps its own tables, so by default there is nothing to do.
+ *
+ * @param[in] obj_hdl  The object reported on
+ * @param[in] req_ctx  Request context
+ * @param[in] lou_body Layout type-specific report, may be NULL
+ * @param[in] arg      Input arguments of the function
+ *
+ * @return NFS4_OK.
+ */
+static nfsstat4 layout_stats(struct fsal_obj_handle *obj_hdl,
+			     struct req_op_context *req_ctx, XDR *lou_body,
+			     const struct fsal_layout_stats_arg *arg)
+{
+	return NFS4_OK;
+}
+
 /* open2
  * default case not supported
  */
@@ -1413,6 +1432,23 @@ static fsal_status_t read2(struct fsal_obj_handle *obj_hdl,
 	return fsalstat(ERR_FSAL_NOTSUPP, ENOTSUP);
 }
 
+/* read_buffer
+ * default case not supported
+ */
+
+static fsal_status_t read_buffer(struct fsal_obj_handle *obj_hdl,
+				 bool bypass,
+				 struct state_t *state,
+				 uint64_t seek_descriptor,
+				 size_t buffer_size,
+				 struct fsal_read_buf *rbuf,
+				 bool *end_of_file)
+{
+	LogCrit(COMPONENT_FSAL,
+		"Invoking unsupported FSAL operation");
+	return fsalstat(ERR_FSAL_NOTSUPP, ENOTSUP);
+}
+
 /* write2
  * default case not supported
  */
@@ -1445,6 +1481,277 @@ static fsal_status_t seek2(struct fsal_obj_handle *obj_hdl,
 	return fsalstat(ERR_FSAL_NOTSUPP, ENOTSUP);
 }
 
+/* copy
+ * default case bounces the data through read2 and write2
+ */
+
+#define COPY_BOUNCE_SIZE (1024 * 1024)
+
+static fsal_status_t file_copy(struct fsal_obj_handle *src_hdl,
+			       struct state_t *src_state,
+			       uint64_t src_offset,
+			       struct fsal_obj_handle *dst_hdl,
+			       struct state_t *dst_state,
+			       uint64_t dst_offset,
+			       uint64_t count,
+			       uint64_t *copied)
+{
+	size_t size = count < COPY_BOUNCE_SIZE ? count : COPY_BOUNCE_SIZE;
+	size_t read_amount = 0, write_amount = 0;
+	bool eof = false, stable = false;
+	fsal_status_t status;
+	void *buffer;
+
+	*copied = 0;
+
+	if (size == 0)
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+	/* One buffer's worth; the caller asks again for the rest */
+	buffer = gsh_malloc(size);
+
+	status = src_hdl->obj_ops.read2(src_hdl, false, src_state, src_offset,
+					size, buffer, &read_amount, &eof,
+					NULL);
+
+	if (!FSAL_IS_ERROR(status) && read_amount != 0) {
+		status = dst_hdl->obj_ops.write2(dst_hdl, false, dst_state,
+						 dst_offset, read_amount,
+						 buffer, &write_amount,
+						 &stable, NULL);
+		if (!FSAL_IS_ERROR(status))
+			*copied = write_amount;
+	}
+
+	gsh_free(buffer);
+	return status;
+}
+
+/* clone
+ * default case not supported
+ */
+
+static fsal_status_t file_clone(struct fsal_obj_handle *src_hdl,
+				struct state_t *src_state,
+				uint64_t src_offset,
+				struct fsal_obj_handle *dst_hdl,
+				struct state_t *dst_state,
+				uint64_t dst_offset,
+				uint64_t count)
+{
+	/* Not an error worth shouting about, clients try CLONE and fall
+	 * back to COPY.
+	 */
+	LogDebug(COMPONENT_FSAL,
+		 "FSAL %s can not clone", src_hdl->fsal->name);
+	return fsalstat(ERR_FSAL_NOTSUPP, ENOTSUP);
+}
+
+/* fallocate
+ * default case passes the range to write2 as WRITE_PLUS content, the way
+ * ALLOCATE and DEALLOCATE reached FSALs before this method existed.
+ */
+
+static fsal_status_t file_fallocate(struct fsal_obj_handle *obj_hdl,
+				    struct state_t *state,
+				    uint64_t offset,
+				    uint64_t length,
+				    bool allocate)
+{
+	struct io_info info;
+	size_t write_amount = 0;
+	bool stable = true;
+
+	memset(&info, 0, sizeof(info));
+	info.io_content.what = allocate ? NFS4_CONTENT_ALLOCATE
+					: NFS4_CONTENT_DEALLOCATE;
+	info.io_content.hole.di_offset = offset;
+	info.io_content.hole.di_length = length;
+
+	return obj_hdl->obj_ops.write2(obj_hdl, false, state, offset, length,
+				       NULL, &write_amount, &stable, &info);
+}
+
+/* write_vec
+ * default case writes each buffer in turn through write2
+ */
+
+static fsal_status_t file_write_vec(struct fsal_obj_handle *obj_hdl,
+				    bool bypass,
+				    struct state_t *state,
+				    uint64_t offset,
+				    const struct iovec *iov,
+				    int iovcnt,
+				    size_t *wrote_amount,
+				    bool *fsal_stable)
+{
+	fsal_status_t status = {0, 0};
+	size_t written;
+	bool stable = true;
+	int i;
+
+	*wrote_amount = 0;
+
+	for (i = 0; i < iovcnt; i++) {
+		bool this_stable = *fsal_stable;
+
+		written = 0;
+		status = obj_hdl->obj_ops.write2(obj_hdl, bypass, state,
+						 offset + *wrote_amount,
+						 iov[i].iov_len,
+						 iov[i].iov_base,
+						 &written, &this_stable,
+						 NULL);
+		if (FSAL_IS_ERROR(status))
+			break;
+
+		*wrote_amount += written;
+		stable = stable && this_stable;
+
+		if (written < iov[i].iov_len)
+			break;
+	}
+
+	*fsal_stable = stable;
+	return status;
+}
+
+/* read_vec
+ * default case reads each buffer in turn through read2
+ */
+
+static fsal_status_t file_read_vec(struct fsal_obj_handle *obj_hdl,
+				   bool bypass,
+				   struct state_t *state,
+				   uint64_t offset,
+				   const struct iovec *iov,
+				   int iovcnt,
+				   size_t *read_amount,
+				   bool *end_of_file)
+{
+	fsal_status_t status = {0, 0};
+	size_t nb_read;
+	int i;
+
+	*read_amount = 0;
+	*end_of_file = false;
+
+	for (i = 0; i < iovcnt && !*end_of_file; i++) {
+		nb_read = 0;
+		status = obj_hdl->obj_ops.read2(obj_hdl, bypass, state,
+						offset + *read_amount,
+						iov[i].iov_len,
+						iov[i].iov_base,
+						&nb_read, end_of_file,
+						NULL);
+		if (FSAL_IS_ERROR(status))
+			break;
+
+		*read_amount += nb_read;
+
+		if (nb_read < iov[i].iov_len)
+			break;
+	}
+
+	return status;
+}
+
+/* read2_async
+ * default is to read synchronously and complete at once
+ */
+
+static void file_read2_async(struct fsal_obj_handle *obj_hdl,
+			     bool bypass,
+			     struct fsal_io_arg *read_arg,
+			     fsal_async_cb done_cb,
+			     void *caller_arg)
+{
+	fsal_status_t status;
+
+	status = obj_hdl->obj_ops.read2(obj_hdl, bypass, read_arg->state,
+					read_arg->offset, read_arg->size,
+					read_arg->buffer, &read_arg->io_amount,
+					&read_arg->end_of_file, read_arg->info);
+
+	done_cb(obj_hdl, status, read_arg, caller_arg);
+}
+
+/* write2_async
+ * default is to write synchronously and complete at once
+ */
+
+static void file_write2_async(struct fsal_obj_handle *obj_hdl,
+			      bool bypass,
+			      struct fsal_io_arg *write_arg,
+			      fsal_async_cb done_cb,
+			      void *caller_arg)
+{
+	fsal_status_t status;
+
+	status = obj_hdl->obj_ops.write2(obj_hdl, bypass, write_arg->state,
+					 write_arg->offset, write_arg->size,
+					 write_arg->buffer,
+					 &write_arg->io_amount,
+					 &write_arg->fsal_stable,
+					 write_arg->info);
+
+	done_cb(obj_hdl, status, write_arg, caller_arg);
+}
+
+/* lookup_multi
+ * default is to look the names up one at a time
+ */
+
+static fsal_status_t lookup_multi(struct fsal_obj_handle *dir_hdl,
+				  const char * const *names,
+				  uint32_t count,
+				  struct fsal_obj_handle **handles,
+				  struct attrlist *attrs_out,
+				  uint32_t *found)
+{
+	struct fsal_obj_handle *dir = dir_hdl;
+	fsal_status_t status = {0, 0};
+
+	for (*found = 0; *found < count; (*found)++) {
+		if (dir->type != DIRECTORY)
+			return fsalstat(ERR_FSAL_NOTDIR, 0);
+
+		status = dir->obj_ops.lookup(dir, names[*found],
+					     &handles[*found],
+					     attrs_out != NULL
+						? &attrs_out[*found]
+						: NULL);
+
+		if (FSAL_IS_ERROR(status))
+			break;
+
+		dir = handles[*found];
+	}
+
+	return status;
+}
+
+/* getattr_change
+ * default case not supported, getattrs has it
+ */
+
+static fsal_status_t getattr_change(struct fsal_obj_handle *obj_hdl,
+				    uint64_t *change)
+{
+	return fsalstat(ERR_FSAL_NOTSUPP, 0);
+}
+
+/* getattrs_multi
+ * default case not supported, getattrs has it
+ */
+
+static fsal_status_t getattrs_multi(struct fsal_obj_handle **handles,
+				    uint32_t count,
+				    struct attrlist *attrs)
+{
+	return fsalstat(ERR_FSAL_NOTSUPP, 0);
+}
+
 /* io io_advise2
  * default case not supported
  */
@@ -1580,6 +1887,18 @@ struct fsal_obj_ops def_handle_ops = {
 	.lock_op2 = lock_op2,
 	.setattr2 = setattr2,
 	.close2 = close2,
+	.read_buffer = read_buffer,
+	.copy = file_copy,
+	.clone = file_clone,
+	.fallocate = file_fallocate,
+	.write_vec = file_write_vec,
+	.read_vec = file_read_vec,
+	.read2_async = file_read2_async,
+	.write2_async = file_write2_async,
+	.lookup_multi = lookup_multi,
+	.getattr_change = getattr_change,
+	.getattrs_multi = getattrs_multi,
+	.layout_stats = layout_stats,
 };
 
 /* fsal_pnfs_ds common methods */
@@ -104,6 +104,10 @@ bool fsal_supports(struct fsal_staticfsinfo_t *info,
 		return !!info->fsal_grace;
 	case fso_link_supports_permission_checks:
 		return !!info->link_supports_permission_checks;
+	case fso_read_buffers:
+		return !!info->read_buffers;
+	case fso_native_exclusive_create:
+		return !!info->native_exclusive_create;
 	default:
 		return false;	/* whatever I don't know about,
 				 * you can't do
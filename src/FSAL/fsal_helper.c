@@ -684,6 +684,44 @@ fsal_status_t fsal_lookup(struct fsal_obj_handle *parent,
 	return parent->obj_ops.lookup(parent, name, obj, attrs_out);
 }
 
+/**
+ * @brief Look up a chain of names ahead of their lookups
+ *
+ * Walks @a names from @a parent with one lookup_multi, so that the
+ * fsal_lookup of each name that follows finds it in the cache rather
+ * than going to the backend once per level.  Nothing is returned and
+ * no access is checked: those lookups do it.  The walk stops before
+ * any "." or "..".
+ *
+ * @param[in] parent Directory the first name is in
+ * @param[in] names  Names to look up, one per level
+ * @param[in] count  Number of names
+ */
+void fsal_lookup_ahead(struct fsal_obj_handle *parent,
+		       const char * const *names,
+		       uint32_t count)
+{
+	struct fsal_obj_handle *handles[FSAL_LOOKUP_MULTI_MAX];
+	uint32_t found = 0, i;
+
+	if (count > FSAL_LOOKUP_MULTI_MAX)
+		count = FSAL_LOOKUP_MULTI_MAX;
+
+	for (i = 0; i < count; i++)
+		if (strcmp(names[i], ".") == 0 || strcmp(names[i], "..") == 0)
+			break;
+	count = i;
+
+	if (count < 2 || parent->type != DIRECTORY)
+		return;
+
+	(void) parent->obj_ops.lookup_multi(parent, names, count, handles,
+					    NULL, &found);
+
+	for (i = 0; i < found; i++)
+		handles[i]->obj_ops.put_ref(handles[i]);
+}
+
 /**
  * @brief Look up a directory's parent
  *
@@ -1026,6 +1064,49 @@ fsal_status_t fsal_read2(struct fsal_obj_handle *obj,
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
 
+/**
+ * @brief Reads into a buffer the FSAL lends
+ *
+ * @param[in]  obj    File to be read
+ * @param[in]  bypass If state doesn't indicate a share reservation,
+ *                    bypass any deny read
+ * @param[in]  state  state_t to use for this operation
+ * @param[in]  offset Offset at which to read
+ * @param[in]  io_size Amount of data to read
+ * @param[out] rbuf   Data read, to be given back with fsal_read_buf_put
+ * @param[out] eof    True if end of file reached
+ *
+ * @return FSAL status
+ */
+
+fsal_status_t fsal_read_buffer(struct fsal_obj_handle *obj,
+			       bool bypass,
+			       struct state_t *state,
+			       uint64_t offset,
+			       size_t io_size,
+			       struct fsal_read_buf *rbuf,
+			       bool *eof)
+{
+	fsal_status_t status;
+
+	status = obj->obj_ops.read_buffer(obj, bypass, state, offset, io_size,
+					  rbuf, eof);
+
+	/* Fixup FSAL_SHARE_DENIED status */
+	if (status.major == ERR_FSAL_SHARE_DENIED)
+		status = fsalstat(ERR_FSAL_LOCKED, 0);
+
+	LogFullDebug(COMPONENT_FSAL,
+		     "FSAL READ BUFFER operation returned %s, asked_size=%zu, effective_size=%zu",
+		     fsal_err_txt(status), io_size,
+		     FSAL_IS_ERROR(status) ? 0 : rbuf->data.len);
+
+	if (FSAL_IS_ERROR(status))
+		rbuf->data.len = 0;
+
+	return status;
+}
+
 /**
  * @brief New style writes
  *
@@ -48,6 +48,12 @@
  * returns it after execution.
  *
  * Every async call returns 0 on success and a POSIX error code on error.
+ *
+ * Invalidates and updates without a callback are coalesced: while one
+ * is pending, later ones for the same handle are merged into it, and
+ * a single job passes everything pending up, the invalidates of an
+ * export in batches.  An update that closes or unlinks, or that has a
+ * callback, is queued on its own as before.
  */
 
 #include "config.h"
@@ -61,6 +67,214 @@
 #include "fsal_convert.h"
 #include "sal_functions.h"
 #include "pnfs_utils.h"
+#include "gsh_list.h"
+#include "gsh_hash.h"
+
+/* Coalesced invalidate and update */
+
+/** Buckets of handles pending */
+#define UP_PENDING_BUCKETS 1024
+
+/** Most handles passed up in one invalidate_batch */
+#define UP_BATCH_MAX 256
+
+struct up_pending {
+	struct up_pending *next;	/*< In its bucket */
+	struct glist_head list;		/*< Pending, oldest first */
+	struct fsal_export *export;
+	struct gsh_buffdesc obj;
+	uint64_t hk;
+	uint32_t flags;			/*< FSAL_UP_INVALIDATE_* */
+	bool update;			/*< attr and upflags are set */
+	uint32_t upflags;
+	struct attrlist attr;
+	char key[];
+};
+
+static struct {
+	pthread_mutex_t mtx;
+	struct up_pending *buckets[UP_PENDING_BUCKETS];
+	struct glist_head pending;
+	/** Fridge the flush is queued in, NULL if none is */
+	struct fridgethr *fr;
+} up_coalesce = {
+	.mtx = PTHREAD_MUTEX_INITIALIZER,
+	.pending = GLIST_HEAD_INIT(up_coalesce.pending),
+};
+
+/**
+ * @brief Pass up the invalidates of a batch
+ */
+static void up_invalidate_batch(struct fsal_export *export,
+				struct gsh_buffdesc *objs, uint32_t *flags,
+				uint32_t count)
+{
+	uint32_t ix;
+
+	if (export->up_ops->invalidate_batch != NULL) {
+		(void) export->up_ops->invalidate_batch(export, objs, flags,
+							count);
+		return;
+	}
+
+	for (ix = 0; ix < count; ix++)
+		(void) export->up_ops->invalidate(export, &objs[ix],
+						  flags[ix]);
+}
+
+/**
+ * @brief Pass up every coalesced invalidate and update
+ *
+ * The updates go first: an update after an invalidate is then at most
+ * invalidated, one before it is as it was.
+ */
+static void queue_coalesced(struct fridgethr_context *ctx)
+{
+	struct up_pending *batch[UP_BATCH_MAX];
+	struct gsh_buffdesc objs[UP_BATCH_MAX];
+	uint32_t flags[UP_BATCH_MAX];
+	struct glist_head todo, *glist, *glistn;
+	struct up_pending *pend;
+	struct fsal_export *export;
+	uint32_t count, ix;
+
+	PTHREAD_MUTEX_lock(&up_coalesce.mtx);
+	glist_init(&todo);
+	glist_splice_tail(&todo, &up_coalesce.pending);
+	memset(up_coalesce.buckets, 0, sizeof(up_coalesce.buckets));
+	up_coalesce.fr = NULL;
+	PTHREAD_MUTEX_unlock(&up_coalesce.mtx);
+
+	glist_for_each(glist, &todo) {
+		pend = glist_entry(glist, struct up_pending, list);
+		if (pend->update)
+			(void) pend->export->up_ops->update(pend->export,
+							     &pend->obj,
+							     &pend->attr,
+							     pend->upflags);
+	}
+
+	/* Batch the invalidates of each export, in the order they came */
+	while (!glist_empty(&todo)) {
+		export = glist_first_entry(&todo, struct up_pending,
+					   list)->export;
+		count = 0;
+
+		glist_for_each_safe(glist, glistn, &todo) {
+			pend = glist_entry(glist, struct up_pending, list);
+			if (pend->export != export)
+				continue;
+			glist_del(&pend->list);
+			if (pend->flags == 0) {
+				gsh_free(pend);
+				continue;
+			}
+			batch[count] = pend;
+			objs[count] = pend->obj;
+			flags[count] = pend->flags;
+			if (++count == UP_BATCH_MAX)
+				break;
+		}
+
+		if (count != 0)
+			up_invalidate_batch(export, objs, flags, count);
+
+		for (ix = 0; ix < count; ix++)
+			gsh_free(batch[ix]);
+	}
+}
+
+/**
+ * @brief Merge an invalidate or update into what is pending
+ *
+ * @param[in] fr     Fridge to pass it up in
+ * @param[in] export Export
+ * @param[in] obj    Handle
+ * @param[in] flags  FSAL_UP_INVALIDATE_* to add
+ * @param[in] attr   Attributes of an update, NULL for none
+ * @param[in] upflags Flags of the update
+ *
+ * @retval 0 if merged or queued.
+ * @retval EAGAIN if a flush is queued in another fridge, the caller
+ *         queues it on its own.
+ * @retval Other errors from fridgethr_submit.
+ */
+static int up_coalesce_add(struct fridgethr *fr, struct fsal_export *export,
+			   struct gsh_buffdesc *obj, uint32_t flags,
+			   struct attrlist *attr, uint32_t upflags)
+{
+	uint64_t hk = gsh_hash64(obj->addr, obj->len, 557);
+	struct up_pending **bucket, *pend;
+	int rc = 0;
+
+	bucket = &up_coalesce.buckets[hk % UP_PENDING_BUCKETS];
+
+	PTHREAD_MUTEX_lock(&up_coalesce.mtx);
+
+	if (up_coalesce.fr != NULL && up_coalesce.fr != fr) {
+		PTHREAD_MUTEX_unlock(&up_coalesce.mtx);
+		return EAGAIN;
+	}
+
+	for (pend = *bucket; pend != NULL; pend = pend->next)
+		if (pend->hk == hk && pend->export == export &&
+		    pend->obj.len == obj->len &&
+		    memcmp(pend->key, obj->addr, obj->len) == 0)
+			break;
+
+	if (pend != NULL) {
+		pend->flags |= flags;
+		if (attr == NULL) {
+			/* nothing to merge */
+		} else if (!pend->update ||
+			   (pend->upflags == upflags &&
+			    (attr->mask & pend->attr.mask) ==
+				pend->attr.mask)) {
+			/* the newer update says all the older did */
+			pend->update = true;
+			pend->attr = *attr;
+			pend->upflags = upflags;
+		} else {
+			/* they cannot be merged, have the attributes
+			 * fetched again
+			 */
+			pend->update = false;
+			pend->flags |= FSAL_UP_INVALIDATE_ATTRS;
+		}
+		PTHREAD_MUTEX_unlock(&up_coalesce.mtx);
+		return 0;
+	}
+
+	pend = gsh_malloc(sizeof(*pend) + obj->len);
+	pend->export = export;
+	pend->hk = hk;
+	pend->flags = flags;
+	pend->update = attr != NULL;
+	if (attr != NULL) {
+		pend->attr = *attr;
+		pend->upflags = upflags;
+	}
+	memcpy(pend->key, obj->addr, obj->len);
+	pend->obj.addr = pend->key;
+	pend->obj.len = obj->len;
+
+	if (up_coalesce.fr == NULL) {
+		rc = fridgethr_submit(fr, queue_coalesced, NULL);
+		if (rc != 0) {
+			PTHREAD_MUTEX_unlock(&up_coalesce.mtx);
+			gsh_free(pend);
+			return rc;
+		}
+		up_coalesce.fr = fr;
+	}
+
+	pend->next = *bucket;
+	*bucket = pend;
+	glist_add_tail(&up_coalesce.pending, &pend->list);
+
+	PTHREAD_MUTEX_unlock(&up_coalesce.mtx);
+	return 0;
+}
 
 /* Invalidate */
 
@@ -95,6 +309,13 @@ fsal_status_t up_async_invalidate(struct fridgethr *fr,
 	struct invalidate_args *args = NULL;
 	int rc = 0;
 
+	if (cb == NULL) {
+		rc = up_coalesce_add(fr, export, obj, flags, NULL, 0);
+		if (rc != EAGAIN)
+			return fsalstat(posix2fsal_error(rc), rc);
+		rc = 0;
+	}
+
 	args = gsh_malloc(sizeof(struct invalidate_args) + obj->len);
 
 	args->export = export;
@@ -148,6 +369,13 @@ fsal_status_t up_async_update(struct fridgethr *fr,
 	struct update_args *args = NULL;
 	int rc = 0;
 
+	if (cb == NULL && !(flags & (fsal_up_nlink | fsal_up_close))) {
+		rc = up_coalesce_add(fr, export, obj, 0, attr, flags);
+		if (rc != EAGAIN)
+			return fsalstat(posix2fsal_error(rc), rc);
+		rc = 0;
+	}
+
 	args = gsh_malloc(sizeof(struct update_args) + obj->len);
 
 	args->export = export;
@@ -354,6 +582,60 @@ fsal_status_t up_async_layoutrecall(struct fridgethr *fr,
 	return fsalstat(posix2fsal_error(rc), rc);
 }
 
+/* Bulk layoutrecall */
+
+struct layoutrecall_bulk_args {
+	struct fsal_export *export;
+	layouttype4 layout_type;
+	bool changed;
+	bool all;
+	void (*cb)(void *, state_status_t);
+	void *cb_arg;
+};
+
+static void queue_layoutrecall_bulk(struct fridgethr_context *ctx)
+{
+	struct layoutrecall_bulk_args *args = ctx->arg;
+	state_status_t status;
+
+	status = args->export->up_ops->layoutrecall_bulk(args->export,
+							 args->layout_type,
+							 args->changed,
+							 args->all);
+
+	if (args->cb)
+		args->cb(args->cb_arg, status);
+
+	gsh_free(args);
+}
+
+fsal_status_t up_async_layoutrecall_bulk(struct fridgethr *fr,
+					 struct fsal_export *export,
+					 layouttype4 layout_type, bool changed,
+					 bool all,
+					 void (*cb)(void *, state_status_t),
+					 void *cb_arg)
+{
+	struct layoutrecall_bulk_args *args = NULL;
+	int rc = 0;
+
+	args = gsh_malloc(sizeof(struct layoutrecall_bulk_args));
+
+	args->export = export;
+	args->layout_type = layout_type;
+	args->changed = changed;
+	args->all = all;
+	args->cb = cb;
+	args->cb_arg = cb_arg;
+
+	rc = fridgethr_submit(fr, queue_layoutrecall_bulk, args);
+
+	if (rc != 0)
+		gsh_free(args);
+
+	return fsalstat(posix2fsal_error(rc), rc);
+}
+
 /* Notify Device */
 
 struct notify_device_args {
@@ -45,6 +45,28 @@
 #include "delayed_exec.h"
 #include "export_mgr.h"
 #include "server_stats.h"
+#include "abstract_atomic.h"
+
+/* Longest a grouped CB_RECALL waits for its reply, the same as any
+ * other callback.
+ */
+#define DELEGRECALL_TIMEOUT 15
+
+/* The CB_RECALLs sent together for one file.  They are all queued
+ * before any is waited on, so the callback workers send them at once
+ * over each client's own channel, and the group lasts until the last
+ * first reply (or failure) comes back.
+ */
+struct delegrecall_group {
+	/* Recalls not yet answered, plus one held by the sender */
+	int32_t dg_outstanding;
+	/* Recalls in the group */
+	uint32_t dg_count;
+	/* When the recalls were gathered */
+	struct timespec dg_start;
+	/* No recall in the group waits for its reply past this */
+	time_t dg_deadline;
+};
 
 struct delegrecall_context {
 	/* Reserve lease during delegation recall */
@@ -53,6 +75,10 @@ struct delegrecall_context {
 	stateid4 drc_stateid;
 	/* Hold a reference to the export during delegation recall */
 	struct gsh_export *drc_exp;
+	/* Group of the first attempt, NULL once it is answered */
+	struct delegrecall_group *drc_group;
+	/* Chains the recalls gathered by delegrecall_impl */
+	struct glist_head drc_list;
 };
 
 enum recall_resp_action {
@@ -105,6 +131,25 @@ fsal_status_t invalidate(struct fsal_export *export,
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
 
+/** Invalidate some or all of several cache entries
+ *
+ * @param[in] export The export
+ * @param[in] objs   Handles being invalidated
+ * @param[in] flags  Flags governing invalidation of each
+ * @param[in] count  Number of handles
+ *
+ * @return FSAL status
+ *
+ */
+
+static fsal_status_t invalidate_batch(struct fsal_export *export,
+				      struct gsh_buffdesc *objs,
+				      const uint32_t *flags, uint32_t count)
+{
+	/* No need to invalidate with no cache */
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
 /**
  * @brief Update cached attributes
  *
@@ -352,6 +397,20 @@ static state_status_t create_file_recall(struct fsal_obj_handle *obj,
 
 static void layoutrecall_one_call(void *arg);
 
+/**
+ * @brief The recalls of the layouts of one file, and how they ended
+ */
+
+struct layoutrecall_file_group {
+	int32_t refcount;	/*< One per recall in flight, one for the
+				    sender */
+	struct timespec start;	/*< When the recalls were sent */
+	uint32_t recalls;	/*< Recalls sent */
+	uint32_t returning;	/*< Answered NFS4_OK, will return */
+	uint32_t nomatch;	/*< Held nothing matching, or gone */
+	uint32_t revoked;	/*< Failed, layout revoked */
+};
+
 /**
  * @brief Data used to handle the response to CB_LAYOUTRECALL
  */
@@ -360,11 +419,101 @@ struct layoutrecall_cb_data {
 	char stateid_other[OTHERSIZE];	/*< "Other" part of state id */
 	struct pnfs_segment segment;	/*< Segment to recall */
 	nfs_cb_argop4 arg;	/*< So we don't free */
-	nfs_client_id_t *client;	/*< The client we're calling. */
+	nfs_client_id_t *client;	/*< The client we're calling,
+					    referenced */
+	struct layoutrecall_file_group *group;
+	struct glist_head client_link;	/*< On cid_layoutrecall_queue */
 	struct timespec first_recall;	/*< Time of first recall */
 	uint32_t attempts;	/*< Number of times we've recalled */
 };
 
+static void put_layoutrecall_file_group(struct layoutrecall_file_group *group)
+{
+	struct timespec done;
+
+	if (atomic_dec_int32_t(&group->refcount) != 0)
+		return;
+
+	if (group->recalls != 0) {
+		now(&done);
+		LogDebug(COMPONENT_PNFS,
+			 "Layout recall of a file over in %" PRIu64
+			 " ms: %" PRIu32 " recalls, %" PRIu32 " returning, %"
+			 PRIu32 " holding none, %" PRIu32 " revoked",
+			 timespec_diff(&group->start, &done) / NS_PER_MSEC,
+			 group->recalls,
+			 atomic_fetch_uint32_t(&group->returning),
+			 atomic_fetch_uint32_t(&group->nomatch),
+			 atomic_fetch_uint32_t(&group->revoked));
+	}
+	gsh_free(group);
+}
+
+/**
+ * @brief Send a recall, or queue it behind those in flight to its client
+ *
+ * At most Layout_Recalls_Per_Client are in flight to a client, so the
+ * recalls of a file, or of many files after a data server failover,
+ * go to all clients at once without flooding any.
+ *
+ * @param[in] cb_data The recall
+ */
+
+static void layoutrecall_dispatch(struct layoutrecall_cb_data *cb_data)
+{
+	nfs_client_id_t *client = cb_data->client;
+
+	PTHREAD_MUTEX_lock(&client->cid_mutex);
+	if (client->cid_layoutrecalls >=
+	    nfs_param.nfsv4_param.layoutrecalls_per_client) {
+		glist_add_tail(&client->cid_layoutrecall_queue,
+			       &cb_data->client_link);
+		PTHREAD_MUTEX_unlock(&client->cid_mutex);
+		return;
+	}
+	client->cid_layoutrecalls++;
+	PTHREAD_MUTEX_unlock(&client->cid_mutex);
+
+	layoutrecall_one_call(cb_data);
+}
+
+/**
+ * @brief A recall is over, send the next one waiting for its client
+ *
+ * @note The next one is queued to delayed_exec, the caller may hold the
+ *       state_lock of its file.
+ *
+ * @param[in] cb_data The recall, freed
+ * @param[in] outcome Counter of its group to count it in
+ */
+
+static void layoutrecall_done(struct layoutrecall_cb_data *cb_data,
+			      uint32_t *outcome)
+{
+	nfs_client_id_t *client = cb_data->client;
+	struct layoutrecall_file_group *group = cb_data->group;
+	struct layoutrecall_cb_data *next;
+
+	(void) atomic_inc_uint32_t(outcome);
+	gsh_free(cb_data);
+
+	PTHREAD_MUTEX_lock(&client->cid_mutex);
+	next = glist_first_entry(&client->cid_layoutrecall_queue,
+				 struct layoutrecall_cb_data, client_link);
+	if (next != NULL)
+		glist_del(&next->client_link);
+	else
+		client->cid_layoutrecalls--;
+	PTHREAD_MUTEX_unlock(&client->cid_mutex);
+
+	/* next takes over the slot */
+	if (next != NULL)
+		(void) delayed_submit(layoutrecall_one_call, next, 0);
+
+	dec_client_id_ref(client);
+	put_layoutrecall_file_group(group);
+}
+
 /**
  * @brief Initiate layout recall
  *
@@ -404,12 +553,17 @@ state_status_t layoutrecall(struct fsal_export *export,
 	struct glist_head *wi = NULL;
 	struct gsh_export *exp = NULL;
 	state_owner_t *owner = NULL;
+	struct layoutrecall_file_group *group;
 
 	rc = state_error_convert(export->exp_ops.create_handle(export, handle,
 							       &obj, NULL));
 	if (rc != STATE_SUCCESS)
 		return rc;
 
+	group = gsh_calloc(1, sizeof(*group));
+	group->refcount = 1;
+	now(&group->start);
+
 	PTHREAD_RWLOCK_wrlock(&obj->state_hdl->state_lock);
 	/* We build up the list before consuming it so that we have
 	   every state on the list before we start executing returns. */
@@ -475,11 +629,15 @@ state_status_t layoutrecall(struct fsal_export *export,
 		memcpy(cb_data->stateid_other, s->stateid_other, OTHERSIZE);
 		cb_data->segment = *segment;
 		cb_data->client = owner->so_owner.so_nfs4_owner.so_clientrec;
+		inc_client_id_ref(cb_data->client);
+		cb_data->group = group;
 		cb_data->attempts = 0;
+		group->recalls++;
+		(void) atomic_inc_int32_t(&group->refcount);
 
 		dec_state_owner_ref(owner);
 
-		layoutrecall_one_call(cb_data);
+		layoutrecall_dispatch(cb_data);
 	}
 
  out:
@@ -487,10 +645,32 @@ state_status_t layoutrecall(struct fsal_export *export,
 	/* Free the recall list resources */
 	destroy_recall(recall);
 	obj->obj_ops.put_ref(obj);
+	put_layoutrecall_file_group(group);
 
 	return rc;
 }
 
+/**
+ * @brief How long to wait before recalling again after NFS4ERR_DELAY
+ *
+ * @param[in] attempts Recalls sent so far
+ *
+ * @return The delay.
+ */
+
+static nsecs_elapsed_t layoutrecall_retry_delay(uint32_t attempts)
+{
+	if (attempts < 5)
+		return 0;
+	else if (attempts < 10)
+		return 1 * NS_PER_MSEC;
+	else if (attempts < 20)
+		return 10 * NS_PER_MSEC;
+	else if (attempts < 30)
+		return 100 * NS_PER_MSEC;
+	return 1 * NS_PER_SEC;
+}
+
 /**
  * @brief Free a CB_LAYOUTRECALL
  *
@@ -535,6 +715,7 @@ static int32_t layoutrec_completion(rpc_call_t *call, rpc_call_hook hook,
 	struct fsal_obj_handle *obj = NULL;
 	struct gsh_export *export = NULL;
 	state_owner_t *owner = NULL;
+	uint32_t *outcome;
 	bool ok = false;
 
 	/* Initialize req_ctx */
@@ -564,7 +745,7 @@ static int32_t layoutrec_completion(rpc_call_t *call, rpc_call_hook hook,
 		 */
 		free_layoutrec(&call->cbt.v_u.v4.args.argarray.argarray_val[1]);
 		nfs41_complete_single(call, hook, cb_data, flags);
-		gsh_free(cb_data);
+		layoutrecall_done(cb_data, &cb_data->group->returning);
 		goto out;
 	} else if (call->cbt.v_u.v4.res.status == NFS4ERR_DELAY) {
 		struct timespec current;
@@ -575,16 +756,7 @@ static int32_t layoutrec_completion(rpc_call_t *call, rpc_call_hook hook,
 		    (nfs_param.nfsv4_param.lease_lifetime * NS_PER_SEC)) {
 			goto revoke;
 		}
-		if (cb_data->attempts < 5)
-			delay = 0;
-		else if (cb_data->attempts < 10)
-			delay = 1 * NS_PER_MSEC;
-		else if (cb_data->attempts < 20)
-			delay = 10 * NS_PER_MSEC;
-		else if (cb_data->attempts < 30)
-			delay = 100 * NS_PER_MSEC;
-		else
-			delay = 1 * NS_PER_SEC;
+		delay = layoutrecall_retry_delay(cb_data->attempts);
 
 		/* We don't free the argument here, because we'll be
 		   re-using that to make the queued call. */
@@ -603,16 +775,19 @@ static int32_t layoutrec_completion(rpc_call_t *call, rpc_call_hook hook,
 	state = nfs4_State_Get_Pointer(cb_data->stateid_other);
 
 	ok = get_state_obj_export_owner_refs(state, &obj, &export, &owner);
+	outcome = &cb_data->group->nomatch;
 
 	if (ok) {
 		enum fsal_layoutreturn_circumstance circumstance;
 
 		if (hook == RPC_CALL_COMPLETE &&
 		    call->cbt.v_u.v4.res.status ==
-		    NFS4ERR_NOMATCHING_LAYOUT)
+		    NFS4ERR_NOMATCHING_LAYOUT) {
 			circumstance = circumstance_client;
-		else
+		} else {
 			circumstance = circumstance_revoke;
+			outcome = &cb_data->group->revoked;
+		}
 
 		/**
 		 * @todo This is where you would record that a
@@ -650,7 +825,7 @@ static int32_t layoutrec_completion(rpc_call_t *call, rpc_call_hook hook,
 
 	free_layoutrec(&call->cbt.v_u.v4.args.argarray.argarray_val[1]);
 	nfs41_complete_single(call, hook, cb_data, flags);
-	gsh_free(cb_data);
+	layoutrecall_done(cb_data, outcome);
 
 out:
 	release_root_op_context();
@@ -716,7 +891,8 @@ static void return_one_async(void *arg)
 	}
 
 	release_root_op_context();
-	gsh_free(cb_data);
+	layoutrecall_done(cb_data, ok ? &cb_data->group->revoked
+				      : &cb_data->group->nomatch);
 
 	if (state != NULL) {
 		/* Release the reference taken above */
@@ -816,7 +992,8 @@ static void layoutrecall_one_call(void *arg)
 						      circumstance_revoke,
 						      state, cb_data->segment,
 						      0, NULL, &deleted);
-				gsh_free(cb_data);
+				layoutrecall_done(cb_data,
+						  &cb_data->group->revoked);
 			}
 		} else {
 			++cb_data->attempts;
@@ -825,7 +1002,8 @@ static void layoutrecall_one_call(void *arg)
 		PTHREAD_RWLOCK_unlock(&obj->state_hdl->state_lock);
 
 	} else {
-		gsh_free(cb_data);
+		/* The layout is gone already */
+		layoutrecall_done(cb_data, &cb_data->group->nomatch);
 	}
 
 	release_root_op_context();
@@ -847,6 +1025,467 @@ static void layoutrecall_one_call(void *arg)
 	}
 }
 
+/**
+ * @brief A bulk layout recall, and how its clients answered
+ *
+ * Each client holding a matching layout gets one CB_LAYOUTRECALL, all
+ * of them sent at once.  The recall is over when the last of them has
+ * been answered, or has failed and had its layouts revoked.
+ */
+
+struct layoutrecall_bulk {
+	int32_t refcount;	/*< One per recall in flight, one for the
+				    sender */
+	layouttype4 type;	/*< The layout type recalled */
+	bool all;		/*< LAYOUTRECALL4_ALL rather than FSID */
+	struct timespec start;	/*< When the recall was sent */
+	uint32_t recalls;	/*< Recalls sent */
+	uint32_t returning;	/*< Answered NFS4_OK, will return */
+	uint32_t nomatch;	/*< Held nothing matching */
+	uint32_t revoked;	/*< Failed, layouts revoked */
+};
+
+/**
+ * @brief One client (and file system) to recall from
+ */
+
+struct layoutrecall_bulk_cb {
+	struct layoutrecall_bulk *bulk;
+	nfs_client_id_t *client;	/*< Referenced client */
+	fsal_fsid_t fsid;	/*< File system, for FSID recalls */
+	nfs_cb_argop4 arg;
+	struct timespec first_recall;	/*< Time of first recall */
+	uint32_t attempts;	/*< Number of times we've recalled */
+};
+
+/**
+ * @brief A client holding a layout, as found on the exports
+ */
+
+struct layoutrecall_bulk_target {
+	nfs_client_id_t *client;	/*< Referenced client */
+	fsal_fsid_t fsid;	/*< File system, zero for ALL recalls */
+};
+
+/**
+ * @brief The clients to recall from, as the exports are walked
+ */
+
+struct layoutrecall_bulk_walk {
+	struct fsal_export *fsal_export;	/*< Only its exports, unless
+						    NULL (ALL recalls) */
+	layouttype4 type;
+	uint32_t count;
+	uint32_t size;
+	struct layoutrecall_bulk_target *targets;
+};
+
+static void layoutrecall_bulk_one_call(void *arg);
+
+static void put_layoutrecall_bulk(struct layoutrecall_bulk *bulk)
+{
+	struct timespec done;
+
+	if (atomic_dec_int32_t(&bulk->refcount) != 0)
+		return;
+
+	now(&done);
+	LogEvent(COMPONENT_PNFS,
+		 "Bulk layout recall (%s) over in %" PRIu64
+		 " ms: %" PRIu32 " recalls, %" PRIu32 " returning, %" PRIu32
+		 " holding none, %" PRIu32 " revoked",
+		 bulk->all ? "all" : "fsid",
+		 timespec_diff(&bulk->start, &done) / NS_PER_MSEC,
+		 bulk->recalls, atomic_fetch_uint32_t(&bulk->returning),
+		 atomic_fetch_uint32_t(&bulk->nomatch),
+		 atomic_fetch_uint32_t(&bulk->revoked));
+	gsh_free(bulk);
+}
+
+static void free_layoutrecall_bulk_cb(struct layoutrecall_bulk_cb *cb_data)
+{
+	struct layoutrecall_bulk *bulk = cb_data->bulk;
+
+	dec_client_id_ref(cb_data->client);
+	gsh_free(cb_data);
+	put_layoutrecall_bulk(bulk);
+}
+
+/**
+ * @brief Return a client's layouts covered by a bulk recall
+ *
+ * @param[in] cb_data      The client's recall
+ * @param[in] circumstance Why they are returned
+ */
+
+static void layoutrecall_bulk_return(struct layoutrecall_bulk_cb *cb_data,
+				     enum fsal_layoutreturn_circumstance
+				     circumstance)
+{
+	state_owner_t *clientid_owner = &cb_data->client->cid_owner;
+	struct glist_head *states =
+		&clientid_owner->so_owner.so_nfs4_owner.so_state_list;
+	struct pnfs_segment entire = {
+		.io_mode = LAYOUTIOMODE4_ANY,
+		.offset = 0,
+		.length = NFS4_UINT64_MAX
+	};
+	struct root_op_context root_op_context;
+	struct glist_head *glist, *glistn;
+	struct fsal_obj_handle *obj;
+	struct gsh_export *export;
+	state_t *state, *first;
+	bool deleted;
+	int errcnt = 0;
+
+	init_root_op_context(&root_op_context, NULL, NULL,
+			     0, 0, UNKNOWN_REQUEST);
+	root_op_context.req_ctx.clientid =
+		&clientid_owner->so_owner.so_nfs4_owner.so_clientid;
+
+	/* As in LAYOUTRETURN4_ALL, we restart after each return, and
+	 * push each state to the end of the list so the restart does
+	 * not look at it again first.
+	 */
+ again:
+	PTHREAD_MUTEX_lock(&clientid_owner->so_mutex);
+	first = NULL;
+
+	glist_for_each_safe(glist, glistn, states) {
+		state = glist_entry(glist, state_t, state_owner_list);
+		if (first == NULL)
+			first = state;
+		else if (first == state)
+			break;
+
+		glist_del(&state->state_owner_list);
+		glist_add_tail(states, &state->state_owner_list);
+
+		if (state->state_type != STATE_TYPE_LAYOUT ||
+		    state->state_data.layout.state_layout_type !=
+		    cb_data->bulk->type)
+			continue;
+
+		if (!get_state_obj_export_owner_refs(state, &obj, &export,
+						     NULL))
+			continue;
+
+		if (!cb_data->bulk->all &&
+		    (obj->fsid.major != cb_data->fsid.major ||
+		     obj->fsid.minor != cb_data->fsid.minor)) {
+			put_gsh_export(export);
+			obj->obj_ops.put_ref(obj);
+			continue;
+		}
+
+		inc_state_t_ref(state);
+		PTHREAD_MUTEX_unlock(&clientid_owner->so_mutex);
+
+		root_op_context.req_ctx.ctx_export = export;
+		root_op_context.req_ctx.fsal_export = export->fsal_export;
+
+		deleted = false;
+		PTHREAD_RWLOCK_wrlock(&obj->state_hdl->state_lock);
+		(void) nfs4_return_one_state(obj, LAYOUTRETURN4_FILE,
+					     circumstance, state, entire,
+					     0, NULL, &deleted);
+		PTHREAD_RWLOCK_unlock(&obj->state_hdl->state_lock);
+
+		dec_state_t_ref(state);
+		put_gsh_export(export);
+		obj->obj_ops.put_ref(obj);
+
+		if (!deleted && ++errcnt >= STATE_ERR_MAX) {
+			LogCrit(COMPONENT_PNFS,
+				"Too many layouts could not be returned");
+			goto out;
+		}
+		goto again;
+	}
+
+	PTHREAD_MUTEX_unlock(&clientid_owner->so_mutex);
+
+ out:
+	release_root_op_context();
+}
+
+/**
+ * @brief Revoke a client's layouts once its recall could not be sent
+ *
+ * @param[in] arg The client's recall
+ */
+
+static void layoutrecall_bulk_revoke_async(void *arg)
+{
+	layoutrecall_bulk_return(arg, circumstance_revoke);
+	free_layoutrecall_bulk_cb(arg);
+}
+
+/**
+ * @brief Handle a client's answer to a bulk CB_LAYOUTRECALL
+ *
+ * @param[in] call  The RPC call being completed
+ * @param[in] hook  The hook itself
+ * @param[in] arg   Supplied argument (the client's recall)
+ * @param[in] flags There are no flags.
+ *
+ * @return 0, constantly.
+ */
+
+static int32_t layoutrecall_bulk_completion(rpc_call_t *call,
+					    rpc_call_hook hook, void *arg,
+					    uint32_t flags)
+{
+	struct layoutrecall_bulk_cb *cb_data = arg;
+	nfsstat4 status = call->cbt.v_u.v4.res.status;
+	struct timespec current;
+
+	LogFullDebug(COMPONENT_NFS_CB, "status %d cb_data %p", status,
+		     cb_data);
+
+	nfs41_complete_single(call, hook, cb_data, flags);
+
+	if (hook != RPC_CALL_COMPLETE)
+		goto revoke;
+
+	switch (status) {
+	case NFS4_OK:
+		/* The client will send LAYOUTRETURN of the same scope */
+		atomic_inc_uint32_t(&cb_data->bulk->returning);
+		free_layoutrecall_bulk_cb(cb_data);
+		return 0;
+
+	case NFS4ERR_NOMATCHING_LAYOUT:
+		atomic_inc_uint32_t(&cb_data->bulk->nomatch);
+		layoutrecall_bulk_return(cb_data, circumstance_client);
+		free_layoutrecall_bulk_cb(cb_data);
+		return 0;
+
+	case NFS4ERR_DELAY:
+		now(&current);
+		if (timespec_diff(&cb_data->first_recall, &current) >
+		    (nfs_param.nfsv4_param.lease_lifetime * NS_PER_SEC))
+			break;
+		delayed_submit(layoutrecall_bulk_one_call, cb_data,
+			       layoutrecall_retry_delay(cb_data->attempts));
+		return 0;
+
+	default:
+		break;
+	}
+
+ revoke:
+	atomic_inc_uint32_t(&cb_data->bulk->revoked);
+	layoutrecall_bulk_return(cb_data, circumstance_revoke);
+	free_layoutrecall_bulk_cb(cb_data);
+	return 0;
+}
+
+/**
+ * @brief Send one bulk layoutrecall to one client
+ *
+ * @param[in] arg The client's recall, so we can queue this function
+ *                in delayed_exec for retry on NFS4ERR_DELAY.
+ */
+
+static void layoutrecall_bulk_one_call(void *arg)
+{
+	struct layoutrecall_bulk_cb *cb_data = arg;
+	int code;
+
+	if (cb_data->attempts == 0)
+		now(&cb_data->first_recall);
+
+	code = nfs_rpc_v41_single(cb_data->client, &cb_data->arg, NULL,
+				  layoutrecall_bulk_completion, cb_data, NULL);
+	if (code == 0) {
+		++cb_data->attempts;
+		return;
+	}
+
+	/* As for single files, a client we can't call loses its
+	 * layouts.  This can call into the FSAL, so don't do it while
+	 * the FSAL may be holding locks for the recall.
+	 */
+	LogDebug(COMPONENT_NFS_CB,
+		 "Could not send bulk CB_LAYOUTRECALL, error %d", code);
+	atomic_inc_uint32_t(&cb_data->bulk->revoked);
+	if (cb_data->attempts == 0)
+		delayed_submit(layoutrecall_bulk_revoke_async, cb_data, 0);
+	else
+		layoutrecall_bulk_revoke_async(cb_data);
+}
+
+/**
+ * @brief Note each client holding a matching layout on an export
+ *
+ * @param[in] exp The export
+ * @param[in] arg The walk
+ *
+ * @return true, to go on with the next export.
+ */
+
+static bool layoutrecall_bulk_collect(struct gsh_export *exp, void *arg)
+{
+	struct layoutrecall_bulk_walk *walk = arg;
+	struct layoutrecall_bulk_target *target;
+	struct fsal_obj_handle *obj;
+	struct glist_head *glist;
+	state_owner_t *owner;
+	state_t *state;
+
+	if (walk->fsal_export != NULL && exp->fsal_export != walk->fsal_export)
+		return true;
+
+	PTHREAD_RWLOCK_rdlock(&exp->lock);
+
+	glist_for_each(glist, &exp->exp_state_list) {
+		state = glist_entry(glist, state_t, state_export_list);
+
+		if (state->state_type != STATE_TYPE_LAYOUT ||
+		    state->state_data.layout.state_layout_type != walk->type)
+			continue;
+
+		if (!get_state_obj_export_owner_refs(state, &obj, NULL,
+						     &owner))
+			continue;
+
+		if (walk->count == walk->size) {
+			walk->size = walk->size != 0 ? walk->size * 2 : 64;
+			walk->targets = gsh_realloc(walk->targets,
+						    walk->size *
+						    sizeof(*walk->targets));
+		}
+
+		target = &walk->targets[walk->count++];
+		target->client = owner->so_owner.so_nfs4_owner.so_clientrec;
+		inc_client_id_ref(target->client);
+		if (walk->fsal_export != NULL)
+			target->fsid = obj->fsid;
+		else
+			memset(&target->fsid, 0, sizeof(target->fsid));
+
+		obj->obj_ops.put_ref(obj);
+		dec_state_owner_ref(owner);
+	}
+
+	PTHREAD_RWLOCK_unlock(&exp->lock);
+
+	return true;
+}
+
+static int layoutrecall_bulk_cmp(const void *a, const void *b)
+{
+	const struct layoutrecall_bulk_target *ta = a, *tb = b;
+
+	if (ta->client != tb->client)
+		return ta->client < tb->client ? -1 : 1;
+	if (ta->fsid.major != tb->fsid.major)
+		return ta->fsid.major < tb->fsid.major ? -1 : 1;
+	if (ta->fsid.minor != tb->fsid.minor)
+		return ta->fsid.minor < tb->fsid.minor ? -1 : 1;
+	return 0;
+}
+
+/**
+ * @brief Recall layouts in bulk
+ *
+ * This function sends one CB_LAYOUTRECALL of FSID or ALL scope to
+ * each client holding a layout of the type, rather than one per file.
+ * An FSID recall goes out once for each file system of the export the
+ * client has layouts on.  The recalls are all sent before any answer
+ * is waited for, and a summary is logged once the last is answered.
+ *
+ * A client that fails to answer, or answers other than with NFS4_OK,
+ * NFS4ERR_DELAY or NFS4ERR_NOMATCHING_LAYOUT, has its layouts in the
+ * scope revoked.  There is no cookie, as no one return satisfies the
+ * recall.
+ *
+ * @param[in] export      Export whose layouts to recall; ignored if
+ *                        @c all is set
+ * @param[in] layout_type The type of layout to recall
+ * @param[in] changed     Whether the layouts have changed and the
+ *                        client ought to finish writes through MDS
+ * @param[in] all         Recall the layouts on every export
+ *
+ * @retval STATE_SUCCESS if scheduled.
+ * @retval STATE_NOT_FOUND if no matching layouts exist.
+ */
+static state_status_t layoutrecall_bulk(struct fsal_export *export,
+					layouttype4 layout_type, bool changed,
+					bool all)
+{
+	struct layoutrecall_bulk_walk walk = {
+		.fsal_export = all ? NULL : export,
+		.type = layout_type,
+	};
+	struct layoutrecall_bulk_target *target;
+	struct layoutrecall_bulk_cb *cb_data;
+	struct layoutrecall_bulk *bulk;
+	CB_LAYOUTRECALL4args *cb_layoutrec;
+	uint32_t i;
+
+	(void) foreach_gsh_export(layoutrecall_bulk_collect, &walk);
+
+	if (walk.count == 0) {
+		gsh_free(walk.targets);
+		return STATE_NOT_FOUND;
+	}
+
+	/* One recall per client and file system */
+	qsort(walk.targets, walk.count, sizeof(*walk.targets),
+	      layoutrecall_bulk_cmp);
+
+	bulk = gsh_calloc(1, sizeof(*bulk));
+	bulk->refcount = 1;
+	bulk->type = layout_type;
+	bulk->all = all;
+	now(&bulk->start);
+
+	for (i = 0; i < walk.count; i++) {
+		target = &walk.targets[i];
+		if (i != 0 && layoutrecall_bulk_cmp(target, target - 1) == 0) {
+			dec_client_id_ref(target->client);
+			continue;
+		}
+
+		cb_data = gsh_calloc(1, sizeof(*cb_data));
+		cb_data->bulk = bulk;
+		cb_data->client = target->client;
+		cb_data->fsid = target->fsid;
+
+		cb_data->arg.argop = NFS4_OP_CB_LAYOUTRECALL;
+		cb_layoutrec = &cb_data->arg.nfs_cb_argop4_u.opcblayoutrecall;
+		cb_layoutrec->clora_type = layout_type;
+		cb_layoutrec->clora_iomode = LAYOUTIOMODE4_ANY;
+		cb_layoutrec->clora_changed = changed;
+		if (all) {
+			cb_layoutrec->clora_recall.lor_recalltype =
+				LAYOUTRECALL4_ALL;
+		} else {
+			cb_layoutrec->clora_recall.lor_recalltype =
+				LAYOUTRECALL4_FSID;
+			cb_layoutrec->clora_recall.layoutrecall4_u.lor_fsid
+				.major = target->fsid.major;
+			cb_layoutrec->clora_recall.layoutrecall4_u.lor_fsid
+				.minor = target->fsid.minor;
+		}
+
+		(void) atomic_inc_int32_t(&bulk->refcount);
+		bulk->recalls++;
+		layoutrecall_bulk_one_call(cb_data);
+	}
+
+	LogInfo(COMPONENT_PNFS,
+		"Sent %" PRIu32 " bulk layout recalls (%s)",
+		bulk->recalls, all ? "all" : "fsid");
+
+	gsh_free(walk.targets);
+	put_layoutrecall_bulk(bulk);
+
+	return STATE_SUCCESS;
+}
+
 /**
  * @brief Data for CB_NOTIFY and CB_NOTIFY_DEVICEID response handler
  */
@@ -874,6 +1513,7 @@ static int32_t notifydev_completion(rpc_call_t *call, rpc_call_hook hook,
 {
 	LogFullDebug(COMPONENT_NFS_CB, "status %d arg %p",
 		     call->cbt.v_u.v4.res.status, arg);
+	nfs41_complete_single(call, hook, arg, flags);
 	gsh_free(arg);
 	return 0;
 }
@@ -963,6 +1603,8 @@ state_status_t notify_device(notify_deviceid_type4 notify_type,
 {
 	struct devnotify_cb_data *cb_data;
 
+	pnfs_devinfo_forget(layout_type, &devid);
+
 	cb_data = gsh_malloc(sizeof(struct devnotify_cb_data));
 
 	cb_data->notify_type = notify_type;
@@ -1083,9 +1725,70 @@ static enum recall_resp_action handle_recall_response(
 	return resp_action;
 }
 
+/**
+ * @brief Drop a reference on a recall group, freeing it with the last
+ */
+
+static void put_delegrecall_group(struct delegrecall_group *group)
+{
+	struct timespec end;
+
+	if (atomic_dec_int32_t(&group->dg_outstanding) != 0)
+		return;
+
+	if (group->dg_count != 0) {
+		now(&end);
+		LogDebug(COMPONENT_NFS_CB,
+			 "%"PRIu32" delegation recalls answered in %"PRIu64
+			 " ns", group->dg_count,
+			 timespec_diff(&group->dg_start, &end));
+	}
+
+	gsh_free(group);
+}
+
+/**
+ * @brief Note that the first attempt of a grouped recall is over
+ *
+ * Retries are sent alone and are not part of the group.
+ */
+
+static inline void delegrecall_group_done(struct delegrecall_context *ctx)
+{
+	struct delegrecall_group *group = ctx->drc_group;
+
+	if (group == NULL)
+		return;
+
+	ctx->drc_group = NULL;
+	put_delegrecall_group(group);
+}
+
+/**
+ * @brief Seconds a recall waits for its reply, 0 for the default
+ */
+
+static uint32_t delegrecall_timeout(struct delegrecall_context *ctx)
+{
+	time_t left;
+
+	if (ctx->drc_group == NULL)
+		return 0;
+
+	left = ctx->drc_group->dg_deadline - time(NULL);
+	if (left < 1)
+		return 1;
+	if (left > DELEGRECALL_TIMEOUT)
+		return DELEGRECALL_TIMEOUT;
+
+	return left;
+}
+
 static inline void
 free_delegrecall_context(struct delegrecall_context *deleg_ctx)
 {
+	delegrecall_group_done(deleg_ctx);
+
 	PTHREAD_MUTEX_lock(&deleg_ctx->drc_clid->cid_mutex);
 	update_lease(deleg_ctx->drc_clid);
 	PTHREAD_MUTEX_unlock(&deleg_ctx->drc_clid->cid_mutex);
@@ -1124,6 +1827,8 @@ static int32_t delegrecall_completion_func(rpc_call_t *call,
 	LogDebug(COMPONENT_NFS_CB, "%p %s", call,
 		 (hook == RPC_CALL_COMPLETE) ? "Success" : "Failed");
 
+	delegrecall_group_done(deleg_ctx);
+
 	state = nfs4_State_Get_Pointer(deleg_ctx->drc_stateid.other);
 
 	if (state == NULL) {
@@ -1228,8 +1933,9 @@ out_free:
 /**
  * @brief Send one delegation recall to one client.
  *
- * This function sends a cb_recall for one delegation, the caller has to lock
- * cache_entry->state_lock before calling this function.
+ * This function sends a cb_recall for one delegation.  The caller must not
+ * hold the state_lock, which is taken here if the delegation has to be
+ * revoked.
  *
  * @param[in] obj The file being delegated
  * @param[in] deleg_entry Lock entry covering the delegation
@@ -1243,6 +1949,7 @@ void delegrecall_one(struct fsal_obj_handle *obj,
 	rpc_call_channel_t *chan;
 	rpc_call_t *call = NULL;
 	nfs_cb_argop4 argop[1];
+	nfsstat4 rc;
 	struct cf_deleg_stats *clfl_stats;
 	char str[LOG_BUFF_LEN];
 	struct display_buffer dspbuf = {sizeof(str), str, str};
@@ -1310,6 +2017,7 @@ void delegrecall_one(struct fsal_obj_handle *obj,
 
 	/* set completion hook */
 	call->call_hook = delegrecall_completion_func;
+	call->timeout = delegrecall_timeout(p_cargs);
 
 	/* call it (here, in current thread context)
 	   ret is always 0 for async calls, might change in future */
@@ -1318,6 +2026,7 @@ void delegrecall_one(struct fsal_obj_handle *obj,
 
 out:
 
+	delegrecall_group_done(p_cargs);
 	inc_failed_recalls(p_cargs->drc_clid->gsh_client);
 
 	nfs4_freeFH(&argop->nfs_cb_argop4_u.opcbrecall.fh);
@@ -1343,7 +2052,11 @@ out:
 	p_cargs->drc_clid->num_revokes++;
 	inc_revokes(p_cargs->drc_clid->gsh_client);
 
-	if (deleg_revoke(obj, state) != NFS4_OK) {
+	PTHREAD_RWLOCK_wrlock(&obj->state_hdl->state_lock);
+	rc = deleg_revoke(obj, state);
+	PTHREAD_RWLOCK_unlock(&obj->state_hdl->state_lock);
+
+	if (rc != NFS4_OK) {
 		LogDebug(COMPONENT_FSAL_UP,
 			 "Failed to revoke delegation %s.", str);
 	} else {
@@ -1492,11 +2205,20 @@ state_status_t delegrecall_impl(struct fsal_obj_handle *obj)
 	struct state_t *state;
 	state_owner_t *owner;
 	struct delegrecall_context *drc_ctx;
+	struct delegrecall_group *group;
+	struct glist_head recalls;
 
 	LogDebug(COMPONENT_FSAL_UP,
 		 "FSAL_UP_DELEG: obj %p type %u",
 		 obj, obj->type);
 
+	glist_init(&recalls);
+	group = gsh_calloc(1, sizeof(*group));
+	group->dg_outstanding = 1;
+	now(&group->dg_start);
+	group->dg_deadline = time(NULL) +
+			     MAX(nfs_param.nfsv4_param.lease_lifetime / 2, 1);
+
 	PTHREAD_RWLOCK_wrlock(&obj->state_hdl->state_lock);
 	glist_for_each_safe(glist, glist_n,
 			    &obj->state_hdl->file.list_of_states) {
@@ -1521,7 +2243,7 @@ state_status_t delegrecall_impl(struct fsal_obj_handle *obj)
 		}
 		*deleg_state = DELEG_RECALL_WIP;
 
-		drc_ctx = gsh_malloc(sizeof(struct delegrecall_context));
+		drc_ctx = gsh_calloc(1, sizeof(struct delegrecall_context));
 
 		/* Get references on the owner and the the export. The
 		 * export reference we will hold while we perform the recall.
@@ -1542,7 +2264,7 @@ state_status_t delegrecall_impl(struct fsal_obj_handle *obj)
 		inc_client_id_ref(drc_ctx->drc_clid);
 		dec_state_owner_ref(owner);
 
-		obj->state_hdl->file.fdeleg_stats.fds_last_recall = time(NULL);
+		deleg_heuristics_conflict(obj->state_hdl);
 
 		/* Prevent client's lease expiring until we complete
 		 * this recall/revoke operation. If the client's lease
@@ -1560,9 +2282,36 @@ state_status_t delegrecall_impl(struct fsal_obj_handle *obj)
 		}
 		PTHREAD_MUTEX_unlock(&drc_ctx->drc_clid->cid_mutex);
 
-		delegrecall_one(obj, state, drc_ctx);
+		drc_ctx->drc_group = group;
+		group->dg_outstanding++;
+		group->dg_count++;
+		glist_add_tail(&recalls, &drc_ctx->drc_list);
 	}
 	PTHREAD_RWLOCK_unlock(&obj->state_hdl->state_lock);
+
+	/* Send the recalls without the state_lock, so that holders can
+	 * return their delegations while channels to the others are still
+	 * being set up.  Each recall is only queued here; the callback
+	 * workers send them all at once.
+	 */
+	glist_for_each_safe(glist, glist_n, &recalls) {
+		drc_ctx = glist_entry(glist, struct delegrecall_context,
+				      drc_list);
+		glist_del(&drc_ctx->drc_list);
+
+		state = nfs4_State_Get_Pointer(drc_ctx->drc_stateid.other);
+		if (state == NULL) {
+			LogDebug(COMPONENT_NFS_CB,
+				 "Delegation is already returned");
+			free_delegrecall_context(drc_ctx);
+			continue;
+		}
+
+		delegrecall_one(obj, state, drc_ctx);
+		dec_state_t_ref(state);
+	}
+
+	put_delegrecall_group(group);
 	return rc;
 }
 
@@ -1617,9 +2366,11 @@ struct fsal_up_vector fsal_up_top = {
 	.invalidate = invalidate,
 	.update = update,
 	.layoutrecall = layoutrecall,
+	.layoutrecall_bulk = layoutrecall_bulk,
 	.notify_device = notify_device,
 	.delegrecall = delegrecall,
-	.invalidate_close = invalidate_close
+	.invalidate_close = invalidate_close,
+	.invalidate_batch = invalidate_batch
 };
 
 /** @} */
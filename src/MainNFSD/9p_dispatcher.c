@@ -32,6 +32,10 @@
  * The file that contains the '_9p_dispatcher_thread' routine for ganesha
  * (and all the related stuff).
  *
+ * The dispatcher accepts 9P/TCP connections and spreads them over a
+ * few event threads, _9P_TCP_Event_Threads of them, each waiting on
+ * its connections with epoll and handing complete messages to the
+ * workers.
  */
 #include "config.h"
 #include <stdio.h>
@@ -44,7 +48,7 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
-#include <poll.h>
+#include <sys/epoll.h>
 #include <arpa/inet.h>		/* For inet_ntop() */
 #include "hashtable.h"
 #include "log.h"
@@ -99,242 +103,401 @@ void DispatchWork9P(request_data_t *req)
 }
 
 /**
- * _9p_socket_thread: 9p socket manager.
- *
- * This function is the main loop for the 9p socket manager.
- * One such thread exists per connection.
- *
- * @param Arg the socket number cast as a void * in pthread_create
- *
- * @return NULL
+ * @brief State of a 9P/TCP connection
  *
+ * A connection belongs to one event thread, which alone reads it.  It
+ * holds a reference on the connection until the socket closes; each
+ * request holds another until its worker is done with it.
  */
+struct _9p_tcp_conn {
+	struct _9p_conn conn;
+	char strcaller[INET6_ADDRSTRLEN];
+	unsigned long sequence;
+	char hdr[_9P_HDR_SIZE];	/*< Header, read before the message */
+	char *msg;		/*< Message being read, once its size known */
+	uint32_t msgsize;	/*< Size of the msg buffer */
+	uint32_t readlen;	/*< Bytes of the message read so far */
+};
+
+/**
+ * @brief A 9P/TCP event thread
+ */
+struct _9p_evloop {
+	int epfd;
+	int index;
+};
+
+/* Messages read from a connection before the others get a turn */
+#define _9P_TCP_READ_BATCH 16
+
+#define _9P_TCP_EVENTS 64
+
+static struct _9p_evloop *_9p_evloops;
+static uint32_t _9p_evloop_next;
 
-void *_9p_socket_thread(void *Arg)
+/**
+ * @brief Free a connection once its last reference is gone
+ *
+ * @param[in] conn The connection
+ */
+void _9p_tcp_conn_put(struct _9p_conn *conn)
 {
-	long int tcp_sock = (long int)Arg;
-	int rc = -1;
-	struct pollfd fds[1];
-	int fdcount = 1;
-	static char my_name[MAXNAMLEN + 1];
-	char strcaller[INET6_ADDRSTRLEN];
-	request_data_t *req = NULL;
-	int tag;
-	unsigned long sequence = 0;
-	unsigned int i = 0;
-	char *_9pmsg = NULL;
-	uint32_t msglen;
+	struct _9p_tcp_conn *tconn;
+	int i;
 
-	struct _9p_conn _9p_conn;
-	socklen_t addrpeerlen;
+	if (atomic_dec_uint32_t(&conn->refcount) != 0)
+		return;
 
-	int readlen = 0;
-	int total_readlen = 0;
+	tconn = container_of(conn, struct _9p_tcp_conn, conn);
 
-	snprintf(my_name, MAXNAMLEN, "9p_sock_mgr#fd=%ld", tcp_sock);
-	SetNameFunction(my_name);
+	/* Only now may the descriptor be reused */
+	close(conn->trans_data.sockfd);
 
-	/* Init the struct _9p_conn structure */
-	memset(&_9p_conn, 0, sizeof(_9p_conn));
-	PTHREAD_MUTEX_init(&_9p_conn.sock_lock, NULL);
-	_9p_conn.trans_type = _9P_TCP;
-	_9p_conn.trans_data.sockfd = tcp_sock;
-	for (i = 0; i < FLUSH_BUCKETS; i++) {
-		PTHREAD_MUTEX_init(&_9p_conn.flush_buckets[i].lock, NULL);
-		glist_init(&_9p_conn.flush_buckets[i].list);
-	}
-	atomic_store_uint32_t(&_9p_conn.refcount, 0);
+	_9p_cleanup_fids(conn);
 
-	/* Init the fids pointers array */
-	memset(&_9p_conn.fids, 0, _9P_FID_PER_CONN * sizeof(struct _9p_fid *));
+	if (conn->client != NULL)
+		put_gsh_client(conn->client);
 
-	/* Set initial msize.
-	 * Client may request a lower value during TVERSION */
-	_9p_conn.msize = _9p_param._9p_tcp_msize;
+	for (i = 0; i < FLUSH_BUCKETS; i++)
+		PTHREAD_MUTEX_destroy(&conn->flush_buckets[i].lock);
+	PTHREAD_MUTEX_destroy(&conn->sock_lock);
+	gsh_free(tconn);
+}
 
-	if (gettimeofday(&_9p_conn.birth, NULL) == -1)
-		LogFatal(COMPONENT_9P, "Cannot get connection's time of birth");
+/**
+ * @brief Stop reading a connection
+ *
+ * The socket is shut down at once, so that workers still replying on
+ * it fail instead of blocking, but kept open until the last request on
+ * it is released.
+ */
+static void _9p_tcp_close(struct _9p_evloop *loop,
+			  struct _9p_tcp_conn *tconn)
+{
+	long int tcp_sock = tconn->conn.trans_data.sockfd;
 
-	addrpeerlen = sizeof(_9p_conn.addrpeer);
-	rc = getpeername(tcp_sock, (struct sockaddr *)&_9p_conn.addrpeer,
-			 &addrpeerlen);
-	if (rc == -1) {
-		LogMajor(COMPONENT_9P,
-			 "Cannot get peername to tcp socket for 9p, error %d (%s)",
-			 errno, strerror(errno));
-		/* XXX */
-		strncpy(strcaller, "(unresolved)", INET6_ADDRSTRLEN);
-		strcaller[12] = '\0';
-	} else {
-		switch (_9p_conn.addrpeer.ss_family) {
-		case AF_INET:
-			inet_ntop(_9p_conn.addrpeer.ss_family,
-				  &((struct sockaddr_in *)&_9p_conn.addrpeer)->
-				  sin_addr, strcaller, INET6_ADDRSTRLEN);
-			break;
-		case AF_INET6:
-			inet_ntop(_9p_conn.addrpeer.ss_family,
-				  &((struct sockaddr_in6 *)&_9p_conn.addrpeer)->
-				  sin6_addr, strcaller, INET6_ADDRSTRLEN);
-			break;
-		default:
-			snprintf(strcaller, INET6_ADDRSTRLEN, "BAD ADDRESS");
-			break;
-		}
+	LogEvent(COMPONENT_9P, "Closing connection on socket %lu", tcp_sock);
 
-		LogEvent(COMPONENT_9P, "9p socket #%ld is connected to %s",
-			 tcp_sock, strcaller);
-	}
-	_9p_conn.client = get_gsh_client(&_9p_conn.addrpeer, false);
+	if (epoll_ctl(loop->epfd, EPOLL_CTL_DEL, tcp_sock, NULL) != 0)
+		LogCrit(COMPONENT_9P,
+			"Cannot remove socket %lu from 9P event thread #%d, error %d (%s)",
+			tcp_sock, loop->index, errno, strerror(errno));
+	(void) shutdown(tcp_sock, SHUT_RDWR);
 
-	/* Set up the structure used by poll */
-	memset((char *)fds, 0, sizeof(struct pollfd));
-	fds[0].fd = tcp_sock;
-	fds[0].events =
-	    POLLIN | POLLPRI | POLLRDBAND | POLLRDNORM | POLLRDHUP | POLLHUP |
-	    POLLERR | POLLNVAL;
+	/* Free buffer if we encountered an error
+	 * before we could give it to a worker */
+	if (tconn->msg != NULL)
+		iobuf_free(nfs_iobuf_pool, tconn->msg, tconn->msgsize);
+	tconn->msg = NULL;
 
-	for (;;) {
-		total_readlen = 0;  /* new message */
-		rc = poll(fds, fdcount, -1);
-		if (rc == -1) {
-			/* timeout = -1 => Wait indefinitely for events */
-			/* Interruption if not an issue */
-			if (errno == EINTR)
-				continue;
+	_9p_tcp_conn_put(&tconn->conn);
+}
 
-			LogCrit(COMPONENT_9P,
-				"Got error %u (%s) on fd %ld connect to %s while polling on socket",
-				errno, strerror(errno), tcp_sock, strcaller);
+/**
+ * @brief Read what is available of a message, without blocking
+ *
+ * @param[in,out] tconn The connection
+ * @param[in]     buf   Where the message goes
+ * @param[in]     want  Bytes of the message wanted in all
+ *
+ * @return 1 once they are read, 0 if the socket has no more for now,
+ *         -1 if the connection is lost.
+ */
+static int _9p_tcp_recv(struct _9p_tcp_conn *tconn, char *buf, uint32_t want)
+{
+	long int tcp_sock = tconn->conn.trans_data.sockfd;
+	ssize_t readlen;
+
+	while (tconn->readlen < want) {
+		readlen = recv(tcp_sock, buf + tconn->readlen,
+			       want - tconn->readlen, MSG_DONTWAIT);
+		if (readlen > 0) {
+			tconn->readlen += readlen;
+			continue;
 		}
 
-		if (fds[0].revents & POLLNVAL) {
-			LogEvent(COMPONENT_9P,
-				 "Client %s on socket %lu produced POLLNVAL",
-				 strcaller, tcp_sock);
-			goto end;
-		}
+		if (readlen < 0 && errno == EINTR)
+			continue;
 
-		if (fds[0].revents & (POLLERR | POLLHUP | POLLRDHUP)) {
+		if (readlen < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return 0;
+
+		if (readlen == 0 && tconn->readlen == 0)
 			LogEvent(COMPONENT_9P,
 				 "Client %s on socket %lu has shut down and closed",
-				 strcaller, tcp_sock);
-			goto end;
-		}
+				 tconn->strcaller, tcp_sock);
+		else if (readlen == 0)
+			LogEvent(COMPONENT_9P,
+				 "Premature end for Client %s on socket %lu, total read = %u",
+				 tconn->strcaller, tcp_sock, tconn->readlen);
+		else
+			LogEvent(COMPONENT_9P,
+				 "Read error client %s on socket %lu errno=%d, total read = %u",
+				 tconn->strcaller, tcp_sock, errno,
+				 tconn->readlen);
+		return -1;
+	}
 
-		if (!(fds[0].revents & (POLLIN | POLLRDNORM)))
-			continue;
+	return 1;
+}
 
-		/* Prepare to read the message */
-		_9pmsg = gsh_malloc(_9p_conn.msize);
+/**
+ * @brief Read the messages available on a connection
+ *
+ * A message is read into a pooled buffer of the connection's msize
+ * once its header is in, so an idle connection holds no buffer.
+ * Complete messages are handed to the workers.
+ *
+ * @param[in,out] tconn The connection
+ *
+ * @return false if the connection must be closed.
+ */
+static bool _9p_tcp_read(struct _9p_tcp_conn *tconn)
+{
+	long int tcp_sock = tconn->conn.trans_data.sockfd;
+	request_data_t *req;
+	uint32_t msglen;
+	int tag;
+	int msgs, rc;
 
+	for (msgs = 0; msgs < _9P_TCP_READ_BATCH; msgs++) {
 		/* An incoming 9P request: the msg has a 4 bytes header
 		   showing the size of the msg including the header */
-		readlen = recv(fds[0].fd, _9pmsg,
-			       _9P_HDR_SIZE, MSG_WAITALL);
-		if (readlen != _9P_HDR_SIZE)
-			goto badmsg;
-
-		msglen = *(uint32_t *) _9pmsg;
-		if (msglen > _9p_conn.msize) {
-			LogCrit(COMPONENT_9P,
-				"Message size too big! got %u, max = %u",
-				msglen, _9p_conn.msize);
-			goto end;
+		if (tconn->msg == NULL) {
+			rc = _9p_tcp_recv(tconn, tconn->hdr, _9P_HDR_SIZE);
+			if (rc <= 0)
+				return rc == 0;
+
+			msglen = *(uint32_t *) tconn->hdr;
+			tconn->msgsize = tconn->conn.msize;
+			if (msglen > tconn->msgsize) {
+				LogCrit(COMPONENT_9P,
+					"Message size too big! got %u, max = %u",
+					msglen, tconn->msgsize);
+				return false;
+			}
+			if (msglen < _9P_HDR_SIZE) {
+				LogEvent(COMPONENT_9P,
+					 "Header too small! for client %s on socket %lu: msglen=%u expected=%u",
+					 tconn->strcaller, tcp_sock, msglen,
+					 _9P_HDR_SIZE);
+				return false;
+			}
+
+			tconn->msg = iobuf_alloc(nfs_iobuf_pool,
+						 tconn->msgsize);
+			memcpy(tconn->msg, tconn->hdr, _9P_HDR_SIZE);
 		}
 
+		msglen = *(uint32_t *) tconn->msg;
+		rc = _9p_tcp_recv(tconn, tconn->msg, msglen);
+		if (rc <= 0)
+			return rc == 0;
+
 		LogFullDebug(COMPONENT_9P,
 			     "Received 9P/TCP message of size %u from client %s on socket %lu",
-			     msglen, strcaller, tcp_sock);
-
-		total_readlen += readlen;
-		while (total_readlen < msglen) {
-			readlen = recv(fds[0].fd,
-				       _9pmsg + total_readlen,
-				       msglen - total_readlen,
-				       0);
+			     msglen, tconn->strcaller, tcp_sock);
 
-			if (readlen > 0) {
-				total_readlen += readlen;
-				continue;
-			}
-			if (readlen == 0 ||
-			    (readlen < 0 && errno != EINTR))
-				goto badmsg;
-		}	/* while */
-
-		server_stats_transport_done(_9p_conn.client,
-					    total_readlen, 1, 0,
+		server_stats_transport_done(tconn->conn.client,
+					    msglen, 1, 0,
 					    0, 0, 0);
 
 		/* Message is good. */
 		req = pool_alloc(request_pool);
 
 		req->rtype = _9P_REQUEST;
-		req->r_u._9p._9pmsg = _9pmsg;
-		req->r_u._9p.pconn = &_9p_conn;
+		req->r_u._9p._9pmsg = tconn->msg;
+		req->r_u._9p._9pmsg_size = tconn->msgsize;
+		req->r_u._9p.pconn = &tconn->conn;
 
 		/* Add this request to the request list,
 		 * should it be flushed later. */
-		tag = *(u16 *) (_9pmsg + _9P_HDR_SIZE +
-				_9P_TYPE_SIZE);
-		_9p_AddFlushHook(&req->r_u._9p, tag,
-				 sequence++);
-		LogFullDebug(COMPONENT_9P,
-			     "Request tag is %d\n", tag);
+		tag = *(u16 *) (tconn->msg + _9P_HDR_SIZE + _9P_TYPE_SIZE);
+		_9p_AddFlushHook(&req->r_u._9p, tag, tconn->sequence++);
+		LogFullDebug(COMPONENT_9P, "Request tag is %d\n", tag);
+
+		/* Not our buffer anymore */
+		tconn->msg = NULL;
+		tconn->readlen = 0;
 
 		/* Message was OK push it */
 		DispatchWork9P(req);
+	}
 
-		/* Not our buffer anymore */
-		_9pmsg = NULL;
-		continue;
+	return true;
+}
 
-badmsg:
-		if (readlen == 0)
-			LogEvent(COMPONENT_9P,
-				 "Premature end for Client %s on socket %lu, total read = %u",
-				 strcaller, tcp_sock, total_readlen);
-		else if (readlen < 0) {
-			LogEvent(COMPONENT_9P,
-				 "Read error client %s on socket %lu errno=%d, total read = %u",
-				 strcaller, tcp_sock,
-				 errno, total_readlen);
-		} else
-			LogEvent(COMPONENT_9P,
-				 "Header too small! for client %s on socket %lu: readlen=%u expected=%u",
-				 strcaller, tcp_sock, readlen,
-				 _9P_HDR_SIZE);
-
-		/* Either way, we close the connection.
-		 * It is not possible to survive
-		 * once we get out of sync in the TCP stream
-		 * with the client
-		 */
-		break; /* bail out */
-	}			/* for( ;; ) */
-
-end:
-	LogEvent(COMPONENT_9P, "Closing connection on socket %lu", tcp_sock);
-	close(tcp_sock);
+/**
+ * @brief Main loop of a 9P/TCP event thread
+ *
+ * Waits for any of its connections to become readable, and reads
+ * them.  The socket itself stays blocking, for the workers sending the
+ * replies.
+ *
+ * @param[in] arg The event thread
+ *
+ * @return NULL
+ */
+static void *_9p_evloop_thread(void *arg)
+{
+	struct _9p_evloop *loop = arg;
+	struct epoll_event events[_9P_TCP_EVENTS];
+	struct _9p_tcp_conn *tconn;
+	char my_name[MAXNAMLEN + 1];
+	int n, i;
 
-	/* Free buffer if we encountered an error
-	 * before we could give it to a worker */
-	if (_9pmsg)
-		gsh_free(_9pmsg);
+	snprintf(my_name, MAXNAMLEN, "9p_ev#%d", loop->index);
+	SetNameFunction(my_name);
 
-	while (atomic_fetch_uint32_t(&_9p_conn.refcount)) {
-		LogEvent(COMPONENT_9P, "Waiting for workers to release pconn");
-		sleep(1);
+	for (;;) {
+		n = epoll_wait(loop->epfd, events, _9P_TCP_EVENTS, -1);
+		if (n < 0) {
+			/* Interruption if not an issue */
+			if (errno != EINTR)
+				LogCrit(COMPONENT_9P,
+					"Got error %d (%s) waiting on 9P event thread #%d",
+					errno, strerror(errno), loop->index);
+			continue;
+		}
+
+		for (i = 0; i < n; i++) {
+			tconn = events[i].data.ptr;
+
+			if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+				LogEvent(COMPONENT_9P,
+					 "Client %s on socket %lu has shut down and closed",
+					 tconn->strcaller,
+					 tconn->conn.trans_data.sockfd);
+				_9p_tcp_close(loop, tconn);
+				continue;
+			}
+
+			/* Anything already sent is read before a hang up */
+			if (!_9p_tcp_read(tconn) ||
+			    (events[i].events & EPOLLRDHUP))
+				_9p_tcp_close(loop, tconn);
+		}
 	}
 
-	_9p_cleanup_fids(&_9p_conn);
+	return NULL;
+}
 
-	if (_9p_conn.client != NULL)
-		put_gsh_client(_9p_conn.client);
+/**
+ * @brief Start the 9P/TCP event threads
+ *
+ * @param[in] attr_thr Attributes of the threads
+ */
+static void _9p_evloop_init(pthread_attr_t *attr_thr)
+{
+	uint16_t nloops = _9p_param._9p_tcp_event_threads;
+	pthread_t thrid;
+	int i;
+
+	_9p_evloops = gsh_calloc(nloops, sizeof(*_9p_evloops));
+
+	for (i = 0; i < nloops; i++) {
+		_9p_evloops[i].index = i;
+		_9p_evloops[i].epfd = epoll_create1(EPOLL_CLOEXEC);
+		if (_9p_evloops[i].epfd < 0)
+			LogFatal(COMPONENT_9P_DISPATCH,
+				 "Cannot create 9P event thread #%d, error %d (%s)",
+				 i, errno, strerror(errno));
+
+		if (pthread_create(&thrid, attr_thr, _9p_evloop_thread,
+				   &_9p_evloops[i]) != 0)
+			LogFatal(COMPONENT_THREAD,
+				 "Could not create 9P event thread, error = %d (%s)",
+				 errno, strerror(errno));
+	}
+
+	LogInfo(COMPONENT_9P_DISPATCH, "Started %u 9P/TCP event threads",
+		nloops);
+}
+
+/**
+ * @brief Set up a new connection and give it to an event thread
+ *
+ * @param[in] tcp_sock The accepted socket
+ */
+static void _9p_tcp_conn_new(long int tcp_sock)
+{
+	struct _9p_tcp_conn *tconn;
+	struct _9p_conn *conn;
+	struct _9p_evloop *loop;
+	struct epoll_event ev;
+	socklen_t addrpeerlen;
+	unsigned int i;
+	int rc;
+
+	/* Init the struct _9p_conn structure */
+	tconn = gsh_calloc(1, sizeof(*tconn));
+	conn = &tconn->conn;
+	PTHREAD_MUTEX_init(&conn->sock_lock, NULL);
+	conn->trans_type = _9P_TCP;
+	conn->trans_data.sockfd = tcp_sock;
+	for (i = 0; i < FLUSH_BUCKETS; i++) {
+		PTHREAD_MUTEX_init(&conn->flush_buckets[i].lock, NULL);
+		glist_init(&conn->flush_buckets[i].list);
+	}
+
+	_9p_init_fids(conn);
+
+	/* The reference of the event thread */
+	atomic_store_uint32_t(&conn->refcount, 1);
+
+	/* Set initial msize.
+	 * Client may request a lower value during TVERSION */
+	conn->msize = _9p_param._9p_tcp_msize;
+
+	if (gettimeofday(&conn->birth, NULL) == -1)
+		LogFatal(COMPONENT_9P, "Cannot get connection's time of birth");
+
+	addrpeerlen = sizeof(conn->addrpeer);
+	rc = getpeername(tcp_sock, (struct sockaddr *)&conn->addrpeer,
+			 &addrpeerlen);
+	if (rc == -1) {
+		LogMajor(COMPONENT_9P,
+			 "Cannot get peername to tcp socket for 9p, error %d (%s)",
+			 errno, strerror(errno));
+		strlcpy(tconn->strcaller, "(unresolved)",
+			sizeof(tconn->strcaller));
+	} else {
+		switch (conn->addrpeer.ss_family) {
+		case AF_INET:
+			inet_ntop(conn->addrpeer.ss_family,
+				  &((struct sockaddr_in *)&conn->addrpeer)->
+				  sin_addr, tconn->strcaller, INET6_ADDRSTRLEN);
+			break;
+		case AF_INET6:
+			inet_ntop(conn->addrpeer.ss_family,
+				  &((struct sockaddr_in6 *)&conn->addrpeer)->
+				  sin6_addr, tconn->strcaller,
+				  INET6_ADDRSTRLEN);
+			break;
+		default:
+			snprintf(tconn->strcaller, INET6_ADDRSTRLEN,
+				 "BAD ADDRESS");
+			break;
+		}
 
-	pthread_exit(NULL);
-}				/* _9p_socket_thread */
+		LogEvent(COMPONENT_9P, "9p socket #%ld is connected to %s",
+			 tcp_sock, tconn->strcaller);
+	}
+	conn->client = get_gsh_client(&conn->addrpeer, false);
+
+	/* The event thread may read at once, so this comes last */
+	loop = &_9p_evloops[atomic_inc_uint32_t(&_9p_evloop_next) %
+			    _9p_param._9p_tcp_event_threads];
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN | EPOLLRDHUP;
+	ev.data.ptr = tconn;
+	if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, tcp_sock, &ev) != 0) {
+		LogCrit(COMPONENT_9P,
+			"Cannot add socket %lu to 9P event thread #%d, error %d (%s)",
+			tcp_sock, loop->index, errno, strerror(errno));
+		_9p_tcp_conn_put(conn);
+	}
+}
 
 /**
  * _9p_create_socket_V4 : create the socket and bind for 9P using
@@ -540,10 +703,8 @@ err:
 void *_9p_dispatcher_thread(void *Arg)
 {
 	int _9p_socket;
-	int rc = 0;
 	long int newsock = -1;
 	pthread_attr_t attr_thr;
-	pthread_t tcp_thrid;
 
 	SetNameFunction("_9p_disp");
 
@@ -576,6 +737,8 @@ void *_9p_dispatcher_thread(void *Arg)
 		LogDebug(COMPONENT_9P_DISPATCH,
 			 "can't set pthread's join state");
 
+	_9p_evloop_init(&attr_thr);
+
 	LogEvent(COMPONENT_9P_DISPATCH, "9P dispatcher started");
 
 	while (true) {
@@ -587,14 +750,7 @@ void *_9p_dispatcher_thread(void *Arg)
 			continue;
 		}
 
-		/* Starting the thread dedicated to signal handling */
-		rc = pthread_create(&tcp_thrid, &attr_thr,
-				    _9p_socket_thread, (void *)newsock);
-		if (rc != 0) {
-			LogFatal(COMPONENT_THREAD,
-				 "Could not create 9p socket manager thread, error = %d (%s)",
-				 errno, strerror(errno));
-		}
+		_9p_tcp_conn_new(newsock);
 	}			/* while */
 
 	close(_9p_socket);
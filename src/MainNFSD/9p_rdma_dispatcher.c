@@ -55,6 +55,7 @@
 #include "nfs_dupreq.h"
 #include "nfs_file_handle.h"
 #include "client_mgr.h"
+#include "gsh_numa.h"
 #include "9p.h"
 
 #include <mooshika.h>
@@ -136,14 +137,21 @@ void *_9p_rdma_thread(void *Arg)
 	struct _9p_conn *p_9p_conn = NULL;
 	unsigned int i = 0;
 	int rc = 0;
-	struct _9p_outqueue *outqueue = trans->private_data;
+	struct _9p_rdma_priv_pernic *pernic = trans->private_data;
 	struct sockaddr *addrpeer;
 
 	priv = gsh_calloc(1, sizeof(*priv));
 
 	trans->private_data = priv;
-	priv->pernic = msk_getpd(trans)->private;
-	priv->outqueue = outqueue;
+
+	if (pernic == NULL) {
+		LogMajor(COMPONENT_9P,
+			 "9P/RDMA: no buffers for the device of trans [%p]",
+			 trans);
+		goto error;
+	}
+	priv->pernic = pernic;
+	priv->outqueue = &pernic->outqueue;
 
 	p_9p_conn = gsh_calloc(1, sizeof(*p_9p_conn));
 
@@ -168,10 +176,7 @@ void *_9p_rdma_thread(void *Arg)
 	p_9p_conn->client =
 		get_gsh_client(&p_9p_conn->addrpeer, false);
 
-	/* Init the fids pointers array */
-	memset(&p_9p_conn->fids,
-	       0,
-	       _9P_FID_PER_CONN * sizeof(struct _9p_fid *));
+	_9p_init_fids(p_9p_conn);
 
 	/* Set initial msize.
 	 * Client may request a lower value during TVERSION */
@@ -198,22 +203,57 @@ void *_9p_rdma_thread(void *Arg)
 	pthread_exit(NULL);
 }				/* _9p_rdma_handle_trans */
 
-static void _9p_rdma_setup_pernic(msk_trans_t *trans, uint8_t *outrdmabuf)
+static void _9p_rdma_free_pernic(struct _9p_rdma_priv_pernic *pernic)
+{
+	if (pernic->inmr)
+		msk_dereg_mr(pernic->inmr);
+	if (pernic->outmr)
+		msk_dereg_mr(pernic->outmr);
+	gsh_free(pernic->rdmabuf);
+	gsh_free(pernic->rdata);
+	gsh_free(pernic->outrdmabuf);
+	gsh_free(pernic->wdata);
+	gsh_free(pernic);
+}
+
+/**
+ * @brief Set up the buffers of the device of a new connection
+ *
+ * Done on the first connection through each device.  The buffers are
+ * allocated on the device's NUMA node, and the input buffers are
+ * posted once to the shared receive queue.
+ *
+ * @param[in] trans The new connection
+ *
+ * @return The device's buffers, NULL on failure.
+ */
+static struct _9p_rdma_priv_pernic *_9p_rdma_setup_pernic(msk_trans_t *trans)
 {
-	struct _9p_rdma_priv_pernic *pernic;
+	struct _9p_rdma_priv_pernic *pernic = msk_getpd(trans)->private;
+	size_t insize = (size_t)_9p_param._9p_rdma_inpool_size *
+			_9p_param._9p_rdma_msize;
+	size_t outsize = (size_t)_9p_param._9p_rdma_outpool_size *
+			 _9p_param._9p_rdma_msize;
 	int rc, i;
 
 	/* Do nothing if we already have stuff setup */
-	if (msk_getpd(trans)->private)
-		return;
+	if (pernic)
+		return pernic;
 
 	pernic = gsh_calloc(1, sizeof(*pernic));
 
+	gsh_numa_init();
+	pernic->numa_node =
+		gsh_numa_dev_node(trans->cm_id->verbs->device->ibdev_path);
+	if (pernic->numa_node != GSH_NUMA_NODE_ANY)
+		LogInfo(COMPONENT_9P,
+			"9P/RDMA: buffers of %s on NUMA node %" PRIu32,
+			trans->cm_id->verbs->device->name, pernic->numa_node);
+
 	/* register output buffers */
-	pernic->outmr = msk_reg_mr(trans, outrdmabuf,
-			_9p_param._9p_rdma_outpool_size
-			* _9p_param._9p_rdma_msize,
-			IBV_ACCESS_LOCAL_WRITE);
+	pernic->outrdmabuf = gsh_numa_alloc(outsize, pernic->numa_node);
+	pernic->outmr = msk_reg_mr(trans, pernic->outrdmabuf, outsize,
+				   IBV_ACCESS_LOCAL_WRITE);
 	if (pernic->outmr == NULL) {
 		rc = errno;
 		LogFatal(COMPONENT_9P,
@@ -221,15 +261,29 @@ static void _9p_rdma_setup_pernic(msk_trans_t *trans, uint8_t *outrdmabuf)
 			 strerror(rc), rc);
 	}
 
+	pernic->wdata = gsh_calloc(_9p_param._9p_rdma_outpool_size,
+				   sizeof(*pernic->wdata));
+
+	for (i = 0; i < _9p_param._9p_rdma_outpool_size; i++) {
+		pernic->wdata[i].data = pernic->outrdmabuf +
+					i * _9p_param._9p_rdma_msize;
+		pernic->wdata[i].max_size = _9p_param._9p_rdma_msize;
+		if (i != _9p_param._9p_rdma_outpool_size - 1)
+			pernic->wdata[i].next = &pernic->wdata[i+1];
+		else
+			pernic->wdata[i].next = NULL;
+	}
+
+	PTHREAD_MUTEX_init(&pernic->outqueue.lock, NULL);
+	PTHREAD_COND_init(&pernic->outqueue.cond, NULL);
+	pernic->outqueue.data = pernic->wdata;
+
 	/* register input buffers */
 	/* Alloc rdmabuf */
-	pernic->rdmabuf = gsh_malloc(_9p_param._9p_rdma_inpool_size *
-				     _9p_param._9p_rdma_msize);
+	pernic->rdmabuf = gsh_numa_alloc(insize, pernic->numa_node);
 
 	/* Register rdmabuf */
-	pernic->inmr = msk_reg_mr(trans, pernic->rdmabuf,
-				  _9p_param._9p_rdma_inpool_size
-					* _9p_param._9p_rdma_msize,
+	pernic->inmr = msk_reg_mr(trans, pernic->rdmabuf, insize,
 				  IBV_ACCESS_LOCAL_WRITE);
 	if (pernic->inmr == NULL) {
 		rc = errno;
@@ -257,54 +311,17 @@ static void _9p_rdma_setup_pernic(msk_trans_t *trans, uint8_t *outrdmabuf)
 			LogEvent(COMPONENT_9P,
 				 "9P/RDMA: trans handler could post_recv first byte of data[%u], rc=%u",
 				 i, rc);
-			msk_dereg_mr(pernic->inmr);
-			msk_dereg_mr(pernic->outmr);
-			gsh_free(pernic->rdmabuf);
-			gsh_free(pernic->rdata);
-			gsh_free(pernic);
-			return;
+			PTHREAD_MUTEX_destroy(&pernic->outqueue.lock);
+			PTHREAD_COND_destroy(&pernic->outqueue.cond);
+			_9p_rdma_free_pernic(pernic);
+			return NULL;
 		}
 	}
 
 	msk_getpd(trans)->private = pernic;
+	return pernic;
 }
 
-static void _9p_rdma_setup_global(uint8_t **poutrdmabuf, msk_data_t **pwdata,
-				  struct _9p_outqueue **poutqueue)
-{
-	uint8_t *outrdmabuf;
-	int i;
-	msk_data_t *wdata;
-	struct _9p_outqueue *outqueue;
-
-	outrdmabuf = gsh_malloc(_9p_param._9p_rdma_outpool_size
-				* _9p_param._9p_rdma_msize);
-
-	*poutrdmabuf = outrdmabuf;
-
-	wdata = gsh_malloc(_9p_param._9p_rdma_outpool_size
-			   * sizeof(*wdata));
-
-	for (i = 0; i < _9p_param._9p_rdma_outpool_size; i++) {
-		wdata[i].data = outrdmabuf +
-				i * _9p_param._9p_rdma_msize;
-		wdata[i].max_size = _9p_param._9p_rdma_msize;
-		if (i != _9p_param._9p_rdma_outpool_size - 1)
-			wdata[i].next = &wdata[i+1];
-		else
-			wdata[i].next = NULL;
-	}
-	*pwdata = wdata;
-
-	outqueue = gsh_malloc(sizeof(*outqueue));
-
-	PTHREAD_MUTEX_init(&outqueue->lock, NULL);
-	PTHREAD_COND_init(&outqueue->cond, NULL);
-	outqueue->data = wdata;
-	*poutqueue = outqueue;
-}
-
-
 /**
  * _9p_rdma_dispatcher_thread: 9P/RDMA dispatcher
  *
@@ -322,10 +339,6 @@ void *_9p_rdma_dispatcher_thread(void *Arg)
 	pthread_attr_t attr_thr;
 	pthread_t thrid_handle_trans;
 
-	uint8_t *outrdmabuf = NULL;
-	msk_data_t *wdata;
-	struct _9p_outqueue *outqueue;
-
 #define PORT_MAX_LEN 6
 	char port[PORT_MAX_LEN];
 
@@ -390,20 +403,11 @@ void *_9p_rdma_dispatcher_thread(void *Arg)
 			LogMajor(COMPONENT_9P,
 				 "9P/RDMA : dispatcher failed to accept a new client");
 		else {
-			/* Create output buffers on first connection.
-			 * need it here because we don't want multiple
-			 * children to do this job.
+			/* Set up the device's buffers here rather than in
+			 * the children, so only one of them does it.
 			 */
-			if (!outrdmabuf) {
-				_9p_rdma_setup_global(&outrdmabuf,
-						      &wdata,
-						      &outqueue);
-				/* this means ENOMEM - abort */
-				if (!outrdmabuf || !wdata || !outqueue)
-					break;
-			}
-			_9p_rdma_setup_pernic(child_trans, outrdmabuf);
-			child_trans->private_data = outqueue;
+			child_trans->private_data =
+				_9p_rdma_setup_pernic(child_trans);
 
 			if (pthread_create(&thrid_handle_trans,
 					   &attr_thr,
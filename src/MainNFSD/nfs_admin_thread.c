@@ -42,6 +42,11 @@
 #include "export_mgr.h"
 #include "fsal.h"
 #include "netgroup_cache.h"
+#include "nfs_ip_stats.h"
+#include "uid2grp.h"
+#include "gsh_metrics.h"
+#include "rquota_cache.h"
+#include "peer_load.h"
 #ifdef USE_DBUS
 #include "gsh_dbus.h"
 #endif
@@ -285,12 +290,122 @@ static struct gsh_dbus_method method_purge_netgroups = {
 		 END_ARG_LIST}
 };
 
+/**
+ * @brief Dbus method for getting the worker pool size
+ *
+ * @param[in]  args  Unused
+ * @param[out] reply Current, minimum and maximum number of workers
+ */
+static bool admin_dbus_get_workers(DBusMessageIter *args,
+				   DBusMessage *reply,
+				   DBusError *error)
+{
+	char *errormsg = "Get workers success";
+	bool success = true;
+	DBusMessageIter iter;
+	uint32_t nthreads, min, max;
+
+	dbus_message_iter_init_append(reply, &iter);
+	if (args != NULL) {
+		errormsg = "Get workers takes no arguments.";
+		success = false;
+		LogWarn(COMPONENT_DBUS, "%s", errormsg);
+		goto out;
+	}
+
+	worker_pool_size(&nthreads, &min, &max);
+	dbus_message_iter_append_basic(&iter, DBUS_TYPE_UINT32, &nthreads);
+	dbus_message_iter_append_basic(&iter, DBUS_TYPE_UINT32, &min);
+	dbus_message_iter_append_basic(&iter, DBUS_TYPE_UINT32, &max);
+
+ out:
+	dbus_status_reply(&iter, success, errormsg);
+	return success;
+}
+
+static struct gsh_dbus_method method_get_workers = {
+	.name = "get_workers",
+	.method = admin_dbus_get_workers,
+	.args = {
+		 {.name = "workers",
+		  .type = "u",
+		  .direction = "out",
+		 },
+		 {.name = "min",
+		  .type = "u",
+		  .direction = "out",
+		 },
+		 {.name = "max",
+		  .type = "u",
+		  .direction = "out",
+		 },
+		 STATUS_REPLY,
+		 END_ARG_LIST}
+};
+
+/**
+ * @brief Dbus method for getting dequeue batching statistics
+ *
+ * @param[in]  args  Unused
+ * @param[out] reply Dequeues, requests dequeued and average batch size
+ */
+static bool admin_dbus_get_dequeue_batch(DBusMessageIter *args,
+					 DBusMessage *reply,
+					 DBusError *error)
+{
+	char *errormsg = "Get dequeue batch success";
+	bool success = true;
+	DBusMessageIter iter;
+	uint64_t batches, reqs;
+	double avg;
+
+	dbus_message_iter_init_append(reply, &iter);
+	if (args != NULL) {
+		errormsg = "Get dequeue batch takes no arguments.";
+		success = false;
+		LogWarn(COMPONENT_DBUS, "%s", errormsg);
+		goto out;
+	}
+
+	get_dequeue_batch_stats(&batches, &reqs);
+	avg = batches ? (double)reqs / batches : 0.0;
+	dbus_message_iter_append_basic(&iter, DBUS_TYPE_UINT64, &batches);
+	dbus_message_iter_append_basic(&iter, DBUS_TYPE_UINT64, &reqs);
+	dbus_message_iter_append_basic(&iter, DBUS_TYPE_DOUBLE, &avg);
+
+ out:
+	dbus_status_reply(&iter, success, errormsg);
+	return success;
+}
+
+static struct gsh_dbus_method method_get_dequeue_batch = {
+	.name = "get_dequeue_batch",
+	.method = admin_dbus_get_dequeue_batch,
+	.args = {
+		 {.name = "batches",
+		  .type = "t",
+		  .direction = "out",
+		 },
+		 {.name = "requests",
+		  .type = "t",
+		  .direction = "out",
+		 },
+		 {.name = "average",
+		  .type = "d",
+		  .direction = "out",
+		 },
+		 STATUS_REPLY,
+		 END_ARG_LIST}
+};
+
 static struct gsh_dbus_method *admin_methods[] = {
 	&method_shutdown,
 	&method_grace_period,
 	&method_get_grace,
 	&method_purge_gids,
 	&method_purge_netgroups,
+	&method_get_workers,
+	&method_get_dequeue_batch,
 	NULL
 };
 
@@ -372,6 +487,13 @@ static void do_shutdown(void)
 			 "State asynchronous request system shut down.");
 	}
 
+	rc = metrics_shutdown();
+	if (rc != 0) {
+		LogMajor(COMPONENT_THREAD,
+			 "Error shutting down metrics exporter: %d", rc);
+		disorderly = true;
+	}
+
 	LogEvent(COMPONENT_MAIN, "Stopping request listener threads.");
 	nfs_rpc_dispatch_stop();
 
@@ -396,6 +518,14 @@ static void do_shutdown(void)
 		LogEvent(COMPONENT_THREAD, "Request threads shut down.");
 	}
 
+	rc = nfs_rpc_node_fridges_shutdown();
+	if (rc != 0) {
+		LogMajor(COMPONENT_THREAD,
+			 "Failed to shut down the NUMA node decoder fridges: %d!",
+			 rc);
+		disorderly = true;
+	}
+
 	LogEvent(COMPONENT_MAIN, "Stopping worker threads");
 
 	rc = worker_shutdown();
@@ -409,6 +539,27 @@ static void do_shutdown(void)
 			 "Worker threads successfully shut down.");
 	}
 
+	rc = nfs_inflight_shutdown();
+	if (rc != 0) {
+		LogMajor(COMPONENT_THREAD,
+			 "Error shutting down slow request watchdog: %d", rc);
+		disorderly = true;
+	}
+
+	rc = rquota_cache_shutdown();
+	if (rc != 0) {
+		LogMajor(COMPONENT_THREAD,
+			 "Error shutting down quota cache: %d", rc);
+		disorderly = true;
+	}
+
+	rc = peer_load_shutdown();
+	if (rc != 0) {
+		LogMajor(COMPONENT_THREAD,
+			 "Error shutting down load balancing: %d", rc);
+		disorderly = true;
+	}
+
 	(void)svc_shutdown(SVC_SHUTDOWN_FLAG_NONE);
 
 	rc = general_fridge_shutdown();
@@ -420,6 +571,27 @@ static void do_shutdown(void)
 		LogEvent(COMPONENT_THREAD, "General fridge shut down.");
 	}
 
+	rc = uid2grp_preload_shutdown();
+	if (rc != 0) {
+		LogMajor(COMPONENT_THREAD,
+			 "Error shutting down uid2grp preload thread: %d", rc);
+		disorderly = true;
+	}
+
+	rc = ng_preload_shutdown();
+	if (rc != 0) {
+		LogMajor(COMPONENT_THREAD,
+			 "Error shutting down netgroup preload thread: %d", rc);
+		disorderly = true;
+	}
+
+	rc = nfs_ip_name_shutdown();
+	if (rc != 0) {
+		LogMajor(COMPONENT_THREAD,
+			 "Error shutting down IP/name resolvers: %d", rc);
+		disorderly = true;
+	}
+
 	rc = reaper_shutdown();
 	if (rc != 0) {
 		LogMajor(COMPONENT_THREAD,
@@ -429,6 +601,9 @@ static void do_shutdown(void)
 		LogEvent(COMPONENT_THREAD, "Reaper thread shut down.");
 	}
 
+	LogEvent(COMPONENT_MAIN, "Flushing client recovery records.");
+	nfs4_recovery_shutdown();
+
 	LogEvent(COMPONENT_MAIN, "Removing all exports.");
 	remove_all_exports();
 
@@ -445,9 +620,21 @@ static void do_shutdown(void)
 		LogEvent(COMPONENT_MAIN, "Destroying the FSAL system.");
 		destroy_fsals();
 		LogEvent(COMPONENT_MAIN, "FSAL system destroyed.");
+
+		/* The workers, decoders and FSAL threads that allocated
+		 * from it are gone.  Anything freed later goes straight
+		 * back to the heap.
+		 */
+		iobuf_pool_destroy(nfs_iobuf_pool);
+		nfs_iobuf_pool = NULL;
 	}
 
-	unlink(pidfile_path);
+	/* The pid file is the new server's after a handoff */
+	if (!nfs_rpc_handed_off())
+		unlink(pidfile_path);
+
+	/* Write out what is queued for the log files */
+	log_async_stop();
 }
 
 void *admin_thread(void *UnusedArg)
@@ -0,0 +1,316 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file nfs_inflight.c
+ * @brief Registry of the requests in flight, and slow request logging
+ *
+ * When Slow_Request_Threshold is set, each request is put on a shard
+ * of the registry as it starts executing, and taken off as it is
+ * released.  Workers keep to one shard each, so the shard locks are
+ * seldom contended.  A watchdog thread walks the registry every second
+ * and logs any request older than the threshold, once, with the stage
+ * and FSAL call it is in; the request is logged again with its stage
+ * breakdown when it completes.
+ *
+ * The current NFSv4 op and FSAL call are read from the request's op
+ * context without synchronization.  They only ever point to static
+ * strings, and a stale one is good enough for a report.
+ */
+
+#include "config.h"
+#include <pthread.h>
+#include "log.h"
+#include "nfs_core.h"
+#include "fridgethr.h"
+#include "client_mgr.h"
+#include "abstract_atomic.h"
+
+#define INFLIGHT_SHARDS 16
+#define INFLIGHT_SCAN_DELAY 1	/*< Seconds between watchdog scans */
+
+struct inflight_shard {
+	pthread_mutex_t lock;
+	struct glist_head requests;
+} __attribute__((__aligned__(64)));
+
+static struct inflight_shard inflight[INFLIGHT_SHARDS];
+static uint32_t inflight_next;
+static __thread int32_t inflight_home = -1;
+static struct fridgethr *inflight_fridge;
+
+static const char * const inflight_stage_names[] = {
+	[INFLIGHT_EXECUTE] = "execute",
+	[INFLIGHT_ENCODE] = "encode",
+};
+
+static inline nsecs_elapsed_t inflight_now(void)
+{
+	struct timespec ts;
+
+	now(&ts);
+	return timespec_diff(&ServerBootTime, &ts);
+}
+
+/** When the request arrived, as best known */
+static inline nsecs_elapsed_t inflight_since(request_data_t *reqdata)
+{
+	return reqdata->time_decode != 0 ? reqdata->time_decode
+					 : reqdata->r_u.req.req_ctx.start_time;
+}
+
+/**
+ * @brief Describe a request on the registry
+ *
+ * Called with its shard locked, so the request still holds its client.
+ */
+static void inflight_describe(request_data_t *reqdata, nsecs_elapsed_t when,
+			      struct inflight_info *info)
+{
+	nfs_request_t *reqnfs = &reqdata->r_u.req;
+	struct req_op_context *ctx = &reqnfs->req_ctx;
+	const char *op = ctx->op_name;
+	const char *call = ctx->fsal_call;
+
+	info->xid = reqnfs->svc.rq_xid;
+	info->client = ctx->client != NULL ? ctx->client->hostaddr_str
+					   : "<unknown client>";
+	info->proc = reqnfs->funcdesc->funcname;
+	info->op = op != NULL ? op : "";
+	if (atomic_fetch_uint32_t(&reqnfs->async_state) ==
+	    NFS_ASYNC_SUSPENDED)
+		info->stage = "waiting for I/O";
+	else
+		info->stage = inflight_stage_names[reqdata->inflight_stage];
+	info->fsal_call = call != NULL ? call : "";
+	info->age_ns = when - inflight_since(reqdata);
+}
+
+/**
+ * @brief Put a request on the registry
+ *
+ * Called once the request's op context is set up.
+ *
+ * @param[in,out] reqdata The request
+ */
+void nfs_inflight_start(request_data_t *reqdata)
+{
+	struct inflight_shard *shard;
+
+	if (nfs_param.core_param.slow_request_ms == 0)
+		return;
+
+	if (inflight_home < 0)
+		inflight_home = atomic_inc_uint32_t(&inflight_next) %
+				INFLIGHT_SHARDS;
+
+	reqdata->inflight_shard = inflight_home;
+	reqdata->inflight_stage = INFLIGHT_EXECUTE;
+	reqdata->inflight_logged = false;
+
+	shard = &inflight[inflight_home];
+	PTHREAD_MUTEX_lock(&shard->lock);
+	glist_add_tail(&shard->requests, &reqdata->inflight);
+	PTHREAD_MUTEX_unlock(&shard->lock);
+}
+
+/**
+ * @brief Take a request off the registry, logging it if it was slow
+ *
+ * Called before the request's client and export are released, from
+ * whichever thread finishes the request.
+ *
+ * @param[in,out] reqdata  The request
+ * @param[in]     svc_done When the service was done, 0 if not timed
+ */
+void nfs_inflight_done(request_data_t *reqdata, nsecs_elapsed_t svc_done)
+{
+	struct inflight_shard *shard;
+	struct inflight_info info;
+	nsecs_elapsed_t stop, queued, start, decode;
+
+	if (reqdata->inflight_shard < 0)
+		return;
+
+	shard = &inflight[reqdata->inflight_shard];
+	PTHREAD_MUTEX_lock(&shard->lock);
+	glist_del(&reqdata->inflight);
+	PTHREAD_MUTEX_unlock(&shard->lock);
+	reqdata->inflight_shard = -1;
+
+	stop = inflight_now();
+	if (stop - inflight_since(reqdata) <
+	    nfs_param.core_param.slow_request_ms * NS_PER_MSEC)
+		return;
+
+	/* This thread owns the request now, the client is still held */
+	inflight_describe(reqdata, stop, &info);
+	queued = timespec_diff(&ServerBootTime, &reqdata->time_queued);
+	start = op_ctx->start_time;
+	decode = reqdata->time_decode != 0 ? queued - reqdata->time_decode : 0;
+	if (svc_done == 0)
+		svc_done = stop;
+
+	LogWarn(COMPONENT_DISPATCH,
+		"Slow request xid=%" PRIu32 " from %s: %s%s%s took %" PRIu64
+		" us (decode %" PRIu64 ", queue %" PRIu64 ", execute %" PRIu64
+		", encode %" PRIu64 ")",
+		info.xid, info.client, info.proc, info.op[0] ? " " : "",
+		info.op, info.age_ns / NS_PER_USEC, decode / NS_PER_USEC,
+		op_ctx->queue_wait / NS_PER_USEC,
+		(svc_done - start) / NS_PER_USEC,
+		(stop - svc_done) / NS_PER_USEC);
+}
+
+/**
+ * @brief Report each request in flight
+ *
+ * The callback runs with a shard of the registry locked and must not
+ * block.
+ *
+ * @param[in] cb  Called for each request
+ * @param[in] arg Passed to @a cb
+ */
+void nfs_inflight_foreach(void (*cb)(const struct inflight_info *, void *),
+			  void *arg)
+{
+	struct inflight_info info;
+	struct glist_head *glist;
+	nsecs_elapsed_t when = inflight_now();
+	int i;
+
+	if (nfs_param.core_param.slow_request_ms == 0)
+		return;
+
+	for (i = 0; i < INFLIGHT_SHARDS; i++) {
+		PTHREAD_MUTEX_lock(&inflight[i].lock);
+		glist_for_each(glist, &inflight[i].requests) {
+			inflight_describe(glist_entry(glist, request_data_t,
+						      inflight),
+					  when, &info);
+			cb(&info, arg);
+		}
+		PTHREAD_MUTEX_unlock(&inflight[i].lock);
+	}
+}
+
+static void inflight_log_stuck(const struct inflight_info *info)
+{
+	LogWarn(COMPONENT_DISPATCH,
+		"Request xid=%" PRIu32 " from %s: %s%s%s in flight for %"
+		PRIu64 " ms, in %s%s%s",
+		info->xid, info->client, info->proc, info->op[0] ? " " : "",
+		info->op, info->age_ns / NS_PER_MSEC, info->stage,
+		info->fsal_call[0] ? ", FSAL call " : "", info->fsal_call);
+}
+
+/**
+ * @brief Log the requests over the threshold not yet logged
+ */
+static void inflight_watchdog(struct fridgethr_context *ctx)
+{
+	nsecs_elapsed_t threshold =
+		nfs_param.core_param.slow_request_ms * NS_PER_MSEC;
+	nsecs_elapsed_t when = inflight_now();
+	struct inflight_info info;
+	struct glist_head *glist;
+	request_data_t *reqdata;
+	int i;
+
+	SetNameFunction("inflight");
+
+	for (i = 0; i < INFLIGHT_SHARDS; i++) {
+		PTHREAD_MUTEX_lock(&inflight[i].lock);
+		glist_for_each(glist, &inflight[i].requests) {
+			reqdata = glist_entry(glist, request_data_t, inflight);
+			if (reqdata->inflight_logged ||
+			    when - inflight_since(reqdata) < threshold)
+				continue;
+			reqdata->inflight_logged = true;
+			inflight_describe(reqdata, when, &info);
+			inflight_log_stuck(&info);
+		}
+		PTHREAD_MUTEX_unlock(&inflight[i].lock);
+	}
+}
+
+/**
+ * @brief Set up the registry and start the watchdog
+ *
+ * @return 0 or an error from the fridge.
+ */
+int nfs_inflight_init(void)
+{
+	struct fridgethr_params frp;
+	int i, rc;
+
+	for (i = 0; i < INFLIGHT_SHARDS; i++) {
+		PTHREAD_MUTEX_init(&inflight[i].lock, NULL);
+		glist_init(&inflight[i].requests);
+	}
+
+	if (nfs_param.core_param.slow_request_ms == 0)
+		return 0;
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = 1;
+	frp.thr_min = 1;
+	frp.thread_delay = INFLIGHT_SCAN_DELAY;
+	frp.flavor = fridgethr_flavor_looper;
+
+	rc = fridgethr_init(&inflight_fridge, "inflight", &frp);
+	if (rc != 0) {
+		LogMajor(COMPONENT_DISPATCH,
+			 "Unable to initialize slow request fridge: %d", rc);
+		return rc;
+	}
+
+	rc = fridgethr_submit(inflight_fridge, inflight_watchdog, NULL);
+	if (rc != 0) {
+		LogMajor(COMPONENT_DISPATCH,
+			 "Unable to start slow request watchdog: %d", rc);
+		return rc;
+	}
+
+	LogInfo(COMPONENT_DISPATCH,
+		"Logging requests slower than %" PRIu32 " ms",
+		nfs_param.core_param.slow_request_ms);
+	return 0;
+}
+
+int nfs_inflight_shutdown(void)
+{
+	int rc;
+
+	if (inflight_fridge == NULL)
+		return 0;
+
+	rc = fridgethr_sync_command(inflight_fridge, fridgethr_comm_stop, 120);
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_DISPATCH,
+			 "Shutdown timed out, cancelling threads.");
+		fridgethr_cancel(inflight_fridge);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_DISPATCH,
+			 "Failed shutting down slow request watchdog: %d", rc);
+	}
+	return rc;
+}
@@ -71,6 +71,9 @@
 #include "netgroup_cache.h"
 #include "pnfs_utils.h"
 #include "mdcache.h"
+#include "gsh_metrics.h"
+#include "rquota_cache.h"
+#include "peer_load.h"
 
 
 /* global information exported to all layers (as extern vars) */
@@ -251,6 +254,8 @@ void nfs_print_param_config(void)
 	       nfs_param.core_param.drc.tcp.recycle_expire_s);
 	printf("\tDRC_TCP_Checksum = %u ;\n",
 	       nfs_param.core_param.drc.tcp.checksum);
+	printf("\tDRC_TCP_Hash_Table = %u ;\n",
+	       nfs_param.core_param.drc.tcp.hash_table);
 	printf("\tDRC_UDP_Npart = %u ;\n", nfs_param.core_param.drc.udp.npart);
 	printf("\tDRC_UDP_Size = %u ;\n", nfs_param.core_param.drc.udp.size);
 	printf("\tDRC_UDP_Cachesz = %u ;\n",
@@ -264,9 +269,41 @@ void nfs_print_param_config(void)
 	       (uint64_t) nfs_param.core_param.decoder_fridge_block_timeout);
 	printf("\tBlocked_Lock_Poller_Interval = %" PRIu64 " ;\n",
 	       (uint64_t) nfs_param.core_param.blocked_lock_poller_interval);
+#ifdef _USE_NFS_RDMA
+	printf("\tNFS_RDMA_Port = %u ;\n", nfs_param.core_param.rpc.rdma.port);
+	printf("\tNFS_RDMA_Credits = %" PRIu32 " ;\n",
+	       nfs_param.core_param.rpc.rdma.credits);
+	printf("\tNFS_RDMA_Inline_Size = %" PRIu32 " ;\n",
+	       nfs_param.core_param.rpc.rdma.inline_size);
+	printf("\tNFS_RDMA_Completion_Threads = %" PRIu32 " ;\n",
+	       nfs_param.core_param.rpc.rdma.worker_count);
+#endif
 
+	printf("\tMetrics_Port = %u ;\n", nfs_param.core_param.metrics_port);
+	printf("\tHot_Sample_Rate = %" PRIu32 " ;\n",
+	       nfs_param.core_param.hot_sample_rate);
+	printf("\tSlow_Request_Threshold = %" PRIu32 " ;\n",
+	       nfs_param.core_param.slow_request_ms);
+	printf("\tNSM_Connections = %" PRIu32 " ;\n",
+	       nfs_param.core_param.nsm_connections);
+	printf("\tRQUOTA_Cache_Time = %" PRIu32 " ;\n",
+	       nfs_param.core_param.rquota_cache_time);
+	if (nfs_param.core_param.rquota_prefetch)
+		printf("\tRQUOTA_Cache_Prefetch = true ;\n");
+	else
+		printf("\tRQUOTA_Cache_Prefetch = false ;\n");
 	printf("\tManage_Gids_Expiration = %" PRIu64 " ;\n",
 	       (uint64_t) nfs_param.core_param.manage_gids_expiration);
+	if (nfs_param.core_param.manage_gids_preload)
+		printf("\tManage_Gids_Preload = true ;\n");
+	else
+		printf("\tManage_Gids_Preload = false ;\n");
+	if (nfs_param.core_param.netgroup_preload)
+		printf("\tNetgroup_Preload = true ;\n");
+	else
+		printf("\tNetgroup_Preload = false ;\n");
+	printf("\tNetgroup_Refresh = %" PRIu32 " ;\n",
+	       nfs_param.core_param.netgroup_refresh);
 
 	if (nfs_param.core_param.drop_io_errors)
 		printf("\tDrop_IO_Errors = true ;\n");
@@ -283,6 +320,9 @@ void nfs_print_param_config(void)
 	else
 		printf("\tDrop_Delay_Errors = false ;\n");
 
+	printf("\tExport_Init_Threads = %" PRIu32 " ;\n",
+	       nfs_param.core_param.export_init_threads);
+
 	printf("}\n\n");
 }
 
@@ -345,6 +385,20 @@ int nfs_set_param_from_conf(config_file_t parse_tree,
 	}
 #endif
 
+#ifdef USE_RPC_TLS
+	/* RPC-with-TLS configuration */
+	(void) load_config_from_parse(parse_tree,
+				      &tls_param,
+				      &nfs_param.tls_param,
+				      true,
+				      err_type);
+	if (!config_error_is_harmless(err_type)) {
+		LogCrit(COMPONENT_INIT,
+			"Error while parsing RPC_TLS configuration");
+		return -1;
+	}
+#endif
+
 	/* NFSv4 specific configuration */
 	(void) load_config_from_parse(parse_tree,
 				      &version4_param,
@@ -454,6 +508,24 @@ static void nfs_Start_threads(void)
 	}
 	LogDebug(COMPONENT_THREAD, "sigmgr thread started");
 
+	rc = nfs_inflight_init();
+	if (rc != 0) {
+		LogFatal(COMPONENT_THREAD,
+			 "Could not start the slow request tracker: %d", rc);
+	}
+
+	rc = rquota_cache_init();
+	if (rc != 0) {
+		LogFatal(COMPONENT_THREAD,
+			 "Could not start the quota cache: %d", rc);
+	}
+
+	rc = peer_load_init();
+	if (rc != 0) {
+		LogFatal(COMPONENT_THREAD,
+			 "Could not start load balancing: %d", rc);
+	}
+
 	rc = worker_init();
 	if (rc != 0) {
 		LogFatal(COMPONENT_THREAD, "Could not start worker threads: %d",
@@ -545,6 +617,41 @@ static void nfs_Start_threads(void)
 	}
 	LogEvent(COMPONENT_THREAD, "General fridge was started successfully");
 
+	/* Starting the fridge for parallel COMPOUND segments */
+	rc = nfs4_compound_fridge_init();
+	if (rc != 0) {
+		LogFatal(COMPONENT_THREAD,
+			 "Could not create compound fridge, error = %d (%s)",
+			 errno, strerror(errno));
+	}
+
+	/* Starting the fridge for asynchronous COPY */
+	rc = nfs4_offload_fridge_init();
+	if (rc != 0) {
+		LogFatal(COMPONENT_THREAD,
+			 "Could not create offload fridge, error = %d (%s)",
+			 errno, strerror(errno));
+	}
+
+	/* Starting the uid2grp preload */
+	rc = uid2grp_preload_init();
+	if (rc != 0) {
+		LogFatal(COMPONENT_THREAD,
+			 "Could not create uid2grp preload fridge, error = %d (%s)",
+			 rc, strerror(rc));
+	}
+
+	/* Starting the netgroup preload */
+	rc = ng_preload_init();
+	if (rc != 0) {
+		LogFatal(COMPONENT_THREAD,
+			 "Could not create netgroup preload fridge, error = %d (%s)",
+			 rc, strerror(rc));
+	}
+
+	/* Starting the metrics exporter, which only complains if it
+	 * cannot listen */
+	(void)metrics_init();
 }
 
 /**
@@ -566,6 +673,9 @@ static void nfs_Init(const nfs_start_info_t *p_start_info)
 	gsh_dbus_pkginit();
 	dbus_export_init();
 	dbus_client_init();
+#ifdef _ERROR_INJECTION
+	dbus_err_inject_init();
+#endif
 #endif
 
 	/* acls cache may be needed by exports_pkginit */
@@ -584,6 +694,12 @@ static void nfs_Init(const nfs_start_info_t *p_start_info)
 	request_pool =
 	    pool_basic_init("Request pool", sizeof(request_data_t));
 
+	nfs_iobuf_pool =
+	    iobuf_pool_init("I/O buffer pool",
+			    nfs_param.core_param.iobuf_high_water,
+			    nfs_param.core_param.iobuf_low_water,
+			    nfs_param.core_param.iobuf_depot_max);
+
 	/* If rpcsec_gss is used, set the path to the keytab */
 #ifdef _HAVE_GSSAPI
 #ifdef HAVE_KRB5
@@ -745,10 +861,10 @@ static void nfs_Init(const nfs_start_info_t *p_start_info)
 	/* Save Ganesha thread credentials with Frank's routine for later use */
 	fsal_save_ganesha_credentials();
 
-	/* Create stable storage directory, this needs to be done before
+	/* Set up stable storage, this needs to be done before
 	 * starting the recovery thread.
 	 */
-	nfs4_create_recov_dir();
+	nfs4_recovery_init();
 
 	/* read in the client IDs */
 	nfs4_load_recov_clids(NULL);
@@ -898,9 +1014,9 @@ void nfs_start(nfs_start_info_t *p_start_info)
 	/* Regular exit */
 	LogEvent(COMPONENT_MAIN, "NFS EXIT: regular exit");
 
-	/* if not in grace period, clean up the old state directory */
+	/* if not in grace period, clean up the old state */
 	if (!nfs_in_grace())
-		nfs4_clean_old_recov_dir(v4_old_dir);
+		nfs4_recovery_end_grace();
 
 	Cleanup();
 
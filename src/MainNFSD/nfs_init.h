@@ -103,4 +103,12 @@ enum xprt_stat thr_decode_rpc_request(void *context, SVCXPRT *xprt);
 void *nfs_rdma_dispatcher_thread(void *nullarg);
 #endif
 
+#ifdef USE_RPC_TLS
+/* in nfs_rpc_tls.c */
+
+void nfs_rpc_tls_init(void);
+bool nfs_rpc_tls_probe(struct svc_req *req);
+bool nfs_rpc_tls_start(SVCXPRT *xprt, struct svc_req *req);
+#endif
+
 #endif				/* !NFS_INIT_H */
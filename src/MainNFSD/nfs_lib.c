@@ -63,7 +63,9 @@
 #define TRACEPOINT_PROBE_DYNAMIC_LINKAGE
 
 #include "gsh_lttng/logger.h"
+#include "gsh_lttng/mdcache.h"
 #include "gsh_lttng/nfs_rpc.h"
+#include "gsh_lttng/state.h"
 #endif /* USE_LTTNG */
 
 /* parameters for NFSd startup and default values */
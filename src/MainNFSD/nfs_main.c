@@ -63,7 +63,9 @@
 #define TRACEPOINT_PROBE_DYNAMIC_LINKAGE
 
 #include "gsh_lttng/logger.h"
+#include "gsh_lttng/mdcache.h"
 #include "gsh_lttng/nfs_rpc.h"
+#include "gsh_lttng/state.h"
 #endif /* USE_LTTNG */
 
 /* parameters for NFSd startup and default values */
@@ -82,13 +84,14 @@ int detach_flag = true;
 
 /* command line syntax */
 
-char options[] = "v@L:N:f:p:FRTE:h";
+char options[] = "v@L:N:f:C:p:FRTE:h";
 char usage[] =
 	"Usage: %s [-hd][-L <logfile>][-N <dbg_lvl>][-f <config_file>]\n"
 	"\t[-v]                display version information\n"
 	"\t[-L <logfile>]      set the default logfile for the daemon\n"
 	"\t[-N <dbg_lvl>]      set the verbosity level\n"
 	"\t[-f <config_file>]  set the config file to be used\n"
+	"\t[-C <cache_file>]   cache the parsed config file there\n"
 	"\t[-p <pid_file>]     set the pid file\n"
 	"\t[-F]                the program stays in foreground\n"
 	"\t[-R]                daemon will manage RPCSEC_GSS (default is no RPCSEC_GSS)\n"
@@ -197,6 +200,11 @@ int main(int argc, char *argv[])
 			config_path = main_strdup("config_path", optarg);
 			break;
 
+		case 'C':
+			/* config cache */
+			config_set_cache(optarg);
+			break;
+
 		case 'p':
 			/* PID file */
 			pidfile_path = main_strdup("pidfile_path", optarg);
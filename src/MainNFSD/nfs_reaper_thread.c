@@ -34,6 +34,7 @@
 #include "nfs_core.h"
 #include "log.h"
 #include "fridgethr.h"
+#include "export_mgr.h"
 
 #define REAPER_DELAY 10
 
@@ -41,92 +42,86 @@ unsigned int reaper_delay = REAPER_DELAY;
 
 static struct fridgethr *reaper_fridge;
 
-static int reap_hash_table(hash_table_t *ht_reap)
+/**
+ * @brief Expire the clients whose leases are due
+ *
+ * Visits only the clients the lease wheel says are due.  One renewed
+ * since it was filed is put back under its new expiry.
+ *
+ * @return Number of clients visited.
+ */
+static int reap_expired_clients(void)
 {
-	struct rbt_head *head_rbt;
-	struct hash_data *addr = NULL;
-	uint32_t i;
-	struct rbt_node *pn;
+	time_t now = time(NULL);
 	nfs_client_id_t *client_id;
 	nfs_client_record_t *client_rec;
 	int count = 0;
 
-	/* For each bucket of the requested hashtable */
-	for (i = 0; i < ht_reap->parameter.index_size; i++) {
-		head_rbt = &ht_reap->partitions[i].rbt;
-
-restart:
-		/* acquire mutex */
-		PTHREAD_RWLOCK_wrlock(&ht_reap->partitions[i].lock);
-
-		/* go through all entries in the red-black-tree */
-		RBT_LOOP(head_rbt, pn) {
-			char str[LOG_BUFF_LEN];
-			struct display_buffer dspbuf = {sizeof(str), str, str};
-			bool str_valid = false;
-
-			addr = RBT_OPAQ(pn);
-			client_id = addr->val.addr;
+	/* Each client comes with the wheel's reference */
+	while ((client_id = nfs4_lease_wheel_next(now)) != NULL) {
+		char str[LOG_BUFF_LEN];
+		struct display_buffer dspbuf = {sizeof(str), str, str};
+		bool str_valid = false;
 
-			count++;
-
-			PTHREAD_MUTEX_lock(&client_id->cid_mutex);
+		count++;
 
-			if (valid_lease(client_id)) {
-				PTHREAD_MUTEX_unlock(&client_id->cid_mutex);
-				RBT_INCREMENT(pn);
-				continue;
-			}
+		PTHREAD_MUTEX_lock(&client_id->cid_mutex);
 
-			if (isDebug(COMPONENT_CLIENTID)) {
-				display_client_id_rec(&dspbuf, client_id);
-				LogFullDebug(COMPONENT_CLIENTID,
-					     "Expire index %d %s", i, str);
-				str_valid = true;
-			}
-
-			/* Get the client record */
-			client_rec = client_id->cid_client_record;
+		if (client_id->cid_confirmed == EXPIRED_CLIENT_ID) {
+			/* Already unhashed by someone else */
+			PTHREAD_MUTEX_unlock(&client_id->cid_mutex);
+			dec_client_id_ref(client_id);
+			continue;
+		}
 
-			/* get a ref to client_id as we might drop the
-			 * last reference with expiring.
-			 */
-			inc_client_id_ref(client_id);
+		if (valid_lease(client_id)) {
+			time_t due = lease_expiry(client_id);
 
-			/* if record is STALE, the linkage to client_record is
-			 * removed already. Acquire a ref on client record
-			 * before we drop the mutex on clientid
-			 */
-			if (client_rec != NULL)
-				inc_client_record_ref(client_rec);
 			PTHREAD_MUTEX_unlock(&client_id->cid_mutex);
-			if (client_rec != NULL)
-				PTHREAD_MUTEX_lock(&client_rec->cr_mutex);
+			nfs4_lease_wheel_refile(client_id, due);
+			continue;
+		}
 
-			PTHREAD_RWLOCK_unlock(&ht_reap->partitions[i].lock);
-			nfs_client_id_expire(client_id, false);
+		if (isDebug(COMPONENT_CLIENTID)) {
+			display_client_id_rec(&dspbuf, client_id);
+			LogFullDebug(COMPONENT_CLIENTID,
+				     "Expire %s", str);
+			str_valid = true;
+		}
 
-			if (client_rec != NULL) {
-				PTHREAD_MUTEX_unlock(&client_rec->cr_mutex);
-				dec_client_record_ref(client_rec);
-			}
+		/* Get the client record */
+		client_rec = client_id->cid_client_record;
 
-			if (isFullDebug(COMPONENT_CLIENTID)) {
-				if (!str_valid)
-					display_printf(&dspbuf, "clientid %p",
-						       client_id);
+		/* if record is STALE, the linkage to client_record is
+		 * removed already. Acquire a ref on client record
+		 * before we drop the mutex on clientid
+		 */
+		if (client_rec != NULL)
+			inc_client_record_ref(client_rec);
+		PTHREAD_MUTEX_unlock(&client_id->cid_mutex);
+		if (client_rec != NULL)
+			PTHREAD_MUTEX_lock(&client_rec->cr_mutex);
 
-				LogFullDebug(COMPONENT_CLIENTID,
-					     "Reaper done, expired {%s}", str);
-			}
+		nfs_client_id_expire(client_id, false);
 
-			/* drop our reference to the client_id */
-			dec_client_id_ref(client_id);
+		if (client_rec != NULL) {
+			PTHREAD_MUTEX_unlock(&client_rec->cr_mutex);
+			dec_client_record_ref(client_rec);
+		}
+
+		if (isFullDebug(COMPONENT_CLIENTID)) {
+			if (!str_valid)
+				display_printf(&dspbuf, "clientid %p",
+					       client_id);
 
-			goto restart;
+			LogFullDebug(COMPONENT_CLIENTID,
+				     "Reaper done, expired {%s}", str);
 		}
-		PTHREAD_RWLOCK_unlock(&ht_reap->partitions[i].lock);
+
+		/* drop the wheel's reference to the client_id */
+		dec_client_id_ref(client_id);
 	}
+
 	return count;
 }
 
@@ -216,12 +211,13 @@ static void reaper_run(struct fridgethr_context *ctx)
 	struct reaper_state *rst = ctx->arg;
 
 	SetNameFunction("reaper");
+	nfs4_recovery_poll_grace();
 	rst->in_grace = nfs_in_grace();
 
 	if (!rst->old_state_cleaned) {
 		/* if not in grace period, clean up the old state */
 		if (!rst->in_grace) {
-			nfs4_clean_old_recov_dir(v4_old_dir);
+			nfs4_recovery_end_grace();
 			rst->old_state_cleaned = true;
 		}
 	}
@@ -240,11 +236,11 @@ static void reaper_run(struct fridgethr_context *ctx)
 #endif
 	}
 
-	rst->count =
-	    (reap_hash_table(ht_confirmed_client_id) +
-	     reap_hash_table(ht_unconfirmed_client_id));
+	rst->count = reap_expired_clients();
 
 	rst->count += reap_expired_open_owners();
+
+	export_lazy_sweep();
 }
 
 int reaper_init(void)
@@ -1010,6 +1010,9 @@ int32_t nfs_rpc_dispatch_call(rpc_call_t *call, uint32_t flags)
 	call->states = NFS_CB_CALL_DISPATCH;
 	PTHREAD_MUTEX_unlock(&call->we.mtx);
 
+	if (call->timeout != 0)
+		CB_TIMEOUT.tv_sec = call->timeout;
+
 	/* XXX TI-RPC does the signal masking */
 	PTHREAD_MUTEX_lock(&call->chan->mtx);
 
@@ -1068,31 +1071,60 @@ int32_t nfs_rpc_abort_call(rpc_call_t *call)
 	return 0;
 }
 
+/* Most operations, besides the CB_SEQUENCE, sent in one CB_COMPOUND */
+#define NFS41_CB_BATCH 8
+
+/**
+ * @brief A v4.1 callback waiting for a back channel slot
+ */
+struct nfs41_cb_pending {
+	struct glist_head link;	/*< On the session's cb_pending */
+	nfs_cb_argop4 *op;	/*< The operation, owned by the caller */
+	rpc_call_func completion;
+	void *completion_arg;
+	bool refer_set;		/*< Whether refer is to be sent */
+	struct state_refer refer;
+};
+
+/**
+ * @brief Waiting callbacks sent together on one slot
+ */
+struct nfs41_cb_batch {
+	nfs41_session_t *session;
+	slotid4 slot;
+	bool sent;		/*< Whether the compound was submitted */
+	uint32_t count;
+	struct nfs41_cb_pending *ops[NFS41_CB_BATCH];
+};
+
 /**
  * @brief Construct a CB_COMPOUND for v41
  *
- * This function constructs a compound with a CB_SEQUENCE and one
- * other operation.
+ * This function constructs a compound with a CB_SEQUENCE and the
+ * other operations.
  *
- * @param[in] session Session on whose back channel we make the call
- * @param[in] op      The operation to add
- * @param[in] refer   Referral data, NULL if none
- * @param[in] slot    Slot number to use
+ * @param[in] session      Session on whose back channel we make the call
+ * @param[in] ops          The operations to add
+ * @param[in] nops         How many there are
+ * @param[in] refer        Referral data, NULL if none
+ * @param[in] slot         Slot number to use
+ * @param[in] highest_slot Highest slot in use
  *
  * @return The constructed call or NULL.
  */
-static rpc_call_t *construct_single_call(nfs41_session_t *session,
-					 nfs_cb_argop4 *op,
-					 struct state_refer *refer,
-					 slotid4 slot, slotid4 highest_slot)
+static rpc_call_t *construct_cb_call(nfs41_session_t *session,
+				     nfs_cb_argop4 **ops, uint32_t nops,
+				     struct state_refer *refer,
+				     slotid4 slot, slotid4 highest_slot)
 {
 	rpc_call_t *call = alloc_rpc_call();
 
 	nfs_cb_argop4 sequenceop;
 	CB_SEQUENCE4args *sequence = &sequenceop.nfs_cb_argop4_u.opcbsequence;
+	uint32_t i;
 
 	call->chan = &session->cb_chan;
-	cb_compound_init_v4(&call->cbt, 2,
+	cb_compound_init_v4(&call->cbt, nops + 1,
 			    session->clientid_record->cid_minorversion, 0, NULL,
 			    0);
 	memset(sequence, 0, sizeof(CB_SEQUENCE4args));
@@ -1130,7 +1162,8 @@ static rpc_call_t *construct_single_call(nfs41_session_t *session,
 		    csa_referring_call_lists_val = NULL;
 	}
 	cb_compound_add_op(&call->cbt, &sequenceop);
-	cb_compound_add_op(&call->cbt, op);
+	for (i = 0; i < nops; i++)
+		cb_compound_add_op(&call->cbt, ops[i]);
 
 	return call;
 }
@@ -1162,61 +1195,69 @@ static void free_single_call(rpc_call_t *call)
 	free_rpc_call(call);
 }
 
+/**
+ * @brief Highest callback slot in use
+ *
+ * The caller must hold the cb_mutex.
+ *
+ * @param[in] session Session to look at
+ *
+ * @return The slot, or 0 if none is in use.
+ */
+static slotid4 cb_highest_slot(nfs41_session_t *session)
+{
+	slotid4 cur = MIN(session->back_channel_attrs.ca_maxrequests,
+			  NFS41_CB_SLOTS);
+
+	while (cur-- > 0) {
+		if (session->cb_slots[cur].in_use)
+			return cur;
+	}
+	return 0;
+}
+
 /**
  * @brief Find a callback slot
  *
- * Find and reserve a slot, if we can.  If @c wait is set to true, we
- * wait on the condition variable for a limited time.
+ * Find and reserve a slot, if we can.  If none is free and @c pend is
+ * given, it is queued on the session, to be sent when a slot is
+ * released.  The check and the queueing are done under the cb_mutex,
+ * so a slot can't be released in between.
  *
  * @param[in,out] session      Sesson on which to operate
- * @param[in]     wait         Whether to wait on the condition variable if
- *                             no slot can be found
+ * @param[in]     pend         Callback to queue if no slot can be found
+ *                             (may be NULL)
  * @param[out]    slot         Slot to use
  * @param[out]    highest_slot Highest slot in use
  *
  * @retval false if a slot was not found.
  * @retval true if a slot was found.
  */
-static bool find_cb_slot(nfs41_session_t *session, bool wait, slotid4 *slot,
+static bool find_cb_slot(nfs41_session_t *session,
+			 struct nfs41_cb_pending *pend, slotid4 *slot,
 			 slotid4 *highest_slot)
 {
 	slotid4 cur = 0;
 	bool found = false;
 
 	PTHREAD_MUTEX_lock(&session->cb_mutex);
- retry:
 	for (cur = 0;
 	     cur < MIN(session->back_channel_attrs.ca_maxrequests,
-		       NFS41_NB_SLOTS); ++cur) {
-		if (!(session->cb_slots[cur].in_use) && (!found)) {
+		       NFS41_CB_SLOTS); ++cur) {
+		if (!(session->cb_slots[cur].in_use)) {
 			found = true;
 			*slot = cur;
-			*highest_slot = cur;
-		}
-		if (session->cb_slots[cur].in_use)
-			*highest_slot = cur;
-	}
-
-	if (!found && wait) {
-		struct timespec ts;
-		bool woke = false;
-
-		clock_gettime(CLOCK_REALTIME, &ts);
-		timespec_addms(&ts, 100);
-
-		woke =
-		    (pthread_cond_timedwait
-		     (&session->cb_cond, &session->cb_mutex, &ts) != ETIMEDOUT);
-		if (woke) {
-			wait = false;
-			goto retry;
+			break;
 		}
 	}
 
 	if (found) {
 		session->cb_slots[*slot].in_use = true;
 		++session->cb_slots[*slot].sequence;
+		*highest_slot = cb_highest_slot(session);
 		assert(*slot < session->back_channel_attrs.ca_maxrequests);
+	} else if (pend != NULL) {
+		glist_add_tail(&session->cb_pending, &pend->link);
 	}
 	PTHREAD_MUTEX_unlock(&session->cb_mutex);
 
@@ -1224,7 +1265,52 @@ static bool find_cb_slot(nfs41_session_t *session, bool wait, slotid4 *slot,
 }
 
 /**
- * @brief Release a reserved callback slot and wake waiters
+ * @brief Take the callbacks to send on a freed slot
+ *
+ * A callback with referral data goes alone, as CB_SEQUENCE can only
+ * carry one referring call here; the others are sent in order, as many
+ * as the client takes in a compound.  The caller must hold the
+ * cb_mutex, and there must be callbacks waiting.
+ *
+ * @param[in,out] session Session holding the slot
+ * @param[in]     slot    The slot, still reserved
+ *
+ * @return The batch to send.
+ */
+static struct nfs41_cb_batch *take_cb_pending(nfs41_session_t *session,
+					      slotid4 slot)
+{
+	struct nfs41_cb_batch *batch = gsh_calloc(1, sizeof(*batch));
+	struct nfs41_cb_pending *pend;
+	uint32_t max = NFS41_CB_BATCH;
+
+	if (session->back_channel_attrs.ca_maxoperations <= max)
+		max = MAX(session->back_channel_attrs.ca_maxoperations, 2) - 1;
+
+	batch->session = session;
+	batch->slot = slot;
+	while (batch->count < max && !glist_empty(&session->cb_pending)) {
+		pend = glist_first_entry(&session->cb_pending,
+					 struct nfs41_cb_pending, link);
+		if (pend->refer_set && batch->count != 0)
+			break;
+		glist_del(&pend->link);
+		batch->ops[batch->count++] = pend;
+		if (pend->refer_set)
+			break;
+	}
+
+	return batch;
+}
+
+static void send_cb_batch(struct nfs41_cb_batch *batch,
+			  slotid4 highest_slot);
+
+/**
+ * @brief Release a reserved callback slot
+ *
+ * If callbacks are waiting for a slot, the slot is handed straight
+ * to them instead.
  *
  * @param[in,out] session Session holding slot to release
  * @param[in]     slot    Slot to release
@@ -1233,12 +1319,179 @@ static bool find_cb_slot(nfs41_session_t *session, bool wait, slotid4 *slot,
 
 static void release_cb_slot(nfs41_session_t *session, slotid4 slot, bool sent)
 {
+	struct nfs41_cb_batch *batch = NULL;
+	slotid4 highest_slot = 0;
+
 	PTHREAD_MUTEX_lock(&session->cb_mutex);
-	session->cb_slots[slot].in_use = false;
 	if (!sent)
 		--session->cb_slots[slot].sequence;
-	pthread_cond_broadcast(&session->cb_cond);
+	if (glist_empty(&session->cb_pending)) {
+		session->cb_slots[slot].in_use = false;
+	} else {
+		++session->cb_slots[slot].sequence;
+		batch = take_cb_pending(session, slot);
+		highest_slot = cb_highest_slot(session);
+	}
+	PTHREAD_MUTEX_unlock(&session->cb_mutex);
+
+	if (batch != NULL)
+		send_cb_batch(batch, highest_slot);
+}
+
+/**
+ * @brief Complete one callback of a batch
+ *
+ * The completion function gets a call of its own, looking like a
+ * single call that got @c status back, so it need not know about
+ * batching.  That call holds no slot, and is freed by
+ * nfs41_complete_single as usual.
+ *
+ * @param[in] session Session the callback was meant for
+ * @param[in] pend    The callback, freed here
+ * @param[in] slot    Slot it was sent on
+ * @param[in] hook    How the call went
+ * @param[in] stat    RPC status of the call
+ * @param[in] status  Status the client answered the operation with
+ */
+static void complete_cb_pending(nfs41_session_t *session,
+				struct nfs41_cb_pending *pend, slotid4 slot,
+				rpc_call_hook hook, enum clnt_stat stat,
+				nfsstat4 status)
+{
+	rpc_call_t *call = construct_cb_call(session, &pend->op, 1, NULL,
+					     slot, slot);
+
+	call->flags = NFS_RPC_CALL_NO_SLOT;
+	call->stat = stat;
+	call->cbt.v_u.v4.res.status = status;
+	call->call_hook = pend->completion;
+	call->completion_arg = pend->completion_arg;
+
+	RPC_CALL_HOOK(call, hook, pend->completion_arg, NFS_RPC_CALL_NONE);
+	gsh_free(pend);
+}
+
+/**
+ * @brief Sort out the replies to a batch of callbacks
+ *
+ * Each operation the client got to is completed with its own status.
+ * If the client stopped at an earlier failed operation, the ones it
+ * did not get to are queued again, ahead of the others waiting; if
+ * CB_SEQUENCE or the call itself failed, they all are completed with
+ * the failure.
+ *
+ * @param[in] call  The batch's call
+ * @param[in] hook  How the call went
+ * @param[in] arg   The batch
+ * @param[in] flags There are no flags.
+ *
+ * @return 0, constantly.
+ */
+static int32_t nfs41_complete_batch(rpc_call_t *call, rpc_call_hook hook,
+				    void *arg, uint32_t flags)
+{
+	struct nfs41_cb_batch *batch = arg;
+	nfs41_session_t *session = batch->session;
+	CB_COMPOUND4res *res = &call->cbt.v_u.v4.res;
+	uint32_t nres = res->resarray.resarray_len;
+	struct glist_head resend;
+	nfsstat4 status;
+	uint32_t i;
+
+	/* No reply was decoded */
+	if (call->stat != RPC_SUCCESS)
+		hook = RPC_CALL_ABORT;
+
+	glist_init(&resend);
+	for (i = 0; i < batch->count; i++) {
+		if (hook != RPC_CALL_COMPLETE || nres < 2) {
+			status = res->status;
+		} else if (i + 1 < nres) {
+			status = res->resarray.resarray_val[i + 1].
+				nfs_cb_resop4_u.opcbillegal.status;
+		} else {
+			glist_add_tail(&resend, &batch->ops[i]->link);
+			continue;
+		}
+		complete_cb_pending(session, batch->ops[i], batch->slot,
+				    hook, call->stat, status);
+	}
+
+	if (!glist_empty(&resend)) {
+		PTHREAD_MUTEX_lock(&session->cb_mutex);
+		glist_splice_tail(&resend, &session->cb_pending);
+		glist_splice_tail(&session->cb_pending, &resend);
+		PTHREAD_MUTEX_unlock(&session->cb_mutex);
+	}
+
+	free_single_call(call);
+	release_cb_slot(session, batch->slot, batch->sent);
+	gsh_free(batch);
+	return 0;
+}
+
+/**
+ * @brief Send a batch of callbacks on the slot it was given
+ *
+ * @param[in] batch        The batch
+ * @param[in] highest_slot Highest slot in use
+ */
+static void send_cb_batch(struct nfs41_cb_batch *batch,
+			  slotid4 highest_slot)
+{
+	nfs41_session_t *session = batch->session;
+	nfs_cb_argop4 *ops[NFS41_CB_BATCH];
+	struct state_refer *refer = NULL;
+	rpc_call_t *call;
+	uint32_t i;
+
+	for (i = 0; i < batch->count; i++)
+		ops[i] = batch->ops[i]->op;
+	if (batch->ops[0]->refer_set)
+		refer = &batch->ops[0]->refer;
+
+	LogFullDebug(COMPONENT_NFS_CB,
+		     "Sending %" PRIu32 " waiting callbacks on slot %" PRIu32,
+		     batch->count, batch->slot);
+
+	call = construct_cb_call(session, ops, batch->count, refer,
+				 batch->slot, highest_slot);
+	call->call_hook = nfs41_complete_batch;
+
+	if (session->flags & session_bc_up &&
+	    nfs_rpc_submit_call(call, batch, NFS_RPC_FLAG_NONE) == 0) {
+		batch->sent = true;
+		return;
+	}
+
+	call->stat = RPC_INTR;
+	nfs41_complete_batch(call, RPC_CALL_ABORT, batch, NFS_RPC_CALL_NONE);
+}
+
+/**
+ * @brief Fail the callbacks still waiting on a session
+ *
+ * Called as the session goes away.
+ *
+ * @param[in,out] session The session
+ */
+void nfs41_abort_cb_pending(nfs41_session_t *session)
+{
+	struct nfs41_cb_pending *pend;
+	struct glist_head pending;
+
+	glist_init(&pending);
+	PTHREAD_MUTEX_lock(&session->cb_mutex);
+	glist_splice_tail(&pending, &session->cb_pending);
 	PTHREAD_MUTEX_unlock(&session->cb_mutex);
+
+	while (!glist_empty(&pending)) {
+		pend = glist_first_entry(&pending, struct nfs41_cb_pending,
+					 link);
+		glist_del(&pend->link);
+		complete_cb_pending(session, pend, 0, RPC_CALL_ABORT, RPC_INTR,
+				    NFS4ERR_BADSESSION);
+	}
 }
 
 /**
@@ -1249,6 +1502,12 @@ static void release_cb_slot(nfs41_session_t *session, slotid4 slot, bool sent)
  * details of CB_SEQUENCE management, finding a connection with a
  * working back channel, and so forth.
  *
+ * The caller is never made to wait for a slot.  If every slot of every
+ * working back channel is in use, the operation is queued on the first
+ * session and sent, batched with others queued there, as a slot is
+ * released; its completion function is called then, and the op must
+ * stay valid until it is.
+ *
  * @note This should work for most practical purposes, but is not
  * ideal.  What we ought to have is a per-clientid queue that
  * operations can be submitted to that will be sent when a
@@ -1278,6 +1537,7 @@ int nfs_rpc_v41_single(nfs_client_id_t *clientid, nfs_cb_argop4 *op,
 	int scan = 0;
 	bool sent = false;
 	struct glist_head *glist = NULL;
+	struct nfs41_cb_pending *pend = NULL;
 
 	if (clientid->cid_minorversion < 1)
 		return EINVAL;
@@ -1296,13 +1556,29 @@ int nfs_rpc_v41_single(nfs_client_id_t *clientid, nfs_cb_argop4 *op,
 			rpc_call_t *call = NULL;
 			int code = 0;
 
-			if (!(find_cb_slot(session, scan == 1, &slot,
+			if (scan == 1 && pend == NULL) {
+				pend = gsh_calloc(1, sizeof(*pend));
+				pend->op = op;
+				pend->completion = completion;
+				pend->completion_arg = completion_arg;
+				if (refer) {
+					pend->refer_set = true;
+					pend->refer = *refer;
+				}
+			}
+
+			if (!(find_cb_slot(session, pend, &slot,
 					   &highest_slot))) {
-				continue;
+				if (pend == NULL)
+					continue;
+				/* Queued, to be sent as a slot frees */
+				sent = true;
+				pend = NULL;
+				goto out;
 			}
 
-			call = construct_single_call(session, op, refer, slot,
-						     highest_slot);
+			call = construct_cb_call(session, &op, 1, refer, slot,
+						 highest_slot);
 
 			call->call_hook = completion;
 			code = nfs_rpc_submit_call(call, completion_arg,
@@ -1324,6 +1600,7 @@ int nfs_rpc_v41_single(nfs_client_id_t *clientid, nfs_cb_argop4 *op,
 	}
 
  out:
+	gsh_free(pend);
 	return (sent) ? 0 : ENOTCONN;
 }
 
@@ -1334,9 +1611,11 @@ int nfs_rpc_v41_single(nfs_client_id_t *clientid, nfs_cb_argop4 *op,
 void nfs41_complete_single(rpc_call_t *call, rpc_call_hook hook, void *arg,
 			   uint32_t flags)
 {
-	release_cb_slot(call->chan->source.session,
-			call->cbt.v_u.v4.args.argarray.argarray_val[0]
-			.nfs_cb_argop4_u.opcbsequence.csa_slotid, true);
+	if (!(call->flags & NFS_RPC_CALL_NO_SLOT))
+		release_cb_slot(call->chan->source.session,
+				call->cbt.v_u.v4.args.argarray.argarray_val[0]
+				.nfs_cb_argop4_u.opcbsequence.csa_slotid,
+				true);
 	free_single_call(call);
 }
 
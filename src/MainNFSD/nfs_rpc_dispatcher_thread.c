@@ -35,6 +35,9 @@
 #include <fcntl.h>
 #include <sys/file.h>		/* for having FNDELAY */
 #include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
 #include <poll.h>
 #ifdef RPC_VSOCK
 #include <sys/types.h>
@@ -60,6 +63,13 @@
 #include "nfs_dupreq.h"
 #include "nfs_file_handle.h"
 #include "fridgethr.h"
+#include "client_mgr.h"
+#include "gsh_metrics.h"
+#include "sal_functions.h"
+#include "nfs_qos.h"
+#ifdef USE_LTTNG
+#include "gsh_lttng/nfs_rpc.h"
+#endif
 
 /**
  * TI-RPC event channels.  Each channel is a thread servicing an event
@@ -77,17 +87,20 @@ struct rpc_evchan {
 #define TCP_RDVS_CHAN     1	/*< Accepts new tcp connections */
 #define TCP_EVCHAN_0      2
 #define N_EVENT_CHAN (N_TCP_EVENT_CHAN + 2)
+#define TCP_LISTEN_CHAN_0 N_EVENT_CHAN	/*< Accepts of the extra listeners */
 
-static struct rpc_evchan rpc_evchan[N_EVENT_CHAN];
+static struct rpc_evchan rpc_evchan[N_EVENT_CHAN + RPC_TCP_LISTENERS_MAX - 1];
 
 struct fridgethr *req_fridge;	/*< Decoder thread pool */
+static struct fridgethr **node_fridge;	/*< Decoders per NUMA node */
 struct nfs_req_st nfs_req_st;	/*< Shared request queues */
 
 const char *req_q_s[N_REQ_QUEUES] = {
 	"REQ_Q_MOUNT",
 	"REQ_Q_CALL",
 	"REQ_Q_LOW_LATENCY",
-	"REQ_Q_HIGH_LATENCY"
+	"REQ_Q_HIGH_LATENCY",
+	"REQ_Q_RECLAIM"
 };
 
 static u_int nfs_rpc_recv_user_data(SVCXPRT *xprt, SVCXPRT *newxprt,
@@ -148,6 +161,15 @@ int tcp_socket[P_COUNT];
 SVCXPRT *udp_xprt[P_COUNT];
 SVCXPRT *tcp_xprt[P_COUNT];
 
+/* Extra NFS TCP listeners, see RPC_TCP_Listeners.  They share the port
+ * of tcp_socket[P_NFS] by SO_REUSEPORT, so that the kernel spreads the
+ * incoming connections over them, and each accepts on its own event
+ * channel.
+ */
+static int tcp_listen_socket[RPC_TCP_LISTENERS_MAX - 1];
+static SVCXPRT *tcp_listen_xprt[RPC_TCP_LISTENERS_MAX - 1];
+static uint32_t n_tcp_listen;	/*< Extra listeners in use */
+
 /* Flag to indicate if V6 interfaces on the host are enabled */
 bool v6disabled;
 bool vsock;
@@ -239,6 +261,7 @@ static inline bool nfs_protocol_enabled(protos p)
 static void close_rpc_fd(void)
 {
 	protos p;
+	uint32_t ix;
 
 	for (p = P_NFS; p < P_COUNT; p++) {
 		if (udp_socket[p] != -1)
@@ -246,6 +269,8 @@ static void close_rpc_fd(void)
 		if (tcp_socket[p] != -1)
 			close(tcp_socket[p]);
 	}
+	for (ix = 0; ix < n_tcp_listen; ix++)
+		close(tcp_listen_socket[ix]);
 	if (vsock)
 		close(tcp_socket[P_NFS_VSOCK]);
 }
@@ -278,37 +303,80 @@ void Create_udp(protos prot)
 				  udp_xprt[prot], SVC_RQST_FLAG_XPRT_UREG);
 }
 
-void Create_tcp(protos prot)
+/**
+ * @brief Create the SVCXPRT of a listening TCP socket
+ *
+ * @param[in] fd   Socket, bound
+ * @param[in] chan Event channel accepting its connections
+ * @param[in] prot Protocol, for the logs
+ *
+ * @return The transport.
+ */
+static SVCXPRT *create_tcp_listener(int fd, uint32_t chan, protos prot)
 {
-	tcp_xprt[prot] =
-		svc_vc_create2(tcp_socket[prot],
-			       nfs_param.core_param.rpc.max_send_buffer_size,
-			       nfs_param.core_param.rpc.max_recv_buffer_size,
-			       SVC_VC_CREATE_LISTEN);
-	if (tcp_xprt[prot] == NULL)
+	SVCXPRT *xprt;
+
+	xprt = svc_vc_create2(fd,
+			      nfs_param.core_param.rpc.max_send_buffer_size,
+			      nfs_param.core_param.rpc.max_recv_buffer_size,
+			      SVC_VC_CREATE_LISTEN);
+	if (xprt == NULL)
 		LogFatal(COMPONENT_DISPATCH, "Cannot allocate %s/TCP SVCXPRT",
 			 tags[prot]);
 
 	/* bind xprt to channel--unregister it from the global event
 	 * channel (if applicable) */
-	(void)svc_rqst_evchan_reg(rpc_evchan[TCP_RDVS_CHAN].chan_id,
-				  tcp_xprt[prot], SVC_RQST_FLAG_XPRT_UREG);
+	(void)svc_rqst_evchan_reg(rpc_evchan[chan].chan_id, xprt,
+				  SVC_RQST_FLAG_XPRT_UREG);
 
 	/* Hook xp_getreq */
-	(void)SVC_CONTROL(tcp_xprt[prot], SVCSET_XP_GETREQ, nfs_rpc_getreq_ng);
+	(void)SVC_CONTROL(xprt, SVCSET_XP_GETREQ, nfs_rpc_getreq_ng);
 
 	/* Hook xp_recv_user_data -- allocate new xprts to event channels */
-	(void)SVC_CONTROL(tcp_xprt[prot], SVCSET_XP_RECV_USER_DATA,
+	(void)SVC_CONTROL(xprt, SVCSET_XP_RECV_USER_DATA,
 			  nfs_rpc_recv_user_data);
 
 	/* Hook xp_free_user_data (finalize/free private data) */
-	(void)SVC_CONTROL(tcp_xprt[prot], SVCSET_XP_FREE_USER_DATA,
+	(void)SVC_CONTROL(xprt, SVCSET_XP_FREE_USER_DATA,
 			  nfs_rpc_free_user_data);
 
 	/* Setup private data */
-	(tcp_xprt[prot])->xp_u1 =
-		alloc_gsh_xprt_private(tcp_xprt[prot],
-				       XPRT_PRIVATE_FLAG_NONE);
+	xprt->xp_u1 = alloc_gsh_xprt_private(xprt, XPRT_PRIVATE_FLAG_NONE);
+
+	return xprt;
+}
+
+void Create_tcp(protos prot)
+{
+	tcp_xprt[prot] = create_tcp_listener(tcp_socket[prot], TCP_RDVS_CHAN,
+					     prot);
+}
+
+/**
+ * @brief Create the SVCXPRTs of the extra NFS TCP listeners
+ *
+ * With Dispatch_NUMA_Affinity, the connections a listener accepts
+ * are decoded on its node rather than spread over the nodes.
+ */
+static void create_tcp_listeners(void)
+{
+	gsh_xprt_private_t *xu;
+	uint32_t ix;
+
+	for (ix = 0; ix < n_tcp_listen; ix++)
+		tcp_listen_xprt[ix] =
+			create_tcp_listener(tcp_listen_socket[ix],
+					    TCP_LISTEN_CHAN_0 + ix, P_NFS);
+
+	if (!node_fridge || n_tcp_listen == 0)
+		return;
+
+	xu = tcp_xprt[P_NFS]->xp_u1;
+	xu->numa_node = 0;
+	for (ix = 0; ix < n_tcp_listen; ix++) {
+		xu = tcp_listen_xprt[ix]->xp_u1;
+		xu->numa_node = (ix + 1) % nfs_req_st.reqs.n_shards;
+	}
 }
 
 void create_vsock(void)
@@ -360,6 +428,7 @@ void Create_SVCXPRTs(void)
 			Create_udp(p);
 			Create_tcp(p);
 		}
+	create_tcp_listeners();
 #ifdef RPC_VSOCK
 	if (vsock)
 		create_vsock();
@@ -564,6 +633,27 @@ int bind_sockets_vsock(void)
 }
 #endif /* RPC_VSOCK */
 
+/**
+ * @brief Bind the extra NFS TCP listeners to the address of the first
+ */
+static void bind_tcp_listeners(void)
+{
+	proto_data *pdatap = &pdata[P_NFS];
+	uint32_t ix;
+	int rc;
+
+	for (ix = 0; ix < n_tcp_listen; ix++) {
+		rc = bind(tcp_listen_socket[ix],
+			  (struct sockaddr *)pdatap->bindaddr_tcp6.addr.buf,
+			  (socklen_t) pdatap->si_tcp6.si_alen);
+		if (rc == -1)
+			LogFatal(COMPONENT_DISPATCH,
+				 "Cannot bind %s tcp listener %" PRIu32
+				 ", error %d(%s)",
+				 tags[P_NFS], ix + 1, errno, strerror(errno));
+	}
+}
+
 void Bind_sockets(void)
 {
 	int rc = 0;
@@ -583,6 +673,7 @@ void Bind_sockets(void)
 			LogFatal(COMPONENT_DISPATCH,
 				 "Error binding to V6 interface. Cannot continue.");
 	}
+	bind_tcp_listeners();
 #ifdef RPC_VSOCK
 	if (vsock) {
 		rc = bind_sockets_vsock();
@@ -707,6 +798,48 @@ static int allocate_socket_vsock(void)
 }
 #endif /* RPC_VSOCK */
 
+/**
+ * @brief Allocate the extra NFS TCP listeners
+ *
+ * The first listener, tcp_socket[P_NFS], has to allow SO_REUSEPORT
+ * too, before it is bound.
+ */
+static void allocate_tcp_listeners(void)
+{
+	int one = 1;
+	uint32_t ix;
+
+	if (n_tcp_listen == 0)
+		return;
+
+	if (setsockopt(tcp_socket[P_NFS], SOL_SOCKET, SO_REUSEPORT,
+		       &one, sizeof(one)))
+		LogFatal(COMPONENT_DISPATCH,
+			 "Cannot set SO_REUSEPORT for %s, error %d(%s)",
+			 tags[P_NFS], errno, strerror(errno));
+
+	for (ix = 0; ix < n_tcp_listen; ix++) {
+		tcp_listen_socket[ix] = socket(v6disabled ? AF_INET : AF_INET6,
+					       SOCK_STREAM, IPPROTO_TCP);
+		if (tcp_listen_socket[ix] == -1)
+			LogFatal(COMPONENT_DISPATCH,
+				 "Cannot allocate %s tcp listener %" PRIu32
+				 ", error %d(%s)",
+				 tags[P_NFS], ix + 1, errno, strerror(errno));
+
+		if (setsockopt(tcp_listen_socket[ix], SOL_SOCKET,
+			       SO_REUSEADDR, &one, sizeof(one)) ||
+		    setsockopt(tcp_listen_socket[ix], SOL_SOCKET,
+			       SO_REUSEPORT, &one, sizeof(one)))
+			LogFatal(COMPONENT_DISPATCH,
+				 "Bad tcp listener options for %s, error %d(%s)",
+				 tags[P_NFS], errno, strerror(errno));
+	}
+
+	LogInfo(COMPONENT_DISPATCH, "%" PRIu32 " %s tcp listeners",
+		n_tcp_listen + 1, tags[P_NFS]);
+}
+
 /**
  * @brief Allocate the tcp and udp sockets for the nfs daemon
  */
@@ -788,12 +921,358 @@ try_V4:
 			}
 		}
 	}
+	allocate_tcp_listeners();
 #ifdef RPC_VSOCK
 	if (vsock)
 		allocate_socket_vsock();
 #endif /* RPC_VSOCK */
 }
 
+/* Hot restart, see Handoff_Socket.  A server starting connects to the
+ * Unix socket of the one running and is passed all its listening
+ * sockets by SCM_RIGHTS, then the running one shuts down.  The
+ * listening sockets are never closed in between, so connections to
+ * the server ports queue instead of being refused; those the old
+ * server had are closed with it and the clients reconnect.
+ */
+#define HANDOFF_MAGIC 0x47534848	/* "GSHH" */
+#define HANDOFF_VERSION 1
+#define HANDOFF_MAX_FDS (2 * P_COUNT + RPC_TCP_LISTENERS_MAX)
+
+/**
+ * @brief The handoff request, and reply with the sockets passed
+ */
+struct handoff_msg {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t v6disabled;
+	uint32_t n_tcp_listen;
+	int32_t udp[P_COUNT];	/*< Index among the fds passed, or -1 */
+	int32_t tcp[P_COUNT];
+	int32_t listen0;	/*< Index of the first extra listener */
+};
+
+static int handoff_fd = -1;	/*< Listening for a new server */
+static pthread_t handoff_thread_id;
+static bool handed_off;		/*< Set once a new server has the sockets */
+
+static inline bool handoff_udp(protos p)
+{
+	return nfs_protocol_enabled(p);
+}
+
+static inline bool handoff_tcp(protos p)
+{
+	return p == P_NFS_VSOCK ? vsock : nfs_protocol_enabled(p);
+}
+
+static bool handoff_addr(struct sockaddr_un *addr)
+{
+	const char *path = nfs_param.core_param.handoff_socket;
+
+	if (path == NULL ||
+	    (nfs_param.core_param.core_options & CORE_OPTION_ALL_NFS_VERS)
+	    == 0)
+		return false;
+
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	if (strlcpy(addr->sun_path, path, sizeof(addr->sun_path)) >=
+	    sizeof(addr->sun_path)) {
+		LogCrit(COMPONENT_DISPATCH,
+			"Handoff_Socket %s is too long", path);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Pass the listening sockets to a new server
+ *
+ * @param[in] conn Connection from the new server
+ *
+ * @return true if it took them.
+ */
+static bool handoff_send(int conn)
+{
+	struct handoff_msg msg;
+	int fds[HANDOFF_MAX_FDS];
+	char cbuf[CMSG_SPACE(sizeof(fds))];
+	struct iovec iov = {.iov_base = &msg, .iov_len = sizeof(msg)};
+	struct msghdr mh;
+	struct cmsghdr *cmsg;
+	uint32_t n_fds = 0, ix;
+	uint8_t ack = 0;
+	protos p;
+
+	if (recv(conn, &msg, sizeof(msg), MSG_WAITALL) != sizeof(msg) ||
+	    msg.magic != HANDOFF_MAGIC || msg.version != HANDOFF_VERSION) {
+		LogWarn(COMPONENT_DISPATCH, "Ignoring bad handoff request");
+		return false;
+	}
+
+	memset(&msg, 0, sizeof(msg));
+	msg.magic = HANDOFF_MAGIC;
+	msg.version = HANDOFF_VERSION;
+	msg.v6disabled = v6disabled;
+	msg.n_tcp_listen = n_tcp_listen;
+	for (p = P_NFS; p < P_COUNT; p++) {
+		msg.udp[p] = -1;
+		msg.tcp[p] = -1;
+		if (handoff_udp(p)) {
+			msg.udp[p] = n_fds;
+			fds[n_fds++] = udp_socket[p];
+		}
+		if (handoff_tcp(p)) {
+			msg.tcp[p] = n_fds;
+			fds[n_fds++] = tcp_socket[p];
+		}
+	}
+	msg.listen0 = n_fds;
+	for (ix = 0; ix < n_tcp_listen; ix++)
+		fds[n_fds++] = tcp_listen_socket[ix];
+
+	memset(&mh, 0, sizeof(mh));
+	mh.msg_iov = &iov;
+	mh.msg_iovlen = 1;
+	mh.msg_control = cbuf;
+	mh.msg_controllen = CMSG_SPACE(n_fds * sizeof(int));
+	cmsg = CMSG_FIRSTHDR(&mh);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(n_fds * sizeof(int));
+	memcpy(CMSG_DATA(cmsg), fds, n_fds * sizeof(int));
+
+	if (sendmsg(conn, &mh, MSG_NOSIGNAL) != sizeof(msg)) {
+		LogWarn(COMPONENT_DISPATCH,
+			"Cannot pass the sockets, error %d(%s)",
+			errno, strerror(errno));
+		return false;
+	}
+
+	if (recv(conn, &ack, sizeof(ack), 0) != sizeof(ack) || ack != 1) {
+		LogWarn(COMPONENT_DISPATCH,
+			"New server did not take the sockets");
+		return false;
+	}
+
+	return true;
+}
+
+static void *handoff_thread(void *arg)
+{
+	struct timeval tv = {.tv_sec = 5};
+	int conn;
+
+	SetNameFunction("handoff");
+
+	for (;;) {
+		conn = accept(handoff_fd, NULL, NULL);
+		if (conn < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			/* Shut down by nfs_rpc_handoff_stop() */
+			break;
+		}
+
+		(void) setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &tv,
+				  sizeof(tv));
+		if (handoff_send(conn)) {
+			close(conn);
+			handed_off = true;
+			LogEvent(COMPONENT_DISPATCH,
+				 "Sockets handed off to a new server, shutting down");
+			admin_halt();
+			break;
+		}
+		close(conn);
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Listen for a new server to hand the sockets off to
+ */
+static void nfs_rpc_handoff_listen(void)
+{
+	struct sockaddr_un addr;
+	int rc;
+
+	if (!handoff_addr(&addr))
+		return;
+
+	handoff_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (handoff_fd < 0) {
+		LogCrit(COMPONENT_DISPATCH,
+			"Cannot allocate the handoff socket, error %d(%s)",
+			errno, strerror(errno));
+		return;
+	}
+
+	(void) unlink(addr.sun_path);
+	if (bind(handoff_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+	    chmod(addr.sun_path, 0600) != 0 || listen(handoff_fd, 1) != 0) {
+		LogCrit(COMPONENT_DISPATCH,
+			"Cannot listen on handoff socket %s, error %d(%s)",
+			addr.sun_path, errno, strerror(errno));
+		goto err;
+	}
+
+	rc = pthread_create(&handoff_thread_id, NULL, handoff_thread, NULL);
+	if (rc != 0) {
+		LogCrit(COMPONENT_THREAD,
+			"Could not create handoff thread, error = %d (%s)",
+			rc, strerror(rc));
+		goto err;
+	}
+
+	LogInfo(COMPONENT_DISPATCH, "Handing off sockets at %s",
+		addr.sun_path);
+	return;
+
+ err:
+	close(handoff_fd);
+	handoff_fd = -1;
+}
+
+static void nfs_rpc_handoff_stop(void)
+{
+	if (handoff_fd == -1)
+		return;
+
+	(void) shutdown(handoff_fd, SHUT_RDWR);
+	pthread_join(handoff_thread_id, NULL);
+	close(handoff_fd);
+	handoff_fd = -1;
+
+	/* The new server has its own there by now */
+	if (!handed_off)
+		(void) unlink(nfs_param.core_param.handoff_socket);
+}
+
+static inline bool handoff_index_ok(int32_t index, bool want,
+				    uint32_t n_fds)
+{
+	return want ? index >= 0 && index < n_fds : index == -1;
+}
+
+/**
+ * @brief Take the listening sockets of a running server
+ *
+ * Its sockets have to be those this configuration would allocate;
+ * when not, it is told so and keeps serving, and this server can not
+ * start.
+ *
+ * @return true if the sockets were taken, false if there is no
+ *         running server to take them from.
+ */
+static bool nfs_rpc_handoff_take(void)
+{
+	struct sockaddr_un addr;
+	struct handoff_msg msg;
+	int fds[HANDOFF_MAX_FDS];
+	char cbuf[CMSG_SPACE(sizeof(fds))];
+	struct iovec iov = {.iov_base = &msg, .iov_len = sizeof(msg)};
+	struct msghdr mh;
+	struct cmsghdr *cmsg;
+	uint32_t n_fds = 0, ix;
+	uint8_t ack = 1;
+	bool ok;
+	protos p;
+	int sock;
+
+	if (!handoff_addr(&addr))
+		return false;
+
+	sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (sock < 0)
+		return false;
+
+	if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+		LogInfo(COMPONENT_DISPATCH,
+			"No running server to take sockets from at %s, error %d(%s)",
+			addr.sun_path, errno, strerror(errno));
+		close(sock);
+		return false;
+	}
+
+	memset(&msg, 0, sizeof(msg));
+	msg.magic = HANDOFF_MAGIC;
+	msg.version = HANDOFF_VERSION;
+
+	memset(&mh, 0, sizeof(mh));
+	mh.msg_iov = &iov;
+	mh.msg_iovlen = 1;
+	mh.msg_control = cbuf;
+	mh.msg_controllen = sizeof(cbuf);
+
+	ok = send(sock, &msg, sizeof(msg), MSG_NOSIGNAL) == sizeof(msg) &&
+	     recvmsg(sock, &mh, MSG_WAITALL) == sizeof(msg);
+
+	for (cmsg = ok ? CMSG_FIRSTHDR(&mh) : NULL; cmsg != NULL;
+	     cmsg = CMSG_NXTHDR(&mh, cmsg)) {
+		if (cmsg->cmsg_level == SOL_SOCKET &&
+		    cmsg->cmsg_type == SCM_RIGHTS) {
+			n_fds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+			memcpy(fds, CMSG_DATA(cmsg), n_fds * sizeof(int));
+			break;
+		}
+	}
+
+	if (!ok) {
+		LogCrit(COMPONENT_DISPATCH,
+			"Handoff from the running server at %s failed, error %d(%s)",
+			addr.sun_path, errno, strerror(errno));
+		close(sock);
+		return false;
+	}
+
+	ok = msg.magic == HANDOFF_MAGIC && msg.version == HANDOFF_VERSION &&
+	     (mh.msg_flags & MSG_CTRUNC) == 0 &&
+	     msg.n_tcp_listen == n_tcp_listen &&
+	     (n_tcp_listen == 0 ||
+	      (msg.listen0 >= 0 && msg.listen0 + n_tcp_listen <= n_fds));
+	for (p = P_NFS; p < P_COUNT; p++)
+		ok = ok && handoff_index_ok(msg.udp[p], handoff_udp(p), n_fds)
+			&& handoff_index_ok(msg.tcp[p], handoff_tcp(p), n_fds);
+
+	if (!ok) {
+		ack = 0;
+		(void) send(sock, &ack, sizeof(ack), MSG_NOSIGNAL);
+		close(sock);
+		for (ix = 0; ix < n_fds; ix++)
+			close(fds[ix]);
+		LogFatal(COMPONENT_DISPATCH,
+			 "The sockets of the running server at %s do not match this configuration",
+			 addr.sun_path);
+	}
+
+	v6disabled = msg.v6disabled;
+	for (p = P_NFS; p < P_COUNT; p++) {
+		udp_socket[p] = msg.udp[p] == -1 ? -1 : fds[msg.udp[p]];
+		tcp_socket[p] = msg.tcp[p] == -1 ? -1 : fds[msg.tcp[p]];
+	}
+	for (ix = 0; ix < n_tcp_listen; ix++)
+		tcp_listen_socket[ix] = fds[msg.listen0 + ix];
+
+	if (send(sock, &ack, sizeof(ack), MSG_NOSIGNAL) != sizeof(ack))
+		LogFatal(COMPONENT_DISPATCH,
+			 "Cannot tell the running server at %s its sockets were taken, error %d(%s)",
+			 addr.sun_path, errno, strerror(errno));
+	close(sock);
+
+	LogEvent(COMPONENT_DISPATCH,
+		 "Took %" PRIu32 " sockets from the running server at %s",
+		 n_fds, addr.sun_path);
+	return true;
+}
+
+bool nfs_rpc_handed_off(void)
+{
+	return handed_off;
+}
+
 /* The following routine must ONLY be called from the shutdown
  * thread */
 void Clean_RPC(void)
@@ -802,7 +1281,10 @@ void Clean_RPC(void)
    * @todo Consider the need to call Svc_dg_destroy for UDP & ?? for
    * TCP based services
    */
-	unregister_rpc();
+	nfs_rpc_handoff_stop();
+	/* The new server registered the same ports */
+	if (!handed_off)
+		unregister_rpc();
 	close_rpc_fd();
 }
 
@@ -858,15 +1340,42 @@ void Register_program(protos prot, int flag, int vers)
 	}
 }
 
+/* What the RPC library allocates is counted apart from the daemon */
+
+static void *ntirpc_malloc(size_t n, const char *file, int line,
+			   const char *function)
+{
+	return gsh_malloc_tag__(MEM_TAG_NTIRPC, n, file, line, function);
+}
+
+static void *ntirpc_malloc_aligned(size_t a, size_t n, const char *file,
+				   int line, const char *function)
+{
+	return gsh_malloc_aligned_tag__(MEM_TAG_NTIRPC, a, n, file, line,
+					function);
+}
+
+static void *ntirpc_calloc(size_t n, size_t s, const char *file, int line,
+			   const char *function)
+{
+	return gsh_calloc_tag__(MEM_TAG_NTIRPC, n, s, file, line, function);
+}
+
+static void *ntirpc_realloc(void *p, size_t n, const char *file, int line,
+			    const char *function)
+{
+	return gsh_realloc_tag__(MEM_TAG_NTIRPC, p, n, file, line, function);
+}
+
 tirpc_pkg_params ntirpc_pp = {
 	0,
 	0,
 	(mem_format_t)rpc_warnx,
 	gsh_free_size,
-	gsh_malloc__,
-	gsh_malloc_aligned__,
-	gsh_calloc__,
-	gsh_realloc__,
+	ntirpc_malloc,
+	ntirpc_malloc_aligned,
+	ntirpc_calloc,
+	ntirpc_realloc,
 };
 
 /**
@@ -879,6 +1388,7 @@ void nfs_Init_svc(void)
 {
 	svc_init_params svc_params;
 	int ix, code __attribute__ ((unused)) = 0;
+	bool handoff;
 
 	LogDebug(COMPONENT_DISPATCH, "NFS INIT: Core options = %d",
 		 nfs_param.core_param.core_options);
@@ -928,7 +1438,15 @@ void nfs_Init_svc(void)
 	if (!svc_init(&svc_params))
 		LogFatal(COMPONENT_INIT, "SVC initialization failed");
 
-	for (ix = 0; ix < N_EVENT_CHAN; ++ix) {
+#ifdef USE_RPC_TLS
+	nfs_rpc_tls_init();
+#endif
+
+	if (nfs_protocol_enabled(P_NFS) &&
+	    (nfs_param.core_param.core_options & CORE_OPTION_ALL_NFS_VERS))
+		n_tcp_listen = nfs_param.core_param.rpc.tcp_listeners - 1;
+
+	for (ix = 0; ix < N_EVENT_CHAN + n_tcp_listen; ++ix) {
 		rpc_evchan[ix].chan_id = 0;
 		code = svc_rqst_new_evchan(&rpc_evchan[ix].chan_id,
 					   NULL /* u_data */,
@@ -976,8 +1494,12 @@ void nfs_Init_svc(void)
 		LogFullDebug(COMPONENT_DISPATCH,
 			     "netconfig found for UDPv6 and TCPv6");
 
-	/* Allocate the UDP and TCP sockets for the RPC */
-	Allocate_sockets();
+	/* Allocate the UDP and TCP sockets for the RPC, unless a running
+	 * server hands its own off.
+	 */
+	handoff = nfs_rpc_handoff_take();
+	if (!handoff)
+		Allocate_sockets();
 
 	if ((nfs_param.core_param.core_options & CORE_OPTION_NFSV3) != 0) {
 		/* Some log that can be useful when debug ONC/RPC
@@ -1010,7 +1532,8 @@ void nfs_Init_svc(void)
 	if ((nfs_param.core_param.core_options &
 	     CORE_OPTION_ALL_NFS_VERS) != 0) {
 		/* Bind the tcp and udp sockets */
-		Bind_sockets();
+		if (!handoff)
+			Bind_sockets();
 
 		/* Unregister from portmapper/rpcbind */
 		unregister_rpc();
@@ -1081,9 +1604,10 @@ static void *rpc_dispatcher_thread(void *arg);
 void nfs_rpc_dispatch_threads(pthread_attr_t *attr_thr)
 {
 	int ix, code = 0;
+	uint32_t node;
 
 	/* Start event channel service threads */
-	for (ix = 0; ix < N_EVENT_CHAN; ++ix) {
+	for (ix = 0; ix < N_EVENT_CHAN + n_tcp_listen; ++ix) {
 		code = pthread_create(&rpc_evchan[ix].thread_id, attr_thr,
 				      rpc_dispatcher_thread,
 				      (void *)&rpc_evchan[ix].chan_id);
@@ -1092,21 +1616,89 @@ void nfs_rpc_dispatch_threads(pthread_attr_t *attr_thr)
 				 "Could not create rpc_dispatcher_thread #%u, error = %d (%s)",
 				 ix, errno, strerror(errno));
 	}
+
+	/* keep each listener on the node its connections are decoded
+	 * on, see create_tcp_listeners()
+	 */
+	if (node_fridge && n_tcp_listen > 0) {
+		for (ix = TCP_RDVS_CHAN; ix < N_EVENT_CHAN + n_tcp_listen;
+		     ++ix) {
+			if (ix == TCP_RDVS_CHAN)
+				node = 0;
+			else if (ix >= TCP_LISTEN_CHAN_0)
+				node = (ix - TCP_LISTEN_CHAN_0 + 1) %
+				       nfs_req_st.reqs.n_shards;
+			else
+				continue;
+			code = pthread_setaffinity_np(rpc_evchan[ix].thread_id,
+						      sizeof(cpu_set_t),
+						      gsh_numa_cpus(node));
+			if (code != 0)
+				LogWarn(COMPONENT_THREAD,
+					"Could not bind tcp listener thread to node %"
+					PRIu32 ", error = %d (%s)",
+					node, code, strerror(code));
+		}
+	}
+
 	LogInfo(COMPONENT_THREAD,
 		"%d rpc dispatcher threads were started successfully",
-		N_EVENT_CHAN);
+		N_EVENT_CHAN + n_tcp_listen);
+
+	/* Serving now, so a new server may take over */
+	nfs_rpc_handoff_listen();
 }
 
 void nfs_rpc_dispatch_stop(void)
 {
 	int ix;
 
-	for (ix = 0; ix < N_EVENT_CHAN; ++ix) {
+	for (ix = 0; ix < N_EVENT_CHAN + n_tcp_listen; ++ix) {
 		svc_rqst_thrd_signal(rpc_evchan[ix].chan_id,
 				     SVC_RQST_SIGNAL_SHUTDOWN);
 	}
 }
 
+/**
+ * @brief Have reads of a new connection busy poll its device queue
+ *
+ * Configured by RPC_Busy_Poll_Usecs.  A socket that does not support
+ * it, or raising it above net.core.busy_read without CAP_NET_ADMIN,
+ * just goes without; that is only logged once.
+ *
+ * @param[in] fd Socket of the connection
+ */
+static void nfs_rpc_busy_poll(int fd)
+{
+#ifdef SO_BUSY_POLL
+	static bool warned;
+	int usecs = nfs_param.core_param.rpc.busy_poll_usecs;
+
+	if (usecs == 0 || fd < 0)
+		return;
+
+	if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usecs,
+		       sizeof(usecs)) != 0) {
+		if (!warned) {
+			warned = true;
+			LogWarn(COMPONENT_DISPATCH,
+				"Cannot set SO_BUSY_POLL on socket %d, error %d(%s)",
+				fd, errno, strerror(errno));
+		}
+		return;
+	}
+#ifdef SO_PREFER_BUSY_POLL
+	{
+		int one = 1;
+
+		/* let the polling keep the device interrupts deferred */
+		(void) setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &one,
+				  sizeof(one));
+	}
+#endif
+#endif
+}
+
 /**
  * @brief Rendezvous callout.  This routine will be called by TI-RPC
  *        after newxprt has been accepted.
@@ -1126,7 +1718,9 @@ static u_int nfs_rpc_recv_user_data(SVCXPRT *xprt, SVCXPRT *newxprt,
 				    const u_int flags, void *u_data)
 {
 	static uint32_t next_chan = TCP_EVCHAN_0;
+	static uint32_t next_node;
 	static pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
+	gsh_xprt_private_t *xu;
 	uint32_t tchan;
 
 	PTHREAD_MUTEX_lock(&mtx);
@@ -1137,14 +1731,30 @@ static u_int nfs_rpc_recv_user_data(SVCXPRT *xprt, SVCXPRT *newxprt,
 		next_chan = TCP_EVCHAN_0;
 
 	/* setup private data (freed when xprt is destroyed) */
-	newxprt->xp_u1 =
-	    alloc_gsh_xprt_private(newxprt, XPRT_PRIVATE_FLAG_NONE);
+	xu = alloc_gsh_xprt_private(newxprt, XPRT_PRIVATE_FLAG_NONE);
+	newxprt->xp_u1 = xu;
+
+	/* keep connections on the node of their listener, or spread
+	 * them over the nodes
+	 */
+	if (node_fridge) {
+		gsh_xprt_private_t *lu = xprt->xp_u1;
+
+		if (lu != NULL && lu->numa_node != GSH_NUMA_NODE_ANY) {
+			xu->numa_node = lu->numa_node;
+		} else {
+			xu->numa_node = atomic_inc_uint32_t(&next_node) %
+					nfs_req_st.reqs.n_shards;
+		}
+	}
 
 	/* NB: xu->drc is allocated on first request--we need shared
 	 * TCP DRC for v3, but per-connection for v4 */
 
 	PTHREAD_MUTEX_unlock(&mtx);
 
+	nfs_rpc_busy_poll(newxprt->xp_fd);
+
 	(void)svc_rqst_evchan_reg(rpc_evchan[tchan].chan_id, newxprt,
 				  SVC_RQST_FLAG_NONE);
 
@@ -1158,6 +1768,12 @@ static u_int nfs_rpc_recv_user_data(SVCXPRT *xprt, SVCXPRT *newxprt,
  */
 static void nfs_rpc_free_user_data(SVCXPRT *xprt)
 {
+	gsh_xprt_private_t *xu = (gsh_xprt_private_t *)xprt->xp_u1;
+
+	if (xu != NULL && xu->client != NULL) {
+		put_gsh_client(xu->client);
+		xu->client = NULL;
+	}
 	if (xprt->xp_u2) {
 		nfs_dupreq_put_drc(xprt, xprt->xp_u2, DRC_FLAG_RELEASE);
 		xprt->xp_u2 = NULL;
@@ -1165,153 +1781,216 @@ static void nfs_rpc_free_user_data(SVCXPRT *xprt)
 	free_gsh_xprt_private(xprt);
 }
 
-uint32_t nfs_rpc_outstanding_reqs_est(void)
+/**
+ * @brief Count the requests waiting in one queue of every shard
+ *
+ * @param[in] ix Queue
+ *
+ * @return Number of queued requests, racy by nature.
+ */
+static uint32_t nfs_rpc_qset_depth(int ix)
 {
-	static uint32_t ctr;
-	static uint32_t nreqs;
 	struct req_q_pair *qpair;
-	uint32_t treqs;
-	int ix;
+	uint32_t treqs = 0;
+	uint32_t shard;
 
-	if ((atomic_inc_uint32_t(&ctr) % 10) != 0)
-		return atomic_fetch_uint32_t(&nreqs);
-
-	treqs = 0;
-	for (ix = 0; ix < N_REQ_QUEUES; ++ix) {
-		qpair = &(nfs_req_st.reqs.nfs_request_q.qset[ix]);
+	for (shard = 0; shard < nfs_req_st.reqs.n_shards; ++shard) {
+		qpair = &(nfs_req_st.reqs.nfs_request_q[shard].qset[ix]);
 		treqs += atomic_fetch_uint32_t(&qpair->producer.size);
 		treqs += atomic_fetch_uint32_t(&qpair->consumer.size);
+		if (nfs_req_st.reqs.ring_size)
+			treqs += gsh_mpmc_ring_size(&qpair->ring);
+		if (qpair->fairq)
+			treqs += atomic_fetch_uint32_t(&qpair->fairq->size);
 	}
 
-	atomic_store_uint32_t(&nreqs, treqs);
 	return treqs;
 }
 
-static inline bool stallq_should_unstall(SVCXPRT *xprt)
+/**
+ * @brief Count the requests waiting in all queues
+ *
+ * @return Number of queued requests, racy by nature.
+ */
+uint32_t nfs_rpc_queue_depth(void)
 {
-	return ((xprt->xp_requests
-		 < nfs_param.core_param.dispatch_max_reqs_xprt / 2)
-		|| (xprt->xp_flags & SVC_XPRT_FLAG_DESTROYED));
+	uint32_t treqs = 0;
+	int ix;
+
+	for (ix = 0; ix < N_REQ_QUEUES; ++ix)
+		treqs += nfs_rpc_qset_depth(ix);
+
+	return treqs;
 }
 
-void thr_stallq(struct fridgethr_context *thr_ctx)
+uint32_t nfs_rpc_outstanding_reqs_est(void)
 {
-	gsh_xprt_private_t *xu;
-	struct glist_head *l;
-	SVCXPRT *xprt;
+	static uint32_t ctr;
+	static uint32_t nreqs;
+	uint32_t treqs;
 
-	while (1) {
-		thread_delay_ms(1000);
-		PTHREAD_MUTEX_lock(&nfs_req_st.stallq.mtx);
- restart:
-		if (nfs_req_st.stallq.stalled == 0) {
-			nfs_req_st.stallq.active = false;
-			PTHREAD_MUTEX_unlock(&nfs_req_st.stallq.mtx);
-			break;
-		}
+	if ((atomic_inc_uint32_t(&ctr) % 10) != 0)
+		return atomic_fetch_uint32_t(&nreqs);
 
-		glist_for_each(l, &nfs_req_st.stallq.q) {
-			xu = glist_entry(l, gsh_xprt_private_t, stallq);
-			xprt = xu->xprt;
+	treqs = nfs_rpc_queue_depth();
+	atomic_store_uint32_t(&nreqs, treqs);
+	return treqs;
+}
 
-			/* handle stalled xprts that idle out */
-			if (stallq_should_unstall(xprt)) {
-				/* lock ordering
-				 * (cf. nfs_rpc_cond_stall_xprt) */
-				PTHREAD_MUTEX_unlock(&nfs_req_st.stallq.mtx);
-				/* !LOCKED */
-				LogDebug(COMPONENT_DISPATCH,
-					 "unstalling stalled xprt %p", xprt);
-				PTHREAD_MUTEX_lock(&xprt->xp_lock);
-				PTHREAD_MUTEX_lock(&nfs_req_st.stallq.mtx);
-				/* check that we're still stalled */
-				if (xu->flags & XPRT_PRIVATE_FLAG_STALLED) {
-					glist_del(&xu->stallq);
-					--(nfs_req_st.stallq.stalled);
-					atomic_clear_uint16_t_bits(&xu->flags,
-						XPRT_PRIVATE_FLAG_STALLED);
-					(void)svc_rqst_rearm_events(
-						xprt, SVC_RQST_FLAG_NONE);
-					/* drop stallq ref */
-					gsh_xprt_unref(
-						xprt, XPRT_PRIVATE_FLAG_LOCKED,
-						__func__, __LINE__);
-				}
-				goto restart;
-			}
-		}
-		PTHREAD_MUTEX_unlock(&nfs_req_st.stallq.mtx);
-	}
+/* Per-xprt flow control
+ *
+ * Each xprt has Dispatch_Max_Reqs_Xprt request credits.  A credit is
+ * taken when a request is queued (xp_requests) and given back when it
+ * completes.  An xprt that runs out is stalled: its events are left
+ * disarmed, and the completion that brings it back down to half its
+ * budget re-arms it directly, so no thread has to poll stalled xprts.
+ */
 
-	LogDebug(COMPONENT_DISPATCH, "stallq idle, thread exit");
+static inline uint32_t xprt_credit_budget(void)
+{
+	return nfs_param.core_param.dispatch_max_reqs_xprt;
 }
 
-static bool nfs_rpc_cond_stall_xprt(SVCXPRT *xprt)
+static inline uint32_t xprt_credit_low_water(void)
 {
-	gsh_xprt_private_t *xu;
-	bool activate = false;
-	uint32_t nreqs = xprt->xp_requests;
+	return xprt_credit_budget() / 2;
+}
 
-	/* check per-xprt quota */
-	if (likely(nreqs < nfs_param.core_param.dispatch_max_reqs_xprt)) {
-		LogDebug(COMPONENT_DISPATCH,
-			 "xprt %p xp_refs %" PRIu32 " has %" PRIu32
-			 " reqs active (max %d)",
-			 xprt,
-			 xprt->xp_refs,
-			 nreqs,
-			 nfs_param.core_param.dispatch_max_reqs_xprt);
-		return false;
-	}
+/**
+ * @brief Re-arm a stalled xprt
+ *
+ * Whoever clears the stalled flag re-arms the xprt and drops the
+ * reference the stall held, so racing callers are harmless.
+ *
+ * @param[in] xprt Transport
+ */
+static void nfs_rpc_unstall_xprt(SVCXPRT *xprt)
+{
+	gsh_xprt_private_t *xu = (gsh_xprt_private_t *) xprt->xp_u1;
 
-	PTHREAD_MUTEX_lock(&xprt->xp_lock);
-	xu = (gsh_xprt_private_t *) xprt->xp_u1;
+	if (!(atomic_postclear_uint16_t_bits(&xu->flags,
+					     XPRT_PRIVATE_FLAG_STALLED)
+	      & XPRT_PRIVATE_FLAG_STALLED))
+		return;
 
-	/* XXX can't happen */
-	if (unlikely(xu->flags & XPRT_PRIVATE_FLAG_STALLED)) {
-		PTHREAD_MUTEX_unlock(&xprt->xp_lock);
-		LogDebug(COMPONENT_DISPATCH, "xprt %p already stalled (oops)",
-			 xprt);
-		return true;
-	}
+	LogDebug(COMPONENT_DISPATCH, "unstalling xprt %p, %" PRIu32 " reqs",
+		 xprt, atomic_fetch_uint32_t(&xprt->xp_requests));
 
-	LogDebug(COMPONENT_DISPATCH, "xprt %p has %u reqs, marking stalled",
-		 xprt, nreqs);
+	(void)svc_rqst_rearm_events(xprt, SVC_RQST_FLAG_NONE);
+	gsh_xprt_unref(xprt, XPRT_PRIVATE_FLAG_NONE, __func__, __LINE__);
+}
 
-	/* ok, need to stall */
-	PTHREAD_MUTEX_lock(&nfs_req_st.stallq.mtx);
+/**
+ * @brief Stall an xprt that is out of request credits
+ *
+ * The caller must be decoding the xprt and hold a reference on it.
+ * If the xprt is stalled the decoding flag is cleared and the
+ * reference passes to the stall.
+ *
+ * @param[in] xprt Transport
+ *
+ * @return true if the xprt was stalled, false if it has credits left.
+ */
+static bool nfs_rpc_stall_xprt(SVCXPRT *xprt)
+{
+	gsh_xprt_private_t *xu = (gsh_xprt_private_t *) xprt->xp_u1;
+	uint32_t nreqs = atomic_fetch_uint32_t(&xprt->xp_requests);
+
+	if (likely(nreqs < xprt_credit_budget()))
+		return false;
+
+	LogDebug(COMPONENT_DISPATCH,
+		 "xprt %p has %" PRIu32 " reqs (max %" PRIu32 "), stalling",
+		 xprt, nreqs, xprt_credit_budget());
 
-	glist_add_tail(&nfs_req_st.stallq.q, &xu->stallq);
-	++(nfs_req_st.stallq.stalled);
 	atomic_set_uint16_t_bits(&xu->flags, XPRT_PRIVATE_FLAG_STALLED);
-	PTHREAD_MUTEX_unlock(&xprt->xp_lock);
+	gsh_xprt_clear_flag(xprt, XPRT_PRIVATE_FLAG_DECODING);
 
-	/* if no thread is servicing the stallq, start one */
-	if (!nfs_req_st.stallq.active) {
-		nfs_req_st.stallq.active = true;
-		activate = true;
-	}
-	PTHREAD_MUTEX_unlock(&nfs_req_st.stallq.mtx);
+	/* enough requests may have completed before the flag was set
+	 * for no completion to see it */
+	if (atomic_fetch_uint32_t(&xprt->xp_requests)
+	    <= xprt_credit_low_water())
+		nfs_rpc_unstall_xprt(xprt);
 
-	if (activate) {
-		int rc = 0;
+	return true;
+}
 
-		LogDebug(COMPONENT_DISPATCH, "starting stallq service thread");
-		rc = fridgethr_submit(req_fridge, thr_stallq,
-				      NULL /* no arg */);
+/**
+ * @brief Give back the credit of a completed request
+ *
+ * Re-arms the xprt if this brought a stalled xprt back under its low
+ * water mark, then drops the request's xprt reference.
+ *
+ * @param[in] xprt Transport the request came in on
+ */
+void nfs_rpc_return_credit(SVCXPRT *xprt)
+{
+	gsh_xprt_private_t *xu = (gsh_xprt_private_t *) xprt->xp_u1;
+
+	if (atomic_dec_uint32_t(&xprt->xp_requests) <= xprt_credit_low_water()
+	    && (atomic_fetch_uint16_t(&xu->flags)
+		& XPRT_PRIVATE_FLAG_STALLED))
+		nfs_rpc_unstall_xprt(xprt);
+
+	gsh_xprt_unref(xprt, XPRT_PRIVATE_FLAG_NONE, __func__, __LINE__);
+}
+
+/**
+ * @brief Create a decoder fridge for each NUMA node
+ *
+ * @param[in] reqparams Parameters of the global decoder fridge
+ */
+static void nfs_rpc_node_fridges_init(struct fridgethr_params *reqparams)
+{
+	struct fridgethr_params nodeparams = *reqparams;
+	uint32_t nnodes = gsh_numa_nodes();
+	char name[32];
+	uint32_t node;
+	int rc;
+
+	node_fridge = gsh_calloc(nnodes, sizeof(struct fridgethr *));
+	for (node = 0; node < nnodes; ++node) {
+		nodeparams.affinity = gsh_numa_cpus(node);
+		snprintf(name, sizeof(name), "decoder-%" PRIu32, node);
+		rc = fridgethr_init(&node_fridge[node], name, &nodeparams);
 		if (rc != 0)
-			LogCrit(COMPONENT_DISPATCH,
-				"Failed to start stallq: %d", rc);
+			LogFatal(COMPONENT_DISPATCH,
+				 "Unable to initialize decoder thread pool for NUMA node %"
+				 PRIu32 ": %d", node, rc);
 	}
+}
 
-	/* stalled */
-	return true;
+/**
+ * @brief Stop the per NUMA node decoder fridges
+ *
+ * @return 0 or the first error.
+ */
+int nfs_rpc_node_fridges_shutdown(void)
+{
+	uint32_t node;
+	int rc, ret = 0;
+
+	if (!node_fridge)
+		return 0;
+
+	for (node = 0; node < gsh_numa_nodes(); ++node) {
+		rc = fridgethr_sync_command(node_fridge[node],
+					    fridgethr_comm_stop, 120);
+		if (rc == ETIMEDOUT)
+			fridgethr_cancel(node_fridge[node]);
+		if (rc != 0 && ret == 0)
+			ret = rc;
+	}
+	return ret;
 }
 
 void nfs_rpc_queue_init(void)
 {
 	struct fridgethr_params reqparams;
+	struct req_q_set *qs;
 	struct req_q_pair *qpair;
+	uint32_t n_shards;
+	uint32_t shard;
 	int rc = 0;
 	int ix;
 
@@ -1333,25 +2012,60 @@ void nfs_rpc_queue_init(void)
 		LogFatal(COMPONENT_DISPATCH,
 			 "Unable to initialize decoder thread pool: %d", rc);
 
-	/* queues */
-	pthread_spin_init(&nfs_req_st.reqs.sp, PTHREAD_PROCESS_PRIVATE);
-	nfs_req_st.reqs.size = 0;
-	for (ix = 0; ix < N_REQ_QUEUES; ++ix) {
-		qpair = &(nfs_req_st.reqs.nfs_request_q.qset[ix]);
-		qpair->s = req_q_s[ix];
-		nfs_rpc_q_init(&qpair->producer);
-		nfs_rpc_q_init(&qpair->consumer);
+	/* queue shards, 0 means one per online CPU */
+	n_shards = nfs_param.core_param.dispatch_queue_shards;
+	if (n_shards == 0) {
+		long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+
+		n_shards = (ncpu > 0) ? ncpu : 1;
+	}
+
+	/* or one per NUMA node, each with its own decoders */
+	if (nfs_param.core_param.dispatch_numa_affinity) {
+		gsh_numa_init();
+		if (gsh_numa_nodes() > 1) {
+			n_shards = gsh_numa_nodes();
+			nfs_req_st.reqs.numa = true;
+			nfs_rpc_node_fridges_init(&reqparams);
+		}
 	}
+	nfs_req_st.reqs.n_shards = n_shards;
+	nfs_req_st.reqs.ring_size =
+		nfs_param.core_param.dispatch_queue_ring_size;
+	nfs_req_st.reqs.nfs_request_q =
+		gsh_malloc_aligned(GSH_CACHE_LINE_SIZE,
+				   n_shards * sizeof(struct req_q_set));
+	memset(nfs_req_st.reqs.nfs_request_q, 0,
+	       n_shards * sizeof(struct req_q_set));
+	nfs_req_st.reqs.size = 0;
+
+	for (shard = 0; shard < n_shards; ++shard) {
+		qs = &nfs_req_st.reqs.nfs_request_q[shard];
+
+		/* queues */
+		for (ix = 0; ix < N_REQ_QUEUES; ++ix) {
+			qpair = &(qs->qset[ix]);
+			qpair->s = req_q_s[ix];
+			nfs_rpc_q_init(&qpair->producer);
+			nfs_rpc_q_init(&qpair->consumer);
+			if (nfs_req_st.reqs.ring_size)
+				gsh_mpmc_ring_init(&qpair->ring,
+						   nfs_req_st.reqs.ring_size);
+			if (nfs_param.core_param.fair.enabled &&
+			    (ix == REQ_Q_LOW_LATENCY ||
+			     ix == REQ_Q_HIGH_LATENCY))
+				qpair->fairq = nfs_rpc_fairq_create();
+		}
 
-	/* waitq */
-	glist_init(&nfs_req_st.reqs.wait_list);
-	nfs_req_st.reqs.waiters = 0;
+		/* waitq */
+		pthread_spin_init(&qs->sp, PTHREAD_PROCESS_PRIVATE);
+		glist_init(&qs->wait_list);
+		qs->waiters = 0;
+	}
 
-	/* stallq */
-	gsh_mutex_init(&nfs_req_st.stallq.mtx, NULL);
-	glist_init(&nfs_req_st.stallq.q);
-	nfs_req_st.stallq.active = false;
-	nfs_req_st.stallq.stalled = 0;
+	LogInfo(COMPONENT_DISPATCH,
+		"Using %" PRIu32 " request queue shards, %s backend",
+		n_shards, nfs_req_st.reqs.ring_size ? "ring" : "list");
 }
 
 static uint32_t enqueued_reqs;
@@ -1367,11 +2081,102 @@ uint32_t get_dequeue_count(void)
 	return dequeued_reqs;
 }
 
+static uint64_t dequeue_batches;
+static uint64_t dequeue_batch_reqs;
+static uint64_t inline_reqs;	/*< Executed by their decoder */
+
+/**
+ * @brief Report how well workers batch their dequeues
+ *
+ * @param[out] batches Dequeues that found work in a queue
+ * @param[out] reqs    Requests those dequeues took
+ */
+void get_dequeue_batch_stats(uint64_t *batches, uint64_t *reqs)
+{
+	*batches = atomic_fetch_uint64_t(&dequeue_batches);
+	*reqs = atomic_fetch_uint64_t(&dequeue_batch_reqs);
+}
+
+/**
+ * @brief Render the request queue depths and counts
+ *
+ * @param[in,out] mb Buffer
+ */
+void nfs_rpc_queue_metrics(struct metrics_buf *mb)
+{
+	static const char *const q_labels[N_REQ_QUEUES] = {
+		"mount", "call", "low_latency", "high_latency", "reclaim"
+	};
+	int ix;
+
+	metrics_family(mb, "ganesha_rpc_queue_depth", "gauge",
+		       "Requests waiting for a worker");
+	for (ix = 0; ix < N_REQ_QUEUES; ++ix)
+		metrics_printf(mb, "ganesha_rpc_queue_depth{queue=\"%s\"} %"
+			       PRIu32 "\n", q_labels[ix],
+			       nfs_rpc_qset_depth(ix));
+
+	metrics_family(mb, "ganesha_rpc_enqueued", "counter",
+		       "Requests queued");
+	metrics_printf(mb, "ganesha_rpc_enqueued_total %" PRIu32 "\n",
+		       atomic_fetch_uint32_t(&enqueued_reqs));
+	metrics_family(mb, "ganesha_rpc_dequeued", "counter",
+		       "Requests taken by workers");
+	metrics_printf(mb, "ganesha_rpc_dequeued_total %" PRIu32 "\n",
+		       atomic_fetch_uint32_t(&dequeued_reqs));
+	metrics_family(mb, "ganesha_rpc_dequeue_batches", "counter",
+		       "Dequeues that found work");
+	metrics_printf(mb, "ganesha_rpc_dequeue_batches_total %" PRIu64 "\n",
+		       atomic_fetch_uint64_t(&dequeue_batches));
+	metrics_family(mb, "ganesha_rpc_inline", "counter",
+		       "Requests executed by their decoder");
+	metrics_printf(mb, "ganesha_rpc_inline_total %" PRIu64 "\n",
+		       atomic_fetch_uint64_t(&inline_reqs));
+}
+
+/**
+ * @brief Release one worker waiting on a queue shard
+ *
+ * @param[in] qs Queue shard
+ *
+ * @return true if a waiter was signalled.
+ */
+static bool nfs_rpc_q_wake_one(struct req_q_set *qs)
+{
+	wait_q_entry_t *wqe;
+
+	/* SPIN LOCKED */
+	pthread_spin_lock(&qs->sp);
+	if (!qs->waiters) {
+		/* ! SPIN LOCKED */
+		pthread_spin_unlock(&qs->sp);
+		return false;
+	}
+
+	wqe = glist_first_entry(&qs->wait_list, wait_q_entry_t, waitq);
+
+	LogFullDebug(COMPONENT_DISPATCH,
+		     "qs %p waiters %u signal wqe %p",
+		     qs, qs->waiters, wqe);
+
+	/* release 1 waiter */
+	glist_del(&wqe->waitq);
+	--(qs->waiters);
+	--(wqe->waiters);
+	/* ! SPIN LOCKED */
+	pthread_spin_unlock(&qs->sp);
+	/* the worker may still be spinning, then this is just a store */
+	wait_park_notify(&wqe->park);
+	return true;
+}
+
 void nfs_rpc_enqueue_req(request_data_t *reqdata)
 {
 	struct req_q_set *nfs_request_q;
 	struct req_q_pair *qpair;
 	struct req_q *q;
+	uint32_t n_shards = nfs_req_st.reqs.n_shards;
+	uint32_t home, shard;
 
 #if defined(HAVE_BLKIN)
 	BLKIN_TIMESTAMP(
@@ -1380,7 +2185,8 @@ void nfs_rpc_enqueue_req(request_data_t *reqdata)
 		"enqueue-enter");
 #endif
 
-	nfs_request_q = &nfs_req_st.reqs.nfs_request_q;
+	home = nfs_rpc_q_local_shard();
+	nfs_request_q = &nfs_req_st.reqs.nfs_request_q[home];
 
 	switch (reqdata->rtype) {
 	case NFS_REQUEST:
@@ -1392,6 +2198,14 @@ void nfs_rpc_enqueue_req(request_data_t *reqdata)
 			qpair = &(nfs_request_q->qset[REQ_Q_MOUNT]);
 			break;
 		}
+		/* After a takeover, clients recovering their state wait on
+		 * nothing else.
+		 */
+		if ((reqdata->r_u.req.lookahead.flags &
+		     NFS_LOOKAHEAD_RECLAIM) && nfs_in_grace()) {
+			qpair = &(nfs_request_q->qset[REQ_Q_RECLAIM]);
+			break;
+		}
 		if (NFS_LOOKAHEAD_HIGH_LATENCY(reqdata->r_u.req.lookahead))
 			qpair = &(nfs_request_q->qset[REQ_Q_HIGH_LATENCY]);
 		else
@@ -1414,7 +2228,32 @@ void nfs_rpc_enqueue_req(request_data_t *reqdata)
 	/* this one is real, timestamp it
 	 */
 	now(&reqdata->time_queued);
-	/* always append to producer queue */
+
+#ifdef USE_LTTNG
+	tracepoint(nfs_rpc, enqueue, reqdata, home, qpair->s);
+#endif
+
+	/* per-client scheduling, if configured */
+	if (qpair->fairq && reqdata->rtype == NFS_REQUEST) {
+		nfs_rpc_fairq_enqueue(qpair->fairq, reqdata);
+		(void) atomic_inc_uint32_t(&enqueued_reqs);
+		LogDebug(COMPONENT_DISPATCH,
+			 "enqueued req, shard %" PRIu32 " fairq %s %p",
+			 home, qpair->s, qpair->fairq);
+		goto wake;
+	}
+
+	/* lock-free ring, if configured and not full */
+	if (nfs_req_st.reqs.ring_size &&
+	    gsh_mpmc_ring_push(&qpair->ring, reqdata)) {
+		(void) atomic_inc_uint32_t(&enqueued_reqs);
+		LogDebug(COMPONENT_DISPATCH,
+			 "enqueued req, shard %" PRIu32 " ring %s %p",
+			 home, qpair->s, &qpair->ring);
+		goto wake;
+	}
+
+	/* otherwise append to producer queue */
 	q = &qpair->producer;
 	pthread_spin_lock(&q->sp);
 	glist_add_tail(&q->q, &reqdata->req_q);
@@ -1438,52 +2277,112 @@ void nfs_rpc_enqueue_req(request_data_t *reqdata)
 		"enqueue-exit");
 #endif
 	LogDebug(COMPONENT_DISPATCH,
-		 "enqueued req, q %p (%s %p:%p) size is %d (enq %u deq %u)",
-		 q, qpair->s, &qpair->producer, &qpair->consumer, q->size,
-		 enqueued_reqs, dequeued_reqs);
-
-	/* potentially wakeup some thread */
-
-	/* global waitq */
-	{
-		wait_q_entry_t *wqe;
+		 "enqueued req, shard %" PRIu32
+		 " q %p (%s %p:%p) size is %d (enq %u deq %u)",
+		 home, q, qpair->s, &qpair->producer, &qpair->consumer,
+		 q->size, enqueued_reqs, dequeued_reqs);
+
+ wake:
+	/* potentially wakeup some thread, preferring a worker idling
+	 * on the local shard.  Remote wait lists are only locked when
+	 * they appear to have waiters. */
+	if (nfs_rpc_q_wake_one(nfs_request_q))
+		goto out;
 
-		/* SPIN LOCKED */
-		pthread_spin_lock(&nfs_req_st.reqs.sp);
-		if (nfs_req_st.reqs.waiters) {
-			wqe = glist_first_entry(&nfs_req_st.reqs.wait_list,
-						wait_q_entry_t, waitq);
+	for (shard = 1; shard < n_shards; ++shard) {
+		struct req_q_set *qs =
+			&nfs_req_st.reqs.nfs_request_q[(home + shard)
+						       % n_shards];
 
-			LogFullDebug(COMPONENT_DISPATCH,
-				     "nfs_req_st.reqs.waiters %u signal wqe %p (for q %p)",
-				     nfs_req_st.reqs.waiters, wqe, q);
-
-			/* release 1 waiter */
-			glist_del(&wqe->waitq);
-			--(nfs_req_st.reqs.waiters);
-			--(wqe->waiters);
-			/* ! SPIN LOCKED */
-			pthread_spin_unlock(&nfs_req_st.reqs.sp);
-			PTHREAD_MUTEX_lock(&wqe->lwe.mtx);
-			/* XXX reliable handoff */
-			wqe->flags |= Wqe_LFlag_SyncDone;
-			if (wqe->flags & Wqe_LFlag_WaitSync)
-				pthread_cond_signal(&wqe->lwe.cv);
-			PTHREAD_MUTEX_unlock(&wqe->lwe.mtx);
-		} else
-			/* ! SPIN LOCKED */
-			pthread_spin_unlock(&nfs_req_st.reqs.sp);
+		if (atomic_fetch_uint32_t(&qs->waiters) == 0)
+			continue;
+		if (nfs_rpc_q_wake_one(qs))
+			break;
 	}
 
  out:
 	return;
 }
 
-/* static inline */
-request_data_t *nfs_rpc_consume_req(struct req_q_pair *qpair)
+/**
+ * @brief Move more requests from a consumer queue to a worker's batch
+ *
+ * @note The consumer spinlock MUST be held.
+ *
+ * @param[in] qpair  Queue pair
+ * @param[in] worker Worker taking the requests
+ * @param[in] room   Most requests to move
+ */
+static inline void nfs_rpc_fill_batch(struct req_q_pair *qpair,
+				      nfs_worker_data_t *worker,
+				      uint32_t room)
+{
+	request_data_t *reqdata;
+
+	for (; room > 0 && qpair->consumer.size > 0; --room) {
+		reqdata = glist_first_entry(&qpair->consumer.q,
+					    request_data_t, req_q);
+		glist_del(&reqdata->req_q);
+		--(qpair->consumer.size);
+		glist_add_tail(&worker->batch, &reqdata->req_q);
+		++(worker->batch_size);
+	}
+}
+
+/**
+ * @brief Move more requests from a ring to a worker's batch
+ *
+ * @param[in] qpair  Queue pair
+ * @param[in] worker Worker taking the requests
+ * @param[in] room   Most requests to move
+ */
+static inline void nfs_rpc_fill_batch_ring(struct req_q_pair *qpair,
+					   nfs_worker_data_t *worker,
+					   uint32_t room)
+{
+	request_data_t *reqdata;
+
+	for (; room > 0; --room) {
+		reqdata = gsh_mpmc_ring_pop(&qpair->ring);
+		if (!reqdata)
+			break;
+		glist_add_tail(&worker->batch, &reqdata->req_q);
+		++(worker->batch_size);
+	}
+}
+
+/**
+ * @brief Take requests from a queue pair
+ *
+ * @param[in] qpair  Queue pair
+ * @param[in] worker Worker, whose batch takes any request after the
+ *                   first
+ * @param[in] room   Most requests to add to the batch
+ *
+ * @return The first request or NULL if the pair is empty.
+ */
+static request_data_t *nfs_rpc_consume_req(struct req_q_pair *qpair,
+					   nfs_worker_data_t *worker,
+					   uint32_t room)
 {
 	request_data_t *reqdata = NULL;
 
+	/* Fairly scheduled NFS requests; anything else (9P) still goes
+	 * through the lists below. */
+	if (qpair->fairq) {
+		reqdata = nfs_rpc_fairq_dequeue(qpair->fairq);
+		if (reqdata)
+			return reqdata;
+	}
+
+	/* With the ring backend the lists only hold overflow, drain
+	 * it first so that it cannot starve behind the ring. */
+	if (nfs_req_st.reqs.ring_size) {
+		if (atomic_fetch_uint32_t(&qpair->consumer.size) == 0 &&
+		    atomic_fetch_uint32_t(&qpair->producer.size) == 0)
+			goto out;
+	}
+
 	pthread_spin_lock(&qpair->consumer.sp);
 	if (qpair->consumer.size > 0) {
 		reqdata =
@@ -1491,6 +2390,7 @@ request_data_t *nfs_rpc_consume_req(struct req_q_pair *qpair)
 				      req_q);
 		glist_del(&reqdata->req_q);
 		--(qpair->consumer.size);
+		nfs_rpc_fill_batch(qpair, worker, room);
 		pthread_spin_unlock(&qpair->consumer.sp);
 		goto out;
 	} else {
@@ -1517,6 +2417,7 @@ request_data_t *nfs_rpc_consume_req(struct req_q_pair *qpair)
 					      request_data_t, req_q);
 			glist_del(&reqdata->req_q);
 			--(qpair->consumer.size);
+			nfs_rpc_fill_batch(qpair, worker, room);
 			pthread_spin_unlock(&qpair->consumer.sp);
 			if (s)
 				LogFullDebug(COMPONENT_DISPATCH,
@@ -1534,23 +2435,82 @@ request_data_t *nfs_rpc_consume_req(struct req_q_pair *qpair)
 				     s, csize, psize);
 	}
  out:
+	if (nfs_req_st.reqs.ring_size) {
+		if (!reqdata)
+			reqdata = gsh_mpmc_ring_pop(&qpair->ring);
+		if (reqdata)
+			nfs_rpc_fill_batch_ring(qpair, worker,
+						room - worker->batch_size);
+	}
 	return reqdata;
 }
 
-request_data_t *nfs_rpc_dequeue_req(nfs_worker_data_t *worker)
+/**
+ * @brief Check whether a queue shard looks empty
+ *
+ * This is done without taking any lock, so that workers looking for
+ * work to steal do not bounce the cache lines of remote shards.
+ *
+ * @param[in] qs Queue shard
+ *
+ * @return true if no request is queued on the shard.
+ */
+static inline bool nfs_rpc_q_set_empty(struct req_q_set *qs)
+{
+	int ix;
+
+	for (ix = 0; ix < N_REQ_QUEUES; ++ix) {
+		if (atomic_fetch_uint32_t(&qs->qset[ix].producer.size) ||
+		    atomic_fetch_uint32_t(&qs->qset[ix].consumer.size))
+			return false;
+		if (nfs_req_st.reqs.ring_size &&
+		    gsh_mpmc_ring_size(&qs->qset[ix].ring))
+			return false;
+		if (qs->qset[ix].fairq &&
+		    atomic_fetch_uint32_t(&qs->qset[ix].fairq->size))
+			return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Take requests from a queue shard
+ *
+ * When no worker is waiting on the shard, up to Dispatch_Batch_Size
+ * requests are taken from the first non-empty queue; all but the
+ * first go on the worker's batch.
+ *
+ * @param[in] nfs_request_q Queue shard
+ * @param[in] worker        Worker dequeueing, its batch must be empty
+ *
+ * @return A request or NULL if the shard is empty.
+ */
+static request_data_t *nfs_rpc_dequeue_q_set(struct req_q_set *nfs_request_q,
+					     nfs_worker_data_t *worker)
 {
 	request_data_t *reqdata = NULL;
-	struct req_q_set *nfs_request_q = &nfs_req_st.reqs.nfs_request_q;
 	struct req_q_pair *qpair;
-	uint32_t ix, slot;
-	struct timespec timeout;
+	uint32_t ix, slot, room = 0;
+
+	if (nfs_param.core_param.dispatch_batch_size > 1 &&
+	    atomic_fetch_uint32_t(&nfs_request_q->waiters) == 0)
+		room = nfs_param.core_param.dispatch_batch_size - 1;
+
+	/* Reclaims, only queued during grace, go first */
+	qpair = &(nfs_request_q->qset[REQ_Q_RECLAIM]);
+	if (atomic_fetch_uint32_t(&qpair->consumer.size) != 0 ||
+	    atomic_fetch_uint32_t(&qpair->producer.size) != 0 ||
+	    nfs_req_st.reqs.ring_size) {
+		reqdata = nfs_rpc_consume_req(qpair, worker, room);
+		if (reqdata)
+			goto dequeued;
+	}
 
 	/* XXX: the following stands in for a more robust/flexible
 	 * weighting function */
 
 	/* slot in 1..4 */
- retry_deq:
-	slot = (nfs_rpc_q_next_slot() % 4);
+	slot = (nfs_rpc_q_next_slot(nfs_request_q) % 4);
 	for (ix = 0; ix < 4; ++ix) {
 		switch (slot) {
 		case 0:
@@ -1580,66 +2540,176 @@ request_data_t *nfs_rpc_dequeue_req(nfs_worker_data_t *worker)
 			     &qpair->producer, &qpair->consumer);
 
 		/* anything? */
-		reqdata = nfs_rpc_consume_req(qpair);
-		if (reqdata) {
-			(void) atomic_inc_uint32_t(&dequeued_reqs);
-			break;
-		}
+		reqdata = nfs_rpc_consume_req(qpair, worker, room);
+		if (reqdata)
+			goto dequeued;
 
 		++slot;
 		slot = slot % 4;
 
 	}			/* for */
 
-	/* wait */
+	return NULL;
+
+ dequeued:
+	(void) atomic_add_uint32_t(&dequeued_reqs, 1 + worker->batch_size);
+	(void) atomic_inc_uint64_t(&dequeue_batches);
+	(void) atomic_add_uint64_t(&dequeue_batch_reqs, 1 + worker->batch_size);
+	return reqdata;
+}
+
+/**
+ * @brief Check whether queued requests wait for QoS tokens
+ *
+ * No worker is woken when the buckets refill, so the waiting workers
+ * have to look again.
+ *
+ * @return true if a fair queue of any shard is held.
+ */
+static bool nfs_rpc_qos_held(void)
+{
+	struct req_q_set *qs;
+	struct req_fairq *fq;
+	uint32_t shard;
+	int ix;
+
+	for (shard = 0; shard < nfs_req_st.reqs.n_shards; ++shard) {
+		qs = &nfs_req_st.reqs.nfs_request_q[shard];
+		for (ix = 0; ix < N_REQ_QUEUES; ++ix) {
+			fq = qs->qset[ix].fairq;
+			if (fq && fq->held && atomic_fetch_uint32_t(&fq->size))
+				return true;
+		}
+	}
+	return false;
+}
+
+request_data_t *nfs_rpc_dequeue_req(nfs_worker_data_t *worker)
+{
+	request_data_t *reqdata = NULL;
+	struct req_q_set *nfs_request_q;
+	uint32_t n_shards = nfs_req_st.reqs.n_shards;
+	uint32_t home, shard;
+	struct timespec timeout;
+	int rc;
+
+	/* requests taken ahead by an earlier dequeue */
+	if (worker->batch_size > 0) {
+		reqdata = glist_first_entry(&worker->batch, request_data_t,
+					    req_q);
+		glist_del(&reqdata->req_q);
+		--(worker->batch_size);
+		goto out;
+	}
+
+ retry_deq:
+	/* local shard first */
+	home = nfs_rpc_q_local_shard();
+	nfs_request_q = &nfs_req_st.reqs.nfs_request_q[home];
+	reqdata = nfs_rpc_dequeue_q_set(nfs_request_q, worker);
+
+	/* then steal from siblings */
+	for (shard = 1; !reqdata && shard < n_shards; ++shard) {
+		struct req_q_set *qs =
+			&nfs_req_st.reqs.nfs_request_q[(home + shard)
+						       % n_shards];
+
+		if (nfs_rpc_q_set_empty(qs))
+			continue;
+
+		reqdata = nfs_rpc_dequeue_q_set(qs, worker);
+		if (reqdata)
+			LogFullDebug(COMPONENT_DISPATCH,
+				     "worker %u stole req %p from shard %"
+				     PRIu32, worker->worker_index, reqdata,
+				     (home + shard) % n_shards);
+	}
+
+	/* wait on the local shard */
 	if (!reqdata) {
 		struct fridgethr_context *ctx =
 			container_of(worker, struct fridgethr_context, wd);
 		wait_q_entry_t *wqe = &worker->wqe;
+		bool held = nfs_rpc_qos_held();
 
 		assert(wqe->waiters == 0); /* wqe is not on any wait queue */
-		PTHREAD_MUTEX_lock(&wqe->lwe.mtx);
-		wqe->flags = Wqe_LFlag_WaitSync;
+		wait_park_reset(&wqe->park);
 		wqe->waiters = 1;
 		/* XXX functionalize */
-		pthread_spin_lock(&nfs_req_st.reqs.sp);
-		glist_add_tail(&nfs_req_st.reqs.wait_list, &wqe->waitq);
-		++(nfs_req_st.reqs.waiters);
-		pthread_spin_unlock(&nfs_req_st.reqs.sp);
-		while (!(wqe->flags & Wqe_LFlag_SyncDone)) {
+		pthread_spin_lock(&nfs_request_q->sp);
+		glist_add_tail(&nfs_request_q->wait_list, &wqe->waitq);
+		++(nfs_request_q->waiters);
+		pthread_spin_unlock(&nfs_request_q->sp);
+		if (held) {
+			/* look again once the buckets have refilled */
+			now(&timeout);
+			timeout.tv_nsec += QOS_HELD_WAIT_MS * NS_PER_MSEC;
+			if (timeout.tv_nsec >= NS_PER_SEC) {
+				timeout.tv_nsec -= NS_PER_SEC;
+				++(timeout.tv_sec);
+			}
+		} else {
 			timeout.tv_sec = time(NULL) + 5;
 			timeout.tv_nsec = 0;
-			pthread_cond_timedwait(&wqe->lwe.cv, &wqe->lwe.mtx,
-					       &timeout);
-			if (fridgethr_you_should_break(ctx)) {
+		}
+		for (;;) {
+			rc = wait_park_wait(
+				&wqe->park,
+				nfs_param.core_param.dispatch_worker_spin,
+				&timeout);
+			if (rc == 0)
+				break;
+			if (rc == ETIMEDOUT) {
+				timeout.tv_sec = time(NULL) + 5;
+				timeout.tv_nsec = 0;
+			}
+			/* an idle adaptive worker returns so that it can
+			 * be retired */
+			if (fridgethr_you_should_break(ctx) ||
+			    (rc == ETIMEDOUT &&
+			     (held || nfs_param.core_param.adaptive_workers))) {
+				bool queued;
+
 				/* We are returning;
 				 * so take us out of the waitq */
-				pthread_spin_lock(&nfs_req_st.reqs.sp);
-				if (wqe->waitq.next != NULL
-				    || wqe->waitq.prev != NULL) {
+				pthread_spin_lock(&nfs_request_q->sp);
+				queued = wqe->waitq.next != NULL
+					 || wqe->waitq.prev != NULL;
+				if (queued) {
 					/* Element is still in wqitq,
 					 * remove it */
 					glist_del(&wqe->waitq);
-					--(nfs_req_st.reqs.waiters);
+					--(nfs_request_q->waiters);
 					--(wqe->waiters);
-					wqe->flags &=
-					    ~(Wqe_LFlag_WaitSync |
-					      Wqe_LFlag_SyncDone);
 				}
-				pthread_spin_unlock(&nfs_req_st.reqs.sp);
-				PTHREAD_MUTEX_unlock(&wqe->lwe.mtx);
+				pthread_spin_unlock(&nfs_request_q->sp);
+				/* an idle worker that was signalled anyway
+				 * must take the wakeup, not lose it */
+				if (!queued && !fridgethr_you_should_break(ctx))
+					continue;
+				if (held && !fridgethr_you_should_break(ctx))
+					goto retry_deq;
 				return NULL;
 			}
 		}
 
-		/* XXX wqe was removed from nfs_req_st.waitq
+		/* XXX wqe was removed from the shard waitq
 		 * (by signalling thread) */
-		wqe->flags &= ~(Wqe_LFlag_WaitSync | Wqe_LFlag_SyncDone);
-		PTHREAD_MUTEX_unlock(&wqe->lwe.mtx);
 		LogFullDebug(COMPONENT_DISPATCH, "wqe wakeup %p", wqe);
 		goto retry_deq;
 	} /* !reqdata */
 
+ out:
+	if (nfs_rpc_stage_timing()) {
+		now(&timeout);
+		reqdata->time_dequeued = timespec_diff(&ServerBootTime,
+						       &timeout);
+	}
+
+#ifdef USE_LTTNG
+	tracepoint(nfs_rpc, dequeue, reqdata, worker->worker_index);
+#endif
+
 #if defined(HAVE_BLKIN)
 	/* thread id */
 	BLKIN_KEYVAL_INTEGER(
@@ -1670,6 +2740,7 @@ static inline request_data_t *alloc_nfs_request(SVCXPRT *xprt)
 
 	/* set the request as NFS already-read */
 	reqdata->rtype = NFS_REQUEST;
+	reqdata->inflight_shard = -1;
 
 	/* set up req */
 	reqdata->r_u.req.svc.rq_xprt = xprt;
@@ -1825,6 +2896,112 @@ static bool is_rpc_call_valid(struct svc_req *req)
 	return false;
 }				/* is_rpc_call_valid */
 
+/** Time this decoder executed requests in its pass over an xprt */
+static __thread nsecs_elapsed_t inline_spent;
+
+/**
+ * @brief Whether the decoder may execute a request itself
+ *
+ * With Dispatch_Inline_Low_Latency, a NULL, GETATTR or ACCESS, or an
+ * NFSv4 COMPOUND of no more than those, RENEW and the operations
+ * setting them up, is executed by the thread that decoded it, saving
+ * the hand over to a worker and its wakeup.  Only while the low
+ * latency queue is no deeper than Dispatch_Inline_Max_Depth and the
+ * decoder has time left of Dispatch_Inline_Budget_Usecs, so that under
+ * load, or once a request was slow, the decoder goes back to decoding
+ * and the request waits its turn; nor when fair queueing or QoS would
+ * hold the request back.
+ *
+ * @param[in] reqdata Request, decoded
+ *
+ * @return true if the request is to be executed inline.
+ */
+static bool nfs_rpc_inline_ok(request_data_t *reqdata)
+{
+	struct svc_req *svc = &reqdata->r_u.req.svc;
+
+	if (!nfs_param.core_param.dispatch_inline ||
+	    nfs_param.core_param.fair.enabled || nfs_qos_active())
+		return false;
+
+	if (svc->rq_prog != nfs_param.core_param.program[P_NFS])
+		return false;
+
+	if (nfs_param.core_param.dispatch_inline_budget != 0 &&
+	    inline_spent >= nfs_param.core_param.dispatch_inline_budget *
+			    NS_PER_USEC)
+		return false;
+
+	if (nfs_rpc_qset_depth(REQ_Q_LOW_LATENCY) >
+	    nfs_param.core_param.dispatch_inline_depth)
+		return false;
+
+#ifdef _USE_NFS3
+	if (svc->rq_vers == NFS_V3)
+		return svc->rq_proc == NFSPROC3_NULL ||
+		       svc->rq_proc == NFSPROC3_GETATTR ||
+		       svc->rq_proc == NFSPROC3_ACCESS;
+#endif /* _USE_NFS3 */
+
+	if (svc->rq_vers == NFS_V4) {
+		COMPOUND4args *args =
+				&reqdata->r_u.req.arg_nfs.arg_compound4;
+		u_int ix;
+
+		if (svc->rq_proc == NFSPROC4_NULL)
+			return true;
+		if (svc->rq_proc != NFSPROC4_COMPOUND)
+			return false;
+
+		for (ix = 0; ix < args->argarray.argarray_len; ++ix) {
+			switch (args->argarray.argarray_val[ix].argop) {
+			case NFS4_OP_SEQUENCE:
+			case NFS4_OP_PUTFH:
+			case NFS4_OP_PUTROOTFH:
+			case NFS4_OP_GETFH:
+			case NFS4_OP_GETATTR:
+			case NFS4_OP_ACCESS:
+			case NFS4_OP_RENEW:
+				break;
+			default:
+				return false;
+			}
+		}
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * @brief Execute a request on the decoder thread, as a worker would
+ *
+ * The request takes a credit of its xprt as if it were queued, and
+ * gives it back once it is done.  Its time is charged to the
+ * decoder's budget.
+ *
+ * @param[in] reqdata Request, decoded
+ */
+static void nfs_rpc_execute_inline(request_data_t *reqdata)
+{
+	SVCXPRT *xprt = reqdata->r_u.req.svc.rq_xprt;
+	struct req_op_context *saved_ctx = op_ctx;
+	struct timespec start, end;
+
+	gsh_xprt_ref(xprt, XPRT_PRIVATE_FLAG_INCREQ, __func__, __LINE__);
+	now(&reqdata->time_queued);
+	(void) atomic_inc_uint64_t(&inline_reqs);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	(void) nfs_rpc_execute(reqdata, false);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	inline_spent += timespec_diff(&start, &end);
+
+	op_ctx = saved_ctx;
+	nfs_rpc_return_credit(xprt);
+	pool_free(request_pool, reqdata);
+}
+
 enum xprt_stat thr_decode_rpc_request(void *context, SVCXPRT *xprt)
 {
 	request_data_t *reqdata;
@@ -1845,6 +3022,12 @@ enum xprt_stat thr_decode_rpc_request(void *context, SVCXPRT *xprt)
 		 xprt, context);
 
 	reqdata = alloc_nfs_request(xprt);	/* ! NULL */
+	if (nfs_rpc_stage_timing()) {
+		struct timespec ts;
+
+		now(&ts);
+		reqdata->time_decode = timespec_diff(&ServerBootTime, &ts);
+	}
 #if HAVE_BLKIN
 	blkin_init_new_trace(&reqdata->r_u.req.svc.bl_trace, "nfs-ganesha",
 			&xprt->blkin.endp);
@@ -1944,6 +3127,20 @@ enum xprt_stat thr_decode_rpc_request(void *context, SVCXPRT *xprt)
 		     reqdata->r_u.req.svc.rq_xid,
 		     xprt);
 
+#ifdef USE_RPC_TLS
+	/* A client starting TLS, answered and set up here, before
+	 * anything else is read from the connection.
+	 */
+	if (nfs_rpc_tls_probe(&reqdata->r_u.req.svc)) {
+		if (!nfs_rpc_tls_start(xprt, &reqdata->r_u.req.svc)) {
+			DISP_RUNLOCK(xprt);
+			stat = XPRT_DIED;
+			goto done;
+		}
+		goto finish;
+	}
+#endif
+
 	/* If authentication is AUTH_NONE or AUTH_UNIX, then the value of
 	 * no_dispatch remains false and the request proceeds normally.
 	 *
@@ -2002,10 +3199,17 @@ enum xprt_stat thr_decode_rpc_request(void *context, SVCXPRT *xprt)
 	if (context) {
 		/* already running worker thread, do not enqueue */
 		DISP_RUNLOCK(xprt);
-		nfs_rpc_execute(reqdata);
+		(void) nfs_rpc_execute(reqdata, false);
 		return XPRT_IDLE;
 	}
 
+	if (nfs_rpc_inline_ok(reqdata)) {
+		stat = SVC_STAT(xprt);
+		DISP_RUNLOCK(xprt);
+		nfs_rpc_execute_inline(reqdata);
+		return stat;
+	}
+
 	gsh_xprt_ref(xprt, XPRT_PRIVATE_FLAG_INCREQ, __func__, __LINE__);
 
 	/* XXX as above, the call has already passed is_rpc_call_valid,
@@ -2027,8 +3231,8 @@ enum xprt_stat thr_decode_rpc_request(void *context, SVCXPRT *xprt)
 
 static inline bool thr_continue_decoding(SVCXPRT *xprt, enum xprt_stat stat)
 {
-	if (unlikely(xprt->xp_requests
-		     > nfs_param.core_param.dispatch_max_reqs_xprt))
+	if (unlikely(atomic_fetch_uint32_t(&xprt->xp_requests)
+		     >= xprt_credit_budget()))
 		return false;
 
 	return (stat == XPRT_MOREREQS);
@@ -2041,12 +3245,17 @@ void thr_decode_rpc_requests(struct fridgethr_context *thr_ctx)
 
 	LogFullDebug(COMPONENT_RPC, "enter xprt=%p", xprt);
 
+	inline_spent = 0;
 	do {
 		stat = thr_decode_rpc_request(NULL, xprt);
 	} while (thr_continue_decoding(xprt, stat));
 
 	LogDebug(COMPONENT_DISPATCH, "exiting, stat=%s", xprt_stat_s[stat]);
 
+	/* out of credits with more to read; the stall owns our ref */
+	if (stat == XPRT_MOREREQS && nfs_rpc_stall_xprt(xprt))
+		return;
+
 	/* order MUST be SVC_DESTROY, gsh_xprt_unref
 	 * (current refcnt balancing) */
 	if (stat != XPRT_DIED)
@@ -2101,6 +3310,8 @@ static bool nfs_rpc_getreq_ng(SVCXPRT *xprt /*, int chan_id */)
 	 * is a message to the log. */
 	int code = 0;
 	int rpc_fd = xprt->xp_fd;
+	struct fridgethr *fr = req_fridge;
+	gsh_xprt_private_t *xu;
 	uint32_t nreqs;
 
 	LogFullDebug(COMPONENT_RPC, "enter xprt=%p", xprt);
@@ -2176,19 +3387,20 @@ static bool nfs_rpc_getreq_ng(SVCXPRT *xprt /*, int chan_id */)
 
 	LogFullDebug(COMPONENT_RPC, "before cond stall %p", xprt);
 
-	/* Check per-xprt max outstanding quota */
-	if (nfs_rpc_cond_stall_xprt(xprt)) {
-		/* Xprt stalled--bail.  Stall queue owns xprt ref and state. */
+	/* Check per-xprt request credits */
+	if (nfs_rpc_stall_xprt(xprt)) {
+		/* Xprt stalled--bail.  The stall owns the xprt ref. */
 		LogDebug(COMPONENT_DISPATCH, "stalled, bail");
-		/* clear decoding flag */
-		gsh_xprt_clear_flag(xprt, XPRT_PRIVATE_FLAG_DECODING);
 		goto out;
 	}
 
 	LogFullDebug(COMPONENT_DISPATCH, "before fridgethr_get");
 
-	/* schedule a thread to decode */
-	code = fridgethr_submit(req_fridge, thr_decode_rpc_requests, xprt);
+	/* schedule a thread to decode, on the xprt's node if it has one */
+	xu = (gsh_xprt_private_t *) xprt->xp_u1;
+	if (node_fridge && xu->numa_node != GSH_NUMA_NODE_ANY)
+		fr = node_fridge[xu->numa_node];
+	code = fridgethr_submit(fr, thr_decode_rpc_requests, xprt);
 	if (code == ETIMEDOUT) {
 		LogFullDebug(COMPONENT_RPC,
 			     "Decode dispatch timed out, rearming. xprt=%p",
@@ -0,0 +1,378 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file nfs_rpc_fairq.c
+ * @brief Deficit round robin scheduling of requests across clients
+ *
+ * Flows are keyed by client address, which is what identifies a
+ * gsh_client, so the scheduler needs no client manager lookup on the
+ * decoder path.  A flow is created when its client has its first
+ * request queued and released as soon as it drains, so idle clients
+ * cost nothing.
+ *
+ * The QoS limits of the clients and exports are enforced here too, so
+ * that a request waiting for tokens holds no worker.
+ */
+
+#include "config.h"
+#include <string.h>
+#include <pthread.h>
+#include "log.h"
+#include "gsh_rpc.h"
+#include "abstract_atomic.h"
+#include "nfs_core.h"
+#include "nfs_req_queue.h"
+#include "nfs_fh.h"
+#include "export_mgr.h"
+#include "nfs_qos.h"
+
+/**
+ * @brief Allocate a fair queue
+ *
+ * @return The new, empty scheduler.
+ */
+struct req_fairq *nfs_rpc_fairq_create(void)
+{
+	struct req_fairq *fq = gsh_calloc(1, sizeof(struct req_fairq));
+	int ix;
+
+	pthread_spin_init(&fq->sp, PTHREAD_PROCESS_PRIVATE);
+	glist_init(&fq->active);
+	for (ix = 0; ix < REQ_FAIRQ_BUCKETS; ++ix)
+		glist_init(&fq->flows[ix]);
+
+	return fq;
+}
+
+/**
+ * @brief Get the caller address of a request, v4-mapped addresses unmapped
+ *
+ * @param[in]  reqdata Request
+ * @param[out] addr    Caller address
+ */
+static void fairq_caller_addr(request_data_t *reqdata, sockaddr_t *addr)
+{
+	struct sockaddr_in6 *sin6;
+	struct sockaddr_in *sin;
+
+	memcpy(addr, svc_getrpccaller(reqdata->r_u.req.svc.rq_xprt),
+	       sizeof(sockaddr_t));
+
+	if (addr->ss_family != AF_INET6)
+		return;
+
+	sin6 = (struct sockaddr_in6 *)addr;
+	if (!IN6_IS_ADDR_V4MAPPED(&sin6->sin6_addr))
+		return;
+
+	sin = (struct sockaddr_in *)addr;
+	memcpy(&sin->sin_addr.s_addr, &sin6->sin6_addr.s6_addr[12],
+	       sizeof(sin->sin_addr.s_addr));
+	sin->sin_family = AF_INET;
+	sin->sin_port = 0;
+}
+
+/**
+ * @brief Find the Dispatch_Client_Weight block of a client
+ *
+ * @param[in] addr Client address
+ *
+ * @return The block, NULL if the client is not listed.
+ */
+struct dispatch_client_weight *nfs_rpc_fairq_client(sockaddr_t *addr)
+{
+	struct glist_head *glist;
+	struct dispatch_client_weight *cw;
+
+	glist_for_each(glist, &nfs_param.core_param.fair.weights) {
+		cw = glist_entry(glist, struct dispatch_client_weight, link);
+		if (cmp_sockaddr(&cw->addr, addr, true))
+			return cw;
+	}
+	return NULL;
+}
+
+/**
+ * @brief Find the export and the bytes of a request, for QoS
+ *
+ * Only the first handle of a request is looked at: every NFSv3
+ * procedure but NULL takes the handle it works on first, and a
+ * COMPOUND is charged to the export of its first PUTFH.  The export
+ * is only kept if it has limits.
+ *
+ * @param[in] reqdata Request, decoded
+ */
+static void fairq_qos_cost(request_data_t *reqdata)
+{
+	nfs_request_t *req = &reqdata->r_u.req;
+	struct svc_req *svc = &req->svc;
+	struct gsh_export *export;
+	int export_id = -1;
+
+	if (svc->rq_prog != nfs_param.core_param.program[P_NFS])
+		return;
+
+#ifdef _USE_NFS3
+	if (svc->rq_vers == NFS_V3 && svc->rq_proc != NFSPROC3_NULL) {
+		nfs_fh3 *fh3 = (nfs_fh3 *) &req->arg_nfs;
+
+		if (fh3->data.data_len >= sizeof(file_handle_v3_t))
+			export_id = ntohs(((file_handle_v3_t *)
+					   fh3->data.data_val)->exportid);
+		if (svc->rq_proc == NFSPROC3_READ)
+			req->qos_bytes = req->arg_nfs.arg_read3.count;
+		else if (svc->rq_proc == NFSPROC3_WRITE)
+			req->qos_bytes =
+				req->arg_nfs.arg_write3.data.data_len;
+	}
+#endif /* _USE_NFS3 */
+
+	if (svc->rq_vers == NFS_V4 && svc->rq_proc == NFSPROC4_COMPOUND) {
+		COMPOUND4args *args = &req->arg_nfs.arg_compound4;
+		nfs_argop4 *op;
+		u_int ix;
+
+		for (ix = 0; ix < args->argarray.argarray_len; ++ix) {
+			op = &args->argarray.argarray_val[ix];
+			switch (op->argop) {
+			case NFS4_OP_PUTFH:
+				if (export_id < 0 &&
+				    op->nfs_argop4_u.opputfh.object.nfs_fh4_len
+				    >= sizeof(file_handle_v4_t))
+					export_id = ntohs(((file_handle_v4_t *)
+					    op->nfs_argop4_u.opputfh.object.
+					    nfs_fh4_val)->id.exports);
+				break;
+			case NFS4_OP_READ:
+				req->qos_bytes += op->nfs_argop4_u.opread.count;
+				break;
+			case NFS4_OP_WRITE:
+				req->qos_bytes +=
+				    op->nfs_argop4_u.opwrite.data.data_len;
+				break;
+			default:
+				break;
+			}
+		}
+	}
+
+	if (export_id < 0)
+		return;
+
+	export = get_gsh_export(export_id);
+	if (export == NULL)
+		return;
+
+	if (qos_limited(&export->qos.limits))
+		req->qos_export = export;
+	else
+		put_gsh_export(export);
+}
+
+/**
+ * @brief Check and charge the buckets of a request
+ *
+ * @note The fair queue spinlock MUST be held.
+ *
+ * @param[in] flow    Flow of the request
+ * @param[in] reqdata Request
+ * @param[in] now     Current time
+ *
+ * @return true if the request may be served now.
+ */
+static bool fairq_qos_admit(struct req_fair_flow *flow,
+			    request_data_t *reqdata, nsecs_elapsed_t now)
+{
+	struct qos_bucket *client = flow->cw ? &flow->cw->qos : NULL;
+	struct gsh_export *export = reqdata->r_u.req.qos_export;
+	struct qos_bucket *exp = export ? &export->qos : NULL;
+
+	if (!qos_bucket_ready(client, now) || !qos_bucket_ready(exp, now))
+		return false;
+
+	qos_bucket_charge(client, reqdata->r_u.req.qos_bytes);
+	qos_bucket_charge(exp, reqdata->r_u.req.qos_bytes);
+	return true;
+}
+
+/**
+ * @brief Look up the flow of a client
+ *
+ * @note The fair queue spinlock MUST be held.
+ *
+ * @param[in] fq   Fair queue
+ * @param[in] addr Client address
+ * @param[in] key  Hash of addr
+ *
+ * @return The flow or NULL.
+ */
+static struct req_fair_flow *fairq_lookup(struct req_fairq *fq,
+					  sockaddr_t *addr, uint64_t key)
+{
+	struct glist_head *glist;
+	struct req_fair_flow *flow;
+
+	glist_for_each(glist, &fq->flows[key % REQ_FAIRQ_BUCKETS]) {
+		flow = glist_entry(glist, struct req_fair_flow, hash);
+		if (flow->key == key && cmp_sockaddr(&flow->addr, addr, true))
+			return flow;
+	}
+	return NULL;
+}
+
+/**
+ * @brief Queue a request on the flow of its client
+ *
+ * @param[in] fq      Fair queue
+ * @param[in] reqdata Request, must be an NFS_REQUEST
+ */
+void nfs_rpc_fairq_enqueue(struct req_fairq *fq, request_data_t *reqdata)
+{
+	struct req_fair_flow *flow, *newflow = NULL;
+	sockaddr_t addr;
+	uint64_t key;
+
+	fairq_caller_addr(reqdata, &addr);
+	key = hash_sockaddr(&addr, true);
+
+	reqdata->r_u.req.qos_export = NULL;
+	reqdata->r_u.req.qos_bytes = 0;
+	if (nfs_qos_active())
+		fairq_qos_cost(reqdata);
+
+ retry:
+	pthread_spin_lock(&fq->sp);
+	flow = fairq_lookup(fq, &addr, key);
+	if (flow == NULL) {
+		if (newflow == NULL) {
+			/* don't allocate under the spinlock */
+			pthread_spin_unlock(&fq->sp);
+			newflow = gsh_calloc(1, sizeof(struct req_fair_flow));
+			glist_init(&newflow->reqs);
+			memcpy(&newflow->addr, &addr, sizeof(addr));
+			newflow->key = key;
+			newflow->cw = nfs_rpc_fairq_client(&addr);
+			newflow->weight = newflow->cw ? newflow->cw->weight
+						      : 1;
+			goto retry;
+		}
+		flow = newflow;
+		newflow = NULL;
+		glist_add_tail(&fq->flows[key % REQ_FAIRQ_BUCKETS],
+			       &flow->hash);
+		glist_add_tail(&fq->active, &flow->active);
+		++(fq->nflows);
+	}
+
+	glist_add_tail(&flow->reqs, &reqdata->req_q);
+	++(flow->size);
+	(void) atomic_inc_uint32_t(&fq->size);
+	pthread_spin_unlock(&fq->sp);
+
+	/* lost a race with another decoder for this client */
+	if (newflow != NULL)
+		gsh_free(newflow);
+}
+
+/**
+ * @brief Take the next request in deficit round robin order
+ *
+ * @param[in] fq Fair queue
+ *
+ * @return A request or NULL if no client has queued work, or none may
+ *         be served before its QoS buckets refill.
+ */
+request_data_t *nfs_rpc_fairq_dequeue(struct req_fairq *fq)
+{
+	struct req_fair_flow *flow, *drained = NULL;
+	request_data_t *reqdata = NULL;
+	bool qos = nfs_qos_active();
+	nsecs_elapsed_t now_ns = 0;
+	uint32_t deferred = 0;
+	struct timespec ts;
+
+	if (atomic_fetch_uint32_t(&fq->size) == 0)
+		return NULL;
+
+	if (qos) {
+		now(&ts);
+		now_ns = timespec_to_nsecs(&ts);
+	}
+
+	pthread_spin_lock(&fq->sp);
+	while (!glist_empty(&fq->active)) {
+		flow = glist_first_entry(&fq->active, struct req_fair_flow,
+					 active);
+
+		if (flow->deficit <= 0) {
+			/* end of this flow's turn, on to the next */
+			flow->deficit += nfs_param.core_param.fair.quantum *
+					 flow->weight;
+			glist_del(&flow->active);
+			glist_add_tail(&fq->active, &flow->active);
+			/* the flows deferred so far are now ahead of this
+			 * one, count them again so that it gets its look
+			 */
+			deferred = 0;
+			continue;
+		}
+
+		reqdata = glist_first_entry(&flow->reqs, request_data_t,
+					    req_q);
+
+		if (qos && !fairq_qos_admit(flow, reqdata, now_ns)) {
+			/* wait for tokens, keeping the deficit */
+			reqdata = NULL;
+			glist_del(&flow->active);
+			glist_add_tail(&fq->active, &flow->active);
+			if (++deferred >= fq->nflows)
+				break;
+			continue;
+		}
+
+		glist_del(&reqdata->req_q);
+		--(flow->size);
+		--(flow->deficit);
+		(void) atomic_dec_uint32_t(&fq->size);
+
+		if (flow->size == 0) {
+			/* an idle flow keeps no credit */
+			glist_del(&flow->active);
+			glist_del(&flow->hash);
+			--(fq->nflows);
+			drained = flow;
+		}
+		break;
+	}
+	fq->held = reqdata == NULL && deferred > 0;
+	pthread_spin_unlock(&fq->sp);
+
+	if (drained != NULL)
+		gsh_free(drained);
+
+	if (reqdata != NULL && reqdata->r_u.req.qos_export != NULL) {
+		put_gsh_export(reqdata->r_u.req.qos_export);
+		reqdata->r_u.req.qos_export = NULL;
+	}
+
+	return reqdata;
+}
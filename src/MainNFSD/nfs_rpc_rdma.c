@@ -40,6 +40,7 @@
 
 #include "gsh_rpc.h"
 #include "nfs_init.h"
+#include "nfs_core.h"
 
 /**
  * rpc_rdma_disconnect_callback: placeholder
@@ -67,25 +68,37 @@ rpc_rdma_disconnect_callback(SVCXPRT *xprt)
 void *
 nfs_rdma_dispatcher_thread(void *nullarg)
 {
+	uint32_t credits = nfs_param.core_param.rpc.rdma.credits;
+	u_int inline_size = nfs_param.core_param.rpc.rdma.inline_size;
+	char port[6];
 	struct rpc_rdma_attr xa = {
 		.statistics_prefix = NULL,
 		.node = "::",
-		.port = "20049",
+		.port = port,
 		.disconnect_cb = rpc_rdma_disconnect_callback,
 		.request_cb = thr_decode_rpc_request,
 		.timeout = 30000,		/* in ms */
-		.sq_depth = 32,			/* default was 50 */
+		/* a send and a receive per credit, and one spare each
+		 * for the credit grant in flight
+		 */
+		.sq_depth = credits + 2,	/* default was 50 */
 		.max_send_sge = 32,		/* minimum 2 */
-		.rq_depth = 32,			/* default was 50 */
+		.rq_depth = credits + 2,	/* default was 50 */
 		.max_recv_sge = 31,		/* minimum 1 */
 		.backlog = 10,			/* minimum 2 */
-		.credits = 30,			/* default 10 */
-		.worker_count = 4,		/* default 0 */
+		.credits = credits,		/* default 10 */
+		.worker_count = nfs_param.core_param.rpc.rdma.worker_count,
 		.worker_queue_size = 256,	/* default 0 */
 		.destroy_on_disconnect = true,
 		.use_srq = false,
 	};
-	SVCXPRT *l_xprt = rpc_rdma_create(&xa);
+	SVCXPRT *l_xprt;
+
+	SetNameFunction("nfs_rdma_disp");
+
+	snprintf(port, sizeof(port), "%" PRIu16,
+		 nfs_param.core_param.rpc.rdma.port);
+	l_xprt = rpc_rdma_create(&xa);
 
 	if (!l_xprt) {
 		LogCrit(COMPONENT_DISPATCH,
@@ -93,18 +106,21 @@ nfs_rdma_dispatcher_thread(void *nullarg)
 		return NULL;
 	}
 	LogEvent(COMPONENT_DISPATCH,
-		"NFS/RDMA engine initialized");
+		"NFS/RDMA engine initialized on port %s, %" PRIu32
+		" credits, inline size %u",
+		port, credits, inline_size);
 
 	/* All clones and large allocations are done in this loop,
 	 * avoiding contention in the heap(s), serialized by the
 	 * connection_requests queue.
 	 */
 	while (l_xprt->xp_refs > 0) {
-		/* values used in Mooshika were 8*1024, 4*8*1024;
-		 * should be configurable.
+		/* Larger READ and WRITE data go by chunks, so the
+		 * inline buffers need only hold the rest of the RPC.
 		 */
-		SVCXPRT *c_xprt = svc_rdma_create(l_xprt, 4*1024, 4*1024,
-							SVC_XPRT_FLAG_NONE);
+		SVCXPRT *c_xprt = svc_rdma_create(l_xprt, inline_size,
+						  inline_size,
+						  SVC_XPRT_FLAG_NONE);
 		if (!c_xprt) {
 			/* message already logged */
 			continue;
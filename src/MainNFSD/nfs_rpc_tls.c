@@ -0,0 +1,305 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file    nfs_rpc_tls.c
+ * @brief   RPC-with-TLS (RFC 9289) on the TCP transports
+ *
+ * A client asks for TLS with a NULL call whose credential is AUTH_TLS.
+ * The reply's verifier is "STARTTLS", after which the client starts a
+ * TLS 1.3 handshake on the connection.  The decoder of the connection
+ * does the handshake with OpenSSL, then hands the record layer to
+ * kernel TLS: from then on, the socket reads and writes clear text as
+ * before and TI-RPC needs to know nothing of it, while the kernel, or
+ * the NIC, does the encryption.
+ *
+ * A connection that OpenSSL could not hand over both ways is closed,
+ * TI-RPC has no way to call OpenSSL for its records.  No session
+ * tickets are sent, whatever OpenSSL would write after the handshake
+ * would not go through the kernel.
+ */
+
+#include "config.h"
+
+#include <poll.h>
+#include <errno.h>
+#include <time.h>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+
+#include "log.h"
+#include "common_utils.h"
+#include "gsh_rpc.h"
+#include "nfs_core.h"
+#include "nfs_init.h"
+#include "abstract_atomic.h"
+
+#ifndef AUTH_TLS
+#define AUTH_TLS 7
+#endif
+
+/** The verifier of the reply to an AUTH_TLS probe */
+static char starttls[] = "STARTTLS";
+
+/** The ALPN protocol of RPC-with-TLS */
+static const unsigned char alpn_sunrpc[] = "\x06sunrpc";
+
+static SSL_CTX *tls_ctx;
+
+/**
+ * @brief Log the OpenSSL errors queued by a failed call
+ *
+ * @param[in] what What failed
+ */
+static void tls_log_errors(const char *what)
+{
+	char buf[256];
+	unsigned long err;
+
+	err = ERR_get_error();
+	if (err == 0) {
+		LogInfo(COMPONENT_DISPATCH, "%s failed", what);
+		return;
+	}
+
+	for (; err != 0; err = ERR_get_error()) {
+		ERR_error_string_n(err, buf, sizeof(buf));
+		LogInfo(COMPONENT_DISPATCH, "%s failed: %s", what, buf);
+	}
+}
+
+/**
+ * @brief Pick "sunrpc" from the protocols the client offers
+ */
+static int tls_alpn_select(SSL *ssl, const unsigned char **out,
+			   unsigned char *outlen, const unsigned char *in,
+			   unsigned int inlen, void *arg)
+{
+	unsigned char *sel;
+
+	if (SSL_select_next_proto(&sel, outlen, alpn_sunrpc,
+				  sizeof(alpn_sunrpc) - 1, in, inlen)
+	    != OPENSSL_NPN_NEGOTIATED)
+		return SSL_TLSEXT_ERR_ALERT_FATAL;
+
+	*out = sel;
+	return SSL_TLSEXT_ERR_OK;
+}
+
+/**
+ * @brief Set up the TLS context from the RPC_TLS block
+ *
+ * Does nothing unless Enable_TLS is set, a context that cannot be set
+ * up is fatal.
+ */
+void nfs_rpc_tls_init(void)
+{
+	nfs_tls_parameter_t *param = &nfs_param.tls_param;
+
+	if (!param->enabled)
+		return;
+
+#ifndef SSL_OP_ENABLE_KTLS
+	LogFatal(COMPONENT_INIT,
+		 "RPC_TLS needs an OpenSSL with kernel TLS support");
+#else
+	if (param->certificate == NULL || param->private_key == NULL)
+		LogFatal(COMPONENT_INIT,
+			 "RPC_TLS needs a Certificate and a Private_Key");
+
+	tls_ctx = SSL_CTX_new(TLS_server_method());
+	if (tls_ctx == NULL) {
+		tls_log_errors("SSL_CTX_new");
+		LogFatal(COMPONENT_INIT, "Cannot create the TLS context");
+	}
+
+	/* RFC 9289 requires TLS 1.3 */
+	(void) SSL_CTX_set_min_proto_version(tls_ctx, TLS1_3_VERSION);
+	SSL_CTX_set_options(tls_ctx, SSL_OP_ENABLE_KTLS);
+	(void) SSL_CTX_set_num_tickets(tls_ctx, 0);
+	SSL_CTX_set_alpn_select_cb(tls_ctx, tls_alpn_select, NULL);
+
+	if (SSL_CTX_use_certificate_chain_file(tls_ctx,
+					       param->certificate) != 1) {
+		tls_log_errors(param->certificate);
+		LogFatal(COMPONENT_INIT, "Cannot load TLS certificate %s",
+			 param->certificate);
+	}
+
+	if (SSL_CTX_use_PrivateKey_file(tls_ctx, param->private_key,
+					SSL_FILETYPE_PEM) != 1 ||
+	    SSL_CTX_check_private_key(tls_ctx) != 1) {
+		tls_log_errors(param->private_key);
+		LogFatal(COMPONENT_INIT, "Cannot load TLS private key %s",
+			 param->private_key);
+	}
+
+	if (param->ca_file != NULL) {
+		if (SSL_CTX_load_verify_locations(tls_ctx, param->ca_file,
+						  NULL) != 1) {
+			tls_log_errors(param->ca_file);
+			LogFatal(COMPONENT_INIT,
+				 "Cannot load TLS authorities %s",
+				 param->ca_file);
+		}
+		SSL_CTX_set_verify(tls_ctx, SSL_VERIFY_PEER |
+					    SSL_VERIFY_FAIL_IF_NO_PEER_CERT,
+				   NULL);
+	}
+
+	LogInfo(COMPONENT_INIT, "RPC-with-TLS enabled%s",
+		param->ca_file != NULL ? ", client certificates required"
+				       : "");
+#endif
+}
+
+/**
+ * @brief Whether a call is an AUTH_TLS probe
+ *
+ * @param[in] req Request, its header decoded
+ */
+bool nfs_rpc_tls_probe(struct svc_req *req)
+{
+	return req->rq_msg->rm_call.cb_cred.oa_flavor == AUTH_TLS &&
+	       req->rq_proc == 0;
+}
+
+/**
+ * @brief Wait for the socket until the handshake may go on
+ *
+ * @param[in] fd       Socket
+ * @param[in] events   POLLIN or POLLOUT
+ * @param[in] deadline When the handshake has to be done
+ *
+ * @return true if it may go on.
+ */
+static bool tls_wait(int fd, short events, const struct timespec *deadline)
+{
+	struct pollfd pfd = { .fd = fd, .events = events };
+	struct timespec ts;
+	nsecs_elapsed_t left;
+	int rc;
+
+	do {
+		now(&ts);
+		if (gsh_time_cmp(&ts, deadline) >= 0)
+			return false;
+		left = timespec_diff(&ts, deadline);
+		rc = poll(&pfd, 1, left / NS_PER_MSEC + 1);
+	} while (rc < 0 && errno == EINTR);
+
+	return rc > 0 && (pfd.revents & (POLLERR | POLLHUP)) == 0;
+}
+
+/**
+ * @brief Answer an AUTH_TLS probe and start TLS on its connection
+ *
+ * Called by the decoder of the connection, that still holds its receive
+ * lock, so nothing else reads from the socket meanwhile.  The client
+ * only starts its handshake once it has the reply.
+ *
+ * A probe on a connection that cannot start TLS is answered with
+ * AUTH_REJECTEDCRED, as by a server without TLS.
+ *
+ * @param[in] xprt Connection
+ * @param[in] req  The NULL call
+ *
+ * @return false if the connection has to be closed.
+ */
+bool nfs_rpc_tls_start(SVCXPRT *xprt, struct svc_req *req)
+{
+	gsh_xprt_private_t *xu = (gsh_xprt_private_t *) xprt->xp_u1;
+	struct timespec deadline;
+	const char *why = NULL;
+	SSL *ssl;
+	int rc;
+
+	if (tls_ctx == NULL || xprt->xp_type != XPRT_TCP || xu == NULL ||
+	    gsh_xprt_tls(xprt)) {
+		svcerr_auth(xprt, req, AUTH_REJECTEDCRED);
+		return true;
+	}
+
+	req->rq_verf.oa_flavor = AUTH_NONE;
+	req->rq_verf.oa_base = starttls;
+	req->rq_verf.oa_length = sizeof(starttls) - 1;
+
+	if (!svc_sendreply(xprt, req, (xdrproc_t) xdr_void, NULL)) {
+		LogInfo(COMPONENT_DISPATCH,
+			"Cannot reply STARTTLS on socket %d", xprt->xp_fd);
+		return false;
+	}
+
+	ssl = SSL_new(tls_ctx);
+	if (ssl == NULL || SSL_set_fd(ssl, xprt->xp_fd) != 1) {
+		tls_log_errors("SSL_new");
+		SSL_free(ssl);
+		return false;
+	}
+
+	now(&deadline);
+	deadline.tv_sec += nfs_param.tls_param.handshake_timeout;
+
+	for (;;) {
+		rc = SSL_accept(ssl);
+		if (rc == 1)
+			break;
+
+		switch (SSL_get_error(ssl, rc)) {
+		case SSL_ERROR_WANT_READ:
+			if (tls_wait(xprt->xp_fd, POLLIN, &deadline))
+				continue;
+			why = "timed out";
+			break;
+		case SSL_ERROR_WANT_WRITE:
+			if (tls_wait(xprt->xp_fd, POLLOUT, &deadline))
+				continue;
+			why = "timed out";
+			break;
+		default:
+			tls_log_errors("SSL_accept");
+			why = "failed";
+			break;
+		}
+		break;
+	}
+
+	if (why == NULL &&
+	    (!BIO_get_ktls_send(SSL_get_wbio(ssl)) ||
+	     !BIO_get_ktls_recv(SSL_get_rbio(ssl))))
+		why = "not handed to kernel TLS";
+
+	/* the kernel has the keys now, or the connection is done with;
+	 * nothing is written by freeing without a shutdown
+	 */
+	SSL_free(ssl);
+
+	if (why != NULL) {
+		LogInfo(COMPONENT_DISPATCH,
+			"TLS handshake on socket %d %s", xprt->xp_fd, why);
+		return false;
+	}
+
+	atomic_set_uint16_t_bits(&xu->flags, XPRT_PRIVATE_FLAG_TLS);
+	LogDebug(COMPONENT_DISPATCH, "TLS started on socket %d",
+		 xprt->xp_fd);
+	return true;
+}
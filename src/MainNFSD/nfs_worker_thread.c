@@ -59,12 +59,14 @@
 #include "export_mgr.h"
 #include "server_stats.h"
 #include "uid2grp.h"
+#include "hot_sampler.h"
 
 #ifdef USE_LTTNG
 #include "gsh_lttng/nfs_rpc.h"
 #endif
 
 pool_t *request_pool;
+iobuf_pool_t *nfs_iobuf_pool;
 
 static struct fridgethr *worker_fridge;
 
@@ -703,13 +705,196 @@ const nfs_function_desc_t *nfs_rpc_get_funcdesc(nfs_request_t *reqnfs)
 	return funcdesc;
 }
 
+/**
+ * @brief Free up a request once it is done with
+ *
+ * @param[in,out] reqdata	NFS request
+ * @param[in] dpq_status	Where the request is with the duplicate
+ *				request cache
+ * @param[in] svc_done		When the service was done, 0 if not timed
+ * @param[in] slocked		The transport's send lock is held
+ */
+static void nfs_rpc_release(request_data_t *reqdata,
+			    dupreq_status_t dpq_status,
+			    nsecs_elapsed_t svc_done, bool slocked)
+{
+	const nfs_function_desc_t *reqdesc = reqdata->r_u.req.funcdesc;
+	SVCXPRT *xprt = reqdata->r_u.req.svc.rq_xprt;
+	nfs_res_t *res_nfs = reqdata->r_u.req.res_nfs;
+
+	/* XXX no need for xprt slock across SVC_FREEARGS */
+	DISP_SUNLOCK(xprt);
+
+	/* Free the allocated resources once the work is done */
+	/* Free the arguments */
+	if ((reqdata->r_u.req.svc.rq_vers == 2)
+	 || (reqdata->r_u.req.svc.rq_vers == 3)
+	 || (reqdata->r_u.req.svc.rq_vers == 4)) {
+		if (!SVC_FREEARGS(xprt, &reqdata->r_u.req.svc,
+				  reqdesc->xdr_decode_func,
+				  (caddr_t) &reqdata->r_u.req.arg_nfs)) {
+			LogCrit(COMPONENT_DISPATCH,
+				"NFS DISPATCHER: FAILURE: Bad SVC_FREEARGS for %s",
+				reqdesc->funcname);
+		}
+	}
+
+	/* Finalize the request.  A hit on an encoded reply has no result
+	 * but still holds its cache entry.
+	 */
+	if (res_nfs || dpq_status == DUPREQ_EXISTS)
+		nfs_dupreq_rele(&reqdata->r_u.req.svc, reqdesc);
+
+	nfs_inflight_done(reqdata, svc_done);
+	if (svc_done != 0 && nfs_param.core_param.enable_latency_hist)
+		server_stats_stages_done(reqdata, svc_done);
+
+	SetClientIP(NULL);
+	if (op_ctx->client != NULL) {
+		put_gsh_client(op_ctx->client);
+		op_ctx->client = NULL;
+	}
+	if (op_ctx->ctx_export != NULL) {
+		put_gsh_export(op_ctx->ctx_export);
+		op_ctx->ctx_export = NULL;
+	}
+	clean_credentials();
+	op_ctx = NULL;
+
+#ifdef USE_LTTNG
+	tracepoint(nfs_rpc, end, reqdata);
+#endif
+}
+
+/**
+ * @brief Send the reply to a request its service is done with
+ *
+ * @param[in,out] reqdata	NFS request
+ * @param[in] rc		What the service returned
+ * @param[in] svc_done		When the service was done, 0 if not timed
+ */
+static void nfs_rpc_reply(request_data_t *reqdata, int rc,
+			  nsecs_elapsed_t svc_done)
+{
+	const nfs_function_desc_t *reqdesc = reqdata->r_u.req.funcdesc;
+	SVCXPRT *xprt = reqdata->r_u.req.svc.rq_xprt;
+	nfs_res_t *res_nfs = reqdata->r_u.req.res_nfs;
+	const char *client_ip = op_ctx->client != NULL
+				? op_ctx->client->hostaddr_str
+				: "<unknown client>";
+	dupreq_status_t dpq_status = DUPREQ_SUCCESS;
+	bool slocked = false;
+
+	reqdata->inflight_stage = INFLIGHT_ENCODE;
+	hot_sample(reqdata->r_u.req.svc.rq_prog, reqdata->r_u.req.svc.rq_vers,
+		   reqdata->r_u.req.svc.rq_proc);
+
+/* NFSv4 stats are handled in nfs4_compound()
+ */
+	if (reqdata->r_u.req.svc.rq_prog != nfs_param.core_param.program[P_NFS]
+	    || reqdata->r_u.req.svc.rq_vers != NFS_V4)
+		server_stats_nfs_done(reqdata, rc, false);
+
+	/* If request is dropped, no return to the client */
+	if (rc == NFS_REQ_DROP) {
+		/* The request was dropped */
+		LogDebug(COMPONENT_DISPATCH,
+			 "Drop request rpc_xid=%u, program %u, version %u, function %u",
+			 reqdata->r_u.req.svc.rq_xid,
+			 (int)reqdata->r_u.req.svc.rq_prog,
+			 (int)reqdata->r_u.req.svc.rq_vers,
+			 (int)reqdata->r_u.req.svc.rq_proc);
+
+		/* If the request is not normally cached, then the entry
+		 * will be removed later.  We only remove a reply that is
+		 * normally cached that has been dropped.
+		 */
+		if (nfs_dupreq_delete(&reqdata->r_u.req.svc)
+		    != DUPREQ_SUCCESS) {
+			LogCrit(COMPONENT_DISPATCH,
+				"Attempt to delete duplicate request failed on line %d",
+				__LINE__);
+		}
+		goto release;
+	} else {
+		LogFullDebug(COMPONENT_DISPATCH,
+			     "Before svc_sendreply on socket %d", xprt->xp_fd);
+
+		DISP_SLOCK(xprt);
+
+		/* encoding the result on xdr output */
+		if (!nfs_dupreq_sendreply(xprt, &reqdata->r_u.req.svc,
+					  reqdesc, res_nfs)) {
+			LogDebug(COMPONENT_DISPATCH,
+				 "NFS DISPATCHER: FAILURE: Error while calling svc_sendreply on a new request. rpcxid=%u socket=%d function:%s client:%s program:%d nfs version:%d proc:%d xid:%u errno: %d",
+				 reqdata->r_u.req.svc.rq_xid, xprt->xp_fd,
+				 reqdesc->funcname,
+				 client_ip,
+				 (int)reqdata->r_u.req.svc.rq_prog,
+				 (int)reqdata->r_u.req.svc.rq_vers,
+				 (int)reqdata->r_u.req.svc.rq_proc,
+				 reqdata->r_u.req.svc.rq_xid, errno);
+			if (xprt->xp_type != XPRT_UDP)
+				svc_destroy(xprt);
+			goto release;
+		}
+
+		LogFullDebug(COMPONENT_DISPATCH,
+			     "After svc_sendreply on socket %d", xprt->xp_fd);
+
+	}			/* rc == NFS_REQ_DROP */
+
+	/* Finish any request not already deleted */
+	if (dpq_status == DUPREQ_SUCCESS)
+		dpq_status = nfs_dupreq_finish(&reqdata->r_u.req.svc, res_nfs);
+
+ release:
+	nfs_rpc_release(reqdata, dpq_status, svc_done, slocked);
+}
+
+/**
+ * @brief Get the client of a request
+ *
+ * A connection only ever carries one client, which it looks up on its
+ * first request and keeps a reference to until it is destroyed.
+ *
+ * @param[in] xprt  Transport the request came on
+ *
+ * @return The client, referenced.
+ */
+static struct gsh_client *get_xprt_client(SVCXPRT *xprt)
+{
+	gsh_xprt_private_t *xu = (gsh_xprt_private_t *)xprt->xp_u1;
+	struct gsh_client *client;
+
+	if (xu == NULL || xprt->xp_type != XPRT_TCP)
+		return get_gsh_client(op_ctx->caller_addr, false);
+
+	client = atomic_fetch_voidptr((void **)&xu->client);
+	if (client == NULL) {
+		client = get_gsh_client(op_ctx->caller_addr, false);
+		if (!atomic_cas_voidptr((void **)&xu->client, NULL, client)) {
+			/* Another request of the connection got there first */
+			put_gsh_client(client);
+			client = atomic_fetch_voidptr((void **)&xu->client);
+		}
+	}
+
+	inc_gsh_client_refcount(client);
+	return client;
+}
+
 /**
  * @brief Main RPC dispatcher routine
  *
  * @param[in,out] reqdata	NFS request
+ * @param[in] may_suspend	The caller can leave the request to be
+ *				finished by nfs_rpc_resume()
  *
+ * @retval true if the request was suspended, and may already be gone.
+ * @retval false if it is done with.
  */
-void nfs_rpc_execute(request_data_t *reqdata)
+bool nfs_rpc_execute(request_data_t *reqdata, bool may_suspend)
 {
 	const char *client_ip = "<unknown client>";
 	const char *progname = "unknown";
@@ -717,11 +902,11 @@ void nfs_rpc_execute(request_data_t *reqdata)
 	nfs_arg_t *arg_nfs = &reqdata->r_u.req.arg_nfs;
 	SVCXPRT *xprt = reqdata->r_u.req.svc.rq_xprt;
 	nfs_res_t *res_nfs;
-	struct export_perms export_perms;
-	struct user_cred user_credentials;
-	struct req_op_context req_ctx;
+	struct export_perms *export_perms = &reqdata->r_u.req.export_perms;
+	struct req_op_context *req_ctx = &reqdata->r_u.req.req_ctx;
 	dupreq_status_t dpq_status;
 	struct timespec timer_start;
+	nsecs_elapsed_t svc_done = 0;
 	enum auth_stat auth_rc;
 	int port;
 	int rc = NFS_REQ_OK;
@@ -729,6 +914,9 @@ void nfs_rpc_execute(request_data_t *reqdata)
 	int exportid = -1;
 #endif /* _USE_NFS3 */
 	bool slocked = false;
+#ifdef USE_MEM_ACCOUNTING
+	struct mem_counter allocs_start;
+#endif
 
 #ifdef USE_LTTNG
 	tracepoint(nfs_rpc, start, reqdata);
@@ -743,14 +931,17 @@ void nfs_rpc_execute(request_data_t *reqdata)
 
 	/* set up the request context
 	 */
-	memset(&export_perms, 0, sizeof(export_perms));
-	memset(&req_ctx, 0, sizeof(req_ctx));
-	op_ctx = &req_ctx;
-	op_ctx->creds = &user_credentials;
+	memset(export_perms, 0, sizeof(*export_perms));
+	memset(req_ctx, 0, sizeof(*req_ctx));
+	op_ctx = req_ctx;
+	op_ctx->creds = &reqdata->r_u.req.user_credentials;
 	op_ctx->caller_addr = (sockaddr_t *)svc_getrpccaller(xprt);
 	op_ctx->nfs_vers = reqdata->r_u.req.svc.rq_vers;
 	op_ctx->req_type = reqdata->rtype;
-	op_ctx->export_perms = &export_perms;
+	op_ctx->export_perms = export_perms;
+	reqdata->r_u.req.may_suspend = may_suspend;
+	reqdata->r_u.req.async_state = NFS_ASYNC_NONE;
+	reqdata->r_u.req.async_resume = NULL;
 
 	/* Set up initial export permissions that don't allow anything. */
 	export_check_access();
@@ -764,6 +955,7 @@ void nfs_rpc_execute(request_data_t *reqdata)
 	op_ctx->queue_wait =
 	    op_ctx->start_time - timespec_diff(&ServerBootTime,
 					       &reqdata->time_queued);
+	nfs_inflight_start(reqdata);
 
 	/* Initialized user_credentials */
 	init_credentials();
@@ -778,7 +970,7 @@ void nfs_rpc_execute(request_data_t *reqdata)
 	 * xprt private data. */
 
 	port = get_port(op_ctx->caller_addr);
-	op_ctx->client = get_gsh_client(op_ctx->caller_addr, false);
+	op_ctx->client = get_xprt_client(xprt);
 	if (op_ctx->client == NULL) {
 		LogDebug(COMPONENT_DISPATCH,
 			 "Cannot get client block for Program %d, Version %d, Function %d",
@@ -827,9 +1019,8 @@ void nfs_rpc_execute(request_data_t *reqdata)
 				     xprt->xp_fd);
 
 			DISP_SLOCK(xprt);
-			if (!svc_sendreply(xprt, &reqdata->r_u.req.svc,
-					   reqdesc->xdr_encode_func,
-					   (caddr_t) res_nfs)) {
+			if (!nfs_dupreq_sendreply(xprt, &reqdata->r_u.req.svc,
+						  reqdesc, res_nfs)) {
 				LogDebug(COMPONENT_DISPATCH,
 					 "NFS DISPATCHER: FAILURE: Error while calling svc_sendreply on a duplicate request. rpcxid=%u socket=%d function:%s client:%s program:%d nfs version:%d proc:%d xid:%u errno: %d",
 					 reqdata->r_u.req.svc.rq_xid,
@@ -932,6 +1123,15 @@ void nfs_rpc_execute(request_data_t *reqdata)
 				goto req_error;
 			}
 
+			if (!export_activate(op_ctx->ctx_export)) {
+				/* Lazy_Init export could not be created,
+				 * let the client retry.
+				 */
+				res_nfs->res_getattr3.status = NFS3ERR_JUKEBOX;
+				rc = NFS_REQ_OK;
+				goto req_error;
+			}
+
 			op_ctx->fsal_export = op_ctx->ctx_export->fsal_export;
 
 			LogMidDebugAlt(COMPONENT_DISPATCH, COMPONENT_EXPORT,
@@ -1009,6 +1209,13 @@ void nfs_rpc_execute(request_data_t *reqdata)
 			} else {
 				op_ctx->ctx_export = get_gsh_export(exportid);
 
+				if (op_ctx->ctx_export != NULL &&
+				    !export_activate(op_ctx->ctx_export)) {
+					/* Lazy_Init export not created */
+					put_gsh_export(op_ctx->ctx_export);
+					op_ctx->ctx_export = NULL;
+				}
+
 				if (op_ctx->ctx_export == NULL) {
 					LogInfoAlt(COMPONENT_DISPATCH,
 						   COMPONENT_EXPORT,
@@ -1054,7 +1261,7 @@ void nfs_rpc_execute(request_data_t *reqdata)
 
 		export_check_access();
 
-		if ((export_perms.options & EXPORT_OPTION_ACCESS_MASK) == 0) {
+		if ((export_perms->options & EXPORT_OPTION_ACCESS_MASK) == 0) {
 			LogInfoAlt(COMPONENT_DISPATCH, COMPONENT_EXPORT,
 				"Client %s is not allowed to access Export_Id %d %s, vers=%d, proc=%d",
 				client_ip,
@@ -1067,7 +1274,7 @@ void nfs_rpc_execute(request_data_t *reqdata)
 			goto auth_failure;
 		}
 
-		if ((EXPORT_OPTION_NFSV3 & export_perms.options) == 0) {
+		if ((EXPORT_OPTION_NFSV3 & export_perms->options) == 0) {
 			LogInfoAlt(COMPONENT_DISPATCH, COMPONENT_EXPORT,
 				"%s Version %d not allowed on Export_Id %d %s for client %s",
 				progname, reqdata->r_u.req.svc.rq_vers,
@@ -1081,9 +1288,10 @@ void nfs_rpc_execute(request_data_t *reqdata)
 
 		/* Check transport type */
 		if (((xprt_type == XPRT_UDP)
-		     && ((export_perms.options & EXPORT_OPTION_UDP) == 0))
+		     && ((export_perms->options & EXPORT_OPTION_UDP) == 0))
 		    || ((xprt_type == XPRT_TCP)
-			&& ((export_perms.options & EXPORT_OPTION_TCP) == 0))) {
+			&& ((export_perms->options & EXPORT_OPTION_TCP)
+			    == 0))) {
 			LogInfoAlt(COMPONENT_DISPATCH, COMPONENT_EXPORT,
 				"%s Version %d over %s not allowed on Export_Id %d %s for client %s",
 				progname, reqdata->r_u.req.svc.rq_vers,
@@ -1096,6 +1304,20 @@ void nfs_rpc_execute(request_data_t *reqdata)
 			goto auth_failure;
 		}
 
+		/* Check the connection is encrypted if it has to be */
+		if ((export_perms->options & EXPORT_OPTION_TLS_REQUIRED)
+		    && !gsh_xprt_tls(xprt)) {
+			LogInfoAlt(COMPONENT_DISPATCH, COMPONENT_EXPORT,
+				"%s Version %d without TLS not allowed on Export_Id %d %s for client %s",
+				progname, reqdata->r_u.req.svc.rq_vers,
+				op_ctx->ctx_export->export_id,
+				op_ctx->ctx_export->fullpath,
+				client_ip);
+
+			auth_rc = AUTH_TOOWEAK;
+			goto auth_failure;
+		}
+
 		/* Test if export allows the authentication provided */
 		if ((reqdesc->dispatch_behaviour & SUPPORTS_GSS)
 		 && !export_check_security(&reqdata->r_u.req.svc)) {
@@ -1114,7 +1336,7 @@ void nfs_rpc_execute(request_data_t *reqdata)
 		 * but only for NFS protocol */
 		if ((reqdata->r_u.req.svc.rq_prog
 		     == nfs_param.core_param.program[P_NFS])
-		 && (export_perms.options & EXPORT_OPTION_PRIVILEGED_PORT)
+		 && (export_perms->options & EXPORT_OPTION_PRIVILEGED_PORT)
 		 && (port >= IPPORT_RESERVED)) {
 			LogInfoAlt(COMPONENT_DISPATCH, COMPONENT_EXPORT,
 				"Non-reserved Port %d is not allowed on Export_Id %d %s for client %s",
@@ -1133,7 +1355,7 @@ void nfs_rpc_execute(request_data_t *reqdata)
 	 */
 	if (op_ctx->ctx_export != NULL
 	    && (reqdesc->dispatch_behaviour & MAKES_IO)
-	    && !(export_perms.options & EXPORT_OPTION_RW_ACCESS)) {
+	    && !(export_perms->options & EXPORT_OPTION_RW_ACCESS)) {
 		/* Request of type MDONLY_RO were rejected at the
 		 * nfs_rpc_dispatcher level.
 		 * This is done by replying EDQUOT
@@ -1166,7 +1388,7 @@ void nfs_rpc_execute(request_data_t *reqdata)
 		}
 	} else if (op_ctx->ctx_export != NULL
 		   && (reqdesc->dispatch_behaviour & MAKES_WRITE)
-		   && (export_perms.options
+		   && (export_perms->options
 		       & (EXPORT_OPTION_WRITE_ACCESS
 			| EXPORT_OPTION_MD_WRITE_ACCESS)) == 0) {
 		if (reqdata->r_u.req.svc.rq_prog
@@ -1194,7 +1416,7 @@ void nfs_rpc_execute(request_data_t *reqdata)
 			rc = NFS_REQ_DROP;
 		}
 	} else if (op_ctx->ctx_export != NULL
-		   && (export_perms.options
+		   && (export_perms->options
 		       & (EXPORT_OPTION_READ_ACCESS
 			 | EXPORT_OPTION_MD_READ_ACCESS)) == 0) {
 		LogInfoAlt(COMPONENT_DISPATCH, COMPONENT_EXPORT,
@@ -1212,7 +1434,7 @@ void nfs_rpc_execute(request_data_t *reqdata)
 				/* If NEEDS_CRED and not NEEDS_EXPORT,
 				 * don't squash
 				 */
-				export_perms.options = EXPORT_OPTION_ROOT;
+				export_perms->options = EXPORT_OPTION_ROOT;
 			}
 
 			if (nfs_req_creds(&reqdata->r_u.req.svc) != NFS4_OK) {
@@ -1277,10 +1499,31 @@ void nfs_rpc_execute(request_data_t *reqdata)
 			"export-id",
 			(op_ctx->export != NULL)
 			? op_ctx->export->export_id : -1);
+#endif
+#ifdef USE_MEM_ACCOUNTING
+		mem_acct_thread_total(&allocs_start);
 #endif
 		rc = reqdesc->service_function(arg_nfs, &reqdata->r_u.req.svc,
 					res_nfs);
 
+		if (rc == NFS_REQ_ASYNC_WAIT) {
+			/* Whoever completes the I/O replies, and may have
+			 * done so already.
+			 */
+			SetClientIP(NULL);
+			op_ctx = NULL;
+			return true;
+		}
+
+#ifdef USE_MEM_ACCOUNTING
+		server_stats_allocs_done(&reqdata->r_u.req.svc, &allocs_start);
+#endif
+
+		if (nfs_rpc_stage_timing()) {
+			now(&timer_start);
+			svc_done = timespec_diff(&ServerBootTime, &timer_start);
+		}
+
 #ifdef USE_LTTNG
 	tracepoint(nfs_rpc, op_end, reqdata);
 #endif
@@ -1296,67 +1539,8 @@ void nfs_rpc_execute(request_data_t *reqdata)
 #ifdef _USE_NFS3
  req_error:
 #endif /* _USE_NFS3 */
-
-/* NFSv4 stats are handled in nfs4_compound()
- */
-	if (reqdata->r_u.req.svc.rq_prog != nfs_param.core_param.program[P_NFS]
-	    || reqdata->r_u.req.svc.rq_vers != NFS_V4)
-		server_stats_nfs_done(reqdata, rc, false);
-
-	/* If request is dropped, no return to the client */
-	if (rc == NFS_REQ_DROP) {
-		/* The request was dropped */
-		LogDebug(COMPONENT_DISPATCH,
-			 "Drop request rpc_xid=%u, program %u, version %u, function %u",
-			 reqdata->r_u.req.svc.rq_xid,
-			 (int)reqdata->r_u.req.svc.rq_prog,
-			 (int)reqdata->r_u.req.svc.rq_vers,
-			 (int)reqdata->r_u.req.svc.rq_proc);
-
-		/* If the request is not normally cached, then the entry
-		 * will be removed later.  We only remove a reply that is
-		 * normally cached that has been dropped.
-		 */
-		if (nfs_dupreq_delete(&reqdata->r_u.req.svc)
-		    != DUPREQ_SUCCESS) {
-			LogCrit(COMPONENT_DISPATCH,
-				"Attempt to delete duplicate request failed on line %d",
-				__LINE__);
-		}
-		goto freeargs;
-	} else {
-		LogFullDebug(COMPONENT_DISPATCH,
-			     "Before svc_sendreply on socket %d", xprt->xp_fd);
-
-		DISP_SLOCK(xprt);
-
-		/* encoding the result on xdr output */
-		if (!svc_sendreply(xprt, &reqdata->r_u.req.svc,
-				   reqdesc->xdr_encode_func,
-				   (caddr_t) res_nfs)) {
-			LogDebug(COMPONENT_DISPATCH,
-				 "NFS DISPATCHER: FAILURE: Error while calling svc_sendreply on a new request. rpcxid=%u socket=%d function:%s client:%s program:%d nfs version:%d proc:%d xid:%u errno: %d",
-				 reqdata->r_u.req.svc.rq_xid, xprt->xp_fd,
-				 reqdesc->funcname,
-				 client_ip,
-				 (int)reqdata->r_u.req.svc.rq_prog,
-				 (int)reqdata->r_u.req.svc.rq_vers,
-				 (int)reqdata->r_u.req.svc.rq_proc,
-				 reqdata->r_u.req.svc.rq_xid, errno);
-			if (xprt->xp_type != XPRT_UDP)
-				svc_destroy(xprt);
-			goto freeargs;
-		}
-
-		LogFullDebug(COMPONENT_DISPATCH,
-			     "After svc_sendreply on socket %d", xprt->xp_fd);
-
-	}			/* rc == NFS_REQ_DROP */
-
-	/* Finish any request not already deleted */
-	if (dpq_status == DUPREQ_SUCCESS)
-		dpq_status = nfs_dupreq_finish(&reqdata->r_u.req.svc, res_nfs);
-	goto freeargs;
+	nfs_rpc_reply(reqdata, rc, svc_done);
+	return false;
 
 	/* Reject the request for authentication reason (incompatible
 	 * file handle) */
@@ -1382,43 +1566,144 @@ void nfs_rpc_execute(request_data_t *reqdata)
 	}
 
  freeargs:
+	nfs_rpc_release(reqdata, dpq_status, svc_done, slocked);
+	return false;
+}
 
-	/* XXX no need for xprt slock across SVC_FREEARGS */
-	DISP_SUNLOCK(xprt);
+/**
+ * @page AsyncRequest Suspending a request
+ *
+ * An operation that can start its I/O without waiting for it calls
+ * nfs_req_async_begin(), starts the I/O, and returns what
+ * nfs_req_suspend() leaves it with.  The completion of the I/O fills in
+ * the result and calls nfs_req_async_done().  Whichever of the two
+ * comes second finishes the request: if the I/O completed first, the
+ * operation carries on as though it had been synchronous; otherwise the
+ * worker is let go and the completion sends the reply, from whatever
+ * thread it runs on.  The request's context lives in the request, not
+ * on the worker's stack, so it is still there for the completion.
+ */
 
-	/* Free the allocated resources once the work is done */
-	/* Free the arguments */
-	if ((reqdata->r_u.req.svc.rq_vers == 2)
-	 || (reqdata->r_u.req.svc.rq_vers == 3)
-	 || (reqdata->r_u.req.svc.rq_vers == 4)) {
-		if (!SVC_FREEARGS(xprt, &reqdata->r_u.req.svc,
-				  reqdesc->xdr_decode_func,
-				  (caddr_t) arg_nfs)) {
-			LogCrit(COMPONENT_DISPATCH,
-				"NFS DISPATCHER: FAILURE: Bad SVC_FREEARGS for %s",
-				reqdesc->funcname);
-		}
-	}
+/**
+ * @brief Context of a request, for a completion running elsewhere
+ *
+ * @param[in] req  The request
+ *
+ * @return Its op context.
+ */
+struct req_op_context *nfs_req_op_ctx(struct svc_req *req)
+{
+	return &container_of(req, nfs_request_t, svc)->req_ctx;
+}
 
-	/* Finalize the request. */
-	if (res_nfs)
-		nfs_dupreq_rele(&reqdata->r_u.req.svc, reqdesc);
+/**
+ * @brief Get ready to start I/O that may suspend the request
+ *
+ * @param[in] req  The request
+ *
+ * @retval true if the I/O may be started without waiting for it.
+ * @retval false if the operation must make it synchronously.
+ */
+bool nfs_req_async_begin(struct svc_req *req)
+{
+	nfs_request_t *reqnfs = container_of(req, nfs_request_t, svc);
 
-	SetClientIP(NULL);
-	if (op_ctx->client != NULL) {
-		put_gsh_client(op_ctx->client);
-		op_ctx->client = NULL;
-	}
-	if (op_ctx->ctx_export != NULL) {
-		put_gsh_export(op_ctx->ctx_export);
-		op_ctx->ctx_export = NULL;
+	if (!reqnfs->may_suspend || reqnfs->async_state != NFS_ASYNC_NONE)
+		return false;
+
+	atomic_store_uint32_t(&reqnfs->async_state, NFS_ASYNC_STARTED);
+	return true;
+}
+
+/**
+ * @brief Suspend a request whose I/O has been started
+ *
+ * This must be the last thing the operation does with the request:
+ * once it returns true the request belongs to the I/O's completion.
+ *
+ * @param[in]  req     The request
+ * @param[in]  resume  If not NULL, called with the request's op context
+ *                     and the completion's result once the request is
+ *                     resumed, to return what the service would have
+ * @param[in]  arg     Passed to @a resume
+ * @param[out] result  The completion's result, if it came first
+ *
+ * @retval true if the request is suspended.
+ * @retval false if the I/O has completed already.
+ */
+bool nfs_req_suspend(struct svc_req *req, nfs_resume_t resume, void *arg,
+		     int *result)
+{
+	nfs_request_t *reqnfs = container_of(req, nfs_request_t, svc);
+
+	reqnfs->async_resume = resume;
+	reqnfs->async_arg = arg;
+
+	if (atomic_cas_uint32_t(&reqnfs->async_state, NFS_ASYNC_STARTED,
+				    NFS_ASYNC_SUSPENDED))
+		return true;
+
+	*result = reqnfs->async_result;
+	atomic_store_uint32_t(&reqnfs->async_state, NFS_ASYNC_NONE);
+	return false;
+}
+
+/**
+ * @brief Finish a suspended request on the thread that completed it
+ *
+ * @param[in,out] reqdata  The request
+ */
+static void nfs_rpc_resume(request_data_t *reqdata)
+{
+	nfs_request_t *reqnfs = &reqdata->r_u.req;
+	SVCXPRT *xprt = reqnfs->svc.rq_xprt;
+	struct req_op_context *saved_ctx = op_ctx;
+	nsecs_elapsed_t svc_done = 0;
+	struct timespec ts;
+	int rc = reqnfs->async_result;
+
+	op_ctx = &reqnfs->req_ctx;
+	if (op_ctx->client != NULL)
+		SetClientIP(op_ctx->client->hostaddr_str);
+
+	if (reqnfs->async_resume != NULL)
+		rc = reqnfs->async_resume(&reqnfs->svc, reqnfs->async_arg, rc);
+
+	if (nfs_rpc_stage_timing()) {
+		now(&ts);
+		svc_done = timespec_diff(&ServerBootTime, &ts);
 	}
-	clean_credentials();
-	op_ctx = NULL;
 
-#ifdef USE_LTTNG
-	tracepoint(nfs_rpc, end, reqdata);
-#endif
+	nfs_rpc_reply(reqdata, rc, svc_done);
+
+	/* What the worker would have done */
+	nfs_rpc_return_credit(xprt);
+	pool_free(request_pool, reqdata);
+
+	op_ctx = saved_ctx;
+}
+
+/**
+ * @brief Hand over the result of a request's I/O
+ *
+ * Called by the completion once the result is filled in, and with
+ * nothing of the request's used after.
+ *
+ * @param[in] req     The request
+ * @param[in] result  For nfs_req_suspend() or the resume function
+ */
+void nfs_req_async_done(struct svc_req *req, int result)
+{
+	nfs_request_t *reqnfs = container_of(req, nfs_request_t, svc);
+
+	reqnfs->async_result = result;
+
+	if (atomic_cas_uint32_t(&reqnfs->async_state, NFS_ASYNC_STARTED,
+				    NFS_ASYNC_DONE))
+		return;
+
+	/* The operation has let its worker go */
+	nfs_rpc_resume(container_of(reqnfs, request_data_t, r_u.req));
 }
 
 #ifdef _USE_9P
@@ -1458,8 +1743,11 @@ static void _9p_execute(request_data_t *reqdata)
  */
 static void _9p_free_reqdata(struct _9p_request_data *req9p)
 {
-	if (req9p->pconn->trans_type == _9P_TCP)
-		gsh_free(req9p->_9pmsg);
+	if (req9p->pconn->trans_type == _9P_TCP) {
+		iobuf_free(nfs_iobuf_pool, req9p->_9pmsg, req9p->_9pmsg_size);
+		_9p_tcp_conn_put(req9p->pconn);
+		return;
+	}
 
 	/* decrease connection refcount */
 	(void) atomic_dec_uint32_t(&req9p->pconn->refcount);
@@ -1468,6 +1756,139 @@ static void _9p_free_reqdata(struct _9p_request_data *req9p)
 
 static uint32_t worker_indexer;
 
+/**
+ * @brief Adaptive worker pool state
+ *
+ * Workers add the time they spend executing requests to busy_ns.
+ * Once per interval, whichever worker first notices resizes the pool
+ * to cover the measured busy time with a quarter again as headroom,
+ * plus enough threads to work off the queued backlog within one
+ * interval at the measured service time.  Growing submits new
+ * loopers to the fridge; shrinking publishes a surplus that workers
+ * claim by retiring.
+ */
+static struct {
+	uint64_t busy_ns;	/*< Time spent executing requests */
+	uint64_t nreqs;		/*< Requests executed */
+	uint64_t last;		/*< Time of the last resize */
+	uint32_t surplus;	/*< Workers still to retire */
+} worker_adapt;
+
+static void worker_run(struct fridgethr_context *ctx);
+
+static inline uint64_t worker_clock(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
+/**
+ * @brief Resize the worker pool if an interval has passed
+ */
+
+static void worker_resize(void)
+{
+	uint64_t interval = nfs_param.core_param.adaptive_workers_interval *
+			    NS_PER_MSEC;
+	uint64_t now_ns = worker_clock();
+	uint64_t last = atomic_fetch_uint64_t(&worker_adapt.last);
+	uint64_t elapsed = now_ns - last;
+	uint64_t busy, nreqs, svc, backlog, want;
+	uint32_t cur;
+	int rc;
+
+	if (elapsed < interval ||
+	    !atomic_cas_uint64_t(&worker_adapt.last, last, now_ns))
+		return;
+
+	busy = atomic_postclear_uint64_t_bits(&worker_adapt.busy_ns,
+					      UINT64_MAX);
+	nreqs = atomic_postclear_uint64_t_bits(&worker_adapt.nreqs,
+					       UINT64_MAX);
+	backlog = nfs_rpc_queue_depth();
+
+	/* Nothing finished: assume whatever is queued is stuck behind
+	 * long requests and needs a thread apiece.
+	 */
+	svc = (nreqs > 0) ? busy / nreqs : interval;
+
+	want = (busy + busy / 4 + elapsed - 1) / elapsed;
+	want += (backlog * svc + interval - 1) / interval;
+	if (want < worker_fridge->p.thr_min)
+		want = worker_fridge->p.thr_min;
+	if (want > worker_fridge->p.thr_max)
+		want = worker_fridge->p.thr_max;
+
+	cur = fridgethr_nthreads(worker_fridge);
+
+	LogFullDebug(COMPONENT_DISPATCH,
+		     "%" PRIu64 " reqs, svc %" PRIu64 "ns, backlog %" PRIu64
+		     ", workers %" PRIu32 " want %" PRIu64,
+		     nreqs, svc, backlog, cur, want);
+
+	if (want <= cur) {
+		atomic_store_uint32_t(&worker_adapt.surplus, cur - want);
+		return;
+	}
+
+	atomic_store_uint32_t(&worker_adapt.surplus, 0);
+	LogDebug(COMPONENT_DISPATCH,
+		 "Growing worker pool from %" PRIu32 " to %" PRIu64,
+		 cur, want);
+	for (; cur < want; ++cur) {
+		rc = fridgethr_submit(worker_fridge, worker_run, NULL);
+		if (rc != 0) {
+			LogDebug(COMPONENT_DISPATCH,
+				 "Unable to add worker: %d", rc);
+			break;
+		}
+	}
+}
+
+/**
+ * @brief Resize the pool and see whether the calling worker retires
+ *
+ * @param[in] ctx Fridge thread context
+ *
+ * @retval true if the worker should return and leave the pool.
+ * @retval false if it should carry on.
+ */
+
+static bool worker_adapt_check(struct fridgethr_context *ctx)
+{
+	uint32_t surplus;
+
+	worker_resize();
+
+	surplus = atomic_fetch_uint32_t(&worker_adapt.surplus);
+	while (surplus > 0) {
+		if (atomic_cas_uint32_t(&worker_adapt.surplus, surplus,
+					surplus - 1)) {
+			fridgethr_retire(ctx);
+			return true;
+		}
+		surplus = atomic_fetch_uint32_t(&worker_adapt.surplus);
+	}
+	return false;
+}
+
+/**
+ * @brief Report the size of the worker pool
+ *
+ * @param[out] nthreads Current number of workers
+ * @param[out] min      Fewest workers the pool keeps
+ * @param[out] max      Most workers the pool grows to
+ */
+
+void worker_pool_size(uint32_t *nthreads, uint32_t *min, uint32_t *max)
+{
+	*nthreads = fridgethr_nthreads(worker_fridge);
+	*min = worker_fridge->p.thr_min;
+	*max = worker_fridge->p.thr_max;
+}
+
 /**
  * @brief Initialize a worker thread
  *
@@ -1483,8 +1904,14 @@ static void worker_thread_initializer(struct fridgethr_context *ctx)
 	snprintf(thr_name, sizeof(thr_name), "work-%u", wd->worker_index);
 	SetNameFunction(thr_name);
 
+	/* spread workers over the nodes, the queue shard of each node
+	 * then feeds the workers local to it */
+	if (nfs_req_st.reqs.numa)
+		(void) gsh_numa_bind(wd->worker_index);
+
 	/* Initalize thr waitq */
 	init_wait_q_entry(&wd->wqe);
+	glist_init(&wd->batch);
 }
 
 /**
@@ -1512,14 +1939,23 @@ static void worker_thread_finalizer(struct fridgethr_context *ctx)
 static void worker_run(struct fridgethr_context *ctx)
 {
 	struct nfs_worker_data *worker_data = &ctx->wd;
+	bool adaptive = nfs_param.core_param.adaptive_workers;
 	request_data_t *reqdata;
+	uint64_t start = 0;
 
-	/* Worker's loop */
-	while (!fridgethr_you_should_break(ctx)) {
+	/* Worker's loop, which finishes a batch before breaking */
+	while (worker_data->batch_size > 0 ||
+	       !fridgethr_you_should_break(ctx)) {
 		reqdata = nfs_rpc_dequeue_req(worker_data);
 
-		if (!reqdata)
+		if (!reqdata) {
+			if (adaptive && worker_adapt_check(ctx))
+				return;
 			continue;
+		}
+
+		if (adaptive)
+			start = worker_clock();
 
 /* need to do a getpeername(2) on the socket fd before we dive into the
  * rpc_execute.  9p is messy but we do have the fd....
@@ -1545,7 +1981,10 @@ static void worker_run(struct fridgethr_context *ctx)
 				 reqdata,
 				 reqdata->r_u.req.svc.rq_xprt,
 				 reqdata->r_u.req.svc.rq_xprt->xp_requests);
-			nfs_rpc_execute(reqdata);
+			if (nfs_rpc_execute(reqdata, true)) {
+				/* Suspended, nfs_rpc_resume() finishes it */
+				goto account;
+			}
 			break;
 
 		case NFS_CALL:
@@ -1567,10 +2006,8 @@ static void worker_run(struct fridgethr_context *ctx)
 
 		switch (reqdata->rtype) {
 		case NFS_REQUEST:
-			/* adjust request count and return xprt ref */
-			gsh_xprt_unref(reqdata->r_u.req.svc.rq_xprt,
-				       XPRT_PRIVATE_FLAG_DECREQ, __func__,
-				       __LINE__);
+			/* return the request credit and xprt ref */
+			nfs_rpc_return_credit(reqdata->r_u.req.svc.rq_xprt);
 			break;
 		case NFS_CALL:
 			break;
@@ -1588,6 +2025,16 @@ static void worker_run(struct fridgethr_context *ctx)
 			     "Invalidating processed entry");
 
 		pool_free(request_pool, reqdata);
+
+ account:
+		if (adaptive) {
+			(void) atomic_add_uint64_t(&worker_adapt.busy_ns,
+						   worker_clock() - start);
+			(void) atomic_inc_uint64_t(&worker_adapt.nreqs);
+			if (worker_data->batch_size == 0 &&
+			    worker_adapt_check(ctx))
+				return;
+		}
 	}
 }
 
@@ -1599,6 +2046,15 @@ int worker_init(void)
 	memset(&frp, 0, sizeof(struct fridgethr_params));
 	frp.thr_max = nfs_param.core_param.nb_worker;
 	frp.thr_min = nfs_param.core_param.nb_worker;
+	if (nfs_param.core_param.adaptive_workers) {
+		/* Start at the low water mark and let load grow it */
+		if (nfs_param.core_param.nb_worker_min < frp.thr_max)
+			frp.thr_min = nfs_param.core_param.nb_worker_min;
+		worker_adapt.last = worker_clock();
+		LogInfo(COMPONENT_DISPATCH,
+			"Adaptive worker pool of %" PRIu32 " to %" PRIu32
+			" threads", frp.thr_min, frp.thr_max);
+	}
 	frp.flavor = fridgethr_flavor_looper;
 	frp.thread_initialize = worker_thread_initializer;
 	frp.thread_finalize = worker_thread_finalizer;
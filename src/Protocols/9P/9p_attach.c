@@ -78,11 +78,6 @@ int _9p_attach(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 		 (u32) *msgtag, *fid, *afid, (int) *uname_len, uname_str,
 		 (int) *aname_len, aname_str, *n_uname);
 
-	if (*fid >= _9P_FID_PER_CONN) {
-		err = ERANGE;
-		goto errout;
-	}
-
 	/*
 	 * Find the export for the aname (using as well Path or Tag)
 	 *
@@ -101,6 +96,12 @@ int _9p_attach(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 		goto errout;
 	}
 
+	if (!export_activate(op_ctx->ctx_export)) {
+		/* Lazy_Init export could not be created */
+		err = EAGAIN;
+		goto errout;
+	}
+
 	/* Fill in more of the op_ctx */
 	op_ctx->fsal_export = op_ctx->ctx_export->fsal_export;
 	op_ctx->caller_addr = &req9p->pconn->addrpeer;
@@ -132,14 +133,13 @@ int _9p_attach(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 	}
 
 	/* Set export and fid id in fid */
-	pfid = gsh_calloc(1, sizeof(struct _9p_fid));
+	pfid = _9p_alloc_fid();
 
 	/* Copy the export into the pfid with reference. */
 	pfid->export = op_ctx->ctx_export;
 	get_gsh_export_ref(pfid->export);
 
-	pfid->fid = *fid;
-	req9p->pconn->fids[*fid] = pfid;
+	_9p_insert_fid(req9p->pconn, *fid, pfid);
 
 	/* Is user name provided as a string or as an uid ? */
 	if (*n_uname != _9P_NONUNAME) {
@@ -235,8 +235,10 @@ errout:
 
 	_9p_release_opctx();
 
-	if (pfid != NULL)
+	if (pfid != NULL) {
+		(void) _9p_remove_fid(req9p->pconn, *fid);
 		free_fid(pfid);
+	}
 
 	return _9p_rerror(req9p, msgtag, err, plenout, preply);
 }
@@ -56,10 +56,7 @@ int _9p_clunk(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 
 	LogDebug(COMPONENT_9P, "TCLUNK: tag=%u fid=%u", (u32) *msgtag, *fid);
 
-	if (*fid >= _9P_FID_PER_CONN)
-		return _9p_rerror(req9p, msgtag, ERANGE, plenout, preply);
-
-	pfid = req9p->pconn->fids[*fid];
+	pfid = _9p_lookup_fid(req9p->pconn, *fid);
 
 	/* Check that it is a valid fid */
 	if (pfid == NULL || pfid->pentry == NULL) {
@@ -69,8 +66,8 @@ int _9p_clunk(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 
 	_9p_init_opctx(pfid, req9p);
 
+	(void) _9p_remove_fid(req9p->pconn, *fid);
 	rc = _9p_tools_clunk(pfid);
-	req9p->pconn->fids[*fid] = NULL;
 
 	if (rc) {
 		return _9p_rerror(req9p, msgtag, rc,
@@ -32,6 +32,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <pthread.h>
+#include <sys/socket.h>
 
 #include "nfs_core.h"
 #include "9p.h"
@@ -103,13 +104,17 @@ int _9p_not_2000L(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 	return -1;
 }				/* _9p_not_2000L */
 
-static ssize_t tcp_conn_send(struct _9p_conn *conn, const void *buf, size_t len,
-			     int flags)
+static ssize_t tcp_conn_send(struct _9p_conn *conn, struct iovec *iov,
+			     int iovcnt)
 {
+	struct msghdr msg = {
+		.msg_iov = iov,
+		.msg_iovlen = iovcnt,
+	};
 	ssize_t ret;
 
 	PTHREAD_MUTEX_lock(&conn->sock_lock);
-	ret = send(conn->trans_data.sockfd, buf, len, flags);
+	ret = sendmsg(conn->trans_data.sockfd, &msg, 0);
 	PTHREAD_MUTEX_unlock(&conn->sock_lock);
 
 	if (ret < 0)
@@ -127,7 +132,11 @@ void _9p_tcp_process_request(struct _9p_request_data *req9p)
 {
 	u32 outdatalen = 0;
 	int rc = 0;
-	char replydata[_9P_MSG_SIZE];
+	/* replies are bounded by msize, see _9p_process_buffer() */
+	u32 replysize = req9p->pconn->msize;
+	char *replydata = iobuf_alloc(nfs_iobuf_pool, replysize);
+	struct iovec iov[2];
+	int iovcnt = 1;
 
 	rc = _9p_process_buffer(req9p, replydata, &outdatalen);
 	if (rc != 1) {
@@ -135,12 +144,25 @@ void _9p_tcp_process_request(struct _9p_request_data *req9p)
 			 "Could not process 9P buffer on socket #%lu",
 			 req9p->pconn->trans_data.sockfd);
 	} else {
-		if (tcp_conn_send(req9p->pconn, replydata, outdatalen, 0) !=
-		    outdatalen)
+		iov[0].iov_base = replydata;
+		iov[0].iov_len = outdatalen;
+		if (req9p->rbuf != NULL) {
+			/* An Rread whose data the FSAL lent */
+			iov[1].iov_base = req9p->rbuf->data.addr;
+			iov[1].iov_len = req9p->rbuf->data.len;
+			outdatalen += iov[1].iov_len;
+			iovcnt++;
+		}
+		if (tcp_conn_send(req9p->pconn, iov, iovcnt) != outdatalen)
 			LogMajor(COMPONENT_9P,
 				 "Could not send 9P/TCP reply correclty on socket #%lu",
 				 req9p->pconn->trans_data.sockfd);
 	}
+	if (req9p->rbuf != NULL) {
+		fsal_read_buf_put(req9p->rbuf);
+		req9p->rbuf = NULL;
+	}
+	iobuf_free(nfs_iobuf_pool, replydata, replysize);
 	_9p_DiscardFlushHook(req9p);
 }				/* _9p_process_request */
 
@@ -111,11 +111,162 @@ static void release_user_cred_ref(struct user_cred *creds)
 	release_9p_user_cred_ref(cred_9p);
 }
 
+/* Fids are many, small and live as long as the client keeps them */
+static slab_pool_t *_9p_fid_pool;
+
 int _9p_init(void)
 {
+	_9p_fid_pool = slab_pool_init("9P fids", sizeof(struct _9p_fid));
 	return 0;
 }				/* _9p_init */
 
+/**
+ * @brief Allocate a zeroed fid
+ */
+struct _9p_fid *_9p_alloc_fid(void)
+{
+	return slab_alloc(_9p_fid_pool);
+}
+
+/**
+ * @brief Free a fid holding nothing, never inserted in a table
+ */
+void _9p_release_fid(struct _9p_fid *pfid)
+{
+	slab_free(_9p_fid_pool, pfid);
+}
+
+static inline uint32_t _9p_fid_bucket(const struct _9p_fid_table *table,
+				      u32 fid)
+{
+	/* Fibonacci hashing, for the dense runs clients allocate fids in */
+	return (fid * 2654435761U) >> table->shift;
+}
+
+/**
+ * @brief Set up the fid table of a new connection
+ */
+void _9p_init_fids(struct _9p_conn *conn)
+{
+	struct _9p_fid_table *table = &conn->fids;
+
+	PTHREAD_RWLOCK_init(&table->lock, NULL);
+	table->buckets = gsh_calloc(_9P_FID_BUCKETS_MIN,
+				    sizeof(*table->buckets));
+	table->shift = 32 - __builtin_ctz(_9P_FID_BUCKETS_MIN);
+	table->count = 0;
+}
+
+/**
+ * @brief Find a fid of a connection
+ *
+ * @return The fid, NULL if the client has no such fid.
+ */
+struct _9p_fid *_9p_lookup_fid(struct _9p_conn *conn, u32 fid)
+{
+	struct _9p_fid_table *table = &conn->fids;
+	struct _9p_fid *pfid;
+
+	PTHREAD_RWLOCK_rdlock(&table->lock);
+	for (pfid = table->buckets[_9p_fid_bucket(table, fid)];
+	     pfid != NULL && pfid->fid != fid;
+	     pfid = pfid->fid_next)
+		;
+	PTHREAD_RWLOCK_unlock(&table->lock);
+
+	return pfid;
+}
+
+/* Called with the table write locked */
+static struct _9p_fid *_9p_unlink_fid(struct _9p_fid_table *table, u32 fid)
+{
+	struct _9p_fid **link = &table->buckets[_9p_fid_bucket(table, fid)];
+	struct _9p_fid *pfid;
+
+	for (pfid = *link; pfid != NULL; link = &pfid->fid_next, pfid = *link) {
+		if (pfid->fid == fid) {
+			*link = pfid->fid_next;
+			table->count--;
+			break;
+		}
+	}
+
+	return pfid;
+}
+
+/* Called with the table write locked */
+static void _9p_grow_fids(struct _9p_fid_table *table)
+{
+	uint32_t old_size = 1U << (32 - table->shift);
+	struct _9p_fid **old = table->buckets;
+	struct _9p_fid *pfid, *next;
+	uint32_t i, bucket;
+
+	table->buckets = gsh_calloc(old_size * 2, sizeof(*table->buckets));
+	table->shift--;
+
+	for (i = 0; i < old_size; i++) {
+		for (pfid = old[i]; pfid != NULL; pfid = next) {
+			next = pfid->fid_next;
+			bucket = _9p_fid_bucket(table, pfid->fid);
+			pfid->fid_next = table->buckets[bucket];
+			table->buckets[bucket] = pfid;
+		}
+	}
+
+	gsh_free(old);
+}
+
+/**
+ * @brief Give a fid its number on a connection
+ *
+ * A fid the number was still in use for is dropped from the table, as
+ * it was when the fids were an array.
+ *
+ * @param[in] conn The connection
+ * @param[in] fid  The number the client chose
+ * @param[in] pfid The fid
+ */
+void _9p_insert_fid(struct _9p_conn *conn, u32 fid, struct _9p_fid *pfid)
+{
+	struct _9p_fid_table *table = &conn->fids;
+	uint32_t bucket;
+
+	pfid->fid = fid;
+
+	PTHREAD_RWLOCK_wrlock(&table->lock);
+
+	if (_9p_unlink_fid(table, fid) != NULL)
+		LogDebug(COMPONENT_9P, "fid=%u reused without a clunk", fid);
+
+	if (table->count >= 1U << (32 - table->shift))
+		_9p_grow_fids(table);
+
+	bucket = _9p_fid_bucket(table, fid);
+	pfid->fid_next = table->buckets[bucket];
+	table->buckets[bucket] = pfid;
+	table->count++;
+
+	PTHREAD_RWLOCK_unlock(&table->lock);
+}
+
+/**
+ * @brief Take a fid off a connection
+ *
+ * @return The fid, NULL if the client had no such fid.
+ */
+struct _9p_fid *_9p_remove_fid(struct _9p_conn *conn, u32 fid)
+{
+	struct _9p_fid_table *table = &conn->fids;
+	struct _9p_fid *pfid;
+
+	PTHREAD_RWLOCK_wrlock(&table->lock);
+	pfid = _9p_unlink_fid(table, fid);
+	PTHREAD_RWLOCK_unlock(&table->lock);
+
+	return pfid;
+}
+
 void _9p_init_opctx(struct _9p_fid *pfid, struct _9p_request_data *req9p)
 {
 	if (pfid->export != NULL) {
@@ -349,7 +500,7 @@ void free_fid(struct _9p_fid *pfid)
 		release_9p_user_cred_ref(pfid->ucred);
 
 	gsh_free(pfid->specdata.xattr.xattr_content);
-	gsh_free(pfid);
+	_9p_release_fid(pfid);
 }
 
 int _9p_tools_clunk(struct _9p_fid *pfid)
@@ -440,9 +591,17 @@ int _9p_tools_clunk(struct _9p_fid *pfid)
 	return 0;
 }
 
+/**
+ * @brief Clunk the fids of a closed connection, and free its table
+ *
+ * No request may be left on the connection.
+ */
 void _9p_cleanup_fids(struct _9p_conn *conn)
 {
-	int i;
+	struct _9p_fid_table *table = &conn->fids;
+	uint32_t size = 1U << (32 - table->shift);
+	struct _9p_fid *pfid, *next;
+	uint32_t i;
 
 	/* Allocate op_ctx, is should always be NULL here
 	 * Note we only need it if there is a non-null fid,
@@ -450,15 +609,20 @@ void _9p_cleanup_fids(struct _9p_conn *conn)
 	 */
 	op_ctx = gsh_calloc(1, sizeof(struct req_op_context));
 
-	for (i = 0; i < _9P_FID_PER_CONN; i++) {
-		if (conn->fids[i]) {
-			_9p_init_opctx(conn->fids[i], NULL);
-			_9p_tools_clunk(conn->fids[i]);
+	for (i = 0; i < size; i++) {
+		for (pfid = table->buckets[i]; pfid != NULL; pfid = next) {
+			next = pfid->fid_next;
+			_9p_init_opctx(pfid, NULL);
+			_9p_tools_clunk(pfid);
 			_9p_release_opctx();
-			conn->fids[i] = NULL;	/* poison the entry */
 		}
 	}
 
 	gsh_free(op_ctx);
 	op_ctx = NULL;
+
+	gsh_free(table->buckets);
+	table->buckets = NULL;
+	table->count = 0;
+	PTHREAD_RWLOCK_destroy(&table->lock);
 }
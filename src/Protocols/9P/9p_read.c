@@ -56,6 +56,7 @@ int _9p_read(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 	u32 outcount = 0;
 
 	struct _9p_fid *pfid = NULL;
+	struct fsal_read_buf *rbuf = NULL;
 
 	size_t read_size = 0;
 	bool eof_met;
@@ -72,10 +73,7 @@ int _9p_read(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 	LogDebug(COMPONENT_9P, "TREAD: tag=%u fid=%u offset=%llu count=%u",
 		 (u32) *msgtag, *fid, (unsigned long long)*offset, *count);
 
-	if (*fid >= _9P_FID_PER_CONN)
-		return _9p_rerror(req9p, msgtag, ERANGE, plenout, preply);
-
-	pfid = req9p->pconn->fids[*fid];
+	pfid = _9p_lookup_fid(req9p->pconn, *fid);
 
 	/* Make sure the requested amount of data respects negotiated msize */
 	if (*count + _9P_ROOM_RREAD > req9p->pconn->msize)
@@ -105,7 +103,27 @@ int _9p_read(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 
 		outcount = (u32) *count;
 	} else {
-		if (pfid->pentry->fsal->m_ops.support_ex(pfid->pentry)) {
+		if (req9p->pconn->trans_type == _9P_TCP &&
+		    fsal_lends_read_buffers(pfid->pentry)) {
+			/* Sent from the FSAL's buffer after the reply,
+			 * see _9p_tcp_process_request()
+			 */
+			rbuf = gsh_calloc(1, sizeof(*rbuf));
+			fsal_status = fsal_read_buffer(pfid->pentry,
+						       false,
+						       pfid->state,
+						       *offset,
+						       *count,
+						       rbuf,
+						       &eof_met);
+			if (FSAL_IS_ERROR(fsal_status)) {
+				gsh_free(rbuf);
+				rbuf = NULL;
+			} else {
+				read_size = rbuf->data.len;
+			}
+		} else if (pfid->pentry->fsal->m_ops.support_ex(
+							pfid->pentry)) {
 			/* Call the new fsal_read */
 			fsal_status = fsal_read2(pfid->pentry,
 						false,
@@ -149,10 +167,20 @@ int _9p_read(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 
 		outcount = (u32) read_size;
 	}
-	_9p_setfilledbuffer(cursor, outcount);
 
-	_9p_setendptr(cursor, preply);
-	_9p_checkbound(cursor, preply, plenout);
+	if (rbuf != NULL) {
+		/* Only the count goes in the reply, the data follow it */
+		*((u32 *)cursor) = outcount;
+		cursor += sizeof(u32);
+		*((u32 *)preply) = (u32)(cursor - preply) + outcount;
+		req9p->rbuf = rbuf;
+		_9p_checkbound(cursor, preply, plenout);
+	} else {
+		_9p_setfilledbuffer(cursor, outcount);
+
+		_9p_setendptr(cursor, preply);
+		_9p_checkbound(cursor, preply, plenout);
+	}
 
 	LogDebug(COMPONENT_9P, "RREAD: tag=%u fid=%u offset=%llu count=%u",
 		 (u32) *msgtag, *fid, (unsigned long long)*offset, *count);
@@ -42,6 +42,8 @@ static struct config_item _9p_params[] = {
 		       _9p_param, _9p_rdma_port),
 	CONF_ITEM_UI32("_9P_TCP_Msize", 1024, UINT32_MAX, _9P_TCP_MSIZE,
 		       _9p_param, _9p_tcp_msize),
+	CONF_ITEM_UI16("_9P_TCP_Event_Threads", 1, 256, _9P_TCP_EVENT_THREADS,
+		       _9p_param, _9p_tcp_event_threads),
 	CONF_ITEM_UI32("_9P_RDMA_Msize", 1024, UINT32_MAX, _9P_RDMA_MSIZE,
 		       _9p_param, _9p_rdma_msize),
 	CONF_ITEM_UI16("_9P_RDMA_Backlog", 1, UINT16_MAX, _9P_RDMA_BACKLOG,
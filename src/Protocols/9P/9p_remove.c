@@ -43,12 +43,12 @@
 #include "9p.h"
 
 #define FREE_FID(pfid, fid, req9p) do {                                 \
+	(void) _9p_remove_fid(req9p->pconn, *fid);			\
 	/* mark object no longer reachable */				\
 	pfid->pentry->obj_ops.put_ref(pfid->pentry);			\
 	pfid->pentry = NULL;						\
 	/* Free the fid */                                              \
 	free_fid(pfid);							\
-	req9p->pconn->fids[*fid] = NULL;                                \
 } while (0)
 
 int _9p_remove(struct _9p_request_data *req9p, u32 *plenout, char *preply)
@@ -66,10 +66,7 @@ int _9p_remove(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 
 	LogDebug(COMPONENT_9P, "TREMOVE: tag=%u fid=%u", (u32) *msgtag, *fid);
 
-	if (*fid >= _9P_FID_PER_CONN)
-		return _9p_rerror(req9p, msgtag, ERANGE, plenout, preply);
-
-	pfid = req9p->pconn->fids[*fid];
+	pfid = _9p_lookup_fid(req9p->pconn, *fid);
 
 	/* Check that it is a valid fid */
 	if (pfid == NULL || pfid->pentry == NULL) {
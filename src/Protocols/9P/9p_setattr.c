@@ -88,10 +88,7 @@ int _9p_setattr(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 		 (unsigned long long)*mtime_sec,
 		 (unsigned long long)*mtime_nsec);
 
-	if (*fid >= _9P_FID_PER_CONN)
-		return _9p_rerror(req9p, msgtag, ERANGE, plenout, preply);
-
-	pfid = req9p->pconn->fids[*fid];
+	pfid = _9p_lookup_fid(req9p->pconn, *fid);
 
 	/* Check that it is a valid fid */
 	if (pfid == NULL || pfid->pentry == NULL) {
@@ -67,10 +67,7 @@ int _9p_unlinkat(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 	LogDebug(COMPONENT_9P, "TUNLINKAT: tag=%u dfid=%u name=%.*s",
 		 (u32) *msgtag, *dfid, *name_len, name_str);
 
-	if (*dfid >= _9P_FID_PER_CONN)
-		return _9p_rerror(req9p, msgtag, ERANGE, plenout, preply);
-
-	pdfid = req9p->pconn->fids[*dfid];
+	pdfid = _9p_lookup_fid(req9p->pconn, *dfid);
 
 	/* Check that it is a valid fid */
 	if (pdfid == NULL || pdfid->pentry == NULL) {
@@ -79,10 +79,7 @@ int _9p_write(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 	LogDebug(COMPONENT_9P, "TWRITE: tag=%u fid=%u offset=%llu count=%u",
 		 (u32) *msgtag, *fid, (unsigned long long)*offset, *count);
 
-	if (*fid >= _9P_FID_PER_CONN)
-		return _9p_rerror(req9p, msgtag, ERANGE, plenout, preply);
-
-	pfid = req9p->pconn->fids[*fid];
+	pfid = _9p_lookup_fid(req9p->pconn, *fid);
 
 	/* Make sure the requested amount of data respects negotiated msize */
 	if (*count + _9P_ROOM_TWRITE > req9p->pconn->msize)
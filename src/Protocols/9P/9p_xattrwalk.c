@@ -87,20 +87,14 @@ int _9p_xattrwalk(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 			 "TXATTRWALK (component): tag=%u fid=%u attrfid=%u name=%.*s",
 			 (u32) *msgtag, *fid, *attrfid, *name_len, name_str);
 
-	if (*fid >= _9P_FID_PER_CONN)
-		return _9p_rerror(req9p, msgtag, ERANGE, plenout, preply);
-
-	if (*attrfid >= _9P_FID_PER_CONN)
-		return _9p_rerror(req9p, msgtag, ERANGE, plenout, preply);
-
-	pfid = req9p->pconn->fids[*fid];
+	pfid = _9p_lookup_fid(req9p->pconn, *fid);
 	/* Check that it is a valid fid */
 	if (pfid == NULL || pfid->pentry == NULL) {
 		LogDebug(COMPONENT_9P, "request on invalid fid=%u", *fid);
 		return _9p_rerror(req9p, msgtag, EIO, plenout, preply);
 	}
 
-	pxattrfid = gsh_calloc(1, sizeof(struct _9p_fid));
+	pxattrfid = _9p_alloc_fid();
 
 	/* set op_ctx, it will be useful if FSAL is later called */
 	_9p_init_opctx(pfid, req9p);
@@ -129,7 +123,7 @@ int _9p_xattrwalk(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 
 		if (FSAL_IS_ERROR(fsal_status)) {
 			gsh_free(pxattrfid->specdata.xattr.xattr_content);
-			gsh_free(pxattrfid);
+			_9p_release_fid(pxattrfid);
 			return _9p_rerror(req9p, msgtag,
 					  _9p_tools_errno(fsal_status), plenout,
 					  preply);
@@ -139,7 +133,7 @@ int _9p_xattrwalk(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 		 * returns ERANGE as listxattr does */
 		if (eod_met != true) {
 			gsh_free(pxattrfid->specdata.xattr.xattr_content);
-			gsh_free(pxattrfid);
+			_9p_release_fid(pxattrfid);
 			return _9p_rerror(req9p, msgtag, ERANGE,
 					  plenout, preply);
 		}
@@ -159,7 +153,7 @@ int _9p_xattrwalk(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 			if (attrsize > XATTR_BUFFERSIZE) {
 				gsh_free(pxattrfid->specdata.xattr.
 					 xattr_content);
-				gsh_free(pxattrfid);
+				_9p_release_fid(pxattrfid);
 				return _9p_rerror(req9p, msgtag, ERANGE,
 						  plenout, preply);
 			}
@@ -175,7 +169,7 @@ int _9p_xattrwalk(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 
 		if (FSAL_IS_ERROR(fsal_status)) {
 			gsh_free(pxattrfid->specdata.xattr.xattr_content);
-			gsh_free(pxattrfid);
+			_9p_release_fid(pxattrfid);
 
 			/* ENOENT for xattr is ENOATTR */
 			if (fsal_status.major == ERR_FSAL_NOENT)
@@ -197,7 +191,7 @@ int _9p_xattrwalk(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 
 		if (FSAL_IS_ERROR(fsal_status)) {
 			gsh_free(pxattrfid->specdata.xattr.xattr_content);
-			gsh_free(pxattrfid);
+			_9p_release_fid(pxattrfid);
 
 			/* fsal_status.minor is a valid errno code */
 			return _9p_rerror(req9p, msgtag,
@@ -205,7 +199,7 @@ int _9p_xattrwalk(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 		}
 	}
 
-	req9p->pconn->fids[*attrfid] = pxattrfid;
+	_9p_insert_fid(req9p->pconn, *attrfid, pxattrfid);
 
 	/* Increments refcount as we're manually making a new copy */
 	pfid->pentry->obj_ops.get_ref(pfid->pentry);
@@ -124,6 +124,13 @@ int mnt_Mnt(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		goto out;
 	}
 
+	if (!export_activate(export)) {
+		/* Lazy_Init export could not be created */
+		res->res_mnt3.fhs_status = MNT3ERR_SERVERFAULT;
+		goto out;
+	}
+	op_ctx->fsal_export = export->fsal_export;
+
 	/* retrieve the associated NFS handle */
 	if (arg->arg_mnt[0] != '/' ||
 	    !strcmp(arg->arg_mnt, export->fullpath)) {
@@ -46,11 +46,11 @@
 #include "sal_functions.h"
 
 static void nfs_read_ok(struct svc_req *req, nfs_res_t *res, char *data,
-			uint32_t read_size, struct fsal_obj_handle *obj,
-			int eof)
+			uint32_t bufsize, uint32_t read_size,
+			struct fsal_obj_handle *obj, int eof)
 {
 	if ((read_size == 0) && (data != NULL)) {
-		gsh_free(data);
+		iobuf_free(nfs_iobuf_pool, data, bufsize);
 		data = NULL;
 	}
 
@@ -63,10 +63,125 @@ static void nfs_read_ok(struct svc_req *req, nfs_res_t *res, char *data,
 	res->res_read3.READ3res_u.resok.count = read_size;
 	res->res_read3.READ3res_u.resok.data.data_val = data;
 	res->res_read3.READ3res_u.resok.data.data_len = read_size;
+	res->res_read3.READ3res_u.resok.data_bufsize = bufsize;
 
 	res->res_read3.status = NFS3_OK;
 }
 
+/**
+ * @brief Fill in the result of a READ the FSAL is done with
+ *
+ * @return What the service returns.
+ */
+static int nfs3_read_result(struct svc_req *req, nfs_res_t *res,
+			    struct fsal_obj_handle *obj,
+			    fsal_status_t fsal_status, void *data,
+			    struct fsal_read_buf *rbuf, size_t size,
+			    size_t read_size, bool eof_met)
+{
+	if (!FSAL_IS_ERROR(fsal_status)) {
+		if (rbuf != NULL && read_size == 0) {
+			fsal_read_buf_put(rbuf);
+			rbuf = NULL;
+			data = NULL;
+		}
+		nfs_read_ok(req, res, data, size, read_size, obj, eof_met);
+		res->res_read3.READ3res_u.resok.rbuf = rbuf;
+		return NFS_REQ_OK;
+	}
+
+	/* nothing is lent on error */
+	if (rbuf != NULL)
+		gsh_free(rbuf);
+	else
+		iobuf_free(nfs_iobuf_pool, data, size);
+
+	if (nfs_RetryableError(fsal_status.major))
+		return NFS_REQ_DROP;
+
+	res->res_read3.status = nfs3_Errno_status(fsal_status);
+
+	nfs_SetPostOpAttr(obj,
+			  &res->res_read3.READ3res_u.resfail.file_attributes,
+			  NULL);
+
+	return NFS_REQ_OK;
+}
+
+struct nfs3_read_io {
+	struct fsal_io_arg read_arg;
+	struct svc_req *req;
+	nfs_res_t *res;
+};
+
+/**
+ * @brief Complete a READ started by nfs3_read_async()
+ */
+static void nfs3_read_done(struct fsal_obj_handle *obj,
+			   fsal_status_t fsal_status,
+			   struct fsal_io_arg *read_arg, void *caller_arg)
+{
+	struct nfs3_read_io *rio = caller_arg;
+	struct svc_req *req = rio->req;
+	struct req_op_context *saved_ctx = op_ctx;
+	int rc;
+
+	op_ctx = nfs_req_op_ctx(req);
+
+	state_share_anonymous_io_done(obj, OPEN4_SHARE_ACCESS_READ);
+
+	/* As fsal_read2() would */
+	if (fsal_status.major == ERR_FSAL_SHARE_DENIED)
+		fsal_status = fsalstat(ERR_FSAL_LOCKED, 0);
+	if (FSAL_IS_ERROR(fsal_status))
+		read_arg->io_amount = 0;
+
+	rc = nfs3_read_result(req, rio->res, obj, fsal_status,
+			      read_arg->buffer, NULL, read_arg->size,
+			      read_arg->io_amount, read_arg->end_of_file);
+
+	server_stats_io_done(read_arg->size, read_arg->io_amount,
+			     (rc == NFS_REQ_OK) ? true : false,
+			     false);
+
+	obj->obj_ops.put_ref(obj);
+	gsh_free(rio);
+
+	op_ctx = saved_ctx;
+	nfs_req_async_done(req, rc);
+}
+
+/**
+ * @brief Start a READ without waiting for it
+ *
+ * The reference on @a obj and the anonymous I/O are handed over to the
+ * completion.
+ *
+ * @return What the service returns.
+ */
+static int nfs3_read_async(struct svc_req *req, nfs_res_t *res,
+			   struct fsal_obj_handle *obj, uint64_t offset,
+			   size_t size)
+{
+	struct nfs3_read_io *rio = gsh_calloc(1, sizeof(*rio));
+	int rc;
+
+	rio->req = req;
+	rio->res = res;
+	/** @todo for now pass NULL state */
+	rio->read_arg.offset = offset;
+	rio->read_arg.size = size;
+	rio->read_arg.buffer = iobuf_alloc(nfs_iobuf_pool, size);
+
+	obj->obj_ops.read2_async(obj, true, &rio->read_arg, nfs3_read_done,
+				 rio);
+
+	if (nfs_req_suspend(req, NULL, NULL, &rc))
+		return NFS_REQ_ASYNC_WAIT;
+
+	return rc;
+}
+
 /**
  *
  * @brief The NFSPROC3_READ
@@ -92,6 +207,7 @@ int nfs3_read(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	size_t read_size = 0;
 	uint64_t offset = 0;
 	void *data = NULL;
+	struct fsal_read_buf *rbuf = NULL;
 	bool eof_met = false;
 	int rc = NFS_REQ_OK;
 	bool sync = false;
@@ -120,6 +236,7 @@ int nfs3_read(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	res->res_read3.READ3res_u.resok.count = 0;
 	res->res_read3.READ3res_u.resok.data.data_val = NULL;
 	res->res_read3.READ3res_u.resok.data.data_len = 0;
+	res->res_read3.READ3res_u.resok.rbuf = NULL;
 	res->res_read3.status = NFS3_OK;
 	obj = nfs3_FhandleToCache(&arg->arg_read3.file,
 				    &res->res_read3.status, &rc);
@@ -200,12 +317,10 @@ int nfs3_read(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	}
 
 	if (size == 0) {
-		nfs_read_ok(req, res, NULL, 0, obj, 0);
+		nfs_read_ok(req, res, NULL, 0, 0, obj, 0);
 		rc = NFS_REQ_OK;
 		goto out;
 	} else {
-		data = gsh_malloc(size);
-
 		res->res_read3.status = nfs3_Errno_state(
 				state_share_anonymous_io_start(
 					obj,
@@ -214,13 +329,29 @@ int nfs3_read(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 
 		if (res->res_read3.status != NFS3_OK) {
 			rc = NFS_REQ_OK;
-			gsh_free(data);
 			goto out;
 		}
 
-		if (obj->fsal->m_ops.support_ex(obj)) {
+		if (fsal_lends_read_buffers(obj)) {
+			/* Reply straight from the FSAL's buffer */
+			rbuf = gsh_calloc(1, sizeof(*rbuf));
+			fsal_status = fsal_read_buffer(obj,
+						       true,
+						       NULL,
+						       offset,
+						       size,
+						       rbuf,
+						       &eof_met);
+			data = rbuf->data.addr;
+			read_size = rbuf->data.len;
+		} else if (obj->fsal->m_ops.support_ex(obj) &&
+			   nfs_req_async_begin(req)) {
+			/* The completion finishes the request */
+			return nfs3_read_async(req, res, obj, offset, size);
+		} else if (obj->fsal->m_ops.support_ex(obj)) {
 			/* Call the new fsal_read2 */
 			/** @todo for now pass NULL state */
+			data = iobuf_alloc(nfs_iobuf_pool, size);
 			fsal_status = fsal_read2(obj,
 						  true,
 						  NULL,
@@ -232,6 +363,7 @@ int nfs3_read(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 						  NULL);
 		} else {
 			/* Call legacy fsal_rdwr */
+			data = iobuf_alloc(nfs_iobuf_pool, size);
 			fsal_status = fsal_rdwr(obj,
 						FSAL_IO_READ,
 						offset,
@@ -245,28 +377,10 @@ int nfs3_read(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 
 		state_share_anonymous_io_done(obj, OPEN4_SHARE_ACCESS_READ);
 
-		if (!FSAL_IS_ERROR(fsal_status)) {
-			nfs_read_ok(req, res, data, read_size, obj, eof_met);
-			rc = NFS_REQ_OK;
-			goto out;
-		}
-		gsh_free(data);
+		rc = nfs3_read_result(req, res, obj, fsal_status, data, rbuf,
+				      size, read_size, eof_met);
 	}
 
-	/* If we are here, there was an error */
-	if (nfs_RetryableError(fsal_status.major)) {
-		rc = NFS_REQ_DROP;
-		goto out;
-	}
-
-	res->res_read3.status = nfs3_Errno_status(fsal_status);
-
-	nfs_SetPostOpAttr(obj,
-			  &res->res_read3.READ3res_u.resfail.file_attributes,
-			  NULL);
-
-	rc = NFS_REQ_OK;
-
  out:
 	/* return references */
 	if (obj)
@@ -287,8 +401,13 @@ int nfs3_read(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
  */
 void nfs3_read_free(nfs_res_t *res)
 {
-	if ((res->res_read3.status == NFS3_OK)
-	    && (res->res_read3.READ3res_u.resok.data.data_len != 0)) {
-		gsh_free(res->res_read3.READ3res_u.resok.data.data_val);
-	}
+	if (res->res_read3.status != NFS3_OK)
+		return;
+
+	if (res->res_read3.READ3res_u.resok.rbuf != NULL)
+		fsal_read_buf_put(res->res_read3.READ3res_u.resok.rbuf);
+	else
+		iobuf_free(nfs_iobuf_pool,
+			   res->res_read3.READ3res_u.resok.data.data_val,
+			   res->res_read3.READ3res_u.resok.data_bufsize);
 }
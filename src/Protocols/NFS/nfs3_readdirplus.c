@@ -53,23 +53,27 @@ fsal_errors_t nfs3_readdirplus_callback(void *opaque,
 					       uint64_t cookie,
 					       enum cb_state cb_state);
 
-static void free_entryplus3s(entryplus3 *entryplus3s);
+/* Post op directory attributes (a fattr3 is 21 XDR units), the cookie
+ * verifier, the NULL ending the entries and eof
+ */
+#define READDIRPLUS3_RESOK_XDR \
+	(22 * BYTES_PER_XDR_UNIT + NFS3_COOKIEVERFSIZE + 2 * BYTES_PER_XDR_UNIT)
 
 /**
  * @brief Opaque bookkeeping structure for NFSPROC3_READDIRPLUS
  *
  * This structure keeps track of the process of writing out an NFSv3
  * READDIRPLUS response between calls to nfs3_readdirplus_callback.
+ * Entries are XDR encoded into one buffer as they are found, so the
+ * stream running out of room is what stops the readdir at maxcount.
  */
 
 struct nfs3_readdirplus_cb_data {
-	entryplus3 *entries;	/*< The array holding individual entries */
-	size_t mem_left;	/*< The amount of memory remaining before we
-				   hit maxcount */
+	XDR xdr;		/*< Stream over the encoded entries */
+	char *entries_xdr;	/*< The buffer the entries go into */
 	size_t count;		/*< The count of complete entries stored in the
 				   buffer */
-	size_t total_entries;	/*< The number of entires we allocated for
-				   the array. */
+	size_t total_entries;	/*< The most entries to return */
 	nfsstat3 error;		/*< Set to a value other than NFS_OK if the
 				   callback function finds a fatal error. */
 };
@@ -117,14 +121,14 @@ int nfs3_readdirplus(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	cookieverf3 cookie_verifier;
 	unsigned int num_entries = 0;
 	unsigned long estimated_num_entries = 0;
+	unsigned long maxcount;
 	object_file_type_t dir_filetype = 0;
 	bool eod_met = false;
 	fsal_status_t fsal_status = {0, 0};
 	fsal_status_t fsal_status_gethandle = {0, 0};
 	int rc = NFS_REQ_OK;
 	struct nfs3_readdirplus_cb_data tracker = {
-		.entries = NULL,
-		.mem_left = 0,
+		.entries_xdr = NULL,
 		.count = 0,
 		.error = NFS3_OK,
 	};
@@ -164,26 +168,32 @@ int nfs3_readdirplus(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		goto out;
 	}
 
-	tracker.mem_left = (arg->arg_readdirplus3.maxcount * 9) / 10;
+	maxcount = (arg->arg_readdirplus3.maxcount * 9) / 10;
 	begin_cookie = arg->arg_readdirplus3.cookie;
 
-	tracker.mem_left -= sizeof(READDIRPLUS3resok);
+	if (maxcount <= READDIRPLUS3_RESOK_XDR) {
+		res->res_readdirplus3.status = NFS3ERR_TOOSMALL;
+		LogFullDebug(COMPONENT_NFS_READDIR,
+			     "Response too small");
+		goto out;
+	}
+
+	maxcount -= READDIRPLUS3_RESOK_XDR;
 
-	/* Estimate assuming that we're going to send no names and no handles.
-	 * Don't count space for pointers for nextentry or
-	 * name_handle.data.data_val in entryplus3
+	/* The entry buffer is allocated whole, keep it within what a READ
+	 * could ask for.
 	 */
-	estimated_num_entries = MIN((tracker.mem_left + sizeof(entryplus3 *))
-				    / (sizeof(entryplus3) - sizeof(char *) * 2),
-				    50);
+	if (maxcount > atomic_fetch_uint64_t(&op_ctx->ctx_export->MaxRead))
+		maxcount = atomic_fetch_uint64_t(&op_ctx->ctx_export->MaxRead);
 
+	estimated_num_entries = 50;
 	tracker.total_entries = estimated_num_entries;
 
 	LogFullDebug(COMPONENT_NFS_READDIR,
 		     "nfs3_readdirplus: dircount=%u begin_cookie=%" PRIu64
-		     " estimated_num_entries=%lu, mem_left=%zd",
+		     " estimated_num_entries=%lu, maxcount=%lu",
 		     arg->arg_readdirplus3.dircount, begin_cookie,
-		     estimated_num_entries, tracker.mem_left);
+		     estimated_num_entries, maxcount);
 
 	/* Convert file handle into a vnode */
 	dir_obj = nfs3_FhandleToCache(&(arg->arg_readdirplus3.dir),
@@ -250,6 +260,9 @@ int nfs3_readdirplus(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	}
 
 	res->res_readdirplus3.READDIRPLUS3res_u.resok.reply.entries = NULL;
+	res->res_readdirplus3.READDIRPLUS3res_u.resok.reply.entries_xdr = NULL;
+	res->res_readdirplus3.READDIRPLUS3res_u.resok.reply.entries_xdr_len =
+		0;
 	res->res_readdirplus3.READDIRPLUS3res_u.resok.reply.eof = FALSE;
 
 	/* Fudge cookie for "." and "..", if necessary */
@@ -258,8 +271,9 @@ int nfs3_readdirplus(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	else
 		fsal_cookie = 0;
 
-	/* Allocate space for entries */
-	tracker.entries = gsh_calloc(estimated_num_entries, sizeof(entryplus3));
+	/* Allocate the buffer the entries are encoded into */
+	tracker.entries_xdr = gsh_malloc(maxcount);
+	xdrmem_create(&tracker.xdr, tracker.entries_xdr, maxcount, XDR_ENCODE);
 
 	if (begin_cookie == 0) {
 		/* Fill in "." */
@@ -332,16 +346,23 @@ int nfs3_readdirplus(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 
 	if ((num_entries == 0) && (begin_cookie > 1)) {
 		res->res_readdirplus3.status = NFS3_OK;
-		res->res_readdirplus3.READDIRPLUS3res_u.resok.reply.entries =
-		    NULL;
 		res->res_readdirplus3.READDIRPLUS3res_u.resok.reply.eof = TRUE;
 	} else {
-		res->res_readdirplus3.READDIRPLUS3res_u.resok.reply.entries =
-		    tracker.entries;
 		res->res_readdirplus3.READDIRPLUS3res_u.resok.reply.eof =
 		    eod_met;
 	}
 
+	if (tracker.count != 0) {
+		dirlistplus3 *reply =
+		    &res->res_readdirplus3.READDIRPLUS3res_u.resok.reply;
+
+		/* The reply owns the buffer from here */
+		reply->entries_xdr = tracker.entries_xdr;
+		reply->entries_xdr_len = xdr_getpos(&tracker.xdr);
+		xdr_destroy(&tracker.xdr);
+		tracker.entries_xdr = NULL;
+	}
+
 	nfs_SetPostOpAttr(dir_obj,
 			  &res->res_readdirplus3.READDIRPLUS3res_u.resok.
 				dir_attributes,
@@ -374,9 +395,10 @@ int nfs3_readdirplus(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	if (dir_obj)
 		dir_obj->obj_ops.put_ref(dir_obj);
 
-	if (((res->res_readdir3.status != NFS3_OK) || (rc != NFS_REQ_OK))
-	    && (tracker.entries != NULL))
-		free_entryplus3s(tracker.entries);
+	if (tracker.entries_xdr != NULL) {
+		xdr_destroy(&tracker.xdr);
+		gsh_free(tracker.entries_xdr);
+	}
 
 	return rc;
 }				/* nfs3_readdirplus */
@@ -392,17 +414,16 @@ int nfs3_readdirplus(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 void nfs3_readdirplus_free(nfs_res_t *resp)
 {
 #define RESREADDIRPLUSREPLY resp->res_readdirplus3.READDIRPLUS3res_u.resok.reply
-	if ((resp->res_readdirplus3.status == NFS3_OK)
-	    && (RESREADDIRPLUSREPLY.entries != NULL))
-		free_entryplus3s(RESREADDIRPLUSREPLY.entries);
+	if (resp->res_readdirplus3.status == NFS3_OK)
+		gsh_free(RESREADDIRPLUSREPLY.entries_xdr);
 }
 
 /**
- * @brief Populate entryplus3s when called from fsal_readdir
+ * @brief Encode entryplus3s when called from fsal_readdir
  *
- * This function is a callback passed to fsal_readdir.  It
- * fills in a pre-allocated array of entryplys3 structures and allocates
- * space for the name and attributes.  This space must be freed.
+ * This function is a callback passed to fsal_readdir.  It builds each
+ * entryplus3 on the stack, handle and all, and encodes it straight
+ * into the reply's entry buffer, so nothing is allocated per entry.
  *
  * @param opaque [in] Pointer to a struct nfs3_readdirplus_cb_data that is
  *                    gives the location of the array and other
@@ -423,94 +444,64 @@ fsal_errors_t nfs3_readdirplus_callback(void *opaque,
 	/* Not-so-opaque pointer to callback data` */
 	struct fsal_readdir_cb_parms *cb_parms = opaque;
 	struct nfs3_readdirplus_cb_data *tracker = cb_parms->opaque;
-	/* Length of the current filename */
-	size_t namelen = strlen(cb_parms->name);
-	entryplus3 *ep3 = tracker->entries + tracker->count;
+	XDR *xdrs = &tracker->xdr;
+	u_int start = xdr_getpos(xdrs);
+	char val_fh[NFS3_FHSIZE];
+	entryplus3 ep3;
+	bool_t follows = TRUE;
 
 	if (tracker->count == tracker->total_entries) {
 		cb_parms->in_result = false;
 		return ERR_FSAL_NO_ERROR;
 	}
-	/* This is a pessimistic check, which assumes that we're going
-	 * to send attributes and full size handle - if it fails then
-	 * we're close enough to the buffer size limit and t's time to
-	 * stop anyway */
-	if (tracker->mem_left
-	    < (sizeof(entryplus3) + namelen + NFS3_FHSIZE)) {
-		if (tracker->count == 0)
-			tracker->error = NFS3ERR_TOOSMALL;
 
-		cb_parms->in_result = false;
-		return ERR_FSAL_NO_ERROR;
-	}
-
-	ep3->fileid = obj->fileid;
-	ep3->name = gsh_strdup(cb_parms->name);
-	ep3->cookie = cookie;
-
-	/* Account for file name + length + cookie */
-	tracker->mem_left -= sizeof(ep3->cookie) + ((namelen + 3) & ~3) + 4;
+	memset(&ep3, 0, sizeof(ep3));
+	ep3.fileid = obj->fileid;
+	ep3.name = (char *)cb_parms->name;
+	ep3.cookie = cookie;
 
 	if (cb_parms->attr_allowed) {
-		ep3->name_handle.handle_follows = TRUE;
+		ep3.name_handle.handle_follows = TRUE;
+		ep3.name_handle.post_op_fh3_u.handle.data.data_val = val_fh;
 
-		if (!nfs3_FSALToFhandle(true,
-					&ep3->name_handle.post_op_fh3_u.handle,
+		if (!nfs3_FSALToFhandle(false,
+					&ep3.name_handle.post_op_fh3_u.handle,
 					obj,
 					op_ctx->ctx_export)) {
 			tracker->error = NFS3ERR_SERVERFAULT;
-			gsh_free(ep3->name);
 			cb_parms->in_result = false;
 			return ERR_FSAL_NO_ERROR;
 		}
 
-		/* Account for filehande + length + follows + nextentry */
-		tracker->mem_left -=
-		    ep3->name_handle.post_op_fh3_u.handle.data.data_len + 12;
-
-		ep3->name_attributes.attributes_follow = true;
+		ep3.name_attributes.attributes_follow = true;
 
 		nfs3_FSALattr_To_Fattr(
 			obj, attr,
-			&ep3->name_attributes.post_op_attr_u.attributes);
+			&ep3.name_attributes.post_op_attr_u.attributes);
 	} else {
-		ep3->name_handle.handle_follows = false;
-		ep3->name_attributes.attributes_follow = false;
-		tracker->mem_left -= sizeof(ep3->name_handle.handle_follows);
+		ep3.name_handle.handle_follows = false;
+		ep3.name_attributes.attributes_follow = false;
 	}
 
-	if (ep3->name_attributes.attributes_follow)
-		tracker->mem_left -= sizeof(ep3->name_attributes);
-	else
-		tracker->mem_left -=
-		    sizeof(ep3->name_attributes.attributes_follow);
+	/* Everything up to the next entry's TRUE */
+	if (!xdr_bool(xdrs, &follows) ||
+	    !xdr_fileid3(xdrs, &ep3.fileid) ||
+	    !xdr_filename3(xdrs, &ep3.name) ||
+	    !xdr_cookie3(xdrs, &ep3.cookie) ||
+	    !xdr_post_op_attr(xdrs, &ep3.name_attributes) ||
+	    !xdr_post_op_fh3(xdrs, &ep3.name_handle)) {
+		/* No room left before maxcount */
+		xdr_setpos(xdrs, start);
 
-	if (tracker->count > 0)
-		tracker->entries[tracker->count - 1].nextentry = ep3;
+		if (tracker->count == 0)
+			tracker->error = NFS3ERR_TOOSMALL;
+
+		cb_parms->in_result = false;
+		return ERR_FSAL_NO_ERROR;
+	}
 
 	++(tracker->count);
 	cb_parms->in_result = true;
 
 	return ERR_FSAL_NO_ERROR;
 }				/* nfs3_readdirplus_callback */
-
-/**
- * @brief Clean up memory allocated to serve NFSv3 READDIRPLUS
- *
- * This function traverses the list of entries, freeing all names
- * allocated in the callback function, then frees the list itself.
- *
- * @param entryplus3s [in] Pointer to first obj
- */
-
-static void free_entryplus3s(entryplus3 *entryplus3s)
-{
-	entryplus3 *entry = NULL;
-
-	for (entry = entryplus3s; entry != NULL; entry = entry->nextentry) {
-		gsh_free(entry->name);
-		gsh_free(entry->name_handle.post_op_fh3_u.handle.data.data_val);
-	}
-
-	gsh_free(entryplus3s);
-}
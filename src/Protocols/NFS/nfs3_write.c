@@ -47,6 +47,132 @@
 #include "export_mgr.h"
 #include "sal_functions.h"
 
+/**
+ * @brief Fill in the result of a WRITE the FSAL is done with
+ *
+ * @return What the service returns.
+ */
+static int nfs3_write_result(nfs_res_t *res, struct fsal_obj_handle *obj,
+			     fsal_status_t fsal_status, size_t written_size,
+			     bool sync)
+{
+	if (FSAL_IS_ERROR(fsal_status)) {
+		/* If we are here, there was an error */
+		LogFullDebug(COMPONENT_NFSPROTO,
+			     "failed write: fsal_status=%s",
+			     fsal_err_txt(fsal_status));
+
+		if (nfs_RetryableError(fsal_status.major))
+			return NFS_REQ_DROP;
+
+		res->res_write3.status = nfs3_Errno_status(fsal_status);
+
+		nfs_SetWccData(NULL, obj,
+			       &res->res_write3.WRITE3res_u.resfail.file_wcc);
+
+		return NFS_REQ_OK;
+	}
+
+	/* Build Weak Cache Coherency data */
+	nfs_SetWccData(NULL, obj,
+		       &res->res_write3.WRITE3res_u.resok.file_wcc);
+
+	/* Set the written size */
+	res->res_write3.WRITE3res_u.resok.count = written_size;
+
+	/* How do we commit data ? */
+	if (sync)
+		res->res_write3.WRITE3res_u.resok.committed = FILE_SYNC;
+	else
+		res->res_write3.WRITE3res_u.resok.committed = UNSTABLE;
+
+	/* Set the write verifier */
+	memcpy(res->res_write3.WRITE3res_u.resok.verf,
+	       NFS3_write_verifier,
+	       sizeof(writeverf3));
+
+	res->res_write3.status = NFS3_OK;
+
+	return NFS_REQ_OK;
+}
+
+struct nfs3_write_io {
+	struct fsal_io_arg write_arg;
+	struct svc_req *req;
+	nfs_res_t *res;
+};
+
+/**
+ * @brief Complete a WRITE started by nfs3_write_async()
+ */
+static void nfs3_write_done(struct fsal_obj_handle *obj,
+			    fsal_status_t fsal_status,
+			    struct fsal_io_arg *write_arg, void *caller_arg)
+{
+	struct nfs3_write_io *wio = caller_arg;
+	struct svc_req *req = wio->req;
+	struct req_op_context *saved_ctx = op_ctx;
+	int rc;
+
+	op_ctx = nfs_req_op_ctx(req);
+
+	state_share_anonymous_io_done(obj, OPEN4_SHARE_ACCESS_WRITE);
+
+	/* As fsal_write2() would */
+	if (fsal_status.major == ERR_FSAL_SHARE_DENIED)
+		fsal_status = fsalstat(ERR_FSAL_LOCKED, 0);
+	if (FSAL_IS_ERROR(fsal_status))
+		write_arg->io_amount = 0;
+
+	rc = nfs3_write_result(wio->res, obj, fsal_status,
+			       write_arg->io_amount, write_arg->fsal_stable);
+
+	server_stats_io_done(write_arg->size, write_arg->io_amount,
+			     (rc == NFS_REQ_OK) ? true : false,
+			     true);
+
+	obj->obj_ops.put_ref(obj);
+	gsh_free(wio);
+
+	op_ctx = saved_ctx;
+	nfs_req_async_done(req, rc);
+}
+
+/**
+ * @brief Start a WRITE without waiting for it
+ *
+ * The reference on @a obj and the anonymous I/O are handed over to the
+ * completion.  The data stay in the arguments, which are kept until the
+ * reply is sent.
+ *
+ * @return What the service returns.
+ */
+static int nfs3_write_async(struct svc_req *req, nfs_res_t *res,
+			    struct fsal_obj_handle *obj, uint64_t offset,
+			    size_t size, void *data, bool sync)
+{
+	struct nfs3_write_io *wio = gsh_calloc(1, sizeof(*wio));
+	int rc;
+
+	wio->req = req;
+	wio->res = res;
+	/** @todo for now pass NULL state */
+	wio->write_arg.offset = offset;
+	wio->write_arg.size = size;
+	wio->write_arg.buffer = data;
+	/* Force sync if export requires it, as fsal_write2() would */
+	wio->write_arg.fsal_stable = sync ||
+		(op_ctx->export_perms->options & EXPORT_OPTION_COMMIT) != 0;
+
+	obj->obj_ops.write2_async(obj, true, &wio->write_arg, nfs3_write_done,
+				  wio);
+
+	if (nfs_req_suspend(req, NULL, NULL, &rc))
+		return NFS_REQ_ASYNC_WAIT;
+
+	return rc;
+}
+
 /**
  *
  * @brief The NFSPROC3_WRITE
@@ -228,7 +354,11 @@ int nfs3_write(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		goto out;
 	}
 
-	if (obj->fsal->m_ops.support_ex(obj)) {
+	if (obj->fsal->m_ops.support_ex(obj) && nfs_req_async_begin(req)) {
+		/* The completion finishes the request */
+		return nfs3_write_async(req, res, obj, offset, size, data,
+					sync);
+	} else if (obj->fsal->m_ops.support_ex(obj)) {
 		/* Call the new fsal_write */
 		/** @todo for now pass NULL state */
 		fsal_status = fsal_write2(obj,
@@ -255,46 +385,7 @@ int nfs3_write(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 
 	state_share_anonymous_io_done(obj, OPEN4_SHARE_ACCESS_WRITE);
 
-	if (FSAL_IS_ERROR(fsal_status)) {
-		/* If we are here, there was an error */
-		LogFullDebug(COMPONENT_NFSPROTO,
-			     "failed write: fsal_status=%s",
-			     fsal_err_txt(fsal_status));
-
-		if (nfs_RetryableError(fsal_status.major)) {
-			rc = NFS_REQ_DROP;
-			goto out;
-		}
-
-		res->res_write3.status = nfs3_Errno_status(fsal_status);
-
-		nfs_SetWccData(NULL, obj,
-			       &res->res_write3.WRITE3res_u.resfail.file_wcc);
-
-		rc = NFS_REQ_OK;
-	} else {
-		/* Build Weak Cache Coherency data */
-		nfs_SetWccData(NULL, obj,
-			       &res->res_write3.WRITE3res_u.resok.file_wcc);
-
-		/* Set the written size */
-		res->res_write3.WRITE3res_u.resok.count = written_size;
-
-		/* How do we commit data ? */
-		if (sync)
-			res->res_write3.WRITE3res_u.resok.committed = FILE_SYNC;
-		else
-			res->res_write3.WRITE3res_u.resok.committed = UNSTABLE;
-
-		/* Set the write verifier */
-		memcpy(res->res_write3.WRITE3res_u.resok.verf,
-		       NFS3_write_verifier,
-		       sizeof(writeverf3));
-
-		res->res_write3.status = NFS3_OK;
-	}
-
-	rc = NFS_REQ_OK;
+	rc = nfs3_write_result(res, obj, fsal_status, written_size, sync);
 
  out:
 	/* return references */
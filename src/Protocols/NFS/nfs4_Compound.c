@@ -42,6 +42,8 @@
 #include "server_stats.h"
 #include "export_mgr.h"
 #include "nfs_creds.h"
+#include "fridgethr.h"
+#include "pnfs_utils.h"
 
 struct nfs4_op_desc {
 	char *name;
@@ -363,8 +365,8 @@ static const struct nfs4_op_desc optabv4[] = {
 				.exp_perm_flags = 0},
 	[NFS4_OP_COPY] = {
 				.name = "OP_COPY",
-				.funct = nfs4_op_notsupp,
-				.free_res = nfs4_op_notsupp_Free,
+				.funct = nfs4_op_copy,
+				.free_res = nfs4_op_copy_Free,
 				.exp_perm_flags = 0},
 	[NFS4_OP_COPY_NOTIFY] = {
 				.name = "OP_COPY_NOTIFY",
@@ -393,13 +395,13 @@ static const struct nfs4_op_desc optabv4[] = {
 				.exp_perm_flags = 0},
 	[NFS4_OP_OFFLOAD_CANCEL] = {
 				.name = "OP_OFFLOAD_CANCEL",
-				.funct = nfs4_op_notsupp,
-				.free_res = nfs4_op_notsupp_Free,
+				.funct = nfs4_op_offload_cancel,
+				.free_res = nfs4_op_offload_cancel_Free,
 				.exp_perm_flags = 0},
 	[NFS4_OP_OFFLOAD_STATUS] = {
 				.name = "OP_OFFLOAD_STATUS",
-				.funct = nfs4_op_notsupp,
-				.free_res = nfs4_op_notsupp_Free,
+				.funct = nfs4_op_offload_status,
+				.free_res = nfs4_op_offload_status_Free,
 				.exp_perm_flags = 0},
 	[NFS4_OP_READ_PLUS] = {
 				.name = "OP_READ_PLUS",
@@ -418,8 +420,8 @@ static const struct nfs4_op_desc optabv4[] = {
 				.exp_perm_flags = 0},
 	[NFS4_OP_CLONE] = {
 				.name = "OP_CLONE",
-				.funct = nfs4_op_notsupp,
-				.free_res = nfs4_op_notsupp_Free,
+				.funct = nfs4_op_clone,
+				.free_res = nfs4_op_clone_Free,
 				.exp_perm_flags = 0},
 
 	/* NFSv4.3 */
@@ -454,6 +456,567 @@ nfs_opnum4 LastOpcode[] = {
 	NFS4_OP_REMOVEXATTR
 };
 
+/**
+ * @brief Record an op refused before it was run
+ *
+ * All the operations, like NFS4_OP_ACCESS, have a first replied field
+ * called .status.
+ *
+ * @return The status.
+ */
+static inline int nfs4_op_refused(nfs_argop4 *argarray, nfs_resop4 *resarray,
+				  uint32_t i, int status)
+{
+	resarray[i].nfs_resop4_u.opaccess.status = status;
+	resarray[i].resop = argarray[i].argop;
+	return status;
+}
+
+/**
+ * @brief Account for an op once it is done
+ *
+ * @return The op's status.
+ */
+static int nfs4_op_done(compound_data_t *data, nfs_resop4 *resarray,
+			uint32_t i, nfs_opnum4 opcode,
+			nsecs_elapsed_t op_start_time, int status)
+{
+	LogCompoundFH(data);
+
+	resarray[i].nfs_resop4_u.opaccess.status = status;
+
+	server_stats_nfsv4_op_done(opcode, op_start_time, status);
+
+	return status;
+}
+
+/**
+ * @brief Check export permissions for an op and run it
+ *
+ * @param[in,out] data      Compound request's data
+ * @param[in]     argarray  Arguments of the compound
+ * @param[out]    resarray  Results of the compound
+ * @param[in]     i         Position of the op
+ *
+ * @return The op's status.
+ */
+static int nfs4_process_op(compound_data_t *data, nfs_argop4 *argarray,
+			   nfs_resop4 *resarray, uint32_t i)
+{
+	nfs_opnum4 opcode = argarray[i].argop;
+	nsecs_elapsed_t op_start_time;
+	struct timespec ts;
+	int perm_flags;
+	int status;
+#ifdef USE_MEM_ACCOUNTING
+	struct mem_counter allocs_start;
+#endif
+
+	/* Used to check if OP_SEQUENCE is the first operation */
+	data->oppos = i;
+
+	/* time each op */
+	now(&ts);
+	op_start_time = timespec_diff(&ServerBootTime, &ts);
+
+	/* Handle opcode overflow */
+	if (opcode > LastOpcode[data->minorversion])
+		opcode = 0;
+
+	LogDebug(COMPONENT_NFS_V4, "Request %d: opcode %d is %s", i,
+		 argarray[i].argop, optabv4[opcode].name);
+	op_ctx->op_name = optabv4[opcode].name;
+	perm_flags =
+	    optabv4[opcode].exp_perm_flags & EXPORT_OPTION_ACCESS_MASK;
+
+	if (perm_flags != 0) {
+		status = nfs4_Is_Fh_Empty(&data->currentFH);
+		if (status != NFS4_OK) {
+			LogDebug(COMPONENT_NFS_V4,
+				 "Status of %s for CurrentFH in position %d = %s",
+				 optabv4[opcode].name,
+				 i,
+				 nfsstat4_to_str(status));
+			return nfs4_op_refused(argarray, resarray, i, status);
+		}
+
+		/* Operation uses a CurrentFH, so we can check export
+		 * perms. Perms should even be set reasonably for pseudo
+		 * file system.
+		 */
+		LogMidDebugAlt(COMPONENT_NFS_V4, COMPONENT_EXPORT,
+			       "Check export perms export = %08x req = %08x",
+			       op_ctx->export_perms->options &
+					EXPORT_OPTION_ACCESS_MASK,
+			       perm_flags);
+		if ((op_ctx->export_perms->options &
+		     perm_flags) != perm_flags) {
+			/* Export doesn't allow requested
+			 * access for this client.
+			 */
+			if ((perm_flags & EXPORT_OPTION_MODIFY_ACCESS)
+			    != 0)
+				status = NFS4ERR_ROFS;
+			else
+				status = NFS4ERR_ACCESS;
+
+			LogDebugAlt(COMPONENT_NFS_V4, COMPONENT_EXPORT,
+				    "Status of %s due to export permissions in position %d = %s",
+				    optabv4[opcode].name, i,
+				    nfsstat4_to_str(status));
+			return nfs4_op_refused(argarray, resarray, i, status);
+		}
+	}
+
+#ifdef USE_MEM_ACCOUNTING
+	mem_acct_thread_total(&allocs_start);
+#endif
+	status = (optabv4[opcode].funct) (&argarray[i], data, &resarray[i]);
+#ifdef USE_MEM_ACCOUNTING
+	if (!data->async_pending)
+		server_stats_nfsv4_op_allocs_done(opcode, &allocs_start);
+#endif
+
+	if (data->async_pending) {
+		/* Finished by nfs4_op_done() once its I/O completes */
+		data->op_start_time = op_start_time;
+		return status;
+	}
+
+	return nfs4_op_done(data, resarray, i, opcode, op_start_time, status);
+}
+
+/**
+ * @brief Finish a COMPOUND once its ops are done
+ *
+ * @param[in,out] data          The compound's data, freed here
+ * @param[out]    res           The result
+ * @param[in]     argarray_len  Number of ops in the compound
+ * @param[in]     status        Status of the last op run
+ * @param[in]     i             Position of the last op run
+ */
+static void nfs4_compound_finish(compound_data_t *data, nfs_res_t *res,
+				 uint32_t argarray_len, int status,
+				 uint32_t i)
+{
+	server_stats_compound_done(argarray_len, status);
+
+	/* Complete the reply, in particular, tell where you stopped if
+	 * unsuccessfull COMPOUD
+	 */
+	res->res_compound4.status = status;
+
+	/* The result takes over the reply storage ops allocated from the
+	 * arena; a replayed result already has its own.
+	 */
+	if (data->use_drc)
+		mem_arena_release(&data->arena);
+	else
+		res->res_compound4_extended.res_arena = data->arena;
+
+	/* Manage session's DRC: keep NFS4.1 replay for later use, but don't
+	 * save a replayed result again.
+	 */
+	if (data->cache_slot != NULL && !data->use_drc) {
+		/* Pointer has been set by nfs4_op_sequence and points to slot
+		 * to cache result in.
+		 */
+		LogFullDebug(COMPONENT_SESSIONS,
+			     "Save result in session replay cache %p",
+			     data->cache_slot);
+
+		nfs41_slot_cache_reply(data->cache_slot,
+				       &res->res_compound4_extended);
+	}
+
+	/* A replay that was not sent after all */
+	if (data->replay != NULL)
+		nfs41_put_reply(data->replay);
+
+	/* Hand the slot SEQUENCE claimed on to the next request, or to a
+	 * replay of this one.
+	 */
+	if (data->session != NULL)
+		atomic_store_uint32_t(&data->session->slots[data->slot].busy,
+				      0);
+
+	/* If we have reserved a lease, update it and release it */
+	if (data->preserved_clientid != NULL) {
+		/* Update and release lease */
+		PTHREAD_MUTEX_lock(&data->preserved_clientid->cid_mutex);
+
+		update_lease(data->preserved_clientid);
+
+		PTHREAD_MUTEX_unlock(&data->preserved_clientid->cid_mutex);
+	}
+
+	if (status != NFS4_OK)
+		LogDebug(COMPONENT_NFS_V4, "End status = %s lastindex = %d",
+			 nfsstat4_to_str(status), i);
+
+	compound_data_Free(data);
+}
+
+/**
+ * @brief Go on with a COMPOUND whose last op was suspended for its I/O
+ *
+ * @param[in] req     The request
+ * @param[in] arg     The compound's data, moved off the worker's stack
+ * @param[in] result  Status of the op
+ *
+ * @return NFS_REQ_OK.
+ */
+static int nfs4_compound_resume(struct svc_req *req, void *arg, int result)
+{
+	compound_data_t *data = arg;
+	nfs_request_t *reqnfs = container_of(req, nfs_request_t, svc);
+	nfs_res_t *res = reqnfs->res_nfs;
+	COMPOUND4args *args = &reqnfs->arg_nfs.arg_compound4;
+	nfs_argop4 *argarray = args->argarray.argarray_val;
+	uint32_t i = data->oppos;
+	nfs_opnum4 opcode = argarray[i].argop;
+	int status;
+
+	if (opcode > LastOpcode[data->minorversion])
+		opcode = 0;
+
+	data->async_pending = false;
+	status = nfs4_op_done(data, res->res_compound4.resarray.resarray_val,
+			      i, opcode, data->op_start_time, result);
+
+	if (status != NFS4_OK)
+		res->res_compound4.resarray.resarray_len = i + 1;
+
+	nfs4_compound_finish(data, res, args->argarray.argarray_len, status,
+			     i);
+	gsh_free(data);
+
+	return NFS_REQ_OK;
+}
+
+/**
+ * @page ParallelCompound Parallel COMPOUND segments
+ *
+ * Clients often batch lookups of unrelated files into one COMPOUND,
+ * as PUTFH, GETATTR, PUTFH, GETATTR and so on.  Each PUTFH replaces
+ * the current filehandle and export outright, so a run of segments
+ * that each start with PUTFH and go on only with ops that neither
+ * change anything nor touch the saved filehandle do not depend on one
+ * another.  With Parallel_Compound set such a run is split up: every
+ * segment but the last goes to the compound fridge with a compound
+ * data and request context of its own, while the worker runs the last
+ * segment itself, leaving the compound in the state the ops after the
+ * run expect.
+ *
+ * Results land in their own slots of the reply.  Once every segment
+ * is done the first failure in op order ends the compound, as it would
+ * have serially, and the results of ops that ran beyond it are freed.
+ * Those ops ran for nothing, but being read only they leave nothing
+ * behind beyond access times and statistics.  SAVEFH and RESTOREFH end
+ * a run, since they carry state across a PUTFH.
+ */
+
+/* Most segments in one run */
+#define COMPOUND_SEGMENTS_MAX 16
+
+struct compound_parallel {
+	pthread_mutex_t mtx;
+	pthread_cond_t cv;
+	uint32_t pending;	/*< Segments still on the fridge */
+};
+
+struct compound_segment {
+	struct compound_parallel *par;
+	nfs_argop4 *argarray;
+	nfs_resop4 *resarray;
+	uint32_t start;		/*< PUTFH starting the segment */
+	uint32_t end;		/*< Op after the segment */
+	uint32_t last;		/*< Last op run */
+	int status;		/*< Status of the last op run */
+	compound_data_t data;
+	struct req_op_context ctx;
+	struct user_cred creds;
+	struct export_perms export_perms;
+};
+
+static struct fridgethr *compound_fridge;
+
+/**
+ * @brief Start the fridge parallel segments run on
+ *
+ * Does nothing unless Parallel_Compound is set.
+ *
+ * @return 0 or an error from fridgethr_init.
+ */
+int nfs4_compound_fridge_init(void)
+{
+	struct fridgethr_params frp;
+	int rc;
+
+	if (!nfs_param.nfsv4_param.parallel_compound)
+		return 0;
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = nfs_param.nfsv4_param.parallel_compound_threads;
+	frp.thr_min = 0;
+	frp.flavor = fridgethr_flavor_worker;
+	frp.deferment = fridgethr_defer_queue;
+
+	rc = fridgethr_init(&compound_fridge, "Compound", &frp);
+	if (rc != 0)
+		LogMajor(COMPONENT_NFS_V4,
+			 "Unable to initialize compound fridge, error code %d.",
+			 rc);
+
+	return rc;
+}
+
+static bool nfs4_parallel_op(nfs_opnum4 op)
+{
+	switch (op) {
+	case NFS4_OP_ACCESS:
+	case NFS4_OP_GETATTR:
+	case NFS4_OP_GETFH:
+	case NFS4_OP_LOOKUP:
+	case NFS4_OP_LOOKUPP:
+	case NFS4_OP_NVERIFY:
+	case NFS4_OP_READ:
+	case NFS4_OP_READLINK:
+	case NFS4_OP_VERIFY:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/**
+ * @brief Find a run of independent segments starting at an op
+ *
+ * @param[in] data          Compound request's data
+ * @param[in] argarray      Arguments of the compound
+ * @param[in] argarray_len  Number of ops
+ * @param[in] start         Op the run would start at
+ *
+ * @return The op after the run, or 0 if there are not two segments.
+ */
+static uint32_t nfs4_parallel_run_end(compound_data_t *data,
+				      nfs_argop4 *argarray,
+				      uint32_t argarray_len, uint32_t start)
+{
+	uint32_t limit = argarray_len;
+	uint32_t segments = 0;
+	uint32_t i;
+
+	if (argarray[start].argop != NFS4_OP_PUTFH)
+		return 0;
+
+	/* Leave the op the session refuses to the serial loop */
+	if (data->minorversion > 0 && data->session != NULL &&
+	    data->session->fore_channel_attrs.ca_maxoperations < limit)
+		limit = data->session->fore_channel_attrs.ca_maxoperations;
+
+	for (i = start; i < limit; i++) {
+		if (argarray[i].argop == NFS4_OP_PUTFH) {
+			if (segments == COMPOUND_SEGMENTS_MAX)
+				break;
+			segments++;
+		} else if (!nfs4_parallel_op(argarray[i].argop)) {
+			break;
+		}
+	}
+
+	return segments > 1 ? i : 0;
+}
+
+/**
+ * @brief Run one segment in its own context
+ *
+ * Everything the segment took is released here, except reply storage
+ * in its arena, which the worker takes over.
+ *
+ * @param[in,out] seg  The segment
+ */
+static void nfs4_segment_execute(struct compound_segment *seg)
+{
+	struct req_op_context *saved_ctx = op_ctx;
+	uint32_t i;
+
+	op_ctx = &seg->ctx;
+	init_credentials();
+
+	for (i = seg->start; i < seg->end; i++) {
+		seg->last = i;
+		seg->status = nfs4_process_op(&seg->data, seg->argarray,
+					      seg->resarray, i);
+		if (seg->status != NFS4_OK)
+			break;
+	}
+
+	if (seg->data.preserved_clientid != NULL) {
+		/* Update and release lease */
+		PTHREAD_MUTEX_lock(&seg->data.preserved_clientid->cid_mutex);
+
+		update_lease(seg->data.preserved_clientid);
+
+		PTHREAD_MUTEX_unlock(&seg->data.preserved_clientid->cid_mutex);
+	}
+
+	if (op_ctx->fsal_pnfs_ds != NULL) {
+		pnfs_ds_put(op_ctx->fsal_pnfs_ds);
+		op_ctx->fsal_pnfs_ds = NULL;
+	}
+
+	compound_data_Free(&seg->data);
+	clean_credentials();
+
+	op_ctx = saved_ctx;
+}
+
+static void nfs4_segment_run(struct fridgethr_context *ctx)
+{
+	struct compound_segment *seg = ctx->arg;
+	struct compound_parallel *par = seg->par;
+
+	nfs4_segment_execute(seg);
+
+	PTHREAD_MUTEX_lock(&par->mtx);
+	if (--par->pending == 0)
+		pthread_cond_signal(&par->cv);
+	PTHREAD_MUTEX_unlock(&par->mtx);
+}
+
+/**
+ * @brief Run a run of independent segments concurrently
+ *
+ * See @ref ParallelCompound.
+ *
+ * @param[in,out] data      Compound request's data
+ * @param[in]     argarray  Arguments of the compound
+ * @param[out]    resarray  Results of the compound
+ * @param[in]     start     First op of the run
+ * @param[in]     end       Op after the run
+ * @param[out]    last      Last op whose result counts
+ *
+ * @return The status of op @a last.
+ */
+static int nfs4_compound_parallel(compound_data_t *data,
+				  nfs_argop4 *argarray,
+				  nfs_resop4 *resarray,
+				  uint32_t start, uint32_t end,
+				  unsigned int *last)
+{
+	uint32_t starts[COMPOUND_SEGMENTS_MAX + 1];
+	struct compound_parallel par;
+	struct compound_segment *segs, *seg;
+	uint32_t nsegs = 0, i, j;
+	uint32_t fail = end;
+	int status = NFS4_OK;
+	int rc;
+
+	for (i = start; i < end; i++) {
+		if (argarray[i].argop == NFS4_OP_PUTFH)
+			starts[nsegs++] = i;
+	}
+	starts[nsegs] = end;
+
+	PTHREAD_MUTEX_init(&par.mtx, NULL);
+	PTHREAD_COND_init(&par.cv, NULL);
+	par.pending = 0;
+
+	segs = gsh_calloc(nsegs - 1, sizeof(*segs));
+
+	for (j = 0; j < nsegs - 1; j++) {
+		seg = &segs[j];
+		seg->par = &par;
+		seg->argarray = argarray;
+		seg->resarray = resarray;
+		seg->start = starts[j];
+		seg->end = starts[j + 1];
+
+		compound_data_init_fh(&seg->data);
+		seg->data.minorversion = data->minorversion;
+		seg->data.req = data->req;
+		seg->data.opcount = seg->end;
+		seg->data.credential = data->credential;
+		if (data->session != NULL) {
+			inc_session_ref(data->session);
+			seg->data.session = data->session;
+			seg->data.sequence = data->sequence;
+			seg->data.slot = data->slot;
+		}
+
+		/* The segment's PUTFH sets its export, permissions and
+		 * credentials afresh.
+		 */
+		seg->ctx = *op_ctx;
+		seg->ctx.creds = &seg->creds;
+		seg->export_perms = *op_ctx->export_perms;
+		seg->ctx.export_perms = &seg->export_perms;
+		seg->ctx.ctx_export = NULL;
+		seg->ctx.fsal_export = NULL;
+		seg->ctx.fsal_pnfs_ds = NULL;
+		seg->ctx.fsal_private = NULL;
+
+		PTHREAD_MUTEX_lock(&par.mtx);
+		par.pending++;
+		PTHREAD_MUTEX_unlock(&par.mtx);
+
+		rc = fridgethr_submit(compound_fridge, nfs4_segment_run, seg);
+		if (rc != 0) {
+			PTHREAD_MUTEX_lock(&par.mtx);
+			par.pending--;
+			PTHREAD_MUTEX_unlock(&par.mtx);
+
+			nfs4_segment_execute(seg);
+		}
+	}
+
+	/* The last segment runs here, so the ops after the run start from
+	 * its filehandle and export.
+	 */
+	for (i = starts[nsegs - 1]; i < end; i++) {
+		status = nfs4_process_op(data, argarray, resarray, i);
+		if (status != NFS4_OK) {
+			fail = i;
+			break;
+		}
+	}
+
+	PTHREAD_MUTEX_lock(&par.mtx);
+	while (par.pending != 0)
+		pthread_cond_wait(&par.cv, &par.mtx);
+	PTHREAD_MUTEX_unlock(&par.mtx);
+
+	for (j = 0; j < nsegs - 1; j++) {
+		seg = &segs[j];
+		mem_arena_splice(&data->arena, &seg->data.arena);
+
+		if (seg->status != NFS4_OK && seg->last < fail) {
+			fail = seg->last;
+			status = seg->status;
+		}
+	}
+
+	if (fail != end) {
+		/* Nothing after the failure would have run */
+		for (i = fail + 1; i < end; i++) {
+			if (resarray[i].resop == 0)
+				continue;
+			nfs4_Compound_FreeOne(&resarray[i]);
+			memset(&resarray[i], 0, sizeof(resarray[i]));
+		}
+		*last = fail;
+	} else {
+		*last = end - 1;
+	}
+
+	gsh_free(segs);
+	PTHREAD_COND_destroy(&par.cv);
+	PTHREAD_MUTEX_destroy(&par.mtx);
+
+	return status;
+}
+
 /**
  * @brief The NFS PROC4 COMPOUND
  *
@@ -479,16 +1042,15 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 {
 	unsigned int i = 0;
 	int status = NFS4_OK;
-	compound_data_t data;
+	compound_data_t cdata;
+	compound_data_t *data = &cdata;
 	nfs_opnum4 opcode;
 	const uint32_t compound4_minor = arg->arg_compound4.minorversion;
 	const uint32_t argarray_len = arg->arg_compound4.argarray.argarray_len;
 	/* Array of op arguments */
 	nfs_argop4 * const argarray = arg->arg_compound4.argarray.argarray_val;
 	nfs_resop4 *resarray;
-	nsecs_elapsed_t op_start_time;
-	struct timespec ts;
-	int perm_flags;
+	uint32_t run_end;
 	char *tagname = NULL;
 	char *notag = "NO TAG";
 
@@ -561,15 +1123,17 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	}
 
 	/* Initialisation of the compound request internal's data */
-	memset(&data, 0, sizeof(data));
+	memset(data, 0, sizeof(*data));
+	compound_data_init_fh(data);
 	op_ctx->nfs_minorvers = compound4_minor;
 
 	/* Minor version related stuff */
-	data.minorversion = compound4_minor;
-	data.req = req;
+	data->minorversion = compound4_minor;
+	data->req = req;
+	data->opcount = argarray_len;
 
 	/* Building the client credential field */
-	if (nfs_rpc_req2client_cred(req, &(data.credential)) == -1)
+	if (nfs_rpc_req2client_cred(req, &(data->credential)) == -1)
 		return NFS_REQ_DROP;	/* Malformed credential */
 
 	/* Keeping the same tag as in the arguments */
@@ -647,107 +1211,69 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	}
 
 	for (i = 0; i < argarray_len; i++) {
-		/* Used to check if OP_SEQUENCE is the first operation */
-		data.oppos = i;
+		run_end = 0;
+		if (compound_fridge != NULL)
+			run_end = nfs4_parallel_run_end(data, argarray,
+							argarray_len, i);
 
-		/* Verify BIND_CONN_TO_SESSION is not used in a compound
-		 * with length > 1.
-		 */
 		if (i > 0 &&
 		    argarray[i].argop == NFS4_OP_BIND_CONN_TO_SESSION) {
-			status = NFS4ERR_NOT_ONLY_OP;
-			goto bad_op_state;
-		}
-
-		/* time each op */
-		now(&ts);
-		op_start_time = timespec_diff(&ServerBootTime, &ts);
-		opcode = argarray[i].argop;
-
-		/* Handle opcode overflow */
-		if (opcode > LastOpcode[compound4_minor])
-			opcode = 0;
-
-		if (compound4_minor > 0 && data.session != NULL &&
-		    data.session->fore_channel_attrs.ca_maxoperations == i) {
-			status = NFS4ERR_TOO_MANY_OPS;
-			goto bad_op_state;
+			/* Verify BIND_CONN_TO_SESSION is not used in a
+			 * compound with length > 1.
+			 */
+			status = nfs4_op_refused(argarray, resarray, i,
+						 NFS4ERR_NOT_ONLY_OP);
+		} else if (compound4_minor > 0 && data->session != NULL &&
+			   data->session->fore_channel_attrs.ca_maxoperations
+			   == i) {
+			status = nfs4_op_refused(argarray, resarray, i,
+						 NFS4ERR_TOO_MANY_OPS);
+		} else if (run_end != 0) {
+			status = nfs4_compound_parallel(data, argarray,
+							resarray, i, run_end,
+							&i);
+		} else {
+			/* Only the last op may leave the compound suspended,
+			 * so that there is nothing left to run but its end.
+			 */
+			data->may_suspend = i == argarray_len - 1;
+			status = nfs4_process_op(data, argarray, resarray, i);
+			data->may_suspend = false;
 		}
 
-		LogDebug(COMPONENT_NFS_V4, "Request %d: opcode %d is %s", i,
-			 argarray[i].argop, optabv4[opcode].name);
-		perm_flags =
-		    optabv4[opcode].exp_perm_flags & EXPORT_OPTION_ACCESS_MASK;
-
-		if (perm_flags != 0) {
-			status = nfs4_Is_Fh_Empty(&data.currentFH);
-			if (status != NFS4_OK) {
-				LogDebug(COMPONENT_NFS_V4,
-					 "Status of %s for CurrentFH in position %d = %s",
-					 optabv4[opcode].name,
-					 i,
-					 nfsstat4_to_str(status));
-				goto bad_op_state;
-			}
+		if (data->async_pending) {
+			compound_data_t *moved = NULL;
+			int result;
 
-			/* Operation uses a CurrentFH, so we can check export
-			 * perms. Perms should even be set reasonably for pseudo
-			 * file system.
+			/* The data must outlive our stack, unless the I/O
+			 * is done already, which it stays.
 			 */
-			LogMidDebugAlt(COMPONENT_NFS_V4, COMPONENT_EXPORT,
-				       "Check export perms export = %08x req = %08x",
-				       op_ctx->export_perms->options &
-						EXPORT_OPTION_ACCESS_MASK,
-				       perm_flags);
-			if ((op_ctx->export_perms->options &
-			     perm_flags) != perm_flags) {
-				/* Export doesn't allow requested
-				 * access for this client.
-				 */
-				if ((perm_flags & EXPORT_OPTION_MODIFY_ACCESS)
-				    != 0)
-					status = NFS4ERR_ROFS;
-				else
-					status = NFS4ERR_ACCESS;
-
-				LogDebugAlt(COMPONENT_NFS_V4, COMPONENT_EXPORT,
-					    "Status of %s due to export permissions in position %d = %s",
-					    optabv4[opcode].name, i,
-					    nfsstat4_to_str(status));
- bad_op_state:
-				/* All the operation, like NFS4_OP_ACESS, have
-				 * a first replied field called .status
-				 */
-				resarray[i].nfs_resop4_u.opaccess.status =
-				    status;
-				resarray[i].resop = argarray[i].argop;
-
-				/* Do not manage the other requests in the
-				 * COMPOUND.
-				 */
-				res->res_compound4.resarray.resarray_len =
-					i + 1;
-				break;
+			if (!nfs_req_async_completed(req)) {
+				moved = gsh_malloc(sizeof(*moved));
+				compound_data_move(moved, data);
 			}
+			if (nfs_req_suspend(req, nfs4_compound_resume, moved,
+					    &result))
+				return NFS_REQ_ASYNC_WAIT;
+
+			/* Completed already, go on here */
+			gsh_free(moved);
+			data->async_pending = false;
+			opcode = argarray[i].argop;
+			if (opcode > LastOpcode[compound4_minor])
+				opcode = 0;
+			status = nfs4_op_done(data, resarray, i, opcode,
+					      data->op_start_time, result);
 		}
 
-		status = (optabv4[opcode].funct) (&argarray[i],
-						  &data,
-						  &resarray[i]);
-
-		LogCompoundFH(&data);
-
-		/* All the operation, like NFS4_OP_ACESS, have a first replyied
-		 * field called .status
-		 */
-		resarray[i].nfs_resop4_u.opaccess.status = status;
-
-		server_stats_nfsv4_op_done(opcode, op_start_time, status);
-
 		if (status != NFS4_OK) {
 			/* An error occured, we do not manage the other requests
 			 * in the COMPOUND, this may be a regular behavior
 			 */
+			opcode = argarray[i].argop;
+			if (opcode > LastOpcode[compound4_minor])
+				opcode = 0;
+
 			LogDebug(COMPONENT_NFS_V4,
 				 "Status of %s in position %d = %s",
 				 optabv4[opcode].name, i,
@@ -761,7 +1287,7 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		/* Check Req size */
 
 		/* NFS_V4.1 specific stuff */
-		if (data.use_drc) {
+		if (data->use_drc) {
 			/* Replay cache, only true for SEQUENCE or
 			 * CREATE_SESSION w/o SEQUENCE. Since will only be set
 			 * in those cases, no need to check operation or
@@ -771,62 +1297,21 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 			/* Free the reply allocated above */
 			gsh_free(res->res_compound4.resarray.resarray_val);
 
-			/* Copy the reply from the cache */
-			res->res_compound4_extended = *data.cached_res;
-			status = ((COMPOUND4res *) data.cached_res)->status;
+			/* Send the cached reply, holding it until sent */
+			res->res_compound4_extended = data->replay->res;
+			res->res_compound4_extended.res_cached = true;
+			res->res_compound4_extended.res_reply = data->replay;
+			data->replay = NULL;
+			status = res->res_compound4.status;
 			LogFullDebug(COMPONENT_SESSIONS,
 				     "Use session replay cache %p result %s",
-				     data.cached_res, nfsstat4_to_str(status));
+				     res->res_compound4_extended.res_reply,
+				     nfsstat4_to_str(status));
 			break;	/* Exit the for loop */
 		}
 	}			/* for */
 
-	server_stats_compound_done(argarray_len, status);
-
-	/* Complete the reply, in particular, tell where you stopped if
-	 * unsuccessfull COMPOUD
-	 */
-	res->res_compound4.status = status;
-
-	/* Manage session's DRC: keep NFS4.1 replay for later use, but don't
-	 * save a replayed result again.
-	 */
-	if (data.cached_res != NULL && !data.use_drc) {
-		/* Pointer has been set by nfs4_op_sequence and points to slot
-		 * to cache result in.
-		 */
-		LogFullDebug(COMPONENT_SESSIONS,
-			     "Save result in session replay cache %p sizeof nfs_res_t=%d",
-			     data.cached_res, (int)sizeof(nfs_res_t));
-
-		/* Indicate to nfs4_Compound_Free that this reply is cached. */
-		res->res_compound4_extended.res_cached = true;
-
-		/* If the cache is already in use, free it. */
-		if (data.cached_res->res_cached) {
-			data.cached_res->res_cached = false;
-			nfs4_Compound_Free((nfs_res_t *) data.cached_res);
-		}
-
-		/* Save the result in the cache. */
-		*data.cached_res = res->res_compound4_extended;
-	}
-
-	/* If we have reserved a lease, update it and release it */
-	if (data.preserved_clientid != NULL) {
-		/* Update and release lease */
-		PTHREAD_MUTEX_lock(&data.preserved_clientid->cid_mutex);
-
-		update_lease(data.preserved_clientid);
-
-		PTHREAD_MUTEX_unlock(&data.preserved_clientid->cid_mutex);
-	}
-
-	if (status != NFS4_OK)
-		LogDebug(COMPONENT_NFS_V4, "End status = %s lastindex = %d",
-			 nfsstat4_to_str(status), i);
-
-	compound_data_Free(&data);
+	nfs4_compound_finish(data, res, argarray_len, status, i);
 
 	return NFS_REQ_OK;
 }				/* nfs4_Compound */
@@ -871,6 +1356,8 @@ void nfs4_Compound_Free(nfs_res_t *res)
 		LogFullDebug(component,
 			     "Skipping free of NFS4 result %p",
 			     res);
+		if (res->res_compound4_extended.res_reply != NULL)
+			nfs41_put_reply(res->res_compound4_extended.res_reply);
 		return;
 	}
 
@@ -892,6 +1379,8 @@ void nfs4_Compound_Free(nfs_res_t *res)
 
 	gsh_free(res->res_compound4.resarray.resarray_val);
 
+	mem_arena_release(&res->res_compound4_extended.res_arena);
+
 	if (res->res_compound4.tag.utf8string_val)
 		gsh_free(res->res_compound4.tag.utf8string_val);
 }
@@ -943,13 +1432,6 @@ void compound_data_Free(compound_data_t *data)
 		put_gsh_export(data->saved_export);
 		data->saved_export = NULL;
 	}
-
-	if (data->currentFH.nfs_fh4_val != NULL)
-		gsh_free(data->currentFH.nfs_fh4_val);
-
-	if (data->savedFH.nfs_fh4_val != NULL)
-		gsh_free(data->savedFH.nfs_fh4_val);
-
 }				/* compound_data_Free */
 
 /**
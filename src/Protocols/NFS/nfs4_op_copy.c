@@ -0,0 +1,886 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file nfs4_op_copy.c
+ * @brief NFSv4.2 COPY, CLONE, OFFLOAD_STATUS and OFFLOAD_CANCEL
+ *
+ * See @ref CopyOffload.
+ */
+
+/**
+ * @page CopyOffload Server side copy
+ *
+ * COPY and CLONE take the source from the saved filehandle and the
+ * destination from the current one, which must be in the same export,
+ * and pass both to the FSAL's copy and clone methods, so the data are
+ * copied inside the filesystem rather than read by the client and
+ * written back.  Only intra-server copies are done; a COPY naming a
+ * source server gets NFS4ERR_NOTSUPP.
+ *
+ * A synchronous COPY copies at most OFFLOAD_CHUNK bytes and reports
+ * how many, leaving the client to ask for the rest.  A client asking
+ * for an asynchronous copy of more than that, with open stateids and a
+ * back channel, gets a copy stateid back at once.  The copy then runs
+ * in the offload fridge, a chunk at a time, for OFFLOAD_STATUS to
+ * report on and OFFLOAD_CANCEL to stop between chunks, and ends with a
+ * CB_OFFLOAD to the client.  Finished copies are forgotten once the
+ * CB_OFFLOAD is answered.
+ *
+ * The data written are unstable, as for WRITE, and the client COMMITs
+ * them.
+ */
+
+#include "config.h"
+#include "log.h"
+#include "fsal.h"
+#include "nfs_core.h"
+#include "sal_functions.h"
+#include "nfs_proto_functions.h"
+#include "nfs_proto_tools.h"
+#include "nfs_convert.h"
+#include "nfs_rpc_callback.h"
+#include "export_mgr.h"
+#include "server_stats.h"
+#include "fridgethr.h"
+
+#define OFFLOAD_CHUNK (64 * 1024 * 1024)
+#define OFFLOAD_THREADS 16
+
+/**
+ * @brief An asynchronous copy
+ */
+struct nfs4_offload {
+	struct glist_head list;		/*< On offload_list */
+	stateid4 stateid;		/*< The copy stateid */
+	nfs_client_id_t *clientid;	/*< Client that asked for it */
+	struct gsh_export *export;
+	struct fsal_obj_handle *src;
+	struct fsal_obj_handle *dst;
+	state_t *src_state;
+	state_t *dst_state;
+	nfs_fh4 dst_fh;			/*< For CB_OFFLOAD */
+	uint64_t src_offset;
+	uint64_t dst_offset;
+	uint64_t count;
+	uint64_t copied;		/*< Under offload_mutex */
+	nfsstat4 status;		/*< Of the finished copy */
+	bool done;			/*< Copy finished, CB_OFFLOAD due */
+	bool cancelled;			/*< OFFLOAD_CANCEL seen */
+	struct user_cred creds;
+	struct export_perms export_perms;
+	nfs_cb_argop4 arg;		/*< CB_OFFLOAD */
+};
+
+static pthread_mutex_t offload_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct glist_head offload_list = GLIST_HEAD_INIT(offload_list);
+static struct fridgethr *offload_fridge;
+
+/**
+ * @brief Start the fridge asynchronous copies run on
+ *
+ * @return 0 or an error from fridgethr_init.
+ */
+int nfs4_offload_fridge_init(void)
+{
+	struct fridgethr_params frp;
+	int rc;
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = OFFLOAD_THREADS;
+	frp.thr_min = 0;
+	frp.flavor = fridgethr_flavor_worker;
+	frp.deferment = fridgethr_defer_queue;
+
+	rc = fridgethr_init(&offload_fridge, "Offload", &frp);
+	if (rc != 0)
+		LogMajor(COMPONENT_NFS_V4,
+			 "Unable to initialize offload fridge, error code %d.",
+			 rc);
+
+	return rc;
+}
+
+/**
+ * @brief Check a COPY or CLONE stateid and start any anonymous I/O
+ *
+ * @param[in]  data       Compound request's data
+ * @param[in]  obj        File the stateid is for
+ * @param[in]  stateid    The stateid
+ * @param[in]  access     OPEN4_SHARE_ACCESS_READ or _WRITE
+ * @param[out] state      The state, with a reference, or NULL for a
+ *                        special stateid
+ * @param[in]  tag        Operation name for log messages
+ *
+ * @return NFS4_OK or an error.
+ */
+static nfsstat4 nfs4_copy_check_state(compound_data_t *data,
+				      struct fsal_obj_handle *obj,
+				      stateid4 *stateid,
+				      uint32_t access,
+				      state_t **state,
+				      const char *tag)
+{
+	struct state_deleg *sdeleg;
+	state_t *state_found = NULL;
+	state_t *state_open;
+	nfsstat4 status;
+
+	*state = NULL;
+
+	status = nfs4_Check_Stateid(stateid, obj, &state_found, data,
+				    STATEID_SPECIAL_ANY, 0, false, tag);
+	if (status != NFS4_OK)
+		return status;
+
+	if (state_found == NULL) {
+		/* Special stateid, check for share conflicts */
+		return nfs4_Errno_state(state_share_anonymous_io_start(
+					obj, access, SHARE_BYPASS_NONE));
+	}
+
+	switch (state_found->state_type) {
+	case STATE_TYPE_SHARE:
+		state_open = state_found;
+		break;
+
+	case STATE_TYPE_LOCK:
+		state_open = state_found->state_data.lock.openstate;
+		break;
+
+	case STATE_TYPE_DELEG:
+		sdeleg = &state_found->state_data.deleg;
+		if (sdeleg->sd_state != DELEG_GRANTED ||
+		    (access == OPEN4_SHARE_ACCESS_WRITE &&
+		     !(sdeleg->sd_type & OPEN_DELEGATE_WRITE))) {
+			LogDebug(COMPONENT_STATE,
+				 "%s with delegation type:%d state:%d", tag,
+				 sdeleg->sd_type, sdeleg->sd_state);
+			status = NFS4ERR_BAD_STATEID;
+			goto out;
+		}
+		state_open = NULL;
+		break;
+
+	default:
+		LogDebug(COMPONENT_NFS_V4_LOCK,
+			 "%s with invalid stateid of type %d", tag,
+			 (int)state_found->state_type);
+		status = NFS4ERR_BAD_STATEID;
+		goto out;
+	}
+
+	if (state_open != NULL &&
+	    (state_open->state_data.share.share_access & access) == 0) {
+		LogDebug(COMPONENT_NFS_V4_LOCK,
+			 "%s stateid without share access %"PRIu32,
+			 tag, access);
+		status = NFS4ERR_OPENMODE;
+		goto out;
+	}
+
+	*state = state_found;
+	return NFS4_OK;
+
+ out:
+
+	dec_state_t_ref(state_found);
+	return status;
+}
+
+/**
+ * @brief Put back what nfs4_copy_check_state took
+ */
+static void nfs4_copy_release_state(struct fsal_obj_handle *obj,
+				    state_t *state, uint32_t access)
+{
+	if (state != NULL)
+		dec_state_t_ref(state);
+	else
+		state_share_anonymous_io_done(obj, access);
+}
+
+/**
+ * @brief Check the files and ranges of a COPY or CLONE
+ *
+ * The source is the saved filehandle and the destination the current
+ * one.  A count of 0 means to the end of the source, and is replaced
+ * with the length that is.
+ *
+ * @param[in]     data        Compound request's data
+ * @param[in]     src_offset  Position to copy from
+ * @param[in]     dst_offset  Position to copy to
+ * @param[in,out] count       Number of bytes to copy
+ *
+ * @return NFS4_OK or an error.
+ */
+static nfsstat4 nfs4_copy_check_range(compound_data_t *data,
+				      uint64_t src_offset,
+				      uint64_t dst_offset,
+				      uint64_t *count)
+{
+	struct fsal_obj_handle *src = data->saved_obj;
+	struct fsal_obj_handle *dst = data->current_obj;
+	uint64_t MaxOffsetWrite =
+		atomic_fetch_uint64_t(&op_ctx->ctx_export->MaxOffsetWrite);
+	struct attrlist attrs;
+	fsal_status_t fsal_status;
+	uint64_t size;
+	nfsstat4 status;
+
+	status = nfs4_sanity_check_saved_FH(data, REGULAR_FILE, false);
+	if (status != NFS4_OK)
+		return status;
+
+	status = nfs4_sanity_check_FH(data, REGULAR_FILE, false);
+	if (status != NFS4_OK)
+		return status;
+
+	if (data->saved_export != op_ctx->ctx_export)
+		return NFS4ERR_XDEV;
+
+	if (!dst->fsal->m_ops.support_ex(dst))
+		return NFS4ERR_NOTSUPP;
+
+	fsal_prepare_attrs(&attrs, ATTR_SIZE);
+
+	fsal_status = src->obj_ops.getattrs(src, &attrs);
+	size = attrs.filesize;
+
+	fsal_release_attrs(&attrs);
+
+	if (FSAL_IS_ERROR(fsal_status))
+		return nfs4_Errno_status(fsal_status);
+
+	if (src_offset > size)
+		return NFS4ERR_INVAL;
+
+	if (*count == 0)
+		*count = size - src_offset;
+	else if (*count > size - src_offset)
+		return NFS4ERR_INVAL;
+
+	if (src == dst && src_offset < dst_offset + *count &&
+	    dst_offset < src_offset + *count)
+		return NFS4ERR_INVAL;
+
+	if (dst_offset + *count < dst_offset ||
+	    dst_offset + *count > MaxOffsetWrite)
+		return NFS4ERR_FBIG;
+
+	fsal_status = src->obj_ops.test_access(src, FSAL_READ_ACCESS,
+					       NULL, NULL, true);
+	if (FSAL_IS_ERROR(fsal_status))
+		return nfs4_Errno_status(fsal_status);
+
+	fsal_status = dst->obj_ops.test_access(dst, FSAL_WRITE_ACCESS,
+					       NULL, NULL, true);
+	if (FSAL_IS_ERROR(fsal_status))
+		return nfs4_Errno_status(fsal_status);
+
+	return NFS4_OK;
+}
+
+/**
+ * @brief Fill in a write_response4 for a copy
+ */
+static void nfs4_copy_response(write_response4 *wr, uint64_t copied)
+{
+	struct gsh_buffdesc verf_desc;
+
+	wr->wr_count = copied;
+	wr->wr_committed = UNSTABLE4;
+
+	verf_desc.addr = wr->wr_writeverf;
+	verf_desc.len = sizeof(verifier4);
+	op_ctx->fsal_export->exp_ops.get_write_verifier(op_ctx->fsal_export,
+							&verf_desc);
+}
+
+/**
+ * @brief Free an asynchronous copy
+ *
+ * The files, states and export have been put back by now.
+ */
+static void nfs4_offload_free(struct nfs4_offload *off)
+{
+	PTHREAD_MUTEX_lock(&offload_mutex);
+	glist_del(&off->list);
+	PTHREAD_MUTEX_unlock(&offload_mutex);
+
+	dec_client_id_ref(off->clientid);
+	gsh_free(off->dst_fh.nfs_fh4_val);
+	gsh_free(off->creds.caller_garray);
+	gsh_free(off);
+}
+
+/**
+ * @brief Handle the client's answer to CB_OFFLOAD
+ *
+ * @param[in] call  The RPC call being completed
+ * @param[in] hook  The hook itself
+ * @param[in] arg   The copy
+ * @param[in] flags There are no flags.
+ *
+ * @return 0, constantly.
+ */
+static int32_t nfs4_offload_cb_done(rpc_call_t *call, rpc_call_hook hook,
+				    void *arg, uint32_t flags)
+{
+	LogFullDebug(COMPONENT_NFS_CB, "status %d arg %p",
+		     call->cbt.v_u.v4.res.status, arg);
+	nfs41_complete_single(call, hook, arg, flags);
+	nfs4_offload_free(arg);
+	return 0;
+}
+
+/**
+ * @brief Tell the client an asynchronous copy is over
+ */
+static void nfs4_offload_notify(struct nfs4_offload *off)
+{
+	CB_OFFLOAD4args *cb_offload = &off->arg.nfs_cb_argop4_u.opcboffload;
+	offload_info4 *info = &cb_offload->coa_offload_info;
+	int code;
+
+	off->arg.argop = NFS4_OP_CB_OFFLOAD;
+	cb_offload->coa_fh = off->dst_fh;
+	cb_offload->coa_stateid = off->stateid;
+	info->coa_status = off->status;
+
+	if (off->status == NFS4_OK)
+		info->coa_resok4.wr_ids = 0;
+	else
+		info->coa_bytes_copied = off->copied;
+
+	code = nfs_rpc_v41_single(off->clientid, &off->arg, NULL,
+				  nfs4_offload_cb_done, off, NULL);
+	if (code != 0) {
+		LogDebug(COMPONENT_NFS_CB,
+			 "Could not send CB_OFFLOAD, error %d", code);
+		nfs4_offload_free(off);
+	}
+}
+
+/**
+ * @brief Run an asynchronous copy
+ *
+ * @param[in] ctx  Thread context, the copy is its argument
+ */
+static void nfs4_offload_run(struct fridgethr_context *ctx)
+{
+	struct nfs4_offload *off = ctx->arg;
+	struct root_op_context root_op_context;
+	fsal_status_t fsal_status = { ERR_FSAL_NO_ERROR, 0 };
+	uint64_t copied = 0, chunk, n;
+	bool cancelled = false;
+
+	init_root_op_context(&root_op_context, off->export,
+			     off->export->fsal_export, NFS_V4, 2,
+			     NFS_REQUEST);
+	root_op_context.creds = off->creds;
+	root_op_context.export_perms = off->export_perms;
+
+	while (copied < off->count) {
+		PTHREAD_MUTEX_lock(&offload_mutex);
+		cancelled = off->cancelled;
+		PTHREAD_MUTEX_unlock(&offload_mutex);
+
+		if (cancelled)
+			break;
+
+		chunk = off->count - copied;
+		if (chunk > OFFLOAD_CHUNK)
+			chunk = OFFLOAD_CHUNK;
+
+		fsal_status = off->src->obj_ops.copy(
+			off->src, off->src_state, off->src_offset + copied,
+			off->dst, off->dst_state, off->dst_offset + copied,
+			chunk, &n);
+
+		if (FSAL_IS_ERROR(fsal_status) || n == 0)
+			break;
+
+		copied += n;
+
+		PTHREAD_MUTEX_lock(&offload_mutex);
+		off->copied = copied;
+		PTHREAD_MUTEX_unlock(&offload_mutex);
+	}
+
+	if (FSAL_IS_ERROR(fsal_status)) {
+		LogDebug(COMPONENT_NFS_V4, "copy returned %s",
+			 fsal_err_txt(fsal_status));
+		off->status = nfs4_Errno_status(fsal_status);
+	} else {
+		off->status = NFS4_OK;
+		nfs4_copy_response(&off->arg.nfs_cb_argop4_u.opcboffload
+				   .coa_offload_info.coa_resok4, copied);
+	}
+
+	server_stats_io_done(off->count, copied, off->status == NFS4_OK,
+			     true);
+
+	dec_state_t_ref(off->src_state);
+	dec_state_t_ref(off->dst_state);
+	off->src->obj_ops.put_ref(off->src);
+	off->dst->obj_ops.put_ref(off->dst);
+	put_gsh_export(off->export);
+
+	release_root_op_context();
+
+	PTHREAD_MUTEX_lock(&offload_mutex);
+	off->done = true;
+	cancelled = off->cancelled;
+	PTHREAD_MUTEX_unlock(&offload_mutex);
+
+	if (cancelled)
+		nfs4_offload_free(off);
+	else
+		nfs4_offload_notify(off);
+}
+
+/**
+ * @brief Start an asynchronous copy
+ *
+ * Takes over the references on the states.
+ *
+ * @return NFS4_OK or NFS4ERR_DELAY if it could not be queued.
+ */
+static nfsstat4 nfs4_offload_start(compound_data_t *data,
+				   COPY4args *arg_COPY,
+				   state_t *src_state, state_t *dst_state,
+				   uint64_t count, stateid4 *stateid)
+{
+	struct nfs4_offload *off = gsh_calloc(1, sizeof(*off));
+	nfs_client_id_t *clientid = data->session->clientid_record;
+	int rc;
+
+	inc_client_id_ref(clientid);
+	off->clientid = clientid;
+	off->stateid.seqid = 1;
+	nfs4_BuildStateId_Other(clientid, off->stateid.other);
+
+	get_gsh_export_ref(op_ctx->ctx_export);
+	off->export = op_ctx->ctx_export;
+	off->src = data->saved_obj;
+	off->src->obj_ops.get_ref(off->src);
+	off->dst = data->current_obj;
+	off->dst->obj_ops.get_ref(off->dst);
+	off->src_state = src_state;
+	off->dst_state = dst_state;
+
+	off->dst_fh.nfs_fh4_len = data->currentFH.nfs_fh4_len;
+	off->dst_fh.nfs_fh4_val = gsh_malloc(data->currentFH.nfs_fh4_len);
+	memcpy(off->dst_fh.nfs_fh4_val, data->currentFH.nfs_fh4_val,
+	       data->currentFH.nfs_fh4_len);
+
+	off->src_offset = arg_COPY->ca_src_offset;
+	off->dst_offset = arg_COPY->ca_dst_offset;
+	off->count = count;
+
+	off->creds = *op_ctx->creds;
+	off->creds.caller_garray = NULL;
+	if (off->creds.caller_glen != 0) {
+		off->creds.caller_garray =
+			gsh_malloc(off->creds.caller_glen * sizeof(gid_t));
+		memcpy(off->creds.caller_garray,
+		       op_ctx->creds->caller_garray,
+		       off->creds.caller_glen * sizeof(gid_t));
+	}
+	off->export_perms = *op_ctx->export_perms;
+
+	PTHREAD_MUTEX_lock(&offload_mutex);
+	glist_add_tail(&offload_list, &off->list);
+	PTHREAD_MUTEX_unlock(&offload_mutex);
+
+	*stateid = off->stateid;
+
+	rc = fridgethr_submit(offload_fridge, nfs4_offload_run, off);
+	if (rc != 0) {
+		LogDebug(COMPONENT_NFS_V4,
+			 "Could not queue copy, error %d", rc);
+		put_gsh_export(off->export);
+		off->src->obj_ops.put_ref(off->src);
+		off->dst->obj_ops.put_ref(off->dst);
+		/* The caller still holds the states */
+		nfs4_offload_free(off);
+		return NFS4ERR_DELAY;
+	}
+
+	return NFS4_OK;
+}
+
+/**
+ * @brief Find an asynchronous copy by its stateid
+ *
+ * Called with offload_mutex held.
+ */
+static struct nfs4_offload *nfs4_offload_lookup(compound_data_t *data,
+						stateid4 *stateid)
+{
+	struct glist_head *glist;
+	struct nfs4_offload *off;
+
+	if (data->session == NULL)
+		return NULL;
+
+	glist_for_each(glist, &offload_list) {
+		off = glist_entry(glist, struct nfs4_offload, list);
+
+		if (off->clientid == data->session->clientid_record &&
+		    memcmp(off->stateid.other, stateid->other,
+			   sizeof(stateid->other)) == 0)
+			return off;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief The NFS4_OP_COPY operation
+ *
+ * This functions handles the NFS4_OP_COPY operation in NFSv4.2. This
+ * function can be called only from nfs4_Compound.
+ *
+ * @param[in]     op    Arguments for nfs4_op
+ * @param[in,out] data  Compound request's data
+ * @param[out]    resp  Results for nfs4_op
+ *
+ * @return per RFC7862
+ */
+int nfs4_op_copy(struct nfs_argop4 *op, compound_data_t *data,
+		 struct nfs_resop4 *resp)
+{
+	COPY4args * const arg_COPY = &op->nfs_argop4_u.opcopy;
+	COPY4res * const res_COPY = &resp->nfs_resop4_u.opcopy;
+	COPY4resok *resok = &res_COPY->COPY4res_u.cr_resok4;
+	struct fsal_obj_handle *src, *dst;
+	state_t *src_state = NULL, *dst_state = NULL;
+	fsal_status_t fsal_status = { ERR_FSAL_NO_ERROR, 0 };
+	uint64_t count = arg_COPY->ca_count;
+	uint64_t copied = 0, n;
+	bool dst_started = false;
+
+	resp->resop = NFS4_OP_COPY;
+
+	if (data->minorversion < 2) {
+		res_COPY->cr_status = NFS4ERR_NOTSUPP;
+		return res_COPY->cr_status;
+	}
+
+	if (arg_COPY->ca_source_server.ca_source_server_len != 0) {
+		/* Inter-server copy */
+		res_COPY->cr_status = NFS4ERR_NOTSUPP;
+		return res_COPY->cr_status;
+	}
+
+	res_COPY->cr_status = nfs4_copy_check_range(data,
+						    arg_COPY->ca_src_offset,
+						    arg_COPY->ca_dst_offset,
+						    &count);
+	if (res_COPY->cr_status != NFS4_OK)
+		return res_COPY->cr_status;
+
+	src = data->saved_obj;
+	dst = data->current_obj;
+
+	res_COPY->cr_status = nfs4_copy_check_state(data, src,
+						    &arg_COPY->ca_src_stateid,
+						    OPEN4_SHARE_ACCESS_READ,
+						    &src_state, "COPY");
+	if (res_COPY->cr_status != NFS4_OK)
+		return res_COPY->cr_status;
+
+	res_COPY->cr_status = nfs4_copy_check_state(data, dst,
+						    &arg_COPY->ca_dst_stateid,
+						    OPEN4_SHARE_ACCESS_WRITE,
+						    &dst_state, "COPY");
+	if (res_COPY->cr_status != NFS4_OK)
+		goto out;
+
+	dst_started = true;
+
+	resok->cr_requirements.cr_consecutive = true;
+	resok->cr_response.wr_ids = 0;
+
+	/* An anonymous copy can not outlive the request, and one that fits
+	 * in a chunk is done as soon as queued.
+	 */
+	if (!arg_COPY->ca_synchronous && count > OFFLOAD_CHUNK &&
+	    src_state != NULL && dst_state != NULL &&
+	    data->session != NULL &&
+	    (data->session->flags & session_bc_up) &&
+	    nfs4_offload_start(data, arg_COPY, src_state, dst_state, count,
+			       &resok->cr_response.wr_callback_id) ==
+	    NFS4_OK) {
+		/* The copy holds the states now */
+		resok->cr_response.wr_ids = 1;
+		resok->cr_requirements.cr_synchronous = false;
+		nfs4_copy_response(&resok->cr_response, 0);
+		return res_COPY->cr_status;
+	}
+
+	/* Synchronous, so keep it to what a request can wait for */
+	if (count > OFFLOAD_CHUNK)
+		count = OFFLOAD_CHUNK;
+
+	while (copied < count) {
+		fsal_status = src->obj_ops.copy(
+				src, src_state,
+				arg_COPY->ca_src_offset + copied,
+				dst, dst_state,
+				arg_COPY->ca_dst_offset + copied,
+				count - copied, &n);
+
+		if (FSAL_IS_ERROR(fsal_status) || n == 0)
+			break;
+
+		copied += n;
+	}
+
+	/* An error after some data were copied is reported as a short
+	 * copy.
+	 */
+	if (FSAL_IS_ERROR(fsal_status) && copied == 0) {
+		LogDebug(COMPONENT_NFS_V4, "copy returned %s",
+			 fsal_err_txt(fsal_status));
+		res_COPY->cr_status = nfs4_Errno_status(fsal_status);
+	} else {
+		resok->cr_requirements.cr_synchronous = true;
+		nfs4_copy_response(&resok->cr_response, copied);
+	}
+
+	server_stats_io_done(count, copied, res_COPY->cr_status == NFS4_OK,
+			     true);
+
+ out:
+
+	if (dst_started)
+		nfs4_copy_release_state(dst, dst_state,
+					OPEN4_SHARE_ACCESS_WRITE);
+
+	nfs4_copy_release_state(src, src_state, OPEN4_SHARE_ACCESS_READ);
+
+	return res_COPY->cr_status;
+}
+
+/**
+ * @brief Free memory allocated for COPY result
+ *
+ * @param[in,out] resp nfs4_op results
+ */
+void nfs4_op_copy_Free(nfs_resop4 *resp)
+{
+	/* Nothing to be done */
+}
+
+/**
+ * @brief The NFS4_OP_CLONE operation
+ *
+ * This functions handles the NFS4_OP_CLONE operation in NFSv4.2. This
+ * function can be called only from nfs4_Compound.
+ *
+ * @param[in]     op    Arguments for nfs4_op
+ * @param[in,out] data  Compound request's data
+ * @param[out]    resp  Results for nfs4_op
+ *
+ * @return per RFC7862
+ */
+int nfs4_op_clone(struct nfs_argop4 *op, compound_data_t *data,
+		  struct nfs_resop4 *resp)
+{
+	CLONE4args * const arg_CLONE = &op->nfs_argop4_u.opclone;
+	CLONE4res * const res_CLONE = &resp->nfs_resop4_u.opclone;
+	struct fsal_obj_handle *src, *dst;
+	state_t *src_state = NULL, *dst_state = NULL;
+	fsal_status_t fsal_status;
+	uint64_t count = arg_CLONE->cl_count;
+
+	resp->resop = NFS4_OP_CLONE;
+
+	if (data->minorversion < 2) {
+		res_CLONE->cl_status = NFS4ERR_NOTSUPP;
+		return res_CLONE->cl_status;
+	}
+
+	res_CLONE->cl_status = nfs4_copy_check_range(data,
+						     arg_CLONE->cl_src_offset,
+						     arg_CLONE->cl_dst_offset,
+						     &count);
+	if (res_CLONE->cl_status != NFS4_OK)
+		return res_CLONE->cl_status;
+
+	src = data->saved_obj;
+	dst = data->current_obj;
+
+	res_CLONE->cl_status = nfs4_copy_check_state(
+					data, src, &arg_CLONE->cl_src_stateid,
+					OPEN4_SHARE_ACCESS_READ, &src_state,
+					"CLONE");
+	if (res_CLONE->cl_status != NFS4_OK)
+		return res_CLONE->cl_status;
+
+	res_CLONE->cl_status = nfs4_copy_check_state(
+					data, dst, &arg_CLONE->cl_dst_stateid,
+					OPEN4_SHARE_ACCESS_WRITE, &dst_state,
+					"CLONE");
+	if (res_CLONE->cl_status != NFS4_OK)
+		goto out;
+
+	fsal_status = src->obj_ops.clone(src, src_state,
+					 arg_CLONE->cl_src_offset,
+					 dst, dst_state,
+					 arg_CLONE->cl_dst_offset, count);
+
+	if (FSAL_IS_ERROR(fsal_status)) {
+		LogDebug(COMPONENT_NFS_V4, "clone returned %s",
+			 fsal_err_txt(fsal_status));
+		res_CLONE->cl_status = nfs4_Errno_status(fsal_status);
+	}
+
+	nfs4_copy_release_state(dst, dst_state, OPEN4_SHARE_ACCESS_WRITE);
+
+ out:
+
+	nfs4_copy_release_state(src, src_state, OPEN4_SHARE_ACCESS_READ);
+
+	return res_CLONE->cl_status;
+}
+
+/**
+ * @brief Free memory allocated for CLONE result
+ *
+ * @param[in,out] resp nfs4_op results
+ */
+void nfs4_op_clone_Free(nfs_resop4 *resp)
+{
+	/* Nothing to be done */
+}
+
+/**
+ * @brief The NFS4_OP_OFFLOAD_STATUS operation
+ *
+ * @param[in]     op    Arguments for nfs4_op
+ * @param[in,out] data  Compound request's data
+ * @param[out]    resp  Results for nfs4_op
+ *
+ * @return per RFC7862
+ */
+int nfs4_op_offload_status(struct nfs_argop4 *op, compound_data_t *data,
+			   struct nfs_resop4 *resp)
+{
+	OFFLOAD_STATUS4args * const arg_STATUS =
+		&op->nfs_argop4_u.opoffload_status;
+	OFFLOAD_STATUS4res * const res_STATUS =
+		&resp->nfs_resop4_u.opoffload_status;
+	OFFLOAD_STATUS4resok *resok =
+		&res_STATUS->OFFLOAD_STATUS4res_u.osr_resok4;
+	struct nfs4_offload *off;
+
+	resp->resop = NFS4_OP_OFFLOAD_STATUS;
+
+	if (data->minorversion < 2) {
+		res_STATUS->osr_status = NFS4ERR_NOTSUPP;
+		return res_STATUS->osr_status;
+	}
+
+	PTHREAD_MUTEX_lock(&offload_mutex);
+
+	off = nfs4_offload_lookup(data, &arg_STATUS->osa_stateid);
+	if (off == NULL || off->cancelled) {
+		res_STATUS->osr_status = NFS4ERR_BAD_STATEID;
+	} else {
+		res_STATUS->osr_status = NFS4_OK;
+		resok->osr_bytes_copied = off->copied;
+		resok->osr_count_complete = off->done ? 1 : 0;
+		resok->osr_complete = off->status;
+	}
+
+	PTHREAD_MUTEX_unlock(&offload_mutex);
+
+	return res_STATUS->osr_status;
+}
+
+/**
+ * @brief Free memory allocated for OFFLOAD_STATUS result
+ *
+ * @param[in,out] resp nfs4_op results
+ */
+void nfs4_op_offload_status_Free(nfs_resop4 *resp)
+{
+	/* Nothing to be done */
+}
+
+/**
+ * @brief The NFS4_OP_OFFLOAD_CANCEL operation
+ *
+ * The copy stops at the end of the chunk it is copying, and no
+ * CB_OFFLOAD is sent for it.
+ *
+ * @param[in]     op    Arguments for nfs4_op
+ * @param[in,out] data  Compound request's data
+ * @param[out]    resp  Results for nfs4_op
+ *
+ * @return per RFC7862
+ */
+int nfs4_op_offload_cancel(struct nfs_argop4 *op, compound_data_t *data,
+			   struct nfs_resop4 *resp)
+{
+	OFFLOAD_CANCEL4args * const arg_CANCEL =
+		&op->nfs_argop4_u.opoffload_cancel;
+	OFFLOAD_CANCEL4res * const res_CANCEL =
+		&resp->nfs_resop4_u.opoffload_cancel;
+	struct nfs4_offload *off;
+
+	resp->resop = NFS4_OP_OFFLOAD_CANCEL;
+
+	if (data->minorversion < 2) {
+		res_CANCEL->ocr_status = NFS4ERR_NOTSUPP;
+		return res_CANCEL->ocr_status;
+	}
+
+	PTHREAD_MUTEX_lock(&offload_mutex);
+
+	off = nfs4_offload_lookup(data, &arg_CANCEL->oca_stateid);
+	if (off == NULL || off->cancelled) {
+		res_CANCEL->ocr_status = NFS4ERR_BAD_STATEID;
+	} else if (off->done) {
+		res_CANCEL->ocr_status = NFS4ERR_COMPLETE_ALREADY;
+	} else {
+		off->cancelled = true;
+		res_CANCEL->ocr_status = NFS4_OK;
+	}
+
+	PTHREAD_MUTEX_unlock(&offload_mutex);
+
+	return res_CANCEL->ocr_status;
+}
+
+/**
+ * @brief Free memory allocated for OFFLOAD_CANCEL result
+ *
+ * @param[in,out] resp nfs4_op results
+ */
+void nfs4_op_offload_cancel_Free(nfs_resop4 *resp)
+{
+	/* Nothing to be done */
+}
@@ -194,12 +194,17 @@ int nfs4_op_create_session(struct nfs_argop4 *op, compound_data_t *data,
 		/* Special case : the request is used without use of
 		 * OP_SEQUENCE
 		 */
-		if ((arg_CREATE_SESSION4->csa_sequence + 1 ==
-		     found->cid_create_session_sequence)
-		    && (found->cid_create_session_slot.cache_used)) {
+		nfs41_session_slot_t *cs_slot = &found->cid_create_session_slot;
+
+		if (arg_CREATE_SESSION4->csa_sequence + 1 ==
+		    found->cid_create_session_sequence) {
+			PTHREAD_MUTEX_lock(&cs_slot->lock);
+			data->replay = nfs41_slot_get_reply(cs_slot);
+			PTHREAD_MUTEX_unlock(&cs_slot->lock);
+		}
+
+		if (data->replay != NULL) {
 			data->use_drc = true;
-			data->cached_res =
-			    &found->cid_create_session_slot.cached_result;
 
 			res_CREATE_SESSION4->csr_status = NFS4_OK;
 
@@ -207,7 +212,7 @@ int nfs4_op_create_session(struct nfs_argop4 *op, compound_data_t *data,
 
 			LogDebug(component,
 				 "CREATE_SESSION replay=%p special case",
-				 data->cached_res);
+				 data->replay);
 
 			goto out;
 		} else if (arg_CREATE_SESSION4->csa_sequence !=
@@ -323,9 +328,7 @@ int nfs4_op_create_session(struct nfs_argop4 *op, compound_data_t *data,
 	nfs41_session->flags = false;
 	nfs41_session->cb_program = 0;
 	PTHREAD_MUTEX_init(&nfs41_session->cb_mutex, NULL);
-	PTHREAD_COND_init(&nfs41_session->cb_cond, NULL);
-	for (i = 0; i < NFS41_NB_SLOTS; i++)
-		PTHREAD_MUTEX_init(&nfs41_session->slots[i].lock, NULL);
+	glist_init(&nfs41_session->cb_pending);
 
 	/* Take reference to clientid record on behalf the session. */
 	inc_client_id_ref(found);
@@ -336,8 +339,30 @@ int nfs4_op_create_session(struct nfs_argop4 *op, compound_data_t *data,
 		  &nfs41_session->session_link);
 	PTHREAD_MUTEX_unlock(&found->cid_mutex);
 
-	/* Set ca_maxrequests */
-	nfs41_session->fore_channel_attrs.ca_maxrequests = NFS41_NB_SLOTS;
+	/* Set ca_maxrequests: grant what the client asks for, up to the
+	 * size of the slot table, and have SEQUENCE raise the target as
+	 * the client uses more.
+	 */
+	nfs41_session->fore_channel_attrs.ca_maxrequests =
+	    MAX(1, MIN(nfs41_session->fore_channel_attrs.ca_maxrequests,
+		       NFS41_MAX_SLOTS));
+	nfs41_session->target_highest_slotid =
+	    MIN(nfs41_session->fore_channel_attrs.ca_maxrequests,
+		NFS41_NB_SLOTS) - 1;
+	/* We use no more backchannel slots than we keep track of */
+	nfs41_session->back_channel_attrs.ca_maxrequests =
+	    MAX(1, MIN(nfs41_session->back_channel_attrs.ca_maxrequests,
+		       NFS41_CB_SLOTS));
+
+	/* Only the slots granted are allocated, their replies as they
+	 * are cached.
+	 */
+	nfs41_session->slots =
+	    gsh_calloc(nfs41_session->fore_channel_attrs.ca_maxrequests,
+		       sizeof(nfs41_session_slot_t));
+	for (i = 0; i < nfs41_session->fore_channel_attrs.ca_maxrequests; i++)
+		PTHREAD_MUTEX_init(&nfs41_session->slots[i].lock, NULL);
+
 	nfs41_Build_sessionid(&clientid, nfs41_session->session_id);
 
 	res_CREATE_SESSION4ok->csr_sequence = arg_CREATE_SESSION4->csa_sequence;
@@ -356,10 +381,9 @@ int nfs4_op_create_session(struct nfs_argop4 *op, compound_data_t *data,
 	       NFS4_SESSIONID_SIZE);
 
 	/* Create Session replay cache */
-	data->cached_res = &found->cid_create_session_slot.cached_result;
-	found->cid_create_session_slot.cache_used = true;
+	data->cache_slot = &found->cid_create_session_slot;
 
-	LogDebug(component, "CREATE_SESSION replay=%p", data->cached_res);
+	LogDebug(component, "CREATE_SESSION replay=%p", data->cache_slot);
 
 	if (!nfs41_Session_Set(nfs41_session)) {
 		LogDebug(component, "Could not insert session into table");
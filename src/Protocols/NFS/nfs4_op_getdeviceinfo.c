@@ -47,6 +47,7 @@
 #include "nfs_proto_functions.h"
 #include "nfs_file_handle.h"
 #include "export_mgr.h"
+#include "pnfs_utils.h"
 
 /**
  *
@@ -91,6 +92,8 @@ int nfs4_op_getdeviceinfo(struct nfs_argop4 *op, compound_data_t *data,
 	size_t da_addr_size = 0;
 	/* Pointer to the fsal appropriate to this deviceid */
 	struct fsal_module *fsal = NULL;
+	/* Generation of the device address cache on a miss */
+	uint64_t gen = 0;
 
 	resp->resop = NFS4_OP_GETDEVICEINFO;
 
@@ -139,6 +142,11 @@ int nfs4_op_getdeviceinfo(struct nfs_argop4 *op, compound_data_t *data,
 
 	da_buffer = gsh_malloc(da_addr_size);
 
+	da_length = pnfs_devinfo_get(arg_GETDEVICEINFO4->gdia_layout_type,
+				     deviceid, da_buffer, da_addr_size, &gen);
+	if (da_length != 0)
+		goto encoded;
+
 	xdrmem_create(&da_addr_body, da_buffer, da_addr_size, XDR_ENCODE);
 
 	da_beginning = xdr_getpos(&da_addr_body);
@@ -156,6 +164,10 @@ int nfs4_op_getdeviceinfo(struct nfs_argop4 *op, compound_data_t *data,
 	if (nfs_status != NFS4_OK)
 		goto out;
 
+	pnfs_devinfo_put(arg_GETDEVICEINFO4->gdia_layout_type, deviceid,
+			 da_buffer, da_length, gen);
+
+ encoded:
 	memset(&res_GETDEVICEINFO4->GETDEVICEINFO4res_u.gdir_resok4.
 	       gdir_notification, 0,
 	       sizeof(res_GETDEVICEINFO4->GETDEVICEINFO4res_u.gdir_resok4.
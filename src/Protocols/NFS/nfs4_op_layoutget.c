@@ -47,6 +47,7 @@
 #include "fsal_pnfs.h"
 #include "sal_data.h"
 #include "sal_functions.h"
+#include "layout_stats.h"
 
 /**
  *
@@ -519,6 +520,58 @@ void nfs4_op_layoutget_Free(nfs_resop4 *res)
 
 }				/* nfs41_op_layoutget_Free */
 
+/**
+ * @brief Find the layout a LAYOUTSTATS or LAYOUTERROR reports on
+ *
+ * @param[in]  data         Compound request's data
+ * @param[in]  stateid      The layout stateid supplied
+ * @param[out] layout_state The layout state, to be released with
+ *                          dec_state_t_ref
+ * @param[in]  tag          Operation name, for logging
+ *
+ * @return NFS4_OK or an error for the client.
+ */
+static nfsstat4 layout_report_state(compound_data_t *data,
+				    stateid4 *stateid,
+				    state_t **layout_state,
+				    const char *tag)
+{
+	nfsstat4 nfs_status;
+
+	nfs_status = nfs4_sanity_check_FH(data, REGULAR_FILE, false);
+
+	if (nfs_status != NFS4_OK)
+		return nfs_status;
+
+	nfs_status = nfs4_Check_Stateid(stateid, data->current_obj,
+					layout_state, data,
+					STATEID_SPECIAL_CURRENT, 0, false,
+					tag);
+
+	if (nfs_status != NFS4_OK)
+		return nfs_status;
+
+	if ((*layout_state)->state_type != STATE_TYPE_LAYOUT) {
+		dec_state_t_ref(*layout_state);
+		*layout_state = NULL;
+		return NFS4ERR_BAD_STATEID;
+	}
+
+	return NFS4_OK;
+}
+
+/**
+ * @brief The NFS4_OP_LAYOUTERROR operation
+ *
+ * The error is counted against the file and the data server device,
+ * then passed to the FSAL.
+ *
+ * @param[in]     op   Arguments for nfs4_op
+ * @param[in,out] data Compound request's data
+ * @param[out]    resp Results for nfs4_op
+ *
+ * @return per RFC 7862, p. 72.
+ */
 int nfs4_op_layouterror(struct nfs_argop4 *op, compound_data_t *data,
 		      struct nfs_resop4 *resp)
 {
@@ -530,8 +583,19 @@ int nfs4_op_layouterror(struct nfs_argop4 *op, compound_data_t *data,
 					&resp->nfs_resop4_u.oplayouterror;
 	/* NFSv4.2 status code */
 	nfsstat4 nfs_status = 0;
+	/* State indicated by client */
+	state_t *layout_state = NULL;
+	/* Input arguments of FSAL_layout_stats */
+	struct fsal_layout_stats_arg arg;
+
+	resp->resop = NFS4_OP_LAYOUTERROR;
 
-	LogEvent(COMPONENT_PNFS,
+	if (data->minorversion < 2) {
+		res_LAYOUTERROR4->ler_status = NFS4ERR_NOTSUPP;
+		return res_LAYOUTERROR4->ler_status;
+	}
+
+	LogDebug(COMPONENT_PNFS,
 		 "LAYOUTERROR OP %d status %d offset: %" PRIu64
 		 " length: %" PRIu64,
 		 arg_LAYOUTERROR4->lea_errors.de_opnum,
@@ -539,8 +603,28 @@ int nfs4_op_layouterror(struct nfs_argop4 *op, compound_data_t *data,
 		 arg_LAYOUTERROR4->lea_offset,
 		 arg_LAYOUTERROR4->lea_length);
 
-	/** @todo: what else do we want to do with this error ???  */
+	nfs_status = layout_report_state(data, &arg_LAYOUTERROR4->lea_stateid,
+					 &layout_state, "LAYOUTERROR");
+
+	if (nfs_status != NFS4_OK)
+		goto out;
+
+	layout_stats_error(op_ctx->ctx_export->export_id,
+			   data->current_obj->fileid,
+			   &arg_LAYOUTERROR4->lea_errors);
+
+	memset(&arg, 0, sizeof(arg));
+	arg.type = layout_state->state_data.layout.state_layout_type;
+	arg.offset = arg_LAYOUTERROR4->lea_offset;
+	arg.length = arg_LAYOUTERROR4->lea_length;
+	arg.error = &arg_LAYOUTERROR4->lea_errors;
 
+	nfs_status = data->current_obj->obj_ops.layout_stats(
+					data->current_obj, op_ctx, NULL, &arg);
+
+	dec_state_t_ref(layout_state);
+
+ out:
 	res_LAYOUTERROR4->ler_status = nfs_status;
 
 	return res_LAYOUTERROR4->ler_status;
@@ -550,6 +634,19 @@ void nfs4_op_layouterror_Free(nfs_resop4 *res)
 {
 }
 
+/**
+ * @brief The NFS4_OP_LAYOUTSTATS operation
+ *
+ * The I/O counts are summed per file, then passed to the FSAL with the
+ * layout type-specific report, which is where a flex files client puts
+ * its per-device latencies.
+ *
+ * @param[in]     op   Arguments for nfs4_op
+ * @param[in,out] data Compound request's data
+ * @param[out]    resp Results for nfs4_op
+ *
+ * @return per RFC 7862, p. 74.
+ */
 int nfs4_op_layoutstats(struct nfs_argop4 *op, compound_data_t *data,
 		      struct nfs_resop4 *resp)
 {
@@ -561,22 +658,61 @@ int nfs4_op_layoutstats(struct nfs_argop4 *op, compound_data_t *data,
 					&resp->nfs_resop4_u.oplayoutstats;
 	/* NFSv4.2 status code */
 	nfsstat4 nfs_status = 0;
+	/* State indicated by client */
+	state_t *layout_state = NULL;
+	/* Input arguments of FSAL_layout_stats */
+	struct fsal_layout_stats_arg arg;
+	/* XDR stream holding the lou_body opaque */
+	XDR lou_body;
 
-	LogEvent(COMPONENT_PNFS,
-		 "LAYOUTSTATS offset %" PRIu64 " length %" PRIu64,
-		 arg_LAYOUTSTATS4->lsa_offset,
-		 arg_LAYOUTSTATS4->lsa_length);
+	resp->resop = NFS4_OP_LAYOUTSTATS;
+
+	if (data->minorversion < 2) {
+		res_LAYOUTSTATS4->lsr_status = NFS4ERR_NOTSUPP;
+		return res_LAYOUTSTATS4->lsr_status;
+	}
 
-	LogEvent(COMPONENT_PNFS,
-		 "LAYOUTSTATS read count %u bytes %" PRIu64
-		 " write count %u bytes %" PRIu64,
-		 arg_LAYOUTSTATS4->lsa_read.ii_count,
-		 arg_LAYOUTSTATS4->lsa_read.ii_bytes,
-		 arg_LAYOUTSTATS4->lsa_write.ii_count,
-		 arg_LAYOUTSTATS4->lsa_write.ii_bytes);
+	LogFullDebug(COMPONENT_PNFS,
+		     "LAYOUTSTATS offset %" PRIu64 " length %" PRIu64
+		     " read count %u bytes %" PRIu64
+		     " write count %u bytes %" PRIu64,
+		     arg_LAYOUTSTATS4->lsa_offset,
+		     arg_LAYOUTSTATS4->lsa_length,
+		     arg_LAYOUTSTATS4->lsa_read.ii_count,
+		     arg_LAYOUTSTATS4->lsa_read.ii_bytes,
+		     arg_LAYOUTSTATS4->lsa_write.ii_count,
+		     arg_LAYOUTSTATS4->lsa_write.ii_bytes);
 
-	/** @todo: what else do we want to do with the stats ???  */
+	nfs_status = layout_report_state(data, &arg_LAYOUTSTATS4->lsa_stateid,
+					 &layout_state, "LAYOUTSTATS");
+
+	if (nfs_status != NFS4_OK)
+		goto out;
 
+	layout_stats_io(op_ctx->ctx_export->export_id,
+			data->current_obj->fileid,
+			&arg_LAYOUTSTATS4->lsa_read,
+			&arg_LAYOUTSTATS4->lsa_write);
+
+	memset(&arg, 0, sizeof(arg));
+	arg.type = layout_state->state_data.layout.state_layout_type;
+	arg.offset = arg_LAYOUTSTATS4->lsa_offset;
+	arg.length = arg_LAYOUTSTATS4->lsa_length;
+	arg.read = arg_LAYOUTSTATS4->lsa_read;
+	arg.write = arg_LAYOUTSTATS4->lsa_write;
+
+	xdrmem_create(&lou_body,
+		      arg_LAYOUTSTATS4->lsa_layoutupdate.lou_body.lou_body_val,
+		      arg_LAYOUTSTATS4->lsa_layoutupdate.lou_body.lou_body_len,
+		      XDR_DECODE);
+
+	nfs_status = data->current_obj->obj_ops.layout_stats(
+				data->current_obj, op_ctx, &lou_body, &arg);
+
+	xdr_destroy(&lou_body);
+	dec_state_t_ref(layout_state);
+
+ out:
 	res_LAYOUTSTATS4->lsr_status = nfs_status;
 
 	return res_LAYOUTSTATS4->lsr_status;
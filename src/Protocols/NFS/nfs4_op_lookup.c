@@ -42,6 +42,46 @@
 #include "nfs_convert.h"
 #include "export_mgr.h"
 
+/**
+ * @brief Look up ahead the names of the LOOKUPs following this one
+ *
+ * A client walking down a path sends a LOOKUP per component in one
+ * compound.  The names of the run of LOOKUPs starting at @a op are
+ * walked with one fsal_lookup_ahead, and each LOOKUP then finds its
+ * name in the cache.
+ *
+ * @param[in] op   This LOOKUP
+ * @param[in] data Compound request's data
+ * @param[in] dir  Directory of this LOOKUP
+ * @param[in] name Name of this LOOKUP
+ */
+
+static void nfs4_lookup_ahead(struct nfs_argop4 *op, compound_data_t *data,
+			      struct fsal_obj_handle *dir, char *name)
+{
+	char *names[FSAL_LOOKUP_MULTI_MAX];
+	uint32_t n;
+
+	names[0] = name;
+
+	for (n = 1; n < FSAL_LOOKUP_MULTI_MAX &&
+		    data->oppos + n < data->opcount &&
+		    op[n].argop == NFS4_OP_LOOKUP; n++) {
+		if (nfs4_utf8string2dynamic(
+				&op[n].nfs_argop4_u.oplookup.objname,
+				UTF8_SCAN_ALL, &names[n]) != NFS4_OK)
+			break;
+	}
+
+	data->lookup_ahead = data->oppos + n;
+
+	if (n > 1)
+		fsal_lookup_ahead(dir, (const char * const *)names, n);
+
+	while (--n > 0)
+		gsh_free(names[n]);
+}
+
 /**
  * @brief NFS4_OP_LOOKUP
  *
@@ -103,6 +143,9 @@ int nfs4_op_lookup(struct nfs_argop4 *op, compound_data_t *data,
 
 	/* Sanity check: dir_obj should be ACTUALLY a directory */
 
+	if (data->oppos >= data->lookup_ahead)
+		nfs4_lookup_ahead(op, data, dir_obj, name);
+
 	status = fsal_lookup(dir_obj, name, &file_obj, NULL);
 	if (FSAL_IS_ERROR(status)) {
 		res_LOOKUP4->status = nfs4_Errno_status(status);
@@ -183,6 +226,13 @@ int nfs4_op_lookup(struct nfs_argop4 *op, compound_data_t *data,
 				goto out;
 			}
 
+			if (!export_activate(op_ctx->ctx_export)) {
+				/* Lazy_Init export could not be created */
+				res_LOOKUP4->status = NFS4ERR_DELAY;
+				goto out;
+			}
+			op_ctx->fsal_export = op_ctx->ctx_export->fsal_export;
+
 			status = nfs_export_get_root_entry(op_ctx->ctx_export,
 							   &obj);
 
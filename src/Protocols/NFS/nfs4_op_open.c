@@ -1047,6 +1047,8 @@ static void do_delegation(OPEN4args *arg_OPEN4, OPEN4res *res_OPEN4,
 	/* This will be updated later if we actually delegate */
 	resok->delegation.delegation_type = OPEN_DELEGATE_NONE;
 
+	deleg_heuristics_open(ostate, arg_OPEN4->share_access);
+
 	/* Client doesn't want a delegation. */
 	if (arg_OPEN4->share_access & OPEN4_SHARE_ACCESS_WANT_NO_DELEG) {
 		resok->delegation.open_delegation4_u.
@@ -1139,11 +1141,8 @@ static void open4_ex_create_args(OPEN4args *arg,
 				return;
 		}
 
-		if (createhow->mode == EXCLUSIVE4_1) {
-			/** @todo FSF: this needs to be corrected in case FSAL
-			 *             uses different attributes for the
-			 *             verifier.
-			 */
+		if (createhow->mode == EXCLUSIVE4_1 &&
+		    !fsal_native_exclusive_create()) {
 			/* Check that we aren't trying to set the verifier
 			 * attributes.
 			 */
@@ -1181,6 +1180,23 @@ static void open4_ex_create_args(OPEN4args *arg,
  *
  */
 
+/**
+ * @brief Check whether an open state already holds an OPEN's modes
+ *
+ * @param[in] state The owner's open state of the file
+ * @param[in] arg   The OPEN arguments
+ *
+ * @return true if the state has all the access and deny asked for.
+ */
+static inline bool open4_state_covers(state_t *state, OPEN4args *arg)
+{
+	uint32_t access = arg->share_access & OPEN4_SHARE_ACCESS_BOTH;
+
+	return (state->state_data.share.share_access & access) == access &&
+	       (state->state_data.share.share_deny & arg->share_deny) ==
+	       arg->share_deny;
+}
+
 static void open4_ex(OPEN4args *arg,
 		     compound_data_t *data,
 		     OPEN4res *res_OPEN4,
@@ -1212,6 +1228,8 @@ static void open4_ex(OPEN4args *arg,
 	fsal_status_t status = {0, 0};
 	/* The open state for the file */
 	bool state_lock_held = false;
+	/* The existing state already covered the open */
+	bool reused = false;
 
 	/* Make sure the attributes are initialized */
 	memset(&sattr, 0, sizeof(sattr));
@@ -1466,6 +1484,17 @@ static void open4_ex(OPEN4args *arg,
 			goto out;
 		}
 
+		/* We need an extra reference below. */
+		file_obj->obj_ops.get_ref(file_obj);
+	} else if (open4_state_covers(*file_state, arg) &&
+		   (openflags & (FSAL_O_TRUNC | FSAL_O_RECLAIM)) == 0) {
+		/* A repeated open by the owner, for access and deny it
+		 * already holds.  The FSAL's open and share reservations
+		 * need not change, so only the stateid's seqid does.
+		 */
+		LogFullDebug(COMPONENT_STATE, "Reusing open state");
+		reused = true;
+
 		/* We need an extra reference below. */
 		file_obj->obj_ops.get_ref(file_obj);
 	} else {
@@ -1562,10 +1591,13 @@ static void open4_ex(OPEN4args *arg,
 			*file_state = NULL;
 			*new_state = false;
 		} else {
-			/*Do an open downgrade to the old open flags */
-			status = file_obj->obj_ops.reopen2(file_obj,
-							   *file_state,
-							   old_openflags);
+			/* Do an open downgrade to the old open flags, if
+			 * the FSAL was asked for new ones.
+			 */
+			if (!reused)
+				status = file_obj->obj_ops.reopen2(
+						file_obj, *file_state,
+						old_openflags);
 			if (FSAL_IS_ERROR(status)) {
 				LogCrit(COMPONENT_NFS_V4,
 					"Failed to allocate handle, reopen2 failed with %s",
@@ -1967,8 +1999,12 @@ int nfs4_op_open(struct nfs_argop4 *op, compound_data_t *data,
 	memset(&res_OPEN4->OPEN4res_u.resok4.attrset,
 	       0,
 	       sizeof(struct bitmap4));
-	if (arg_OPEN4->openhow.openflag4_u.how.mode == EXCLUSIVE4 ||
-	    arg_OPEN4->openhow.openflag4_u.how.mode == EXCLUSIVE4_1) {
+	if ((arg_OPEN4->openhow.openflag4_u.how.mode == EXCLUSIVE4 ||
+	     arg_OPEN4->openhow.openflag4_u.how.mode == EXCLUSIVE4_1) &&
+	    !fsal_native_exclusive_create()) {
+		/* The verifier went in the times, the client must set
+		 * them once it is done with the create.
+		 */
 		struct bitmap4 *bits = &res_OPEN4->OPEN4res_u.resok4.attrset;
 
 		set_attribute_in_bitmap(bits, FATTR4_TIME_ACCESS);
@@ -46,17 +46,32 @@
 #include "nfs_file_handle.h"
 #include "pnfs_utils.h"
 
+/**
+ * @brief Set a DS handle as the current FH
+ *
+ * A COMPOUND to a data server is nothing but PUTFHs of DS handles and
+ * the I/O on them, so a PUTFH to the server of the previous one keeps
+ * the server, export and permissions it checked.
+ */
 static int nfs4_ds_putfh(compound_data_t *data)
 {
 	struct file_handle_v4 *v4_handle =
 		(struct file_handle_v4 *)data->currentFH.nfs_fh4_val;
-	struct fsal_pnfs_ds *pds;
+	struct fsal_pnfs_ds *pds = op_ctx->fsal_pnfs_ds;
 	struct gsh_buffdesc fh_desc;
 	bool changed = true;
 
 	LogFullDebug(COMPONENT_FILEHANDLE, "NFS4 Handle 0x%X export id %d",
 		v4_handle->fhflags1, ntohs(v4_handle->id.exports));
 
+	if (pds != NULL &&
+	    pds->id_servers == ntohs(v4_handle->id.servers) &&
+	    pds->pnfs_ds_status == PNFS_DS_READY &&
+	    op_ctx->ctx_export == pds->mds_export) {
+		set_current_entry(data, NULL);
+		goto make_handle;
+	}
+
 	/* Find any existing server by the "id" from the handle,
 	 * before releasing the old DS (to prevent thrashing).
 	 */
@@ -81,7 +96,7 @@ static int nfs4_ds_putfh(compound_data_t *data)
 
 	/* If old CurrentFH had a related export, release reference. */
 	if (op_ctx->ctx_export != NULL) {
-		changed = op_ctx->ctx_export != pds->mds_export;
+		changed = changed || op_ctx->ctx_export != pds->mds_export;
 		put_gsh_export(op_ctx->ctx_export);
 	}
 
@@ -117,6 +132,8 @@ static int nfs4_ds_putfh(compound_data_t *data)
 			return status;
 	}
 
+
+ make_handle:
 	fh_desc.len = v4_handle->fs_len;
 	fh_desc.addr = &v4_handle->fsopaque;
 
@@ -146,6 +163,15 @@ static int nfs4_mds_putfh(compound_data_t *data)
 	LogFullDebugOpaque(COMPONENT_FILEHANDLE, "NFS4 FSAL Handle %s",
 			   LEN_FH_STR, v4_handle->fsopaque, v4_handle->fs_len);
 
+	if (op_ctx->ctx_export != NULL &&
+	    op_ctx->ctx_export->export_id == ntohs(v4_handle->id.exports) &&
+	    export_ready(op_ctx->ctx_export)) {
+		/* Still in the same export, keep the reference held. */
+		exporting = op_ctx->ctx_export;
+		changed = false;
+		goto same_export;
+	}
+
 	/* Find any existing export by the "id" from the handle,
 	 * before releasing the old export (to prevent thrashing).
 	 */
@@ -161,6 +187,12 @@ static int nfs4_mds_putfh(compound_data_t *data)
 		return NFS4ERR_STALE;
 	}
 
+	if (!export_activate(exporting)) {
+		/* Lazy_Init export could not be created */
+		put_gsh_export(exporting);
+		return NFS4ERR_DELAY;
+	}
+
 	/* If old CurrentFH had a related export, release reference. */
 	if (op_ctx->ctx_export != NULL) {
 		changed = ntohs(v4_handle->id.exports) !=
@@ -168,6 +200,8 @@ static int nfs4_mds_putfh(compound_data_t *data)
 		put_gsh_export(op_ctx->ctx_export);
 	}
 
+ same_export:
+
 	/* If old CurrentFH had a related server, release reference. */
 	if (op_ctx->fsal_pnfs_ds != NULL) {
 		pnfs_ds_put(op_ctx->fsal_pnfs_ds);
@@ -219,6 +253,7 @@ static int nfs4_mds_putfh(compound_data_t *data)
 
 	/* Set the current entry using the ref from get */
 	set_current_entry(data, new_hdl);
+	op_ctx->fileid = new_hdl->fileid;
 
 	/* Put our ref */
 	new_hdl->obj_ops.put_ref(new_hdl);
@@ -231,6 +266,61 @@ static int nfs4_mds_putfh(compound_data_t *data)
 	return NFS4_OK;
 }
 
+/**
+ * @brief Take the handle from an object the COMPOUND already holds
+ *
+ * A handle byte for byte the same as the current or saved one names
+ * the same object in the same export, and the export's access was
+ * checked when that one was put, so neither the export nor the FSAL
+ * need be asked again.  The handle is still in the arguments, not yet
+ * copied to the current FH.
+ *
+ * @param[in,out] data Compound request's data
+ * @param[in]     fh   The handle put
+ *
+ * @retval true if the current FH is now that object.
+ * @retval false if the handle must be looked up.
+ */
+static bool nfs4_putfh_held(compound_data_t *data, nfs_fh4 *fh)
+{
+	if (data->current_obj != NULL && data->current_ds == NULL &&
+	    data->currentFH.nfs_fh4_len == fh->nfs_fh4_len &&
+	    memcmp(data->currentFH.nfs_fh4_val, fh->nfs_fh4_val,
+		   fh->nfs_fh4_len) == 0) {
+		data->current_stateid_valid = false;
+		return true;
+	}
+
+	if (data->saved_obj == NULL || data->saved_ds != NULL ||
+	    data->saved_export == NULL ||
+	    op_ctx->fsal_pnfs_ds != NULL ||
+	    data->savedFH.nfs_fh4_len != fh->nfs_fh4_len ||
+	    memcmp(data->savedFH.nfs_fh4_val, fh->nfs_fh4_val,
+		   fh->nfs_fh4_len) != 0 ||
+	    !export_ready(data->saved_export))
+		return false;
+
+	/* As RESTOREFH does, but for the stateid */
+	get_gsh_export_ref(data->saved_export);
+
+	data->currentFH.nfs_fh4_len = fh->nfs_fh4_len;
+	memcpy(data->currentFH.nfs_fh4_val, fh->nfs_fh4_val,
+	       fh->nfs_fh4_len);
+
+	if (op_ctx->ctx_export != NULL)
+		put_gsh_export(op_ctx->ctx_export);
+
+	op_ctx->ctx_export = data->saved_export;
+	op_ctx->fsal_export = op_ctx->ctx_export->fsal_export;
+	*op_ctx->export_perms = data->saved_export_perms;
+
+	set_current_entry(data, data->saved_obj);
+	op_ctx->fileid = data->saved_obj->fileid;
+	data->current_stateid_valid = false;
+
+	return true;
+}
+
 /**
  * @brief The NFS4_OP_PUTFH operation
  *
@@ -262,9 +352,20 @@ int nfs4_op_putfh(struct nfs_argop4 *op, compound_data_t *data,
 	if (res_PUTFH4->status != NFS4_OK)
 		return res_PUTFH4->status;
 
-	/* If no currentFH were set, allocate one */
-	if (data->currentFH.nfs_fh4_val == NULL)
-		nfs4_AllocateFH(&data->currentFH);
+	/* The same DS handle again, as a client does PUTFH for each I/O
+	 * it sends in a COMPOUND, keeps the DS handle made for it.
+	 */
+	if (data->current_ds != NULL &&
+	    data->currentFH.nfs_fh4_len == arg_PUTFH4->object.nfs_fh4_len &&
+	    memcmp(data->currentFH.nfs_fh4_val, arg_PUTFH4->object.nfs_fh4_val,
+		   arg_PUTFH4->object.nfs_fh4_len) == 0) {
+		data->current_stateid_valid = false;
+		return res_PUTFH4->status;
+	}
+
+	/* Likewise an object already resolved in this COMPOUND. */
+	if (nfs4_putfh_held(data, &arg_PUTFH4->object))
+		return res_PUTFH4->status;
 
 	/* Copy the filehandle from the arg structure */
 	data->currentFH.nfs_fh4_len = arg_PUTFH4->object.nfs_fh4_len;
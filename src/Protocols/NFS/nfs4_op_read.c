@@ -86,9 +86,11 @@ static int op_dsread(struct nfs_argop4 *op, compound_data_t *data,
 
 	/* Construct the FSAL file handle */
 
-	buffer = gsh_malloc_aligned(4096, arg_READ4->count);
+	buffer = iobuf_alloc(nfs_iobuf_pool, arg_READ4->count);
 
 	res_READ4->READ4res_u.resok4.data.data_val = buffer;
+	res_READ4->READ4res_u.resok4.data_bufsize = arg_READ4->count;
+	res_READ4->READ4res_u.resok4.rbuf = NULL;
 
 	nfs_status = data->current_ds->dsh_ops.read(
 				data->current_ds,
@@ -101,7 +103,7 @@ static int op_dsread(struct nfs_argop4 *op, compound_data_t *data,
 				&eof);
 
 	if (nfs_status != NFS4_OK) {
-		gsh_free(buffer);
+		iobuf_free(nfs_iobuf_pool, buffer, arg_READ4->count);
 		res_READ4->READ4res_u.resok4.data.data_val = NULL;
 	}
 
@@ -157,7 +159,7 @@ static int op_dsread_plus(struct nfs_argop4 *op, compound_data_t *data,
 
 	/* Construct the FSAL file handle */
 
-	buffer = gsh_malloc_aligned(4096, arg_READ4->count);
+	buffer = iobuf_alloc(nfs_iobuf_pool, arg_READ4->count);
 
 	nfs_status = data->current_ds->dsh_ops.read_plus(
 				data->current_ds,
@@ -171,10 +173,14 @@ static int op_dsread_plus(struct nfs_argop4 *op, compound_data_t *data,
 
 	res_RPLUS->rpr_status = nfs_status;
 	if (nfs_status != NFS4_OK) {
-		gsh_free(buffer);
+		iobuf_free(nfs_iobuf_pool, buffer, arg_READ4->count);
 		return res_RPLUS->rpr_status;
 	}
 
+	/* Kept whether or not the FSAL reports a hole */
+	res_RPLUS->rpr_resok4.rpr_buf = buffer;
+	res_RPLUS->rpr_resok4.rpr_bufsize = arg_READ4->count;
+
 	contentp->what = info->io_content.what;
 	res_RPLUS->rpr_resok4.rpr_contents_count = 1;
 	res_RPLUS->rpr_resok4.rpr_eof = eof;
@@ -193,6 +199,119 @@ static int op_dsread_plus(struct nfs_argop4 *op, compound_data_t *data,
 	return res_RPLUS->rpr_status;
 }
 
+/**
+ * @brief Fill in the result of a READ the FSAL is done with
+ */
+static void nfs4_read_result(struct fsal_obj_handle *obj, READ4res *res_READ4,
+			     fsal_status_t fsal_status, void *bufferdata,
+			     struct fsal_read_buf *rbuf, uint64_t offset,
+			     uint64_t size, size_t read_size, bool eof_met)
+{
+	if (FSAL_IS_ERROR(fsal_status)) {
+		res_READ4->status = nfs4_Errno_status(fsal_status);
+		/* nothing is lent on error */
+		if (rbuf != NULL)
+			gsh_free(rbuf);
+		else
+			iobuf_free(nfs_iobuf_pool, bufferdata, size);
+		res_READ4->READ4res_u.resok4.data.data_val = NULL;
+		return;
+	}
+
+	if (!eof_met) {
+		/** @todo FSF: add a config option for this behavior?
+		 */
+		/* Need to check against filesize for ESXi clients */
+		struct attrlist attrs;
+
+		fsal_prepare_attrs(&attrs, ATTR_SIZE);
+
+		if (!FSAL_IS_ERROR(obj->obj_ops.getattrs(obj, &attrs)))
+			eof_met = (offset + read_size) >= attrs.filesize;
+
+		/* Done with the attrs */
+		fsal_release_attrs(&attrs);
+	}
+
+	res_READ4->READ4res_u.resok4.data.data_len = read_size;
+	res_READ4->READ4res_u.resok4.data.data_val = bufferdata;
+	res_READ4->READ4res_u.resok4.data_bufsize = size;
+	res_READ4->READ4res_u.resok4.rbuf = rbuf;
+
+	LogFullDebug(COMPONENT_NFS_V4,
+		     "NFS4_OP_READ: offset = %" PRIu64
+		     " read length = %zu eof=%u", offset, read_size, eof_met);
+
+	/* Is EOF met or not ? */
+	res_READ4->READ4res_u.resok4.eof = eof_met;
+
+	/* Say it is ok */
+	res_READ4->status = NFS4_OK;
+}
+
+/**
+ * @brief What a READ holds while its I/O is pending
+ */
+struct nfs4_read_io {
+	struct fsal_io_arg read_arg;
+	struct svc_req *req;
+	READ4res *res_READ4;
+	state_t *state_found;
+	state_t *state_open;
+	state_owner_t *owner;
+	bool anonymous_started;
+};
+
+/**
+ * @brief Complete a READ started without waiting for it
+ *
+ * The object stays referenced as the compound's current object.
+ */
+static void nfs4_read_done(struct fsal_obj_handle *obj,
+			   fsal_status_t fsal_status,
+			   struct fsal_io_arg *read_arg, void *caller_arg)
+{
+	struct nfs4_read_io *rio = caller_arg;
+	READ4res *res_READ4 = rio->res_READ4;
+	struct svc_req *req = rio->req;
+	struct req_op_context *saved_ctx = op_ctx;
+
+	op_ctx = nfs_req_op_ctx(req);
+
+	/* As fsal_read2() would */
+	if (fsal_status.major == ERR_FSAL_SHARE_DENIED)
+		fsal_status = fsalstat(ERR_FSAL_LOCKED, 0);
+	if (FSAL_IS_ERROR(fsal_status))
+		read_arg->io_amount = 0;
+
+	nfs4_read_result(obj, res_READ4, fsal_status, read_arg->buffer, NULL,
+			 read_arg->offset, read_arg->size, read_arg->io_amount,
+			 read_arg->end_of_file);
+
+	if (rio->owner != NULL)
+		op_ctx->clientid = NULL;
+
+	if (rio->anonymous_started)
+		state_share_anonymous_io_done(obj, OPEN4_SHARE_ACCESS_READ);
+
+	server_stats_io_done(read_arg->size, read_arg->io_amount,
+			     (res_READ4->status == NFS4_OK) ? true : false,
+			     false);
+
+	if (rio->owner != NULL)
+		dec_state_owner_ref(rio->owner);
+
+	if (rio->state_found != NULL)
+		dec_state_t_ref(rio->state_found);
+
+	if (rio->state_open != NULL)
+		dec_state_t_ref(rio->state_open);
+
+	gsh_free(rio);
+
+	op_ctx = saved_ctx;
+	nfs_req_async_done(req, res_READ4->status);
+}
 
 static int nfs4_read(struct nfs_argop4 *op, compound_data_t *data,
 		    struct nfs_resop4 *resp, fsal_io_direction_t io,
@@ -205,6 +324,7 @@ static int nfs4_read(struct nfs_argop4 *op, compound_data_t *data,
 	uint64_t offset = 0;
 	bool eof_met = false;
 	void *bufferdata = NULL;
+	struct fsal_read_buf *rbuf = NULL;
 	fsal_status_t fsal_status = {0, 0};
 	state_t *state_found = NULL;
 	state_t *state_open = NULL;
@@ -443,13 +563,11 @@ static int nfs4_read(struct nfs_argop4 *op, compound_data_t *data,
 		res_READ4->READ4res_u.resok4.eof = false;
 		res_READ4->READ4res_u.resok4.data.data_len = 0;
 		res_READ4->READ4res_u.resok4.data.data_val = NULL;
+		res_READ4->READ4res_u.resok4.rbuf = NULL;
 		res_READ4->status = NFS4_OK;
 		goto done;
 	}
 
-	/* Some work is to be done */
-	bufferdata = gsh_malloc_aligned(4096, size);
-
 	if (!anonymous_started && data->minorversion == 0) {
 		owner = get_state_owner_ref(state_found);
 		if (owner != NULL) {
@@ -458,55 +576,53 @@ static int nfs4_read(struct nfs_argop4 *op, compound_data_t *data,
 		}
 	}
 
-	if (obj->fsal->m_ops.support_ex(obj)) {
+	if (info == NULL && fsal_lends_read_buffers(obj)) {
+		/* Reply straight from the FSAL's buffer */
+		rbuf = gsh_calloc(1, sizeof(*rbuf));
+		fsal_status = fsal_read_buffer(obj, bypass, state_found,
+					       offset, size, rbuf, &eof_met);
+		bufferdata = rbuf->data.addr;
+		read_size = rbuf->data.len;
+	} else if (info == NULL && obj->fsal->m_ops.support_ex(obj) &&
+		   nfs4_io_async_begin(data)) {
+		/* Hand what we hold over to the completion */
+		struct nfs4_read_io *rio = gsh_calloc(1, sizeof(*rio));
+
+		rio->req = data->req;
+		rio->res_READ4 = res_READ4;
+		rio->state_found = state_found;
+		rio->state_open = state_open;
+		rio->owner = owner;
+		rio->anonymous_started = anonymous_started;
+		rio->read_arg.state = state_found;
+		rio->read_arg.offset = offset;
+		rio->read_arg.size = size;
+		rio->read_arg.buffer = iobuf_alloc(nfs_iobuf_pool, size);
+
+		data->async_pending = true;
+		obj->obj_ops.read2_async(obj, bypass, &rio->read_arg,
+					 nfs4_read_done, rio);
+		return NFS4_OK;
+	} else if (obj->fsal->m_ops.support_ex(obj)) {
 		/* Call the new fsal_read2 */
+		bufferdata = iobuf_alloc(nfs_iobuf_pool, size);
 		fsal_status = fsal_read2(obj, bypass, state_found, offset, size,
 					 &read_size, bufferdata, &eof_met,
 					 info);
 	} else {
 		/* Call legacy fsal_rdwr */
+		bufferdata = iobuf_alloc(nfs_iobuf_pool, size);
 		fsal_status = fsal_rdwr(obj, io, offset, size, &read_size,
 					bufferdata, &eof_met, &sync, info);
 	}
 
-	if (FSAL_IS_ERROR(fsal_status)) {
-		res_READ4->status = nfs4_Errno_status(fsal_status);
-		gsh_free(bufferdata);
-		res_READ4->READ4res_u.resok4.data.data_val = NULL;
-		goto done;
-	}
+	nfs4_read_result(obj, res_READ4, fsal_status, bufferdata, rbuf,
+			 offset, size, read_size, eof_met);
 
-	if (!eof_met) {
-		/** @todo FSF: add a config option for this behavior?
-		 */
-		/* Need to check against filesize for ESXi clients */
-		struct attrlist attrs;
-
-		fsal_prepare_attrs(&attrs, ATTR_SIZE);
-
-		if (!FSAL_IS_ERROR(obj->obj_ops.getattrs(obj, &attrs)))
-			eof_met = (offset + read_size) >= attrs.filesize;
-
-		/* Done with the attrs */
-		fsal_release_attrs(&attrs);
-	}
-
-	if (!anonymous_started && data->minorversion == 0)
+	if (!FSAL_IS_ERROR(fsal_status) &&
+	    !anonymous_started && data->minorversion == 0)
 		op_ctx->clientid = NULL;
 
-	res_READ4->READ4res_u.resok4.data.data_len = read_size;
-	res_READ4->READ4res_u.resok4.data.data_val = bufferdata;
-
-	LogFullDebug(COMPONENT_NFS_V4,
-		     "NFS4_OP_READ: offset = %" PRIu64
-		     " read length = %zu eof=%u", offset, read_size, eof_met);
-
-	/* Is EOF met or not ? */
-	res_READ4->READ4res_u.resok4.eof = eof_met;
-
-	/* Say it is ok */
-	res_READ4->status = NFS4_OK;
-
  done:
 
 	if (anonymous_started)
@@ -566,9 +682,15 @@ void nfs4_op_read_Free(nfs_resop4 *res)
 {
 	READ4res *resp = &res->nfs_resop4_u.opread;
 
-	if (resp->status == NFS4_OK)
-		if (resp->READ4res_u.resok4.data.data_val != NULL)
-			gsh_free(resp->READ4res_u.resok4.data.data_val);
+	if (resp->status != NFS4_OK)
+		return;
+
+	if (resp->READ4res_u.resok4.rbuf != NULL)
+		fsal_read_buf_put(resp->READ4res_u.resok4.rbuf);
+	else
+		iobuf_free(nfs_iobuf_pool,
+			   resp->READ4res_u.resok4.data.data_val,
+			   resp->READ4res_u.resok4.data_bufsize);
 }
 
 /**
@@ -596,12 +718,22 @@ int nfs4_op_read_plus(struct nfs_argop4 *op, compound_data_t *data,
 
 	resp->resop = NFS4_OP_READ_PLUS;
 
+	/* An FSAL that knows nothing of holes leaves this as data */
+	memset(&info, 0, sizeof(info));
+	info.io_content.what = NFS4_CONTENT_DATA;
+
 	nfs4_read(op, data, &res, FSAL_IO_READ_PLUS, &info);
 
 	res_RPLUS->rpr_status = res_READ4->status;
 	if (res_RPLUS->rpr_status != NFS4_OK)
 		return res_RPLUS->rpr_status;
 
+	/* Kept whether or not the FSAL reports a hole */
+	res_RPLUS->rpr_resok4.rpr_buf =
+			res_READ4->READ4res_u.resok4.data.data_val;
+	res_RPLUS->rpr_resok4.rpr_bufsize =
+			res_READ4->READ4res_u.resok4.data_bufsize;
+
 	contentp->what = info.io_content.what;
 	res_RPLUS->rpr_resok4.rpr_contents_count = 1;
 	res_RPLUS->rpr_resok4.rpr_eof =
@@ -612,11 +744,11 @@ int nfs4_op_read_plus(struct nfs_argop4 *op, compound_data_t *data,
 		contentp->hole.di_length = info.io_content.hole.di_length;
 	}
 	if (info.io_content.what == NFS4_CONTENT_DATA) {
-		contentp->data.d_offset = info.io_content.data.d_offset;
+		contentp->data.d_offset = op->nfs_argop4_u.opread.offset;
 		contentp->data.d_data.data_len =
-					info.io_content.data.d_data.data_len;
+				res_READ4->READ4res_u.resok4.data.data_len;
 		contentp->data.d_data.data_val =
-					info.io_content.data.d_data.data_val;
+				res_READ4->READ4res_u.resok4.data.data_val;
 	}
 	return res_RPLUS->rpr_status;
 }
@@ -624,11 +756,10 @@ int nfs4_op_read_plus(struct nfs_argop4 *op, compound_data_t *data,
 void nfs4_op_read_plus_Free(nfs_resop4 *res)
 {
 	READ_PLUS4res *resp = &res->nfs_resop4_u.opread_plus;
-	contents *conp = &resp->rpr_resok4.rpr_contents;
 
-	if (resp->rpr_status == NFS4_OK && conp->what == NFS4_CONTENT_DATA)
-		if (conp->data.d_data.data_val != NULL)
-			gsh_free(conp->data.d_data.data_val);
+	if (resp->rpr_status == NFS4_OK)
+		iobuf_free(nfs_iobuf_pool, resp->rpr_resok4.rpr_buf,
+			   resp->rpr_resok4.rpr_bufsize);
 }
 
 /**
@@ -762,25 +893,33 @@ int nfs4_op_seek(struct nfs_argop4 *op, compound_data_t *data,
 	if (res_SEEK->sr_status != NFS4_OK)
 		goto done;
 
-	if (state_found != NULL) {
+	memset(&info, 0, sizeof(info));
+	if (state_found != NULL)
 		info.io_advise = state_found->state_data.io_advise;
-		info.io_content.what = arg_SEEK->sa_what;
+	info.io_content.what = arg_SEEK->sa_what;
 
-		if (arg_SEEK->sa_what == NFS4_CONTENT_DATA ||
-				arg_SEEK->sa_what == NFS4_CONTENT_HOLE) {
-			info.io_content.hole.di_offset = arg_SEEK->sa_offset;
-}
-		else
-			info.io_content.adb.adb_offset = arg_SEEK->sa_offset;
+	if (arg_SEEK->sa_what == NFS4_CONTENT_DATA ||
+	    arg_SEEK->sa_what == NFS4_CONTENT_HOLE)
+		info.io_content.hole.di_offset = arg_SEEK->sa_offset;
+	else
+		info.io_content.adb.adb_offset = arg_SEEK->sa_offset;
 
+	if (obj->fsal->m_ops.support_ex(obj)) {
+		/* Any stateid will do, the FSAL finds a descriptor */
+		fsal_status = obj->obj_ops.seek2(obj, state_found, &info);
+	} else if (state_found != NULL) {
 		fsal_status = obj->obj_ops.seek(obj, &info);
-		if (FSAL_IS_ERROR(fsal_status)) {
-			res_SEEK->sr_status = NFS4ERR_NXIO;
-			goto done;
-		}
-		res_SEEK->sr_resok4.sr_eof = info.io_eof;
-		res_SEEK->sr_resok4.sr_offset = info.io_content.hole.di_offset;
+	} else {
+		res_SEEK->sr_status = NFS4ERR_NOTSUPP;
+		goto done;
+	}
+
+	if (FSAL_IS_ERROR(fsal_status)) {
+		res_SEEK->sr_status = NFS4ERR_NXIO;
+		goto done;
 	}
+	res_SEEK->sr_resok4.sr_eof = info.io_eof;
+	res_SEEK->sr_resok4.sr_offset = info.io_content.hole.di_offset;
 done:
 	LogDebug(COMPONENT_NFS_V4,
 		 "Status  %s type %d offset %" PRIu64,
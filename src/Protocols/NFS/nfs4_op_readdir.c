@@ -35,21 +35,25 @@
 #include "nfs_convert.h"
 #include "export_mgr.h"
 
+/* The cookie verifier, the NULL ending the entries and eof */
+#define READDIR4_RESOK_XDR (NFS4_VERIFIER_SIZE + 2 * BYTES_PER_XDR_UNIT)
+
 /**
  * @brief Opaque bookkeeping structure for NFSv4 readdir
  *
  * This structure keeps track of the process of writing out an NFSv4
- * READDIR response between calls to nfs4_readdir_callback.
+ * READDIR response between calls to nfs4_readdir_callback.  Entries
+ * are XDR encoded into one buffer as they are found, so the stream
+ * running out of room is what stops the readdir at maxcount.
  */
 
 struct nfs4_readdir_cb_data {
-	entry4 *entries;	/*< The array holding individual entries */
-	size_t mem_left;	/*< The amount of memory remaining before we
-				   hit maxcount */
+	XDR xdr;		/*< Stream over the encoded entries */
+	char *entries_xdr;	/*< The buffer the entries go into */
+	u_int entries_xdr_len;	/*< The size of that buffer */
 	size_t count;		/*< The count of complete entries stored in the
 				   buffer */
-	size_t total_entries;	/*< The total number of entries available
-				   in the array */
+	size_t total_entries;	/*< The most entries to return */
 	nfsstat4 error;		/*< Set to a value other than NFS4_OK if the
 				   callback function finds a fatal error. */
 	struct bitmap4 *req_attr;	/*< The requested attributes */
@@ -78,11 +82,46 @@ static void restore_data(struct nfs4_readdir_cb_data *tracker)
 }
 
 /**
- * @brief Populate entry4s when called from fsal_readdir
+ * @brief Append an entry to the encoded READDIR reply
+ *
+ * The attribute values were built in the compound's arena; once they
+ * are in the stream that space is handed back for the next entry.
  *
- * This function is a callback passed to fsal_readdir.  It
- * fills in a pre-allocated array of entry4 structures and allocates
- * space for the name and attributes.  This space must be freed.
+ * @param[in,out] tracker  The readdir in progress
+ * @param[in]     entry    The entry, its nextentry is not used
+ *
+ * @return false if the entry did not fit, leaving the stream as it was.
+ */
+static bool nfs4_readdir_encode_entry(struct nfs4_readdir_cb_data *tracker,
+				      entry4 *entry)
+{
+	XDR *xdrs = &tracker->xdr;
+	u_int start = xdr_getpos(xdrs);
+	bool_t follows = TRUE;
+	bool fits;
+
+	fits = xdr_bool(xdrs, &follows) &&
+	       xdr_nfs_cookie4(xdrs, &entry->cookie) &&
+	       xdr_component4(xdrs, &entry->name) &&
+	       xdr_fattr4(xdrs, &entry->attrs);
+
+	if (!fits)
+		xdr_setpos(xdrs, start);
+
+	if (entry->attrs.attr_vals.attrlist4_val != NULL)
+		mem_arena_trim(&tracker->data->arena,
+			       entry->attrs.attr_vals.attrlist4_val,
+			       entry->attrs.attr_vals.attrlist4_len, 0);
+
+	return fits;
+}
+
+/**
+ * @brief Encode entry4s when called from fsal_readdir
+ *
+ * This function is a callback passed to fsal_readdir.  It builds each
+ * entry on the stack, with its attributes in the compound's arena,
+ * and encodes it straight into the reply's entry buffer.
  *
  * @param[in,out] opaque A struct nfs4_readdir_cb_data that stores the
  *                       location of the array and other bookeeping
@@ -110,7 +149,7 @@ fsal_errors_t nfs4_readdir_callback(void *opaque,
 	struct xdr_attrs_args args;
 	compound_data_t *data = tracker->data;
 	nfsstat4 rdattr_error = NFS4_OK;
-	entry4 *tracker_entry = tracker->entries + tracker->count;
+	entry4 entry;
 	fsal_status_t fsal_status;
 	fsal_accessflags_t access_mask_attr = 0;
 
@@ -161,6 +200,13 @@ fsal_errors_t nfs4_readdir_callback(void *opaque,
 			goto not_junction;
 		}
 
+		if (!export_is_active(obj->state_hdl->dir.junction_export)) {
+			/* A Lazy_Init export is not created for a listing,
+			 * show the junction itself until it is looked up.
+			 */
+			goto not_junction;
+		}
+
 		get_gsh_export_ref(obj->state_hdl->dir.junction_export);
 
 		/* Save the compound data context */
@@ -275,39 +321,13 @@ not_junction:
 
 	/* Now process the entry */
 	memset(val_fh, 0, NFS4_FHSIZE);
+	memset(&entry, 0, sizeof(entry));
+	entry.cookie = cookie;
 
-	/* Bits that don't require allocation */
-	if (tracker->mem_left < sizeof(entry4)) {
-		if (tracker->count == 0)
-			tracker->error = NFS4ERR_TOOSMALL;
-
-		goto failure;
-	}
-
-	tracker->mem_left -= sizeof(entry4);
-	tracker_entry->cookie = cookie;
-	tracker_entry->nextentry = NULL;
-
-	/* The filename.  We don't use str2utf8 because that has an
-	 * additional copy into a buffer before copying into the
-	 * destination.
-	 */
+	/* The filename is encoded straight from the FSAL's copy */
 	namelen = strlen(cb_parms->name);
-
-	if (tracker->mem_left < (namelen + 1)) {
-		if (tracker->count == 0)
-			tracker->error = NFS4ERR_TOOSMALL;
-
-		goto failure;
-	}
-
-	tracker->mem_left -= (namelen + 1);
-	tracker_entry->name.utf8string_len = namelen;
-	tracker_entry->name.utf8string_val = gsh_malloc(namelen + 1);
-
-	memcpy(tracker_entry->name.utf8string_val,
-	       cb_parms->name,
-	       namelen);
+	entry.name.utf8string_len = namelen;
+	entry.name.utf8string_val = (char *)cb_parms->name;
 
 	/* If we carried an error from above, now that we have
 	 * the name set up, go ahead and try and put error in
@@ -365,10 +385,11 @@ not_junction:
 	args.mounted_on_fileid = mounted_on_fileid;
 	args.fileid = obj->fileid;
 	args.fsid = obj->fsid;
+	args.arena = &data->arena;
 
 	if (nfs4_FSALattr_To_Fattr(&args,
 				   tracker->req_attr,
-				   &tracker_entry->attrs) != 0) {
+				   &entry.attrs) != 0) {
 		LogCrit(COMPONENT_NFS_READDIR,
 			"nfs4_FSALattr_To_Fattr failed to convert attr");
 		goto server_fault;
@@ -386,31 +407,22 @@ not_junction:
 	if (rdattr_error != NFS4_OK) {
 		if (!attribute_is_set(tracker->req_attr, FATTR4_RDATTR_ERROR)) {
 			tracker->error = rdattr_error;
-			goto failure;
+			goto not_inresult;
 		}
 
-		if (nfs4_Fattr_Fill_Error(&tracker_entry->attrs,
-					  rdattr_error) == -1)
+		if (nfs4_Fattr_Fill_Error(&entry.attrs,
+					  rdattr_error, &data->arena) == -1)
 			goto server_fault;
 	}
 
-	if (tracker->mem_left <
-	    ((tracker_entry->attrs.attrmask.bitmap4_len * sizeof(uint32_t))
-	     + (tracker_entry->attrs.attr_vals.attrlist4_len))) {
+	if (!nfs4_readdir_encode_entry(tracker, &entry)) {
+		/* No room left before maxcount */
 		if (tracker->count == 0)
 			tracker->error = NFS4ERR_TOOSMALL;
 
-		goto failure;
+		goto not_inresult;
 	}
 
-	tracker->mem_left -= tracker_entry->attrs.attrmask.bitmap4_len *
-			     sizeof(uint32_t);
-
-	tracker->mem_left -= tracker_entry->attrs.attr_vals.attrlist4_len;
-
-	if (tracker->count != 0)
-		tracker->entries[tracker->count - 1].nextentry = tracker_entry;
-
 	++(tracker->count);
 	cb_parms->in_result = true;
 	goto out;
@@ -419,18 +431,6 @@ not_junction:
 
 	tracker->error = NFS4ERR_SERVERFAULT;
 
- failure:
-
-	if (tracker_entry->attrs.attr_vals.attrlist4_val != NULL) {
-		gsh_free(tracker_entry->attrs.attr_vals.attrlist4_val);
-		tracker_entry->attrs.attr_vals.attrlist4_val = NULL;
-	}
-
-	if (tracker_entry->name.utf8string_val != NULL) {
-		gsh_free(tracker_entry->name.utf8string_val);
-		tracker_entry->name.utf8string_val = NULL;
-	}
-
  not_inresult:
 
 	cb_parms->in_result = false;
@@ -440,28 +440,6 @@ not_junction:
 	return ERR_FSAL_NO_ERROR;
 }
 
-/**
- * @brief Free a list of entry4s
- *
- * This function frees a list of entry4s and all dependent strctures.
- *
- * @param[in,out] entries The entries to be freed
- */
-
-static void free_entries(entry4 *entries)
-{
-	entry4 *entry = NULL;
-
-	for (entry = entries; entry != NULL; entry = entry->nextentry) {
-		if (entry->attrs.attr_vals.attrlist4_val != NULL)
-			gsh_free(entry->attrs.attr_vals.attrlist4_val);
-
-		if (entry->name.utf8string_val != NULL)
-			gsh_free(entry->name.utf8string_val);
-	}
-	gsh_free(entries);
-}
-
 /**
  * @brief NFS4_OP_READDIR
  *
@@ -484,7 +462,6 @@ int nfs4_op_readdir(struct nfs_argop4 *op, compound_data_t *data,
 	bool eod_met = false;
 	unsigned long dircount = 0;
 	unsigned long maxcount = 0;
-	entry4 *entries = NULL;
 	verifier4 cookie_verifier;
 	uint64_t cookie = 0;
 	unsigned int estimated_num_entries = 0;
@@ -545,10 +522,10 @@ int nfs4_op_readdir(struct nfs_argop4 *op, compound_data_t *data,
 		goto out;
 	}
 
-	/* If maxcount is too short (14 should be enough for an empty
-	 * directory) return NFS4ERR_TOOSMALL
+	/* If maxcount is too short to hold even an empty directory
+	 * return NFS4ERR_TOOSMALL
 	 */
-	if (maxcount < 14 || estimated_num_entries == 0) {
+	if (maxcount < READDIR4_RESOK_XDR || estimated_num_entries == 0) {
 		res_READDIR4->status = NFS4ERR_TOOSMALL;
 		LogFullDebug(COMPONENT_NFS_READDIR,
 			     "Response too small");
@@ -608,11 +585,18 @@ int nfs4_op_readdir(struct nfs_argop4 *op, compound_data_t *data,
 		}
 	}
 
-	/* Prepare to read the entries */
-
-	entries = gsh_calloc(estimated_num_entries, sizeof(entry4));
-	tracker.entries = entries;
-	tracker.mem_left = maxcount - sizeof(READDIR4resok);
+	/* Prepare to read the entries, the buffer goes with the reply */
+	tracker.entries_xdr_len = maxcount - READDIR4_RESOK_XDR;
+
+	/* It is allocated whole, keep it within what a READ could ask for */
+	if (tracker.entries_xdr_len >
+	    atomic_fetch_uint64_t(&op_ctx->ctx_export->MaxRead))
+		tracker.entries_xdr_len =
+			atomic_fetch_uint64_t(&op_ctx->ctx_export->MaxRead);
+	tracker.entries_xdr = mem_arena_alloc(&data->arena,
+					      tracker.entries_xdr_len);
+	xdrmem_create(&tracker.xdr, tracker.entries_xdr,
+		      tracker.entries_xdr_len, XDR_ENCODE);
 	tracker.count = 0;
 	tracker.error = NFS4_OK;
 	tracker.req_attr = &arg_READDIR4->attr_request;
@@ -636,6 +620,22 @@ int nfs4_op_readdir(struct nfs_argop4 *op, compound_data_t *data,
 				   nfs4_readdir_callback,
 				   &tracker);
 
+	res_READDIR4->READDIR4res_u.resok4.reply.entries = NULL;
+	res_READDIR4->READDIR4res_u.resok4.reply.entries_xdr = NULL;
+	res_READDIR4->READDIR4res_u.resok4.reply.entries_xdr_len = 0;
+
+	if (tracker.count != 0) {
+		/* Put the encoded entries in the READDIR reply if
+		 * there were any.
+		 */
+		res_READDIR4->READDIR4res_u.resok4.reply.entries_xdr =
+			tracker.entries_xdr;
+		res_READDIR4->READDIR4res_u.resok4.reply.entries_xdr_len =
+			xdr_getpos(&tracker.xdr);
+	}
+
+	xdr_destroy(&tracker.xdr);
+
 	if (FSAL_IS_ERROR(fsal_status)) {
 		res_READDIR4->status = nfs4_Errno_status(fsal_status);
 		LogFullDebug(COMPONENT_NFS_READDIR,
@@ -656,17 +656,6 @@ int nfs4_op_readdir(struct nfs_argop4 *op, compound_data_t *data,
 		goto out;
 	}
 
-	if (tracker.count != 0) {
-		/* Put the entry's list in the READDIR reply if
-		 * there were any.
-		 */
-		res_READDIR4->READDIR4res_u.resok4.reply.entries = entries;
-	} else {
-		gsh_free(entries);
-		entries = NULL;
-		res_READDIR4->READDIR4res_u.resok4.reply.entries = NULL;
-	}
-
 	/* This slight bit of oddness is caused by most booleans
 	 * throughout Ganesha being of C99's bool type (taking the values
 	 * true and false), but fields in XDR being of the older bool_t
@@ -685,9 +674,6 @@ int nfs4_op_readdir(struct nfs_argop4 *op, compound_data_t *data,
 	res_READDIR4->status = NFS4_OK;
 
  out:
-	if ((res_READDIR4->status != NFS4_OK) && (entries != NULL))
-		free_entries(entries);
-
 	LogFullDebug(COMPONENT_NFS_READDIR,
 		     "Returning %s",
 		     nfsstat4_to_str(res_READDIR4->status));
@@ -705,7 +691,5 @@ int nfs4_op_readdir(struct nfs_argop4 *op, compound_data_t *data,
  */
 void nfs4_op_readdir_Free(nfs_resop4 *res)
 {
-	READDIR4res *resp = &res->nfs_resop4_u.opreaddir;
-
-	free_entries(resp->READDIR4res_u.resok4.reply.entries);
+	/* Entries live in the compound's arena */
 }				/* nfs4_op_readdir_Free */
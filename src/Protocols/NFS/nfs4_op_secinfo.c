@@ -148,6 +148,13 @@ int nfs4_op_secinfo(struct nfs_argop4 *op, compound_data_t *data,
 		/* Only other error is NFS4ERR_WRONGSEC which is actually
 		 * what we expect here. Finish crossing the junction.
 		 */
+		if (!export_activate(op_ctx->ctx_export)) {
+			/* Lazy_Init export could not be created */
+			res_SECINFO4->status = NFS4ERR_DELAY;
+			goto out;
+		}
+		op_ctx->fsal_export = op_ctx->ctx_export->fsal_export;
+
 		fsal_status = nfs_export_get_root_entry(op_ctx->ctx_export,
 							&obj);
 
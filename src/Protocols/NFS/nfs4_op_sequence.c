@@ -35,6 +35,59 @@
 #include "nfs_rpc_callback.h"
 #include "nfs_convert.h"
 
+/**
+ * @brief SEQUENCE on a slot that is busy or out of step
+ *
+ * Either a replay, which is answered from the slot's cached reply
+ * unless the original is still in progress, or a misordered request.
+ *
+ * @param[in]     arg  SEQUENCE arguments
+ * @param[in]     slot The slot named in the arguments
+ * @param[in,out] data Compound request's data
+ *
+ * @return NFS4_OK to replay, or an error.
+ */
+static nfsstat4 nfs4_sequence_slow(SEQUENCE4args *arg,
+				   nfs41_session_slot_t *slot,
+				   compound_data_t *data)
+{
+	nfsstat4 status = NFS4ERR_SEQ_MISORDERED;
+
+	PTHREAD_MUTEX_lock(&slot->lock);
+
+	if (atomic_fetch_uint32_t(&slot->sequence) != arg->sa_sequenceid)
+		goto out;
+
+	if (atomic_fetch_uint32_t(&slot->busy)) {
+		/* The reply has not been cached yet */
+		status = NFS4ERR_DELAY;
+		goto out;
+	}
+
+	/* Ganesha always caches the result, so ignore cachethis.  A slot
+	 * given up by a shrink has no reply left, though.
+	 */
+	data->replay = nfs41_slot_get_reply(slot);
+	if (data->replay == NULL) {
+		/* Illegal replay */
+		status = NFS4ERR_RETRY_UNCACHED_REP;
+		goto out;
+	}
+
+	/* Replay operation through the DRC */
+	data->use_drc = true;
+
+	LogFullDebugAlt(COMPONENT_SESSIONS, COMPONENT_CLIENTID,
+			"Use sesson slot %" PRIu32 "=%p for DRC",
+			arg->sa_slotid, data->replay);
+
+	status = NFS4_OK;
+
+ out:
+	PTHREAD_MUTEX_unlock(&slot->lock);
+	return status;
+}
+
 /**
  * @brief the NFS4_OP_SEQUENCE operation
  *
@@ -54,6 +107,9 @@ int nfs4_op_sequence(struct nfs_argop4 *op, compound_data_t *data,
 	SEQUENCE4res * const res_SEQUENCE4 = &resp->nfs_resop4_u.opsequence;
 
 	nfs41_session_t *session;
+	nfs41_session_slot_t *slot;
+	slotid4 target;
+	bool fast = false;
 
 	resp->resop = NFS4_OP_SEQUENCE;
 	res_SEQUENCE4->sr_status = NFS4_OK;
@@ -114,63 +170,28 @@ int nfs4_op_sequence(struct nfs_argop4 *op, compound_data_t *data,
 	/* By default, no DRC replay */
 	data->use_drc = false;
 
-	PTHREAD_MUTEX_lock(&session->slots[arg_SEQUENCE4->sa_slotid].lock);
-	if (session->slots[arg_SEQUENCE4->sa_slotid].sequence + 1 !=
-	    arg_SEQUENCE4->sa_sequenceid) {
-		if (session->slots[arg_SEQUENCE4->sa_slotid].sequence ==
-		    arg_SEQUENCE4->sa_sequenceid) {
-#if IMPLEMENT_CACHETHIS
-			/** @todo
-			 *
-			 * Ganesha always caches result anyway so ignore
-			 * cachethis
-			 */
-			if (session->slots[arg_SEQUENCE4->sa_slotid]
-			    .cache_used) {
-#endif
-				/* Replay operation through the DRC */
-				data->use_drc = true;
-				data->cached_res =
-				    &session->slots[arg_SEQUENCE4->sa_slotid].
-				    cached_result;
-
-				LogFullDebugAlt(COMPONENT_SESSIONS,
-						COMPONENT_CLIENTID,
-						"Use sesson slot %" PRIu32
-						"=%p for DRC",
-						arg_SEQUENCE4->sa_slotid,
-						data->cached_res);
-
-				PTHREAD_MUTEX_unlock(&session->
-					slots[arg_SEQUENCE4->sa_slotid].lock);
-				dec_session_ref(session);
-				res_SEQUENCE4->sr_status = NFS4_OK;
-				return res_SEQUENCE4->sr_status;
-#if IMPLEMENT_CACHETHIS
-			} else {
-				/* Illegal replay */
-				PTHREAD_MUTEX_unlock(&session->
-					slots[arg_SEQUENCE4->sa_slotid].lock);
-				dec_session_ref(session);
-				res_SEQUENCE4->sr_status =
-				    NFS4ERR_RETRY_UNCACHED_REP;
-				LogDebugAlt(COMPONENT_SESSIONS,
-					    COMPONENT_CLIENTID,
-					    "SEQUENCE returning status %s",
-					    nfsstat4_to_str(res_SEQUENCE4->
-							    sr_status));
-				return res_SEQUENCE4->sr_status;
-			}
-#endif
-		}
+	slot = &session->slots[arg_SEQUENCE4->sa_slotid];
 
-		PTHREAD_MUTEX_unlock(&session->
-			slots[arg_SEQUENCE4->sa_slotid].lock);
+	/* The usual case is the next request on an idle slot: claim the
+	 * slot and take its sequence without the lock.  The claim holds
+	 * until nfs4_Compound has cached the reply.
+	 */
+	if (atomic_cas_uint32_t(&slot->busy, 0, 1)) {
+		if (atomic_fetch_uint32_t(&slot->sequence) + 1 ==
+		    arg_SEQUENCE4->sa_sequenceid)
+			fast = true;
+		else
+			atomic_store_uint32_t(&slot->busy, 0);
+	}
+
+	if (!fast) {
+		res_SEQUENCE4->sr_status = nfs4_sequence_slow(arg_SEQUENCE4,
+							      slot, data);
 		dec_session_ref(session);
-		res_SEQUENCE4->sr_status = NFS4ERR_SEQ_MISORDERED;
-		LogDebugAlt(COMPONENT_SESSIONS, COMPONENT_CLIENTID,
-			    "SEQUENCE returning status %s",
-			    nfsstat4_to_str(res_SEQUENCE4->sr_status));
+		if (res_SEQUENCE4->sr_status != NFS4_OK)
+			LogDebugAlt(COMPONENT_SESSIONS, COMPONENT_CLIENTID,
+				    "SEQUENCE returning status %s",
+				    nfsstat4_to_str(res_SEQUENCE4->sr_status));
 		return res_SEQUENCE4->sr_status;
 	}
 
@@ -182,18 +203,44 @@ int nfs4_op_sequence(struct nfs_argop4 *op, compound_data_t *data,
 	data->slot = arg_SEQUENCE4->sa_slotid;
 
 	/* Update the sequence id within the slot */
-	session->slots[arg_SEQUENCE4->sa_slotid].sequence += 1;
+	atomic_store_uint32_t(&slot->sequence, arg_SEQUENCE4->sa_sequenceid);
+
+	/* A client using every slot we asked it to is offered twice as
+	 * many, up to the size of its table.  One using under a quarter
+	 * of them is asked to give half back, and the replies cached in
+	 * the slots it gives up are freed.
+	 */
+	target = atomic_fetch_uint32_t(&session->target_highest_slotid);
+	if (arg_SEQUENCE4->sa_highest_slotid >= target &&
+	    target + 1 < session->fore_channel_attrs.ca_maxrequests) {
+		slotid4 grown = MIN(2 * target + 1,
+				    session->fore_channel_attrs.ca_maxrequests
+				    - 1);
+
+		if (atomic_cas_uint32_t(&session->target_highest_slotid,
+					target, grown))
+			target = grown;
+	} else if (arg_SEQUENCE4->sa_highest_slotid < target / 4) {
+		slotid4 shrunk = MAX(target / 2, NFS41_NB_SLOTS - 1);
+
+		if (shrunk < target &&
+		    atomic_cas_uint32_t(&session->target_highest_slotid,
+					target, shrunk)) {
+			nfs41_session_trim_slots(session, shrunk + 1);
+			target = shrunk;
+		}
+	}
 
 	memcpy(res_SEQUENCE4->SEQUENCE4res_u.sr_resok4.sr_sessionid,
 	       arg_SEQUENCE4->sa_sessionid, NFS4_SESSIONID_SIZE);
 	res_SEQUENCE4->SEQUENCE4res_u.sr_resok4.sr_sequenceid =
-	    session->slots[arg_SEQUENCE4->sa_slotid].sequence;
+	    arg_SEQUENCE4->sa_sequenceid;
 	res_SEQUENCE4->SEQUENCE4res_u.sr_resok4.sr_slotid =
 	    arg_SEQUENCE4->sa_slotid;
 	res_SEQUENCE4->SEQUENCE4res_u.sr_resok4.sr_highest_slotid =
-	    NFS41_NB_SLOTS - 1;
-	res_SEQUENCE4->SEQUENCE4res_u.sr_resok4.sr_target_highest_slotid =
 	    session->fore_channel_attrs.ca_maxrequests - 1;
+	res_SEQUENCE4->SEQUENCE4res_u.sr_resok4.sr_target_highest_slotid =
+	    target;
 
 	res_SEQUENCE4->SEQUENCE4res_u.sr_resok4.sr_status_flags = 0;
 
@@ -202,29 +249,12 @@ int nfs4_op_sequence(struct nfs_argop4 *op, compound_data_t *data,
 		    SEQ4_STATUS_CB_PATH_DOWN;
 	}
 
-#if IMPLEMENT_CACHETHIS
-/* Ganesha always caches result anyway so ignore cachethis */
-	if (arg_SEQUENCE4->sa_cachethis) {
-#endif
-		data->cached_res =
-		    &session->slots[arg_SEQUENCE4->sa_slotid].cached_result;
-		session->slots[arg_SEQUENCE4->sa_slotid].cache_used = true;
-
-		LogFullDebugAlt(COMPONENT_SESSIONS, COMPONENT_CLIENTID,
-				"Use sesson slot %" PRIu32 "=%p for DRC",
-				arg_SEQUENCE4->sa_slotid, data->cached_res);
-#if IMPLEMENT_CACHETHIS
-	} else {
-		data->cached_res = NULL;
-		session->slots[arg_SEQUENCE4->sa_slotid].cache_used = false;
-
-		LogFullDebugAlt(COMPONENT_SESSIONS, COMPONENT_CLIENTID,
-				"Don't use sesson slot %" PRIu32
-				"=NULL for DRC", arg_SEQUENCE4->sa_slotid);
-	}
-#endif
+	/* Ganesha always caches result anyway so ignore cachethis */
+	data->cache_slot = slot;
 
-	PTHREAD_MUTEX_unlock(&session->slots[arg_SEQUENCE4->sa_slotid].lock);
+	LogFullDebugAlt(COMPONENT_SESSIONS, COMPONENT_CLIENTID,
+			"Use sesson slot %" PRIu32 "=%p for DRC",
+			arg_SEQUENCE4->sa_slotid, slot);
 
 	/* If we were successful, stash the clientid in the request
 	 * context.
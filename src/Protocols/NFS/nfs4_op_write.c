@@ -42,6 +42,7 @@
 #include "fsal_pnfs.h"
 #include "server_stats.h"
 #include "export_mgr.h"
+#include "nfs_exports.h"
 
 /**
  * @brief Write for a data server
@@ -133,6 +134,101 @@ static int op_dswrite_plus(struct nfs_argop4 *op, compound_data_t *data,
 	return res_WRITE4->status;
 }
 
+/**
+ * @brief Fill in the result of a WRITE the FSAL is done with
+ */
+static void nfs4_write_result(WRITE4res *res_WRITE4,
+			      fsal_status_t fsal_status, size_t written_size,
+			      bool sync)
+{
+	struct gsh_buffdesc verf_desc;
+
+	if (FSAL_IS_ERROR(fsal_status)) {
+		LogDebug(COMPONENT_NFS_V4, "write returned %s",
+			 fsal_err_txt(fsal_status));
+		res_WRITE4->status = nfs4_Errno_status(fsal_status);
+		return;
+	}
+
+	/* Set the returned value */
+	if (sync)
+		res_WRITE4->WRITE4res_u.resok4.committed = FILE_SYNC4;
+	else
+		res_WRITE4->WRITE4res_u.resok4.committed = UNSTABLE4;
+
+	res_WRITE4->WRITE4res_u.resok4.count = written_size;
+
+	verf_desc.addr = res_WRITE4->WRITE4res_u.resok4.writeverf;
+	verf_desc.len = sizeof(verifier4);
+	op_ctx->fsal_export->exp_ops.get_write_verifier(op_ctx->fsal_export,
+							&verf_desc);
+
+	res_WRITE4->status = NFS4_OK;
+}
+
+/**
+ * @brief What a WRITE holds while its I/O is pending
+ */
+struct nfs4_write_io {
+	struct fsal_io_arg write_arg;
+	struct svc_req *req;
+	WRITE4res *res_WRITE4;
+	state_t *state_found;
+	state_t *state_open;
+	state_owner_t *owner;
+	bool anonymous_started;
+};
+
+/**
+ * @brief Complete a WRITE started without waiting for it
+ *
+ * The object stays referenced as the compound's current object, and
+ * the data in the arguments until the reply is sent.
+ */
+static void nfs4_write_done(struct fsal_obj_handle *obj,
+			    fsal_status_t fsal_status,
+			    struct fsal_io_arg *write_arg, void *caller_arg)
+{
+	struct nfs4_write_io *wio = caller_arg;
+	WRITE4res *res_WRITE4 = wio->res_WRITE4;
+	struct svc_req *req = wio->req;
+	struct req_op_context *saved_ctx = op_ctx;
+
+	op_ctx = nfs_req_op_ctx(req);
+
+	/* As fsal_write2() would */
+	if (fsal_status.major == ERR_FSAL_SHARE_DENIED)
+		fsal_status = fsalstat(ERR_FSAL_LOCKED, 0);
+	if (FSAL_IS_ERROR(fsal_status))
+		write_arg->io_amount = 0;
+
+	if (wio->owner != NULL)
+		op_ctx->clientid = NULL;
+
+	nfs4_write_result(res_WRITE4, fsal_status, write_arg->io_amount,
+			  write_arg->fsal_stable);
+
+	if (wio->anonymous_started)
+		state_share_anonymous_io_done(obj, OPEN4_SHARE_ACCESS_WRITE);
+
+	server_stats_io_done(write_arg->size, write_arg->io_amount,
+			     res_WRITE4->status == NFS4_OK, true);
+
+	if (wio->owner != NULL)
+		dec_state_owner_ref(wio->owner);
+
+	if (wio->state_found != NULL)
+		dec_state_t_ref(wio->state_found);
+
+	if (wio->state_open != NULL)
+		dec_state_t_ref(wio->state_open);
+
+	gsh_free(wio);
+
+	op_ctx = saved_ctx;
+	nfs_req_async_done(req, res_WRITE4->status);
+}
+
 /**
  * @brief The NFS4_OP_WRITE operation
  *
@@ -164,6 +260,7 @@ static int nfs4_write(struct nfs_argop4 *op, compound_data_t *data,
 	fsal_status_t fsal_status = {0, 0};
 	struct fsal_obj_handle *obj = NULL;
 	bool anonymous_started = false;
+	bool fallocate = false;
 	struct gsh_buffdesc verf_desc;
 	state_owner_t *owner = NULL;
 	uint64_t MaxWrite =
@@ -331,6 +428,15 @@ static int nfs4_write(struct nfs_argop4 *op, compound_data_t *data,
 	offset = arg_WRITE4->offset;
 	size = arg_WRITE4->data.data_len;
 	stable_how = arg_WRITE4->stable;
+
+	/* ALLOCATE and DEALLOCATE move no data and their length is 64 bit */
+	if (info != NULL &&
+	    (info->io_content.what == NFS4_CONTENT_ALLOCATE ||
+	     info->io_content.what == NFS4_CONTENT_DEALLOCATE)) {
+		fallocate = true;
+		size = info->io_content.hole.di_length;
+	}
+
 	LogFullDebug(COMPONENT_NFS_V4,
 		     "offset = %" PRIu64 "  length = %" PRIu64 "  stable = %d",
 		     offset, size, stable_how);
@@ -358,8 +464,8 @@ static int nfs4_write(struct nfs_argop4 *op, compound_data_t *data,
 		 * must restrict him
 		 */
 
-		if (info == NULL ||
-		    info->io_content.what != NFS4_CONTENT_HOLE) {
+		if (!fallocate && (info == NULL ||
+		    info->io_content.what != NFS4_CONTENT_HOLE)) {
 			LogFullDebug(COMPONENT_NFS_V4,
 				     "write requested size = %" PRIu64
 				     " write allowed size = %" PRIu64,
@@ -402,7 +508,40 @@ static int nfs4_write(struct nfs_argop4 *op, compound_data_t *data,
 		}
 	}
 
-	if (obj->fsal->m_ops.support_ex(obj)) {
+	if (fallocate && obj->fsal->m_ops.support_ex(obj)) {
+		/* The FSAL reserves or punches the whole range itself */
+		fsal_status = obj->obj_ops.fallocate(
+			obj, state_found, offset, size,
+			info->io_content.what == NFS4_CONTENT_ALLOCATE);
+
+		if (fsal_status.major == ERR_FSAL_SHARE_DENIED)
+			fsal_status = fsalstat(ERR_FSAL_LOCKED, 0);
+	} else if (!fallocate && info == NULL &&
+		   obj->fsal->m_ops.support_ex(obj) &&
+		   nfs4_io_async_begin(data)) {
+		/* Hand what we hold over to the completion */
+		struct nfs4_write_io *wio = gsh_calloc(1, sizeof(*wio));
+
+		wio->req = data->req;
+		wio->res_WRITE4 = res_WRITE4;
+		wio->state_found = state_found;
+		wio->state_open = state_open;
+		wio->owner = owner;
+		wio->anonymous_started = anonymous_started;
+		wio->write_arg.state = state_found;
+		wio->write_arg.offset = offset;
+		wio->write_arg.size = size;
+		wio->write_arg.buffer = bufferdata;
+		/* Force sync if export requires it, as fsal_write2() would */
+		wio->write_arg.fsal_stable = sync ||
+			(op_ctx->export_perms->options &
+			 EXPORT_OPTION_COMMIT) != 0;
+
+		data->async_pending = true;
+		obj->obj_ops.write2_async(obj, false, &wio->write_arg,
+					  nfs4_write_done, wio);
+		return NFS4_OK;
+	} else if (obj->fsal->m_ops.support_ex(obj)) {
 		/* Call the new fsal_write */
 		fsal_status = fsal_write2(obj, false, state_found, offset, size,
 					  &written_size, bufferdata, &sync,
@@ -413,39 +552,20 @@ static int nfs4_write(struct nfs_argop4 *op, compound_data_t *data,
 					bufferdata, &eof_met, &sync, info);
 	}
 
-	if (FSAL_IS_ERROR(fsal_status)) {
-		LogDebug(COMPONENT_NFS_V4, "write returned %s",
-			 fsal_err_txt(fsal_status));
-		res_WRITE4->status = nfs4_Errno_status(fsal_status);
-		goto done;
-	}
-
-	if (!anonymous_started && data->minorversion == 0)
+	if (!FSAL_IS_ERROR(fsal_status) &&
+	    !anonymous_started && data->minorversion == 0)
 		op_ctx->clientid = NULL;
 
-	/* Set the returned value */
-	if (sync)
-		res_WRITE4->WRITE4res_u.resok4.committed = FILE_SYNC4;
-	else
-		res_WRITE4->WRITE4res_u.resok4.committed = UNSTABLE4;
-
-	res_WRITE4->WRITE4res_u.resok4.count = written_size;
-
-	verf_desc.addr = res_WRITE4->WRITE4res_u.resok4.writeverf;
-	verf_desc.len = sizeof(verifier4);
-	op_ctx->fsal_export->exp_ops.get_write_verifier(op_ctx->fsal_export,
-							&verf_desc);
-
-	res_WRITE4->status = NFS4_OK;
+	nfs4_write_result(res_WRITE4, fsal_status, written_size, sync);
 
  done:
 
 	if (anonymous_started)
 		state_share_anonymous_io_done(obj, OPEN4_SHARE_ACCESS_WRITE);
 
-	server_stats_io_done(size, written_size,
-			     (res_WRITE4->status == NFS4_OK) ? true : false,
-			     true);
+	if (!fallocate)
+		server_stats_io_done(size, written_size,
+				     res_WRITE4->status == NFS4_OK, true);
 
  out:
 
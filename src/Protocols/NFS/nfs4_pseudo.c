@@ -326,6 +326,15 @@ bool pseudo_mount_export(struct gsh_export *export)
 			 export->pseudopath, tmp_pseudopath);
 	}
 
+	/* An export mounted on a Lazy_Init one needs its root */
+	if (!export_activate(op_ctx->ctx_export)) {
+		LogCrit(COMPONENT_EXPORT,
+			"BUILDING PSEUDOFS: Could not create Export_Id %d to mount Export_Id %d on",
+			op_ctx->ctx_export->export_id, export->export_id);
+		put_gsh_export(op_ctx->ctx_export);
+		return false;
+	}
+
 	op_ctx->fsal_export = op_ctx->ctx_export->fsal_export;
 
 	/* Put the slash back in */
@@ -40,6 +40,8 @@
 #include "nfs4_acls.h"
 #include "idmapper.h"
 #include "export_mgr.h"
+#include "peer_load.h"
+#include "abstract_atomic.h"
 
 /* Define mapping of NFS4 who name and type. */
 static struct {
@@ -690,55 +692,125 @@ static fattr_xdr_result decode_rdattr_error(XDR *xdr,
  * FATTR4_ACL
  */
 
+/* Most bytes an encoded ACE takes, with a name@domain who */
+#define ACE4_XDR_MAX (4 * BYTES_PER_XDR_UNIT + MAXNAMLEN + 1 + \
+		      NFS4_MAX_DOMAIN_LEN + BYTES_PER_XDR_UNIT)
+
+/* Largest ACL whose encoding is kept */
+#define ACL4_XDR_CACHE_MAX 256
+
+static bool encode_aces(XDR *xdr, fsal_acl_t *acl)
+{
+	fsal_ace_t *ace;
+	int i;
+	char *name = NULL;
+
+	for (ace = acl->aces; ace < acl->aces + acl->naces; ace++) {
+		LogFullDebug(COMPONENT_NFS_V4,
+			     "type=0X%x, flag=0X%x, perm=0X%x",
+			     ace->type, ace->flag, ace->perm);
+		if (!inline_xdr_u_int32_t(xdr, &ace->type))
+			return false;
+		if (!inline_xdr_u_int32_t(xdr, &ace->flag))
+			return false;
+		if (!inline_xdr_u_int32_t(xdr, &ace->perm))
+			return false;
+		if (IS_FSAL_ACE_SPECIAL_ID(*ace)) {
+			for (i = 0; i < FSAL_ACE_SPECIAL_EVERYONE; i++) {
+				if (whostr_2_type_map[i].type ==
+				    ace->who.uid) {
+					name = whostr_2_type_map[i].string;
+					break;
+				}
+			}
+			if (name == NULL ||
+			    !xdr_string(xdr, &name, MAXNAMLEN))
+				return false;
+		} else if (IS_FSAL_ACE_GROUP_ID(*ace)) {
+			/* Encode group name. */
+			if (!xdr_encode_nfs4_group(xdr, ace->who.gid))
+				return false;
+		} else {
+			if (!xdr_encode_nfs4_owner(xdr, ace->who.uid))
+				return false;
+		}
+	}			/* for ace... */
+
+	return true;
+}
+
+/**
+ * @brief Encode the ACEs of a shared ACL from its kept encoding
+ *
+ * An ACL is shared by every object that has the same ACEs, so its
+ * encoding is made once and copied out after.  The names in it are
+ * mapped by the idmapper, so it is kept no longer than a mapping is,
+ * and not past idmapper_clear_cache.
+ */
+
+static bool encode_aces_cached(XDR *xdr, fsal_acl_t *acl)
+{
+	uint32_t gen = atomic_fetch_uint32_t(&idmapper_generation);
+	time_t now = time(NULL);
+	uint32_t ttl = nfs_param.nfsv4_param.idmap_expiration;
+	uint32_t neg_ttl = nfs_param.nfsv4_param.idmap_negative_expiration;
+	size_t size = (size_t)acl->naces * ACE4_XDR_MAX;
+	XDR mem;
+	char *buf;
+	u_int len;
+	bool res;
+
+	if (acl->naces == 0 || acl->naces > ACL4_XDR_CACHE_MAX)
+		return encode_aces(xdr, acl);
+
+	PTHREAD_RWLOCK_rdlock(&acl->lock);
+	if (acl->xdr != NULL && acl->xdr_gen == gen &&
+	    (acl->xdr_expire == 0 || now < acl->xdr_expire)) {
+		res = xdr_opaque(xdr, acl->xdr, acl->xdr_len);
+		PTHREAD_RWLOCK_unlock(&acl->lock);
+		return res;
+	}
+	PTHREAD_RWLOCK_unlock(&acl->lock);
+
+	buf = gsh_malloc(size);
+	xdrmem_create(&mem, buf, size, XDR_ENCODE);
+	res = encode_aces(&mem, acl);
+	len = xdr_getpos(&mem);
+	xdr_destroy(&mem);
+
+	if (!res) {
+		gsh_free(buf);
+		return encode_aces(xdr, acl);
+	}
+
+	buf = gsh_realloc(buf, len);
+	res = xdr_opaque(xdr, buf, len);
+
+	/* Numeric names of unmapped ids are kept as long as those are */
+	if (ttl == 0 || (neg_ttl != 0 && neg_ttl < ttl))
+		ttl = neg_ttl;
+
+	PTHREAD_RWLOCK_wrlock(&acl->lock);
+	gsh_free(acl->xdr);
+	acl->xdr = buf;
+	acl->xdr_len = len;
+	acl->xdr_gen = gen;
+	acl->xdr_expire = ttl == 0 ? 0 : now + ttl;
+	PTHREAD_RWLOCK_unlock(&acl->lock);
+
+	return res;
+}
+
 static fattr_xdr_result encode_acl(XDR *xdr, struct xdr_attrs_args *args)
 {
 	if (args->attrs->acl) {
-		fsal_ace_t *ace;
-		int i;
-		char *name = NULL;
-
 		LogFullDebug(COMPONENT_NFS_V4, "Number of ACEs = %u",
 			     args->attrs->acl->naces);
 
 		if (!inline_xdr_u_int32_t(xdr, &(args->attrs->acl->naces)))
 			return FATTR_XDR_FAILED;
-		for (ace = args->attrs->acl->aces;
-		     ace < args->attrs->acl->aces + args->attrs->acl->naces;
-		     ace++) {
-			LogFullDebug(COMPONENT_NFS_V4,
-				     "type=0X%x, flag=0X%x, perm=0X%x",
-				     ace->type, ace->flag, ace->perm);
-			if (!inline_xdr_u_int32_t(xdr, &ace->type))
-				return FATTR_XDR_FAILED;
-			if (!inline_xdr_u_int32_t(xdr, &ace->flag))
-				return FATTR_XDR_FAILED;
-			if (!inline_xdr_u_int32_t(xdr, &ace->perm))
-				return FATTR_XDR_FAILED;
-			if (IS_FSAL_ACE_SPECIAL_ID(*ace)) {
-				for (i = 0;
-				     i < FSAL_ACE_SPECIAL_EVERYONE;
-				     i++) {
-					if (whostr_2_type_map[i].type ==
-					    ace->who.uid) {
-						name = whostr_2_type_map[i]
-							.string;
-						break;
-					}
-				}
-				if (name == NULL ||
-				    !xdr_string(xdr, &name, MAXNAMLEN))
-					return FATTR_XDR_FAILED;
-			} else if (IS_FSAL_ACE_GROUP_ID(*ace)) {
-				/* Encode group name. */
-				if (!xdr_encode_nfs4_group(xdr, ace->who.gid))
-					return FATTR_XDR_FAILED;
-			} else {
-				if (!xdr_encode_nfs4_owner
-				    (xdr, ace->who.uid)) {
-					return FATTR_XDR_FAILED;
-				}
-			}
-		}		/* for ace... */
+		if (!encode_aces_cached(xdr, args->attrs->acl))
+			return FATTR_XDR_FAILED;
 	} else {
 		uint32_t noacls = 0;
 
@@ -1190,6 +1262,72 @@ static fattr_xdr_result decode_files_total(XDR *xdr,
  * FATTR4_FS_LOCATIONS
  */
 
+/**
+ * @brief Encode every head serving the export, least loaded first
+ *
+ * The heads export the same filesystems at the same paths, so each
+ * location's root is the pseudo path of the current export.
+ */
+static fattr_xdr_result encode_fs_locations_balanced(XDR *xdr)
+{
+	const char *path = op_ctx->ctx_export->pseudopath;
+	struct peer_load *heads;
+	fs_locations4 fs_locs;
+	fs_location4 *locs;
+	component4 *servers;
+	component4 *comps;
+	uint32_t ix, n, ncomps = 0;
+	const char *p, *end;
+	fattr_xdr_result res = FATTR_XDR_SUCCESS;
+
+	for (p = path; *p != '\0'; p++)
+		if (*p == '/')
+			ncomps++;
+
+	heads = gsh_malloc(PEER_LOAD_HEADS * sizeof(*heads));
+	locs = gsh_malloc(PEER_LOAD_HEADS * sizeof(*locs));
+	servers = gsh_malloc(PEER_LOAD_HEADS * sizeof(*servers));
+	comps = gsh_calloc(ncomps + 1, sizeof(*comps));
+
+	/* Split the pseudo path in its components */
+	ncomps = 0;
+	for (p = path; *p != '\0'; p = end) {
+		while (*p == '/')
+			p++;
+		for (end = p; *end != '\0' && *end != '/'; end++)
+			;
+		if (end == p)
+			break;
+		comps[ncomps].utf8string_val = (char *)p;
+		comps[ncomps].utf8string_len = end - p;
+		ncomps++;
+	}
+
+	n = peer_load_ranked(heads, PEER_LOAD_HEADS);
+	for (ix = 0; ix < n; ix++) {
+		servers[ix].utf8string_val = heads[ix].address;
+		servers[ix].utf8string_len = strlen(heads[ix].address);
+		locs[ix].server.server_len = 1;
+		locs[ix].server.server_val = &servers[ix];
+		locs[ix].rootpath.pathname4_len = ncomps;
+		locs[ix].rootpath.pathname4_val = comps;
+	}
+
+	fs_locs.fs_root.pathname4_len = ncomps;
+	fs_locs.fs_root.pathname4_val = comps;
+	fs_locs.locations.locations_len = n;
+	fs_locs.locations.locations_val = locs;
+
+	if (!xdr_fs_locations4(xdr, &fs_locs))
+		res = FATTR_XDR_FAILED;
+
+	gsh_free(comps);
+	gsh_free(servers);
+	gsh_free(locs);
+	gsh_free(heads);
+	return res;
+}
+
 static fattr_xdr_result encode_fs_locations(XDR *xdr,
 					    struct xdr_attrs_args *args)
 {
@@ -1232,6 +1370,10 @@ static fattr_xdr_result encode_fs_locations(XDR *xdr,
 	st = args->data->current_obj->obj_ops.fs_locations(
 					args->data->current_obj,
 					&fs_locs);
+	if (FSAL_IS_ERROR(st) && peer_load_enabled() &&
+	    op_ctx->ctx_export != NULL)
+		return encode_fs_locations_balanced(xdr);
+
 	if (FSAL_IS_ERROR(st)) {
 		strcpy(root, "not_supported");
 		strcpy(path, "not_supported");
@@ -2388,10 +2530,13 @@ static fattr_xdr_result encode_support_exclusive_create(XDR *xdr,
 			assert(res);
 		}
 	}
-	res = clear_attribute_in_bitmap(&bits, FATTR4_TIME_ACCESS_SET);
-	assert(res);
-	res = clear_attribute_in_bitmap(&bits, FATTR4_TIME_MODIFY_SET);
-	assert(res);
+	if (op_ctx->fsal_export == NULL || !fsal_native_exclusive_create()) {
+		/* The verifier is kept in the times */
+		res = clear_attribute_in_bitmap(&bits, FATTR4_TIME_ACCESS_SET);
+		assert(res);
+		res = clear_attribute_in_bitmap(&bits, FATTR4_TIME_MODIFY_SET);
+		assert(res);
+	}
 	if (!inline_xdr_u_int32_t(xdr, &bits.bitmap4_len))
 		return FATTR_XDR_FAILED;
 	for (offset = 0; offset < bits.bitmap4_len; offset++) {
@@ -3314,58 +3459,286 @@ nfsstat4 file_To_Fattr(compound_data_t *data,
 	return NFS4_OK;
 }
 
-int nfs4_Fattr_Fill_Error(fattr4 *Fattr, nfsstat4 rdattr_error)
+/**
+ * @brief Fill an NFSv4 Fattr buffer with just FATTR4_RDATTR_ERROR
+ *
+ * @param[out] Fattr        NFSv4 Fattr buffer
+ * @param[in]  rdattr_error The error
+ * @param[in]  arena        Arena to allocate attr_vals from, or NULL
+ *			    for the heap
+ *
+ * @return -1 if failed, 0 if successful.
+ */
+int nfs4_Fattr_Fill_Error(fattr4 *Fattr, nfsstat4 rdattr_error,
+			  struct mem_arena *arena)
 {
-	u_int LastOffset;
-	XDR attr_body;
 	struct xdr_attrs_args args;
-	fattr_xdr_result xdr_res;
-
-	/* basic init */
-	memset(&Fattr->attrmask, 0, sizeof(Fattr->attrmask));
-	Fattr->attr_vals.attrlist4_val =
-	    gsh_malloc(fattr4tab[FATTR4_RDATTR_ERROR].size_fattr4);
+	struct bitmap4 bitmap;
 
-	LastOffset = 0;
-	memset(&attr_body, 0, sizeof(attr_body));
-	xdrmem_create(&attr_body, Fattr->attr_vals.attrlist4_val,
-		      fattr4tab[FATTR4_RDATTR_ERROR].size_fattr4, XDR_ENCODE);
 	memset(&args, 0, sizeof(args));
 	args.rdattr_error = rdattr_error;
+	args.arena = arena;
 
-	xdr_res = fattr4tab[FATTR4_RDATTR_ERROR].encode(&attr_body, &args);
-	if (xdr_res == FATTR_XDR_SUCCESS) {
-		bool res = set_attribute_in_bitmap(&Fattr->attrmask,
-						   FATTR4_RDATTR_ERROR);
-		assert(res);
-		LogFullDebug(COMPONENT_NFS_V4,
-			     "Encoded attribute %d, name = %s",
-			     FATTR4_RDATTR_ERROR,
-			     fattr4tab[FATTR4_RDATTR_ERROR].name);
+	memset(&bitmap, 0, sizeof(bitmap));
+	set_attribute_in_bitmap(&bitmap, FATTR4_RDATTR_ERROR);
 
-		/* mark the attribute in the bitmap should be new bitmap btw */
+	return nfs4_FSALattr_To_Fattr(&args, &bitmap, Fattr);
+}
+
+/*
+ * Fast fattr4 encoding
+ *
+ * The attributes the Linux client asks for in GETATTR and READDIR are
+ * nearly all fixed size and come straight from the attrlist.  When a
+ * request asks for nothing outside fattr4_fast_mask, each run of fixed
+ * size attributes is reserved with a single xdr_inline() and stored
+ * directly, with only the variable length attributes that break up
+ * the runs (filehandle, owner and owner_group) going through their
+ * usual encoders.  Anything else takes the generic path.
+ *
+ * Every attribute here is at or below FATTR4_MOUNTED_ON_FILEID, so
+ * none is ever beyond nfs4_max_attr_index() for any minor version.
+ */
+
+#define FATTR4_FAST_WORD(w, a) \
+	((a) / 32 == (w) ? (uint32_t) 1 << ((a) % 32) : 0)
+
+#define FATTR4_FAST_MASK(w)					\
+	(FATTR4_FAST_WORD(w, FATTR4_TYPE) |			\
+	 FATTR4_FAST_WORD(w, FATTR4_CHANGE) |			\
+	 FATTR4_FAST_WORD(w, FATTR4_SIZE) |			\
+	 FATTR4_FAST_WORD(w, FATTR4_FSID) |			\
+	 FATTR4_FAST_WORD(w, FATTR4_RDATTR_ERROR) |		\
+	 FATTR4_FAST_WORD(w, FATTR4_FILEHANDLE) |		\
+	 FATTR4_FAST_WORD(w, FATTR4_FILEID) |			\
+	 FATTR4_FAST_WORD(w, FATTR4_MODE) |			\
+	 FATTR4_FAST_WORD(w, FATTR4_NUMLINKS) |			\
+	 FATTR4_FAST_WORD(w, FATTR4_OWNER) |			\
+	 FATTR4_FAST_WORD(w, FATTR4_OWNER_GROUP) |		\
+	 FATTR4_FAST_WORD(w, FATTR4_RAWDEV) |			\
+	 FATTR4_FAST_WORD(w, FATTR4_SPACE_USED) |		\
+	 FATTR4_FAST_WORD(w, FATTR4_TIME_ACCESS) |		\
+	 FATTR4_FAST_WORD(w, FATTR4_TIME_METADATA) |		\
+	 FATTR4_FAST_WORD(w, FATTR4_TIME_MODIFY) |		\
+	 FATTR4_FAST_WORD(w, FATTR4_MOUNTED_ON_FILEID))
+
+static const uint32_t fattr4_fast_mask[BITMAP4_MAPLEN] = {
+	FATTR4_FAST_MASK(0),
+	FATTR4_FAST_MASK(1),
+	FATTR4_FAST_MASK(2),
+};
 
-		LastOffset = xdr_getpos(&attr_body);	/* dumb but for now */
-		xdr_destroy(&attr_body);
+/* Encoded size of each fixed size attribute in the fast mask, 0 for
+ * the variable length ones.
+ */
+static const uint8_t fattr4_fast_size[FATTR4_MOUNTED_ON_FILEID + 1] = {
+	[FATTR4_TYPE] = 4,
+	[FATTR4_CHANGE] = 8,
+	[FATTR4_SIZE] = 8,
+	[FATTR4_FSID] = 16,
+	[FATTR4_RDATTR_ERROR] = 4,
+	[FATTR4_FILEID] = 8,
+	[FATTR4_MODE] = 4,
+	[FATTR4_NUMLINKS] = 4,
+	[FATTR4_RAWDEV] = 8,
+	[FATTR4_SPACE_USED] = 8,
+	[FATTR4_TIME_ACCESS] = 12,
+	[FATTR4_TIME_METADATA] = 12,
+	[FATTR4_TIME_MODIFY] = 12,
+	[FATTR4_MOUNTED_ON_FILEID] = 8,
+};
+
+static inline bool fattr4_fast_bitmap(struct bitmap4 *bitmap)
+{
+	u_int ix;
+
+	if (bitmap->bitmap4_len > BITMAP4_MAPLEN)
+		return false;
 
-		if (LastOffset == 0) {	/* no supported attrs so we can free */
-			assert(Fattr->attrmask.bitmap4_len == 0);
-			gsh_free(Fattr->attr_vals.attrlist4_val);
-			Fattr->attr_vals.attrlist4_val = NULL;
+	for (ix = 0; ix < bitmap->bitmap4_len; ix++) {
+		if ((bitmap->map[ix] & ~fattr4_fast_mask[ix]) != 0)
+			return false;
+	}
+
+	return true;
+}
+
+static inline int32_t *fattr4_put_u64(int32_t *buf, uint64_t val)
+{
+	IXDR_PUT_U_INT32(buf, (uint32_t) (val >> 32));
+	IXDR_PUT_U_INT32(buf, (uint32_t) val);
+	return buf;
+}
+
+static inline int32_t *fattr4_put_time(int32_t *buf, struct timespec *ts)
+{
+	buf = fattr4_put_u64(buf, ts->tv_sec);
+	IXDR_PUT_U_INT32(buf, (uint32_t) ts->tv_nsec);
+	return buf;
+}
+
+/**
+ * @brief Store one fixed size attribute
+ *
+ * Produces the same bytes as the attribute's fattr4tab encoder.
+ *
+ * @return The position after the attribute, or NULL if it can not be
+ *         encoded.
+ */
+static int32_t *fattr4_fast_put(int32_t *buf, int attr,
+				struct xdr_attrs_args *args)
+{
+	struct attrlist *attrs = args->attrs;
+	uint32_t file_type;
+
+	switch (attr) {
+	case FATTR4_TYPE:
+		switch (attrs->type) {
+		case REGULAR_FILE:
+		case EXTENDED_ATTR:
+			file_type = NF4REG;
+			break;
+		case DIRECTORY:
+			file_type = NF4DIR;
+			break;
+		case BLOCK_FILE:
+			file_type = NF4BLK;
+			break;
+		case CHARACTER_FILE:
+			file_type = NF4CHR;
+			break;
+		case SYMBOLIC_LINK:
+			file_type = NF4LNK;
+			break;
+		case SOCKET_FILE:
+			file_type = NF4SOCK;
+			break;
+		case FIFO_FILE:
+			file_type = NF4FIFO;
+			break;
+		default:
+			return NULL;
 		}
-		Fattr->attr_vals.attrlist4_len = LastOffset;
-		return 0;
-	} else {
-		LogFullDebug(COMPONENT_NFS_V4,
-			     "Encode FAILED for attribute %d, name = %s",
-			     FATTR4_RDATTR_ERROR,
-			     fattr4tab[FATTR4_RDATTR_ERROR].name);
-		/* signal fail so if(LastOffset > 0) works right */
+		IXDR_PUT_U_INT32(buf, file_type);
+		return buf;
+	case FATTR4_CHANGE:
+		return fattr4_put_u64(buf, attrs->change);
+	case FATTR4_SIZE:
+		return fattr4_put_u64(buf, attrs->filesize);
+	case FATTR4_FSID:
+		if (args->data != NULL &&
+		    op_ctx_export_has_option_set(EXPORT_OPTION_FSID_SET)) {
+			buf = fattr4_put_u64(buf,
+				op_ctx->ctx_export->filesystem_id.major);
+			return fattr4_put_u64(buf,
+				op_ctx->ctx_export->filesystem_id.minor);
+		}
+		buf = fattr4_put_u64(buf, args->fsid.major);
+		return fattr4_put_u64(buf, args->fsid.minor);
+	case FATTR4_RDATTR_ERROR:
+		IXDR_PUT_U_INT32(buf, args->rdattr_error);
+		return buf;
+	case FATTR4_FILEID:
+		return fattr4_put_u64(buf, args->fileid);
+	case FATTR4_MODE:
+		IXDR_PUT_U_INT32(buf, fsal2unix_mode(attrs->mode));
+		return buf;
+	case FATTR4_NUMLINKS:
+		IXDR_PUT_U_INT32(buf, attrs->numlinks);
+		return buf;
+	case FATTR4_RAWDEV:
+		IXDR_PUT_U_INT32(buf, attrs->rawdev.major);
+		IXDR_PUT_U_INT32(buf, attrs->rawdev.minor);
+		return buf;
+	case FATTR4_SPACE_USED:
+		return fattr4_put_u64(buf, attrs->spaceused);
+	case FATTR4_TIME_ACCESS:
+		return fattr4_put_time(buf, &attrs->atime);
+	case FATTR4_TIME_METADATA:
+		return fattr4_put_time(buf, &attrs->ctime);
+	case FATTR4_TIME_MODIFY:
+		return fattr4_put_time(buf, &attrs->mtime);
+	case FATTR4_MOUNTED_ON_FILEID:
+		return fattr4_put_u64(buf, args->mounted_on_fileid);
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Encode a bitmap within fattr4_fast_mask
+ *
+ * @param[in]  args    XDR attribute arguments
+ * @param[in]  Bitmap  Bitmap of attributes being requested
+ * @param[out] Fattr   Attribute mask of what was encoded
+ * @param[in]  xdr     Stream for the attribute values
+ *
+ * @return true if every attribute was encoded.
+ */
+static bool fattr4_fast_encode(struct xdr_attrs_args *args,
+			       struct bitmap4 *Bitmap, fattr4 *Fattr,
+			       XDR *xdr)
+{
+	int attr, next;
+	uint32_t run;
+	int32_t *buf;
+
+	attr = next_attr_from_bitmap(Bitmap, -1);
+
+	while (attr != -1) {
+		if (fattr4_fast_size[attr] == 0) {
+			if (fattr4tab[attr].encode(xdr, args) !=
+			    FATTR_XDR_SUCCESS)
+				return false;
+
+			set_attribute_in_bitmap(&Fattr->attrmask, attr);
+			attr = next_attr_from_bitmap(Bitmap, attr);
+			continue;
+		}
+
+		/* Reserve the whole run of fixed size attributes at once */
+		run = 0;
+		for (next = attr;
+		     next != -1 && fattr4_fast_size[next] != 0;
+		     next = next_attr_from_bitmap(Bitmap, next))
+			run += fattr4_fast_size[next];
+
+		buf = xdr_inline(xdr, run);
+		if (buf == NULL)
+			return false;
+
+		for (; attr != next;
+		     attr = next_attr_from_bitmap(Bitmap, attr)) {
+			buf = fattr4_fast_put(buf, attr, args);
+			if (buf == NULL)
+				return false;
+
+			set_attribute_in_bitmap(&Fattr->attrmask, attr);
+		}
+	}
+
+	return true;
+}
 
+/**
+ * @brief Give back the attr_vals buffer beyond what was encoded
+ *
+ * @param[in]     args   XDR attribute arguments
+ * @param[in,out] Fattr  NFSv4 Fattr buffer
+ * @param[in]     len    Bytes encoded, 0 to give back all of it
+ */
+static void fattr4_trim_vals(struct xdr_attrs_args *args, fattr4 *Fattr,
+			     u_int len)
+{
+	if (args->arena != NULL) {
+		mem_arena_trim(args->arena, Fattr->attr_vals.attrlist4_val,
+			       NFS4_ATTRVALS_BUFFLEN, len);
+	} else if (len == 0) {
 		gsh_free(Fattr->attr_vals.attrlist4_val);
-		Fattr->attr_vals.attrlist4_val = NULL;
-		return -1;
 	}
+
+	if (len == 0)
+		Fattr->attr_vals.attrlist4_val = NULL;
 }
 
 /**
@@ -3377,8 +3750,9 @@ int nfs4_Fattr_Fill_Error(fattr4 *Fattr, nfsstat4 rdattr_error)
  * @param[in]  Bitmap  Bitmap of attributes being requested
  * @param[out] Fattr   NFSv4 Fattr buffer
  *		       Memory for bitmap_val and attr_val is
- *                     dynamically allocated,
- *		       caller is responsible for freeing it.
+ *                     dynamically allocated, from args->arena if
+ *		       set, otherwise the caller is responsible for
+ *		       freeing it.
  *
  * @return -1 if failed, 0 if successful.
  *
@@ -3400,7 +3774,12 @@ int nfs4_FSALattr_To_Fattr(struct xdr_attrs_args *args, struct bitmap4 *Bitmap,
 	if (Bitmap->bitmap4_len == 0)
 		return 0;	/* they ask for nothing, they get nothing */
 
-	Fattr->attr_vals.attrlist4_val = gsh_malloc(NFS4_ATTRVALS_BUFFLEN);
+	if (args->arena != NULL)
+		Fattr->attr_vals.attrlist4_val =
+			mem_arena_alloc(args->arena, NFS4_ATTRVALS_BUFFLEN);
+	else
+		Fattr->attr_vals.attrlist4_val =
+			gsh_malloc(NFS4_ATTRVALS_BUFFLEN);
 
 	max_attr_idx = nfs4_max_attr_index(args->data);
 	LogFullDebug(COMPONENT_NFS_V4, "Maximum allowed attr index = %d",
@@ -3414,6 +3793,15 @@ int nfs4_FSALattr_To_Fattr(struct xdr_attrs_args *args, struct bitmap4 *Bitmap,
 	if (args->dynamicinfo == NULL)
 		args->dynamicinfo = &dynamicinfo;
 
+	if (fattr4_fast_bitmap(Bitmap)) {
+		if (!fattr4_fast_encode(args, Bitmap, Fattr, &attr_body)) {
+			LogFullDebug(COMPONENT_NFS_V4,
+				     "Fast attribute encode FAILED");
+			goto err;
+		}
+		goto done;
+	}
+
 	for (attribute_to_set = next_attr_from_bitmap(Bitmap, -1);
 	     attribute_to_set != -1;
 	     attribute_to_set =
@@ -3447,20 +3835,19 @@ int nfs4_FSALattr_To_Fattr(struct xdr_attrs_args *args, struct bitmap4 *Bitmap,
 		}
 		/* mark the attribute in the bitmap should be new bitmap btw */
 	}
+
+ done:
 	LastOffset = xdr_getpos(&attr_body);	/* dumb but for now */
 	xdr_destroy(&attr_body);
 
-	if (LastOffset == 0) {	/* no supported attrs so we can free */
-		assert(Fattr->attrmask.bitmap4_len == 0);
-		gsh_free(Fattr->attr_vals.attrlist4_val);
-		Fattr->attr_vals.attrlist4_val = NULL;
-	}
+	/* no supported attrs so we can free */
+	assert(LastOffset != 0 || Fattr->attrmask.bitmap4_len == 0);
+	fattr4_trim_vals(args, Fattr, LastOffset);
 	Fattr->attr_vals.attrlist4_len = LastOffset;
 	return 0;
 
  err:
-	gsh_free(Fattr->attr_vals.attrlist4_val);
-	Fattr->attr_vals.attrlist4_val = NULL;
+	fattr4_trim_vals(args, Fattr, 0);
 	return -1;
 }
 
@@ -4194,6 +4581,27 @@ int nfs4_Fattr_To_FSAL_attr(struct attrlist *FSAL_attr, fattr4 *Fattr,
 	return Fattr4_To_FSAL_attr(FSAL_attr, Fattr, NULL, NULL, data);
 }
 
+/**
+ * @brief Convert NFSv4 attribute buffer to an FSAL attribute list and
+ *        file handle
+ *
+ * @param[out] FSAL_attr FSAL attributes
+ * @param[in]  Fattr     NFSv4 attributes
+ * @param[out] hdl4      File handle, its nfs_fh4_val holding
+ *                       NFS4_FHSIZE bytes.  Its length is left as is
+ *                       if FATTR4_FILEHANDLE is not in Fattr.
+ * @param[in]  data      Compound data
+ *
+ * @return NFS4_OK if successful, NFS4ERR codes if not.
+ *
+ */
+int nfs4_Fattr_To_FSAL_attr_fh(struct attrlist *FSAL_attr, fattr4 *Fattr,
+			       nfs_fh4 *hdl4, compound_data_t *data)
+{
+	memset(FSAL_attr, 0, sizeof(struct attrlist));
+	return Fattr4_To_FSAL_attr(FSAL_attr, Fattr, hdl4, NULL, data);
+}
+
 /**
  *
  * nfs4_Fattr_To_fsinfo: Decode filesystem info out of NFSv4 attributes.
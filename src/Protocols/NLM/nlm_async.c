@@ -34,6 +34,7 @@
 #include "sal_functions.h"
 #include "nlm_util.h"
 #include "nlm_async.h"
+#include "fridgethr.h"
 
 pthread_mutex_t nlm_async_resp_mutex = PTHREAD_MUTEX_INITIALIZER;
 pthread_cond_t nlm_async_resp_cond = PTHREAD_COND_INITIALIZER;
@@ -112,151 +113,252 @@ xdrproc_t nlm_reply_proc[] = {
 	[NLMPROC4_UNLOCK_RES] = (xdrproc_t) xdr_nlm4_res,
 };
 
-static void *resp_key;
+/**
+ * @brief A sender waiting for the reply to its message
+ *
+ * Replies such as GRANTED_RES come back as calls of their own, which
+ * find their sender here by key.  Any number of senders may wait at
+ * once.
+ */
+struct nlm_async_wait {
+	struct glist_head list;
+	void *key;
+	bool done;
+};
+
+static struct glist_head nlm_async_waits = GLIST_HEAD_INIT(nlm_async_waits);
 
 static const int MAX_ASYNC_RETRY = 2;
 
+/* Threads sending GRANTED messages */
+#define NLM_CALLBACK_THREADS 16
+
+static struct fridgethr *nlm_callback_fridge;
+
+/**
+ * @brief Start the threads sending GRANTED messages
+ *
+ * @return 0 or an error from the fridge.
+ */
+int nlm_async_callback_init(void)
+{
+	struct fridgethr_params frp;
+	int rc;
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = NLM_CALLBACK_THREADS;
+	frp.deferment = fridgethr_defer_queue;
+
+	rc = fridgethr_init(&nlm_callback_fridge, "NLM_Callback", &frp);
+	if (rc != 0)
+		LogMajor(COMPONENT_NLM,
+			 "Unable to initialize NLM callback fridge: %d", rc);
+	return rc;
+}
+
+static void nlm_async_func_caller(struct fridgethr_context *ctx)
+{
+	state_async_queue_t *entry = ctx->arg;
+
+	entry->state_async_func(entry);
+}
+
+/**
+ * @brief Schedule a message that may wait for its reply
+ *
+ * GRANTED messages wait for their GRANTED_RES, so they are sent from a
+ * pool of their own rather than the single State_Async thread, and
+ * many are outstanding at once.
+ *
+ * @param[in] arg Message to send
+ *
+ * @return State status.
+ */
+state_status_t nlm_async_schedule(state_async_queue_t *arg)
+{
+	int rc;
+
+	if (nlm_callback_fridge == NULL)
+		return state_async_schedule(arg);
+
+	rc = fridgethr_submit(nlm_callback_fridge, nlm_async_func_caller, arg);
+	if (rc != 0)
+		LogCrit(COMPONENT_NLM, "Unable to schedule callback: %d", rc);
+
+	return rc == 0 ? STATE_SUCCESS : STATE_SIGNAL_ERROR;
+}
+
+/**
+ * @brief Get the callback client of a host
+ *
+ * Called with slc_callback_lock held.  The client is kept on the host
+ * for the next message and destroyed only if a call on it fails.
+ *
+ * @return RPC_SUCCESS, RPC_UNKNOWNADDR to retry, or -1.
+ */
+static int nlm_async_connect(state_nlm_client_t *host)
+{
+	int retval;
+
+	if (host->slc_callback_clnt != NULL)
+		return RPC_SUCCESS;
+
+	LogFullDebug(COMPONENT_NLM,
+		     "gsh_clnt_create %s",
+		     host->slc_nsm_client->ssc_nlm_caller_name);
+
+	if (host->slc_client_type == XPRT_TCP) {
+		int fd;
+		struct sockaddr_in6 server_addr;
+		struct netbuf *buf, local_buf;
+		struct addrinfo *result;
+		struct addrinfo hints;
+		char port_str[20];
+
+		fd = socket(PF_INET6, SOCK_STREAM, IPPROTO_TCP);
+		if (fd < 0)
+			return -1;
+
+		memcpy(&server_addr,
+		       &(host->slc_server_addr),
+		       sizeof(struct sockaddr_in6));
+		server_addr.sin6_port = 0;
+
+		if (bind(fd,
+			 (struct sockaddr *)&server_addr,
+			  sizeof(server_addr)) == -1) {
+			LogMajor(COMPONENT_NLM, "Cannot bind");
+			close(fd);
+			return -1;
+		}
+
+		buf = rpcb_find_mapped_addr(
+		     (char *) xprt_type_to_str(
+					host->slc_client_type),
+		     NLMPROG, NLM4_VERS,
+		     host->slc_nsm_client->ssc_nlm_caller_name);
+		/* handle error here, for example,
+		 * client side blocking rpc call
+		 */
+		if (buf == NULL) {
+			LogMajor(COMPONENT_NLM,
+				 "Cannot create NLM async %s connection to client %s",
+				 xprt_type_to_str(
+					host->slc_client_type),
+				 host->slc_nsm_client->
+				 ssc_nlm_caller_name);
+			close(fd);
+			return -1;
+		}
+
+		memset(&hints, 0, sizeof(struct addrinfo));
+		hints.ai_family = AF_INET6;	/* only INET6 */
+		hints.ai_socktype = SOCK_STREAM; /* TCP */
+		hints.ai_protocol = 0;	/* Any protocol */
+		hints.ai_canonname = NULL;
+		hints.ai_addr = NULL;
+		hints.ai_next = NULL;
+
+		/* convert port to string format */
+		sprintf(port_str, "%d",
+			htons(((struct sockaddr_in *)
+				buf->buf)->sin_port));
+
+		/* buf with inet is only needed for the port */
+		gsh_free(buf->buf);
+		gsh_free(buf);
+
+		/* get the IPv4 mapped IPv6 address */
+		retval = getaddrinfo(host->slc_nsm_client->
+				     ssc_nlm_caller_name,
+				     port_str,
+				     &hints,
+				     &result);
+
+		/* retry for spurious EAI_NONAME errors */
+		if (retval == EAI_NONAME ||
+		    retval == EAI_AGAIN) {
+			LogEvent(COMPONENT_NLM,
+				 "failed to resolve %s to an address: %s",
+				 host->slc_nsm_client->
+				 ssc_nlm_caller_name,
+				 gai_strerror(retval));
+			/* getaddrinfo() failed, retry */
+			close(fd);
+			return RPC_UNKNOWNADDR;
+		} else if (retval != 0) {
+			LogMajor(COMPONENT_NLM,
+				 "failed to resolve %s to an address: %s",
+				 host->slc_nsm_client->
+				 ssc_nlm_caller_name,
+				 gai_strerror(retval));
+			close(fd);
+			return -1;
+		}
+
+		/* setup the netbuf with in6 address */
+		local_buf.buf = result->ai_addr;
+		local_buf.len = local_buf.maxlen =
+		    result->ai_addrlen;
+
+		host->slc_callback_clnt =
+		    clnt_vc_ncreate(fd, &local_buf, NLMPROG,
+				    NLM4_VERS, 0, 0);
+		freeaddrinfo(result);
+	} else {
+
+		host->slc_callback_clnt = gsh_clnt_create(
+		    host->slc_nsm_client->ssc_nlm_caller_name,
+		    NLMPROG,
+		    NLM4_VERS,
+		    (char *) xprt_type_to_str(
+				host->slc_client_type));
+	}
+
+	if (host->slc_callback_clnt == NULL) {
+		LogMajor(COMPONENT_NLM,
+			 "Cannot create NLM async %s connection to client %s",
+			 xprt_type_to_str(host->
+					  slc_client_type),
+			 host->slc_nsm_client->
+			 ssc_nlm_caller_name);
+		return -1;
+	}
+
+	/* split auth (for authnone, idempotent) */
+	host->slc_callback_auth = authnone_create();
+
+	return RPC_SUCCESS;
+}
+
 /* Client routine  to send the asynchrnous response,
  * key is used to wait for a response
  */
 int nlm_send_async(int proc, state_nlm_client_t *host, void *inarg, void *key)
 {
 	struct timeval tout = { 0, 10 };
-	int retval, retry;
-	struct timeval start, now;
+	int retval = -1, retry;
+	struct timeval start;
 	struct timespec timeout;
+	struct nlm_async_wait wait = { .key = key };
 
-	for (retry = 0; retry < MAX_ASYNC_RETRY; retry++) {
-		if (host->slc_callback_clnt == NULL) {
-			LogFullDebug(COMPONENT_NLM,
-				     "gsh_clnt_create %s",
-				     host->slc_nsm_client->ssc_nlm_caller_name);
-
-			if (host->slc_client_type == XPRT_TCP) {
-				int fd;
-				struct sockaddr_in6 server_addr;
-				struct netbuf *buf, local_buf;
-				struct addrinfo *result;
-				struct addrinfo hints;
-				char port_str[20];
-
-				fd = socket(PF_INET6, SOCK_STREAM, IPPROTO_TCP);
-				if (fd < 0)
-					return -1;
-
-				memcpy(&server_addr,
-				       &(host->slc_server_addr),
-				       sizeof(struct sockaddr_in6));
-				server_addr.sin6_port = 0;
-
-				if (bind(fd,
-					 (struct sockaddr *)&server_addr,
-					  sizeof(server_addr)) == -1) {
-					LogMajor(COMPONENT_NLM, "Cannot bind");
-					close(fd);
-					return -1;
-				}
-
-				buf = rpcb_find_mapped_addr(
-				     (char *) xprt_type_to_str(
-							host->slc_client_type),
-				     NLMPROG, NLM4_VERS,
-				     host->slc_nsm_client->ssc_nlm_caller_name);
-				/* handle error here, for example,
-				 * client side blocking rpc call
-				 */
-				if (buf == NULL) {
-					LogMajor(COMPONENT_NLM,
-						 "Cannot create NLM async %s connection to client %s",
-						 xprt_type_to_str(
-							host->slc_client_type),
-						 host->slc_nsm_client->
-						 ssc_nlm_caller_name);
-					close(fd);
-					return -1;
-				}
-
-				memset(&hints, 0, sizeof(struct addrinfo));
-				hints.ai_family = AF_INET6;	/* only INET6 */
-				hints.ai_socktype = SOCK_STREAM; /* TCP */
-				hints.ai_protocol = 0;	/* Any protocol */
-				hints.ai_canonname = NULL;
-				hints.ai_addr = NULL;
-				hints.ai_next = NULL;
-
-				/* convert port to string format */
-				sprintf(port_str, "%d",
-					htons(((struct sockaddr_in *)
-						buf->buf)->sin_port));
-
-				/* buf with inet is only needed for the port */
-				gsh_free(buf->buf);
-				gsh_free(buf);
-
-				/* get the IPv4 mapped IPv6 address */
-				retval = getaddrinfo(host->slc_nsm_client->
-						     ssc_nlm_caller_name,
-						     port_str,
-						     &hints,
-						     &result);
-
-				/* retry for spurious EAI_NONAME errors */
-				if (retval == EAI_NONAME ||
-				    retval == EAI_AGAIN) {
-					LogEvent(COMPONENT_NLM,
-						 "failed to resolve %s to an address: %s",
-						 host->slc_nsm_client->
-						 ssc_nlm_caller_name,
-						 gai_strerror(retval));
-					/* getaddrinfo() failed, retry */
-					retval = RPC_UNKNOWNADDR;
-					usleep(1000);
-					continue;
-				} else if (retval != 0) {
-					LogMajor(COMPONENT_NLM,
-						 "failed to resolve %s to an address: %s",
-						 host->slc_nsm_client->
-						 ssc_nlm_caller_name,
-						 gai_strerror(retval));
-					return -1;
-				}
-
-				/* setup the netbuf with in6 address */
-				local_buf.buf = result->ai_addr;
-				local_buf.len = local_buf.maxlen =
-				    result->ai_addrlen;
-
-				host->slc_callback_clnt =
-				    clnt_vc_ncreate(fd, &local_buf, NLMPROG,
-						    NLM4_VERS, 0, 0);
-				freeaddrinfo(result);
-			} else {
-
-				host->slc_callback_clnt = gsh_clnt_create(
-				    host->slc_nsm_client->ssc_nlm_caller_name,
-				    NLMPROG,
-				    NLM4_VERS,
-				    (char *) xprt_type_to_str(
-						host->slc_client_type));
-			}
-
-			if (host->slc_callback_clnt == NULL) {
-				LogMajor(COMPONENT_NLM,
-					 "Cannot create NLM async %s connection to client %s",
-					 xprt_type_to_str(host->
-							  slc_client_type),
-					 host->slc_nsm_client->
-					 ssc_nlm_caller_name);
-				return -1;
-			}
-
-			/* split auth (for authnone, idempotent) */
-			host->slc_callback_auth = authnone_create();
-		}
-
+	/* Wait before sending, the reply may be quick */
+	if (key != NULL) {
 		PTHREAD_MUTEX_lock(&nlm_async_resp_mutex);
-		resp_key = key;
+		glist_add_tail(&nlm_async_waits, &wait.list);
 		PTHREAD_MUTEX_unlock(&nlm_async_resp_mutex);
+	}
+
+	PTHREAD_MUTEX_lock(&host->slc_callback_lock);
+
+	for (retry = 0; retry < MAX_ASYNC_RETRY; retry++) {
+		retval = nlm_async_connect(host);
+		if (retval == RPC_UNKNOWNADDR) {
+			usleep(1000);
+			continue;
+		}
+		if (retval != RPC_SUCCESS)
+			break;
 
 		LogFullDebug(COMPONENT_NLM, "About to make clnt_call");
 
@@ -283,31 +385,32 @@ int nlm_send_async(int proc, state_nlm_client_t *host, void *inarg, void *key)
 
 		gsh_clnt_destroy(host->slc_callback_clnt);
 		host->slc_callback_clnt = NULL;
+		AUTH_DESTROY(host->slc_callback_auth);
+		host->slc_callback_auth = NULL;
 	}
 
-	if (retry == MAX_ASYNC_RETRY) {
+	PTHREAD_MUTEX_unlock(&host->slc_callback_lock);
+
+	if (retry == MAX_ASYNC_RETRY)
 		LogMajor(COMPONENT_NLM,
 			 "NLM async Client exceeded retry count %d",
 			 MAX_ASYNC_RETRY);
-		PTHREAD_MUTEX_lock(&nlm_async_resp_mutex);
-		resp_key = NULL;
-		PTHREAD_MUTEX_unlock(&nlm_async_resp_mutex);
+
+	if (key == NULL)
 		return retval;
-	}
 
 	PTHREAD_MUTEX_lock(&nlm_async_resp_mutex);
 
-	if (resp_key != NULL) {
+	if (retval == RPC_SUCCESS && !wait.done) {
 		/* Wait for 5 seconds or a signal */
 		gettimeofday(&start, NULL);
-		gettimeofday(&now, NULL);
 		timeout.tv_sec = 5 + start.tv_sec;
-		timeout.tv_nsec = 0;
+		timeout.tv_nsec = start.tv_usec * 1000;
 
 		LogFullDebug(COMPONENT_NLM,
-			     "About to wait for signal for key %p", resp_key);
+			     "About to wait for signal for key %p", key);
 
-		while (resp_key != NULL && now.tv_sec < (start.tv_sec + 5)) {
+		while (!wait.done) {
 			int rc;
 
 			rc = pthread_cond_timedwait(&nlm_async_resp_cond,
@@ -316,11 +419,13 @@ int nlm_send_async(int proc, state_nlm_client_t *host, void *inarg, void *key)
 			LogFullDebug(COMPONENT_NLM,
 				     "pthread_cond_timedwait returned %d",
 				     rc);
-			gettimeofday(&now, NULL);
+			if (rc == ETIMEDOUT)
+				break;
 		}
 		LogFullDebug(COMPONENT_NLM, "Done waiting");
 	}
 
+	glist_del(&wait.list);
 	PTHREAD_MUTEX_unlock(&nlm_async_resp_mutex);
 
 	return retval;
@@ -328,15 +433,24 @@ int nlm_send_async(int proc, state_nlm_client_t *host, void *inarg, void *key)
 
 void nlm_signal_async_resp(void *key)
 {
+	struct glist_head *glist;
+	struct nlm_async_wait *wait;
+
 	PTHREAD_MUTEX_lock(&nlm_async_resp_mutex);
 
-	if (resp_key == key) {
-		resp_key = NULL;
-		pthread_cond_signal(&nlm_async_resp_cond);
-		LogFullDebug(COMPONENT_NLM, "Signaled condition variable");
-	} else {
-		LogFullDebug(COMPONENT_NLM, "Didn't signal condition variable");
+	glist_for_each(glist, &nlm_async_waits) {
+		wait = glist_entry(glist, struct nlm_async_wait, list);
+		if (wait->key == key) {
+			wait->done = true;
+			pthread_cond_broadcast(&nlm_async_resp_cond);
+			LogFullDebug(COMPONENT_NLM,
+				     "Signaled condition variable");
+			goto out;
+		}
 	}
 
+	LogFullDebug(COMPONENT_NLM, "Didn't signal condition variable");
+
+ out:
 	PTHREAD_MUTEX_unlock(&nlm_async_resp_mutex);
 }
@@ -138,6 +138,8 @@ void nlm_init(void)
 	granted_cookie.gc_seconds = (unsigned long)nlm_grace_tv.tv_sec;
 	granted_cookie.gc_microseconds = (unsigned long)nlm_grace_tv.tv_usec;
 	granted_cookie.gc_cookie = 0;
+
+	(void) nlm_async_callback_init();
 }
 
 void free_grant_arg(state_async_queue_t *arg)
@@ -648,7 +650,7 @@ state_status_t nlm_granted_callback(struct fsal_obj_handle *obj,
 	}
 
 	/* Now try to schedule NLMPROC4_GRANTED_MSG call */
-	state_status = state_async_schedule(arg);
+	state_status = nlm_async_schedule(arg);
 
 	if (state_status != STATE_SUCCESS)
 		goto grant_fail;
@@ -29,67 +29,132 @@
 #include "gsh_rpc.h"
 #include "nsm.h"
 #include "sal_data.h"
+#include "nfs_core.h"
 
-pthread_mutex_t nsm_mutex = PTHREAD_MUTEX_INITIALIZER;
-CLIENT *nsm_clnt;
-AUTH *nsm_auth;
-unsigned long nsm_count;
-char *nodename;
-
-bool nsm_connect(void)
+/**
+ * @brief A connection to statd
+ *
+ * Monitor and unmonitor calls go out on whichever connection is free,
+ * so that when many clients come back at once, as after a failover,
+ * their round trips to statd overlap rather than queue on one socket.
+ */
+struct nsm_conn {
+	pthread_mutex_t lock;
+	CLIENT *clnt;
+	AUTH *auth;
+};
+
+static struct nsm_conn *nsm_conns;
+static uint32_t nsm_nconns;
+static uint32_t nsm_next;
+static pthread_once_t nsm_once = PTHREAD_ONCE_INIT;
+static char *nodename;
+
+static void nsm_init(void)
 {
 	struct utsname utsname;
+	uint32_t i;
 
-	if (nsm_clnt != NULL)
-		return true;
+	nsm_nconns = nfs_param.core_param.nsm_connections;
+	nsm_conns = gsh_calloc(nsm_nconns, sizeof(*nsm_conns));
+	for (i = 0; i < nsm_nconns; i++)
+		PTHREAD_MUTEX_init(&nsm_conns[i].lock, NULL);
 
 	if (uname(&utsname) == -1) {
 		LogCrit(COMPONENT_NLM,
 			"uname failed with errno %d (%s)",
 			errno, strerror(errno));
-		return false;
+		return;
 	}
 
 	nodename = gsh_strdup(utsname.nodename);
+}
 
-	nsm_clnt = gsh_clnt_create("localhost", SM_PROG, SM_VERS, "tcp");
+static bool nsm_connect(struct nsm_conn *conn)
+{
+	if (conn->clnt != NULL)
+		return true;
 
-	if (nsm_clnt == NULL) {
+	if (nodename == NULL)
+		return false;
+
+	conn->clnt = gsh_clnt_create("localhost", SM_PROG, SM_VERS, "tcp");
+
+	if (conn->clnt == NULL) {
 		LogCrit(COMPONENT_NLM, "failed to connect to statd");
-		gsh_free(nodename);
-		nodename = NULL;
+		return false;
 	}
 
 	/* split auth (for authnone, idempotent) */
-	nsm_auth = authnone_create();
+	conn->auth = authnone_create();
 
-	return nsm_clnt != NULL;
+	return true;
 }
 
-void nsm_disconnect(void)
+static void nsm_disconnect(struct nsm_conn *conn)
 {
-	if (nsm_count == 0 && nsm_clnt != NULL) {
-		gsh_clnt_destroy(nsm_clnt);
-		nsm_clnt = NULL;
-		AUTH_DESTROY(nsm_auth);
-		nsm_auth = NULL;
-		gsh_free(nodename);
-		nodename = NULL;
+	if (conn->clnt != NULL) {
+		gsh_clnt_destroy(conn->clnt);
+		conn->clnt = NULL;
+		AUTH_DESTROY(conn->auth);
+		conn->auth = NULL;
 	}
 }
 
+/**
+ * @brief Take a connection to statd
+ *
+ * Takes the first idle connection, or waits for one if all are busy.
+ *
+ * @return The connection, locked and connected, or NULL.
+ */
+static struct nsm_conn *nsm_get_conn(void)
+{
+	uint32_t start, i;
+	struct nsm_conn *conn = NULL;
+
+	(void)pthread_once(&nsm_once, nsm_init);
+
+	start = atomic_inc_uint32_t(&nsm_next);
+	for (i = 0; i < nsm_nconns; i++) {
+		conn = &nsm_conns[(start + i) % nsm_nconns];
+		if (pthread_mutex_trylock(&conn->lock) == 0)
+			break;
+		conn = NULL;
+	}
+
+	if (conn == NULL) {
+		conn = &nsm_conns[start % nsm_nconns];
+		PTHREAD_MUTEX_lock(&conn->lock);
+	}
+
+	if (!nsm_connect(conn)) {
+		PTHREAD_MUTEX_unlock(&conn->lock);
+		return NULL;
+	}
+
+	return conn;
+}
+
+static inline void nsm_put_conn(struct nsm_conn *conn)
+{
+	PTHREAD_MUTEX_unlock(&conn->lock);
+}
+
 bool nsm_monitor(state_nsm_client_t *host)
 {
 	enum clnt_stat ret;
 	struct mon nsm_mon;
 	struct sm_stat_res res;
 	struct timeval tout = { 25, 0 };
+	struct nsm_conn *conn;
 
 	if (host == NULL)
 		return true;
 
 	PTHREAD_MUTEX_lock(&host->ssc_mutex);
 
+	/* Whoever else was monitoring this host has done so */
 	if (atomic_fetch_int32_t(&host->ssc_monitored)) {
 		PTHREAD_MUTEX_unlock(&host->ssc_mutex);
 		return true;
@@ -103,23 +168,21 @@ bool nsm_monitor(state_nsm_client_t *host)
 	/* nothing to put in the private data */
 	LogDebug(COMPONENT_NLM, "Monitor %s", host->ssc_nlm_caller_name);
 
-	PTHREAD_MUTEX_lock(&nsm_mutex);
-
-	/* create a connection to nsm on the localhost */
-	if (!nsm_connect()) {
+	/* get a connection to nsm on the localhost */
+	conn = nsm_get_conn();
+	if (conn == NULL) {
 		LogCrit(COMPONENT_NLM,
 			"Can not monitor %s clnt_create returned NULL",
 			nsm_mon.mon_id.mon_name);
-		PTHREAD_MUTEX_unlock(&nsm_mutex);
 		PTHREAD_MUTEX_unlock(&host->ssc_mutex);
 		return false;
 	}
 
-	/* Set this after we call nsm_connect() */
+	/* Set this after we call nsm_get_conn() */
 	nsm_mon.mon_id.my_id.my_name = nodename;
 
-	ret = clnt_call(nsm_clnt,
-			nsm_auth,
+	ret = clnt_call(conn->clnt,
+			conn->auth,
 			SM_MON,
 			(xdrproc_t) xdr_mon,
 			&nsm_mon,
@@ -132,33 +195,31 @@ bool nsm_monitor(state_nsm_client_t *host)
 			"Can not monitor %s SM_MON ret %d %s",
 			nsm_mon.mon_id.mon_name,
 			ret,
-			clnt_sperror(nsm_clnt, ""));
+			clnt_sperror(conn->clnt, ""));
 
-		nsm_disconnect();
-		PTHREAD_MUTEX_unlock(&nsm_mutex);
+		nsm_disconnect(conn);
+		nsm_put_conn(conn);
 		PTHREAD_MUTEX_unlock(&host->ssc_mutex);
 		return false;
 	}
 
+	nsm_put_conn(conn);
+
 	if (res.res_stat != STAT_SUCC) {
 		LogCrit(COMPONENT_NLM,
 			"Can not monitor %s SM_MON status %d",
 			nsm_mon.mon_id.mon_name, res.res_stat);
 
-		nsm_disconnect();
-		PTHREAD_MUTEX_unlock(&nsm_mutex);
 		PTHREAD_MUTEX_unlock(&host->ssc_mutex);
 		return false;
 	}
 
-	nsm_count++;
 	atomic_store_int32_t(&host->ssc_monitored, true);
 
 	LogDebug(COMPONENT_NLM,
 		 "Monitored %s for nodename %s",
 		 nsm_mon.mon_id.mon_name, nodename);
 
-	PTHREAD_MUTEX_unlock(&nsm_mutex);
 	PTHREAD_MUTEX_unlock(&host->ssc_mutex);
 	return true;
 }
@@ -169,6 +230,7 @@ bool nsm_unmonitor(state_nsm_client_t *host)
 	struct sm_stat res;
 	struct mon_id nsm_mon_id;
 	struct timeval tout = { 25, 0 };
+	struct nsm_conn *conn;
 
 	if (host == NULL)
 		return true;
@@ -185,23 +247,21 @@ bool nsm_unmonitor(state_nsm_client_t *host)
 	nsm_mon_id.my_id.my_vers = NLM4_VERS;
 	nsm_mon_id.my_id.my_proc = NLMPROC4_SM_NOTIFY;
 
-	PTHREAD_MUTEX_lock(&nsm_mutex);
-
-	/* create a connection to nsm on the localhost */
-	if (!nsm_connect()) {
+	/* get a connection to nsm on the localhost */
+	conn = nsm_get_conn();
+	if (conn == NULL) {
 		LogCrit(COMPONENT_NLM,
 			"Can not unmonitor %s clnt_create returned NULL",
 			nsm_mon_id.mon_name);
-		PTHREAD_MUTEX_unlock(&nsm_mutex);
 		PTHREAD_MUTEX_unlock(&host->ssc_mutex);
 		return false;
 	}
 
-	/* Set this after we call nsm_connect() */
+	/* Set this after we call nsm_get_conn() */
 	nsm_mon_id.my_id.my_name = nodename;
 
-	ret = clnt_call(nsm_clnt,
-			nsm_auth,
+	ret = clnt_call(conn->clnt,
+			conn->auth,
 			SM_UNMON,
 			(xdrproc_t) xdr_mon_id,
 			&nsm_mon_id,
@@ -214,23 +274,21 @@ bool nsm_unmonitor(state_nsm_client_t *host)
 			"Can not unmonitor %s SM_MON ret %d %s",
 			nsm_mon_id.mon_name,
 			ret,
-			clnt_sperror(nsm_clnt, ""));
+			clnt_sperror(conn->clnt, ""));
 
-		nsm_disconnect();
-		PTHREAD_MUTEX_unlock(&nsm_mutex);
+		nsm_disconnect(conn);
+		nsm_put_conn(conn);
 		PTHREAD_MUTEX_unlock(&host->ssc_mutex);
 		return false;
 	}
 
+	nsm_put_conn(conn);
+
 	atomic_store_int32_t(&host->ssc_monitored, false);
-	nsm_count--;
 
 	LogDebug(COMPONENT_NLM, "Unonitored %s for nodename %s",
 		 nsm_mon_id.mon_name, nodename);
 
-	nsm_disconnect();
-
-	PTHREAD_MUTEX_unlock(&nsm_mutex);
 	PTHREAD_MUTEX_unlock(&host->ssc_mutex);
 	return true;
 }
@@ -241,26 +299,25 @@ void nsm_unmonitor_all(void)
 	struct sm_stat res;
 	struct my_id nsm_id;
 	struct timeval tout = { 25, 0 };
+	struct nsm_conn *conn;
 
 	nsm_id.my_prog = NLMPROG;
 	nsm_id.my_vers = NLM4_VERS;
 	nsm_id.my_proc = NLMPROC4_SM_NOTIFY;
 
-	PTHREAD_MUTEX_lock(&nsm_mutex);
-
-	/* create a connection to nsm on the localhost */
-	if (!nsm_connect()) {
+	/* get a connection to nsm on the localhost */
+	conn = nsm_get_conn();
+	if (conn == NULL) {
 		LogCrit(COMPONENT_NLM,
 			"Can not unmonitor all clnt_create returned NULL");
-		PTHREAD_MUTEX_unlock(&nsm_mutex);
 		return;
 	}
 
-	/* Set this after we call nsm_connect() */
+	/* Set this after we call nsm_get_conn() */
 	nsm_id.my_name = nodename;
 
-	ret = clnt_call(nsm_clnt,
-			nsm_auth,
+	ret = clnt_call(conn->clnt,
+			conn->auth,
 			SM_UNMON_ALL,
 			(xdrproc_t) xdr_my_id,
 			&nsm_id,
@@ -272,9 +329,9 @@ void nsm_unmonitor_all(void)
 		LogCrit(COMPONENT_NLM,
 			"Can not unmonitor all ret %d %s",
 			ret,
-			clnt_sperror(nsm_clnt, ""));
+			clnt_sperror(conn->clnt, ""));
+		nsm_disconnect(conn);
 	}
 
-	nsm_disconnect();
-	PTHREAD_MUTEX_unlock(&nsm_mutex);
+	nsm_put_conn(conn);
 }
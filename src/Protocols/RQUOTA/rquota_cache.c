@@ -0,0 +1,408 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file rquota_cache.c
+ * @brief Cache of the quotas returned by RQUOTA GETQUOTA
+ *
+ * Some clients ask for a user's quota on every df or login, and the
+ * FSAL's get_quota may be slow.  With RQUOTA_Cache_Time set, the
+ * result for an export, quota type and id is kept that many seconds,
+ * including a result of no quota, and SETQUOTA drops it.
+ *
+ * A thread sweeps the cache every half period, freeing what has
+ * expired.  With RQUOTA_Cache_Prefetch, an entry asked for at least
+ * RQUOTA_PREFETCH_HITS times since it was fetched is fetched again
+ * before it expires, so the busiest users never wait on the FSAL.
+ */
+
+#include "config.h"
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "log.h"
+#include "fsal.h"
+#include "nfs_core.h"
+#include "export_mgr.h"
+#include "fridgethr.h"
+#include "rquota_cache.h"
+
+#define RQUOTA_CACHE_SHIFT 10
+#define RQUOTA_CACHE_BUCKETS (1 << RQUOTA_CACHE_SHIFT)
+
+/* Seconds between sweeps */
+#define RQUOTA_SWEEP_DELAY(ttl) ((ttl) > 1 ? (ttl) / 2 : 1)
+
+/* Lookups since the last fetch that make an entry worth prefetching */
+#define RQUOTA_PREFETCH_HITS 4
+
+struct rquota_entry {
+	struct rquota_entry *next;
+	uint16_t export_id;
+	int quota_type;
+	int quota_id;
+	char *path;
+	fsal_status_t status;	/*< Of the fetch, success or no quota */
+	fsal_quota_t quota;
+	time_t fetched;
+	uint32_t hits;		/*< Lookups since fetched */
+};
+
+struct rquota_bucket {
+	pthread_mutex_t lock;
+	struct rquota_entry *head;
+	uint64_t generation;	/*< Bumped by each invalidation */
+};
+
+static struct rquota_bucket rquota_cache[RQUOTA_CACHE_BUCKETS];
+static struct fridgethr *rquota_cache_fridge;
+
+static inline time_t rquota_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+	return ts.tv_sec;
+}
+
+static inline struct rquota_bucket *rquota_bucket(uint16_t export_id,
+						  int quota_type,
+						  int quota_id)
+{
+	uint64_t h = ((uint64_t)export_id << 40) ^
+		     ((uint64_t)quota_type << 32) ^ (uint32_t)quota_id;
+
+	h *= 0x9E3779B97F4A7C15ULL;
+	return &rquota_cache[h >> (64 - RQUOTA_CACHE_SHIFT)];
+}
+
+static struct rquota_entry *rquota_find(struct rquota_bucket *b,
+					uint16_t export_id, const char *path,
+					int quota_type, int quota_id)
+{
+	struct rquota_entry *e;
+
+	for (e = b->head; e != NULL; e = e->next) {
+		if (e->export_id == export_id &&
+		    e->quota_type == quota_type &&
+		    e->quota_id == quota_id &&
+		    strcmp(e->path, path) == 0)
+			return e;
+	}
+	return NULL;
+}
+
+static void rquota_free_entry(struct rquota_entry *e)
+{
+	gsh_free(e->path);
+	gsh_free(e);
+}
+
+static inline uint64_t rquota_generation(struct rquota_bucket *b)
+{
+	uint64_t generation;
+
+	PTHREAD_MUTEX_lock(&b->lock);
+	generation = b->generation;
+	PTHREAD_MUTEX_unlock(&b->lock);
+	return generation;
+}
+
+/**
+ * @brief Keep the result of a fetch
+ *
+ * Errors other than no quota are not kept, and drop what was.  Nor is
+ * a fetch that raced with a SETQUOTA, which may have seen the old
+ * quota.
+ *
+ * @param[in] generation Of the bucket, from before the fetch
+ */
+static void rquota_store(uint16_t export_id, const char *path,
+			 int quota_type, int quota_id, fsal_status_t status,
+			 const fsal_quota_t *quota, uint64_t generation)
+{
+	struct rquota_bucket *b = rquota_bucket(export_id, quota_type,
+						quota_id);
+	struct rquota_entry *e, **pe;
+	bool keep = !FSAL_IS_ERROR(status) ||
+		    status.major == ERR_FSAL_NO_QUOTA;
+
+	PTHREAD_MUTEX_lock(&b->lock);
+	if (b->generation != generation) {
+		PTHREAD_MUTEX_unlock(&b->lock);
+		return;
+	}
+	e = rquota_find(b, export_id, path, quota_type, quota_id);
+	if (e == NULL && keep) {
+		e = gsh_calloc(1, sizeof(*e));
+		e->export_id = export_id;
+		e->quota_type = quota_type;
+		e->quota_id = quota_id;
+		e->path = gsh_strdup(path);
+		e->next = b->head;
+		b->head = e;
+	} else if (e != NULL && !keep) {
+		for (pe = &b->head; *pe != e; pe = &(*pe)->next)
+			;
+		*pe = e->next;
+		rquota_free_entry(e);
+		e = NULL;
+	}
+	if (e != NULL) {
+		e->status = status;
+		e->quota = *quota;
+		e->fetched = rquota_now();
+		e->hits = 0;
+	}
+	PTHREAD_MUTEX_unlock(&b->lock);
+}
+
+/**
+ * @brief Get a quota, from the cache if it is fresh
+ *
+ * @param[in]  exp        Export the quota is asked on
+ * @param[in]  path       Path the quota is asked for
+ * @param[in]  quota_type USRQUOTA or GRPQUOTA
+ * @param[in]  quota_id   User or group
+ * @param[out] quota      The quota
+ *
+ * @return What the FSAL's get_quota returned.
+ */
+fsal_status_t rquota_cache_get(struct gsh_export *exp, const char *path,
+			       int quota_type, int quota_id,
+			       fsal_quota_t *quota)
+{
+	uint32_t ttl = nfs_param.core_param.rquota_cache_time;
+	struct rquota_bucket *b;
+	struct rquota_entry *e;
+	fsal_status_t status;
+	uint64_t generation = 0;
+
+	if (ttl != 0) {
+		b = rquota_bucket(exp->export_id, quota_type, quota_id);
+		PTHREAD_MUTEX_lock(&b->lock);
+		generation = b->generation;
+		e = rquota_find(b, exp->export_id, path, quota_type, quota_id);
+		if (e != NULL && rquota_now() - e->fetched < ttl) {
+			e->hits++;
+			status = e->status;
+			*quota = e->quota;
+			PTHREAD_MUTEX_unlock(&b->lock);
+			return status;
+		}
+		PTHREAD_MUTEX_unlock(&b->lock);
+	}
+
+	status = exp->fsal_export->exp_ops.get_quota(exp->fsal_export,
+						     path, quota_type,
+						     quota_id, quota);
+
+	if (ttl != 0)
+		rquota_store(exp->export_id, path, quota_type, quota_id,
+			     status, quota, generation);
+	return status;
+}
+
+/**
+ * @brief Forget the quotas of a user or group on an export
+ *
+ * @param[in] exp        The export
+ * @param[in] quota_type USRQUOTA or GRPQUOTA
+ * @param[in] quota_id   User or group
+ */
+void rquota_cache_invalidate(struct gsh_export *exp, int quota_type,
+			     int quota_id)
+{
+	struct rquota_bucket *b = rquota_bucket(exp->export_id, quota_type,
+						quota_id);
+	struct rquota_entry *e, **pe;
+
+	PTHREAD_MUTEX_lock(&b->lock);
+	b->generation++;
+	pe = &b->head;
+	while ((e = *pe) != NULL) {
+		if (e->export_id == exp->export_id &&
+		    e->quota_type == quota_type &&
+		    e->quota_id == quota_id) {
+			*pe = e->next;
+			rquota_free_entry(e);
+		} else {
+			pe = &e->next;
+		}
+	}
+	PTHREAD_MUTEX_unlock(&b->lock);
+}
+
+/**
+ * @brief Fetch a quota again, outside of any request
+ */
+static void rquota_prefetch(uint16_t export_id, const char *path,
+			    int quota_type, int quota_id)
+{
+	struct root_op_context root_op_context;
+	struct gsh_export *exp = get_gsh_export(export_id);
+	struct rquota_bucket *b = rquota_bucket(export_id, quota_type,
+						quota_id);
+	uint64_t generation = rquota_generation(b);
+	fsal_quota_t quota;
+	fsal_status_t status;
+
+	if (exp == NULL)
+		return;
+
+	if (exp->fsal_export == NULL) {
+		/* An idle Lazy_Init export is not created again for this */
+		put_gsh_export(exp);
+		return;
+	}
+
+	init_root_op_context(&root_op_context, exp, exp->fsal_export,
+			     0, 0, UNKNOWN_REQUEST);
+
+	memset(&quota, 0, sizeof(quota));
+	status = exp->fsal_export->exp_ops.get_quota(exp->fsal_export,
+						     path, quota_type,
+						     quota_id, &quota);
+	rquota_store(export_id, path, quota_type, quota_id, status, &quota,
+		     generation);
+
+	release_root_op_context();
+	put_gsh_export(exp);
+}
+
+/**
+ * @brief Free expired entries and prefetch busy ones
+ *
+ * A prefetch is done with the bucket unlocked, after which the bucket
+ * is walked again; the fresh entry is not picked a second time.
+ */
+static void rquota_cache_sweep(struct fridgethr_context *ctx)
+{
+	uint32_t ttl = nfs_param.core_param.rquota_cache_time;
+	time_t next_sweep = RQUOTA_SWEEP_DELAY(ttl);
+	struct rquota_bucket *b;
+	struct rquota_entry *e, **pe;
+	uint16_t export_id;
+	int quota_type, quota_id;
+	char *path;
+	time_t age;
+	int i;
+
+	SetNameFunction("rquota_cache");
+
+	for (i = 0; i < RQUOTA_CACHE_BUCKETS; i++) {
+		b = &rquota_cache[i];
+ again:
+		path = NULL;
+		PTHREAD_MUTEX_lock(&b->lock);
+		pe = &b->head;
+		while ((e = *pe) != NULL) {
+			age = rquota_now() - e->fetched;
+			if (nfs_param.core_param.rquota_prefetch &&
+			    e->hits >= RQUOTA_PREFETCH_HITS &&
+			    age + next_sweep >= ttl) {
+				export_id = e->export_id;
+				quota_type = e->quota_type;
+				quota_id = e->quota_id;
+				path = gsh_strdup(e->path);
+				/* Not again if this prefetch fails */
+				e->hits = 0;
+				break;
+			}
+			if (age >= ttl) {
+				*pe = e->next;
+				rquota_free_entry(e);
+			} else {
+				pe = &e->next;
+			}
+		}
+		PTHREAD_MUTEX_unlock(&b->lock);
+
+		if (path != NULL) {
+			rquota_prefetch(export_id, path, quota_type, quota_id);
+			gsh_free(path);
+			goto again;
+		}
+	}
+}
+
+/**
+ * @brief Set up the cache and start its sweeper
+ *
+ * @return 0 or an error from the fridge.
+ */
+int rquota_cache_init(void)
+{
+	uint32_t ttl = nfs_param.core_param.rquota_cache_time;
+	struct fridgethr_params frp;
+	int i, rc;
+
+	for (i = 0; i < RQUOTA_CACHE_BUCKETS; i++)
+		PTHREAD_MUTEX_init(&rquota_cache[i].lock, NULL);
+
+	if (ttl == 0)
+		return 0;
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = 1;
+	frp.thr_min = 1;
+	frp.thread_delay = RQUOTA_SWEEP_DELAY(ttl);
+	frp.flavor = fridgethr_flavor_looper;
+
+	rc = fridgethr_init(&rquota_cache_fridge, "rquota_cache", &frp);
+	if (rc != 0) {
+		LogMajor(COMPONENT_NFSPROTO,
+			 "Unable to initialize quota cache fridge: %d", rc);
+		return rc;
+	}
+
+	rc = fridgethr_submit(rquota_cache_fridge, rquota_cache_sweep, NULL);
+	if (rc != 0) {
+		LogMajor(COMPONENT_NFSPROTO,
+			 "Unable to start quota cache sweeper: %d", rc);
+		return rc;
+	}
+
+	LogInfo(COMPONENT_NFSPROTO,
+		"Caching quotas for %" PRIu32 " s%s", ttl,
+		nfs_param.core_param.rquota_prefetch ? ", with prefetch" : "");
+	return 0;
+}
+
+int rquota_cache_shutdown(void)
+{
+	int rc;
+
+	if (rquota_cache_fridge == NULL)
+		return 0;
+
+	rc = fridgethr_sync_command(rquota_cache_fridge, fridgethr_comm_stop,
+				    120);
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_NFSPROTO,
+			 "Shutdown timed out, cancelling threads.");
+		fridgethr_cancel(rquota_cache_fridge);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_NFSPROTO,
+			 "Failed shutting down quota cache sweeper: %d", rc);
+	}
+	return rc;
+}
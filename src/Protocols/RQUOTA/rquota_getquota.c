@@ -38,6 +38,7 @@
 #include "rquota.h"
 #include "nfs_proto_functions.h"
 #include "export_mgr.h"
+#include "rquota_cache.h"
 
 /**
  * @brief The Rquota getquota function, for all versions.
@@ -82,10 +83,10 @@ int rquota_getquota(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 			goto out;
 		quota_path = exp->fullpath;
 	}
-	fsal_status =
-	    exp->fsal_export->exp_ops.get_quota(exp->fsal_export,
-					     quota_path, quota_type,
-					     quota_id, &fsal_quota);
+	if (!export_activate(exp))
+		goto out;
+	fsal_status = rquota_cache_get(exp, quota_path, quota_type, quota_id,
+				       &fsal_quota);
 	if (FSAL_IS_ERROR(fsal_status)) {
 		if (fsal_status.major == ERR_FSAL_NO_QUOTA)
 			qres->status = Q_NOQUOTA;
@@ -36,6 +36,7 @@
 #include "rquota.h"
 #include "nfs_proto_functions.h"
 #include "export_mgr.h"
+#include "rquota_cache.h"
 
 static int do_rquota_setquota(char *quota_path, int quota_type,
 			      int quota_id,
@@ -106,6 +107,8 @@ static int do_rquota_setquota(char *quota_path, int quota_type,
 			goto out;
 		qpath = exp->fullpath;
 	}
+	if (!export_activate(exp))
+		goto out;
 
 	memset(&fsal_quota_in, 0, sizeof(fsal_quota_t));
 	memset(&fsal_quota_out, 0, sizeof(fsal_quota_t));
@@ -123,6 +126,7 @@ static int do_rquota_setquota(char *quota_path, int quota_type,
 						       quota_id,
 						       &fsal_quota_in,
 						       &fsal_quota_out);
+	rquota_cache_invalidate(exp, quota_type, quota_id);
 	if (FSAL_IS_ERROR(fsal_status)) {
 		if (fsal_status.major == ERR_FSAL_NO_QUOTA)
 			qres->status = Q_NOQUOTA;
@@ -476,16 +476,65 @@ nfstime3 *objp;
 	return (true);
 }
 
+/* The XDR units of a fattr3 and of a wcc_attr */
+#define FATTR3_UNITS 21
+#define WCC_ATTR_UNITS 6
+
+/**
+ * @brief Put a 64 bit value in an inlined buffer, high word first
+ */
+#define IXDR_PUT_NFS3_UINT64(buf, v)				\
+	do {							\
+		IXDR_PUT_U_INT32((buf), (uint32_t)((v) >> 32));	\
+		IXDR_PUT_U_INT32((buf), (uint32_t)(v));		\
+	} while (0)
+
+/**
+ * @brief Encode a fattr3 in FATTR3_UNITS units of an inlined buffer
+ *
+ * The attributes of every LOOKUP, GETATTR and READDIRPLUS entry go
+ * through here, so they are written out after a single check for the
+ * room, rather than through a call and a check per field.
+ *
+ * @return The buffer past the attributes.
+ */
+static inline int32_t *ixdr_put_fattr3(int32_t *buf, const fattr3 *objp)
+{
+	IXDR_PUT_ENUM(buf, objp->type);
+	IXDR_PUT_U_INT32(buf, objp->mode);
+	IXDR_PUT_U_INT32(buf, objp->nlink);
+	IXDR_PUT_U_INT32(buf, objp->uid);
+	IXDR_PUT_U_INT32(buf, objp->gid);
+	IXDR_PUT_NFS3_UINT64(buf, objp->size);
+	IXDR_PUT_NFS3_UINT64(buf, objp->used);
+	IXDR_PUT_U_INT32(buf, objp->rdev.specdata1);
+	IXDR_PUT_U_INT32(buf, objp->rdev.specdata2);
+	IXDR_PUT_NFS3_UINT64(buf, objp->fsid);
+	IXDR_PUT_NFS3_UINT64(buf, objp->fileid);
+	IXDR_PUT_U_INT32(buf, objp->atime.tv_sec);
+	IXDR_PUT_U_INT32(buf, objp->atime.tv_nsec);
+	IXDR_PUT_U_INT32(buf, objp->mtime.tv_sec);
+	IXDR_PUT_U_INT32(buf, objp->mtime.tv_nsec);
+	IXDR_PUT_U_INT32(buf, objp->ctime.tv_sec);
+	IXDR_PUT_U_INT32(buf, objp->ctime.tv_nsec);
+
+	return buf;
+}
+
 bool xdr_fattr3(xdrs, objp)
 register XDR *xdrs;
 fattr3 *objp;
 {
+	int32_t *buf;
 
-#if defined(_LP64) || defined(_KERNEL)
-	register int __attribute__ ((__unused__)) * buf;
-#else
-	register long __attribute__ ((__unused__)) * buf;
-#endif
+	if (xdrs->x_op == XDR_ENCODE) {
+		buf = (int32_t *) XDR_INLINE(xdrs,
+					     FATTR3_UNITS * BYTES_PER_XDR_UNIT);
+		if (buf != NULL) {
+			(void) ixdr_put_fattr3(buf, objp);
+			return (true);
+		}
+	}
 
 	if (!xdr_ftype3(xdrs, &objp->type))
 		return (false);
@@ -520,12 +569,18 @@ bool xdr_post_op_attr(xdrs, objp)
 register XDR *xdrs;
 post_op_attr *objp;
 {
-
-#if defined(_LP64) || defined(_KERNEL)
-	register int __attribute__ ((__unused__)) * buf;
-#else
-	register long __attribute__ ((__unused__)) * buf;
-#endif
+	int32_t *buf;
+
+	if (xdrs->x_op == XDR_ENCODE && objp->attributes_follow) {
+		buf = (int32_t *) XDR_INLINE(xdrs, (1 + FATTR3_UNITS) *
+						      BYTES_PER_XDR_UNIT);
+		if (buf != NULL) {
+			IXDR_PUT_BOOL(buf, TRUE);
+			(void) ixdr_put_fattr3(
+				buf, &objp->post_op_attr_u.attributes);
+			return (true);
+		}
+	}
 
 	if (!xdr_bool(xdrs, &objp->attributes_follow))
 		return (false);
@@ -546,12 +601,21 @@ bool xdr_wcc_attr(xdrs, objp)
 register XDR *xdrs;
 wcc_attr *objp;
 {
-
-#if defined(_LP64) || defined(_KERNEL)
-	register int __attribute__ ((__unused__)) * buf;
-#else
-	register long __attribute__ ((__unused__)) * buf;
-#endif
+	int32_t *buf;
+
+	if (xdrs->x_op == XDR_ENCODE) {
+		buf = (int32_t *) XDR_INLINE(xdrs,
+					     WCC_ATTR_UNITS *
+					     BYTES_PER_XDR_UNIT);
+		if (buf != NULL) {
+			IXDR_PUT_NFS3_UINT64(buf, objp->size);
+			IXDR_PUT_U_INT32(buf, objp->mtime.tv_sec);
+			IXDR_PUT_U_INT32(buf, objp->mtime.tv_nsec);
+			IXDR_PUT_U_INT32(buf, objp->ctime.tv_sec);
+			IXDR_PUT_U_INT32(buf, objp->ctime.tv_nsec);
+			return (true);
+		}
+	}
 
 	if (!xdr_size3(xdrs, &objp->size))
 		return (false);
@@ -1350,7 +1414,7 @@ WRITE3args *objp;
 		return (false);
 	if (!xdr_stable_how(xdrs, &objp->stable))
 		return (false);
-	if (!xdr_bytes
+	if (!xdr_iobuf
 	    (xdrs, (char **)&objp->data.data_val,
 	     &objp->data.data_len, XDR_BYTES_MAXLEN_IO))
 		return (false);
@@ -2368,10 +2432,20 @@ dirlistplus3 *objp;
 #else
 	register long __attribute__ ((__unused__)) * buf;
 #endif
+	entryplus3 *end = NULL;
 
-	if (!xdr_pointer
-	    (xdrs, (char **)&objp->entries, sizeof(entryplus3),
-	     (xdrproc_t) xdr_entryplus3))
+	if (xdrs->x_op == XDR_ENCODE && objp->entries_xdr != NULL) {
+		/* The encoded entries, then the NULL that ends them */
+		if (!xdr_opaque(xdrs, objp->entries_xdr,
+				objp->entries_xdr_len))
+			return (false);
+		if (!xdr_pointer
+		    (xdrs, (char **)&end, sizeof(entryplus3),
+		     (xdrproc_t) xdr_entryplus3))
+			return (false);
+	} else if (!xdr_pointer
+		   (xdrs, (char **)&objp->entries, sizeof(entryplus3),
+		    (xdrproc_t) xdr_entryplus3))
 		return (false);
 	if (!xdr_bool(xdrs, &objp->eof))
 		return (false);
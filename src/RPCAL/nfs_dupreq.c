@@ -49,6 +49,10 @@
 #include "abstract_mem.h"
 #include "gsh_intrinsic.h"
 #include "wait_queue.h"
+#include "gsh_metrics.h"
+#ifdef USE_LTTNG
+#include "gsh_lttng/nfs_rpc.h"
+#endif
 
 #define DUPREQ_BAD_ADDR1 0x01	/* safe for marked pointers, etc */
 #define DUPREQ_NOCACHE   0x02
@@ -83,6 +87,14 @@ struct drc_st {
 
 static struct drc_st *drc_st;
 
+/* Outcomes of nfs_dupreq_start, for the metrics */
+static struct {
+	uint64_t hits;		/*< Answered from the cache */
+	uint64_t in_progress;	/*< Retransmits of requests still running */
+	uint64_t misses;	/*< New requests entered */
+	uint64_t nocache;	/*< Requests not cached */
+} drc_counts;
+
 /**
  * @brief Comparison function for duplicate request entries.
  *
@@ -349,18 +361,25 @@ static inline drc_t *alloc_tcp_drc(enum drc_type dtype)
 
 	PTHREAD_MUTEX_init(&drc->mtx, NULL);
 
-	/* init dict */
-	code =
-	    rbtx_init(&drc->xt, dupreq_tcp_cmpf, drc->npart,
-		      RBT_X_FLAG_ALLOC | RBT_X_FLAG_CACHE_WT);
-	assert(!code);
-
 	/* completed requests */
 	TAILQ_INIT(&drc->dupreq_q);
 
 	/* recycling DRC */
 	TAILQ_INIT_ENTRY(drc, d_u.tcp.recycle_q);
 
+	if (nfs_param.core_param.drc.tcp.hash_table) {
+		/* one table by XID, under drc->mtx */
+		drc->flags |= DRC_FLAG_TABLE;
+		gsh_oa_init(&drc->xid_t, drc->maxsize);
+		return drc;
+	}
+
+	/* init dict */
+	code =
+	    rbtx_init(&drc->xt, dupreq_tcp_cmpf, drc->npart,
+		      RBT_X_FLAG_ALLOC | RBT_X_FLAG_CACHE_WT);
+	assert(!code);
+
 	/* init "cache" partition */
 	for (ix = 0; ix < drc->npart; ++ix) {
 		struct rbtree_x_part *xp = &(drc->xt.tree[ix]);
@@ -373,6 +392,8 @@ static inline drc_t *alloc_tcp_drc(enum drc_type dtype)
 	return drc;
 }
 
+static inline void nfs_dupreq_free_dupreq(dupreq_entry_t *dv);
+
 /**
  * @brief Deep-free a per-connection (TCP) duplicate request cache
  *
@@ -382,11 +403,25 @@ static inline drc_t *alloc_tcp_drc(enum drc_type dtype)
  */
 static inline void free_tcp_drc(drc_t *drc)
 {
+	uint32_t slot;
 	int ix;
 
-	for (ix = 0; ix < drc->npart; ++ix) {
-		if (drc->xt.tree[ix].cache)
-			gsh_free(drc->xt.tree[ix].cache);
+	if (drc->flags & DRC_FLAG_TABLE) {
+		/* no connection reaches the DRC, nor its requests */
+		slot = 0;
+		while ((slot = gsh_oa_next(&drc->xid_t, slot)) != UINT32_MAX) {
+			dupreq_entry_t *dv = drc->xid_t.slots[slot].item;
+
+			gsh_oa_remove(&drc->xid_t, drc->xid_t.slots[slot].hash,
+				      dv);
+			nfs_dupreq_free_dupreq(dv);
+		}
+		gsh_oa_destroy(&drc->xid_t);
+	} else {
+		for (ix = 0; ix < drc->npart; ++ix) {
+			if (drc->xt.tree[ix].cache)
+				gsh_free(drc->xt.tree[ix].cache);
+		}
 	}
 	PTHREAD_MUTEX_destroy(&drc->mtx);
 	LogFullDebug(COMPONENT_DUPREQ, "free TCP drc %p", drc);
@@ -783,6 +818,7 @@ static inline void nfs_dupreq_free_dupreq(dupreq_entry_t *dv)
 		func->free_function(dv->res);
 		free_nfs_res(dv->res);
 	}
+	gsh_free(dv->reply);
 	PTHREAD_MUTEX_destroy(&dv->mtx);
 	pool_free(dupreq_pool, dv);
 }
@@ -856,6 +892,130 @@ static inline bool drc_should_retire(drc_t *drc)
 	return false;
 }
 
+/**
+ * @page DRC_TABLE DRC XID table.
+ *
+ * With DRC_TCP_Hash_Table, the requests of a connection are kept in one
+ * open-addressing table keyed by XID and checksum, under drc->mtx.  A
+ * lookup is one probe, and the partition locks, the partition caches
+ * and the FIFO of the trees are not needed.
+ *
+ * Requests are retired by CLOCK rather than in order.  The requests
+ * are also kept on dupreq_q in the order they came, and the hand is its
+ * head: a hit marks the request referenced, and the hand passing it
+ * clears the mark and puts it back at the tail, so a request the client
+ * keeps retransmitting survives a sweep while the oldest one nobody
+ * asked for again is retired.  When to retire is still decided by
+ * drc_should_retire.
+ *
+ * The lookup takes drc->mtx.  The epoch reclamation of hashtable.c
+ * would not make it lock-free at a lower cost: a miss must insert under
+ * the lock it looked up with, or two retransmissions of a new request
+ * could both run it, and that is most starts.  Each retirement would
+ * have to wait out a grace period with ht_synchronize, and past the
+ * high water mark every finish retires.  And a rehash of the table
+ * replaces its control bytes and slots separately, so a reader would
+ * need both kept until it was done.
+ */
+
+/**
+ * @brief Hash of a request's XID and checksum
+ *
+ * @param[in] dv The request
+ *
+ * @return The hash.
+ */
+static inline uint64_t dupreq_xid_hash(const dupreq_entry_t *dv)
+{
+	uint64_t h = (dv->hk ^ dv->hin.tcp.rq_xid) * 0x9E3779B97F4A7C15ULL;
+
+	return h ^ (h >> 29);
+}
+
+static bool dupreq_xid_match(const void *item, const void *key)
+{
+	const dupreq_entry_t *dv = item, *dk = key;
+
+	return dv->hin.tcp.rq_xid == dk->hin.tcp.rq_xid && dv->hk == dk->hk;
+}
+
+/**
+ * @brief Pick a request to retire by CLOCK
+ *
+ * Requests in progress, referenced by a call path or replayed since the
+ * hand last passed go back to the tail of dupreq_q.  The hand goes
+ * round at most twice, clearing marks the first time.  Called with
+ * drc->mtx held.
+ *
+ * @param[in] drc The duplicate request cache
+ *
+ * @return The request, removed from the table, or NULL.
+ */
+static dupreq_entry_t *drc_clock_retire(drc_t *drc)
+{
+	dupreq_entry_t *dv;
+	uint32_t n;
+	bool keep;
+
+	for (n = 0; n <= 2 * drc->size; ++n) {
+		dv = TAILQ_FIRST(&drc->dupreq_q);
+		if (dv == NULL)
+			break;
+		TAILQ_REMOVE(&drc->dupreq_q, dv, fifo_q);
+
+		PTHREAD_MUTEX_lock(&dv->mtx);
+		keep = dv->state == DUPREQ_START || dv->refcnt > 0 ||
+		       dv->referenced;
+		dv->referenced = false;
+		PTHREAD_MUTEX_unlock(&dv->mtx);
+
+		if (keep) {
+			TAILQ_INSERT_TAIL(&drc->dupreq_q, dv, fifo_q);
+			continue;
+		}
+
+		gsh_oa_remove(&drc->xid_t, dupreq_xid_hash(dv), dv);
+		--(drc->size);
+		return dv;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief The checksum a request is matched by, besides its XID
+ *
+ * TI-RPC checksums the start of the call body as it is received.  With
+ * DRC_TCP_Checksum or DRC_UDP_Checksum off, the call header stands in
+ * for it: the XID with the program, version and procedure already tell
+ * the requests of a client apart, and a retransmission is known by its
+ * header alone.
+ *
+ * @param[in] drc The duplicate request cache
+ * @param[in] req The request
+ *
+ * @return The checksum.
+ */
+static inline uint64_t dupreq_checksum(drc_t *drc, struct svc_req *req)
+{
+	bool checksum = drc->type == DRC_UDP_V234
+				? nfs_param.core_param.drc.udp.checksum
+				: nfs_param.core_param.drc.tcp.checksum;
+	uint64_t h;
+
+	if (checksum)
+		return req->rq_cksum;
+
+	/* mix the header the way a 64-bit finalizer would */
+	h = ((uint64_t)req->rq_prog << 32) ^ ((uint64_t)req->rq_vers << 16) ^
+	    req->rq_proc ^ ((uint64_t)req->rq_xid << 24);
+	h ^= h >> 33;
+	h *= 0xFF51AFD7ED558CCDULL;
+	h ^= h >> 33;
+
+	return h;
+}
+
 static inline bool nfs_dupreq_v4_cacheable(nfs_request_t *reqnfs)
 {
 	COMPOUND4args *arg_c4 = (COMPOUND4args *)&reqnfs->arg_nfs;
@@ -970,13 +1130,49 @@ dupreq_status_t nfs_dupreq_start(nfs_request_t *reqnfs,
 		goto release_dk;
 	}
 
-	/* TI-RPC computed checksum */
-	dk->hk = req->rq_cksum;
+	/* TI-RPC computed checksum, or the call header */
+	dk->hk = dupreq_checksum(drc, req);
 
 	dk->state = DUPREQ_START;
 	dk->timestamp = time(NULL);
 
-	{
+	if (drc->flags & DRC_FLAG_TABLE) {
+		uint64_t hash = dupreq_xid_hash(dk);
+
+		PTHREAD_MUTEX_lock(&drc->mtx);
+		dv = gsh_oa_lookup(&drc->xid_t, hash, dupreq_xid_match, dk);
+		if (dv) {
+			/* cached request */
+			PTHREAD_MUTEX_lock(&dv->mtx);
+			if (unlikely(dv->state == DUPREQ_START)) {
+				status = DUPREQ_BEING_PROCESSED;
+			} else {
+				res = dv->res;
+				drc_inc_retwnd(drc);
+				dv->referenced = true;
+				status = DUPREQ_EXISTS;
+				(dv->refcnt)++;
+			}
+			LogDebug(COMPONENT_DUPREQ,
+				 "dupreq hit dk=%p, dk xid=%u cksum %" PRIu64
+				 " state=%s", dk, dk->hin.tcp.rq_xid, dk->hk,
+				 dupreq_state_table[dk->state]);
+			req->rq_u1 = dv;
+			PTHREAD_MUTEX_unlock(&dv->mtx);
+		} else {
+			/* new request */
+			res = req->rq_u2 = dk->res = alloc_nfs_res();
+			gsh_oa_insert(&drc->xid_t, hash, dk);
+			/* the hand comes to it last */
+			TAILQ_INSERT_TAIL(&drc->dupreq_q, dk, fifo_q);
+			(dk->refcnt)++;
+			++(drc->size);
+			req->rq_u1 = dk;
+			release_dk = false;
+			dv = dk;
+		}
+		PTHREAD_MUTEX_unlock(&drc->mtx);
+	} else {
 		struct opr_rbtree_node *nv;
 		struct rbtree_x_part *t =
 		    rbtx_partition_of_scalar(&drc->xt, dk->hk);
@@ -1035,8 +1231,23 @@ dupreq_status_t nfs_dupreq_start(nfs_request_t *reqnfs,
 	nfs_dupreq_put_drc(req->rq_xprt, drc, DRC_FLAG_NONE);	/* dk ref */
 
  out:
+	/* A hit on an encoded reply has no result to hand back */
+	reqnfs->res_nfs = res;
 	if (res)
-		reqnfs->res_nfs = req->rq_u2 = res;
+		req->rq_u2 = res;
+
+	if (status == DUPREQ_EXISTS)
+		(void)atomic_inc_uint64_t(&drc_counts.hits);
+	else if (status == DUPREQ_BEING_PROCESSED)
+		(void)atomic_inc_uint64_t(&drc_counts.in_progress);
+	else if (req->rq_u1 == (void *)DUPREQ_NOCACHE)
+		(void)atomic_inc_uint64_t(&drc_counts.nocache);
+	else if (status == DUPREQ_SUCCESS)
+		(void)atomic_inc_uint64_t(&drc_counts.misses);
+
+#ifdef USE_LTTNG
+	tracepoint(nfs_rpc, dupreq, req->rq_xid, status);
+#endif
 
 	return status;
 }
@@ -1082,6 +1293,15 @@ dupreq_status_t nfs_dupreq_finish(struct svc_req *req, nfs_res_t *res_nfs)
 	if (dv == (void *)DUPREQ_BAD_ADDR1)
 		goto out;
 
+	/* Once the reply is encoded, the decoded result is not needed */
+	if (dv->reply != NULL) {
+		const nfs_function_desc_t *func = nfs_dupreq_func(dv);
+
+		func->free_function(res_nfs);
+		free_nfs_res(res_nfs);
+		res_nfs = NULL;
+	}
+
 	PTHREAD_MUTEX_lock(&dv->mtx);
 	dv->res = res_nfs;
 	dv->timestamp = time(NULL);
@@ -1098,6 +1318,22 @@ dupreq_status_t nfs_dupreq_finish(struct svc_req *req, nfs_res_t *res_nfs)
 		     dupreq_state_table[dv->state], dupreq_status_table[status],
 		     dv->refcnt);
 
+	if (drc->flags & DRC_FLAG_TABLE) {
+		if (drc_should_retire(drc)) {
+			drc_dec_retwnd(drc);
+			ov = drc_clock_retire(drc);
+		}
+		PTHREAD_MUTEX_unlock(&drc->mtx);
+
+		if (ov) {
+			LogDebug(COMPONENT_DUPREQ,
+				 "retiring ov=%p xid=%u on DRC=%p",
+				 ov, ov->hin.tcp.rq_xid, drc);
+			nfs_dupreq_free_dupreq(ov);
+		}
+		goto out;
+	}
+
 	/* ok, do the new retwnd calculation here.  then, put drc only if
 	 * we retire an entry */
 	if (drc_should_retire(drc)) {
@@ -1184,6 +1420,17 @@ dupreq_status_t nfs_dupreq_delete(struct svc_req *req)
 		     dupreq_state_table[dv->state], dupreq_status_table[status],
 		     dv->refcnt);
 
+	if (drc->flags & DRC_FLAG_TABLE) {
+		PTHREAD_MUTEX_lock(&drc->mtx);
+		if (gsh_oa_remove(&drc->xid_t, dupreq_xid_hash(dv), dv))
+			--(drc->size);
+		if (TAILQ_IS_ENQUEUED(dv, fifo_q))
+			TAILQ_REMOVE(&drc->dupreq_q, dv, fifo_q);
+		/* release dv's ref and unlock */
+		nfs_dupreq_put_drc(req->rq_xprt, drc, DRC_FLAG_LOCKED);
+		goto out;
+	}
+
 	/* XXX dv holds a ref on drc */
 	t = rbtx_partition_of_scalar(&drc->xt, dv->hk);
 
@@ -1257,6 +1504,125 @@ void nfs_dupreq_rele(struct svc_req *req, const nfs_function_desc_t *func)
 	(void)free_rpc_msg(req->rq_msg);
 }
 
+/* Largest reply kept in encoded form; larger ones keep their result */
+#define DUPREQ_REPLY_MAX 4096
+
+/**
+ * @brief XDR routine for an encoded reply
+ *
+ * The bytes are already a whole number of XDR units, so xdr_opaque()
+ * adds no padding.
+ */
+static bool xdr_dupreq_reply(XDR *xdrs, struct dupreq_reply *reply)
+{
+	if (xdrs->x_op != XDR_ENCODE)
+		return true;
+
+	return xdr_opaque(xdrs, reply->data, reply->len);
+}
+
+/**
+ * @brief Encode a result for the cache
+ *
+ * @param[in] func The function descriptor for this request type
+ * @param[in] res  The result
+ *
+ * @return The encoded reply, or NULL if it did not fit.
+ */
+static struct dupreq_reply *nfs_dupreq_encode(const nfs_function_desc_t *func,
+					      nfs_res_t *res)
+{
+	struct dupreq_reply *reply;
+	XDR xdrs;
+	bool ok;
+
+	reply = gsh_malloc(sizeof(*reply) + DUPREQ_REPLY_MAX);
+
+	memset(&xdrs, 0, sizeof(xdrs));
+	xdrmem_create(&xdrs, reply->data, DUPREQ_REPLY_MAX, XDR_ENCODE);
+	ok = func->xdr_encode_func(&xdrs, res);
+	reply->len = xdr_getpos(&xdrs);
+	xdr_destroy(&xdrs);
+
+	if (!ok) {
+		gsh_free(reply);
+		return NULL;
+	}
+
+	return gsh_realloc(reply, sizeof(*reply) + reply->len);
+}
+
+/**
+ * @brief Send the reply to a request
+ *
+ * A cacheable request's result is encoded once, here, into the reply
+ * the cache keeps; that is what goes on the wire, and what a replay
+ * sends again without encoding anything.  nfs_dupreq_finish() then
+ * frees the decoded result.  Uncached requests, and results too
+ * large to keep encoded, are sent from the result as before.
+ *
+ * @param[in] xprt The transport
+ * @param[in] req  The request
+ * @param[in] func The function descriptor for this request type
+ * @param[in] res  The result, NULL on a hit on an encoded reply
+ *
+ * @return true if the reply was sent.
+ */
+bool nfs_dupreq_sendreply(SVCXPRT *xprt, struct svc_req *req,
+			  const nfs_function_desc_t *func, nfs_res_t *res)
+{
+	dupreq_entry_t *dv = (dupreq_entry_t *) req->rq_u1;
+
+	if (dv == (void *)DUPREQ_NOCACHE || dv == (void *)DUPREQ_BAD_ADDR1)
+		goto result;
+
+	/* Only the thread that owns a request in START touches its reply;
+	 * once COMPLETE it never changes.
+	 */
+	if (dv->state == DUPREQ_START)
+		dv->reply = nfs_dupreq_encode(func, res);
+
+	if (dv->reply != NULL)
+		return svc_sendreply(xprt, req, (xdrproc_t) xdr_dupreq_reply,
+				     (caddr_t) dv->reply);
+
+ result:
+	return svc_sendreply(xprt, req, func->xdr_encode_func, (caddr_t) res);
+}
+
+#define DRC_LOOKUPS "ganesha_drc_lookups_total{result="
+
+/**
+ * @brief Render the DRC counters
+ *
+ * @param[in,out] mb Buffer
+ */
+void nfs_dupreq_metrics(struct metrics_buf *mb)
+{
+	metrics_family(mb, "ganesha_drc_lookups", "counter",
+		       "DRC lookups by outcome");
+	metrics_printf(mb, "%s\"hit\"} %" PRIu64 "\n", DRC_LOOKUPS,
+		       atomic_fetch_uint64_t(&drc_counts.hits));
+	metrics_printf(mb, "%s\"in_progress\"} %" PRIu64 "\n", DRC_LOOKUPS,
+		       atomic_fetch_uint64_t(&drc_counts.in_progress));
+	metrics_printf(mb, "%s\"miss\"} %" PRIu64 "\n", DRC_LOOKUPS,
+		       atomic_fetch_uint64_t(&drc_counts.misses));
+	metrics_printf(mb, "%s\"nocache\"} %" PRIu64 "\n", DRC_LOOKUPS,
+		       atomic_fetch_uint64_t(&drc_counts.nocache));
+
+	if (drc_st == NULL)
+		return;
+
+	metrics_family(mb, "ganesha_drc_udp_entries", "gauge",
+		       "Requests in the shared UDP DRC");
+	metrics_printf(mb, "ganesha_drc_udp_entries %" PRIu32 "\n",
+		       atomic_fetch_uint32_t(&drc_st->udp_drc.size));
+	metrics_family(mb, "ganesha_drc_tcp_recycle", "gauge",
+		       "Per-connection DRCs kept for reconnecting clients");
+	metrics_printf(mb, "ganesha_drc_tcp_recycle %" PRId32 "\n",
+		       atomic_fetch_int32_t(&drc_st->tcp_drc_recycle_qlen));
+}
+
 /**
  * @brief Shutdown the dupreq2 package.
  */
@@ -50,6 +50,8 @@
 #include <grp.h>
 
 #include "hashtable.h"
+#include "city.h"
+#include "gsh_hash.h"
 #include "log.h"
 #include "nfs_core.h"
 #include "nfs23.h"
@@ -158,11 +160,9 @@ bool copy_xprt_addr(sockaddr_t *addr, SVCXPRT *xprt)
 /**
  * @brief Create a hash value based on the sockaddr_t structure
  *
- * This creates a native pointer size (unsigned long int) hash value
- * from the sockaddr_t structure. It supports both IPv4 and IPv6,
- * other types can be added in time.
- *
- * XXX is this hash...good?
+ * This creates a 64 bit hash value from the sockaddr_t structure,
+ * with CityHash.  It supports both IPv4 and IPv6, other types can
+ * be added in time.
  *
  * @param[in] addr        sockaddr_t address to hash
  * @param[in] ignore_port Whether to ignore the port
@@ -172,34 +172,28 @@ bool copy_xprt_addr(sockaddr_t *addr, SVCXPRT *xprt)
  */
 uint64_t hash_sockaddr(sockaddr_t *addr, bool ignore_port)
 {
-	unsigned long addr_hash = 0;
-	int port;
+	uint64_t port = 0;
 
 	switch (addr->ss_family) {
 	case AF_INET:
 		{
 			struct sockaddr_in *paddr = (struct sockaddr_in *)addr;
 
-			addr_hash = paddr->sin_addr.s_addr;
-			if (!ignore_port) {
+			if (!ignore_port)
 				port = paddr->sin_port;
-				addr_hash ^= (port << 16);
-			}
-			break;
+			return gsh_hash_u64_2(paddr->sin_addr.s_addr, port,
+					      AF_INET);
 		}
 	case AF_INET6:
 		{
 			struct sockaddr_in6 *paddr =
 			    (struct sockaddr_in6 *)addr;
-			uint32_t *va;
 
-			va = (uint32_t *)&paddr->sin6_addr;
-			addr_hash = va[0] ^ va[1] ^ va[2] ^ va[3];
-			if (!ignore_port) {
+			if (!ignore_port)
 				port = paddr->sin6_port;
-				addr_hash ^= (port << 16);
-			}
-			break;
+			return CityHash64WithSeed(
+					(char *)&paddr->sin6_addr,
+					sizeof(paddr->sin6_addr), port);
 		}
 #ifdef RPC_VSOCK
 	case AF_VSOCK:
@@ -207,16 +201,14 @@ uint64_t hash_sockaddr(sockaddr_t *addr, bool ignore_port)
 		struct sockaddr_vm *svm; /* XXX checkpatch horror */
 
 		svm = (struct sockaddr_vm *) addr;
-		addr_hash = svm->svm_cid;
 		if (!ignore_port)
-			addr_hash ^= svm->svm_port;
+			port = svm->svm_port;
+		return gsh_hash_u64_2(svm->svm_cid, port, AF_VSOCK);
 	}
 #endif /* VSOCK */
 	default:
-		break;
+		return 0;
 	}
-
-	return addr_hash;
 }
 
 int display_sockaddr(struct display_buffer *dspbuf, sockaddr_t *addr)
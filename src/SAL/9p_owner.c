@@ -40,6 +40,7 @@
 #include "hashtable.h"
 #include "nfs_core.h"
 #include "sal_functions.h"
+#include "gsh_hash.h"
 
 /**
  * @brief Hash table for 9p owners
@@ -178,20 +179,15 @@ int compare_9p_owner_key(struct gsh_buffdesc *buff1, struct gsh_buffdesc *buff2)
 }
 
 /**
- * @brief Get the hash index from a 9p owner
+ * @brief Hash a 9p owner
  *
- * @param[in] hparam Hash parameters
- * @param[in] key The key to hash
+ * @param[in] pkey The owner
  *
- * @return The hash index.
+ * @return The hash.
  */
 
-uint32_t _9p_owner_value_hash_func(hash_parameter_t *hparam,
-				   struct gsh_buffdesc *key)
+static uint64_t _9p_owner_hash(state_owner_t *pkey)
 {
-	unsigned long res;
-	state_owner_t *pkey = key->addr;
-
 	struct sockaddr_in *paddr =
 	    (struct sockaddr_in *)&pkey->so_owner.so_9p_owner.client_addr;
 
@@ -200,15 +196,29 @@ uint32_t _9p_owner_value_hash_func(hash_parameter_t *hparam,
 	/** @todo using sin_addr.s_addr as an int makes this only work for
 	 *        IPv4.
 	 */
-	res = (unsigned long)(pkey->so_owner.so_9p_owner.proc_id) +
-	      (unsigned long)paddr->sin_addr.s_addr;
+	return gsh_hash_u64_2(pkey->so_owner.so_9p_owner.proc_id,
+			      paddr->sin_addr.s_addr, 0);
+}
+
+/**
+ * @brief Get the hash index from a 9p owner
+ *
+ * @param[in] hparam Hash parameters
+ * @param[in] key The key to hash
+ *
+ * @return The hash index.
+ */
+
+uint32_t _9p_owner_value_hash_func(hash_parameter_t *hparam,
+				   struct gsh_buffdesc *key)
+{
+	uint64_t res = _9p_owner_hash(key->addr);
 
 	if (isDebug(COMPONENT_HASHTABLE))
-		LogFullDebug(COMPONENT_STATE, "value = %lu",
+		LogFullDebug(COMPONENT_STATE, "value = %" PRIu64,
 			     res % hparam->index_size);
 
-	return (uint32_t)(res % hparam->index_size);
-
+	return res % hparam->index_size;
 }
 
 /**
@@ -223,19 +233,7 @@ uint32_t _9p_owner_value_hash_func(hash_parameter_t *hparam,
 uint64_t _9p_owner_rbt_hash_func(hash_parameter_t *hparam,
 				 struct gsh_buffdesc *key)
 {
-	uint64_t res;
-	state_owner_t *pkey = key->addr;
-
-	struct sockaddr_in *paddr =
-	    (struct sockaddr_in *)&pkey->so_owner.so_9p_owner.client_addr;
-
-	/* so_owner_len is always zero so don't bother with so_owner_val */
-
-	/** @todo using sin_addr.s_addr as an int makes this only work for
-	 *        IPv4.
-	 */
-	res = (uint64_t)(pkey->so_owner.so_9p_owner.proc_id) +
-	      (uint64_t)paddr->sin_addr.s_addr;
+	uint64_t res = _9p_owner_hash(key->addr);
 
 	if (isDebug(COMPONENT_HASHTABLE))
 		LogFullDebug(COMPONENT_STATE, "rbt = %" PRIu64, res);
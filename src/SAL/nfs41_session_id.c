@@ -37,6 +37,8 @@
 #include "config.h"
 #include "nfs_core.h"
 #include "sal_functions.h"
+#include "nfs_rpc_callback.h"
+#include "nfs_proto_functions.h"
 
 /**
  * @brief Pool for allocating session data
@@ -189,7 +191,7 @@ static hash_parameter_t session_id_param = {
 	.compare_key = compare_session_id,
 	.key_to_str = display_session_id_key,
 	.val_to_str = display_session_id_val,
-	.flags = HT_FLAG_CACHE,
+	.flags = HT_FLAG_CACHE | HT_FLAG_LOCKLESS_READ | HT_FLAG_GROW,
 };
 
 /**
@@ -237,6 +239,127 @@ int32_t inc_session_ref(nfs41_session_t *session)
 	return refcnt;
 }
 
+/**
+ * @brief Take a reference on a session found in the hash table
+ *
+ * @param[in] val Buffer pointing to the session
+ */
+static void Hash_inc_session_ref(struct gsh_buffdesc *val)
+{
+	(void) inc_session_ref(val->addr);
+}
+
+/**
+ * @brief Drop a reference to a cached reply, freeing it with the last
+ *
+ * @param[in] reply The reply
+ */
+void nfs41_put_reply(struct nfs41_cached_reply *reply)
+{
+	if (atomic_dec_int32_t(&reply->refcount) != 0)
+		return;
+
+	nfs4_Compound_Free((nfs_res_t *) &reply->res);
+	gsh_free(reply);
+}
+
+/**
+ * @brief Cache the reply of a request in its slot
+ *
+ * The reply being sent is marked cached and shares the slot's
+ * reference-counted copy, so a replay of it and the next request on
+ * the slot never free it from under each other.  The last reply's
+ * storage is reused when the slot had the only reference to it.
+ *
+ * @param[in]     slot The slot
+ * @param[in,out] res  The reply, about to be sent
+ */
+void nfs41_slot_cache_reply(nfs41_session_slot_t *slot,
+			    struct COMPOUND4res_extended *res)
+{
+	struct nfs41_cached_reply *reply, *old;
+	struct COMPOUND4res_extended stale;
+
+	res->res_cached = true;
+
+	PTHREAD_MUTEX_lock(&slot->lock);
+
+	/* References are only taken under the slot lock */
+	old = slot->reply;
+	if (old != NULL && atomic_fetch_int32_t(&old->refcount) == 1) {
+		stale = old->res;
+		reply = old;
+		old = NULL;
+	} else {
+		stale.res_cached = true;
+		reply = gsh_malloc(sizeof(*reply));
+		slot->reply = reply;
+	}
+
+	reply->res = *res;
+	reply->res.res_cached = false;
+	reply->res.res_reply = NULL;
+	atomic_store_int32_t(&reply->refcount, 2);
+	res->res_reply = reply;
+
+	PTHREAD_MUTEX_unlock(&slot->lock);
+
+	if (!stale.res_cached)
+		nfs4_Compound_Free((nfs_res_t *) &stale);
+	if (old != NULL)
+		nfs41_put_reply(old);
+}
+
+/**
+ * @brief Take a reference to the reply cached in a slot
+ *
+ * @note The caller must hold the slot lock.
+ *
+ * @param[in] slot The slot
+ *
+ * @return The reply, or NULL if none is cached.
+ */
+struct nfs41_cached_reply *nfs41_slot_get_reply(nfs41_session_slot_t *slot)
+{
+	if (slot->reply != NULL)
+		(void) atomic_inc_int32_t(&slot->reply->refcount);
+
+	return slot->reply;
+}
+
+/**
+ * @brief Drop the replies cached in slots a client gave up
+ *
+ * The slots are past the client's sa_highest_slotid, so it has no
+ * request on them it could retry; a request in flight on one caches
+ * its own reply as usual.  Should a replay come anyway, it gets
+ * NFS4ERR_RETRY_UNCACHED_REP.
+ *
+ * @param[in] session The session
+ * @param[in] first   First slot to drop the reply of
+ */
+void nfs41_session_trim_slots(nfs41_session_t *session, slotid4 first)
+{
+	struct nfs41_cached_reply *reply;
+	nfs41_session_slot_t *slot;
+	slotid4 i;
+
+	for (i = first; i < session->fore_channel_attrs.ca_maxrequests; i++) {
+		slot = &session->slots[i];
+
+		if (atomic_fetch_voidptr((void **) &slot->reply) == NULL)
+			continue;
+
+		PTHREAD_MUTEX_lock(&slot->lock);
+		reply = slot->reply;
+		slot->reply = NULL;
+		PTHREAD_MUTEX_unlock(&slot->lock);
+
+		if (reply != NULL)
+			nfs41_put_reply(reply);
+	}
+}
+
 int32_t dec_session_ref(nfs41_session_t *session)
 {
 	int i;
@@ -250,14 +373,21 @@ int32_t dec_session_ref(nfs41_session_t *session)
 		glist_del(&session->session_link);
 		PTHREAD_MUTEX_unlock(&session->clientid_record->cid_mutex);
 
+		/* Fail any callbacks still waiting for a slot */
+		nfs41_abort_cb_pending(session);
+
 		/* Decrement our reference to the clientid record */
 		dec_client_id_ref(session->clientid_record);
 		/* Destroy this session's mutexes and condition variable */
 
-		for (i = 0; i < NFS41_NB_SLOTS; i++)
+		for (i = 0; i < session->fore_channel_attrs.ca_maxrequests;
+		     i++) {
 			PTHREAD_MUTEX_destroy(&session->slots[i].lock);
+			if (session->slots[i].reply != NULL)
+				nfs41_put_reply(session->slots[i].reply);
+		}
+		gsh_free(session->slots);
 
-		PTHREAD_COND_destroy(&session->cb_cond);
 		PTHREAD_MUTEX_destroy(&session->cb_mutex);
 
 		/* Destroy the session's back channel (if any) */
@@ -331,7 +461,6 @@ int nfs41_Session_Get_Pointer(char sessionid[NFS4_SESSIONID_SIZE],
 {
 	struct gsh_buffdesc key;
 	struct gsh_buffdesc val;
-	struct hash_latch latch;
 	char str[LOG_BUFF_LEN];
 	struct display_buffer dspbuf = {sizeof(str), str, str};
 	bool str_valid = false;
@@ -346,9 +475,9 @@ int nfs41_Session_Get_Pointer(char sessionid[NFS4_SESSIONID_SIZE],
 	key.addr = sessionid;
 	key.len = NFS4_SESSIONID_SIZE;
 
-	code = hashtable_getlatch(ht_session_id, &key, &val, false, &latch);
+	code = hashtable_getref(ht_session_id, &key, &val,
+				Hash_inc_session_ref);
 	if (code != HASHTABLE_SUCCESS) {
-		hashtable_releaselatched(ht_session_id, &latch);
 		if (str_valid)
 			LogFullDebug(COMPONENT_SESSIONS,
 				     "Session %s Not Found", str);
@@ -356,9 +485,6 @@ int nfs41_Session_Get_Pointer(char sessionid[NFS4_SESSIONID_SIZE],
 	}
 
 	*session_data = val.addr;
-	inc_session_ref(*session_data);	/* XXX more locks? */
-
-	hashtable_releaselatched(ht_session_id, &latch);
 
 	if (str_valid)
 		LogFullDebug(COMPONENT_SESSIONS, "Session %s Found", str);
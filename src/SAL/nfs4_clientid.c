@@ -340,6 +340,9 @@ void free_client_id(nfs_client_id_t *clientid)
 
 	PTHREAD_MUTEX_destroy(&clientid->cid_mutex);
 	PTHREAD_MUTEX_destroy(&clientid->cid_owner.so_mutex);
+	if (clientid->cid_create_session_slot.reply != NULL)
+		nfs41_put_reply(clientid->cid_create_session_slot.reply);
+	PTHREAD_MUTEX_destroy(&clientid->cid_create_session_slot.lock);
 	if (clientid->cid_minorversion == 0)
 		PTHREAD_MUTEX_destroy(&clientid->cid_cb.v40.cb_chan.mtx);
 
@@ -530,6 +533,8 @@ nfs_client_id_t *create_client_id(clientid4 clientid,
 
 	PTHREAD_MUTEX_init(&owner->so_mutex, NULL);
 
+	PTHREAD_MUTEX_init(&client_rec->cid_create_session_slot.lock, NULL);
+
 	/* initialize the chan mutex for v4 */
 	if (minorversion == 0) {
 		PTHREAD_MUTEX_init(&client_rec->cid_cb.v40.cb_chan.mtx, NULL);
@@ -552,6 +557,7 @@ nfs_client_id_t *create_client_id(clientid4 clientid,
 	/* need to init the list_head */
 	glist_init(&client_rec->cid_openowners);
 	glist_init(&client_rec->cid_lockowners);
+	glist_init(&client_rec->cid_layoutrecall_queue);
 
 	/* set up the content of the clientid_owner */
 	owner->so_type = STATE_CLIENTID_OWNER_NFSV4;
@@ -615,6 +621,8 @@ clientid_status_t nfs_client_id_insert(nfs_client_id_t *clientid)
 	/* Take a reference to the unconfirmed clientid for the hash table. */
 	(void)inc_client_id_ref(clientid);
 
+	nfs4_lease_wheel_add(clientid);
+
 	if (isFullDebug(COMPONENT_CLIENTID) &&
 	    isFullDebug(COMPONENT_HASHTABLE)) {
 		LogFullDebug(COMPONENT_CLIENTID,
@@ -662,6 +670,8 @@ int remove_confirmed_client_id(nfs_client_id_t *clientid)
 	/* Set this up so this client id record will be freed. */
 	clientid->cid_confirmed = EXPIRED_CLIENT_ID;
 
+	nfs4_lease_wheel_del(clientid);
+
 	/* Release hash table reference to the unconfirmed record */
 	(void)dec_client_id_ref(clientid);
 
@@ -706,6 +716,8 @@ int remove_unconfirmed_client_id(nfs_client_id_t *clientid)
 	/* Set this up so this client id record will be freed. */
 	clientid->cid_confirmed = EXPIRED_CLIENT_ID;
 
+	nfs4_lease_wheel_del(clientid);
+
 	/* Release hash table reference to the unconfirmed record */
 	(void)dec_client_id_ref(clientid);
 
@@ -781,6 +793,8 @@ clientid_status_t nfs_client_id_confirm(nfs_client_id_t *clientid,
 		   freed. */
 		clientid->cid_confirmed = EXPIRED_CLIENT_ID;
 
+		nfs4_lease_wheel_del(clientid);
+
 		/* Release hash table reference to the unconfirmed
 		   record */
 		(void)dec_client_id_ref(clientid);
@@ -936,6 +950,8 @@ bool nfs_client_id_expire(nfs_client_id_t *clientid, bool make_stale)
 				" error=%s", clientid->cid_clientid,
 				hash_table_err_to_str(rc));
 		}
+
+		nfs4_lease_wheel_del(clientid);
 	}
 
 	/* Traverse the client's lock owners, and release all
@@ -1080,7 +1096,7 @@ bool nfs_client_id_expire(nfs_client_id_t *clientid, bool make_stale)
 	}
 
 	if (clientid->cid_recov_dir != NULL && !make_stale) {
-		nfs4_rm_clid(clientid->cid_recov_dir, v4_recov_dir, 0);
+		nfs4_rm_clid(clientid);
 		gsh_free(clientid->cid_recov_dir);
 		clientid->cid_recov_dir = NULL;
 	}
@@ -1222,7 +1238,7 @@ static hash_parameter_t cid_confirmed_hash_param = {
 	.key_to_str = display_client_id_key,
 	.val_to_str = display_client_id_val,
 	.ht_name = "Confirmed Client ID",
-	.flags = HT_FLAG_CACHE,
+	.flags = HT_FLAG_CACHE | HT_FLAG_LOCKLESS_READ | HT_FLAG_GROW,
 	.ht_log_component = COMPONENT_CLIENTID,
 };
 
@@ -1235,7 +1251,7 @@ static hash_parameter_t cid_unconfirmed_hash_param = {
 	.key_to_str = display_client_id_key,
 	.val_to_str = display_client_id_val,
 	.ht_name = "Unconfirmed Client ID",
-	.flags = HT_FLAG_CACHE,
+	.flags = HT_FLAG_CACHE | HT_FLAG_LOCKLESS_READ | HT_FLAG_GROW,
 	.ht_log_component = COMPONENT_CLIENTID,
 };
 
@@ -1248,7 +1264,7 @@ static hash_parameter_t cr_hash_param = {
 	.key_to_str = display_client_record_key,
 	.val_to_str = display_client_record_val,
 	.ht_name = "Client Record",
-	.flags = HT_FLAG_CACHE,
+	.flags = HT_FLAG_CACHE | HT_FLAG_GROW,
 	.ht_log_component = COMPONENT_CLIENTID,
 };
 
@@ -1290,6 +1306,8 @@ int nfs_Init_client_id(void)
 	client_id_pool =
 	    pool_basic_init("NFS4 Client ID Pool", sizeof(nfs_client_id_t));
 
+	nfs4_lease_wheel_init();
+
 	return CLIENT_ID_SUCCESS;
 }
 
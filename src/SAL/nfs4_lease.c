@@ -32,6 +32,12 @@
 /**
  * @file  nfs4_lease.c
  * @brief NFSv4 lease management
+ *
+ * Every hashed clientid also sits on the lease wheel, filed under the
+ * second its lease could first run out, so the reaper visits only
+ * the clients that are due rather than walking the clientid tables.
+ * Renewals do not touch the wheel: a renewed client is simply filed
+ * again, under its new expiry, when the reaper finds it still valid.
  */
 
 #include "config.h"
@@ -157,4 +163,220 @@ void update_lease(nfs_client_id_t *clientid)
 	}
 }
 
+/**
+ * @brief When the lease will run out if not renewed
+ *
+ * The caller must hold cid_mutex.  A reserved lease cannot run out
+ * before a full lifetime after the reservation is released, so that
+ * is the earliest it need be looked at again.
+ *
+ * @param[in] clientid Record to check
+ *
+ * @return The expiry time.
+ */
+time_t lease_expiry(nfs_client_id_t *clientid)
+{
+	if (clientid->cid_lease_reservations != 0)
+		return time(NULL) + nfs_param.nfsv4_param.lease_lifetime;
+
+	return clientid->cid_last_renew + nfs_param.nfsv4_param.lease_lifetime;
+}
+
+/* A hierarchical timer wheel with a one second tick.  Level n has
+ * LEASE_WHEEL_SLOTS slots of LEASE_WHEEL_SLOTS^n seconds each; as the
+ * tick reaches the start of a slot on a higher level, its clients are
+ * cascaded down, so each client is moved at most once per level.
+ * Anything due after the last level can reach is filed at its far
+ * end and filed again when found early.
+ */
+#define LEASE_WHEEL_BITS 6
+#define LEASE_WHEEL_SLOTS (1 << LEASE_WHEEL_BITS)
+#define LEASE_WHEEL_MASK (LEASE_WHEEL_SLOTS - 1)
+#define LEASE_WHEEL_LEVELS 3
+#define LEASE_WHEEL_SPAN ((time_t) 1 << \
+			  (LEASE_WHEEL_BITS * LEASE_WHEEL_LEVELS))
+
+static struct glist_head lease_wheel[LEASE_WHEEL_LEVELS][LEASE_WHEEL_SLOTS];
+
+/** Clients whose second has come, waiting for the reaper */
+static struct glist_head lease_due;
+
+/** The next second the wheel will run */
+static time_t lease_wheel_now;
+
+/** Protects the wheel and the due list; taken with no other lock held
+ * but cid_mutex.
+ */
+static pthread_mutex_t lease_wheel_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+void nfs4_lease_wheel_init(void)
+{
+	int level, slot;
+
+	for (level = 0; level < LEASE_WHEEL_LEVELS; level++)
+		for (slot = 0; slot < LEASE_WHEEL_SLOTS; slot++)
+			glist_init(&lease_wheel[level][slot]);
+
+	glist_init(&lease_due);
+	lease_wheel_now = time(NULL);
+}
+
+/**
+ * @brief File a client under its due time
+ *
+ * Called with lease_wheel_mutex held.
+ */
+static void lease_wheel_file(nfs_client_id_t *clientid)
+{
+	time_t due = clientid->cid_lease_due;
+	time_t delta;
+	int level;
+
+	if (due < lease_wheel_now)
+		due = lease_wheel_now;
+
+	delta = due - lease_wheel_now;
+
+	if (delta >= LEASE_WHEEL_SPAN) {
+		delta = LEASE_WHEEL_SPAN - 1;
+		due = lease_wheel_now + delta;
+	}
+
+	for (level = 0; level < LEASE_WHEEL_LEVELS - 1; level++)
+		if (delta < (time_t) 1 << (LEASE_WHEEL_BITS * (level + 1)))
+			break;
+
+	glist_add_tail(&lease_wheel[level][(due >> (LEASE_WHEEL_BITS * level))
+					   & LEASE_WHEEL_MASK],
+		       &clientid->cid_lease_link);
+}
+
+/**
+ * @brief Move the clients of a slot down to lower levels
+ *
+ * Called with lease_wheel_mutex held.
+ *
+ * @return The slot index, zero when the next level must cascade too.
+ */
+static int lease_wheel_cascade(int level)
+{
+	int slot = (lease_wheel_now >> (LEASE_WHEEL_BITS * level)) &
+		   LEASE_WHEEL_MASK;
+	struct glist_head list;
+	struct glist_head *glist, *glistn;
+
+	glist_init(&list);
+	glist_splice_tail(&list, &lease_wheel[level][slot]);
+
+	glist_for_each_safe(glist, glistn, &list) {
+		glist_del(glist);
+		lease_wheel_file(glist_entry(glist, nfs_client_id_t,
+					     cid_lease_link));
+	}
+
+	return slot;
+}
+
+/**
+ * @brief Put a newly hashed client on the wheel
+ *
+ * The wheel holds a reference on the client until the reaper or
+ * nfs4_lease_wheel_del takes it off.
+ *
+ * @param[in] clientid The client, just inserted in the unconfirmed table
+ */
+void nfs4_lease_wheel_add(nfs_client_id_t *clientid)
+{
+	inc_client_id_ref(clientid);
+
+	/* A new record has no reservations and cannot be renewed before
+	 * its first operation, so needs no cid_mutex to read.
+	 */
+	clientid->cid_lease_due = lease_expiry(clientid);
+
+	PTHREAD_MUTEX_lock(&lease_wheel_mutex);
+	lease_wheel_file(clientid);
+	PTHREAD_MUTEX_unlock(&lease_wheel_mutex);
+}
+
+/**
+ * @brief Take an unhashed client off the wheel
+ *
+ * Does nothing if the reaper already holds it.
+ *
+ * @param[in] clientid The client, being marked expired
+ */
+void nfs4_lease_wheel_del(nfs_client_id_t *clientid)
+{
+	bool linked;
+
+	PTHREAD_MUTEX_lock(&lease_wheel_mutex);
+	linked = !glist_null(&clientid->cid_lease_link);
+	if (linked)
+		glist_del(&clientid->cid_lease_link);
+	PTHREAD_MUTEX_unlock(&lease_wheel_mutex);
+
+	if (linked)
+		dec_client_id_ref(clientid);
+}
+
+/**
+ * @brief Take the next client whose lease may have run out
+ *
+ * Runs the wheel up to and including @a now.  The wheel's reference
+ * passes to the caller, who must either put it back with
+ * nfs4_lease_wheel_refile or release it.
+ *
+ * @param[in] now  The current time
+ *
+ * @return A client, or NULL if none is due.
+ */
+nfs_client_id_t *nfs4_lease_wheel_next(time_t now)
+{
+	nfs_client_id_t *clientid = NULL;
+	int level;
+
+	PTHREAD_MUTEX_lock(&lease_wheel_mutex);
+
+	while (glist_empty(&lease_due) && lease_wheel_now <= now) {
+		for (level = 1; level < LEASE_WHEEL_LEVELS; level++) {
+			if ((lease_wheel_now &
+			     (((time_t) 1 << (LEASE_WHEEL_BITS * level)) - 1))
+			    != 0)
+				break;
+
+			if (lease_wheel_cascade(level) != 0)
+				break;
+		}
+
+		glist_splice_tail(&lease_due,
+				  &lease_wheel[0][lease_wheel_now &
+						  LEASE_WHEEL_MASK]);
+		lease_wheel_now++;
+	}
+
+	clientid = glist_first_entry(&lease_due, nfs_client_id_t,
+				     cid_lease_link);
+	if (clientid != NULL)
+		glist_del(&clientid->cid_lease_link);
+
+	PTHREAD_MUTEX_unlock(&lease_wheel_mutex);
+
+	return clientid;
+}
+
+/**
+ * @brief Put back a client the reaper found still valid
+ *
+ * @param[in] clientid The client from nfs4_lease_wheel_next
+ * @param[in] due      When to look at it next
+ */
+void nfs4_lease_wheel_refile(nfs_client_id_t *clientid, time_t due)
+{
+	PTHREAD_MUTEX_lock(&lease_wheel_mutex);
+	clientid->cid_lease_due = due;
+	lease_wheel_file(clientid);
+	PTHREAD_MUTEX_unlock(&lease_wheel_mutex);
+}
+
 /** @} */
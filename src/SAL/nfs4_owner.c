@@ -41,6 +41,8 @@
 #include "sal_functions.h"
 #include "nfs_proto_functions.h"
 #include "nfs_core.h"
+#include "city.h"
+#include "gsh_hash.h"
 
 hash_table_t *ht_nfs4_owner;
 
@@ -243,9 +245,22 @@ int compare_nfs4_owner_key(struct gsh_buffdesc *buff1,
 }
 
 /**
- * @brief Compute the hash index for an NFSv4 owner
+ * @brief Hash an NFSv4 owner
+ *
+ * @param[in] pkey The owner
  *
- * @todo Destroy this function and replace it with a real hash.
+ * @return The hash.
+ */
+static uint64_t nfs4_owner_hash(state_owner_t *pkey)
+{
+	uint64_t seed = gsh_hash_u64_2(pkey->so_owner.so_nfs4_owner.so_clientid,
+				       pkey->so_type, 0);
+
+	return CityHash64WithSeed(pkey->so_owner_val, pkey->so_owner_len, seed);
+}
+
+/**
+ * @brief Compute the hash index for an NFSv4 owner
  *
  * @param[in] hparam Hash parameter
  * @param[in] key    The key
@@ -255,23 +270,7 @@ int compare_nfs4_owner_key(struct gsh_buffdesc *buff1,
 uint32_t nfs4_owner_value_hash_func(hash_parameter_t *hparam,
 				    struct gsh_buffdesc *key)
 {
-	unsigned int sum = 0;
-	unsigned int i = 0;
-	unsigned char c = 0;
-	uint32_t res = 0;
-
-	state_owner_t *pkey = key->addr;
-
-	/* Compute the sum of all the characters */
-	for (i = 0; i < pkey->so_owner_len; i++) {
-		c = ((char *)pkey->so_owner_val)[i];
-		sum += c;
-	}
-
-	res =
-	    ((uint32_t) pkey->so_owner.so_nfs4_owner.so_clientid +
-	     (uint32_t) sum + pkey->so_owner_len +
-	     (uint32_t) pkey->so_type) % (uint32_t) hparam->index_size;
+	uint32_t res = nfs4_owner_hash(key->addr) % hparam->index_size;
 
 	if (isDebug(COMPONENT_HASHTABLE))
 		LogFullDebug(COMPONENT_STATE, "value = %" PRIu32, res);
@@ -282,8 +281,6 @@ uint32_t nfs4_owner_value_hash_func(hash_parameter_t *hparam,
 /**
  * @brief Compute the RBT hash for an NFSv4 owner
  *
- * @todo Destroy this function and replace it with a real hash.
- *
  * @param[in] hparam Hash parameter
  * @param[in] key    The key
  *
@@ -292,22 +289,7 @@ uint32_t nfs4_owner_value_hash_func(hash_parameter_t *hparam,
 uint64_t nfs4_owner_rbt_hash_func(hash_parameter_t *hparam,
 				  struct gsh_buffdesc *key)
 {
-	state_owner_t *pkey = key->addr;
-
-	unsigned int sum = 0;
-	unsigned int i = 0;
-	unsigned char c = 0;
-	uint64_t res = 0;
-
-	/* Compute the sum of all the characters */
-	for (i = 0; i < pkey->so_owner_len; i++) {
-		c = ((char *)pkey->so_owner_val)[i];
-		sum += c;
-	}
-
-	res =
-	    (uint64_t) pkey->so_owner.so_nfs4_owner.so_clientid +
-	    (uint64_t) sum + pkey->so_owner_len + (uint64_t) pkey->so_type;
+	uint64_t res = nfs4_owner_hash(key->addr);
 
 	if (isDebug(COMPONENT_HASHTABLE))
 		LogFullDebug(COMPONENT_STATE, "rbt = %" PRIu64, res);
@@ -349,7 +331,7 @@ static hash_parameter_t nfs4_owner_param = {
 	.compare_key = compare_nfs4_owner_key,
 	.key_to_str = display_nfs4_owner_key,
 	.val_to_str = display_nfs4_owner_val,
-	.flags = HT_FLAG_CACHE,
+	.flags = HT_FLAG_CACHE | HT_FLAG_GROW,
 };
 
 /**
@@ -41,20 +41,155 @@
 #include "bsd-base64.h"
 #include "client_mgr.h"
 #include "fsal.h"
+#include "fridgethr.h"
 
 #define NFS_V4_RECOV_DIR "v4recov"
 #define NFS_V4_OLD_DIR "v4old"
 
-char v4_recov_dir[PATH_MAX];
-char v4_old_dir[PATH_MAX];
+static char v4_recov_dir[PATH_MAX];
+static char v4_old_dir[PATH_MAX];
 time_t current_grace;
 pthread_mutex_t grace_mutex = PTHREAD_MUTEX_INITIALIZER;        /*< Mutex */
 struct glist_head clid_list = GLIST_HEAD_INIT(clid_list);  /*< Clients */
+static struct nfs4_recovery_backend *recovery_backend;
+
+/* Clients on clid_list that have yet to send RECLAIM_COMPLETE, and
+ * whether they all have, which ends the grace period early.
+ */
+static uint32_t reclaims_pending;		/*< Protected by grace_mutex */
+static uint32_t grace_reclaimed;
+
+/* Whether another head of the cluster is in grace, as last polled */
+static uint32_t peers_in_grace;
 
 static void nfs4_load_recov_clids_nolock(nfs_grace_start_t *gsp);
+static void nfs4_count_reclaims_pending(void);
 static void nfs_release_nlm_state(char *release_ip);
 static void nfs_release_v4_client(char *ip);
 
+/* Releases clients of a takeover in parallel */
+static struct fridgethr *release_fridge;
+
+struct release_item {
+	struct glist_head item;
+	void *client;
+};
+
+struct release_batch;
+
+struct release_part {
+	struct glist_head items;	/*< struct release_item */
+	struct release_batch *batch;
+};
+
+/**
+ * @brief Clients to release, partitioned by a hash of the client
+ *
+ * Each partition is released in order by one job of the takeover pool,
+ * so a client listed twice is not released by two threads at once, and
+ * thousands of clients cost a job per partition rather than per client.
+ */
+struct release_batch {
+	pthread_mutex_t mtx;
+	pthread_cond_t cv;
+	uint32_t pending;	/*< Partitions being released */
+	void (*release)(void *client);
+	uint32_t nparts;
+	struct release_part parts[];
+};
+
+static struct release_batch *release_batch_new(void (*release)(void *))
+{
+	uint32_t nparts = nfs_param.nfsv4_param.takeover_threads;
+	struct release_batch *batch;
+	uint32_t i;
+
+	batch = gsh_calloc(1, sizeof(*batch) +
+				 nparts * sizeof(batch->parts[0]));
+	PTHREAD_MUTEX_init(&batch->mtx, NULL);
+	PTHREAD_COND_init(&batch->cv, NULL);
+	batch->release = release;
+	batch->nparts = nparts;
+	for (i = 0; i < nparts; i++) {
+		glist_init(&batch->parts[i].items);
+		batch->parts[i].batch = batch;
+	}
+
+	return batch;
+}
+
+static void release_batch_add(struct release_batch *batch, void *client,
+			      uint64_t hash)
+{
+	struct release_item *item = gsh_malloc(sizeof(*item));
+
+	item->client = client;
+	glist_add_tail(&batch->parts[hash % batch->nparts].items, &item->item);
+}
+
+/** Release the clients of a partition */
+static void release_part(struct release_part *part)
+{
+	struct release_batch *batch = part->batch;
+	struct release_item *item;
+
+	while ((item = glist_first_entry(&part->items, struct release_item,
+					 item)) != NULL) {
+		glist_del(&item->item);
+		batch->release(item->client);
+		gsh_free(item);
+	}
+
+	PTHREAD_MUTEX_lock(&batch->mtx);
+	if (--batch->pending == 0)
+		pthread_cond_signal(&batch->cv);
+	PTHREAD_MUTEX_unlock(&batch->mtx);
+}
+
+static void release_part_job(struct fridgethr_context *ctx)
+{
+	release_part(ctx->arg);
+}
+
+/**
+ * @brief Release the clients of a batch, and free it
+ *
+ * Waits for every partition to be done.  A partition the pool would
+ * not take is released by the caller.
+ */
+static void release_batch_run(struct release_batch *batch)
+{
+	struct release_part *part;
+	uint32_t i;
+
+	batch->pending = 1;	/* Until all are submitted */
+
+	for (i = 0; i < batch->nparts; i++) {
+		part = &batch->parts[i];
+		if (glist_empty(&part->items))
+			continue;
+
+		PTHREAD_MUTEX_lock(&batch->mtx);
+		batch->pending++;
+		PTHREAD_MUTEX_unlock(&batch->mtx);
+
+		if (release_fridge == NULL ||
+		    fridgethr_submit(release_fridge, release_part_job,
+				     part) != 0)
+			release_part(part);
+	}
+
+	PTHREAD_MUTEX_lock(&batch->mtx);
+	batch->pending--;
+	while (batch->pending != 0)
+		pthread_cond_wait(&batch->cv, &batch->mtx);
+	PTHREAD_MUTEX_unlock(&batch->mtx);
+
+	PTHREAD_MUTEX_destroy(&batch->mtx);
+	PTHREAD_COND_destroy(&batch->cv);
+	gsh_free(batch);
+}
+
 /**
  * @brief Start grace period
  *
@@ -91,6 +226,10 @@ void nfs4_start_grace(nfs_grace_start_t *gsp)
 
 	LogEvent(COMPONENT_STATE, "NFS Server Now IN GRACE, duration %d",
 		 (int)nfs_param.nfsv4_param.grace_period);
+	atomic_store_uint32_t(&grace_reclaimed, false);
+
+	if (recovery_backend != NULL && recovery_backend->join_grace != NULL)
+		recovery_backend->join_grace();
 	/*
 	 * if called from failover code and given a nodeid, then this node
 	 * is doing a take over.  read in the client ids from the failing node
@@ -100,22 +239,42 @@ void nfs4_start_grace(nfs_grace_start_t *gsp)
 			 "NFS Server recovery event %d nodeid %d ip %s",
 			 gsp->event, gsp->nodeid, gsp->ipaddr);
 
-		if (gsp->event == EVENT_CLEAR_BLOCKED)
+		if (gsp->event != EVENT_CLEAR_BLOCKED &&
+		    gsp->event != EVENT_RELEASE_IP)
+			nfs4_load_recov_clids_nolock(gsp);
+	}
+
+	nfs4_count_reclaims_pending();
+	PTHREAD_MUTEX_unlock(&grace_mutex);
+
+	/* Released on the takeover pool, which must not wait for the
+	 * grace_mutex.
+	 */
+	if (gsp && gsp->event != EVENT_JUST_GRACE) {
+		if (gsp->event == EVENT_CLEAR_BLOCKED) {
 			cancel_all_nlm_blocked();
-		else {
+		} else {
 			nfs_release_nlm_state(gsp->ipaddr);
 			if (gsp->event == EVENT_RELEASE_IP)
 				nfs_release_v4_client(gsp->ipaddr);
-			else
-				nfs4_load_recov_clids_nolock(gsp);
 		}
 	}
-	PTHREAD_MUTEX_unlock(&grace_mutex);
+}
+
+/** Whether this head is in grace on its own account */
+static inline bool nfs_local_grace(void)
+{
+	return ((atomic_fetch_time_t(&current_grace) +
+		 nfs_param.nfsv4_param.grace_period) > time(NULL)) &&
+	       !atomic_fetch_uint32_t(&grace_reclaimed);
 }
 
 /**
  * @brief Check if we are in the grace period
  *
+ * With a recovery backend shared by a cluster, also while another head
+ * was in grace when last polled.
+ *
  * @retval true if so.
  * @retval false if not.
  */
@@ -127,8 +286,8 @@ int nfs_in_grace(void)
 	if (nfs_param.nfsv4_param.graceless)
 		return 0;
 
-	in_grace = ((atomic_fetch_time_t(&current_grace) +
-		     nfs_param.nfsv4_param.grace_period) > time(NULL));
+	in_grace = nfs_local_grace() ||
+		   atomic_fetch_uint32_t(&peers_in_grace);
 
 	if (in_grace != last_grace) {
 		LogEvent(COMPONENT_STATE, "NFS Server Now %s",
@@ -292,15 +451,12 @@ void nfs4_create_clid_name41(nfs_client_record_t *cl_rec,
  *
  * @param[in] clientid Client record
  */
-void nfs4_add_clid(nfs_client_id_t *clientid)
+static void fs_add_clid(nfs_client_id_t *clientid)
 {
 	int err = 0;
 	char path[PATH_MAX] = {0}, segment[NAME_MAX + 1] = {0};
 	int length, position = 0;
 
-	if (clientid->cid_minorversion > 0)
-		nfs4_create_clid_name41(clientid->cid_client_record, clientid);
-
 	/* break clientid down if it is greater than max dir name */
 	/* and create a directory hierachy to represent the clientid. */
 	snprintf(path, sizeof(path), "%s", v4_recov_dir);
@@ -344,7 +500,7 @@ void nfs4_add_clid(nfs_client_id_t *clientid)
  * @param[in] path Path of the client-id on the stable storage.
  */
 
-void nfs4_rm_revoked_handles(char *path)
+static void nfs4_rm_revoked_handles(char *path)
 {
 	DIR *dp;
 	struct dirent *dentp;
@@ -383,7 +539,8 @@ void nfs4_rm_revoked_handles(char *path)
  *
  * @param[in] recov_dir Recovery directory
  */
-void nfs4_rm_clid(const char *recov_dir, char *parent_path, int position)
+static void fs_rm_clid_impl(const char *recov_dir, char *parent_path,
+			    int position)
 {
 	int err;
 	char *path;
@@ -422,7 +579,7 @@ void nfs4_rm_clid(const char *recov_dir, char *parent_path, int position)
 	/* recursively remove the directory hirerchy which represent the
 	 *clientid
 	 */
-	nfs4_rm_clid(recov_dir, path, position+segment_len);
+	fs_rm_clid_impl(recov_dir, path, position+segment_len);
 
 	err = rmdir(path);
 	if (err == -1) {
@@ -435,6 +592,11 @@ void nfs4_rm_clid(const char *recov_dir, char *parent_path, int position)
 	gsh_free(path);
 }
 
+static void fs_rm_clid(nfs_client_id_t *clientid)
+{
+	fs_rm_clid_impl(clientid->cid_recov_dir, v4_recov_dir, 0);
+}
+
 /**
  * @brief Determine whether or not this client may reclaim state
  *
@@ -486,6 +648,97 @@ void  nfs4_chk_clid_impl(nfs_client_id_t *clientid, clid_entry_t **clid_ent_arg)
 	}
 }
 
+/**
+ * @brief Whether grace may end before Grace_Period
+ *
+ * NLM clients reclaim their locks once they get the sm-notify sent at
+ * startup, and are not on clid_list, so nothing says when they are
+ * done.  While NLM is served, grace runs its full length.
+ */
+static bool nfs_grace_may_end_early(void)
+{
+#ifdef _USE_NLM
+	if (nfs_param.core_param.enable_NLM)
+		return false;
+#endif /* _USE_NLM */
+	return true;
+}
+
+/**
+ * @brief Count the clients that may still reclaim
+ *
+ * Grace is ended here only if clients are expected and all of them
+ * have already reclaimed.  With none expected, grace runs its full
+ * length, as it did before clients were counted.
+ *
+ * @note The grace_mutex MUST be held
+ */
+static void nfs4_count_reclaims_pending(void)
+{
+	struct glist_head *node;
+	clid_entry_t *clid_ent;
+	uint32_t expected = 0;
+
+	reclaims_pending = 0;
+	glist_for_each(node, &clid_list) {
+		clid_ent = glist_entry(node, clid_entry_t, cl_list);
+		expected++;
+		if (!clid_ent->cl_reclaim_complete)
+			reclaims_pending++;
+	}
+
+	LogEvent(COMPONENT_STATE,
+		 "%"PRIu32" clients may reclaim during grace",
+		 reclaims_pending);
+
+	if (expected != 0 && reclaims_pending == 0 &&
+	    nfs_grace_may_end_early())
+		atomic_store_uint32_t(&grace_reclaimed, true);
+}
+
+/**
+ * @brief Note that a client has finished reclaiming
+ *
+ * Once every client loaded from stable storage has sent
+ * RECLAIM_COMPLETE, no more reclaims can come, so the grace period is
+ * ended without waiting out Grace_Period, unless NLM is served.
+ * NFSv4.0 clients have no RECLAIM_COMPLETE: their entries are never
+ * marked, which keeps reclaims_pending above zero, so while any of
+ * them are expected grace runs its full length.
+ *
+ * @param[in] clientid Client record
+ */
+void nfs4_reclaim_complete(nfs_client_id_t *clientid)
+{
+	clid_entry_t *clid_ent;
+
+	if (!nfs_in_grace())
+		return;
+
+	PTHREAD_MUTEX_lock(&grace_mutex);
+
+	nfs4_chk_clid_impl(clientid, &clid_ent);
+	if (clid_ent == NULL || clid_ent->cl_reclaim_complete) {
+		PTHREAD_MUTEX_unlock(&grace_mutex);
+		return;
+	}
+
+	clid_ent->cl_reclaim_complete = true;
+	assert(reclaims_pending > 0);
+
+	if (--reclaims_pending == 0 && nfs_grace_may_end_early()) {
+		LogEvent(COMPONENT_STATE,
+			 "All clients have reclaimed, ending grace early");
+		atomic_store_uint32_t(&grace_reclaimed, true);
+	} else {
+		LogDebug(COMPONENT_STATE,
+			 "%"PRIu32" clients yet to reclaim",
+			 reclaims_pending);
+	}
+
+	PTHREAD_MUTEX_unlock(&grace_mutex);
+}
+
 void  nfs4_chk_clid(nfs_client_id_t *clientid)
 {
 	clid_entry_t *dummy_clid_ent;
@@ -524,7 +777,7 @@ static void free_heap(char *path, char *new_path, char *build_clid)
  * @param[in] del Delete after populating
  */
 
-void nfs4_cp_pop_revoked_delegs(clid_entry_t *clid_ent,
+static void nfs4_cp_pop_revoked_delegs(clid_entry_t *clid_ent,
 				char *path,
 				char *tgtdir,
 				bool del)
@@ -781,6 +1034,7 @@ static int nfs4_read_recov_clids(DIR *dp,
 			len = strlen(ptr2);
 			if ((len == (cid_len+2)) && (ptr2[len-1] == ')')) {
 				new_ent = gsh_malloc(sizeof(clid_entry_t));
+				new_ent->cl_reclaim_complete = false;
 
 				nfs4_cp_pop_revoked_delegs(new_ent,
 							path,
@@ -813,28 +1067,17 @@ static int nfs4_read_recov_clids(DIR *dp,
 }
 
 /**
- * @brief Load clients for recovery, with no lock
+ * @brief Load clients for recovery from the recovery directories
  *
  * @param[in] nodeid Node, on takeover
  */
-static void nfs4_load_recov_clids_nolock(nfs_grace_start_t *gsp)
+static void fs_read_clids(nfs_grace_start_t *gsp)
 {
 	DIR *dp;
-	struct clid_entry *clid_entry;
 	int rc;
 	char path[PATH_MAX];
 
-	LogDebug(COMPONENT_STATE, "Load recovery cli %p", gsp);
-
 	if (gsp == NULL) {
-		/* when not doing a takeover, start with an empty list */
-		while ((clid_entry = glist_first_entry(&clid_list,
-						       struct clid_entry,
-						       cl_list)) != NULL) {
-			glist_del(&clid_entry->cl_list);
-			gsh_free(clid_entry);
-		}
-
 		dp = opendir(v4_old_dir);
 		if (dp == NULL) {
 			LogEvent(COMPONENT_CLIENTID,
@@ -920,24 +1163,10 @@ static void nfs4_load_recov_clids_nolock(nfs_grace_start_t *gsp)
 	}
 }
 
-/**
- * @brief Load clients for recovery
- *
- * @param[in] nodeid Node, on takeover
- */
-void nfs4_load_recov_clids(nfs_grace_start_t *gsp)
-{
-	PTHREAD_MUTEX_lock(&grace_mutex);
-
-	nfs4_load_recov_clids_nolock(gsp);
-
-	PTHREAD_MUTEX_unlock(&grace_mutex);
-}
-
 /**
  * @brief Clean up recovery directory
  */
-void nfs4_clean_old_recov_dir(char *parent_path)
+static void fs_clean_old_recov_dir(char *parent_path)
 {
 	DIR *dp;
 	struct dirent *dentp;
@@ -983,7 +1212,7 @@ void nfs4_clean_old_recov_dir(char *parent_path)
 
 		snprintf(path, total_len, "%s/%s", parent_path, dentp->d_name);
 
-		nfs4_clean_old_recov_dir(path);
+		fs_clean_old_recov_dir(path);
 		rc = rmdir(path);
 		if (rc == -1) {
 			LogEvent(COMPONENT_CLIENTID,
@@ -994,6 +1223,11 @@ void nfs4_clean_old_recov_dir(char *parent_path)
 	(void)closedir(dp);
 }
 
+static void fs_end_grace(void)
+{
+	fs_clean_old_recov_dir(v4_old_dir);
+}
+
 /**
  * @brief Create the recovery directory
  *
@@ -1001,7 +1235,7 @@ void nfs4_clean_old_recov_dir(char *parent_path)
  * should only need to be done once (if at all).  Also, the location
  * of the directory could be configurable.
  */
-void nfs4_create_recov_dir(void)
+static int fs_create_recov_dir(void)
 {
 	int err;
 
@@ -1050,6 +1284,277 @@ void nfs4_create_recov_dir(void)
 				 v4_old_dir, errno);
 		}
 	}
+
+	return 0;
+}
+
+/**
+ * @brief Record revoked filehandle under the client's directory.
+ *
+ * @param[in] delr_clid Client record
+ * @param[in] rhdlstr   Encoded handle of the revoked file.
+ */
+static void fs_add_revoke_fh(nfs_client_id_t *delr_clid, const char *rhdlstr)
+{
+	char path[PATH_MAX] = {0}, segment[NAME_MAX + 1] = {0};
+	int length, position = 0;
+	int fd;
+
+	snprintf(path, sizeof(path), "%s", v4_recov_dir);
+	length = strlen(delr_clid->cid_recov_dir);
+	while (position < length) {
+		int len = strlen(&delr_clid->cid_recov_dir[position]);
+
+		if (len <= NAME_MAX) {
+			strcat(path, "/");
+			strncat(path, &delr_clid->cid_recov_dir[position], len);
+			strcat(path, "/\x1"); /* Prefix 1 to converted fh */
+			strncat(path, rhdlstr, strlen(rhdlstr));
+			fd = creat(path, 0700);
+			if (fd < 0) {
+				LogEvent(COMPONENT_CLIENTID,
+					"Failed to record revoke errno:%d\n",
+					errno);
+			} else {
+				close(fd);
+			}
+			return;
+		}
+		strncpy(segment, &delr_clid->cid_recov_dir[position], NAME_MAX);
+		strcat(path, "/");
+		strncat(path, segment, NAME_MAX);
+		position += NAME_MAX;
+	}
+}
+
+/**
+ * @brief Keep client records as a hierarchy of directories
+ *
+ * One directory per client under the recovery root, and one empty file
+ * per revoked delegation inside it.
+ */
+struct nfs4_recovery_backend fs_backend = {
+	.recovery_init = fs_create_recov_dir,
+	.recovery_read_clids = fs_read_clids,
+	.end_grace = fs_end_grace,
+	.add_clid = fs_add_clid,
+	.rm_clid = fs_rm_clid,
+	.add_revoke_fh = fs_add_revoke_fh,
+};
+
+/**
+ * @brief Set up the configured recovery backend
+ *
+ * This needs to be done before the client records are read.
+ */
+void nfs4_recovery_init(void)
+{
+	struct fridgethr_params frp;
+	int rc;
+
+	switch (nfs_param.nfsv4_param.recovery_backend) {
+	case RECOVERY_BACKEND_FS_LOG:
+		recovery_backend = &fs_log_backend;
+		break;
+	case RECOVERY_BACKEND_FS_CLUSTER:
+		recovery_backend = &fs_cluster_backend;
+		break;
+	case RECOVERY_BACKEND_FS:
+	default:
+		recovery_backend = &fs_backend;
+		break;
+	}
+
+	if (recovery_backend->recovery_init() != 0) {
+		LogCrit(COMPONENT_CLIENTID,
+			"Recovery backend failed to start, using recovery directories");
+		recovery_backend = &fs_backend;
+		(void) recovery_backend->recovery_init();
+	}
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = nfs_param.nfsv4_param.takeover_threads;
+	frp.deferment = fridgethr_defer_queue;
+
+	rc = fridgethr_init(&release_fridge, "takeover", &frp);
+	if (rc != 0) {
+		LogMajor(COMPONENT_STATE,
+			 "Unable to initialize takeover fridge: %d, clients will be released serially",
+			 rc);
+		release_fridge = NULL;
+	}
+}
+
+/**
+ * @brief Write out any client records not yet on stable storage
+ */
+void nfs4_recovery_shutdown(void)
+{
+	int rc;
+
+	if (release_fridge != NULL) {
+		rc = fridgethr_sync_command(release_fridge,
+					    fridgethr_comm_stop, 120);
+		if (rc == ETIMEDOUT) {
+			LogMajor(COMPONENT_STATE,
+				 "Shutdown timed out, cancelling threads.");
+			fridgethr_cancel(release_fridge);
+		} else if (rc != 0) {
+			LogMajor(COMPONENT_STATE,
+				 "Failed shutting down takeover threads: %d",
+				 rc);
+		}
+	}
+
+	if (recovery_backend != NULL &&
+	    recovery_backend->recovery_shutdown != NULL)
+		recovery_backend->recovery_shutdown();
+}
+
+/**
+ * @brief Forget the previous epoch's clients once grace is over
+ */
+void nfs4_recovery_end_grace(void)
+{
+	recovery_backend->end_grace();
+}
+
+/**
+ * @brief Learn whether the other heads of the cluster are in grace
+ *
+ * Called periodically by the reaper; a no-op unless the recovery
+ * backend is shared by a cluster.
+ */
+void nfs4_recovery_poll_grace(void)
+{
+	if (nfs_param.nfsv4_param.graceless ||
+	    recovery_backend == NULL ||
+	    recovery_backend->peers_in_grace == NULL)
+		return;
+
+	atomic_store_uint32_t(&peers_in_grace,
+			      recovery_backend->peers_in_grace(
+						nfs_local_grace()));
+}
+
+/**
+ * @brief Record a client so that it may reclaim after a restart
+ *
+ * @param[in] clientid Client record
+ */
+void nfs4_add_clid(nfs_client_id_t *clientid)
+{
+	if (clientid->cid_minorversion > 0)
+		nfs4_create_clid_name41(clientid->cid_client_record, clientid);
+
+	if (clientid->cid_recov_dir == NULL)
+		return;
+
+	recovery_backend->add_clid(clientid);
+}
+
+/**
+ * @brief Remove a client's record
+ *
+ * This function would be called when a client expires.
+ *
+ * @param[in] clientid Client record
+ */
+void nfs4_rm_clid(nfs_client_id_t *clientid)
+{
+	if (clientid->cid_recov_dir == NULL)
+		return;
+
+	recovery_backend->rm_clid(clientid);
+}
+
+/**
+ * @brief Add a client to the list allowed to reclaim
+ *
+ * For recovery backends filling the list from their stable storage.
+ * Called with the grace_mutex held.
+ *
+ * @param[in] cl_name Client name, as in cid_recov_dir
+ *
+ * @return The new entry.
+ */
+clid_entry_t *nfs4_add_clid_entry(const char *cl_name)
+{
+	clid_entry_t *new_ent = gsh_malloc(sizeof(clid_entry_t));
+
+	new_ent->cl_reclaim_complete = false;
+	glist_init(&new_ent->cl_rfh_list);
+	(void) strlcpy(new_ent->cl_name, cl_name, sizeof(new_ent->cl_name));
+	glist_add(&clid_list, &new_ent->cl_list);
+
+	LogDebug(COMPONENT_CLIENTID, "added %s to clid list",
+		 new_ent->cl_name);
+
+	return new_ent;
+}
+
+/**
+ * @brief Add a revoked delegation to a client allowed to reclaim
+ *
+ * @param[in] clid_ent Entry from nfs4_add_clid_entry()
+ * @param[in] rfh_name Encoded handle of the revoked file
+ */
+void nfs4_add_rfh_entry(clid_entry_t *clid_ent, const char *rfh_name)
+{
+	rdel_fh_t *new_ent = gsh_malloc(sizeof(rdel_fh_t));
+
+	new_ent->rdfh_handle_str = gsh_strdup(rfh_name);
+	glist_add(&clid_ent->cl_rfh_list, &new_ent->rdfh_list);
+
+	LogFullDebug(COMPONENT_CLIENTID, "revoked handle: %s",
+		     new_ent->rdfh_handle_str);
+}
+
+/**
+ * @brief Load clients for recovery, with no lock
+ *
+ * @param[in] nodeid Node, on takeover
+ */
+static void nfs4_load_recov_clids_nolock(nfs_grace_start_t *gsp)
+{
+	struct clid_entry *clid_entry;
+	rdel_fh_t *rfh_entry;
+
+	LogDebug(COMPONENT_STATE, "Load recovery cli %p", gsp);
+
+	if (gsp == NULL) {
+		/* when not doing a takeover, start with an empty list */
+		while ((clid_entry = glist_first_entry(&clid_list,
+						       struct clid_entry,
+						       cl_list)) != NULL) {
+			glist_del(&clid_entry->cl_list);
+			while ((rfh_entry = glist_first_entry(
+						&clid_entry->cl_rfh_list,
+						rdel_fh_t,
+						rdfh_list)) != NULL) {
+				glist_del(&rfh_entry->rdfh_list);
+				gsh_free(rfh_entry->rdfh_handle_str);
+				gsh_free(rfh_entry);
+			}
+			gsh_free(clid_entry);
+		}
+	}
+
+	recovery_backend->recovery_read_clids(gsp);
+}
+
+/**
+ * @brief Load clients for recovery
+ *
+ * @param[in] nodeid Node, on takeover
+ */
+void nfs4_load_recov_clids(nfs_grace_start_t *gsp)
+{
+	PTHREAD_MUTEX_lock(&grace_mutex);
+
+	nfs4_load_recov_clids_nolock(gsp);
+
+	PTHREAD_MUTEX_unlock(&grace_mutex);
 }
 
 /**
@@ -1061,9 +1566,6 @@ void nfs4_create_recov_dir(void)
 void nfs4_record_revoke(nfs_client_id_t *delr_clid, nfs_fh4 *delr_handle)
 {
 	char rhdlstr[NAME_MAX];
-	char path[PATH_MAX] = {0}, segment[NAME_MAX + 1] = {0};
-	int length, position = 0;
-	int fd;
 	int retval;
 
 	/* Convert nfs_fh4_val into base64 encoded string */
@@ -1088,34 +1590,10 @@ void nfs4_record_revoke(nfs_client_id_t *delr_clid, nfs_fh4 *delr_handle)
 	}
 	PTHREAD_MUTEX_unlock(&delr_clid->cid_mutex);
 
-	/* Parse through the clientid directory structure */
+	/* The revoked handle is recorded under the client's name */
 	assert(delr_clid->cid_recov_dir != NULL);
 
-	snprintf(path, sizeof(path), "%s", v4_recov_dir);
-	length = strlen(delr_clid->cid_recov_dir);
-	while (position < length) {
-		int len = strlen(&delr_clid->cid_recov_dir[position]);
-
-		if (len <= NAME_MAX) {
-			strcat(path, "/");
-			strncat(path, &delr_clid->cid_recov_dir[position], len);
-			strcat(path, "/\x1"); /* Prefix 1 to converted fh */
-			strncat(path, rhdlstr, strlen(rhdlstr));
-			fd = creat(path, 0700);
-			if (fd < 0) {
-				LogEvent(COMPONENT_CLIENTID,
-					"Failed to record revoke errno:%d\n",
-					errno);
-			} else {
-				close(fd);
-			}
-			return;
-		}
-		strncpy(segment, &delr_clid->cid_recov_dir[position], NAME_MAX);
-		strcat(path, "/");
-		strncat(path, segment, NAME_MAX);
-		position += NAME_MAX;
-	}
+	recovery_backend->add_revoke_fh(delr_clid, rhdlstr);
 }
 
 /**
@@ -1172,12 +1650,11 @@ bool nfs4_check_deleg_reclaim(nfs_client_id_t *clid, nfs_fh4 *fhandle)
 /**
  * @brief Release NLM state
  */
-static void nlm_releasecall(struct fridgethr_context *ctx)
+static void nlm_release_one(void *client)
 {
-	state_nsm_client_t *nsm_cp;
+	state_nsm_client_t *nsm_cp = client;
 	state_status_t err;
 
-	nsm_cp = ctx->arg;
 	err = state_nlm_notify(nsm_cp, false, 0);
 	if (err != STATE_SUCCESS)
 		LogDebug(COMPONENT_STATE,
@@ -1245,7 +1722,7 @@ static void nfs_release_nlm_state(char *release_ip)
 	struct rbt_head *head_rbt;
 	struct rbt_node *pn;
 	struct hash_data *pdata;
-	state_status_t state_status;
+	struct release_batch *batch;
 	char serverip[SOCK_NAME_MAX + 1];
 	int i;
 
@@ -1253,6 +1730,11 @@ static void nfs_release_nlm_state(char *release_ip)
 
 	cancel_all_nlm_blocked();
 
+	/* NSM clients shared by several NLM clients are listed once per
+	 * NLM client, in the same partition.
+	 */
+	batch = release_batch_new(nlm_release_one);
+
 	/* walk the client list and call state_nlm_notify */
 	for (i = 0; i < ht->parameter.index_size; i++) {
 		PTHREAD_RWLOCK_wrlock(&ht->partitions[i].lock);
@@ -1267,20 +1749,15 @@ static void nfs_release_nlm_state(char *release_ip)
 			if (ip_str_match(release_ip, serverip)) {
 				nsm_cp = nlm_cp->slc_nsm_client;
 				inc_nsm_client_ref(nsm_cp);
-				state_status = fridgethr_submit(
-						state_async_fridge,
-						nlm_releasecall,
-						nsm_cp);
-				if (state_status != STATE_SUCCESS) {
-					dec_nsm_client_ref(nsm_cp);
-					LogCrit(COMPONENT_STATE,
-						"failed to submit nlm release thread ");
-				}
+				release_batch_add(batch, nsm_cp,
+						  (uintptr_t)nsm_cp >> 6);
 			}
 			RBT_INCREMENT(pn);
 		}
 		PTHREAD_RWLOCK_unlock(&ht->partitions[i].lock);
 	}
+
+	release_batch_run(batch);
 #endif /* _USE_NLM */
 }
 
@@ -1309,6 +1786,35 @@ static int ip_match(char *ip, nfs_client_id_t *cid)
  * only search the confirmed clients, unconfirmed clients won't
  * have any state to release.
  */
+/** Expire a client taken over by another node */
+static void v4_release_one(void *client)
+{
+	nfs_client_id_t *cp = client;
+	nfs_client_record_t *recp;
+
+	/* Take a reference to the client record before we drop cid_mutex.
+	 * client record may be decoupled, so check if it is still coupled!
+	 */
+	PTHREAD_MUTEX_lock(&cp->cid_mutex);
+	recp = cp->cid_client_record;
+	if (recp)
+		inc_client_record_ref(recp);
+	PTHREAD_MUTEX_unlock(&cp->cid_mutex);
+
+	/* nfs_client_id_expire requires cr_mutex if not decoupled already */
+	if (recp)
+		PTHREAD_MUTEX_lock(&recp->cr_mutex);
+
+	nfs_client_id_expire(cp, true);
+
+	if (recp) {
+		PTHREAD_MUTEX_unlock(&recp->cr_mutex);
+		dec_client_record_ref(recp);
+	}
+
+	dec_client_id_ref(cp);
+}
+
 static void nfs_release_v4_client(char *ip)
 {
 	hash_table_t *ht = ht_confirmed_client_id;
@@ -1316,15 +1822,17 @@ static void nfs_release_v4_client(char *ip)
 	struct rbt_node *pn;
 	struct hash_data *pdata;
 	nfs_client_id_t *cp;
-	nfs_client_record_t *recp;
+	struct release_batch *batch;
 	int i;
 
 	LogEvent(COMPONENT_STATE, "NFS Server V4 recovery release ip %s", ip);
 
-	/* go through the confirmed clients looking for a match */
+	batch = release_batch_new(v4_release_one);
+
+	/* go through the confirmed clients looking for all that match */
 	for (i = 0; i < ht->parameter.index_size; i++) {
 
-		PTHREAD_RWLOCK_wrlock(&ht->partitions[i].lock);
+		PTHREAD_RWLOCK_rdlock(&ht->partitions[i].lock);
 		head_rbt = &ht->partitions[i].rbt;
 
 		/* go through all entries in the red-black-tree */
@@ -1336,43 +1844,15 @@ static void nfs_release_v4_client(char *ip)
 			if ((cp->cid_confirmed == CONFIRMED_CLIENT_ID)
 			     && ip_match(ip, cp)) {
 				inc_client_id_ref(cp);
-
-				/* Take a reference to the client record
-				 * before we drop cid_mutex. client record
-				 * may be decoupled, so check if it is still
-				 * coupled!
-				 */
-				recp = cp->cid_client_record;
-				if (recp)
-					inc_client_record_ref(recp);
-
-				PTHREAD_MUTEX_unlock(&cp->cid_mutex);
-
-				PTHREAD_RWLOCK_unlock(&ht->partitions[i].lock);
-
-				/* nfs_client_id_expire requires cr_mutex
-				 * if not decoupled alread
-				 */
-				if (recp)
-					PTHREAD_MUTEX_lock(&recp->cr_mutex);
-
-				nfs_client_id_expire(cp, true);
-
-				if (recp) {
-					PTHREAD_MUTEX_unlock(&recp->cr_mutex);
-					dec_client_record_ref(recp);
-				}
-
-				dec_client_id_ref(cp);
-				return;
-
-			} else {
-				PTHREAD_MUTEX_unlock(&cp->cid_mutex);
+				release_batch_add(batch, cp, cp->cid_clientid);
 			}
+			PTHREAD_MUTEX_unlock(&cp->cid_mutex);
 			RBT_INCREMENT(pn);
 		}
 		PTHREAD_RWLOCK_unlock(&ht->partitions[i].lock);
 	}
+
+	release_batch_run(batch);
 }
 
 /** @} */
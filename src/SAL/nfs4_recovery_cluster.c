@@ -0,0 +1,217 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @addtogroup SAL
+ * @{
+ */
+
+/**
+ * @file nfs4_recovery_cluster.c
+ * @brief NFSv4 recovery shared by the heads of an active-active cluster
+ *
+ * For heads exporting the same cluster filesystem, with the recovery
+ * root on that filesystem.  Each head keeps its client records in its
+ * own node directory, as the recovery directories do when Clustered is
+ * set, so any head may take over a failed one's clients.
+ *
+ * The grace period is the cluster's: a head in grace keeps a file
+ *
+ *	<recovery root>/v4grace/node<nodeid>
+ *
+ * from the start of its grace until its clients have reclaimed, and
+ * every head enforces grace while any such file is younger than the
+ * grace period.  New state granted by a head out of grace could
+ * otherwise conflict with what a restarted head's clients reclaim.  A
+ * file left behind by a head that died expires with its grace period;
+ * the head taking over its clients enters grace on its own account.
+ *
+ * Lock conflicts between heads need no coordination here, as the
+ * cluster filesystem enforces the locks the FSAL passes down.
+ */
+
+#include "config.h"
+#include "log.h"
+#include "nfs_core.h"
+#include "sal_functions.h"
+#include "fsal.h"
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <stdio.h>
+
+#define NFS_V4_GRACE_DIR "v4grace"
+
+static char grace_dir[PATH_MAX];
+static char grace_path[PATH_MAX];	/*< This head's grace file */
+
+static int cluster_init(void)
+{
+	if (!nfs_param.core_param.clustered) {
+		LogCrit(COMPONENT_CLIENTID,
+			"The fs_cluster recovery backend needs Clustered");
+		return -1;
+	}
+
+	if (fs_backend.recovery_init() != 0)
+		return -1;
+
+	snprintf(grace_dir, sizeof(grace_dir), "%s/%s", NFS_V4_RECOV_ROOT,
+		 NFS_V4_GRACE_DIR);
+	if (mkdir(grace_dir, 0755) == -1 && errno != EEXIST) {
+		LogCrit(COMPONENT_CLIENTID,
+			"Failed to create cluster grace dir (%s), errno=%d",
+			grace_dir, errno);
+		return -1;
+	}
+
+	snprintf(grace_path, sizeof(grace_path), "%s/node%d", grace_dir,
+		 g_nodeid);
+
+	LogInfo(COMPONENT_CLIENTID,
+		"Grace coordinated with the other heads in %s", grace_dir);
+
+	return 0;
+}
+
+/**
+ * @brief Tell the other heads this one is in grace
+ */
+static void cluster_join_grace(void)
+{
+	int fd;
+
+	fd = open(grace_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to create grace file %s, errno=%d",
+			 grace_path, errno);
+		return;
+	}
+
+	/* Restart the clock of a file left by an earlier grace */
+	if (futimens(fd, NULL) != 0)
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to touch grace file %s, errno=%d",
+			 grace_path, errno);
+
+	(void) close(fd);
+}
+
+/**
+ * @brief Whether any other head is in grace
+ *
+ * Polled by the reaper.  Once this head is out of grace on its own
+ * account its grace file is removed.
+ *
+ * @param[in] local_grace Whether this head still is in grace
+ *
+ * @return true if another head is.
+ */
+static bool cluster_peers_in_grace(bool local_grace)
+{
+	time_t now = time(NULL);
+	char path[PATH_MAX];
+	struct dirent *dentp;
+	struct stat st;
+	bool in_grace = false;
+	int nodeid;
+	DIR *dp;
+
+	if (!local_grace && unlink(grace_path) != 0 && errno != ENOENT)
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to remove grace file %s, errno=%d",
+			 grace_path, errno);
+
+	dp = opendir(grace_dir);
+	if (dp == NULL) {
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to open cluster grace dir (%s), errno=%d",
+			 grace_dir, errno);
+		return false;
+	}
+
+	for (dentp = readdir(dp); dentp != NULL; dentp = readdir(dp)) {
+		if (sscanf(dentp->d_name, "node%d", &nodeid) != 1 ||
+		    nodeid == g_nodeid)
+			continue;
+
+		snprintf(path, sizeof(path), "%s/%s", grace_dir,
+			 dentp->d_name);
+		if (stat(path, &st) != 0)
+			continue;
+
+		if (st.st_mtime + nfs_param.nfsv4_param.grace_period > now) {
+			LogDebug(COMPONENT_CLIENTID,
+				 "Node %d is in grace", nodeid);
+			in_grace = true;
+			break;
+		}
+	}
+
+	(void) closedir(dp);
+
+	return in_grace;
+}
+
+static void cluster_read_clids(nfs_grace_start_t *gsp)
+{
+	fs_backend.recovery_read_clids(gsp);
+}
+
+static void cluster_end_grace(void)
+{
+	fs_backend.end_grace();
+}
+
+static void cluster_add_clid(nfs_client_id_t *clientid)
+{
+	fs_backend.add_clid(clientid);
+}
+
+static void cluster_rm_clid(nfs_client_id_t *clientid)
+{
+	fs_backend.rm_clid(clientid);
+}
+
+static void cluster_add_revoke_fh(nfs_client_id_t *clientid,
+				  const char *rhdlstr)
+{
+	fs_backend.add_revoke_fh(clientid, rhdlstr);
+}
+
+/**
+ * @brief Keep client records per head on the cluster filesystem, and
+ *        coordinate the grace period across the heads
+ */
+struct nfs4_recovery_backend fs_cluster_backend = {
+	.recovery_init = cluster_init,
+	.recovery_read_clids = cluster_read_clids,
+	.end_grace = cluster_end_grace,
+	.add_clid = cluster_add_clid,
+	.rm_clid = cluster_rm_clid,
+	.add_revoke_fh = cluster_add_revoke_fh,
+	.join_grace = cluster_join_grace,
+	.peers_in_grace = cluster_peers_in_grace,
+};
+
+/** @} */
@@ -0,0 +1,827 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @addtogroup SAL
+ * @{
+ */
+
+/**
+ * @file nfs4_recovery_log.c
+ * @brief NFSv4 recovery records in an append-only log
+ *
+ * Each epoch's clients are kept as lines appended to one file,
+ *
+ *	+ <client name>		the client was confirmed
+ *	- <client name>		the client went away
+ *	! <handle> <client name>	a delegation was revoked from it
+ *
+ * so taking a new client costs an append, synced before the client is
+ * answered.  The appends made while a sync runs are synced together by
+ * the next one.  At startup the log and the
+ * previous epoch's file are read straight through, their clients are
+ * allowed to reclaim, and they are written out compacted as the new
+ * previous epoch, which is removed once grace is over.  A log that has
+ * grown well past the clients it holds is rewritten the same way.
+ *
+ * A partial last line, left by a crash during an append, is ignored.
+ */
+
+#include "config.h"
+#include "log.h"
+#include "nfs_core.h"
+#include "sal_functions.h"
+#include "delayed_exec.h"
+#include "avltree.h"
+#include "fsal.h"
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+
+#define NFS_V4_RECOV_LOG_DIR "v4log"
+
+/* How long after the append that calls for it the log is compacted */
+#define RECOV_LOG_COMPACT_DELAY (100 * NS_PER_MSEC)
+
+/* The log is compacted once it holds this many more records than twice
+ * its clients.
+ */
+#define RECOV_LOG_COMPACT_SLACK 1024
+
+struct log_rfh {
+	struct glist_head rfh_list;
+	char *rfh_handle;
+};
+
+struct log_clid {
+	struct avltree_node clid_node;
+	struct glist_head clid_rfh;	/*< Revoked handles, struct log_rfh */
+	char *clid_name;
+};
+
+static char log_path[PATH_MAX];		/*< This epoch's log */
+static char old_path[PATH_MAX];		/*< The previous epoch's clients */
+static int log_fd = -1;
+static pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t log_synced_cond = PTHREAD_COND_INITIALIZER;
+static uint64_t log_appended;		/*< Appends made, as a sequence */
+static uint64_t log_synced;		/*< Of them known to be on disk */
+static bool log_syncing;		/*< A sync is running */
+static bool log_compact_queued;
+static uint64_t log_records;		/*< Lines in the log */
+static struct avltree log_live;		/*< The clients in the log */
+
+static int log_clid_cmpf(const struct avltree_node *lhs,
+			 const struct avltree_node *rhs)
+{
+	struct log_clid *lk = avltree_container_of(lhs, struct log_clid,
+						   clid_node);
+	struct log_clid *rk = avltree_container_of(rhs, struct log_clid,
+						   clid_node);
+
+	return strcmp(lk->clid_name, rk->clid_name);
+}
+
+static struct log_clid *log_clid_lookup(struct avltree *tree,
+					const char *name)
+{
+	struct log_clid key;
+	struct avltree_node *node;
+
+	key.clid_name = (char *) name;
+	node = avltree_lookup(&key.clid_node, tree);
+	if (node == NULL)
+		return NULL;
+
+	return avltree_container_of(node, struct log_clid, clid_node);
+}
+
+/**
+ * @brief Find a client in a set, adding it if need be
+ */
+static struct log_clid *log_clid_get(struct avltree *tree, const char *name,
+				     bool *added)
+{
+	struct log_clid *clid = log_clid_lookup(tree, name);
+
+	*added = clid == NULL;
+	if (clid != NULL)
+		return clid;
+
+	clid = gsh_malloc(sizeof(*clid));
+	glist_init(&clid->clid_rfh);
+	clid->clid_name = gsh_strdup(name);
+	(void) avltree_insert(&clid->clid_node, tree);
+
+	return clid;
+}
+
+/**
+ * @brief Record a revoked handle for a client, once
+ */
+static bool log_clid_add_rfh(struct log_clid *clid, const char *handle)
+{
+	struct glist_head *glist;
+	struct log_rfh *rfh;
+
+	glist_for_each(glist, &clid->clid_rfh) {
+		rfh = glist_entry(glist, struct log_rfh, rfh_list);
+		if (!strcmp(rfh->rfh_handle, handle))
+			return false;
+	}
+
+	rfh = gsh_malloc(sizeof(*rfh));
+	rfh->rfh_handle = gsh_strdup(handle);
+	glist_add_tail(&clid->clid_rfh, &rfh->rfh_list);
+
+	return true;
+}
+
+static void log_clid_free(struct avltree *tree, struct log_clid *clid)
+{
+	struct log_rfh *rfh;
+
+	avltree_remove(&clid->clid_node, tree);
+
+	while ((rfh = glist_first_entry(&clid->clid_rfh, struct log_rfh,
+					rfh_list)) != NULL) {
+		glist_del(&rfh->rfh_list);
+		gsh_free(rfh->rfh_handle);
+		gsh_free(rfh);
+	}
+
+	gsh_free(clid->clid_name);
+	gsh_free(clid);
+}
+
+static void log_clids_free(struct avltree *tree)
+{
+	struct avltree_node *node;
+
+	while ((node = avltree_first(tree)) != NULL)
+		log_clid_free(tree,
+			      avltree_container_of(node, struct log_clid,
+						   clid_node));
+}
+
+/**
+ * @brief Apply one line of a log to a set of clients
+ *
+ * @return false if the line is not a record.
+ */
+static bool log_apply(struct avltree *tree, char *line)
+{
+	struct log_clid *clid;
+	char *name;
+	bool added;
+
+	if (line[0] == '\0' || line[1] != ' ' || line[2] == '\0')
+		return false;
+
+	name = line + 2;
+
+	switch (line[0]) {
+	case '+':
+		(void) log_clid_get(tree, name, &added);
+		return true;
+	case '-':
+		clid = log_clid_lookup(tree, name);
+		if (clid != NULL)
+			log_clid_free(tree, clid);
+		return true;
+	case '!':
+		name = strchr(line + 2, ' ');
+		if (name == NULL || name[1] == '\0')
+			return false;
+		*name++ = '\0';
+		clid = log_clid_get(tree, name, &added);
+		(void) log_clid_add_rfh(clid, line + 2);
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * @brief Read a log into a set of clients
+ *
+ * @param[in]     path Log to read, which need not exist
+ * @param[in,out] tree Set to add to
+ *
+ * @return The number of records read.
+ */
+static uint64_t log_replay(const char *path, struct avltree *tree)
+{
+	FILE *fp;
+	char *line = NULL;
+	size_t size = 0;
+	ssize_t len;
+	uint64_t records = 0;
+
+	fp = fopen(path, "r");
+	if (fp == NULL) {
+		if (errno != ENOENT)
+			LogEvent(COMPONENT_CLIENTID,
+				 "Failed to open recovery log %s, errno=%d",
+				 path, errno);
+		return 0;
+	}
+
+	while ((len = getline(&line, &size, fp)) > 0) {
+		/* A line without a newline is a torn append */
+		if (line[len - 1] != '\n')
+			break;
+		line[len - 1] = '\0';
+
+		if (log_apply(tree, line))
+			records++;
+		else
+			LogEvent(COMPONENT_CLIENTID,
+				 "Skipping bad record in %s: %s", path, line);
+	}
+
+	free(line);
+	(void) fclose(fp);
+
+	LogDebug(COMPONENT_CLIENTID, "Read %"PRIu64" records from %s",
+		 records, path);
+
+	return records;
+}
+
+/**
+ * @brief Write one record, all or nothing as far as replay is concerned
+ */
+static int log_write(int fd, const char *buf, size_t len)
+{
+	ssize_t done;
+
+	while (len > 0) {
+		done = write(fd, buf, len);
+		if (done < 0) {
+			if (errno == EINTR)
+				continue;
+			return errno;
+		}
+		buf += done;
+		len -= done;
+	}
+
+	return 0;
+}
+
+static int log_write_record(int fd, char type, const char *handle,
+			    const char *name)
+{
+	char buf[PATH_MAX + NAME_MAX + 8];
+	int len;
+
+	if (handle != NULL)
+		len = snprintf(buf, sizeof(buf), "%c %s %s\n",
+			       type, handle, name);
+	else
+		len = snprintf(buf, sizeof(buf), "%c %s\n", type, name);
+
+	if (len >= sizeof(buf))
+		return ENAMETOOLONG;
+
+	return log_write(fd, buf, len);
+}
+
+/**
+ * @brief Write every client of a set to a file
+ *
+ * @return 0 or an errno.
+ */
+static int log_write_clids(int fd, struct avltree *tree)
+{
+	struct avltree_node *node;
+	struct glist_head *glist;
+	struct log_clid *clid;
+	struct log_rfh *rfh;
+	int rc;
+
+	for (node = avltree_first(tree); node != NULL;
+	     node = avltree_next(node)) {
+		clid = avltree_container_of(node, struct log_clid, clid_node);
+
+		rc = log_write_record(fd, '+', NULL, clid->clid_name);
+		if (rc != 0)
+			return rc;
+
+		glist_for_each(glist, &clid->clid_rfh) {
+			rfh = glist_entry(glist, struct log_rfh, rfh_list);
+			rc = log_write_record(fd, '!', rfh->rfh_handle,
+					      clid->clid_name);
+			if (rc != 0)
+				return rc;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Replace a file with the clients of a set
+ *
+ * The set is written beside the file, synced, and renamed over it, so
+ * a crash leaves one or the other.
+ *
+ * @return 0 or an errno.
+ */
+static int log_rewrite(const char *path, struct avltree *tree)
+{
+	char tmp_path[PATH_MAX];
+	int fd, rc;
+
+	if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path) >=
+	    sizeof(tmp_path))
+		return ENAMETOOLONG;
+
+	fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0)
+		return errno;
+
+	rc = log_write_clids(fd, tree);
+	if (rc == 0 && fdatasync(fd) != 0)
+		rc = errno;
+	(void) close(fd);
+
+	if (rc == 0 && rename(tmp_path, path) != 0)
+		rc = errno;
+
+	if (rc != 0) {
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to write recovery log %s, error=%d",
+			 path, rc);
+		(void) unlink(tmp_path);
+	}
+
+	return rc;
+}
+
+/**
+ * @brief Rewrite this epoch's log from the clients in it
+ *
+ * @note The log_mutex MUST be held
+ */
+static void log_compact(void)
+{
+	struct avltree_node *node;
+	struct log_clid *clid;
+	int fd;
+
+	if (log_rewrite(log_path, &log_live) != 0)
+		return;
+
+	fd = open(log_path, O_WRONLY | O_CREAT | O_APPEND, 0600);
+	if (fd < 0) {
+		LogCrit(COMPONENT_CLIENTID,
+			"Failed to reopen recovery log %s, errno=%d",
+			log_path, errno);
+		return;
+	}
+
+	(void) close(log_fd);
+	log_fd = fd;
+	log_records = 0;
+	for (node = avltree_first(&log_live); node != NULL;
+	     node = avltree_next(node)) {
+		clid = avltree_container_of(node, struct log_clid, clid_node);
+		log_records += 1 + glist_length(&clid->clid_rfh);
+	}
+
+	LogDebug(COMPONENT_CLIENTID,
+		 "Compacted recovery log to %"PRIu64" records", log_records);
+}
+
+/**
+ * @brief Compact the log, if it is still worth it
+ */
+static void log_compact_run(void *arg)
+{
+	PTHREAD_MUTEX_lock(&log_mutex);
+
+	log_compact_queued = false;
+
+	if (log_fd >= 0 &&
+	    log_records > 2 * avltree_size(&log_live) +
+			  RECOV_LOG_COMPACT_SLACK)
+		log_compact();
+
+	PTHREAD_MUTEX_unlock(&log_mutex);
+}
+
+/**
+ * @brief Wait until the appends up to seq are on disk
+ *
+ * The first appender to find no sync running syncs every append made
+ * so far.  Those that come while it runs wait for it, and the first of
+ * them left uncovered runs the next one, so that concurrent appends
+ * share a sync.  The sync is made on a duplicate of log_fd without
+ * the mutex, so the log may be compacted or closed meanwhile: the
+ * compacted log is synced before it replaces this one.
+ *
+ * @note The log_mutex MUST be held, and is dropped during the sync
+ *
+ * @param[in] seq The last append to wait for
+ */
+static void log_commit(uint64_t seq)
+{
+	uint64_t target;
+	int fd, rc;
+
+	while (log_synced < seq) {
+		if (log_syncing) {
+			pthread_cond_wait(&log_synced_cond, &log_mutex);
+			continue;
+		}
+
+		if (log_fd < 0)
+			return;
+
+		fd = dup(log_fd);
+		if (fd < 0) {
+			LogEvent(COMPONENT_CLIENTID,
+				 "Failed to sync recovery log %s, errno=%d",
+				 log_path, errno);
+			return;
+		}
+
+		target = log_appended;
+		log_syncing = true;
+
+		PTHREAD_MUTEX_unlock(&log_mutex);
+
+		rc = fdatasync(fd) != 0 ? errno : 0;
+		(void) close(fd);
+
+		PTHREAD_MUTEX_lock(&log_mutex);
+
+		log_syncing = false;
+		if (rc == 0 && target > log_synced)
+			log_synced = target;
+		pthread_cond_broadcast(&log_synced_cond);
+
+		if (rc != 0) {
+			LogEvent(COMPONENT_CLIENTID,
+				 "Failed to sync recovery log %s, errno=%d",
+				 log_path, rc);
+			return;
+		}
+	}
+}
+
+/**
+ * @brief Append a record to this epoch's log
+ *
+ * The record is on disk when this returns, unless the log could not be
+ * written or synced, which is logged.
+ *
+ * @note The log_mutex MUST be held, and is dropped while syncing
+ */
+static void log_append(char type, const char *handle, const char *name)
+{
+	int rc;
+
+	if (log_fd < 0) {
+		LogDebug(COMPONENT_CLIENTID,
+			 "Recovery log closed, not recording %s", name);
+		return;
+	}
+
+	rc = log_write_record(log_fd, type, handle, name);
+	if (rc != 0) {
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to append to recovery log %s for %s, error=%d",
+			 log_path, name, rc);
+		return;
+	}
+
+	log_records++;
+
+	if (!log_compact_queued &&
+	    log_records > 2 * avltree_size(&log_live) +
+			  RECOV_LOG_COMPACT_SLACK &&
+	    delayed_submit(log_compact_run, NULL,
+			   RECOV_LOG_COMPACT_DELAY) == 0)
+		log_compact_queued = true;
+
+	log_commit(++log_appended);
+}
+
+/**
+ * @brief Put the clients of a set on the reclaim list
+ */
+static void log_load_clids(struct avltree *tree)
+{
+	struct avltree_node *node;
+	struct glist_head *glist;
+	struct log_clid *clid;
+	struct log_rfh *rfh;
+	clid_entry_t *clid_ent;
+
+	for (node = avltree_first(tree); node != NULL;
+	     node = avltree_next(node)) {
+		clid = avltree_container_of(node, struct log_clid, clid_node);
+
+		if (strlen(clid->clid_name) >= PATH_MAX) {
+			LogEvent(COMPONENT_CLIENTID,
+				 "invalid clid format: %s, too long",
+				 clid->clid_name);
+			continue;
+		}
+
+		clid_ent = nfs4_add_clid_entry(clid->clid_name);
+
+		glist_for_each(glist, &clid->clid_rfh) {
+			rfh = glist_entry(glist, struct log_rfh, rfh_list);
+			nfs4_add_rfh_entry(clid_ent, rfh->rfh_handle);
+		}
+	}
+}
+
+/**
+ * @brief Add every client of one set to another
+ */
+static void log_merge(struct avltree *dst, struct avltree *src)
+{
+	struct avltree_node *node;
+	struct glist_head *glist;
+	struct log_clid *clid, *dst_clid;
+	struct log_rfh *rfh;
+	bool added;
+
+	for (node = avltree_first(src); node != NULL;
+	     node = avltree_next(node)) {
+		clid = avltree_container_of(node, struct log_clid, clid_node);
+		dst_clid = log_clid_get(dst, clid->clid_name, &added);
+
+		glist_for_each(glist, &clid->clid_rfh) {
+			rfh = glist_entry(glist, struct log_rfh, rfh_list);
+			(void) log_clid_add_rfh(dst_clid, rfh->rfh_handle);
+		}
+	}
+}
+
+/**
+ * @brief Start a new epoch
+ *
+ * The clients of the previous epoch, and those of this log that were
+ * still around, may reclaim.  They become the previous epoch until
+ * grace ends, and the log starts again empty.
+ */
+static void log_new_epoch(void)
+{
+	struct avltree old, cur;
+
+	avltree_init(&old, log_clid_cmpf, 0);
+	avltree_init(&cur, log_clid_cmpf, 0);
+
+	/* Clients removed in this epoch stay allowed if they were in the
+	 * previous one, as with the recovery directories.
+	 */
+	(void) log_replay(old_path, &old);
+	(void) log_replay(log_path, &cur);
+	log_merge(&old, &cur);
+	log_clids_free(&cur);
+
+	PTHREAD_MUTEX_lock(&log_mutex);
+
+	if (log_rewrite(old_path, &old) == 0 && log_fd >= 0) {
+		if (ftruncate(log_fd, 0) != 0 || fdatasync(log_fd) != 0)
+			LogEvent(COMPONENT_CLIENTID,
+				 "Failed to truncate recovery log %s, errno=%d",
+				 log_path, errno);
+		log_records = 0;
+		log_synced = log_appended;
+		log_clids_free(&log_live);
+	}
+
+	PTHREAD_MUTEX_unlock(&log_mutex);
+
+	log_load_clids(&old);
+	log_clids_free(&old);
+}
+
+/**
+ * @brief Take over the clients of another node or address
+ *
+ * They may reclaim, and are added to the previous epoch so that they
+ * still may after a restart during this grace period.
+ */
+static void log_take_over(const char *path)
+{
+	struct avltree taken;
+	int fd, rc;
+
+	avltree_init(&taken, log_clid_cmpf, 0);
+
+	LogEvent(COMPONENT_CLIENTID, "Recovery from log (%s)", path);
+
+	(void) log_replay(path, &taken);
+
+	fd = open(old_path, O_WRONLY | O_CREAT | O_APPEND, 0600);
+	if (fd < 0) {
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to open recovery log %s, errno=%d",
+			 old_path, errno);
+	} else {
+		rc = log_write_clids(fd, &taken);
+		if (rc == 0 && fdatasync(fd) != 0)
+			rc = errno;
+		if (rc != 0)
+			LogEvent(COMPONENT_CLIENTID,
+				 "Failed to write recovery log %s, error=%d",
+				 old_path, rc);
+		(void) close(fd);
+	}
+
+	log_load_clids(&taken);
+	log_clids_free(&taken);
+}
+
+static void log_read_clids(nfs_grace_start_t *gsp)
+{
+	char path[PATH_MAX];
+
+	if (gsp == NULL) {
+		log_new_epoch();
+		return;
+	}
+
+	switch (gsp->event) {
+	case EVENT_UPDATE_CLIENTS:
+		PTHREAD_MUTEX_lock(&log_mutex);
+		if (log_fd >= 0 && fdatasync(log_fd) != 0)
+			LogEvent(COMPONENT_CLIENTID,
+				 "Failed to sync recovery log %s, errno=%d",
+				 log_path, errno);
+		PTHREAD_MUTEX_unlock(&log_mutex);
+		snprintf(path, sizeof(path), "%s", log_path);
+		break;
+	case EVENT_TAKE_IP:
+		snprintf(path, sizeof(path), "%s/%s/%s/recov.log",
+			 NFS_V4_RECOV_ROOT, gsp->ipaddr,
+			 NFS_V4_RECOV_LOG_DIR);
+		break;
+	case EVENT_TAKE_NODEID:
+		snprintf(path, sizeof(path), "%s/%s/node%d.log",
+			 NFS_V4_RECOV_ROOT, NFS_V4_RECOV_LOG_DIR,
+			 gsp->nodeid);
+		break;
+	default:
+		return;
+	}
+
+	log_take_over(path);
+}
+
+static void log_end_grace(void)
+{
+	if (unlink(old_path) != 0 && errno != ENOENT)
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to remove %s, errno=%d", old_path, errno);
+}
+
+static void log_add_clid(nfs_client_id_t *clientid)
+{
+	bool added;
+
+	PTHREAD_MUTEX_lock(&log_mutex);
+
+	(void) log_clid_get(&log_live, clientid->cid_recov_dir, &added);
+	if (added)
+		log_append('+', NULL, clientid->cid_recov_dir);
+
+	PTHREAD_MUTEX_unlock(&log_mutex);
+
+	LogDebug(COMPONENT_CLIENTID, "Logged client [%s]",
+		 clientid->cid_recov_dir);
+}
+
+static void log_rm_clid(nfs_client_id_t *clientid)
+{
+	struct log_clid *clid;
+
+	PTHREAD_MUTEX_lock(&log_mutex);
+
+	clid = log_clid_lookup(&log_live, clientid->cid_recov_dir);
+	if (clid != NULL) {
+		log_clid_free(&log_live, clid);
+		log_append('-', NULL, clientid->cid_recov_dir);
+	}
+
+	PTHREAD_MUTEX_unlock(&log_mutex);
+}
+
+static void log_add_revoke_fh(nfs_client_id_t *clientid, const char *rhdlstr)
+{
+	struct log_clid *clid;
+	bool added;
+
+	PTHREAD_MUTEX_lock(&log_mutex);
+
+	clid = log_clid_get(&log_live, clientid->cid_recov_dir, &added);
+	if (log_clid_add_rfh(clid, rhdlstr))
+		log_append('!', rhdlstr, clientid->cid_recov_dir);
+
+	PTHREAD_MUTEX_unlock(&log_mutex);
+}
+
+static int log_init(void)
+{
+	char dir[PATH_MAX];
+	char base[NAME_MAX];
+
+	if (mkdir(NFS_V4_RECOV_ROOT, 0755) == -1 && errno != EEXIST) {
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to create v4 recovery dir (%s), errno=%d",
+			 NFS_V4_RECOV_ROOT, errno);
+	}
+
+	snprintf(dir, sizeof(dir), "%s/%s", NFS_V4_RECOV_ROOT,
+		 NFS_V4_RECOV_LOG_DIR);
+	if (mkdir(dir, 0755) == -1 && errno != EEXIST) {
+		LogCrit(COMPONENT_CLIENTID,
+			"Failed to create v4 recovery log dir (%s), errno=%d",
+			dir, errno);
+		return -1;
+	}
+
+	if (nfs_param.core_param.clustered)
+		snprintf(base, sizeof(base), "node%d", g_nodeid);
+	else
+		snprintf(base, sizeof(base), "recov");
+
+	snprintf(log_path, sizeof(log_path), "%s/%s.log", dir, base);
+	snprintf(old_path, sizeof(old_path), "%s/%s.old", dir, base);
+
+	avltree_init(&log_live, log_clid_cmpf, 0);
+
+	log_fd = open(log_path, O_WRONLY | O_CREAT | O_APPEND, 0600);
+	if (log_fd < 0) {
+		LogCrit(COMPONENT_CLIENTID,
+			"Failed to open recovery log %s, errno=%d",
+			log_path, errno);
+		return -1;
+	}
+
+	LogInfo(COMPONENT_CLIENTID, "Recovery records kept in %s", log_path);
+
+	return 0;
+}
+
+static void log_shutdown(void)
+{
+	PTHREAD_MUTEX_lock(&log_mutex);
+
+	if (log_fd >= 0) {
+		if (log_synced < log_appended && fdatasync(log_fd) != 0)
+			LogEvent(COMPONENT_CLIENTID,
+				 "Failed to sync recovery log %s, errno=%d",
+				 log_path, errno);
+		(void) close(log_fd);
+		log_fd = -1;
+		log_synced = log_appended;
+	}
+
+	log_clids_free(&log_live);
+
+	PTHREAD_MUTEX_unlock(&log_mutex);
+}
+
+/**
+ * @brief Keep client records in an append-only log
+ */
+struct nfs4_recovery_backend fs_log_backend = {
+	.recovery_init = log_init,
+	.recovery_shutdown = log_shutdown,
+	.recovery_read_clids = log_read_clids,
+	.end_grace = log_end_grace,
+	.add_clid = log_add_clid,
+	.rm_clid = log_rm_clid,
+	.add_revoke_fh = log_add_revoke_fh,
+};
+
+/** @} */
@@ -61,6 +61,7 @@
 #include "sal_functions.h"
 #include "nfs_proto_tools.h"
 #include "city.h"
+#include "gsh_hash.h"
 
 struct state_t *nfs4_State_Get_State_Obj(struct state_obj *state_obj,
 					 state_owner_t *owner);
@@ -269,11 +270,11 @@ int compare_state_id(struct gsh_buffdesc *buff1, struct gsh_buffdesc *buff2)
 /**
  * @brief Hash a stateid
  *
- * @param[in] stateid Array aliased to stateid
+ * @param[in] other The other field of the stateid
  */
-static inline uint32_t compute_stateid_hash_value(uint32_t *stateid)
+static inline uint64_t compute_stateid_hash_value(const void *other)
 {
-	return stateid[1] ^ stateid[2];
+	return CityHash64WithSeed(other, OTHERSIZE, 0);
 }
 
 /**
@@ -287,8 +288,8 @@ static inline uint32_t compute_stateid_hash_value(uint32_t *stateid)
 uint32_t state_id_value_hash_func(hash_parameter_t *hparam,
 				  struct gsh_buffdesc *key)
 {
-	uint32_t val =
-	    compute_stateid_hash_value(key->addr) % hparam->index_size;
+	uint32_t val = compute_stateid_hash_value(key->addr) %
+		       hparam->index_size;
 
 	if (isDebug(COMPONENT_HASHTABLE))
 		LogFullDebug(COMPONENT_STATE, "val = %" PRIu32, val);
@@ -322,7 +323,7 @@ static hash_parameter_t state_id_param = {
 	.compare_key = compare_state_id,
 	.key_to_str = display_state_id_key,
 	.val_to_str = display_state_id_val,
-	.flags = HT_FLAG_CACHE,
+	.flags = HT_FLAG_CACHE | HT_FLAG_LOCKLESS_READ | HT_FLAG_GROW,
 	.ht_log_component = COMPONENT_STATE,
 	.ht_name = "State ID Table"
 };
@@ -351,6 +352,25 @@ int compare_state_obj(struct gsh_buffdesc *buff1, struct gsh_buffdesc *buff2)
 	return compare_nfs4_owner(state1->state_owner, state2->state_owner);
 }
 
+/**
+ * @brief Hash a stateid by entry/owner
+ *
+ * @param[in] pkey The state
+ */
+static uint64_t compute_state_obj_hash_value(state_t *pkey)
+{
+	state_owner_t *owner = pkey->state_owner;
+	uint64_t seed = gsh_hash_u64_2(
+			owner->so_owner.so_nfs4_owner.so_clientid,
+			owner->so_type, 557);
+
+	seed = CityHash64WithSeed(owner->so_owner_val, owner->so_owner_len,
+				  seed);
+
+	return CityHash64WithSeed(pkey->state_obj.digest, pkey->state_obj.len,
+				  seed);
+}
+
 /**
  * @brief Hash index for a stateid by entry/owner
  *
@@ -362,25 +382,8 @@ int compare_state_obj(struct gsh_buffdesc *buff1, struct gsh_buffdesc *buff2)
 uint32_t state_obj_value_hash_func(hash_parameter_t *hparam,
 				   struct gsh_buffdesc *key)
 {
-	unsigned int sum = 0;
-	unsigned int i = 0;
-	unsigned char c = 0;
-	uint32_t res = 0;
-
-	state_t *pkey = key->addr;
-
-	/* Compute the sum of all the characters */
-	for (i = 0; i < pkey->state_owner->so_owner_len; i++) {
-		c = ((char *)pkey->state_owner->so_owner_val)[i];
-		sum += c;
-	}
-
-	res = ((uint32_t) pkey->state_owner->so_owner.so_nfs4_owner.so_clientid
-	      + (uint32_t) sum + pkey->state_owner->so_owner_len
-	      + (uint32_t) pkey->state_owner->so_type
-	      + (uint32_t) CityHash64WithSeed(pkey->state_obj.digest,
-					      pkey->state_obj.len, 557))
-	      % (uint32_t) hparam->index_size;
+	uint32_t res = compute_state_obj_hash_value(key->addr) %
+		       hparam->index_size;
 
 	if (isDebug(COMPONENT_HASHTABLE))
 		LogFullDebug(COMPONENT_STATE, "value = %" PRIu32, res);
@@ -399,24 +402,7 @@ uint32_t state_obj_value_hash_func(hash_parameter_t *hparam,
 uint64_t state_obj_rbt_hash_func(hash_parameter_t *hparam,
 				 struct gsh_buffdesc *key)
 {
-	state_t *pkey = key->addr;
-
-	unsigned int sum = 0;
-	unsigned int i = 0;
-	unsigned char c = 0;
-	uint64_t res = 0;
-
-	/* Compute the sum of all the characters */
-	for (i = 0; i < pkey->state_owner->so_owner_len; i++) {
-		c = ((char *)pkey->state_owner->so_owner_val)[i];
-		sum += c;
-	}
-
-	res = (uint64_t) pkey->state_owner->so_owner.so_nfs4_owner.so_clientid
-	      + (uint64_t) sum + pkey->state_owner->so_owner_len
-	      + (uint64_t) pkey->state_owner->so_type
-	      + (uint64_t) CityHash64WithSeed(pkey->state_obj.digest,
-					      pkey->state_obj.len, 557);
+	uint64_t res = compute_state_obj_hash_value(key->addr);
 
 	if (isDebug(COMPONENT_HASHTABLE))
 		LogFullDebug(COMPONENT_STATE, "rbt = %" PRIu64, res);
@@ -431,7 +417,7 @@ static hash_parameter_t state_obj_param = {
 	.compare_key = compare_state_obj,
 	.key_to_str = display_state_id_val,
 	.val_to_str = display_state_id_val,
-	.flags = HT_FLAG_CACHE,
+	.flags = HT_FLAG_CACHE | HT_FLAG_LOCKLESS_READ | HT_FLAG_GROW,
 	.ht_log_component = COMPONENT_STATE,
 	.ht_name = "State Obj Table"
 };
@@ -615,6 +601,16 @@ int nfs4_State_Set(state_t *state)
 	return 1;
 }
 
+/**
+ * @brief Take a reference on a state found in a hash table
+ *
+ * @param[in] val Buffer pointing to the state
+ */
+static void Hash_inc_state_t_ref(struct gsh_buffdesc *val)
+{
+	inc_state_t_ref(val->addr);
+}
+
 /**
  * @brief Get the state from the stateid
  *
@@ -627,30 +623,20 @@ struct state_t *nfs4_State_Get_Pointer(char *other)
 	struct gsh_buffdesc buffkey;
 	struct gsh_buffdesc buffval;
 	hash_error_t rc;
-	struct hash_latch latch;
-	struct state_t *state;
 
 	buffkey.addr = other;
 	buffkey.len = OTHERSIZE;
 
-	rc = hashtable_getlatch(ht_state_id, &buffkey, &buffval, true, &latch);
+	/* Takes the reference without a lock, see HT_FLAG_LOCKLESS_READ */
+	rc = hashtable_getref(ht_state_id, &buffkey, &buffval,
+			      Hash_inc_state_t_ref);
 
 	if (rc != HASHTABLE_SUCCESS) {
-		if (rc == HASHTABLE_ERROR_NO_SUCH_KEY)
-			hashtable_releaselatched(ht_state_id, &latch);
 		LogDebug(COMPONENT_STATE, "HashTable_Get returned %d", rc);
 		return NULL;
 	}
 
-	state = buffval.addr;
-
-	/* Take a reference under latch */
-	inc_state_t_ref(state);
-
-	/* Release latch */
-	hashtable_releaselatched(ht_state_id, &latch);
-
-	return state;
+	return buffval.addr;
 }
 
 /**
@@ -665,8 +651,6 @@ struct state_t *nfs4_State_Get_State_Obj(struct state_obj *state_obj,
 	struct gsh_buffdesc buffkey;
 	struct gsh_buffdesc buffval;
 	hash_error_t rc;
-	struct hash_latch latch;
-	struct state_t *state;
 
 	memset(&state_key, 0, sizeof(state_key));
 
@@ -676,28 +660,17 @@ struct state_t *nfs4_State_Get_State_Obj(struct state_obj *state_obj,
 	state_key.state_owner = owner;
 	state_key.state_obj = *state_obj; /* Struct copy */
 
-	rc = hashtable_getlatch(ht_state_obj,
-				&buffkey,
-				&buffval,
-				true,
-				&latch);
+	rc = hashtable_getref(ht_state_obj,
+			      &buffkey,
+			      &buffval,
+			      Hash_inc_state_t_ref);
 
 	if (rc != HASHTABLE_SUCCESS) {
-		if (rc == HASHTABLE_ERROR_NO_SUCH_KEY)
-			hashtable_releaselatched(ht_state_obj, &latch);
 		LogDebug(COMPONENT_STATE, "HashTable_Get returned %d", rc);
 		return NULL;
 	}
 
-	state = buffval.addr;
-
-	/* Take a reference under latch */
-	inc_state_t_ref(state);
-
-	/* Release latch */
-	hashtable_releaselatched(ht_state_obj, &latch);
-
-	return state;
+	return buffval.addr;
 }
 
 /**
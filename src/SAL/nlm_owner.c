@@ -45,6 +45,8 @@
 #include "log.h"
 #include "client_mgr.h"
 #include "fsal.h"
+#include "city.h"
+#include "gsh_hash.h"
 
 /**
  * @brief NSM clients
@@ -202,9 +204,23 @@ int compare_nsm_client_key(struct gsh_buffdesc *buff1,
 }
 
 /**
- * @brief Calculate hash index for an NSM key
+ * @brief Hash an NSM key
  *
- * @todo Replace with a good hash function.
+ * @param[in] pkey The NSM client
+ *
+ * @return The hash.
+ */
+static uint64_t nsm_client_hash(state_nsm_client_t *pkey)
+{
+	if (!nfs_param.core_param.nsm_use_caller_name)
+		return gsh_hash_u64((uintptr_t) pkey->ssc_client, 0);
+
+	return CityHash64WithSeed(pkey->ssc_nlm_caller_name,
+				  pkey->ssc_nlm_caller_name_len, 0);
+}
+
+/**
+ * @brief Calculate hash index for an NSM key
  *
  * @param[in]  hparam Hash params
  * @param[out] key    Key to hash
@@ -214,36 +230,18 @@ int compare_nsm_client_key(struct gsh_buffdesc *buff1,
 uint32_t nsm_client_value_hash_func(hash_parameter_t *hparam,
 				    struct gsh_buffdesc *key)
 {
-	unsigned long res;
-	state_nsm_client_t *pkey = key->addr;
-
-	if (nfs_param.core_param.nsm_use_caller_name) {
-		unsigned int sum = 0;
-		unsigned int i;
-
-		/* Compute the sum of all the characters */
-		for (i = 0; i < pkey->ssc_nlm_caller_name_len; i++)
-			sum += (unsigned char)pkey->ssc_nlm_caller_name[i];
-
-		res =
-		    (unsigned long)sum +
-		    (unsigned long)pkey->ssc_nlm_caller_name_len;
-	} else {
-		res = (unsigned long) pkey->ssc_client;
-	}
+	uint64_t res = nsm_client_hash(key->addr);
 
 	if (isDebug(COMPONENT_HASHTABLE))
-		LogFullDebug(COMPONENT_STATE, "value = %lu",
+		LogFullDebug(COMPONENT_STATE, "value = %"PRIu64,
 			     res % hparam->index_size);
 
-	return (unsigned long)(res % hparam->index_size);
+	return res % hparam->index_size;
 }
 
 /**
  * @brief Calculate RBT hash for an NSM key
  *
- * @todo Replace with a good hash function.
- *
  * @param[in]  hparam Hash params
  * @param[out] key    Key to hash
  *
@@ -252,26 +250,10 @@ uint32_t nsm_client_value_hash_func(hash_parameter_t *hparam,
 uint64_t nsm_client_rbt_hash_func(hash_parameter_t *hparam,
 				  struct gsh_buffdesc *key)
 {
-	unsigned long res;
-	state_nsm_client_t *pkey = key->addr;
-
-	if (nfs_param.core_param.nsm_use_caller_name) {
-		unsigned int sum = 0;
-		unsigned int i;
-
-		/* Compute the sum of all the characters */
-		for (i = 0; i < pkey->ssc_nlm_caller_name_len; i++)
-			sum += (unsigned char)pkey->ssc_nlm_caller_name[i];
-
-		res =
-		    (unsigned long)sum +
-		    (unsigned long)pkey->ssc_nlm_caller_name_len;
-	} else {
-		res = (unsigned long) pkey->ssc_client;
-	}
+	uint64_t res = nsm_client_hash(key->addr);
 
 	if (isDebug(COMPONENT_HASHTABLE))
-		LogFullDebug(COMPONENT_STATE, "rbt = %lu", res);
+		LogFullDebug(COMPONENT_STATE, "rbt = %"PRIu64, res);
 
 	return res;
 }				/* nsm_client_rbt_hash_func */
@@ -423,9 +405,21 @@ int compare_nlm_client_key(struct gsh_buffdesc *buff1,
 }
 
 /**
- * @brief Calculate hash index for an NLM key
+ * @brief Hash an NLM client key
  *
- * @todo Replace with a good hash function.
+ * @param[in] pkey The NLM client
+ *
+ * @return The hash.
+ */
+static uint64_t nlm_client_hash(state_nlm_client_t *pkey)
+{
+	return CityHash64WithSeed(pkey->slc_nlm_caller_name,
+				  pkey->slc_nlm_caller_name_len,
+				  pkey->slc_client_type);
+}
+
+/**
+ * @brief Calculate hash index for an NLM key
  *
  * @param[in]  hparam Hash params
  * @param[out] key    Key to hash
@@ -435,29 +429,18 @@ int compare_nlm_client_key(struct gsh_buffdesc *buff1,
 uint32_t nlm_client_value_hash_func(hash_parameter_t *hparam,
 				    struct gsh_buffdesc *key)
 {
-	uint32_t sum = 0;
-	unsigned int i;
-	unsigned long res;
-	state_nlm_client_t *pkey = key->addr;
-
-	/* Compute the sum of all the characters */
-	for (i = 0; i < pkey->slc_nlm_caller_name_len; i++)
-		sum += (unsigned char)pkey->slc_nlm_caller_name[i];
-
-	res = (unsigned long)sum + (unsigned long)pkey->slc_nlm_caller_name_len;
+	uint64_t res = nlm_client_hash(key->addr);
 
 	if (isDebug(COMPONENT_HASHTABLE))
-		LogFullDebug(COMPONENT_STATE, "value = %lu",
+		LogFullDebug(COMPONENT_STATE, "value = %"PRIu64,
 			     res % hparam->index_size);
 
-	return (unsigned long)(res % hparam->index_size);
+	return res % hparam->index_size;
 }
 
 /**
  * @brief Calculate RBT hash for an NLM key
  *
- * @todo Replace with a good hash function.
- *
  * @param[in]  hparam Hash params
  * @param[out] key    Key to hash
  *
@@ -466,19 +449,10 @@ uint32_t nlm_client_value_hash_func(hash_parameter_t *hparam,
 uint64_t nlm_client_rbt_hash_func(hash_parameter_t *hparam,
 				  struct gsh_buffdesc *key)
 {
-	unsigned int sum = 0;
-	unsigned int i;
-	unsigned long res;
-	state_nlm_client_t *pkey = key->addr;
-
-	/* Compute the sum of all the characters */
-	for (i = 0; i < pkey->slc_nlm_caller_name_len; i++)
-		sum += (unsigned char)pkey->slc_nlm_caller_name[i];
-
-	res = (unsigned long)sum + (unsigned long)pkey->slc_nlm_caller_name_len;
+	uint64_t res = nlm_client_hash(key->addr);
 
 	if (isDebug(COMPONENT_HASHTABLE))
-		LogFullDebug(COMPONENT_STATE, "rbt = %lu", res);
+		LogFullDebug(COMPONENT_STATE, "rbt = %"PRIu64, res);
 
 	return res;
 }				/* nlm_client_rbt_hash_func */
@@ -625,9 +599,20 @@ int compare_nlm_owner_key(struct gsh_buffdesc *buff1,
 }
 
 /**
- * @brief Calculate hash index for an NLM owner key
+ * @brief Hash an NLM owner key
  *
- * @todo Replace with a good hash function.
+ * @param[in] pkey The NLM owner
+ *
+ * @return The hash.
+ */
+static uint64_t nlm_owner_hash(state_owner_t *pkey)
+{
+	return CityHash64WithSeed(pkey->so_owner_val, pkey->so_owner_len,
+				  pkey->so_owner.so_nlm_owner.so_nlm_svid);
+}
+
+/**
+ * @brief Calculate hash index for an NLM owner key
  *
  * @param[in]  hparam Hash params
  * @param[out] key    Key to hash
@@ -637,32 +622,18 @@ int compare_nlm_owner_key(struct gsh_buffdesc *buff1,
 uint32_t nlm_owner_value_hash_func(hash_parameter_t *hparam,
 				   struct gsh_buffdesc *key)
 {
-	unsigned int sum = 0;
-	unsigned int i;
-	unsigned long res;
-	state_owner_t *pkey = key->addr;
-
-	/* Compute the sum of all the characters */
-	for (i = 0; i < pkey->so_owner_len; i++)
-		sum += (unsigned char)pkey->so_owner_val[i];
-
-	res =
-	    (unsigned long)(pkey->so_owner.so_nlm_owner.so_nlm_svid) +
-	    (unsigned long)sum + (unsigned long)pkey->so_owner_len;
+	uint64_t res = nlm_owner_hash(key->addr);
 
 	if (isDebug(COMPONENT_HASHTABLE))
-		LogFullDebug(COMPONENT_STATE, "value = %lu",
+		LogFullDebug(COMPONENT_STATE, "value = %"PRIu64,
 			     res % hparam->index_size);
 
-	return (unsigned long)(res % hparam->index_size);
-
+	return res % hparam->index_size;
 }
 
 /**
  * @brief Calculate RBT hash for an NLM owner key
  *
- * @todo Replace with a good hash function.
- *
  * @param[in]  hparam Hash params
  * @param[out] key    Key to hash
  *
@@ -671,21 +642,10 @@ uint32_t nlm_owner_value_hash_func(hash_parameter_t *hparam,
 uint64_t nlm_owner_rbt_hash_func(hash_parameter_t *hparam,
 				 struct gsh_buffdesc *key)
 {
-	unsigned int sum = 0;
-	unsigned int i;
-	unsigned long res;
-	state_owner_t *pkey = key->addr;
-
-	/* Compute the sum of all the characters */
-	for (i = 0; i < pkey->so_owner_len; i++)
-		sum += (unsigned char)pkey->so_owner_val[i];
-
-	res =
-	    (unsigned long)(pkey->so_owner.so_nlm_owner.so_nlm_svid) +
-	    (unsigned long)sum + (unsigned long)pkey->so_owner_len;
+	uint64_t res = nlm_owner_hash(key->addr);
 
 	if (isDebug(COMPONENT_HASHTABLE))
-		LogFullDebug(COMPONENT_STATE, "rbt = %lu", res);
+		LogFullDebug(COMPONENT_STATE, "rbt = %"PRIu64, res);
 
 	return res;
 }				/* state_id_rbt_hash_func */
@@ -697,7 +657,7 @@ static hash_parameter_t nsm_client_hash_param = {
 	.compare_key = compare_nsm_client_key,
 	.key_to_str = display_nsm_client_key,
 	.val_to_str = display_nsm_client_val,
-	.flags = HT_FLAG_NONE,
+	.flags = HT_FLAG_GROW,
 };
 
 static hash_parameter_t nlm_client_hash_param = {
@@ -707,7 +667,7 @@ static hash_parameter_t nlm_client_hash_param = {
 	.compare_key = compare_nlm_client_key,
 	.key_to_str = display_nlm_client_key,
 	.val_to_str = display_nlm_client_val,
-	.flags = HT_FLAG_NONE,
+	.flags = HT_FLAG_GROW,
 };
 
 static hash_parameter_t nlm_owner_hash_param = {
@@ -717,7 +677,7 @@ static hash_parameter_t nlm_owner_hash_param = {
 	.compare_key = compare_nlm_owner_key,
 	.key_to_str = display_nlm_owner_key,
 	.val_to_str = display_nlm_owner_val,
-	.flags = HT_FLAG_NONE,
+	.flags = HT_FLAG_GROW,
 };
 
 /**
@@ -1045,6 +1005,12 @@ void free_nlm_client(state_nlm_client_t *client)
 	if (client->slc_nlm_caller_name != NULL)
 		gsh_free(client->slc_nlm_caller_name);
 
+	if (client->slc_callback_clnt != NULL) {
+		gsh_clnt_destroy(client->slc_callback_clnt);
+		AUTH_DESTROY(client->slc_callback_auth);
+	}
+
+	PTHREAD_MUTEX_destroy(&client->slc_callback_lock);
 	gsh_free(client);
 }
 
@@ -1253,6 +1219,10 @@ state_nlm_client_t *get_nlm_client(care_t care, SVCXPRT *xprt,
 	/* Copy everything over */
 	memcpy(pclient, &key, sizeof(key));
 
+	PTHREAD_MUTEX_init(&pclient->slc_callback_lock, NULL);
+	pclient->slc_callback_clnt = NULL;
+	pclient->slc_callback_auth = NULL;
+
 	pclient->slc_nlm_caller_name = gsh_strdup(key.slc_nlm_caller_name);
 
 	/* Take a reference to the NSM Client */
@@ -179,8 +179,8 @@ uint32_t nlm_state_value_hash_func(hash_parameter_t *hparam,
 
 	/* We hash based on the owner pointer, and the object key.  This depends
 	 * on them being sequential in memory. */
-	hk = CityHash64WithSeed(addr, sizeof(pkey->state_owner)
-				+ sizeof(pkey->state_obj), 557);
+	hk = CityHash64WithSeed(addr, sizeof(pkey->state_owner) +
+				sizeof(pkey->state_obj), 557);
 
 	if (pkey->state_type == STATE_TYPE_NLM_SHARE)
 		hk = ~hk;
@@ -218,10 +218,9 @@ uint64_t nlm_state_rbt_hash_func(hash_parameter_t *hparam,
 		hk = ~hk;
 
 	if (isDebug(COMPONENT_HASHTABLE))
-		LogFullDebug(COMPONENT_STATE, "value = %"PRIx64,
-			     hk % hparam->index_size);
+		LogFullDebug(COMPONENT_STATE, "rbt = %"PRIx64, hk);
 
-	return hk % hparam->index_size;
+	return hk;
 }
 
 static hash_parameter_t nlm_state_hash_param = {
@@ -231,7 +230,7 @@ static hash_parameter_t nlm_state_hash_param = {
 	.compare_key = compare_nlm_state_key,
 	.key_to_str = display_nlm_state_key,
 	.val_to_str = display_nlm_state_val,
-	.flags = HT_FLAG_NONE,
+	.flags = HT_FLAG_GROW,
 };
 
 /**
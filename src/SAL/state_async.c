@@ -32,6 +32,11 @@
 /**
  * @file  state_async.c
  * @brief Management of SAL asynchronous processing
+ *
+ * Lock grants have a lane of their own, so that a client waiting in
+ * a blocking lock does not wait behind NLM responses and cleanups.
+ * The grant lane takes all the grants queued at once and tries those
+ * of each file together, under one take of its state_lock.
  */
 
 #include "config.h"
@@ -48,24 +53,91 @@
 #include "sal_functions.h"
 #include "fridgethr.h"
 #include "gsh_config.h"
+#include "gsh_list.h"
 
 struct fridgethr *state_async_fridge;
 struct fridgethr *state_poll_fridge;
+struct fridgethr *state_grant_fridge;
+
+/**
+ * @brief A blocked lock waiting for the grant lane
+ */
+struct state_grant_req {
+	struct glist_head list;
+	state_block_data_t *block;
+};
+
+static struct {
+	pthread_mutex_t mtx;
+	struct glist_head queue;	/*< Of state_grant_req, oldest first */
+	bool scheduled;			/*< The lane has been submitted */
+} state_grants = {
+	.mtx = PTHREAD_MUTEX_INITIALIZER,
+	.queue = GLIST_HEAD_INIT(state_grants.queue),
+};
 
 /**
- * @brief Process a blocked lock request
+ * @brief Try the grants of a batch, a file at a time
  *
- * We use this wrapper so we can void rewriting stuff.  We can change
- * this later.
+ * @param[in] todo Requests, freed
+ */
+static void state_grant_batch(struct glist_head *todo)
+{
+	state_block_data_t *blocks[STATE_GRANT_BATCH];
+	struct glist_head *glist, *glistn;
+	struct state_grant_req *req;
+	struct fsal_obj_handle *obj;
+	int count;
+
+	while (!glist_empty(todo)) {
+		req = glist_first_entry(todo, struct state_grant_req, list);
+		obj = req->block->sbd_lock_entry->sle_obj;
+		count = 0;
+
+		glist_for_each_safe(glist, glistn, todo) {
+			req = glist_entry(glist, struct state_grant_req, list);
+			if (req->block->sbd_lock_entry->sle_obj != obj)
+				continue;
+			glist_del(&req->list);
+			blocks[count] = req->block;
+			gsh_free(req);
+			if (++count == STATE_GRANT_BATCH)
+				break;
+		}
+
+		LogFullDebug(COMPONENT_STATE,
+			     "Granting %d blocked locks on %p", count, obj);
+
+		process_blocked_lock_upcalls(blocks, count);
+	}
+}
+
+/**
+ * @brief Process the blocked lock requests queued
  *
- * @param[in] ctx Thread context, containing arguments.
+ * Runs until the queue is empty.
+ *
+ * @param[in] ctx Thread context
  */
 
 static void state_blocked_lock_caller(struct fridgethr_context *ctx)
 {
-	state_block_data_t *block = ctx->arg;
+	struct glist_head todo;
+
+	glist_init(&todo);
+
+	for (;;) {
+		PTHREAD_MUTEX_lock(&state_grants.mtx);
+		glist_splice_tail(&todo, &state_grants.queue);
+		if (glist_empty(&todo)) {
+			state_grants.scheduled = false;
+			PTHREAD_MUTEX_unlock(&state_grants.mtx);
+			return;
+		}
+		PTHREAD_MUTEX_unlock(&state_grants.mtx);
 
-	process_blocked_lock_upcall(block);
+		state_grant_batch(&todo);
+	}
 }
 
 /**
@@ -113,17 +185,34 @@ state_status_t state_async_schedule(state_async_queue_t *arg)
  */
 state_status_t state_block_schedule(state_block_data_t *block)
 {
-	int rc;
+	struct state_grant_req *req;
+	int rc = 0;
 
 	LogFullDebug(COMPONENT_STATE, "Schedule notification %p", block);
 
-	rc = fridgethr_submit(state_async_fridge, state_blocked_lock_caller,
-			      block);
+	req = gsh_malloc(sizeof(*req));
+	req->block = block;
+
+	PTHREAD_MUTEX_lock(&state_grants.mtx);
+
+	if (!state_grants.scheduled) {
+		rc = fridgethr_submit(state_grant_fridge,
+				      state_blocked_lock_caller, NULL);
+		if (rc != 0) {
+			PTHREAD_MUTEX_unlock(&state_grants.mtx);
+			gsh_free(req);
+			LogMajor(COMPONENT_STATE,
+				 "Unable to schedule request: %d", rc);
+			return STATE_SIGNAL_ERROR;
+		}
+		state_grants.scheduled = true;
+	}
 
-	if (rc != 0)
-		LogMajor(COMPONENT_STATE, "Unable to schedule request: %d", rc);
+	glist_add_tail(&state_grants.queue, &req->list);
 
-	return rc == 0 ? STATE_SUCCESS : STATE_SIGNAL_ERROR;
+	PTHREAD_MUTEX_unlock(&state_grants.mtx);
+
+	return STATE_SUCCESS;
 }
 
 /**
@@ -149,6 +238,19 @@ state_status_t state_async_init(void)
 		return STATE_INIT_ENTRY_FAILED;
 	}
 
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = 1;
+	frp.deferment = fridgethr_defer_queue;
+
+	rc = fridgethr_init(&state_grant_fridge, "State_Grant", &frp);
+
+	if (rc != 0) {
+		LogMajor(COMPONENT_STATE,
+			 "Unable to initialize state grant thread fridge: %d",
+			 rc);
+		return STATE_INIT_ENTRY_FAILED;
+	}
+
 	memset(&frp, 0, sizeof(struct fridgethr_params));
 	frp.thr_max = 1;
 	frp.thr_min = 1;
@@ -183,7 +285,7 @@ state_status_t state_async_init(void)
  */
 state_status_t state_async_shutdown(void)
 {
-	int rc1, rc2;
+	int rc1, rc2, rc3;
 
 	rc1 = fridgethr_sync_command(state_async_fridge,
 				     fridgethr_comm_stop,
@@ -212,7 +314,21 @@ state_status_t state_async_shutdown(void)
 			 rc2);
 	}
 
-	return ((rc1 == 0) && (rc2 == 0)) ? STATE_SUCCESS : STATE_SIGNAL_ERROR;
+	rc3 = fridgethr_sync_command(state_grant_fridge,
+				     fridgethr_comm_stop,
+				     120);
+
+	if (rc3 == ETIMEDOUT) {
+		LogMajor(COMPONENT_STATE,
+			 "Shutdown timed out, cancelling threads.");
+		fridgethr_cancel(state_grant_fridge);
+	} else if (rc3 != 0) {
+		LogMajor(COMPONENT_STATE,
+			 "Failed shutting down state grant thread: %d", rc3);
+	}
+
+	return ((rc1 == 0) && (rc2 == 0) && (rc3 == 0)) ? STATE_SUCCESS
+							  : STATE_SIGNAL_ERROR;
 }
 
 /** @} */
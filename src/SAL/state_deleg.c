@@ -346,6 +346,10 @@ bool init_deleg_heuristics(struct fsal_obj_handle *obj)
 	statistics->fds_avg_hold = 0;
 	statistics->fds_num_opens = 0;
 	statistics->fds_first_open = 0;
+	statistics->fds_read_opens = 0;
+	statistics->fds_write_opens = 0;
+	statistics->fds_recent_recalls = 0;
+	statistics->fds_history_start = 0;
 
 	return true;
 }
@@ -355,6 +359,120 @@ bool init_deleg_heuristics(struct fsal_obj_handle *obj)
  */
 #define RECALL2DELEG_TIME 10
 
+/* The open and recall history of a file is halved this often, so that
+ * it reflects the last few minutes of use.
+ */
+#define DELEG_HISTORY_WINDOW 60
+
+/* A file is read-mostly while it has this many read opens for each
+ * write open.
+ */
+#define DELEG_READ_MOSTLY_RATIO 8
+
+/* Each recent recall doubles the time after a recall during which no
+ * delegation is granted on a file that is not read-mostly, up to this
+ * many times.
+ */
+#define DELEG_RECALL_BACKOFF_MAX 4
+
+/**
+ * @brief Age the open and recall history of a file
+ *
+ * The counts are only a guide, so they are updated without more than
+ * the state_lock for read.
+ */
+static void deleg_history_age(struct file_deleg_stats *statistics,
+			      time_t now_sec)
+{
+	time_t windows;
+
+	if (statistics->fds_history_start == 0) {
+		statistics->fds_history_start = now_sec;
+		return;
+	}
+
+	windows = (now_sec - statistics->fds_history_start) /
+		  DELEG_HISTORY_WINDOW;
+	if (windows <= 0)
+		return;
+
+	if (windows >= 32) {
+		statistics->fds_read_opens = 0;
+		statistics->fds_write_opens = 0;
+		statistics->fds_recent_recalls = 0;
+	} else {
+		statistics->fds_read_opens >>= windows;
+		statistics->fds_write_opens >>= windows;
+		statistics->fds_recent_recalls >>= windows;
+	}
+
+	statistics->fds_history_start += windows * DELEG_HISTORY_WINDOW;
+}
+
+/**
+ * @brief Record an open in the file's history
+ *
+ * @note The state_lock MUST be held for read
+ *
+ * @param[in] ostate       File state
+ * @param[in] share_access Access the open asked for
+ */
+void deleg_heuristics_open(struct state_hdl *ostate, uint32_t share_access)
+{
+	struct file_deleg_stats *statistics = &ostate->file.fdeleg_stats;
+
+	deleg_history_age(statistics, time(NULL));
+
+	if (share_access & OPEN4_SHARE_ACCESS_WRITE)
+		statistics->fds_write_opens++;
+	else
+		statistics->fds_read_opens++;
+}
+
+/**
+ * @brief Record that the delegations on a file are being recalled
+ *
+ * @note The state_lock MUST be held for write
+ *
+ * @param[in] ostate File state
+ */
+void deleg_heuristics_conflict(struct state_hdl *ostate)
+{
+	struct file_deleg_stats *statistics = &ostate->file.fdeleg_stats;
+	time_t now_sec = time(NULL);
+
+	deleg_history_age(statistics, now_sec);
+
+	/* One recall of every holder counts once */
+	if (statistics->fds_last_recall != now_sec)
+		statistics->fds_recent_recalls++;
+
+	statistics->fds_last_recall = now_sec;
+}
+
+/**
+ * @brief How long after a recall to hold off granting on this file
+ *
+ * Read-mostly files keep the short fixed delay, so their readers get
+ * delegations back quickly.  Elsewhere each recent recall doubles it,
+ * since delegations there are likely to be recalled again.
+ */
+static time_t deleg_recall_backoff(struct file_deleg_stats *statistics)
+{
+	uint32_t recalls = statistics->fds_recent_recalls;
+
+	if (statistics->fds_read_opens >=
+	    statistics->fds_write_opens * DELEG_READ_MOSTLY_RATIO)
+		return RECALL2DELEG_TIME;
+
+	if (recalls > 0)
+		recalls--;
+	if (recalls > DELEG_RECALL_BACKOFF_MAX)
+		recalls = DELEG_RECALL_BACKOFF_MAX;
+
+	return RECALL2DELEG_TIME << recalls;
+}
+
 /**
  * @brief Decide if a delegation should be granted based on heuristics.
  *
@@ -424,8 +542,14 @@ bool should_we_grant_deleg(struct state_hdl *ostate, nfs_client_id_t *client,
 	 * the recall.
 	 */
 	if (file_stats->fds_last_recall != 0 &&
-	    time(NULL) - file_stats->fds_last_recall < RECALL2DELEG_TIME)
+	    time(NULL) - file_stats->fds_last_recall <
+	    deleg_recall_backoff(file_stats)) {
+		LogFullDebug(COMPONENT_STATE,
+			     "Recalled %"PRIu32
+			     " times recently, not granting delegation",
+			     file_stats->fds_recent_recalls);
 		return false;
+	}
 
 	/* Check if this is a misbehaving or unreliable client */
 	if (client->num_revokes > 2) /* more than 2 revokes */
@@ -49,6 +49,11 @@
 #include "sal_functions.h"
 /*#include "nlm_util.h"*/
 #include "export_mgr.h"
+#include "gsh_intrinsic.h"
+#include "city.h"
+#ifdef USE_LTTNG
+#include "gsh_lttng/state.h"
+#endif
 
 /**
  * @page state_lock_entry_locking state_lock_entry_t locking rule
@@ -71,26 +76,46 @@
  * last release on the data structure ensure that it is freed.
  */
 
-#ifdef DEBUG_SAL
 /**
- * @brief All locks.
+ * @brief Number of partitions of the process-wide lock lists
  */
-static struct glist_head state_all_locks = GLIST_HEAD_INIT(state_all_locks);
+#define LOCK_PARTITIONS 17
+
 /**
- * @brief All locks mutex
+ * @brief A share of the process-wide lock lists
+ *
+ * Locks are spread across partitions by file, so blocking and granting
+ * locks on one file only contends with the files that hash alongside
+ * it.
  */
-pthread_mutex_t all_locks_mutex = PTHREAD_MUTEX_INITIALIZER;
+struct lock_partition {
+	/** Mutex to protect blocked */
+	pthread_mutex_t blocked_mutex;
+	/** Locks blocked in FSAL */
+	struct glist_head blocked;
+#ifdef DEBUG_SAL
+	/** Mutex to protect all */
+	pthread_mutex_t all_mutex;
+	/** All locks */
+	struct glist_head all;
 #endif
+	GSH_CACHE_PAD(0);
+};
 
-/**
- * @brief All locks blocked in FSAL
- */
-struct glist_head state_blocked_locks = GLIST_HEAD_INIT(state_blocked_locks);
+static struct lock_partition lock_partitions[LOCK_PARTITIONS];
 
 /**
- * @brief Mutex to protect lock lists
+ * @brief Find the partition holding a file's locks
+ *
+ * @param[in] obj File
+ *
+ * @return The partition.
  */
-pthread_mutex_t blocked_locks_mutex = PTHREAD_MUTEX_INITIALIZER;
+static inline struct lock_partition *lock_partition_of(
+					struct fsal_obj_handle *obj)
+{
+	return &lock_partitions[((uintptr_t) obj >> 4) % LOCK_PARTITIONS];
+}
 
 /**
  * @brief Owner of state with no defined owner
@@ -143,6 +168,16 @@ static hash_table_t *ht_lock_cookies;
 state_status_t state_lock_init(void)
 {
 	state_status_t status = STATE_SUCCESS;
+	int i;
+
+	for (i = 0; i < LOCK_PARTITIONS; i++) {
+		PTHREAD_MUTEX_init(&lock_partitions[i].blocked_mutex, NULL);
+		glist_init(&lock_partitions[i].blocked);
+#ifdef DEBUG_SAL
+		PTHREAD_MUTEX_init(&lock_partitions[i].all_mutex, NULL);
+		glist_init(&lock_partitions[i].all);
+#endif
+	}
 
 	ht_lock_cookies = hashtable_init(&cookie_param);
 	if (ht_lock_cookies == NULL) {
@@ -154,7 +189,8 @@ state_status_t state_lock_init(void)
 	status = state_async_init();
 
 	state_owner_pool =
-		pool_basic_init("NFSv4 state owners", sizeof(state_owner_t));
+		slab_pool_init("State owners",
+			       sizeof(state_owner_t) + STATE_OWNER_INLINE_NAME);
 
 	return status;
 }
@@ -409,7 +445,7 @@ static bool LogList(const char *reason, struct fsal_obj_handle *obj,
 /**
  * @brief Log blocked locks on list
  *
- * Must hold blocked_locks_mutex.
+ * Must hold the blocked_mutex of the list's partition.
  *
  * @param[in] reason Arbitrary string
  * @param[in] obj  File
@@ -517,8 +553,12 @@ void log_lock_desc(log_components_t component, log_levels_t debug,
 }
 
 #define LogLockDesc(component, debug, reason, obj, owner, lock) \
-	log_lock_desc(component, debug, reason, obj, owner, lock, \
-		      (char *) __FILE__, __LINE__, (char *) __func__)
+	do { \
+		if (isLevel(component, debug)) \
+			log_lock_desc(component, debug, reason, obj, owner, \
+				      lock, (char *) __FILE__, __LINE__, \
+				      (char *) __func__); \
+	} while (0)
 
 /**
  * @brief Log all locks
@@ -529,20 +569,27 @@ void dump_all_locks(const char *label)
 {
 #ifdef DEBUG_SAL
 	struct glist_head *glist;
+	struct lock_partition *part;
+	bool empty = true;
+	int i;
 
-	PTHREAD_MUTEX_lock(&all_locks_mutex);
+	for (i = 0; i < LOCK_PARTITIONS; i++) {
+		part = &lock_partitions[i];
 
-	if (glist_empty(&state_all_locks)) {
-		LogFullDebug(COMPONENT_STATE, "All Locks are freed");
-		PTHREAD_MUTEX_unlock(&all_locks_mutex);
-		return;
-	}
+		PTHREAD_MUTEX_lock(&part->all_mutex);
+
+		glist_for_each(glist, &part->all) {
+			LogEntry(label,
+				 glist_entry(glist, state_lock_entry_t,
+					     sle_all_locks));
+			empty = false;
+		}
 
-	glist_for_each(glist, &state_all_locks)
-	    LogEntry(label,
-		     glist_entry(glist, state_lock_entry_t, sle_all_locks));
+		PTHREAD_MUTEX_unlock(&part->all_mutex);
+	}
 
-	PTHREAD_MUTEX_unlock(&all_locks_mutex);
+	if (empty)
+		LogFullDebug(COMPONENT_STATE, "All Locks are freed");
 #else
 	return;
 #endif
@@ -575,6 +622,9 @@ static state_lock_entry_t *create_state_lock_entry(struct fsal_obj_handle *obj,
 						   fsal_lock_param_t *lock)
 {
 	state_lock_entry_t *new_entry;
+#ifdef DEBUG_SAL
+	struct lock_partition *part;
+#endif
 
 	new_entry = gsh_malloc(sizeof(*new_entry));
 
@@ -639,11 +689,13 @@ static state_lock_entry_t *create_state_lock_entry(struct fsal_obj_handle *obj,
 	PTHREAD_MUTEX_unlock(&owner->so_mutex);
 
 #ifdef DEBUG_SAL
-	PTHREAD_MUTEX_lock(&all_locks_mutex);
+	part = lock_partition_of(obj);
+
+	PTHREAD_MUTEX_lock(&part->all_mutex);
 
-	glist_add_tail(&state_all_locks, &new_entry->sle_all_locks);
+	glist_add_tail(&part->all, &new_entry->sle_all_locks);
 
-	PTHREAD_MUTEX_unlock(&all_locks_mutex);
+	PTHREAD_MUTEX_unlock(&part->all_mutex);
 #endif
 
 	return new_entry;
@@ -687,6 +739,7 @@ static inline void lock_entry_inc_ref(state_lock_entry_t *lock_entry)
 static void lock_entry_dec_ref(state_lock_entry_t *lock_entry)
 {
 	int32_t refcount = atomic_dec_int32_t(&lock_entry->sle_ref_count);
+	struct lock_partition *part;
 
 	LogEntryRefCount(refcount != 0
 			 ? "Decrement refcount"
@@ -694,18 +747,20 @@ static void lock_entry_dec_ref(state_lock_entry_t *lock_entry)
 			 lock_entry, refcount);
 
 	if (refcount == 0) {
+		part = lock_partition_of(lock_entry->sle_obj);
+
 		/* Release block data if present */
 		if (lock_entry->sle_block_data != NULL) {
-			/* need to remove from the state_blocked_locks list */
-			PTHREAD_MUTEX_lock(&blocked_locks_mutex);
+			/* need to remove from the blocked locks list */
+			PTHREAD_MUTEX_lock(&part->blocked_mutex);
 			glist_del(&lock_entry->sle_block_data->sbd_list);
-			PTHREAD_MUTEX_unlock(&blocked_locks_mutex);
+			PTHREAD_MUTEX_unlock(&part->blocked_mutex);
 			gsh_free(lock_entry->sle_block_data);
 		}
 #ifdef DEBUG_SAL
-		PTHREAD_MUTEX_lock(&all_locks_mutex);
+		PTHREAD_MUTEX_lock(&part->all_mutex);
 		glist_del(&lock_entry->sle_all_locks);
-		PTHREAD_MUTEX_unlock(&all_locks_mutex);
+		PTHREAD_MUTEX_unlock(&part->all_mutex);
 #endif
 
 		lock_entry->sle_obj->obj_ops.put_ref(lock_entry->sle_obj);
@@ -715,6 +770,182 @@ static void lock_entry_dec_ref(state_lock_entry_t *lock_entry)
 	}
 }
 
+/**
+ * @brief Index an entry of a file's lock list by its range
+ *
+ * @note The state_lock MUST be held for write
+ *
+ * @param[in,out] file       File state
+ * @param[in,out] lock_entry Entry on file->lock_list
+ */
+static void lock_tree_insert(struct state_file *file,
+			     state_lock_entry_t *lock_entry)
+{
+	lock_entry->sle_tree.start = lock_entry->sle_lock.lock_start;
+	lock_entry->sle_tree.end = lock_end(&lock_entry->sle_lock);
+	itree_insert(&file->lock_tree, &lock_entry->sle_tree);
+
+	if (lock_entry->sle_blocked != STATE_NON_BLOCKING)
+		file->lock_unsettled++;
+
+	if (file->lock_export_count == 0)
+		file->lock_export = lock_entry->sle_export;
+
+	if (lock_entry->sle_export == file->lock_export)
+		file->lock_export_count++;
+}
+
+/**
+ * @brief Drop an entry from the range index of a file's lock list
+ *
+ * @note The state_lock MUST be held for write
+ *
+ * @param[in,out] file       File state
+ * @param[in,out] lock_entry Entry in file->lock_tree
+ */
+static void lock_tree_remove(struct state_file *file,
+			     state_lock_entry_t *lock_entry)
+{
+	itree_remove(&file->lock_tree, &lock_entry->sle_tree);
+
+	if (lock_entry->sle_blocked != STATE_NON_BLOCKING)
+		file->lock_unsettled--;
+
+	if (lock_entry->sle_export == file->lock_export)
+		file->lock_export_count--;
+}
+
+/**
+ * @brief Add an entry to a file's lock list
+ *
+ * @note The state_lock MUST be held for write
+ *
+ * @param[in,out] ostate     File state
+ * @param[in,out] lock_entry Entry to add
+ */
+static void lock_list_add(struct state_hdl *ostate,
+			  state_lock_entry_t *lock_entry)
+{
+	glist_add_tail(&ostate->file.lock_list, &lock_entry->sle_list);
+	lock_tree_insert(&ostate->file, lock_entry);
+}
+
+/**
+ * @brief Mark an entry as fully granted
+ *
+ * @note The state_lock MUST be held for write
+ *
+ * @param[in,out] ostate     File state
+ * @param[in,out] lock_entry Entry being granted
+ */
+static void lock_entry_granted(struct state_hdl *ostate,
+			       state_lock_entry_t *lock_entry)
+{
+	if (lock_entry->sle_blocked != STATE_NON_BLOCKING &&
+	    itree_linked(&lock_entry->sle_tree))
+		ostate->file.lock_unsettled--;
+
+	lock_entry->sle_blocked = STATE_NON_BLOCKING;
+}
+
+/**
+ * @brief Check that all locks on a file were taken through one export
+ *
+ * @param[in] file   File state
+ * @param[in] export The export
+ *
+ * @return true if every entry on the lock list belongs to @a export.
+ */
+static inline bool lock_list_one_export(struct state_file *file,
+					struct gsh_export *export)
+{
+	return file->lock_tree.count == 0 ||
+		(file->lock_export == export &&
+		 file->lock_export_count == file->lock_tree.count);
+}
+
+/**
+ * @brief Gather the entries of a file's lock list overlapping a range
+ *
+ * The entries are referenced, so the caller may split, shrink or
+ * remove them, which it could not do while walking the tree.
+ *
+ * @param[in]  file  File state
+ * @param[in]  start First byte of the range
+ * @param[in]  end   Last byte of the range
+ * @param[out] count Number of entries found
+ *
+ * @return Array of entries by start, release with lock_tree_release.
+ */
+static state_lock_entry_t **lock_tree_gather(struct state_file *file,
+					     uint64_t start, uint64_t end,
+					     size_t *count)
+{
+	struct itree_node *node;
+	state_lock_entry_t **found = NULL;
+	size_t n = 0, size = 0;
+
+	itree_for_each_overlap(node, &file->lock_tree, start, end) {
+		if (n == size) {
+			size = size != 0 ? size * 2 : 8;
+			found = gsh_realloc(found, size * sizeof(*found));
+		}
+		found[n] = itree_entry(node, state_lock_entry_t, sle_tree);
+		lock_entry_inc_ref(found[n]);
+		n++;
+	}
+
+	*count = n;
+	return found;
+}
+
+/**
+ * @brief Gather the entries of a list of locks
+ *
+ * As lock_tree_gather, for a list that is not indexed.
+ *
+ * @param[in]  list  List of locks
+ * @param[out] count Number of entries found
+ *
+ * @return Array of entries, release with lock_tree_release.
+ */
+static state_lock_entry_t **lock_list_gather(struct glist_head *list,
+					     size_t *count)
+{
+	struct glist_head *glist;
+	state_lock_entry_t **found = NULL;
+	size_t n = 0, size = 0;
+
+	glist_for_each(glist, list) {
+		if (n == size) {
+			size = size != 0 ? size * 2 : 8;
+			found = gsh_realloc(found, size * sizeof(*found));
+		}
+		found[n] = glist_entry(glist, state_lock_entry_t, sle_list);
+		lock_entry_inc_ref(found[n]);
+		n++;
+	}
+
+	*count = n;
+	return found;
+}
+
+/**
+ * @brief Release entries gathered by lock_tree_gather
+ *
+ * @param[in] found Array of entries
+ * @param[in] count Number of entries
+ */
+static void lock_tree_release(state_lock_entry_t **found, size_t count)
+{
+	size_t i;
+
+	for (i = 0; i < count; i++)
+		lock_entry_dec_ref(found[i]);
+
+	gsh_free(found);
+}
+
 /**
  * @brief Remove an entry from the lock lists
  *
@@ -770,6 +1001,9 @@ static void remove_from_locklist(state_lock_entry_t *lock_entry)
 	}
 
 	lock_entry->sle_owner = NULL;
+	if (itree_linked(&lock_entry->sle_tree))
+		lock_tree_remove(&lock_entry->sle_obj->state_hdl->file,
+				 lock_entry);
 	glist_del(&lock_entry->sle_list);
 	lock_entry_dec_ref(lock_entry);
 }
@@ -789,12 +1023,13 @@ static state_lock_entry_t *get_overlapping_entry(struct state_hdl *ostate,
 						 state_owner_t *owner,
 						 fsal_lock_param_t *lock)
 {
-	struct glist_head *glist;
+	struct itree_node *node;
 	state_lock_entry_t *found_entry = NULL;
-	uint64_t found_entry_end, range_end = lock_end(lock);
+	uint64_t range_end = lock_end(lock);
 
-	glist_for_each(glist, &ostate->file.lock_list) {
-		found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
+	itree_for_each_overlap(node, &ostate->file.lock_tree,
+			       lock->lock_start, range_end) {
+		found_entry = itree_entry(node, state_lock_entry_t, sle_tree);
 
 		LogEntry("Checking", found_entry);
 
@@ -804,21 +1039,15 @@ static state_lock_entry_t *get_overlapping_entry(struct state_hdl *ostate,
 		    || found_entry->sle_blocked == STATE_CANCELED)
 			continue;
 
-		found_entry_end = lock_end(&found_entry->sle_lock);
-
-		if ((found_entry_end >= lock->lock_start)
-		    && (found_entry->sle_lock.lock_start <= range_end)) {
-			/* lock overlaps see if we can allow:
-			 * allow if neither lock is exclusive or
-			 * the owner is the same
-			 */
-			if ((found_entry->sle_lock.lock_type == FSAL_LOCK_W
-			     || lock->lock_type == FSAL_LOCK_W)
-			    && different_owners(found_entry->sle_owner, owner)
-			    ) {
-				/* found a conflicting lock, return it */
-				return found_entry;
-			}
+		/* lock overlaps see if we can allow:
+		 * allow if neither lock is exclusive or
+		 * the owner is the same
+		 */
+		if ((found_entry->sle_lock.lock_type == FSAL_LOCK_W
+		     || lock->lock_type == FSAL_LOCK_W)
+		    && different_owners(found_entry->sle_owner, owner)) {
+			/* found a conflicting lock, return it */
+			return found_entry;
 		}
 	}
 
@@ -828,9 +1057,9 @@ static state_lock_entry_t *get_overlapping_entry(struct state_hdl *ostate,
 /**
  * @brief Add a lock, potentially merging with existing locks
  *
- * We need to iterate over the full lock list and remove
- * any mapping entry. And l_offset = 0 and sle_lock.lock_length = 0 lock_entry
- * implies remove all entries
+ * We need to visit every entry touching or overlapping the lock and
+ * remove any mapping entry. And l_offset = 0 and sle_lock.lock_length = 0
+ * lock_entry implies remove all entries
  *
  * @note The state_lock MUST be held for write
  *
@@ -844,13 +1073,28 @@ static void merge_lock_entry(struct state_hdl *ostate,
 	state_lock_entry_t *check_entry_right;
 	uint64_t check_entry_end;
 	uint64_t lock_entry_end;
-	struct glist_head *glist;
-	struct glist_head *glistn;
+	uint64_t start = lock_entry->sle_lock.lock_start;
+	uint64_t end = lock_end(&lock_entry->sle_lock);
+	state_lock_entry_t **found;
+	size_t count, i;
+	bool linked = itree_linked(&lock_entry->sle_tree);
 
 	/* lock_entry might be STATE_NON_BLOCKING or STATE_GRANTING */
 
-	glist_for_each_safe(glist, glistn, &ostate->file.lock_list) {
-		check_entry = glist_entry(glist, state_lock_entry_t, sle_list);
+	/* Touching locks merge as well as overlapping ones */
+	if (start > 0)
+		start--;
+	if (end < UINT64_MAX)
+		end++;
+
+	found = lock_tree_gather(&ostate->file, start, end, &count);
+
+	/* lock_entry's range changes below, take it out of the tree */
+	if (linked)
+		lock_tree_remove(&ostate->file, lock_entry);
+
+	for (i = 0; i < count; i++) {
+		check_entry = found[i];
 
 		/* Skip entry being merged - it could be in the list */
 		if (check_entry == lock_entry)
@@ -885,6 +1129,8 @@ static void merge_lock_entry(struct state_hdl *ostate,
 		    && ((lock_entry_end < check_entry_end)
 			|| (check_entry->sle_lock.lock_start <
 			    lock_entry->sle_lock.lock_start))) {
+			lock_tree_remove(&ostate->file, check_entry);
+
 			if (lock_entry_end < check_entry_end
 			    && check_entry->sle_lock.lock_start <
 			    lock_entry->sle_lock.lock_start) {
@@ -924,6 +1170,10 @@ static void merge_lock_entry(struct state_hdl *ostate,
 				LogEntry("Merge shrunk left", check_entry);
 			}
 			/* Done splitting/shrinking old lock */
+			lock_tree_insert(&ostate->file, check_entry);
+			if (check_entry_right != check_entry)
+				lock_tree_insert(&ostate->file,
+						 check_entry_right);
 			continue;
 		}
 
@@ -949,6 +1199,11 @@ static void merge_lock_entry(struct state_hdl *ostate,
 		LogEntry("Merging removing", check_entry);
 		remove_from_locklist(check_entry);
 	}
+
+	if (linked)
+		lock_tree_insert(&ostate->file, lock_entry);
+
+	lock_tree_release(found, count);
 }
 
 /**
@@ -1065,6 +1320,8 @@ static state_status_t subtract_lock_from_entry(state_lock_entry_t *found_entry,
  * @param[in]     lock    Lock to remove
  * @param[out]    removed True if an entry was removed
  * @param[in,out] list    List of locks to modify
+ * @param[in,out] file    File state if @a list is its lock_list,
+ *                        else NULL
  *
  * @return State status.
  */
@@ -1073,21 +1330,30 @@ static state_status_t subtract_lock_from_list(state_owner_t *owner,
 					      int32_t state,
 					      fsal_lock_param_t *lock,
 					      bool *removed,
-					      struct glist_head *list)
+					      struct glist_head *list,
+					      struct state_file *file)
 {
 	state_lock_entry_t *found_entry;
 	struct glist_head split_lock_list, remove_list;
 	struct glist_head *glist, *glistn;
 	state_status_t status = STATE_SUCCESS;
 	bool removed_one = false;
+	state_lock_entry_t **found;
+	size_t count, i;
 
 	*removed = false;
 
 	glist_init(&split_lock_list);
 	glist_init(&remove_list);
 
-	glist_for_each_safe(glist, glistn, list) {
-		found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
+	if (file != NULL)
+		found = lock_tree_gather(file, lock->lock_start,
+					 lock_end(lock), &count);
+	else
+		found = lock_list_gather(list, &count);
+
+	for (i = 0; i < count; i++) {
+		found_entry = found[i];
 
 		if (owner != NULL
 		    && different_owners(found_entry->sle_owner, owner))
@@ -1113,6 +1379,8 @@ static state_status_t subtract_lock_from_list(state_owner_t *owner,
 		    subtract_lock_from_entry(found_entry, lock,
 					     &split_lock_list, &remove_list,
 					     &removed_one);
+		if (removed_one && file != NULL)
+			lock_tree_remove(file, found_entry);
 		*removed |= removed_one;
 
 		if (status != STATE_SUCCESS) {
@@ -1134,15 +1402,25 @@ static state_status_t subtract_lock_from_list(state_owner_t *owner,
 			    glist_entry(glist, state_lock_entry_t, sle_list);
 			glist_del(&found_entry->sle_list);
 			glist_add_tail(list, &(found_entry->sle_list));
+			if (file != NULL)
+				lock_tree_insert(file, found_entry);
 		}
 	} else {
 		/* free the enttries on the remove_list */
 		free_list(&remove_list);
 
 		/* now add the split lock list */
+		glist_for_each(glist, &split_lock_list) {
+			found_entry =
+			    glist_entry(glist, state_lock_entry_t, sle_list);
+			if (file != NULL)
+				lock_tree_insert(file, found_entry);
+		}
 		glist_add_list_tail(list, &split_lock_list);
 	}
 
+	lock_tree_release(found, count);
+
 	LogFullDebug(COMPONENT_STATE,
 		     "List of all locks for list=%p returning %d", list,
 		     status);
@@ -1173,7 +1451,7 @@ static state_status_t subtract_list_from_list(struct fsal_obj_handle *obj,
 
 		status = subtract_lock_from_list(NULL, false, 0,
 						 &found_entry->sle_lock,
-						 &removed, target);
+						 &removed, target, NULL);
 		if (status != STATE_SUCCESS)
 			break;
 	}
@@ -1315,8 +1593,6 @@ int compare_lock_cookie_key(struct gsh_buffdesc *buff1,
 /**
  * @brief Hash index for lock cookie
  *
- * @todo Replace with a good hash function.
- *
  * @param[in] hparam Hash parameters
  * @param[in] key    Key to hash
  *
@@ -1325,29 +1601,18 @@ int compare_lock_cookie_key(struct gsh_buffdesc *buff1,
 uint32_t lock_cookie_value_hash_func(hash_parameter_t *hparam,
 				     struct gsh_buffdesc *key)
 {
-	unsigned int sum = 0;
-	unsigned int i;
-	unsigned long res;
-	unsigned char *addr = key->addr;
-
-	/* Compute the sum of all the characters */
-	for (i = 0; i < key->len; i++)
-		sum += (unsigned char)addr[i];
-
-	res = (unsigned long)sum + (unsigned long)key->len;
+	uint64_t res = CityHash64WithSeed(key->addr, key->len, 0);
 
 	if (isDebug(COMPONENT_HASHTABLE))
-		LogFullDebug(COMPONENT_STATE, "value = %lu",
+		LogFullDebug(COMPONENT_STATE, "value = %"PRIu64,
 			     res % hparam->index_size);
 
-	return (unsigned long)(res % hparam->index_size);
+	return res % hparam->index_size;
 }
 
 /**
  * @brief RBT hash for lock cookie
  *
- * @todo Replace with a good hash function.
- *
  * @param[in] hparam Hash parameters
  * @param[in] key    Key to hash
  *
@@ -1356,19 +1621,10 @@ uint32_t lock_cookie_value_hash_func(hash_parameter_t *hparam,
 uint64_t lock_cookie_rbt_hash_func(hash_parameter_t *hparam,
 				   struct gsh_buffdesc *key)
 {
-	unsigned int sum = 0;
-	unsigned int i;
-	unsigned long res;
-	unsigned char *addr = key->addr;
-
-	/* Compute the sum of all the characters */
-	for (i = 0; i < key->len; i++)
-		sum += (unsigned char)addr[i];
-
-	res = (unsigned long)sum + (unsigned long)key->len;
+	uint64_t res = CityHash64WithSeed(key->addr, key->len, 0);
 
 	if (isDebug(COMPONENT_HASHTABLE))
-		LogFullDebug(COMPONENT_STATE, "rbt = %lu", res);
+		LogFullDebug(COMPONENT_STATE, "rbt = %"PRIu64, res);
 
 	return res;
 }
@@ -1691,7 +1947,7 @@ void grant_blocked_lock_immediate(struct state_hdl *ostate,
 	}
 
 	/* Mark lock as granted */
-	lock_entry->sle_blocked = STATE_NON_BLOCKING;
+	lock_entry_granted(ostate, lock_entry);
 
 	/* Merge any touching or overlapping locks into this one. */
 	LogEntry("Granted immediate, merging locks for", lock_entry);
@@ -1730,7 +1986,7 @@ void state_complete_grant(state_cookie_entry_t *cookie_entry)
 	/* We need to make sure lock is ready to be granted */
 	if (lock_entry->sle_blocked == STATE_GRANTING) {
 		/* Mark lock as granted */
-		lock_entry->sle_blocked = STATE_NON_BLOCKING;
+		lock_entry_granted(obj->state_hdl, lock_entry);
 
 		/* Merge any touching or overlapping locks into this one. */
 		LogEntry("Granted, merging locks for", lock_entry);
@@ -1764,6 +2020,7 @@ void try_to_grant_lock(state_lock_entry_t *lock_entry)
 	state_status_t status;
 	struct root_op_context root_op_context;
 	struct gsh_export *export = lock_entry->sle_export;
+	struct lock_partition *part;
 	const char *reason;
 
 	/* Try to grant if not cancelled and has block data and we are able
@@ -1814,11 +2071,13 @@ void try_to_grant_lock(state_lock_entry_t *lock_entry)
 		/* At this point, we no longer need the entry on the
 		 * blocked lock list.
 		 */
-		PTHREAD_MUTEX_lock(&blocked_locks_mutex);
+		part = lock_partition_of(lock_entry->sle_obj);
+
+		PTHREAD_MUTEX_lock(&part->blocked_mutex);
 
 		glist_del(&lock_entry->sle_block_data->sbd_list);
 
-		PTHREAD_MUTEX_unlock(&blocked_locks_mutex);
+		PTHREAD_MUTEX_unlock(&part->blocked_mutex);
 
 		if (status == STATE_SUCCESS)
 			return;
@@ -1837,20 +2096,34 @@ void try_to_grant_lock(state_lock_entry_t *lock_entry)
 /**
  * @brief Routine to be called from the FSAL upcall handler
  *
- * @param[in] block_data Data describing blocked lock
+ * Tries to grant blocked locks of one file with its state_lock taken
+ * once for all of them, so that their waiters are woken together.
+ *
+ * @param[in] blocks Data describing the blocked locks, all on one file
+ * @param[in] count  Number of them, at most STATE_GRANT_BATCH
  */
 
-void process_blocked_lock_upcall(state_block_data_t *block_data)
+void process_blocked_lock_upcalls(state_block_data_t **blocks, int count)
 {
-	state_lock_entry_t *lock_entry = block_data->sbd_lock_entry;
+	state_lock_entry_t *lock_entries[STATE_GRANT_BATCH];
+	struct fsal_obj_handle *obj = blocks[0]->sbd_lock_entry->sle_obj;
+	int i;
 
-	lock_entry_inc_ref(lock_entry);
-	PTHREAD_RWLOCK_wrlock(&lock_entry->sle_obj->state_hdl->state_lock);
+	/* Granting a lock may free its block data */
+	for (i = 0; i < count; i++) {
+		lock_entries[i] = blocks[i]->sbd_lock_entry;
+		lock_entry_inc_ref(lock_entries[i]);
+	}
 
-	try_to_grant_lock(lock_entry);
+	PTHREAD_RWLOCK_wrlock(&obj->state_hdl->state_lock);
 
-	PTHREAD_RWLOCK_unlock(&lock_entry->sle_obj->state_hdl->state_lock);
-	lock_entry_dec_ref(lock_entry);
+	for (i = 0; i < count; i++)
+		try_to_grant_lock(lock_entries[i]);
+
+	PTHREAD_RWLOCK_unlock(&obj->state_hdl->state_lock);
+
+	for (i = 0; i < count; i++)
+		lock_entry_dec_ref(lock_entries[i]);
 }
 
 /**
@@ -1874,6 +2147,10 @@ static void grant_blocked_locks(struct state_hdl *ostate)
 	if (export->exp_ops.fs_supports(export, fso_lock_support_async_block))
 		return;
 
+	/* Nothing is blocked */
+	if (ostate->file.lock_unsettled == 0)
+		return;
+
 	glist_for_each_safe(glist, glistn, &ostate->file.lock_list) {
 		found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
 
@@ -2002,12 +2279,19 @@ void cancel_blocked_locks_range(struct state_hdl *ostate,
 				int32_t state,
 				fsal_lock_param_t *lock)
 {
-	struct glist_head *glist, *glistn;
 	state_lock_entry_t *found_entry = NULL;
-	uint64_t found_entry_end, range_end = lock_end(lock);
+	state_lock_entry_t **found;
+	size_t count, i;
 
-	glist_for_each_safe(glist, glistn, &ostate->file.lock_list) {
-		found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
+	/* Only blocked locks are cancelled */
+	if (ostate->file.lock_unsettled == 0)
+		return;
+
+	found = lock_tree_gather(&ostate->file, lock->lock_start,
+				 lock_end(lock), &count);
+
+	for (i = 0; i < count; i++) {
+		found_entry = found[i];
 
 		/* Skip locks not owned by owner */
 		if (owner != NULL
@@ -2028,14 +2312,11 @@ void cancel_blocked_locks_range(struct state_hdl *ostate,
 
 		LogEntry("Checking", found_entry);
 
-		found_entry_end = lock_end(&found_entry->sle_lock);
-
-		if ((found_entry_end >= lock->lock_start)
-		    && (found_entry->sle_lock.lock_start <= range_end)) {
-			/* lock overlaps, cancel it. */
-			cancel_blocked_lock(ostate->file.obj, found_entry);
-		}
+		/* lock overlaps, cancel it. */
+		cancel_blocked_lock(ostate->file.obj, found_entry);
 	}
+
+	lock_tree_release(found, count);
 }
 
 /**
@@ -2501,6 +2782,7 @@ state_status_t state_lock(struct fsal_obj_handle *obj,
 {
 	bool allow = true, overlap = false;
 	struct glist_head *glist;
+	struct itree_node *node;
 	state_lock_entry_t *found_entry;
 	uint64_t found_entry_end;
 	uint64_t range_end = lock_end(lock);
@@ -2510,6 +2792,7 @@ state_status_t state_lock(struct fsal_obj_handle *obj,
 	state_status_t status = 0;
 	fsal_openflags_t openflags;
 	bool async;
+	struct lock_partition *part;
 
 	/* If the FSAL doesn't support multiple file descriptors, we must
 	 * use the legacy fsal_open. Otherwise, the FSAL will manage
@@ -2543,39 +2826,60 @@ state_status_t state_lock(struct fsal_obj_handle *obj,
 		}
 	}
 
+#ifdef USE_LTTNG
+	tracepoint(state, lock_start, obj, owner, lock->lock_type,
+		   lock->lock_start, lock->lock_length, blocking);
+#endif
+
 	PTHREAD_RWLOCK_wrlock(&obj->state_hdl->state_lock);
 
-	if (blocking != STATE_NON_BLOCKING) {
+#ifdef USE_LTTNG
+	tracepoint(state, lock_acquired, obj);
+#endif
+
+	/* Need to reject lock request if this lock owner already has a lock
+	 * on this file via a different export.  Only worth looking for if
+	 * some lock on the file was taken through another export.
+	 */
+	if (!lock_list_one_export(&obj->state_hdl->file, op_ctx->ctx_export)) {
+		glist_for_each(glist, &obj->state_hdl->file.lock_list) {
+			found_entry =
+			    glist_entry(glist, state_lock_entry_t, sle_list);
+
+			if (found_entry->sle_export == op_ctx->ctx_export
+			    || different_owners(found_entry->sle_owner, owner))
+				continue;
+
+			LogEvent(COMPONENT_STATE,
+				 "Lock Owner Export Conflict, Lock held for export %d (%s), request for export %d (%s)",
+				 found_entry->sle_export->export_id,
+				 found_entry->sle_export->fullpath,
+				 op_ctx->ctx_export->export_id,
+				 op_ctx->ctx_export->fullpath);
+
+			LogEntry("Found lock entry belonging to another export",
+				 found_entry);
+
+			status = STATE_INVALID_ARGUMENT;
+			goto out_unlock;
+		}
+	}
+
+	if (blocking != STATE_NON_BLOCKING &&
+	    obj->state_hdl->file.lock_unsettled != 0) {
 		/* First search for a blocked request. Client can ignore the
 		 * blocked request and keep sending us new lock request again
 		 * and again. So if we have a mapping blocked request return
 		 * that
 		 */
-		glist_for_each(glist, &obj->state_hdl->file.lock_list) {
+		itree_for_each_overlap(node, &obj->state_hdl->file.lock_tree,
+				       lock->lock_start, range_end) {
 			found_entry =
-			    glist_entry(glist, state_lock_entry_t, sle_list);
+			    itree_entry(node, state_lock_entry_t, sle_tree);
 
 			if (different_owners(found_entry->sle_owner, owner))
 				continue;
 
-			/* Need to reject lock request if this lock owner
-			 * already has a lock on this file via a different
-			 * export.
-			 */
-			if (found_entry->sle_export != op_ctx->ctx_export) {
-				LogEvent(COMPONENT_STATE,
-					 "Lock Owner Export Conflict, Lock held for export %d (%s), request for export %d (%s)",
-					 found_entry->sle_export->export_id,
-					 found_entry->sle_export->fullpath,
-					 op_ctx->ctx_export->export_id,
-					 op_ctx->ctx_export->fullpath);
-				LogEntry(
-					"Found lock entry belonging to another export",
-					found_entry);
-				status = STATE_INVALID_ARGUMENT;
-				goto out_unlock;
-			}
-
 			if (found_entry->sle_blocked != blocking)
 				continue;
 
@@ -2592,33 +2896,14 @@ state_status_t state_lock(struct fsal_obj_handle *obj,
 		}
 	}
 
-	glist_for_each(glist, &obj->state_hdl->file.lock_list) {
-		found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
-		/* Need to reject lock request if this lock owner already has
-		 * a lock on this file via a different export.
-		 */
-		if (found_entry->sle_export != op_ctx->ctx_export
-		    && !different_owners(found_entry->sle_owner, owner)) {
-			LogEvent(COMPONENT_STATE,
-				 "Lock Owner Export Conflict, Lock held for export %d (%s), request for export %d (%s)",
-				 found_entry->sle_export->export_id,
-				 found_entry->sle_export->fullpath,
-				 op_ctx->ctx_export->export_id,
-				 op_ctx->ctx_export->fullpath);
-
-			LogEntry("Found lock entry belonging to another export",
-				 found_entry);
-
-			status = STATE_INVALID_ARGUMENT;
-			goto out_unlock;
-		}
+	itree_for_each_overlap(node, &obj->state_hdl->file.lock_tree,
+			       lock->lock_start, range_end) {
+		found_entry = itree_entry(node, state_lock_entry_t, sle_tree);
 
 		/* Don't skip blocked locks for fairness */
 		found_entry_end = lock_end(&found_entry->sle_lock);
 
-		if (!(lock->lock_reclaim)
-		    && (found_entry_end >= lock->lock_start)
-		    && (found_entry->sle_lock.lock_start <= range_end)) {
+		if (!(lock->lock_reclaim)) {
 			/* lock overlaps see if we can allow:
 			 * allow if neither lock is exclusive or
 			 * the owner is the same
@@ -2801,8 +3086,7 @@ state_status_t state_lock(struct fsal_obj_handle *obj,
 		/* Insert entry into lock list */
 		LogEntry("New lock", found_entry);
 
-		glist_add_tail(&obj->state_hdl->file.lock_list,
-			       &found_entry->sle_list);
+		lock_list_add(obj->state_hdl, found_entry);
 
 		/* A lock downgrade could unblock blocked locks */
 		grant_blocked_locks(obj->state_hdl);
@@ -2834,14 +3118,15 @@ state_status_t state_lock(struct fsal_obj_handle *obj,
 		/* Insert entry into lock list */
 		LogEntry("FSAL block for", found_entry);
 
-		glist_add_tail(&obj->state_hdl->file.lock_list,
-			       &found_entry->sle_list);
+		lock_list_add(obj->state_hdl, found_entry);
+
+		part = lock_partition_of(obj);
 
-		PTHREAD_MUTEX_lock(&blocked_locks_mutex);
+		PTHREAD_MUTEX_lock(&part->blocked_mutex);
 
-		glist_add_tail(&state_blocked_locks, &block_data->sbd_list);
+		glist_add_tail(&part->blocked, &block_data->sbd_list);
 
-		PTHREAD_MUTEX_unlock(&blocked_locks_mutex);
+		PTHREAD_MUTEX_unlock(&part->blocked_mutex);
 	} else {
 		LogMajor(COMPONENT_STATE, "Unable to lock FSAL, error=%s",
 			 state_err_str(status));
@@ -2853,6 +3138,10 @@ state_status_t state_lock(struct fsal_obj_handle *obj,
  out_unlock:
 	PTHREAD_RWLOCK_unlock(&obj->state_hdl->state_lock);
 
+#ifdef USE_LTTNG
+	tracepoint(state, lock_end, obj, status);
+#endif
+
 	return status;
 }
 
@@ -2910,7 +3199,8 @@ state_status_t state_unlock(struct fsal_obj_handle *obj,
 	/* Release the lock from cache inode lock list for entry */
 	status = subtract_lock_from_list(owner, state_applies, nsm_state, lock,
 					 &removed,
-					 &obj->state_hdl->file.lock_list);
+					 &obj->state_hdl->file.lock_list,
+					 &obj->state_hdl->file);
 
 	/* If the lock list has become zero; decrement the pin ref count pt
 	 * placed. Do this here just in case subtract_lock_from_list has made
@@ -2983,7 +3273,7 @@ state_status_t state_unlock(struct fsal_obj_handle *obj,
 state_status_t state_cancel(struct fsal_obj_handle *obj,
 			    state_owner_t *owner, fsal_lock_param_t *lock)
 {
-	struct glist_head *glist;
+	struct itree_node *node;
 	state_lock_entry_t *found_entry;
 
 	if (obj->type != REGULAR_FILE) {
@@ -3003,8 +3293,9 @@ state_status_t state_cancel(struct fsal_obj_handle *obj,
 		goto out_unlock;
 	}
 
-	glist_for_each(glist, &obj->state_hdl->file.lock_list) {
-		found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
+	itree_for_each_overlap(node, &obj->state_hdl->file.lock_tree,
+			       lock->lock_start, lock_end(lock)) {
+		found_entry = itree_entry(node, state_lock_entry_t, sle_tree);
 
 		if (different_owners(found_entry->sle_owner, owner))
 			continue;
@@ -3542,27 +3833,22 @@ void state_export_unlock_all(void)
 }
 
 /**
- * @brief Poll any blocked locks of type STATE_BLOCK_POLL
+ * @brief Poll the blocked locks of one partition
  *
- * @param[in] ctx Fridge Thread Context
+ * Must hold the blocked_mutex of the list's partition.
  *
+ * @param[in] list List of blocked locks
  */
-
-void blocked_lock_polling(struct fridgethr_context *ctx)
+static void blocked_lock_poll_list(struct glist_head *list)
 {
 	state_lock_entry_t *found_entry;
 	struct glist_head *glist;
 	state_block_data_t *pblock;
 
-	SetNameFunction("lk_poll");
-
-	PTHREAD_MUTEX_lock(&blocked_locks_mutex);
-
 	if (isFullDebug(COMPONENT_STATE) && isFullDebug(COMPONENT_MEMLEAKS))
-		LogBlockedList("Blocked Lock List",
-			       NULL, &state_blocked_locks);
+		LogBlockedList("Blocked Lock List", NULL, list);
 
-	glist_for_each(glist, &state_blocked_locks) {
+	glist_for_each(glist, list) {
 		pblock = glist_entry(glist, state_block_data_t, sbd_list);
 
 		found_entry = pblock->sbd_lock_entry;
@@ -3587,8 +3873,28 @@ void blocked_lock_polling(struct fridgethr_context *ctx)
 
 		LogEntry("Blocked Lock found", found_entry);
 	}			/* glist_for_each_safe */
+}
 
-	PTHREAD_MUTEX_unlock(&blocked_locks_mutex);
+/**
+ * @brief Poll any blocked locks of type STATE_BLOCK_POLL
+ *
+ * @param[in] ctx Fridge Thread Context
+ *
+ */
+
+void blocked_lock_polling(struct fridgethr_context *ctx)
+{
+	struct lock_partition *part;
+	int i;
+
+	SetNameFunction("lk_poll");
+
+	for (i = 0; i < LOCK_PARTITIONS; i++) {
+		part = &lock_partitions[i];
+		PTHREAD_MUTEX_lock(&part->blocked_mutex);
+		blocked_lock_poll_list(&part->blocked);
+		PTHREAD_MUTEX_unlock(&part->blocked_mutex);
+	}
 }
 
 /**
@@ -3606,10 +3912,11 @@ static void find_blocked_lock_upcall(struct fsal_obj_handle *obj, void *owner,
 	state_lock_entry_t *found_entry;
 	struct glist_head *glist;
 	state_block_data_t *pblock;
+	struct lock_partition *part = lock_partition_of(obj);
 
-	PTHREAD_MUTEX_lock(&blocked_locks_mutex);
+	PTHREAD_MUTEX_lock(&part->blocked_mutex);
 
-	glist_for_each(glist, &state_blocked_locks) {
+	glist_for_each(glist, &part->blocked) {
 		pblock = glist_entry(glist, state_block_data_t, sbd_list);
 
 		found_entry = pblock->sbd_lock_entry;
@@ -3643,16 +3950,15 @@ static void find_blocked_lock_upcall(struct fsal_obj_handle *obj, void *owner,
 
 		LogEntry("Blocked Lock found", found_entry);
 
-		PTHREAD_MUTEX_unlock(&blocked_locks_mutex);
+		PTHREAD_MUTEX_unlock(&part->blocked_mutex);
 
 		return;
 	}			/* glist_for_each_safe */
 
 	if (isFullDebug(COMPONENT_STATE) && isFullDebug(COMPONENT_MEMLEAKS))
-		LogBlockedList("Blocked Lock List",
-			       NULL, &state_blocked_locks);
+		LogBlockedList("Blocked Lock List", NULL, &part->blocked);
 
-	PTHREAD_MUTEX_unlock(&blocked_locks_mutex);
+	PTHREAD_MUTEX_unlock(&part->blocked_mutex);
 
 	/* We must be out of sync with FSAL, this is fatal */
 	LogLockDesc(COMPONENT_STATE, NIV_MAJ, "Blocked Lock Not Found for",
@@ -3713,68 +4019,69 @@ void cancel_all_nlm_blocked(void)
 	state_lock_entry_t *found_entry;
 	state_block_data_t *pblock;
 	struct root_op_context root_op_context;
+	struct lock_partition *part;
+	int i;
 
 	/* Initialize context */
 	init_root_op_context(&root_op_context, NULL, NULL, 0, 0, NFS_REQUEST);
 
 	LogDebug(COMPONENT_STATE, "Cancel all blocked locks");
 
-	PTHREAD_MUTEX_lock(&blocked_locks_mutex);
+	for (i = 0; i < LOCK_PARTITIONS; i++) {
+		part = &lock_partitions[i];
 
-	pblock = glist_first_entry(&state_blocked_locks,
-				   state_block_data_t,
-				   sbd_list);
+		PTHREAD_MUTEX_lock(&part->blocked_mutex);
 
-	if (pblock == NULL) {
-		LogFullDebug(COMPONENT_STATE, "No blocked locks");
-		goto out;
-	}
+		pblock = glist_first_entry(&part->blocked,
+					   state_block_data_t,
+					   sbd_list);
 
-	while (pblock != NULL) {
-		found_entry = pblock->sbd_lock_entry;
+		while (pblock != NULL) {
+			found_entry = pblock->sbd_lock_entry;
 
-		/* Remove lock from blocked list */
-		glist_del(&pblock->sbd_list);
+			/* Remove lock from blocked list */
+			glist_del(&pblock->sbd_list);
 
-		lock_entry_inc_ref(found_entry);
+			lock_entry_inc_ref(found_entry);
 
-		PTHREAD_MUTEX_unlock(&blocked_locks_mutex);
+			PTHREAD_MUTEX_unlock(&part->blocked_mutex);
 
-		root_op_context.req_ctx.ctx_export = found_entry->sle_export;
-		root_op_context.req_ctx.fsal_export =
-			root_op_context.req_ctx.ctx_export->fsal_export;
+			root_op_context.req_ctx.ctx_export =
+				found_entry->sle_export;
+			root_op_context.req_ctx.fsal_export =
+				found_entry->sle_export->fsal_export;
 
-		get_gsh_export_ref(root_op_context.req_ctx.ctx_export);
+			get_gsh_export_ref(found_entry->sle_export);
 
-		/** @todo also look at the LRU ref for pentry */
+			/** @todo also look at the LRU ref for pentry */
 
-		LogEntry("Blocked Lock found", found_entry);
+			LogEntry("Blocked Lock found", found_entry);
 
-		cancel_blocked_lock(found_entry->sle_obj, found_entry);
+			cancel_blocked_lock(found_entry->sle_obj, found_entry);
 
-		if (pblock->sbd_blocked_cookie != NULL)
-			gsh_free(pblock->sbd_blocked_cookie);
+			if (pblock->sbd_blocked_cookie != NULL)
+				gsh_free(pblock->sbd_blocked_cookie);
 
-		gsh_free(found_entry->sle_block_data);
-		found_entry->sle_block_data = NULL;
+			gsh_free(found_entry->sle_block_data);
+			found_entry->sle_block_data = NULL;
 
-		LogEntry("Canceled Lock", found_entry);
+			LogEntry("Canceled Lock", found_entry);
 
-		put_gsh_export(root_op_context.req_ctx.ctx_export);
+			put_gsh_export(root_op_context.req_ctx.ctx_export);
 
-		lock_entry_dec_ref(found_entry);
+			lock_entry_dec_ref(found_entry);
 
-		PTHREAD_MUTEX_lock(&blocked_locks_mutex);
+			PTHREAD_MUTEX_lock(&part->blocked_mutex);
 
-		/* Get next item off list */
-		pblock = glist_first_entry(&state_blocked_locks,
-					   state_block_data_t,
-					   sbd_list);
-	}
+			/* Get next item off list */
+			pblock = glist_first_entry(&part->blocked,
+						   state_block_data_t,
+						   sbd_list);
+		}
 
-out:
+		PTHREAD_MUTEX_unlock(&part->blocked_mutex);
+	}
 
-	PTHREAD_MUTEX_unlock(&blocked_locks_mutex);
 	release_root_op_context();
 }
 
@@ -54,7 +54,10 @@ struct glist_head cached_open_owners = GLIST_HEAD_INIT(cached_open_owners);
 
 pthread_mutex_t cached_open_owners_lock = PTHREAD_MUTEX_INITIALIZER;
 
-pool_t *state_owner_pool;	/*< Pool for NFSv4 files's open owner */
+slab_pool_t *state_owner_pool; /*< Slab pool for all state owners */
+
+static uint64_t owner_heap_names;	/*< Owner names not held inline */
+static uint64_t owner_heap_name_bytes;
 
 #ifdef DEBUG_SAL
 struct glist_head state_owners_all = GLIST_HEAD_INIT(state_owners_all);
@@ -837,8 +840,12 @@ void free_state_owner(state_owner_t *owner)
 		return;
 	}
 
-	if (owner->so_owner_val != NULL)
+	if (owner->so_owner_len > STATE_OWNER_INLINE_NAME) {
 		gsh_free(owner->so_owner_val);
+		(void) atomic_dec_uint64_t(&owner_heap_names);
+		(void) atomic_sub_uint64_t(&owner_heap_name_bytes,
+					   owner->so_owner_len);
+	}
 
 	PTHREAD_MUTEX_destroy(&owner->so_mutex);
 
@@ -850,7 +857,19 @@ void free_state_owner(state_owner_t *owner)
 	PTHREAD_MUTEX_unlock(&all_state_owners_mutex);
 #endif
 
-	pool_free(state_owner_pool, owner);
+	slab_free(state_owner_pool, owner);
+}
+
+/**
+ * @brief Report the memory held by state owners
+ *
+ * @param[out] stats Owner slab pool and out of line name usage
+ */
+void state_owner_mem_stats(struct state_owner_mem_stats *stats)
+{
+	slab_pool_stats(state_owner_pool, &stats->slab);
+	stats->heap_names = atomic_fetch_uint64_t(&owner_heap_names);
+	stats->heap_name_bytes = atomic_fetch_uint64_t(&owner_heap_name_bytes);
 }
 
 /**
@@ -1199,7 +1218,7 @@ state_owner_t *get_state_owner(care_t care, state_owner_t *key,
 		return NULL;
 	}
 
-	owner = pool_alloc(state_owner_pool);
+	owner = slab_alloc(state_owner_pool);
 
 	/* Copy everything over */
 	memcpy(owner, key, sizeof(*key));
@@ -1219,13 +1238,19 @@ state_owner_t *get_state_owner(care_t care, state_owner_t *key,
 		init_owner(owner);
 
 
-	if (key->so_owner_len != 0) {
+	if (key->so_owner_len > STATE_OWNER_INLINE_NAME) {
 		owner->so_owner_val = gsh_malloc(key->so_owner_len);
+		(void) atomic_inc_uint64_t(&owner_heap_names);
+		(void) atomic_add_uint64_t(&owner_heap_name_bytes,
+					   key->so_owner_len);
+	} else if (key->so_owner_len != 0) {
+		owner->so_owner_val = (char *)(owner + 1);
+	}
 
+	if (key->so_owner_len != 0)
 		memcpy(owner->so_owner_val,
 		       key->so_owner_val,
 		       key->so_owner_len);
-	}
 
 	glist_init(&owner->so_lock_list);
 
@@ -70,6 +70,41 @@ else (NOT CEPH_FS)
   else(CEPH_FS_SETLK)
     set(USE_FSAL_CEPH_SETLK ON)
   endif(NOT CEPH_FS_SETLK)
+  check_library_exists(cephfs ceph_ll_lseek ${CEPHFS_LIBRARY_DIR} CEPH_FS_LL_LSEEK)
+  if(NOT CEPH_FS_LL_LSEEK)
+    message("Cannot find ceph_ll_lseek.  Disabling CEPH fsal hole detection")
+    set(USE_FSAL_CEPH_LL_LSEEK OFF)
+  else(CEPH_FS_LL_LSEEK)
+    set(USE_FSAL_CEPH_LL_LSEEK ON)
+  endif(NOT CEPH_FS_LL_LSEEK)
+  check_library_exists(cephfs ceph_ll_fallocate ${CEPHFS_LIBRARY_DIR} CEPH_FS_LL_FALLOCATE)
+  if(NOT CEPH_FS_LL_FALLOCATE)
+    message("Cannot find ceph_ll_fallocate.  Disabling CEPH fsal fallocate method")
+    set(USE_FSAL_CEPH_LL_FALLOCATE OFF)
+  else(CEPH_FS_LL_FALLOCATE)
+    set(USE_FSAL_CEPH_LL_FALLOCATE ON)
+  endif(NOT CEPH_FS_LL_FALLOCATE)
+  check_library_exists(cephfs ceph_ll_writev ${CEPHFS_LIBRARY_DIR} CEPH_FS_LL_WRITEV)
+  if(NOT CEPH_FS_LL_WRITEV)
+    message("Cannot find ceph_ll_writev.  Disabling CEPH fsal vectored I/O")
+    set(USE_FSAL_CEPH_LL_IOV OFF)
+  else(CEPH_FS_LL_WRITEV)
+    set(USE_FSAL_CEPH_LL_IOV ON)
+  endif(NOT CEPH_FS_LL_WRITEV)
+  check_library_exists(cephfs ceph_ll_nonblocking_readv_writev ${CEPHFS_LIBRARY_DIR} CEPH_FS_LL_NONBLOCKING_RW)
+  if(NOT CEPH_FS_LL_NONBLOCKING_RW)
+    message("Cannot find ceph_ll_nonblocking_readv_writev.  Disabling CEPH fsal asynchronous I/O")
+    set(USE_FSAL_CEPH_LL_NONBLOCKING_RW OFF)
+  else(CEPH_FS_LL_NONBLOCKING_RW)
+    set(USE_FSAL_CEPH_LL_NONBLOCKING_RW ON)
+  endif(NOT CEPH_FS_LL_NONBLOCKING_RW)
+  check_library_exists(cephfs ceph_ll_register_callbacks ${CEPHFS_LIBRARY_DIR} CEPH_FS_LL_REGISTER_CALLBACKS)
+  if(NOT CEPH_FS_LL_REGISTER_CALLBACKS)
+    message("Cannot find ceph_ll_register_callbacks.  Disabling CEPH fsal cache invalidation upcalls")
+    set(USE_FSAL_CEPH_LL_REGISTER_CALLBACKS OFF)
+  else(CEPH_FS_LL_REGISTER_CALLBACKS)
+    set(USE_FSAL_CEPH_LL_REGISTER_CALLBACKS ON)
+  endif(NOT CEPH_FS_LL_REGISTER_CALLBACKS)
   check_library_exists(cephfs ceph_ll_lookup_root ${CEPHFS_LIBRARY_DIR} CEPH_FS_LOOKUP_ROOT)
   if(NOT CEPH_FS_LOOKUP_ROOT)
     message("Cannot find ceph_ll_lookup_root. Working around it...")
@@ -93,4 +128,9 @@ mark_as_advanced(CEPHFS_INCLUDE_DIR)
 mark_as_advanced(CEPHFS_LIBRARY_DIR)
 mark_as_advanced(USE_FSAL_CEPH_MKNOD)
 mark_as_advanced(USE_FSAL_CEPH_SETLK)
+mark_as_advanced(USE_FSAL_CEPH_LL_LSEEK)
+mark_as_advanced(USE_FSAL_CEPH_LL_FALLOCATE)
+mark_as_advanced(USE_FSAL_CEPH_LL_IOV)
+mark_as_advanced(USE_FSAL_CEPH_LL_NONBLOCKING_RW)
+mark_as_advanced(USE_FSAL_CEPH_LL_REGISTER_CALLBACKS)
 
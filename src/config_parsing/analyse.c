@@ -33,6 +33,7 @@
 #if HAVE_STRING_H
 #include <string.h>
 #endif
+#include <sys/mman.h>
 #include "abstract_mem.h"
 
 /**
@@ -243,10 +244,12 @@ void free_parse_tree(struct config_root *tree)
 	struct config_node *node;
 	struct glist_head *nsi, *nsn;
 
-	glist_for_each_safe(nsi, nsn, &tree->root.u.nterm.sub_nodes) {
-		node = glist_entry(nsi, struct config_node, node);
-		glist_del(&node->node);
-		free_node(node);
+	if (tree->cache_map == NULL) {
+		glist_for_each_safe(nsi, nsn, &tree->root.u.nterm.sub_nodes) {
+			node = glist_entry(nsi, struct config_node, node);
+			glist_del(&node->node);
+			free_node(node);
+		}
 	}
 	gsh_free(tree->root.filename);
 	if(tree->conf_dir != NULL)
@@ -254,10 +257,15 @@ void free_parse_tree(struct config_root *tree)
 	file = tree->files;
 	while (file != NULL) {
 		next_file = file->next;
-		gsh_free(file->pathname);
+		if (tree->cache_map == NULL)
+			gsh_free(file->pathname);
 		gsh_free(file);
 		file = next_file;
 	}
+	if (tree->cache_map != NULL) {
+		gsh_free(tree->cache_nodes);
+		(void) munmap(tree->cache_map, tree->cache_len);
+	}
 	token = tree->tokens;
 	while (token != NULL) {
 		next_token = token->next;
@@ -103,6 +103,12 @@ struct config_root {
 	char *conf_dir;
 	struct file_list *files;
 	struct token_tab *tokens;
+	/* A tree loaded from its cache has no tokens: its nodes are one
+	 * array and its strings, file names included, are in the map.
+	 */
+	void *cache_map;
+	size_t cache_len;
+	struct config_node *cache_nodes;
 };
 
 /*
@@ -141,4 +147,11 @@ void print_parse_tree(FILE * output, struct config_root *tree);
  */
 void free_parse_tree(struct config_root *tree);
 
+/**
+ * Binary cache of a parse tree, see config_cache.c
+ */
+struct config_root *config_cache_load(const char *cache_path,
+				      const char *srcfile);
+void config_cache_save(const char *cache_path, struct config_root *tree);
+
 #endif				/* CONFPARSER_H */
@@ -0,0 +1,563 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file config_cache.c
+ * @brief Binary cache of a parse tree
+ *
+ * A parse tree that parsed without errors is written out, nodes in
+ * preorder followed by one table of their strings, along with the
+ * size, modification time and a hash of the contents of every file
+ * read for it.  If those still match, a later parse of the same file
+ * maps the cache and links the nodes over it, without lexing or
+ * saving a single token.  The strings stay in the mapping, which is
+ * private, so writes to the tree are not seen by the cache file.
+ *
+ * The cache is in host byte order and is only ever a copy: when it
+ * cannot be used for any reason, the files are parsed.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "config_parsing.h"
+#include "analyse.h"
+#include "abstract_mem.h"
+#include "log.h"
+
+#define CONFIG_CACHE_MAGIC "GSHCONF1"
+#define CONFIG_CACHE_VERSION 1
+
+#define CONFIG_CACHE_BASIS 0xcbf29ce484222325ULL
+#define CONFIG_CACHE_PRIME 0x100000001b3ULL
+
+struct config_cache_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t nfiles;
+	uint32_t nnodes;	/*< Not counting the root */
+	uint32_t strtab_len;
+	uint32_t src_off;	/*< File the tree was parsed from */
+	uint32_t conf_dir_off;
+	uint64_t hash;		/*< Of everything after the header */
+};
+
+struct config_cache_file {
+	int64_t mtime_sec;
+	int64_t mtime_nsec;
+	uint64_t size;
+	uint64_t hash;		/*< Of the contents */
+	uint32_t path_off;
+	uint32_t pad;
+};
+
+struct config_cache_node {
+	uint32_t type;
+	uint32_t term_type;
+	int32_t linenumber;
+	uint32_t file_off;
+	uint32_t str_off;	/*< Name, or value of a term */
+	uint32_t op_off;	/*< Operator of a term */
+	uint32_t nsub;		/*< Sub nodes, which follow */
+	uint32_t pad;
+};
+
+static uint64_t cache_hash(uint64_t hash, const void *buf, size_t len)
+{
+	const unsigned char *c = buf, *end = c + len;
+
+	for (; c < end; c++)
+		hash = (hash ^ *c) * CONFIG_CACHE_PRIME;
+
+	return hash;
+}
+
+/** Hash the contents of a file, and return its size and time */
+static int cache_file_hash(const char *path, struct config_cache_file *cf)
+{
+	struct stat st;
+	void *map;
+	int fd, rc = 0;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return errno;
+
+	if (fstat(fd, &st) != 0) {
+		rc = errno;
+		goto out;
+	}
+
+	cf->mtime_sec = st.st_mtim.tv_sec;
+	cf->mtime_nsec = st.st_mtim.tv_nsec;
+	cf->size = st.st_size;
+	cf->hash = CONFIG_CACHE_BASIS;
+
+	if (st.st_size != 0) {
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map == MAP_FAILED) {
+			rc = errno;
+			goto out;
+		}
+		cf->hash = cache_hash(cf->hash, map, st.st_size);
+		(void) munmap(map, st.st_size);
+	}
+
+ out:
+	close(fd);
+	return rc;
+}
+
+/*
+ * Writing
+ */
+
+struct cache_writer {
+	struct config_cache_node *nodes;
+	uint32_t nnodes, nodes_size;
+	char *strtab;
+	uint32_t strtab_len, strtab_size;
+	const char **str_keys;		/*< Strings saved, by address */
+	uint32_t *str_offs;
+	uint32_t str_count, str_size;	/*< str_size is a power of 2 */
+};
+
+static void cache_str_grow(struct cache_writer *w);
+
+/**
+ * @brief Offset of a string in the table, adding it once
+ *
+ * Tokens are shared between the nodes of a tree, so strings are
+ * matched by address and each is written once.
+ */
+static uint32_t cache_str(struct cache_writer *w, const char *str)
+{
+	uint32_t slot, len;
+
+	if (str == NULL)
+		return 0;
+
+	if (w->str_count * 2 >= w->str_size)
+		cache_str_grow(w);
+
+	slot = (((uintptr_t) str) >> 3) & (w->str_size - 1);
+	while (w->str_keys[slot] != NULL) {
+		if (w->str_keys[slot] == str)
+			return w->str_offs[slot];
+		slot = (slot + 1) & (w->str_size - 1);
+	}
+
+	len = strlen(str) + 1;
+	while (w->strtab_len + len > w->strtab_size) {
+		w->strtab_size *= 2;
+		w->strtab = gsh_realloc(w->strtab, w->strtab_size);
+	}
+	memcpy(w->strtab + w->strtab_len, str, len);
+
+	w->str_keys[slot] = str;
+	w->str_offs[slot] = w->strtab_len;
+	w->str_count++;
+	w->strtab_len += len;
+
+	return w->str_offs[slot];
+}
+
+static void cache_str_grow(struct cache_writer *w)
+{
+	const char **keys = w->str_keys;
+	uint32_t *offs = w->str_offs;
+	uint32_t size = w->str_size, i, slot;
+
+	w->str_size = size == 0 ? 1024 : size * 2;
+	w->str_keys = gsh_calloc(w->str_size, sizeof(*w->str_keys));
+	w->str_offs = gsh_calloc(w->str_size, sizeof(*w->str_offs));
+
+	for (i = 0; i < size; i++) {
+		if (keys[i] == NULL)
+			continue;
+		slot = (((uintptr_t) keys[i]) >> 3) & (w->str_size - 1);
+		while (w->str_keys[slot] != NULL)
+			slot = (slot + 1) & (w->str_size - 1);
+		w->str_keys[slot] = keys[i];
+		w->str_offs[slot] = offs[i];
+	}
+
+	gsh_free(keys);
+	gsh_free(offs);
+}
+
+static void cache_node(struct cache_writer *w, struct config_node *node)
+{
+	struct config_cache_node *cn;
+	struct glist_head *ns;
+	uint32_t index;
+
+	if (w->nnodes == w->nodes_size) {
+		w->nodes_size *= 2;
+		w->nodes = gsh_realloc(w->nodes,
+				       w->nodes_size * sizeof(*w->nodes));
+	}
+
+	index = w->nnodes++;
+	cn = &w->nodes[index];
+	memset(cn, 0, sizeof(*cn));
+	cn->type = node->type;
+	cn->linenumber = node->linenumber;
+	cn->file_off = cache_str(w, node->filename);
+
+	if (node->type == TYPE_TERM) {
+		w->nodes[index].term_type = node->u.term.type;
+		w->nodes[index].str_off = cache_str(w, node->u.term.varvalue);
+		w->nodes[index].op_off = cache_str(w, node->u.term.op_code);
+		return;
+	}
+
+	w->nodes[index].str_off = cache_str(w, node->u.nterm.name);
+
+	glist_for_each(ns, &node->u.nterm.sub_nodes) {
+		/* w->nodes may move as it grows */
+		w->nodes[index].nsub++;
+		cache_node(w, glist_entry(ns, struct config_node, node));
+	}
+}
+
+/**
+ * @brief Write the cache of a parse tree
+ *
+ * The cache is written aside and renamed into place, so a reader sees
+ * either the old one or the new one.  Failure is only logged.
+ *
+ * @param[in] cache_path Cache file
+ * @param[in] tree       Tree parsed without errors
+ */
+void config_cache_save(const char *cache_path, struct config_root *tree)
+{
+	struct cache_writer w;
+	struct config_cache_header hdr;
+	struct config_cache_file *files = NULL;
+	struct file_list *file;
+	struct glist_head *ns;
+	char *tmp_path = NULL;
+	uint32_t nfiles = 0, i;
+	FILE *fp = NULL;
+	int rc;
+
+	memset(&w, 0, sizeof(w));
+	w.nodes_size = 1024;
+	w.nodes = gsh_malloc(w.nodes_size * sizeof(*w.nodes));
+	w.strtab_size = 64 * 1024;
+	w.strtab = gsh_malloc(w.strtab_size);
+	w.strtab[0] = '\0';	/* Offset 0 is NULL */
+	w.strtab_len = 1;
+
+	for (file = tree->files; file != NULL; file = file->next)
+		nfiles++;
+
+	files = gsh_calloc(nfiles, sizeof(*files));
+	for (file = tree->files, i = 0; file != NULL; file = file->next, i++) {
+		rc = cache_file_hash(file->pathname, &files[i]);
+		if (rc != 0) {
+			LogWarn(COMPONENT_CONFIG,
+				"Not caching config, cannot read %s: %s",
+				file->pathname, strerror(rc));
+			goto out;
+		}
+		files[i].path_off = cache_str(&w, file->pathname);
+	}
+
+	glist_for_each(ns, &tree->root.u.nterm.sub_nodes)
+		cache_node(&w, glist_entry(ns, struct config_node, node));
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, CONFIG_CACHE_MAGIC, sizeof(hdr.magic));
+	hdr.version = CONFIG_CACHE_VERSION;
+	hdr.nfiles = nfiles;
+	hdr.nnodes = w.nnodes;
+	hdr.src_off = cache_str(&w, tree->root.filename);
+	hdr.conf_dir_off = cache_str(&w, tree->conf_dir);
+	hdr.strtab_len = w.strtab_len;
+
+	hdr.hash = cache_hash(CONFIG_CACHE_BASIS, files,
+			      nfiles * sizeof(*files));
+	hdr.hash = cache_hash(hdr.hash, w.nodes,
+			      w.nnodes * sizeof(*w.nodes));
+	hdr.hash = cache_hash(hdr.hash, w.strtab, w.strtab_len);
+
+	tmp_path = gsh_malloc(strlen(cache_path) + 16);
+	sprintf(tmp_path, "%s.%d", cache_path, (int) getpid());
+
+	fp = fopen(tmp_path, "w");
+	if (fp == NULL) {
+		LogWarn(COMPONENT_CONFIG,
+			"Not caching config, cannot create %s: %s",
+			tmp_path, strerror(errno));
+		goto out;
+	}
+
+	if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1 ||
+	    (nfiles != 0 &&
+	     fwrite(files, sizeof(*files), nfiles, fp) != nfiles) ||
+	    (w.nnodes != 0 &&
+	     fwrite(w.nodes, sizeof(*w.nodes), w.nnodes, fp) != w.nnodes) ||
+	    fwrite(w.strtab, w.strtab_len, 1, fp) != 1 ||
+	    fclose(fp) != 0) {
+		rc = errno;
+		if (fp != NULL)
+			(void) fclose(fp);
+		fp = NULL;
+		LogWarn(COMPONENT_CONFIG,
+			"Not caching config, cannot write %s: %s",
+			tmp_path, strerror(rc));
+		(void) unlink(tmp_path);
+		goto out;
+	}
+	fp = NULL;
+
+	if (rename(tmp_path, cache_path) != 0) {
+		LogWarn(COMPONENT_CONFIG,
+			"Not caching config, cannot rename %s: %s",
+			tmp_path, strerror(errno));
+		(void) unlink(tmp_path);
+		goto out;
+	}
+
+	LogInfo(COMPONENT_CONFIG,
+		"Cached config of %" PRIu32 " files and %" PRIu32
+		" nodes in %s", nfiles, w.nnodes, cache_path);
+
+ out:
+	gsh_free(tmp_path);
+	gsh_free(files);
+	gsh_free(w.nodes);
+	gsh_free(w.strtab);
+	gsh_free(w.str_keys);
+	gsh_free(w.str_offs);
+}
+
+/*
+ * Loading
+ */
+
+struct cache_reader {
+	const struct config_cache_node *cnodes;
+	struct config_node *nodes;
+	uint32_t nnodes, next;
+	char *strtab;
+	uint32_t strtab_len;
+};
+
+static bool cache_str_ok(struct cache_reader *r, uint32_t off)
+{
+	return off < r->strtab_len;
+}
+
+static char *cache_str_at(struct cache_reader *r, uint32_t off)
+{
+	return off == 0 ? NULL : r->strtab + off;
+}
+
+/** Link the next node, and its sub nodes, under parent */
+static bool cache_link(struct cache_reader *r, struct config_node *parent)
+{
+	const struct config_cache_node *cn;
+	struct config_node *node;
+	uint32_t i;
+
+	if (r->next >= r->nnodes)
+		return false;
+
+	cn = &r->cnodes[r->next];
+	node = &r->nodes[r->next++];
+
+	if (!cache_str_ok(r, cn->file_off) || !cache_str_ok(r, cn->str_off) ||
+	    !cache_str_ok(r, cn->op_off))
+		return false;
+
+	node->type = cn->type;
+	node->linenumber = cn->linenumber;
+	node->filename = cache_str_at(r, cn->file_off);
+	glist_add_tail(&parent->u.nterm.sub_nodes, &node->node);
+
+	switch (cn->type) {
+	case TYPE_TERM:
+		if (cn->nsub != 0 || cn->term_type > TERM_NETGROUP)
+			return false;
+		node->u.term.type = cn->term_type;
+		node->u.term.varvalue = cache_str_at(r, cn->str_off);
+		node->u.term.op_code = cache_str_at(r, cn->op_off);
+		return true;
+
+	case TYPE_BLOCK:
+	case TYPE_STMT:
+		node->u.nterm.name = cache_str_at(r, cn->str_off);
+		node->u.nterm.parent = parent;
+		glist_init(&node->u.nterm.sub_nodes);
+		for (i = 0; i < cn->nsub; i++) {
+			if (!cache_link(r, node))
+				return false;
+		}
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+/**
+ * @brief Load a parse tree from its cache
+ *
+ * @param[in] cache_path Cache file
+ * @param[in] srcfile    File to be parsed
+ *
+ * @return The tree, or NULL if there is no cache for srcfile or any
+ *         file read for it changed.
+ */
+struct config_root *config_cache_load(const char *cache_path,
+				      const char *srcfile)
+{
+	const struct config_cache_header *hdr;
+	const struct config_cache_file *files;
+	struct config_cache_file cur;
+	struct config_root *tree = NULL;
+	struct file_list *flist;
+	struct cache_reader r;
+	struct stat st;
+	void *map = MAP_FAILED;
+	size_t len, body;
+	const char *why = "bad format";
+	uint32_t i;
+	int fd;
+
+	fd = open(cache_path, O_RDONLY);
+	if (fd < 0) {
+		if (errno != ENOENT)
+			LogWarn(COMPONENT_CONFIG,
+				"Cannot open config cache %s: %s",
+				cache_path, strerror(errno));
+		return NULL;
+	}
+
+	if (fstat(fd, &st) != 0 || st.st_size < sizeof(*hdr)) {
+		close(fd);
+		goto stale;
+	}
+
+	len = st.st_size;
+	map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		goto stale;
+
+	hdr = map;
+	if (memcmp(hdr->magic, CONFIG_CACHE_MAGIC, sizeof(hdr->magic)) != 0 ||
+	    hdr->version != CONFIG_CACHE_VERSION)
+		goto stale;
+
+	body = (size_t) hdr->nfiles * sizeof(*files) +
+	       (size_t) hdr->nnodes * sizeof(struct config_cache_node) +
+	       hdr->strtab_len;
+	if (len != sizeof(*hdr) + body || hdr->strtab_len == 0)
+		goto stale;
+
+	if (cache_hash(CONFIG_CACHE_BASIS, (const char *)map + sizeof(*hdr),
+		       body) != hdr->hash)
+		goto stale;
+
+	memset(&r, 0, sizeof(r));
+	files = (const void *)((const char *)map + sizeof(*hdr));
+	r.cnodes = (const void *)(files + hdr->nfiles);
+	r.nnodes = hdr->nnodes;
+	r.strtab = (char *)(r.cnodes + hdr->nnodes);
+	r.strtab_len = hdr->strtab_len;
+
+	if (r.strtab[r.strtab_len - 1] != '\0' ||
+	    !cache_str_ok(&r, hdr->src_off) || hdr->src_off == 0 ||
+	    !cache_str_ok(&r, hdr->conf_dir_off))
+		goto stale;
+
+	why = "for another file";
+	if (strcmp(cache_str_at(&r, hdr->src_off), srcfile) != 0)
+		goto stale;
+
+	why = "out of date";
+	for (i = 0; i < hdr->nfiles; i++) {
+		if (!cache_str_ok(&r, files[i].path_off) ||
+		    files[i].path_off == 0 ||
+		    cache_file_hash(cache_str_at(&r, files[i].path_off),
+				    &cur) != 0 ||
+		    cur.size != files[i].size ||
+		    cur.mtime_sec != files[i].mtime_sec ||
+		    cur.mtime_nsec != files[i].mtime_nsec ||
+		    cur.hash != files[i].hash)
+			goto stale;
+	}
+
+	why = "bad format";
+	tree = gsh_calloc(1, sizeof(struct config_root));
+	glist_init(&tree->root.node);
+	glist_init(&tree->root.u.nterm.sub_nodes);
+	tree->root.type = TYPE_ROOT;
+	tree->root.filename = gsh_strdup(srcfile);
+	if (hdr->conf_dir_off != 0)
+		tree->conf_dir = gsh_strdup(cache_str_at(&r,
+							 hdr->conf_dir_off));
+	tree->cache_map = map;
+	tree->cache_len = len;
+
+	/* Built in the reverse order of the parser's list, as it does */
+	for (i = hdr->nfiles; i > 0; i--) {
+		flist = gsh_calloc(1, sizeof(struct file_list));
+		flist->pathname = cache_str_at(&r, files[i - 1].path_off);
+		flist->next = tree->files;
+		tree->files = flist;
+	}
+
+	r.nodes = gsh_calloc(r.nnodes ? r.nnodes : 1, sizeof(*r.nodes));
+	tree->cache_nodes = r.nodes;
+
+	while (r.next < r.nnodes) {
+		if (!cache_link(&r, &tree->root))
+			goto stale;
+	}
+
+	LogInfo(COMPONENT_CONFIG,
+		"Loaded config of %" PRIu32 " files and %" PRIu32
+		" nodes from %s", hdr->nfiles, r.nnodes, cache_path);
+
+	return tree;
+
+ stale:
+	LogInfo(COMPONENT_CONFIG, "Not using config cache %s, %s",
+		cache_path, why);
+
+	if (tree != NULL)
+		free_parse_tree(tree);
+	else if (map != MAP_FAILED)
+		(void) munmap(map, len);
+
+	return NULL;
+}
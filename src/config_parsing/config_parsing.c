@@ -38,6 +38,26 @@
 #include "log.h"
 #include "fsal_convert.h"
 
+/* Binary cache of parsed trees, NULL for none */
+static char *config_cache_path;
+
+/**
+ * @brief Cache parse trees in a file
+ *
+ * A file that parses without errors is written to the cache, and
+ * later parses of it are loaded from there while none of the files
+ * read for it changed.
+ *
+ * @param[in] cache_path The cache, NULL to stop caching
+ */
+
+void config_set_cache(const char *cache_path)
+{
+	gsh_free(config_cache_path);
+	config_cache_path = cache_path != NULL ? gsh_strdup(cache_path)
+					       : NULL;
+}
+
 /* config_ParseFile:
  * Reads the content of a configuration file and
  * stores it in a memory structure.
@@ -50,6 +70,12 @@ config_file_t config_ParseFile(char *file_path,
 	struct config_root *root;
 	int rc;
 
+	if (config_cache_path != NULL) {
+		root = config_cache_load(config_cache_path, file_path);
+		if (root != NULL)
+			return (config_file_t)root;
+	}
+
 	memset(&st, 0, sizeof(struct parser_state));
 	st.err_type = err_type;
 	rc = ganeshun_yy_init_parser(file_path, &st);
@@ -67,6 +93,9 @@ config_file_t config_ParseFile(char *file_path,
 	print_parse_tree(stderr, root);
 #endif
 	ganeshun_yy_cleanup_parser(&st);
+	if (config_cache_path != NULL && rc == 0 && root != NULL &&
+	    config_error_no_error(err_type))
+		config_cache_save(config_cache_path, root);
 	return (config_file_t)root;
 }
 
@@ -1785,6 +1814,171 @@ out:
 	return rc;
 }
 
+/**
+ * @brief Find every top level block of a name
+ *
+ * Unlike find_config_nodes, this needs no parameter to match.
+ *
+ * @param config    [IN] root of parse tree
+ * @param name      [IN] name of the blocks
+ * @param node_list [OUT] pointer to store node list, to be freed
+ *                        with gsh_free
+ *
+ * @return 0 on success, ENOENT if there is no such block
+ */
+
+int find_config_blocks(config_file_t config, const char *name,
+		       struct config_node_list **node_list)
+{
+	struct config_root *tree = (struct config_root *)config;
+	struct config_node_list *list, *list_tail = NULL;
+	struct config_node *sub_node;
+	struct glist_head *ns;
+
+	*node_list = NULL;
+
+	glist_for_each(ns, &tree->root.u.nterm.sub_nodes) {
+		sub_node = glist_entry(ns, struct config_node, node);
+		if (sub_node->type != TYPE_BLOCK ||
+		    strcasecmp(name, sub_node->u.nterm.name) != 0)
+			continue;
+
+		list = gsh_calloc(1, sizeof(struct config_node_list));
+		list->tree_node = sub_node;
+		if (*node_list == NULL)
+			*node_list = list;
+		else
+			list_tail->next = list;
+		list_tail = list;
+	}
+
+	return *node_list != NULL ? 0 : ENOENT;
+}
+
+/**
+ * @brief The value of a parameter of a block
+ *
+ * @param tree_node [IN] A TYPE_BLOCK node in the parse tree
+ * @param name      [IN] Parameter name
+ *
+ * @return The first value given the parameter, NULL if it has none.
+ */
+
+const char *config_block_value(void *tree_node, const char *name)
+{
+	struct config_node *node = tree_node;
+	struct config_node *sub_node, *term;
+	struct glist_head *ns;
+
+	glist_for_each(ns, &node->u.nterm.sub_nodes) {
+		sub_node = glist_entry(ns, struct config_node, node);
+		if (sub_node->type != TYPE_STMT ||
+		    strcasecmp(name, sub_node->u.nterm.name) != 0)
+			continue;
+
+		term = glist_first_entry(&sub_node->u.nterm.sub_nodes,
+					 struct config_node, node);
+		if (term == NULL || term->type != TYPE_TERM)
+			return NULL;
+
+		return term->u.term.varvalue;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief The first sub-block of a block with a name
+ *
+ * @param tree_node [IN] A TYPE_BLOCK node in the parse tree
+ * @param name      [IN] Sub-block name
+ *
+ * @return The sub-block, NULL if the block has none of that name.
+ */
+
+void *config_sub_block(void *tree_node, const char *name)
+{
+	struct config_node *node = tree_node;
+	struct config_node *sub_node;
+	struct glist_head *ns;
+
+	glist_for_each(ns, &node->u.nterm.sub_nodes) {
+		sub_node = glist_entry(ns, struct config_node, node);
+		if (sub_node->type == TYPE_BLOCK &&
+		    strcasecmp(name, sub_node->u.nterm.name) == 0)
+			return sub_node;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief The file a parse tree was read from
+ *
+ * @param config [IN] root of parse tree
+ *
+ * @return The path given config_ParseFile.
+ */
+
+const char *config_root_file(config_file_t config)
+{
+	struct config_root *root = (struct config_root *)config;
+
+	return root->root.filename;
+}
+
+#define CONFIG_HASH_PRIME 0x100000001b3ULL
+
+static uint64_t config_hash_str(uint64_t hash, const char *str, bool fold)
+{
+	const unsigned char *c;
+
+	if (str == NULL)
+		return hash * CONFIG_HASH_PRIME;
+
+	for (c = (const unsigned char *)str; *c != '\0'; c++)
+		hash = (hash ^ (fold ? tolower(*c) : *c)) * CONFIG_HASH_PRIME;
+
+	/* Terminate, so "ab" "c" is not "a" "bc" */
+	return hash * CONFIG_HASH_PRIME;
+}
+
+/**
+ * @brief Fingerprint a block of the parse tree
+ *
+ * Two blocks that would load the same, whatever file or line they
+ * came from, hash the same.  Names are compared without case, as
+ * the loader does, values as written.
+ *
+ * @param tree_node [IN] A node in the parse tree
+ * @param seed      [IN] Hash to start from
+ *
+ * @return The hash.
+ */
+
+uint64_t config_node_hash(void *tree_node, uint64_t seed)
+{
+	struct config_node *node = tree_node;
+	struct glist_head *ns;
+	uint64_t hash = (seed ^ node->type) * CONFIG_HASH_PRIME;
+
+	if (node->type == TYPE_TERM) {
+		hash = (hash ^ node->u.term.type) * CONFIG_HASH_PRIME;
+		hash = config_hash_str(hash, node->u.term.op_code, false);
+		return config_hash_str(hash, node->u.term.varvalue, false);
+	}
+
+	hash = config_hash_str(hash, node->u.nterm.name, true);
+
+	glist_for_each(ns, &node->u.nterm.sub_nodes)
+		hash = config_node_hash(glist_entry(ns, struct config_node,
+						    node),
+					hash);
+
+	/* Close the block, so nesting changes the hash */
+	return (hash ^ 0xff) * CONFIG_HASH_PRIME;
+}
+
 /**
  * @brief Fill configuration structure from a parse tree node
  *
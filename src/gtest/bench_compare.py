@@ -0,0 +1,148 @@
+#!/usr/bin/env python3
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public
+# License as published by the Free Software Foundation; either
+# version 3 of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public
+# License along with this library; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+# 02110-1301 USA
+#
+"""Compare benchmark results with a baseline.
+
+Reads the --json files the benchmarks write (see bench_json.h), and
+prints each result beside its baseline figure.  A result worse than
+its baseline by more than the threshold is a regression, and the exit
+status is 1 if there is any.
+
+  bench_compare.py [--baseline FILE] [--threshold PCT]
+                   [--unit-threshold UNIT=PCT ...] [--update]
+                   RESULTS.json ...
+
+--unit-threshold sets the threshold of one unit, such as allocs/op=0
+to fail on any new allocation.  A baseline of 0 regresses on any
+increase.  --update writes the results into the baseline instead,
+keeping the figures of benchmarks that did not run.
+"""
+
+from __future__ import print_function
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    """Results of a file, keyed by suite, name and unit"""
+    with open(path) as f:
+        doc = json.load(f)
+
+    res = {}
+    for run in doc.get('runs', [doc]):
+        for r in run['results']:
+            key = '%s/%s [%s]' % (run['suite'], r['name'], r['unit'])
+            res[key] = r
+    return res
+
+
+def save(path, res):
+    """Write results as a baseline, one run per suite"""
+    runs = {}
+    for key in sorted(res):
+        suite = key.split('/', 1)[0]
+        r = res[key]
+        runs.setdefault(suite, []).append(r)
+
+    with open(path, 'w') as f:
+        json.dump({'runs': [{'suite': s, 'results': runs[s]}
+                            for s in sorted(runs)]},
+                  f, indent=1, sort_keys=True)
+        f.write('\n')
+
+
+def change(r, base):
+    """Percent by which r is worse than base, < 0 if better"""
+    worse = base['value'] - r['value'] if r['higher_is_better'] \
+        else r['value'] - base['value']
+    if base['value'] == 0:
+        return float('inf') if worse > 0 else 0.0
+    return 100.0 * worse / abs(base['value'])
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Compare benchmark results with a baseline')
+    parser.add_argument('results', nargs='+',
+                        help='--json output of a benchmark')
+    parser.add_argument('--baseline', help='results to compare with')
+    parser.add_argument('--threshold', type=float, default=10.0,
+                        help='percent a result may be worse by')
+    parser.add_argument('--unit-threshold', action='append', default=[],
+                        metavar='UNIT=PCT',
+                        help='threshold for the results of one unit')
+    parser.add_argument('--update', action='store_true',
+                        help='write the results to --baseline')
+    args = parser.parse_args()
+
+    thresholds = {}
+    for ut in args.unit_threshold:
+        unit, _, pct = ut.rpartition('=')
+        if not unit:
+            parser.error('bad --unit-threshold %s' % ut)
+        thresholds[unit] = float(pct)
+
+    res = {}
+    for path in args.results:
+        res.update(load(path))
+
+    base = {}
+    if args.baseline:
+        try:
+            base = load(args.baseline)
+        except (IOError, OSError):
+            if not args.update:
+                print('No baseline %s, nothing to compare with' %
+                      args.baseline)
+
+    if args.update:
+        if not args.baseline:
+            parser.error('--update needs --baseline')
+        base.update(res)
+        save(args.baseline, base)
+        print('Wrote %d results to %s' % (len(base), args.baseline))
+        return 0
+
+    regressions = 0
+    width = max(len(k) for k in res) if res else 0
+    for key in sorted(res):
+        r = res[key]
+        b = base.get(key)
+        if b is None:
+            print('%-*s %14.1f' % (width, key, r['value']))
+            continue
+
+        pct = change(r, b)
+        limit = thresholds.get(r['unit'], args.threshold)
+        bad = pct > limit
+        regressions += bad
+        delta = 100.0 * (r['value'] - b['value']) / abs(b['value']) \
+            if b['value'] != 0 else 0.0
+        print('%-*s %14.1f %14.1f %+8.1f%%%s' %
+              (width, key, r['value'], b['value'], delta,
+               '  REGRESSED' if bad else ''))
+
+    if regressions:
+        print('%d results regressed past their threshold' % regressions)
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,90 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/*
+ * Results of the benchmarks, written with --json for the bench target
+ * and compared with a baseline by bench_compare.py:
+ *
+ *   { "suite": "nfs_bench",
+ *     "results": [ { "name": "GETATTR", "unit": "ns/op",
+ *                    "value": 1234.5, "higher_is_better": false },
+ *                  ... ] }
+ */
+
+#ifndef BENCH_JSON_H
+#define BENCH_JSON_H
+
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+namespace bench_json {
+
+  struct result {
+    std::string name;
+    std::string unit;
+    double value;
+    bool higher_is_better;
+  };
+
+  inline std::vector<result>& results() {
+    static std::vector<result> r;
+    return r;
+  }
+
+  inline void record(const std::string& name, const char *unit,
+		     double value, bool higher_is_better = false) {
+    results().push_back({name, unit, value, higher_is_better});
+  }
+
+  inline std::string quote(const std::string& s) {
+    std::string q = "\"";
+
+    for (char c : s) {
+      if (c == '"' || c == '\\')
+	q += '\\';
+      q += c;
+    }
+    return q + "\"";
+  }
+
+  /* Write what was recorded, false if the file could not be */
+  inline bool write(const std::string& path, const char *suite) {
+    std::ofstream out(path);
+    const char *sep = "";
+
+    out << "{ \"suite\": " << quote(suite) << ",\n  \"results\": [";
+    for (auto& r : results()) {
+      out << sep << "\n    { \"name\": " << quote(r.name)
+	  << ", \"unit\": " << quote(r.unit)
+	  << ", \"value\": " << std::fixed << std::setprecision(3) << r.value
+	  << ", \"higher_is_better\": "
+	  << (r.higher_is_better ? "true" : "false") << " }";
+      sep = ",";
+    }
+    out << "\n  ] }" << std::endl;
+    return out.good();
+  }
+
+} /* namespace bench_json */
+
+#endif /* BENCH_JSON_H */
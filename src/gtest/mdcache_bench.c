@@ -0,0 +1,356 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file mdcache_bench.c
+ * @brief MDCACHE operations timed by test_mdcache_bench
+ *
+ * The callers run with op_ctx on the export under test.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include "fsal.h"
+#include "mdcache_int.h"
+#include "mdcache_lru.h"
+#include "mdcache_hash.h"
+#include "mdcache_avl.h"
+#include "mdcache_bench.h"
+
+/** Keys of the files of the working set */
+static mdcache_key_t *keys;
+static uint32_t nkeys;
+
+/** Entries held by mdcache_bench_pin() */
+static mdcache_entry_t **pinned;
+static uint32_t npinned;
+
+/** Directory of the dirent benchmarks, never in the cache */
+static mdcache_entry_t *dirents;
+
+/** Directory the working set is made in */
+static struct fsal_obj_handle *bench_dir;
+
+/** Subdirectory of bench_dir that cross directory renames start in */
+static struct fsal_obj_handle *rename_dir;
+
+uint32_t mdcache_bench_hwmark(void)
+{
+	return mdcache_param.entries_hwmark;
+}
+
+static void dirent_add(const char *name)
+{
+	mdcache_dir_entry_t *dirent = mdcache_dirent_alloc(name);
+
+	(void) mdcache_avl_qp_insert(dirents, &dirent);
+}
+
+/**
+ * @brief Make the working set
+ *
+ * Creates files f0 .. f(files - 1) in dir, or finds them from an
+ * earlier run, and keeps their keys.  They are not referenced, so
+ * past Entries_HWMark they get reaped and reloaded.  The dirent
+ * directory gets entries of the same names.
+ */
+int mdcache_bench_setup(struct fsal_obj_handle *dir, uint32_t files)
+{
+	struct attrlist attrs;
+	struct fsal_obj_handle *obj;
+	fsal_status_t status;
+	char name[32];
+	uint32_t i;
+
+	bench_dir = dir;
+	keys = gsh_calloc(files, sizeof(*keys));
+	dirents = gsh_calloc(1, sizeof(*dirents));
+	PTHREAD_RWLOCK_init(&dirents->content_lock, NULL);
+	mdcache_avl_init(dirents);
+
+	for (i = 0; i < files; i++) {
+		snprintf(name, sizeof(name), "f%" PRIu32, i);
+
+		status = fsal_lookup(dir, name, &obj, NULL);
+		if (FSAL_IS_ERROR(status)) {
+			memset(&attrs, 0, sizeof(attrs));
+			FSAL_SET_MASK(attrs.mask, ATTR_MODE);
+			attrs.mode = 0644;
+			status = fsal_create(dir, name, REGULAR_FILE, &attrs,
+					     NULL, &obj, NULL);
+		}
+		if (FSAL_IS_ERROR(status)) {
+			LogCrit(COMPONENT_CACHE_INODE,
+				"Could not make %s: %s", name,
+				msg_fsal_err(status.major));
+			return -1;
+		}
+
+		mdcache_key_dup(&keys[i],
+				&container_of(obj, mdcache_entry_t,
+					      obj_handle)->fh_hk.key);
+		obj->obj_ops.put_ref(obj);
+		nkeys++;
+
+		dirent_add(name);
+	}
+
+	status = fsal_lookup(dir, "rename", &rename_dir, NULL);
+	if (FSAL_IS_ERROR(status)) {
+		memset(&attrs, 0, sizeof(attrs));
+		FSAL_SET_MASK(attrs.mask, ATTR_MODE);
+		attrs.mode = 0755;
+		status = fsal_create(dir, "rename", DIRECTORY, &attrs,
+				     NULL, &rename_dir, NULL);
+	}
+	if (FSAL_IS_ERROR(status)) {
+		LogCrit(COMPONENT_CACHE_INODE,
+			"Could not make rename: %s",
+			msg_fsal_err(status.major));
+		rename_dir = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+void mdcache_bench_teardown(void)
+{
+	uint32_t i;
+
+	mdcache_bench_unpin();
+
+	if (rename_dir != NULL) {
+		rename_dir->obj_ops.put_ref(rename_dir);
+		rename_dir = NULL;
+	}
+
+	for (i = 0; i < nkeys; i++)
+		mdcache_key_delete(&keys[i]);
+	gsh_free(keys);
+	keys = NULL;
+	nkeys = 0;
+
+	mdcache_avl_clean_tree(&dirents->fsobj.fsdir.avl.t);
+	PTHREAD_RWLOCK_destroy(&dirents->content_lock);
+	gsh_free(dirents);
+	dirents = NULL;
+	bench_dir = NULL;
+}
+
+/**
+ * @brief Find an object by its key, loading it on a miss
+ */
+bool mdcache_bench_locate(uint32_t i)
+{
+	mdcache_entry_t *entry;
+	fsal_status_t status;
+
+	status = mdcache_locate_keyed(&keys[i], mdc_cur_export(), &entry,
+				      NULL);
+	if (FSAL_IS_ERROR(status))
+		return false;
+
+	mdcache_put(entry);
+	return true;
+}
+
+/**
+ * @brief Look an object up in the handle table only
+ */
+bool mdcache_bench_latch(uint32_t i)
+{
+	mdcache_entry_t *entry;
+	cih_latch_t latch;
+
+	entry = cih_get_by_key_latch(&keys[i], &latch,
+				     CIH_GET_RLOCK | CIH_GET_UNLOCK_ON_MISS,
+				     __func__, __LINE__);
+	if (entry == NULL)
+		return false;
+
+	cih_hash_release(&latch);
+	return true;
+}
+
+/**
+ * @brief Hold references on the first n objects of the working set
+ */
+int mdcache_bench_pin(uint32_t n)
+{
+	fsal_status_t status;
+
+	pinned = gsh_calloc(n, sizeof(*pinned));
+
+	for (npinned = 0; npinned < n; npinned++) {
+		status = mdcache_locate_keyed(&keys[npinned], mdc_cur_export(),
+					      &pinned[npinned], NULL);
+		if (FSAL_IS_ERROR(status))
+			return -1;
+	}
+
+	return 0;
+}
+
+void mdcache_bench_unpin(void)
+{
+	uint32_t i;
+
+	for (i = 0; i < npinned; i++)
+		mdcache_put(pinned[i]);
+	gsh_free(pinned);
+	pinned = NULL;
+	npinned = 0;
+}
+
+/**
+ * @brief Take and drop a reference on a pinned object
+ *
+ * The pin keeps the entry, so this is the LRU cost only.
+ */
+void mdcache_bench_ref(uint32_t i)
+{
+	(void) mdcache_lru_ref(pinned[i], LRU_REQ_INITIAL);
+	(void) mdcache_lru_unref(pinned[i], LRU_FLAG_NONE);
+}
+
+/**
+ * @brief Take the cached attributes of a pinned object
+ *
+ * As a GETATTR would: a reference, then the attributes under the
+ * attr_lock for read.
+ */
+void mdcache_bench_getattr(uint32_t i)
+{
+	struct fsal_obj_handle *obj = &pinned[i]->obj_handle;
+	struct attrlist attrs;
+
+	fsal_prepare_attrs(&attrs, ATTRS_POSIX);
+
+	obj->obj_ops.get_ref(obj);
+	(void) obj->obj_ops.getattrs(obj, &attrs);
+	obj->obj_ops.put_ref(obj);
+
+	fsal_release_attrs(&attrs);
+}
+
+/**
+ * @brief Put an object on L1, then reap the lanes of reaper me
+ */
+size_t mdcache_bench_reap(uint32_t i, uint32_t me, uint32_t nthreads)
+{
+	uint64_t closed = 0;
+
+	(void) mdcache_bench_locate(i);
+	return mdcache_lru_run_lanes(me, nthreads, false, &closed);
+}
+
+/**
+ * @brief Add a new dirent, as a create in the directory would
+ */
+void mdcache_bench_dirent_insert(uint32_t thread, uint64_t n)
+{
+	char name[48];
+
+	snprintf(name, sizeof(name), "t%" PRIu32 ".%" PRIu64, thread, n);
+
+	PTHREAD_RWLOCK_wrlock(&dirents->content_lock);
+	dirent_add(name);
+	PTHREAD_RWLOCK_unlock(&dirents->content_lock);
+}
+
+/**
+ * @brief Create a new file in the working set directory and remove it
+ */
+bool mdcache_bench_create_remove(uint32_t thread, uint64_t n)
+{
+	struct attrlist attrs;
+	struct fsal_obj_handle *obj;
+	fsal_status_t status;
+	char name[48];
+
+	snprintf(name, sizeof(name), "c%" PRIu32 ".%" PRIu64, thread, n);
+
+	memset(&attrs, 0, sizeof(attrs));
+	FSAL_SET_MASK(attrs.mask, ATTR_MODE);
+	attrs.mode = 0644;
+
+	status = fsal_create(bench_dir, name, REGULAR_FILE, &attrs, NULL,
+			     &obj, NULL);
+	if (FSAL_IS_ERROR(status))
+		return false;
+
+	obj->obj_ops.put_ref(obj);
+
+	status = fsal_remove(bench_dir, name);
+
+	return !FSAL_IS_ERROR(status);
+}
+
+/**
+ * @brief Write a temporary file and rename it over the thread's target
+ *
+ * The atomic replace of editors and build tools.  The temporary file
+ * is made in bench_dir, or with cross in a subdirectory of it.
+ */
+bool mdcache_bench_rename(uint32_t thread, uint64_t n, bool cross)
+{
+	struct fsal_obj_handle *src = cross ? rename_dir : bench_dir;
+	struct attrlist attrs;
+	struct fsal_obj_handle *obj;
+	fsal_status_t status;
+	char tmp[48], target[32];
+
+	snprintf(tmp, sizeof(tmp), "r%" PRIu32 ".%" PRIu64 ".tmp", thread, n);
+	snprintf(target, sizeof(target), "r%" PRIu32, thread);
+
+	memset(&attrs, 0, sizeof(attrs));
+	FSAL_SET_MASK(attrs.mask, ATTR_MODE);
+	attrs.mode = 0644;
+
+	status = fsal_create(src, tmp, REGULAR_FILE, &attrs, NULL, &obj,
+			     NULL);
+	if (FSAL_IS_ERROR(status))
+		return false;
+
+	obj->obj_ops.put_ref(obj);
+
+	status = fsal_rename(src, tmp, bench_dir, target);
+
+	return !FSAL_IS_ERROR(status);
+}
+
+/**
+ * @brief Look up a dirent by name, as a cached lookup would
+ */
+bool mdcache_bench_dirent_lookup(uint32_t i)
+{
+	mdcache_dir_entry_t *dirent;
+	char name[32];
+
+	snprintf(name, sizeof(name), "f%" PRIu32, i);
+
+	PTHREAD_RWLOCK_rdlock(&dirents->content_lock);
+	dirent = mdcache_avl_qp_lookup_s(dirents, name, 1);
+	PTHREAD_RWLOCK_unlock(&dirents->content_lock);
+
+	return dirent != NULL;
+}
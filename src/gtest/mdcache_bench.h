@@ -0,0 +1,56 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file mdcache_bench.h
+ * @brief MDCACHE operations timed by test_mdcache_bench
+ *
+ * The MDCACHE headers are C only, so the operations are wrapped here
+ * for the C++ driver.  Objects are named by their index in the working
+ * set made by mdcache_bench_setup().
+ */
+
+#ifndef MDCACHE_BENCH_H
+#define MDCACHE_BENCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+struct fsal_obj_handle;
+
+uint32_t mdcache_bench_hwmark(void);
+int mdcache_bench_setup(struct fsal_obj_handle *dir, uint32_t files);
+void mdcache_bench_teardown(void);
+
+bool mdcache_bench_locate(uint32_t i);
+bool mdcache_bench_latch(uint32_t i);
+int mdcache_bench_pin(uint32_t n);
+void mdcache_bench_unpin(void);
+void mdcache_bench_ref(uint32_t i);
+void mdcache_bench_getattr(uint32_t i);
+size_t mdcache_bench_reap(uint32_t i, uint32_t me, uint32_t nthreads);
+void mdcache_bench_dirent_insert(uint32_t thread, uint64_t n);
+bool mdcache_bench_dirent_lookup(uint32_t i);
+bool mdcache_bench_create_remove(uint32_t thread, uint64_t n);
+bool mdcache_bench_rename(uint32_t thread, uint64_t n, bool cross);
+
+#endif				/* MDCACHE_BENCH_H */
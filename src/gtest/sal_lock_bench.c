@@ -0,0 +1,171 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file sal_lock_bench.c
+ * @brief SAL backend of the multilock stress driver
+ *
+ * All the owners lock through one 9P fid state, so the FSAL sees a
+ * single open; the conflicts between owners are SAL's own.  Blocking
+ * locks need a protocol to grant them, so they are refused.
+ */
+
+#include "config.h"
+#include <netinet/in.h>
+#include "fsal.h"
+#include "sal_functions.h"
+#include "sal_lock_bench.h"
+
+static struct fsal_obj_handle *lock_obj;
+static state_t *lock_state;
+static state_owner_t **owners;
+static uint32_t nowners;
+
+/** Context of the setup, copied by each stress thread */
+static struct req_op_context *lock_ctx;
+static __thread struct req_op_context thread_ctx;
+
+static void sal_thread_init(void *ctx)
+{
+	thread_ctx = *lock_ctx;
+	op_ctx = &thread_ctx;
+}
+
+static int sal_lock(void *ctx, uint32_t owner, bool write, bool wait,
+		    uint64_t start, uint64_t len)
+{
+	fsal_lock_param_t lock = {
+		.lock_sle_type = FSAL_POSIX_LOCK,
+		.lock_type = write ? FSAL_LOCK_W : FSAL_LOCK_R,
+		.lock_start = start,
+		.lock_length = len,
+	};
+	state_owner_t *holder = NULL;
+	fsal_lock_param_t conflict;
+	state_status_t status;
+
+	if (wait)
+		return EOPNOTSUPP;
+
+	status = state_lock(lock_obj, owners[owner], lock_state,
+			    STATE_NON_BLOCKING, NULL, &lock, &holder,
+			    &conflict);
+
+	if (holder != NULL)
+		dec_state_owner_ref(holder);
+
+	if (status == STATE_SUCCESS)
+		return 0;
+	if (status == STATE_LOCK_CONFLICT)
+		return EAGAIN;
+	return EIO;
+}
+
+static int sal_unlock(void *ctx, uint32_t owner, uint64_t start,
+		      uint64_t len)
+{
+	fsal_lock_param_t lock = {
+		.lock_sle_type = FSAL_POSIX_LOCK,
+		.lock_type = FSAL_NO_LOCK,
+		.lock_start = start,
+		.lock_length = len,
+	};
+
+	if (state_unlock(lock_obj, lock_state, owners[owner], false, 0,
+			 &lock) != STATE_SUCCESS)
+		return EIO;
+
+	return 0;
+}
+
+struct ml_backend sal_lock_backend = {
+	.thread_init = sal_thread_init,
+	.lock = sal_lock,
+	.unlock = sal_unlock,
+};
+
+/**
+ * @brief Open obj for locking, and make the owners
+ *
+ * Called with op_ctx on the export of obj.
+ */
+int sal_lock_bench_setup(struct fsal_obj_handle *obj, uint32_t n)
+{
+	struct sockaddr_storage addr;
+	struct sockaddr_in *sin = (struct sockaddr_in *)&addr;
+	fsal_status_t status;
+
+	lock_ctx = op_ctx;
+	lock_obj = obj;
+
+	/* As 9p_attach makes the state of a fid */
+	lock_state =
+		op_ctx->fsal_export->exp_ops.alloc_state(op_ctx->fsal_export,
+							 STATE_TYPE_9P_FID,
+							 NULL);
+	glist_init(&lock_state->state_data.fid.state_locklist);
+	lock_state->state_refcount = 1;
+	lock_state->state_data.fid.share_access = OPEN4_SHARE_ACCESS_BOTH;
+
+	if (obj->fsal->m_ops.support_ex(obj)) {
+		status = fsal_reopen2(obj, lock_state, FSAL_O_RDWR, true);
+		if (FSAL_IS_ERROR(status))
+			return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	sin->sin_family = AF_INET;
+	sin->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	owners = gsh_calloc(n, sizeof(*owners));
+	for (nowners = 0; nowners < n; nowners++) {
+		owners[nowners] = get_9p_owner(&addr, nowners + 1);
+		if (owners[nowners] == NULL)
+			return -1;
+	}
+
+	return 0;
+}
+
+void sal_lock_bench_teardown(void)
+{
+	fsal_lock_param_t lock = {
+		.lock_sle_type = FSAL_POSIX_LOCK,
+		.lock_type = FSAL_NO_LOCK,
+		.lock_start = 0,
+		.lock_length = 0,	/* to the end of the file */
+	};
+	uint32_t i;
+
+	for (i = 0; i < nowners; i++) {
+		(void) state_unlock(lock_obj, lock_state, owners[i], false, 0,
+				    &lock);
+		dec_state_owner_ref(owners[i]);
+	}
+	gsh_free(owners);
+	owners = NULL;
+	nowners = 0;
+
+	if (lock_obj->fsal->m_ops.support_ex(lock_obj))
+		(void) lock_obj->obj_ops.close2(lock_obj, lock_state);
+	lock_state->state_exp->exp_ops.free_state(lock_state);
+	lock_state = NULL;
+}
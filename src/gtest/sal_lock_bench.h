@@ -0,0 +1,43 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file sal_lock_bench.h
+ * @brief SAL backend of the multilock stress driver
+ *
+ * Lets ml_stress_run() take its locks with state_lock() and
+ * state_unlock() on one file, each stress owner being a 9P lock owner.
+ */
+
+#ifndef SAL_LOCK_BENCH_H
+#define SAL_LOCK_BENCH_H
+
+#include <stdint.h>
+#include "ml_stress.h"
+
+struct fsal_obj_handle;
+
+extern struct ml_backend sal_lock_backend;
+
+int sal_lock_bench_setup(struct fsal_obj_handle *obj, uint32_t owners);
+void sal_lock_bench_teardown(void);
+
+#endif				/* SAL_LOCK_BENCH_H */
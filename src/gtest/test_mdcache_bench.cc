@@ -0,0 +1,419 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/*
+ * MDCACHE scaling benchmarks.
+ *
+ * Each benchmark runs with 1, 2, 4 ... --threads threads, on working
+ * sets of half, once and twice Entries_HWMark files made under the
+ * root of --export, and prints the throughput and the p50, p99 and
+ * p99.9 latencies of its operation:
+ *
+ *   LOCATE  mdcache_locate_keyed, loading the entry on a miss
+ *   LATCH   cih_get_by_key_latch, the handle table alone
+ *   REF     mdcache_lru_ref/unref of entries held by the test
+ *   GETATTR a reference and the cached attributes of entries held by
+ *           the test, alone and with half the threads doing REF on
+ *           the same few entries
+ *   REAP    a LOCATE then an lru_run_lane pass over the thread's lanes
+ *   DIRENT  mdcache_avl_qp_lookup_s, and mdcache_avl_qp_insert of new
+ *           names, in one directory under its content_lock
+ *   CREATE  fsal_create then fsal_remove of new names, all threads in
+ *           the directory of the working set
+ *   RENAME  fsal_create of a temporary file and fsal_rename over a
+ *           target of the thread's, in the directory of the working
+ *           set, and (RENAME_X) from a subdirectory of it
+ *
+ * With --json the results are also written for the bench target.
+ */
+
+#include <sys/types.h>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+#include "gtest/gtest.h"
+#include <boost/program_options.hpp>
+#include "bench_json.h"
+
+extern "C" {
+/* Ganesha headers */
+#include "nfs_lib.h"
+#include "export_mgr.h"
+#include "nfs_exports.h"
+#include "sal_data.h"
+#include "fsal.h"
+#include "mdcache_bench.h"
+
+/* From nfs_core.h, which C++ cannot include */
+void admin_halt(void);
+}
+
+namespace {
+
+  char* ganesha_conf = nullptr;
+  char* lpath = nullptr;
+  int dlevel = -1;
+  uint16_t export_id = 77;
+  uint32_t max_threads = std::thread::hardware_concurrency();
+  uint32_t iterations = 100000;
+
+  const char bench_dir[] = "mdcache_bench";
+
+  struct req_op_context req_ctx;
+  struct user_cred user_credentials;
+  struct attrlist object_attributes;
+
+  struct gsh_export* a_export = nullptr;
+  struct fsal_obj_handle *root_entry = nullptr;
+  struct fsal_obj_handle *test_root = nullptr;
+
+  uint32_t hwmark;
+  std::vector<uint32_t> working_sets;
+
+  int ganesha_server() {
+    return nfs_libmain(
+      ganesha_conf,
+      lpath,
+      dlevel
+      );
+  }
+
+  /* An op gets its object, thread index, thread count and iteration */
+  typedef std::function<void(uint32_t, uint32_t, uint32_t,
+			     uint64_t)> bench_op;
+
+  /*
+   * Run op iterations times on each of nthreads threads, choosing an
+   * object of the working set at random for each call.
+   */
+  void run(const char *name, uint32_t nthreads, uint32_t ws,
+	   bench_op op) {
+    std::vector<std::thread> threads;
+    std::vector<std::vector<uint32_t>> lat(nthreads);
+    std::vector<uint32_t> all;
+    std::atomic<uint32_t> ready(0);
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (uint32_t t = 0; t < nthreads; t++) {
+      threads.emplace_back([&, t]() {
+	  struct req_op_context ctx = req_ctx;
+	  std::mt19937 rng(t);
+	  std::uniform_int_distribution<uint32_t> pick(0, ws - 1);
+
+	  op_ctx = &ctx;
+	  lat[t].reserve(iterations);
+
+	  /* start together, for the contention */
+	  ready++;
+	  while (ready < nthreads)
+	    std::this_thread::yield();
+
+	  for (uint32_t i = 0; i < iterations; i++) {
+	    auto s = std::chrono::steady_clock::now();
+
+	    op(pick(rng), t, nthreads, i);
+	    lat[t].push_back(
+	      std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now() - s).count());
+	  }
+	});
+    }
+
+    for (auto& th : threads)
+      th.join();
+
+    auto secs = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+
+    for (auto& l : lat)
+      all.insert(all.end(), l.begin(), l.end());
+    std::sort(all.begin(), all.end());
+
+    auto pct = [&](double p) { return all[(size_t)(p * (all.size() - 1))]; };
+
+    std::cout << std::left << std::setw(8) << name
+	      << std::right << " threads " << std::setw(3) << nthreads
+	      << " ws " << std::setw(8) << ws
+	      << std::fixed << std::setprecision(0)
+	      << std::setw(12) << all.size() / secs << " ops/s"
+	      << " p50 " << std::setw(7) << pct(0.50)
+	      << " p99 " << std::setw(7) << pct(0.99)
+	      << " p99.9 " << std::setw(8) << pct(0.999) << " ns"
+	      << std::endl;
+
+    std::string key = std::string(name) + " threads " +
+      std::to_string(nthreads) + " ws " + std::to_string(ws);
+
+    bench_json::record(key, "ops/s", all.size() / secs, true);
+    bench_json::record(key, "p99 ns", pct(0.99));
+  }
+
+  /* Run op for each thread count and working set */
+  void scale(const char *name, bench_op op) {
+    for (uint32_t ws : working_sets)
+      for (uint32_t n = 1; n <= max_threads; n *= 2)
+	run(name, n, ws, op);
+  }
+
+} /* namespace */
+
+TEST(MDCACHE_BENCH, INIT)
+{
+  fsal_status_t status;
+
+  a_export = get_gsh_export(export_id);
+  ASSERT_NE(a_export, nullptr);
+
+  status = nfs_export_get_root_entry(a_export, &root_entry);
+  ASSERT_FALSE(FSAL_IS_ERROR(status));
+
+  /* Ganesha call paths need real or forged context info */
+  memset(&user_credentials, 0, sizeof(struct user_cred));
+  memset(&req_ctx, 0, sizeof(struct req_op_context));
+  req_ctx.ctx_export = a_export;
+  req_ctx.fsal_export = a_export->fsal_export;
+  req_ctx.creds = &user_credentials;
+
+  /* stashed in tls */
+  op_ctx = &req_ctx;
+}
+
+TEST(MDCACHE_BENCH, SETUP)
+{
+  fsal_status_t status;
+
+  // the bench directory, from an earlier run if there was one
+  status = fsal_lookup(root_entry, bench_dir, &test_root, nullptr);
+  if (FSAL_IS_ERROR(status)) {
+    memset(&object_attributes, 0, sizeof(object_attributes));
+    FSAL_SET_MASK(object_attributes.mask, ATTR_MODE);
+    object_attributes.mode = 0777;
+    status = root_entry->obj_ops.mkdir(root_entry, bench_dir,
+				      &object_attributes, &test_root,
+				      nullptr);
+  }
+  ASSERT_NE(test_root, nullptr);
+
+  hwmark = mdcache_bench_hwmark();
+  working_sets = { std::max(hwmark / 2, 1U), hwmark, hwmark * 2 };
+  ASSERT_EQ(mdcache_bench_setup(test_root, working_sets.back()), 0);
+
+  if (max_threads == 0)
+    max_threads = 1;
+}
+
+TEST(MDCACHE_BENCH, LOCATE)
+{
+  scale("LOCATE", [](uint32_t i, uint32_t, uint32_t, uint64_t) {
+      (void) mdcache_bench_locate(i);
+    });
+}
+
+TEST(MDCACHE_BENCH, LATCH)
+{
+  scale("LATCH", [](uint32_t i, uint32_t, uint32_t, uint64_t) {
+      (void) mdcache_bench_latch(i);
+    });
+}
+
+TEST(MDCACHE_BENCH, REF)
+{
+  /* Only what fits, the rest would be refused past the high water mark */
+  uint32_t ws = working_sets.front();
+
+  ASSERT_EQ(mdcache_bench_pin(ws), 0);
+  for (uint32_t n = 1; n <= max_threads; n *= 2)
+    run("REF", n, ws, [](uint32_t i, uint32_t, uint32_t, uint64_t) {
+	mdcache_bench_ref(i);
+      });
+  mdcache_bench_unpin();
+}
+
+TEST(MDCACHE_BENCH, GETATTR)
+{
+  uint32_t ws = working_sets.front();
+
+  ASSERT_EQ(mdcache_bench_pin(ws), 0);
+  for (uint32_t n = 1; n <= max_threads; n *= 2)
+    run("GETATTR", n, ws, [](uint32_t i, uint32_t, uint32_t, uint64_t) {
+	mdcache_bench_getattr(i);
+      });
+
+  /* The reads of one half against the reference counts of the other,
+   * on a few hot entries so that they meet */
+  for (uint32_t n = 2; n <= max_threads; n *= 2)
+    run("GETATTR+REF", n, std::min(ws, 4U), [](uint32_t i, uint32_t t, uint32_t,
+				  uint64_t) {
+	  if (t % 2)
+	    mdcache_bench_ref(i);
+	  else
+	    mdcache_bench_getattr(i);
+	});
+  mdcache_bench_unpin();
+}
+
+TEST(MDCACHE_BENCH, REAP)
+{
+  scale("REAP", [](uint32_t i, uint32_t t, uint32_t n, uint64_t) {
+      (void) mdcache_bench_reap(i, t, n);
+    });
+}
+
+TEST(MDCACHE_BENCH, DIRENT)
+{
+  scale("LOOKUP_S", [](uint32_t i, uint32_t, uint32_t, uint64_t) {
+      (void) mdcache_bench_dirent_lookup(i);
+    });
+
+  /* The names are new each run, so the directory keeps growing */
+  for (uint32_t n = 1; n <= max_threads; n *= 2)
+    run("INSERT", n, 1, [n](uint32_t, uint32_t t, uint32_t, uint64_t i) {
+	mdcache_bench_dirent_insert(n * 1000 + t, i);
+      });
+}
+
+TEST(MDCACHE_BENCH, CREATE)
+{
+  for (uint32_t n = 1; n <= max_threads; n *= 2)
+    run("CREATE", n, 1, [n](uint32_t, uint32_t t, uint32_t, uint64_t i) {
+	EXPECT_TRUE(mdcache_bench_create_remove(n * 1000 + t, i));
+      });
+}
+
+TEST(MDCACHE_BENCH, RENAME)
+{
+  for (uint32_t n = 1; n <= max_threads; n *= 2)
+    run("RENAME", n, 1, [n](uint32_t, uint32_t t, uint32_t, uint64_t i) {
+	EXPECT_TRUE(mdcache_bench_rename(n * 1000 + t, i, false));
+      });
+
+  for (uint32_t n = 1; n <= max_threads; n *= 2)
+    run("RENAME_X", n, 1, [n](uint32_t, uint32_t t, uint32_t, uint64_t i) {
+	EXPECT_TRUE(mdcache_bench_rename(n * 1000 + t, i, true));
+      });
+}
+
+TEST(MDCACHE_BENCH, TEARDOWN)
+{
+  mdcache_bench_teardown();
+}
+
+int main(int argc, char *argv[])
+{
+  int code = 0;
+
+  using namespace std;
+  using namespace std::literals;
+  namespace po = boost::program_options;
+
+  po::options_description opts("program options");
+  po::variables_map vm;
+
+  try {
+
+    opts.add_options()
+      ("config", po::value<string>(),
+	"path to Ganesha conf file")
+
+      ("logfile", po::value<string>(),
+	"log to the provided file path")
+
+      ("export", po::value<uint16_t>(),
+	"id of export on which to operate (must exist)")
+
+      ("threads", po::value<uint32_t>(),
+	"most threads to scale to")
+
+      ("iterations", po::value<uint32_t>(),
+	"operations timed per thread")
+
+      ("debug", po::value<string>(),
+	"ganesha debug level")
+
+      ("json", po::value<string>(),
+	"write the results to this file, and stop ganesha once done")
+      ;
+
+    po::variables_map::iterator vm_iter;
+    po::store(po::parse_command_line(argc, argv, opts), vm);
+    po::notify(vm);
+
+    // use config vars--leaves them on the stack
+    vm_iter = vm.find("config");
+    if (vm_iter != vm.end()) {
+      ganesha_conf = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("logfile");
+    if (vm_iter != vm.end()) {
+      lpath = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("debug");
+    if (vm_iter != vm.end()) {
+      dlevel = ReturnLevelAscii(
+	(char*) vm_iter->second.as<std::string>().c_str());
+    }
+    vm_iter = vm.find("export");
+    if (vm_iter != vm.end()) {
+      export_id = vm_iter->second.as<uint16_t>();
+    }
+    vm_iter = vm.find("threads");
+    if (vm_iter != vm.end()) {
+      max_threads = vm_iter->second.as<uint32_t>();
+    }
+    vm_iter = vm.find("iterations");
+    if (vm_iter != vm.end()) {
+      iterations = vm_iter->second.as<uint32_t>();
+    }
+
+    ::testing::InitGoogleTest(&argc, argv);
+
+    std::thread ganesha(ganesha_server);
+    std::this_thread::sleep_for(5s);
+
+    code  = RUN_ALL_TESTS();
+    vm_iter = vm.find("json");
+    if (vm_iter != vm.end()) {
+      if (!bench_json::write(vm_iter->second.as<std::string>(),
+			     "mdcache_bench"))
+	code = 1;
+      admin_halt();
+    }
+    ganesha.join();
+  }
+
+  catch(po::error& e) {
+    cout << "Error parsing opts " << e.what() << endl;
+  }
+
+  catch(...) {
+    cout << "Unhandled exception in main()" << endl;
+  }
+
+  return code;
+}
@@ -0,0 +1,825 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/*
+ * Protocol level microbenchmarks.
+ *
+ * Starts ganesha in-process, as test_ci_hash_dist1 does, and drives
+ * nfs4_Compound() and the NFSv3 handlers directly with requests built
+ * here, on a directory created under the root of --export.  Each
+ * benchmark prints ns/op and the mallocs/op done by the calling
+ * thread in the statically linked core (the FSAL modules are loaded
+ * with dlopen and are not counted).
+ *
+ * With --alloc-baseline, a benchmark whose allocs/op went up from the
+ * figure for it in the file fails; --alloc-update writes the figures
+ * of the run to the file instead, once an allocation has been removed.
+ * Each line of the file is a benchmark name, a tab and its allocs/op.
+ * With --json the figures are also written for the bench target.
+ *
+ * The config must let root on 127.0.0.1 read and write the export
+ * (Squash = No_Root_Squash) over NFSv3 and NFSv4, and should set
+ * Graceless = true in NFSV4 so that OPEN and LOCK are not refused
+ * during the grace period.
+ */
+
+#include <sys/types.h>
+#include <arpa/inet.h>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <fstream>
+#include <map>
+#include <chrono>
+#include <thread>
+#include "gtest/gtest.h"
+#include <boost/program_options.hpp>
+#include "bench_json.h"
+
+extern "C" {
+/* Ganesha headers */
+#include "nfs_lib.h"
+#include "export_mgr.h"
+#include "nfs_exports.h"
+#include "nfs_proto_functions.h"
+#include "nfs_proto_tools.h"
+#include "nfs_file_handle.h"
+#include "client_mgr.h"
+#include "sal_data.h"
+#include "fsal.h"
+
+/* From nfs_core.h, which C++ cannot include */
+void admin_halt(void);
+
+/* Linked with --wrap for these, see CMakeLists.txt */
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+}
+
+namespace {
+
+  char* ganesha_conf = nullptr;
+  char* lpath = nullptr;
+  int dlevel = -1;
+  uint16_t export_id = 77;
+  uint32_t iterations = 100000;
+
+  const char bench_dir[] = "nfs_bench";
+  const char bench_file[] = "file";
+  const int bench_entries = 64;
+
+  /* Allocations of the thread, only the benchmark's is read */
+  thread_local uint64_t allocs;
+
+  /* allocs/op of each benchmark, from and for --alloc-baseline */
+  std::string alloc_baseline;
+  bool alloc_update = false;
+  std::map<std::string, double> baseline_allocs;
+  std::map<std::string, double> run_allocs;
+
+  void read_baseline() {
+    std::ifstream in(alloc_baseline);
+    std::string line;
+
+    while (std::getline(in, line)) {
+      size_t tab = line.find('\t');
+
+      if (tab != std::string::npos)
+	baseline_allocs[line.substr(0, tab)] =
+	  std::stod(line.substr(tab + 1));
+    }
+  }
+
+  void write_baseline() {
+    std::ofstream out(alloc_baseline);
+
+    for (auto& b : run_allocs)
+      out << b.first << '\t' << std::fixed << std::setprecision(1)
+	  << b.second << std::endl;
+  }
+
+  struct req_op_context req_ctx;
+  struct user_cred user_credentials;
+  struct export_perms export_perms;
+  struct authunix_parms aup;
+  sockaddr_t client_addr;
+  SVCXPRT xprt;
+  struct svc_req req;
+
+  struct gsh_export* a_export = nullptr;
+  struct fsal_obj_handle *root_entry = nullptr;
+  struct fsal_obj_handle *test_root = nullptr;
+
+  nfs_fh4 dir_fh4;
+  nfs_fh4 file_fh4;
+  nfs_fh3 dir_fh3;
+  nfs_fh3 file_fh3;
+
+  clientid4 clientid;
+  seqid4 open_seqid;
+  char open_owner[] = "nfs_bench_open";
+  char lock_owner[] = "nfs_bench_lock";
+  char io_buf[4096];
+
+  int ganesha_server() {
+    return nfs_libmain(
+      ganesha_conf,
+      lpath,
+      dlevel
+      );
+  }
+
+  /* Time a loop of iterations, and count its allocations */
+  template <typename F>
+  void bench(const char *name, F op) {
+    uint64_t start_allocs = allocs;
+    auto start = std::chrono::steady_clock::now();
+
+    for (uint32_t i = 0; i < iterations; i++)
+      op();
+
+    auto end = std::chrono::steady_clock::now();
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      end - start).count();
+
+    double per_op = (double)(allocs - start_allocs) / iterations;
+
+    std::cout << std::left << std::setw(16) << name
+	      << std::right << std::setw(10) << ns / iterations
+	      << " ns/op " << std::fixed << std::setprecision(1)
+	      << std::setw(8) << per_op
+	      << " allocs/op" << std::endl;
+
+    run_allocs[name] = per_op;
+    bench_json::record(name, "ns/op", (double)ns / iterations);
+    bench_json::record(name, "allocs/op", per_op);
+
+    /* Rounded as written, so that an unchanged run matches */
+    auto base = baseline_allocs.find(name);
+    if (!alloc_update && base != baseline_allocs.end())
+      EXPECT_LE(per_op, base->second + 0.05)
+	<< name << " allocations regressed from " << base->second
+	<< " per op";
+  }
+
+  void set_component(component4 *c, const char *name) {
+    c->utf8string_len = strlen(name);
+    c->utf8string_val = (char *)name;
+  }
+
+  void op_putfh(nfs_argop4 *op, nfs_fh4 *fh) {
+    memset(op, 0, sizeof(*op));
+    op->argop = NFS4_OP_PUTFH;
+    op->nfs_argop4_u.opputfh.object = *fh;
+  }
+
+  void op_getattr(nfs_argop4 *op) {
+    struct bitmap4 *bits = &op->nfs_argop4_u.opgetattr.attr_request;
+
+    memset(op, 0, sizeof(*op));
+    op->argop = NFS4_OP_GETATTR;
+    set_attribute_in_bitmap(bits, FATTR4_TYPE);
+    set_attribute_in_bitmap(bits, FATTR4_CHANGE);
+    set_attribute_in_bitmap(bits, FATTR4_SIZE);
+    set_attribute_in_bitmap(bits, FATTR4_FSID);
+    set_attribute_in_bitmap(bits, FATTR4_FILEID);
+    set_attribute_in_bitmap(bits, FATTR4_MODE);
+    set_attribute_in_bitmap(bits, FATTR4_NUMLINKS);
+    set_attribute_in_bitmap(bits, FATTR4_OWNER);
+    set_attribute_in_bitmap(bits, FATTR4_OWNER_GROUP);
+    set_attribute_in_bitmap(bits, FATTR4_SPACE_USED);
+    set_attribute_in_bitmap(bits, FATTR4_TIME_ACCESS);
+    set_attribute_in_bitmap(bits, FATTR4_TIME_METADATA);
+    set_attribute_in_bitmap(bits, FATTR4_TIME_MODIFY);
+  }
+
+  void op_getfh(nfs_argop4 *op) {
+    memset(op, 0, sizeof(*op));
+    op->argop = NFS4_OP_GETFH;
+  }
+
+  /* Run a COMPOUND, the caller frees the result */
+  nfsstat4 compound(nfs_argop4 *ops, u_int nops, nfs_res_t *res) {
+    nfs_arg_t arg;
+
+    memset(&arg, 0, sizeof(arg));
+    memset(res, 0, sizeof(*res));
+    arg.arg_compound4.minorversion = 0;
+    arg.arg_compound4.argarray.argarray_len = nops;
+    arg.arg_compound4.argarray.argarray_val = ops;
+
+    /* PUTFH takes the export, the compound releases it */
+    op_ctx->ctx_export = nullptr;
+    op_ctx->fsal_export = nullptr;
+    op_ctx->nfs_vers = NFS_V4;
+
+    (void) nfs4_Compound(&arg, &req, res);
+    return res->res_compound4.status;
+  }
+
+  nfs_resop4 *compound_res(nfs_res_t *res, u_int i) {
+    return &res->res_compound4.resarray.resarray_val[i];
+  }
+
+  void copy_fh(nfs_fh4 *dst, nfs_fh4 *src) {
+    dst->nfs_fh4_len = src->nfs_fh4_len;
+    dst->nfs_fh4_val = (char *)gsh_malloc(src->nfs_fh4_len);
+    memcpy(dst->nfs_fh4_val, src->nfs_fh4_val, src->nfs_fh4_len);
+  }
+
+  /* OPEN a file of the bench directory for read and write */
+  nfsstat4 open_file(const char *name, bool create, stateid4 *stateid,
+		     nfs_fh4 *fh) {
+    nfs_argop4 ops[3];
+    nfs_res_t res;
+    OPEN4args *open = &ops[1].nfs_argop4_u.opopen;
+    OPEN4resok *resok;
+    nfsstat4 status;
+    bool confirm;
+
+    op_putfh(&ops[0], &dir_fh4);
+    memset(&ops[1], 0, sizeof(ops[1]));
+    ops[1].argop = NFS4_OP_OPEN;
+    open->seqid = open_seqid;
+    open->share_access = OPEN4_SHARE_ACCESS_BOTH;
+    open->share_deny = OPEN4_SHARE_DENY_NONE;
+    open->owner.clientid = clientid;
+    open->owner.owner.owner_len = strlen(open_owner);
+    open->owner.owner.owner_val = open_owner;
+    if (create) {
+      open->openhow.opentype = OPEN4_CREATE;
+      open->openhow.openflag4_u.how.mode = UNCHECKED4;
+    } else {
+      open->openhow.opentype = OPEN4_NOCREATE;
+    }
+    open->claim.claim = CLAIM_NULL;
+    set_component(&open->claim.open_claim4_u.file, name);
+    op_getfh(&ops[2]);
+
+    status = compound(ops, 3, &res);
+    open_seqid++;
+    if (status != NFS4_OK) {
+      nfs4_Compound_Free(&res);
+      return status;
+    }
+
+    resok = &compound_res(&res, 1)->nfs_resop4_u.opopen.OPEN4res_u.resok4;
+    *stateid = resok->stateid;
+    confirm = (resok->rflags & OPEN4_RESULT_CONFIRM) != 0;
+    if (fh != nullptr)
+      copy_fh(fh, &compound_res(&res, 2)->nfs_resop4_u.opgetfh.
+	      GETFH4res_u.resok4.object);
+    nfs4_Compound_Free(&res);
+
+    if (!confirm || fh == nullptr)
+      return NFS4_OK;
+
+    /* First use of the open owner */
+    op_putfh(&ops[0], fh);
+    memset(&ops[1], 0, sizeof(ops[1]));
+    ops[1].argop = NFS4_OP_OPEN_CONFIRM;
+    ops[1].nfs_argop4_u.opopen_confirm.open_stateid = *stateid;
+    ops[1].nfs_argop4_u.opopen_confirm.seqid = open_seqid;
+
+    status = compound(ops, 2, &res);
+    open_seqid++;
+    if (status == NFS4_OK)
+      *stateid = compound_res(&res, 1)->nfs_resop4_u.opopen_confirm.
+	OPEN_CONFIRM4res_u.resok4.open_stateid;
+    nfs4_Compound_Free(&res);
+    return status;
+  }
+
+  nfsstat4 close_file(nfs_fh4 *fh, stateid4 *stateid) {
+    nfs_argop4 ops[2];
+    nfs_res_t res;
+    nfsstat4 status;
+
+    op_putfh(&ops[0], fh);
+    memset(&ops[1], 0, sizeof(ops[1]));
+    ops[1].argop = NFS4_OP_CLOSE;
+    ops[1].nfs_argop4_u.opclose.seqid = open_seqid;
+    ops[1].nfs_argop4_u.opclose.open_stateid = *stateid;
+
+    status = compound(ops, 2, &res);
+    open_seqid++;
+    nfs4_Compound_Free(&res);
+    return status;
+  }
+
+  /* Give an NFSv3 handler the export of the handle, as dispatch does */
+  void nfs3_ctx() {
+    get_gsh_export_ref(a_export);
+    op_ctx->ctx_export = a_export;
+    op_ctx->fsal_export = a_export->fsal_export;
+    op_ctx->nfs_vers = NFS_V3;
+  }
+
+  void nfs3_ctx_done() {
+    put_gsh_export(op_ctx->ctx_export);
+    op_ctx->ctx_export = nullptr;
+    op_ctx->fsal_export = nullptr;
+  }
+
+} /* namespace */
+
+extern "C" {
+
+void *__wrap_malloc(size_t size)
+{
+  allocs++;
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+  allocs++;
+  return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+  allocs++;
+  return __real_realloc(ptr, size);
+}
+
+}
+
+TEST(NFS_BENCH, INIT)
+{
+  fsal_status_t status;
+  struct sockaddr_in *sin = (struct sockaddr_in *)&client_addr;
+
+  a_export = get_gsh_export(export_id);
+  ASSERT_NE(a_export, nullptr);
+
+  status = nfs_export_get_root_entry(a_export, &root_entry);
+  ASSERT_FALSE(FSAL_IS_ERROR(status));
+
+  /* A request from root on 127.0.0.1 over TCP with AUTH_SYS */
+  memset(&client_addr, 0, sizeof(client_addr));
+  sin->sin_family = AF_INET;
+  sin->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  sin->sin_port = htons(1023);
+
+  memset(&xprt, 0, sizeof(xprt));
+  xprt.xp_type = XPRT_TCP;
+
+  memset(&aup, 0, sizeof(aup));
+  memset(&req, 0, sizeof(req));
+  req.rq_xprt = &xprt;
+  req.rq_cred.oa_flavor = AUTH_UNIX;
+  req.rq_clntcred = &aup;
+
+  memset(&user_credentials, 0, sizeof(struct user_cred));
+  memset(&export_perms, 0, sizeof(export_perms));
+  memset(&req_ctx, 0, sizeof(struct req_op_context));
+  req_ctx.creds = &user_credentials;
+  req_ctx.caller_addr = &client_addr;
+  req_ctx.client = get_gsh_client(&client_addr, false);
+  req_ctx.export_perms = &export_perms;
+  req_ctx.req_type = NFS_REQUEST;
+
+  /* stashed in tls */
+  op_ctx = &req_ctx;
+}
+
+TEST(NFS_BENCH, SETUP)
+{
+  struct attrlist object_attributes;
+  fsal_status_t status;
+  nfs_argop4 ops[1];
+  nfs_res_t res;
+  SETCLIENTID4args *sc = &ops[0].nfs_argop4_u.opsetclientid;
+  SETCLIENTID4resok *scok;
+  verifier4 confirm;
+  char client_name[] = "nfs_bench";
+  char netid[] = "tcp";
+  char addr[] = "127.0.0.1.0.0";
+  stateid4 stateid;
+  nfs_fh4 fh;
+  char name[32];
+
+  // the bench directory, from an earlier run if there was one
+  status = fsal_lookup(root_entry, bench_dir, &test_root, nullptr);
+  if (FSAL_IS_ERROR(status)) {
+    memset(&object_attributes, 0, sizeof(object_attributes));
+    FSAL_SET_MASK(object_attributes.mask, ATTR_MODE);
+    object_attributes.mode = 0777;
+    status = root_entry->obj_ops.mkdir(root_entry, bench_dir,
+				      &object_attributes, &test_root,
+				      nullptr);
+  }
+  ASSERT_NE(test_root, nullptr);
+
+  ASSERT_TRUE(nfs4_FSALToFhandle(true, &dir_fh4, test_root, a_export));
+  ASSERT_TRUE(nfs3_FSALToFhandle(true, &dir_fh3, test_root, a_export));
+
+  // an NFSv4.0 client
+  memset(&ops[0], 0, sizeof(ops[0]));
+  ops[0].argop = NFS4_OP_SETCLIENTID;
+  memcpy(sc->client.verifier, "benchver", NFS4_VERIFIER_SIZE);
+  sc->client.id.id_len = strlen(client_name);
+  sc->client.id.id_val = client_name;
+  sc->callback.cb_location.r_netid = netid;
+  sc->callback.cb_location.r_addr = addr;
+  ASSERT_EQ(compound(ops, 1, &res), NFS4_OK);
+  scok = &compound_res(&res, 0)->nfs_resop4_u.opsetclientid.
+    SETCLIENTID4res_u.resok4;
+  clientid = scok->clientid;
+  memcpy(confirm, scok->setclientid_confirm, NFS4_VERIFIER_SIZE);
+  nfs4_Compound_Free(&res);
+
+  memset(&ops[0], 0, sizeof(ops[0]));
+  ops[0].argop = NFS4_OP_SETCLIENTID_CONFIRM;
+  ops[0].nfs_argop4_u.opsetclientid_confirm.clientid = clientid;
+  memcpy(ops[0].nfs_argop4_u.opsetclientid_confirm.setclientid_confirm,
+	 confirm, NFS4_VERIFIER_SIZE);
+  ASSERT_EQ(compound(ops, 1, &res), NFS4_OK);
+  nfs4_Compound_Free(&res);
+
+  // the file read and written, and entries for READDIR
+  ASSERT_EQ(open_file(bench_file, true, &stateid, &file_fh4), NFS4_OK);
+  ASSERT_EQ(close_file(&file_fh4, &stateid), NFS4_OK);
+
+  for (int i = 0; i < bench_entries; i++) {
+    snprintf(name, sizeof(name), "entry%d", i);
+    ASSERT_EQ(open_file(name, true, &stateid, &fh), NFS4_OK);
+    ASSERT_EQ(close_file(&fh, &stateid), NFS4_OK);
+    gsh_free(fh.nfs_fh4_val);
+  }
+
+  memset(io_buf, 'x', sizeof(io_buf));
+}
+
+TEST(NFS_BENCH, GETATTR)
+{
+  nfs_argop4 ops[2];
+
+  op_putfh(&ops[0], &file_fh4);
+  op_getattr(&ops[1]);
+
+  bench("GETATTR", [&]() {
+      nfs_res_t res;
+
+      ASSERT_EQ(compound(ops, 2, &res), NFS4_OK);
+      nfs4_Compound_Free(&res);
+    });
+}
+
+TEST(NFS_BENCH, LOOKUP)
+{
+  nfs_argop4 ops[4];
+
+  op_putfh(&ops[0], &dir_fh4);
+  memset(&ops[1], 0, sizeof(ops[1]));
+  ops[1].argop = NFS4_OP_LOOKUP;
+  set_component(&ops[1].nfs_argop4_u.oplookup.objname, bench_file);
+  op_getfh(&ops[2]);
+  op_getattr(&ops[3]);
+
+  bench("LOOKUP", [&]() {
+      nfs_res_t res;
+
+      ASSERT_EQ(compound(ops, 4, &res), NFS4_OK);
+      nfs4_Compound_Free(&res);
+    });
+}
+
+TEST(NFS_BENCH, READDIR)
+{
+  nfs_argop4 ops[2];
+  READDIR4args *rd = &ops[1].nfs_argop4_u.opreaddir;
+
+  op_putfh(&ops[0], &dir_fh4);
+  memset(&ops[1], 0, sizeof(ops[1]));
+  ops[1].argop = NFS4_OP_READDIR;
+  rd->dircount = 8192;
+  rd->maxcount = 32768;
+  set_attribute_in_bitmap(&rd->attr_request, FATTR4_TYPE);
+  set_attribute_in_bitmap(&rd->attr_request, FATTR4_FILEID);
+  set_attribute_in_bitmap(&rd->attr_request, FATTR4_SIZE);
+
+  bench("READDIR", [&]() {
+      nfs_res_t res;
+
+      ASSERT_EQ(compound(ops, 2, &res), NFS4_OK);
+      nfs4_Compound_Free(&res);
+    });
+}
+
+TEST(NFS_BENCH, OPEN_CLOSE)
+{
+  bench("OPEN+CLOSE", [&]() {
+      stateid4 stateid;
+
+      ASSERT_EQ(open_file(bench_file, false, &stateid, nullptr), NFS4_OK);
+      ASSERT_EQ(close_file(&file_fh4, &stateid), NFS4_OK);
+    });
+}
+
+TEST(NFS_BENCH, READ)
+{
+  nfs_argop4 ops[2];
+
+  op_putfh(&ops[0], &file_fh4);
+  memset(&ops[1], 0, sizeof(ops[1]));
+  ops[1].argop = NFS4_OP_READ;	/* anonymous stateid */
+  ops[1].nfs_argop4_u.opread.count = sizeof(io_buf);
+
+  bench("READ", [&]() {
+      nfs_res_t res;
+
+      ASSERT_EQ(compound(ops, 2, &res), NFS4_OK);
+      nfs4_Compound_Free(&res);
+    });
+}
+
+TEST(NFS_BENCH, WRITE)
+{
+  nfs_argop4 ops[2];
+
+  op_putfh(&ops[0], &file_fh4);
+  memset(&ops[1], 0, sizeof(ops[1]));
+  ops[1].argop = NFS4_OP_WRITE;	/* anonymous stateid */
+  ops[1].nfs_argop4_u.opwrite.stable = UNSTABLE4;
+  ops[1].nfs_argop4_u.opwrite.data.data_len = sizeof(io_buf);
+  ops[1].nfs_argop4_u.opwrite.data.data_val = io_buf;
+
+  bench("WRITE", [&]() {
+      nfs_res_t res;
+
+      ASSERT_EQ(compound(ops, 2, &res), NFS4_OK);
+      nfs4_Compound_Free(&res);
+    });
+}
+
+TEST(NFS_BENCH, LOCK)
+{
+  stateid4 open_stateid, lock_stateid;
+  seqid4 lock_seqid = 0;
+  bool new_owner = true;
+
+  ASSERT_EQ(open_file(bench_file, false, &open_stateid, nullptr), NFS4_OK);
+
+  bench("LOCK+LOCKU", [&]() {
+      nfs_argop4 ops[2];
+      nfs_res_t res;
+      LOCK4args *lock = &ops[1].nfs_argop4_u.oplock;
+      LOCKU4args *locku = &ops[1].nfs_argop4_u.oplocku;
+
+      op_putfh(&ops[0], &file_fh4);
+      memset(&ops[1], 0, sizeof(ops[1]));
+      ops[1].argop = NFS4_OP_LOCK;
+      lock->locktype = WRITE_LT;
+      lock->offset = 0;
+      lock->length = 1;
+      lock->locker.new_lock_owner = new_owner;
+      if (new_owner) {
+	open_to_lock_owner4 *owner = &lock->locker.locker4_u.open_owner;
+
+	owner->open_seqid = open_seqid++;
+	owner->open_stateid = open_stateid;
+	owner->lock_seqid = lock_seqid;
+	owner->lock_owner.clientid = clientid;
+	owner->lock_owner.owner.owner_len = strlen(lock_owner);
+	owner->lock_owner.owner.owner_val = lock_owner;
+      } else {
+	lock->locker.locker4_u.lock_owner.lock_stateid = lock_stateid;
+	lock->locker.locker4_u.lock_owner.lock_seqid = lock_seqid;
+      }
+      ASSERT_EQ(compound(ops, 2, &res), NFS4_OK);
+      lock_stateid = compound_res(&res, 1)->nfs_resop4_u.oplock.
+	LOCK4res_u.resok4.lock_stateid;
+      nfs4_Compound_Free(&res);
+      lock_seqid++;
+      new_owner = false;
+
+      memset(&ops[1], 0, sizeof(ops[1]));
+      ops[1].argop = NFS4_OP_LOCKU;
+      locku->locktype = WRITE_LT;
+      locku->seqid = lock_seqid++;
+      locku->lock_stateid = lock_stateid;
+      locku->offset = 0;
+      locku->length = 1;
+      ASSERT_EQ(compound(ops, 2, &res), NFS4_OK);
+      lock_stateid = compound_res(&res, 1)->nfs_resop4_u.oplocku.
+	LOCKU4res_u.lock_stateid;
+      nfs4_Compound_Free(&res);
+    });
+
+  ASSERT_EQ(close_file(&file_fh4, &open_stateid), NFS4_OK);
+}
+
+TEST(NFS_BENCH, NFS3_GETATTR)
+{
+  struct fsal_obj_handle *obj;
+  fsal_status_t status;
+
+  status = fsal_lookup(test_root, bench_file, &obj, nullptr);
+  ASSERT_FALSE(FSAL_IS_ERROR(status));
+  ASSERT_TRUE(nfs3_FSALToFhandle(true, &file_fh3, obj, a_export));
+  obj->obj_ops.put_ref(obj);
+
+  bench("NFS3 GETATTR", [&]() {
+      nfs_arg_t arg;
+      nfs_res_t res;
+
+      memset(&arg, 0, sizeof(arg));
+      arg.arg_getattr3.object = file_fh3;
+      nfs3_ctx();
+      (void) nfs3_getattr(&arg, &req, &res);
+      nfs3_ctx_done();
+      ASSERT_EQ(res.res_getattr3.status, NFS3_OK);
+      nfs3_getattr_free(&res);
+    });
+}
+
+TEST(NFS_BENCH, NFS3_LOOKUP)
+{
+  bench("NFS3 LOOKUP", [&]() {
+      nfs_arg_t arg;
+      nfs_res_t res;
+
+      memset(&arg, 0, sizeof(arg));
+      arg.arg_lookup3.what.dir = dir_fh3;
+      arg.arg_lookup3.what.name = (char *)bench_file;
+      nfs3_ctx();
+      (void) nfs3_lookup(&arg, &req, &res);
+      nfs3_ctx_done();
+      ASSERT_EQ(res.res_lookup3.status, NFS3_OK);
+      nfs3_lookup_free(&res);
+    });
+}
+
+TEST(NFS_BENCH, NFS3_READDIR)
+{
+  bench("NFS3 READDIR", [&]() {
+      nfs_arg_t arg;
+      nfs_res_t res;
+
+      memset(&arg, 0, sizeof(arg));
+      arg.arg_readdir3.dir = dir_fh3;
+      arg.arg_readdir3.count = 32768;
+      nfs3_ctx();
+      (void) nfs3_readdir(&arg, &req, &res);
+      nfs3_ctx_done();
+      ASSERT_EQ(res.res_readdir3.status, NFS3_OK);
+      nfs3_readdir_free(&res);
+    });
+}
+
+TEST(NFS_BENCH, NFS3_READ)
+{
+  bench("NFS3 READ", [&]() {
+      nfs_arg_t arg;
+      nfs_res_t res;
+
+      memset(&arg, 0, sizeof(arg));
+      arg.arg_read3.file = file_fh3;
+      arg.arg_read3.count = sizeof(io_buf);
+      nfs3_ctx();
+      (void) nfs3_read(&arg, &req, &res);
+      nfs3_ctx_done();
+      ASSERT_EQ(res.res_read3.status, NFS3_OK);
+      nfs3_read_free(&res);
+    });
+}
+
+TEST(NFS_BENCH, NFS3_WRITE)
+{
+  bench("NFS3 WRITE", [&]() {
+      nfs_arg_t arg;
+      nfs_res_t res;
+
+      memset(&arg, 0, sizeof(arg));
+      arg.arg_write3.file = file_fh3;
+      arg.arg_write3.count = sizeof(io_buf);
+      arg.arg_write3.stable = UNSTABLE;
+      arg.arg_write3.data.data_len = sizeof(io_buf);
+      arg.arg_write3.data.data_val = io_buf;
+      nfs3_ctx();
+      (void) nfs3_write(&arg, &req, &res);
+      nfs3_ctx_done();
+      ASSERT_EQ(res.res_write3.status, NFS3_OK);
+      nfs3_write_free(&res);
+    });
+}
+
+int main(int argc, char *argv[])
+{
+  int code = 0;
+
+  using namespace std;
+  using namespace std::literals;
+  namespace po = boost::program_options;
+
+  po::options_description opts("program options");
+  po::variables_map vm;
+
+  try {
+
+    opts.add_options()
+      ("config", po::value<string>(),
+	"path to Ganesha conf file")
+
+      ("logfile", po::value<string>(),
+	"log to the provided file path")
+
+      ("export", po::value<uint16_t>(),
+	"id of export on which to operate (must exist)")
+
+      ("iterations", po::value<uint32_t>(),
+	"operations timed by each benchmark")
+
+      ("debug", po::value<string>(),
+	"ganesha debug level")
+
+      ("alloc-baseline", po::value<string>(),
+	"file of allocs/op a benchmark must not exceed")
+
+      ("alloc-update", "write this run's allocs/op to --alloc-baseline")
+
+      ("json", po::value<string>(),
+	"write the results to this file, and stop ganesha once done")
+      ;
+
+    po::variables_map::iterator vm_iter;
+    po::store(po::parse_command_line(argc, argv, opts), vm);
+    po::notify(vm);
+
+    // use config vars--leaves them on the stack
+    vm_iter = vm.find("config");
+    if (vm_iter != vm.end()) {
+      ganesha_conf = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("logfile");
+    if (vm_iter != vm.end()) {
+      lpath = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("debug");
+    if (vm_iter != vm.end()) {
+      dlevel = ReturnLevelAscii(
+	(char*) vm_iter->second.as<std::string>().c_str());
+    }
+    vm_iter = vm.find("export");
+    if (vm_iter != vm.end()) {
+      export_id = vm_iter->second.as<uint16_t>();
+    }
+    vm_iter = vm.find("iterations");
+    if (vm_iter != vm.end()) {
+      iterations = vm_iter->second.as<uint32_t>();
+    }
+    vm_iter = vm.find("alloc-baseline");
+    if (vm_iter != vm.end()) {
+      alloc_baseline = vm_iter->second.as<std::string>();
+      read_baseline();
+    }
+    alloc_update = vm.count("alloc-update") != 0;
+
+    ::testing::InitGoogleTest(&argc, argv);
+
+    std::thread ganesha(ganesha_server);
+    std::this_thread::sleep_for(5s);
+
+    code  = RUN_ALL_TESTS();
+    if (alloc_update && !alloc_baseline.empty())
+      write_baseline();
+    vm_iter = vm.find("json");
+    if (vm_iter != vm.end()) {
+      if (!bench_json::write(vm_iter->second.as<std::string>(), "nfs_bench"))
+	code = 1;
+      admin_halt();
+    }
+    ganesha.join();
+  }
+
+  catch(po::error& e) {
+    cout << "Error parsing opts " << e.what() << endl;
+  }
+
+  catch(...) {
+    cout << "Unhandled exception in main()" << endl;
+  }
+
+  return code;
+}
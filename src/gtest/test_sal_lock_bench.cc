@@ -0,0 +1,292 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/*
+ * SAL lock benchmarks.
+ *
+ * Runs the multilock stress patterns in-process, with state_lock() and
+ * state_unlock() on a file made under the root of --export, for 1, 2,
+ * 4 ... --threads threads, and prints the lock and unlock latency
+ * histograms.  The storm pattern is left out, blocking locks need a
+ * protocol to grant them.  With --json the rates and mean latencies
+ * are also written for the bench target.
+ */
+
+#include <sys/types.h>
+#include <iostream>
+#include <string>
+#include <thread>
+#include "gtest/gtest.h"
+#include <boost/program_options.hpp>
+#include "bench_json.h"
+
+extern "C" {
+/* Ganesha headers */
+#include "nfs_lib.h"
+#include "export_mgr.h"
+#include "nfs_exports.h"
+#include "sal_data.h"
+#include "fsal.h"
+#include "sal_lock_bench.h"
+
+/* From nfs_core.h, which C++ cannot include */
+void admin_halt(void);
+}
+
+namespace {
+
+  char* ganesha_conf = nullptr;
+  char* lpath = nullptr;
+  int dlevel = -1;
+  uint16_t export_id = 77;
+  uint32_t max_threads = std::thread::hardware_concurrency();
+  uint32_t iterations = 10000;
+  uint32_t owners = 1024;
+
+  const char bench_file[] = "sal_lock_bench";
+
+  struct req_op_context req_ctx;
+  struct user_cred user_credentials;
+  struct attrlist object_attributes;
+
+  struct gsh_export* a_export = nullptr;
+  struct fsal_obj_handle *root_entry = nullptr;
+  struct fsal_obj_handle *test_file = nullptr;
+
+  int ganesha_server() {
+    return nfs_libmain(
+      ganesha_conf,
+      lpath,
+      dlevel
+      );
+  }
+
+  void record(const std::string& name, struct ml_hist *hist,
+	      double seconds) {
+    if (hist->count == 0)
+      return;
+    bench_json::record(name, "ops/s",
+		       seconds > 0 ? hist->count / seconds : 0.0, true);
+    bench_json::record(name, "avg ns",
+		       (double)hist->total_ns / hist->count);
+  }
+
+  void scale(enum ml_pattern pattern) {
+    struct ml_stress stress;
+
+    for (uint32_t n = 1; n <= max_threads; n *= 2) {
+      memset(&stress, 0, sizeof(stress));
+      stress.pattern = pattern;
+      stress.owners = owners;
+      stress.threads = n;
+      stress.iterations = iterations;
+      stress.range = 4096;
+      stress.write_pct = 50;
+      stress.backend = &sal_lock_backend;
+
+      ASSERT_EQ(ml_stress_run(&stress), 0);
+      EXPECT_EQ(stress.lock.errors, 0U);
+      EXPECT_EQ(stress.unlock.errors, 0U);
+
+      std::cout << ml_pattern_name(pattern) << ": " << owners
+		<< " owners, " << n << " threads" << std::endl;
+      ml_hist_print(stdout, "lock", &stress.lock, stress.seconds);
+      ml_hist_print(stdout, "unlock", &stress.unlock, stress.seconds);
+      fflush(stdout);
+
+      std::string key = std::string(ml_pattern_name(pattern)) +
+	" threads " + std::to_string(n);
+
+      record(key + " lock", &stress.lock, stress.seconds);
+      record(key + " unlock", &stress.unlock, stress.seconds);
+    }
+  }
+
+} /* namespace */
+
+TEST(SAL_LOCK_BENCH, INIT)
+{
+  fsal_status_t status;
+
+  a_export = get_gsh_export(export_id);
+  ASSERT_NE(a_export, nullptr);
+
+  status = nfs_export_get_root_entry(a_export, &root_entry);
+  ASSERT_FALSE(FSAL_IS_ERROR(status));
+
+  /* Ganesha call paths need real or forged context info */
+  memset(&user_credentials, 0, sizeof(struct user_cred));
+  memset(&req_ctx, 0, sizeof(struct req_op_context));
+  req_ctx.ctx_export = a_export;
+  req_ctx.fsal_export = a_export->fsal_export;
+  req_ctx.creds = &user_credentials;
+
+  /* stashed in tls */
+  op_ctx = &req_ctx;
+}
+
+TEST(SAL_LOCK_BENCH, SETUP)
+{
+  fsal_status_t status;
+
+  // the bench file, from an earlier run if there was one
+  status = fsal_lookup(root_entry, bench_file, &test_file, nullptr);
+  if (FSAL_IS_ERROR(status)) {
+    memset(&object_attributes, 0, sizeof(object_attributes));
+    FSAL_SET_MASK(object_attributes.mask, ATTR_MODE);
+    object_attributes.mode = 0666;
+    status = fsal_create(root_entry, bench_file, REGULAR_FILE,
+			 &object_attributes, nullptr, &test_file, nullptr);
+  }
+  ASSERT_FALSE(FSAL_IS_ERROR(status));
+
+  if (max_threads == 0)
+    max_threads = 1;
+  ASSERT_GE(owners, max_threads);
+  ASSERT_EQ(sal_lock_bench_setup(test_file, owners), 0);
+}
+
+TEST(SAL_LOCK_BENCH, DISJOINT)
+{
+  scale(ML_PATTERN_DISJOINT);
+}
+
+TEST(SAL_LOCK_BENCH, OVERLAP)
+{
+  scale(ML_PATTERN_OVERLAP);
+}
+
+TEST(SAL_LOCK_BENCH, SPLIT)
+{
+  scale(ML_PATTERN_SPLIT);
+}
+
+TEST(SAL_LOCK_BENCH, MERGE)
+{
+  scale(ML_PATTERN_MERGE);
+}
+
+TEST(SAL_LOCK_BENCH, TEARDOWN)
+{
+  sal_lock_bench_teardown();
+  test_file->obj_ops.put_ref(test_file);
+}
+
+int main(int argc, char *argv[])
+{
+  int code = 0;
+
+  using namespace std;
+  using namespace std::literals;
+  namespace po = boost::program_options;
+
+  po::options_description opts("program options");
+  po::variables_map vm;
+
+  try {
+
+    opts.add_options()
+      ("config", po::value<string>(),
+	"path to Ganesha conf file")
+
+      ("logfile", po::value<string>(),
+	"log to the provided file path")
+
+      ("export", po::value<uint16_t>(),
+	"id of export on which to operate (must exist)")
+
+      ("threads", po::value<uint32_t>(),
+	"most threads to scale to")
+
+      ("iterations", po::value<uint32_t>(),
+	"operations timed per thread")
+
+      ("owners", po::value<uint32_t>(),
+	"lock owners, at least --threads")
+
+      ("debug", po::value<string>(),
+	"ganesha debug level")
+
+      ("json", po::value<string>(),
+	"write the results to this file, and stop ganesha once done")
+      ;
+
+    po::variables_map::iterator vm_iter;
+    po::store(po::parse_command_line(argc, argv, opts), vm);
+    po::notify(vm);
+
+    // use config vars--leaves them on the stack
+    vm_iter = vm.find("config");
+    if (vm_iter != vm.end()) {
+      ganesha_conf = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("logfile");
+    if (vm_iter != vm.end()) {
+      lpath = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("debug");
+    if (vm_iter != vm.end()) {
+      dlevel = ReturnLevelAscii(
+	(char*) vm_iter->second.as<std::string>().c_str());
+    }
+    vm_iter = vm.find("export");
+    if (vm_iter != vm.end()) {
+      export_id = vm_iter->second.as<uint16_t>();
+    }
+    vm_iter = vm.find("threads");
+    if (vm_iter != vm.end()) {
+      max_threads = vm_iter->second.as<uint32_t>();
+    }
+    vm_iter = vm.find("iterations");
+    if (vm_iter != vm.end()) {
+      iterations = vm_iter->second.as<uint32_t>();
+    }
+    vm_iter = vm.find("owners");
+    if (vm_iter != vm.end()) {
+      owners = vm_iter->second.as<uint32_t>();
+    }
+
+    ::testing::InitGoogleTest(&argc, argv);
+
+    std::thread ganesha(ganesha_server);
+    std::this_thread::sleep_for(5s);
+
+    code  = RUN_ALL_TESTS();
+    vm_iter = vm.find("json");
+    if (vm_iter != vm.end()) {
+      if (!bench_json::write(vm_iter->second.as<std::string>(),
+			     "sal_lock_bench"))
+	code = 1;
+      admin_halt();
+    }
+    ganesha.join();
+  }
+
+  catch(po::error& e) {
+    cout << "Error parsing opts " << e.what() << endl;
+  }
+
+  catch(...) {
+    cout << "Unhandled exception in main()" << endl;
+  }
+
+  return code;
+}
@@ -39,6 +39,21 @@
  * determines which of the partitions (each containing a tree and each
  * separately locked), and a hash which acts as the key within an
  * individual Red-Black Tree.
+ *
+ * Tables created with HT_FLAG_LOCKLESS_READ are searched by
+ * HashTable_Get and hashtable_getref without the partition lock.
+ * Writers still take it, but mark each change of a tree in the
+ * partition's sequence and do not free an unlinked node or replaced
+ * key/value pair until every lockless reader that might see it has
+ * finished, so a reader can always follow the pointers it finds.
+ *
+ * The number of partitions is fixed, as the tables' own index
+ * functions reduce modulo it, and a partition's tree stays balanced
+ * however large it gets.  What falls behind as a table fills is the
+ * expected entry cache in front of each tree, so in tables created
+ * with HT_FLAG_GROW each partition doubles its cache, on its own and
+ * under its own lock, whenever it holds more than HT_CACHE_LOAD
+ * entries per slot.
  */
 
 #include "config.h"
@@ -46,26 +61,165 @@
 #include <stdio.h>
 #include <string.h>
 #include <pthread.h>
+#include <sched.h>
 #include "hashtable.h"
 #include "log.h"
 #include "abstract_atomic.h"
 #include "common_utils.h"
+#include "gsh_list.h"
 #include <assert.h>
 
+/** Times a lockless lookup races a writer before taking the lock */
+#define HT_LOCKLESS_TRIES 4
+
+/** Slots in the first cache of a growing partition */
+#define HT_CACHE_MIN 1024
+/** Slots past which a partition's cache does not grow */
+#define HT_CACHE_MAX (1 << 20)
+/** Entries per slot at which a partition's cache grows */
+#define HT_CACHE_LOAD 2
+
 /**
- * @brief Total size of the cache page configured for a table
+ * @brief A thread that reads without locks
  *
- * This function returns the size of the cache page for the given hash
- * table, based on the configured entry count.
+ * While a thread searches a lockless table it publishes the grace
+ * period it started in, and zero the rest of the time.  Each thread
+ * writes only its own, so readers share no cache line.
+ */
+struct ht_reader {
+	struct glist_head list;	/*< On ht_readers */
+	uint64_t epoch;		/*< Grace period of the current read, or 0 */
+};
+
+/** The current grace period, only ever increased */
+static uint64_t ht_epoch = 1;
+
+/** Every thread that has read a lockless table */
+static struct glist_head ht_readers = GLIST_HEAD_INIT(ht_readers);
+static pthread_mutex_t ht_readers_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_key_t ht_reader_key;
+static pthread_once_t ht_reader_once = PTHREAD_ONCE_INIT;
+static __thread struct ht_reader *ht_reader;
+
+static void ht_reader_exit(void *arg)
+{
+	struct ht_reader *reader = arg;
+
+	PTHREAD_MUTEX_lock(&ht_readers_mutex);
+	glist_del(&reader->list);
+	PTHREAD_MUTEX_unlock(&ht_readers_mutex);
+
+	gsh_free(reader);
+}
+
+static void ht_reader_key_init(void)
+{
+	(void) pthread_key_create(&ht_reader_key, ht_reader_exit);
+}
+
+/**
+ * @brief Start a lockless read
  *
- * @param[in] ht The hash table to query
+ * Registers the thread on its first read.  Publishing the epoch is a
+ * full barrier, so no pointer in the tables is loaded before a
+ * writer's ht_synchronize can see this thread is reading.
  *
- * @return The cache page size
+ * @return The thread's reader, to pass to ht_read_unlock.
  */
-static inline size_t
-cache_page_size(const hash_table_t *ht)
+static inline struct ht_reader *ht_read_lock(void)
+{
+	struct ht_reader *reader = ht_reader;
+
+	if (unlikely(reader == NULL)) {
+		(void) pthread_once(&ht_reader_once, ht_reader_key_init);
+		reader = gsh_calloc(1, sizeof(*reader));
+
+		PTHREAD_MUTEX_lock(&ht_readers_mutex);
+		glist_add_tail(&ht_readers, &reader->list);
+		PTHREAD_MUTEX_unlock(&ht_readers_mutex);
+
+		(void) pthread_setspecific(ht_reader_key, reader);
+		ht_reader = reader;
+	}
+
+	atomic_store_uint64_t(&reader->epoch,
+			      atomic_fetch_uint64_t(&ht_epoch));
+	return reader;
+}
+
+static inline void ht_read_unlock(struct ht_reader *reader)
 {
-	return (ht->parameter.cache_entry_count) * sizeof(struct rbt_node *);
+	atomic_store_uint64_t(&reader->epoch, 0);
+}
+
+/**
+ * @brief Wait for every lockless read begun before now
+ *
+ * Anything unlinked from a table before this call can be freed after
+ * it: a reader that started later cannot reach it.  Must not be
+ * called inside a read; it may be called with a partition locked,
+ * since readers never wait on partition locks while reading.
+ */
+static void ht_synchronize(void)
+{
+	uint64_t target = atomic_inc_uint64_t(&ht_epoch);
+	struct glist_head *glist;
+	struct ht_reader *reader;
+	uint64_t epoch;
+
+	PTHREAD_MUTEX_lock(&ht_readers_mutex);
+
+	glist_for_each(glist, &ht_readers) {
+		reader = glist_entry(glist, struct ht_reader, list);
+
+		/* Reads are a single tree walk, so this is short unless
+		 * the reader was preempted.
+		 */
+		for (epoch = atomic_fetch_uint64_t(&reader->epoch);
+		     epoch != 0 && epoch < target;
+		     epoch = atomic_fetch_uint64_t(&reader->epoch))
+			(void) sched_yield();
+	}
+
+	PTHREAD_MUTEX_unlock(&ht_readers_mutex);
+}
+
+static inline bool ht_lockless(const struct hash_table *ht)
+{
+	return (ht->parameter.flags & HT_FLAG_LOCKLESS_READ) != 0;
+}
+
+/**
+ * @brief Mark the start or end of a change to a partition's tree
+ *
+ * The increment is a full barrier, so a node is filled in before it
+ * can be linked and a lockless reader that saw the old tree sees the
+ * sequence move.
+ */
+static inline void ht_write_seq(struct hash_table *ht,
+				struct hash_partition *partition)
+{
+	if (ht_lockless(ht))
+		(void) atomic_inc_uint32_t(&partition->seq);
+}
+
+/**
+ * @brief Allocate an empty cache
+ *
+ * @param[in] size Number of slots
+ *
+ * @return The cache.
+ */
+static inline struct ht_cache *
+cache_new(uint32_t size)
+{
+	struct ht_cache *cache;
+
+	cache = gsh_calloc(1, sizeof(struct ht_cache) +
+			   size * sizeof(struct rbt_node *));
+	cache->size = size;
+	return cache;
 }
 
 /**
@@ -74,16 +228,81 @@ cache_page_size(const hash_table_t *ht)
  * This function returns the offset into a cache array of the given
  * hash value.
  *
- * @param[in] ht      The hash table to query
+ * @param[in] cache   The cache to query
  * @param[in] rbthash The hash value to look up
  *
  * @return the offset into the cache at which the hash value might be
  *         found
  */
 static inline int
-cache_offsetof(struct hash_table *ht, uint64_t rbthash)
+cache_offsetof(const struct ht_cache *cache, uint64_t rbthash)
+{
+	return rbthash % cache->size;
+}
+
+/**
+ * @brief The cache slot for a hash value
+ */
+static inline void **
+cache_slot(struct ht_cache *cache, uint64_t rbthash)
 {
-	return rbthash % ht->parameter.cache_entry_count;
+	return (void **)&cache->slot[cache_offsetof(cache, rbthash)];
+}
+
+/**
+ * @brief Grow a partition's cache if it holds too many entries
+ *
+ * The new cache is seeded from the old one slot by slot, so what the
+ * old one expected is still found, and then replaces it whole.  That
+ * costs one pass over the old slots with only this partition locked;
+ * the rest of the table is not held up.  The old cache is freed once
+ * no lockless reader can still be looking at it.
+ *
+ * Must be called with the partition write-locked.
+ *
+ * @param[in] ht        The hash table
+ * @param[in] partition The partition just added to
+ */
+static void
+cache_grow(struct hash_table *ht, struct hash_partition *partition)
+{
+	struct ht_cache *old = partition->cache;
+	struct ht_cache *cache;
+	struct rbt_node *node;
+	uint32_t size = old != NULL ? old->size : 0;
+	uint32_t i;
+
+	if (partition->count <= (size_t) size * HT_CACHE_LOAD ||
+	    size >= HT_CACHE_MAX)
+		return;
+
+	if (size == 0)
+		size = HT_CACHE_MIN;
+	else
+		size = size < HT_CACHE_MAX / 2 ? size * 2 : HT_CACHE_MAX;
+
+	cache = cache_new(size);
+
+	for (i = 0; old != NULL && i < old->size; i++) {
+		node = old->slot[i];
+		if (node != NULL)
+			*cache_slot(cache, RBT_VALUE(node)) = node;
+	}
+
+	atomic_store_voidptr((void **)&partition->cache, cache);
+	(void) atomic_inc_uint32_t(&ht->cache_grows);
+
+	LogDebug(COMPONENT_HASHTABLE,
+		 "%s partition %td cache grown to %" PRIu32
+		 " slots for %zu entries",
+		 ht->parameter.ht_name, partition - ht->partitions,
+		 size, partition->count);
+
+	if (old != NULL) {
+		if (ht_lockless(ht))
+			ht_synchronize();
+		gsh_free(old);
+	}
 }
 
 /**
@@ -132,6 +351,10 @@ hash_table_err_to_str(hash_error_t err)
  * @param[in]  key     The key to look up
  * @param[in]  index   Index into RBT array
  * @param[in]  rbthash Hash in red-black tree
+ * @param[in]  locked  The partition is locked, so the found node may
+ *                     be cached.  A lockless reader must not, since
+ *                     the node could be deleted and the slot cleared
+ *                     before it stores it.
  * @param[out] node    On success, the found node, NULL otherwise
  *
  * @retval HASHTABLE_SUCCESS if successfull
@@ -139,11 +362,16 @@ hash_table_err_to_str(hash_error_t err)
  */
 static hash_error_t
 key_locate(struct hash_table *ht, const struct gsh_buffdesc *key,
-	   uint32_t index, uint64_t rbthash, struct rbt_node **node)
+	   uint32_t index, uint64_t rbthash, bool locked,
+	   struct rbt_node **node)
 {
 	/* The current partition */
 	struct hash_partition *partition = &(ht->partitions[index]);
 
+	/* Its cache, which a lockless reader may see replaced */
+	struct ht_cache *cache = atomic_fetch_voidptr(
+					(void **)&partition->cache);
+
 	/* The root of the red black tree matching this index */
 	struct rbt_head *root = NULL;
 
@@ -159,16 +387,14 @@ key_locate(struct hash_table *ht, const struct gsh_buffdesc *key,
 
 	*node = NULL;
 
-	if (partition->cache) {
-		void **cache_slot = (void **)
-		    &(partition->cache[cache_offsetof(ht, rbthash)]);
-		cursor = atomic_fetch_voidptr(cache_slot);
+	if (cache) {
+		cursor = atomic_fetch_voidptr(cache_slot(cache, rbthash));
 		LogFullDebug(COMPONENT_HASHTABLE_CACHE,
 			     "hash %s index %" PRIu32 " slot %d",
 			     (cursor) ? "hit" : "miss", index,
-			     cache_offsetof(ht, rbthash));
+			     cache_offsetof(cache, rbthash));
 		if (cursor) {
-			data = RBT_OPAQ(cursor);
+			data = atomic_fetch_voidptr(&RBT_OPAQ(cursor));
 			if (ht->parameter.
 			    compare_key((struct gsh_buffdesc *)key,
 					&(data->key)) == 0) {
@@ -193,16 +419,14 @@ key_locate(struct hash_table *ht, const struct gsh_buffdesc *key,
 	}
 
 	while ((cursor != NULL) && (RBT_VALUE(cursor) == rbthash)) {
-		data = RBT_OPAQ(cursor);
+		data = atomic_fetch_voidptr(&RBT_OPAQ(cursor));
 		if (ht->parameter.
 		    compare_key((struct gsh_buffdesc *)key,
 				&(data->key)) == 0) {
-			if (partition->cache) {
-				void **cache_slot = (void **)
-				    &(partition->
-				      cache[cache_offsetof(ht, rbthash)]);
-				atomic_store_voidptr(cache_slot, cursor);
-			}
+			if (cache && locked)
+				atomic_store_voidptr(cache_slot(cache,
+								rbthash),
+						     cursor);
 			found = true;
 			break;
 		}
@@ -223,6 +447,74 @@ key_locate(struct hash_table *ht, const struct gsh_buffdesc *key,
 	return HASHTABLE_SUCCESS;
 }
 
+/**
+ * @brief Look up a key without taking the partition lock
+ *
+ * The walk runs inside a lockless read, so nothing it reaches is
+ * freed under it, and get_ref is called inside it too: a writer that
+ * deletes the entry does not return from hashtable_releaselatched,
+ * and so cannot drop the table's hold on the value, until this read
+ * is done.  A walk that races a rotation may be steered wrong and
+ * miss the key, so a miss only stands if the partition's sequence did
+ * not move while it ran.
+ *
+ * @param[in]  ht      The hashtable to be used
+ * @param[in]  key     The key to look up
+ * @param[in]  index   Index into RBT array
+ * @param[in]  rbthash Hash in red-black tree
+ * @param[out] val     If non-NULL, the value found
+ * @param[in]  get_ref If non-NULL, called on the value found
+ * @param[out] rc      HASHTABLE_SUCCESS or HASHTABLE_ERROR_NO_SUCH_KEY
+ *
+ * @retval true if rc is the answer.
+ * @retval false if every try raced a writer; look up under the lock.
+ */
+static bool
+key_locate_lockless(struct hash_table *ht, const struct gsh_buffdesc *key,
+		    uint32_t index, uint64_t rbthash,
+		    struct gsh_buffdesc *val,
+		    void (*get_ref)(struct gsh_buffdesc *),
+		    hash_error_t *rc)
+{
+	struct hash_partition *partition = &ht->partitions[index];
+	struct ht_reader *reader = ht_read_lock();
+	struct rbt_node *locator = NULL;
+	struct hash_data *data;
+	uint32_t seq;
+	int tries;
+
+	for (tries = 0; tries < HT_LOCKLESS_TRIES; tries++) {
+		seq = atomic_fetch_uint32_t(&partition->seq);
+		if (seq & 1)
+			continue;
+
+		*rc = key_locate(ht, key, index, rbthash, false, &locator);
+
+		if (*rc == HASHTABLE_SUCCESS) {
+			/* A node with the key was in the tree during the
+			 * walk, whatever the writers did meanwhile.
+			 */
+			data = atomic_fetch_voidptr(&RBT_OPAQ(locator));
+			if (val) {
+				val->addr = data->val.addr;
+				val->len = data->val.len;
+				if (get_ref != NULL)
+					get_ref(val);
+			}
+			ht_read_unlock(reader);
+			return true;
+		}
+
+		if (atomic_fetch_uint32_t(&partition->seq) == seq) {
+			ht_read_unlock(reader);
+			return true;
+		}
+	}
+
+	ht_read_unlock(reader);
+	return false;
+}
+
 /**
  * @brief Compute the values to search a hash store
  *
@@ -336,9 +628,12 @@ hashtable_init(struct hash_param *hparam)
 			goto deconstruct;
 		}
 
-		/* Allocate a cache if requested */
+		/* Allocate a cache if requested, a growing table without
+		 * one allocates it as the partition fills.
+		 */
 		if (hparam->flags & HT_FLAG_CACHE)
-			partition->cache = gsh_calloc(1, cache_page_size(ht));
+			partition->cache =
+				cache_new(hparam->cache_entry_count);
 
 		completed++;
 	}
@@ -352,8 +647,7 @@ hashtable_init(struct hash_param *hparam)
  deconstruct:
 
 	while (completed != 0) {
-		if (hparam->flags & HT_FLAG_CACHE)
-			gsh_free(ht->partitions[completed - 1].cache);
+		gsh_free(ht->partitions[completed - 1].cache);
 
 		PTHREAD_RWLOCK_destroy(&(ht->partitions[completed - 1].lock));
 		completed--;
@@ -425,6 +719,9 @@ hashtable_destroy(struct hash_table *ht,
  * @brief[out] latch     Opaque structure holding information on the
  *                       table.
  *
+ * A lookup with neither may_write nor a latch in a table with
+ * HT_FLAG_LOCKLESS_READ takes no lock.
+ *
  * @retval HASHTABLE_SUCCESS The entry was found, the table is
  *         latched.
  * @retval HASHTABLE_ERROR_NOT_FOUND The entry was not found, the
@@ -455,13 +752,17 @@ hashtable_getlatch(struct hash_table *ht,
 	if (rc != HASHTABLE_SUCCESS)
 		return rc;
 
+	if (ht_lockless(ht) && latch == NULL &&
+	    key_locate_lockless(ht, key, index, rbt_hash, val, NULL, &rc))
+		goto out;
+
 	/* Acquire mutex */
 	if (may_write)
 		PTHREAD_RWLOCK_wrlock(&(ht->partitions[index].lock));
 	else
 		PTHREAD_RWLOCK_rdlock(&(ht->partitions[index].lock));
 
-	rc = key_locate(ht, key, index, rbt_hash, &locator);
+	rc = key_locate(ht, key, index, rbt_hash, true, &locator);
 
 	if (rc == HASHTABLE_SUCCESS) {
 		/* Key was found */
@@ -492,10 +793,13 @@ hashtable_getlatch(struct hash_table *ht,
 		latch->index = index;
 		latch->rbt_hash = rbt_hash;
 		latch->locator = locator;
+		latch->retired_node = NULL;
+		latch->retired_data = NULL;
 	} else {
 		PTHREAD_RWLOCK_unlock(&ht->partitions[index].lock);
 	}
 
+ out:
 	if (rc != HASHTABLE_SUCCESS && isDebug(COMPONENT_HASHTABLE)
 	    && isFullDebug(ht->parameter.ht_log_component))
 		LogFullDebug(ht->parameter.ht_log_component,
@@ -515,6 +819,10 @@ hashtable_getlatch(struct hash_table *ht,
  * freed by some other means (hashtable_setlatched or
  * HashTable_DelLatched).
  *
+ * In a lockless table, anything deleted or replaced under the latch
+ * is freed here once no lockless reader can still be using it, so
+ * when this returns the caller may free the old value.
+ *
  * @param[in] ht    The hash table with the lock to be released
  * @param[in] latch The latch structure holding retained state
  */
@@ -524,6 +832,16 @@ hashtable_releaselatched(struct hash_table *ht, struct hash_latch *latch)
 {
 	if (latch) {
 		PTHREAD_RWLOCK_unlock(&ht->partitions[latch->index].lock);
+
+		if (latch->retired_node != NULL ||
+		    latch->retired_data != NULL) {
+			ht_synchronize();
+			if (latch->retired_data != NULL)
+				pool_free(ht->data_pool, latch->retired_data);
+			if (latch->retired_node != NULL)
+				pool_free(ht->node_pool, latch->retired_node);
+		}
+
 		memset(latch, 0, sizeof(struct hash_latch));
 	}
 }
@@ -571,6 +889,8 @@ hashtable_setlatched(struct hash_table *ht,
 	struct rbt_node *locator = NULL;
 	/* New node for the case of non-overwrite */
 	struct rbt_node *mutator = NULL;
+	/* The latched partition */
+	struct hash_partition *partition = &ht->partitions[latch->index];
 
 	if (isDebug(COMPONENT_HASHTABLE)
 	    && isFullDebug(ht->parameter.ht_log_component)) {
@@ -635,8 +955,20 @@ hashtable_setlatched(struct hash_table *ht,
 		if (stored_val)
 			*stored_val = descriptors->val;
 
-		descriptors->key = *key;
-		descriptors->val = *val;
+		if (ht_lockless(ht)) {
+			/* Readers may be looking at the old pair, so
+			 * publish a new one rather than tear it.
+			 */
+			latch->retired_data = descriptors;
+			descriptors = pool_alloc(ht->data_pool);
+			descriptors->key = *key;
+			descriptors->val = *val;
+			atomic_store_voidptr(&RBT_OPAQ(latch->locator),
+					     descriptors);
+		} else {
+			descriptors->key = *key;
+			descriptors->val = *val;
+		}
 		rc = HASHTABLE_OVERWRITTEN;
 		goto out;
 	}
@@ -644,24 +976,38 @@ hashtable_setlatched(struct hash_table *ht,
 	/* We have no collision, so go about creating and inserting a new
 	   node. */
 
-	RBT_FIND(&ht->partitions[latch->index].rbt, locator, latch->rbt_hash);
+	RBT_FIND(&partition->rbt, locator, latch->rbt_hash);
 
 	mutator = pool_alloc(ht->node_pool);
 
 	descriptors = pool_alloc(ht->data_pool);
 
-	RBT_OPAQ(mutator) = descriptors;
-	RBT_VALUE(mutator) = latch->rbt_hash;
-	RBT_INSERT(&ht->partitions[latch->index].rbt, mutator, locator);
-
 	descriptors->key.addr = key->addr;
 	descriptors->key.len = key->len;
 
 	descriptors->val.addr = val->addr;
 	descriptors->val.len = val->len;
 
+	RBT_OPAQ(mutator) = descriptors;
+	RBT_VALUE(mutator) = latch->rbt_hash;
+
+	ht_write_seq(ht, partition);
+	RBT_INSERT(&partition->rbt, mutator, locator);
+	ht_write_seq(ht, partition);
+
+	/* Lockless readers cannot fill the cache, so offer them the
+	 * newest entry.
+	 */
+	if (partition->cache && ht_lockless(ht))
+		atomic_store_voidptr(cache_slot(partition->cache,
+						latch->rbt_hash),
+				     mutator);
+
 	/* Only in the non-overwrite case */
-	++ht->partitions[latch->index].count;
+	++partition->count;
+
+	if (ht->parameter.flags & HT_FLAG_GROW)
+		cache_grow(ht, partition);
 
 	rc = HASHTABLE_SUCCESS;
 
@@ -743,8 +1089,9 @@ void hashtable_deletelatched(struct hash_table *ht,
 
 	/* Clear cache */
 	if (partition->cache) {
-		uint32_t offset = cache_offsetof(ht, latch->rbt_hash);
-		struct rbt_node *cnode = partition->cache[offset];
+		uint32_t offset = cache_offsetof(partition->cache,
+						 latch->rbt_hash);
+		struct rbt_node *cnode = partition->cache->slot[offset];
 
 		if (cnode) {
 #if COMPARE_BEFORE_CLEAR_CACHE
@@ -757,20 +1104,29 @@ void hashtable_deletelatched(struct hash_table *ht,
 				LogFullDebug(COMPONENT_HASHTABLE_CACHE,
 					     "hash clear index %d slot %" PRIu64
 					     latch->index, offset);
-				partition->cache[offset] = NULL;
+				partition->cache->slot[offset] = NULL;
 			}
 #else
 			LogFullDebug(COMPONENT_HASHTABLE_CACHE,
 				     "hash clear slot %d", offset);
-			partition->cache[offset] = NULL;
+			partition->cache->slot[offset] = NULL;
 #endif
 		}
 	}
 
 	/* Now remove the entry */
+	ht_write_seq(ht, partition);
 	RBT_UNLINK(&partition->rbt, latch->locator);
-	pool_free(ht->data_pool, data);
-	pool_free(ht->node_pool, latch->locator);
+	ht_write_seq(ht, partition);
+
+	if (ht_lockless(ht)) {
+		/* Freed by hashtable_releaselatched */
+		latch->retired_node = latch->locator;
+		latch->retired_data = data;
+	} else {
+		pool_free(ht->data_pool, data);
+		pool_free(ht->node_pool, latch->locator);
+	}
 	--ht->partitions[latch->index].count;
 }
 
@@ -819,12 +1175,22 @@ hashtable_delall(struct hash_table *ht,
 			   on failure */
 			int rc = 0;
 
+			ht_write_seq(ht, &ht->partitions[index]);
 			RBT_UNLINK(root, cursor);
+			ht_write_seq(ht, &ht->partitions[index]);
 			data = RBT_OPAQ(holder);
 
 			key = data->key;
 			val = data->val;
 
+			if (ht->partitions[index].cache)
+				atomic_store_voidptr(
+					cache_slot(ht->partitions[index].cache,
+						   RBT_VALUE(holder)),
+					NULL);
+			if (ht_lockless(ht))
+				ht_synchronize();
+
 			pool_free(ht->data_pool, data);
 			pool_free(ht->node_pool, holder);
 			--ht->partitions[index].count;
@@ -846,7 +1212,8 @@ hashtable_delall(struct hash_table *ht,
  * @brief Log information about the hashtable
  *
  * This debugging function prints information about the hash table to
- * the log.
+ * the log: at debug, how full the partitions and their caches are; at
+ * full debug, every entry.
  *
  * @param[in] component The component debugging config to use.
  * @param[in] ht        The hashtable to be used.
@@ -873,15 +1240,43 @@ hashtable_log(log_components_t component, struct hash_table *ht)
 	uint32_t index = 0;
 	/* Recomputed hash for Red-Black tree */
 	uint64_t rbt_hash = 0;
+	/* Fewest and most entries in a partition */
+	size_t min_entries = SIZE_MAX, max_entries = 0;
+	/* Cache slots in all partitions */
+	size_t nb_slots = 0;
+	/* A partition's cache */
+	struct ht_cache *cache;
 
 	LogFullDebug(component, "The hash is partitioned into %d trees",
 		     ht->parameter.index_size);
 
-	for (i = 0; i < ht->parameter.index_size; i++)
-		nb_entries += ht->partitions[i].count;
+	for (i = 0; i < ht->parameter.index_size; i++) {
+		size_t count = atomic_fetch_size_t(&ht->partitions[i].count);
+
+		nb_entries += count;
+		if (count < min_entries)
+			min_entries = count;
+		if (count > max_entries)
+			max_entries = count;
+
+		PTHREAD_RWLOCK_rdlock(&ht->partitions[i].lock);
+		cache = ht->partitions[i].cache;
+		if (cache != NULL)
+			nb_slots += cache->size;
+		PTHREAD_RWLOCK_unlock(&ht->partitions[i].lock);
+	}
 
 	LogFullDebug(component, "The hash contains %zd entries", nb_entries);
 
+	LogDebug(component,
+		 "%s: %zu entries in %" PRIu32
+		 " partitions, %zu to %zu per partition, %zu cache slots (%.2f entries per slot), caches grown %"
+		 PRIu32 " times",
+		 ht->parameter.ht_name, nb_entries, ht->parameter.index_size,
+		 min_entries, max_entries, nb_slots,
+		 nb_slots != 0 ? (double) nb_entries / nb_slots : 0.0,
+		 atomic_fetch_uint32_t(&ht->cache_grows));
+
 	for (i = 0; i < ht->parameter.index_size; i++) {
 		root = &ht->partitions[i].rbt;
 		LogFullDebug(component,
@@ -978,6 +1373,9 @@ hashtable_test_and_set(struct hash_table *ht,
  * a reference before releasing the partition lock.  It is implemented
  * as a wrapper around hashtable_getlatched.
  *
+ * In a table with HT_FLAG_LOCKLESS_READ no lock is taken, and get_ref
+ * is called inside the lockless read instead; it must not block.
+ *
  * @param[in]  ht      The hash store to be searched
  * @param[in]  key     A buffer descriptore locating the key to find
  * @param[out] val     A buffer descriptor locating the value found
@@ -995,6 +1393,19 @@ hashtable_getref(hash_table_t *ht, struct gsh_buffdesc *key,
 	struct hash_latch latch;
 	/* Stored return code */
 	hash_error_t rc = 0;
+	/* Partition index and red-black tree hash for a lockless read */
+	uint32_t index;
+	uint64_t rbt_hash;
+
+	if (ht_lockless(ht)) {
+		rc = compute(ht, key, &index, &rbt_hash);
+		if (rc != HASHTABLE_SUCCESS)
+			return rc;
+
+		if (key_locate_lockless(ht, key, index, rbt_hash, val,
+					get_ref, &rc))
+			return rc;
+	}
 
 	rc = hashtable_getlatch(ht, key, val, false, &latch);
 
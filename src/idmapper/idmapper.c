@@ -52,6 +52,7 @@
 #include "common_utils.h"
 #include "gsh_rpc.h"
 #include "nfs_core.h"
+#include "fridgethr.h"
 #include "idmapper.h"
 
 static struct gsh_buffdesc owner_domain;
@@ -90,6 +91,192 @@ bool idmapper_init(void)
 	return true;
 }
 
+/**
+ * @brief Account for a lookup in the directory
+ *
+ * @param[in] start When the lookup started
+ */
+
+static void idmapper_lookup_done(const struct timespec *start)
+{
+	struct timespec end;
+	uint64_t ns, max;
+
+	now(&end);
+	ns = timespec_diff(start, &end);
+
+	(void) atomic_inc_uint64_t(&idmapper_stats.lookups);
+	(void) atomic_add_uint64_t(&idmapper_stats.lookup_ns, ns);
+
+	max = atomic_fetch_uint64_t(&idmapper_stats.lookup_max_ns);
+	while (ns > max &&
+	       !atomic_cas_uint64_t(&idmapper_stats.lookup_max_ns, max, ns))
+		max = atomic_fetch_uint64_t(&idmapper_stats.lookup_max_ns);
+}
+
+/**
+ * @brief Size of the buffer id2name needs
+ *
+ * @param[in] group True if this is a GID, false for a UID
+ *
+ * @return The size.
+ */
+
+static int id2name_size(bool group)
+{
+	int size;
+
+	if (!nfs_param.nfsv4_param.use_getpwnam)
+		return NFS4_MAX_DOMAIN_LEN + 2;
+
+	if (group)
+		size = sysconf(_SC_GETGR_R_SIZE_MAX);
+	else
+		size = sysconf(_SC_GETPW_R_SIZE_MAX);
+	if (size == -1)
+		size = PWENT_BEST_GUESS_LEN;
+
+	return size + owner_domain.len + 2;
+}
+
+/**
+ * @brief Look up the name of a UID or GID in the directory
+ *
+ * An ID with no name is given a numeric name or nobody.
+ *
+ * @param[in]  id       UID or GID
+ * @param[in]  group    True if this is a GID, false for a UID
+ * @param[out] new_name The name, in a buffer of id2name_size() bytes
+ *
+ * @return What the lookup found.
+ */
+
+static enum idmapper_result id2name(uint32_t id, bool group,
+				    struct gsh_buffdesc *new_name)
+{
+	char *namebuff = new_name->addr;
+	bool looked_up = false;
+	struct timespec start;
+	int rc;
+
+	now(&start);
+
+	if (nfs_param.nfsv4_param.use_getpwnam) {
+		char *cursor;
+		bool nulled;
+
+		new_name->len = id2name_size(group) - owner_domain.len - 2;
+
+		if (group) {
+			struct group g;
+			struct group *gres;
+
+			rc = getgrgid_r(id, &g, namebuff, new_name->len,
+					&gres);
+			nulled = (gres == NULL);
+		} else {
+			struct passwd p;
+			struct passwd *pres;
+
+			rc = getpwuid_r(id, &p, namebuff, new_name->len,
+					&pres);
+			nulled = (pres == NULL);
+		}
+
+		if ((rc == 0) && !nulled) {
+			new_name->len = strlen(namebuff);
+			cursor = namebuff + new_name->len;
+			*(cursor++) = '@';
+			++new_name->len;
+			memcpy(cursor, owner_domain.addr,
+			       owner_domain.len);
+			new_name->len += owner_domain.len;
+			looked_up = true;
+		} else {
+			LogInfo(COMPONENT_IDMAPPER,
+				"%s failed with code %d.",
+				(group ? "getgrgid_r" : "getpwuid_r"),
+				rc);
+		}
+	} else {
+#ifdef USE_NFSIDMAP
+		if (group) {
+			rc = nfs4_gid_to_name(id, owner_domain.addr,
+					      namebuff,
+					      NFS4_MAX_DOMAIN_LEN + 1);
+		} else {
+			rc = nfs4_uid_to_name(id, owner_domain.addr,
+					      namebuff,
+					      NFS4_MAX_DOMAIN_LEN + 1);
+		}
+		if (rc == 0) {
+			new_name->len = strlen(namebuff);
+			looked_up = true;
+		} else {
+			LogInfo(COMPONENT_IDMAPPER,
+				"%s failed with code %d.",
+				(group ? "nfs4_gid_to_name" :
+				"nfs4_uid_to_name"), rc);
+		}
+#else				/* USE_NFSIDMAP */
+		looked_up = false;
+#endif				/* !USE_NFSIDMAP */
+	}
+
+	idmapper_lookup_done(&start);
+
+	if (looked_up)
+		return IDMAP_MAPPED;
+
+	if (nfs_param.nfsv4_param.allow_numeric_owners) {
+		LogInfo(COMPONENT_IDMAPPER,
+			"Lookup for %d failed, using numeric %s",
+			id, (group ? "group" : "owner"));
+		/* 2**32 is 10 digits long in decimal */
+		sprintf(namebuff, "%"PRIu32, id);
+		new_name->len = strlen(namebuff);
+	} else {
+		LogInfo(COMPONENT_IDMAPPER,
+			"Lookup for %d failed, using nobody.",
+			id);
+		memcpy(new_name->addr, "nobody", 6);
+		new_name->len = 6;
+	}
+
+	return IDMAP_NO_NAME;
+}
+
+/**
+ * @brief Cache the name of a UID or GID
+ *
+ * @param[in] id    UID or GID
+ * @param[in] group True if this is a GID, false for a UID
+ * @param[in] name  The name
+ * @param[in] res   What the lookup found
+ */
+
+static void id2name_add(uint32_t id, bool group,
+			const struct gsh_buffdesc *name,
+			enum idmapper_result res)
+{
+	bool success;
+
+	PTHREAD_RWLOCK_wrlock(group ? &idmapper_group_lock :
+			      &idmapper_user_lock);
+	if (group)
+		success = idmapper_add_group(name, id, res);
+	else
+		success = idmapper_add_user(name, id, NULL, false, res);
+
+	PTHREAD_RWLOCK_unlock(group ? &idmapper_group_lock :
+			      &idmapper_user_lock);
+	if (unlikely(!success)) {
+		LogMajor(COMPONENT_IDMAPPER, "%s failed.",
+			 group ? "idmapper_add_group" :
+			 "idmaper_add_user");
+	}
+}
+
 /**
  * @brief Encode a UID or GID as a string
  *
@@ -128,134 +315,25 @@ static bool xdr_encode_nfs4_princ(XDR *xdrs, uint32_t id, bool group)
 		success = idmapper_lookup_by_uid(id, &found, NULL);
 
 	if (likely(success)) {
-		not_a_size_t = found->len;
-
 		/* Fully qualified owners are always stored in the
-		   hash table, no matter what our lookup method. */
-		success =
-		    inline_xdr_bytes(xdrs, (char **)&found->addr, &not_a_size_t,
-				     UINT32_MAX);
+		   hash table, no matter what our lookup method, and
+		   already encoded. */
+		success = xdr_opaque(xdrs, found->addr, found->len);
 		PTHREAD_RWLOCK_unlock(group ? &idmapper_group_lock :
 				      &idmapper_user_lock);
 		return success;
 	} else {
 		PTHREAD_RWLOCK_unlock(group ? &idmapper_group_lock :
 				      &idmapper_user_lock);
-		int rc;
-		int size;
-		bool looked_up = false;
-		char *namebuff = NULL;
 		struct gsh_buffdesc new_name;
+		enum idmapper_result res;
 
-		if (nfs_param.nfsv4_param.use_getpwnam) {
-			if (group)
-				size = sysconf(_SC_GETGR_R_SIZE_MAX);
-			else
-				size = sysconf(_SC_GETPW_R_SIZE_MAX);
-			if (size == -1)
-				size = PWENT_BEST_GUESS_LEN;
-			new_name.len = size;
-			size += owner_domain.len + 2;
-		} else {
-			size = NFS4_MAX_DOMAIN_LEN + 2;
-		}
-
-		namebuff = alloca(size);
-
-		new_name.addr = namebuff;
-
-		if (nfs_param.nfsv4_param.use_getpwnam) {
-			char *cursor;
-			bool nulled;
-
-			if (group) {
-				struct group g;
-				struct group *gres;
-
-				rc = getgrgid_r(id, &g, namebuff, new_name.len,
-						&gres);
-				nulled = (gres == NULL);
-			} else {
-				struct passwd p;
-				struct passwd *pres;
-
-				rc = getpwuid_r(id, &p, namebuff, new_name.len,
-						&pres);
-				nulled = (pres == NULL);
-			}
-
-			if ((rc == 0) && !nulled) {
-				new_name.len = strlen(namebuff);
-				cursor = namebuff + new_name.len;
-				*(cursor++) = '@';
-				++new_name.len;
-				memcpy(cursor, owner_domain.addr,
-				       owner_domain.len);
-				new_name.len += owner_domain.len;
-				looked_up = true;
-			} else {
-				LogInfo(COMPONENT_IDMAPPER,
-					"%s failed with code %d.",
-					(group ? "getgrgid_r" : "getpwuid_r"),
-					rc);
-			}
-		} else {
-#ifdef USE_NFSIDMAP
-			if (group) {
-				rc = nfs4_gid_to_name(id, owner_domain.addr,
-						      namebuff,
-						      NFS4_MAX_DOMAIN_LEN + 1);
-			} else {
-				rc = nfs4_uid_to_name(id, owner_domain.addr,
-						      namebuff,
-						      NFS4_MAX_DOMAIN_LEN + 1);
-			}
-			if (rc == 0) {
-				new_name.len = strlen(namebuff);
-				looked_up = true;
-			} else {
-				LogInfo(COMPONENT_IDMAPPER,
-					"%s failed with code %d.",
-					(group ? "nfs4_gid_to_name" :
-					"nfs4_uid_to_name"), rc);
-			}
-#else				/* USE_NFSIDMAP */
-			looked_up = false;
-#endif				/* !USE_NFSIDMAP */
-		}
-
-		if (!looked_up) {
-			if (nfs_param.nfsv4_param.allow_numeric_owners) {
-				LogInfo(COMPONENT_IDMAPPER,
-					"Lookup for %d failed, using numeric %s",
-					id, (group ? "group" : "owner"));
-				/* 2**32 is 10 digits long in decimal */
-				sprintf(namebuff, "%"PRIu32, id);
-				new_name.len = strlen(namebuff);
-			} else {
-				LogInfo(COMPONENT_IDMAPPER,
-					"Lookup for %d failed, using nobody.",
-					id);
-				memcpy(new_name.addr, "nobody", 6);
-				new_name.len = 6;
-			}
-		}
+		new_name.addr = alloca(id2name_size(group));
+		res = id2name(id, group, &new_name);
 
 		/* Add to the cache and encode the result. */
-		PTHREAD_RWLOCK_wrlock(group ? &idmapper_group_lock :
-				      &idmapper_user_lock);
-		if (group)
-			success = idmapper_add_group(&new_name, id);
-		else
-			success = idmapper_add_user(&new_name, id, NULL, false);
+		id2name_add(id, group, &new_name, res);
 
-		PTHREAD_RWLOCK_unlock(group ? &idmapper_group_lock :
-				      &idmapper_user_lock);
-		if (unlikely(!success)) {
-			LogMajor(COMPONENT_IDMAPPER, "%s failed.",
-				 group ? "idmapper_add_group" :
-				 "idmaper_add_user");
-		}
 		not_a_size_t = new_name.len;
 		return inline_xdr_bytes(xdrs, (char **)&new_name.addr,
 					&not_a_size_t, UINT32_MAX);
@@ -506,6 +584,107 @@ static bool idmapname2id(char *name, size_t len, uint32_t *id,
 #endif				/* USE_NFSIDMAP */
 }
 
+/**
+ * @brief Look up a name in the directory
+ *
+ * @param[in]  name    The name of the user or group
+ * @param[out] id      The resulting id
+ * @param[in]  group   True if this is a group name
+ * @param[in]  anon    ID to return if look up fails
+ * @param[out] gid     The user's GID, if got_gid
+ * @param[out] got_gid Whether the user's GID was found
+ * @param[out] res     What the lookup found
+ *
+ * @return true if the name may be mapped, false otherwise
+ */
+
+static bool name2id_lookup(const struct gsh_buffdesc *name, uint32_t *id,
+			   bool group, const uint32_t anon, gid_t *gid,
+			   bool *got_gid, enum idmapper_result *res)
+{
+	/* Something we can mutate and count on as terminated */
+	char *namebuff = alloca(name->len + 1);
+	struct timespec start;
+	char *at;
+	bool looked_up = false;
+
+	memcpy(namebuff, name->addr, name->len);
+	*(namebuff + name->len) = '\0';
+	at = memchr(namebuff, '@', name->len);
+
+	*got_gid = false;
+	*res = IDMAP_MAPPED;
+	now(&start);
+
+	if (at == NULL) {
+		if (pwentname2id
+		    (namebuff, name->len, id, anon, group, gid,
+		     got_gid, NULL)) {
+			looked_up = true;
+		} else if (atless2id(namebuff, name->len, id, anon)) {
+			/* nobody, or a number */
+			looked_up = true;
+			if (*id == anon)
+				*res = IDMAP_NO_ID;
+		} else {
+			idmapper_lookup_done(&start);
+			return false;
+		}
+	} else if (nfs_param.nfsv4_param.use_getpwnam) {
+		looked_up =
+		    pwentname2id(namebuff, name->len, id, anon, group,
+				 gid, got_gid, at);
+	} else {
+		looked_up =
+		    idmapname2id(namebuff, name->len, id, anon, group,
+				 gid, got_gid, at);
+	}
+
+	idmapper_lookup_done(&start);
+
+	if (!looked_up) {
+		LogInfo(COMPONENT_IDMAPPER,
+			"All lookups failed for %s, using anonymous.",
+			namebuff);
+		*id = anon;
+		*res = IDMAP_NO_ID;
+	}
+
+	return true;
+}
+
+/**
+ * @brief Cache the ID of a name
+ *
+ * @param[in] name    The name of the user or group
+ * @param[in] id      The ID
+ * @param[in] group   True if this is a group name
+ * @param[in] gid     The user's GID, or NULL
+ * @param[in] res     What the lookup found
+ */
+
+static void name2id_add(const struct gsh_buffdesc *name, uint32_t id,
+			bool group, const gid_t *gid,
+			enum idmapper_result res)
+{
+	bool success;
+
+	PTHREAD_RWLOCK_wrlock(group ? &idmapper_group_lock :
+			      &idmapper_user_lock);
+	if (group)
+		success = idmapper_add_group(name, id, res);
+	else
+		success = idmapper_add_user(name, id, gid, false, res);
+
+	PTHREAD_RWLOCK_unlock(group ? &idmapper_group_lock :
+			      &idmapper_user_lock);
+
+	if (!success)
+		LogMajor(COMPONENT_IDMAPPER, "%s(%.*s %u) failed",
+			 (group ? "gidmap_add" : "uidmap_add"),
+			 (int)name->len, (char *)name->addr, id);
+}
+
 /**
  * @brief Convert a name to an ID
  *
@@ -521,6 +700,9 @@ static bool name2id(const struct gsh_buffdesc *name, uint32_t *id, bool group,
 		    const uint32_t anon)
 {
 	bool success;
+	gid_t gid;
+	bool got_gid;
+	enum idmapper_result res;
 
 	PTHREAD_RWLOCK_rdlock(group ? &idmapper_group_lock :
 			      &idmapper_user_lock);
@@ -533,62 +715,118 @@ static bool name2id(const struct gsh_buffdesc *name, uint32_t *id, bool group,
 
 	if (success)
 		return true;
-	else {
-		gid_t gid;
-		bool got_gid = false;
-		/* Something we can mutate and count on as terminated */
-		char *namebuff = alloca(name->len + 1);
-		char *at;
-		bool looked_up = false;
-
-		memcpy(namebuff, name->addr, name->len);
-		*(namebuff + name->len) = '\0';
-		at = memchr(namebuff, '@', name->len);
-
-		if (at == NULL) {
-			if (pwentname2id
-			    (namebuff, name->len, id, anon, group, &gid,
-			     &got_gid, NULL))
-				looked_up = true;
-			else if (atless2id(namebuff, name->len, id, anon))
-				looked_up = true;
-			else
-				return false;
-		} else if (nfs_param.nfsv4_param.use_getpwnam) {
-			looked_up =
-			    pwentname2id(namebuff, name->len, id, anon, group,
-					 &gid, &got_gid, at);
-		} else {
-			looked_up =
-			    idmapname2id(namebuff, name->len, id, anon, group,
-					 &gid, &got_gid, at);
-		}
 
-		if (!looked_up) {
-			LogInfo(COMPONENT_IDMAPPER,
-				"All lookups failed for %s, using anonymous.",
-				namebuff);
-			*id = anon;
-		}
+	if (!name2id_lookup(name, id, group, anon, &gid, &got_gid, &res))
+		return false;
 
-		PTHREAD_RWLOCK_wrlock(group ? &idmapper_group_lock :
-				      &idmapper_user_lock);
-		if (group)
-			success = idmapper_add_group(name, *id);
-		else
-			success =
-			    idmapper_add_user(name, *id, got_gid ? &gid : NULL,
-					      false);
+	name2id_add(name, *id, group, got_gid ? &gid : NULL, res);
 
-		PTHREAD_RWLOCK_unlock(group ? &idmapper_group_lock :
-				      &idmapper_user_lock);
+	return true;
+}
 
-		if (!success)
-			LogMajor(COMPONENT_IDMAPPER, "%s(%s %u) failed",
-				 (group ? "gidmap_add" : "uidmap_add"),
-				 namebuff, *id);
-		return true;
+/**
+ * @brief A mapping to look up again in the background
+ */
+
+struct idmapper_refresh {
+	bool group;		/*< a group rather than a user */
+	bool by_name;		/*< name was looked up, else id */
+	uint32_t id;		/*< the UID or GID */
+	struct gsh_buffdesc name;	/*< the name */
+	char buf[];
+};
+
+/**
+ * @brief Look a mapping up again and replace it in the cache
+ *
+ * A lookup that fails leaves the mapping as it was until it expires.
+ *
+ * @param[in] ctx Thread context, holding the idmapper_refresh
+ */
+
+static void idmapper_refresh_run(struct fridgethr_context *ctx)
+{
+	struct idmapper_refresh *job = ctx->arg;
+	struct gsh_buffdesc new_name;
+	enum idmapper_result res;
+	bool got_gid;
+	uint32_t id;
+	gid_t gid;
+
+	if (job->by_name) {
+		if (name2id_lookup(&job->name, &id, job->group, -1, &gid,
+				   &got_gid, &res) &&
+		    res == IDMAP_MAPPED)
+			name2id_add(&job->name, id, job->group,
+				    got_gid ? &gid : NULL, res);
+	} else {
+		new_name.addr = gsh_malloc(id2name_size(job->group));
+		res = id2name(job->id, job->group, &new_name);
+		if (res == IDMAP_MAPPED)
+			id2name_add(job->id, job->group, &new_name, res);
+		gsh_free(new_name.addr);
 	}
+
+	gsh_free(job);
+}
+
+static void idmapper_refresh_submit(struct idmapper_refresh *job)
+{
+	int rc = EAGAIN;
+
+	if (general_fridge != NULL)
+		rc = fridgethr_submit(general_fridge, idmapper_refresh_run,
+				      job);
+	if (rc != 0) {
+		/* the mapping will just expire */
+		LogDebug(COMPONENT_IDMAPPER,
+			 "Could not queue a refresh: %d", rc);
+		gsh_free(job);
+	}
+}
+
+/**
+ * @brief Look a name up again in the background
+ *
+ * Called with the cache lock held for read.
+ *
+ * @param[in] name  The name of the user or group
+ * @param[in] group True if this is a group name
+ */
+
+void idmapper_refresh_name(const struct gsh_buffdesc *name, bool group)
+{
+	struct idmapper_refresh *job;
+
+	job = gsh_malloc(sizeof(*job) + name->len);
+	job->group = group;
+	job->by_name = true;
+	job->name.addr = job->buf;
+	job->name.len = name->len;
+	memcpy(job->buf, name->addr, name->len);
+
+	idmapper_refresh_submit(job);
+}
+
+/**
+ * @brief Look an ID up again in the background
+ *
+ * Called with the cache lock held for read.
+ *
+ * @param[in] id    The UID or GID
+ * @param[in] group True if this is a GID
+ */
+
+void idmapper_refresh_id(uint32_t id, bool group)
+{
+	struct idmapper_refresh *job;
+
+	job = gsh_malloc(sizeof(*job));
+	job->group = group;
+	job->by_name = false;
+	job->id = id;
+
+	idmapper_refresh_submit(job);
 }
 
 /**
@@ -649,6 +887,7 @@ bool principal2uid(char *principal, uid_t *uid, gid_t *gid)
 	uid_t gss_uid = -1;
 	gid_t gss_gid = -1;
 	const gid_t *gss_gidres = NULL;
+	struct timespec start;
 	int rc;
 	bool success;
 	struct gsh_buffdesc princbuff = {
@@ -661,6 +900,9 @@ bool principal2uid(char *principal, uid_t *uid, gid_t *gid)
 		return false;
 
 #ifdef USE_NFSIDMAP
+	if (idmapper_lookup_principal(&princbuff, uid, gid))
+		return true;
+
 	PTHREAD_RWLOCK_rdlock(&idmapper_user_lock);
 	success =
 	    idmapper_lookup_by_uname(&princbuff, &gss_uid, &gss_gidres, true);
@@ -689,12 +931,15 @@ bool principal2uid(char *principal, uid_t *uid, gid_t *gid)
 			   hostbased nfs principal, use root */
 			*uid = 0;
 			*gid = 0;
+			idmapper_add_principal(&princbuff, 0, 0);
 			return true;
 		}
 		/* nfs4_gss_princ_to_ids required to extract uid/gid
 		   from gss creds */
+		now(&start);
 		rc = nfs4_gss_princ_to_ids("krb5", principal, &gss_uid,
 					   &gss_gid);
+		idmapper_lookup_done(&start);
 		if (rc) {
 #ifdef _MSPAC_SUPPORT
 			bool found_uid = false;
@@ -772,7 +1017,8 @@ bool principal2uid(char *principal, uid_t *uid, gid_t *gid)
 
 		PTHREAD_RWLOCK_wrlock(&idmapper_user_lock);
 		success =
-		    idmapper_add_user(&princbuff, gss_uid, &gss_gid, true);
+		    idmapper_add_user(&princbuff, gss_uid, &gss_gid, true,
+				      IDMAP_MAPPED);
 		PTHREAD_RWLOCK_unlock(&idmapper_user_lock);
 
 		if (!success) {
@@ -784,6 +1030,7 @@ bool principal2uid(char *principal, uid_t *uid, gid_t *gid)
 
 	*uid = gss_uid;
 	*gid = gss_gid;
+	idmapper_add_principal(&princbuff, gss_uid, gss_gid);
 
 	return true;
 #else				/* !USE_NFSIDMAP */
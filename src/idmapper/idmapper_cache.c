@@ -43,6 +43,8 @@
 #include "avltree.h"
 #include "idmapper.h"
 #include "abstract_atomic.h"
+#include "gsh_config.h"
+#include "gsh_cache.h"
 
 /**
  * @brief User entry in the IDMapper cache
@@ -50,12 +52,17 @@
 
 struct cache_user {
 	struct gsh_buffdesc uname;	/*< Username */
+	struct gsh_buffdesc xdr_name;	/*< Username as an XDR opaque */
 	uid_t uid;		/*< Corresponding UID */
 	gid_t gid;		/*< Corresponding GID */
 	bool gid_set;		/*< if the GID has been set */
 	struct avltree_node uname_node;	/*< Node in the name tree */
 	struct avltree_node uid_node;	/*< Node in the UID tree */
 	bool in_uidtree;		/* true iff this is in uid_tree */
+	bool in_unametree;		/* true iff this is in uname_tree */
+	bool negative;		/*< the lookup found no mapping */
+	uint32_t refreshing;	/*< a background lookup is queued */
+	time_t expires;		/*< when to look up again, 0 for never */
 };
 
 /**
@@ -64,9 +71,15 @@ struct cache_user {
 
 struct cache_group {
 	struct gsh_buffdesc gname;	/*< Group name */
+	struct gsh_buffdesc xdr_name;	/*< Group name as an XDR opaque */
 	gid_t gid;		/*< Group ID */
 	struct avltree_node gname_node;	/*< Node in the name tree */
 	struct avltree_node gid_node;	/*< Node in the GID tree */
+	bool in_gidtree;		/* true iff this is in gid_tree */
+	bool in_gnametree;		/* true iff this is in gname_tree */
+	bool negative;		/*< the lookup found no mapping */
+	uint32_t refreshing;	/*< a background lookup is queued */
+	time_t expires;		/*< when to look up again, 0 for never */
 };
 
 /**
@@ -75,6 +88,16 @@ struct cache_group {
 
 #define id_cache_size 1009
 
+/**
+ * @brief IDs below this have a slot of their own in the ID caches
+ *
+ * Local and most directory IDs are dense from 0, so encoding the owner
+ * of a file never goes to the tree for them.  Larger IDs, as mapped
+ * from SIDs, share the hashed slots of the caches below.
+ */
+
+#define id_dense_size 65536
+
 /**
  * @brief UID cache, may only be accessed with idmapper_user_lock
  * held.  If idmapper_user_lock is held for read, it must be accessed
@@ -83,6 +106,7 @@ struct cache_group {
  */
 
 static struct avltree_node *uid_cache[id_cache_size];
+static struct avltree_node *uid_dense[id_dense_size];
 
 /**
  * @brief GID cache, may only be accessed with idmapper_group_lock
@@ -92,6 +116,23 @@ static struct avltree_node *uid_cache[id_cache_size];
  */
 
 static struct avltree_node *gid_cache[id_cache_size];
+static struct avltree_node *gid_dense[id_dense_size];
+
+static inline struct avltree_node **uid_slot(uid_t uid)
+{
+	if (uid < id_dense_size)
+		return &uid_dense[uid];
+
+	return &uid_cache[uid % id_cache_size];
+}
+
+static inline struct avltree_node **gid_slot(gid_t gid)
+{
+	if (gid < id_dense_size)
+		return &gid_dense[gid];
+
+	return &gid_cache[gid % id_cache_size];
+}
 
 /**
  * @brief Lock that protects the idmapper user cache
@@ -128,6 +169,125 @@ static struct avltree gname_tree;
 
 static struct avltree gid_tree;
 
+/**
+ * @brief Counters of the cache, updated atomically
+ */
+
+struct idmapper_stats idmapper_stats;
+
+/**
+ * @brief Bumped each time the cache is wiped out
+ */
+
+uint32_t idmapper_generation;
+
+/**
+ * @brief Memory of the principal cache
+ */
+
+#define princ_cache_bytes (1024 * 1024)
+
+/**
+ * @brief Longest principal the principal cache holds
+ */
+
+#define princ_cache_name 112
+
+/**
+ * @brief Seconds a principal cache entry may be used
+ *
+ * The entries bypass the expiry and refresh of the user tree, so they
+ * only keep a mapping for a short while before going back to it.
+ */
+
+#define princ_cache_ttl 60
+
+/**
+ * @brief What a principal maps to
+ */
+
+struct princ_ids {
+	uid_t uid;		/*< Corresponding UID */
+	gid_t gid;		/*< Corresponding GID */
+};
+
+/**
+ * @brief Principals mapped lately
+ *
+ * Every RPCSEC_GSS request maps its principal.  The cache is read
+ * without idmapper_user_lock, which every client would otherwise take.
+ */
+
+static struct gsh_cache *princ_cache;
+
+/**
+ * @brief When a mapping just looked up expires
+ *
+ * @param[in] res What the lookup found
+ *
+ * @return The time, or 0 for never.
+ */
+
+static time_t idmapper_expires(enum idmapper_result res)
+{
+	uint32_t ttl = (res == IDMAP_MAPPED)
+			? nfs_param.nfsv4_param.idmap_expiration
+			: nfs_param.nfsv4_param.idmap_negative_expiration;
+
+	return ttl == 0 ? 0 : time(NULL) + ttl;
+}
+
+/**
+ * @brief Check whether a cached mapping may still be used
+ *
+ * A mapping used in the last quarter of its life is looked up again in
+ * the background while it goes on being used, so a directory that is
+ * slow to answer only delays the lookups that miss.  Only the first
+ * caller to see it there is asked to start that lookup.
+ *
+ * @param[in]  expires    When the mapping expires
+ * @param[in]  negative   Whether the mapping failed
+ * @param[in]  refreshing The flag of the mapping's background lookup
+ * @param[out] refresh    Whether to start a background lookup
+ *
+ * @retval true if the mapping may be used.
+ * @retval false if it expired.
+ */
+
+static bool idmapper_fresh(time_t expires, bool negative,
+			   uint32_t *refreshing, bool *refresh)
+{
+	time_t now;
+
+	*refresh = false;
+
+	if (expires == 0)
+		goto hit;
+
+	now = time(NULL);
+	if (now >= expires) {
+		(void) atomic_inc_uint64_t(&idmapper_stats.expired);
+		return false;
+	}
+
+	/* Failed mappings just expire, they are cheap to look up again
+	 * once the directory is back.
+	 */
+	if (!negative &&
+	    (expires - now) * 4 < nfs_param.nfsv4_param.idmap_expiration &&
+	    atomic_cas_uint32_t(refreshing, 0, 1)) {
+		(void) atomic_inc_uint64_t(&idmapper_stats.refreshes);
+		*refresh = true;
+	}
+
+ hit:
+	(void) atomic_inc_uint64_t(&idmapper_stats.hits);
+	if (negative)
+		(void) atomic_inc_uint64_t(&idmapper_stats.negative_hits);
+
+	return true;
+}
+
 /**
  * @brief Compare two buffers
  *
@@ -274,10 +434,61 @@ void idmapper_cache_init(void)
 	avltree_init(&uname_tree, uname_comparator, 0);
 	avltree_init(&uid_tree, uid_comparator, 0);
 	memset(uid_cache, 0, id_cache_size * sizeof(struct avltree_node *));
+	memset(uid_dense, 0, id_dense_size * sizeof(struct avltree_node *));
 
 	avltree_init(&gname_tree, gname_comparator, 0);
 	avltree_init(&gid_tree, gid_comparator, 0);
 	memset(gid_cache, 0, id_cache_size * sizeof(struct avltree_node *));
+	memset(gid_dense, 0, id_dense_size * sizeof(struct avltree_node *));
+
+	if (princ_cache == NULL) {
+		struct gsh_cache_params params = {
+			.name = "principal",
+			.key_max = princ_cache_name,
+			.value_max = sizeof(struct princ_ids),
+			.ttl = nfs_param.nfsv4_param.idmap_expiration,
+			.bytes = princ_cache_bytes,
+		};
+
+		if (params.ttl == 0 || params.ttl > princ_cache_ttl)
+			params.ttl = princ_cache_ttl;
+		princ_cache = gsh_cache_create(&params);
+	}
+}
+
+/**
+ * @brief Size of the name storage of a cache entry
+ */
+
+#define idmapper_name_size(len) (BYTES_PER_XDR_UNIT + RNDUP(len))
+
+/**
+ * @brief Store the name of a cache entry
+ *
+ * The name is kept as the XDR opaque the owner attributes encode to,
+ * so encoding them is a single copy.
+ *
+ * @param[in]  src      The name
+ * @param[in]  storage  idmapper_name_size(src->len) bytes
+ * @param[out] name     The name
+ * @param[out] xdr_name The name as an XDR opaque
+ */
+
+static void idmapper_store_name(const struct gsh_buffdesc *src,
+				char *storage, struct gsh_buffdesc *name,
+				struct gsh_buffdesc *xdr_name)
+{
+	uint32_t len = htonl(src->len);
+	size_t pad = RNDUP(src->len) - src->len;
+
+	memcpy(storage, &len, BYTES_PER_XDR_UNIT);
+	memcpy(storage + BYTES_PER_XDR_UNIT, src->addr, src->len);
+	memset(storage + BYTES_PER_XDR_UNIT + src->len, 0, pad);
+
+	name->addr = storage + BYTES_PER_XDR_UNIT;
+	name->len = src->len;
+	xdr_name->addr = storage;
+	xdr_name->len = idmapper_name_size(src->len);
 }
 
 /**
@@ -290,25 +501,28 @@ void idmapper_cache_init(void)
  * @param[in] gid  Optional.  Set to NULL if no gid is known.
  * @param[in] gss_princ true when name is gss principal.
  *                      The uid to name map is not added for gss principals.
+ * @param[in] res  What the lookup found.  A failed mapping is only
+ *                 added in the direction it was looked up.
  *
  * @retval true on success.
  * @retval false if our reach exceeds our grasp.
  */
 
 bool idmapper_add_user(const struct gsh_buffdesc *name, uid_t uid,
-		       const gid_t *gid, bool gss_princ)
+		       const gid_t *gid, bool gss_princ,
+		       enum idmapper_result res)
 {
 	struct avltree_node *found_name;
 	struct avltree_node *found_id;
 	struct cache_user *old;
 	struct cache_user *new;
 
-	new = gsh_malloc(sizeof(struct cache_user) + name->len);
+	new = gsh_malloc(sizeof(struct cache_user) +
+			 idmapper_name_size(name->len));
 
-	new->uname.addr = (char *)new + sizeof(struct cache_user);
-	new->uname.len = name->len;
+	idmapper_store_name(name, (char *)new + sizeof(struct cache_user),
+			    &new->uname, &new->xdr_name);
 	new->uid = uid;
-	memcpy(new->uname.addr, name->addr, name->len);
 	if (gid) {
 		new->gid = *gid;
 		new->gid_set = true;
@@ -316,7 +530,11 @@ bool idmapper_add_user(const struct gsh_buffdesc *name, uid_t uid,
 		new->gid = -1;
 		new->gid_set = false;
 	}
-	new->in_uidtree = (gss_princ) ? false : true;
+	new->in_uidtree = !gss_princ && res != IDMAP_NO_ID;
+	new->in_unametree = res != IDMAP_NO_NAME;
+	new->negative = res != IDMAP_MAPPED;
+	new->refreshing = 0;
+	new->expires = idmapper_expires(res);
 
 	/*
 	 * There are 3 cases why we find an existing cache entry.
@@ -346,12 +564,15 @@ bool idmapper_add_user(const struct gsh_buffdesc *name, uid_t uid,
 	 * Note that the 3rd case happens if and only if IDMAPD_DOMAIN
 	 * and LOCAL_REALMS are set to the same value!
 	 */
+	if (!new->in_unametree)
+		goto uidtree;
+
 	found_name = avltree_insert(&new->uname_node, &uname_tree);
 	if (unlikely(found_name)) {
 		old = avltree_container_of(found_name, struct cache_user,
 					   uname_node);
 		/* Combine old into new if uid's match */
-		if (old->uid == new->uid) {
+		if (old->uid == new->uid && !old->negative && !new->negative) {
 			if (!new->gid_set && old->gid_set) {
 				new->gid = old->gid;
 				new->gid_set = true;
@@ -363,7 +584,7 @@ bool idmapper_add_user(const struct gsh_buffdesc *name, uid_t uid,
 		/* Remove the old and insert the new */
 		avltree_remove(found_name, &uname_tree);
 		if (old->in_uidtree) {
-			uid_cache[old->uid % id_cache_size] = NULL;
+			*uid_slot(old->uid) = NULL;
 			avltree_remove(&old->uid_node, &uid_tree);
 		}
 		gsh_free(old);
@@ -371,6 +592,7 @@ bool idmapper_add_user(const struct gsh_buffdesc *name, uid_t uid,
 		assert(found_name == NULL);
 	}
 
+ uidtree:
 	if (!new->in_uidtree) /* all done */
 		return true;
 
@@ -378,14 +600,15 @@ bool idmapper_add_user(const struct gsh_buffdesc *name, uid_t uid,
 	if (unlikely(found_id)) {
 		old = avltree_container_of(found_id, struct cache_user,
 					   uid_node);
-		uid_cache[old->uid % id_cache_size] = NULL;
+		*uid_slot(old->uid) = NULL;
 		avltree_remove(found_id, &uid_tree);
-		avltree_remove(&old->uname_node, &uname_tree);
+		if (old->in_unametree)
+			avltree_remove(&old->uname_node, &uname_tree);
 		gsh_free(old);
 		found_id = avltree_insert(&new->uid_node, &uid_tree);
 		assert(found_id == NULL);
 	}
-	uid_cache[uid % id_cache_size] = &new->uid_node;
+	*uid_slot(uid) = &new->uid_node;
 
 	return true;
 }
@@ -397,24 +620,32 @@ bool idmapper_add_user(const struct gsh_buffdesc *name, uid_t uid,
  *
  * @param[in] name The user name
  * @param[in] gid  The group id
+ * @param[in] res  What the lookup found.  A failed mapping is only
+ *                 added in the direction it was looked up.
  *
  * @retval true on success.
  * @retval false if our reach exceeds our grasp.
  */
 
-bool idmapper_add_group(const struct gsh_buffdesc *name, const gid_t gid)
+bool idmapper_add_group(const struct gsh_buffdesc *name, const gid_t gid,
+			enum idmapper_result res)
 {
 	struct avltree_node *found_name;
 	struct avltree_node *found_id;
 	struct cache_group *tmp;
 	struct cache_group *new;
 
-	new = gsh_malloc(sizeof(struct cache_group) + name->len);
+	new = gsh_malloc(sizeof(struct cache_group) +
+			 idmapper_name_size(name->len));
 
-	new->gname.addr = (char *)new + sizeof(struct cache_group);
-	new->gname.len = name->len;
+	idmapper_store_name(name, (char *)new + sizeof(struct cache_group),
+			    &new->gname, &new->xdr_name);
 	new->gid = gid;
-	memcpy(new->gname.addr, name->addr, name->len);
+	new->in_gidtree = res != IDMAP_NO_ID;
+	new->in_gnametree = res != IDMAP_NO_NAME;
+	new->negative = res != IDMAP_MAPPED;
+	new->refreshing = 0;
+	new->expires = idmapper_expires(res);
 
 	/*
 	 * The threads that lookup by-name or by-id use the read lock. If
@@ -430,31 +661,41 @@ bool idmapper_add_group(const struct gsh_buffdesc *name, const gid_t gid)
 	 * If we find an existing entry, we remove it from both the name
 	 * and the id AVL trees, and then add the new entry.
 	 */
+	if (!new->in_gnametree)
+		goto gidtree;
+
 	found_name = avltree_insert(&new->gname_node, &gname_tree);
 	if (unlikely(found_name)) {
 		tmp = avltree_container_of(found_name, struct cache_group,
 					   gname_node);
 		avltree_remove(found_name, &gname_tree);
-		avltree_remove(&tmp->gid_node, &gid_tree);
-		gid_cache[tmp->gid % id_cache_size] = NULL;
+		if (tmp->in_gidtree) {
+			avltree_remove(&tmp->gid_node, &gid_tree);
+			*gid_slot(tmp->gid) = NULL;
+		}
 		gsh_free(tmp);
 		found_name = avltree_insert(&new->gname_node, &gname_tree);
 		assert(found_name == NULL);
 	}
 
+ gidtree:
+	if (!new->in_gidtree) /* all done */
+		return true;
+
 	found_id = avltree_insert(&new->gid_node, &gid_tree);
 	if (unlikely(found_id)) {
 		tmp = avltree_container_of(found_id, struct cache_group,
 					   gid_node);
 
-		gid_cache[tmp->gid % id_cache_size] = NULL;
+		*gid_slot(tmp->gid) = NULL;
 		avltree_remove(found_id, &gid_tree);
-		avltree_remove(&tmp->gname_node, &gname_tree);
+		if (tmp->in_gnametree)
+			avltree_remove(&tmp->gname_node, &gname_tree);
 		gsh_free(tmp);
 		found_id = avltree_insert(&new->gid_node, &gid_tree);
 		assert(found_id == NULL);
 	}
-	gid_cache[gid % id_cache_size] = &new->gid_node;
+	*gid_slot(gid) = &new->gid_node;
 
 	return true;
 }
@@ -471,6 +712,7 @@ bool idmapper_add_group(const struct gsh_buffdesc *name, const gid_t gid)
  * @param[out] gid  The GID for the user, or NULL if there is
  *                  none. The caller may specify NULL if it isn't
  *                  interested.
+ * @param[in]  gss_princ true when name is gss principal.
  *
  * @retval true on success.
  * @retval false if we need to try, try again.
@@ -486,13 +728,24 @@ bool idmapper_lookup_by_uname(const struct gsh_buffdesc *name, uid_t *uid,
 							 &uname_tree);
 	struct cache_user *found_user;
 	void **cache_slot;
+	bool refresh;
 
-	if (unlikely(!found_node))
+	if (unlikely(!found_node)) {
+		(void) atomic_inc_uint64_t(&idmapper_stats.misses);
 		return false;
+	}
 
 	found_user =
 	    avltree_container_of(found_node, struct cache_user, uname_node);
-	if (!gss_princ) {
+	if (!idmapper_fresh(found_user->expires, found_user->negative,
+			    &found_user->refreshing, &refresh))
+		return false;
+
+	/* Principals are mapped with the credentials of the call */
+	if (refresh && !gss_princ)
+		idmapper_refresh_name(name, false);
+
+	if (found_user->in_uidtree) {
 		/* I assume that if someone likes this user enough to look it
 		   up by name, they'll like it enough to look it up by ID
 		   later.
@@ -500,8 +753,7 @@ bool idmapper_lookup_by_uname(const struct gsh_buffdesc *name, uid_t *uid,
 		   If the name is gss principal it does not have entry
 		   in uid tree */
 
-		cache_slot = (void **)
-			&uid_cache[found_user->uid % id_cache_size];
+		cache_slot = (void **)uid_slot(found_user->uid);
 		atomic_store_voidptr(cache_slot, &found_user->uid_node);
 	}
 
@@ -520,8 +772,9 @@ bool idmapper_lookup_by_uname(const struct gsh_buffdesc *name, uid_t *uid,
  * @note The caller must hold idmapper_user_lock for read.
  *
  * @param[in]  uid  The user ID to look up.
- * @param[out] name The user name to look up. (May be NULL if the user
- *                  doesn't care about the name.)
+ * @param[out] name The user name, as the XDR opaque of the owner
+ *                  attribute. (May be NULL if the user doesn't care
+ *                  about the name.)
  * @param[out] gid  The GID for the user, or NULL if there is
  *                  none. The caller may specify NULL if it isn't
  *                  interested.
@@ -536,10 +789,11 @@ bool idmapper_lookup_by_uid(const uid_t uid, const struct gsh_buffdesc **name,
 	struct cache_user prototype = {
 		.uid = uid
 	};
-	void **cache_slot = (void **)&uid_cache[uid % id_cache_size];
+	void **cache_slot = (void **)uid_slot(uid);
 	struct avltree_node *found_node = atomic_fetch_voidptr(cache_slot);
 	struct cache_user *found_user;
 	bool found = false;
+	bool refresh;
 
 	if (likely(found_node)) {
 		found_user = avltree_container_of(found_node,
@@ -551,8 +805,10 @@ bool idmapper_lookup_by_uid(const uid_t uid, const struct gsh_buffdesc **name,
 
 	if (unlikely(!found)) {
 		found_node = avltree_lookup(&prototype.uid_node, &uid_tree);
-		if (unlikely(!found_node))
+		if (unlikely(!found_node)) {
+			(void) atomic_inc_uint64_t(&idmapper_stats.misses);
 			return false;
+		}
 
 		atomic_store_voidptr(cache_slot, found_node);
 		found_user = avltree_container_of(found_node,
@@ -560,8 +816,15 @@ bool idmapper_lookup_by_uid(const uid_t uid, const struct gsh_buffdesc **name,
 						  uid_node);
 	}
 
+	if (!idmapper_fresh(found_user->expires, found_user->negative,
+			    &found_user->refreshing, &refresh))
+		return false;
+
+	if (refresh)
+		idmapper_refresh_id(uid, false);
+
 	if (likely(name))
-		*name = &found_user->uname;
+		*name = &found_user->xdr_name;
 
 	if (gid)
 		*gid = (found_user->gid_set ? &found_user->gid : NULL);
@@ -593,19 +856,30 @@ bool idmapper_lookup_by_gname(const struct gsh_buffdesc *name, uid_t *gid)
 							 &gname_tree);
 	struct cache_group *found_group;
 	void **cache_slot;
+	bool refresh;
 
-	if (unlikely(!found_node))
+	if (unlikely(!found_node)) {
+		(void) atomic_inc_uint64_t(&idmapper_stats.misses);
 		return false;
+	}
 
 	found_group =
 	    avltree_container_of(found_node, struct cache_group, gname_node);
+	if (!idmapper_fresh(found_group->expires, found_group->negative,
+			    &found_group->refreshing, &refresh))
+		return false;
+
+	if (refresh)
+		idmapper_refresh_name(name, true);
 
 	/* I assume that if someone likes this group enough to look it
 	   up by name, they'll like it enough to look it up by ID
 	   later. */
 
-	cache_slot = (void **)&gid_cache[found_group->gid % id_cache_size];
-	atomic_store_voidptr(cache_slot, &found_group->gid_node);
+	if (found_group->in_gidtree) {
+		cache_slot = (void **)gid_slot(found_group->gid);
+		atomic_store_voidptr(cache_slot, &found_group->gid_node);
+	}
 
 	if (likely(gid))
 		*gid = found_group->gid;
@@ -621,8 +895,9 @@ bool idmapper_lookup_by_gname(const struct gsh_buffdesc *name, uid_t *gid)
  * @note The caller must hold idmapper_group_lock for read.
  *
  * @param[in]  gid  The group ID to look up.
- * @param[out] name The user name to look up. (May be NULL if the user
- *                  doesn't care about the name, which would be weird.)
+ * @param[out] name The group name, as the XDR opaque of the owner_group
+ *                  attribute. (May be NULL if the user doesn't care
+ *                  about the name, which would be weird.)
  *
  * @retval true on success.
  * @retval false if we're most unfortunate.
@@ -633,10 +908,11 @@ bool idmapper_lookup_by_gid(const gid_t gid, const struct gsh_buffdesc **name)
 	struct cache_group prototype = {
 		.gid = gid
 	};
-	void **cache_slot = (void **)&gid_cache[gid % id_cache_size];
+	void **cache_slot = (void **)gid_slot(gid);
 	struct avltree_node *found_node = atomic_fetch_voidptr(cache_slot);
 	struct cache_group *found_group;
 	bool found = false;
+	bool refresh;
 
 	if (likely(found_node)) {
 		found_group = avltree_container_of(found_node,
@@ -648,8 +924,10 @@ bool idmapper_lookup_by_gid(const gid_t gid, const struct gsh_buffdesc **name)
 
 	if (unlikely(!found)) {
 		found_node = avltree_lookup(&prototype.gid_node, &gid_tree);
-		if (unlikely(!found_node))
+		if (unlikely(!found_node)) {
+			(void) atomic_inc_uint64_t(&idmapper_stats.misses);
 			return false;
+		}
 
 		atomic_store_voidptr(cache_slot, found_node);
 		found_group = avltree_container_of(found_node,
@@ -657,8 +935,15 @@ bool idmapper_lookup_by_gid(const gid_t gid, const struct gsh_buffdesc **name)
 						   gid_node);
 	}
 
+	if (!idmapper_fresh(found_group->expires, found_group->negative,
+			    &found_group->refreshing, &refresh))
+		return false;
+
+	if (refresh)
+		idmapper_refresh_id(gid, true);
+
 	if (likely(name))
-		*name = &found_group->gname;
+		*name = &found_group->xdr_name;
 	else
 		LogDebug(COMPONENT_IDMAPPER, "Caller is being weird.");
 
@@ -676,8 +961,12 @@ void idmapper_clear_cache(void)
 	PTHREAD_RWLOCK_wrlock(&idmapper_user_lock);
 	PTHREAD_RWLOCK_wrlock(&idmapper_group_lock);
 
+	gsh_cache_clear(princ_cache);
+	atomic_inc_uint32_t(&idmapper_generation);
 	memset(uid_cache, 0, id_cache_size * sizeof(struct avltree_node *));
 	memset(gid_cache, 0, id_cache_size * sizeof(struct avltree_node *));
+	memset(uid_dense, 0, id_dense_size * sizeof(struct avltree_node *));
+	memset(gid_dense, 0, id_dense_size * sizeof(struct avltree_node *));
 
 	for (node = avltree_first(&uname_tree);
 	     node != NULL;
@@ -687,11 +976,22 @@ void idmapper_clear_cache(void)
 		user = avltree_container_of(node,
 					    struct cache_user, uname_node);
 		avltree_remove(&user->uname_node, &uname_tree);
-		avltree_remove(&user->uid_node, &uid_tree);
+		if (user->in_uidtree)
+			avltree_remove(&user->uid_node, &uid_tree);
 		gsh_free(user);
 	}
 
-	assert(avltree_first(&uid_tree) == NULL);
+	/* IDs that mapped to no name */
+	for (node = avltree_first(&uid_tree);
+	     node != NULL;
+	     node = avltree_first(&uid_tree)) {
+		struct cache_user *user;
+
+		user = avltree_container_of(node,
+					    struct cache_user, uid_node);
+		avltree_remove(&user->uid_node, &uid_tree);
+		gsh_free(user);
+	}
 
 	for (node = avltree_first(&gname_tree);
 	     node != NULL;
@@ -701,14 +1001,88 @@ void idmapper_clear_cache(void)
 		group = avltree_container_of(node,
 					     struct cache_group, gname_node);
 		avltree_remove(&group->gname_node, &gname_tree);
-		avltree_remove(&group->gid_node, &gid_tree);
+		if (group->in_gidtree)
+			avltree_remove(&group->gid_node, &gid_tree);
 		gsh_free(group);
 	}
 
-	assert(avltree_first(&gid_tree) == NULL);
+	for (node = avltree_first(&gid_tree);
+	     node != NULL;
+	     node = avltree_first(&gid_tree)) {
+		struct cache_group *group;
+
+		group = avltree_container_of(node,
+					     struct cache_group, gid_node);
+		avltree_remove(&group->gid_node, &gid_tree);
+		gsh_free(group);
+	}
 
 	PTHREAD_RWLOCK_unlock(&idmapper_group_lock);
 	PTHREAD_RWLOCK_unlock(&idmapper_user_lock);
 }
 
+/**
+ * @brief Look up a principal without the user lock
+ *
+ * @param[in]  name The principal
+ * @param[out] uid  The UID it maps to
+ * @param[out] gid  The GID it maps to
+ *
+ * @retval true if the principal was mapped lately.
+ * @retval false if it has to be looked up.
+ */
+
+bool idmapper_lookup_principal(const struct gsh_buffdesc *name, uid_t *uid,
+			       gid_t *gid)
+{
+	struct princ_ids ids;
+
+	if (gsh_cache_lookup(princ_cache, name->addr, name->len, &ids,
+			     NULL) != GSH_CACHE_HIT)
+		return false;
+
+	*uid = ids.uid;
+	*gid = ids.gid;
+	return true;
+}
+
+/**
+ * @brief Remember the mapping of a principal
+ *
+ * If another thread is writing the slot, the mapping is not kept.
+ *
+ * @param[in] name The principal
+ * @param[in] uid  The UID it maps to
+ * @param[in] gid  The GID it maps to
+ */
+
+void idmapper_add_principal(const struct gsh_buffdesc *name, uid_t uid,
+			    gid_t gid)
+{
+	struct princ_ids ids = { .uid = uid, .gid = gid };
+
+	gsh_cache_insert(princ_cache, name->addr, name->len, &ids,
+			 sizeof(ids));
+}
+
+/**
+ * @brief Read the counters of the cache
+ *
+ * @param[out] stats The counters
+ */
+
+void idmapper_get_stats(struct idmapper_stats *stats)
+{
+	stats->hits = atomic_fetch_uint64_t(&idmapper_stats.hits);
+	stats->negative_hits =
+		atomic_fetch_uint64_t(&idmapper_stats.negative_hits);
+	stats->misses = atomic_fetch_uint64_t(&idmapper_stats.misses);
+	stats->expired = atomic_fetch_uint64_t(&idmapper_stats.expired);
+	stats->refreshes = atomic_fetch_uint64_t(&idmapper_stats.refreshes);
+	stats->lookups = atomic_fetch_uint64_t(&idmapper_stats.lookups);
+	stats->lookup_ns = atomic_fetch_uint64_t(&idmapper_stats.lookup_ns);
+	stats->lookup_max_ns =
+		atomic_fetch_uint64_t(&idmapper_stats.lookup_max_ns);
+}
+
 /** @} */
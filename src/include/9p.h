@@ -53,7 +53,8 @@
 
 #define _9P_LOCK_CLIENT_LEN 64
 
-#define _9P_FID_PER_CONN        1024
+/* Buckets of a new connection's fid table */
+#define _9P_FID_BUCKETS_MIN 16
 
 /* _9P_MSG_SIZE: maximum message size for 9P/TCP */
 #define _9P_MSG_SIZE 70000
@@ -296,6 +297,7 @@ struct _9p_user_cred {
 
 struct _9p_fid {
 	u32 fid;
+	struct _9p_fid *fid_next; /*< In its connection's fid table */
 	/** Ganesha export of the file (refcounted). */
 	struct gsh_export *export;
 	struct _9p_user_cred *ucred; /*< Client credentials (refcounted). */
@@ -319,6 +321,19 @@ struct _9p_fid {
 	} specdata;
 };
 
+/**
+ * @brief Fids of a connection
+ *
+ * A chained hash of the fids by number, doubling as it fills, so a
+ * connection only holds as much as the fids it has.
+ */
+struct _9p_fid_table {
+	pthread_rwlock_t lock;
+	struct _9p_fid **buckets;
+	uint32_t shift;		/*< 32 less log2 of the number of buckets */
+	uint32_t count;
+};
+
 enum _9p_trans_type {
 	_9P_TCP,
 	_9P_RDMA
@@ -359,11 +374,12 @@ struct _9p_conn {
 #endif
 	} trans_data;
 	enum _9p_trans_type trans_type;
-	uint32_t refcount;
+	uint32_t refcount;	/*< Requests in flight, and on TCP one more
+				    until the socket closes */
 	struct gsh_client *client;
 	struct timeval birth;	/* This is useful if same sockfd is
 				   reused on socket's close/open */
-	struct _9p_fid *fids[_9P_FID_PER_CONN];
+	struct _9p_fid_table fids;
 	struct _9p_flush_bucket flush_buckets[FLUSH_BUCKETS];
 	unsigned long sequence;
 	pthread_mutex_t sock_lock;
@@ -379,11 +395,22 @@ struct _9p_outqueue {
 	pthread_cond_t cond;
 };
 
+/**
+ * @brief Buffers of an RDMA device
+ *
+ * Each device has its own input and output buffers, allocated on the
+ * device's NUMA node.  The input buffers are posted to the shared
+ * receive queue, so they are shared by all the device's connections.
+ */
 struct _9p_rdma_priv_pernic {
 	struct ibv_mr *outmr;
 	struct ibv_mr *inmr;
 	uint8_t *rdmabuf;
 	msk_data_t *rdata;
+	uint8_t *outrdmabuf;
+	msk_data_t *wdata;
+	struct _9p_outqueue outqueue;
+	uint32_t numa_node;	/*< GSH_NUMA_NODE_ANY if unknown */
 };
 
 struct _9p_rdma_priv {
@@ -396,7 +423,10 @@ struct _9p_rdma_priv {
 
 struct _9p_request_data {
 	char *_9pmsg;
+	u32 _9pmsg_size;	/*< pooled size of _9pmsg, TCP only */
 	struct _9p_conn *pconn;
+	struct fsal_read_buf *rbuf;	/*< Rread data lent by the FSAL, sent
+					    after the reply, TCP only */
 #ifdef _USE_9P_RDMA
 	msk_data_t *data;
 #endif
@@ -593,6 +623,11 @@ do {                                                   \
  */
 #define _9P_TCP_MSIZE 65536
 
+/**
+ * @brief Default value for _9p_tcp_event_threads
+ */
+#define _9P_TCP_EVENT_THREADS 4
+
 /**
  * @brief Default value for _9p_rdma_msize
  */
@@ -632,6 +667,9 @@ struct _9p_param {
 	/** Msize for 9P operation on tcp.  Defaults to _9P_TCP_MSIZE,
 	    settable by _9P_TCP_Msize */
 	uint32_t _9p_tcp_msize;
+	/** Threads reading the 9P tcp connections.  Defaults to
+	    _9P_TCP_EVENT_THREADS, settable by _9P_TCP_Event_Threads */
+	uint16_t _9p_tcp_event_threads;
 	/** Msize for 9P operation on rdma.  Defaults to _9P_RDMA_MSIZE,
 	    settable by _9P_RDMA_Msize */
 	uint32_t _9p_rdma_msize;
@@ -707,6 +745,13 @@ void _9p_release_opctx(void);
  */
 void free_fid(struct _9p_fid *pfid);
 
+struct _9p_fid *_9p_alloc_fid(void);
+void _9p_release_fid(struct _9p_fid *pfid);
+void _9p_init_fids(struct _9p_conn *conn);
+struct _9p_fid *_9p_lookup_fid(struct _9p_conn *conn, u32 fid);
+void _9p_insert_fid(struct _9p_conn *conn, u32 fid, struct _9p_fid *pfid);
+struct _9p_fid *_9p_remove_fid(struct _9p_conn *conn, u32 fid);
+
 int _9p_tools_get_req_context_by_uid(u32 uid, struct _9p_fid *pfid);
 int _9p_tools_get_req_context_by_name(int uname_len, char *uname_str,
 				      struct _9p_fid *pfid);
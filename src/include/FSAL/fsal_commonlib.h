@@ -198,6 +198,7 @@ fsal_status_t fsal_reopen_obj(struct fsal_obj_handle *obj_hdl,
 			      struct fsal_share *share,
 			      fsal_open_func open_func,
 			      fsal_close_func close_func,
+			      size_t fd_size,
 			      struct fsal_fd **out_fd,
 			      bool *has_lock,
 			      bool *closefd);
@@ -211,11 +212,14 @@ fsal_status_t fsal_find_fd(struct fsal_fd **out_fd,
 			   fsal_openflags_t openflags,
 			   fsal_open_func open_func,
 			   fsal_close_func close_func,
+			   size_t fd_size,
 			   bool *has_lock,
 			   bool *need_fsync,
 			   bool *closefd,
 			   bool open_for_locks);
 
+void fsal_fd_cache_close(struct fsal_obj_handle *obj_hdl);
+
 /**
  * @brief Initialize a state_t structure
  *
@@ -242,6 +246,38 @@ static inline struct state_t *init_state(struct state_t *state,
 	return state;
 }
 
+/**
+ * @brief Describe data read for READ_PLUS
+ *
+ * @param[out] info    The I/O information
+ * @param[in]  offset  Where the data starts
+ * @param[in]  buffer  The data
+ * @param[in]  length  Bytes of data
+ */
+static inline void io_info_data(struct io_info *info, uint64_t offset,
+				void *buffer, size_t length)
+{
+	info->io_content.what = NFS4_CONTENT_DATA;
+	info->io_content.data.d_offset = offset;
+	info->io_content.data.d_data.data_len = length;
+	info->io_content.data.d_data.data_val = buffer;
+}
+
+/**
+ * @brief Describe a hole found instead of data for READ_PLUS
+ *
+ * @param[out] info    The I/O information
+ * @param[in]  offset  Where the hole starts
+ * @param[in]  length  Bytes of hole
+ */
+static inline void io_info_hole(struct io_info *info, uint64_t offset,
+				uint64_t length)
+{
+	info->io_content.what = NFS4_CONTENT_HOLE;
+	info->io_content.hole.di_offset = offset;
+	info->io_content.hole.di_length = length;
+}
+
 bool check_verifier_stat(struct stat *st, fsal_verifier_t verifier);
 
 bool check_verifier_attrlist(struct attrlist *attrs, fsal_verifier_t verifier);
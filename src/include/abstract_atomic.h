@@ -70,6 +70,7 @@
 
 #ifndef _ABSTRACT_ATOMIC_H
 #define _ABSTRACT_ATOMIC_H
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <time.h>
@@ -2470,4 +2471,86 @@ static inline void atomic_store_uint8_t(uint8_t *var, uint8_t val)
 	(void)__sync_lock_test_and_set(var, val);
 }
 #endif
+
+/**
+ * @brief Atomically compare and swap a uint64_t
+ *
+ * This function stores @c newval in the variable indicated by the
+ * supplied pointer if and only if it currently holds @c oldval.
+ *
+ * @param[in,out] var    Pointer to the variable to modify
+ * @param[in]     oldval The value expected
+ * @param[in]     newval The value to store
+ *
+ * @return true if the swap happened.
+ */
+
+#ifdef GCC_ATOMIC_FUNCTIONS
+static inline bool atomic_cas_uint64_t(uint64_t *var, uint64_t oldval,
+				       uint64_t newval)
+{
+	return __atomic_compare_exchange_n(var, &oldval, newval, false,
+					   __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+#elif defined(GCC_SYNC_FUNCTIONS)
+static inline bool atomic_cas_uint64_t(uint64_t *var, uint64_t oldval,
+				       uint64_t newval)
+{
+	return __sync_bool_compare_and_swap(var, oldval, newval);
+}
+#endif
+
+/**
+ * @brief Atomically compare and swap a uint32_t
+ *
+ * This function stores @c newval in the variable indicated by the
+ * supplied pointer if and only if it currently holds @c oldval.
+ *
+ * @param[in,out] var    Pointer to the variable to modify
+ * @param[in]     oldval The value expected
+ * @param[in]     newval The value to store
+ *
+ * @return true if the swap happened.
+ */
+
+#ifdef GCC_ATOMIC_FUNCTIONS
+static inline bool atomic_cas_uint32_t(uint32_t *var, uint32_t oldval,
+				       uint32_t newval)
+{
+	return __atomic_compare_exchange_n(var, &oldval, newval, false,
+					   __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+#elif defined(GCC_SYNC_FUNCTIONS)
+static inline bool atomic_cas_uint32_t(uint32_t *var, uint32_t oldval,
+				       uint32_t newval)
+{
+	return __sync_bool_compare_and_swap(var, oldval, newval);
+}
+#endif
+
+/**
+ * @brief Atomically compare and swap a void pointer
+ *
+ * This function stores @c newval in the pointer indicated by @c var
+ * if and only if it currently holds @c oldval.
+ *
+ * @param[in,out] var    Pointer to the pointer to modify
+ * @param[in]     oldval The value expected
+ * @param[in]     newval The value to store
+ *
+ * @return true if the swap happened.
+ */
+
+#ifdef GCC_ATOMIC_FUNCTIONS
+static inline bool atomic_cas_voidptr(void **var, void *oldval, void *newval)
+{
+	return __atomic_compare_exchange_n(var, &oldval, newval, false,
+					   __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+#elif defined(GCC_SYNC_FUNCTIONS)
+static inline bool atomic_cas_voidptr(void **var, void *oldval, void *newval)
+{
+	return __sync_bool_compare_and_swap(var, oldval, newval);
+}
+#endif
 #endif				/* !_ABSTRACT_ATOMIC_H */
@@ -40,10 +40,201 @@
 #define ABSTRACT_MEM_H
 
 #include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
 #include <string.h>
 #include <assert.h>
 #include "log.h"
 
+/**
+ * @page MemStats Memory Statistics
+ *
+ * Allocations are counted per thread, without locking, into a table
+ * of counters summed when reported.  Every pool has a slot of the
+ * table, shared by the pools of the same name, and pool_alloc and
+ * pool_free count into it.
+ *
+ * Built with USE_MEM_ACCOUNTING, the general allocator also counts
+ * each allocation against the subsystem it was made by, set per
+ * directory in the build with GSH_MEM_TAG.  The tag and size of a
+ * block are kept in a header just before it, so gsh_free can tell what
+ * it releases.  A pointer without the header, that came from some
+ * library's malloc, is passed to free as is; but memory from gsh_malloc
+ * must not be released with a bare free.
+ */
+
+enum mem_tag {
+	MEM_TAG_OTHER,
+	MEM_TAG_MAIN,
+	MEM_TAG_CONFIG,
+	MEM_TAG_HASHTABLE,
+	MEM_TAG_SUPPORT,
+	MEM_TAG_SAL,
+	MEM_TAG_RPCAL,
+	MEM_TAG_PROTOCOLS,
+	MEM_TAG_FSAL,
+	MEM_TAG_MDCACHE,
+	MEM_TAG_IDMAPPER,
+	MEM_TAG_NTIRPC,		/*< The RPC library, XDR buffers included */
+	MEM_TAG_COUNT
+};
+
+#ifndef GSH_MEM_TAG
+#define GSH_MEM_TAG MEM_TAG_OTHER
+#endif
+
+/* Slots of the counter table: the tags, then the pools */
+#define MEM_STATS_SLOTS 256
+
+/* Slot of the pools past the table */
+#define MEM_STATS_OTHER_POOLS (MEM_STATS_SLOTS - 1)
+
+struct mem_counter {
+	uint64_t allocs;
+	uint64_t frees;
+	int64_t bytes;		/*< Net allocated, one thread's may be < 0 */
+};
+
+struct mem_stats_report {
+	const char *name;
+	size_t object_size;	/*< Of a pool, 0 if its pools differ */
+	bool pool;
+	struct mem_counter count;
+};
+
+extern __thread struct mem_counter *mem_counters;
+
+struct mem_counter *mem_stats_thread(void);
+uint32_t mem_stats_pool_slot(const char *name, size_t object_size);
+uint32_t mem_stats_collect(struct mem_stats_report **reports);
+
+/**
+ * @brief This thread's counters of a slot
+ */
+static inline struct mem_counter *mem_counter(uint32_t slot)
+{
+	struct mem_counter *counters = mem_counters;
+
+	if (counters == NULL)
+		counters = mem_stats_thread();
+	return &counters[slot];
+}
+
+#ifdef USE_MEM_ACCOUNTING
+
+#define MEM_ACCT_MAGIC 0x6d656d61
+
+struct mem_acct_hdr {
+	uint32_t magic;
+	uint32_t offset;	/*< Of the block from its allocation */
+	uint64_t size:56;
+	uint64_t tag:8;
+};
+
+#define MEM_ACCT_HDR sizeof(struct mem_acct_hdr)
+
+/* Room before an aligned block, whole multiples of the alignment */
+#define MEM_ACCT_PAD(a) ((a) > MEM_ACCT_HDR ? (a) : MEM_ACCT_HDR)
+
+/**
+ * @brief Set the header of a new block and count it
+ *
+ * @param[in] base   What the system allocator returned
+ * @param[in] offset Of the block in it
+ * @param[in] n      Size of the block
+ * @param[in] tag    Subsystem allocating it
+ *
+ * @return The block.
+ */
+static inline void *mem_acct_set(void *base, size_t offset, size_t n,
+				 unsigned int tag)
+{
+	struct mem_acct_hdr *hdr =
+		(struct mem_acct_hdr *)((char *)base + offset) - 1;
+	struct mem_counter *counter = mem_counter(tag);
+
+	hdr->magic = MEM_ACCT_MAGIC;
+	hdr->offset = offset;
+	hdr->size = n;
+	hdr->tag = tag;
+	counter->allocs++;
+	counter->bytes += n;
+	return hdr + 1;
+}
+
+/**
+ * @brief Find the header of a block
+ *
+ * @return The header, NULL if the block has none.
+ */
+static inline struct mem_acct_hdr *mem_acct_get(void *p)
+{
+	struct mem_acct_hdr *hdr = (struct mem_acct_hdr *)p - 1;
+
+	if (hdr->magic != MEM_ACCT_MAGIC ||
+	    hdr->offset < MEM_ACCT_HDR ||
+	    (hdr->offset & (hdr->offset - 1)) != 0)
+		return NULL;
+	return hdr;
+}
+
+/**
+ * @brief Count a block as freed
+ *
+ * @return What to pass to free.
+ */
+static inline void *mem_acct_release(void *p)
+{
+	struct mem_acct_hdr *hdr = mem_acct_get(p);
+	struct mem_counter *counter;
+
+	if (hdr == NULL)
+		return p;
+
+	counter = mem_counter(hdr->tag);
+	counter->frees++;
+	counter->bytes -= hdr->size;
+	hdr->magic = 0;
+	return (char *)p - hdr->offset;
+}
+
+void *mem_acct_realloc(void *p, size_t n, unsigned int tag);
+
+/**
+ * @brief This thread's general allocations so far, of every tag
+ *
+ * Pools allocate through the general allocator, so their objects are
+ * in the sum already.  The server stats take the difference across a
+ * request to count what its service allocated.
+ *
+ * @param[out] total Sum of the tags' counters
+ */
+static inline void mem_acct_thread_total(struct mem_counter *total)
+{
+	struct mem_counter *counters = mem_counter(0);
+	int tag;
+
+	memset(total, 0, sizeof(*total));
+	for (tag = 0; tag < MEM_TAG_COUNT; tag++) {
+		total->allocs += counters[tag].allocs;
+		total->frees += counters[tag].frees;
+		total->bytes += counters[tag].bytes;
+	}
+}
+
+#else				/* USE_MEM_ACCOUNTING */
+
+#define MEM_ACCT_HDR 0
+#define MEM_ACCT_PAD(a) 0
+
+static inline void *mem_acct_set(void *base, size_t offset, size_t n,
+				 unsigned int tag)
+{
+	return base;
+}
+
+#endif				/* USE_MEM_ACCOUNTING */
+
 /**
  * @page GeneralAllocator General Allocator Shim
  *
@@ -64,6 +255,7 @@
  *
  * This function aborts if no memory is available.
  *
+ * @param[in] tag Subsystem to count the block against
  * @param[in] n Number of bytes to allocate
  * @param[in] file Calling source file
  * @param[in] line Calling source line
@@ -72,17 +264,24 @@
  * @return Pointer to a block of memory.
  */
 static inline void *
-gsh_malloc__(size_t n,
-	     const char *file, int line, const char *function)
+gsh_malloc_tag__(unsigned int tag, size_t n,
+		 const char *file, int line, const char *function)
 {
-	void *p = malloc(n);
+	void *p = malloc(MEM_ACCT_HDR + n);
 
 	if (p == NULL) {
 		LogMallocFailure(file, line, function, "gsh_malloc");
 		abort();
 	}
 
-	return p;
+	return mem_acct_set(p, MEM_ACCT_HDR, n, tag);
+}
+
+static inline void *
+gsh_malloc__(size_t n,
+	     const char *file, int line, const char *function)
+{
+	return gsh_malloc_tag__(GSH_MEM_TAG, n, file, line, function);
 }
 
 #define gsh_malloc(n) gsh_malloc__(n, __FILE__, __LINE__, __func__)
@@ -94,6 +293,7 @@ gsh_malloc__(size_t n,
  * Failure may indicate either insufficient memory or an invalid
  * alignment.
  *
+ * @param[in] tag Subsystem to count the block against
  * @param[in] a Block alignment
  * @param[in] n Number of bytes to allocate
  * @param[in] file Calling source file
@@ -103,15 +303,15 @@ gsh_malloc__(size_t n,
  * @return Pointer to a block of memory or NULL.
  */
 static inline void *
-gsh_malloc_aligned__(size_t a, size_t n,
-		     const char *file, int line, const char *function)
+gsh_malloc_aligned_tag__(unsigned int tag, size_t a, size_t n,
+			 const char *file, int line, const char *function)
 {
 	void *p;
 
 #ifdef __APPLE__
-	p = valloc(n);
+	p = valloc(MEM_ACCT_PAD(a) + n);
 #else
-	if (posix_memalign(&p, a, n) != 0)
+	if (posix_memalign(&p, a, MEM_ACCT_PAD(a) + n) != 0)
 		p = NULL;
 #endif
 	if (p == NULL) {
@@ -119,7 +319,15 @@ gsh_malloc_aligned__(size_t a, size_t n,
 		abort();
 	}
 
-	return p;
+	return mem_acct_set(p, MEM_ACCT_PAD(a), n, tag);
+}
+
+static inline void *
+gsh_malloc_aligned__(size_t a, size_t n,
+		     const char *file, int line, const char *function)
+{
+	return gsh_malloc_aligned_tag__(GSH_MEM_TAG, a, n, file, line,
+					function);
 }
 
 #define gsh_malloc_aligned(a, n) \
@@ -133,23 +341,39 @@ gsh_malloc_aligned__(size_t a, size_t n,
  *
  * This function aborts if no memory is available.
  *
+ * @param[in] tag Subsystem to count the block against
  * @param[in] n Number of objects in block
  * @param[in] s Size of object
  *
  * @return Pointer to a block of zeroed memory.
  */
 static inline void *
-gsh_calloc__(size_t n, size_t s,
-	     const char *file, int line, const char *function)
+gsh_calloc_tag__(unsigned int tag, size_t n, size_t s,
+		 const char *file, int line, const char *function)
 {
-	void *p = calloc(n, s);
+	void *p;
 
+#ifdef USE_MEM_ACCOUNTING
+	if (s != 0 && n > (SIZE_MAX - MEM_ACCT_HDR) / s)
+		p = NULL;
+	else
+		p = calloc(1, MEM_ACCT_HDR + n * s);
+#else
+	p = calloc(n, s);
+#endif
 	if (p == NULL) {
 		LogMallocFailure(file, line, function, "gsh_calloc");
 		abort();
 	}
 
-	return p;
+	return mem_acct_set(p, MEM_ACCT_HDR, n * s, tag);
+}
+
+static inline void *
+gsh_calloc__(size_t n, size_t s,
+	     const char *file, int line, const char *function)
+{
+	return gsh_calloc_tag__(GSH_MEM_TAG, n, s, file, line, function);
 }
 
 #define gsh_calloc(n, s) gsh_calloc__(n, s, __FILE__, __LINE__, __func__)
@@ -163,6 +387,7 @@ gsh_calloc__(size_t n, size_t s,
  *
  * This function aborts if no memory is available to resize.
  *
+ * @param[in] tag Subsystem to count a new block against
  * @param[in] p Block of memory to resize
  * @param[in] n New size
  * @param[in] file Calling source file
@@ -172,10 +397,14 @@ gsh_calloc__(size_t n, size_t s,
  * @return Pointer to the address of the resized block.
  */
 static inline void *
-gsh_realloc__(void *p, size_t n,
-	      const char *file, int line, const char *function)
+gsh_realloc_tag__(unsigned int tag, void *p, size_t n,
+		  const char *file, int line, const char *function)
 {
+#ifdef USE_MEM_ACCOUNTING
+	void *p2 = mem_acct_realloc(p, n, tag);
+#else
 	void *p2 = realloc(p, n);
+#endif
 
 	if (n != 0 && p2 == NULL) {
 		LogMallocFailure(file, line, function, "gsh_realloc");
@@ -185,6 +414,13 @@ gsh_realloc__(void *p, size_t n,
 	return p2;
 }
 
+static inline void *
+gsh_realloc__(void *p, size_t n,
+	      const char *file, int line, const char *function)
+{
+	return gsh_realloc_tag__(GSH_MEM_TAG, p, n, file, line, function);
+}
+
 #define gsh_realloc(p, n) gsh_realloc__(p, n, __FILE__, __LINE__, __func__)
 
 /**
@@ -205,12 +441,19 @@ gsh_realloc__(void *p, size_t n,
 static inline char *
 gsh_strdup__(const char *s, const char *file, int line, const char *function)
 {
+#ifdef USE_MEM_ACCOUNTING
+	size_t n = strlen(s) + 1;
+	char *p = (char *) gsh_malloc__(n, file, line, function);
+
+	memcpy(p, s, n);
+#else
 	char *p = strdup(s);
 
 	if (p == NULL) {
 		LogMallocFailure(file, line, function, "gsh_strdup");
 		abort();
 	}
+#endif
 
 	return p;
 }
@@ -268,6 +511,10 @@ gsh_strldup__(const char *s, size_t length, size_t *copied,
 static inline void
 gsh_free(void *p)
 {
+#ifdef USE_MEM_ACCOUNTING
+	if (p != NULL)
+		p = mem_acct_release(p);
+#endif
 	free(p);
 }
 
@@ -284,7 +531,7 @@ gsh_free(void *p)
 static inline void
 gsh_free_size(void *p, size_t n __attribute__ ((unused)))
 {
-	free(p);
+	gsh_free(p);
 }
 
 /**
@@ -299,20 +546,29 @@ gsh_free_size(void *p, size_t n __attribute__ ((unused)))
  * This allows for flexible growth in the future.
  */
 
+typedef struct huge_pool huge_pool_t;
+
 typedef struct pool {
 	char *name; /*< The name of the pool */
 	size_t object_size; /*< The size of the objects created */
+	uint32_t slot; /*< Of its counters in the memory statistics */
+	huge_pool_t *huge; /*< Backing huge page pool, NULL for malloc */
 } pool_t;
 
+huge_pool_t *huge_pool_select(const char *name, size_t object_size);
+void huge_pool_destroy(huge_pool_t *pool);
+void *huge_alloc(huge_pool_t *pool);
+void huge_free(huge_pool_t *pool, void *object);
+
 /**
  * @brief Create a basic object pool
  *
  * This function creates a new object pool, given a name, object size,
  * constructor and destructor.
  *
- * This particular implementation throws the name away, but other
- * implementations that do tracking or keep counts of allocated or
- * de-allocated objects will likely wish to use it in log messages.
+ * The objects are counted under the name in the memory statistics,
+ * together with those of any other pool of the same name.  A pool
+ * named in Huge_Page_Pools is backed by huge pages, see @ref HugePool.
  *
  * This initializer function is expected to abort if it fails.
  *
@@ -343,6 +599,9 @@ pool_basic_init__(const char *name, size_t object_size,
 	else
 		pool->name = NULL;
 
+	pool->slot = mem_stats_pool_slot(name, object_size);
+	pool->huge = huge_pool_select(name, object_size);
+
 	return pool;
 }
 
@@ -361,6 +620,7 @@ pool_basic_init__(const char *name, size_t object_size,
 static inline void
 pool_destroy(pool_t *pool)
 {
+	huge_pool_destroy(pool->huge);
 	gsh_free(pool->name);
 	gsh_free(pool);
 }
@@ -392,6 +652,12 @@ pool_destroy(pool_t *pool)
 static inline void *
 pool_alloc__(pool_t *pool, const char *file, int line, const char *function)
 {
+	struct mem_counter *counter = mem_counter(pool->slot);
+
+	counter->allocs++;
+	counter->bytes += pool->object_size;
+	if (pool->huge != NULL)
+		return huge_alloc(pool->huge);
 	return gsh_calloc__(1, pool->object_size, file, line, function);
 }
 
@@ -417,7 +683,258 @@ pool_alloc__(pool_t *pool, const char *file, int line, const char *function)
 static inline void
 pool_free(pool_t *pool, void *object)
 {
-	gsh_free(object);
+	struct mem_counter *counter;
+
+	if (object == NULL)
+		return;
+
+	counter = mem_counter(pool->slot);
+	counter->frees++;
+	counter->bytes -= pool->object_size;
+	if (pool->huge != NULL)
+		huge_free(pool->huge, object);
+	else
+		gsh_free(object);
+}
+
+/**
+ * @page IOBufPool I/O Buffer Pool
+ *
+ * READ and WRITE payloads are large, page aligned and short lived,
+ * which is the worst case for a general allocator: sizes past its
+ * mmap threshold turn into an mmap/munmap pair per request.  An I/O
+ * buffer pool keeps freed payload buffers for reuse instead.
+ *
+ * Buffers come in power of two size classes from IOBUF_MIN_SIZE to
+ * IOBUF_MAX_SIZE, all aligned to IOBUF_ALIGN.  Each thread keeps a
+ * cache per class that it allocates from and frees to without
+ * locking.  When a cache grows past its high water mark it spills
+ * down to its low water mark into a depot shared by all threads, and
+ * an empty cache refills from the depot before going to the system
+ * allocator.  The depot is bounded too, and anything past its bound
+ * goes back to the system.  This lets buffers flow between threads
+ * that only allocate (decoders receiving WRITE data) and threads that
+ * only free (workers sending it to the FSAL).
+ *
+ * Larger requests are passed to gsh_malloc_aligned.  A buffer must be
+ * freed with the size it was allocated with, since that is all that
+ * identifies its class.  A NULL pool means no pooling at all.
+ */
+
+#define IOBUF_ALIGN 4096
+#define IOBUF_MIN_SHIFT 12
+#define IOBUF_MAX_SHIFT 20
+#define IOBUF_MIN_SIZE (1UL << IOBUF_MIN_SHIFT)
+#define IOBUF_MAX_SIZE (1UL << IOBUF_MAX_SHIFT)
+#define IOBUF_CLASSES (IOBUF_MAX_SHIFT - IOBUF_MIN_SHIFT + 1)
+
+typedef struct iobuf_pool iobuf_pool_t;
+
+/**
+ * @brief I/O buffer pool statistics
+ *
+ * Allocations served from a thread cache are counted by that thread
+ * and folded in whenever it takes the depot lock, so a snapshot lags
+ * slightly behind.
+ */
+
+struct iobuf_pool_stats {
+	uint64_t allocs;	/*< Buffers handed out */
+	uint64_t cache_hits;	/*< ... straight from a thread cache */
+	uint64_t depot_refills;	/*< Thread caches refilled from the depot */
+	uint64_t mallocs;	/*< Buffers taken from the system */
+	uint64_t releases;	/*< Buffers given back to the system */
+	uint64_t oversize;	/*< Requests past IOBUF_MAX_SIZE */
+	uint64_t depot[IOBUF_CLASSES];	/*< Buffers now in the depot */
+};
+
+iobuf_pool_t *iobuf_pool_init(const char *name, size_t high_water,
+			      size_t low_water, size_t depot_max);
+void iobuf_pool_destroy(iobuf_pool_t *pool);
+void *iobuf_alloc(iobuf_pool_t *pool, size_t size);
+void iobuf_free(iobuf_pool_t *pool, void *buf, size_t size);
+void iobuf_pool_stats(iobuf_pool_t *pool, struct iobuf_pool_stats *stats);
+
+/**
+ * @page SlabPool Slab Pool
+ *
+ * Long lived, fixed size objects that exist in large numbers, such as
+ * state owners, cost more than their size when each is a separate
+ * malloc: every one carries allocator overhead and they scatter across
+ * the heap.  A slab pool carves them out of SLAB_SIZE chunks instead,
+ * packed back to back at a cache line aligned stride, and chains free
+ * objects through their first word.
+ *
+ * Slabs are aligned to their own size, so an object finds its slab by
+ * masking its address and nothing is stored per object.  Allocation
+ * prefers the slab that was partly used first, leaving later slabs to
+ * drain; once a slab is empty it is given back to the system, except
+ * for one spare kept to avoid thrashing at a boundary.  Objects larger
+ * than a slab can hold are not supported.  Allocated objects are
+ * zeroed, as with pool_alloc.
+ *
+ * A pool made with slab_pool_init_node places its slabs on a NUMA
+ * node, see gsh_numa_alloc.
+ */
+
+#define SLAB_SIZE (64 * 1024)
+
+typedef struct slab_pool slab_pool_t;
+
+struct slab_pool_stats {
+	uint64_t object_size;	/*< Stride of each object, in bytes */
+	uint64_t objects;	/*< Objects now allocated */
+	uint64_t slabs;		/*< Slabs now held */
+	uint64_t allocs;	/*< Objects handed out */
+	uint64_t slab_allocs;	/*< Slabs taken from the system */
+	uint64_t slab_releases;	/*< Slabs given back to the system */
+};
+
+slab_pool_t *slab_pool_init(const char *name, size_t object_size);
+slab_pool_t *slab_pool_init_node(const char *name, size_t object_size,
+				 uint32_t node);
+void slab_pool_destroy(slab_pool_t *pool);
+void *slab_alloc(slab_pool_t *pool);
+void slab_free(slab_pool_t *pool, void *object);
+void slab_pool_stats(slab_pool_t *pool, struct slab_pool_stats *stats);
+
+/**
+ * @page HugePool Huge Page Pool
+ *
+ * Objects that exist by the million, such as MDCACHE entries, spread
+ * over so many small pages that the TLB misses show.  A pool named in
+ * Huge_Page_Pools is carved out of HUGE_REGION_SIZE regions backed by
+ * huge pages instead: transparent ones, asked for with madvise, or
+ * explicit hugetlbfs ones reserved by the administrator, falling back
+ * to transparent ones once there are none left.
+ *
+ * Each thread keeps a cache of free objects of each pool, allocating
+ * from it and freeing to it without locking; past HUGE_CACHE_HIGH it
+ * spills down to HUGE_CACHE_LOW into a depot shared by the threads,
+ * as the I/O buffer pool does.  An empty cache refills from the depot,
+ * then from the current region.  Regions are only given back when the
+ * pool is destroyed, which suits objects whose number is bounded, such
+ * as by the MDCACHE LRU, rather than ones that come in bursts.
+ *
+ * The objects are zeroed when allocated, as with pool_alloc.
+ */
+
+#define HUGE_REGION_SIZE (2 * 1024 * 1024)
+
+/** Objects a thread cache keeps before spilling to the depot */
+#define HUGE_CACHE_HIGH 256
+
+/** Objects it keeps after a spill, and refills to */
+#define HUGE_CACHE_LOW 128
+
+/** Values of Huge_Pages */
+enum huge_page_mode {
+	HUGE_PAGES_NONE,	/*< Huge_Page_Pools are plain pools */
+	HUGE_PAGES_TRANSPARENT,	/*< madvise(MADV_HUGEPAGE) */
+	HUGE_PAGES_EXPLICIT,	/*< MAP_HUGETLB, then transparent */
+};
+
+struct huge_pool_stats {
+	uint64_t object_size;	/*< Stride of each object, in bytes */
+	uint64_t regions;	/*< Regions mapped */
+	uint64_t explicit;	/*< ... of which hugetlbfs pages */
+	uint64_t carved;	/*< Objects carved from the regions */
+	uint64_t depot;		/*< Objects now in the depot */
+	uint64_t depot_refills;	/*< Thread caches refilled from it */
+};
+
+void huge_pool_stats(huge_pool_t *pool, struct huge_pool_stats *stats);
+
+/**
+ * @page MemArena Memory Arena
+ *
+ * Some results are built from many small pieces that all die at once,
+ * such as the entries, names and attributes of a READDIR reply.  A
+ * memory arena hands them out by bumping a pointer through
+ * MEM_ARENA_CHUNK sized chunks and frees everything together with
+ * mem_arena_release(), so none of the pieces is freed on its own.
+ *
+ * Requests larger than a quarter chunk get a chunk of their own, kept
+ * behind the current one so its remaining space is not wasted.  The
+ * most recent allocation may be shrunk with mem_arena_trim(), which
+ * lets a caller reserve a worst case buffer and give back what it did
+ * not use.  An arena does no locking; zero initialise it before use.
+ */
+
+#define MEM_ARENA_CHUNK (16 * 1024)
+#define MEM_ARENA_ALIGN 8
+
+struct mem_arena_chunk {
+	struct mem_arena_chunk *next;
+	size_t size;		/*< Usable bytes in data */
+	size_t used;		/*< Bytes handed out */
+	char data[];
+};
+
+struct mem_arena {
+	struct mem_arena_chunk *chunks;	/*< Current chunk first */
+};
+
+static inline size_t mem_arena_round(size_t size)
+{
+	return (size + MEM_ARENA_ALIGN - 1) & ~((size_t) MEM_ARENA_ALIGN - 1);
+}
+
+void *mem_arena_alloc_slow(struct mem_arena *arena, size_t size);
+void mem_arena_release(struct mem_arena *arena);
+void mem_arena_splice(struct mem_arena *arena, struct mem_arena *from);
+
+/**
+ * @brief Allocate uninitialised memory from an arena
+ *
+ * @param[in,out] arena  The arena
+ * @param[in]     size   Bytes wanted
+ *
+ * @return The memory, MEM_ARENA_ALIGN aligned.
+ */
+static inline void *mem_arena_alloc(struct mem_arena *arena, size_t size)
+{
+	struct mem_arena_chunk *chunk = arena->chunks;
+	void *p;
+
+	size = mem_arena_round(size);
+
+	if (chunk == NULL || chunk->size - chunk->used < size)
+		return mem_arena_alloc_slow(arena, size);
+
+	p = chunk->data + chunk->used;
+	chunk->used += size;
+	return p;
+}
+
+static inline void *mem_arena_calloc(struct mem_arena *arena, size_t n,
+				     size_t size)
+{
+	void *p = mem_arena_alloc(arena, n * size);
+
+	memset(p, 0, n * size);
+	return p;
+}
+
+/**
+ * @brief Shrink the most recent allocation from an arena
+ *
+ * Does nothing if @a p is not the most recent allocation.
+ *
+ * @param[in,out] arena     The arena
+ * @param[in]     p         The allocation
+ * @param[in]     size      Size it was allocated with
+ * @param[in]     new_size  Size to keep, no more than @a size
+ */
+static inline void mem_arena_trim(struct mem_arena *arena, void *p,
+				  size_t size, size_t new_size)
+{
+	struct mem_arena_chunk *chunk = arena->chunks;
+
+	size = mem_arena_round(size);
+
+	if (chunk != NULL && (char *)p + size == chunk->data + chunk->used)
+		chunk->used -= size - mem_arena_round(new_size);
 }
 
 #endif /* ABSTRACT_MEM_H */
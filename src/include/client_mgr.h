@@ -44,14 +44,33 @@
 
 #include "avltree.h"
 #include "gsh_types.h"
+#include "fsal_types.h"
+
+/* Slots of the export permission cache of a client */
+#define CLIENT_EXPORT_PERMS 16
+
+/**
+ * @brief Export permissions resolved for a client
+ *
+ * Filled by export_check_access, valid while export_perms_gen stays
+ * at generation.
+ */
+struct gsh_client_perms {
+	uint64_t generation;	/*< 0 if the slot is empty */
+	uint16_t export_id;
+	struct export_perms perms;
+};
 
 struct gsh_client {
 	struct avltree_node node_k;
+	/** Protects perms */
 	pthread_rwlock_t lock;
 	struct gsh_buffdesc addr;
 	int64_t refcnt;
 	nsecs_elapsed_t last_update;
 	char *hostaddr_str;
+	/** Export permissions cache, by export_id */
+	struct gsh_client_perms perms[CLIENT_EXPORT_PERMS];
 	unsigned char addrbuf[];
 };
 
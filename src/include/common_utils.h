@@ -19,6 +19,7 @@
 
 #include "gsh_types.h"
 #include "log.h"
+#include "lock_prof.h"
 
 /**
  * BUILD_BUG_ON - break compile if a condition is true.
@@ -141,7 +142,9 @@ extern int portable_clock_gettime(struct timespec *ts);
 	do {								\
 		int rc;							\
 									\
-		rc = pthread_rwlock_wrlock(_lock);			\
+		rc = LOCK_PROF_ACQUIRE(_lock,				\
+				       pthread_rwlock_trywrlock(_lock),	\
+				       pthread_rwlock_wrlock(_lock));	\
 		if (rc == 0) {						\
 			LogFullDebug(COMPONENT_RW_LOCK,			\
 				     "Got write lock on %p (%s) "	\
@@ -166,7 +169,9 @@ extern int portable_clock_gettime(struct timespec *ts);
 	do {								\
 		int rc;							\
 									\
-		rc = pthread_rwlock_rdlock(_lock);			\
+		rc = LOCK_PROF_ACQUIRE(_lock,				\
+				       pthread_rwlock_tryrdlock(_lock),	\
+				       pthread_rwlock_rdlock(_lock));	\
 		if (rc == 0) {						\
 			LogFullDebug(COMPONENT_RW_LOCK,			\
 				     "Got read lock on %p (%s) "	\
@@ -191,7 +196,8 @@ extern int portable_clock_gettime(struct timespec *ts);
 	do {								\
 		int rc;							\
 									\
-		rc = pthread_rwlock_unlock(_lock);			\
+		rc = LOCK_PROF_RELEASE(_lock,				\
+				       pthread_rwlock_unlock(_lock));	\
 		if (rc == 0) {						\
 			LogFullDebug(COMPONENT_RW_LOCK,			\
 				     "Unlocked %p (%s) at %s:%d",       \
@@ -216,7 +222,9 @@ extern int portable_clock_gettime(struct timespec *ts);
 	do {								\
 		int rc;							\
 									\
-		rc = pthread_mutex_lock(_mtx);				\
+		rc = LOCK_PROF_ACQUIRE(_mtx,				\
+				       pthread_mutex_trylock(_mtx),	\
+				       pthread_mutex_lock(_mtx));	\
 		if (rc == 0) {						\
 			LogFullDebug(COMPONENT_RW_LOCK,			\
 				     "Acquired mutex %p (%s) at %s:%d",	\
@@ -241,7 +249,8 @@ extern int portable_clock_gettime(struct timespec *ts);
 	do {								\
 		int rc;							\
 									\
-		rc = pthread_mutex_unlock(_mtx);			\
+		rc = LOCK_PROF_RELEASE(_mtx,				\
+				       pthread_mutex_unlock(_mtx));	\
 		if (rc == 0) {						\
 			LogFullDebug(COMPONENT_RW_LOCK,			\
 				     "Released mutex %p (%s) at %s:%d",	\
@@ -27,11 +27,15 @@
 #cmakedefine _USE_9P 1
 #cmakedefine _USE_9P_RDMA 1
 #cmakedefine _USE_NFS_RDMA 1
+#cmakedefine USE_RPC_TLS 1
 #cmakedefine _USE_NFS3 1
 #cmakedefine _USE_NLM 1
 #cmakedefine DEBUG_SAL 1
+#cmakedefine USE_LOCK_PROFILING 1
+#cmakedefine USE_MEM_ACCOUNTING 1
 #cmakedefine _VALGRIND_MEMCHECK 1
 #cmakedefine _NO_MOUNT_LIST 1
+#cmakedefine _ERROR_INJECTION 1
 #cmakedefine HAVE_STDBOOL_H 1
 #cmakedefine HAVE_KRB5 1
 #cmakedefine KRB5_VERSION @KRB5_VERSION@
@@ -47,16 +51,27 @@
 #cmakedefine LITTLEEND 1
 #cmakedefine BIGEND 1
 #cmakedefine HAVE_XATTR_H 1
+#cmakedefine HAVE_LINUX_IO_URING_H 1
+#cmakedefine HAVE_STATX 1
 #cmakedefine HAVE_DAEMON 1
 #cmakedefine USE_LTTNG 1
 #cmakedefine ENABLE_VFS_DEBUG_ACL 1
 #cmakedefine ENABLE_RFC_ACL 1
 #cmakedefine USE_GLUSTER_SYMLINK_MOUNT 1
+#cmakedefine USE_GLUSTER_COPY_FILE_RANGE 1
+#cmakedefine USE_GLUSTER_UPCALL_REGISTER 1
 #cmakedefine USE_FSAL_CEPH_MKNOD 1
 #cmakedefine USE_FSAL_CEPH_SETLK 1
+#cmakedefine USE_FSAL_CEPH_LL_LSEEK 1
+#cmakedefine USE_FSAL_CEPH_LL_FALLOCATE 1
+#cmakedefine USE_FSAL_CEPH_LL_IOV 1
+#cmakedefine USE_FSAL_CEPH_LL_NONBLOCKING_RW 1
+#cmakedefine USE_FSAL_CEPH_LL_REGISTER_CALLBACKS 1
 
 #define NFS_GANESHA 1
 
+#define LOG_COMPILED_LEVEL NIV_@LOG_COMPILED_LEVEL@
+
 #define GANESHA_CONFIG_PATH "@SYSCONFDIR@/ganesha/ganesha.conf"
 #define GANESHA_PIDFILE_PATH "@SYSSTATEDIR@/run/ganesha.pid"
 #define NFS_V4_RECOV_ROOT "@SYSSTATEDIR@/lib/nfs/ganesha"
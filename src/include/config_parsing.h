@@ -832,6 +832,9 @@ void config_Print(FILE *output, config_file_t config);
 /* Free the memory structure that store the configuration. */
 void config_Free(config_file_t config);
 
+/* cache parse trees in a binary file */
+void config_set_cache(const char *cache_path);
+
 /* Find the root of the parse tree given a TYPE_BLOCK node */
 config_file_t get_parse_root(void *node);
 
@@ -845,6 +848,22 @@ int find_config_nodes(config_file_t config, char *expr,
 		     struct config_node_list **node_list,
 		      struct config_error_type *err_type);
 
+/* find every top level block of a name */
+int find_config_blocks(config_file_t config, const char *name,
+		       struct config_node_list **node_list);
+
+/* first value of a parameter of a block */
+const char *config_block_value(void *tree_node, const char *name);
+
+/* first sub-block of a block with a name */
+void *config_sub_block(void *tree_node, const char *name);
+
+/* file a parse tree was read from */
+const char *config_root_file(config_file_t config);
+
+/* fingerprint of a block, same for blocks that load the same */
+uint64_t config_node_hash(void *tree_node, uint64_t seed);
+
 /* fill configuration structure from parse tree */
 int load_config_from_node(void *tree_node,
 			  struct config_block *conf_blk,
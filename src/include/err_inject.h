@@ -21,13 +21,80 @@
  *
  */
 
+/**
+ * @file err_inject.h
+ * @brief Error and latency injection
+ *
+ * A layer wanting latency injected into its calls registers a set of
+ * points, one for each call, and asks for the delay of a point before
+ * making the call.  The delays, and caps on the bytes read and written
+ * a second, are set through DBus while the server runs, so that a slow
+ * backend can be made up in front of a fast one.
+ */
+
 #ifndef ERR_INJECT_H
 #define ERR_INJECT_H
 
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+#include "gsh_list.h"
+
 #ifdef _ERROR_INJECTION
 extern int worker_delay_time;
 extern int next_worker_delay_time;
 int init_error_injector(void);
+
+/**
+ * @brief Latency injected at a point
+ *
+ * A call waits base_us, plus up to jitter_us more taken uniformly, and
+ * tail_ppm calls in a million wait tail_us on top of that.
+ */
+struct err_inject_delay {
+	uint32_t base_us;
+	uint32_t jitter_us;
+	uint32_t tail_ppm;
+	uint32_t tail_us;
+};
+
+/**
+ * @brief A cap on bytes a second
+ *
+ * The bytes let through are paced, each call waiting until the bytes
+ * before it and its own would have gone at the rate.
+ */
+struct err_inject_rate {
+	pthread_mutex_t mtx;
+	uint64_t bytes_per_sec;	/*< 0 for no cap */
+	struct timespec next;	/*< When the bytes let through are done */
+};
+
+/**
+ * @brief The points of a layer
+ */
+struct err_inject_points {
+	struct glist_head list;		/*< On the registered sets */
+	const char *name;		/*< Of the layer, as given to DBus */
+	const char * const *op_names;	/*< Name of each point */
+	struct err_inject_delay *delays; /*< Delay of each point */
+	uint32_t count;			/*< Of points */
+	uint32_t armed;			/*< Points with a delay, and caps */
+	struct err_inject_rate read;
+	struct err_inject_rate write;
+};
+
+void err_inject_register(struct err_inject_points *points);
+void err_inject_unregister(struct err_inject_points *points);
+void err_inject_wait(struct err_inject_points *points, uint32_t op);
+void err_inject_throttle(struct err_inject_points *points, bool write,
+			 uint64_t bytes);
+
+#ifdef USE_DBUS
+void dbus_err_inject_init(void);
 #endif
 
+#endif				/* _ERROR_INJECTION */
+
 #endif				/* ERR_INJECT_H */
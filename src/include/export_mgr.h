@@ -40,6 +40,7 @@
 #include "avltree.h"
 #include "abstract_atomic.h"
 #include "fsal.h"
+#include "nfs_qos.h"
 
 #ifndef EXPORT_MGR_H
 #define EXPORT_MGR_H
@@ -67,6 +68,15 @@ struct gsh_export {
 	struct glist_head exp_lock_list;
 	/** List of NLM shares belonging to this export */
 	struct glist_head exp_nlm_share_list;
+	/** Exports with the same fullpath, protected by export_by_id.lock */
+	struct glist_head exp_path_list;
+	/** Exports with the same pseudopath, protected by export_by_id.lock */
+	struct glist_head exp_pseudo_list;
+	/** Exports in the same tag bucket, protected by export_by_id.lock */
+	struct glist_head exp_tag_list;
+	/** Nodes of the path tries this export is on */
+	struct export_path_node *exp_path_node;
+	struct export_path_node *exp_pseudo_node;
 	/** List of exports rooted on the same inode */
 	struct glist_head exp_root_list;
 	/** List of exports to be mounted or cleaned up */
@@ -79,6 +89,9 @@ struct gsh_export {
 	struct fsal_obj_handle *exp_root_obj;
 	/** CFG Allowed clients - update protected by lock */
 	struct glist_head clients;
+	/** Allowed clients compiled for lookup by address - update protected
+	    by lock */
+	struct export_client_index *client_index;
 	/** Entry for the junction of this export.  Protected by lock */
 	struct fsal_obj_handle *exp_junction_obj;
 	/** The export this export sits on. Protected by lock */
@@ -117,6 +130,10 @@ struct gsh_export {
 	struct export_perms export_perms;
 	/** The last time the export stats were updated */
 	nsecs_elapsed_t last_update;
+	/** Fingerprint of the EXPORT block and defaults the export was
+	    last loaded from by a config reload, 0 if not known.  A
+	    reload skips the export while its block keeps this hash. */
+	uint64_t config_hash;
 	/** CFG: Export non-permission options - atomic changeable option */
 	uint32_t options;
 	/** CFG: Export non-permission options set - atomic changeable option */
@@ -124,11 +141,30 @@ struct gsh_export {
 	/** CFG: Expiration time interval in seconds for attributes.  Settable
 	    with Attr_Expiration_Time. - atomic changeable option */
 	int32_t expire_time_attr;
+	/** CFG: Seconds a Lazy_Init export stays up unused - static option */
+	uint32_t lazy_idle_time;
+	/** Lazy_Init: FSAL module of the export, protected by lazy_mtx */
+	struct fsal_module *lazy_fsal;
+	/** Lazy_Init: config file holding the FSAL block */
+	char *lazy_config;
+	/** Lazy_Init: serializes creating and releasing the FSAL export */
+	pthread_mutex_t lazy_mtx;
+	/** Lazy_Init: last use, in seconds since the epoch */
+	uint64_t lazy_last_use;
+	/** CFG: IOPS and bandwidth limits - changeable option */
+	struct qos_limits qos_limits;
+	/** Their token buckets, checked by the fair queue */
+	struct qos_bucket qos;
 	/** CFG: Export_Id for this export - static option */
 	uint16_t export_id;
 
 	uint8_t export_status;		/*< current condition */
 	bool has_pnfs_ds;		/*< id_servers matches export_id */
+	/** CFG: Create the FSAL export on first use - static option */
+	bool lazy_init;
+	/** Lazy_Init: fsal_export and exp_root_obj are set.  Held by a
+	    reference, an export that is not active has no fsal_export. */
+	uint8_t lazy_active;
 };
 
 static inline bool op_ctx_export_has_option(uint32_t option)
@@ -159,6 +195,10 @@ struct gsh_export *get_gsh_export_by_tag(char *tag);
 bool mount_gsh_export(struct gsh_export *exp);
 void put_gsh_export(struct gsh_export *a_export);
 void remove_gsh_export(uint16_t export_id);
+bool export_lazy_idle(struct gsh_export *a_export, uint64_t before,
+		      struct fsal_export **fsal_export);
+bool export_activate(struct gsh_export *a_export);
+void export_lazy_sweep(void);
 bool foreach_gsh_export(bool(*cb) (struct gsh_export *exp, void *state),
 			void *state);
 
@@ -180,6 +220,21 @@ static inline bool export_ready(struct gsh_export *a_export)
 	return a_export->export_status == EXPORT_READY;
 }
 
+/**
+ * @brief Whether the FSAL export of an export is created
+ *
+ * Only a Lazy_Init export not used yet, or idle, is not active.
+ *
+ * @param[in] export The export to test.
+ *
+ * @retval true if the export has its fsal_export
+ */
+static inline bool export_is_active(struct gsh_export *a_export)
+{
+	return !a_export->lazy_init ||
+	       atomic_fetch_uint8_t(&a_export->lazy_active);
+}
+
 static inline void get_gsh_export_ref(struct gsh_export *a_export)
 {
 	(void) atomic_inc_int64_t(&a_export->refcnt);
@@ -197,5 +252,13 @@ extern struct config_block update_export_param;
 
 void remove_all_exports(void);
 
+/** Bumped whenever export permissions may have changed */
+extern uint64_t export_perms_gen;
+
+static inline void export_perms_changed(void)
+{
+	(void) atomic_inc_uint64_t(&export_perms_gen);
+}
+
 #endif				/* !EXPORT_MGR_H */
 /** @} */
@@ -44,6 +44,7 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <sched.h>
 #include "gsh_list.h"
 #include "wait_queue.h"
 
@@ -59,8 +60,25 @@ extern struct fridgethr *req_fridge;
 typedef struct nfs_worker_data {
 	wait_q_entry_t wqe;	/*< Queue for coordinating with decoder */
 	unsigned int worker_index;	/*< Index for log messages */
+	struct glist_head batch;	/*< Requests dequeued ahead */
+	uint32_t batch_size;	/*< Number of requests in batch */
 } nfs_worker_data_t;
 
+struct fridgethr_work;
+
+/**
+ * @brief Work pushed by one thread, for fridges that steal work
+ *
+ * A Chase-Lev deque: its thread pushes and takes at the bottom without
+ * locking, other threads steal from the top.
+ */
+struct fridgethr_deque {
+	uint64_t top;		/*< Next slot to steal */
+	uint64_t bottom;	/*< Next slot to push */
+	uint32_t mask;		/*< Slots - 1, slots a power of two */
+	struct fridgethr_work **slots; /*< The work */
+};
+
 /**
  * @brief A given thread in the fridge
  */
@@ -96,6 +114,7 @@ struct fridgethr_entry {
 					   threads */
 	struct glist_head idle_link; /*< Link in the idle queue */
 	struct fridgethr *fr; /*< The fridge we belong to */
+	struct fridgethr_deque deque; /*< Work this thread submitted */
 };
 
 /**
@@ -179,6 +198,19 @@ struct fridgethr_params {
 	void (*wake_threads)(void *);
 	/* Argument for wake_threads */
 	void *wake_threads_arg;
+	/**
+	 * If non-NULL, the CPUs threads are created on.  Must stay
+	 * valid for the life of the fridge.
+	 */
+	const cpu_set_t *affinity;
+	/**
+	 * If non-zero, work submitted by a thread of the fridge while
+	 * all its threads are busy goes on a deque of this many slots
+	 * belonging to that thread, rather than on the shared queue.
+	 * The thread takes it back without locking, idle threads
+	 * steal it.  Only for fridgethr_defer_queue workers.
+	 */
+	uint32_t steal_slots;
 };
 
 /**
@@ -223,6 +255,7 @@ struct fridgethr {
 	pthread_cond_t *cb_cv;	/*< Condition variable, signalled on
 				   completion */
 	bool transitioning; /*< Changing state */
+	uint32_t nstealable;	/*< Work on the threads' deques */
 	union {
 		struct glist_head work_q; /*< Work queued */
 		struct {
@@ -239,6 +272,7 @@ struct fridgethr {
 #define fridgethr_flag_available 0x0001 /*< I am available to be
 					    dispatched */
 #define fridgethr_flag_dispatched 0x0002 /*< You have been dispatched */
+#define fridgethr_flag_retire 0x0004 /*< Exit rather than reschedule */
 
 int fridgethr_init(struct fridgethr **, const char *,
 		   const struct fridgethr_params *);
@@ -256,6 +290,8 @@ int fridgethr_start(struct fridgethr *, pthread_mutex_t *, pthread_cond_t *,
 		    void (*)(void *), void *);
 int fridgethr_sync_command(struct fridgethr *, fridgethr_comm_t, time_t);
 bool fridgethr_you_should_break(struct fridgethr_context *);
+void fridgethr_retire(struct fridgethr_context *);
+uint32_t fridgethr_nthreads(struct fridgethr *);
 int fridgethr_populate(struct fridgethr *, void (*)(struct fridgethr_context *),
 		      void *);
 
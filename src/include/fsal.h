@@ -245,8 +245,12 @@ void log_attrlist(log_components_t component, log_levels_t level,
 		  char *file, int line, char *function);
 
 #define LogAttrlist(component, level, reason, attr, is_obj) \
-	log_attrlist(component, level, reason, attr, is_obj, \
-		     (char *) __FILE__, __LINE__, (char *) __func__)
+	do { \
+		if (isLevel(component, level)) \
+			log_attrlist(component, level, reason, attr, is_obj, \
+				     (char *) __FILE__, __LINE__, \
+				     (char *) __func__); \
+	} while (0)
 
 const char *msg_fsal_err(fsal_errors_t fsal_err);
 #define fsal_err_txt(s) msg_fsal_err((s).major)
@@ -314,6 +318,9 @@ fsal_status_t fsal_link(struct fsal_obj_handle *obj,
 			const char *name);
 fsal_status_t fsal_readlink(struct fsal_obj_handle *obj,
 			    struct gsh_buffdesc *link_content);
+void fsal_lookup_ahead(struct fsal_obj_handle *parent,
+		       const char * const *names,
+		       uint32_t count);
 fsal_status_t fsal_lookup(struct fsal_obj_handle *parent,
 			  const char *name,
 			  struct fsal_obj_handle **obj,
@@ -342,6 +349,51 @@ fsal_status_t fsal_read2(struct fsal_obj_handle *obj,
 			 void *buffer,
 			 bool *eof,
 			 struct io_info *info);
+fsal_status_t fsal_read_buffer(struct fsal_obj_handle *obj,
+			       bool bypass,
+			       struct state_t *state,
+			       uint64_t offset,
+			       size_t io_size,
+			       struct fsal_read_buf *rbuf,
+			       bool *eof);
+
+/**
+ * @brief Whether reads of a file should use read_buffer
+ *
+ * @param[in] obj File to be read
+ */
+static inline bool fsal_lends_read_buffers(struct fsal_obj_handle *obj)
+{
+	return obj->fsal->m_ops.support_ex(obj) &&
+	       op_ctx->fsal_export->exp_ops.fs_supports(op_ctx->fsal_export,
+							fso_read_buffers);
+}
+
+/**
+ * @brief Whether the export keeps exclusive create verifiers itself
+ *
+ * If it does, the verifier of an exclusive create is not stored in
+ * atime and mtime, so the client may set them on create and is not
+ * told to set them again afterwards.
+ */
+static inline bool fsal_native_exclusive_create(void)
+{
+	return op_ctx->fsal_export->exp_ops.fs_supports(
+					op_ctx->fsal_export,
+					fso_native_exclusive_create);
+}
+
+/**
+ * @brief Give back a read buffer and free its descriptor
+ *
+ * @param[in] rbuf Descriptor filled in by fsal_read_buffer
+ */
+static inline void fsal_read_buf_put(struct fsal_read_buf *rbuf)
+{
+	rbuf->release(rbuf);
+	gsh_free(rbuf);
+}
+
 fsal_status_t fsal_write2(struct fsal_obj_handle *obj,
 			  bool bypass,
 			  struct state_t *state,
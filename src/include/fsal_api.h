@@ -40,6 +40,7 @@
 #ifndef FSAL_API
 #define FSAL_API
 
+#include <sys/uio.h>
 #include "fsal_types.h"
 #include "fsal_pnfs.h"
 #include "sal_shared.h"
@@ -325,7 +326,7 @@ struct state_t;
  * rules), increment the minor version
  */
 
-#define FSAL_MINOR_VERSION 0
+#define FSAL_MINOR_VERSION 10
 
 /* Forward references for object methods */
 
@@ -421,6 +422,10 @@ struct req_op_context {
 	void *fsal_private;		/*< private for FSAL use */
 	struct fsal_module *fsal_module;	/*< current fsal module */
 	struct fsal_pnfs_ds *fsal_pnfs_ds;	/*< current pNFS DS */
+	uint64_t fileid;		/*< last handle resolved, if any */
+	uint64_t io_bytes;		/*< bytes read or written */
+	const char *op_name;		/*< current NFSv4 op, if any */
+	const char *fsal_call;		/*< FSAL call in progress, if any */
 	/* add new context members here */
 };
 
@@ -1203,6 +1208,37 @@ typedef uint64_t fsal_cookie_t;
 typedef bool (*fsal_readdir_cb)(const char *name, struct fsal_obj_handle *obj,
 				struct attrlist *attrs,
 				void *dir_state, fsal_cookie_t cookie);
+
+/**
+ * @brief Arguments and results of an asynchronous read or write
+ *
+ * The caller fills in the arguments; the FSAL fills in io_amount and
+ * either end_of_file or fsal_stable before calling the completion.
+ */
+struct fsal_io_arg {
+	struct state_t *state;	/*< state_t to use, as for read2/write2 */
+	uint64_t offset;	/*< Position of the I/O */
+	size_t size;		/*< Bytes to read or write */
+	void *buffer;		/*< Data read or to write */
+	struct io_info *info;	/*< io_info for READ_PLUS/WRITE_PLUS */
+	size_t io_amount;	/*< Bytes read or written */
+	bool end_of_file;	/*< A read reached the end of file */
+	bool fsal_stable;	/*< In, a stable write is asked for; out,
+				    what the FSAL did */
+};
+
+/**
+ * @brief Completion of an asynchronous read or write
+ *
+ * @param[in] obj_hdl     The file the I/O was made on
+ * @param[in] ret         Status of the I/O
+ * @param[in] io_arg      The arguments it was started with, and results
+ * @param[in] caller_arg  As passed to read2_async or write2_async
+ */
+typedef void (*fsal_async_cb)(struct fsal_obj_handle *obj_hdl,
+			      fsal_status_t ret, struct fsal_io_arg *io_arg,
+			      void *caller_arg);
+
 /**
  * @brief FSAL object operations vector
  */
@@ -2570,6 +2606,308 @@ struct fsal_obj_ops {
 	 fsal_status_t (*close2)(struct fsal_obj_handle *obj_hdl,
 				 struct state_t *state);
 
+/**
+ * @brief Read data from a file into a buffer of the FSAL's own
+ *
+ * Only called for FSALs with fso_read_buffers.  Otherwise like read2,
+ * except that rather than copying into a caller's buffer the FSAL
+ * points rbuf at data it holds, such as a cache page or a buffer its
+ * client library returned, and sets rbuf->release to give it back.
+ * Nothing is lent if an error is returned.
+ *
+ * @param[in]     obj_hdl        File on which to operate
+ * @param[in]     bypass         If state doesn't indicate a share reservation,
+ *                               bypass any deny read
+ * @param[in]     state          state_t to use for this operation
+ * @param[in]     offset         Position from which to read
+ * @param[in]     buffer_size    Amount of data to read
+ * @param[out]    rbuf           Data read and how to release them
+ * @param[out]    end_of_file    true if the end of file has been reached
+ *
+ * @return FSAL status.
+ */
+	 fsal_status_t (*read_buffer)(struct fsal_obj_handle *obj_hdl,
+				      bool bypass,
+				      struct state_t *state,
+				      uint64_t offset,
+				      size_t buffer_size,
+				      struct fsal_read_buf *rbuf,
+				      bool *end_of_file);
+
+/**
+ * @brief Copy a range of one file into another
+ *
+ * Copies data from src_hdl to dst_hdl without passing them through
+ * the protocol layer, as for NFSv4.2 COPY.  The FSAL should have its
+ * filesystem or backend do the copy where it can.  A short copy is not
+ * an error, the caller asks again for the rest; only reaching the end
+ * of src_hdl copies nothing.  Both handles are in the same export and
+ * may be the same file, though the ranges do not overlap.
+ *
+ * The default implementation reads and writes through read2 and write2.
+ *
+ * @param[in]  src_hdl     File to copy from
+ * @param[in]  src_state   state_t to use for reading, may be NULL
+ * @param[in]  src_offset  Position to copy from
+ * @param[in]  dst_hdl     File to copy to
+ * @param[in]  dst_state   state_t to use for writing, may be NULL
+ * @param[in]  dst_offset  Position to copy to
+ * @param[in]  count       Number of bytes to copy
+ * @param[out] copied      Number of bytes copied
+ *
+ * @return FSAL status.
+ */
+	 fsal_status_t (*copy)(struct fsal_obj_handle *src_hdl,
+			       struct state_t *src_state,
+			       uint64_t src_offset,
+			       struct fsal_obj_handle *dst_hdl,
+			       struct state_t *dst_state,
+			       uint64_t dst_offset,
+			       uint64_t count,
+			       uint64_t *copied);
+
+/**
+ * @brief Share a range of one file's blocks with another
+ *
+ * Makes the range of dst_hdl refer to the same storage as the range of
+ * src_hdl, as for NFSv4.2 CLONE, the way a reflink does.  Unlike copy
+ * this is all or nothing.  The FSAL returns ERR_FSAL_NOTSUPP if its
+ * filesystem cannot share blocks, and the client falls back to COPY.
+ *
+ * @param[in] src_hdl     File to clone from
+ * @param[in] src_state   state_t to use for reading, may be NULL
+ * @param[in] src_offset  Position to clone from
+ * @param[in] dst_hdl     File to clone into
+ * @param[in] dst_state   state_t to use for writing, may be NULL
+ * @param[in] dst_offset  Position to clone to
+ * @param[in] count       Number of bytes to clone
+ *
+ * @return FSAL status.
+ */
+	 fsal_status_t (*clone)(struct fsal_obj_handle *src_hdl,
+				struct state_t *src_state,
+				uint64_t src_offset,
+				struct fsal_obj_handle *dst_hdl,
+				struct state_t *dst_state,
+				uint64_t dst_offset,
+				uint64_t count);
+
+/**
+ * @brief Reserve or release storage for a range of a file
+ *
+ * Backs NFSv4.2 ALLOCATE and DEALLOCATE.  Allocating reserves blocks
+ * for the range, extending the file if the range runs past its end, so
+ * later writes there cannot fail for lack of space.  Deallocating
+ * punches a hole: the range reads back as zeros and the file size is
+ * unchanged.  Either way no data moves, however large the range.
+ *
+ * @param[in] obj_hdl   File on which to operate
+ * @param[in] state     state_t to use for this operation, may be NULL
+ * @param[in] offset    Start of the range
+ * @param[in] length    Length of the range
+ * @param[in] allocate  true to allocate, false to punch a hole
+ *
+ * @return FSAL status.
+ */
+	 fsal_status_t (*fallocate)(struct fsal_obj_handle *obj_hdl,
+				    struct state_t *state,
+				    uint64_t offset,
+				    uint64_t length,
+				    bool allocate);
+
+/**
+ * @brief Write several buffers to consecutive positions in a file
+ *
+ * Like write2, but the data come from @a iovcnt buffers written one
+ * after the other starting at @a offset, as for pwritev(2).  MDCACHE
+ * uses this to hand the FSAL a run of gathered unstable writes as one
+ * request.  The default implementation calls write2 once per buffer.
+ *
+ * @param[in]     obj_hdl       File on which to operate
+ * @param[in]     bypass        If state doesn't indicate a share
+ *                              reservation, bypass any deny write
+ * @param[in]     state         state_t to use for this operation
+ * @param[in]     offset        Position at which to write
+ * @param[in]     iov           The buffers
+ * @param[in]     iovcnt        Number of buffers
+ * @param[out]    wrote_amount  Number of bytes written
+ * @param[in,out] fsal_stable   In, if on, the fsal is requested to
+ *                              write data to stable store. Out, the
+ *                              fsal reports what it did.
+ *
+ * @return FSAL status.
+ */
+	 fsal_status_t (*write_vec)(struct fsal_obj_handle *obj_hdl,
+				    bool bypass,
+				    struct state_t *state,
+				    uint64_t offset,
+				    const struct iovec *iov,
+				    int iovcnt,
+				    size_t *wrote_amount,
+				    bool *fsal_stable);
+
+/**
+ * @brief Read from consecutive positions in a file into several buffers
+ *
+ * Like read2, but the data go into @a iovcnt buffers filled one after
+ * the other starting at @a offset, as for preadv(2).  The default
+ * implementation calls read2 once per buffer.
+ *
+ * @param[in]  obj_hdl      File on which to operate
+ * @param[in]  bypass       If state doesn't indicate a share reservation,
+ *                          bypass any deny read
+ * @param[in]  state        state_t to use for this operation
+ * @param[in]  offset       Position from which to read
+ * @param[in]  iov          The buffers
+ * @param[in]  iovcnt       Number of buffers
+ * @param[out] read_amount  Number of bytes read
+ * @param[out] end_of_file  true if the end of file has been reached
+ *
+ * @return FSAL status.
+ */
+	 fsal_status_t (*read_vec)(struct fsal_obj_handle *obj_hdl,
+				   bool bypass,
+				   struct state_t *state,
+				   uint64_t offset,
+				   const struct iovec *iov,
+				   int iovcnt,
+				   size_t *read_amount,
+				   bool *end_of_file);
+
+/**
+ * @brief Read from a file without waiting for the data
+ *
+ * Like read2, but the result is handed to @a done_cb rather than
+ * returned.  The completion may be called before this returns, on the
+ * caller's thread, or later on a thread of the FSAL, where op_ctx is
+ * not the caller's; the caller keeps its op_ctx, the object, the state
+ * and @a read_arg valid until then.  The default implementation calls
+ * read2 and then the completion.
+ *
+ * @param[in]     obj_hdl     File on which to operate
+ * @param[in]     bypass      If state doesn't indicate a share
+ *                            reservation, bypass any deny read
+ * @param[in,out] read_arg    Arguments of the read, and its results
+ * @param[in]     done_cb     Called once the read is done
+ * @param[in]     caller_arg  Passed to @a done_cb
+ */
+	 void (*read2_async)(struct fsal_obj_handle *obj_hdl,
+			     bool bypass,
+			     struct fsal_io_arg *read_arg,
+			     fsal_async_cb done_cb,
+			     void *caller_arg);
+
+/**
+ * @brief Write to a file without waiting for the write
+ *
+ * Like write2, with the result handed to @a done_cb as for
+ * read2_async.  The default implementation calls write2 and then the
+ * completion.
+ *
+ * @param[in]     obj_hdl     File on which to operate
+ * @param[in]     bypass      If state doesn't indicate a share
+ *                            reservation, bypass any deny write
+ * @param[in,out] write_arg   Arguments of the write, and its results
+ * @param[in]     done_cb     Called once the write is done
+ * @param[in]     caller_arg  Passed to @a done_cb
+ */
+	 void (*write2_async)(struct fsal_obj_handle *obj_hdl,
+			      bool bypass,
+			      struct fsal_io_arg *write_arg,
+			      fsal_async_cb done_cb,
+			      void *caller_arg);
+
+/**
+ * @brief Look up a chain of names
+ *
+ * Looks @a names[0] up in @a dir_hdl, @a names[1] in what that found,
+ * and so on, as successive calls to lookup would, but in as few calls
+ * to the backend as the FSAL can.  The names are neither "." nor "..".
+ *
+ * The walk ends at the first error, at an object that is not a
+ * directory with names left, or wherever the FSAL finds it simpler to
+ * stop, such as at a filesystem boundary.  Stopping short is not an
+ * error: the caller goes on from the last handle with lookup.  The
+ * default implementation calls lookup for each name.
+ *
+ * @param[in]     dir_hdl   Directory to start from
+ * @param[in]     names     Names to look up, one per level
+ * @param[in]     count     Number of names, at most FSAL_LOOKUP_MULTI_MAX
+ * @param[out]    handles   Objects found, one per name
+ * @param[in,out] attrs_out Optional attributes, one per name
+ * @param[out]    found     Number of objects found
+ *
+ * @note On return, each of the @a found handles has been ref'd
+ *
+ * @return FSAL status of the name the walk ended on.
+ */
+	 fsal_status_t (*lookup_multi)(struct fsal_obj_handle *dir_hdl,
+				       const char * const *names,
+				       uint32_t count,
+				       struct fsal_obj_handle **handles,
+				       struct attrlist *attrs_out,
+				       uint32_t *found);
+
+/**
+ * @brief Get the change attribute alone
+ *
+ * Fetches the change attribute of an object, as getattrs would give it,
+ * for a cache to tell whether attributes it holds are still current.
+ * FSALs implement it only if they can get it for much less than the
+ * whole getattrs; the default returns ERR_FSAL_NOTSUPP, and the caller
+ * then calls getattrs.
+ *
+ * @param[in]  obj_hdl The object
+ * @param[out] change  Its change attribute
+ *
+ * @return FSAL status.
+ */
+	 fsal_status_t (*getattr_change)(struct fsal_obj_handle *obj_hdl,
+					 uint64_t *change);
+
+/**
+ * @brief Get the attributes of several objects at once
+ *
+ * Fills each of @a attrs as getattrs would for the handle at the same
+ * index, in as few calls to the backend as the FSAL can.  The handles
+ * are of the one export, and each of @a attrs has been prepared with
+ * ATTR_RDATTR_ERR in its mask.  An object the FSAL could not get the
+ * attributes of is left with ATTR_RDATTR_ERR alone in its mask, and
+ * the caller calls getattrs for it.  FSALs implement it only if they
+ * have such a bulk call; the default returns ERR_FSAL_NOTSUPP, and the
+ * caller then calls getattrs for each.
+ *
+ * @param[in]     handles Objects to query
+ * @param[in]     count   Number of objects
+ * @param[in,out] attrs   Their attributes, one per handle
+ *
+ * @return FSAL status.
+ */
+	 fsal_status_t (*getattrs_multi)(struct fsal_obj_handle **handles,
+					 uint32_t count,
+					 struct attrlist *attrs);
+
+/**
+ * @brief Take a client's report of I/O done through a layout
+ *
+ * Called for LAYOUTSTATS and LAYOUTERROR, after the report has been
+ * added to the server's own tables, so the FSAL may steer new layouts
+ * away from busy or failing data servers.  The status is returned to
+ * the client.
+ *
+ * @param[in] obj_hdl  The object reported on
+ * @param[in] req_ctx  Request context
+ * @param[in] lou_body An XDR stream containing the layout type-specific
+ *                     part of a LAYOUTSTATS, NULL for a LAYOUTERROR
+ * @param[in] arg      Input arguments of the function
+ *
+ * @return NFS4_OK or an error of RFC 7862, p. 74.
+ */
+	 nfsstat4(*layout_stats)(struct fsal_obj_handle *obj_hdl,
+				 struct req_op_context *req_ctx,
+				 XDR * lou_body,
+				 const struct fsal_layout_stats_arg *arg);
+
 /**@}*/
 };
 
@@ -2987,6 +3325,10 @@ struct fsal_obj_handle {
 				   the scope of the fsid, (e.g. inode number) */
 
 	struct state_hdl *state_hdl;	/*< State related to this handle */
+
+	/** Shared fds for when the global fd is busy, managed by
+	 *  fsal_reopen_obj() */
+	struct fsal_fd_cache *fd_cache;
 };
 
 /**
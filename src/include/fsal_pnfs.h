@@ -314,6 +314,25 @@ struct fsal_layoutcommit_res {
 	bool commit_done;
 };
 
+/**
+ * Input parameters to FSAL_layout_stats
+ */
+
+struct fsal_layout_stats_arg {
+	/** The type of the layout reported on */
+	layouttype4 type;
+	/** The range of the file reported on */
+	offset4 offset;
+	length4 length;
+	/** I/O done through the layout since the last report.  Zero
+	 *  for a LAYOUTERROR. */
+	io_info4 read;
+	io_info4 write;
+	/** The error a data server returned, for a LAYOUTERROR,
+	 *  otherwise NULL. */
+	const device_error4 *error;
+};
+
 /**
  * In/out and output parameters to FSAL_getdevicelist
  */
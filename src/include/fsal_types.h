@@ -203,8 +203,15 @@ typedef struct fsal_ace__ {
 typedef struct fsal_acl__ {
 	uint32_t naces;
 	fsal_ace_t *aces;
-	pthread_rwlock_t lock;
-	uint32_t ref;
+	pthread_rwlock_t lock;	/*< Protects the cached encoding */
+	uint32_t ref;		/*< Atomic */
+	uint64_t fingerprint;	/*< gsh_hash64 of the ACEs */
+	char *xdr;		/*< NFSv4 encoding of the ACEs, or NULL */
+	uint32_t xdr_len;
+	uint32_t xdr_gen;	/*< idmapper_generation it was made in */
+	time_t xdr_expire;	/*< When owner names must be mapped again */
+	void *compiled;		/*< Form for access checks, see
+				    access_check.c */
 } fsal_acl_t;
 
 typedef struct fsal_acl_data__ {
@@ -630,8 +637,13 @@ typedef enum enum_fsal_fsinfo_options {
 	fso_reopen_method,
 	fso_grace_method,
 	fso_link_supports_permission_checks,
+	fso_read_buffers,
+	fso_native_exclusive_create,
 } fsal_fsinfo_options_t;
 
+/* The most names one lookup_multi walks */
+#define FSAL_LOOKUP_MULTI_MAX 16
+
 /* The largest maxread and maxwrite value */
 #define FSAL_MAXIOSIZE XDR_BYTES_MAXLEN_IO
 
@@ -680,8 +692,25 @@ typedef struct fsal_staticfsinfo_t {
 	bool fsal_trace;	/*< fsal trace supports */
 	bool fsal_grace;	/*< fsal will handle grace */
 	bool link_supports_permission_checks;
+	bool read_buffers;	/*< fsal can lend its buffers on read */
+	bool native_exclusive_create;	/*< fsal keeps the exclusive create
+					   verifier apart from the times */
 } fsal_staticfsinfo_t;
 
+/**
+ * @brief Read data lent by an FSAL
+ *
+ * Filled in by read_buffer.  The data belong to the FSAL and stay
+ * valid until release is called, which the protocol layer does once
+ * the reply holding them has been sent.
+ */
+
+struct fsal_read_buf {
+	struct gsh_buffdesc data;	/*< Data read */
+	void (*release)(struct fsal_read_buf *rbuf);
+	void *fsal_private;	/*< For release's use */
+};
+
 /**
  * @brief The return error values of FSAL calls.
  */
@@ -114,12 +114,14 @@ static const uint32_t FSAL_UP_INVALIDATE_ATTRS = 0x01;
 static const uint32_t FSAL_UP_INVALIDATE_ACL = 0x02;
 static const uint32_t FSAL_UP_INVALIDATE_CONTENT = 0x04;
 static const uint32_t FSAL_UP_INVALIDATE_DIR_POPULATED = 0x08;
+static const uint32_t FSAL_UP_INVALIDATE_XATTRS = 0x10;
 static const uint32_t FSAL_UP_INVALIDATE_CLOSE = 0x100;
 #define FSAL_UP_INVALIDATE_CACHE ( \
 	FSAL_UP_INVALIDATE_ATTRS | \
 	FSAL_UP_INVALIDATE_ACL | \
 	FSAL_UP_INVALIDATE_CONTENT | \
-	FSAL_UP_INVALIDATE_DIR_POPULATED)
+	FSAL_UP_INVALIDATE_DIR_POPULATED | \
+	FSAL_UP_INVALIDATE_XATTRS)
 
 /**
  * @brief Possible upcall functions
@@ -220,6 +222,21 @@ struct fsal_up_vector {
 				       void *cookie,
 				       struct layoutrecall_spec *spec);
 
+	/** Recall layouts of a type from every client holding one, with
+	 *  one CB_LAYOUTRECALL of FSID or ALL scope per client
+	 *
+	 * @param[in] export       FSAL export owning ops
+	 * @param[in] layout_type  The type of layout to recall
+	 * @param[in] changed      Whether the layouts have changed and the
+	 *                         client ought to finish writes through MDS
+	 * @param[in] all          Recall the layouts on every export, not
+	 *                         just the file systems of this one
+	 *
+	 */
+	state_status_t (*layoutrecall_bulk)(struct fsal_export *exp,
+					    layouttype4 layout_type,
+					    bool changed, bool all);
+
 	/** Remove or change a deviceid
 	 *
 	 * @param[in] notify_type  Change or remove
@@ -257,6 +274,24 @@ struct fsal_up_vector {
 	fsal_status_t (*invalidate_close)(struct fsal_export *exp,
 					  struct gsh_buffdesc *obj,
 					  uint32_t flags);
+
+	/** Invalidate some or all of several cache entries
+	 *
+	 * As many calls of invalidate, but a cache may take each of its
+	 * locks once for all of them.
+	 *
+	 * @param[in] export FSAL export owning ops
+	 * @param[in] objs   The files to invalidate
+	 * @param[in] flags  FSAL_UP_INVALIDATE_* of each
+	 * @param[in] count  Number of files
+	 *
+	 * @return FSAL status of the last that failed.
+	 *
+	 */
+	fsal_status_t (*invalidate_batch)(struct fsal_export *exp,
+					  struct gsh_buffdesc *objs,
+					  const uint32_t *flags,
+					  uint32_t count);
 };
 
 extern struct fsal_up_vector fsal_up_top;
@@ -298,6 +333,12 @@ fsal_status_t up_async_layoutrecall(struct fridgethr *fr,
 				    struct layoutrecall_spec *spec,
 				    void (*cb)(void *, state_status_t),
 				    void *cb_arg);
+fsal_status_t up_async_layoutrecall_bulk(struct fridgethr *fr,
+					 struct fsal_export *exp,
+					 layouttype4 layout_type, bool changed,
+					 bool all,
+					 void (*cb)(void *, state_status_t),
+					 void *cb_arg);
 fsal_status_t up_async_notify_device(struct fridgethr *fr,
 				     struct fsal_export *exp,
 				     notify_deviceid_type4 notify_type,
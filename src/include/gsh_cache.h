@@ -0,0 +1,110 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file gsh_cache.h
+ * @brief Concurrent cache of small keys and values
+ *
+ * A fixed memory budget of slots, each holding a copy of its key and
+ * value, split into shards of set-associative buckets found by a
+ * gsh_hash64 of the key.  Lookups take no lock: a slot is guarded by a
+ * sequence count, odd while a writer has it, and a reader that sees
+ * it change misses.  Writers claim a slot by bumping its count and
+ * never wait either; an insert racing another on the same slot is
+ * dropped.
+ *
+ * Entries expire after their TTL.  Negative entries remember that a
+ * key has no value.  Clearing the cache bumps a generation, which
+ * leaves every slot stale without touching it.
+ *
+ * The stats of every cache are reported by the GetCacheStats DBus
+ * method.
+ */
+
+#ifndef GSH_CACHE_H
+#define GSH_CACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @brief Parameters of a cache
+ */
+
+struct gsh_cache_params {
+	const char *name;	/*< Name in the stats */
+	uint32_t key_max;	/*< Longest key kept, longer ones miss */
+	uint32_t value_max;	/*< Largest value kept */
+	uint32_t ttl;		/*< Seconds an entry lives, 0 for ever */
+	uint32_t negative_ttl;	/*< Seconds a negative entry lives */
+	uint64_t bytes;		/*< Memory budget of the slots */
+	uint32_t shards;	/*< Shards of the stats, 0 for 16 */
+};
+
+/**
+ * @brief Result of a lookup
+ */
+
+enum gsh_cache_result {
+	GSH_CACHE_MISS,		/*< Not known, expired or raced */
+	GSH_CACHE_HIT,		/*< The value was copied out */
+	GSH_CACHE_NEGATIVE	/*< Known to have no value */
+};
+
+/**
+ * @brief Counters of a cache
+ */
+
+struct gsh_cache_stats {
+	const char *name;
+	uint64_t slots;		/*< Entries the budget holds */
+	uint64_t bytes;		/*< Memory of the slots */
+	uint64_t hits;
+	uint64_t negative_hits;
+	uint64_t misses;
+	uint64_t expired;	/*< Misses on an expired entry */
+	uint64_t inserts;
+	uint64_t evictions;	/*< Live entries replaced by an insert */
+	uint64_t dropped;	/*< Inserts lost to a racing writer */
+};
+
+struct gsh_cache;
+
+struct gsh_cache *gsh_cache_create(const struct gsh_cache_params *params);
+void gsh_cache_destroy(struct gsh_cache *cache);
+
+enum gsh_cache_result gsh_cache_lookup(struct gsh_cache *cache,
+				       const void *key, uint32_t key_len,
+				       void *value, uint32_t *value_len);
+void gsh_cache_insert(struct gsh_cache *cache, const void *key,
+		      uint32_t key_len, const void *value,
+		      uint32_t value_len);
+void gsh_cache_insert_negative(struct gsh_cache *cache, const void *key,
+			       uint32_t key_len);
+void gsh_cache_remove(struct gsh_cache *cache, const void *key,
+		      uint32_t key_len);
+void gsh_cache_clear(struct gsh_cache *cache);
+
+void gsh_cache_get_stats(struct gsh_cache *cache,
+			 struct gsh_cache_stats *stats);
+void gsh_cache_foreach(void (*cb)(struct gsh_cache *, void *), void *arg);
+
+#endif /* GSH_CACHE_H */
@@ -48,6 +48,7 @@
 
 #include "nfs4.h"
 #include "gsh_rpc.h"
+#include "nfs_qos.h"
 
 /**
  * @brief An enumeration of protocols in the NFS family
@@ -68,6 +69,18 @@ typedef enum protos {
  * @{
  */
 
+/**
+ * @brief Scheduling weight for one client (Dispatch_Client_Weight block)
+ */
+struct dispatch_client_weight {
+	struct glist_head link;	/*< on core_param.fair.weights */
+	char *client;		/*< client address, as configured */
+	sockaddr_t addr;	/*< parsed client address */
+	uint32_t weight;	/*< multiple of Dispatch_Fair_Quantum */
+	struct qos_limits qos_limits;	/*< as configured */
+	struct qos_bucket qos;	/*< the client's rate limits */
+};
+
 /**
  * @brief Default NFS Port.
  */
@@ -118,6 +131,11 @@ typedef enum protos {
  */
 #define DRC_TCP_CHECKSUM true
 
+/**
+ * @brief Default value for core_param.drc.tcp.hash_table
+ */
+#define DRC_TCP_HASH_TABLE false
+
 /**
  * @brief Default value for core_param.drc.udp.npart
  */
@@ -158,6 +176,21 @@ typedef enum protos {
  */
 #define NFS_DEFAULT_RECV_BUFFER_SIZE 1048576
 
+/**
+ * @brief Most values of core_param.rpc.tcp_listeners
+ */
+#define RPC_TCP_LISTENERS_MAX 16
+
+/**
+ * @brief Default value for core_param.rpc.rdma.port
+ */
+#define NFS_RDMA_PORT 20049
+
+/**
+ * @brief Default value for core_param.rpc.rdma.inline_size
+ */
+#define NFS_RDMA_INLINE_SIZE 4096
+
 /**
  * @brief Support NFSv3
  */
@@ -208,6 +241,17 @@ typedef struct nfs_core_param {
 	/** Number of worker threads.  Set to NB_WORKER_DEFAULT by
 	    default and changed with the Nb_Worker option. */
 	uint32_t nb_worker;
+	/** Whether to size the worker pool from queue depth and
+	    service time, between Nb_Worker_Min and Nb_Worker
+	    threads.  Defaults to false and settable by
+	    Adaptive_Workers. */
+	bool adaptive_workers;
+	/** Fewest worker threads the adaptive pool shrinks to.
+	    Defaults to 16 and settable by Nb_Worker_Min. */
+	uint32_t nb_worker_min;
+	/** Milliseconds between adaptive pool size adjustments.
+	    Defaults to 1000 and settable by Adaptive_Workers_Interval. */
+	uint32_t adaptive_workers_interval;
 	/** For NFSv3, whether to drop rather than reply to requests
 	    yielding I/O errors.  True by default and settable with
 	    Drop_IO_Errors.  As this generally results in client
@@ -229,9 +273,63 @@ typedef struct nfs_core_param {
 	    once.  Defaults to 5000 and settable by Dispatch_Max_Reqs */
 	uint32_t dispatch_max_reqs;
 	/** Number of requests to allow into the dispatcher from one
-	    specific transport.  Defaults to 512 and settable by
-	    Dispatch_Max_Reqs_Xprt. */
+	    specific transport, its request credits.  A transport out
+	    of credits is not read again until half of them are back.
+	    Defaults to 512 and settable by Dispatch_Max_Reqs_Xprt. */
 	uint32_t dispatch_max_reqs_xprt;
+	/** Number of request queue shards.  Decoders enqueue on the
+	    shard of their CPU and workers steal from sibling shards
+	    when their own is empty.  Defaults to 1 (a single global
+	    queue set), 0 means one shard per online CPU.  Settable by
+	    Dispatch_Queue_Shards. */
+	uint32_t dispatch_queue_shards;
+	/** Number of slots in the lock-free ring backing each request
+	    queue.  Defaults to 0, which keeps the spinlocked list
+	    backend; the lists still take overflow when a ring is
+	    full.  Settable by Dispatch_Queue_Ring_Size. */
+	uint32_t dispatch_queue_ring_size;
+	/** Most requests a worker takes from a queue at once when no
+	    other worker is waiting for work.  Defaults to 1 and
+	    settable by Dispatch_Batch_Size. */
+	uint32_t dispatch_batch_size;
+	/** Times an idle worker polls for a wakeup before it sleeps in
+	    the kernel.  Defaults to 0 and settable by
+	    Dispatch_Worker_Spin. */
+	uint32_t dispatch_worker_spin;
+	/** Whether to place decoders, workers and request queues by
+	    NUMA node.  Each connection is bound to a node, decoded by
+	    that node's decoders and preferably executed by its
+	    workers.  Defaults to false and settable by
+	    Dispatch_NUMA_Affinity. */
+	bool dispatch_numa_affinity;
+	/** Whether the decoder executes a cheap request itself, a
+	    NULL, GETATTR or ACCESS, rather than queue it, while the
+	    low latency queue is empty.  Defaults to false and
+	    settable by Dispatch_Inline_Low_Latency. */
+	bool dispatch_inline;
+	/** Depth of the low latency queue up to which requests are
+	    still executed by their decoder.  Defaults to 0 and
+	    settable by Dispatch_Inline_Max_Depth. */
+	uint32_t dispatch_inline_depth;
+	/** Microseconds a decoder may spend executing requests in one
+	    pass over a connection before it queues the rest, 0 for no
+	    limit.  Defaults to 1000 and settable by
+	    Dispatch_Inline_Budget_Usecs. */
+	uint32_t dispatch_inline_budget;
+	/** Deficit round robin scheduling across clients for the
+	    low and high latency queues. */
+	struct {
+		/** Whether to schedule fairly between clients.  Defaults
+		    to false and settable by Dispatch_Fair_Queueing. */
+		bool enabled;
+		/** Requests a client with weight 1 may have dispatched
+		    per round.  Defaults to 4 and settable by
+		    Dispatch_Fair_Quantum. */
+		uint32_t quantum;
+		/** Per-client weights, from Dispatch_Client_Weight
+		    blocks.  Unlisted clients have weight 1. */
+		struct glist_head weights;
+	} fair;
 	/** Parameters controlling the Duplicate Request Cache.  */
 	struct {
 		/** Whether to disable the DRC entirely.  Defaults to
@@ -270,11 +368,18 @@ typedef struct nfs_core_param {
 			    DRC_TCP_RECYCLE_EXPIRE_S and settable by
 			    DRC_TCP_Recycle_Expire_S. */
 			uint32_t recycle_expire_s;
-			/** Whether to use a checksum to match
-			    requests as well as the XID.  Defaults to
-			    DRC_TCP_CHECKSUM and settable by
-			    DRC_TCP_Checksum. */
+			/** Whether to use a checksum of the call
+			    body to match requests as well as the XID,
+			    rather than the call header alone.
+			    Defaults to DRC_TCP_CHECKSUM and settable
+			    by DRC_TCP_Checksum. */
 			bool checksum;
+			/** Whether to keep a connection's requests in
+			    an open-addressing table by XID, retired by
+			    CLOCK, rather than in the tree and retired
+			    in order.  Defaults to DRC_TCP_HASH_TABLE
+			    and settable by DRC_TCP_Hash_Table. */
+			bool hash_table;
 		} tcp;
 		/** Parameters controlling UDP DRC behavior. */
 		struct {
@@ -296,10 +401,11 @@ typedef struct nfs_core_param {
 			    Defaults to DRC_UDP_HIWAT and settable by
 			    DRC_UDP_Hiwat. */
 			uint32_t hiwat;
-			/** Whether to use a checksum to match
-			    requests as well as the XID.  Defaults to
-			    DRC_UDP_CHECKSUM and settable by
-			    DRC_UDP_Checksum. */
+			/** Whether to use a checksum of the call
+			    body to match requests as well as the XID,
+			    rather than the call header alone.
+			    Defaults to DRC_UDP_CHECKSUM and settable
+			    by DRC_UDP_Checksum. */
 			bool checksum;
 		} udp;
 	} drc;
@@ -326,6 +432,37 @@ typedef struct nfs_core_param {
 		/** TIRPC ioq max simultaneous io threads.  Defaults to
 		    200 and settable by RPC_Ioq_ThrdMax. */
 		uint32_t ioq_thrd_max;
+		/** NFS TCP sockets listening on the port with
+		    SO_REUSEPORT, each accepting on its own event
+		    channel.  Defaults to 1 and settable by
+		    RPC_TCP_Listeners. */
+		uint32_t tcp_listeners;
+		/** Microseconds a read of an NFS TCP connection
+		    busy polls the device queue before waiting,
+		    SO_BUSY_POLL, 0 for none.  Defaults to 0 and
+		    settable by RPC_Busy_Poll_Usecs. */
+		uint32_t busy_poll_usecs;
+		/** NFS over RDMA, when built with USE_NFS_RDMA. */
+		struct {
+			/** Port to listen on.  Defaults to
+			    NFS_RDMA_PORT and settable by
+			    NFS_RDMA_Port. */
+			uint16_t port;
+			/** Requests a client may have outstanding
+			    per connection.  Defaults to 30 and
+			    settable by NFS_RDMA_Credits. */
+			uint32_t credits;
+			/** Size of the inline send and receive
+			    buffers; larger READ and WRITE payloads
+			    move by RDMA chunks.  Defaults to
+			    NFS_RDMA_INLINE_SIZE and settable by
+			    NFS_RDMA_Inline_Size. */
+			uint32_t inline_size;
+			/** Threads handling completions.  Defaults
+			    to 4 and settable by
+			    NFS_RDMA_Completion_Threads. */
+			uint32_t worker_count;
+		} rdma;
 		struct {
 			/** Partitions in GSS ctx cache table (default 13). */
 			uint32_t ctx_hash_partitions;
@@ -356,6 +493,17 @@ typedef struct nfs_core_param {
 	    address in NSM operations.  Settable with
 	    NSM_Use_Caller_Name. */
 	bool nsm_use_caller_name;
+	/** Connections to statd, over which monitor calls are spread.
+	    Defaults to 4 and settable with NSM_Connections. */
+	uint32_t nsm_connections;
+	/** Seconds to keep quotas returned by RQUOTA GETQUOTA, 0 to
+	    ask the FSAL each time.  Defaults to 0 and settable with
+	    RQUOTA_Cache_Time. */
+	uint32_t rquota_cache_time;
+	/** Whether to refresh the cached quotas most asked for before
+	    they expire.  Defaults to false and settable with
+	    RQUOTA_Cache_Prefetch. */
+	bool rquota_prefetch;
 	/** Whether this Ganesha is part of a cluster of Ganeshas.
 	    This is somewhat vendor-specific and should probably be
 	    moved somewhere else.  Settable with Clustered. */
@@ -368,6 +516,26 @@ typedef struct nfs_core_param {
 	bool enable_RQUOTA;
 	/** Whether to use fast stats.  Defaults to false. */
 	bool enable_FASTSTATS;
+	/** Whether to keep per-operation latency histograms of each
+	    request stage.  Defaults to false and settable with
+	    Enable_Latency_Histograms. */
+	bool enable_latency_hist;
+	/** TCP port on which to serve statistics as OpenMetrics text
+	    over HTTP.  Defaults to 0, which serves nothing, and
+	    settable with Metrics_Port. */
+	uint16_t metrics_port;
+	/** Address the metrics listener binds to.  IPv4 only.
+	    Defaults to the loopback and settable with
+	    Metrics_Addr. */
+	struct sockaddr_in metrics_addr;
+	/** Sample one request in this many for the hot files and
+	    clients.  Defaults to 0, which samples nothing, and settable
+	    with Hot_Sample_Rate. */
+	uint32_t hot_sample_rate;
+	/** Requests in flight longer than this many milliseconds are
+	    logged, with their stages.  Defaults to 0, which tracks
+	    nothing, and settable with Slow_Request_Threshold. */
+	uint32_t slow_request_ms;
 	/** Whether to use short NFS file handle to accommodate VMware
 	    NFS client. Enable this if you have a VMware NFSv3 client.
 	    VMware NFSv3 client has a max limit of 56 byte file handles!
@@ -377,11 +545,51 @@ typedef struct nfs_core_param {
 	    calling getgroups() when "Manage_Gids = TRUE" is
 	    used in a export entry. */
 	time_t manage_gids_expiration;
+	/** Whether to enumerate the password and group databases at
+	    startup, and every half Manage_Gids_Expiration after, to fill
+	    the uid2grp cache in bulk instead of calling getgrouplist()
+	    for each new user.  Defaults to false and settable with
+	    Manage_Gids_Preload. */
+	bool manage_gids_preload;
+	/** Whether to enumerate the netgroups named by export clients in
+	    the background, so client matching finds their hosts in a
+	    table instead of calling innetgr().  Defaults to false and
+	    settable with Netgroup_Preload. */
+	bool netgroup_preload;
+	/** Seconds between enumerations of each netgroup.  Defaults to
+	    30 minutes and settable with Netgroup_Refresh. */
+	uint32_t netgroup_refresh;
 	/** Path to the directory containing server specific
 	    modules.  In particular, this is where FSALs live. */
 	char *ganesha_modules_loc;
 	/* Frequency of dbus health heartbeat in ms. Set to 0 to disable */
 	uint32_t heartbeat_freq;
+	/** @name I/O buffer pool limits, in bytes per size class
+	    @{ */
+	/** Thread cache size that spills to the shared depot.
+	    Defaults to 2M and settable with IOBuf_High_Water. */
+	uint32_t iobuf_high_water;
+	/** Thread cache size left after a spill.  Defaults to 1M and
+	    settable with IOBuf_Low_Water. */
+	uint32_t iobuf_low_water;
+	/** Most the shared depot keeps, 0 to keep nothing.  Defaults
+	    to 64M and settable with IOBuf_Depot_Size. */
+	uint32_t iobuf_depot_max;
+	/** @} */
+	/** Huge pages backing the pools of Huge_Page_Pools, an
+	    enum huge_page_mode.  Defaults to none and settable with
+	    Huge_Pages. */
+	uint32_t huge_pages;
+	/** Names of the pools backed by huge pages, separated by
+	    commas.  Settable with Huge_Page_Pools. */
+	char *huge_page_pools;
+	/** Threads looking up the roots of the exports at startup.
+	    Defaults to 16 and settable with Export_Init_Threads. */
+	uint32_t export_init_threads;
+	/** Unix socket a new server takes the listening sockets of the
+	    running one through, NULL for none.  Settable with
+	    Handoff_Socket. */
+	char *handoff_socket;
 } nfs_core_parameter_t;
 
 /** @} */
@@ -412,11 +620,31 @@ typedef struct nfs_core_param {
  */
 #define IDMAPCONF_DEFAULT "/etc/idmapd.conf"
 
+/**
+ * @brief Default value of idmap_expiration.
+ */
+#define IDMAP_EXPIRATION_DEFAULT 900
+
+/**
+ * @brief Default value of idmap_negative_expiration.
+ */
+#define IDMAP_NEGATIVE_EXPIRATION_DEFAULT 60
+
 /**
  * @brief Default value of deleg_recall_retry_delay.
  */
 #define DELEG_RECALL_RETRY_DELAY_DEFAULT 1
 
+/**
+ * @brief Where client recovery records are kept
+ */
+enum recovery_backend {
+	RECOVERY_BACKEND_FS,		/*< A directory per client */
+	RECOVERY_BACKEND_FS_LOG,	/*< An append-only log file */
+	RECOVERY_BACKEND_FS_CLUSTER,	/*< Directories shared by the heads of
+					    a cluster, with a shared grace */
+};
+
 typedef struct nfs_version4_parameter {
 	/** Whether to disable the NFSv4 grace period.  Defaults to
 	    false and settable with Graceless. */
@@ -448,17 +676,81 @@ typedef struct nfs_version4_parameter {
 	    Only_Numeric_Owners. NB., this is permissible for a server
 	    implementation (RFC 5661). */
 	bool only_numeric_owners;
+	/** Seconds an ID mapping is cached, 0 for ever.  One used in
+	    its last quarter is looked up again in the background.
+	    Defaults to IDMAP_EXPIRATION_DEFAULT and settable with
+	    Idmap_Expiration. */
+	uint32_t idmap_expiration;
+	/** Seconds a name or ID that could not be mapped is cached.
+	    Defaults to IDMAP_NEGATIVE_EXPIRATION_DEFAULT and
+	    settable with Idmap_Negative_Expiration. */
+	uint32_t idmap_negative_expiration;
 	/** Whether to allow delegations. Defaults to false and settable
 	    with Delegations */
 	bool allow_delegations;
 	/** Delay after which server will retry a recall in case of failures */
 	uint32_t deleg_recall_retry_delay;
+	/** Where client recovery records are kept, an enum
+	    recovery_backend.  Defaults to RECOVERY_BACKEND_FS and
+	    settable with RecoveryBackend. */
+	uint32_t recovery_backend;
 	/** Whether this a pNFS MDS server. Defaults to false */
 	bool pnfs_mds;
 	/** Whether this a pNFS DS server. Defaults to false */
 	bool pnfs_ds;
+	/** Whether GETDEVICEINFO caches the device addresses FSALs
+	    encode, until they notify a change.  Defaults to true and
+	    settable with Device_Info_Cache. */
+	bool devinfo_cache;
+	/** Whether to run independent PUTFH segments of a COMPOUND
+	    concurrently.  Defaults to false and settable with
+	    Parallel_Compound. */
+	bool parallel_compound;
+	/** Most threads running such segments.  Defaults to 16 and
+	    settable with Parallel_Compound_Threads. */
+	uint32_t parallel_compound_threads;
+	/** Threads releasing the state of the clients of a node taken
+	    over.  Defaults to 16 and settable with Takeover_Threads. */
+	uint32_t takeover_threads;
+	/** Most CB_LAYOUTRECALLs in flight to one client.  Defaults
+	    to 16, settable with Layout_Recalls_Per_Client. */
+	uint32_t layoutrecalls_per_client;
+	/** IPv4 multicast group the heads serving the same exports
+	    publish their load on, NULL for none.  Settable with
+	    Load_Balance_Group. */
+	char *lb_group;
+	/** UDP port of lb_group.  Defaults to 20492, settable with
+	    Load_Balance_Port. */
+	uint16_t lb_port;
+	/** Address clients reach this head at, as listed in
+	    FS_LOCATIONS.  Defaults to the host name, settable with
+	    Load_Balance_Address. */
+	char *lb_address;
 } nfs_version4_parameter_t;
 
+#ifdef USE_RPC_TLS
+/**
+ * @brief RPC-with-TLS parameters
+ */
+typedef struct nfs_tls_param {
+	/** Whether clients may start TLS on their TCP connections.
+	    Defaults to false and settable with Enable_TLS. */
+	bool enabled;
+	/** PEM file of the server certificate chain, settable with
+	    Certificate. */
+	char *certificate;
+	/** PEM file of its private key, settable with Private_Key. */
+	char *private_key;
+	/** PEM file of the authorities client certificates are
+	    checked against, NULL not to ask for one.  Settable with
+	    CA_File. */
+	char *ca_file;
+	/** Seconds a client has to complete its handshake.  Defaults
+	    to 10 and settable with Handshake_Timeout. */
+	uint32_t handshake_timeout;
+} nfs_tls_parameter_t;
+#endif				/* USE_RPC_TLS */
+
 /** @} */
 
 typedef struct nfs_param {
@@ -471,6 +763,11 @@ typedef struct nfs_param {
 	/** kerberos configuration.  Settable in the NFS_KRB5 stanza. */
 	nfs_krb5_parameter_t krb5_param;
 #endif				/* _HAVE_GSSAPI */
+#ifdef USE_RPC_TLS
+	/** RPC-with-TLS configuration.  Settable in the RPC_TLS
+	    stanza. */
+	nfs_tls_parameter_t tls_param;
+#endif				/* USE_RPC_TLS */
 } nfs_parameter_t;
 
 extern nfs_parameter_t nfs_param;
@@ -0,0 +1,95 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file gsh_hash.h
+ * @brief Hashing of keys for the internal tables
+ *
+ * gsh_hash64 hashes a byte string to 64 bits.  It runs four CRC32C
+ * lanes over the 8 byte words of the key, two of them over the words
+ * times an odd constant, and mixes the lanes with the length at the
+ * end.  The CRC is taken with the SSE 4.2 or the ARMv8 CRC
+ * instructions when the CPU has them, chosen on the first call, and
+ * with tables otherwise; all of them give the same hash.
+ *
+ * gsh_hash_u64 and gsh_hash_u64_2 are inline, for keys of one or two
+ * words such as ids and counters.
+ *
+ * gsh_hash64 is not faster than CityHash for the 8 to 64 byte keys of
+ * the tables looked up on every request, so the handle cache, the DRC
+ * and the SAL tables hash their byte strings with CityHash64WithSeed.
+ *
+ * None of these are for anything kept on disk or sent on the wire:
+ * the hashes are free to change from one release to the next.
+ */
+
+#ifndef GSH_HASH_H
+#define GSH_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define GSH_HASH_K1 0x9E3779B97F4A7C15ULL
+#define GSH_HASH_K2 0xC2B2AE3D27D4EB4FULL
+
+/**
+ * @brief Finish a hash, so every bit of it depends on every bit of h
+ */
+
+static inline uint64_t gsh_hash_mix(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= 0xFF51AFD7ED558CCDULL;
+	h ^= h >> 33;
+	h *= 0xC4CEB9FE1A85EC53ULL;
+	h ^= h >> 33;
+
+	return h;
+}
+
+/**
+ * @brief Hash a 64 bit key
+ */
+
+static inline uint64_t gsh_hash_u64(uint64_t v, uint64_t seed)
+{
+	return gsh_hash_mix(v ^ (seed * GSH_HASH_K1));
+}
+
+/**
+ * @brief Hash a key of two 64 bit words
+ */
+
+static inline uint64_t gsh_hash_u64_2(uint64_t v1, uint64_t v2,
+				      uint64_t seed)
+{
+	return gsh_hash_mix(gsh_hash_u64(v1, seed) ^ (v2 * GSH_HASH_K2));
+}
+
+uint64_t gsh_hash64(const void *buf, size_t len, uint64_t seed);
+
+/* The table driven implementation, whatever the CPU, for tests */
+uint64_t gsh_hash64_generic(const void *buf, size_t len, uint64_t seed);
+
+/* Name of the implementation gsh_hash64 uses */
+const char *gsh_hash_impl(void);
+
+#endif /* GSH_HASH_H */
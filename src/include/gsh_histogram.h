@@ -0,0 +1,107 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file gsh_histogram.h
+ * @brief Log-bucketed latency histograms
+ *
+ * In the style of HDR histograms: each power of two of nanoseconds
+ * is split into 2^GSH_HIST_SUB_BITS linear sub-buckets, so a recorded
+ * value is known to within 25% whatever its magnitude.  Bucket 0
+ * holds everything under 2^GSH_HIST_MIN_SHIFT ns and the last bucket
+ * everything past the top of the range.  Recording is three atomic
+ * adds and no locks.
+ */
+
+#ifndef GSH_HISTOGRAM_H
+#define GSH_HISTOGRAM_H
+
+#include <stdint.h>
+#include "abstract_atomic.h"
+
+#define GSH_HIST_SUB_BITS 2
+#define GSH_HIST_MIN_SHIFT 10	/*< 1us */
+#define GSH_HIST_OCTAVES 28	/*< up to 2^38ns, about 4.5 minutes */
+#define GSH_HIST_BUCKETS (1 + (GSH_HIST_OCTAVES << GSH_HIST_SUB_BITS))
+
+struct gsh_histogram {
+	uint64_t count;
+	uint64_t sum;		/*< Total of recorded values, in ns */
+	uint64_t buckets[GSH_HIST_BUCKETS];
+};
+
+/**
+ * @brief Find the bucket of a value
+ *
+ * @param[in] v Value in ns
+ *
+ * @return Bucket index.
+ */
+static inline uint32_t gsh_hist_bucket(uint64_t v)
+{
+	uint32_t msb, ix;
+
+	if (v < (1ULL << GSH_HIST_MIN_SHIFT))
+		return 0;
+
+	msb = 63 - __builtin_clzll(v);
+	ix = 1 + ((msb - GSH_HIST_MIN_SHIFT) << GSH_HIST_SUB_BITS) +
+	     ((v >> (msb - GSH_HIST_SUB_BITS)) &
+	      ((1 << GSH_HIST_SUB_BITS) - 1));
+
+	return (ix < GSH_HIST_BUCKETS) ? ix : GSH_HIST_BUCKETS - 1;
+}
+
+/**
+ * @brief Smallest value falling in a bucket
+ *
+ * @param[in] ix Bucket index
+ *
+ * @return Lower bound of the bucket, in ns.
+ */
+static inline uint64_t gsh_hist_bucket_floor(uint32_t ix)
+{
+	uint32_t msb;
+
+	if (ix == 0)
+		return 0;
+
+	--ix;
+	msb = (ix >> GSH_HIST_SUB_BITS) + GSH_HIST_MIN_SHIFT;
+	return (1ULL << msb) +
+	       ((uint64_t) (ix & ((1 << GSH_HIST_SUB_BITS) - 1))
+		<< (msb - GSH_HIST_SUB_BITS));
+}
+
+/**
+ * @brief Record a value
+ *
+ * @param[in,out] h Histogram
+ * @param[in]     v Value in ns
+ */
+static inline void gsh_hist_record(struct gsh_histogram *h, uint64_t v)
+{
+	(void) atomic_inc_uint64_t(&h->buckets[gsh_hist_bucket(v)]);
+	(void) atomic_inc_uint64_t(&h->count);
+	(void) atomic_add_uint64_t(&h->sum, v);
+}
+
+#endif				/* GSH_HISTOGRAM_H */
@@ -0,0 +1,352 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file gsh_itree.h
+ * @brief Interval tree of closed 64 bit ranges
+ *
+ * An AVL tree ordered by the start of each range, in which every node
+ * also carries the greatest end found in its subtree.  A search for
+ * the ranges overlapping [start, end] skips any subtree whose greatest
+ * end is below start and stops at the first node starting after end,
+ * so finding k overlaps among n ranges costs O(k log n) rather than a
+ * walk of all n.
+ *
+ * Nodes are embedded in the caller's structures, as with glist, and
+ * ranges may overlap or repeat.  A node's range must not change while
+ * it is in a tree; remove it, change it, and insert it again.  The
+ * tree does no locking of its own.
+ */
+
+#ifndef GSH_ITREE_H
+#define GSH_ITREE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct itree_node {
+	struct itree_node *left, *right, *parent;
+	uint64_t start;		/*< First byte of the range */
+	uint64_t end;		/*< Last byte of the range, inclusive */
+	uint64_t max_end;	/*< Greatest end in this subtree */
+	int32_t height;		/*< 0 while not in a tree */
+};
+
+struct itree {
+	struct itree_node *root;
+	uint64_t count;
+};
+
+#define itree_entry(node, type, member) \
+	((type *)((char *)(node) - offsetof(type, member)))
+
+static inline void itree_init(struct itree *tree)
+{
+	tree->root = NULL;
+	tree->count = 0;
+}
+
+static inline bool itree_empty(const struct itree *tree)
+{
+	return tree->root == NULL;
+}
+
+/**
+ * @brief Is this node in a tree?
+ */
+static inline bool itree_linked(const struct itree_node *node)
+{
+	return node->height != 0;
+}
+
+static inline int32_t itree_height(const struct itree_node *node)
+{
+	return node != NULL ? node->height : 0;
+}
+
+/**
+ * @brief Recompute a node's height and max_end from its children
+ */
+static inline void itree_fix(struct itree_node *node)
+{
+	int32_t hl = itree_height(node->left);
+	int32_t hr = itree_height(node->right);
+
+	node->height = (hl > hr ? hl : hr) + 1;
+	node->max_end = node->end;
+
+	if (node->left != NULL && node->left->max_end > node->max_end)
+		node->max_end = node->left->max_end;
+
+	if (node->right != NULL && node->right->max_end > node->max_end)
+		node->max_end = node->right->max_end;
+}
+
+static inline void itree_replace_child(struct itree *tree,
+				       struct itree_node *parent,
+				       struct itree_node *old,
+				       struct itree_node *new)
+{
+	if (parent == NULL)
+		tree->root = new;
+	else if (parent->left == old)
+		parent->left = new;
+	else
+		parent->right = new;
+}
+
+static inline struct itree_node *itree_rotate_left(struct itree *tree,
+						   struct itree_node *x)
+{
+	struct itree_node *y = x->right;
+
+	x->right = y->left;
+	if (y->left != NULL)
+		y->left->parent = x;
+
+	y->parent = x->parent;
+	itree_replace_child(tree, x->parent, x, y);
+
+	y->left = x;
+	x->parent = y;
+
+	itree_fix(x);
+	itree_fix(y);
+	return y;
+}
+
+static inline struct itree_node *itree_rotate_right(struct itree *tree,
+						    struct itree_node *x)
+{
+	struct itree_node *y = x->left;
+
+	x->left = y->right;
+	if (y->right != NULL)
+		y->right->parent = x;
+
+	y->parent = x->parent;
+	itree_replace_child(tree, x->parent, x, y);
+
+	y->right = x;
+	x->parent = y;
+
+	itree_fix(x);
+	itree_fix(y);
+	return y;
+}
+
+/**
+ * @brief Restore balance and max_end from a node up to the root
+ *
+ * Always walks to the root, since max_end may change all the way up
+ * even where the heights do not.
+ */
+static inline void itree_rebalance(struct itree *tree,
+				   struct itree_node *node)
+{
+	int32_t balance;
+
+	while (node != NULL) {
+		itree_fix(node);
+		balance = itree_height(node->left) - itree_height(node->right);
+
+		if (balance > 1) {
+			if (itree_height(node->left->left) <
+			    itree_height(node->left->right))
+				itree_rotate_left(tree, node->left);
+			node = itree_rotate_right(tree, node);
+		} else if (balance < -1) {
+			if (itree_height(node->right->right) <
+			    itree_height(node->right->left))
+				itree_rotate_right(tree, node->right);
+			node = itree_rotate_left(tree, node);
+		}
+
+		node = node->parent;
+	}
+}
+
+/**
+ * @brief Insert a node
+ *
+ * @param[in,out] tree  The tree
+ * @param[in,out] node  Node with start and end set, not in any tree
+ */
+static inline void itree_insert(struct itree *tree, struct itree_node *node)
+{
+	struct itree_node *parent = NULL;
+	struct itree_node **link = &tree->root;
+
+	while (*link != NULL) {
+		parent = *link;
+		if (node->start < parent->start)
+			link = &parent->left;
+		else
+			link = &parent->right;
+	}
+
+	node->left = NULL;
+	node->right = NULL;
+	node->parent = parent;
+	*link = node;
+	tree->count++;
+
+	itree_rebalance(tree, node);
+}
+
+/**
+ * @brief Remove a node
+ *
+ * @param[in,out] tree  The tree
+ * @param[in,out] node  Node in the tree, unlinked on return
+ */
+static inline void itree_remove(struct itree *tree, struct itree_node *node)
+{
+	struct itree_node *child, *next, *fix;
+
+	if (node->left != NULL && node->right != NULL) {
+		/* Put the successor in the node's place */
+		next = node->right;
+		while (next->left != NULL)
+			next = next->left;
+
+		if (next->parent == node) {
+			fix = next;
+		} else {
+			fix = next->parent;
+			fix->left = next->right;
+			if (next->right != NULL)
+				next->right->parent = fix;
+			next->right = node->right;
+			next->right->parent = next;
+		}
+
+		next->left = node->left;
+		next->left->parent = next;
+		next->parent = node->parent;
+		itree_replace_child(tree, node->parent, node, next);
+	} else {
+		child = node->left != NULL ? node->left : node->right;
+		if (child != NULL)
+			child->parent = node->parent;
+		itree_replace_child(tree, node->parent, node, child);
+		fix = node->parent;
+	}
+
+	node->left = NULL;
+	node->right = NULL;
+	node->parent = NULL;
+	node->height = 0;
+	tree->count--;
+
+	itree_rebalance(tree, fix);
+}
+
+/**
+ * @brief Leftmost node in a subtree overlapping [start, end]
+ */
+static inline struct itree_node *itree_subtree_overlap(struct itree_node *node,
+						       uint64_t start,
+						       uint64_t end)
+{
+	while (node != NULL && node->max_end >= start) {
+		if (node->left != NULL && node->left->max_end >= start) {
+			/* If anything overlaps, the leftmost one is here:
+			 * the left subtree reaches start, so either some
+			 * node in it begins by end, or nothing to the right
+			 * of it does either.
+			 */
+			node = node->left;
+			continue;
+		}
+
+		if (node->start > end)
+			return NULL;
+
+		if (node->end >= start)
+			return node;
+
+		node = node->right;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief First node, by start, overlapping [start, end]
+ *
+ * @return The node or NULL.
+ */
+static inline struct itree_node *itree_first_overlap(const struct itree *tree,
+						     uint64_t start,
+						     uint64_t end)
+{
+	return itree_subtree_overlap(tree->root, start, end);
+}
+
+/**
+ * @brief Next node, by start, overlapping [start, end]
+ *
+ * @param[in] node   A node overlapping [start, end]
+ * @param[in] start  First byte of the range
+ * @param[in] end    Last byte of the range
+ *
+ * @return The node after @a node or NULL.
+ */
+static inline struct itree_node *itree_next_overlap(struct itree_node *node,
+						    uint64_t start,
+						    uint64_t end)
+{
+	struct itree_node *found, *parent;
+
+	found = itree_subtree_overlap(node->right, start, end);
+	if (found != NULL)
+		return found;
+
+	/* Climb until we come up from a left child; that parent and its
+	 * right subtree are next in order.
+	 */
+	for (parent = node->parent; parent != NULL;
+	     node = parent, parent = parent->parent) {
+		if (parent->left != node)
+			continue;
+
+		if (parent->start > end)
+			return NULL;
+
+		if (parent->end >= start)
+			return parent;
+
+		found = itree_subtree_overlap(parent->right, start, end);
+		if (found != NULL)
+			return found;
+	}
+
+	return NULL;
+}
+
+#define itree_for_each_overlap(node, tree, start, end)			\
+	for (node = itree_first_overlap(tree, start, end);		\
+	     node != NULL;						\
+	     node = itree_next_overlap(node, start, end))
+
+#endif /* GSH_ITREE_H */
@@ -0,0 +1,145 @@
+
+#undef TRACEPOINT_PROVIDER
+#define TRACEPOINT_PROVIDER mdcache
+
+#if !defined(GANESHA_LTTNG_MDCACHE_H) || defined(TRACEPOINT_HEADER_MULTI_READ)
+#define GANESHA_LTTNG_MDCACHE_H
+
+#include <stdint.h>
+#include <lttng/tracepoint.h>
+
+/**
+ * @brief Trace a handle found in the cache hash
+ *
+ * @param hk    - hash of the key looked up
+ * @param entry - the entry found
+ * @param slot  - found in the one-slot cache of the partition
+ */
+
+TRACEPOINT_EVENT(
+	mdcache,
+	cih_hit,
+	TP_ARGS(uint64_t, hk,
+		void *, entry,
+		int, slot),
+	TP_FIELDS(
+		ctf_integer_hex(uint64_t, hk, hk)
+		ctf_integer_hex(void *, entry, entry)
+		ctf_integer(int, slot, slot)
+	)
+)
+
+TRACEPOINT_LOGLEVEL(
+	mdcache,
+	cih_hit,
+	TRACE_INFO)
+
+/**
+ * @brief Trace a handle not found in the cache hash
+ *
+ * @param hk - hash of the key looked up
+ */
+
+TRACEPOINT_EVENT(
+	mdcache,
+	cih_miss,
+	TP_ARGS(uint64_t, hk),
+	TP_FIELDS(
+		ctf_integer_hex(uint64_t, hk, hk)
+	)
+)
+
+TRACEPOINT_LOGLEVEL(
+	mdcache,
+	cih_miss,
+	TRACE_INFO)
+
+/**
+ * @brief Trace an entry reaped from the LRU for reuse by mdcache_lru_get
+ *
+ * @param entry - the entry reused
+ */
+
+TRACEPOINT_EVENT(
+	mdcache,
+	lru_reap,
+	TP_ARGS(void *, entry),
+	TP_FIELDS(
+		ctf_integer_hex(void *, entry, entry)
+	)
+)
+
+TRACEPOINT_LOGLEVEL(
+	mdcache,
+	lru_reap,
+	TRACE_INFO)
+
+/**
+ * @brief Trace an entry allocated by mdcache_lru_get, none being reapable
+ *
+ * @param entry - the entry allocated
+ */
+
+TRACEPOINT_EVENT(
+	mdcache,
+	lru_alloc,
+	TP_ARGS(void *, entry),
+	TP_FIELDS(
+		ctf_integer_hex(void *, entry, entry)
+	)
+)
+
+TRACEPOINT_LOGLEVEL(
+	mdcache,
+	lru_alloc,
+	TRACE_INFO)
+
+/**
+ * @brief Trace the start of a call into the FSAL below MDCACHE
+ *
+ * @param func - the MDCACHE method making the call
+ */
+
+TRACEPOINT_EVENT(
+	mdcache,
+	subcall_start,
+	TP_ARGS(const char *, func),
+	TP_FIELDS(
+		ctf_string(func, func)
+	)
+)
+
+TRACEPOINT_LOGLEVEL(
+	mdcache,
+	subcall_start,
+	TRACE_INFO)
+
+/**
+ * @brief Trace the return of a call into the FSAL below MDCACHE
+ *
+ * The timestamp difference from subcall_start on the same thread is the
+ * latency of the FSAL.
+ *
+ * @param func - the MDCACHE method making the call
+ */
+
+TRACEPOINT_EVENT(
+	mdcache,
+	subcall_end,
+	TP_ARGS(const char *, func),
+	TP_FIELDS(
+		ctf_string(func, func)
+	)
+)
+
+TRACEPOINT_LOGLEVEL(
+	mdcache,
+	subcall_end,
+	TRACE_INFO)
+
+#endif /* GANESHA_LTTNG_MDCACHE_H */
+
+#undef TRACEPOINT_INCLUDE
+#define TRACEPOINT_INCLUDE "gsh_lttng/mdcache.h"
+
+#include <lttng/tracepoint-event.h>
@@ -95,6 +95,80 @@ TRACEPOINT_LOGLEVEL(
 	op_end,
 	TRACE_INFO)
 
+/**
+ * @brief Trace a request queued for the workers
+ *
+ * @param req   - the request queued
+ * @param shard - the queue shard it went to
+ * @param queue - name of the queue in the shard
+ */
+
+TRACEPOINT_EVENT(
+	nfs_rpc,
+	enqueue,
+	TP_ARGS(request_data_t *, req,
+		unsigned int, shard,
+		const char *, queue),
+	TP_FIELDS(
+		ctf_integer_hex(request_data_t *, req, req)
+		ctf_integer(unsigned int, shard, shard)
+		ctf_string(queue, queue)
+	)
+)
+
+TRACEPOINT_LOGLEVEL(
+	nfs_rpc,
+	enqueue,
+	TRACE_INFO)
+
+/**
+ * @brief Trace a request taken by a worker
+ *
+ * The timestamp difference from enqueue is the time the request waited.
+ *
+ * @param req    - the request taken
+ * @param worker - index of the worker
+ */
+
+TRACEPOINT_EVENT(
+	nfs_rpc,
+	dequeue,
+	TP_ARGS(request_data_t *, req,
+		unsigned int, worker),
+	TP_FIELDS(
+		ctf_integer_hex(request_data_t *, req, req)
+		ctf_integer(unsigned int, worker, worker)
+	)
+)
+
+TRACEPOINT_LOGLEVEL(
+	nfs_rpc,
+	dequeue,
+	TRACE_INFO)
+
+/**
+ * @brief Trace the duplicate request cache lookup of a request
+ *
+ * @param xid    - xid of the request
+ * @param status - the dupreq_status_t, DUPREQ_EXISTS for a cached reply
+ */
+
+TRACEPOINT_EVENT(
+	nfs_rpc,
+	dupreq,
+	TP_ARGS(uint32_t, xid,
+		int, status),
+	TP_FIELDS(
+		ctf_integer_hex(uint32_t, xid, xid)
+		ctf_integer(int, status, status)
+	)
+)
+
+TRACEPOINT_LOGLEVEL(
+	nfs_rpc,
+	dupreq,
+	TRACE_INFO)
+
 #endif /* GANESHA_LTTNG_NFS_RPC_H */
 
 #undef TRACEPOINT_INCLUDE
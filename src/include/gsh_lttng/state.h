@@ -0,0 +1,98 @@
+
+#undef TRACEPOINT_PROVIDER
+#define TRACEPOINT_PROVIDER state
+
+#if !defined(GANESHA_LTTNG_STATE_H) || defined(TRACEPOINT_HEADER_MULTI_READ)
+#define GANESHA_LTTNG_STATE_H
+
+#include <stdint.h>
+#include <lttng/tracepoint.h>
+
+/**
+ * @brief Trace the start of state_lock
+ *
+ * @param obj      - the file being locked
+ * @param owner    - the lock owner
+ * @param type     - the fsal_lock_t of the request
+ * @param start    - start of the range
+ * @param length   - length of the range, 0 to the end of file
+ * @param blocking - the state_blocking_t of the request
+ */
+
+TRACEPOINT_EVENT(
+	state,
+	lock_start,
+	TP_ARGS(void *, obj,
+		void *, owner,
+		int, type,
+		uint64_t, start,
+		uint64_t, length,
+		int, blocking),
+	TP_FIELDS(
+		ctf_integer_hex(void *, obj, obj)
+		ctf_integer_hex(void *, owner, owner)
+		ctf_integer(int, type, type)
+		ctf_integer(uint64_t, start, start)
+		ctf_integer(uint64_t, length, length)
+		ctf_integer(int, blocking, blocking)
+	)
+)
+
+TRACEPOINT_LOGLEVEL(
+	state,
+	lock_start,
+	TRACE_INFO)
+
+/**
+ * @brief Trace state_lock taking the file's state lock
+ *
+ * The timestamp difference from lock_start is the wait for the state
+ * lock of the file.
+ *
+ * @param obj - the file being locked
+ */
+
+TRACEPOINT_EVENT(
+	state,
+	lock_acquired,
+	TP_ARGS(void *, obj),
+	TP_FIELDS(
+		ctf_integer_hex(void *, obj, obj)
+	)
+)
+
+TRACEPOINT_LOGLEVEL(
+	state,
+	lock_acquired,
+	TRACE_INFO)
+
+/**
+ * @brief Trace the exit of state_lock
+ *
+ * @param obj    - the file being locked
+ * @param status - the state_status_t returned, STATE_LOCK_BLOCKED for a
+ *                 lock left waiting for a grant
+ */
+
+TRACEPOINT_EVENT(
+	state,
+	lock_end,
+	TP_ARGS(void *, obj,
+		int, status),
+	TP_FIELDS(
+		ctf_integer_hex(void *, obj, obj)
+		ctf_integer(int, status, status)
+	)
+)
+
+TRACEPOINT_LOGLEVEL(
+	state,
+	lock_end,
+	TRACE_INFO)
+
+#endif /* GANESHA_LTTNG_STATE_H */
+
+#undef TRACEPOINT_INCLUDE
+#define TRACEPOINT_INCLUDE "gsh_lttng/state.h"
+
+#include <lttng/tracepoint-event.h>
@@ -0,0 +1,63 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file gsh_metrics.h
+ * @brief OpenMetrics exporter
+ *
+ * When Metrics_Port is set, a thread serves the statistics as
+ * OpenMetrics text over HTTP, for Prometheus style scrapers.  Each
+ * package renders its own metric families into a metrics_buf; all
+ * samples of a family must be emitted together.
+ */
+
+#ifndef GSH_METRICS_H
+#define GSH_METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "gsh_histogram.h"
+
+struct metrics_buf {
+	char *buf;
+	size_t len;		/*< Bytes rendered */
+	size_t size;		/*< Bytes allocated */
+};
+
+void metrics_printf(struct metrics_buf *mb, const char *fmt, ...)
+	__attribute__ ((format(printf, 2, 3)));
+void metrics_family(struct metrics_buf *mb, const char *name,
+		    const char *type, const char *help);
+size_t metrics_escape(char *dst, size_t len, const char *src);
+void metrics_histogram(struct metrics_buf *mb, const char *name,
+		       const char *labels, struct gsh_histogram *h);
+
+int metrics_init(void);
+int metrics_shutdown(void);
+
+/* Metric families of each package */
+
+void server_stats_metrics(struct metrics_buf *mb);
+void nfs_rpc_queue_metrics(struct metrics_buf *mb);
+void nfs_dupreq_metrics(struct metrics_buf *mb);
+void mdcache_metrics(struct metrics_buf *mb);
+
+#endif				/* GSH_METRICS_H */
@@ -0,0 +1,181 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file gsh_mpmc_ring.h
+ * @brief Bounded lock-free multi-producer/multi-consumer ring
+ *
+ * An array backed FIFO of pointers.  Each slot carries a sequence
+ * number that tells producers and consumers whether the slot is free
+ * for the current lap, so neither side ever takes a lock; contention
+ * is limited to one compare-and-swap on the head or tail index.
+ * Slots are padded to a cache line so that neighbouring producers and
+ * consumers do not false-share.
+ *
+ * The ring is bounded: gsh_mpmc_ring_push() fails when it is full and
+ * the caller must provide an overflow path.
+ */
+
+#ifndef GSH_MPMC_RING_H
+#define GSH_MPMC_RING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "gsh_intrinsic.h"
+#include "abstract_atomic.h"
+#include "abstract_mem.h"
+
+struct gsh_mpmc_slot {
+	uint64_t seq;
+	void *data;
+	char __pad[GSH_CACHE_LINE_SIZE - sizeof(uint64_t) - sizeof(void *)];
+};
+
+struct gsh_mpmc_ring {
+	uint64_t mask;		/*< number of slots - 1 */
+	struct gsh_mpmc_slot *slots;
+	GSH_CACHE_PAD(0);
+	uint64_t head;		/*< next slot to fill */
+	GSH_CACHE_PAD(1);
+	uint64_t tail;		/*< next slot to drain */
+	GSH_CACHE_PAD(2);
+};
+
+/**
+ * @brief Initialize a ring
+ *
+ * @param[in,out] ring The ring
+ * @param[in]     size Minimum number of slots, rounded up to a power
+ *                     of two
+ */
+static inline void gsh_mpmc_ring_init(struct gsh_mpmc_ring *ring,
+				      uint32_t size)
+{
+	uint64_t nslots = 2;
+	uint64_t ix;
+
+	while (nslots < size)
+		nslots <<= 1;
+
+	ring->mask = nslots - 1;
+	ring->slots = gsh_malloc_aligned(GSH_CACHE_LINE_SIZE,
+					 nslots * sizeof(struct gsh_mpmc_slot));
+	memset(ring->slots, 0, nslots * sizeof(struct gsh_mpmc_slot));
+	for (ix = 0; ix < nslots; ++ix)
+		ring->slots[ix].seq = ix;
+	ring->head = 0;
+	ring->tail = 0;
+}
+
+/**
+ * @brief Release the slots of a ring
+ *
+ * @param[in,out] ring The ring, which must be empty
+ */
+static inline void gsh_mpmc_ring_destroy(struct gsh_mpmc_ring *ring)
+{
+	gsh_free(ring->slots);
+	ring->slots = NULL;
+}
+
+/**
+ * @brief Append an element to a ring
+ *
+ * @param[in,out] ring The ring
+ * @param[in]     data Element to append, may not be NULL
+ *
+ * @return false if the ring is full.
+ */
+static inline bool gsh_mpmc_ring_push(struct gsh_mpmc_ring *ring, void *data)
+{
+	struct gsh_mpmc_slot *slot;
+	uint64_t pos = atomic_fetch_uint64_t(&ring->head);
+	int64_t dif;
+
+	for (;;) {
+		slot = &ring->slots[pos & ring->mask];
+		dif = (int64_t) atomic_fetch_uint64_t(&slot->seq) -
+		      (int64_t) pos;
+		if (dif == 0) {
+			if (atomic_cas_uint64_t(&ring->head, pos, pos + 1))
+				break;
+		} else if (dif < 0) {
+			/* slot still holds last lap's element */
+			return false;
+		}
+		pos = atomic_fetch_uint64_t(&ring->head);
+	}
+
+	slot->data = data;
+	atomic_store_uint64_t(&slot->seq, pos + 1);
+	return true;
+}
+
+/**
+ * @brief Remove the oldest element from a ring
+ *
+ * @param[in,out] ring The ring
+ *
+ * @return The element or NULL if the ring is empty.
+ */
+static inline void *gsh_mpmc_ring_pop(struct gsh_mpmc_ring *ring)
+{
+	struct gsh_mpmc_slot *slot;
+	uint64_t pos = atomic_fetch_uint64_t(&ring->tail);
+	int64_t dif;
+	void *data;
+
+	for (;;) {
+		slot = &ring->slots[pos & ring->mask];
+		dif = (int64_t) atomic_fetch_uint64_t(&slot->seq) -
+		      (int64_t) (pos + 1);
+		if (dif == 0) {
+			if (atomic_cas_uint64_t(&ring->tail, pos, pos + 1))
+				break;
+		} else if (dif < 0) {
+			/* nothing published in this slot yet */
+			return NULL;
+		}
+		pos = atomic_fetch_uint64_t(&ring->tail);
+	}
+
+	data = slot->data;
+	atomic_store_uint64_t(&slot->seq, pos + ring->mask + 1);
+	return data;
+}
+
+/**
+ * @brief Estimate the number of elements in a ring
+ *
+ * @param[in] ring The ring
+ *
+ * @return Number of elements, racy by nature.
+ */
+static inline uint32_t gsh_mpmc_ring_size(struct gsh_mpmc_ring *ring)
+{
+	uint64_t tail = atomic_fetch_uint64_t(&ring->tail);
+	uint64_t head = atomic_fetch_uint64_t(&ring->head);
+
+	return (head > tail) ? (uint32_t) (head - tail) : 0;
+}
+
+#endif				/* GSH_MPMC_RING_H */
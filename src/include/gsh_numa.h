@@ -0,0 +1,51 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file gsh_numa.h
+ * @brief NUMA topology and thread placement
+ *
+ * The topology is read once from sysfs, so no NUMA library is
+ * needed.  Nodes are numbered densely from 0 in the order the kernel
+ * lists them, skipping nodes without CPUs.  On systems without NUMA
+ * information everything is node 0.
+ */
+
+#ifndef GSH_NUMA_H
+#define GSH_NUMA_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sched.h>
+
+/** No node, for objects not bound anywhere */
+#define GSH_NUMA_NODE_ANY UINT32_MAX
+
+void gsh_numa_init(void);
+uint32_t gsh_numa_nodes(void);
+uint32_t gsh_numa_node(void);
+const cpu_set_t *gsh_numa_cpus(uint32_t node);
+int gsh_numa_bind(uint32_t node);
+uint32_t gsh_numa_dev_node(const char *devpath);
+void *gsh_numa_alloc(size_t size, uint32_t node);
+void *gsh_numa_alloc_aligned(size_t align, size_t size, uint32_t node);
+
+#endif				/* GSH_NUMA_H */
@@ -0,0 +1,335 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file gsh_oa_hash.h
+ * @brief Open-addressing hash table of pointers
+ *
+ * In the style of Swiss tables: slots come in groups of 16, with one
+ * control byte per slot holding the top 7 bits of the hash of its
+ * item, or marking it empty or deleted.  A probe compares all 16
+ * control bytes of a group at once (one SSE2 compare where available)
+ * and only visits slots whose tag matches, so a lookup costs the
+ * control bytes and, almost always, one slot.  Slots keep the full
+ * hash so an item is only touched to confirm a match.
+ *
+ * Groups are probed triangularly, which visits every group of a power
+ * of two table, and a probe ends at the first group with an empty
+ * slot.  The table grows by rehashing when 7/8 full.  It does no
+ * locking of its own.
+ */
+
+#ifndef GSH_OA_HASH_H
+#define GSH_OA_HASH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "abstract_mem.h"
+
+#define GSH_OA_GROUP 16
+#define GSH_OA_EMPTY ((uint8_t) 0x80)
+#define GSH_OA_DELETED ((uint8_t) 0xfe)
+
+struct gsh_oa_slot {
+	uint64_t hash;
+	void *item;
+};
+
+struct gsh_oa_hash {
+	uint8_t *ctrl;		/*< Control byte of each slot */
+	struct gsh_oa_slot *slots;
+	uint32_t mask;		/*< Number of groups - 1 */
+	uint32_t size;		/*< Items in the table */
+	uint32_t deleted;	/*< Deleted slots */
+	uint32_t max;		/*< Used slots that force a rehash */
+};
+
+static inline uint8_t gsh_oa_tag(uint64_t hash)
+{
+	return hash >> 57;
+}
+
+/**
+ * @brief Find the slots of a group holding a control byte
+ *
+ * @param[in] ctrl Control bytes of the group
+ * @param[in] c    Control byte to look for
+ *
+ * @return Bitmask of matching slots.
+ */
+static inline uint32_t gsh_oa_match(const uint8_t *ctrl, uint8_t c)
+{
+#ifdef __SSE2__
+	__m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(c)));
+#else
+	uint32_t m = 0;
+	int ix;
+
+	for (ix = 0; ix < GSH_OA_GROUP; ++ix)
+		if (ctrl[ix] == c)
+			m |= 1 << ix;
+	return m;
+#endif
+}
+
+/**
+ * @brief Find the empty or deleted slots of a group
+ *
+ * @param[in] ctrl Control bytes of the group
+ *
+ * @return Bitmask of free slots.
+ */
+static inline uint32_t gsh_oa_match_free(const uint8_t *ctrl)
+{
+#ifdef __SSE2__
+	/* only empty and deleted have the top bit set */
+	return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)ctrl));
+#else
+	uint32_t m = 0;
+	int ix;
+
+	for (ix = 0; ix < GSH_OA_GROUP; ++ix)
+		if (ctrl[ix] & 0x80)
+			m |= 1 << ix;
+	return m;
+#endif
+}
+
+static inline void gsh_oa_alloc(struct gsh_oa_hash *t, uint32_t ngroups)
+{
+	uint32_t nslots = ngroups * GSH_OA_GROUP;
+
+	t->ctrl = gsh_malloc(nslots);
+	memset(t->ctrl, GSH_OA_EMPTY, nslots);
+	t->slots = gsh_malloc(nslots * sizeof(struct gsh_oa_slot));
+	t->mask = ngroups - 1;
+	t->size = 0;
+	t->deleted = 0;
+	t->max = nslots - nslots / 8;
+}
+
+/**
+ * @brief Find a free slot for a hash
+ *
+ * @param[in] t    The table
+ * @param[in] hash The hash
+ *
+ * @return Index of the slot.
+ */
+static inline uint32_t gsh_oa_find_free(const struct gsh_oa_hash *t,
+					uint64_t hash)
+{
+	uint32_t g = hash & t->mask;
+	uint32_t step = 0;
+	uint32_t m;
+
+	for (;;) {
+		m = gsh_oa_match_free(&t->ctrl[g * GSH_OA_GROUP]);
+		if (m)
+			return g * GSH_OA_GROUP + __builtin_ctz(m);
+		g = (g + ++step) & t->mask;
+	}
+}
+
+/**
+ * @brief Initialize a table
+ *
+ * @param[in,out] t    The table
+ * @param[in]     size Items to make room for without rehashing
+ */
+static inline void gsh_oa_init(struct gsh_oa_hash *t, uint32_t size)
+{
+	uint32_t ngroups = 1;
+
+	while (ngroups * GSH_OA_GROUP - ngroups * GSH_OA_GROUP / 8 <= size)
+		ngroups <<= 1;
+
+	gsh_oa_alloc(t, ngroups);
+}
+
+static inline void gsh_oa_destroy(struct gsh_oa_hash *t)
+{
+	gsh_free(t->ctrl);
+	gsh_free(t->slots);
+	t->ctrl = NULL;
+	t->slots = NULL;
+}
+
+/**
+ * @brief Rehash into a new table, dropping deleted slots
+ *
+ * @param[in,out] t       The table
+ * @param[in]     ngroups Number of groups of the new table
+ */
+static inline void gsh_oa_rehash(struct gsh_oa_hash *t, uint32_t ngroups)
+{
+	struct gsh_oa_hash old = *t;
+	uint32_t ix, nix;
+
+	gsh_oa_alloc(t, ngroups);
+
+	for (ix = 0; ix < (old.mask + 1) * GSH_OA_GROUP; ++ix) {
+		if (old.ctrl[ix] & 0x80)
+			continue;
+		nix = gsh_oa_find_free(t, old.slots[ix].hash);
+		t->ctrl[nix] = old.ctrl[ix];
+		t->slots[nix] = old.slots[ix];
+	}
+	t->size = old.size;
+
+	gsh_oa_destroy(&old);
+}
+
+/**
+ * @brief Look up an item
+ *
+ * @param[in] t     The table
+ * @param[in] hash  Hash of the key
+ * @param[in] match Whether an item with the same hash has the key
+ * @param[in] key   The key
+ *
+ * @return The item or NULL.
+ */
+static inline void *gsh_oa_lookup(const struct gsh_oa_hash *t, uint64_t hash,
+				  bool (*match)(const void *item,
+						const void *key),
+				  const void *key)
+{
+	uint8_t tag = gsh_oa_tag(hash);
+	uint32_t g = hash & t->mask;
+	uint32_t step = 0;
+	const uint8_t *ctrl;
+	uint32_t m, ix;
+
+	for (;;) {
+		ctrl = &t->ctrl[g * GSH_OA_GROUP];
+		for (m = gsh_oa_match(ctrl, tag); m; m &= m - 1) {
+			ix = g * GSH_OA_GROUP + __builtin_ctz(m);
+			if (t->slots[ix].hash == hash &&
+			    match(t->slots[ix].item, key))
+				return t->slots[ix].item;
+		}
+		if (gsh_oa_match(ctrl, GSH_OA_EMPTY))
+			return NULL;
+		g = (g + ++step) & t->mask;
+	}
+}
+
+/**
+ * @brief Insert an item
+ *
+ * The caller MUST know that no item with the same key is present.
+ *
+ * @param[in,out] t    The table
+ * @param[in]     hash Hash of the item's key
+ * @param[in]     item The item
+ */
+static inline void gsh_oa_insert(struct gsh_oa_hash *t, uint64_t hash,
+				 void *item)
+{
+	uint32_t ix;
+
+	if (t->size + t->deleted >= t->max) {
+		/* grow, unless it's mostly deleted slots */
+		gsh_oa_rehash(t, t->size >= t->max / 2
+				 ? (t->mask + 1) * 2 : t->mask + 1);
+	}
+
+	ix = gsh_oa_find_free(t, hash);
+	if (t->ctrl[ix] == GSH_OA_DELETED)
+		--(t->deleted);
+	t->ctrl[ix] = gsh_oa_tag(hash);
+	t->slots[ix].hash = hash;
+	t->slots[ix].item = item;
+	++(t->size);
+}
+
+/**
+ * @brief Remove an item
+ *
+ * @param[in,out] t    The table
+ * @param[in]     hash Hash of the item's key
+ * @param[in]     item The item
+ *
+ * @return true if the item was in the table.
+ */
+static inline bool gsh_oa_remove(struct gsh_oa_hash *t, uint64_t hash,
+				 void *item)
+{
+	uint8_t tag = gsh_oa_tag(hash);
+	uint32_t g = hash & t->mask;
+	uint32_t step = 0;
+	uint8_t *ctrl;
+	uint32_t m, ix;
+
+	for (;;) {
+		ctrl = &t->ctrl[g * GSH_OA_GROUP];
+		for (m = gsh_oa_match(ctrl, tag); m; m &= m - 1) {
+			ix = g * GSH_OA_GROUP + __builtin_ctz(m);
+			if (t->slots[ix].item != item)
+				continue;
+			/* A group with an empty slot ends every probe that
+			 * reaches it, so nothing probes past this slot. */
+			if (gsh_oa_match(ctrl, GSH_OA_EMPTY)) {
+				t->ctrl[ix] = GSH_OA_EMPTY;
+			} else {
+				t->ctrl[ix] = GSH_OA_DELETED;
+				++(t->deleted);
+			}
+			--(t->size);
+			return true;
+		}
+		if (gsh_oa_match(ctrl, GSH_OA_EMPTY))
+			return false;
+		g = (g + ++step) & t->mask;
+	}
+}
+
+/**
+ * @brief Find the next used slot, wrapping around
+ *
+ * @param[in] t  The table
+ * @param[in] ix Slot to start at, taken modulo the table size
+ *
+ * @return Index of the slot, or UINT32_MAX if the table is empty.
+ */
+static inline uint32_t gsh_oa_next(const struct gsh_oa_hash *t, uint32_t ix)
+{
+	uint32_t nslots = (t->mask + 1) * GSH_OA_GROUP;
+	uint32_t n;
+
+	if (t->size == 0)
+		return UINT32_MAX;
+
+	for (n = 0, ix %= nslots; n < nslots; ++n, ix = (ix + 1) % nslots)
+		if (!(t->ctrl[ix] & 0x80))
+			return ix;
+
+	return UINT32_MAX;
+}
+
+#endif				/* GSH_OA_HASH_H */
@@ -32,6 +32,7 @@
 #include "gsh_list.h"
 #include "log.h"
 #include "fridgethr.h"
+#include "gsh_numa.h"
 
 #define NFS_LOOKAHEAD_NONE 0x0000
 #define NFS_LOOKAHEAD_MOUNT 0x0001
@@ -51,6 +52,7 @@
 #define NFS_LOOKAHEAD_SETCLIENTID_CONFIRM  0x0200
 #define NFS_LOOKAHEAD_LOOKUP 0x0400
 #define NFS_LOOKAHEAD_READLINK 0x0800
+#define NFS_LOOKAHEAD_RECLAIM 0x1000 /* reclaims and RECLAIM_COMPLETE */
 /* ... */
 
 struct nfs_request_lookahead {
@@ -143,7 +145,8 @@ const char *str_gc_proc(rpc_gss_proc_t);
 #define XPRT_PRIVATE_FLAG_NONE		SVC_XPRT_FLAG_NONE
 /* uint16_t actually used */
 #define XPRT_PRIVATE_FLAG_DECODING 0x0008
-#define XPRT_PRIVATE_FLAG_STALLED 0x0010	/* ie, -on stallq- */
+#define XPRT_PRIVATE_FLAG_STALLED 0x0010	/* out of request credits */
+#define XPRT_PRIVATE_FLAG_TLS 0x0020	/* records are kernel TLS */
 
 /* uint32_t instructions */
 #define XPRT_PRIVATE_FLAG_LOCKED	SVC_XPRT_FLAG_LOCKED
@@ -153,8 +156,9 @@ const char *str_gc_proc(rpc_gss_proc_t);
 
 typedef struct gsh_xprt_private {
 	SVCXPRT *xprt;
-	struct glist_head stallq;
 	uint16_t flags;
+	uint32_t numa_node;	/*< Node decoding this xprt */
+	struct gsh_client *client;	/*< Client of a connection */
 } gsh_xprt_private_t;
 
 static inline gsh_xprt_private_t *alloc_gsh_xprt_private(SVCXPRT *xprt,
@@ -165,10 +169,23 @@ static inline gsh_xprt_private_t *alloc_gsh_xprt_private(SVCXPRT *xprt,
 
 	xu->xprt = xprt;
 	xu->flags = flags;
+	xu->numa_node = GSH_NUMA_NODE_ANY;
+	xu->client = NULL;
 
 	return xu;
 }
 
+/**
+ * @brief Whether a connection runs RPC-with-TLS
+ */
+static inline bool gsh_xprt_tls(SVCXPRT *xprt)
+{
+	gsh_xprt_private_t *xu = (gsh_xprt_private_t *) xprt->xp_u1;
+
+	return xu != NULL &&
+	       (atomic_fetch_uint16_t(&xu->flags) & XPRT_PRIVATE_FLAG_TLS);
+}
+
 #ifndef DRC_FLAG_RELEASE
 #define DRC_FLAG_RELEASE 0x0040
 #endif
@@ -333,4 +350,45 @@ CLIENT *gsh_clnt_create(char *, unsigned long, unsigned long, char *);
 void gsh_clnt_destroy(CLIENT *);
 
 extern tirpc_pkg_params ntirpc_pp;
+
+/* Payload buffers of READ, WRITE and 9P */
+extern iobuf_pool_t *nfs_iobuf_pool;
+
+/**
+ * @brief XDR variable length opaque data in a pooled I/O buffer
+ *
+ * As xdr_bytes, except that a decoded buffer comes from
+ * nfs_iobuf_pool and XDR_FREE gives it back there.
+ */
+static inline bool xdr_iobuf(XDR *xdrs, char **cpp, u_int *sizep,
+			     u_int maxsize)
+{
+	char *sp = *cpp;
+	u_int nodesize;
+
+	if (!inline_xdr_u_int(xdrs, sizep))
+		return false;
+
+	nodesize = *sizep;
+	if (nodesize > maxsize && xdrs->x_op != XDR_FREE)
+		return false;
+
+	switch (xdrs->x_op) {
+	case XDR_DECODE:
+		if (nodesize == 0)
+			return true;
+		if (sp == NULL)
+			*cpp = sp = iobuf_alloc(nfs_iobuf_pool, nodesize);
+		/* FALLTHROUGH */
+	case XDR_ENCODE:
+		return inline_xdr_opaque(xdrs, sp, nodesize);
+	case XDR_FREE:
+		if (sp != NULL) {
+			iobuf_free(nfs_iobuf_pool, sp, nodesize);
+			*cpp = NULL;
+		}
+		return true;
+	}
+	return false;
+}
 #endif /* GSH_RPC_H */
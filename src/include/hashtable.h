@@ -77,6 +77,12 @@ typedef int (*val_display_function_t)(struct gsh_buffdesc *, char *);
 #define HT_FLAG_NONE 0x0000	/*< Null hash table flags */
 #define HT_FLAG_CACHE 0x0001	/*< Indicates that caching should be
 				   enabled */
+#define HT_FLAG_LOCKLESS_READ 0x0002	/*< HashTable_Get and
+					   hashtable_getref do not take
+					   the partition lock */
+#define HT_FLAG_GROW 0x0004	/*< Each partition's cache grows with
+				   the partition, from none at first if
+				   HT_FLAG_CACHE is not set */
 
 /**
  * @brief Hash parameters
@@ -137,6 +143,19 @@ typedef struct hash_stat {
 				       the rbt used. */
 } hash_stat_t;
 
+/**
+ * @brief The expected entry cache of a partition
+ *
+ * A cache is replaced whole when it grows, so its size travels with
+ * its slots.
+ */
+
+struct ht_cache {
+	uint32_t size; /*< Number of slots */
+	struct rbt_node *slot[]; /*< Last entry found for each hash modulo
+				     size */
+};
+
 /**
  * @brief Represents an individual partition
  *
@@ -148,7 +167,10 @@ struct hash_partition {
 	size_t count; /*< Numer of entries in this partition */
 	struct rbt_head rbt; /*< The red-black tree */
 	pthread_rwlock_t lock; /*< Lock for this partition */
-	struct rbt_node **cache; /*< Expected entry cache */
+	struct ht_cache *cache; /*< Expected entry cache */
+	uint32_t seq; /*< Odd while a writer changes the tree, bumped
+			  twice for each change, so lockless readers can
+			  tell that they raced one */
 };
 
 /**
@@ -162,6 +184,7 @@ typedef struct hash_table {
 					 HashTable */
 	pool_t *node_pool; /*< Pool of RBT nodes */
 	pool_t *data_pool; /*< Pool of buffer pairs */
+	uint32_t cache_grows; /*< Times a partition's cache grew */
 	struct hash_partition partitions[]; /*< Parameter.index_size
 						partitions of the hash
 						table. */
@@ -178,6 +201,10 @@ struct hash_latch {
 	struct rbt_node *locator; /*< Saved location in the tree */
 	uint64_t rbt_hash; /*< Saved red-black hash */
 	uint32_t index;	/*< Saved partition index */
+	struct rbt_node *retired_node; /*< Unlinked while latched, freed
+					   on release */
+	struct hash_data *retired_data; /*< Replaced or deleted while
+					    latched, freed on release */
 };
 
 typedef enum hash_set_how {
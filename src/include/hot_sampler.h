@@ -0,0 +1,93 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file hot_sampler.h
+ * @brief Heavy hitter sampling of requests
+ *
+ * One request in Hot_Sample_Rate is recorded, at reply time, into
+ * fixed size Space-Saving summaries of the files, the clients and the
+ * (client, export, file, operation) tuples, weighted once by requests
+ * and once by bytes read or written.  Each summary keeps the
+ * HOT_SLOTS heaviest keys seen; a count overestimates the true
+ * (sampled) weight of its key by at most its error.
+ */
+
+#ifndef HOT_SAMPLER_H
+#define HOT_SAMPLER_H
+
+#include <stdint.h>
+#include <netinet/in.h>
+#include "gsh_config.h"
+
+#define HOT_SLOTS 128
+
+enum hot_dim {
+	HOT_FILES,		/*< (export, fileid) */
+	HOT_CLIENTS,		/*< client address */
+	HOT_REQUESTS,		/*< the whole key */
+	HOT_DIM_COUNT
+};
+
+enum hot_weight {
+	HOT_BY_OPS,
+	HOT_BY_BYTES,
+	HOT_WEIGHT_COUNT
+};
+
+struct hot_key {
+	char client[INET6_ADDRSTRLEN];
+	uint16_t export_id;
+	uint64_t fileid;	/*< 0 when the request resolved no handle */
+	uint32_t prog;
+	uint32_t vers;
+	uint32_t proc;
+};
+
+struct hot_entry {
+	struct hot_key key;
+	uint64_t count;		/*< Sampled weight, scaled by the rate */
+	uint64_t error;		/*< Most count may overestimate by */
+};
+
+extern __thread uint32_t hot_sample_tick;
+
+void hot_sample_record(uint32_t prog, uint32_t vers, uint32_t proc);
+uint32_t hot_sampler_top(enum hot_dim dim, enum hot_weight weight,
+			 struct hot_entry *top, uint32_t max);
+
+/**
+ * @brief Sample the request in op_ctx
+ *
+ * Called once per request when its reply is sent; costs a thread local
+ * increment unless the request is sampled.
+ */
+static inline void hot_sample(uint32_t prog, uint32_t vers, uint32_t proc)
+{
+	uint32_t rate = nfs_param.core_param.hot_sample_rate;
+
+	if (rate == 0 || ++hot_sample_tick < rate)
+		return;
+	hot_sample_tick = 0;
+	hot_sample_record(prog, vers, proc);
+}
+
+#endif				/* HOT_SAMPLER_H */
@@ -47,6 +47,20 @@
 /* Arbitrary string buffer lengths */
 #define PWENT_BEST_GUESS_LEN 1024
 
+/**
+ * @brief Counters of the ID mapping cache
+ */
+struct idmapper_stats {
+	uint64_t hits;		/*< lookups the cache answered */
+	uint64_t negative_hits;	/*< of which with a failed mapping */
+	uint64_t misses;	/*< lookups of what was not cached */
+	uint64_t expired;	/*< lookups of what had expired */
+	uint64_t refreshes;	/*< background lookups started */
+	uint64_t lookups;	/*< directory lookups */
+	uint64_t lookup_ns;	/*< time spent in them */
+	uint64_t lookup_max_ns;	/*< the longest of them */
+};
+
 /**
  * @brief Shared between idmapper.c and idmapper_cache.c.  If you
  * aren't in idmapper.c, leave these symbols alone.
@@ -57,21 +71,44 @@
 extern pthread_rwlock_t idmapper_user_lock;
 extern pthread_rwlock_t idmapper_group_lock;
 
+/**
+ * @brief What a lookup in the directory found
+ *
+ * A mapping that was not found is cached for
+ * Idmap_Negative_Expiration, in the direction it was looked up only.
+ */
+enum idmapper_result {
+	IDMAP_MAPPED,		/*< name and ID map to each other */
+	IDMAP_NO_ID,		/*< the name maps to no ID */
+	IDMAP_NO_NAME,		/*< the ID maps to no name */
+};
+
+extern struct idmapper_stats idmapper_stats;
+
 void idmapper_cache_init(void);
 bool idmapper_add_user(const struct gsh_buffdesc *, uid_t, const gid_t *,
-		       bool);
-bool idmapper_add_group(const struct gsh_buffdesc *, gid_t);
+		       bool, enum idmapper_result);
+bool idmapper_add_group(const struct gsh_buffdesc *, gid_t,
+			enum idmapper_result);
 bool idmapper_lookup_by_uname(const struct gsh_buffdesc *, uid_t *,
 			      const gid_t **, bool);
 bool idmapper_lookup_by_uid(const uid_t, const struct gsh_buffdesc **,
 			    const gid_t **);
 bool idmapper_lookup_by_gname(const struct gsh_buffdesc *, uid_t *);
 bool idmapper_lookup_by_gid(const gid_t, const struct gsh_buffdesc **);
+bool idmapper_lookup_principal(const struct gsh_buffdesc *, uid_t *, gid_t *);
+void idmapper_add_principal(const struct gsh_buffdesc *, uid_t, gid_t);
+void idmapper_refresh_name(const struct gsh_buffdesc *, bool);
+void idmapper_refresh_id(uint32_t, bool);
 /** @} */
 
 bool idmapper_init(void);
 void idmapper_clear_cache(void);
 
+/* Bumped by idmapper_clear_cache, for callers keeping mapped names */
+extern uint32_t idmapper_generation;
+void idmapper_get_stats(struct idmapper_stats *);
+
 bool xdr_encode_nfs4_owner(XDR *, uid_t);
 bool xdr_encode_nfs4_group(XDR *, gid_t);
 
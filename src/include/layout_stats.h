@@ -0,0 +1,68 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file layout_stats.h
+ * @brief What pNFS clients report of their I/O through layouts
+ *
+ * LAYOUTSTATS counts are summed per file and LAYOUTERROR reports per
+ * file and per data server device.  Both tables are of fixed size; a
+ * key new to a full set of a table replaces the one of that set
+ * reported least recently.
+ */
+
+#ifndef LAYOUT_STATS_H
+#define LAYOUT_STATS_H
+
+#include <stdint.h>
+#include <time.h>
+#include "nfsv41.h"
+
+#define LAYOUT_STATS_FILES 4096
+#define LAYOUT_STATS_DEVICES 1024
+
+struct layout_file_stats {
+	uint16_t export_id;
+	uint64_t fileid;
+	uint64_t reads;
+	uint64_t read_bytes;
+	uint64_t writes;
+	uint64_t write_bytes;
+	uint64_t errors;
+	time_t last;		/*< When last reported, 0 if the slot is free */
+};
+
+struct layout_device_stats {
+	deviceid4 deviceid;
+	uint64_t errors;
+	nfsstat4 last_status;
+	nfs_opnum4 last_op;
+	time_t last;		/*< When last reported, 0 if the slot is free */
+};
+
+void layout_stats_io(uint16_t export_id, uint64_t fileid,
+		     const io_info4 *read, const io_info4 *write);
+void layout_stats_error(uint16_t export_id, uint64_t fileid,
+			const device_error4 *error);
+uint32_t layout_stats_files(struct layout_file_stats **files);
+uint32_t layout_stats_devices(struct layout_device_stats **devices);
+
+#endif				/* LAYOUT_STATS_H */
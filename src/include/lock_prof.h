@@ -0,0 +1,118 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file lock_prof.h
+ * @brief Lock contention profiling
+ *
+ * Built with USE_LOCK_PROFILING, the PTHREAD_MUTEX_lock and
+ * PTHREAD_RWLOCK_{rd,wr}lock wrappers record, for each call site, how
+ * often the lock was taken, how often it had to be waited for, and the
+ * time spent waiting for it and holding it.  Each thread counts into
+ * its own table, and the tables are summed when reported.
+ *
+ * An uncontended acquisition costs a trylock and a clock read, a
+ * release another clock read.  The hold time of a mutex includes any
+ * condition wait made with it held, as the wait is not seen here.
+ */
+
+#ifndef LOCK_PROF_H
+#define LOCK_PROF_H
+
+#ifdef USE_LOCK_PROFILING
+
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+
+/* Call sites tracked; those past it are counted together */
+#define LOCK_PROF_SITES 2048
+
+struct lock_prof_site {
+	const char *file;
+	int line;
+	const char *name;	/*< The lock expression */
+	uint32_t id;		/*< 0 until first used */
+};
+
+struct lock_prof_stats {
+	uint64_t acquired;
+	uint64_t contended;	/*< Had to wait */
+	uint64_t wait_ns;
+	uint64_t wait_max;
+	uint64_t hold_ns;
+	uint64_t hold_max;
+};
+
+struct lock_prof_report {
+	const struct lock_prof_site *site;
+	struct lock_prof_stats stats;
+};
+
+void lock_prof_acquired(struct lock_prof_site *site, void *lock,
+			const struct timespec *wait_start);
+void lock_prof_released(void *lock);
+uint32_t lock_prof_collect(struct lock_prof_report **reports);
+
+/**
+ * @brief Take a lock, recording the wait
+ *
+ * @param[in] _lock The lock
+ * @param[in] _try  The trylock call, failing with EBUSY if contended
+ * @param[in] _call The blocking call
+ *
+ * @return What the lock call returned.
+ */
+#define LOCK_PROF_ACQUIRE(_lock, _try, _call)				\
+	({								\
+		static struct lock_prof_site __lp_site = {		\
+			.file = __FILE__,				\
+			.line = __LINE__,				\
+			.name = #_lock,					\
+		};							\
+		struct timespec __lp_start = { 0, 0 };			\
+		int __lp_rc = (_try);					\
+									\
+		if (__lp_rc == EBUSY) {					\
+			clock_gettime(CLOCK_MONOTONIC, &__lp_start);	\
+			__lp_rc = (_call);				\
+		}							\
+		if (__lp_rc == 0)					\
+			lock_prof_acquired(&__lp_site, (_lock),		\
+					   &__lp_start);		\
+		__lp_rc;						\
+	})
+
+/** Release a lock, recording how long it was held */
+#define LOCK_PROF_RELEASE(_lock, _call)					\
+	({								\
+		lock_prof_released(_lock);				\
+		(_call);						\
+	})
+
+#else				/* USE_LOCK_PROFILING */
+
+#define LOCK_PROF_ACQUIRE(_lock, _try, _call) (_call)
+#define LOCK_PROF_RELEASE(_lock, _call) (_call)
+
+#endif				/* USE_LOCK_PROFILING */
+
+#endif				/* LOCK_PROF_H */
@@ -158,6 +158,12 @@ void LogMallocFailure(const char *file, int line, const char *function,
 int read_log_config(config_file_t in_config,
 		    struct config_error_type *err_type);
 
+/* Buffered writes of log files, see log_async.c */
+bool log_async_write(const char *path, const char *msg, size_t len);
+int log_async_start(void);
+void log_async_stop(void);
+void log_async_reopen(void);
+
 /* These functions display a timeval or timespec into the display buffer
  * in the same format used for logging timestamp.
  */
@@ -208,6 +214,17 @@ extern log_levels_t *component_log_level;
 
 extern struct log_component_info LogComponents[COMPONENT_COUNT];
 
+/* The most verbose level built in, see the LOG_COMPILED_LEVEL cmake
+ * option.  Messages above it are compiled out, arguments and all.
+ */
+#ifndef LOG_COMPILED_LEVEL
+#define LOG_COMPILED_LEVEL NIV_FULL_DEBUG
+#endif
+
+#define log_enabled(component, level) \
+	((level) <= LOG_COMPILED_LEVEL && \
+	 unlikely(component_log_level[component] >= (level)))
+
 #define LogAlways(component, format, args...) \
 	DisplayLogComponentLevel(component, __FILE__, \
 				 __LINE__, \
@@ -280,8 +297,7 @@ extern struct log_component_info LogComponents[COMPONENT_COUNT];
 
 #define LogInfo(component, format, args...) \
 	do { \
-		if (unlikely(component_log_level[component] \
-		    >= NIV_INFO)) \
+		if (log_enabled(component, NIV_INFO)) \
 			DisplayLogComponentLevel(component,  __FILE__,\
 						 __LINE__, \
 						  __func__, \
@@ -290,8 +306,7 @@ extern struct log_component_info LogComponents[COMPONENT_COUNT];
 
 #define LogDebug(component, format, args...) \
 	do { \
-		if (unlikely(component_log_level[component] \
-		    >= NIV_DEBUG)) \
+		if (log_enabled(component, NIV_DEBUG)) \
 			DisplayLogComponentLevel(component,  __FILE__,\
 						 __LINE__, \
 						  __func__, \
@@ -300,8 +315,7 @@ extern struct log_component_info LogComponents[COMPONENT_COUNT];
 
 #define LogMidDebug(component, format, args...) \
 	do { \
-		if (unlikely(component_log_level[component] \
-		    >= NIV_MID_DEBUG)) \
+		if (log_enabled(component, NIV_MID_DEBUG)) \
 			DisplayLogComponentLevel(component,  __FILE__,\
 						 __LINE__, \
 						  __func__, \
@@ -311,8 +325,7 @@ extern struct log_component_info LogComponents[COMPONENT_COUNT];
 
 #define LogFullDebug(component, format, args...) \
 	do { \
-		if (unlikely(component_log_level[component] \
-		    >= NIV_FULL_DEBUG)) \
+		if (log_enabled(component, NIV_FULL_DEBUG)) \
 			DisplayLogComponentLevel(component,  __FILE__,\
 						 __LINE__, \
 						  __func__, \
@@ -323,8 +336,7 @@ extern struct log_component_info LogComponents[COMPONENT_COUNT];
 #define \
 LogFullDebugOpaque(component, format, buf_size, value, length, args...) \
 	do { \
-		if (unlikely(component_log_level[component] \
-		    >= NIV_FULL_DEBUG)) { \
+		if (log_enabled(component, NIV_FULL_DEBUG)) { \
 			char buf[buf_size]; \
 			struct display_buffer dspbuf = {buf_size, buf, buf}; \
 			\
@@ -340,8 +352,7 @@ LogFullDebugOpaque(component, format, buf_size, value, length, args...) \
 
 #define LogFullDebugBytes(component, format, buf_size, value, length, args...) \
 	do { \
-		if (unlikely(component_log_level[component] \
-		    >= NIV_FULL_DEBUG)) { \
+		if (log_enabled(component, NIV_FULL_DEBUG)) { \
 			char buf[buf_size]; \
 			struct display_buffer dspbuf = {buf_size, buf, buf}; \
 			\
@@ -357,8 +368,7 @@ LogFullDebugOpaque(component, format, buf_size, value, length, args...) \
 
 #define LogAtLevel(component, level, format, args...) \
 	do { \
-		if (unlikely(component_log_level[component] \
-		    >= level)) \
+		if (log_enabled(component, level)) \
 			DisplayLogComponentLevel(component,  __FILE__,\
 						 __LINE__, \
 						  __func__, \
@@ -366,29 +376,27 @@ LogFullDebugOpaque(component, format, buf_size, value, length, args...) \
 	} while (0)
 
 #define isLevel(component, level) \
-	(unlikely(component_log_level[component] >= level))
+	log_enabled(component, level)
 
 #define isInfo(component) \
-	(unlikely(component_log_level[component] >= NIV_INFO))
+	log_enabled(component, NIV_INFO)
 
 #define isDebug(component) \
-	(unlikely(component_log_level[component] >= NIV_DEBUG))
+	log_enabled(component, NIV_DEBUG)
 
 #define isMidDebug(component) \
-	(unlikely(component_log_level[component] >= NIV_MID_DEBUG))
+	log_enabled(component, NIV_MID_DEBUG)
 
 #define isFullDebug(component) \
-	(unlikely(component_log_level[component] >= NIV_FULL_DEBUG))
+	log_enabled(component, NIV_FULL_DEBUG)
 
 /* Use either the first component, or if it is not at least at level,
  * use the second component.
  */
 #define LogInfoAlt(comp1, comp2, format, args...) \
 	do { \
-		if (unlikely(component_log_level[comp1] \
-		    >= NIV_INFO) || \
-		    unlikely(component_log_level[comp2] \
-		    >= NIV_INFO)) { \
+		if (log_enabled(comp1, NIV_INFO) || \
+		    log_enabled(comp2, NIV_INFO)) { \
 			log_components_t component = \
 			    component_log_level[comp1] \
 				>= NIV_INFO ? comp1 : comp2; \
@@ -405,10 +413,8 @@ LogFullDebugOpaque(component, format, buf_size, value, length, args...) \
 
 #define LogDebugAlt(comp1, comp2, format, args...) \
 	do { \
-		if (unlikely(component_log_level[comp1] \
-		    >= NIV_DEBUG) || \
-		    unlikely(component_log_level[comp2] \
-		    >= NIV_DEBUG)) { \
+		if (log_enabled(comp1, NIV_DEBUG) || \
+		    log_enabled(comp2, NIV_DEBUG)) { \
 			log_components_t component = \
 			    component_log_level[comp1] \
 				>= NIV_DEBUG ? comp1 : comp2; \
@@ -425,10 +431,8 @@ LogFullDebugOpaque(component, format, buf_size, value, length, args...) \
 
 #define LogMidDebugAlt(comp1, comp2, format, args...) \
 	do { \
-		if (unlikely(component_log_level[comp1] \
-		    >= NIV_MID_DEBUG) || \
-		    unlikely(component_log_level[comp2] \
-		    >= NIV_MID_DEBUG)) { \
+		if (log_enabled(comp1, NIV_MID_DEBUG) || \
+		    log_enabled(comp2, NIV_MID_DEBUG)) { \
 			log_components_t component = \
 			    component_log_level[comp1] \
 				>= NIV_MID_DEBUG ? comp1 : comp2; \
@@ -445,10 +449,8 @@ LogFullDebugOpaque(component, format, buf_size, value, length, args...) \
 
 #define LogFullDebugAlt(comp1, comp2, format, args...) \
 	do { \
-		if (unlikely(component_log_level[comp1] \
-		    >= NIV_FULL_DEBUG) || \
-		    unlikely(component_log_level[comp2] \
-		    >= NIV_FULL_DEBUG)) { \
+		if (log_enabled(comp1, NIV_FULL_DEBUG) || \
+		    log_enabled(comp2, NIV_FULL_DEBUG)) { \
 			log_components_t component = \
 			    component_log_level[comp1] \
 				>= NIV_FULL_DEBUG ? comp1 : comp2; \
@@ -26,4 +26,8 @@
 void ng_cache_init(void);
 void ng_clear_cache(void);
 bool ng_innetgr(const char *group, const char *host);
+void ng_register(const char *group);
+void ng_unregister(const char *group);
+int ng_preload_init(void);
+int ng_preload_shutdown(void);
 #endif
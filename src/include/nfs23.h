@@ -446,6 +446,8 @@ struct READ3resok {
 		u_int data_len;
 		char *data_val;
 	} data;
+	struct fsal_read_buf *rbuf;	/* lender of data, not XDR */
+	u_int data_bufsize;	/* pooled size of data, not XDR */
 };
 typedef struct READ3resok READ3resok;
 
@@ -816,6 +818,11 @@ typedef struct entryplus3 entryplus3;
 struct dirlistplus3 {
 	entryplus3 *entries;
 	bool_t eof;
+	/* Entries READDIRPLUS has already encoded, each led by its TRUE,
+	 * sent in place of the list.
+	 */
+	char *entries_xdr;
+	u_int entries_xdr_len;
 };
 typedef struct dirlistplus3 dirlistplus3;
 
@@ -92,6 +92,8 @@ struct _rpc_call {
 	enum clnt_stat stat;
 	uint32_t states;
 	uint32_t flags;
+	uint32_t timeout;	/*< Seconds to wait for the reply, 0 for
+				 *  the default */
 	void *u_data[2];
 	void *completion_arg;
 };
@@ -110,6 +112,13 @@ typedef struct request_data {
 	struct timespec time_queued;	/*< The time at which a request was
 					 *  added to the worker thread queue.
 					 */
+	nsecs_elapsed_t time_decode;	/*< Decoding started, for latency
+					 *  histograms (since boot) */
+	nsecs_elapsed_t time_dequeued;	/*< Taken by a worker, likewise */
+	struct glist_head inflight;	/*< On the in-flight registry */
+	int32_t inflight_shard;		/*< Its shard there, -1 if none */
+	uint32_t inflight_stage;	/*< enum inflight_stage */
+	bool inflight_logged;		/*< Reported as slow in flight */
 	request_type_t rtype;
 
 	union request_content {
@@ -140,6 +149,7 @@ extern char *pidfile_path;
 #ifdef _USE_9P
 void *_9p_dispatcher_thread(void *arg);
 void _9p_tcp_process_request(struct _9p_request_data *req9p);
+void _9p_tcp_conn_put(struct _9p_conn *conn);
 int _9p_process_buffer(struct _9p_request_data *req9p, char *replydata,
 		       u32 *poutlen);
 
@@ -158,19 +168,99 @@ void Clean_RPC(void);
 void nfs_Init_svc(void);
 void nfs_rpc_dispatch_threads(pthread_attr_t *attr_thr);
 void nfs_rpc_dispatch_stop(void);
+bool nfs_rpc_handed_off(void);
+int nfs_rpc_node_fridges_shutdown(void);
 
 request_data_t *nfs_rpc_dequeue_req(nfs_worker_data_t *worker);
 void nfs_rpc_enqueue_req(request_data_t *req);
 uint32_t get_dequeue_count(void);
+void get_dequeue_batch_stats(uint64_t *batches, uint64_t *reqs);
 uint32_t get_enqueue_count(void);
+uint32_t nfs_rpc_queue_depth(void);
+void nfs_rpc_return_credit(SVCXPRT *xprt);
 
 /* in nfs_worker_thread.c */
 
-void nfs_rpc_execute(request_data_t *req);
+bool nfs_rpc_execute(request_data_t *req, bool may_suspend);
+struct req_op_context *nfs_req_op_ctx(struct svc_req *req);
+bool nfs_req_async_begin(struct svc_req *req);
+bool nfs_req_suspend(struct svc_req *req, nfs_resume_t resume, void *arg,
+		     int *result);
+void nfs_req_async_done(struct svc_req *req, int result);
+
+/**
+ * @brief Check whether a request's I/O has completed before suspending
+ *
+ * Once true, nfs_req_suspend() will not suspend the request.
+ */
+static inline bool nfs_req_async_completed(struct svc_req *req)
+{
+	nfs_request_t *reqnfs = container_of(req, nfs_request_t, svc);
+
+	return atomic_fetch_uint32_t(&reqnfs->async_state) == NFS_ASYNC_DONE;
+}
+
+/**
+ * @brief Get ready to start an NFSv4 op's I/O that may suspend it
+ *
+ * An op that gets true sets async_pending in the compound's data,
+ * starts its I/O and returns.  Its completion calls
+ * nfs_req_async_done() with the op's status.
+ *
+ * @param[in,out] data  The compound's data
+ *
+ * @retval true if the I/O may be started without waiting for it.
+ * @retval false if the op must make it synchronously.
+ */
+static inline bool nfs4_io_async_begin(compound_data_t *data)
+{
+	return data->may_suspend && nfs_req_async_begin(data->req);
+}
 const nfs_function_desc_t *nfs_rpc_get_funcdesc(nfs_request_t *);
 
+/* in nfs_inflight.c */
+
+enum inflight_stage {
+	INFLIGHT_EXECUTE,
+	INFLIGHT_ENCODE,
+};
+
+/**
+ * @brief A request in flight, as reported
+ *
+ * The strings are valid only for the duration of the callback.
+ */
+struct inflight_info {
+	uint32_t xid;
+	const char *client;
+	const char *proc;	/*< The RPC's function */
+	const char *op;		/*< Current NFSv4 op, "" if none */
+	const char *stage;
+	const char *fsal_call;	/*< FSAL call in progress, "" if none */
+	uint64_t age_ns;	/*< Since the request was decoded */
+};
+
+int nfs_inflight_init(void);
+int nfs_inflight_shutdown(void);
+void nfs_inflight_start(request_data_t *reqdata);
+void nfs_inflight_done(request_data_t *reqdata, nsecs_elapsed_t svc_done);
+void nfs_inflight_foreach(void (*cb)(const struct inflight_info *, void *),
+			  void *arg);
+
+/**
+ * @brief Whether requests are timed through their stages
+ *
+ * For the latency histograms and for the slow request tracker.
+ */
+static inline bool nfs_rpc_stage_timing(void)
+{
+	return nfs_param.core_param.enable_latency_hist ||
+	       nfs_param.core_param.slow_request_ms != 0;
+}
+
 int worker_init(void);
 int worker_shutdown(void);
+void worker_pool_size(uint32_t *nthreads, uint32_t *min, uint32_t *max);
 
 /* Config parsing routines */
 extern config_file_t config_struct;
@@ -179,6 +269,9 @@ extern struct config_block nfs_ip_name;
 #ifdef _HAVE_GSSAPI
 extern struct config_block krb5_param;
 #endif
+#ifdef USE_RPC_TLS
+extern struct config_block tls_param;
+#endif
 extern struct config_block version4_param;
 
 /* in nfs_admin_thread.c */
@@ -40,6 +40,7 @@
 #include "nfs_core.h"
 #include <misc/rbtree_x.h>
 #include <misc/queue.h>
+#include "gsh_oa_hash.h"
 
 enum drc_type {
 	DRC_TCP_V4, /*< safe to use an XID-based, per-connection DRC */
@@ -55,11 +56,14 @@ enum drc_type {
 #define DRC_FLAG_LOCKED 0x0010
 #define DRC_FLAG_RECYCLE 0x0020
 #define DRC_FLAG_RELEASE 0x0040
+#define DRC_FLAG_TABLE 0x0080	/*< requests are in xid_t, not xt */
 
 typedef struct drc {
 	enum drc_type type;
 	struct rbtree_x xt;
-	/* Define the tail queue */
+	/* Or, with DRC_TCP_Hash_Table, by XID and checksum */
+	struct gsh_oa_hash xid_t;
+	/* Define the tail queue, also the CLOCK ring of xid_t */
 	TAILQ_HEAD(drc_tailq, dupreq_entry) dupreq_q;
 	pthread_mutex_t mtx;
 	uint32_t npart;
@@ -88,6 +92,18 @@ typedef enum dupreq_state {
 	DUPREQ_DELETED
 } dupreq_state_t;
 
+/**
+ * @brief A cached reply in XDR form
+ *
+ * The encoded result of a completed request, sent as is on a replay.
+ * It belongs to its dupreq_entry and lives as long as the entry does,
+ * so the entry's refcnt covers any replay still sending it.
+ */
+struct dupreq_reply {
+	uint32_t len;
+	char data[];
+};
+
 struct dupreq_entry {
 	struct opr_rbtree_node rbt_k;
 	/* Define the tail queue */
@@ -106,8 +122,10 @@ struct dupreq_entry {
 	} hin;
 	uint64_t hk;		/* hash key */
 	dupreq_state_t state;
+	bool referenced;	/* replayed since the CLOCK hand passed */
 	uint32_t refcnt;
-	nfs_res_t *res;
+	nfs_res_t *res;		/* Decoded result, if not encoded */
+	struct dupreq_reply *reply;	/* Encoded result */
 	time_t timestamp;
 };
 
@@ -145,5 +163,7 @@ dupreq_status_t nfs_dupreq_start(nfs_request_t *,
 dupreq_status_t nfs_dupreq_finish(struct svc_req *, nfs_res_t *);
 dupreq_status_t nfs_dupreq_delete(struct svc_req *);
 void nfs_dupreq_rele(struct svc_req *, const nfs_function_desc_t *);
+bool nfs_dupreq_sendreply(SVCXPRT *, struct svc_req *,
+			  const nfs_function_desc_t *, nfs_res_t *);
 
 #endif /* NFS_DUPREQ_H */
@@ -114,6 +114,9 @@ typedef struct exportlist_client_entry__ {
 /** Controls whether a directory's dirent cache is trusted for
     negative results. */
 #define EXPORT_OPTION_TRUST_READIR_NEGATIVE_CACHE 0x00000008
+/** Cached attributes stay valid until the FSAL invalidates them
+    with an upcall. */
+#define EXPORT_OPTION_UPCALL_COHERENT 0x00000010
 
 /* Constants for export permissions masks */
 #define EXPORT_OPTION_ROOT 0x00000001	/*< Allow root access as root uid */
@@ -180,6 +183,7 @@ typedef struct exportlist_client_entry__ {
 #define EXPORT_OPTION_NFSV3 0x00100000	/*< NFSv3 operations are supported */
 #define EXPORT_OPTION_NFSV4 0x00200000	/*< NFSv4 operations are supported */
 #define EXPORT_OPTION_9P 0x00400000	/*< 9P operations are supported */
+#define EXPORT_OPTION_TLS_REQUIRED 0x00800000	/*< Only over RPC-with-TLS */
 #define EXPORT_OPTION_UDP 0x01000000	/*< UDP protocol is supported */
 #define EXPORT_OPTION_TCP 0x02000000	/*< TCP protocol is supported */
 #define EXPORT_OPTION_RDMA 0x04000000	/*< RDMA protocol is supported */
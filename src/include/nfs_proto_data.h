@@ -103,6 +103,21 @@ typedef union nfs_arg__ {
 struct COMPOUND4res_extended {
 	COMPOUND4res res_compound4;
 	bool res_cached;
+	struct mem_arena res_arena;	/*< Reply storage taken from the
+					    compound's arena */
+	struct nfs41_cached_reply *res_reply;	/*< Held while a cached
+						    reply is sent */
+};
+
+/**
+ * @brief A reply cached in a session slot
+ *
+ * Shared by the slot and each send of it, the original and any
+ * replays, and freed with the last of them.
+ */
+struct nfs41_cached_reply {
+	int32_t refcount;
+	struct COMPOUND4res_extended res;
 };
 
 typedef union nfs_res__ {
@@ -189,12 +204,43 @@ typedef struct nfs_function_desc__ {
 	unsigned int dispatch_behaviour;
 } nfs_function_desc_t;
 
+/**
+ * @brief Finish a resumed request's service
+ *
+ * @param[in] req     The request
+ * @param[in] arg     As passed to nfs_req_suspend()
+ * @param[in] result  As passed to nfs_req_async_done()
+ *
+ * @return What the service returns.
+ */
+typedef int (*nfs_resume_t)(struct svc_req *req, void *arg, int result);
+
+/* Where a request is in suspending for its I/O, see @ref AsyncRequest */
+#define NFS_ASYNC_NONE		0
+#define NFS_ASYNC_STARTED	1	/*< I/O started, not yet suspended */
+#define NFS_ASYNC_SUSPENDED	2	/*< Worker let go, I/O pending */
+#define NFS_ASYNC_DONE		3	/*< I/O completed before suspending */
+
 typedef struct nfs_request {
 	struct svc_req svc;
 	struct nfs_request_lookahead lookahead;
+	struct gsh_export *qos_export;	/*< Export whose QoS limits apply,
+					    a reference held while queued */
+	uint64_t qos_bytes;	/*< Bytes it reads or writes, for QoS */
 	nfs_arg_t arg_nfs;
 	nfs_res_t *res_nfs;
 	const nfs_function_desc_t *funcdesc;
+	/* The request's context is kept here rather than on the stack so
+	 * that a suspended request still has it.
+	 */
+	struct req_op_context req_ctx;
+	struct export_perms export_perms;
+	struct user_cred user_credentials;
+	bool may_suspend;	/*< The worker can leave it suspended */
+	uint32_t async_state;	/*< NFS_ASYNC_* */
+	int async_result;	/*< From nfs_req_async_done() */
+	nfs_resume_t async_resume;
+	void *async_arg;
 } nfs_request_t;
 
 enum rpc_chan_type {
@@ -292,6 +338,8 @@ typedef struct nfs_client_cred__ {
 typedef struct compound_data {
 	nfs_fh4 currentFH;	/*< Current filehandle */
 	nfs_fh4 savedFH;	/*< Saved filehandle */
+	char currentFH_buf[NFS4_FHSIZE];	/*< Storage for currentFH */
+	char savedFH_buf[NFS4_FHSIZE];	/*< Storage for savedFH */
 	stateid4 current_stateid;	/*< Current stateid */
 	bool current_stateid_valid;	/*< Current stateid is valid */
 	stateid4 saved_stateid;	/*< Saved stateid */
@@ -311,20 +359,59 @@ typedef struct compound_data {
 	nfs_client_cred_t credential;	/*< Raw RPC credentials */
 	nfs_client_id_t *preserved_clientid;	/*< clientid that has lease
 						   reserved, if any */
-	struct COMPOUND4res_extended *cached_res;	/*< NFv41: pointer to
-							   cached RPC result in
-							   a session's slot */
+	nfs41_session_slot_t *cache_slot;	/*< NFv41: slot to cache the
+						    result in */
+	struct nfs41_cached_reply *replay;	/*< NFv41: referenced cached
+						    reply to send again */
 	bool use_drc;		/*< Set to true if session DRC is to be used */
 	uint32_t oppos;		/*< Position of the operation within the
 				    request processed  */
+	uint32_t opcount;	/*< Operations this data runs up to */
+	uint32_t lookup_ahead;	/*< Op after the LOOKUPs looked up ahead */
 	nfs41_session_t *session;	/*< Related session
 					   (found by OP_SEQUENCE) */
 	sequenceid4 sequence;	/*< Sequence ID of the current compound
 				   (if applicable) */
 	slotid4 slot;		/*< Slot ID of the current compound
 				   (if applicable) */
+	struct mem_arena arena;	/*< Reply storage, handed to the result and
+				    released when the result is freed */
+	bool may_suspend;	/*< The op may suspend the request for its
+				    I/O, see nfs4_io_async_begin() */
+	bool async_pending;	/*< The op is waiting for its I/O */
+	nsecs_elapsed_t op_start_time;	/*< When the pending op started */
 } compound_data_t;
 
+/**
+ * @brief Point a compound's filehandles at their own storage
+ *
+ * currentFH and savedFH live in the compound data, so PUTFH and SAVEFH
+ * do not allocate them for every request.
+ *
+ * @param[in,out] data The compound data
+ */
+static inline void compound_data_init_fh(compound_data_t *data)
+{
+	data->currentFH.nfs_fh4_val = data->currentFH_buf;
+	data->savedFH.nfs_fh4_val = data->savedFH_buf;
+}
+
+/**
+ * @brief Move a compound's data, as when its op is suspended
+ *
+ * The filehandles of the copy point into its own buffers, so it does
+ * not depend on the storage it was moved from.
+ *
+ * @param[out] dst  Where to move the data
+ * @param[in]  src  The data to move
+ */
+static inline void compound_data_move(compound_data_t *dst,
+				      const compound_data_t *src)
+{
+	*dst = *src;
+	compound_data_init_fh(dst);
+}
+
 typedef int (*nfs4_op_function_t) (struct nfs_argop4 *, compound_data_t *,
 				   struct nfs_resop4 *);
 
@@ -155,6 +155,8 @@ int nfs3_mknod(nfs_arg_t *, struct svc_req *, nfs_res_t *);
 /* Functions needed for nfs v4 */
 
 int nfs4_Compound(nfs_arg_t *, struct svc_req *, nfs_res_t *);
+int nfs4_compound_fridge_init(void);
+int nfs4_offload_fridge_init(void);
 
 int nfs4_op_access(struct nfs_argop4 *, compound_data_t *,
 		   struct nfs_resop4 *);
@@ -338,6 +340,26 @@ int nfs4_op_io_advise(struct nfs_argop4 *, compound_data_t *,
 
 void nfs4_op_io_advise_Free(nfs_resop4 *resp);
 
+int nfs4_op_copy(struct nfs_argop4 *, compound_data_t *,
+		 struct nfs_resop4 *);
+
+void nfs4_op_copy_Free(nfs_resop4 *resp);
+
+int nfs4_op_clone(struct nfs_argop4 *, compound_data_t *,
+		  struct nfs_resop4 *);
+
+void nfs4_op_clone_Free(nfs_resop4 *resp);
+
+int nfs4_op_offload_status(struct nfs_argop4 *, compound_data_t *,
+			   struct nfs_resop4 *);
+
+void nfs4_op_offload_status_Free(nfs_resop4 *resp);
+
+int nfs4_op_offload_cancel(struct nfs_argop4 *, compound_data_t *,
+			   struct nfs_resop4 *);
+
+void nfs4_op_offload_cancel_Free(nfs_resop4 *resp);
+
 int nfs4_op_layouterror(struct nfs_argop4 *, compound_data_t *,
 		      struct nfs_resop4 *);
 
@@ -375,6 +397,8 @@ void nfs4_op_removexattr_Free(nfs_resop4 *resp);
 
 #define NFS_REQ_OK   0
 #define NFS_REQ_DROP 1
+/* The request is suspended for its I/O, see @ref AsyncRequest */
+#define NFS_REQ_ASYNC_WAIT 2
 
 /* Free functions */
 void mnt1_Mnt_Free(nfs_res_t *);
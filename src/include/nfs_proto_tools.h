@@ -85,6 +85,9 @@ struct xdr_attrs_args {
 	compound_data_t *data;
 	bool statfscalled;
 	fsal_dynamicfsinfo_t *dynamicinfo;
+	struct mem_arena *arena;	/*< If set, encoded attributes are
+					    allocated from it rather than
+					    the heap */
 };
 
 typedef struct fattr4_dent {
@@ -289,9 +292,12 @@ bool nfs3_Sattr_To_FSALattr(struct attrlist *, sattr3 *);
 
 int nfs4_Fattr_To_FSAL_attr(struct attrlist *, fattr4 *, compound_data_t *);
 
+int nfs4_Fattr_To_FSAL_attr_fh(struct attrlist *, fattr4 *, nfs_fh4 *,
+			       compound_data_t *);
+
 int nfs4_Fattr_To_fsinfo(fsal_dynamicfsinfo_t *, fattr4 *);
 
-int nfs4_Fattr_Fill_Error(fattr4 *, nfsstat4);
+int nfs4_Fattr_Fill_Error(fattr4 *, nfsstat4, struct mem_arena *);
 
 int nfs4_FSALattr_To_Fattr(struct xdr_attrs_args *, struct bitmap4 *,
 			   fattr4 *);
@@ -0,0 +1,145 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file nfs_qos.h
+ * @brief Token buckets limiting the request and byte rates
+ *
+ * An export and a Dispatch_Client_Weight client may each have a
+ * bucket of requests and a bucket of bytes, filled at their rate up
+ * to their burst.  The fair queue only hands a worker the next
+ * request of a client when both buckets of the client and of the
+ * request's export have tokens; otherwise the client's flow waits its
+ * next turn and its requests stay queued.
+ *
+ * A request needs a whole token of the request bucket and a byte
+ * bucket that is not in debt.  Its bytes are charged once it is
+ * admitted, so that a large READ or WRITE puts the byte bucket in
+ * debt, paid back by later refills, rather than waiting for a burst
+ * it may never fit in.
+ */
+
+#ifndef NFS_QOS_H
+#define NFS_QOS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "gsh_types.h"
+#include "abstract_atomic.h"
+
+/** Highest IOPS_Limit, so that a refill cannot overflow */
+#define QOS_IOPS_MAX 100000000
+
+/** Highest Bandwidth_Limit, 100GB/s */
+#define QOS_BANDWIDTH_MAX 100000000000ULL
+
+/** Highest Bandwidth_Burst, ten seconds at the highest limit */
+#define QOS_BANDWIDTH_BURST_MAX (10 * QOS_BANDWIDTH_MAX)
+
+/**
+ * @brief Configured limits of a bucket
+ */
+
+struct qos_limits {
+	uint32_t iops;		/*< Requests a second, 0 for no limit */
+	uint32_t iops_burst;	/*< Requests let through at once, 0 for
+				    one second's worth */
+	uint64_t bandwidth;	/*< Bytes a second, 0 for no limit */
+	uint64_t bandwidth_burst; /*< Bytes let through at once, 0 for
+				      one second's worth */
+};
+
+/**
+ * @brief A pair of token buckets and their counters
+ */
+
+struct qos_bucket {
+	pthread_spinlock_t sp;
+	struct qos_limits limits;
+	int64_t iops_tokens;	/*< Requests, in NS_PER_SEC units */
+	int64_t bw_tokens;	/*< Bytes, negative when in debt */
+	nsecs_elapsed_t refilled; /*< Time of the last refill */
+	uint64_t admitted;	/*< Requests let through */
+	uint64_t deferred;	/*< Times a request had to wait */
+	uint64_t bytes;		/*< Bytes of the requests let through */
+};
+
+/** Buckets with a limit, the fair queue skips QoS while there are none */
+extern uint32_t qos_limited_buckets;
+
+static inline bool qos_limited(const struct qos_limits *limits)
+{
+	return limits->iops != 0 || limits->bandwidth != 0;
+}
+
+/**
+ * @brief Whether any export or client has a limit
+ */
+static inline bool nfs_qos_active(void)
+{
+	return atomic_fetch_uint32_t(&qos_limited_buckets) != 0;
+}
+
+void qos_bucket_init(struct qos_bucket *bucket);
+void qos_bucket_destroy(struct qos_bucket *bucket);
+void qos_bucket_set(struct qos_bucket *bucket,
+		    const struct qos_limits *limits);
+void qos_bucket_get(struct qos_bucket *bucket, struct qos_bucket *copy);
+bool qos_bucket_ready(struct qos_bucket *bucket, nsecs_elapsed_t now);
+void qos_bucket_charge(struct qos_bucket *bucket, uint64_t bytes);
+
+#ifdef USE_DBUS
+#include <dbus/dbus.h>
+
+/** Limits and counters of a bucket, as appended by qos_dbus_append */
+#define QOS_DBUS_TYPE "ttttttt"
+
+/** The limits taken by the SetQoS methods, 0 for none */
+#define QOS_LIMITS_ARGS			\
+{					\
+	.name = "iops",			\
+	.type = "t",			\
+	.direction = "in"		\
+},					\
+{					\
+	.name = "iops_burst",		\
+	.type = "t",			\
+	.direction = "in"		\
+},					\
+{					\
+	.name = "bandwidth",		\
+	.type = "t",			\
+	.direction = "in"		\
+},					\
+{					\
+	.name = "bandwidth_burst",	\
+	.type = "t",			\
+	.direction = "in"		\
+}
+
+bool qos_dbus_limits(DBusMessageIter *args, struct qos_limits *limits,
+		     char **errormsg);
+void qos_dbus_append(DBusMessageIter *struct_iter,
+		     struct qos_bucket *bucket);
+#endif
+
+#endif /* NFS_QOS_H */
@@ -35,8 +35,11 @@
 #ifndef NFS_REQ_QUEUE_H
 #define NFS_REQ_QUEUE_H
 
+#include <sched.h>
 #include "gsh_list.h"
+#include "gsh_mpmc_ring.h"
 #include "wait_queue.h"
+#include "gsh_numa.h"
 
 struct req_q {
 	pthread_spinlock_t sp;
@@ -46,6 +49,47 @@ struct req_q {
 	uint32_t waiters;
 };
 
+/**
+ * @brief Deficit round robin scheduler over client flows
+ *
+ * When Dispatch_Fair_Queueing is set, NFS requests bound for the low
+ * and high latency queues are held in one FIFO per client address.
+ * Flows with queued work sit on the active list; a worker serves the
+ * flow at its head until its deficit is spent, then moves it to the
+ * tail and credits it with quantum * weight.  A client that floods the
+ * server therefore only gets its share of each round.
+ *
+ * With QoS limits (see nfs_qos.h), a flow whose next request is not
+ * let through by its client's or its export's buckets moves to the
+ * tail keeping its deficit.  When no flow can go, the queue is held
+ * and workers look again every QOS_HELD_WAIT_MS.
+ */
+
+#define REQ_FAIRQ_BUCKETS 61	/*< flow hash buckets, prime */
+
+struct req_fair_flow {
+	struct glist_head active;	/*< on req_fairq.active */
+	struct glist_head hash;		/*< on req_fairq.flows[] */
+	struct glist_head reqs;		/*< queued request_data_t */
+	sockaddr_t addr;		/*< client address, port ignored */
+	struct dispatch_client_weight *cw; /*< its configuration, or NULL */
+	uint64_t key;			/*< hash of addr */
+	uint32_t size;
+	uint32_t weight;
+	int32_t deficit;
+};
+
+struct req_fairq {
+	pthread_spinlock_t sp;
+	struct glist_head active;
+	struct glist_head flows[REQ_FAIRQ_BUCKETS];
+	uint32_t size;
+	uint32_t nflows;
+	bool held;			/*< requests wait for QoS tokens */
+};
+
+#define QOS_HELD_WAIT_MS 10
+
 struct req_q_pair {
 	const char *s;
 	GSH_CACHE_PAD(0);
@@ -53,42 +97,59 @@ struct req_q_pair {
 	GSH_CACHE_PAD(1);
 	struct req_q consumer;	/* to executor */
 	GSH_CACHE_PAD(2);
+	struct gsh_mpmc_ring ring;	/* lock-free backend, if configured;
+					 * the lists above take overflow */
+	struct req_fairq *fairq;	/* per-client scheduler, or NULL */
 };
 
 #define REQ_Q_MOUNT 0
 #define REQ_Q_CALL 1
 #define REQ_Q_LOW_LATENCY 2	/*< GETATTR, RENEW, etc */
 #define REQ_Q_HIGH_LATENCY 3	/*< READ, WRITE, COMMIT, etc */
-#define N_REQ_QUEUES 4
+#define REQ_Q_RECLAIM 4		/*< Reclaims, served first during grace */
+#define N_REQ_QUEUES 5
 
 extern const char *req_q_s[N_REQ_QUEUES];	/* for debug prints */
 
+/**
+ * @brief One shard of the request queues
+ *
+ * In the default configuration there is exactly one shard.  When
+ * Dispatch_Queue_Shards is larger than one, each shard serves a subset
+ * of the CPUs: decoders enqueue on the shard of the CPU they are
+ * running on, and workers dequeue from their local shard first,
+ * stealing from sibling shards only when it is empty.  Each shard
+ * has its own wait list, so idle workers are woken near the work.
+ */
 struct req_q_set {
 	struct req_q_pair qset[N_REQ_QUEUES];
+	uint32_t ctr;		/*< dequeue slot counter */
+	pthread_spinlock_t sp;	/*< protects wait_list */
+	struct glist_head wait_list;
+	uint32_t waiters;
+	GSH_CACHE_PAD(0);
 };
 
 struct nfs_req_st {
 	struct {
-		uint32_t ctr;
-		struct req_q_set nfs_request_q;
+		uint32_t n_shards;
+		uint32_t ring_size;	/*< 0 if the ring backend is off */
+		bool numa;	/*< One shard per NUMA node */
+		struct req_q_set *nfs_request_q;	/*< n_shards sets */
 		uint64_t size;
-		pthread_spinlock_t sp;
-		struct glist_head wait_list;
-		uint32_t waiters;
 	} reqs;
-	GSH_CACHE_PAD(1);
-	struct {
-		pthread_mutex_t mtx;
-		struct glist_head q;
-		uint32_t stalled;
-		bool active;
-	} stallq;
 };
 
 extern struct nfs_req_st nfs_req_st;
 
 void nfs_rpc_queue_init(void);
 
+/* in nfs_rpc_fairq.c */
+struct req_fairq *nfs_rpc_fairq_create(void);
+void nfs_rpc_fairq_enqueue(struct req_fairq *fq, request_data_t *reqdata);
+request_data_t *nfs_rpc_fairq_dequeue(struct req_fairq *fq);
+struct dispatch_client_weight *nfs_rpc_fairq_client(sockaddr_t *addr);
+
 static inline void nfs_rpc_q_init(struct req_q *q)
 {
 	glist_init(&q->q);
@@ -97,29 +158,59 @@ static inline void nfs_rpc_q_init(struct req_q *q)
 	q->waiters = 0;
 }
 
-static inline uint32_t nfs_rpc_q_next_slot(void)
+/**
+ * @brief Find the queue shard local to the calling thread
+ *
+ * @return Index of the shard for the CPU we are running on.
+ */
+static inline uint32_t nfs_rpc_q_local_shard(void)
 {
-	uint32_t ix = atomic_inc_uint32_t(&nfs_req_st.reqs.ctr);
+	uint32_t n_shards = nfs_req_st.reqs.n_shards;
+
+	if (likely(n_shards == 1))
+		return 0;
+	if (nfs_req_st.reqs.numa)
+		return gsh_numa_node() % n_shards;
+#if defined(__linux__)
+	{
+		int cpu = sched_getcpu();
+
+		if (likely(cpu >= 0))
+			return cpu % n_shards;
+	}
+#endif
+	/* no cpu information, spread threads by identity */
+	return ((uintptr_t) pthread_self() >> 6) % n_shards;
+}
+
+static inline uint32_t nfs_rpc_q_next_slot(struct req_q_set *qs)
+{
+	uint32_t ix = atomic_inc_uint32_t(&qs->ctr);
 
 	if (!ix)
-		ix = atomic_inc_uint32_t(&nfs_req_st.reqs.ctr);
+		ix = atomic_inc_uint32_t(&qs->ctr);
 	return ix;
 }
 
 static inline void nfs_rpc_queue_awaken(void *arg)
 {
 	struct nfs_req_st *st = arg;
+	struct req_q_set *qs;
 	struct glist_head *g = NULL;
 	struct glist_head *n = NULL;
-
-	pthread_spin_lock(&st->reqs.sp);
-	glist_for_each_safe(g, n, &st->reqs.wait_list) {
-		wait_q_entry_t *wqe = glist_entry(g, wait_q_entry_t, waitq);
-
-		pthread_cond_signal(&wqe->lwe.cv);
-		pthread_cond_signal(&wqe->rwe.cv);
+	uint32_t ix;
+
+	for (ix = 0; ix < st->reqs.n_shards; ++ix) {
+		qs = &st->reqs.nfs_request_q[ix];
+		pthread_spin_lock(&qs->sp);
+		glist_for_each_safe(g, n, &qs->wait_list) {
+			wait_q_entry_t *wqe =
+				glist_entry(g, wait_q_entry_t, waitq);
+
+			wait_park_kick(&wqe->park);
+		}
+		pthread_spin_unlock(&qs->sp);
 	}
-	pthread_spin_unlock(&st->reqs.sp);
 }
 
 #endif				/* NFS_REQ_QUEUE_H */
@@ -140,6 +140,7 @@ int nfs_rpc_call_init(rpc_call_t call, uint32_t flags);
 #define NFS_RPC_CALL_NONE 0x0000
 #define NFS_RPC_CALL_INLINE 0x0001	/*< execute in current thread ctxt */
 #define NFS_RPC_CALL_BROADCAST 0x0002
+#define NFS_RPC_CALL_NO_SLOT 0x0004	/*< v4.1 call not holding a slot */
 
 /* Submit rpc to be called on chan, optionally waiting for completion. */
 int32_t nfs_rpc_submit_call(rpc_call_t *call, void *completion_arg,
@@ -156,6 +157,7 @@ int nfs_rpc_v41_single(nfs_client_id_t *clientid, nfs_cb_argop4 *op,
 		       void (*free_op)(nfs_cb_argop4 *op));
 void nfs41_complete_single(rpc_call_t *call, rpc_call_hook hook, void *arg,
 			   uint32_t flags);
+void nfs41_abort_cb_pending(nfs41_session_t *session);
 enum clnt_stat nfs_test_cb_chan(nfs_client_id_t *);
 
 #endif /* !NFS_RPC_CALLBACK_H */
@@ -1645,6 +1645,8 @@ extern "C" {
 			u_int data_len;
 			char *data_val;
 		} data;
+		struct fsal_read_buf *rbuf;	/* lender of data, not XDR */
+		u_int data_bufsize;	/* pooled size of data, not XDR */
 	};
 	typedef struct READ4resok READ4resok;
 
@@ -1676,6 +1678,11 @@ extern "C" {
 	struct dirlist4 {
 		entry4 *entries;
 		bool_t eof;
+		/* Server side only: entries READDIR has already encoded,
+		 * each led by its TRUE, sent in place of the list.
+		 */
+		char *entries_xdr;
+		u_int entries_xdr_len;
 	};
 	typedef struct dirlist4 dirlist4;
 
@@ -2559,6 +2566,8 @@ extern "C" {
 		bool_t            rpr_eof;
 		count4            rpr_contents_count;
 		contents          rpr_contents;
+		char             *rpr_buf;	/* pooled buffer, not XDR */
+		u_int             rpr_bufsize;	/* its size, not XDR */
 	} read_plus_res4;
 
 	typedef struct {
@@ -2609,39 +2618,73 @@ extern "C" {
 	};
 	typedef struct OFFLOAD_REVOKE4res OFFLOAD_REVOKE4res;
 
+	typedef struct {
+		netloc_type4    nl_type;
+		union {
+			utf8str_cis nl_name;
+			utf8str_cis nl_url;
+			netaddr4    nl_addr;
+		};
+	} netloc4;
+
 	struct COPY4args {
 		stateid4        ca_src_stateid;
 		stateid4        ca_dst_stateid;
 		offset4         ca_src_offset;
 		offset4         ca_dst_offset;
 		length4         ca_count;
-		netloc_type4        ca_type;
-		union {
-			utf8str_cis ca_name;
-			utf8str_cis ca_url;
-			netaddr4    ca_addr;
-		};
+		bool_t          ca_consecutive;
+		bool_t          ca_synchronous;
+		struct {
+			u_int ca_source_server_len;
+			netloc4 *ca_source_server_val;
+		} ca_source_server;
 	};
 	typedef struct COPY4args COPY4args;
 
+	typedef struct {
+		bool_t          cr_consecutive;
+		bool_t          cr_synchronous;
+	} copy_requirements4;
+
+	typedef struct {
+		write_response4    cr_response;
+		copy_requirements4 cr_requirements;
+	} COPY4resok;
+
 	struct COPY4res {
 		nfsstat4 cr_status;
 		union {
-			write_response4 cr_resok4;
-			length4         cr_bytes_copied;
+			COPY4resok         cr_resok4;
+			/* NFS4ERR_OFFLOAD_NO_REQS */
+			copy_requirements4 cr_requirements;
 		} COPY4res_u;
 	};
 	typedef struct COPY4res COPY4res;
 
-	struct OFFLOAD_ABORT4args {
-		stateid4        oaa_stateid;
+	struct OFFLOAD_CANCEL4args {
+		stateid4        oca_stateid;
 	};
-	typedef struct OFFLOAD_ABORT4args OFFLOAD_ABORT4args;
+	typedef struct OFFLOAD_CANCEL4args OFFLOAD_CANCEL4args;
 
-	struct OFFLOAD_ABORT4res {
-		stateid4        oar_stateid;
+	struct OFFLOAD_CANCEL4res {
+		nfsstat4        ocr_status;
 	};
-	typedef struct OFFLOAD_ABORT4res OFFLOAD_ABORT4res;
+	typedef struct OFFLOAD_CANCEL4res OFFLOAD_CANCEL4res;
+
+	struct CLONE4args {
+		stateid4        cl_src_stateid;
+		stateid4        cl_dst_stateid;
+		offset4         cl_src_offset;
+		offset4         cl_dst_offset;
+		length4         cl_count;
+	};
+	typedef struct CLONE4args CLONE4args;
+
+	struct CLONE4res {
+		nfsstat4        cl_status;
+	};
+	typedef struct CLONE4res CLONE4res;
 
 	struct OFFLOAD_STATUS4args {
 		stateid4        osa_stateid;
@@ -3160,8 +3203,9 @@ extern "C" {
 			COPY_NOTIFY4args opoffload_notify;
 			OFFLOAD_REVOKE4args opcopy_revoke;
 			COPY4args opcopy;
-			OFFLOAD_ABORT4args opoffload_abort;
+			OFFLOAD_CANCEL4args opoffload_cancel;
 			OFFLOAD_STATUS4args opoffload_status;
+			CLONE4args opclone;
 			WRITE_SAME4args opwrite_plus;
 			ALLOCATE4args opallocate;
 			DEALLOCATE4args opdeallocate;
@@ -3245,8 +3289,9 @@ extern "C" {
 			COPY_NOTIFY4res opoffload_notify;
 			OFFLOAD_REVOKE4res opcopy_revoke;
 			COPY4res opcopy;
-			OFFLOAD_ABORT4res opoffload_abort;
+			OFFLOAD_CANCEL4res opoffload_cancel;
 			OFFLOAD_STATUS4res opoffload_status;
+			CLONE4res opclone;
 			WRITE_SAME4res opwrite_plus;
 			ALLOCATE4res opallocate;
 			DEALLOCATE4res opdeallocate;
@@ -3599,6 +3644,26 @@ extern "C" {
 	};
 	typedef struct CB_NOTIFY_DEVICEID4res CB_NOTIFY_DEVICEID4res;
 
+	typedef struct {
+		nfsstat4 coa_status;
+		union {
+			write_response4 coa_resok4;
+			length4         coa_bytes_copied;
+		};
+	} offload_info4;
+
+	struct CB_OFFLOAD4args {
+		nfs_fh4 coa_fh;
+		stateid4 coa_stateid;
+		offload_info4 coa_offload_info;
+	};
+	typedef struct CB_OFFLOAD4args CB_OFFLOAD4args;
+
+	struct CB_OFFLOAD4res {
+		nfsstat4 cor_status;
+	};
+	typedef struct CB_OFFLOAD4res CB_OFFLOAD4res;
+
 /* Callback operations new to NFSv4.1 */
 
 	enum nfs_cb_opnum4 {
@@ -3614,6 +3679,7 @@ extern "C" {
 		NFS4_OP_CB_WANTS_CANCELLED = 12,
 		NFS4_OP_CB_NOTIFY_LOCK = 13,
 		NFS4_OP_CB_NOTIFY_DEVICEID = 14,
+		NFS4_OP_CB_OFFLOAD = 15,
 		NFS4_OP_CB_ILLEGAL = 10044,
 	};
 	typedef enum nfs_cb_opnum4 nfs_cb_opnum4;
@@ -3633,6 +3699,7 @@ extern "C" {
 			CB_WANTS_CANCELLED4args opcbwants_cancelled;
 			CB_NOTIFY_LOCK4args opcbnotify_lock;
 			CB_NOTIFY_DEVICEID4args opcbnotify_deviceid;
+			CB_OFFLOAD4args opcboffload;
 		} nfs_cb_argop4_u;
 	};
 	typedef struct nfs_cb_argop4 nfs_cb_argop4;
@@ -3652,6 +3719,7 @@ extern "C" {
 			CB_WANTS_CANCELLED4res opcbwants_cancelled;
 			CB_NOTIFY_LOCK4res opcbnotify_lock;
 			CB_NOTIFY_DEVICEID4res opcbnotify_deviceid;
+			CB_OFFLOAD4res opcboffload;
 			CB_ILLEGAL4res opcbillegal;
 		} nfs_cb_resop4_u;
 	};
@@ -6433,9 +6501,20 @@ extern "C" {
 
 	static inline bool xdr_dirlist4(XDR * xdrs, dirlist4 *objp)
 	{
-		if (!xdr_pointer
-		    (xdrs, (char **)&objp->entries, sizeof(entry4),
-		     (xdrproc_t) xdr_entry4))
+		entry4 *end = NULL;
+
+		if (xdrs->x_op == XDR_ENCODE && objp->entries_xdr != NULL) {
+			/* The encoded entries, then the NULL that ends them */
+			if (!xdr_opaque(xdrs, objp->entries_xdr,
+					objp->entries_xdr_len))
+				return false;
+			if (!xdr_pointer
+			    (xdrs, (char **)&end, sizeof(entry4),
+			     (xdrproc_t) xdr_entry4))
+				return false;
+		} else if (!xdr_pointer
+			   (xdrs, (char **)&objp->entries, sizeof(entry4),
+			    (xdrproc_t) xdr_entry4))
 			return false;
 		if (!inline_xdr_bool(xdrs, &objp->eof))
 			return false;
@@ -6759,7 +6838,7 @@ extern "C" {
 			return false;
 		if (!xdr_stable_how4(xdrs, &objp->stable))
 			return false;
-		if (!inline_xdr_bytes
+		if (!xdr_iobuf
 		    (xdrs, (char **)&objp->data.data_val,
 		     &objp->data.data_len, XDR_BYTES_MAXLEN_IO))
 			return false;
@@ -8098,6 +8177,158 @@ extern "C" {
 		return true;
 	}
 
+	static inline bool xdr_netloc4(XDR * xdrs, netloc4 *objp)
+	{
+		if (!inline_xdr_enum(xdrs, (enum_t *) &objp->nl_type))
+			return false;
+		switch (objp->nl_type) {
+		case NL4_NAME:
+			if (!xdr_utf8str_cis(xdrs, &objp->nl_name))
+				return false;
+			break;
+		case NL4_URL:
+			if (!xdr_utf8str_cis(xdrs, &objp->nl_url))
+				return false;
+			break;
+		case NL4_NETADDR:
+			if (!xdr_netaddr4(xdrs, &objp->nl_addr))
+				return false;
+			break;
+		default:
+			return false;
+		}
+		return true;
+	}
+
+	static inline bool xdr_COPY4args(XDR * xdrs, COPY4args *objp)
+	{
+		if (!xdr_stateid4(xdrs, &objp->ca_src_stateid))
+			return false;
+		if (!xdr_stateid4(xdrs, &objp->ca_dst_stateid))
+			return false;
+		if (!xdr_offset4(xdrs, &objp->ca_src_offset))
+			return false;
+		if (!xdr_offset4(xdrs, &objp->ca_dst_offset))
+			return false;
+		if (!xdr_length4(xdrs, &objp->ca_count))
+			return false;
+		if (!inline_xdr_bool(xdrs, &objp->ca_consecutive))
+			return false;
+		if (!inline_xdr_bool(xdrs, &objp->ca_synchronous))
+			return false;
+		if (!xdr_array
+		    (xdrs,
+		     (char **)&objp->ca_source_server.ca_source_server_val,
+		     &objp->ca_source_server.ca_source_server_len,
+		     XDR_ARRAY_MAXLEN, sizeof(netloc4),
+		     (xdrproc_t) xdr_netloc4))
+			return false;
+		return true;
+	}
+
+	static inline bool xdr_copy_requirements4(XDR * xdrs,
+						  copy_requirements4 *objp)
+	{
+		if (!inline_xdr_bool(xdrs, &objp->cr_consecutive))
+			return false;
+		if (!inline_xdr_bool(xdrs, &objp->cr_synchronous))
+			return false;
+		return true;
+	}
+
+	static inline bool xdr_COPY4res(XDR * xdrs, COPY4res *objp)
+	{
+		if (!xdr_nfsstat4(xdrs, &objp->cr_status))
+			return false;
+		switch (objp->cr_status) {
+		case NFS4_OK:
+			if (!xdr_WRITE_SAME4resok(xdrs,
+				&objp->COPY4res_u.cr_resok4.cr_response))
+				return false;
+			if (!xdr_copy_requirements4(xdrs,
+				&objp->COPY4res_u.cr_resok4.cr_requirements))
+				return false;
+			break;
+		case NFS4ERR_OFFLOAD_NO_REQS:
+			if (!xdr_copy_requirements4(xdrs,
+				&objp->COPY4res_u.cr_requirements))
+				return false;
+			break;
+		default:
+			break;
+		}
+		return true;
+	}
+
+	static inline bool xdr_OFFLOAD_CANCEL4args(XDR * xdrs,
+						   OFFLOAD_CANCEL4args *objp)
+	{
+		if (!xdr_stateid4(xdrs, &objp->oca_stateid))
+			return false;
+		return true;
+	}
+
+	static inline bool xdr_OFFLOAD_CANCEL4res(XDR * xdrs,
+						  OFFLOAD_CANCEL4res *objp)
+	{
+		if (!xdr_nfsstat4(xdrs, &objp->ocr_status))
+			return false;
+		return true;
+	}
+
+	static inline bool xdr_OFFLOAD_STATUS4args(XDR * xdrs,
+						   OFFLOAD_STATUS4args *objp)
+	{
+		if (!xdr_stateid4(xdrs, &objp->osa_stateid))
+			return false;
+		return true;
+	}
+
+	static inline bool xdr_OFFLOAD_STATUS4res(XDR * xdrs,
+						  OFFLOAD_STATUS4res *objp)
+	{
+		OFFLOAD_STATUS4resok *resok =
+			&objp->OFFLOAD_STATUS4res_u.osr_resok4;
+
+		if (!xdr_nfsstat4(xdrs, &objp->osr_status))
+			return false;
+		if (objp->osr_status != NFS4_OK)
+			return true;
+		if (!xdr_length4(xdrs, &resok->osr_bytes_copied))
+			return false;
+		/* osr_complete<1> */
+		if (!xdr_count4(xdrs, &resok->osr_count_complete))
+			return false;
+		if (resok->osr_count_complete > 1)
+			return false;
+		if (resok->osr_count_complete == 1)
+			if (!xdr_nfsstat4(xdrs, &resok->osr_complete))
+				return false;
+		return true;
+	}
+
+	static inline bool xdr_CLONE4args(XDR * xdrs, CLONE4args *objp)
+	{
+		if (!xdr_stateid4(xdrs, &objp->cl_src_stateid))
+			return false;
+		if (!xdr_stateid4(xdrs, &objp->cl_dst_stateid))
+			return false;
+		if (!xdr_offset4(xdrs, &objp->cl_src_offset))
+			return false;
+		if (!xdr_offset4(xdrs, &objp->cl_dst_offset))
+			return false;
+		if (!xdr_length4(xdrs, &objp->cl_count))
+			return false;
+		return true;
+	}
+
+	static inline bool xdr_CLONE4res(XDR * xdrs, CLONE4res *objp)
+	{
+		if (!xdr_nfsstat4(xdrs, &objp->cl_status))
+			return false;
+		return true;
+	}
+
 	static inline bool xdr_ALLOCATE4res(XDR * xdrs, ALLOCATE4res *objp)
 	{
 		if (!xdr_nfsstat4(xdrs, &objp->ar_status))
@@ -8268,6 +8499,8 @@ extern "C" {
 			if (!xdr_LOCK4args(xdrs, &objp->nfs_argop4_u.oplock))
 				return false;
 			lkhd->flags |= NFS_LOOKAHEAD_LOCK;
+			if (objp->nfs_argop4_u.oplock.reclaim)
+				lkhd->flags |= NFS_LOOKAHEAD_RECLAIM;
 			break;
 		case NFS4_OP_LOCKT:
 			if (!xdr_LOCKT4args(xdrs, &objp->nfs_argop4_u.oplockt))
@@ -8299,6 +8532,15 @@ extern "C" {
 			if (objp->nfs_argop4_u.opopen.openhow.opentype ==
 			    OPEN4_CREATE)
 				lkhd->flags |= NFS_LOOKAHEAD_CREATE;
+			switch (objp->nfs_argop4_u.opopen.claim.claim) {
+			case CLAIM_PREVIOUS:
+			case CLAIM_DELEGATE_PREV:
+			case CLAIM_DELEG_PREV_FH:
+				lkhd->flags |= NFS_LOOKAHEAD_RECLAIM;
+				break;
+			default:
+				break;
+			}
 			break;
 		case NFS4_OP_OPENATTR:
 			if (!xdr_OPENATTR4args
@@ -8494,6 +8736,7 @@ extern "C" {
 			if (!xdr_RECLAIM_COMPLETE4args
 			    (xdrs, &objp->nfs_argop4_u.opreclaim_complete))
 				return false;
+			lkhd->flags |= NFS_LOOKAHEAD_RECLAIM;
 			break;
 
 		/* NFSv4.2 */
@@ -8543,10 +8786,27 @@ extern "C" {
 			break;
 
 		case NFS4_OP_COPY:
-		case NFS4_OP_COPY_NOTIFY:
+			if (!xdr_COPY4args(xdrs,
+					&objp->nfs_argop4_u.opcopy))
+				return false;
+			break;
 		case NFS4_OP_OFFLOAD_CANCEL:
+			if (!xdr_OFFLOAD_CANCEL4args(xdrs,
+					&objp->nfs_argop4_u.opoffload_cancel))
+				return false;
+			break;
 		case NFS4_OP_OFFLOAD_STATUS:
+			if (!xdr_OFFLOAD_STATUS4args(xdrs,
+					&objp->nfs_argop4_u.opoffload_status))
+				return false;
+			break;
 		case NFS4_OP_CLONE:
+			if (!xdr_CLONE4args(xdrs,
+					&objp->nfs_argop4_u.opclone))
+				return false;
+			break;
+
+		case NFS4_OP_COPY_NOTIFY:
 			break;
 
 		/* NFSv4.3 */
@@ -8893,10 +9153,28 @@ extern "C" {
 			break;
 
 		case NFS4_OP_COPY:
-		case NFS4_OP_COPY_NOTIFY:
+			if (!xdr_COPY4res(xdrs,
+					&objp->nfs_resop4_u.opcopy))
+				return false;
+			break;
 		case NFS4_OP_OFFLOAD_CANCEL:
+			if (!xdr_OFFLOAD_CANCEL4res(xdrs,
+					&objp->nfs_resop4_u.opoffload_cancel))
+				return false;
+			break;
 		case NFS4_OP_OFFLOAD_STATUS:
+			if (!xdr_OFFLOAD_STATUS4res(xdrs,
+					&objp->nfs_resop4_u.opoffload_status))
+				return false;
+			break;
 		case NFS4_OP_CLONE:
+			if (!xdr_CLONE4res(xdrs,
+					&objp->nfs_resop4_u.opclone))
+				return false;
+			break;
+
+		case NFS4_OP_COPY_NOTIFY:
+			break;
 
 		/* NFSv4.3 */
 		case NFS4_OP_GETXATTR:
@@ -9705,6 +9983,34 @@ extern "C" {
 		return true;
 	}
 
+	static inline bool xdr_CB_OFFLOAD4args(XDR * xdrs,
+					       CB_OFFLOAD4args *objp)
+	{
+		offload_info4 *info = &objp->coa_offload_info;
+
+		if (!xdr_nfs_fh4(xdrs, &objp->coa_fh))
+			return false;
+		if (!xdr_stateid4(xdrs, &objp->coa_stateid))
+			return false;
+		if (!xdr_nfsstat4(xdrs, &info->coa_status))
+			return false;
+		if (info->coa_status == NFS4_OK) {
+			if (!xdr_WRITE_SAME4resok(xdrs, &info->coa_resok4))
+				return false;
+		} else {
+			if (!xdr_length4(xdrs, &info->coa_bytes_copied))
+				return false;
+		}
+		return true;
+	}
+
+	static inline bool xdr_CB_OFFLOAD4res(XDR * xdrs, CB_OFFLOAD4res *objp)
+	{
+		if (!xdr_nfsstat4(xdrs, &objp->cor_status))
+			return false;
+		return true;
+	}
+
 /* Callback operations new to NFSv4.1 */
 
 	static inline bool xdr_nfs_cb_opnum4(XDR * xdrs, nfs_cb_opnum4 *objp)
@@ -9780,6 +10086,11 @@ extern "C" {
 			    (xdrs, &objp->nfs_cb_argop4_u.opcbnotify_deviceid))
 				return false;
 			break;
+		case NFS4_OP_CB_OFFLOAD:
+			if (!xdr_CB_OFFLOAD4args
+			    (xdrs, &objp->nfs_cb_argop4_u.opcboffload))
+				return false;
+			break;
 		case NFS4_OP_CB_ILLEGAL:
 			break;
 		default:
@@ -9854,6 +10165,11 @@ extern "C" {
 			    (xdrs, &objp->nfs_cb_resop4_u.opcbnotify_deviceid))
 				return false;
 			break;
+		case NFS4_OP_CB_OFFLOAD:
+			if (!xdr_CB_OFFLOAD4res
+			    (xdrs, &objp->nfs_cb_resop4_u.opcboffload))
+				return false;
+			break;
 		case NFS4_OP_CB_ILLEGAL:
 			if (!xdr_CB_ILLEGAL4res
 			    (xdrs, &objp->nfs_cb_resop4_u.opcbillegal))
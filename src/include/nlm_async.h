@@ -33,6 +33,8 @@ extern pthread_cond_t nlm_async_resp_cond;
 
 int nlm_async_callback_init(void);
 
+state_status_t nlm_async_schedule(state_async_queue_t *arg);
+
 int nlm_send_async_res_nlm4(state_nlm_client_t *host, state_async_func_t func,
 			    nfs_res_t *pres);
 
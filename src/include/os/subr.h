@@ -54,5 +54,10 @@ bool to_vfs_dirent(char *buf, int bpos, struct vfs_dirent *vd, off_t base);
 uid_t setuser(uid_t uid);
 gid_t setgroup(gid_t gid);
 int set_threadgroups(size_t size, const gid_t *list);
+ssize_t vfs_copy_file_range(int src_fd, off_t src_offset, int dst_fd,
+			    off_t dst_offset, size_t count);
+int vfs_clone_range(int src_fd, off_t src_offset, int dst_fd,
+		    off_t dst_offset, size_t count);
+int vfs_fallocate_range(int fd, off_t offset, off_t length, bool punch_hole);
 
 #endif/* SUBR_OS_H */
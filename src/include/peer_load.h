@@ -0,0 +1,64 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file peer_load.h
+ * @brief Load of the heads serving the same exports
+ *
+ * With Load_Balance_Group set, each head multicasts its load every
+ * PEER_LOAD_INTERVAL seconds, and keeps the last load heard from each
+ * other head.  FS_LOCATIONS then lists every head, least loaded first,
+ * so that clients choosing a replica spread by capacity.
+ */
+
+#ifndef PEER_LOAD_H
+#define PEER_LOAD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "gsh_config.h"
+
+#define PEER_LOAD_INTERVAL 2	/*< Seconds between publications */
+#define PEER_LOAD_HEADS 32	/*< Heads known, this one included */
+#define PEER_LOAD_ADDR 256	/*< Longest address, with its NUL */
+
+struct peer_load {
+	char address[PEER_LOAD_ADDR];	/*< Where clients reach the head */
+	uint32_t ops;			/*< Requests per second */
+	uint32_t queued;		/*< Requests waiting for a worker */
+	uint32_t clients;		/*< Confirmed NFSv4 clients */
+	uint64_t score;			/*< Lower is less loaded */
+	bool self;
+};
+
+/**
+ * @brief Whether the heads are load balanced
+ */
+static inline bool peer_load_enabled(void)
+{
+	return nfs_param.nfsv4_param.lb_group != NULL;
+}
+
+uint32_t peer_load_ranked(struct peer_load *heads, uint32_t max);
+int peer_load_init(void);
+int peer_load_shutdown(void);
+
+#endif				/* PEER_LOAD_H */
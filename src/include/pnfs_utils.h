@@ -225,6 +225,33 @@ nfsstat4 FSAL_encode_file_layout(XDR *xdrs,
 nfsstat4 FSAL_encode_v4_multipath(XDR *xdrs, const uint32_t num_hosts,
 				  const fsal_multipath_member_t *hosts);
 
+/**
+ * @brief One data server of a flex files mirror
+ *
+ * The data servers are plain NFSv3 servers, loosely coupled to the
+ * MDS: the client reaches the file through them with their own handle
+ * for it, and the uid and gid given here as its credentials.
+ */
+
+typedef struct fsal_ff_data_server {
+	struct pnfs_deviceid deviceid;	/*< Device for the data server */
+	uint32_t efficiency;	/*< Preference among mirrors, higher
+				    is better */
+	struct gsh_buffdesc fh;	/*< The file's NFSv3 handle there */
+	uint32_t uid;		/*< Credentials to use there */
+	uint32_t gid;
+} fsal_ff_data_server_t;
+
+nfsstat4 FSAL_encode_flex_files_layout(XDR *xdrs, const length4 stripe_unit,
+				       const uint32_t num_mirrors,
+				       const uint32_t stripes,
+				       const fsal_ff_data_server_t *ds);
+
+nfsstat4 FSAL_encode_ff_device_addr(XDR *xdrs, const uint32_t num_hosts,
+				    const fsal_multipath_member_t *hosts,
+				    const uint32_t rsize,
+				    const uint32_t wsize);
+
 nfsstat4 posix2nfs4_error(int posix_errorcode);
 
 /*
@@ -249,4 +276,14 @@ int ReadDataServers(config_file_t in_config,
 		    struct config_error_type *err_type);
 void server_pkginit(void);
 
+/*
+** in support/pnfs_devinfo.c
+*/
+
+size_t pnfs_devinfo_get(layouttype4 type, const struct pnfs_deviceid *devid,
+			char *buf, size_t max, uint64_t *gen);
+void pnfs_devinfo_put(layouttype4 type, const struct pnfs_deviceid *devid,
+		      const char *buf, size_t len, uint64_t gen);
+void pnfs_devinfo_forget(layouttype4 type, const struct pnfs_deviceid *devid);
+
 #endif				/* PNFS_UTILS_H */
@@ -0,0 +1,42 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file rquota_cache.h
+ * @brief Cache of the quotas returned by RQUOTA GETQUOTA
+ */
+
+#ifndef RQUOTA_CACHE_H
+#define RQUOTA_CACHE_H
+
+#include "fsal_types.h"
+
+struct gsh_export;
+
+int rquota_cache_init(void);
+int rquota_cache_shutdown(void);
+fsal_status_t rquota_cache_get(struct gsh_export *exp, const char *path,
+			       int quota_type, int quota_id,
+			       fsal_quota_t *quota);
+void rquota_cache_invalidate(struct gsh_export *exp, int quota_type,
+			     int quota_id);
+
+#endif				/* RQUOTA_CACHE_H */
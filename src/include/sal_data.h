@@ -49,6 +49,7 @@
 #include "hashtable.h"
 #include "fsal_pnfs.h"
 #include "config_parsing.h"
+#include "gsh_itree.h"
 
 #ifdef _USE_9P
 /* define u32 and related types independent of SAL and 9P */
@@ -63,6 +64,7 @@
 
 typedef struct nfs_client_id_t		nfs_client_id_t;
 typedef struct nfs41_session		nfs41_session_t;
+typedef struct nfs41_session_slot__	nfs41_session_slot_t;
 
 /**
 ** Consolidated circular dependencies
@@ -116,25 +118,37 @@ extern pool_t *nfs41_session_pool;
 extern hash_table_t *ht_session_id;
 
 /**
- * @brief Number of forechannel slots in a session
- *
- * This is also the maximum number of backchannel slots we'll use,
- * even if the client offers more.
+ * @brief Number of forechannel slots a session starts out asking for
  */
 #define NFS41_NB_SLOTS 3
 
+/**
+ * @brief Most backchannel slots we'll use, even if the client offers more
+ */
+#define NFS41_CB_SLOTS 16
+
+/**
+ * @brief Most forechannel slots a session may have
+ *
+ * The client is granted up to this many at CREATE_SESSION and asked,
+ * through sr_target_highest_slotid, to use NFS41_NB_SLOTS of them at
+ * first and more as it shows it has that many requests in flight.
+ */
+#define NFS41_MAX_SLOTS 64
+
 /**
  * @brief Members in the slot table
  */
 
-typedef struct nfs41_session_slot__ {
+struct nfs41_session_slot__ {
 	sequenceid4 sequence;	/*< Sequence number of this operation */
-	pthread_mutex_t lock;	/*< Lock on the slot */
-	struct COMPOUND4res_extended cached_result;	/*< NFv41: pointer to
-							   cached RPC result in
-							   a session's slot */
-	unsigned int cache_used;	/*< If we cached the result */
-} nfs41_session_slot_t;
+	uint32_t busy;		/*< Set from SEQUENCE until the reply is
+				    cached */
+	pthread_mutex_t lock;	/*< Lock on the slot, for replays and
+				    misordered requests */
+	struct nfs41_cached_reply *reply;	/*< Last reply, NULL until the
+						    slot is first used */
+};
 
 /**
  * @brief Bookkeeping for callback slots on the client
@@ -170,19 +184,20 @@ struct nfs41_session {
 	SVCXPRT *xprt;		/*< Referenced pointer to transport */
 
 	channel_attrs4 fore_channel_attrs;	/*< Fore-channel attributes */
-	nfs41_session_slot_t slots[NFS41_NB_SLOTS];	/*< Slot table */
+	nfs41_session_slot_t *slots;	/*< Slot table, of ca_maxrequests */
+	slotid4 target_highest_slotid;	/*< Slots we would like the client
+					   to use */
 
 	channel_attrs4 back_channel_attrs;	/*< Back-channel attributes */
-	nfs41_cb_session_slot_t cb_slots[NFS41_NB_SLOTS];	/*< Callback
+	nfs41_cb_session_slot_t cb_slots[NFS41_CB_SLOTS];	/*< Callback
 								   Slot table */
 	uint32_t cb_program;	/*< Callback program ID */
 	struct rpc_call_channel cb_chan;	/*< Back channel */
 	pthread_mutex_t cb_mutex;	/*< Protects the cb slot table,
-					   when searching for a free slot */
-	pthread_cond_t cb_cond;	/*< Condition variable on which we
-				   wait if the slot table is full
-				   and on which we signal when we
-				   free an entry. */
+					   when searching for a free slot,
+					   and cb_pending */
+	struct glist_head cb_pending;	/*< Callbacks waiting for a slot,
+					   sent as one is released */
 };
 
 /**
@@ -216,12 +231,10 @@ typedef struct rdel_fh {
 typedef struct clid_entry {
 	struct glist_head cl_list;	/*< Link in the list */
 	struct glist_head cl_rfh_list;
+	bool cl_reclaim_complete;	/*< Sent RECLAIM_COMPLETE this grace */
 	char cl_name[PATH_MAX];	/*< Client name */
 } clid_entry_t;
 
-extern char v4_old_dir[PATH_MAX];
-extern char v4_recov_dir[PATH_MAX];
-
 /******************************************************************************
  *
  * NFSv4 State data
@@ -500,6 +513,7 @@ struct state_nlm_client_t {
 						     made */
 	int32_t slc_nlm_caller_name_len;	/*< Length of client name */
 	char *slc_nlm_caller_name;	/*< Client name */
+	pthread_mutex_t slc_callback_lock;	/*< Protects the callback */
 	CLIENT *slc_callback_clnt;	/*< Callback for blocking locks */
 	AUTH *slc_callback_auth;	/*< Authentication for callback */
 };
@@ -580,8 +594,15 @@ struct state_nfs4_owner_t {
  *
  * This structure encodes the owner of any state, protocol specific
  * information is contained within the union.
+ *
+ * Owners come from state_owner_pool with STATE_OWNER_INLINE_NAME bytes
+ * following the structure, and a name that fits there lives in them
+ * rather than in its own allocation.  Open and lock owner names from
+ * real clients nearly always fit.
  */
 
+#define STATE_OWNER_INLINE_NAME 64
+
 struct state_owner_t {
 	state_owner_type_t so_type;	/*< Owner type */
 	struct glist_head so_lock_list;	/*< Locks for this owner */
@@ -591,7 +612,7 @@ struct state_owner_t {
 	pthread_mutex_t so_mutex;	/*< Mutex on this owner */
 	int32_t so_refcount;	/*< Reference count for lifecyce management */
 	int so_owner_len;	/*< Length of owner name */
-	char *so_owner_val;	/*< Owner name */
+	char *so_owner_val;	/*< Owner name, inline if it fits */
 	union {
 		state_nfs4_owner_t so_nfs4_owner; /*< All NFSv4 state owners */
 		state_nlm_owner_t so_nlm_owner;	/*< NLM lock and share
@@ -698,6 +719,8 @@ struct nfs_client_id_t {
 	int32_t cid_refcount;	/*< Reference count for lifecycle */
 	int cid_lease_reservations;	/*< Counted lease reservations, to spare
 					   this clientid from the reaper */
+	struct glist_head cid_lease_link; /*< On the lease wheel */
+	time_t cid_lease_due;	/*< When the reaper next looks at the lease */
 	uint32_t cid_minorversion;
 	uint32_t cid_stateid_counter;
 
@@ -705,6 +728,9 @@ struct nfs_client_id_t {
 				       this client */
 	uint32_t num_revokes;       /* Num revokes for the client */
 	struct gsh_client *gsh_client; /* for client specific statistics. */
+	uint32_t cid_layoutrecalls;	/*< CB_LAYOUTRECALLs in flight */
+	struct glist_head cid_layoutrecall_queue; /*< Recalls waiting for
+						      one of them */
 };
 
 /**
@@ -778,8 +804,6 @@ typedef struct state_nlm_block_data_t {
 						   FH buffer */
 } state_nlm_block_data_t;
 
-extern struct glist_head state_blocked_locks;
-
 /**
  * @brief Grant types
  */
@@ -820,6 +844,7 @@ struct state_block_data_t {
 
 struct state_lock_entry_t {
 	struct glist_head sle_list;	/*< Locks on this file */
+	struct itree_node sle_tree;	/*< Lock tree of this file */
 	struct glist_head sle_owner_locks; /*< Link on the owner lock list */
 	struct glist_head sle_client_locks;	/*< Locks on this client */
 	struct glist_head sle_state_locks;	/*< Locks on this state */
@@ -873,6 +898,11 @@ struct file_deleg_stats {
 	uint32_t fds_num_opens;         /* total num of opens so far. */
 	time_t fds_first_open;          /* time that we started recording
 					   num_opens */
+	/* Recent history, halved every DELEG_HISTORY_WINDOW seconds */
+	uint32_t fds_read_opens;        /* opens for read only */
+	uint32_t fds_write_opens;       /* opens for write */
+	uint32_t fds_recent_recalls;    /* recalls of the file */
+	time_t fds_history_start;       /* start of the current window */
 };
 
 /**
@@ -889,6 +919,15 @@ struct state_file {
 	struct glist_head layoutrecall_list;
 	/** Pointers for lock list. Protected by state_lock */
 	struct glist_head lock_list;
+	/** The entries of lock_list by range. Protected by state_lock */
+	struct itree lock_tree;
+	/** Entries of lock_list not yet fully granted. Protected by
+	    state_lock */
+	uint32_t lock_unsettled;
+	/** An export holding locks on this file, and how many of the
+	    lock_list entries it holds. Protected by state_lock */
+	struct gsh_export *lock_export;
+	uint32_t lock_export_count;
 	/** Pointers for NLM share list. Protected by state_lock */
 	struct glist_head nlm_share_list;
 	/** Share reservation state for this file. Protected by state_lock */
@@ -1087,7 +1126,7 @@ typedef struct nfs_grace_start {
 
 /* Memory pools */
 
-extern pool_t *state_owner_pool;	/*< Pool for NFSv4 files's open owner */
+extern slab_pool_t *state_owner_pool; /*< Slab pool for all state owners */
 
 #ifdef DEBUG_SAL
 extern struct glist_head state_v4_all;
@@ -81,6 +81,17 @@ void free_state_owner(state_owner_t *owner);
 state_owner_t *get_state_owner(care_t care, state_owner_t *pkey,
 			       state_owner_init_t init_owner, bool_t *isnew);
 
+/**
+ * @brief Memory held by state owners
+ */
+struct state_owner_mem_stats {
+	struct slab_pool_stats slab;	/*< The owner slab pool */
+	uint64_t heap_names;	/*< Owner names too long to be inline */
+	uint64_t heap_name_bytes;	/*< ... and their total length */
+};
+
+void state_owner_mem_stats(struct state_owner_mem_stats *stats);
+
 void state_wipe_file(struct fsal_obj_handle *obj);
 
 #ifdef DEBUG_SAL
@@ -110,6 +121,7 @@ static inline void state_hdl_init(struct state_hdl *ostate,
 		glist_init(&ostate->file.list_of_states);
 		glist_init(&ostate->file.layoutrecall_list);
 		glist_init(&ostate->file.lock_list);
+		itree_init(&ostate->file.lock_tree);
 		glist_init(&ostate->file.nlm_share_list);
 		ostate->file.obj = obj;
 		break;
@@ -354,6 +366,12 @@ int display_session(struct display_buffer *dspbuf, nfs41_session_t *session);
 int32_t inc_session_ref(nfs41_session_t *session);
 int32_t dec_session_ref(nfs41_session_t *session);
 
+void nfs41_put_reply(struct nfs41_cached_reply *reply);
+void nfs41_slot_cache_reply(nfs41_session_slot_t *slot,
+			    struct COMPOUND4res_extended *res);
+struct nfs41_cached_reply *nfs41_slot_get_reply(nfs41_session_slot_t *slot);
+void nfs41_session_trim_slots(nfs41_session_t *session, slotid4 first);
+
 int display_session_id_key(struct gsh_buffdesc *buff, char *str);
 int display_session_id_val(struct gsh_buffdesc *buff, char *str);
 int compare_session_id(struct gsh_buffdesc *buff1, struct gsh_buffdesc *buff2);
@@ -476,6 +494,13 @@ uint64_t state_id_rbt_hash_func(hash_parameter_t *hparam,
 int reserve_lease(nfs_client_id_t *clientid);
 void update_lease(nfs_client_id_t *clientid);
 bool valid_lease(nfs_client_id_t *clientid);
+time_t lease_expiry(nfs_client_id_t *clientid);
+
+void nfs4_lease_wheel_init(void);
+void nfs4_lease_wheel_add(nfs_client_id_t *clientid);
+void nfs4_lease_wheel_del(nfs_client_id_t *clientid);
+nfs_client_id_t *nfs4_lease_wheel_next(time_t now);
+void nfs4_lease_wheel_refile(nfs_client_id_t *clientid, time_t due);
 
 /******************************************************************************
  *
@@ -623,8 +648,12 @@ void log_lock(log_components_t component,
 	      char *function);
 
 #define LogLock(component, debug, reason, obj, owner, lock) \
-	log_lock(component, debug, reason, obj, owner, lock, \
-		 (char *) __FILE__, __LINE__, (char *) __func__)
+	do { \
+		if (isLevel(component, debug)) \
+			log_lock(component, debug, reason, obj, owner, lock, \
+				 (char *) __FILE__, __LINE__, \
+				 (char *) __func__); \
+	} while (0)
 
 void dump_all_locks(const char *label);
 
@@ -876,6 +905,8 @@ void init_new_deleg_state(union state_data *deleg_state,
 void deleg_heuristics_recall(struct fsal_obj_handle *obj,
 			     state_owner_t *owner,
 			     struct state_t *deleg);
+void deleg_heuristics_open(struct state_hdl *ostate, uint32_t share_access);
+void deleg_heuristics_conflict(struct state_hdl *ostate);
 void get_deleg_perm(nfsace4 *permissions, open_delegation_type4 type);
 void update_delegation_stats(struct state_hdl *ostate,
 			     state_owner_t *owner,
@@ -997,7 +1028,10 @@ void grant_blocked_lock_upcall(struct fsal_obj_handle *obj, void *owner,
 void available_blocked_lock_upcall(struct fsal_obj_handle *obj, void *owner,
 				   fsal_lock_param_t *lock);
 
-void process_blocked_lock_upcall(state_block_data_t *block_data);
+/* Most blocked locks of a file granted together */
+#define STATE_GRANT_BATCH 32
+
+void process_blocked_lock_upcalls(state_block_data_t **blocks, int count);
 
 void blocked_lock_polling(struct fridgethr_context *ctx);
 
@@ -1012,14 +1046,49 @@ int nfs_in_grace(void);
 void nfs4_create_clid_name(nfs_client_record_t *, nfs_client_id_t *,
 			   struct svc_req *);
 void nfs4_add_clid(nfs_client_id_t *);
-void nfs4_rm_clid(const char *, char *, int);
+void nfs4_rm_clid(nfs_client_id_t *);
 void nfs4_chk_clid(nfs_client_id_t *);
+void nfs4_reclaim_complete(nfs_client_id_t *);
 void nfs4_load_recov_clids(nfs_grace_start_t *gsp);
-void nfs4_clean_old_recov_dir(char *);
-void nfs4_create_recov_dir(void);
+void nfs4_recovery_init(void);
+void nfs4_recovery_shutdown(void);
+void nfs4_recovery_end_grace(void);
+void nfs4_recovery_poll_grace(void);
 void nfs4_record_revoke(nfs_client_id_t *, nfs_fh4 *);
 bool nfs4_check_deleg_reclaim(nfs_client_id_t *, nfs_fh4 *);
 
+/**
+ * @brief Stable storage for the clients allowed to reclaim
+ *
+ * A backend keeps each client given to add_clid, until rm_clid, along
+ * with the handles of the delegations revoked from it.  After a
+ * restart, recovery_read_clids puts the clients of the previous epoch
+ * on the reclaim list with nfs4_add_clid_entry() and
+ * nfs4_add_rfh_entry(), and end_grace forgets them.  On a takeover it
+ * adds the clients of the node or address being taken over.
+ *
+ * Clients are identified by their cid_recov_dir name.
+ */
+struct nfs4_recovery_backend {
+	int (*recovery_init)(void);
+	void (*recovery_shutdown)(void);
+	void (*recovery_read_clids)(nfs_grace_start_t *gsp);
+	void (*end_grace)(void);
+	void (*add_clid)(nfs_client_id_t *);
+	void (*rm_clid)(nfs_client_id_t *);
+	void (*add_revoke_fh)(nfs_client_id_t *, const char *);
+	/* Optional, for backends shared by the heads of a cluster */
+	void (*join_grace)(void);
+	bool (*peers_in_grace)(bool local_grace);
+};
+
+extern struct nfs4_recovery_backend fs_backend;
+extern struct nfs4_recovery_backend fs_log_backend;
+extern struct nfs4_recovery_backend fs_cluster_backend;
+
+clid_entry_t *nfs4_add_clid_entry(const char *cl_name);
+void nfs4_add_rfh_entry(clid_entry_t *clid_ent, const char *rfh_name);
+
 
 #endif				/* SAL_FUNCTIONS_H */
 
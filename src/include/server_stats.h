@@ -42,6 +42,8 @@
 #include <sys/types.h>
 
 void server_stats_nfs_done(request_data_t *reqdata, int rc, bool dup);
+void server_stats_stages_done(request_data_t *reqdata,
+			      nsecs_elapsed_t svc_done);
 
 #ifdef _USE_9P
 void server_stats_9p_done(u8 msgtype, struct _9p_request_data *req9p);
@@ -52,6 +54,12 @@ void server_stats_io_done(size_t requested,
 void server_stats_compound_done(int num_ops, int status);
 void server_stats_nfsv4_op_done(int proto_op,
 				nsecs_elapsed_t start_time, int status);
+#ifdef USE_MEM_ACCOUNTING
+void server_stats_allocs_done(struct svc_req *req,
+			      const struct mem_counter *start);
+void server_stats_nfsv4_op_allocs_done(int proto_op,
+				       const struct mem_counter *start);
+#endif
 void server_stats_transport_done(struct gsh_client *client,
 				uint64_t rx_bytes, uint64_t rx_pkt,
 				uint64_t rx_err, uint64_t tx_bytes,
@@ -174,6 +174,132 @@ struct export_stats {
 	.direction = "out"   \
 }
 
+#define LATENCY_HIST_REPLY          \
+{                                   \
+	.name = "histograms",       \
+	.type = "a(ssstta(tt))",    \
+	.direction = "out"          \
+}
+
+#define ALLOC_STATS_REPLY           \
+{                                   \
+	.name = "allocs",           \
+	.type = "a(ssttt)",         \
+	.direction = "out"          \
+}
+
+#define IOBUF_STATS_REPLY           \
+{                                   \
+	.name = "iobuf",            \
+	.type = "(tttttt)a(tt)",    \
+	.direction = "out"          \
+}
+
+#define OWNER_STATS_REPLY           \
+{                                   \
+	.name = "owners",           \
+	.type = "(ttttttt)",        \
+	.direction = "out"          \
+}
+
+#define IDMAPPER_STATS_REPLY        \
+{                                   \
+	.name = "idmapper",         \
+	.type = "(tttttttt)",       \
+	.direction = "out"          \
+}
+
+#define CACHE_STATS_REPLY           \
+{                                   \
+	.name = "caches",           \
+	.type = "a(sttttttttt)",    \
+	.direction = "out"          \
+}
+
+#define QOS_STATS_REPLY             \
+{                                   \
+	.name = "exports",          \
+	.type = "a(qttttttt)",      \
+	.direction = "out"          \
+},                                  \
+{                                   \
+	.name = "clients",          \
+	.type = "a(sttttttt)",      \
+	.direction = "out"          \
+}
+
+#define HOT_ENTRIES_TYPE "a(sqtuuutt)"
+
+#define HOT_SPOTS_REPLY			\
+{					\
+	.name = "files_by_ops",		\
+	.type = HOT_ENTRIES_TYPE,	\
+	.direction = "out"		\
+},					\
+{					\
+	.name = "files_by_bytes",	\
+	.type = HOT_ENTRIES_TYPE,	\
+	.direction = "out"		\
+},					\
+{					\
+	.name = "clients_by_ops",	\
+	.type = HOT_ENTRIES_TYPE,	\
+	.direction = "out"		\
+},					\
+{					\
+	.name = "clients_by_bytes",	\
+	.type = HOT_ENTRIES_TYPE,	\
+	.direction = "out"		\
+},					\
+{					\
+	.name = "requests_by_ops",	\
+	.type = HOT_ENTRIES_TYPE,	\
+	.direction = "out"		\
+},					\
+{					\
+	.name = "requests_by_bytes",	\
+	.type = HOT_ENTRIES_TYPE,	\
+	.direction = "out"		\
+}
+
+#define INFLIGHT_REPLY		\
+{				\
+	.name = "requests",	\
+	.type = "a(ussssst)",	\
+	.direction = "out"	\
+}
+
+#define LOCK_STATS_REPLY		\
+{				\
+	.name = "locks",	\
+	.type = "a(sistttttt)",	\
+	.direction = "out"	\
+}
+
+#define MEM_STATS_REPLY		\
+{				\
+	.name = "tags",		\
+	.type = "a(sttt)",	\
+	.direction = "out"	\
+},				\
+{				\
+	.name = "pools",	\
+	.type = "a(stttt)",	\
+	.direction = "out"	\
+}
+
+#define LAYOUT_STATS_REPLY		\
+{					\
+	.name = "devices",		\
+	.type = "a(stuut)",		\
+	.direction = "out"		\
+},					\
+{					\
+	.name = "files",		\
+	.type = "a(qttttttt)",		\
+	.direction = "out"		\
+}
+
 #define LAYOUTS_REPLY		\
 {				\
 	.name = "getdevinfo",	\
@@ -202,11 +328,12 @@ struct export_stats {
 }
 
 /* number of delegations, number of sent recalls,
- * number of failed recalls, number of revokes */
+ * number of failed recalls, number of revokes,
+ * number of grants, recalls per grant */
 #define DELEG_REPLY		       \
 {				       \
 	.name = "delegation_stats",    \
-	.type = "(tttt)",	       \
+	.type = "(tttttd)",	       \
 	.direction = "out"	       \
 }
 
@@ -220,6 +347,13 @@ struct export_stats {
 }						\
 
 
+#define SNAPSHOT_REPLY      \
+{                           \
+	.name = "snapshot", \
+	.type = "ay",       \
+	.direction = "out"  \
+}
+
 #define _9P_OP_ARG           \
 {                            \
 	.name = "_9p_opname",\
@@ -236,6 +370,51 @@ struct export_stats {
 }
 
 
+/**
+ * @brief A binary snapshot of the stats of many exports or clients
+ *
+ * Built with the export or client table locked, which only copies the
+ * counters, and sent as one byte array once it is unlocked.  All in
+ * host byte order, which the magic tells:
+ *
+ *   magic (u32), version (u16), kind (u16), time (u64 seconds,
+ *   u64 nanoseconds), count of records (u32)
+ *
+ * then for each record, its owner:
+ *
+ *   export: id (u16)
+ *   client: address length (u8), address (4 or 16 bytes), last
+ *           update (u64 nanoseconds since server start)
+ *
+ * a mask (u8) of the NFSv3, v4.0, v4.1 and v4.2 stats present, from
+ * bit 0, and for each present the ops (total, errors), then read and
+ * write (requested, transferred, total, errors, latency, queue wait),
+ * all u64.
+ */
+struct stats_snapshot {
+	char *buf;
+	size_t len;
+	size_t size;
+	uint32_t count;
+};
+
+#define STATS_SNAPSHOT_MAGIC 0x47535350	/* "GSSP" */
+#define STATS_SNAPSHOT_VERSION 1
+
+enum stats_snapshot_kind {
+	STATS_SNAPSHOT_EXPORTS = 1,
+	STATS_SNAPSHOT_CLIENTS = 2
+};
+
+void server_stats_snapshot_init(struct stats_snapshot *snap,
+				enum stats_snapshot_kind kind);
+void server_stats_snapshot_export(struct stats_snapshot *snap,
+				  struct export_stats *export_st);
+void server_stats_snapshot_client(struct stats_snapshot *snap,
+				  struct server_stats *client_st);
+void server_stats_snapshot_reply(struct stats_snapshot *snap,
+				 DBusMessageIter *iter);
+
 void server_stats_summary(DBusMessageIter *iter, struct gsh_stats *st);
 void server_dbus_v3_iostats(struct nfsv3_stats *v3p, DBusMessageIter *iter);
 void server_dbus_v40_iostats(struct nfsv40_stats *v40p, DBusMessageIter *iter);
@@ -250,6 +429,8 @@ void server_dbus_total_ops(struct export_stats *export_st,
 			   DBusMessageIter *iter);
 void global_dbus_total_ops(DBusMessageIter *iter);
 void server_dbus_fast_ops(DBusMessageIter *iter);
+void server_dbus_latency_hist(DBusMessageIter *iter);
+void server_dbus_alloc_stats(DBusMessageIter *iter);
 void mdcache_dbus_show(DBusMessageIter *iter);
 
 #ifdef _USE_9P
@@ -81,5 +81,8 @@ void uid2grp_unref(struct group_data *gdata);
 void uid2grp_hold_group_data(struct group_data *);
 void uid2grp_release_group_data(struct group_data *);
 
+int uid2grp_preload_init(void);
+int uid2grp_preload_shutdown(void);
+
 #endif				/* UID2GRP_H */
 /** @} */
@@ -30,14 +30,25 @@
  *
  * @section DESCRIPTION
  *
- * This module provides simple wait queues using pthreads primitives.
+ * This module provides simple wait queues using pthreads primitives,
+ * and a parking word with which one thread can wait for a wakeup from
+ * another without either taking a lock.  The parking word is a futex
+ * on Linux and a mutex and condition variable elsewhere.
  */
 
 #ifndef WAIT_QUEUE_H
 #define WAIT_QUEUE_H
 
 #include <errno.h>
+#include <limits.h>
 #include <pthread.h>
+#include <time.h>
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+#include "abstract_atomic.h"
 #include "gsh_list.h"
 
 typedef struct wait_entry {
@@ -45,16 +56,28 @@ typedef struct wait_entry {
 	pthread_cond_t cv;
 } wait_entry_t;
 
-#define Wqe_LFlag_None        0x0000
-#define Wqe_LFlag_WaitSync    0x0001
-#define Wqe_LFlag_SyncDone    0x0002
+#define WAIT_PARK_IDLE      0	/* nobody waiting, no wakeup pending */
+#define WAIT_PARK_WAITING   1	/* the owner is (about to be) asleep */
+#define WAIT_PARK_NOTIFIED  2	/* a wakeup is pending */
+
+/**
+ * @brief A parking word for one waiting thread
+ *
+ * Only its owner waits on it; any thread may notify it.  A notify
+ * before the wait is not lost, the wait returns at once.
+ */
+struct wait_park {
+	uint32_t state;
+#if !defined(__linux__)
+	pthread_mutex_t mtx;
+	pthread_cond_t cv;
+#endif
+};
 
 /* thread wait queue */
 typedef struct wait_q_entry {
-	uint32_t flags;
 	uint32_t waiters;
-	wait_entry_t lwe;	/* left */
-	wait_entry_t rwe;	/* right */
+	struct wait_park park;
 	struct glist_head waitq;
 } wait_q_entry_t;
 
@@ -81,11 +104,134 @@ static inline void init_wait_entry(wait_entry_t *we)
 	pthread_cond_init(&we->cv, NULL);
 }
 
+static inline void init_wait_park(struct wait_park *wp)
+{
+	wp->state = WAIT_PARK_IDLE;
+#if !defined(__linux__)
+	gsh_mutex_init(&wp->mtx, NULL);
+	pthread_cond_init(&wp->cv, NULL);
+#endif
+}
+
 static inline void init_wait_q_entry(wait_q_entry_t *wqe)
 {
 	glist_init(&wqe->waitq);
-	init_wait_entry(&wqe->lwe);
-	init_wait_entry(&wqe->rwe);
+	init_wait_park(&wqe->park);
+}
+
+/**
+ * @brief Forget any wakeup pending on a parking word
+ *
+ * Called by the owner before it makes itself visible to notifiers.
+ */
+static inline void wait_park_reset(struct wait_park *wp)
+{
+	atomic_store_uint32_t(&wp->state, WAIT_PARK_IDLE);
+}
+
+/**
+ * @brief Set the state of a parking word, returning the old one
+ */
+static inline uint32_t wait_park_xchg(struct wait_park *wp, uint32_t state)
+{
+	uint32_t old = atomic_fetch_uint32_t(&wp->state);
+
+	while (!atomic_cas_uint32_t(&wp->state, old, state))
+		old = atomic_fetch_uint32_t(&wp->state);
+	return old;
+}
+
+/**
+ * @brief Wake the owner of a parking word
+ *
+ * Takes no lock, and only enters the kernel when the owner is
+ * actually asleep.
+ */
+static inline void wait_park_notify(struct wait_park *wp)
+{
+	if (wait_park_xchg(wp, WAIT_PARK_NOTIFIED) != WAIT_PARK_WAITING)
+		return;
+#if defined(__linux__)
+	(void) syscall(SYS_futex, &wp->state, FUTEX_WAKE_PRIVATE, 1,
+		       NULL, NULL, 0);
+#else
+	pthread_mutex_lock(&wp->mtx);
+	pthread_cond_signal(&wp->cv);
+	pthread_mutex_unlock(&wp->mtx);
+#endif
+}
+
+/**
+ * @brief Rouse the owner of a parking word without notifying it
+ *
+ * The owner's wait returns EAGAIN, so that it can look at why it is
+ * waiting.  A kick that races with the owner going to sleep may be
+ * missed, the owner should wait with a timeout.
+ */
+static inline void wait_park_kick(struct wait_park *wp)
+{
+#if defined(__linux__)
+	(void) syscall(SYS_futex, &wp->state, FUTEX_WAKE_PRIVATE, INT_MAX,
+		       NULL, NULL, 0);
+#else
+	pthread_mutex_lock(&wp->mtx);
+	pthread_cond_broadcast(&wp->cv);
+	pthread_mutex_unlock(&wp->mtx);
+#endif
+}
+
+/**
+ * @brief Wait on a parking word until it is notified
+ *
+ * Polls the word spin times before sleeping, so that a wakeup coming
+ * soon is taken without a system call on either side.  The pending
+ * wakeup, if any, is consumed.
+ *
+ * @param[in] wp       Parking word, owned by the caller
+ * @param[in] spin     Times to poll before sleeping
+ * @param[in] abstime  CLOCK_REALTIME deadline
+ *
+ * @retval 0          Notified
+ * @retval ETIMEDOUT  The deadline passed
+ * @retval EAGAIN     Kicked, or woken spuriously
+ */
+static inline int wait_park_wait(struct wait_park *wp, uint32_t spin,
+				 const struct timespec *abstime)
+{
+	int rc = EAGAIN;
+
+	for (; spin > 0; --spin) {
+		if (atomic_fetch_uint32_t(&wp->state) == WAIT_PARK_NOTIFIED)
+			goto out;
+#if defined(__x86_64__) || defined(__i386__)
+		__builtin_ia32_pause();
+#endif
+	}
+
+	if (!atomic_cas_uint32_t(&wp->state, WAIT_PARK_IDLE,
+				 WAIT_PARK_WAITING))
+		goto out;	/* notified meanwhile */
+
+#if defined(__linux__)
+	if (syscall(SYS_futex, &wp->state,
+		    FUTEX_WAIT_BITSET_PRIVATE | FUTEX_CLOCK_REALTIME,
+		    WAIT_PARK_WAITING, abstime, NULL,
+		    FUTEX_BITSET_MATCH_ANY) != 0 && errno == ETIMEDOUT)
+		rc = ETIMEDOUT;
+#else
+	pthread_mutex_lock(&wp->mtx);
+	if (atomic_fetch_uint32_t(&wp->state) == WAIT_PARK_WAITING)
+		rc = pthread_cond_timedwait(&wp->cv, &wp->mtx, abstime);
+	pthread_mutex_unlock(&wp->mtx);
+	if (rc != ETIMEDOUT)
+		rc = EAGAIN;
+#endif
+
+ out:
+	/* take the wakeup, or stop advertising that we sleep */
+	if (wait_park_xchg(wp, WAIT_PARK_IDLE) == WAIT_PARK_NOTIFIED)
+		rc = 0;
+	return rc;
 }
 
 static inline void thread_delay_ms(time_t ms)
@@ -0,0 +1,484 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file log_async.c
+ * @brief Buffered writes of log files
+ *
+ * With LOG { Async = true; } a thread logging to a file copies the
+ * message into a ring of its own instead of opening the file, writing
+ * it with O_SYNC and closing it again.  One writer thread drains the
+ * rings, keeps the files open and hands each run of messages for the
+ * same file to a single writev().  Messages of different threads may
+ * so land in the file a little out of order; their timestamps are not.
+ *
+ * A message that does not fit in its thread's ring is dropped and
+ * counted, and the writer notes how many were lost in the file.
+ *
+ * The writer reopens a file when its path no longer names the file it
+ * has open, as logrotate leaves it, and all of them when the LOG block
+ * is reloaded on SIGHUP.
+ *
+ * Nothing here may log: the locks are taken with the plain pthread
+ * calls, and the writer reports its own errors on stderr.
+ */
+
+#include "config.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <string.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "log.h"
+#include "gsh_list.h"
+#include "abstract_mem.h"
+#include "abstract_atomic.h"
+
+/** Bytes of a thread's ring, a power of two */
+#define LOG_RING_SIZE (64 * 1024)
+
+/** Open log files the writer keeps */
+#define LOG_ASYNC_FILES 8
+
+/** Messages handed to one writev() */
+#define LOG_ASYNC_IOV 64
+
+/** Milliseconds the writer sleeps when the rings are empty */
+#define LOG_ASYNC_POLL_MS 10
+
+/**
+ * @brief A message in a ring
+ *
+ * The path follows the header, then the message.  A record with no
+ * path skips the end of the ring.
+ */
+struct log_record {
+	uint32_t len;		/*< Bytes of the record, 8 aligned */
+	uint16_t path_len;	/*< Length of the path */
+	uint16_t msg_len;	/*< Length of the message */
+};
+
+#define LOG_RECORD_LEN(path_len, msg_len) \
+	((sizeof(struct log_record) + (path_len) + (msg_len) + 7) & ~7)
+
+/**
+ * @brief Messages of one thread
+ *
+ * Only the thread moves head and only the writer moves tail, so
+ * neither takes a lock.
+ */
+struct log_ring {
+	struct glist_head list;	/*< In log_rings */
+	uint64_t head;		/*< End of what the thread queued */
+	uint64_t tail;		/*< End of what the writer wrote */
+	uint64_t dropped;	/*< Messages that did not fit */
+	uint64_t reported;	/*< Drops the writer noted */
+	uint32_t dead;		/*< The thread exited */
+	char data[LOG_RING_SIZE];
+};
+
+/**
+ * @brief A log file the writer has open
+ */
+struct log_file {
+	char *path;
+	int fd;
+	dev_t dev;
+	ino_t ino;
+	time_t checked;		/*< When the path was last checked */
+	time_t used;		/*< When the file was last written */
+};
+
+static pthread_mutex_t log_ring_mtx = PTHREAD_MUTEX_INITIALIZER;
+static struct glist_head log_rings = GLIST_HEAD_INIT(log_rings);
+static pthread_key_t log_ring_key;
+static pthread_once_t log_ring_once = PTHREAD_ONCE_INIT;
+static __thread struct log_ring *log_ring;
+
+static pthread_t log_writer;
+static uint32_t log_async_running;
+static uint32_t log_async_stopping;
+static uint32_t log_async_reopening;
+
+static struct log_file log_files[LOG_ASYNC_FILES];
+
+static void log_ring_exit(void *arg)
+{
+	struct log_ring *ring = arg;
+
+	atomic_store_uint32_t(&ring->dead, 1);
+}
+
+static void log_ring_key_init(void)
+{
+	(void)pthread_key_create(&log_ring_key, log_ring_exit);
+}
+
+static struct log_ring *log_ring_get(void)
+{
+	struct log_ring *ring = log_ring;
+
+	if (likely(ring != NULL))
+		return ring;
+
+	ring = gsh_calloc(1, sizeof(*ring));
+
+	pthread_mutex_lock(&log_ring_mtx);
+	glist_add_tail(&log_rings, &ring->list);
+	pthread_mutex_unlock(&log_ring_mtx);
+
+	(void)pthread_setspecific(log_ring_key, ring);
+	log_ring = ring;
+
+	return ring;
+}
+
+/**
+ * @brief Queue a message for a log file
+ *
+ * @param[in] path Path of the file
+ * @param[in] msg  The message, with its newline
+ * @param[in] len  Length of the message
+ *
+ * @retval true if the message was queued or dropped.
+ * @retval false if it must be written by the caller.
+ */
+
+bool log_async_write(const char *path, const char *msg, size_t len)
+{
+	struct log_ring *ring;
+	struct log_record *rec;
+	size_t path_len = strlen(path);
+	uint64_t head, tail, need, off;
+
+	if (!atomic_fetch_uint32_t(&log_async_running) ||
+	    path_len > UINT16_MAX || len > UINT16_MAX)
+		return false;
+
+	ring = log_ring_get();
+	need = LOG_RECORD_LEN(path_len, len);
+	head = ring->head;
+	tail = atomic_fetch_uint64_t(&ring->tail);
+	off = head & (LOG_RING_SIZE - 1);
+
+	if (LOG_RING_SIZE - off < need) {
+		/* Skip to the start of the ring */
+		if (head + (LOG_RING_SIZE - off) + need - tail >
+		    LOG_RING_SIZE)
+			goto drop;
+
+		rec = (struct log_record *)(ring->data + off);
+		rec->len = LOG_RING_SIZE - off;
+		rec->path_len = 0;
+		rec->msg_len = 0;
+		head += LOG_RING_SIZE - off;
+		off = 0;
+	} else if (head + need - tail > LOG_RING_SIZE) {
+		goto drop;
+	}
+
+	rec = (struct log_record *)(ring->data + off);
+	rec->len = need;
+	rec->path_len = path_len;
+	rec->msg_len = len;
+	memcpy(rec + 1, path, path_len);
+	memcpy((char *)(rec + 1) + path_len, msg, len);
+
+	atomic_store_uint64_t(&ring->head, head + need);
+	return true;
+
+drop:
+	/* Publish a skip record written above, if any */
+	atomic_store_uint64_t(&ring->head, head);
+	(void)atomic_inc_uint64_t(&ring->dropped);
+	return true;
+}
+
+static void log_file_close(struct log_file *file)
+{
+	(void)close(file->fd);
+	gsh_free(file->path);
+	file->path = NULL;
+}
+
+static bool log_file_open(struct log_file *file, const char *path,
+			  size_t path_len, time_t now)
+{
+	struct stat st;
+
+	file->path = gsh_malloc(path_len + 1);
+	memcpy(file->path, path, path_len);
+	file->path[path_len] = '\0';
+
+	file->fd = open(file->path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC,
+			S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+	if (file->fd < 0 || fstat(file->fd, &st) != 0) {
+		fprintf(stderr, "Error: couldn't open the log file %s (%s)\n",
+			file->path, strerror(errno));
+		if (file->fd >= 0)
+			(void)close(file->fd);
+		gsh_free(file->path);
+		file->path = NULL;
+		return false;
+	}
+
+	file->dev = st.st_dev;
+	file->ino = st.st_ino;
+	file->checked = now;
+	file->used = now;
+	return true;
+}
+
+/**
+ * @brief Find the open file for a path, opening it if need be
+ *
+ * A file whose path was renamed or removed is reopened.
+ */
+
+static struct log_file *log_file_get(const char *path, size_t path_len,
+				     time_t now)
+{
+	struct log_file *file, *lru = &log_files[0];
+	struct stat st;
+	int ix;
+
+	for (ix = 0; ix < LOG_ASYNC_FILES; ix++) {
+		file = &log_files[ix];
+		if (file->path == NULL) {
+			lru = file;
+			continue;
+		}
+		if (strncmp(file->path, path, path_len) != 0 ||
+		    file->path[path_len] != '\0') {
+			if (lru->path != NULL && file->used < lru->used)
+				lru = file;
+			continue;
+		}
+
+		if (file->checked != now) {
+			file->checked = now;
+			if (stat(file->path, &st) != 0 ||
+			    st.st_dev != file->dev || st.st_ino != file->ino) {
+				log_file_close(file);
+				return log_file_open(file, path, path_len, now)
+					? file : NULL;
+			}
+		}
+
+		file->used = now;
+		return file;
+	}
+
+	if (lru->path != NULL)
+		log_file_close(lru);
+
+	return log_file_open(lru, path, path_len, now) ? lru : NULL;
+}
+
+static void log_file_writev(struct log_file *file, struct iovec *iov,
+			    int iovcnt)
+{
+	ssize_t rc;
+	int ix;
+
+	if (iovcnt == 0)
+		return;
+
+	if (file == NULL) {
+		/* Could not open it, the messages go to stderr */
+		for (ix = 0; ix < iovcnt; ix++)
+			fwrite(iov[ix].iov_base, iov[ix].iov_len, 1, stderr);
+		return;
+	}
+
+	rc = writev(file->fd, iov, iovcnt);
+	if (rc < 0)
+		fprintf(stderr,
+			"Error: couldn't complete write to the log file %s (%s)\n",
+			file->path, strerror(errno));
+}
+
+/**
+ * @brief Write out what a ring holds
+ *
+ * @return Whether there was anything.
+ */
+
+static bool log_ring_drain(struct log_ring *ring, time_t now)
+{
+	struct iovec iov[LOG_ASYNC_IOV];
+	char note[64];
+	struct log_file *file = NULL;
+	const char *path = NULL;
+	struct log_record *rec;
+	uint64_t head, tail, dropped;
+	uint16_t path_len = 0;
+	int iovcnt = 0;
+
+	head = atomic_fetch_uint64_t(&ring->head);
+	tail = ring->tail;
+	dropped = atomic_fetch_uint64_t(&ring->dropped);
+
+	if (head == tail)
+		return false;
+
+	while (tail != head) {
+		rec = (struct log_record *)(ring->data +
+					    (tail & (LOG_RING_SIZE - 1)));
+		tail += rec->len;
+		if (rec->path_len == 0)
+			continue;
+
+		if (path == NULL || rec->path_len != path_len ||
+		    memcmp(rec + 1, path, path_len) != 0 ||
+		    iovcnt == LOG_ASYNC_IOV - 1) {
+			log_file_writev(file, iov, iovcnt);
+			iovcnt = 0;
+			path = (const char *)(rec + 1);
+			path_len = rec->path_len;
+			file = log_file_get(path, path_len, now);
+		}
+
+		if (dropped != ring->reported) {
+			/* Note the drops where the messages would have been */
+			iov[iovcnt].iov_base = note;
+			iov[iovcnt].iov_len =
+				snprintf(note, sizeof(note),
+					 "%" PRIu64 " log messages dropped\n",
+					 dropped - ring->reported);
+			iovcnt++;
+			ring->reported = dropped;
+		}
+
+		iov[iovcnt].iov_base = (char *)(rec + 1) + rec->path_len;
+		iov[iovcnt].iov_len = rec->msg_len;
+		iovcnt++;
+	}
+
+	log_file_writev(file, iov, iovcnt);
+
+	/* The thread may reuse the space now */
+	atomic_store_uint64_t(&ring->tail, tail);
+	return true;
+}
+
+static void *log_writer_thread(void *arg)
+{
+	struct glist_head *glist, *glistn;
+	struct timespec nap = {
+		.tv_sec = 0,
+		.tv_nsec = LOG_ASYNC_POLL_MS * 1000000
+	};
+	struct log_ring *ring;
+	bool busy, stopping = false;
+	time_t now;
+	int ix;
+
+	while (!stopping) {
+		stopping = atomic_fetch_uint32_t(&log_async_stopping);
+		now = time(NULL);
+		busy = false;
+
+		if (atomic_fetch_uint32_t(&log_async_reopening)) {
+			atomic_store_uint32_t(&log_async_reopening, 0);
+			for (ix = 0; ix < LOG_ASYNC_FILES; ix++)
+				if (log_files[ix].path != NULL)
+					log_file_close(&log_files[ix]);
+		}
+
+		pthread_mutex_lock(&log_ring_mtx);
+		glist_for_each_safe(glist, glistn, &log_rings) {
+			ring = glist_entry(glist, struct log_ring, list);
+
+			if (log_ring_drain(ring, now))
+				busy = true;
+			else if (atomic_fetch_uint32_t(&ring->dead)) {
+				glist_del(&ring->list);
+				gsh_free(ring);
+			}
+		}
+		pthread_mutex_unlock(&log_ring_mtx);
+
+		if (!busy && !stopping)
+			nanosleep(&nap, NULL);
+	}
+
+	for (ix = 0; ix < LOG_ASYNC_FILES; ix++)
+		if (log_files[ix].path != NULL)
+			log_file_close(&log_files[ix]);
+
+	return NULL;
+}
+
+/**
+ * @brief Start writing log files asynchronously
+ *
+ * @return 0 or an error from pthread_create.
+ */
+
+int log_async_start(void)
+{
+	int rc;
+
+	if (atomic_fetch_uint32_t(&log_async_running))
+		return 0;
+
+	(void)pthread_once(&log_ring_once, log_ring_key_init);
+
+	atomic_store_uint32_t(&log_async_stopping, 0);
+	rc = pthread_create(&log_writer, NULL, log_writer_thread, NULL);
+	if (rc != 0)
+		return rc;
+
+	atomic_store_uint32_t(&log_async_running, 1);
+	return 0;
+}
+
+/**
+ * @brief Write out everything queued and go back to synchronous writes
+ */
+
+void log_async_stop(void)
+{
+	if (!atomic_fetch_uint32_t(&log_async_running))
+		return;
+
+	atomic_store_uint32_t(&log_async_running, 0);
+	atomic_store_uint32_t(&log_async_stopping, 1);
+	(void)pthread_join(log_writer, NULL);
+}
+
+/**
+ * @brief Have the writer reopen its files
+ */
+
+void log_async_reopen(void)
+{
+	atomic_store_uint32_t(&log_async_reopening, 1);
+}
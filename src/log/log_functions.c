@@ -308,6 +308,7 @@ void Cleanup(void)
 
 void Fatal(void)
 {
+	log_async_stop();
 	Cleanup();
 	exit(2);
 }
@@ -1207,6 +1208,11 @@ static int log_to_file(log_header_t headers, void *private,
 	buffer->b_start[len] = '\n';
 	buffer->b_start[len + 1] = '\0';
 
+	/* A fatal message is written before the process exits */
+	if (level != NIV_FATAL &&
+	    log_async_write(path, buffer->b_start, len + 1))
+		goto out;
+
 	fd = open(path, O_WRONLY | O_SYNC | O_APPEND | O_CREAT, log_mask);
 
 	if (fd != -1) {
@@ -1913,6 +1919,7 @@ struct logger_config {
 	struct glist_head facility_list;
 	struct logfields *logfields;
 	log_levels_t *comp_log_level;
+	bool async;		/*< Buffer file writes in a writer thread */
 };
 
 /**
@@ -2546,6 +2553,17 @@ static int log_conf_commit(void *node, void *link_mem, void *self_struct,
 		if (logger->comp_log_level != NULL)
 			gsh_free(logger->comp_log_level);
 	}
+	if (logger->async) {
+		rc = log_async_start();
+		if (rc != 0)
+			LogCrit(COMPONENT_CONFIG,
+				"Could not start the log writer because (%s)",
+				strerror(rc));
+		/* Files renamed since are reopened on reload */
+		log_async_reopen();
+	} else {
+		log_async_stop();
+	}
 	logger->logfields = NULL;
 	logger->comp_log_level = NULL;
 	return errcnt;
@@ -2563,6 +2581,8 @@ static struct config_item logging_params[] = {
 	CONF_ITEM_BLOCK("Components", component_levels,
 			component_init, component_commit,
 			logger_config, comp_log_level),
+	CONF_ITEM_BOOL("Async", false,
+		       logger_config, async),
 	CONFIG_EOL
 };
 
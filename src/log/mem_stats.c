@@ -0,0 +1,307 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file mem_stats.c
+ * @brief Memory statistics per pool and per subsystem
+ *
+ * Each thread has a table of counters, written only by the thread and
+ * read unlocked when the tables are summed.  The table of an exited
+ * thread is given to the next new thread, so its counts are kept and
+ * the tables do not grow with thread churn.
+ *
+ * This lives with LogMallocFailure in the log library, as everything
+ * using abstract_mem.h links it.  Nothing in here may allocate with
+ * gsh_malloc, which counts into these tables.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "abstract_mem.h"
+#include "abstract_atomic.h"
+
+struct mem_stats_thread {
+	struct mem_stats_thread *next;		/*< All tables */
+	struct mem_stats_thread *next_free;	/*< Tables of exited threads */
+	struct mem_counter counters[MEM_STATS_SLOTS];
+};
+
+struct mem_stats_pool {
+	char *name;
+	size_t object_size;
+};
+
+static const char * const mem_tag_names[MEM_TAG_COUNT] = {
+	[MEM_TAG_OTHER] = "other",
+	[MEM_TAG_MAIN] = "main",
+	[MEM_TAG_CONFIG] = "config",
+	[MEM_TAG_HASHTABLE] = "hashtable",
+	[MEM_TAG_SUPPORT] = "support",
+	[MEM_TAG_SAL] = "sal",
+	[MEM_TAG_RPCAL] = "rpcal",
+	[MEM_TAG_PROTOCOLS] = "protocols",
+	[MEM_TAG_FSAL] = "fsal",
+	[MEM_TAG_MDCACHE] = "mdcache",
+	[MEM_TAG_IDMAPPER] = "idmapper",
+	[MEM_TAG_NTIRPC] = "ntirpc",
+};
+
+static struct mem_stats_pool mem_stats_pools[MEM_STATS_SLOTS] = {
+	[MEM_STATS_OTHER_POOLS] = { .name = "(other pools)" },
+};
+static uint32_t mem_stats_npools = MEM_TAG_COUNT;
+
+static pthread_mutex_t mem_stats_mtx = PTHREAD_MUTEX_INITIALIZER;
+static struct mem_stats_thread *mem_stats_threads;
+static struct mem_stats_thread *mem_stats_free;
+static pthread_key_t mem_stats_key;
+static pthread_once_t mem_stats_once = PTHREAD_ONCE_INIT;
+
+__thread struct mem_counter *mem_counters;
+
+/** Give the table of an exiting thread to the next thread */
+static void mem_stats_thread_exit(void *arg)
+{
+	struct mem_stats_thread *self = arg;
+
+	/* Anything freed after this gets the thread a table again */
+	mem_counters = NULL;
+
+	pthread_mutex_lock(&mem_stats_mtx);
+	self->next_free = mem_stats_free;
+	mem_stats_free = self;
+	pthread_mutex_unlock(&mem_stats_mtx);
+}
+
+static void mem_stats_key_init(void)
+{
+	(void)pthread_key_create(&mem_stats_key, mem_stats_thread_exit);
+}
+
+/**
+ * @brief Get this thread a table of counters
+ *
+ * @return The counters.
+ */
+struct mem_counter *mem_stats_thread(void)
+{
+	struct mem_stats_thread *self;
+
+	(void)pthread_once(&mem_stats_once, mem_stats_key_init);
+
+	pthread_mutex_lock(&mem_stats_mtx);
+	self = mem_stats_free;
+	if (self != NULL) {
+		mem_stats_free = self->next_free;
+	} else {
+		self = calloc(1, sizeof(*self));
+		if (self == NULL) {
+			LogMallocFailure(__FILE__, __LINE__, __func__,
+					 "mem_stats_thread");
+			abort();
+		}
+		self->next = mem_stats_threads;
+		atomic_store_voidptr((void **)&mem_stats_threads, self);
+	}
+	pthread_mutex_unlock(&mem_stats_mtx);
+
+	(void)pthread_setspecific(mem_stats_key, self);
+	mem_counters = self->counters;
+	return self->counters;
+}
+
+/**
+ * @brief Find or make the slot of a pool
+ *
+ * Pools of the same name share a slot.  Slots are never reused, so the
+ * counts of destroyed pools stay with their name.
+ *
+ * @param[in] name        Name of the pool, may be NULL
+ * @param[in] object_size Size of its objects
+ *
+ * @return The slot.
+ */
+uint32_t mem_stats_pool_slot(const char *name, size_t object_size)
+{
+	struct mem_stats_pool *pool;
+	uint32_t slot;
+
+	if (name == NULL)
+		name = "(unnamed)";
+
+	pthread_mutex_lock(&mem_stats_mtx);
+
+	for (slot = MEM_TAG_COUNT; slot < mem_stats_npools; slot++) {
+		pool = &mem_stats_pools[slot];
+		if (strcmp(pool->name, name) == 0) {
+			if (pool->object_size != object_size)
+				pool->object_size = 0;
+			goto out;
+		}
+	}
+
+	slot = MEM_STATS_OTHER_POOLS;
+	if (mem_stats_npools < MEM_STATS_OTHER_POOLS) {
+		pool = &mem_stats_pools[mem_stats_npools];
+		pool->name = strdup(name);
+		if (pool->name == NULL) {
+			LogMallocFailure(__FILE__, __LINE__, __func__,
+					 "mem_stats_pool_slot");
+			abort();
+		}
+		pool->object_size = object_size;
+		slot = mem_stats_npools;
+		atomic_store_uint32_t(&mem_stats_npools, slot + 1);
+	}
+
+ out:
+	pthread_mutex_unlock(&mem_stats_mtx);
+	return slot;
+}
+
+#ifdef USE_MEM_ACCOUNTING
+/**
+ * @brief Resize a block of the general allocator
+ *
+ * A block keeps its tag; an aligned one loses its alignment, as
+ * realloc would not keep it either.
+ *
+ * @param[in] p   Block to resize, may be NULL or not from gsh_malloc
+ * @param[in] n   New size
+ * @param[in] tag Subsystem to count a new block against
+ *
+ * @return The resized block, NULL if it was freed or on failure.
+ */
+void *mem_acct_realloc(void *p, size_t n, unsigned int tag)
+{
+	struct mem_acct_hdr *hdr;
+	struct mem_counter *counter;
+	void *base, *p2;
+	size_t size;
+
+	if (p == NULL) {
+		base = malloc(MEM_ACCT_HDR + n);
+		return base != NULL ? mem_acct_set(base, MEM_ACCT_HDR, n, tag)
+				    : NULL;
+	}
+
+	hdr = mem_acct_get(p);
+	if (hdr == NULL)
+		return realloc(p, n);
+
+	if (n == 0) {
+		gsh_free(p);
+		return NULL;
+	}
+
+	tag = hdr->tag;
+	size = hdr->size;
+
+	if (hdr->offset != MEM_ACCT_HDR) {
+		base = malloc(MEM_ACCT_HDR + n);
+		if (base == NULL)
+			return NULL;
+		p2 = mem_acct_set(base, MEM_ACCT_HDR, n, tag);
+		memcpy(p2, p, size < n ? size : n);
+		gsh_free(p);
+		return p2;
+	}
+
+	base = realloc(hdr, MEM_ACCT_HDR + n);
+	if (base == NULL)
+		return NULL;
+
+	counter = mem_counter(tag);
+	counter->frees++;
+	counter->bytes -= size;
+	return mem_acct_set(base, MEM_ACCT_HDR, n, tag);
+}
+#endif				/* USE_MEM_ACCOUNTING */
+
+static int mem_stats_cmp(const void *a, const void *b)
+{
+	const struct mem_stats_report *ra = a, *rb = b;
+
+	if (ra->count.bytes != rb->count.bytes)
+		return ra->count.bytes < rb->count.bytes ? 1 : -1;
+	return 0;
+}
+
+/**
+ * @brief Sum the counters of all threads
+ *
+ * The counters are read while the threads update them, so a report
+ * may be slightly off.  Subsystems are reported only in a
+ * USE_MEM_ACCOUNTING build.
+ *
+ * @param[out] reports Pools and subsystems used at all, most bytes
+ *                     first, to be freed with gsh_free
+ *
+ * @return Number of reports.
+ */
+uint32_t mem_stats_collect(struct mem_stats_report **reports)
+{
+	uint32_t npools = atomic_fetch_uint32_t(&mem_stats_npools);
+	struct mem_stats_report *rep;
+	struct mem_stats_thread *thr;
+	struct mem_counter *dst, *src;
+	uint32_t slot, n = 0;
+
+	rep = gsh_calloc(MEM_STATS_SLOTS, sizeof(*rep));
+
+	for (thr = atomic_fetch_voidptr((void **)&mem_stats_threads);
+	     thr != NULL;
+	     thr = thr->next) {
+		for (slot = 0; slot < MEM_STATS_SLOTS; slot++) {
+			src = &thr->counters[slot];
+			dst = &rep[slot].count;
+			dst->allocs += src->allocs;
+			dst->frees += src->frees;
+			dst->bytes += src->bytes;
+		}
+	}
+
+	for (slot = 0; slot < MEM_STATS_SLOTS; slot++) {
+		if (rep[slot].count.allocs == 0)
+			continue;
+		if (slot < MEM_TAG_COUNT) {
+#ifndef USE_MEM_ACCOUNTING
+			continue;
+#endif
+			rep[slot].name = mem_tag_names[slot];
+		} else if (slot < npools || slot == MEM_STATS_OTHER_POOLS) {
+			rep[slot].name = mem_stats_pools[slot].name;
+			rep[slot].object_size =
+				mem_stats_pools[slot].object_size;
+			rep[slot].pool = true;
+		} else {
+			continue;
+		}
+		rep[n++] = rep[slot];
+	}
+
+	qsort(rep, n, sizeof(*rep), mem_stats_cmp);
+	*reports = rep;
+	return n;
+}
@@ -36,6 +36,12 @@ Requires: sles-release >= 12
 @BCOND_NULLFS@ nullfs
 %global use_fsal_null %{on_off_switch nullfs}
 
+@BCOND_TRACEFS@ tracefs
+%global use_fsal_trace %{on_off_switch tracefs}
+
+@BCOND_DATACACHEFS@ datacachefs
+%global use_fsal_datacache %{on_off_switch datacachefs}
+
 @BCOND_GPFS@ gpfs
 %global use_fsal_gpfs %{on_off_switch gpfs}
 
@@ -228,6 +234,32 @@ This package contains a Stackable FSAL shared object to
 be used with NFS-Ganesha. This is mostly a template for future (more sophisticated) stackable FSALs
 %endif
 
+# TRACE
+%if %{with tracefs}
+%package tracefs
+Summary: The NFS-GANESHA's TRACE Stackable FSAL
+Group: Applications/System
+Requires: nfs-ganesha = %{version}-%{release}
+
+%description tracefs
+This package contains a Stackable FSAL shared object to
+be used with NFS-Ganesha. It times the calls made to the FSAL below it
+and reports their latencies to the log.
+%endif
+
+# DATACACHE
+%if %{with datacachefs}
+%package datacachefs
+Summary: The NFS-GANESHA's DATACACHE Stackable FSAL
+Group: Applications/System
+Requires: nfs-ganesha = %{version}-%{release}
+
+%description datacachefs
+This package contains a Stackable FSAL shared object to
+be used with NFS-Ganesha. It caches the blocks read from the files
+of the FSAL below it in memory.
+%endif
+
 # GPFS
 %if %{with gpfs}
 %package gpfs
@@ -325,6 +357,8 @@ be used with NFS-Ganesha to support Gluster
 cmake .	-DCMAKE_BUILD_TYPE=Debug			\
 	-DBUILD_CONFIG=rpmbuild				\
 	-DUSE_FSAL_NULL=%{use_fsal_null}		\
+	-DUSE_FSAL_TRACE=%{use_fsal_trace}		\
+	-DUSE_FSAL_DATACACHE=%{use_fsal_datacache}	\
 	-DUSE_FSAL_ZFS=%{use_fsal_zfs}			\
 	-DUSE_FSAL_XFS=%{use_fsal_xfs}			\
 	-DUSE_FSAL_CEPH=%{use_fsal_ceph}		\
@@ -494,6 +528,18 @@ killall -SIGHUP dbus-daemon 2>&1 > /dev/null
 %{_libdir}/ganesha/libfsalnull*
 %endif
 
+%if %{with tracefs}
+%files tracefs
+%defattr(-,root,root,-)
+%{_libdir}/ganesha/libfsaltrace*
+%endif
+
+%if %{with datacachefs}
+%files datacachefs
+%defattr(-,root,root,-)
+%{_libdir}/ganesha/libfsaldatacache*
+%endif
+
 %if %{with gpfs}
 %files gpfs
 %defattr(-,root,root,-)
@@ -30,6 +30,8 @@
 
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <os/subr.h>
 #include <dirent.h>
 #include <sys/syscall.h>
@@ -151,3 +153,36 @@ int set_threadgroups(size_t size, const gid_t *list)
 {
 	return syscall(SYS_setgroups, size, list);
 }
+
+ssize_t vfs_copy_file_range(int src_fd, off_t src_offset, int dst_fd,
+			    off_t dst_offset, size_t count)
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+int vfs_clone_range(int src_fd, off_t src_offset, int dst_fd,
+		    off_t dst_offset, size_t count)
+{
+	errno = EOPNOTSUPP;
+	return -1;
+}
+
+int vfs_fallocate_range(int fd, off_t offset, off_t length, bool punch_hole)
+{
+	int rc;
+
+	if (punch_hole) {
+		errno = EOPNOTSUPP;
+		return -1;
+	}
+
+	/* posix_fallocate returns the error rather than setting errno */
+	rc = posix_fallocate(fd, offset, length);
+	if (rc != 0) {
+		errno = rc;
+		return -1;
+	}
+
+	return 0;
+}
@@ -30,10 +30,24 @@
 #include <stddef.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/falloc.h>
 #include <sys/fsuid.h>
+#include <sys/ioctl.h>
 #include <sys/syscall.h>
 #include "os/subr.h"
 
+/* FICLONERANGE from linux/fs.h, which does not mix with glibc's headers */
+struct vfs_clone_range_args {
+	int64_t src_fd;
+	uint64_t src_offset;
+	uint64_t src_length;
+	uint64_t dest_offset;
+};
+
+#define VFS_FICLONERANGE _IOW(0x94, 13, struct vfs_clone_range_args)
+
 /**
  * @brief Read system directory entries into the buffer
  *
@@ -130,3 +144,76 @@ int set_threadgroups(size_t size, const gid_t *list)
 {
 	return syscall(__NR_setgroups, size, list);
 }
+
+/**
+ * @brief Copy a range between files in the kernel
+ *
+ * @param[in] src_fd      File to copy from
+ * @param[in] src_offset  Position to copy from
+ * @param[in] dst_fd      File to copy to
+ * @param[in] dst_offset  Position to copy to
+ * @param[in] count       Number of bytes to copy
+ *
+ * @return Bytes copied or -1 with errno set; ENOSYS, EXDEV or
+ *         EOPNOTSUPP mean the kernel or filesystem can not do it.
+ */
+ssize_t vfs_copy_file_range(int src_fd, off_t src_offset, int dst_fd,
+			    off_t dst_offset, size_t count)
+{
+#ifdef __NR_copy_file_range
+	loff_t in = src_offset, out = dst_offset;
+
+	return syscall(__NR_copy_file_range, src_fd, &in, dst_fd, &out,
+		       count, 0);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+/**
+ * @brief Share a range of blocks between files, as a reflink does
+ *
+ * @param[in] src_fd      File to clone from
+ * @param[in] src_offset  Position to clone from
+ * @param[in] dst_fd      File to clone into
+ * @param[in] dst_offset  Position to clone to
+ * @param[in] count       Number of bytes, 0 for all to end of file
+ *
+ * @return 0 or -1 with errno set; EOPNOTSUPP or ENOTTY mean the
+ *         filesystem can not share blocks.
+ */
+int vfs_clone_range(int src_fd, off_t src_offset, int dst_fd,
+		    off_t dst_offset, size_t count)
+{
+	struct vfs_clone_range_args args = {
+		.src_fd = src_fd,
+		.src_offset = src_offset,
+		.src_length = count,
+		.dest_offset = dst_offset,
+	};
+
+	return ioctl(dst_fd, VFS_FICLONERANGE, &args);
+}
+
+/**
+ * @brief Reserve blocks for, or punch a hole in, a range of a file
+ *
+ * @param[in] fd          File to operate on
+ * @param[in] offset      Start of the range
+ * @param[in] length      Length of the range
+ * @param[in] punch_hole  Punch a hole, keeping the file size, rather
+ *                        than allocate
+ *
+ * @return 0 or -1 with errno set; EOPNOTSUPP means the filesystem
+ *         can not do it.
+ */
+int vfs_fallocate_range(int fd, off_t offset, off_t length, bool punch_hole)
+{
+	int mode = 0;
+
+	if (punch_hole)
+		mode = FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE;
+
+	return fallocate(fd, mode, offset, length);
+}
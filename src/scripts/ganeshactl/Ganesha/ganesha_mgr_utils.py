@@ -268,6 +268,30 @@ class AdminInterface():
         msg = reply[1]
         return status, msg
 
+    def get_workers(self):
+        method = self.dbusobj.get_dbus_method("get_workers",
+                                              self.dbus_interface)
+        try:
+           reply = method()
+        except dbus.exceptions.DBusException as e:
+           return False, e, None
+
+        status = reply[3]
+        msg = reply[4]
+        return status, msg, tuple(reply[0:3])
+
+    def get_dequeue_batch(self):
+        method = self.dbusobj.get_dbus_method("get_dequeue_batch",
+                                              self.dbus_interface)
+        try:
+           reply = method()
+        except dbus.exceptions.DBusException as e:
+           return False, e, None
+
+        status = reply[3]
+        msg = reply[4]
+        return status, msg, tuple(reply[0:3])
+
 
 LOGGER_PROPS = 'org.ganesha.nfsd.log.component'
 
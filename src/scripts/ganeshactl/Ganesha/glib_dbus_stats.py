@@ -34,6 +34,56 @@ class RetrieveExportStats():
         stats_op = self.exportmgrobj.get_dbus_method("GetFastOPS",
                                  self.dbus_exportstats_name)
         return FastStats(stats_op())
+    # Per stage latency histograms of each operation
+    def latency_stats(self):
+        stats_op = self.exportmgrobj.get_dbus_method("GetLatencyHistograms",
+                                 self.dbus_exportstats_name)
+        return LatencyStats(stats_op())
+    # READ/WRITE payload buffer pool
+    def iobuf_stats(self):
+        stats_op = self.exportmgrobj.get_dbus_method("GetIOBufStats",
+                                 self.dbus_exportstats_name)
+        return IOBufStats(stats_op())
+    # Memory held by open, lock and NLM owners
+    def owner_stats(self):
+        stats_op = self.exportmgrobj.get_dbus_method("GetOwnerStats",
+                                 self.dbus_exportstats_name)
+        return OwnerStats(stats_op())
+    # ID mapping cache
+    def idmapper_stats(self):
+        stats_op = self.exportmgrobj.get_dbus_method("GetIdmapperStats",
+                                 self.dbus_exportstats_name)
+        return IdmapperStats(stats_op())
+    # small lookup caches
+    def cache_stats(self):
+        stats_op = self.exportmgrobj.get_dbus_method("GetCacheStats",
+                                 self.dbus_exportstats_name)
+        return CacheStats(stats_op())
+    # QoS limits of the exports and clients
+    def qos_stats(self):
+        stats_op = self.exportmgrobj.get_dbus_method("GetQoS",
+                                 self.dbus_exportstats_name)
+        return QoSStats(stats_op())
+    # heavy hitters of the request sampler
+    def hot_spots(self):
+        stats_op = self.exportmgrobj.get_dbus_method("GetHotSpots",
+                                 self.dbus_exportstats_name)
+        return HotSpots(stats_op())
+    # requests in flight
+    def inflight_requests(self):
+        stats_op = self.exportmgrobj.get_dbus_method("GetInflightRequests",
+                                 self.dbus_exportstats_name)
+        return InflightRequests(stats_op())
+    # lock contention, in a USE_LOCK_PROFILING build
+    def lock_stats(self):
+        stats_op = self.exportmgrobj.get_dbus_method("GetLockStats",
+                                 self.dbus_exportstats_name)
+        return LockStats(stats_op())
+    # memory by pool, and by subsystem in a USE_MEM_ACCOUNTING build
+    def mem_stats(self):
+        stats_op = self.exportmgrobj.get_dbus_method("GetMemStats",
+                                 self.dbus_exportstats_name)
+        return MemStats(stats_op())
     # NFSv3/NFSv40/NFSv41/NFSv42/NLM4/MNTv1/MNTv3/RQUOTA totalled over all exports
     def global_stats(self):
         stats_op = self.exportmgrobj.get_dbus_method("GetGlobalOPS",
@@ -146,6 +196,8 @@ class DelegStats():
             self.curr_recall = stats[3][1]
             self.fail_recall = stats[3][2]
             self.num_revokes = stats[3][3]
+            self.tot_grants = stats[3][4]
+            self.recall_ratio = stats[3][5]
     def __str__(self):
         if self.status != "OK":
             return ("GANESHA RESPONSE STATUS: " + self.status)
@@ -155,7 +207,9 @@ class DelegStats():
                      "\nCurrent Delegations: " + str(self.curr_deleg) +
                      "\nCurrent Recalls: " + str(self.curr_recall) +
                      "\nCurrent Failed Recalls: " + str(self.fail_recall) +
-                     "\nCurrent Number of Revokes: " + str(self.num_revokes) )
+                     "\nCurrent Number of Revokes: " + str(self.num_revokes) +
+                     "\nTotal Grants: " + str(self.tot_grants) +
+                     "\nRecalls per Grant: " + str(self.recall_ratio) )
 
 class Export():
     def __init__(self, export):
@@ -225,16 +279,32 @@ class InodeStats():
         self.cache_conflict = stats[3][7]
         self.cache_add = stats[3][9]
         self.cache_mapping = stats[3][11]
+        self.cache_ghost_add = stats[3][13]
+        self.cache_ghost_hit = stats[3][15]
+        self.cache_upcall_trust = stats[3][17]
+        self.cache_change_trust = stats[3][19]
+        self.cache_mem_used = stats[3][21]
+        self.cache_mem_limit = stats[3][23]
     def __str__(self):
         if self.status != "OK":
             return "No NFS activity, GANESHA RESPONSE STATUS: " + self.status
+        hit_rate = 0.0
+        if self.cache_requests:
+            hit_rate = 100.0 * self.cache_hits / self.cache_requests
         return ( "Timestamp: " + time.ctime(self.timestamp[0]) + str(self.timestamp[1]) + " nsecs" +
                  "\nInode Cache Requests: " + str(self.cache_requests) +
                  "\nInode Cache Hits: " + str(self.cache_hits) +
+                 "\nInode Cache Hit Rate: %.2f%%" % hit_rate +
                  "\nInode Cache Misses: " + str(self.cache_miss) +
                  "\nInode Cache Conflicts:: " + str(self.cache_conflict) +
                  "\nInode Cache Adds: " + str(self.cache_add) +
-                 "\nInode Cache Mapping: " + str(self.cache_mapping) )
+                 "\nInode Cache Mapping: " + str(self.cache_mapping) +
+                 "\nInode Cache Ghosts Added: " + str(self.cache_ghost_add) +
+                 "\nInode Cache Ghost Hits: " + str(self.cache_ghost_hit) +
+                 "\nInode Cache Refreshes Avoided: " + str(self.cache_upcall_trust) +
+                 "\nInode Cache Refreshes by Change: " + str(self.cache_change_trust) +
+                 "\nInode Cache Memory Used: " + str(self.cache_mem_used) +
+                 "\nInode Cache Memory Limit: " + str(self.cache_mem_limit) )
 
 class FastStats():
     def __init__(self, stats):
@@ -255,6 +325,196 @@ class FastStats():
                     output += "%s: " % (self.stats[3][i].ljust(20))
         return output
 
+class LatencyStats():
+    def __init__(self, stats):
+        self.stats = stats
+    # lower bound of the bucket holding the given fraction of requests
+    def percentile(self, buckets, count, fraction):
+        seen = 0
+        for floor, cnt in buckets:
+            seen += cnt
+            if seen >= count * fraction:
+                return floor
+        return buckets[-1][0]
+    def __str__(self):
+        if self.stats[1] != "OK":
+            return "GANESHA RESPONSE STATUS: " + self.stats[1]
+        output = ("Timestamp: " + time.ctime(self.stats[2][0]) + str(self.stats[2][1]) + " nsecs" +
+                  "\nLatencies in usecs, percentiles are bucket lower bounds\n" +
+                  "%-8s %-20s %-8s %12s %10s %10s %10s %10s\n" %
+                  ("Proto", "Op", "Stage", "Count", "Mean", "p50", "p90", "p99"))
+        for prog, op, stage, count, total, buckets in self.stats[3]:
+            output += "%-8s %-20s %-8s %12d %10d %10d %10d %10d\n" % (
+                prog, op, stage, count, total / count / 1000,
+                self.percentile(buckets, count, 0.5) / 1000,
+                self.percentile(buckets, count, 0.9) / 1000,
+                self.percentile(buckets, count, 0.99) / 1000)
+        return output
+
+class IOBufStats():
+    def __init__(self, stats):
+        self.stats = stats
+    def __str__(self):
+        if self.stats[1] != "OK":
+            return "GANESHA RESPONSE STATUS: " + self.stats[1]
+        allocs, hits, refills, mallocs, releases, oversize = self.stats[3]
+        output = ("Timestamp: " + time.ctime(self.stats[2][0]) + str(self.stats[2][1]) + " nsecs" +
+                  "\nAllocations: " + str(allocs) +
+                  "\nThread Cache Hits: " + str(hits) +
+                  "\nDepot Refills: " + str(refills) +
+                  "\nSystem Allocations: " + str(mallocs) +
+                  "\nSystem Releases: " + str(releases) +
+                  "\nOversize Allocations: " + str(oversize) +
+                  "\nDepot:\n")
+        for size, count in self.stats[4]:
+            output += "%10d bytes %8d buffers\n" % (size, count)
+        return output
+
+class OwnerStats():
+    def __init__(self, stats):
+        self.stats = stats
+    def __str__(self):
+        if self.stats[1] != "OK":
+            return "GANESHA RESPONSE STATUS: " + self.stats[1]
+        owners, slabs, nbytes, size, slab_allocs, names, name_bytes = self.stats[3]
+        return ("Timestamp: " + time.ctime(self.stats[2][0]) + str(self.stats[2][1]) + " nsecs" +
+                "\nOwners: " + str(owners) +
+                "\nOwner Size: " + str(size) + " bytes" +
+                "\nSlabs: " + str(slabs) + " (" + str(nbytes) + " bytes)" +
+                "\nSlabs Allocated: " + str(slab_allocs) +
+                "\nOut of Line Names: " + str(names) + " (" + str(name_bytes) + " bytes)")
+
+class IdmapperStats():
+    def __init__(self, stats):
+        self.stats = stats
+    def __str__(self):
+        if self.stats[1] != "OK":
+            return "GANESHA RESPONSE STATUS: " + self.stats[1]
+        hits, neg_hits, misses, expired, refreshes, lookups, lookup_ns, max_ns = self.stats[3]
+        avg_ns = lookup_ns / lookups if lookups else 0
+        return ("Timestamp: " + time.ctime(self.stats[2][0]) + str(self.stats[2][1]) + " nsecs" +
+                "\nHits: " + str(hits) + " (" + str(neg_hits) + " of unmapped names or IDs)" +
+                "\nMisses: " + str(misses) +
+                "\nExpired: " + str(expired) +
+                "\nBackground Refreshes: " + str(refreshes) +
+                "\nDirectory Lookups: " + str(lookups) +
+                "\nLookup Latency: " + str(avg_ns / 1000) + " usecs average, " +
+                str(max_ns / 1000) + " usecs max")
+
+class CacheStats():
+    def __init__(self, stats):
+        self.stats = stats
+    def __str__(self):
+        if self.stats[1] != "OK":
+            return "GANESHA RESPONSE STATUS: " + self.stats[1]
+        output = "Timestamp: " + time.ctime(self.stats[2][0]) + str(self.stats[2][1]) + " nsecs"
+        for (name, slots, nbytes, hits, neg_hits, misses, expired,
+             inserts, evictions, dropped) in self.stats[3]:
+            output += ("\n\nCache: " + str(name) +
+                       "\nSlots: " + str(slots) + " (" + str(nbytes) + " bytes)" +
+                       "\nHits: " + str(hits) + " (" + str(neg_hits) + " negative)" +
+                       "\nMisses: " + str(misses) + " (" + str(expired) + " expired)" +
+                       "\nInserts: " + str(inserts) + " (" + str(evictions) +
+                       " evicting, " + str(dropped) + " dropped)")
+        return output
+
+class QoSStats():
+    def __init__(self, stats):
+        self.stats = stats
+    def __str__(self):
+        if self.stats[1] != "OK":
+            return "GANESHA RESPONSE STATUS: " + self.stats[1]
+        output = "Timestamp: " + time.ctime(self.stats[2][0]) + str(self.stats[2][1]) + " nsecs"
+        for title, entries in (("Export", self.stats[3]),
+                               ("Client", self.stats[4])):
+            for (key, iops, iops_burst, bw, bw_burst, admitted, deferred,
+                 nbytes) in entries:
+                output += ("\n\n" + title + ": " + str(key) +
+                           "\nIOPS limit: " + str(iops) + " (burst " +
+                           str(iops_burst) + ")" +
+                           "\nBandwidth limit: " + str(bw) + " bytes/s (burst " +
+                           str(bw_burst) + ")" +
+                           "\nRequests: " + str(admitted) + " (" +
+                           str(deferred) + " times held back)" +
+                           "\nBytes: " + str(nbytes))
+        return output
+
+class HotSpots():
+    def __init__(self, stats):
+        self.stats = stats
+    def __str__(self):
+        if self.stats[1] != "OK":
+            return "GANESHA RESPONSE STATUS: " + self.stats[1]
+        titles = ("Files by requests", "Files by bytes",
+                  "Clients by requests", "Clients by bytes",
+                  "Requests by requests", "Requests by bytes")
+        output = "Timestamp: " + time.ctime(self.stats[2][0]) + str(self.stats[2][1]) + " nsecs"
+        for title, entries in zip(titles, self.stats[3:]):
+            output += "\n\n" + title + ":"
+            for (client, export_id, fileid, prog, vers, proc,
+                 count, error) in entries[:10]:
+                key = []
+                if client:
+                    key.append(str(client))
+                if fileid:
+                    key.append("export " + str(export_id) + " fileid " + str(fileid))
+                if prog:
+                    key.append("prog " + str(prog) + " v" + str(vers) + " proc " + str(proc))
+                output += ("\n\t" + str(count).rjust(12) + " (+/- " + str(error) + ")\t" +
+                           ", ".join(key))
+        return output
+
+class InflightRequests():
+    def __init__(self, stats):
+        self.stats = stats
+    def __str__(self):
+        if self.stats[1] != "OK":
+            return "GANESHA RESPONSE STATUS: " + self.stats[1]
+        output = "Timestamp: " + time.ctime(self.stats[2][0]) + str(self.stats[2][1]) + " nsecs"
+        output += "\n\n        xid\t   age(ms)\tclient\trequest\tstage\tFSAL call"
+        for (xid, client, proc, op, stage, call, age) in sorted(
+                self.stats[3], key=lambda r: r[6], reverse=True):
+            output += ("\n" + str(xid).rjust(11) + "\t" + str(age / 1000000).rjust(10) +
+                       "\t" + client + "\t" + proc + (" " + op if op else "") +
+                       "\t" + stage + "\t" + call)
+        return output
+
+class LockStats():
+    def __init__(self, stats):
+        self.stats = stats
+    def __str__(self):
+        if self.stats[1] != "OK":
+            return "GANESHA RESPONSE STATUS: " + self.stats[1]
+        output = "Timestamp: " + time.ctime(self.stats[2][0]) + str(self.stats[2][1]) + " nsecs"
+        output += ("\n\n     taken   waited  wait(ms)  max(us)  held(ms)  max(us)  site")
+        for (fname, line, name, taken, contended, wait_ns, wait_max,
+             hold_ns, hold_max) in self.stats[3][:40]:
+            output += ("\n" + str(taken).rjust(10) + str(contended).rjust(9) +
+                       str(wait_ns / 1000000).rjust(10) + str(wait_max / 1000).rjust(9) +
+                       str(hold_ns / 1000000).rjust(10) + str(hold_max / 1000).rjust(9) +
+                       "  " + fname + ":" + str(line) + " " + name)
+        return output
+
+class MemStats():
+    def __init__(self, stats):
+        self.stats = stats
+    def __str__(self):
+        if self.stats[1] != "OK":
+            return "GANESHA RESPONSE STATUS: " + self.stats[1]
+        output = "Timestamp: " + time.ctime(self.stats[2][0]) + str(self.stats[2][1]) + " nsecs"
+        if self.stats[3]:
+            output += ("\n\nSubsystem          allocs       frees       bytes")
+            for (name, allocs, frees, nbytes) in self.stats[3]:
+                output += ("\n" + name.ljust(12) + str(allocs).rjust(12) +
+                           str(frees).rjust(12) + str(nbytes).rjust(12))
+        output += ("\n\nPool                            size      allocs" +
+                   "       frees       bytes")
+        for (name, size, allocs, frees, nbytes) in self.stats[4]:
+            output += ("\n" + name.ljust(28) + str(size).rjust(8) +
+                       str(allocs).rjust(12) + str(frees).rjust(12) +
+                       str(nbytes).rjust(12))
+        return output
+
 class ExportIOv3Stats():
     def __init__(self, stats):
         self.stats = stats
@@ -165,6 +165,20 @@ class ServerAdmin():
         status, msg = self.admin.purge_netgroups()
         self.status_message(status, msg)
 
+    def get_workers(self):
+        status, msg, sizes = self.admin.get_workers()
+        if status == True:
+           print "Workers: %d (min %d, max %d)" % sizes
+        else:
+           self.status_message(status, msg)
+
+    def get_dequeue_batch(self):
+        status, msg, stats = self.admin.get_dequeue_batch()
+        if status == True:
+           print "Dequeues: %d, requests: %d, average batch: %.2f" % stats
+        else:
+           self.status_message(status, msg)
+
     def status_message(self, status, errormsg):
         print "Returns: status = %s, %s" % (str(status), errormsg)
 
@@ -231,6 +245,8 @@ if __name__ == '__main__':
        "   shutdown: Shuts down the ganesha nfs server\n\n"                  \
        "   purge netgroups: Purges netgroups cache\n\n"                      \
        "   grace ipaddr: Begins grace for the given IP\n\n"                  \
+       "   get_workers: Shows the current worker pool size\n\n"              \
+       "   get_dequeue_batch: Shows the average dequeue batch size\n\n"      \
        "   get_log component: Gets the log level for the given component\n\n"\
        "   set_log component level: \n"                                      \
        "       Sets the given log level to the given component\n\n"          \
@@ -294,6 +310,10 @@ if __name__ == '__main__':
                  " Try \"ganesha_mgr.py help\" for more info"
            sys.exit(1)
         ganesha.grace(sys.argv[2])
+    elif sys.argv[1] == "get_workers":
+        ganesha.get_workers()
+    elif sys.argv[1] == "get_dequeue_batch":
+        ganesha.get_dequeue_batch()
 
     elif sys.argv[1] == "set_log":
         if len(sys.argv) < 4:
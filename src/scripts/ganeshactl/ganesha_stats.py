@@ -16,7 +16,9 @@ def usage():
     message = "Command gives global stats by default.\n"
     message += "%s [list_clients | deleg <ip address> | " % (sys.argv[0])
     message += "inode | iov3 [export id] | iov4 [export id] | export |"
-    message += " total [export id] | fast | pnfs [export id] ]"
+    message += " total [export id] | fast | pnfs [export id] | latency |"
+    message += " iobuf | owners | idmapper | caches | hot | inflight | locks |"
+    message += " memory | qos ]"
     sys.exit(message)
 
 if len(sys.argv) < 2:
@@ -26,7 +28,9 @@ else:
 
 # check arguments
 commands = ('help', 'list_clients', 'deleg', 'global', 'inode', 'iov3', 'iov4',
-           'export', 'total', 'fast', 'pnfs')
+           'export', 'total', 'fast', 'pnfs', 'latency', 'iobuf',
+           'owners', 'idmapper', 'caches', 'hot', 'inflight', 'locks',
+           'memory', 'qos')
 if command not in commands:
     print "Option \"%s\" is not correct." % (command)
     usage()
@@ -58,6 +62,26 @@ elif command == "inode":
     print exp_interface.inode_stats()
 elif command == "fast":
     print exp_interface.fast_stats()
+elif command == "latency":
+    print exp_interface.latency_stats()
+elif command == "iobuf":
+    print exp_interface.iobuf_stats()
+elif command == "owners":
+    print exp_interface.owner_stats()
+elif command == "idmapper":
+    print exp_interface.idmapper_stats()
+elif command == "caches":
+    print exp_interface.cache_stats()
+elif command == "qos":
+    print exp_interface.qos_stats()
+elif command == "hot":
+    print exp_interface.hot_spots()
+elif command == "inflight":
+    print exp_interface.inflight_requests()
+elif command == "locks":
+    print exp_interface.lock_stats()
+elif command == "memory":
+    print exp_interface.mem_stats()
 elif command == "list_clients":
     print cl_interface.list_clients()
 elif command == "deleg":
@@ -0,0 +1,109 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file arena.c
+ * @brief Bump pointer memory arena
+ *
+ * See @ref MemArena.  The fast path is inline in abstract_mem.h.
+ */
+
+#include "config.h"
+#include "abstract_mem.h"
+
+/**
+ * @brief Allocate from a new chunk
+ *
+ * @param[in,out] arena  The arena
+ * @param[in]     size   Bytes wanted, already rounded
+ *
+ * @return The memory.
+ */
+void *mem_arena_alloc_slow(struct mem_arena *arena, size_t size)
+{
+	struct mem_arena_chunk *chunk;
+	bool own = size > MEM_ARENA_CHUNK / 4;
+	size_t chunk_size = own ? size : MEM_ARENA_CHUNK;
+
+	chunk = gsh_malloc(sizeof(*chunk) + chunk_size);
+	chunk->size = chunk_size;
+	chunk->used = size;
+
+	if (own && arena->chunks != NULL) {
+		/* A chunk of its own; leave the current one in front */
+		chunk->next = arena->chunks->next;
+		arena->chunks->next = chunk;
+	} else {
+		chunk->next = arena->chunks;
+		arena->chunks = chunk;
+	}
+
+	return chunk->data;
+}
+
+/**
+ * @brief Free everything allocated from an arena
+ *
+ * The arena is left empty and may be used again.
+ *
+ * @param[in,out] arena  The arena
+ */
+void mem_arena_release(struct mem_arena *arena)
+{
+	struct mem_arena_chunk *chunk, *next;
+
+	for (chunk = arena->chunks; chunk != NULL; chunk = next) {
+		next = chunk->next;
+		gsh_free(chunk);
+	}
+
+	arena->chunks = NULL;
+}
+
+/**
+ * @brief Move everything allocated from one arena into another
+ *
+ * The chunks go behind the current one of @a arena, which keeps its
+ * free space, and @a from is left empty.
+ *
+ * @param[in,out] arena  The arena taking over the memory
+ * @param[in,out] from   The arena giving it up
+ */
+void mem_arena_splice(struct mem_arena *arena, struct mem_arena *from)
+{
+	struct mem_arena_chunk *tail;
+
+	if (from->chunks == NULL)
+		return;
+
+	if (arena->chunks == NULL) {
+		arena->chunks = from->chunks;
+		from->chunks = NULL;
+		return;
+	}
+
+	for (tail = from->chunks; tail->next != NULL; tail = tail->next)
+		;
+
+	tail->next = arena->chunks->next;
+	arena->chunks->next = from->chunks;
+	from->chunks = NULL;
+}
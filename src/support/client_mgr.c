@@ -66,10 +66,15 @@
 #include "gsh_intrinsic.h"
 #include "server_stats.h"
 #include "sal_functions.h"
+#include "gsh_hash.h"
+#include "nfs_req_queue.h"
 
-/* Clients are stored in an AVL tree
+/* Clients are stored in AVL trees, sharded by a hash of their address
+ * so lookups of different clients do not contend for one lock.
  */
 
+#define CLIENT_BY_IP_SHARDS 64
+
 struct client_by_ip {
 	struct avltree t;
 	pthread_rwlock_t lock;
@@ -77,22 +82,40 @@ struct client_by_ip {
 	uint32_t cache_sz;
 };
 
-static struct client_by_ip client_by_ip;
+static struct client_by_ip client_by_ip[CLIENT_BY_IP_SHARDS];
+
+/**
+ * @brief Find the shard of an address
+ *
+ * @param addr [in] The address
+ * @param len  [in] Its length
+ * @param hash [out] Its hash, for the cache slot
+ *
+ * @return The shard.
+ */
+static inline struct client_by_ip *client_shard(uint8_t *addr, int len,
+						uint64_t *hash)
+{
+	*hash = gsh_hash64(addr, len, 0);
+
+	return &client_by_ip[*hash % CLIENT_BY_IP_SHARDS];
+}
 
 /**
  * @brief Compute cache slot for an entry
  *
- * This function computes a hash slot, taking an address modulo the
- * number of cache slotes (which should be prime).
+ * This function computes a hash slot, taking the part of the address
+ * hash not used to pick the shard modulo the number of cache slotes
+ * (which should be prime).
  *
  * @param wt [in] The table
- * @param ptr [in] Entry address
+ * @param ptr [in] Entry address hash
  *
  * @return The computed offset.
  */
-static inline uint32_t eip_cache_offsetof(struct client_by_ip *eid, uint32_t k)
+static inline uint32_t eip_cache_offsetof(struct client_by_ip *eid, uint64_t k)
 {
-	return k % eid->cache_sz;
+	return (k / CLIENT_BY_IP_SHARDS) % eid->cache_sz;
 }
 
 /**
@@ -137,7 +160,8 @@ struct gsh_client *get_gsh_client(sockaddr_t *client_ipaddr, bool lookup_only)
 	struct gsh_client v;
 	char hoststr[SOCK_NAME_MAX];
 	uint8_t *addr = NULL;
-	uint32_t ipaddr;
+	struct client_by_ip *cbi;
+	uint64_t hash;
 	int addr_len = 0;
 	void **cache_slot;
 
@@ -147,18 +171,12 @@ struct gsh_client *get_gsh_client(sockaddr_t *client_ipaddr, bool lookup_only)
 		    (uint8_t *) &((struct sockaddr_in *)client_ipaddr)->
 		    sin_addr;
 		addr_len = 4;
-		memcpy(&ipaddr,
-		       (uint8_t *) &((struct sockaddr_in *)client_ipaddr)->
-		       sin_addr, sizeof(ipaddr));
 		break;
 	case AF_INET6:
 		addr =
 		    (uint8_t *) &((struct sockaddr_in6 *)client_ipaddr)->
 		    sin6_addr;
 		addr_len = 16;
-		memcpy(&ipaddr,
-		       (uint8_t *) &((struct sockaddr_in6 *)client_ipaddr)->
-		       sin6_addr, sizeof(ipaddr));
 		break;
 #ifdef RPC_VSOCK
 	case AF_VSOCK:
@@ -168,7 +186,6 @@ struct gsh_client *get_gsh_client(sockaddr_t *client_ipaddr, bool lookup_only)
 		svm = (struct sockaddr_vm *)client_ipaddr;
 		addr = (uint8_t *)&(svm->svm_cid);
 		addr_len = sizeof(svm->svm_cid);
-		ipaddr = svm->svm_cid;
 	}
 	break;
 #endif /* VSOCK */
@@ -177,19 +194,19 @@ struct gsh_client *get_gsh_client(sockaddr_t *client_ipaddr, bool lookup_only)
 	}
 	v.addr.addr = addr;
 	v.addr.len = addr_len;
+	cbi = client_shard(addr, addr_len, &hash);
 
-	PTHREAD_RWLOCK_rdlock(&client_by_ip.lock);
+	PTHREAD_RWLOCK_rdlock(&cbi->lock);
 
 	/* check cache */
-	cache_slot = (void **)
-	    &(client_by_ip.cache[eip_cache_offsetof(&client_by_ip, ipaddr)]);
+	cache_slot = (void **)&(cbi->cache[eip_cache_offsetof(cbi, hash)]);
 	node = (struct avltree_node *)atomic_fetch_voidptr(cache_slot);
 	if (node) {
 		if (client_ip_cmpf(&v.node_k, node) == 0) {
 			/* got it in 1 */
 			LogDebug(COMPONENT_HASHTABLE_CACHE,
 				 "client_mgr cache hit slot %d",
-				 eip_cache_offsetof(&client_by_ip, ipaddr));
+				 eip_cache_offsetof(cbi, hash));
 			cl = avltree_container_of(node, struct gsh_client,
 						  node_k);
 			goto out;
@@ -197,17 +214,17 @@ struct gsh_client *get_gsh_client(sockaddr_t *client_ipaddr, bool lookup_only)
 	}
 
 	/* fall back to AVL */
-	node = avltree_lookup(&v.node_k, &client_by_ip.t);
+	node = avltree_lookup(&v.node_k, &cbi->t);
 	if (node) {
 		cl = avltree_container_of(node, struct gsh_client, node_k);
 		/* update cache */
 		atomic_store_voidptr(cache_slot, node);
 		goto out;
 	} else if (lookup_only) {
-		PTHREAD_RWLOCK_unlock(&client_by_ip.lock);
+		PTHREAD_RWLOCK_unlock(&cbi->lock);
 		return NULL;
 	}
-	PTHREAD_RWLOCK_unlock(&client_by_ip.lock);
+	PTHREAD_RWLOCK_unlock(&cbi->lock);
 
 	server_st = gsh_calloc(1, (sizeof(struct server_stats) + addr_len));
 
@@ -219,8 +236,8 @@ struct gsh_client *get_gsh_client(sockaddr_t *client_ipaddr, bool lookup_only)
 	sprint_sockip(client_ipaddr, hoststr, SOCK_NAME_MAX);
 	cl->hostaddr_str = gsh_strdup(hoststr);
 
-	PTHREAD_RWLOCK_wrlock(&client_by_ip.lock);
-	node = avltree_insert(&cl->node_k, &client_by_ip.t);
+	PTHREAD_RWLOCK_wrlock(&cbi->lock);
+	node = avltree_insert(&cl->node_k, &cbi->t);
 	if (node) {
 		gsh_free(server_st);	/* somebody beat us to it */
 		cl = avltree_container_of(node, struct gsh_client, node_k);
@@ -230,7 +247,7 @@ struct gsh_client *get_gsh_client(sockaddr_t *client_ipaddr, bool lookup_only)
 
  out:
 	inc_gsh_client_refcount(cl);
-	PTHREAD_RWLOCK_unlock(&client_by_ip.lock);
+	PTHREAD_RWLOCK_unlock(&cbi->lock);
 	return cl;
 }
 
@@ -266,7 +283,8 @@ int remove_gsh_client(sockaddr_t *client_ipaddr)
 	struct server_stats *server_st;
 	struct gsh_client v;
 	uint8_t *addr = NULL;
-	uint32_t ipaddr;
+	struct client_by_ip *cbi;
+	uint64_t hash;
 	int addr_len = 0;
 	int removed = 0;
 	void **cache_slot;
@@ -277,18 +295,12 @@ int remove_gsh_client(sockaddr_t *client_ipaddr)
 		    (uint8_t *) &((struct sockaddr_in *)client_ipaddr)->
 		    sin_addr;
 		addr_len = 4;
-		memcpy(&ipaddr,
-		       (uint8_t *) &((struct sockaddr_in *)client_ipaddr)->
-		       sin_addr, sizeof(ipaddr));
 		break;
 	case AF_INET6:
 		addr =
 		    (uint8_t *) &((struct sockaddr_in6 *)client_ipaddr)->
 		    sin6_addr;
 		addr_len = 16;
-		memcpy(&ipaddr,
-		       (uint8_t *) &((struct sockaddr_in6 *)client_ipaddr)->
-		       sin6_addr, sizeof(ipaddr));
 		break;
 #ifdef RPC_VSOCK
 	case AF_VSOCK:
@@ -298,7 +310,6 @@ int remove_gsh_client(sockaddr_t *client_ipaddr)
 		svm = (struct sockaddr_vm *)client_ipaddr;
 		addr = (uint8_t *)&(svm->svm_cid);
 		addr_len = sizeof(svm->svm_cid);
-		ipaddr = svm->svm_cid;
 	}
 	break;
 #endif /* VSOCK */
@@ -307,9 +318,10 @@ int remove_gsh_client(sockaddr_t *client_ipaddr)
 	}
 	v.addr.addr = addr;
 	v.addr.len = addr_len;
+	cbi = client_shard(addr, addr_len, &hash);
 
-	PTHREAD_RWLOCK_wrlock(&client_by_ip.lock);
-	node = avltree_lookup(&v.node_k, &client_by_ip.t);
+	PTHREAD_RWLOCK_wrlock(&cbi->lock);
+	node = avltree_lookup(&v.node_k, &cbi->t);
 	if (node) {
 		cl = avltree_container_of(node, struct gsh_client, node_k);
 		if (atomic_fetch_int64_t(&cl->refcnt) > 0) {
@@ -317,17 +329,16 @@ int remove_gsh_client(sockaddr_t *client_ipaddr)
 			goto out;
 		}
 		cache_slot = (void **)
-		    &(client_by_ip.
-		      cache[eip_cache_offsetof(&client_by_ip, ipaddr)]);
+		    &(cbi->cache[eip_cache_offsetof(cbi, hash)]);
 		cnode = (struct avltree_node *)atomic_fetch_voidptr(cache_slot);
 		if (node == cnode)
 			atomic_store_voidptr(cache_slot, NULL);
-		avltree_remove(node, &client_by_ip.t);
+		avltree_remove(node, &cbi->t);
 	} else {
 		removed = ENOENT;
 	}
  out:
-	PTHREAD_RWLOCK_unlock(&client_by_ip.lock);
+	PTHREAD_RWLOCK_unlock(&cbi->lock);
 	if (removed == 0) {
 		server_st = container_of(cl, struct server_stats, client);
 		server_stats_free(&server_st->st);
@@ -351,17 +362,23 @@ int foreach_gsh_client(bool(*cb) (struct gsh_client *cl, void *state),
 	struct avltree_node *client_node;
 	struct gsh_client *cl;
 	int cnt = 0;
-
-	PTHREAD_RWLOCK_rdlock(&client_by_ip.lock);
-	for (client_node = avltree_first(&client_by_ip.t); client_node != NULL;
-	     client_node = avltree_next(client_node)) {
-		cl = avltree_container_of(client_node, struct gsh_client,
-					  node_k);
-		if (!cb(cl, state))
-			break;
-		cnt++;
+	int i;
+
+	for (i = 0; i < CLIENT_BY_IP_SHARDS; i++) {
+		PTHREAD_RWLOCK_rdlock(&client_by_ip[i].lock);
+		for (client_node = avltree_first(&client_by_ip[i].t);
+		     client_node != NULL;
+		     client_node = avltree_next(client_node)) {
+			cl = avltree_container_of(client_node,
+						  struct gsh_client, node_k);
+			if (!cb(cl, state)) {
+				PTHREAD_RWLOCK_unlock(&client_by_ip[i].lock);
+				return cnt;
+			}
+			cnt++;
+		}
+		PTHREAD_RWLOCK_unlock(&client_by_ip[i].lock);
 	}
-	PTHREAD_RWLOCK_unlock(&client_by_ip.lock);
 	return cnt;
 }
 
@@ -556,10 +573,61 @@ static struct gsh_dbus_method cltmgr_show_clients = {
 		 END_ARG_LIST}
 };
 
+/**
+ * @brief Change the QoS limits of a client
+ *
+ * Only the clients of a Dispatch_Client_Weight block have limits,
+ * enforced when Dispatch_Fair_Queueing is on.
+ *
+ * @param args [IN] client address, then the limits
+ * @param reply [OUT] status
+ */
+
+static bool gsh_client_setqos(DBusMessageIter *args,
+			      DBusMessage *reply,
+			      DBusError *error)
+{
+	struct dispatch_client_weight *cw;
+	struct qos_limits limits;
+	sockaddr_t sockaddr;
+	bool success;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	success = arg_ipaddr(args, &sockaddr, &errormsg);
+	if (success) {
+		dbus_message_iter_next(args);
+		success = qos_dbus_limits(args, &limits, &errormsg);
+	}
+	if (success) {
+		cw = nfs_rpc_fairq_client(&sockaddr);
+		if (cw != NULL) {
+			cw->qos_limits = limits;
+			qos_bucket_set(&cw->qos, &limits);
+		} else {
+			success = false;
+			errormsg = "Client has no Dispatch_Client_Weight block";
+		}
+	}
+	dbus_status_reply(&iter, success, errormsg);
+	return true;
+}
+
+static struct gsh_dbus_method cltmgr_set_qos = {
+	.name = "SetQoS",
+	.method = gsh_client_setqos,
+	.args = {IPADDR_ARG,
+		 QOS_LIMITS_ARGS,
+		 STATUS_REPLY,
+		 END_ARG_LIST}
+};
+
 static struct gsh_dbus_method *cltmgr_client_methods[] = {
 	&cltmgr_add_client,
 	&cltmgr_remove_client,
 	&cltmgr_show_clients,
+	&cltmgr_set_qos,
 	NULL
 };
 
@@ -975,6 +1043,46 @@ static struct gsh_dbus_method cltmgr_show_9p_op_stats = {
 #endif
 
 
+static bool client_to_snapshot(struct gsh_client *cl_node, void *state)
+{
+	server_stats_snapshot_client(state,
+				     container_of(cl_node, struct server_stats,
+						  client));
+	return true;
+}
+
+/**
+ * DBUS method to report the NFS I/O stats of all clients as one
+ * snapshot
+ *
+ * Each shard of the client table is only locked while the counters
+ * of its clients are copied, see struct stats_snapshot for the
+ * encoding.
+ */
+
+static bool get_client_snapshot(DBusMessageIter *args,
+				DBusMessage *reply,
+				DBusError *error)
+{
+	DBusMessageIter iter;
+	struct stats_snapshot snap;
+
+	dbus_message_iter_init_append(reply, &iter);
+
+	server_stats_snapshot_init(&snap, STATS_SNAPSHOT_CLIENTS);
+	(void)foreach_gsh_client(client_to_snapshot, (void *)&snap);
+	server_stats_snapshot_reply(&snap, &iter);
+
+	return true;
+}
+
+static struct gsh_dbus_method cltmgr_show_snapshot = {
+	.name = "GetClientSnapshot",
+	.method = get_client_snapshot,
+	.args = {SNAPSHOT_REPLY,
+		 END_ARG_LIST}
+};
+
 static struct gsh_dbus_method *cltmgr_stats_methods[] = {
 	&cltmgr_show_v3_io,
 	&cltmgr_show_v40_io,
@@ -986,6 +1094,7 @@ static struct gsh_dbus_method *cltmgr_stats_methods[] = {
 	&cltmgr_show_9p_trans,
 	&cltmgr_show_9p_op_stats,
 #endif
+	&cltmgr_show_snapshot,
 	NULL
 };
 
@@ -1019,6 +1128,7 @@ void dbus_client_init(void)
 void client_pkginit(void)
 {
 	pthread_rwlockattr_t rwlock_attr;
+	int i;
 
 	pthread_rwlockattr_init(&rwlock_attr);
 #ifdef GLIBC
@@ -1026,11 +1136,14 @@ void client_pkginit(void)
 		&rwlock_attr,
 		PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
 #endif
-	PTHREAD_RWLOCK_init(&client_by_ip.lock, &rwlock_attr);
-	avltree_init(&client_by_ip.t, client_ip_cmpf, 0);
-	client_by_ip.cache_sz = 32767;
-	client_by_ip.cache =
-	    gsh_calloc(client_by_ip.cache_sz, sizeof(struct avltree_node *));
+	for (i = 0; i < CLIENT_BY_IP_SHARDS; i++) {
+		PTHREAD_RWLOCK_init(&client_by_ip[i].lock, &rwlock_attr);
+		avltree_init(&client_by_ip[i].t, client_ip_cmpf, 0);
+		client_by_ip[i].cache_sz = 509;
+		client_by_ip[i].cache =
+		    gsh_calloc(client_by_ip[i].cache_sz,
+			       sizeof(struct avltree_node *));
+	}
 }
 
 /** @} */
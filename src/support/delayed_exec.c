@@ -37,36 +37,65 @@
 
 #include "config.h"
 #include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
 #ifdef LINUX
 #include <sys/signal.h>
 #elif FREEBSD
 #include <signal.h>
 #endif
 #include "abstract_mem.h"
+#include "abstract_atomic.h"
 #include "delayed_exec.h"
 #include "log.h"
-#include "avltree.h"
+#include "gsh_list.h"
 #include "misc/queue.h"
 #include "gsh_intrinsic.h"
 #include "common_utils.h"
 
 /**
- * @brief A list of tasks
+ * @page DelayedWheel Timer wheels
+ *
+ * Each executor thread owns a shard, with a lock of its own and a
+ * hierarchical timer wheel.  delayed_submit puts a task on the shard
+ * of the CPU it runs on, so submitters on different CPUs do not
+ * contend.
+ *
+ * Times are kept in ticks of DELAYED_TICK_NS, and a task runs at the
+ * first tick at or after its time.  Level 0 of a wheel has a slot per
+ * tick for the next DELAYED_WHEEL_SLOTS ticks, and each level above
+ * has slots DELAYED_WHEEL_SLOTS times as wide.  A task is put in the
+ * lowest level whose range reaches its tick, which is O(1).  When the
+ * clock enters the period of a slot in a higher level, the slot is
+ * cascaded, its tasks put again in lower levels.  A task past the top
+ * level's range goes in its last slot, to be put again when that is
+ * cascaded.  Each level has a bitmap of its non-empty slots, so the
+ * next tick that has anything to do is found without walking the
+ * empty ones, and an idle shard sleeps until then.
+ *
+ * Tasks whose tick has come go on the shard's ready list.  A thread
+ * with nothing of its own to do takes due tasks from the other shards,
+ * and sleeps no later than the next task of a shard whose thread is
+ * busy, so one long task does not hold up those due behind it.  A
+ * thread that leaves ready tasks behind as it starts one, and a submit
+ * to a busy shard, wake an idle thread to see to them.
  */
 
-LIST_HEAD(delayed_tasklist, delayed_task);
+/** Resolution of the wheels */
+#define DELAYED_TICK_NS NS_PER_MSEC
 
-/**
- * @brief All tasks executing at a given time.
- */
+#define DELAYED_WHEEL_BITS 6
+#define DELAYED_WHEEL_SLOTS (1 << DELAYED_WHEEL_BITS)
+#define DELAYED_WHEEL_MASK (DELAYED_WHEEL_SLOTS - 1)
 
-struct delayed_multi {
-	struct timespec realtime;	/*< A wallclock time at which to
-					   perform the given task. */
-	struct delayed_tasklist list;	/*< The linked list of tasks to
-					   perform. */
-	struct avltree_node node;	/*< Our node in the tree */
-};
+/** Levels of a wheel, covering 2^24 ticks, some four and a half hours */
+#define DELAYED_LEVELS 4
+
+/** Ticks a level's slot spans, or the whole range of the levels below */
+#define DELAYED_SPAN(level) (1ULL << (DELAYED_WHEEL_BITS * (level)))
+
+/** Most executor threads, one per CPU up to this */
+#define DELAYED_MAX_SHARDS 16
 
 /**
  * @brief An individual delayed task
@@ -77,8 +106,35 @@ struct delayed_task {
 	void (*func)(void *);
 	/** Argument for delayed task */
 	void *arg;
-	/** Link in the task list. */
-	LIST_ENTRY(delayed_task) link;
+	/** Tick at which to perform it */
+	uint64_t expires;
+	/** Link in a wheel slot or the ready list. */
+	struct glist_head link;
+};
+
+/**
+ * @brief A level of a timer wheel
+ */
+
+struct delayed_level {
+	uint64_t occupied;	/*< Bitmap of the non-empty slots */
+	struct glist_head slot[DELAYED_WHEEL_SLOTS];
+};
+
+/**
+ * @brief The tasks of one executor thread
+ */
+
+struct delayed_shard {
+	pthread_mutex_t mtx;	/*< Protects the rest */
+	pthread_cond_t cv;	/*< The shard's thread waits on it */
+	uint64_t clock;		/*< Next tick to expire */
+	uint64_t wakeup;	/*< Tick the thread sleeps until, 0 if it
+				    is awake */
+	uint32_t pending;	/*< Tasks on the wheel */
+	uint32_t busy;		/*< The thread is performing a task */
+	struct glist_head ready;	/*< Tasks due, to be performed */
+	struct delayed_level level[DELAYED_LEVELS];
 };
 
 /**
@@ -93,6 +149,7 @@ LIST_HEAD(delayed_threadlist, delayed_thread);
 
 struct delayed_thread {
 	pthread_t id;		/*< Thread id */
+	uint32_t shard;		/*< Index of the shard it serves */
 	 LIST_ENTRY(delayed_thread) link;	/*< Link in the thread list. */
 };
 
@@ -103,12 +160,15 @@ struct delayed_thread {
 
 /** list of all threads */
 static struct delayed_threadlist thread_list;
-/** Mutex for delayed execution */
+/** Mutex for the thread list and state */
 static pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
-/** Condition variable for delayed execution */
+/** Condition variable for shutdown */
 static pthread_cond_t cv = PTHREAD_COND_INITIALIZER;
-/** The timer tree */
-static struct avltree tree;
+/** The shards, one per thread */
+static struct delayed_shard *shards;
+static uint32_t nshards;
+/** Shard of the next submitter whose CPU is unknown */
+static uint32_t next_shard;
 
 /**
  * @brief Posssible states for the delayed executor
@@ -121,74 +181,286 @@ enum delayed_state {
 /** State for the executor */
 static enum delayed_state delayed_state;
 
-enum delayed_employment {
-	delayed_employed,	/*< Work is available, do it. */
-	delayed_on_break,	/*< Work is available, but wait for it */
-	delayed_unemployed	/*< No work is available, wait indefinitely */
-};
-
 /** @} */
 
-static int comparator(const struct avltree_node *a,
-		      const struct avltree_node *b)
+static inline uint64_t ts_to_tick(const struct timespec *ts)
+{
+	return ((uint64_t) ts->tv_sec * NS_PER_SEC + ts->tv_nsec) /
+	       DELAYED_TICK_NS;
+}
+
+static inline void tick_to_ts(uint64_t tick, struct timespec *ts)
+{
+	uint64_t ns = tick * DELAYED_TICK_NS;
+
+	ts->tv_sec = ns / NS_PER_SEC;
+	ts->tv_nsec = ns % NS_PER_SEC;
+}
+
+static inline uint64_t current_tick(void)
+{
+	struct timespec ts;
+
+	now(&ts);
+	return ts_to_tick(&ts);
+}
+
+/**
+ * @brief Put a task on a shard's wheel, or its ready list if it is due
+ *
+ * This function must be called with the shard's mutex held.
+ *
+ * @param[in,out] sh   The shard
+ * @param[in]     task The task, its expiry set
+ */
+
+static void wheel_insert(struct delayed_shard *sh, struct delayed_task *task)
+{
+	uint64_t expires = task->expires;
+	uint64_t delta;
+	uint32_t slot;
+	int level;
+
+	if (expires < sh->clock) {
+		glist_add_tail(&sh->ready, &task->link);
+		return;
+	}
+
+	delta = expires - sh->clock;
+	for (level = 0; level < DELAYED_LEVELS - 1; level++) {
+		if (delta < DELAYED_SPAN(level + 1))
+			break;
+	}
+
+	/* Past the top level, wait in its last slot to be put again */
+	if (delta >= DELAYED_SPAN(DELAYED_LEVELS))
+		expires = sh->clock + DELAYED_SPAN(DELAYED_LEVELS) - 1;
+
+	slot = (expires >> (DELAYED_WHEEL_BITS * level)) & DELAYED_WHEEL_MASK;
+	glist_add_tail(&sh->level[level].slot[slot], &task->link);
+	sh->level[level].occupied |= 1ULL << slot;
+	sh->pending++;
+}
+
+/**
+ * @brief Take the tasks off a slot
+ *
+ * @param[in,out] sh    The shard
+ * @param[in]     level Level of the slot
+ * @param[in]     slot  The slot
+ * @param[out]    list  Where to put its tasks
+ */
+
+static void wheel_take(struct delayed_shard *sh, int level, uint32_t slot,
+		       struct glist_head *list)
 {
-	struct delayed_multi *p =
-	    avltree_container_of(a, struct delayed_multi, node);
-	struct delayed_multi *q =
-	    avltree_container_of(b, struct delayed_multi, node);
+	struct delayed_level *lvl = &sh->level[level];
 
-	return gsh_time_cmp(&p->realtime, &q->realtime);
+	if (!(lvl->occupied & (1ULL << slot)))
+		return;
+
+	sh->pending -= glist_length(&lvl->slot[slot]);
+	glist_add_list_tail(list, &lvl->slot[slot]);
+	glist_init(&lvl->slot[slot]);
+	lvl->occupied &= ~(1ULL << slot);
 }
 
 /**
- * @brief Get a task to perform
+ * @brief Find the next tick with something to do
+ *
+ * That is the tick of the first task in level 0, or the first tick of
+ * the first slot to cascade in a higher level.
  *
- * This function must be called with the mutex held.
+ * This function must be called with the shard's mutex held.
  *
- * @param[out] when The time for which to wait, if there is one
- * @param[out] func The function to execute, if there is one
- * @param[out] arg  The argument to supply, if there is one
+ * @param[in] sh The shard
  *
- * @retval delayed_employed if there is a task to perform now.  Its
- *         argument and function are stored in @c arg and @c func.
- * @retval delayed_on_break if there is work but it is not to be
- *         performed yet.  The time at which it is to be performed is
- *         set in *when.
- * @retval delayed_unemployed if there is no work at all.  The caller
- *         should wait indefinitely to be signalled.
+ * @return The tick, UINT64_MAX if the wheel is empty.
  */
 
-static enum delayed_employment delayed_get_work(struct timespec *when,
-						void (**func) (void *),
-						void **arg)
+static uint64_t wheel_next(struct delayed_shard *sh)
 {
-	struct avltree_node *first = avltree_first(&tree);
-	struct delayed_multi *mul;
-	struct timespec current;
-	struct delayed_task *task;
+	uint64_t next = UINT64_MAX;
+	uint64_t clock = sh->clock;
+	int level;
+
+	if (sh->pending == 0)
+		return next;
+
+	for (level = 0; level < DELAYED_LEVELS; level++) {
+		int shift = DELAYED_WHEEL_BITS * level;
+		uint64_t occupied = sh->level[level].occupied;
+		uint64_t base = clock >> shift;
+		uint32_t rot = base & DELAYED_WHEEL_MASK;
+		uint64_t slots, period;
+
+		if (occupied == 0)
+			continue;
+
+		/* The slots in order from the clock's */
+		slots = rot ? (occupied >> rot) | (occupied << (64 - rot))
+			    : occupied;
+		period = base + __builtin_ctzll(slots);
+
+		/* The clock's own slot, once its period has begun, holds
+		 * tasks of the period a turn later.
+		 */
+		if ((period << shift) < clock) {
+			slots &= slots - 1;
+			period = slots ? base + __builtin_ctzll(slots)
+				       : base + DELAYED_WHEEL_SLOTS;
+		}
 
-	if (first == NULL)
-		return delayed_unemployed;
+		if ((period << shift) < next)
+			next = period << shift;
+	}
 
-	now(&current);
-	mul = avltree_container_of(first, struct delayed_multi, node);
+	return next;
+}
 
-	if (gsh_time_cmp(&mul->realtime, &current) > 0) {
-		*when = mul->realtime;
-		return delayed_on_break;
+/**
+ * @brief Move the tasks due by a tick to the ready list
+ *
+ * Ticks with nothing to do are skipped over.
+ *
+ * This function must be called with the shard's mutex held.
+ *
+ * @param[in,out] sh   The shard
+ * @param[in]     tick The current tick
+ */
+
+static void wheel_expire(struct delayed_shard *sh, uint64_t tick)
+{
+	struct glist_head cascade;
+	struct glist_head *glist, *glistn;
+	struct delayed_task *task;
+	uint64_t next;
+	int level;
+
+	while (sh->clock <= tick) {
+		next = wheel_next(sh);
+		if (next > tick) {
+			sh->clock = tick + 1;
+			return;
+		}
+
+		sh->clock = next;
+
+		/* Put the slots whose period begins now in lower levels */
+		for (level = DELAYED_LEVELS - 1; level > 0; level--) {
+			if ((next & (DELAYED_SPAN(level) - 1)) != 0)
+				continue;
+
+			glist_init(&cascade);
+			wheel_take(sh, level,
+				   (next >> (DELAYED_WHEEL_BITS * level)) &
+				   DELAYED_WHEEL_MASK, &cascade);
+			glist_for_each_safe(glist, glistn, &cascade) {
+				task = glist_entry(glist, struct delayed_task,
+						   link);
+				glist_del(glist);
+				wheel_insert(sh, task);
+			}
+		}
+
+		wheel_take(sh, 0, next & DELAYED_WHEEL_MASK, &sh->ready);
+		sh->clock = next + 1;
 	}
+}
 
-	task = LIST_FIRST(&mul->list);
-	*func = task->func;
-	*arg = task->arg;
-	LIST_REMOVE(task, link);
+/**
+ * @brief Get a task to perform from a shard
+ *
+ * This function must be called with the shard's mutex held.
+ *
+ * @param[in,out] sh The shard
+ *
+ * @return The task, NULL if none is due.
+ */
+
+static struct delayed_task *delayed_get_work(struct delayed_shard *sh)
+{
+	struct delayed_task *task;
+
+	wheel_expire(sh, current_tick());
+
+	task = glist_first_entry(&sh->ready, struct delayed_task, link);
+	if (task != NULL)
+		glist_del(&task->link);
+
+	return task;
+}
+
+/**
+ * @brief Perform a task, and free it
+ */
+
+static void delayed_run(struct delayed_task *task)
+{
+	task->func(task->arg);
 	gsh_free(task);
-	if (LIST_EMPTY(&mul->list)) {
-		avltree_remove(first, &tree);
-		gsh_free(mul);
+}
+
+/**
+ * @brief Wake the thread of an idle shard other than one
+ *
+ * @param[in] self Index of the shard not to wake
+ */
+
+static void delayed_wake_idle(uint32_t self)
+{
+	struct delayed_shard *sh;
+	uint32_t i;
+
+	for (i = 1; i < nshards; i++) {
+		sh = &shards[(self + i) % nshards];
+		if (!atomic_fetch_uint32_t(&sh->busy)) {
+			pthread_cond_signal(&sh->cv);
+			return;
+		}
 	}
+}
 
-	return delayed_employed;
+/**
+ * @brief Perform a task due on another shard
+ *
+ * Shards whose lock is taken are passed over, their thread is at work
+ * on them.
+ *
+ * @param[in]     self Index of the caller's shard
+ * @param[in,out] next Lowered to the next tick of a busy shard
+ *
+ * @retval true if a task was performed.
+ * @retval false if there was none to take.
+ */
+
+static bool delayed_steal(uint32_t self, uint64_t *next)
+{
+	struct delayed_shard *sh;
+	struct delayed_task *task;
+	uint64_t tick;
+	uint32_t i;
+
+	for (i = 1; i < nshards; i++) {
+		sh = &shards[(self + i) % nshards];
+		if (pthread_mutex_trylock(&sh->mtx) != 0)
+			continue;
+
+		task = delayed_get_work(sh);
+		if (task == NULL && sh->busy) {
+			tick = wheel_next(sh);
+			if (tick < *next)
+				*next = tick;
+		}
+		PTHREAD_MUTEX_unlock(&sh->mtx);
+
+		if (task != NULL) {
+			delayed_run(task);
+			return true;
+		}
+	}
+
+	return false;
 }
 
 /**
@@ -202,6 +474,7 @@ static enum delayed_employment delayed_get_work(struct timespec *when,
 void *delayed_thread(void *arg)
 {
 	struct delayed_thread *thr = arg;
+	struct delayed_shard *sh = &shards[thr->shard];
 	int old_type = 0;
 	int old_state = 0;
 	sigset_t old_sigmask;
@@ -218,28 +491,56 @@ void *delayed_thread(void *arg)
 
 	pthread_sigmask(SIG_SETMASK, NULL, &old_sigmask);
 
-	PTHREAD_MUTEX_lock(&mtx);
+	PTHREAD_MUTEX_lock(&sh->mtx);
 	while (delayed_state == delayed_running) {
+		struct delayed_task *task = delayed_get_work(sh);
+		uint64_t next = UINT64_MAX, own;
 		struct timespec then;
-		void (*func)(void *);
-		void *arg;
 
-		switch (delayed_get_work(&then, &func, &arg)) {
-		case delayed_unemployed:
-			pthread_cond_wait(&cv, &mtx);
-			break;
+		if (task != NULL) {
+			/* Let another thread help with the rest */
+			if (!glist_empty(&sh->ready) && nshards > 1)
+				delayed_wake_idle(thr->shard);
+
+			atomic_store_uint32_t(&sh->busy, 1);
+			PTHREAD_MUTEX_unlock(&sh->mtx);
+			delayed_run(task);
+			PTHREAD_MUTEX_lock(&sh->mtx);
+			atomic_store_uint32_t(&sh->busy, 0);
+			continue;
+		}
 
-		case delayed_on_break:
-			pthread_cond_timedwait(&cv, &mtx, &then);
-			break;
+		if (nshards > 1) {
+			bool stole;
 
-		case delayed_employed:
-			PTHREAD_MUTEX_unlock(&mtx);
-			func(arg);
-			PTHREAD_MUTEX_lock(&mtx);
-			break;
+			PTHREAD_MUTEX_unlock(&sh->mtx);
+			stole = delayed_steal(thr->shard, &next);
+			PTHREAD_MUTEX_lock(&sh->mtx);
+			if (stole)
+				continue;
+
+			/* Tasks may have come while unlocked */
+			if (!glist_empty(&sh->ready) ||
+			    delayed_state != delayed_running)
+				continue;
 		}
+
+		own = wheel_next(sh);
+		if (own < next)
+			next = own;
+		if (next == UINT64_MAX) {
+			sh->wakeup = UINT64_MAX;
+			pthread_cond_wait(&sh->cv, &sh->mtx);
+		} else {
+			sh->wakeup = next;
+			tick_to_ts(next, &then);
+			pthread_cond_timedwait(&sh->cv, &sh->mtx, &then);
+		}
+		sh->wakeup = 0;
 	}
+	PTHREAD_MUTEX_unlock(&sh->mtx);
+
+	PTHREAD_MUTEX_lock(&mtx);
 	LIST_REMOVE(thr, link);
 	if (LIST_EMPTY(&thread_list))
 		pthread_cond_broadcast(&cv);
@@ -256,19 +557,29 @@ void *delayed_thread(void *arg)
 
 void delayed_start(void)
 {
-	/* Make this a parameter later */
-	const size_t threads_to_start = 1;
+	/* A thread per CPU, up to DELAYED_MAX_SHARDS */
+	long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
 	/* Thread attributes */
 	pthread_attr_t attr;
-	/* Thread index */
-	int i;
+	/* Thread and slot index */
+	int i, j, level;
 
 	LIST_INIT(&thread_list);
-	avltree_init(&tree, comparator, 0);
 
-	if (threads_to_start == 0) {
-		LogFatal(COMPONENT_THREAD,
-			 "You can't execute tasks with zero threads.");
+	nshards = ncpus < 1 ? 1 : ncpus > DELAYED_MAX_SHARDS
+			? DELAYED_MAX_SHARDS : ncpus;
+	shards = gsh_calloc(nshards, sizeof(struct delayed_shard));
+
+	for (i = 0; i < nshards; i++) {
+		struct delayed_shard *sh = &shards[i];
+
+		PTHREAD_MUTEX_init(&sh->mtx, NULL);
+		PTHREAD_COND_init(&sh->cv, NULL);
+		sh->clock = current_tick();
+		glist_init(&sh->ready);
+		for (level = 0; level < DELAYED_LEVELS; level++)
+			for (j = 0; j < DELAYED_WHEEL_SLOTS; j++)
+				glist_init(&sh->level[level].slot[j]);
 	}
 
 	if (pthread_attr_init(&attr) != 0)
@@ -280,11 +591,12 @@ void delayed_start(void)
 	PTHREAD_MUTEX_lock(&mtx);
 	delayed_state = delayed_running;
 
-	for (i = 0; i < threads_to_start; ++i) {
+	for (i = 0; i < nshards; ++i) {
 		struct delayed_thread *thread =
 		    gsh_malloc(sizeof(struct delayed_thread));
 		int rc = 0;
 
+		thread->shard = i;
 		rc = pthread_create(&thread->id, &attr, delayed_thread, thread);
 		if (rc != 0) {
 			LogFatal(COMPONENT_THREAD,
@@ -303,13 +615,20 @@ void delayed_shutdown(void)
 {
 	int rc = -1;
 	struct timespec then;
+	uint32_t i;
 
 	now(&then);
 	then.tv_sec += 120;
 
+	/* The threads look at the state under their shard's lock */
 	PTHREAD_MUTEX_lock(&mtx);
+	for (i = 0; i < nshards; i++)
+		PTHREAD_MUTEX_lock(&shards[i].mtx);
 	delayed_state = delayed_stopping;
-	pthread_cond_broadcast(&cv);
+	for (i = 0; i < nshards; i++) {
+		pthread_cond_broadcast(&shards[i].cv);
+		PTHREAD_MUTEX_unlock(&shards[i].mtx);
+	}
 	while ((rc != ETIMEDOUT) && !LIST_EMPTY(&thread_list))
 		rc = pthread_cond_timedwait(&cv, &mtx, &then);
 
@@ -327,6 +646,21 @@ void delayed_shutdown(void)
 	PTHREAD_MUTEX_unlock(&mtx);
 }
 
+/**
+ * @brief Shard of the calling CPU
+ */
+
+static struct delayed_shard *delayed_shard_here(void)
+{
+#ifdef LINUX
+	int cpu = sched_getcpu();
+
+	if (cpu >= 0)
+		return &shards[cpu % nshards];
+#endif
+	return &shards[atomic_inc_uint32_t(&next_shard) % nshards];
+}
+
 /**
  * @brief Submit a new task
  *
@@ -340,36 +674,32 @@ void delayed_shutdown(void)
 
 int delayed_submit(void (*func) (void *), void *arg, nsecs_elapsed_t delay)
 {
-	struct delayed_multi *mul = NULL;
-	struct delayed_task *task = NULL;
-	struct avltree_node *collision = NULL;
-	struct avltree_node *first = NULL;
-
-	mul = gsh_malloc(sizeof(struct delayed_multi));
-	task = gsh_malloc(sizeof(struct delayed_task));
-
-	now(&mul->realtime);
-	timespec_add_nsecs(delay, &mul->realtime);
+	struct delayed_task *task = gsh_malloc(sizeof(struct delayed_task));
+	struct delayed_shard *sh = delayed_shard_here();
+	struct timespec when;
 
-	PTHREAD_MUTEX_lock(&mtx);
-	first = avltree_first(&tree);
-	collision = avltree_insert(&mul->node, &tree);
-	if (unlikely(collision)) {
-		gsh_free(mul);
-		/* There is already a node for this exact time in the
-		   tree.  Add our task to its list. */
-		mul =
-		    avltree_container_of(collision, struct delayed_multi, node);
-	} else {
-		LIST_INIT(&mul->list);
-	}
 	task->func = func;
 	task->arg = arg;
-	LIST_INSERT_HEAD(&mul->list, task, link);
-	if (!first || comparator(&mul->node, first) < 0)
-		pthread_cond_broadcast(&cv);
 
-	PTHREAD_MUTEX_unlock(&mtx);
+	/* The first tick at or after the time */
+	now(&when);
+	timespec_add_nsecs(delay, &when);
+	task->expires = ts_to_tick(&when);
+	if (when.tv_nsec % DELAYED_TICK_NS != 0)
+		task->expires++;
+
+	PTHREAD_MUTEX_lock(&sh->mtx);
+	wheel_insert(sh, task);
+
+	/* Wake the thread if it sleeps past the task, or another if it is
+	 * busy
+	 */
+	if (sh->wakeup != 0 && task->expires < sh->wakeup)
+		pthread_cond_signal(&sh->cv);
+	else if (sh->busy && nshards > 1)
+		delayed_wake_idle(sh - shards);
+
+	PTHREAD_MUTEX_unlock(&sh->mtx);
 
 	return 0;
 }
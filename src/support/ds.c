@@ -34,33 +34,47 @@
 #include "pnfs_utils.h"
 
 /**
- * @brief Servers are stored in an AVL tree with front-end cache.
+ * @brief Servers are stored in an AVL tree, and indexed by id.
  *
- * @note  number of cache slots should be prime.
+ * Every DS I/O looks its server up by the id in its handle, so the
+ * index is a two level table of the 16 bit ids, its pages allocated
+ * as servers are inserted: a lookup is two loads, never a tree walk.
  */
-#define SERVER_BY_ID_CACHE_SIZE 193
+#define SERVER_BY_ID_PAGE_SHIFT 8
+#define SERVER_BY_ID_PAGE_SIZE (1 << SERVER_BY_ID_PAGE_SHIFT)
+#define SERVER_BY_ID_PAGES (UINT16_MAX / SERVER_BY_ID_PAGE_SIZE + 1)
 
 struct server_by_id {
 	pthread_rwlock_t lock;
 	struct avltree t;
-	struct avltree_node *cache[SERVER_BY_ID_CACHE_SIZE];
+	struct fsal_pnfs_ds **index[SERVER_BY_ID_PAGES];
 };
 
 static struct server_by_id server_by_id;
 
 /**
- * @brief Compute cache slot for an entry
+ * @brief Find the index slot of a server id
  *
- * This function computes a hash slot, taking an address modulo the
- * number of cache slots (which should be prime).
+ * Called with server_by_id.lock held.
  *
- * @param k [in] Entry index value
+ * @param k     [in] Server id
+ * @param alloc [in] Allocate its page if missing, lock held for write
  *
- * @return The computed offset.
+ * @return The slot, NULL if its page is missing.
  */
-static inline uint16_t id_cache_offsetof(uint16_t k)
+static inline struct fsal_pnfs_ds **id_index_slot(uint16_t k, bool alloc)
 {
-	return k % SERVER_BY_ID_CACHE_SIZE;
+	struct fsal_pnfs_ds **page =
+		server_by_id.index[k >> SERVER_BY_ID_PAGE_SHIFT];
+
+	if (page == NULL) {
+		if (!alloc)
+			return NULL;
+		page = gsh_calloc(SERVER_BY_ID_PAGE_SIZE, sizeof(*page));
+		server_by_id.index[k >> SERVER_BY_ID_PAGE_SHIFT] = page;
+	}
+
+	return &page[k & (SERVER_BY_ID_PAGE_SIZE - 1)];
 }
 
 /**
@@ -115,8 +129,6 @@ void pnfs_ds_free(struct fsal_pnfs_ds *pds)
 bool pnfs_ds_insert(struct fsal_pnfs_ds *pds)
 {
 	struct avltree_node *node;
-	void **cache_slot = (void **)
-		&(server_by_id.cache[id_cache_offsetof(pds->id_servers)]);
 
 	/* we will hold a ref starting out... */
 	assert(pds->refcount == 1);
@@ -129,8 +141,8 @@ bool pnfs_ds_insert(struct fsal_pnfs_ds *pds)
 		return false;
 	}
 
-	/* update cache */
-	atomic_store_voidptr(cache_slot, &pds->ds_node);
+	/* update index */
+	*id_index_slot(pds->id_servers, true) = pds;
 
 	pnfs_ds_get_ref(pds);		/* == 2 */
 	if (pds->mds_export != NULL) {
@@ -156,40 +168,18 @@ bool pnfs_ds_insert(struct fsal_pnfs_ds *pds)
  */
 struct fsal_pnfs_ds *pnfs_ds_get(uint16_t id_servers)
 {
-	struct fsal_pnfs_ds v;
-	struct avltree_node *node;
+	struct fsal_pnfs_ds **slot;
 	struct fsal_pnfs_ds *pds;
-	void **cache_slot = (void **)
-		&(server_by_id.cache[id_cache_offsetof(id_servers)]);
 
-	v.id_servers = id_servers;
 	PTHREAD_RWLOCK_rdlock(&server_by_id.lock);
 
-	/* check cache */
-	node = (struct avltree_node *)atomic_fetch_voidptr(cache_slot);
-	if (node) {
-		pds = avltree_container_of(node, struct fsal_pnfs_ds, ds_node);
-		if (pds->id_servers == id_servers) {
-			/* got it in 1 */
-			LogDebug(COMPONENT_HASHTABLE_CACHE,
-				 "server_by_id cache hit slot %d",
-				 id_cache_offsetof(id_servers));
-			goto out;
-		}
-	}
-
-	/* fall back to AVL */
-	node = avltree_lookup(&v.ds_node, &server_by_id.t);
-	if (node) {
-		pds = avltree_container_of(node, struct fsal_pnfs_ds, ds_node);
-		/* update cache */
-		atomic_store_voidptr(cache_slot, node);
-	} else {
+	slot = id_index_slot(id_servers, false);
+	pds = slot != NULL ? *slot : NULL;
+	if (pds == NULL) {
 		PTHREAD_RWLOCK_unlock(&server_by_id.lock);
 		return NULL;
 	}
 
- out:
 	pnfs_ds_get_ref(pds);
 	if (pds->mds_export != NULL)
 		/* also bump related export for duration */
@@ -231,20 +221,14 @@ void pnfs_ds_remove(uint16_t id_servers, bool final)
 	struct fsal_pnfs_ds v;
 	struct avltree_node *node;
 	struct fsal_pnfs_ds *pds = NULL;
-	void **cache_slot = (void **)
-		&(server_by_id.cache[id_cache_offsetof(id_servers)]);
 
 	v.id_servers = id_servers;
 	PTHREAD_RWLOCK_wrlock(&server_by_id.lock);
 
 	node = avltree_lookup(&v.ds_node, &server_by_id.t);
 	if (node) {
-		struct avltree_node *cnode = (struct avltree_node *)
-			 atomic_fetch_voidptr(cache_slot);
-
-		/* Remove from the AVL cache and tree */
-		if (node == cnode)
-			atomic_store_voidptr(cache_slot, NULL);
+		/* Remove from the index and tree */
+		*id_index_slot(id_servers, false) = NULL;
 		avltree_remove(node, &server_by_id.t);
 
 		pds = avltree_container_of(node, struct fsal_pnfs_ds, ds_node);
@@ -486,5 +470,5 @@ void server_pkginit(void)
 #endif
 	PTHREAD_RWLOCK_init(&server_by_id.lock, &rwlock_attr);
 	avltree_init(&server_by_id.t, server_id_cmpf, 0);
-	memset(&server_by_id.cache, 0, sizeof(server_by_id.cache));
+	memset(&server_by_id.index, 0, sizeof(server_by_id.index));
 }
@@ -24,15 +24,29 @@
 #include "config.h"
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
+#include <errno.h>
 #include <pthread.h>
 #include <sys/stat.h>
 #include <time.h>
 #include "nfs_core.h"
 #include "nfs_exports.h"
-#include "external_tools.h"
 
 #include "common_utils.h"
+#include "abstract_atomic.h"
 #include "log.h"
+#include "err_inject.h"
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+
+/** The layer a latency injection call is about */
+#define ERR_INJECT_LAYER_ARG	\
+{				\
+	.name = "layer",	\
+	.type = "s",		\
+	.direction = "in"	\
+}
+#endif
 
 int worker_delay_time = 0;
 int next_worker_delay_time = 0;
@@ -103,3 +117,620 @@ int init_error_injector(void)
 	return 0;
 }
 #endif
+
+/* Latency injection
+ */
+
+/** The registered sets of points, and the lock on their settings */
+static struct glist_head err_inject_sets = GLIST_HEAD_INIT(err_inject_sets);
+static pthread_mutex_t err_inject_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** State of this thread's random numbers, for jitter and tails */
+static __thread uint64_t err_inject_seed;
+
+/**
+ * @brief A random number, xorshift64 seeded from the clock
+ */
+static uint64_t err_inject_random(void)
+{
+	uint64_t x = err_inject_seed;
+	struct timespec ts;
+
+	if (x == 0) {
+		now(&ts);
+		x = (timespec_to_nsecs(&ts) ^ (uint64_t) pthread_self()) | 1;
+	}
+
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	err_inject_seed = x;
+
+	return x;
+}
+
+/**
+ * @brief Count what is injected into a set
+ *
+ * Called with err_inject_mutex held.  The callers of the set skip it
+ * when there is nothing.
+ *
+ * @param[in] points The set
+ */
+static void err_inject_rearm(struct err_inject_points *points)
+{
+	struct err_inject_delay *d;
+	uint32_t armed = 0;
+	uint32_t op;
+
+	for (op = 0; op < points->count; op++) {
+		d = &points->delays[op];
+		if (d->base_us != 0 || d->jitter_us != 0 ||
+		    (d->tail_ppm != 0 && d->tail_us != 0))
+			armed++;
+	}
+
+	if (points->read.bytes_per_sec != 0)
+		armed++;
+	if (points->write.bytes_per_sec != 0)
+		armed++;
+
+	atomic_store_uint32_t(&points->armed, armed);
+}
+
+/**
+ * @brief Register a layer's points
+ *
+ * The delays must be zeroed, nothing is injected until they are set.
+ *
+ * @param[in] points The set, with name, op_names, delays and count
+ */
+void err_inject_register(struct err_inject_points *points)
+{
+	PTHREAD_MUTEX_init(&points->read.mtx, NULL);
+	PTHREAD_MUTEX_init(&points->write.mtx, NULL);
+	points->read.bytes_per_sec = 0;
+	points->write.bytes_per_sec = 0;
+	memset(&points->read.next, 0, sizeof(points->read.next));
+	memset(&points->write.next, 0, sizeof(points->write.next));
+
+	PTHREAD_MUTEX_lock(&err_inject_mutex);
+
+	err_inject_rearm(points);
+	glist_add_tail(&err_inject_sets, &points->list);
+
+	PTHREAD_MUTEX_unlock(&err_inject_mutex);
+
+	LogDebug(COMPONENT_INIT, "Latency injection points of %s registered",
+		 points->name);
+}
+
+/**
+ * @brief Unregister a layer's points
+ *
+ * @param[in] points The set
+ */
+void err_inject_unregister(struct err_inject_points *points)
+{
+	PTHREAD_MUTEX_lock(&err_inject_mutex);
+
+	glist_del(&points->list);
+
+	PTHREAD_MUTEX_unlock(&err_inject_mutex);
+
+	PTHREAD_MUTEX_destroy(&points->read.mtx);
+	PTHREAD_MUTEX_destroy(&points->write.mtx);
+}
+
+/**
+ * @brief Sleep, through signals
+ *
+ * @param[in] ns Nanoseconds
+ */
+static void err_inject_sleep(nsecs_elapsed_t ns)
+{
+	struct timespec ts;
+
+	nsecs_to_timespec(ns, &ts);
+
+	while (nanosleep(&ts, &ts) != 0 && errno == EINTR)
+		continue;
+}
+
+/**
+ * @brief Wait the delay of a point
+ *
+ * The settings may change under us, a call may see the old value of
+ * one and the new of another.
+ *
+ * @param[in] points Set of the point
+ * @param[in] op     The point
+ */
+void err_inject_wait(struct err_inject_points *points, uint32_t op)
+{
+	struct err_inject_delay *d;
+	uint64_t us, r = 0;
+	uint32_t jitter, tail_ppm;
+
+	if (atomic_fetch_uint32_t(&points->armed) == 0 || op >= points->count)
+		return;
+
+	d = &points->delays[op];
+	us = atomic_fetch_uint32_t(&d->base_us);
+	jitter = atomic_fetch_uint32_t(&d->jitter_us);
+	tail_ppm = atomic_fetch_uint32_t(&d->tail_ppm);
+
+	if (jitter != 0 || tail_ppm != 0)
+		r = err_inject_random();
+	if (jitter != 0)
+		us += (r & UINT32_MAX) % jitter;
+	if (tail_ppm != 0 && (r >> 32) % 1000000 < tail_ppm)
+		us += atomic_fetch_uint32_t(&d->tail_us);
+
+	if (us != 0)
+		err_inject_sleep(us * NS_PER_USEC);
+}
+
+/**
+ * @brief Pace bytes read or written to the cap of a set
+ *
+ * A cap does not build up credit while the layer is idle, a call
+ * after a pause waits its own bytes' worth.
+ *
+ * @param[in] points The set
+ * @param[in] write  Whether the bytes are written
+ * @param[in] bytes  Bytes of the call
+ */
+void err_inject_throttle(struct err_inject_points *points, bool write,
+			 uint64_t bytes)
+{
+	struct err_inject_rate *rate = write ? &points->write : &points->read;
+	struct timespec ts, until;
+	uint64_t bps;
+
+	if (atomic_fetch_uint32_t(&points->armed) == 0 || bytes == 0)
+		return;
+
+	bps = atomic_fetch_uint64_t(&rate->bytes_per_sec);
+	if (bps == 0)
+		return;
+
+	now(&ts);
+
+	PTHREAD_MUTEX_lock(&rate->mtx);
+
+	if (gsh_time_cmp(&rate->next, &ts) < 0)
+		rate->next = ts;
+	timespec_add_nsecs(bytes * NS_PER_SEC / bps, &rate->next);
+	until = rate->next;
+
+	PTHREAD_MUTEX_unlock(&rate->mtx);
+
+	while (clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &until,
+			       NULL) == EINTR)
+		continue;
+}
+
+#ifdef USE_DBUS
+
+/**
+ * @brief Find a registered set by name
+ *
+ * Called with err_inject_mutex held.
+ *
+ * @param[in]  args     Iterator on the name
+ * @param[out] errormsg Why there is no set
+ *
+ * @return The set, or NULL.
+ */
+static struct err_inject_points *err_inject_lookup(DBusMessageIter *args,
+						   char **errormsg)
+{
+	struct glist_head *glist;
+	struct err_inject_points *points;
+	char *name;
+
+	if (args == NULL ||
+	    dbus_message_iter_get_arg_type(args) != DBUS_TYPE_STRING) {
+		*errormsg = "layer is not a string";
+		return NULL;
+	}
+	dbus_message_iter_get_basic(args, &name);
+
+	glist_for_each(glist, &err_inject_sets) {
+		points = glist_entry(glist, struct err_inject_points, list);
+		if (strcasecmp(points->name, name) == 0)
+			return points;
+	}
+
+	*errormsg = "no such layer";
+	return NULL;
+}
+
+/**
+ * @brief Take the 32 bit integers of a call
+ *
+ * @param[in]  args     Iterator before the first of them
+ * @param[out] val      The integers
+ * @param[in]  count    How many
+ * @param[out] errormsg Why they are not valid
+ *
+ * @return true if there are count of them.
+ */
+static bool err_inject_uint32_args(DBusMessageIter *args, uint32_t *val,
+				   int count, char **errormsg)
+{
+	int ix;
+
+	for (ix = 0; ix < count; ++ix) {
+		if (!dbus_message_iter_next(args) ||
+		    dbus_message_iter_get_arg_type(args) != DBUS_TYPE_UINT32) {
+			*errormsg = "delays are not 32 bit integers";
+			return false;
+		}
+		dbus_message_iter_get_basic(args, &val[ix]);
+	}
+
+	return true;
+}
+
+/**
+ * @brief Set the delay of a point, or of all the points of a layer
+ *
+ * @param "layer"     [IN] Name of the layer, as "TRACE"
+ * @param "op"        [IN] Name of the point, "*" for all of them
+ * @param "base_us"   [IN] Delay of every call
+ * @param "jitter_us" [IN] Most added to it, taken uniformly
+ * @param "tail_ppm"  [IN] Calls in a million also waiting tail_us
+ * @param "tail_us"   [IN] Delay of those calls
+ *
+ * @return status
+ */
+static bool err_inject_set_delay(DBusMessageIter *args,
+				 DBusMessage *reply,
+				 DBusError *error)
+{
+	struct err_inject_points *points;
+	struct err_inject_delay *d;
+	DBusMessageIter iter;
+	char *errormsg = "OK";
+	bool success = false;
+	uint32_t val[4];
+	char *name = NULL;
+	uint32_t op;
+
+	dbus_message_iter_init_append(reply, &iter);
+
+	PTHREAD_MUTEX_lock(&err_inject_mutex);
+
+	points = err_inject_lookup(args, &errormsg);
+	if (points == NULL)
+		goto out;
+
+	if (!dbus_message_iter_next(args) ||
+	    dbus_message_iter_get_arg_type(args) != DBUS_TYPE_STRING) {
+		errormsg = "op is not a string";
+		goto out;
+	}
+	dbus_message_iter_get_basic(args, &name);
+
+	if (!err_inject_uint32_args(args, val, 4, &errormsg))
+		goto out;
+
+	if (val[2] > 1000000) {
+		errormsg = "tail_ppm is over a million";
+		goto out;
+	}
+
+	for (op = 0; op < points->count; op++) {
+		if (strcmp(name, "*") != 0 &&
+		    strcasecmp(name, points->op_names[op]) != 0)
+			continue;
+
+		d = &points->delays[op];
+		atomic_store_uint32_t(&d->base_us, val[0]);
+		atomic_store_uint32_t(&d->jitter_us, val[1]);
+		atomic_store_uint32_t(&d->tail_ppm, val[2]);
+		atomic_store_uint32_t(&d->tail_us, val[3]);
+		success = true;
+	}
+
+	if (!success) {
+		errormsg = "no such op";
+		goto out;
+	}
+
+	err_inject_rearm(points);
+
+	LogEvent(COMPONENT_DBUS,
+		 "Delay of %s %s set to %" PRIu32 " us, jitter %" PRIu32
+		 " us, %" PRIu32 " ppm of %" PRIu32 " us",
+		 points->name, name, val[0], val[1], val[2], val[3]);
+
+out:
+	PTHREAD_MUTEX_unlock(&err_inject_mutex);
+
+	dbus_status_reply(&iter, success, errormsg);
+	return true;
+}
+
+static struct gsh_dbus_method err_inject_method_set_delay = {
+	.name = "SetDelay",
+	.method = err_inject_set_delay,
+	.args = {ERR_INJECT_LAYER_ARG,
+		 {
+		  .name = "op",
+		  .type = "s",
+		  .direction = "in"
+		 },
+		 {
+		  .name = "base_us",
+		  .type = "u",
+		  .direction = "in"
+		 },
+		 {
+		  .name = "jitter_us",
+		  .type = "u",
+		  .direction = "in"
+		 },
+		 {
+		  .name = "tail_ppm",
+		  .type = "u",
+		  .direction = "in"
+		 },
+		 {
+		  .name = "tail_us",
+		  .type = "u",
+		  .direction = "in"
+		 },
+		 STATUS_REPLY,
+		 END_ARG_LIST}
+};
+
+/**
+ * @brief Cap the bytes a layer reads and writes a second
+ *
+ * @param "layer" [IN] Name of the layer
+ * @param "read"  [IN] Bytes read a second, 0 for no cap
+ * @param "write" [IN] Bytes written a second, 0 for no cap
+ *
+ * @return status
+ */
+static bool err_inject_set_throughput(DBusMessageIter *args,
+				      DBusMessage *reply,
+				      DBusError *error)
+{
+	struct err_inject_points *points;
+	DBusMessageIter iter;
+	char *errormsg = "OK";
+	bool success = false;
+	uint64_t val[2];
+	int ix;
+
+	dbus_message_iter_init_append(reply, &iter);
+
+	PTHREAD_MUTEX_lock(&err_inject_mutex);
+
+	points = err_inject_lookup(args, &errormsg);
+	if (points == NULL)
+		goto out;
+
+	for (ix = 0; ix < 2; ++ix) {
+		if (!dbus_message_iter_next(args) ||
+		    dbus_message_iter_get_arg_type(args) != DBUS_TYPE_UINT64) {
+			errormsg = "caps are not 64 bit integers";
+			goto out;
+		}
+		dbus_message_iter_get_basic(args, &val[ix]);
+	}
+
+	atomic_store_uint64_t(&points->read.bytes_per_sec, val[0]);
+	atomic_store_uint64_t(&points->write.bytes_per_sec, val[1]);
+	err_inject_rearm(points);
+	success = true;
+
+	LogEvent(COMPONENT_DBUS,
+		 "Throughput of %s capped to %" PRIu64 " bytes/s read, %"
+		 PRIu64 " bytes/s written", points->name, val[0], val[1]);
+
+out:
+	PTHREAD_MUTEX_unlock(&err_inject_mutex);
+
+	dbus_status_reply(&iter, success, errormsg);
+	return true;
+}
+
+static struct gsh_dbus_method err_inject_method_set_throughput = {
+	.name = "SetThroughput",
+	.method = err_inject_set_throughput,
+	.args = {ERR_INJECT_LAYER_ARG,
+		 {
+		  .name = "read",
+		  .type = "t",
+		  .direction = "in"
+		 },
+		 {
+		  .name = "write",
+		  .type = "t",
+		  .direction = "in"
+		 },
+		 STATUS_REPLY,
+		 END_ARG_LIST}
+};
+
+/**
+ * @brief Take all the delays and caps off a layer
+ *
+ * @param "layer" [IN] Name of the layer
+ *
+ * @return status
+ */
+static bool err_inject_clear(DBusMessageIter *args,
+			     DBusMessage *reply,
+			     DBusError *error)
+{
+	struct err_inject_points *points;
+	struct err_inject_delay *d;
+	DBusMessageIter iter;
+	char *errormsg = "OK";
+	bool success = false;
+	uint32_t op;
+
+	dbus_message_iter_init_append(reply, &iter);
+
+	PTHREAD_MUTEX_lock(&err_inject_mutex);
+
+	points = err_inject_lookup(args, &errormsg);
+	if (points == NULL)
+		goto out;
+
+	for (op = 0; op < points->count; op++) {
+		d = &points->delays[op];
+		atomic_store_uint32_t(&d->base_us, 0);
+		atomic_store_uint32_t(&d->jitter_us, 0);
+		atomic_store_uint32_t(&d->tail_ppm, 0);
+		atomic_store_uint32_t(&d->tail_us, 0);
+	}
+	atomic_store_uint64_t(&points->read.bytes_per_sec, 0);
+	atomic_store_uint64_t(&points->write.bytes_per_sec, 0);
+	err_inject_rearm(points);
+	success = true;
+
+	LogEvent(COMPONENT_DBUS, "Latency injection of %s cleared",
+		 points->name);
+
+out:
+	PTHREAD_MUTEX_unlock(&err_inject_mutex);
+
+	dbus_status_reply(&iter, success, errormsg);
+	return true;
+}
+
+static struct gsh_dbus_method err_inject_method_clear = {
+	.name = "Clear",
+	.method = err_inject_clear,
+	.args = {ERR_INJECT_LAYER_ARG,
+		 STATUS_REPLY,
+		 END_ARG_LIST}
+};
+
+/**
+ * @brief Report what is injected into a layer
+ *
+ * Only the points with a delay are listed.
+ *
+ * @param "layer" [IN] Name of the layer
+ *
+ * @return status, the delays as (op, base_us, jitter_us, tail_ppm,
+ *         tail_us) and the read and write caps.
+ */
+static bool err_inject_get(DBusMessageIter *args,
+			   DBusMessage *reply,
+			   DBusError *error)
+{
+	struct err_inject_points *points;
+	struct err_inject_delay *d;
+	DBusMessageIter iter, array_iter, struct_iter;
+	char *errormsg = "OK";
+	bool success = false;
+	uint64_t bps;
+	uint32_t op;
+
+	dbus_message_iter_init_append(reply, &iter);
+
+	PTHREAD_MUTEX_lock(&err_inject_mutex);
+
+	points = err_inject_lookup(args, &errormsg);
+	success = points != NULL;
+	dbus_status_reply(&iter, success, errormsg);
+	if (!success)
+		goto out;
+
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					 "(suuuu)", &array_iter);
+	for (op = 0; op < points->count; op++) {
+		d = &points->delays[op];
+		if (d->base_us == 0 && d->jitter_us == 0 &&
+		    (d->tail_ppm == 0 || d->tail_us == 0))
+			continue;
+
+		dbus_message_iter_open_container(&array_iter,
+						 DBUS_TYPE_STRUCT, NULL,
+						 &struct_iter);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &points->op_names[op]);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+					       &d->base_us);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+					       &d->jitter_us);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+					       &d->tail_ppm);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+					       &d->tail_us);
+		dbus_message_iter_close_container(&array_iter, &struct_iter);
+	}
+	dbus_message_iter_close_container(&iter, &array_iter);
+
+	bps = points->read.bytes_per_sec;
+	dbus_message_iter_append_basic(&iter, DBUS_TYPE_UINT64, &bps);
+	bps = points->write.bytes_per_sec;
+	dbus_message_iter_append_basic(&iter, DBUS_TYPE_UINT64, &bps);
+
+out:
+	PTHREAD_MUTEX_unlock(&err_inject_mutex);
+
+	return true;
+}
+
+static struct gsh_dbus_method err_inject_method_get = {
+	.name = "GetDelays",
+	.method = err_inject_get,
+	.args = {ERR_INJECT_LAYER_ARG,
+		 STATUS_REPLY,
+		 {
+		  .name = "delays",
+		  .type = "a(suuuu)",
+		  .direction = "out"
+		 },
+		 {
+		  .name = "read",
+		  .type = "t",
+		  .direction = "out"
+		 },
+		 {
+		  .name = "write",
+		  .type = "t",
+		  .direction = "out"
+		 },
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method *err_inject_methods[] = {
+	&err_inject_method_set_delay,
+	&err_inject_method_set_throughput,
+	&err_inject_method_clear,
+	&err_inject_method_get,
+	NULL
+};
+
+static struct gsh_dbus_interface err_inject_table = {
+	.name = "org.ganesha.nfsd.errinject",
+	.props = NULL,
+	.methods = err_inject_methods,
+	.signals = NULL
+};
+
+static struct gsh_dbus_interface *err_inject_interfaces[] = {
+	&err_inject_table,
+	NULL
+};
+
+/**
+ * @brief Register the latency injection DBus interface
+ */
+void dbus_err_inject_init(void)
+{
+	gsh_dbus_register_path("ErrInject", err_inject_interfaces);
+}
+
+#endif				/* USE_DBUS */
@@ -64,6 +64,12 @@
 #include "nfs_exports.h"
 #include "nfs_proto_functions.h"
 #include "pnfs_utils.h"
+#include "sal_functions.h"
+#include "gsh_hash.h"
+#include "idmapper.h"
+#include "gsh_cache.h"
+#include "hot_sampler.h"
+#include "layout_stats.h"
 
 /**
  * @brief Exports are stored in an AVL tree with front-end cache.
@@ -80,6 +86,40 @@ struct export_by_id {
 
 static struct export_by_id export_by_id;
 
+/**
+ * @brief Exports are also found by path, on a trie of path components.
+ *
+ * A node is a path, the root is the empty path.  The path "/" has one
+ * empty component, every other absolute path starts with one.  The
+ * exports on a node are in the order they were inserted.  Protected by
+ * export_by_id.lock.
+ */
+struct export_path_node {
+	struct avltree_node node_k;
+	struct avltree children;
+	struct export_path_node *parent;
+	struct glist_head exports;
+	/** The last component of the path */
+	const char *name;
+	size_t len;
+	char buf[];
+};
+
+static struct export_path_node *export_by_path;
+static struct export_path_node *export_by_pseudo;
+
+/**
+ * @brief And by tag, in a hash table.
+ *
+ * @note  number of buckets should be prime.
+ */
+#define EXPORT_BY_TAG_SIZE 769
+
+static struct glist_head export_by_tag[EXPORT_BY_TAG_SIZE];
+
+/** Generation of the export permissions clients cached, never 0 */
+uint64_t export_perms_gen = 1;
+
 /** List of all active exports,
   * protected by export_by_id.lock
   */
@@ -231,6 +271,8 @@ struct gsh_export *alloc_export(void)
 	glist_init(&export->clients);
 
 	PTHREAD_RWLOCK_init(&export->lock, NULL);
+	PTHREAD_MUTEX_init(&export->lazy_mtx, NULL);
+	qos_bucket_init(&export->qos);
 
 	return export;
 }
@@ -250,12 +292,166 @@ void free_export(struct gsh_export *export)
 
 	/* free resources */
 	free_export_resources(export);
+	PTHREAD_MUTEX_destroy(&export->lazy_mtx);
+	qos_bucket_destroy(&export->qos);
 	export_st = container_of(export, struct export_stats, export);
 	server_stats_free(&export_st->st);
 	gsh_free(export_st);
 	PTHREAD_RWLOCK_destroy(&export->lock);
 }
 
+static int export_path_cmpf(const struct avltree_node *lhs,
+			    const struct avltree_node *rhs)
+{
+	struct export_path_node *lk, *rk;
+
+	lk = avltree_container_of(lhs, struct export_path_node, node_k);
+	rk = avltree_container_of(rhs, struct export_path_node, node_k);
+
+	if (lk->len != rk->len)
+		return lk->len < rk->len ? -1 : 1;
+
+	return memcmp(lk->name, rk->name, lk->len);
+}
+
+static struct export_path_node *export_path_node_alloc(const char *name,
+						       size_t len)
+{
+	struct export_path_node *node;
+
+	node = gsh_calloc(1, sizeof(*node) + len);
+	avltree_init(&node->children, export_path_cmpf, 0);
+	glist_init(&node->exports);
+	memcpy(node->buf, name, len);
+	node->name = node->buf;
+	node->len = len;
+
+	return node;
+}
+
+/**
+ * @brief Length of a path, ignoring a trailing '/'
+ */
+
+static inline size_t export_path_len(const char *path)
+{
+	size_t len = strlen(path);
+
+	if (len > 0 && path[len - 1] == '/')
+		len--;
+
+	return len;
+}
+
+/**
+ * @brief Find the child of a node for the path component at *path
+ *
+ * @param[in]     node    The node
+ * @param[in,out] path    The component, moved past it
+ * @param[in]     end     End of the path
+ * @param[in]     create  Add the child if it is missing
+ */
+
+static struct export_path_node *export_path_child(struct export_path_node
+						  *node, const char **path,
+						  const char *end,
+						  bool create)
+{
+	const char *next = memchr(*path, '/', end - *path);
+	struct export_path_node *child;
+	struct avltree_node *found;
+	struct export_path_node v;
+
+	if (next == NULL)
+		next = end;
+
+	v.name = *path;
+	v.len = next - *path;
+
+	found = avltree_lookup(&v.node_k, &node->children);
+	if (found != NULL) {
+		child = avltree_container_of(found, struct export_path_node,
+					     node_k);
+	} else if (create) {
+		child = export_path_node_alloc(*path, v.len);
+		child->parent = node;
+		avltree_insert(&child->node_k, &node->children);
+	} else {
+		return NULL;
+	}
+
+	*path = next + 1;
+
+	return child;
+}
+
+static struct export_path_node *export_path_add(struct export_path_node *root,
+						const char *path)
+{
+	const char *end = path + export_path_len(path);
+	struct export_path_node *node = root;
+
+	while (path <= end)
+		node = export_path_child(node, &path, end, true);
+
+	return node;
+}
+
+/**
+ * @brief Take an export with no path left off a node, and prune it
+ */
+
+static void export_path_del(struct export_path_node *node,
+			    struct glist_head *link)
+{
+	struct export_path_node *parent;
+
+	glist_del(link);
+
+	while (node->parent != NULL && glist_empty(&node->exports) &&
+	       avltree_size(&node->children) == 0) {
+		parent = node->parent;
+		avltree_remove(&node->node_k, &parent->children);
+		gsh_free(node);
+		node = parent;
+	}
+}
+
+/**
+ * @brief Find the deepest node on the trie path with exports
+ *
+ * @param[in] root         The trie
+ * @param[in] path         The path
+ * @param[in] exact_match  The node must be the path itself
+ */
+
+static struct export_path_node *export_path_find(struct export_path_node *root,
+						 const char *path,
+						 bool exact_match)
+{
+	const char *end = path + export_path_len(path);
+	struct export_path_node *node = root;
+	struct export_path_node *found = NULL;
+
+	while (node != NULL) {
+		if (!glist_empty(&node->exports))
+			found = node;
+		if (path > end)
+			break;
+		node = export_path_child(node, &path, end, false);
+	}
+
+	if (exact_match && (node == NULL || found != node))
+		return NULL;
+
+	return found;
+}
+
+static inline struct glist_head *export_tag_bucket(const char *tag)
+{
+	return &export_by_tag[gsh_hash64(tag, strlen(tag), 0) %
+			      EXPORT_BY_TAG_SIZE];
+}
 
 /**
  * @brief Insert an export list entry into the export manager
@@ -291,7 +487,26 @@ bool insert_gsh_export(struct gsh_export *export)
 	glist_add_tail(&exportlist, &export->exp_list);
 	get_gsh_export_ref(export);		/* == 2 */
 
+	export->exp_path_node = export_path_add(export_by_path,
+						export->fullpath);
+	glist_add_tail(&export->exp_path_node->exports,
+		       &export->exp_path_list);
+
+	if (export->pseudopath != NULL) {
+		export->exp_pseudo_node = export_path_add(export_by_pseudo,
+							  export->pseudopath);
+		glist_add_tail(&export->exp_pseudo_node->exports,
+			       &export->exp_pseudo_list);
+	}
+
+	if (export->FS_tag != NULL)
+		glist_add_tail(export_tag_bucket(export->FS_tag),
+			       &export->exp_tag_list);
+
 	PTHREAD_RWLOCK_unlock(&export_by_id.lock);
+
+	/* Clients may have cached permissions of an export by this id */
+	export_perms_changed();
 	return true;
 }
 
@@ -350,9 +565,9 @@ struct gsh_export *get_gsh_export(uint16_t export_id)
 /**
  * @brief Lookup the export manager struct by export path
  *
- * Gets an export entry from its path using a substring match and
- * linear search of the export list, assumes being called with
- * export manager lock held (such as from within foreach_gsh_export.
+ * Gets an export entry from its path, the one with the longest path
+ * the path is in, assumes being called with export manager lock held
+ * (such as from within foreach_gsh_export.
  * If path has a trailing '/', ignore it.
  *
  * @param path        [IN] the path for the entry to be found.
@@ -364,71 +579,25 @@ struct gsh_export *get_gsh_export(uint16_t export_id)
 struct gsh_export *get_gsh_export_by_path_locked(char *path,
 						 bool exact_match)
 {
+	struct export_path_node *node;
 	struct gsh_export *export;
-	struct glist_head *glist;
-	int len_path = strlen(path);
-	int len_export;
-	struct gsh_export *ret_exp = NULL;
-	int len_ret = 0;
-
-	if (len_path > 1 && path[len_path - 1] == '/')
-		len_path--;
-
-	glist_for_each(glist, &exportlist) {
-		export = glist_entry(glist, struct gsh_export, exp_list);
-
-		len_export = strlen(export->fullpath);
-
-		if (len_path == 0 && len_export == 1) {
-			/* Special case for root match */
-			ret_exp = export;
-			len_ret = len_export;
-			break;
-		}
-
-		/* A path shorter than the full path cannot match.
-		 * Also skip if this export has a shorter path than
-		 * the previous match.
-		 */
-		if (len_path < len_export ||
-		    len_export < len_ret)
-			continue;
-
-		/* If partial match is not allowed, lengths must be the same */
-		if (exact_match && len_path != len_export)
-			continue;
-
-		/* if the char in fullpath just after the end of path is not '/'
-		 * it is a name token longer, i.e. /mnt/foo != /mnt/foob/
-		 */
-		if (len_export > 1 &&
-		    path[len_export] != '/' &&
-		    path[len_export] != '\0')
-			continue;
-
-		/* we agree on size, now compare the leading substring
-		 */
-		if (strncmp(export->fullpath, path, len_export) == 0) {
-			ret_exp = export;
-			len_ret = len_export;
 
-			/* If we have found an exact match, exit loop. */
-			if (len_export == len_path)
-				break;
-		}
-	}
+	node = export_path_find(export_by_path, path, exact_match);
+	if (node == NULL)
+		return NULL;
 
-	if (ret_exp != NULL)
-		get_gsh_export_ref(ret_exp);
+	export = glist_first_entry(&node->exports, struct gsh_export,
+				   exp_path_list);
+	get_gsh_export_ref(export);
 
-	return ret_exp;
+	return export;
 }
 
 /**
  * @brief Lookup the export manager struct by export path
  *
- * Gets an export entry from its path using a substring match and
- * linear search of the export list.
+ * Gets an export entry from its path, the one with the longest path
+ * the path is in.
  * If path has a trailing '/', ignore it.
  *
  * @param path        [IN] the path for the entry to be found.
@@ -466,74 +635,23 @@ struct gsh_export *get_gsh_export_by_path(char *path, bool exact_match)
 struct gsh_export *get_gsh_export_by_pseudo_locked(char *path,
 						   bool exact_match)
 {
+	struct export_path_node *node;
 	struct gsh_export *export;
-	struct glist_head *glist;
-	int len_path = strlen(path);
-	int len_export;
-	struct gsh_export *ret_exp = NULL;
-	int len_ret = 0;
-
-	/* Ignore trailing slash in path */
-	if (len_path > 1 && path[len_path - 1] == '/')
-		len_path--;
-
-	glist_for_each(glist, &exportlist) {
-		export = glist_entry(glist, struct gsh_export, exp_list);
-
-		if (export->pseudopath == NULL)
-			continue;
-
-		len_export = strlen(export->pseudopath);
-
-		LogFullDebug(COMPONENT_EXPORT,
-			     "Comparing %s %d to %s %d",
-			     path, len_path,
-			     export->pseudopath, len_export);
-
-		if (len_path == 0 && len_export == 1) {
-			/* Special case for Pseudo root match */
-			ret_exp = export;
-			len_ret = len_export;
-			break;
-		}
-
-		/* A path shorter than the full path cannot match.
-		 * Also skip if this export has a shorter path than
-		 * the previous match.
-		 */
-		if (len_path < len_export ||
-		    len_export < len_ret)
-			continue;
 
-		/* If partial match is not allowed, lengths must be the same */
-		if (exact_match && len_path != len_export)
-			continue;
+	node = export_path_find(export_by_pseudo, path, exact_match);
+	if (node == NULL)
+		return NULL;
 
-		/* if the char in pseudopath just after the end of path is not
-		 * '/' it is a name token longer, i.e. /mnt/foo != /mnt/foob/
-		 */
-		if (len_export > 1 &&
-		    path[len_export] != '/' &&
-		    path[len_export] != '\0')
-			continue;
+	export = glist_first_entry(&node->exports, struct gsh_export,
+				   exp_pseudo_list);
 
-		/* we agree on size, now compare the leading substring
-		 */
-		if (strncmp(export->pseudopath, path, len_export)
-		    == 0) {
-			ret_exp = export;
-			len_ret = len_export;
-
-			/* If we have found an exact match, exit loop. */
-			if (len_export == len_path)
-				break;
-		}
-	}
+	LogFullDebug(COMPONENT_EXPORT,
+		     "Pseudo path %s is in %s",
+		     path, export->pseudopath);
 
-	if (ret_exp != NULL)
-		get_gsh_export_ref(ret_exp);
+	get_gsh_export_ref(export);
 
-	return ret_exp;
+	return export;
 }
 
 /**
@@ -576,11 +694,10 @@ struct gsh_export *get_gsh_export_by_tag(char *tag)
 	struct glist_head *glist;
 
 	PTHREAD_RWLOCK_rdlock(&export_by_id.lock);
-	glist_for_each(glist, &exportlist) {
-		export = glist_entry(glist, struct gsh_export, exp_list);
+	glist_for_each(glist, export_tag_bucket(tag)) {
+		export = glist_entry(glist, struct gsh_export, exp_tag_list);
 
-		if (export->FS_tag != NULL &&
-		    !strcmp(export->FS_tag, tag))
+		if (!strcmp(export->FS_tag, tag))
 			goto out;
 	}
 	PTHREAD_RWLOCK_unlock(&export_by_id.lock);
@@ -632,6 +749,50 @@ void put_gsh_export(struct gsh_export *export)
 	free_export(export);
 }
 
+/**
+ * @brief Take the FSAL export of an idle Lazy_Init export
+ *
+ * The export is idle if it was last used before a time and nothing
+ * but the export table and the caller holds it: no request, state,
+ * lock, share or export mounted on it.  Under the export table lock,
+ * nobody can get a new reference while it is marked inactive, so any
+ * later user finds it inactive and activates it again.
+ *
+ * The caller holds a reference and the export's lazy_mtx.
+ *
+ * @param[in]  export      The export
+ * @param[in]  before      Last use, in seconds, it must be older than
+ * @param[out] fsal_export The FSAL export, now the caller's to release
+ *
+ * @return true if the export was idle and is now inactive.
+ */
+
+bool export_lazy_idle(struct gsh_export *export, uint64_t before,
+		      struct fsal_export **fsal_export)
+{
+	bool idle;
+
+	PTHREAD_RWLOCK_wrlock(&export_by_id.lock);
+
+	idle = export->lazy_active &&
+	       atomic_fetch_int64_t(&export->refcnt) == 2 &&
+	       atomic_fetch_uint64_t(&export->lazy_last_use) < before &&
+	       glist_empty(&export->exp_state_list) &&
+	       glist_empty(&export->exp_lock_list) &&
+	       glist_empty(&export->exp_nlm_share_list) &&
+	       glist_empty(&export->mounted_exports_list);
+
+	if (idle) {
+		atomic_store_uint8_t(&export->lazy_active, false);
+		*fsal_export = export->fsal_export;
+		atomic_store_voidptr((void **)&export->fsal_export, NULL);
+	}
+
+	PTHREAD_RWLOCK_unlock(&export_by_id.lock);
+
+	return idle;
+}
+
 /**
  * @brief Remove the export management struct
  *
@@ -664,12 +825,26 @@ void remove_gsh_export(uint16_t export_id)
 		/* Remove the export from the export list */
 		glist_del(&export->exp_list);
 
+		export_path_del(export->exp_path_node,
+				&export->exp_path_list);
+		if (export->exp_pseudo_node != NULL)
+			export_path_del(export->exp_pseudo_node,
+					&export->exp_pseudo_list);
+		export->exp_path_node = NULL;
+		export->exp_pseudo_node = NULL;
+
+		if (export->FS_tag != NULL)
+			glist_del(&export->exp_tag_list);
+
 		/* No new references will be granted. Idempotent. */
 		export->export_status = EXPORT_STALE;
 	}
 
 	PTHREAD_RWLOCK_unlock(&export_by_id.lock);
 
+	if (export != NULL)
+		export_perms_changed();
+
 	/* removal has a once-only semantic */
 	if (export != NULL) {
 		if (export->has_pnfs_ds) {
@@ -1430,12 +1605,63 @@ static struct gsh_dbus_method export_update_export = {
 		 END_ARG_LIST}
 };
 
+/**
+ * @brief Change the QoS limits of an export
+ *
+ * They last until the export is updated or the server restarts.
+ *
+ * @param "id"     [IN] Export id
+ * @param "limits" [IN] IOPS, IOPS burst, bandwidth, bandwidth burst
+ *
+ * @return        status
+ */
+
+static bool gsh_export_setqos(DBusMessageIter *args,
+			      DBusMessage *reply,
+			      DBusError *error)
+{
+	struct gsh_export *export;
+	struct qos_limits limits;
+	bool success = false;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	export = lookup_export(args, &errormsg);
+	if (export != NULL) {
+		dbus_message_iter_next(args);
+		success = qos_dbus_limits(args, &limits, &errormsg);
+		if (success) {
+			export->qos_limits = limits;
+			qos_bucket_set(&export->qos, &limits);
+			LogInfo(COMPONENT_EXPORT,
+				"QoS of export %d set to %" PRIu32
+				" IOPS and %" PRIu64 " bytes/s",
+				export->export_id, limits.iops,
+				limits.bandwidth);
+		}
+		put_gsh_export(export);
+	}
+	dbus_status_reply(&iter, success, errormsg);
+	return true;
+}
+
+static struct gsh_dbus_method export_set_qos = {
+	.name = "SetQoS",
+	.method = gsh_export_setqos,
+	.args = {ID_ARG,
+		 QOS_LIMITS_ARGS,
+		 STATUS_REPLY,
+		 END_ARG_LIST}
+};
+
 static struct gsh_dbus_method *export_mgr_methods[] = {
 	&export_add_export,
 	&export_remove_export,
 	&export_display_export,
 	&export_show_exports,
 	&export_update_export,
+	&export_set_qos,
 	NULL
 };
 
@@ -1683,7 +1909,13 @@ static bool get_nfsv_global_fast_ops(DBusMessageIter *args,
 	return true;
 }
 
-static bool show_cache_inode_stats(DBusMessageIter *args,
+/**
+ * @brief Report the per stage latency histograms
+ *
+ * Stages are decode, queue, execute and encode.  Only operations and
+ * stages that have seen requests are listed.
+ */
+static bool get_latency_histograms(DBusMessageIter *args,
 				   DBusMessage *reply,
 				   DBusError *error)
 {
@@ -1691,96 +1923,825 @@ static bool show_cache_inode_stats(DBusMessageIter *args,
 	char *errormsg = "OK";
 	DBusMessageIter iter;
 
+	if (!nfs_param.core_param.enable_latency_hist) {
+		success = false;
+		errormsg = "Latency histograms are not enabled";
+	}
+
 	dbus_message_iter_init_append(reply, &iter);
 	dbus_status_reply(&iter, success, errormsg);
 
-	mdcache_dbus_show(&iter);
+	server_dbus_latency_hist(&iter);
 
 	return true;
 }
 
-static struct gsh_dbus_method export_show_v41_layouts = {
-	.name = "GetNFSv41Layouts",
-	.method = get_nfsv41_export_layouts,
-	.args = {EXPORT_ID_ARG,
-		 STATUS_REPLY,
-		 TIMESTAMP_REPLY,
-		 LAYOUTS_REPLY,
-		 END_ARG_LIST}
-};
-
-#ifdef _USE_9P
 /**
- * DBUS method to report 9p I/O statistics
+ * @brief Report the general allocations made per operation
  *
+ * Counted around each service function, and each NFSv4 operation of a
+ * COMPOUND, when built with USE_MEM_ACCOUNTING.
+ *
+ * @return
+ *	status
+ *	error message
+ *	time
+ *	array of (program, operation, calls, allocations, frees)
  */
-static bool get_9p_export_io(DBusMessageIter *args,
-			     DBusMessage *reply,
-			     DBusError *error)
+static bool get_alloc_stats(DBusMessageIter *args,
+			    DBusMessage *reply,
+			    DBusError *error)
 {
-	struct gsh_export *export = NULL;
-	struct export_stats *export_st = NULL;
 	bool success = true;
 	char *errormsg = "OK";
 	DBusMessageIter iter;
 
+#ifndef USE_MEM_ACCOUNTING
+	success = false;
+	errormsg = "Not built with USE_MEM_ACCOUNTING";
+#endif
+
 	dbus_message_iter_init_append(reply, &iter);
-	export = lookup_export(args, &errormsg);
-	if (export == NULL) {
-		success = false;
-	} else {
-		export_st = container_of(export, struct export_stats, export);
-		if (export_st->st._9p == NULL) {
-			success = false;
-			errormsg = "Export does not have any 9p activity";
-		}
-	}
 	dbus_status_reply(&iter, success, errormsg);
-	if (success)
-		server_dbus_9p_iostats(export_st->st._9p, &iter);
 
-	if (export != NULL)
-		put_gsh_export(export);
+	server_dbus_alloc_stats(&iter);
+
 	return true;
 }
 
-static struct gsh_dbus_method export_show_9p_io = {
-	.name = "Get9pIO",
-	.method = get_9p_export_io,
-	.args = {EXPORT_ID_ARG,
-		 STATUS_REPLY,
-		 TIMESTAMP_REPLY,
-		 IOSTATS_REPLY,
-		 END_ARG_LIST}
-};
-
 /**
- * DBUS method to report 9p protocol operation statistics
+ * @brief Report the statistics of the I/O buffer pool
  *
+ * @return
+ *	status
+ *	error message
+ *	time
+ *	(allocs, cache hits, depot refills, mallocs, releases, oversize)
+ *	array of (class size, buffers in the depot)
  */
-static bool get_9p_export_op_stats(DBusMessageIter *args,
-				   DBusMessage *reply,
-				   DBusError *error)
+static bool get_iobuf_stats(DBusMessageIter *args,
+			    DBusMessage *reply,
+			    DBusError *error)
 {
-	struct gsh_export *export = NULL;
-	struct export_stats *export_st = NULL;
-	u8 opcode;
 	bool success = true;
 	char *errormsg = "OK";
-	DBusMessageIter iter;
+	DBusMessageIter iter, struct_iter, array_iter;
+	struct iobuf_pool_stats stats;
+	struct timespec timestamp;
+	uint64_t size;
+	int ix;
+
+	iobuf_pool_stats(nfs_iobuf_pool, &stats);
 
 	dbus_message_iter_init_append(reply, &iter);
-	export = lookup_export(args, &errormsg);
-	if (export == NULL) {
-		success = false;
-	} else {
-		export_st = container_of(export, struct export_stats, export);
-		if (export_st->st._9p == NULL) {
-			success = false;
-			errormsg = "Export does not have any 9p activity";
-		}
-	}
-	dbus_message_iter_next(args);
+	dbus_status_reply(&iter, success, errormsg);
+	now(&timestamp);
+	dbus_append_timestamp(&iter, &timestamp);
+
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &stats.allocs);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &stats.cache_hits);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &stats.depot_refills);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &stats.mallocs);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &stats.releases);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &stats.oversize);
+	dbus_message_iter_close_container(&iter, &struct_iter);
+
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "(tt)",
+					 &array_iter);
+	for (ix = 0; ix < IOBUF_CLASSES; ix++) {
+		size = IOBUF_MIN_SIZE << ix;
+		dbus_message_iter_open_container(&array_iter,
+						 DBUS_TYPE_STRUCT, NULL,
+						 &struct_iter);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT64, &size);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT64,
+					       &stats.depot[ix]);
+		dbus_message_iter_close_container(&array_iter, &struct_iter);
+	}
+	dbus_message_iter_close_container(&iter, &array_iter);
+
+	return true;
+}
+
+/**
+ * DBUS method to report memory held by state owners
+ *
+ * @return
+ *	status
+ *	error message
+ *	time
+ *	(owners, slabs, slab bytes, object size, slab allocs,
+ *	 names held out of line, bytes in them)
+ */
+static bool get_owner_stats(DBusMessageIter *args,
+			    DBusMessage *reply,
+			    DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter, struct_iter;
+	struct state_owner_mem_stats stats;
+	struct timespec timestamp;
+	uint64_t bytes;
+
+	state_owner_mem_stats(&stats);
+	bytes = stats.slab.slabs * SLAB_SIZE;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+	now(&timestamp);
+	dbus_append_timestamp(&iter, &timestamp);
+
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &stats.slab.objects);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &stats.slab.slabs);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &bytes);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &stats.slab.object_size);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &stats.slab.slab_allocs);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &stats.heap_names);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &stats.heap_name_bytes);
+	dbus_message_iter_close_container(&iter, &struct_iter);
+
+	return true;
+}
+
+/**
+ * DBUS method to report the counters of the ID mapping cache
+ *
+ * @return
+ *	status
+ *	error message
+ *	time
+ *	(hits, negative hits, misses, expired, background refreshes,
+ *	 directory lookups, nsecs in them, nsecs in the longest)
+ */
+static bool get_idmapper_stats(DBusMessageIter *args,
+			       DBusMessage *reply,
+			       DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter, struct_iter;
+	struct idmapper_stats stats;
+	struct timespec timestamp;
+
+	idmapper_get_stats(&stats);
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+	now(&timestamp);
+	dbus_append_timestamp(&iter, &timestamp);
+
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &stats.hits);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &stats.negative_hits);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &stats.misses);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &stats.expired);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &stats.refreshes);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &stats.lookups);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &stats.lookup_ns);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &stats.lookup_max_ns);
+	dbus_message_iter_close_container(&iter, &struct_iter);
+
+	return true;
+}
+
+static void append_cache_stats(struct gsh_cache *cache, void *arg)
+{
+	DBusMessageIter *array_iter = arg;
+	DBusMessageIter struct_iter;
+	struct gsh_cache_stats stats;
+
+	gsh_cache_get_stats(cache, &stats);
+
+	dbus_message_iter_open_container(array_iter, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+				       &stats.name);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &stats.slots);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &stats.bytes);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &stats.hits);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &stats.negative_hits);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &stats.misses);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &stats.expired);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &stats.inserts);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &stats.evictions);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &stats.dropped);
+	dbus_message_iter_close_container(array_iter, &struct_iter);
+}
+
+/**
+ * DBUS method to report the counters of the small lookup caches
+ *
+ * @return
+ *	status
+ *	error message
+ *	time
+ *	array of (name, slots, bytes, hits, negative hits, misses,
+ *	expired, inserts, evictions, dropped inserts)
+ */
+static bool get_cache_stats(DBusMessageIter *args,
+			    DBusMessage *reply,
+			    DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter, array_iter;
+	struct timespec timestamp;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+	now(&timestamp);
+	dbus_append_timestamp(&iter, &timestamp);
+
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					 "(sttttttttt)", &array_iter);
+	gsh_cache_foreach(append_cache_stats, &array_iter);
+	dbus_message_iter_close_container(&iter, &array_iter);
+
+	return true;
+}
+
+static bool append_export_qos(struct gsh_export *export, void *arg)
+{
+	DBusMessageIter *array_iter = arg;
+	DBusMessageIter struct_iter;
+
+	if (!qos_limited(&export->qos.limits))
+		return true;
+
+	dbus_message_iter_open_container(array_iter, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT16,
+				       &export->export_id);
+	qos_dbus_append(&struct_iter, &export->qos);
+	dbus_message_iter_close_container(array_iter, &struct_iter);
+	return true;
+}
+
+/**
+ * DBUS method to report the QoS limits and counters
+ *
+ * Only the exports and Dispatch_Client_Weight clients with limits are
+ * listed.
+ *
+ * @return
+ *	status
+ *	error message
+ *	time
+ *	array of (export id, IOPS, IOPS burst, bandwidth, bandwidth
+ *	burst, requests let through, times held back, bytes)
+ *	array of (client, the same)
+ */
+static bool get_qos_stats(DBusMessageIter *args,
+			  DBusMessage *reply,
+			  DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter, array_iter, struct_iter;
+	struct timespec timestamp;
+	struct glist_head *glist;
+	struct dispatch_client_weight *cw;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+	now(&timestamp);
+	dbus_append_timestamp(&iter, &timestamp);
+
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					 "(q" QOS_DBUS_TYPE ")", &array_iter);
+	(void) foreach_gsh_export(append_export_qos, &array_iter);
+	dbus_message_iter_close_container(&iter, &array_iter);
+
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					 "(s" QOS_DBUS_TYPE ")", &array_iter);
+	glist_for_each(glist, &nfs_param.core_param.fair.weights) {
+		cw = glist_entry(glist, struct dispatch_client_weight, link);
+		if (!qos_limited(&cw->qos.limits))
+			continue;
+		dbus_message_iter_open_container(&array_iter,
+						 DBUS_TYPE_STRUCT, NULL,
+						 &struct_iter);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_STRING,
+					       &cw->client);
+		qos_dbus_append(&struct_iter, &cw->qos);
+		dbus_message_iter_close_container(&array_iter, &struct_iter);
+	}
+	dbus_message_iter_close_container(&iter, &array_iter);
+
+	return true;
+}
+
+/**
+ * DBUS method to report the heavy hitters of the request sampler
+ *
+ * Fields a summary does not count by are zero or empty.
+ *
+ * @return
+ *	status
+ *	error message
+ *	time
+ *	for files, clients and requests, by requests then by bytes,
+ *	heaviest first, array of (client, export id, fileid, program,
+ *	version, procedure, estimated count, error bound)
+ */
+static bool get_hot_spots(DBusMessageIter *args,
+			  DBusMessage *reply,
+			  DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter, array_iter, struct_iter;
+	struct timespec timestamp;
+	struct hot_entry *top;
+	char *client;
+	uint32_t n, ix;
+	int dim, weight;
+
+	if (nfs_param.core_param.hot_sample_rate == 0) {
+		success = false;
+		errormsg = "Hot_Sample_Rate is not set";
+	}
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+	now(&timestamp);
+	dbus_append_timestamp(&iter, &timestamp);
+
+	top = gsh_malloc(HOT_SLOTS * sizeof(*top));
+
+	for (dim = 0; dim < HOT_DIM_COUNT; dim++) {
+		for (weight = 0; weight < HOT_WEIGHT_COUNT; weight++) {
+			n = hot_sampler_top(dim, weight, top, HOT_SLOTS);
+			dbus_message_iter_open_container(&iter,
+							 DBUS_TYPE_ARRAY,
+							 "(sqtuuutt)",
+							 &array_iter);
+			for (ix = 0; ix < n; ix++) {
+				client = top[ix].key.client;
+				dbus_message_iter_open_container(
+					&array_iter, DBUS_TYPE_STRUCT, NULL,
+					&struct_iter);
+				dbus_message_iter_append_basic(
+					&struct_iter, DBUS_TYPE_STRING,
+					&client);
+				dbus_message_iter_append_basic(
+					&struct_iter, DBUS_TYPE_UINT16,
+					&top[ix].key.export_id);
+				dbus_message_iter_append_basic(
+					&struct_iter, DBUS_TYPE_UINT64,
+					&top[ix].key.fileid);
+				dbus_message_iter_append_basic(
+					&struct_iter, DBUS_TYPE_UINT32,
+					&top[ix].key.prog);
+				dbus_message_iter_append_basic(
+					&struct_iter, DBUS_TYPE_UINT32,
+					&top[ix].key.vers);
+				dbus_message_iter_append_basic(
+					&struct_iter, DBUS_TYPE_UINT32,
+					&top[ix].key.proc);
+				dbus_message_iter_append_basic(
+					&struct_iter, DBUS_TYPE_UINT64,
+					&top[ix].count);
+				dbus_message_iter_append_basic(
+					&struct_iter, DBUS_TYPE_UINT64,
+					&top[ix].error);
+				dbus_message_iter_close_container(
+					&array_iter, &struct_iter);
+			}
+			dbus_message_iter_close_container(&iter, &array_iter);
+		}
+	}
+
+	gsh_free(top);
+	return true;
+}
+
+static void append_inflight(const struct inflight_info *info, void *arg)
+{
+	DBusMessageIter *array_iter = arg;
+	DBusMessageIter struct_iter;
+
+	dbus_message_iter_open_container(array_iter, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+				       &info->xid);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+				       &info->client);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+				       &info->proc);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+				       &info->op);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+				       &info->stage);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+				       &info->fsal_call);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &info->age_ns);
+	dbus_message_iter_close_container(array_iter, &struct_iter);
+}
+
+/**
+ * DBUS method to dump the requests in flight
+ *
+ * @return
+ *	status
+ *	error message
+ *	time
+ *	array of (xid, client, procedure, current NFSv4 op, stage,
+ *	FSAL call in progress, nsecs since decode)
+ */
+static bool get_inflight_requests(DBusMessageIter *args,
+				  DBusMessage *reply,
+				  DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter, array_iter;
+	struct timespec timestamp;
+
+	if (nfs_param.core_param.slow_request_ms == 0) {
+		success = false;
+		errormsg = "Slow_Request_Threshold is not set";
+	}
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+	now(&timestamp);
+	dbus_append_timestamp(&iter, &timestamp);
+
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					 "(ussssst)", &array_iter);
+	nfs_inflight_foreach(append_inflight, &array_iter);
+	dbus_message_iter_close_container(&iter, &array_iter);
+
+	return true;
+}
+
+#ifdef USE_LOCK_PROFILING
+/**
+ * DBUS method to report lock contention by call site
+ *
+ * @return
+ *	status
+ *	error message
+ *	time
+ *	array of (file, line, lock, acquisitions, contended, nsecs waited,
+ *	longest wait, nsecs held, longest hold), most waited for first
+ */
+static bool get_lock_stats(DBusMessageIter *args,
+			   DBusMessage *reply,
+			   DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter, array_iter, struct_iter;
+	struct timespec timestamp;
+	struct lock_prof_report *reps;
+	struct lock_prof_stats *st;
+	uint32_t n, ix;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+	now(&timestamp);
+	dbus_append_timestamp(&iter, &timestamp);
+
+	n = lock_prof_collect(&reps);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					 "(sistttttt)", &array_iter);
+	for (ix = 0; ix < n; ix++) {
+		st = &reps[ix].stats;
+		dbus_message_iter_open_container(&array_iter,
+						 DBUS_TYPE_STRUCT, NULL,
+						 &struct_iter);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &reps[ix].site->file);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_INT32,
+					       &reps[ix].site->line);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &reps[ix].site->name);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &st->acquired);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &st->contended);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &st->wait_ns);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &st->wait_max);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &st->hold_ns);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &st->hold_max);
+		dbus_message_iter_close_container(&array_iter, &struct_iter);
+	}
+	dbus_message_iter_close_container(&iter, &array_iter);
+	gsh_free(reps);
+
+	return true;
+}
+#endif
+
+/**
+ * DBUS method to report memory use by subsystem and by pool
+ *
+ * @return
+ *	status
+ *	error message
+ *	time
+ *	array of (subsystem, allocations, frees, bytes), empty unless
+ *	built with USE_MEM_ACCOUNTING
+ *	array of (pool, object size, allocations, frees, bytes)
+ *	both with the most bytes first
+ */
+static bool get_mem_stats(DBusMessageIter *args,
+			  DBusMessage *reply,
+			  DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter, array_iter, struct_iter;
+	struct timespec timestamp;
+	struct mem_stats_report *reps;
+	uint64_t object_size, bytes;
+	uint32_t n, ix;
+	int pools;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+	now(&timestamp);
+	dbus_append_timestamp(&iter, &timestamp);
+
+	n = mem_stats_collect(&reps);
+	for (pools = 0; pools < 2; pools++) {
+		dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+						 pools ? "(stttt)" : "(sttt)",
+						 &array_iter);
+		for (ix = 0; ix < n; ix++) {
+			if (reps[ix].pool != pools)
+				continue;
+			dbus_message_iter_open_container(&array_iter,
+							 DBUS_TYPE_STRUCT,
+							 NULL, &struct_iter);
+			dbus_message_iter_append_basic(&struct_iter,
+						       DBUS_TYPE_STRING,
+						       &reps[ix].name);
+			if (pools) {
+				object_size = reps[ix].object_size;
+				dbus_message_iter_append_basic(
+					&struct_iter, DBUS_TYPE_UINT64,
+					&object_size);
+			}
+			dbus_message_iter_append_basic(&struct_iter,
+						       DBUS_TYPE_UINT64,
+						       &reps[ix].count.allocs);
+			dbus_message_iter_append_basic(&struct_iter,
+						       DBUS_TYPE_UINT64,
+						       &reps[ix].count.frees);
+			bytes = reps[ix].count.bytes > 0
+					? reps[ix].count.bytes : 0;
+			dbus_message_iter_append_basic(&struct_iter,
+						       DBUS_TYPE_UINT64,
+						       &bytes);
+			dbus_message_iter_close_container(&array_iter,
+							  &struct_iter);
+		}
+		dbus_message_iter_close_container(&iter, &array_iter);
+	}
+	gsh_free(reps);
+
+	return true;
+}
+
+/**
+ * DBUS method to report what pNFS clients said of their layout I/O
+ *
+ * @return
+ *	status
+ *	error message
+ *	time
+ *	array of data server devices, most errors first, as (device id in
+ *	hex, errors, last error status, operation it failed, when last
+ *	reported)
+ *	array of files, most errors then most bytes first, as (export id,
+ *	fileid, reads, bytes read, writes, bytes written, errors, when
+ *	last reported)
+ */
+static bool get_layout_stats(DBusMessageIter *args,
+			     DBusMessage *reply,
+			     DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter, array_iter, struct_iter;
+	struct timespec timestamp;
+	struct layout_device_stats *devs;
+	struct layout_file_stats *files;
+	char devid[NFS4_DEVICEID4_SIZE * 2 + 1];
+	char *devidp = devid;
+	uint32_t status, op;
+	uint64_t last;
+	uint32_t n, ix;
+	int b;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+	now(&timestamp);
+	dbus_append_timestamp(&iter, &timestamp);
+
+	n = layout_stats_devices(&devs);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "(stuut)",
+					 &array_iter);
+	for (ix = 0; ix < n; ix++) {
+		for (b = 0; b < NFS4_DEVICEID4_SIZE; b++)
+			sprintf(devid + 2 * b, "%02x",
+				(unsigned char)devs[ix].deviceid[b]);
+		status = devs[ix].last_status;
+		op = devs[ix].last_op;
+		last = devs[ix].last;
+		dbus_message_iter_open_container(&array_iter, DBUS_TYPE_STRUCT,
+						 NULL, &struct_iter);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &devidp);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &devs[ix].errors);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+					       &status);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+					       &op);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &last);
+		dbus_message_iter_close_container(&array_iter, &struct_iter);
+	}
+	dbus_message_iter_close_container(&iter, &array_iter);
+	gsh_free(devs);
+
+	n = layout_stats_files(&files);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "(qttttttt)",
+					 &array_iter);
+	for (ix = 0; ix < n; ix++) {
+		last = files[ix].last;
+		dbus_message_iter_open_container(&array_iter, DBUS_TYPE_STRUCT,
+						 NULL, &struct_iter);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT16,
+					       &files[ix].export_id);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &files[ix].fileid);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &files[ix].reads);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &files[ix].read_bytes);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &files[ix].writes);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &files[ix].write_bytes);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &files[ix].errors);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &last);
+		dbus_message_iter_close_container(&array_iter, &struct_iter);
+	}
+	dbus_message_iter_close_container(&iter, &array_iter);
+	gsh_free(files);
+
+	return true;
+}
+
+static bool show_cache_inode_stats(DBusMessageIter *args,
+				   DBusMessage *reply,
+				   DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+
+	mdcache_dbus_show(&iter);
+
+	return true;
+}
+
+static struct gsh_dbus_method export_show_v41_layouts = {
+	.name = "GetNFSv41Layouts",
+	.method = get_nfsv41_export_layouts,
+	.args = {EXPORT_ID_ARG,
+		 STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 LAYOUTS_REPLY,
+		 END_ARG_LIST}
+};
+
+#ifdef _USE_9P
+/**
+ * DBUS method to report 9p I/O statistics
+ *
+ */
+static bool get_9p_export_io(DBusMessageIter *args,
+			     DBusMessage *reply,
+			     DBusError *error)
+{
+	struct gsh_export *export = NULL;
+	struct export_stats *export_st = NULL;
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	export = lookup_export(args, &errormsg);
+	if (export == NULL) {
+		success = false;
+	} else {
+		export_st = container_of(export, struct export_stats, export);
+		if (export_st->st._9p == NULL) {
+			success = false;
+			errormsg = "Export does not have any 9p activity";
+		}
+	}
+	dbus_status_reply(&iter, success, errormsg);
+	if (success)
+		server_dbus_9p_iostats(export_st->st._9p, &iter);
+
+	if (export != NULL)
+		put_gsh_export(export);
+	return true;
+}
+
+static struct gsh_dbus_method export_show_9p_io = {
+	.name = "Get9pIO",
+	.method = get_9p_export_io,
+	.args = {EXPORT_ID_ARG,
+		 STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 IOSTATS_REPLY,
+		 END_ARG_LIST}
+};
+
+/**
+ * DBUS method to report 9p protocol operation statistics
+ *
+ */
+static bool get_9p_export_op_stats(DBusMessageIter *args,
+				   DBusMessage *reply,
+				   DBusError *error)
+{
+	struct gsh_export *export = NULL;
+	struct export_stats *export_st = NULL;
+	u8 opcode;
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	export = lookup_export(args, &errormsg);
+	if (export == NULL) {
+		success = false;
+	} else {
+		export_st = container_of(export, struct export_stats, export);
+		if (export_st->st._9p == NULL) {
+			success = false;
+			errormsg = "Export does not have any 9p activity";
+		}
+	}
+	dbus_message_iter_next(args);
 	if (success)
 		success = arg_9p_op(args, &opcode, &errormsg);
 	dbus_status_reply(&iter, success, errormsg);
@@ -1832,6 +2793,116 @@ static struct gsh_dbus_method global_show_fast_ops = {
 		 END_ARG_LIST}
 };
 
+static struct gsh_dbus_method global_show_latency_hist = {
+	.name = "GetLatencyHistograms",
+	.method = get_latency_histograms,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 LATENCY_HIST_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method global_show_alloc_stats = {
+	.name = "GetAllocStats",
+	.method = get_alloc_stats,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 ALLOC_STATS_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method global_show_iobuf_stats = {
+	.name = "GetIOBufStats",
+	.method = get_iobuf_stats,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 IOBUF_STATS_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method global_show_owner_stats = {
+	.name = "GetOwnerStats",
+	.method = get_owner_stats,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 OWNER_STATS_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method global_show_idmapper_stats = {
+	.name = "GetIdmapperStats",
+	.method = get_idmapper_stats,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 IDMAPPER_STATS_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method global_show_cache_stats = {
+	.name = "GetCacheStats",
+	.method = get_cache_stats,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 CACHE_STATS_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method global_show_qos_stats = {
+	.name = "GetQoS",
+	.method = get_qos_stats,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 QOS_STATS_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method global_show_hot_spots = {
+	.name = "GetHotSpots",
+	.method = get_hot_spots,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 HOT_SPOTS_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method global_show_inflight = {
+	.name = "GetInflightRequests",
+	.method = get_inflight_requests,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 INFLIGHT_REPLY,
+		 END_ARG_LIST}
+};
+
+#ifdef USE_LOCK_PROFILING
+static struct gsh_dbus_method global_show_lock_stats = {
+	.name = "GetLockStats",
+	.method = get_lock_stats,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 LOCK_STATS_REPLY,
+		 END_ARG_LIST}
+};
+#endif
+
+static struct gsh_dbus_method global_show_mem_stats = {
+	.name = "GetMemStats",
+	.method = get_mem_stats,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 MEM_STATS_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method global_show_layout_stats = {
+	.name = "GetLayoutStats",
+	.method = get_layout_stats,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 LAYOUT_STATS_REPLY,
+		 END_ARG_LIST}
+};
+
 static struct gsh_dbus_method cache_inode_show = {
 	.name = "ShowCacheInode",
 	.method = show_cache_inode_stats,
@@ -1895,6 +2966,47 @@ static struct gsh_dbus_method export_show_all_io = {
 		 END_ARG_LIST}
 };
 
+static bool snapshot_export_io(struct gsh_export *export_node, void *state)
+{
+	server_stats_snapshot_export(state,
+				     container_of(export_node,
+						  struct export_stats,
+						  export));
+	return true;
+}
+
+/**
+ * @brief Report the NFS I/O stats of all exports as one snapshot
+ *
+ * The export list is only locked while the counters are copied, see
+ * struct stats_snapshot for the encoding.
+ *
+ * @return
+ *	snapshot byte array
+ */
+static bool get_export_snapshot(DBusMessageIter *args,
+				DBusMessage *message,
+				DBusError *error)
+{
+	DBusMessageIter reply_iter;
+	struct stats_snapshot snap;
+
+	dbus_message_iter_init_append(message, &reply_iter);
+
+	server_stats_snapshot_init(&snap, STATS_SNAPSHOT_EXPORTS);
+	(void) foreach_gsh_export(&snapshot_export_io, (void *) &snap);
+	server_stats_snapshot_reply(&snap, &reply_iter);
+
+	return true;
+}
+
+static struct gsh_dbus_method export_show_snapshot = {
+	.name = "GetExportSnapshot",
+	.method = get_export_snapshot,
+	.args = {SNAPSHOT_REPLY,
+		 END_ARG_LIST}
+};
+
 static struct gsh_dbus_method *export_stats_methods[] = {
 	&export_show_v3_io,
 	&export_show_v40_io,
@@ -1907,8 +3019,23 @@ static struct gsh_dbus_method *export_stats_methods[] = {
 #endif
 	&global_show_total_ops,
 	&global_show_fast_ops,
+	&global_show_latency_hist,
+	&global_show_alloc_stats,
+	&global_show_iobuf_stats,
+	&global_show_owner_stats,
+	&global_show_idmapper_stats,
+	&global_show_cache_stats,
+	&global_show_qos_stats,
+	&global_show_hot_spots,
+	&global_show_inflight,
+#ifdef USE_LOCK_PROFILING
+	&global_show_lock_stats,
+#endif
+	&global_show_mem_stats,
+	&global_show_layout_stats,
 	&cache_inode_show,
 	&export_show_all_io,
+	&export_show_snapshot,
 	NULL
 };
 
@@ -1939,6 +3066,7 @@ void dbus_export_init(void)
 void export_pkginit(void)
 {
 	pthread_rwlockattr_t rwlock_attr;
+	int i;
 
 	pthread_rwlockattr_init(&rwlock_attr);
 #ifdef GLIBC
@@ -1953,6 +3081,11 @@ void export_pkginit(void)
 	glist_init(&exportlist);
 	glist_init(&mount_work);
 	glist_init(&unexport_work);
+
+	export_by_path = export_path_node_alloc("", 0);
+	export_by_pseudo = export_path_node_alloc("", 0);
+	for (i = 0; i < EXPORT_BY_TAG_SIZE; i++)
+		glist_init(&export_by_tag[i]);
 }
 
 /** @} */
@@ -52,6 +52,7 @@
 #include "sal_functions.h"
 #include "pnfs_utils.h"
 #include "netgroup_cache.h"
+#include "fridgethr.h"
 
 /**
  * @brief Protect EXPORT_DEFAULTS structure for dynamic update.
@@ -87,6 +88,7 @@ struct global_export_perms export_opt_cfg = {
 };
 
 static void FreeClientList(struct glist_head *clients);
+static void free_client_index(struct export_client_index *index);
 
 static int StrExportOptions(struct display_buffer *dspbuf,
 			    struct export_perms *p_perms)
@@ -222,6 +224,13 @@ static int StrExportOptions(struct display_buffer *dspbuf,
 	if (b_left <= 0)
 		return b_left;
 
+	if ((p_perms->set & EXPORT_OPTION_TLS_REQUIRED) != 0 &&
+	    (p_perms->options & EXPORT_OPTION_TLS_REQUIRED) != 0)
+		b_left = display_cat(dspbuf, ", Require_TLS");
+
+	if (b_left <= 0)
+		return b_left;
+
 	if ((p_perms->set & EXPORT_OPTION_DELEGATIONS) != 0) {
 		if ((p_perms->options & EXPORT_OPTION_READ_DELEG) != 0)
 			b_left = display_cat(dspbuf, ", R");
@@ -303,12 +312,20 @@ static char *client_types[] = {
 	[BAD_CLIENT] = "BAD_CLIENT"
 	 };
 
-void LogClientListEntry(log_levels_t level,
-			log_components_t component,
-			int line,
-			char *func,
-			char *tag,
-			exportlist_client_entry_t *entry)
+/* Nothing is formatted unless the level is on */
+#define LogClientListEntry(level, component, line, func, tag, entry) \
+	do { \
+		if (isLevel(component, level)) \
+			log_client_list_entry(level, component, line, func, \
+					      tag, entry); \
+	} while (0)
+
+static void log_client_list_entry(log_levels_t level,
+				  log_components_t component,
+				  int line,
+				  char *func,
+				  char *tag,
+				  exportlist_client_entry_t *entry)
 {
 	char perms[1024];
 	struct display_buffer dspbuf = {sizeof(perms), perms, perms};
@@ -450,6 +467,7 @@ static int add_client(struct glist_head *client_list,
 		}
 		cli->client.netgroup.netgroupname = gsh_strdup(client_tok + 1);
 		cli->type = NETGROUP_CLIENT;
+		ng_register(cli->client.netgroup.netgroupname);
 		break;
 	case TERM_V4CIDR:  /* this needs to be migrated to libcidr! (no v6) */
 		cidr = cidr_from_str(client_tok);
@@ -678,6 +696,194 @@ static int client_commit(void *node, void *link_mem, void *self_struct,
 	return errcnt;
 }
 
+/* Compiled client lists
+ *
+ * Exports commonly list hundreds of hosts and networks, and every
+ * request walked the list to find the first one matching its client.
+ * When an export is committed, its addresses and networks go into a
+ * binary trie per address family, each node remembering the position
+ * in the list of the first client with that prefix.  The nodes on the
+ * path of an address are all the prefixes it matches, so the first
+ * matching client is found in as many steps as the address has bits.
+ *
+ * Netgroup and wildcard clients can only be matched by the name of the
+ * client.  They are kept aside, in order, and only those listed before
+ * the client the trie found are tried.  Their own caches keep names and
+ * netgroups from going stale, so the outcome itself is not cached.
+ */
+
+#define CLIENT_NONE UINT32_MAX
+
+struct client_trie_node {
+	struct client_trie_node *child[2];
+	/** Position of the first client with this prefix, or CLIENT_NONE */
+	uint32_t first;
+};
+
+struct export_client_index {
+	/** Clients by IPv4 prefix */
+	struct client_trie_node *v4;
+	/** Clients by IPv6 prefix */
+	struct client_trie_node *v6;
+	/** Clients by position in the list */
+	exportlist_client_entry_t **entries;
+	uint32_t nentries;
+	/** Positions of the clients matched by name, in order */
+	uint32_t *by_name;
+	uint32_t nby_name;
+};
+
+static inline int key_bit(const uint8_t *key, int bit)
+{
+	return (key[bit / 8] >> (7 - bit % 8)) & 1;
+}
+
+static void client_trie_insert(struct client_trie_node **root,
+			       const uint8_t *key, int bits, uint32_t pos)
+{
+	struct client_trie_node **node = root;
+	int bit = 0;
+
+	for (;;) {
+		if (*node == NULL) {
+			*node = gsh_calloc(1, sizeof(**node));
+			(*node)->first = CLIENT_NONE;
+		}
+		if (bit == bits)
+			break;
+		node = &(*node)->child[key_bit(key, bit++)];
+	}
+
+	/* Clients are inserted in order, the first one stays */
+	if ((*node)->first == CLIENT_NONE)
+		(*node)->first = pos;
+}
+
+static uint32_t client_trie_lookup(const struct client_trie_node *node,
+				   const uint8_t *key, int bits)
+{
+	uint32_t first = CLIENT_NONE;
+	int bit = 0;
+
+	while (node != NULL) {
+		first = MIN(first, node->first);
+		if (bit == bits)
+			break;
+		node = node->child[key_bit(key, bit++)];
+	}
+
+	return first;
+}
+
+static void client_trie_free(struct client_trie_node *node)
+{
+	if (node == NULL)
+		return;
+
+	client_trie_free(node->child[0]);
+	client_trie_free(node->child[1]);
+	gsh_free(node);
+}
+
+/**
+ * @brief Compile the client list of an export
+ *
+ * @param[in] clients  The client list
+ *
+ * @return The index, NULL if the list is empty.
+ */
+
+static struct export_client_index *compile_clients(struct glist_head *clients)
+{
+	struct export_client_index *index;
+	exportlist_client_entry_t *client;
+	struct glist_head *glist;
+	uint32_t netaddr, mask;
+	uint32_t pos = 0;
+	int bits;
+
+	if (glist_empty(clients))
+		return NULL;
+
+	index = gsh_calloc(1, sizeof(*index));
+	index->nentries = glist_length(clients);
+	index->entries = gsh_calloc(index->nentries, sizeof(*index->entries));
+	index->by_name = gsh_calloc(index->nentries, sizeof(*index->by_name));
+
+	glist_for_each(glist, clients) {
+		client = glist_entry(glist, exportlist_client_entry_t,
+				     cle_list);
+		index->entries[pos] = client;
+
+		switch (client->type) {
+		case HOSTIF_CLIENT:
+			/* Already in network order */
+			client_trie_insert(&index->v4,
+				(uint8_t *) &client->client.hostif.clientaddr,
+				32, pos);
+			break;
+
+		case NETWORK_CLIENT:
+			mask = client->client.network.netmask;
+			for (bits = 0; bits < 32; bits++)
+				if ((mask & (0x80000000U >> bits)) == 0)
+					break;
+
+			if (bits < 32 && mask != ~(0xFFFFFFFFU >> bits)) {
+				/* Not a prefix, match it the slow way */
+				index->by_name[index->nby_name++] = pos;
+				break;
+			}
+
+			/* A network with host bits set matches nothing */
+			if ((client->client.network.netaddr & ~mask) != 0)
+				break;
+
+			netaddr = htonl(client->client.network.netaddr);
+			client_trie_insert(&index->v4, (uint8_t *) &netaddr,
+					   bits, pos);
+			break;
+
+		case NETGROUP_CLIENT:
+		case WILDCARDHOST_CLIENT:
+		case GSSPRINCIPAL_CLIENT:
+			index->by_name[index->nby_name++] = pos;
+			break;
+
+		case HOSTIF_CLIENT_V6:
+			client_trie_insert(&index->v6,
+				client->client.hostif.clientaddr6.s6_addr,
+				128, pos);
+			break;
+
+		case MATCH_ANY_CLIENT:
+			client_trie_insert(&index->v4, NULL, 0, pos);
+			client_trie_insert(&index->v6, NULL, 0, pos);
+			break;
+
+		case BAD_CLIENT:
+		default:
+			break;
+		}
+
+		pos++;
+	}
+
+	return index;
+}
+
+static void free_client_index(struct export_client_index *index)
+{
+	if (index == NULL)
+		return;
+
+	client_trie_free(index->v4);
+	client_trie_free(index->v6);
+	gsh_free(index->entries);
+	gsh_free(index->by_name);
+	gsh_free(index);
+}
+
 /**
  * @brief Clean up EXPORT path strings
  */
@@ -711,46 +917,38 @@ void clean_export_paths(struct gsh_export *export)
 }
 
 /**
- * @brief Commit a FSAL sub-block
+ * @brief Create the FSAL export of an export
  *
- * Use the Name parameter passed in via the link_mem to lookup the
- * fsal.  If the fsal is not loaded (yet), load it and call its init.
+ * @param[in]     export   The export
+ * @param[in]     node     Its FSAL sub-block
+ * @param[in]     fsal     The FSAL, whose reference is consumed
+ * @param[in,out] err_type Errors
  *
- * Create an export and pass the FSAL sub-block to it so that the
- * fsal method can process the rest of the parameters in the block
+ * @return The number of errors.
  */
 
-static int fsal_cfg_commit(void *node, void *link_mem, void *self_struct,
-			   struct config_error_type *err_type)
+static int export_create_fsal(struct gsh_export *export, void *node,
+			      struct fsal_module *fsal,
+			      struct config_error_type *err_type)
 {
-	struct fsal_export **exp_hdl = link_mem;
-	struct gsh_export *export =
-	    container_of(exp_hdl, struct gsh_export, fsal_export);
-	struct fsal_args *fp = self_struct;
-	struct fsal_module *fsal;
 	struct root_op_context root_op_context;
 	uint64_t MaxRead, MaxWrite;
 	fsal_status_t status;
-	int errcnt;
+	struct timespec start, end;
+	int errcnt = 0;
 
 	/* Initialize req_ctx */
 	init_root_op_context(&root_op_context, export, NULL, 0, 0,
 			     UNKNOWN_REQUEST);
 
-	errcnt = fsal_load_init(node, fp->name, &fsal, err_type);
-	if (errcnt > 0)
-		goto err;
-
-	clean_export_paths(export);
-
+	now(&start);
 	status = fsal->m_ops.create_export(fsal, node, err_type, &fsal_up_top);
+	now(&end);
 
-	PTHREAD_RWLOCK_rdlock(&export_opt_lock);
-
-	if ((export->options_set & EXPORT_OPTION_EXPIRE_SET) == 0)
-		export->expire_time_attr = export_opt.expire_time_attr;
-
-	PTHREAD_RWLOCK_unlock(&export_opt_lock);
+	LogInfo(COMPONENT_CONFIG,
+		"FSAL %s export for (%s) created in %" PRIu64 " ms",
+		fsal->name, export->fullpath,
+		timespec_diff(&start, &end) / NS_PER_MSEC);
 
 	if (FSAL_IS_ERROR(status)) {
 		fsal_put(fsal);
@@ -794,6 +992,59 @@ err:
 	return errcnt;
 }
 
+/**
+ * @brief Commit a FSAL sub-block
+ *
+ * Use the Name parameter passed in via the link_mem to lookup the
+ * fsal.  If the fsal is not loaded (yet), load it and call its init.
+ *
+ * Create an export and pass the FSAL sub-block to it so that the
+ * fsal method can process the rest of the parameters in the block.
+ * A Lazy_Init export only keeps the FSAL and where its block is, the
+ * export is created on first use by export_activate.
+ */
+
+static int fsal_cfg_commit(void *node, void *link_mem, void *self_struct,
+			   struct config_error_type *err_type)
+{
+	struct fsal_export **exp_hdl = link_mem;
+	struct gsh_export *export =
+	    container_of(exp_hdl, struct gsh_export, fsal_export);
+	struct fsal_args *fp = self_struct;
+	struct fsal_module *fsal;
+	struct root_op_context root_op_context;
+	int errcnt;
+
+	/* Initialize req_ctx */
+	init_root_op_context(&root_op_context, export, NULL, 0, 0,
+			     UNKNOWN_REQUEST);
+
+	errcnt = fsal_load_init(node, fp->name, &fsal, err_type);
+
+	release_root_op_context();
+
+	if (errcnt > 0)
+		return errcnt;
+
+	clean_export_paths(export);
+
+	PTHREAD_RWLOCK_rdlock(&export_opt_lock);
+
+	if ((export->options_set & EXPORT_OPTION_EXPIRE_SET) == 0)
+		export->expire_time_attr = export_opt.expire_time_attr;
+
+	PTHREAD_RWLOCK_unlock(&export_opt_lock);
+
+	if (export->lazy_init) {
+		export->lazy_fsal = fsal;
+		export->lazy_config =
+			gsh_strdup(config_root_file(get_parse_root(node)));
+		return 0;
+	}
+
+	return export_create_fsal(export, node, fsal, err_type);
+}
+
 /**
  * @brief Commit a FSAL sub-block for export update
  *
@@ -844,6 +1095,14 @@ static int fsal_update_cfg_commit(void *node, void *link_mem, void *self_struct,
 	 * fsal_export to later release...
 	 */
 
+	if (probe_exp->fsal_export == NULL) {
+		/* A Lazy_Init export not created yet, activating it
+		 * validates the limits.
+		 */
+		put_gsh_export(probe_exp);
+		return 0;
+	}
+
 	/* Initialize req_ctx from the probe_exp */
 	init_root_op_context(&root_op_context, probe_exp,
 			     probe_exp->fsal_export, 0, 0, UNKNOWN_REQUEST);
@@ -961,6 +1220,8 @@ static inline void update_atomic_fields(struct gsh_export *export,
 	atomic_store_uint32_t(&export->options, src->options);
 	atomic_store_uint32_t(&export->options_set, src->options_set);
 	atomic_store_int32_t(&export->expire_time_attr, src->expire_time_attr);
+	export->qos_limits = src->qos_limits;
+	qos_bucket_set(&export->qos, &src->qos_limits);
 }
 
 /**
@@ -981,12 +1242,15 @@ static int export_commit_common(void *node, void *link_mem, void *self_struct,
 				enum export_commit_type commit_type)
 {
 	struct gsh_export *export = self_struct, *probe_exp;
+	struct export_client_index *client_index;
 	int errcnt = 0;
 	char perms[1024];
 	struct display_buffer dspbuf = {sizeof(perms), perms, perms};
 
 	LogFullDebug(COMPONENT_EXPORT, "Processing %p", export);
 
+	qos_bucket_set(&export->qos, &export->qos_limits);
+
 	/* validate the export now */
 	if (export->export_perms.options & EXPORT_OPTION_NFSV4) {
 		if (export->pseudopath == NULL) {
@@ -1031,10 +1295,19 @@ static int export_commit_common(void *node, void *link_mem, void *self_struct,
 			err_type->invalid = true;
 			errcnt++;
 		}
+		if (export->lazy_init) {
+			LogCrit(COMPONENT_CONFIG,
+				"Export id 0 can not be Lazy_Init");
+			err_type->invalid = true;
+			errcnt++;
+		}
 	}
 	if (errcnt)
 		return errcnt;  /* have basic errors. don't even try more... */
 
+	/* The new export is not visible yet, no need for the lock */
+	export->client_index = compile_clients(&export->clients);
+
 	/* Note: need to check export->fsal_export AFTER we have checked for
 	 * duplicate export_id. That is because an update export WILL NOT
 	 * have fsal_export attached.
@@ -1119,6 +1392,11 @@ static int export_commit_common(void *node, void *link_mem, void *self_struct,
 		/* Update atomic fields */
 		update_atomic_fields(probe_exp, export);
 
+		/* Whatever block this came from, a reload must apply its
+		 * own again.
+		 */
+		atomic_store_uint64_t(&probe_exp->config_hash, 0);
+
 		/* Now take lock and swap out client list and export_perms... */
 		PTHREAD_RWLOCK_wrlock(&probe_exp->lock);
 
@@ -1135,9 +1413,14 @@ static int export_commit_common(void *node, void *link_mem, void *self_struct,
 			     export->clients.next, export->clients.prev);
 
 		glist_swap_lists(&probe_exp->clients, &export->clients);
+		client_index = probe_exp->client_index;
+		probe_exp->client_index = export->client_index;
+		export->client_index = client_index;
 
 		PTHREAD_RWLOCK_unlock(&probe_exp->lock);
 
+		export_perms_changed();
+
 		/* We will need to dispose of the config export since we
 		 * updated the existing export.
 		 */
@@ -1172,7 +1455,7 @@ static int export_commit_common(void *node, void *link_mem, void *self_struct,
 	 * Config code calls export_commit even if fsal_cfg_commit fails at
 	 * the moment, so error out here if fsal_cfg_commit failed.
 	 */
-	if (export->fsal_export == NULL) {
+	if (export->fsal_export == NULL && export->lazy_fsal == NULL) {
 		err_type->validate = true;
 		errcnt++;
 		return errcnt;
@@ -1252,8 +1535,10 @@ static int export_commit_common(void *node, void *link_mem, void *self_struct,
 		export_add_to_mount_work(export);
 
 	if (commit_type != initial_export) {
-		/* add_export or update_export with new export_id. */
-		int rc = init_export_root(export);
+		/* add_export or update_export with new export_id.  The
+		 * root of a Lazy_Init export is looked up on first use.
+		 */
+		int rc = export->lazy_init ? 0 : init_export_root(export);
 
 		if (rc) {
 			export_revert(export);
@@ -1407,6 +1692,8 @@ static int export_defaults_commit(void *node, void *link_mem,
 	export_opt = export_opt_cfg;
 	PTHREAD_RWLOCK_unlock(&export_opt_lock);
 
+	export_perms_changed();
+
 	return 0;
 }
 
@@ -1559,6 +1846,9 @@ struct config_item_list deleg_types[] =  {
 	CONF_ITEM_BOOLBIT_SET("PrivilegedPort",				\
 		false, EXPORT_OPTION_PRIVILEGED_PORT,			\
 		_struct_, _perms_.options, _perms_.set),		\
+	CONF_ITEM_BOOLBIT_SET("Require_TLS",				\
+		false, EXPORT_OPTION_TLS_REQUIRED,			\
+		_struct_, _perms_.options, _perms_.set),		\
 	CONF_ITEM_BOOLBIT_SET("Manage_Gids",				\
 		false, EXPORT_OPTION_MANAGE_GIDS,			\
 		_struct_, _perms_.options, _perms_.set),		\
@@ -1692,12 +1982,27 @@ static struct config_item fsal_params[] = {
 	CONF_ITEM_BOOLBIT_SET("Trust_Readdir_Negative_Cache",		\
 		false, EXPORT_OPTION_TRUST_READIR_NEGATIVE_CACHE,	\
 		_struct_, options, options_set),			\
+	CONF_ITEM_BOOLBIT_SET("Attr_Upcall_Coherent",			\
+		false, EXPORT_OPTION_UPCALL_COHERENT,			\
+		_struct_, options, options_set),			\
 	CONF_ITEM_BOOLBIT_SET("Disable_ACL",				\
 		false, EXPORT_OPTION_DISABLE_ACL,			\
 		_struct_, options, options_set),			\
 	CONF_ITEM_I32_SET("Attr_Expiration_Time", -1, INT32_MAX, 60,	\
 		       _struct_, expire_time_attr,			\
-		       EXPORT_OPTION_EXPIRE_SET, options_set)
+		       EXPORT_OPTION_EXPIRE_SET, options_set),		\
+	CONF_ITEM_BOOL("Lazy_Init", false,				\
+		       _struct_, lazy_init),				\
+	CONF_ITEM_UI32("Lazy_Idle_Time", 0, UINT32_MAX, 300,		\
+		       _struct_, lazy_idle_time),				\
+	CONF_ITEM_UI32("IOPS_Limit", 0, QOS_IOPS_MAX, 0,		\
+		       _struct_, qos_limits.iops),			\
+	CONF_ITEM_UI32("IOPS_Burst", 0, UINT32_MAX, 0,			\
+		       _struct_, qos_limits.iops_burst),			\
+	CONF_ITEM_UI64("Bandwidth_Limit", 0, QOS_BANDWIDTH_MAX, 0,	\
+		       _struct_, qos_limits.bandwidth),			\
+	CONF_ITEM_UI64("Bandwidth_Burst", 0, QOS_BANDWIDTH_BURST_MAX, 0, \
+		       _struct_, qos_limits.bandwidth_burst)
 
 /**
  * @brief Table of EXPORT block parameters
@@ -1875,7 +2180,8 @@ static int build_default_root(struct config_error_type *err_type)
 				    EXPORT_OPTION_PROTOCOLS |
 				    EXPORT_OPTION_TRANSPORTS |
 				    EXPORT_OPTION_AUTH_TYPES |
-				    EXPORT_OPTION_PRIVILEGED_PORT;
+				    EXPORT_OPTION_PRIVILEGED_PORT |
+				    EXPORT_OPTION_TLS_REQUIRED;
 
 	export->options = EXPORT_OPTION_USE_COOKIE_VERIFIER;
 	export->options_set = EXPORT_OPTION_FSID_SET |
@@ -1948,6 +2254,100 @@ err_out:
  *         the number of export entries else.
  */
 
+/**
+ * @brief Fingerprint of the export defaults
+ *
+ * Every export is loaded over them, so it is part of the hash of
+ * every export.
+ */
+
+static uint64_t export_defaults_hash(config_file_t in_config)
+{
+	struct config_node_list *config_list, *lp, *lp_next;
+	uint64_t hash = 0;
+
+	if (find_config_blocks(in_config, "EXPORT_DEFAULTS",
+			       &config_list) != 0)
+		return hash;
+
+	for (lp = config_list; lp != NULL; lp = lp_next) {
+		lp_next = lp->next;
+		hash = config_node_hash(lp->tree_node, hash);
+		gsh_free(lp);
+	}
+
+	return hash;
+}
+
+/**
+ * @brief The Export_Id of an EXPORT block
+ *
+ * @return The id, -1 if the block has no valid one.
+ */
+
+static int export_block_id(void *tree_node)
+{
+	const char *value = config_block_value(tree_node, "Export_Id");
+	unsigned long export_id;
+	char *end;
+
+	if (value == NULL)
+		return -1;
+
+	errno = 0;
+	export_id = strtoul(value, &end, 0);
+	if (errno != 0 || *end != '\0' || end == value ||
+	    export_id > UINT16_MAX)
+		return -1;
+
+	return export_id;
+}
+
+/**
+ * @brief The export loaded from an EXPORT block, if there is one
+ *
+ * @return A reference to the export, or NULL.
+ */
+
+static struct gsh_export *export_of_block(void *tree_node)
+{
+	int export_id = export_block_id(tree_node);
+
+	if (export_id < 0)
+		return NULL;
+
+	return get_gsh_export(export_id);
+}
+
+/**
+ * @brief Note the block each export was loaded from
+ *
+ * @param[in] in_config     The parse tree loaded
+ * @param[in] defaults_hash Fingerprint of its export defaults
+ */
+
+static void export_note_hashes(config_file_t in_config,
+			       uint64_t defaults_hash)
+{
+	struct config_node_list *config_list, *lp, *lp_next;
+	struct gsh_export *export;
+
+	if (find_config_blocks(in_config, "EXPORT", &config_list) != 0)
+		return;
+
+	for (lp = config_list; lp != NULL; lp = lp_next) {
+		lp_next = lp->next;
+		export = export_of_block(lp->tree_node);
+		if (export != NULL) {
+			atomic_store_uint64_t(&export->config_hash,
+					      config_node_hash(lp->tree_node,
+							       defaults_hash));
+			put_gsh_export(export);
+		}
+		gsh_free(lp);
+	}
+}
+
 int ReadExports(config_file_t in_config,
 		struct config_error_type *err_type)
 {
@@ -1979,12 +2379,19 @@ int ReadExports(config_file_t in_config,
 		return -1;
 	}
 
+	export_note_hashes(in_config, export_defaults_hash(in_config));
+
 	return num_exp;
 }
 
 /**
  * @brief Reread the export entries from the parsed configuration file.
  *
+ * Only the EXPORT blocks that changed since they were last loaded are
+ * applied, each on its own; an export whose block and defaults hash
+ * the same as then is left alone, so a reload of a large config that
+ * changes a few exports only touches those.
+ *
  * @param[in]  in_config    The file that contains the export list
  *
  * @return A negative value on error,
@@ -1994,7 +2401,11 @@ int ReadExports(config_file_t in_config,
 int reread_exports(config_file_t in_config,
 		   struct config_error_type *err_type)
 {
-	int rc, num_exp;
+	struct config_node_list *config_list, *lp, *lp_next;
+	struct gsh_export *export;
+	uint64_t defaults_hash, hash;
+	int rc, num_exp = 0, unchanged = 0;
+	bool failed = false;
 
 	LogInfo(COMPONENT_CONFIG, "Reread exports");
 
@@ -2009,13 +2420,52 @@ int reread_exports(config_file_t in_config,
 		return -1;
 	}
 
-	num_exp = load_config_from_parse(in_config,
-					 &update_export_param,
-					 NULL,
-					 false,
-					 err_type);
+	defaults_hash = export_defaults_hash(in_config);
 
-	if (num_exp < 0) {
+	if (find_config_blocks(in_config, "EXPORT", &config_list) != 0)
+		return 0;
+
+	for (lp = config_list; lp != NULL; lp = lp_next) {
+		lp_next = lp->next;
+		hash = config_node_hash(lp->tree_node, defaults_hash);
+
+		export = export_of_block(lp->tree_node);
+		if (export != NULL &&
+		    atomic_fetch_uint64_t(&export->config_hash) == hash) {
+			put_gsh_export(export);
+			unchanged++;
+			num_exp++;
+			gsh_free(lp);
+			continue;
+		}
+		if (export != NULL)
+			put_gsh_export(export);
+
+		rc = load_config_from_node(lp->tree_node,
+					   &update_export_param,
+					   NULL,
+					   false,
+					   err_type);
+		if (rc == 0) {
+			num_exp++;
+			export = export_of_block(lp->tree_node);
+			if (export != NULL) {
+				atomic_store_uint64_t(&export->config_hash,
+						      hash);
+				put_gsh_export(export);
+			}
+		} else if (config_error_is_harmless(err_type)) {
+			num_exp++;
+		} else {
+			failed = true;
+		}
+		gsh_free(lp);
+	}
+
+	LogInfo(COMPONENT_CONFIG,
+		"Reread %d exports, %d unchanged", num_exp, unchanged);
+
+	if (failed) {
 		LogCrit(COMPONENT_CONFIG, "Export block error");
 		return -1;
 	}
@@ -2035,8 +2485,10 @@ static void FreeClientList(struct glist_head *clients)
 		    glist_entry(glist, exportlist_client_entry_t, cle_list);
 		glist_del(&client->cle_list);
 		if (client->type == NETGROUP_CLIENT &&
-		    client->client.netgroup.netgroupname != NULL)
+		    client->client.netgroup.netgroupname != NULL) {
+			ng_unregister(client->client.netgroup.netgroupname);
 			gsh_free(client->client.netgroup.netgroupname);
+		}
 		if (client->type == WILDCARDHOST_CLIENT &&
 		    client->client.wildcard.wildcard != NULL)
 			gsh_free(client->client.wildcard.wildcard);
@@ -2057,6 +2509,8 @@ static void FreeClientList(struct glist_head *clients)
 
 void free_export_resources(struct gsh_export *export)
 {
+	free_client_index(export->client_index);
+	export->client_index = NULL;
 	FreeClientList(&export->clients);
 	if (export->fsal_export != NULL) {
 		struct fsal_module *fsal = export->fsal_export->fsal;
@@ -2065,6 +2519,11 @@ void free_export_resources(struct gsh_export *export)
 		fsal_put(fsal);
 	}
 	export->fsal_export = NULL;
+	if (export->lazy_fsal != NULL)
+		fsal_put(export->lazy_fsal);
+	export->lazy_fsal = NULL;
+	gsh_free(export->lazy_config);
+	export->lazy_config = NULL;
 	/* free strings here */
 	if (export->fullpath != NULL)
 		gsh_free(export->fullpath);
@@ -2075,25 +2534,246 @@ void free_export_resources(struct gsh_export *export)
 }
 
 /**
- * @brief pkginit callback to initialize exports from nfs_init
+ * @brief Exports whose roots are being looked up at startup
  *
- * Assumes being called with the export_by_id.lock held.
- * true on success
+ * The exports are sorted by path and linked into chains: an export
+ * nested under another of the same FSAL follows it in its chain, as
+ * looking up its path goes through the outer one's root and file
+ * systems.  Each chain is looked up in order by one job of a pool of
+ * Export_Init_Threads, and the chains in parallel.
  */
+struct export_init_batch {
+	pthread_mutex_t mtx;
+	pthread_cond_t cv;
+	uint32_t pending;		/*< Chains being looked up */
+	uint32_t failed;		/*< Roots that could not be found */
+	uint32_t count;
+	uint32_t size;
+	struct gsh_export **exports;	/*< Referenced, sorted by path */
+	uint32_t *next;			/*< Next in the chain, or count */
+};
+
+struct export_init_job {
+	struct export_init_batch *batch;
+	uint32_t first;			/*< Head of the chain */
+};
 
-static bool init_export_cb(struct gsh_export *exp, void *state)
+static bool export_init_collect(struct gsh_export *exp, void *state)
 {
-	return !(init_export_root(exp));
-}
+	struct export_init_batch *batch = state;
 
-/**
- * @brief Initialize exports over a live cache inode and fsal layer
- */
+	/* A Lazy_Init export is looked up when first used */
+	if (exp->fsal_export == NULL)
+		return true;
 
-void exports_pkginit(void)
-{
-	foreach_gsh_export(init_export_cb, NULL);
-}
+	if (batch->count == batch->size) {
+		batch->size = batch->size == 0 ? 64 : batch->size * 2;
+		batch->exports = gsh_realloc(batch->exports,
+					     batch->size *
+					     sizeof(*batch->exports));
+	}
+
+	get_gsh_export_ref(exp);
+	batch->exports[batch->count++] = exp;
+	return true;
+}
+
+static int export_init_cmp(const void *a, const void *b)
+{
+	const struct gsh_export *ea = *(struct gsh_export * const *)a;
+	const struct gsh_export *eb = *(struct gsh_export * const *)b;
+
+	return strcmp_null(ea->fullpath, eb->fullpath);
+}
+
+/** The FSAL under any stacked ones */
+static struct fsal_module *export_init_fsal(struct gsh_export *exp)
+{
+	struct fsal_export *fsal_export = exp->fsal_export;
+
+	while (fsal_export->sub_export != NULL)
+		fsal_export = fsal_export->sub_export;
+
+	return fsal_export->fsal;
+}
+
+/** Whether inner is outer or a path under it, on the same FSAL */
+static bool export_init_nested(struct gsh_export *outer,
+			       struct gsh_export *inner)
+{
+	size_t len;
+
+	if (outer->fullpath == NULL || inner->fullpath == NULL ||
+	    export_init_fsal(outer) != export_init_fsal(inner))
+		return false;
+
+	len = strlen(outer->fullpath);
+
+	return strncmp(outer->fullpath, inner->fullpath, len) == 0 &&
+	       (inner->fullpath[len] == '\0' || inner->fullpath[len] == '/'
+		|| (len > 0 && outer->fullpath[len - 1] == '/'));
+}
+
+/** Look up the roots of a chain */
+static void export_init_chain(struct export_init_batch *batch,
+			      uint32_t first)
+{
+	struct gsh_export *exp;
+	struct timespec start, end;
+	uint32_t i;
+
+	for (i = first; i < batch->count; i = batch->next[i]) {
+		exp = batch->exports[i];
+
+		now(&start);
+		if (init_export_root(exp) != 0)
+			(void) atomic_inc_uint32_t(&batch->failed);
+		now(&end);
+
+		LogInfo(COMPONENT_EXPORT,
+			"Root of export_id=%d looked up in %" PRIu64 " ms",
+			exp->export_id,
+			timespec_diff(&start, &end) / NS_PER_MSEC);
+	}
+
+	PTHREAD_MUTEX_lock(&batch->mtx);
+	if (--batch->pending == 0)
+		pthread_cond_signal(&batch->cv);
+	PTHREAD_MUTEX_unlock(&batch->mtx);
+}
+
+static void export_init_job(struct fridgethr_context *ctx)
+{
+	struct export_init_job *job = ctx->arg;
+
+	export_init_chain(job->batch, job->first);
+	gsh_free(job);
+}
+
+/**
+ * @brief Initialize exports over a live cache inode and fsal layer
+ *
+ * Looks up the root of every export, in parallel where the exports
+ * do not nest, and waits for all of them.  An export whose root
+ * cannot be found is logged and left without one, as before.
+ */
+
+void exports_pkginit(void)
+{
+	struct export_init_batch batch;
+	struct fridgethr_params frp;
+	struct fridgethr *fridge = NULL;
+	struct export_init_job *job;
+	struct timespec start, end;
+	uint32_t *tail, *heads, nheads = 0;
+	uint32_t i, h;
+	int rc;
+
+	memset(&batch, 0, sizeof(batch));
+	now(&start);
+
+	(void) foreach_gsh_export(export_init_collect, &batch);
+	if (batch.count == 0)
+		return;
+
+	qsort(batch.exports, batch.count, sizeof(*batch.exports),
+	      export_init_cmp);
+
+	batch.next = gsh_malloc(batch.count * sizeof(*batch.next));
+	tail = gsh_malloc(batch.count * sizeof(*tail));
+	heads = gsh_malloc(batch.count * sizeof(*heads));
+
+	/* Sorted by path, an outer export comes before those under it */
+	for (i = 0; i < batch.count; i++) {
+		batch.next[i] = batch.count;
+
+		for (h = 0; h < nheads; h++) {
+			if (export_init_nested(batch.exports[heads[h]],
+					       batch.exports[i]))
+				break;
+		}
+
+		if (h < nheads) {
+			batch.next[tail[h]] = i;
+			tail[h] = i;
+		} else {
+			heads[nheads] = i;
+			tail[nheads++] = i;
+		}
+	}
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = nfs_param.core_param.export_init_threads;
+	frp.deferment = fridgethr_defer_queue;
+
+	if (nheads > 1) {
+		rc = fridgethr_init(&fridge, "export_init", &frp);
+		if (rc != 0) {
+			LogMajor(COMPONENT_EXPORT,
+				 "Unable to initialize export_init fridge: %d, looking up export roots serially",
+				 rc);
+			fridge = NULL;
+		}
+	}
+
+	PTHREAD_MUTEX_init(&batch.mtx, NULL);
+	PTHREAD_COND_init(&batch.cv, NULL);
+	batch.pending = 1;	/* Until all are submitted */
+
+	for (h = 0; h < nheads; h++) {
+		PTHREAD_MUTEX_lock(&batch.mtx);
+		batch.pending++;
+		PTHREAD_MUTEX_unlock(&batch.mtx);
+
+		job = gsh_malloc(sizeof(*job));
+		job->batch = &batch;
+		job->first = heads[h];
+
+		if (fridge == NULL ||
+		    fridgethr_submit(fridge, export_init_job, job) != 0) {
+			gsh_free(job);
+			export_init_chain(&batch, heads[h]);
+		}
+	}
+
+	PTHREAD_MUTEX_lock(&batch.mtx);
+	batch.pending--;
+	while (batch.pending != 0)
+		pthread_cond_wait(&batch.cv, &batch.mtx);
+	PTHREAD_MUTEX_unlock(&batch.mtx);
+
+	if (fridge != NULL) {
+		rc = fridgethr_sync_command(fridge, fridgethr_comm_stop, 120);
+		if (rc == ETIMEDOUT) {
+			LogMajor(COMPONENT_EXPORT,
+				 "Shutdown timed out, cancelling threads.");
+			fridgethr_cancel(fridge);
+		} else if (rc != 0) {
+			LogMajor(COMPONENT_EXPORT,
+				 "Failed shutting down export_init threads: %d",
+				 rc);
+		}
+		fridgethr_destroy(fridge);
+	}
+
+	now(&end);
+
+	LogEvent(COMPONENT_EXPORT,
+		 "Looked up the roots of %" PRIu32 " exports in %" PRIu32
+		 " chains in %" PRIu64 " ms, %" PRIu32 " failed",
+		 batch.count, nheads,
+		 timespec_diff(&start, &end) / NS_PER_MSEC, batch.failed);
+
+	for (i = 0; i < batch.count; i++)
+		put_gsh_export(batch.exports[i]);
+
+	PTHREAD_MUTEX_destroy(&batch.mtx);
+	PTHREAD_COND_destroy(&batch.cv);
+	gsh_free(heads);
+	gsh_free(tail);
+	gsh_free(batch.next);
+	gsh_free(batch.exports);
+}
 
 /**
  * @brief Return a reference to the root object of the export
@@ -2259,8 +2939,9 @@ static inline void clean_up_export(struct gsh_export *export)
 	/* Release state belonging to this export */
 	state_release_export(export);
 
-	/* Flush FSAL-specific state */
-	export->fsal_export->exp_ops.unexport(export->fsal_export);
+	/* Flush FSAL-specific state, a Lazy_Init export may have none */
+	if (export->fsal_export != NULL)
+		export->fsal_export->exp_ops.unexport(export->fsal_export);
 }
 
 void unexport(struct gsh_export *export)
@@ -2272,6 +2953,11 @@ void unexport(struct gsh_export *export)
 		 "Unexport %s, Pseduo %s",
 		 export->fullpath, export->pseudopath);
 
+	/* Keep a Lazy_Init export from being created or released under
+	 * us; once stale, it is not created again.
+	 */
+	PTHREAD_MUTEX_lock(&export->lazy_mtx);
+
 	/* Lots of obj_ops may be called during cleanup; make sure that an
 	 * op_ctx exists */
 	if (!op_ctx) {
@@ -2284,140 +2970,361 @@ void unexport(struct gsh_export *export)
 	clean_up_export(export);
 	if (op_ctx_set)
 		release_root_op_context();
+
+	PTHREAD_MUTEX_unlock(&export->lazy_mtx);
+}
+
+static inline uint64_t export_lazy_now(void)
+{
+	struct timespec ts;
+
+	now(&ts);
+	return ts.tv_sec;
 }
 
 /**
- * @brief Match a specific option in the client export list
+ * @brief Find the FSAL block of an export in a parse tree
  *
- * @param[in]  hostaddr      Host to search for
- * @param[in]  clients       Client list to search
- * @param[out] client_found Matching entry
- * @param[in]  export_option Option to search for
+ * @return The FSAL sub-block, NULL if the export has none.
+ */
+
+static void *export_fsal_block(config_file_t config, uint16_t export_id)
+{
+	struct config_node_list *config_list, *lp, *lp_next;
+	void *node = NULL;
+
+	if (find_config_blocks(config, "EXPORT", &config_list) != 0)
+		return NULL;
+
+	for (lp = config_list; lp != NULL; lp = lp_next) {
+		lp_next = lp->next;
+		if (node == NULL && export_block_id(lp->tree_node) == export_id)
+			node = config_sub_block(lp->tree_node, "FSAL");
+		gsh_free(lp);
+	}
+
+	return node;
+}
+
+/**
+ * @brief Release the FSAL export of a Lazy_Init export
  *
- * @return true if found, false otherwise.
+ * The export is no longer active, and the caller holds its lazy_mtx.
+ *
+ * @param[in] export      The export
+ * @param[in] fsal_export The FSAL export it had
  */
-static exportlist_client_entry_t *client_match(sockaddr_t *hostaddr,
-					       struct gsh_export *export)
+
+static void export_release_fsal(struct gsh_export *export,
+				struct fsal_export *fsal_export)
+{
+	struct fsal_module *fsal = fsal_export->fsal;
+	struct root_op_context root_op_context;
+
+	init_root_op_context(&root_op_context, export, fsal_export,
+			     0, 0, UNKNOWN_REQUEST);
+
+	release_export_root(export);
+
+	/* Flush the cached objects of the export */
+	fsal_export->exp_ops.unexport(fsal_export);
+
+	release_root_op_context();
+
+	fsal_export->exp_ops.release(fsal_export);
+	fsal_put(fsal);
+}
+
+/**
+ * @brief Make sure the FSAL export of an export is created
+ *
+ * A Lazy_Init export is created when first used, from its FSAL block
+ * read again from its config file, and its root looked up.  Every
+ * path that takes an export from a client (a handle, a MOUNT path or
+ * a junction) calls this before using its fsal_export.
+ *
+ * The caller holds a reference to the export.
+ *
+ * @param[in] export The export
+ *
+ * @return true if the export can be used.
+ */
+
+bool export_activate(struct gsh_export *export)
+{
+	struct config_error_type err_type;
+	config_file_t config;
+	void *node;
+	int errcnt;
+	bool active;
+
+	if (!export->lazy_init)
+		return true;
+
+	atomic_store_uint64_t(&export->lazy_last_use, export_lazy_now());
+
+	if (atomic_fetch_uint8_t(&export->lazy_active))
+		return true;
+
+	PTHREAD_MUTEX_lock(&export->lazy_mtx);
+
+	if (export->lazy_active || !export_ready(export))
+		goto out;
+
+	(void) init_error_type(&err_type);
+	config = config_ParseFile(export->lazy_config, &err_type);
+	if (config == NULL || !config_error_is_harmless(&err_type)) {
+		LogCrit(COMPONENT_EXPORT,
+			"Could not read %s to create export %d",
+			export->lazy_config, export->export_id);
+		if (config != NULL)
+			config_Free(config);
+		goto out;
+	}
+
+	node = export_fsal_block(config, export->export_id);
+	if (node == NULL) {
+		LogCrit(COMPONENT_EXPORT,
+			"No FSAL block for export %d in %s",
+			export->export_id, export->lazy_config);
+		config_Free(config);
+		goto out;
+	}
+
+	fsal_get(export->lazy_fsal);
+	errcnt = export_create_fsal(export, node, export->lazy_fsal,
+				    &err_type);
+	config_Free(config);
+	if (errcnt != 0)
+		goto out;
+
+	if (init_export_root(export) != 0) {
+		export_release_fsal(export, export->fsal_export);
+		export->fsal_export = NULL;
+		goto out;
+	}
+
+	atomic_store_uint8_t(&export->lazy_active, true);
+
+	LogEvent(COMPONENT_EXPORT,
+		 "Lazy_Init export %d created for path %s",
+		 export->export_id, export->fullpath);
+
+out:
+	active = export->lazy_active;
+	PTHREAD_MUTEX_unlock(&export->lazy_mtx);
+	return active;
+}
+
+/**
+ * @brief Lazy_Init exports idle for longer than their Lazy_Idle_Time
+ */
+struct export_lazy_batch {
+	uint64_t now;
+	uint32_t count;
+	uint32_t size;
+	struct gsh_export **exports;	/*< Referenced */
+};
+
+static bool export_lazy_collect(struct gsh_export *exp, void *state)
+{
+	struct export_lazy_batch *batch = state;
+
+	if (!exp->lazy_init || exp->lazy_idle_time == 0 ||
+	    !atomic_fetch_uint8_t(&exp->lazy_active) ||
+	    atomic_fetch_uint64_t(&exp->lazy_last_use) + exp->lazy_idle_time
+	    > batch->now)
+		return true;
+
+	if (batch->count == batch->size) {
+		batch->size = batch->size == 0 ? 16 : batch->size * 2;
+		batch->exports = gsh_realloc(batch->exports,
+					     batch->size *
+					     sizeof(*batch->exports));
+	}
+
+	get_gsh_export_ref(exp);
+	batch->exports[batch->count++] = exp;
+	return true;
+}
+
+/**
+ * @brief Release the FSAL exports of idle Lazy_Init exports
+ *
+ * Called periodically by the reaper.
+ */
+
+void export_lazy_sweep(void)
+{
+	struct export_lazy_batch batch;
+	struct fsal_export *fsal_export;
+	struct gsh_export *export;
+	uint32_t i;
+
+	memset(&batch, 0, sizeof(batch));
+	batch.now = export_lazy_now();
+
+	(void) foreach_gsh_export(export_lazy_collect, &batch);
+
+	for (i = 0; i < batch.count; i++) {
+		export = batch.exports[i];
+
+		PTHREAD_MUTEX_lock(&export->lazy_mtx);
+
+		if (export_lazy_idle(export,
+				     batch.now + 1 - export->lazy_idle_time,
+				     &fsal_export)) {
+			export_release_fsal(export, fsal_export);
+			LogEvent(COMPONENT_EXPORT,
+				 "Lazy_Init export %d idle, released",
+				 export->export_id);
+		}
+
+		PTHREAD_MUTEX_unlock(&export->lazy_mtx);
+		put_gsh_export(export);
+	}
+
+	gsh_free(batch.exports);
+}
+
+/**
+ * @brief Match an IPv4 host against a client entry
+ *
+ * @param[in]     hostaddr  Host to match
+ * @param[in]     client    Client entry
+ * @param[in,out] ipvalid   -1 if ipstring is not printed yet, 0 if it
+ *                          could not be, 1 if it was
+ * @param[in,out] ipstring  The host address, printed when first needed
+ *
+ * @return true if the host matches.
+ */
+static bool client_match_entry(sockaddr_t *hostaddr,
+			       exportlist_client_entry_t *client,
+			       int *ipvalid, char *ipstring)
 {
-	struct glist_head *glist;
 	in_addr_t addr = get_in_addr(hostaddr);
 	int rc;
-	int ipvalid = -1;	/* -1 need to print, 0 - invalid, 1 - ok */
 	char hostname[MAXHOSTNAMELEN + 1];
-	char ipstring[SOCK_NAME_MAX + 1];
 
-	glist_for_each(glist, &export->clients) {
-		exportlist_client_entry_t *client;
+	switch (client->type) {
+	case HOSTIF_CLIENT:
+		return client->client.hostif.clientaddr == addr;
 
-		client = glist_entry(glist, exportlist_client_entry_t,
-				     cle_list);
-		LogClientListEntry(NIV_MID_DEBUG,
-				   COMPONENT_EXPORT,
-				   __LINE__,
-				   (char *) __func__,
-				   "Match V4: ",
-				   client);
+	case NETWORK_CLIENT:
+		return (client->client.network.netmask & ntohl(addr)) ==
+		       client->client.network.netaddr;
 
-		switch (client->type) {
-		case HOSTIF_CLIENT:
-			if (client->client.hostif.clientaddr == addr)
-				return client;
-			break;
+	case NETGROUP_CLIENT:
+		/* Get the name from the IP/name cache.  One still being
+		 * resolved does not match; the answer is not kept in the
+		 * client's perms, so a later request tries again.
+		 */
+		rc = nfs_ip_name_lookup(hostaddr, hostname, sizeof(hostname));
 
-		case NETWORK_CLIENT:
-			if ((client->client.network.netmask & ntohl(addr)) ==
-			    client->client.network.netaddr)
-				return client;
-			break;
+		if (rc != IP_NAME_SUCCESS)
+			return false;
 
-		case NETGROUP_CLIENT:
-			/* Try to get the entry from th IP/name cache */
-			rc = nfs_ip_name_get(hostaddr, hostname,
-					     sizeof(hostname));
-
-			if (rc == IP_NAME_NOT_FOUND) {
-				/* IPaddr was not cached, add it to the cache */
-				rc = nfs_ip_name_add(hostaddr,
-						     hostname,
-						     sizeof(hostname));
-			}
+		/* At this point 'hostname' should contain the
+		 * name that was found
+		 */
+		return ng_innetgr(client->client.netgroup.netgroupname,
+				  hostname);
 
-			if (rc != IP_NAME_SUCCESS)
-				break; /* Fatal failure */
+	case WILDCARDHOST_CLIENT:
+		/* Now checking for IP wildcards */
+		if (*ipvalid < 0)
+			*ipvalid = sprint_sockip(hostaddr,
+						 ipstring,
+						 SOCK_NAME_MAX + 1);
+
+		if (*ipvalid &&
+		    (fnmatch(client->client.wildcard.wildcard,
+			     ipstring,
+			     FNM_PATHNAME) == 0)) {
+			return true;
+		}
 
-			/* At this point 'hostname' should contain the
-			 * name that was found
-			 */
-			if (ng_innetgr(client->client.netgroup.netgroupname,
-				    hostname)) {
-				return client;
-			}
-			break;
+		/* Get the name from the IP/name cache, as above */
+		rc = nfs_ip_name_lookup(hostaddr, hostname, sizeof(hostname));
 
-		case WILDCARDHOST_CLIENT:
-			/* Now checking for IP wildcards */
-			if (ipvalid < 0)
-				ipvalid = sprint_sockip(hostaddr,
-							ipstring,
-							sizeof(ipstring));
-
-			if (ipvalid &&
-			    (fnmatch(client->client.wildcard.wildcard,
-				     ipstring,
-				     FNM_PATHNAME) == 0)) {
-				return client;
-			}
+		if (rc != IP_NAME_SUCCESS)
+			return false;
 
-			/* Try to get the entry from th IP/name cache */
-			rc = nfs_ip_name_get(hostaddr, hostname,
-					     sizeof(hostname));
+		/* At this point 'hostname' should contain the
+		 * name that was found
+		 */
+		return fnmatch(client->client.wildcard.wildcard, hostname,
+			       FNM_PATHNAME) == 0;
 
-			if (rc == IP_NAME_NOT_FOUND) {
-				/* IPaddr was not cached, add it to the cache */
+	case GSSPRINCIPAL_CLIENT:
+  /** @todo BUGAZOMEU a completer lors de l'integration de RPCSEC_GSS */
+		LogCrit(COMPONENT_EXPORT,
+			"Unsupported type GSS_PRINCIPAL_CLIENT");
+		return false;
 
-				/** @todo this change from 1.5 is not IPv6
-				 * useful.  come back to this and use the
-				 * string from client mgr inside req_ctx...
-				 */
-				rc = nfs_ip_name_add(hostaddr,
-						     hostname,
-						     sizeof(hostname));
-			}
+	case HOSTIF_CLIENT_V6:
+		return false;
 
-			if (rc != IP_NAME_SUCCESS)
-					break;
+	case MATCH_ANY_CLIENT:
+		return true;
 
-			/* At this point 'hostname' should contain the
-			 * name that was found
-			 */
-			if (fnmatch
-			    (client->client.wildcard.wildcard, hostname,
-			     FNM_PATHNAME) == 0) {
-				return client;
-			}
-			break;
+	case BAD_CLIENT:
+	default:
+		return false;
+	}
+}
 
-		case GSSPRINCIPAL_CLIENT:
-	  /** @todo BUGAZOMEU a completer lors de l'integration de RPCSEC_GSS */
-			LogCrit(COMPONENT_EXPORT,
-				"Unsupported type GSS_PRINCIPAL_CLIENT");
-			break;
+/**
+ * @brief Match a specific option in the client export list
+ *
+ * @param[in]  hostaddr      Host to search for
+ * @param[in]  clients       Client list to search
+ * @param[out] client_found Matching entry
+ * @param[in]  export_option Option to search for
+ * @param[out] by_name       Set if clients were matched by name
+ *
+ * @return true if found, false otherwise.
+ */
+static exportlist_client_entry_t *client_match(sockaddr_t *hostaddr,
+					       struct gsh_export *export,
+					       bool *by_name)
+{
+	struct export_client_index *index = export->client_index;
+	exportlist_client_entry_t *client;
+	in_addr_t addr = get_in_addr(hostaddr);
+	int ipvalid = -1;	/* -1 need to print, 0 - invalid, 1 - ok */
+	char ipstring[SOCK_NAME_MAX + 1];
+	uint32_t first, i;
 
-		case HOSTIF_CLIENT_V6:
-			break;
+	if (index == NULL)
+		return NULL;
 
-		case MATCH_ANY_CLIENT:
-			return client;
+	/* The first client matching by address, then maybe one before it
+	 * matching by name.
+	 */
+	first = client_trie_lookup(index->v4, (uint8_t *) &addr, 32);
 
-		case BAD_CLIENT:
-		default:
-			continue;
+	for (i = 0; i < index->nby_name && index->by_name[i] < first; i++) {
+		*by_name = true;
+		client = index->entries[index->by_name[i]];
+		if (client_match_entry(hostaddr, client, &ipvalid, ipstring)) {
+			first = index->by_name[i];
+			break;
 		}
 	}
 
-	/* no export found for this option */
-	return NULL;
+	if (first == CLIENT_NONE)
+		return NULL;
+
+	client = index->entries[first];
+	LogClientListEntry(NIV_MID_DEBUG,
+			   COMPONENT_EXPORT,
+			   __LINE__,
+			   (char *) __func__,
+			   "Match V4: ",
+			   client);
 
+	return client;
 }
 
 /**
@@ -2433,63 +3340,93 @@ static exportlist_client_entry_t *client_match(sockaddr_t *hostaddr,
 static exportlist_client_entry_t *client_matchv6(struct in6_addr *paddrv6,
 						 struct gsh_export *export)
 {
-	struct glist_head *glist;
-
-	glist_for_each(glist, &export->clients) {
-		exportlist_client_entry_t *client;
-
-		client = glist_entry(glist, exportlist_client_entry_t,
-				     cle_list);
-		LogClientListEntry(NIV_MID_DEBUG,
-				   COMPONENT_EXPORT,
-				   __LINE__,
-				   (char *) __func__,
-				   "Match V6: ",
-				   client);
+	struct export_client_index *index = export->client_index;
+	exportlist_client_entry_t *client;
+	uint32_t first;
 
-		switch (client->type) {
-		case HOSTIF_CLIENT:
-		case NETWORK_CLIENT:
-		case NETGROUP_CLIENT:
-		case WILDCARDHOST_CLIENT:
-		case GSSPRINCIPAL_CLIENT:
-		case BAD_CLIENT:
-			break;
-
-		case HOSTIF_CLIENT_V6:
-			if (!memcmp(client->client.hostif.clientaddr6.s6_addr,
-				    paddrv6->s6_addr, 16)) {
-				/* Remember that IPv6 address are
-				 * 128 bits = 16 bytes long
-				 */
-				return client;
-			}
-			break;
+	if (index == NULL)
+		return NULL;
 
-		case MATCH_ANY_CLIENT:
-			return client;
+	/* Only addresses are matched for IPv6 */
+	first = client_trie_lookup(index->v6, paddrv6->s6_addr, 128);
+	if (first == CLIENT_NONE)
+		return NULL;
 
-		default:
-			break;
-		}
-	}
+	client = index->entries[first];
+	LogClientListEntry(NIV_MID_DEBUG,
+			   COMPONENT_EXPORT,
+			   __LINE__,
+			   (char *) __func__,
+			   "Match V6: ",
+			   client);
 
-	/* no export found for this option */
-	return NULL;
+	return client;
 }
 
 static exportlist_client_entry_t *client_match_any(sockaddr_t *hostaddr,
-						   struct gsh_export *export)
+						   struct gsh_export *export,
+						   bool *by_name)
 {
 	if (hostaddr->ss_family == AF_INET6) {
 		struct sockaddr_in6 *psockaddr_in6 =
 		    (struct sockaddr_in6 *)hostaddr;
 		return client_matchv6(&(psockaddr_in6->sin6_addr), export);
 	} else {
-		return client_match(hostaddr, export);
+		return client_match(hostaddr, export, by_name);
 	}
 }
 
+/**
+ * @brief Take the export permissions the client cached, if still valid
+ *
+ * @param[in] gen  Current export permissions generation
+ *
+ * @return true if op_ctx->export_perms was filled in.
+ */
+static bool client_perms_get(uint64_t gen)
+{
+	struct gsh_client *client = op_ctx->client;
+	uint16_t export_id = op_ctx->ctx_export->export_id;
+	struct gsh_client_perms *slot;
+	bool found;
+
+	if (client == NULL)
+		return false;
+
+	slot = &client->perms[export_id % CLIENT_EXPORT_PERMS];
+
+	PTHREAD_RWLOCK_rdlock(&client->lock);
+	found = slot->generation == gen && slot->export_id == export_id;
+	if (found)
+		*op_ctx->export_perms = slot->perms;
+	PTHREAD_RWLOCK_unlock(&client->lock);
+
+	return found;
+}
+
+/**
+ * @brief Cache the export permissions just resolved for the client
+ *
+ * @param[in] gen  Export permissions generation they were resolved in
+ */
+static void client_perms_set(uint64_t gen)
+{
+	struct gsh_client *client = op_ctx->client;
+	uint16_t export_id = op_ctx->ctx_export->export_id;
+	struct gsh_client_perms *slot;
+
+	if (client == NULL)
+		return;
+
+	slot = &client->perms[export_id % CLIENT_EXPORT_PERMS];
+
+	PTHREAD_RWLOCK_wrlock(&client->lock);
+	slot->generation = gen;
+	slot->export_id = export_id;
+	slot->perms = *op_ctx->export_perms;
+	PTHREAD_RWLOCK_unlock(&client->lock);
+}
+
 /**
  * @brief Checks if request security flavor is suffcient for the requested
  *        export
@@ -2709,7 +3646,9 @@ gid_t get_anonymous_gid(void)
  * Permissions in the op context get updated based on export and client.
  *
  * Takes the export->lock in read mode to protect the client list and
- * export permissions while performing this work.
+ * export permissions while performing this work.  The outcome is cached
+ * in the gsh_client until export permissions change, unless it depended
+ * on the client's name.
  */
 
 void export_check_access(void)
@@ -2717,6 +3656,8 @@ void export_check_access(void)
 	exportlist_client_entry_t *client = NULL;
 	sockaddr_t alt_hostaddr;
 	sockaddr_t *hostaddr = NULL;
+	uint64_t gen = atomic_fetch_uint64_t(&export_perms_gen);
+	bool by_name = false;
 
 	assert(op_ctx != NULL);
 	assert(op_ctx->export_perms != NULL);
@@ -2727,6 +3668,10 @@ void export_check_access(void)
 	memset(op_ctx->export_perms, 0, sizeof(*op_ctx->export_perms));
 
 	if (op_ctx->ctx_export != NULL) {
+		/* Nothing changed since the client last used the export */
+		if (client_perms_get(gen))
+			return;
+
 		/* Take lock */
 		PTHREAD_RWLOCK_rdlock(&op_ctx->ctx_export->lock);
 	} else {
@@ -2749,7 +3694,7 @@ void export_check_access(void)
 	}
 
 	/* Does the client match anyone on the client list? */
-	client = client_match_any(hostaddr, op_ctx->ctx_export);
+	client = client_match_any(hostaddr, op_ctx->ctx_export, &by_name);
 	if (client != NULL) {
 		/* Take client options */
 		op_ctx->export_perms->options = client->client_perms.options &
@@ -2867,5 +3812,9 @@ void export_check_access(void)
 	if (op_ctx->ctx_export != NULL) {
 		/* Release lock */
 		PTHREAD_RWLOCK_unlock(&op_ctx->ctx_export->lock);
+
+		/* Names and netgroups expire in their own caches */
+		if (!by_name)
+			client_perms_set(gen);
 	}
 }
@@ -99,6 +99,7 @@ int fridgethr_init(struct fridgethr **frout, const char *s,
 	frobj->s = NULL;
 	frobj->nthreads = 0;
 	frobj->nidle = 0;
+	frobj->nstealable = 0;
 	frobj->flags = fridgethr_flag_none;
 
 	/* This always succeeds on Linux, but it might fail on other
@@ -124,6 +125,19 @@ int fridgethr_init(struct fridgethr **frout, const char *s,
 			 rc);
 		goto out;
 	}
+#ifdef LINUX
+	if (p->affinity != NULL) {
+		rc = pthread_attr_setaffinity_np(&frobj->attr,
+						 sizeof(cpu_set_t),
+						 p->affinity);
+		if (rc != 0) {
+			LogMajor(COMPONENT_THREAD,
+				 "Unable to set thread affinity for fridge %s: %d",
+				 s, rc);
+			goto out;
+		}
+	}
+#endif
 	/* This always succeeds on Linux (if you believe the manual),
 	   but SUS defines errors. */
 	rc = pthread_mutex_init(&frobj->mtx, NULL);
@@ -186,6 +200,15 @@ int fridgethr_init(struct fridgethr **frout, const char *s,
 		goto out;
 	}
 
+	if ((frobj->p.steal_slots != 0) &&
+	    ((frobj->p.flavor != fridgethr_flavor_worker) ||
+	     (frobj->p.deferment != fridgethr_defer_queue))) {
+		LogMajor(COMPONENT_THREAD,
+			 "Work stealing needs a queueing worker fridge: %s", s);
+		rc = EINVAL;
+		goto out;
+	}
+
 	*frout = frobj;
 	rc = 0;
 
@@ -279,7 +302,8 @@ static bool fridgethr_deferredwork(struct fridgethr *fr)
 
 	switch (fr->p.deferment) {
 	case fridgethr_defer_queue:
-		res = !glist_empty(&fr->deferment.work_q);
+		res = !glist_empty(&fr->deferment.work_q) ||
+		      (atomic_fetch_uint32_t(&fr->nstealable) > 0);
 		break;
 
 	case fridgethr_defer_block:
@@ -294,6 +318,172 @@ static bool fridgethr_deferredwork(struct fridgethr *fr)
 	return res;
 }
 
+/**
+ * @brief The fridge entry of the calling thread, if it has one
+ */
+
+static __thread struct fridgethr_entry *fridgethr_self;
+
+/**
+ * @brief Set up a thread's deque
+ *
+ * @param[in] fr Fridge
+ * @param[in] fe Fridge entry
+ */
+
+static void fridgethr_deque_init(struct fridgethr *fr,
+				 struct fridgethr_entry *fe)
+{
+	uint32_t slots = 1;
+
+	if (fr->p.steal_slots == 0)
+		return;
+
+	while (slots < fr->p.steal_slots)
+		slots <<= 1;
+
+	fe->deque.top = 0;
+	fe->deque.bottom = 0;
+	fe->deque.mask = slots - 1;
+	fe->deque.slots = gsh_calloc(slots, sizeof(struct fridgethr_work *));
+}
+
+/**
+ * @brief Push work on the calling thread's own deque
+ *
+ * @return false if the deque is full.
+ */
+
+static bool fridgethr_deque_push(struct fridgethr_deque *d,
+				 struct fridgethr_work *q)
+{
+	uint64_t b = atomic_fetch_uint64_t(&d->bottom);
+	uint64_t t = atomic_fetch_uint64_t(&d->top);
+
+	if (b - t > d->mask)
+		return false;
+
+	atomic_store_voidptr((void **)&d->slots[b & d->mask], q);
+	atomic_store_uint64_t(&d->bottom, b + 1);
+	return true;
+}
+
+/**
+ * @brief Take the newest work from the calling thread's own deque
+ *
+ * Only contends with stealers for the last item.
+ */
+
+static struct fridgethr_work *fridgethr_deque_take(struct fridgethr_deque *d)
+{
+	uint64_t b = atomic_fetch_uint64_t(&d->bottom) - 1;
+	uint64_t t;
+	struct fridgethr_work *q = NULL;
+
+	/* claim the bottom slot before looking at the top */
+	atomic_store_uint64_t(&d->bottom, b);
+	t = atomic_fetch_uint64_t(&d->top);
+
+	if ((int64_t)(b - t) >= 0) {
+		q = atomic_fetch_voidptr((void **)&d->slots[b & d->mask]);
+		if (b != t)
+			return q;
+		/* the last one, race the stealers for it */
+		if (!atomic_cas_uint64_t(&d->top, t, t + 1))
+			q = NULL;
+	}
+
+	atomic_store_uint64_t(&d->bottom, b + 1);
+	return q;
+}
+
+/**
+ * @brief Steal the oldest work from another thread's deque
+ */
+
+static struct fridgethr_work *fridgethr_deque_steal(struct fridgethr_deque *d)
+{
+	uint64_t t = atomic_fetch_uint64_t(&d->top);
+	uint64_t b = atomic_fetch_uint64_t(&d->bottom);
+	struct fridgethr_work *q;
+
+	if ((int64_t)(b - t) <= 0)
+		return NULL;
+
+	q = atomic_fetch_voidptr((void **)&d->slots[t & d->mask]);
+	if (!atomic_cas_uint64_t(&d->top, t, t + 1))
+		return NULL;	/* lost to the owner or another thief */
+	return q;
+}
+
+/**
+ * @brief Load work into a thread context and free its wrapper
+ */
+
+static void fridgethr_load(struct fridgethr *fr, struct fridgethr_entry *fe,
+			   struct fridgethr_work *q, bool stolen)
+{
+	if (stolen)
+		(void) atomic_dec_uint32_t(&fr->nstealable);
+	fe->ctx.func = q->func;
+	fe->ctx.arg = q->arg;
+	gsh_free(q);
+}
+
+/**
+ * @brief Steal work from the other threads of a fridge
+ *
+ * @note This function must be called with the fridge mutex held,
+ * which keeps the other threads' deques from going away.
+ *
+ * @return The work, or NULL if there was none.
+ */
+
+static struct fridgethr_work *fridgethr_steal(struct fridgethr *fr,
+					      struct fridgethr_entry *fe)
+{
+	struct glist_head *g;
+	struct fridgethr_work *q = NULL;
+
+	if (atomic_fetch_uint32_t(&fr->nstealable) == 0)
+		return NULL;
+
+	glist_for_each(g, &fr->thread_list) {
+		struct fridgethr_entry *victim =
+		    glist_entry(g, struct fridgethr_entry, thread_link);
+
+		if (victim == fe)
+			continue;
+		q = fridgethr_deque_steal(&victim->deque);
+		if (q != NULL)
+			break;
+	}
+
+	return q;
+}
+
+/**
+ * @brief Move what is left on a thread's deque to the shared queue
+ *
+ * Called by the thread on its way out.
+ *
+ * @note This function must be called with the fridge mutex held.
+ */
+
+static void fridgethr_deque_drain(struct fridgethr *fr,
+				  struct fridgethr_entry *fe)
+{
+	struct fridgethr_work *q;
+
+	if (fr->p.steal_slots == 0)
+		return;
+
+	while ((q = fridgethr_deque_take(&fe->deque)) != NULL) {
+		(void) atomic_dec_uint32_t(&fr->nstealable);
+		glist_add(&fr->deferment.work_q, &q->link);
+	}
+}
+
 /**
  * @brief Get deferred work
  *
@@ -302,6 +492,9 @@ static bool fridgethr_deferredwork(struct fridgethr *fr)
  * and returns true.  If work is not available (or the fridge is not a
  * queueing fridge) it returns false and leaves the context untouched.
  *
+ * A work stealing fridge looks at the thread's own deque first, then
+ * at the other threads' deques and last at the shared queue.
+ *
  * @param[in,out] fr Fridge
  * @param[in,out] fe Fridge entry
  *
@@ -312,21 +505,73 @@ static bool fridgethr_deferredwork(struct fridgethr *fr)
 
 static bool fridgethr_getwork(struct fridgethr *fr, struct fridgethr_entry *fe)
 {
+	struct fridgethr_work *q;
+
 	if ((fr->p.deferment == fridgethr_defer_block)
-	    || (fr->p.deferment == fridgethr_defer_fail)
-	    || glist_empty(&fr->deferment.work_q)) {
+	    || (fr->p.deferment == fridgethr_defer_fail))
 		return false;
-	} else {
-		struct fridgethr_work *q =
-		    glist_first_entry(&fr->deferment.work_q,
-				      struct fridgethr_work,
-				      link);
-		glist_del(&q->link);
-		fe->ctx.func = q->func;
-		fe->ctx.arg = q->arg;
+
+	if (fr->p.steal_slots != 0) {
+		q = fridgethr_deque_take(&fe->deque);
+		if (q == NULL)
+			q = fridgethr_steal(fr, fe);
+		if (q != NULL) {
+			fridgethr_load(fr, fe, q, true);
+			return true;
+		}
+	}
+
+	if (glist_empty(&fr->deferment.work_q))
+		return false;
+
+	q = glist_first_entry(&fr->deferment.work_q, struct fridgethr_work,
+			      link);
+	glist_del(&q->link);
+	fridgethr_load(fr, fe, q, false);
+	return true;
+}
+
+/**
+ * @brief Submit work from a thread of a saturated fridge to its deque
+ *
+ * When every thread of a work stealing fridge is busy, work submitted
+ * by one of them is kept on its own deque without taking the fridge
+ * mutex.  The submitter takes it back once done with what it is
+ * running, unless an idle thread steals it first.
+ *
+ * @return true if the work was pushed.
+ */
+
+static bool fridgethr_submit_local(struct fridgethr *fr,
+				   void (*func)(struct fridgethr_context *),
+				   void *arg)
+{
+	struct fridgethr_entry *fe = fridgethr_self;
+	struct fridgethr_work *q;
+
+	/* Unlocked peeks, a stale answer only sends the work down the
+	   shared path */
+	if ((fe == NULL) || (fe->fr != fr)
+	    || (fr->command == fridgethr_comm_stop)
+	    || (atomic_fetch_uint32_t(&fr->nidle) > 0)
+	    || (fr->p.thr_max == 0)
+	    || (atomic_fetch_uint32_t(&fr->nthreads) < fr->p.thr_max))
+		return false;
+
+	q = gsh_malloc(sizeof(struct fridgethr_work));
+	glist_init(&q->link);
+	q->func = func;
+	q->arg = arg;
+
+	/* counted first, so a thief never takes it uncounted */
+	(void) atomic_inc_uint32_t(&fr->nstealable);
+	if (!fridgethr_deque_push(&fe->deque, q)) {
+		(void) atomic_dec_uint32_t(&fr->nstealable);
 		gsh_free(q);
-		return true;
+		return false;
 	}
+
+	return true;
 }
 
 /**
@@ -354,6 +599,18 @@ static bool fridgethr_freeze(struct fridgethr *fr,
 			 ctx);
 	/* Return code from system calls */
 	int rc = 0;
+	/* Work from our own deque */
+	struct fridgethr_work *q;
+
+	/* Work we pushed ourselves needs no lock, unless we are
+	   pausing or stopping. */
+	if ((fr->p.steal_slots != 0) && (fr->command == fridgethr_comm_run)) {
+		q = fridgethr_deque_take(&fe->deque);
+		if (q != NULL) {
+			fridgethr_load(fr, fe, q, true);
+			return true;
+		}
+	}
 
 	PTHREAD_MUTEX_lock(&fr->mtx);
  restart:
@@ -366,10 +623,12 @@ static bool fridgethr_freeze(struct fridgethr *fr,
 	}
 
 	/* rc would have been set in the while loop below */
-	if (((rc == ETIMEDOUT) && (fr->nthreads > fr->p.thr_min))
+	if ((((rc == ETIMEDOUT) || (fe->flags & fridgethr_flag_retire))
+	     && (fr->nthreads > fr->p.thr_min))
 	    || (fr->command == fridgethr_comm_stop)) {
 		/* We do this here since we already have the fridge
 		   lock. */
+		fridgethr_deque_drain(fr, fe);
 		--(fr->nthreads);
 		glist_del(&fe->thread_link);
 		if ((fr->nthreads == 0) && (fr->command == fridgethr_comm_stop)
@@ -398,6 +657,8 @@ static bool fridgethr_freeze(struct fridgethr *fr,
 	PTHREAD_MUTEX_lock(&fe->ctx.mtx);
 	fe->frozen = true;
 	fe->flags |= fridgethr_flag_available;
+	/* At the low water mark, so a retiring thread stays. */
+	fe->flags &= ~fridgethr_flag_retire;
 	/* Not ideal, but no ideal factoring occurred to me. */
 	if ((fr->p.deferment == fridgethr_defer_block)
 	    && (fr->deferment.block.waiters > 0)) {
@@ -522,6 +783,7 @@ static void *fridgethr_start_routine(void *arg)
 	int old_state = 0;
 
 	SetNameFunction(fr->s);
+	fridgethr_self = fe;
 
 	/* Excplicitly and definitely enable cancellation */
 	pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &old_state);
@@ -560,8 +822,10 @@ static void *fridgethr_start_routine(void *arg)
 
 	PTHREAD_MUTEX_destroy(&fe->ctx.mtx);
 	PTHREAD_COND_destroy(&fe->ctx.cv);
+	gsh_free(fe->deque.slots);
 	gsh_free(fe);
 	fe = NULL;
+	fridgethr_self = NULL;
 	/* At this point the fridge entry no longer exists and must
 	   not be accessed. */
 	return NULL;
@@ -617,6 +881,7 @@ static int fridgethr_spawn(struct fridgethr *fr,
 	fe->ctx.func = func;
 	fe->ctx.arg = arg;
 	fe->frozen = false;
+	fridgethr_deque_init(fr, fe);
 
 	rc = pthread_create(&fe->ctx.id, &fr->attr, fridgethr_start_routine,
 			    fe);
@@ -649,6 +914,7 @@ static int fridgethr_spawn(struct fridgethr *fr,
 	if (mutexed)
 		PTHREAD_MUTEX_destroy(&fe->ctx.mtx);
 
+	gsh_free(fe->deque.slots);
 	gsh_free(fe);
 	PTHREAD_MUTEX_unlock(&fr->mtx);
 
@@ -833,6 +1099,9 @@ int fridgethr_submit(struct fridgethr *fr,
 		return EPIPE;
 	}
 
+	if ((fr->p.steal_slots != 0) && fridgethr_submit_local(fr, func, arg))
+		return 0;
+
 	PTHREAD_MUTEX_lock(&fr->mtx);
 	if (fr->command == fridgethr_comm_stop) {
 		LogMajor(COMPONENT_THREAD,
@@ -1351,6 +1620,47 @@ bool fridgethr_you_should_break(struct fridgethr_context *ctx)
 	return fr->transitioning;
 }
 
+/**
+ * @brief Ask for the calling thread to leave the fridge
+ *
+ * Meant for fridgethr_flavor_looper fridges, whose threads otherwise
+ * only exit on stop.  When the looper function returns, the thread
+ * exits instead of being rescheduled, unless that would take the
+ * fridge to or below its low water mark.
+ *
+ * @param[in] ctx The thread context
+ */
+
+void fridgethr_retire(struct fridgethr_context *ctx)
+{
+	/* Entry for this thread */
+	struct fridgethr_entry *fe = container_of(ctx, struct fridgethr_entry,
+						  ctx);
+
+	PTHREAD_MUTEX_lock(&fe->ctx.mtx);
+	fe->flags |= fridgethr_flag_retire;
+	PTHREAD_MUTEX_unlock(&fe->ctx.mtx);
+}
+
+/**
+ * @brief Return the number of threads in a fridge
+ *
+ * @param[in] fr The fridge
+ *
+ * @return Thread count, including idle threads.
+ */
+
+uint32_t fridgethr_nthreads(struct fridgethr *fr)
+{
+	uint32_t nthreads;
+
+	PTHREAD_MUTEX_lock(&fr->mtx);
+	nthreads = fr->nthreads;
+	PTHREAD_MUTEX_unlock(&fr->mtx);
+
+	return nthreads;
+}
+
 /**
  * @brief Populate a fridge with threads all running the same thing
  *
@@ -1414,6 +1724,7 @@ int fridgethr_populate(struct fridgethr *fr,
 		fe->ctx.func = func;
 		fe->ctx.arg = arg;
 		fe->frozen = false;
+		fridgethr_deque_init(fr, fe);
 
 		rc = pthread_create(&fe->ctx.id, &fr->attr,
 				    fridgethr_start_routine, fe);
@@ -1515,6 +1826,7 @@ int general_fridge_init(void)
 	frp.thr_min = 0;
 	frp.flavor = fridgethr_flavor_worker;
 	frp.deferment = fridgethr_defer_queue;
+	frp.steal_slots = 64;
 
 	rc = fridgethr_init(&general_fridge, "Gen_Fridge", &frp);
 	if (rc != 0) {
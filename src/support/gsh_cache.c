@@ -0,0 +1,510 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file gsh_cache.c
+ * @brief Concurrent cache of small keys and values
+ *
+ * See gsh_cache.h.
+ */
+
+#include "config.h"
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include "log.h"
+#include "common_utils.h"
+#include "gsh_list.h"
+#include "gsh_intrinsic.h"
+#include "abstract_atomic.h"
+#include "abstract_mem.h"
+#include "gsh_hash.h"
+#include "gsh_cache.h"
+
+/**
+ * @brief Slots in a bucket, any of which may hold a key
+ */
+
+#define GSH_CACHE_WAYS 4
+
+/**
+ * @brief A cached key and value
+ *
+ * The key, then the value, follow the header.
+ */
+
+struct gsh_cache_slot {
+	uint32_t seq;		/*< odd while the slot is written */
+	uint32_t gen;		/*< cache generation when written */
+	uint64_t hash;		/*< hash of the key */
+	time_t stamp;		/*< when written */
+	time_t expires;		/*< when to stop using it, 0 never */
+	uint16_t key_len;
+	uint16_t value_len;
+	bool used;		/*< holds an entry */
+	bool negative;		/*< the key has no value */
+	char data[];
+};
+
+/**
+ * @brief A part of the slots, with its own counters
+ */
+
+struct gsh_cache_shard {
+	uint64_t hits;
+	uint64_t negative_hits;
+	uint64_t misses;
+	uint64_t expired;
+	uint64_t inserts;
+	uint64_t evictions;
+	uint64_t dropped;
+	char *slots;		/*< buckets * GSH_CACHE_WAYS slots */
+} __attribute__((__aligned__(GSH_CACHE_LINE_SIZE)));
+
+struct gsh_cache {
+	struct glist_head caches;	/*< Link in gsh_caches */
+	struct gsh_cache_params p;
+	char *name;
+	uint32_t gen;		/*< bumped to empty the cache */
+	size_t stride;		/*< bytes per slot */
+	uint32_t nshards;	/*< a power of two */
+	uint32_t nbuckets;	/*< per shard, a power of two */
+	char *slots;		/*< all of the shards' slots */
+	struct gsh_cache_shard *shards;
+};
+
+/**
+ * @brief Every cache, for the stats
+ */
+
+static struct glist_head gsh_caches = GLIST_HEAD_INIT(gsh_caches);
+static pthread_mutex_t gsh_caches_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+static inline uint32_t gsh_cache_pow2_floor(uint64_t n)
+{
+	uint32_t p = 1;
+
+	while ((uint64_t)p * 2 <= n && p < (1U << 30))
+		p <<= 1;
+	return p;
+}
+
+/**
+ * @brief Create a cache
+ *
+ * The number of slots is what fits in the byte budget, rounded down
+ * to a power of two buckets per shard.
+ *
+ * @param[in] params The cache's parameters, the name is copied
+ *
+ * @return The cache.
+ */
+
+struct gsh_cache *gsh_cache_create(const struct gsh_cache_params *params)
+{
+	struct gsh_cache *cache = gsh_calloc(1, sizeof(*cache));
+	uint64_t nslots;
+	uint32_t i;
+
+	cache->p = *params;
+	cache->name = gsh_strdup(params->name);
+	cache->p.name = cache->name;
+	if (cache->p.key_max > UINT16_MAX)
+		cache->p.key_max = UINT16_MAX;
+	if (cache->p.value_max > UINT16_MAX)
+		cache->p.value_max = UINT16_MAX;
+
+	cache->gen = 1;
+	cache->stride = sizeof(struct gsh_cache_slot) + cache->p.key_max +
+			cache->p.value_max;
+	cache->stride = (cache->stride + 7) & ~(size_t)7;
+
+	cache->nshards = gsh_cache_pow2_floor(params->shards ? params->shards
+							     : 16);
+	nslots = params->bytes / cache->stride;
+	cache->nbuckets = gsh_cache_pow2_floor(
+		nslots / (cache->nshards * GSH_CACHE_WAYS));
+
+	cache->shards = gsh_malloc_aligned(GSH_CACHE_LINE_SIZE,
+					   cache->nshards *
+					   sizeof(struct gsh_cache_shard));
+	memset(cache->shards, 0,
+	       cache->nshards * sizeof(struct gsh_cache_shard));
+	cache->slots = gsh_calloc((size_t)cache->nshards * cache->nbuckets *
+				  GSH_CACHE_WAYS, cache->stride);
+	for (i = 0; i < cache->nshards; i++)
+		cache->shards[i].slots = cache->slots +
+			(size_t)i * cache->nbuckets * GSH_CACHE_WAYS *
+			cache->stride;
+
+	PTHREAD_MUTEX_lock(&gsh_caches_mtx);
+	glist_add_tail(&gsh_caches, &cache->caches);
+	PTHREAD_MUTEX_unlock(&gsh_caches_mtx);
+
+	LogDebug(COMPONENT_INIT,
+		 "Cache %s holds %u entries of up to %u+%u bytes",
+		 cache->name,
+		 cache->nshards * cache->nbuckets * GSH_CACHE_WAYS,
+		 cache->p.key_max, cache->p.value_max);
+
+	return cache;
+}
+
+/**
+ * @brief Destroy a cache nobody uses any more
+ *
+ * @param[in] cache The cache
+ */
+
+void gsh_cache_destroy(struct gsh_cache *cache)
+{
+	PTHREAD_MUTEX_lock(&gsh_caches_mtx);
+	glist_del(&cache->caches);
+	PTHREAD_MUTEX_unlock(&gsh_caches_mtx);
+
+	gsh_free(cache->slots);
+	gsh_free(cache->shards);
+	gsh_free(cache->name);
+	gsh_free(cache);
+}
+
+/**
+ * @brief Find the shard and the first slot of a key's bucket
+ */
+
+static inline struct gsh_cache_slot *gsh_cache_bucket(
+					struct gsh_cache *cache,
+					uint64_t hash,
+					struct gsh_cache_shard **shard)
+{
+	uint32_t bucket = hash & (cache->nbuckets - 1);
+
+	*shard = &cache->shards[(hash >> 32) & (cache->nshards - 1)];
+	return (struct gsh_cache_slot *)
+		((*shard)->slots + (size_t)bucket * GSH_CACHE_WAYS *
+		 cache->stride);
+}
+
+static inline struct gsh_cache_slot *gsh_cache_way(struct gsh_cache *cache,
+						   struct gsh_cache_slot *first,
+						   uint32_t way)
+{
+	return (struct gsh_cache_slot *)((char *)first + way * cache->stride);
+}
+
+/**
+ * @brief Whether a slot holds a key, in the current generation
+ */
+
+static inline bool gsh_cache_match(struct gsh_cache_slot *slot, uint32_t gen,
+				   uint64_t hash, const void *key,
+				   uint32_t key_len)
+{
+	return slot->used && slot->gen == gen && slot->hash == hash &&
+	       slot->key_len == key_len &&
+	       memcmp(slot->data, key, key_len) == 0;
+}
+
+/**
+ * @brief Look up a key
+ *
+ * @param[in]     cache     The cache
+ * @param[in]     key       The key
+ * @param[in]     key_len   Its length
+ * @param[out]    value     Buffer of value_max bytes for the value,
+ *                          undefined unless GSH_CACHE_HIT
+ * @param[out]    value_len Length of the value, may be NULL
+ *
+ * @return Whether the key was found, and with which kind of entry.
+ */
+
+enum gsh_cache_result gsh_cache_lookup(struct gsh_cache *cache,
+				       const void *key, uint32_t key_len,
+				       void *value, uint32_t *value_len)
+{
+	struct gsh_cache_shard *shard;
+	struct gsh_cache_slot *first, *slot;
+	enum gsh_cache_result res = GSH_CACHE_MISS;
+	bool expired = false;
+	uint64_t hash;
+	uint32_t gen, seq, way, len;
+
+	if (key_len > cache->p.key_max)
+		return GSH_CACHE_MISS;
+
+	hash = gsh_hash64(key, key_len, 0);
+	first = gsh_cache_bucket(cache, hash, &shard);
+	gen = atomic_fetch_uint32_t(&cache->gen);
+
+	for (way = 0; way < GSH_CACHE_WAYS; way++) {
+		slot = gsh_cache_way(cache, first, way);
+		seq = atomic_fetch_uint32_t(&slot->seq);
+		if ((seq & 1) ||
+		    !gsh_cache_match(slot, gen, hash, key, key_len))
+			continue;
+
+		if (slot->expires != 0 && slot->expires <= time(NULL)) {
+			expired = true;
+		} else if (slot->negative) {
+			res = GSH_CACHE_NEGATIVE;
+		} else {
+			len = slot->value_len;
+			if (len > cache->p.value_max)
+				len = cache->p.value_max;
+			if (len != 0)
+				memcpy(value, slot->data + key_len, len);
+			if (value_len)
+				*value_len = len;
+			res = GSH_CACHE_HIT;
+		}
+
+		/* Finish reading the slot before checking nobody wrote
+		 * it */
+		__sync_synchronize();
+		if (atomic_fetch_uint32_t(&slot->seq) != seq) {
+			res = GSH_CACHE_MISS;
+			expired = false;
+		}
+		break;
+	}
+
+	switch (res) {
+	case GSH_CACHE_HIT:
+		(void) atomic_inc_uint64_t(&shard->hits);
+		break;
+	case GSH_CACHE_NEGATIVE:
+		(void) atomic_inc_uint64_t(&shard->negative_hits);
+		break;
+	case GSH_CACHE_MISS:
+		(void) atomic_inc_uint64_t(&shard->misses);
+		if (expired)
+			(void) atomic_inc_uint64_t(&shard->expired);
+		break;
+	}
+
+	return res;
+}
+
+/**
+ * @brief Store an entry
+ *
+ * The key's own slot is reused if it has one, else an empty, stale
+ * or expired slot of the bucket, else the oldest one.
+ */
+
+static void gsh_cache_store(struct gsh_cache *cache, const void *key,
+			    uint32_t key_len, const void *value,
+			    uint32_t value_len, bool negative)
+{
+	struct gsh_cache_shard *shard;
+	struct gsh_cache_slot *first, *slot, *victim = NULL;
+	bool live = false;
+	time_t now_s = time(NULL);
+	uint32_t ttl = negative ? cache->p.negative_ttl : cache->p.ttl;
+	uint64_t hash;
+	uint32_t gen, seq, way;
+
+	if (key_len > cache->p.key_max || value_len > cache->p.value_max)
+		return;
+
+	hash = gsh_hash64(key, key_len, 0);
+	first = gsh_cache_bucket(cache, hash, &shard);
+	gen = atomic_fetch_uint32_t(&cache->gen);
+
+	for (way = 0; way < GSH_CACHE_WAYS; way++) {
+		slot = gsh_cache_way(cache, first, way);
+
+		if (gsh_cache_match(slot, gen, hash, key, key_len)) {
+			victim = slot;
+			live = false;
+			break;
+		}
+		if (!slot->used || slot->gen != gen ||
+		    (slot->expires != 0 && slot->expires <= now_s)) {
+			if (victim == NULL || live) {
+				victim = slot;
+				live = false;
+			}
+		} else if (victim == NULL ||
+			   (live && slot->stamp < victim->stamp)) {
+			victim = slot;
+			live = true;
+		}
+	}
+
+	seq = atomic_fetch_uint32_t(&victim->seq);
+	if ((seq & 1) || !atomic_cas_uint32_t(&victim->seq, seq, seq + 1)) {
+		(void) atomic_inc_uint64_t(&shard->dropped);
+		return;
+	}
+
+	victim->gen = gen;
+	victim->hash = hash;
+	victim->stamp = now_s;
+	victim->expires = ttl ? now_s + ttl : 0;
+	victim->key_len = key_len;
+	victim->value_len = negative ? 0 : value_len;
+	victim->used = true;
+	victim->negative = negative;
+	memcpy(victim->data, key, key_len);
+	if (!negative && value_len != 0)
+		memcpy(victim->data + key_len, value, value_len);
+
+	atomic_store_uint32_t(&victim->seq, seq + 2);
+
+	(void) atomic_inc_uint64_t(&shard->inserts);
+	if (live)
+		(void) atomic_inc_uint64_t(&shard->evictions);
+}
+
+/**
+ * @brief Remember the value of a key
+ *
+ * Keys or values larger than the cache takes are not kept, nor is
+ * the entry if another thread is writing the slot.
+ *
+ * @param[in] cache     The cache
+ * @param[in] key       The key
+ * @param[in] key_len   Its length
+ * @param[in] value     The value
+ * @param[in] value_len Its length
+ */
+
+void gsh_cache_insert(struct gsh_cache *cache, const void *key,
+		      uint32_t key_len, const void *value,
+		      uint32_t value_len)
+{
+	gsh_cache_store(cache, key, key_len, value, value_len, false);
+}
+
+/**
+ * @brief Remember that a key has no value
+ *
+ * @param[in] cache   The cache
+ * @param[in] key     The key
+ * @param[in] key_len Its length
+ */
+
+void gsh_cache_insert_negative(struct gsh_cache *cache, const void *key,
+			       uint32_t key_len)
+{
+	gsh_cache_store(cache, key, key_len, NULL, 0, true);
+}
+
+/**
+ * @brief Forget a key
+ *
+ * @param[in] cache   The cache
+ * @param[in] key     The key
+ * @param[in] key_len Its length
+ */
+
+void gsh_cache_remove(struct gsh_cache *cache, const void *key,
+		      uint32_t key_len)
+{
+	struct gsh_cache_shard *shard;
+	struct gsh_cache_slot *first, *slot;
+	uint64_t hash;
+	uint32_t gen, seq, way;
+
+	if (key_len > cache->p.key_max)
+		return;
+
+	hash = gsh_hash64(key, key_len, 0);
+	first = gsh_cache_bucket(cache, hash, &shard);
+	gen = atomic_fetch_uint32_t(&cache->gen);
+
+	for (way = 0; way < GSH_CACHE_WAYS; way++) {
+		slot = gsh_cache_way(cache, first, way);
+		if (!gsh_cache_match(slot, gen, hash, key, key_len))
+			continue;
+
+		/* a writer that has it is replacing it anyway */
+		seq = atomic_fetch_uint32_t(&slot->seq);
+		if ((seq & 1) ||
+		    !atomic_cas_uint32_t(&slot->seq, seq, seq + 1))
+			continue;
+		slot->used = false;
+		atomic_store_uint32_t(&slot->seq, seq + 2);
+	}
+}
+
+/**
+ * @brief Forget every entry
+ *
+ * @param[in] cache The cache
+ */
+
+void gsh_cache_clear(struct gsh_cache *cache)
+{
+	(void) atomic_inc_uint32_t(&cache->gen);
+}
+
+/**
+ * @brief Read the counters of a cache
+ *
+ * @param[in]  cache The cache
+ * @param[out] stats The counters, summed over the shards
+ */
+
+void gsh_cache_get_stats(struct gsh_cache *cache,
+			 struct gsh_cache_stats *stats)
+{
+	uint32_t i;
+
+	memset(stats, 0, sizeof(*stats));
+	stats->name = cache->name;
+	stats->slots = (uint64_t)cache->nshards * cache->nbuckets *
+		       GSH_CACHE_WAYS;
+	stats->bytes = stats->slots * cache->stride;
+
+	for (i = 0; i < cache->nshards; i++) {
+		struct gsh_cache_shard *shard = &cache->shards[i];
+
+		stats->hits += atomic_fetch_uint64_t(&shard->hits);
+		stats->negative_hits +=
+			atomic_fetch_uint64_t(&shard->negative_hits);
+		stats->misses += atomic_fetch_uint64_t(&shard->misses);
+		stats->expired += atomic_fetch_uint64_t(&shard->expired);
+		stats->inserts += atomic_fetch_uint64_t(&shard->inserts);
+		stats->evictions += atomic_fetch_uint64_t(&shard->evictions);
+		stats->dropped += atomic_fetch_uint64_t(&shard->dropped);
+	}
+}
+
+/**
+ * @brief Call a function on every cache
+ *
+ * Caches are neither created nor destroyed meanwhile.
+ *
+ * @param[in] cb  The function
+ * @param[in] arg Its argument
+ */
+
+void gsh_cache_foreach(void (*cb)(struct gsh_cache *, void *), void *arg)
+{
+	struct glist_head *g;
+
+	PTHREAD_MUTEX_lock(&gsh_caches_mtx);
+	glist_for_each(g, &gsh_caches)
+		cb(glist_entry(g, struct gsh_cache, caches), arg);
+	PTHREAD_MUTEX_unlock(&gsh_caches_mtx);
+}
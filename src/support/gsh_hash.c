@@ -0,0 +1,267 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file gsh_hash.c
+ * @brief CRC32C based hashing, with the CRC instructions of the CPU
+ *
+ * Each implementation is the same body, inlined around its own CRC
+ * step, so that the one for a target is built for it alone.  The
+ * first call picks the best the CPU has.  Until then, or if it has
+ * none, the tables of slice by 8 stand in.
+ */
+
+#include "config.h"
+#include <string.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include "gsh_hash.h"
+#include "abstract_atomic.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <nmmintrin.h>
+#define GSH_HASH_SSE42 1
+#endif
+
+#if defined(__aarch64__) && defined(__GNUC__) && defined(__linux__)
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#define GSH_HASH_ARMV8 1
+#endif
+
+#ifdef WORDS_BIGENDIAN
+#include <byteswap.h>
+#define le64_order(x) bswap_64(x)
+#else
+#define le64_order(x) (x)
+#endif
+
+#define CRC32C_POLY 0x82F63B78	/* Castagnoli, reflected */
+
+static uint32_t crc32c_table[8][256];
+
+typedef uint64_t (*gsh_hash64_t)(const void *, size_t, uint64_t);
+
+static uint64_t gsh_hash64_select(const void *buf, size_t len,
+				  uint64_t seed);
+
+static gsh_hash64_t gsh_hash64_fn = gsh_hash64_select;
+static const char *gsh_hash_name = "generic";
+static pthread_once_t gsh_hash_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Load 8 bytes, low byte first whatever the machine
+ */
+
+static inline uint64_t load64(const unsigned char *p)
+{
+	uint64_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return le64_order(v);
+}
+
+/**
+ * @brief Load the last 1 to 7 bytes, zero filled
+ */
+
+static inline uint64_t load_tail(const unsigned char *p, size_t len)
+{
+	uint64_t v = 0;
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		v |= (uint64_t)p[i] << (8 * i);
+
+	return v;
+}
+
+/**
+ * @brief The hash, around a CRC32C step of one 64 bit word
+ */
+
+#define GSH_HASH_BODY(crc_u64)						\
+	const unsigned char *p = buf;					\
+	uint32_t a = (uint32_t)seed;					\
+	uint32_t b = (uint32_t)(seed >> 32) ^ (uint32_t)len;		\
+	uint32_t c = a ^ 0x5BD1E995, d = b;				\
+	size_t left = len;						\
+	uint64_t w, x;							\
+									\
+	/* Two words at a time, into four lanes that run in parallel */\
+	for (; left >= 16; p += 16, left -= 16) {			\
+		w = load64(p);						\
+		x = load64(p + 8);					\
+		a = crc_u64(a, w);					\
+		b = crc_u64(b, w * GSH_HASH_K1);			\
+		c = crc_u64(c, x);					\
+		d = crc_u64(d, x * GSH_HASH_K1);			\
+	}								\
+									\
+	if (left >= 8) {						\
+		w = load64(p);						\
+		a = crc_u64(a, w);					\
+		b = crc_u64(b, w * GSH_HASH_K1);			\
+		p += 8;							\
+		left -= 8;						\
+	}								\
+									\
+	if (left != 0) {						\
+		x = load_tail(p, left);					\
+		c = crc_u64(c, x);					\
+		d = crc_u64(d, x * GSH_HASH_K1);			\
+	}								\
+									\
+	return gsh_hash_mix(((uint64_t)a << 32 | b) ^			\
+			    (((uint64_t)c << 32 | d) * GSH_HASH_K1) ^	\
+			    ((uint64_t)len * GSH_HASH_K2))
+
+static void crc32c_init_table(void)
+{
+	uint32_t crc;
+	int i, j;
+
+	for (i = 0; i < 256; i++) {
+		crc = i;
+		for (j = 0; j < 8; j++)
+			crc = (crc >> 1) ^ ((crc & 1) ? CRC32C_POLY : 0);
+		crc32c_table[0][i] = crc;
+	}
+
+	for (i = 0; i < 256; i++) {
+		crc = crc32c_table[0][i];
+		for (j = 1; j < 8; j++) {
+			crc = crc32c_table[0][crc & 0xff] ^ (crc >> 8);
+			crc32c_table[j][i] = crc;
+		}
+	}
+}
+
+static inline uint32_t crc32c_sw_u64(uint32_t crc, uint64_t v)
+{
+	v ^= crc;
+
+	return crc32c_table[7][v & 0xff] ^
+	       crc32c_table[6][(v >> 8) & 0xff] ^
+	       crc32c_table[5][(v >> 16) & 0xff] ^
+	       crc32c_table[4][(v >> 24) & 0xff] ^
+	       crc32c_table[3][(v >> 32) & 0xff] ^
+	       crc32c_table[2][(v >> 40) & 0xff] ^
+	       crc32c_table[1][(v >> 48) & 0xff] ^
+	       crc32c_table[0][v >> 56];
+}
+
+static uint64_t gsh_hash64_sw(const void *buf, size_t len, uint64_t seed)
+{
+	GSH_HASH_BODY(crc32c_sw_u64);
+}
+
+#ifdef GSH_HASH_SSE42
+static inline __attribute__((always_inline, target("sse4.2")))
+uint32_t crc32c_sse42_u64(uint32_t crc, uint64_t v)
+{
+	return _mm_crc32_u64(crc, v);
+}
+
+static __attribute__((target("sse4.2")))
+uint64_t gsh_hash64_sse42(const void *buf, size_t len, uint64_t seed)
+{
+	GSH_HASH_BODY(crc32c_sse42_u64);
+}
+#endif
+
+#ifdef GSH_HASH_ARMV8
+static inline __attribute__((always_inline, target("+crc")))
+uint32_t crc32c_armv8_u64(uint32_t crc, uint64_t v)
+{
+	return __crc32cd(crc, v);
+}
+
+static __attribute__((target("+crc")))
+uint64_t gsh_hash64_armv8(const void *buf, size_t len, uint64_t seed)
+{
+	GSH_HASH_BODY(crc32c_armv8_u64);
+}
+#endif
+
+static void gsh_hash_init(void)
+{
+	gsh_hash64_t fn = gsh_hash64_sw;
+
+	crc32c_init_table();
+
+#ifdef GSH_HASH_SSE42
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse4.2")) {
+		fn = gsh_hash64_sse42;
+		gsh_hash_name = "sse4.2";
+	}
+#endif
+
+#ifdef GSH_HASH_ARMV8
+	if (getauxval(AT_HWCAP) & HWCAP_CRC32) {
+		fn = gsh_hash64_armv8;
+		gsh_hash_name = "armv8-crc";
+	}
+#endif
+
+	atomic_store_voidptr((void **)&gsh_hash64_fn, fn);
+}
+
+static uint64_t gsh_hash64_select(const void *buf, size_t len,
+				  uint64_t seed)
+{
+	pthread_once(&gsh_hash_once, gsh_hash_init);
+
+	return gsh_hash64(buf, len, seed);
+}
+
+/**
+ * @brief Hash a byte string
+ *
+ * @param[in] buf  The key
+ * @param[in] len  Its length
+ * @param[in] seed Seed, so one key may hash differently in two tables
+ *
+ * @return The hash.
+ */
+
+uint64_t gsh_hash64(const void *buf, size_t len, uint64_t seed)
+{
+	gsh_hash64_t fn = atomic_fetch_voidptr((void **)&gsh_hash64_fn);
+
+	return fn(buf, len, seed);
+}
+
+uint64_t gsh_hash64_generic(const void *buf, size_t len, uint64_t seed)
+{
+	pthread_once(&gsh_hash_once, gsh_hash_init);
+
+	return gsh_hash64_sw(buf, len, seed);
+}
+
+const char *gsh_hash_impl(void)
+{
+	pthread_once(&gsh_hash_once, gsh_hash_init);
+
+	return gsh_hash_name;
+}
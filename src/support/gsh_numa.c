@@ -0,0 +1,275 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file gsh_numa.c
+ * @brief NUMA topology from sysfs
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include "log.h"
+#include "abstract_mem.h"
+#include "gsh_numa.h"
+
+#define GSH_NUMA_MAX_NODES 64
+
+static uint32_t numa_nnodes = 1;
+static cpu_set_t numa_cpus[GSH_NUMA_MAX_NODES];
+static uint16_t numa_cpu_node[CPU_SETSIZE];
+static uint32_t numa_sysid[GSH_NUMA_MAX_NODES];	/*< Kernel's node numbers */
+
+#ifdef LINUX
+/**
+ * @brief Parse a sysfs CPU list such as "0-3,8-11"
+ *
+ * @param[in]  list CPU list
+ * @param[out] set  CPUs in the list
+ *
+ * @return Number of CPUs in the list.
+ */
+static int numa_parse_cpulist(char *list, cpu_set_t *set)
+{
+	char *tok, *save = NULL;
+	long lo, hi, cpu;
+
+	CPU_ZERO(set);
+	for (tok = strtok_r(list, ",\n", &save); tok != NULL;
+	     tok = strtok_r(NULL, ",\n", &save)) {
+		char *dash = strchr(tok, '-');
+
+		lo = strtol(tok, NULL, 10);
+		hi = dash ? strtol(dash + 1, NULL, 10) : lo;
+		for (cpu = lo; cpu <= hi && cpu < CPU_SETSIZE; ++cpu)
+			CPU_SET(cpu, set);
+	}
+	return CPU_COUNT(set);
+}
+#endif
+
+/**
+ * @brief Read the NUMA topology
+ *
+ * Safe to call more than once; only the first call does anything.
+ */
+void gsh_numa_init(void)
+{
+#ifdef LINUX
+	static bool initialized;
+	char path[64];
+	char buf[1024];
+	uint32_t id, nnodes = 0;
+	int cpu;
+	FILE *fp;
+
+	if (initialized)
+		return;
+	initialized = true;
+
+	for (id = 0; id < GSH_NUMA_MAX_NODES * 4; ++id) {
+		if (nnodes == GSH_NUMA_MAX_NODES)
+			break;
+		snprintf(path, sizeof(path),
+			 "/sys/devices/system/node/node%" PRIu32 "/cpulist",
+			 id);
+		fp = fopen(path, "r");
+		if (fp == NULL)
+			continue;
+		if (fgets(buf, sizeof(buf), fp) != NULL &&
+		    numa_parse_cpulist(buf, &numa_cpus[nnodes]) > 0) {
+			for (cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+				if (CPU_ISSET(cpu, &numa_cpus[nnodes]))
+					numa_cpu_node[cpu] = nnodes;
+			numa_sysid[nnodes] = id;
+			++nnodes;
+		}
+		fclose(fp);
+	}
+
+	if (nnodes > 0)
+		numa_nnodes = nnodes;
+	else
+		(void) sched_getaffinity(0, sizeof(cpu_set_t), &numa_cpus[0]);
+
+	LogInfo(COMPONENT_INIT, "Found %" PRIu32 " NUMA nodes", numa_nnodes);
+#endif
+}
+
+/**
+ * @brief Number of NUMA nodes with CPUs
+ */
+uint32_t gsh_numa_nodes(void)
+{
+	return numa_nnodes;
+}
+
+/**
+ * @brief Node of the CPU the calling thread runs on
+ */
+uint32_t gsh_numa_node(void)
+{
+#ifdef LINUX
+	int cpu;
+
+	if (numa_nnodes == 1)
+		return 0;
+
+	cpu = sched_getcpu();
+	if (cpu >= 0 && cpu < CPU_SETSIZE)
+		return numa_cpu_node[cpu];
+#endif
+	return 0;
+}
+
+/**
+ * @brief CPUs of a node
+ *
+ * @param[in] node Node, taken modulo the number of nodes
+ *
+ * @return The CPU set, valid for the life of the process.
+ */
+const cpu_set_t *gsh_numa_cpus(uint32_t node)
+{
+	return &numa_cpus[node % numa_nnodes];
+}
+
+/**
+ * @brief Bind the calling thread to the CPUs of a node
+ *
+ * @param[in] node Node, taken modulo the number of nodes
+ *
+ * @return 0 or an error from pthread_setaffinity_np.
+ */
+int gsh_numa_bind(uint32_t node)
+{
+#ifdef LINUX
+	int rc;
+
+	rc = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t),
+				    gsh_numa_cpus(node));
+	if (rc != 0)
+		LogWarn(COMPONENT_THREAD,
+			"Unable to bind thread to NUMA node %" PRIu32 ": %d",
+			node % numa_nnodes, rc);
+	return rc;
+#else
+	return ENOTSUP;
+#endif
+}
+
+/**
+ * @brief Node of a device
+ *
+ * @param[in] devpath The device's sysfs directory, such as
+ *                    /sys/class/infiniband/mlx5_0
+ *
+ * @return The node, GSH_NUMA_NODE_ANY if the device has none.
+ */
+uint32_t gsh_numa_dev_node(const char *devpath)
+{
+#ifdef LINUX
+	char path[PATH_MAX];
+	uint32_t node;
+	int id = -1;
+	FILE *fp;
+
+	snprintf(path, sizeof(path), "%s/device/numa_node", devpath);
+	fp = fopen(path, "r");
+	if (fp == NULL)
+		return GSH_NUMA_NODE_ANY;
+	if (fscanf(fp, "%d", &id) != 1)
+		id = -1;
+	fclose(fp);
+
+	for (node = 0; id >= 0 && node < numa_nnodes; ++node)
+		if (numa_sysid[node] == (uint32_t)id)
+			return node;
+#endif
+	return GSH_NUMA_NODE_ANY;
+}
+
+/**
+ * @brief Allocate zeroed memory, aligned or not
+ */
+static inline void *numa_zalloc(size_t align, size_t size)
+{
+	void *p;
+
+	if (align == 0)
+		return gsh_calloc(1, size);
+
+	p = gsh_malloc_aligned(align, size);
+	memset(p, 0, size);
+	return p;
+}
+
+/**
+ * @brief Allocate aligned memory on a node
+ *
+ * The memory is zeroed by a thread bound to the node, so the kernel's
+ * default first touch policy places its pages there.  The calling
+ * thread's affinity is restored afterwards.
+ *
+ * @param[in] align Alignment, a power of two, 0 for malloc's
+ * @param[in] size  Bytes to allocate
+ * @param[in] node  Node, GSH_NUMA_NODE_ANY for no placement
+ *
+ * @return The memory, to be freed with gsh_free.
+ */
+void *gsh_numa_alloc_aligned(size_t align, size_t size, uint32_t node)
+{
+	void *p;
+#ifdef LINUX
+	cpu_set_t saved;
+
+	if (node == GSH_NUMA_NODE_ANY || numa_nnodes == 1 ||
+	    pthread_getaffinity_np(pthread_self(), sizeof(saved),
+				   &saved) != 0)
+		return numa_zalloc(align, size);
+
+	(void) gsh_numa_bind(node);
+	p = numa_zalloc(align, size);
+	(void) pthread_setaffinity_np(pthread_self(), sizeof(saved), &saved);
+#else
+	p = numa_zalloc(align, size);
+#endif
+	return p;
+}
+
+/**
+ * @brief Allocate memory on a node
+ *
+ * See gsh_numa_alloc_aligned.
+ *
+ * @param[in] size Bytes to allocate
+ * @param[in] node Node, GSH_NUMA_NODE_ANY for no placement
+ *
+ * @return The memory, to be freed with gsh_free.
+ */
+void *gsh_numa_alloc(size_t size, uint32_t node)
+{
+	return gsh_numa_alloc_aligned(0, size, node);
+}
@@ -0,0 +1,200 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file hot_sampler.c
+ * @brief Heavy hitter sampling of requests
+ *
+ * Space-Saving (Metwally et al.): a summary of k counters tracks any
+ * key whose weight is over 1/k of the total, a new key replacing the
+ * lightest counter and inheriting its count as error.  Unlike a
+ * count-min sketch it needs no separate candidate list to name the
+ * heavy hitters, and it never grows.  The summaries are small enough
+ * for a linear scan; only sampled requests take their locks.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "common_utils.h"
+#include "gsh_hash.h"
+#include "fsal.h"
+#include "client_mgr.h"
+#include "export_mgr.h"
+#include "hot_sampler.h"
+
+struct hot_summary {
+	pthread_mutex_t lock;
+	uint32_t used;
+	uint64_t hash[HOT_SLOTS];	/*< Scanned first, kept apart */
+	uint64_t count[HOT_SLOTS];
+	uint64_t error[HOT_SLOTS];
+	struct hot_key key[HOT_SLOTS];
+};
+
+#define HOT_SUMMARY_INIT { .lock = PTHREAD_MUTEX_INITIALIZER }
+
+static struct hot_summary hot_summaries[HOT_DIM_COUNT][HOT_WEIGHT_COUNT] = {
+	{ HOT_SUMMARY_INIT, HOT_SUMMARY_INIT },
+	{ HOT_SUMMARY_INIT, HOT_SUMMARY_INIT },
+	{ HOT_SUMMARY_INIT, HOT_SUMMARY_INIT },
+};
+
+__thread uint32_t hot_sample_tick;
+
+/**
+ * @brief The part of a request's key a summary counts by
+ */
+static void hot_project(struct hot_key *dst, const struct hot_key *src,
+			enum hot_dim dim)
+{
+	switch (dim) {
+	case HOT_FILES:
+		memset(dst, 0, sizeof(*dst));
+		dst->export_id = src->export_id;
+		dst->fileid = src->fileid;
+		break;
+	case HOT_CLIENTS:
+		memset(dst, 0, sizeof(*dst));
+		memcpy(dst->client, src->client, sizeof(dst->client));
+		break;
+	default:
+		*dst = *src;
+		break;
+	}
+}
+
+static void hot_update(struct hot_summary *s, const struct hot_key *key,
+		       uint64_t weight)
+{
+	uint64_t hash = gsh_hash64(key, sizeof(*key), 0);
+	uint32_t ix, min = 0;
+
+	PTHREAD_MUTEX_lock(&s->lock);
+
+	for (ix = 0; ix < s->used; ix++) {
+		if (s->hash[ix] == hash &&
+		    memcmp(&s->key[ix], key, sizeof(*key)) == 0) {
+			s->count[ix] += weight;
+			goto out;
+		}
+		if (s->count[ix] < s->count[min])
+			min = ix;
+	}
+
+	if (s->used < HOT_SLOTS) {
+		ix = s->used++;
+		s->count[ix] = weight;
+		s->error[ix] = 0;
+	} else {
+		ix = min;
+		s->error[ix] = s->count[ix];
+		s->count[ix] += weight;
+	}
+	s->hash[ix] = hash;
+	s->key[ix] = *key;
+
+ out:
+	PTHREAD_MUTEX_unlock(&s->lock);
+}
+
+/**
+ * @brief Record a sampled request
+ *
+ * The client is copied by address, so nothing here holds a reference.
+ * The weights are scaled by the sampling rate to estimate the whole
+ * traffic.
+ *
+ * @param[in] prog Program of the request
+ * @param[in] vers Version
+ * @param[in] proc Procedure
+ */
+void hot_sample_record(uint32_t prog, uint32_t vers, uint32_t proc)
+{
+	uint64_t rate = nfs_param.core_param.hot_sample_rate;
+	struct hot_key key, proj;
+	int dim;
+
+	memset(&key, 0, sizeof(key));
+	if (op_ctx->client != NULL)
+		(void)strlcpy(key.client, op_ctx->client->hostaddr_str,
+			      sizeof(key.client));
+	if (op_ctx->ctx_export != NULL)
+		key.export_id = op_ctx->ctx_export->export_id;
+	key.fileid = op_ctx->fileid;
+	key.prog = prog;
+	key.vers = vers;
+	key.proc = proc;
+
+	for (dim = 0; dim < HOT_DIM_COUNT; dim++) {
+		if (dim == HOT_FILES && key.fileid == 0)
+			continue;
+		hot_project(&proj, &key, dim);
+		hot_update(&hot_summaries[dim][HOT_BY_OPS], &proj, rate);
+		if (op_ctx->io_bytes != 0)
+			hot_update(&hot_summaries[dim][HOT_BY_BYTES], &proj,
+				   rate * op_ctx->io_bytes);
+	}
+}
+
+static int hot_entry_cmp(const void *a, const void *b)
+{
+	const struct hot_entry *ea = a, *eb = b;
+
+	if (ea->count != eb->count)
+		return ea->count < eb->count ? 1 : -1;
+	return 0;
+}
+
+/**
+ * @brief Get the heaviest keys of a summary
+ *
+ * @param[in]  dim    Which summary
+ * @param[in]  weight By requests or by bytes
+ * @param[out] top    Heaviest first
+ * @param[in]  max    Size of top, at most HOT_SLOTS is useful
+ *
+ * @return Number of entries filled in.
+ */
+uint32_t hot_sampler_top(enum hot_dim dim, enum hot_weight weight,
+			 struct hot_entry *top, uint32_t max)
+{
+	struct hot_summary *s = &hot_summaries[dim][weight];
+	struct hot_entry all[HOT_SLOTS];
+	uint32_t ix, used;
+
+	PTHREAD_MUTEX_lock(&s->lock);
+	used = s->used;
+	for (ix = 0; ix < used; ix++) {
+		all[ix].key = s->key[ix];
+		all[ix].count = s->count[ix];
+		all[ix].error = s->error[ix];
+	}
+	PTHREAD_MUTEX_unlock(&s->lock);
+
+	qsort(all, used, sizeof(all[0]), hot_entry_cmp);
+	if (used > max)
+		used = max;
+	memcpy(top, all, used * sizeof(all[0]));
+	return used;
+}
@@ -0,0 +1,431 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file huge_pool.c
+ * @brief Fixed size object pool carved from huge page regions
+ *
+ * See @ref HugePool.  Free objects are chained through their first
+ * word, a region through a header in its first cache line.
+ */
+
+#include "config.h"
+#include <pthread.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include "log.h"
+#include "common_utils.h"
+#include "gsh_intrinsic.h"
+#include "gsh_config.h"
+#include "abstract_mem.h"
+#include "abstract_atomic.h"
+
+struct huge_link {
+	struct huge_link *next;
+};
+
+struct huge_list {
+	struct huge_link *head;
+	uint32_t count;
+};
+
+struct huge_region {
+	struct huge_region *next;	/*< Regions of the pool */
+	bool explicit;			/*< Mapped with MAP_HUGETLB */
+};
+
+struct huge_pool {
+	char *name;
+	pthread_key_t key;
+	size_t object_size;	/*< As asked, zeroed on allocation */
+	size_t stride;		/*< A multiple of the cache line */
+	pthread_mutex_t mtx;	/*< What follows */
+	struct huge_list depot;
+	struct huge_region *regions;
+	char *carve;		/*< Next object of the current region */
+	char *carve_end;	/*< End of the current region */
+	struct huge_pool_stats stats;
+};
+
+struct huge_cache {
+	huge_pool_t *pool;
+	struct huge_list list;
+};
+
+/** Explicit huge pages ran out, or were never reserved */
+static uint32_t huge_explicit_failed;
+
+static inline void huge_push(struct huge_list *list, void *object)
+{
+	struct huge_link *link = object;
+
+	link->next = list->head;
+	list->head = link;
+	++(list->count);
+}
+
+static inline void *huge_pop(struct huge_list *list)
+{
+	struct huge_link *link = list->head;
+
+	if (link != NULL) {
+		list->head = link->next;
+		--(list->count);
+	}
+	return link;
+}
+
+/**
+ * @brief Whether a pool is named in Huge_Page_Pools
+ *
+ * The names are separated by commas, blanks around them being ignored.
+ */
+static bool huge_pool_named(const char *name)
+{
+	const char *list = nfs_param.core_param.huge_page_pools;
+	size_t len = strlen(name);
+	const char *end;
+
+	while (list != NULL && *list != '\0') {
+		while (*list == ' ' || *list == '\t' || *list == ',')
+			++list;
+		end = strchrnul(list, ',');
+		while (end > list && (end[-1] == ' ' || end[-1] == '\t'))
+			--end;
+		if ((size_t)(end - list) == len &&
+		    strncasecmp(list, name, len) == 0)
+			return true;
+		list = strchrnul(list, ',');
+	}
+
+	return false;
+}
+
+/**
+ * @brief Map a region, MAP_HUGETLB or transparent huge pages
+ *
+ * Transparent huge pages need the region aligned to their size, so
+ * twice as much is mapped and the ends not needed given back.
+ *
+ * @param[out] explicit Whether it is made of hugetlbfs pages
+ *
+ * @return The region, or NULL.
+ */
+static void *huge_map(bool *explicit)
+{
+	size_t size = HUGE_REGION_SIZE;
+	char *base, *aligned;
+
+	*explicit = false;
+
+	if (nfs_param.core_param.huge_pages == HUGE_PAGES_EXPLICIT &&
+	    !atomic_fetch_uint32_t(&huge_explicit_failed)) {
+		base = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (base != MAP_FAILED) {
+			*explicit = true;
+			return base;
+		}
+		if (!atomic_fetch_uint32_t(&huge_explicit_failed)) {
+			atomic_store_uint32_t(&huge_explicit_failed, 1);
+			LogWarn(COMPONENT_MEM_ALLOC,
+				"No hugetlbfs pages left (%s), using transparent huge pages",
+				strerror(errno));
+		}
+	}
+
+	base = mmap(NULL, 2 * size, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (base == MAP_FAILED)
+		return NULL;
+
+	aligned = (char *)(((uintptr_t) base + size - 1) &
+			   ~((uintptr_t) size - 1));
+	if (aligned != base)
+		(void) munmap(base, aligned - base);
+	(void) munmap(aligned + size, base + size - aligned);
+
+#ifdef MADV_HUGEPAGE
+	(void) madvise(aligned, size, MADV_HUGEPAGE);
+#endif
+	return aligned;
+}
+
+/**
+ * @brief Start carving a new region
+ *
+ * @note The pool mutex MUST be held.
+ */
+static void huge_region_add(huge_pool_t *pool)
+{
+	struct huge_region *region;
+	size_t line = GSH_CACHE_LINE_SIZE;
+	size_t first;
+	bool explicit;
+
+	region = huge_map(&explicit);
+	if (region == NULL) {
+		LogMallocFailure(__FILE__, __LINE__, __func__, "huge_map");
+		abort();
+	}
+
+	region->next = pool->regions;
+	region->explicit = explicit;
+	pool->regions = region;
+
+	first = (sizeof(struct huge_region) + line - 1) & ~(line - 1);
+	pool->carve = (char *)region + first;
+	pool->carve_end = (char *)region + HUGE_REGION_SIZE;
+
+	pool->stats.regions++;
+	if (explicit)
+		pool->stats.explicit++;
+}
+
+/**
+ * @brief Refill an empty thread cache
+ *
+ * From the depot first, then by carving new objects.
+ *
+ * @param[in,out] cache Thread cache
+ */
+static void huge_refill(struct huge_cache *cache)
+{
+	huge_pool_t *pool = cache->pool;
+	struct huge_list *list = &cache->list;
+
+	PTHREAD_MUTEX_lock(&pool->mtx);
+
+	if (pool->depot.head != NULL) {
+		while (list->count < HUGE_CACHE_LOW && pool->depot.head != NULL)
+			huge_push(list, huge_pop(&pool->depot));
+		pool->stats.depot = pool->depot.count;
+		pool->stats.depot_refills++;
+		PTHREAD_MUTEX_unlock(&pool->mtx);
+		return;
+	}
+
+	while (list->count < HUGE_CACHE_LOW) {
+		if (pool->carve + pool->stride > pool->carve_end) {
+			if (list->count != 0)
+				break;
+			huge_region_add(pool);
+		}
+		huge_push(list, pool->carve);
+		pool->carve += pool->stride;
+		pool->stats.carved++;
+	}
+
+	PTHREAD_MUTEX_unlock(&pool->mtx);
+}
+
+/**
+ * @brief Move objects from a thread cache to the depot
+ *
+ * @param[in,out] cache Thread cache
+ * @param[in]     keep  Objects to leave in the cache
+ */
+static void huge_spill(struct huge_cache *cache, uint32_t keep)
+{
+	huge_pool_t *pool = cache->pool;
+	struct huge_list *list = &cache->list;
+
+	PTHREAD_MUTEX_lock(&pool->mtx);
+	while (list->count > keep)
+		huge_push(&pool->depot, huge_pop(list));
+	pool->stats.depot = pool->depot.count;
+	PTHREAD_MUTEX_unlock(&pool->mtx);
+}
+
+/**
+ * @brief Give back everything a thread cached, at thread exit
+ *
+ * @param[in] arg Thread cache
+ */
+static void huge_cache_destroy(void *arg)
+{
+	struct huge_cache *cache = arg;
+
+	if (cache->list.count != 0)
+		huge_spill(cache, 0);
+	gsh_free(cache);
+}
+
+/**
+ * @brief Get the calling thread's cache for a pool
+ *
+ * @param[in] pool Pool
+ *
+ * @return The cache, created on first use.
+ */
+static inline struct huge_cache *huge_cache_get(huge_pool_t *pool)
+{
+	struct huge_cache *cache = pthread_getspecific(pool->key);
+
+	if (unlikely(cache == NULL)) {
+		cache = gsh_calloc(1, sizeof(struct huge_cache));
+		cache->pool = pool;
+		(void) pthread_setspecific(pool->key, cache);
+	}
+	return cache;
+}
+
+/**
+ * @brief Create the huge page pool backing a pool, if configured
+ *
+ * Called by pool_basic_init.  Only pools named in Huge_Page_Pools get
+ * one, and only while Huge_Pages is not none.
+ *
+ * @param[in] name        Name of the pool, may be NULL
+ * @param[in] object_size Size of its objects
+ *
+ * @return The huge page pool, or NULL to allocate with malloc.
+ */
+huge_pool_t *huge_pool_select(const char *name, size_t object_size)
+{
+	size_t line = GSH_CACHE_LINE_SIZE;
+	huge_pool_t *pool;
+	int rc;
+
+	if (name == NULL ||
+	    nfs_param.core_param.huge_pages == HUGE_PAGES_NONE ||
+	    !huge_pool_named(name))
+		return NULL;
+
+	if (object_size < sizeof(struct huge_link))
+		object_size = sizeof(struct huge_link);
+
+	if (((object_size + line - 1) & ~(line - 1)) >
+	    HUGE_REGION_SIZE / 16) {
+		LogWarn(COMPONENT_MEM_ALLOC,
+			"Objects of %zu bytes are too large for huge pages, pool %s uses malloc",
+			object_size, name);
+		return NULL;
+	}
+
+	pool = gsh_calloc(1, sizeof(huge_pool_t));
+	pool->name = gsh_strdup(name);
+	pool->object_size = object_size;
+	pool->stride = (object_size + line - 1) & ~(line - 1);
+	pool->stats.object_size = pool->stride;
+
+	rc = pthread_key_create(&pool->key, huge_cache_destroy);
+	if (rc != 0) {
+		LogFatal(COMPONENT_INIT,
+			 "Could not create thread key for %s: %d",
+			 pool->name, rc);
+	}
+	PTHREAD_MUTEX_init(&pool->mtx, NULL);
+
+	LogInfo(COMPONENT_MEM_ALLOC,
+		"Pool %s backed by %s huge pages, objects of %zu bytes",
+		name,
+		nfs_param.core_param.huge_pages == HUGE_PAGES_EXPLICIT
+			? "explicit" : "transparent",
+		pool->stride);
+
+	return pool;
+}
+
+/**
+ * @brief Destroy a huge page pool
+ *
+ * Every object must have been freed and every thread that used the
+ * pool must have exited, as for an I/O buffer pool.
+ *
+ * @param[in] pool The pool, may be NULL
+ */
+void huge_pool_destroy(huge_pool_t *pool)
+{
+	struct huge_region *region;
+
+	if (pool == NULL)
+		return;
+
+	(void) pthread_key_delete(pool->key);
+
+	while ((region = pool->regions) != NULL) {
+		pool->regions = region->next;
+		(void) munmap(region, HUGE_REGION_SIZE);
+	}
+
+	PTHREAD_MUTEX_destroy(&pool->mtx);
+	gsh_free(pool->name);
+	gsh_free(pool);
+}
+
+/**
+ * @brief Allocate a zeroed object
+ *
+ * This function aborts if no memory is available.
+ *
+ * @param[in] pool The pool
+ *
+ * @return The object.
+ */
+void *huge_alloc(huge_pool_t *pool)
+{
+	struct huge_cache *cache = huge_cache_get(pool);
+	void *object;
+
+	if (unlikely(cache->list.head == NULL))
+		huge_refill(cache);
+
+	object = huge_pop(&cache->list);
+	memset(object, 0, pool->object_size);
+	return object;
+}
+
+/**
+ * @brief Return an object to its pool
+ *
+ * @param[in] pool   The pool it was allocated from
+ * @param[in] object The object
+ */
+void huge_free(huge_pool_t *pool, void *object)
+{
+	struct huge_cache *cache = huge_cache_get(pool);
+
+	huge_push(&cache->list, object);
+
+	if (unlikely(cache->list.count > HUGE_CACHE_HIGH))
+		huge_spill(cache, HUGE_CACHE_LOW);
+}
+
+/**
+ * @brief Take a snapshot of the statistics of a pool
+ *
+ * @param[in]  pool  Pool, may be NULL
+ * @param[out] stats Statistics
+ */
+void huge_pool_stats(huge_pool_t *pool, struct huge_pool_stats *stats)
+{
+	if (pool == NULL) {
+		memset(stats, 0, sizeof(*stats));
+		return;
+	}
+
+	PTHREAD_MUTEX_lock(&pool->mtx);
+	*stats = pool->stats;
+	PTHREAD_MUTEX_unlock(&pool->mtx);
+}
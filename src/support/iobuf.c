@@ -0,0 +1,406 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file iobuf.c
+ * @brief Size-classed I/O buffer pool
+ *
+ * See @ref IOBufPool.  Free buffers are chained through their first
+ * word, so an idle buffer costs nothing beyond itself.
+ */
+
+#include "config.h"
+#include <pthread.h>
+#include "log.h"
+#include "common_utils.h"
+#include "abstract_mem.h"
+#include "abstract_atomic.h"
+
+struct iobuf_link {
+	struct iobuf_link *next;
+};
+
+struct iobuf_list {
+	struct iobuf_link *head;
+	uint32_t count;
+};
+
+struct iobuf_depot {
+	pthread_mutex_t mtx;
+	struct iobuf_list list;
+	uint32_t high_water;	/*< Thread cache limits, in buffers */
+	uint32_t low_water;
+	uint32_t max;		/*< Depot limit, in buffers */
+};
+
+struct iobuf_pool {
+	char *name;
+	pthread_key_t key;
+	struct iobuf_depot depot[IOBUF_CLASSES];
+	struct iobuf_pool_stats stats;
+};
+
+struct iobuf_cache {
+	iobuf_pool_t *pool;
+	struct iobuf_list list[IOBUF_CLASSES];
+	uint64_t allocs;	/*< Not yet folded into the pool */
+	uint64_t cache_hits;
+};
+
+/**
+ * @brief Find the size class of a buffer
+ *
+ * @param[in] size Buffer size
+ *
+ * @return Class index, or -1 if larger than any class.
+ */
+static inline int iobuf_class(size_t size)
+{
+	int shift;
+
+	if (size <= IOBUF_MIN_SIZE)
+		return 0;
+	if (size > IOBUF_MAX_SIZE)
+		return -1;
+
+	shift = 64 - __builtin_clzll(size - 1);
+	return shift - IOBUF_MIN_SHIFT;
+}
+
+static inline void iobuf_push(struct iobuf_list *list, void *buf)
+{
+	struct iobuf_link *link = buf;
+
+	link->next = list->head;
+	list->head = link;
+	++(list->count);
+}
+
+static inline void *iobuf_pop(struct iobuf_list *list)
+{
+	struct iobuf_link *link = list->head;
+
+	if (link != NULL) {
+		list->head = link->next;
+		--(list->count);
+	}
+	return link;
+}
+
+/**
+ * @brief Fold the counters of a thread cache into its pool
+ *
+ * @param[in,out] cache Thread cache
+ */
+static void iobuf_fold_stats(struct iobuf_cache *cache)
+{
+	iobuf_pool_t *pool = cache->pool;
+
+	if (cache->allocs == 0)
+		return;
+
+	(void) atomic_add_uint64_t(&pool->stats.allocs, cache->allocs);
+	(void) atomic_add_uint64_t(&pool->stats.cache_hits,
+				   cache->cache_hits);
+	cache->allocs = 0;
+	cache->cache_hits = 0;
+}
+
+/**
+ * @brief Move buffers from a thread cache to the depot
+ *
+ * Whatever will not fit in the depot goes back to the system.
+ *
+ * @param[in,out] cache Thread cache
+ * @param[in]     ix    Size class
+ * @param[in]     keep  Buffers to leave in the cache
+ */
+static void iobuf_spill(struct iobuf_cache *cache, int ix, uint32_t keep)
+{
+	iobuf_pool_t *pool = cache->pool;
+	struct iobuf_depot *depot = &pool->depot[ix];
+	struct iobuf_list *list = &cache->list[ix];
+	struct iobuf_list excess = { NULL, 0 };
+	void *buf;
+
+	PTHREAD_MUTEX_lock(&depot->mtx);
+	while (list->count > keep) {
+		buf = iobuf_pop(list);
+		if (depot->list.count < depot->max)
+			iobuf_push(&depot->list, buf);
+		else
+			iobuf_push(&excess, buf);
+	}
+	PTHREAD_MUTEX_unlock(&depot->mtx);
+
+	iobuf_fold_stats(cache);
+
+	if (excess.count == 0)
+		return;
+
+	(void) atomic_add_uint64_t(&pool->stats.releases, excess.count);
+	while ((buf = iobuf_pop(&excess)) != NULL)
+		gsh_free(buf);
+}
+
+/**
+ * @brief Refill an empty thread cache from the depot
+ *
+ * @param[in,out] cache Thread cache
+ * @param[in]     ix    Size class
+ */
+static void iobuf_refill(struct iobuf_cache *cache, int ix)
+{
+	iobuf_pool_t *pool = cache->pool;
+	struct iobuf_depot *depot = &pool->depot[ix];
+	struct iobuf_list *list = &cache->list[ix];
+	uint32_t want = depot->low_water > 0 ? depot->low_water : 1;
+
+	PTHREAD_MUTEX_lock(&depot->mtx);
+	while (list->count < want && depot->list.head != NULL)
+		iobuf_push(list, iobuf_pop(&depot->list));
+	PTHREAD_MUTEX_unlock(&depot->mtx);
+
+	if (list->count != 0)
+		(void) atomic_inc_uint64_t(&pool->stats.depot_refills);
+
+	iobuf_fold_stats(cache);
+}
+
+/**
+ * @brief Give back everything a thread cached, at thread exit
+ *
+ * @param[in] arg Thread cache
+ */
+static void iobuf_cache_destroy(void *arg)
+{
+	struct iobuf_cache *cache = arg;
+	int ix;
+
+	for (ix = 0; ix < IOBUF_CLASSES; ++ix)
+		if (cache->list[ix].count != 0)
+			iobuf_spill(cache, ix, 0);
+
+	iobuf_fold_stats(cache);
+	gsh_free(cache);
+}
+
+/**
+ * @brief Get the calling thread's cache for a pool
+ *
+ * @param[in] pool Pool
+ *
+ * @return The cache, created on first use.
+ */
+static inline struct iobuf_cache *iobuf_cache_get(iobuf_pool_t *pool)
+{
+	struct iobuf_cache *cache = pthread_getspecific(pool->key);
+
+	if (unlikely(cache == NULL)) {
+		cache = gsh_calloc(1, sizeof(struct iobuf_cache));
+		cache->pool = pool;
+		(void) pthread_setspecific(pool->key, cache);
+	}
+	return cache;
+}
+
+/**
+ * @brief Create an I/O buffer pool
+ *
+ * Limits are in bytes per size class and converted to a count of
+ * buffers of each class, keeping at least one buffer of even the
+ * largest class in each thread.
+ *
+ * @param[in] name       Name of the pool, for log messages
+ * @param[in] high_water Thread cache size that triggers a spill
+ * @param[in] low_water  Thread cache size left after a spill
+ * @param[in] depot_max  Most the shared depot keeps
+ *
+ * @return The new pool.
+ */
+iobuf_pool_t *iobuf_pool_init(const char *name, size_t high_water,
+			      size_t low_water, size_t depot_max)
+{
+	iobuf_pool_t *pool = gsh_calloc(1, sizeof(iobuf_pool_t));
+	struct iobuf_depot *depot;
+	int ix, rc;
+
+	pool->name = gsh_strdup(name ? name : "iobuf");
+
+	rc = pthread_key_create(&pool->key, iobuf_cache_destroy);
+	if (rc != 0) {
+		LogFatal(COMPONENT_INIT,
+			 "Could not create thread key for %s: %d",
+			 pool->name, rc);
+	}
+
+	for (ix = 0; ix < IOBUF_CLASSES; ++ix) {
+		depot = &pool->depot[ix];
+		PTHREAD_MUTEX_init(&depot->mtx, NULL);
+		depot->high_water = high_water >> (IOBUF_MIN_SHIFT + ix);
+		if (depot->high_water == 0)
+			depot->high_water = 1;
+		depot->low_water = low_water >> (IOBUF_MIN_SHIFT + ix);
+		if (depot->low_water >= depot->high_water)
+			depot->low_water = depot->high_water - 1;
+		depot->max = depot_max >> (IOBUF_MIN_SHIFT + ix);
+	}
+
+	LogInfo(COMPONENT_INIT,
+		"I/O buffer pool %s: %lu to %lu bytes, thread cache %zu/%zu, depot %zu bytes per class",
+		pool->name, IOBUF_MIN_SIZE, IOBUF_MAX_SIZE,
+		high_water, low_water, depot_max);
+
+	return pool;
+}
+
+/**
+ * @brief Destroy an I/O buffer pool
+ *
+ * Every thread that used the pool must have exited, since the caches
+ * of live threads cannot be reached from here.
+ *
+ * @param[in] pool The pool to destroy
+ */
+void iobuf_pool_destroy(iobuf_pool_t *pool)
+{
+	struct iobuf_depot *depot;
+	void *buf;
+	int ix;
+
+	if (pool == NULL)
+		return;
+
+	(void) pthread_key_delete(pool->key);
+
+	for (ix = 0; ix < IOBUF_CLASSES; ++ix) {
+		depot = &pool->depot[ix];
+		while ((buf = iobuf_pop(&depot->list)) != NULL)
+			gsh_free(buf);
+		PTHREAD_MUTEX_destroy(&depot->mtx);
+	}
+
+	gsh_free(pool->name);
+	gsh_free(pool);
+}
+
+/**
+ * @brief Allocate an I/O buffer
+ *
+ * This function aborts if no memory is available.
+ *
+ * @param[in] pool Pool, or NULL not to pool
+ * @param[in] size Size wanted
+ *
+ * @return A buffer of at least size bytes, aligned to IOBUF_ALIGN.
+ */
+void *iobuf_alloc(iobuf_pool_t *pool, size_t size)
+{
+	struct iobuf_cache *cache;
+	struct iobuf_list *list;
+	void *buf;
+	int ix;
+
+	if (pool == NULL)
+		return gsh_malloc_aligned(IOBUF_ALIGN, size);
+
+	ix = iobuf_class(size);
+	if (ix < 0) {
+		(void) atomic_inc_uint64_t(&pool->stats.oversize);
+		return gsh_malloc_aligned(IOBUF_ALIGN, size);
+	}
+
+	cache = iobuf_cache_get(pool);
+	list = &cache->list[ix];
+	++(cache->allocs);
+
+	if (likely(list->head != NULL)) {
+		++(cache->cache_hits);
+		return iobuf_pop(list);
+	}
+
+	iobuf_refill(cache, ix);
+	buf = iobuf_pop(list);
+	if (buf != NULL)
+		return buf;
+
+	(void) atomic_inc_uint64_t(&pool->stats.mallocs);
+	return gsh_malloc_aligned(IOBUF_ALIGN, IOBUF_MIN_SIZE << ix);
+}
+
+/**
+ * @brief Free an I/O buffer
+ *
+ * @param[in] pool Pool the buffer came from
+ * @param[in] buf  Buffer, may be NULL
+ * @param[in] size Size it was allocated with
+ */
+void iobuf_free(iobuf_pool_t *pool, void *buf, size_t size)
+{
+	struct iobuf_cache *cache;
+	struct iobuf_list *list;
+	int ix;
+
+	if (buf == NULL)
+		return;
+
+	ix = iobuf_class(size);
+	if (pool == NULL || ix < 0) {
+		gsh_free(buf);
+		return;
+	}
+
+	cache = iobuf_cache_get(pool);
+	list = &cache->list[ix];
+	iobuf_push(list, buf);
+
+	if (unlikely(list->count > pool->depot[ix].high_water))
+		iobuf_spill(cache, ix, pool->depot[ix].low_water);
+}
+
+/**
+ * @brief Take a snapshot of the statistics of a pool
+ *
+ * @param[in]  pool  Pool
+ * @param[out] stats Statistics
+ */
+void iobuf_pool_stats(iobuf_pool_t *pool, struct iobuf_pool_stats *stats)
+{
+	int ix;
+
+	memset(stats, 0, sizeof(*stats));
+	if (pool == NULL)
+		return;
+
+	stats->allocs = atomic_fetch_uint64_t(&pool->stats.allocs);
+	stats->cache_hits = atomic_fetch_uint64_t(&pool->stats.cache_hits);
+	stats->depot_refills =
+		atomic_fetch_uint64_t(&pool->stats.depot_refills);
+	stats->mallocs = atomic_fetch_uint64_t(&pool->stats.mallocs);
+	stats->releases = atomic_fetch_uint64_t(&pool->stats.releases);
+	stats->oversize = atomic_fetch_uint64_t(&pool->stats.oversize);
+
+	for (ix = 0; ix < IOBUF_CLASSES; ++ix) {
+		PTHREAD_MUTEX_lock(&pool->depot[ix].mtx);
+		stats->depot[ix] = pool->depot[ix].list.count;
+		PTHREAD_MUTEX_unlock(&pool->depot[ix].mtx);
+	}
+}
@@ -0,0 +1,224 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file layout_stats.c
+ * @brief What pNFS clients report of their I/O through layouts
+ *
+ * The tables are 4-way set associative, hashed by key.  Clients send
+ * LAYOUTSTATS every few seconds per open layout at most, so a single
+ * lock for both tables is plenty.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "common_utils.h"
+#include "abstract_mem.h"
+#include "gsh_hash.h"
+#include "layout_stats.h"
+
+#define LAYOUT_STATS_WAYS 4
+
+static struct layout_file_stats layout_files[LAYOUT_STATS_FILES];
+static struct layout_device_stats layout_devices[LAYOUT_STATS_DEVICES];
+static pthread_mutex_t layout_stats_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Find or make the slot of a file
+ *
+ * Called with layout_stats_mtx held.
+ */
+static struct layout_file_stats *layout_file_slot(uint16_t export_id,
+						  uint64_t fileid,
+						  time_t when)
+{
+	uint64_t key[2] = { export_id, fileid };
+	uint32_t set = gsh_hash64(key, sizeof(key), 0) %
+		       (LAYOUT_STATS_FILES / LAYOUT_STATS_WAYS);
+	struct layout_file_stats *way = &layout_files[set * LAYOUT_STATS_WAYS];
+	struct layout_file_stats *victim = way;
+	int ix;
+
+	for (ix = 0; ix < LAYOUT_STATS_WAYS; ix++) {
+		if (way[ix].last != 0 && way[ix].export_id == export_id &&
+		    way[ix].fileid == fileid)
+			goto out;
+		if (way[ix].last < victim->last)
+			victim = &way[ix];
+	}
+
+	memset(victim, 0, sizeof(*victim));
+	victim->export_id = export_id;
+	victim->fileid = fileid;
+	ix = victim - way;
+
+ out:
+	way[ix].last = when;
+	return &way[ix];
+}
+
+/**
+ * @brief Record the I/O counts of a LAYOUTSTATS
+ *
+ * @param[in] export_id Export of the file
+ * @param[in] fileid    The file
+ * @param[in] read      Reads done through the layout since the last report
+ * @param[in] write     Writes
+ */
+void layout_stats_io(uint16_t export_id, uint64_t fileid,
+		     const io_info4 *read, const io_info4 *write)
+{
+	struct layout_file_stats *fs;
+
+	PTHREAD_MUTEX_lock(&layout_stats_mtx);
+	fs = layout_file_slot(export_id, fileid, time(NULL));
+	fs->reads += read->ii_count;
+	fs->read_bytes += read->ii_bytes;
+	fs->writes += write->ii_count;
+	fs->write_bytes += write->ii_bytes;
+	PTHREAD_MUTEX_unlock(&layout_stats_mtx);
+}
+
+/**
+ * @brief Record a LAYOUTERROR against the file and the device
+ *
+ * @param[in] export_id Export of the file
+ * @param[in] fileid    The file
+ * @param[in] error     What the client got from the data server
+ */
+void layout_stats_error(uint16_t export_id, uint64_t fileid,
+			const device_error4 *error)
+{
+	uint32_t set = gsh_hash64(error->de_deviceid, NFS4_DEVICEID4_SIZE, 0) %
+		       (LAYOUT_STATS_DEVICES / LAYOUT_STATS_WAYS);
+	struct layout_device_stats *way =
+		&layout_devices[set * LAYOUT_STATS_WAYS];
+	struct layout_device_stats *ds = NULL, *victim = way;
+	time_t when = time(NULL);
+	int ix;
+
+	PTHREAD_MUTEX_lock(&layout_stats_mtx);
+
+	layout_file_slot(export_id, fileid, when)->errors++;
+
+	for (ix = 0; ix < LAYOUT_STATS_WAYS; ix++) {
+		if (way[ix].last != 0 &&
+		    memcmp(way[ix].deviceid, error->de_deviceid,
+			   NFS4_DEVICEID4_SIZE) == 0) {
+			ds = &way[ix];
+			break;
+		}
+		if (way[ix].last < victim->last)
+			victim = &way[ix];
+	}
+
+	if (ds == NULL) {
+		ds = victim;
+		memset(ds, 0, sizeof(*ds));
+		memcpy(ds->deviceid, error->de_deviceid, NFS4_DEVICEID4_SIZE);
+	}
+
+	ds->errors++;
+	ds->last_status = error->de_status;
+	ds->last_op = error->de_opnum;
+	ds->last = when;
+
+	PTHREAD_MUTEX_unlock(&layout_stats_mtx);
+}
+
+static int layout_file_cmp(const void *a, const void *b)
+{
+	const struct layout_file_stats *fa = a, *fb = b;
+	uint64_t ba = fa->read_bytes + fa->write_bytes;
+	uint64_t bb = fb->read_bytes + fb->write_bytes;
+
+	if (fa->errors != fb->errors)
+		return fa->errors < fb->errors ? 1 : -1;
+	if (ba != bb)
+		return ba < bb ? 1 : -1;
+	return 0;
+}
+
+static int layout_device_cmp(const void *a, const void *b)
+{
+	const struct layout_device_stats *da = a, *db = b;
+
+	if (da->errors != db->errors)
+		return da->errors < db->errors ? 1 : -1;
+	return 0;
+}
+
+/**
+ * @brief Copy out the files reported on
+ *
+ * @param[out] files Files with errors first, most errors then most
+ *                   bytes first, to be freed with gsh_free
+ *
+ * @return Number of files.
+ */
+uint32_t layout_stats_files(struct layout_file_stats **files)
+{
+	struct layout_file_stats *rep;
+	uint32_t ix, n = 0;
+
+	rep = gsh_malloc(sizeof(layout_files));
+
+	PTHREAD_MUTEX_lock(&layout_stats_mtx);
+	for (ix = 0; ix < LAYOUT_STATS_FILES; ix++) {
+		if (layout_files[ix].last != 0)
+			rep[n++] = layout_files[ix];
+	}
+	PTHREAD_MUTEX_unlock(&layout_stats_mtx);
+
+	qsort(rep, n, sizeof(*rep), layout_file_cmp);
+	*files = rep;
+	return n;
+}
+
+/**
+ * @brief Copy out the devices reported on
+ *
+ * @param[out] devices Devices, most errors first, to be freed with
+ *                     gsh_free
+ *
+ * @return Number of devices.
+ */
+uint32_t layout_stats_devices(struct layout_device_stats **devices)
+{
+	struct layout_device_stats *rep;
+	uint32_t ix, n = 0;
+
+	rep = gsh_malloc(sizeof(layout_devices));
+
+	PTHREAD_MUTEX_lock(&layout_stats_mtx);
+	for (ix = 0; ix < LAYOUT_STATS_DEVICES; ix++) {
+		if (layout_devices[ix].last != 0)
+			rep[n++] = layout_devices[ix];
+	}
+	PTHREAD_MUTEX_unlock(&layout_stats_mtx);
+
+	qsort(rep, n, sizeof(*rep), layout_device_cmp);
+	*devices = rep;
+	return n;
+}
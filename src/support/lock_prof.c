@@ -0,0 +1,286 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file lock_prof.c
+ * @brief Lock contention profiling
+ *
+ * Call sites are numbered as they are first used.  Each thread has a
+ * table of counters indexed by site, and a short stack of the locks it
+ * holds, to attribute the hold time of a release to the site that took
+ * the lock.  A lock released by a thread other than the one that took
+ * it gets no hold time; when the stack is full its oldest entry is
+ * dropped, so such locks do not fill it.
+ *
+ * Nothing in here may use the PTHREAD_ wrappers.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "abstract_mem.h"
+#include "abstract_atomic.h"
+#include "gsh_intrinsic.h"
+#include "lock_prof.h"
+
+/* Locks a thread may hold at once and have their hold time recorded */
+#define LOCK_PROF_DEPTH 16
+
+/* Site id of the sites past the table, counted in slot 0 */
+#define LOCK_PROF_OVERFLOW LOCK_PROF_SITES
+
+struct lock_prof_held {
+	void *lock;
+	uint32_t id;
+	uint64_t since;
+};
+
+struct lock_prof_thread {
+	struct lock_prof_thread *next;		/*< All tables */
+	struct lock_prof_thread *next_free;	/*< Tables of exited threads */
+	uint32_t depth;
+	struct lock_prof_held held[LOCK_PROF_DEPTH];
+	struct lock_prof_stats stats[LOCK_PROF_SITES];
+};
+
+/* Slot 0 counts the sites past LOCK_PROF_SITES */
+static struct lock_prof_site lock_prof_overflow = {
+	.file = "(other)",
+	.name = "(sites past the table)",
+};
+
+static struct lock_prof_site *lock_prof_sites[LOCK_PROF_SITES] = {
+	&lock_prof_overflow,
+};
+static uint32_t lock_prof_nsites = 1;
+
+static pthread_mutex_t lock_prof_mtx = PTHREAD_MUTEX_INITIALIZER;
+static struct lock_prof_thread *lock_prof_threads;
+static struct lock_prof_thread *lock_prof_free;
+static pthread_key_t lock_prof_key;
+static pthread_once_t lock_prof_once = PTHREAD_ONCE_INIT;
+static __thread struct lock_prof_thread *lock_prof_self;
+
+static inline uint64_t lock_prof_clock(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/** Give the table of an exiting thread to the next thread */
+static void lock_prof_thread_exit(void *arg)
+{
+	struct lock_prof_thread *self = arg;
+
+	self->depth = 0;
+	pthread_mutex_lock(&lock_prof_mtx);
+	self->next_free = lock_prof_free;
+	lock_prof_free = self;
+	pthread_mutex_unlock(&lock_prof_mtx);
+}
+
+static void lock_prof_key_init(void)
+{
+	(void)pthread_key_create(&lock_prof_key, lock_prof_thread_exit);
+}
+
+static struct lock_prof_thread *lock_prof_thread(void)
+{
+	struct lock_prof_thread *self = lock_prof_self;
+
+	if (likely(self != NULL))
+		return self;
+
+	(void)pthread_once(&lock_prof_once, lock_prof_key_init);
+
+	pthread_mutex_lock(&lock_prof_mtx);
+	self = lock_prof_free;
+	if (self != NULL) {
+		lock_prof_free = self->next_free;
+	} else {
+		self = gsh_calloc(1, sizeof(*self));
+		self->next = lock_prof_threads;
+		atomic_store_voidptr((void **)&lock_prof_threads, self);
+	}
+	pthread_mutex_unlock(&lock_prof_mtx);
+
+	(void)pthread_setspecific(lock_prof_key, self);
+	lock_prof_self = self;
+	return self;
+}
+
+static uint32_t lock_prof_site_id(struct lock_prof_site *site)
+{
+	uint32_t id = atomic_fetch_uint32_t(&site->id);
+
+	if (unlikely(id == 0)) {
+		pthread_mutex_lock(&lock_prof_mtx);
+		if (site->id == 0) {
+			id = LOCK_PROF_OVERFLOW;
+			if (lock_prof_nsites < LOCK_PROF_SITES) {
+				id = lock_prof_nsites;
+				lock_prof_sites[id] = site;
+				atomic_store_uint32_t(&lock_prof_nsites,
+						      id + 1);
+			}
+			atomic_store_uint32_t(&site->id, id);
+		}
+		id = site->id;
+		pthread_mutex_unlock(&lock_prof_mtx);
+	}
+
+	return id == LOCK_PROF_OVERFLOW ? 0 : id;
+}
+
+/**
+ * @brief Record an acquisition
+ *
+ * @param[in] site       Call site
+ * @param[in] lock       The lock taken
+ * @param[in] wait_start When the wait began, zero if there was none
+ */
+void lock_prof_acquired(struct lock_prof_site *site, void *lock,
+			const struct timespec *wait_start)
+{
+	struct lock_prof_thread *self = lock_prof_thread();
+	uint64_t now = lock_prof_clock();
+	uint32_t id = lock_prof_site_id(site);
+	struct lock_prof_stats *st = &self->stats[id];
+	uint64_t wait;
+
+	st->acquired++;
+	if (wait_start->tv_sec != 0 || wait_start->tv_nsec != 0) {
+		wait = now - (wait_start->tv_sec * 1000000000ULL +
+			      wait_start->tv_nsec);
+		st->contended++;
+		st->wait_ns += wait;
+		if (wait > st->wait_max)
+			st->wait_max = wait;
+	}
+
+	if (self->depth == LOCK_PROF_DEPTH) {
+		memmove(&self->held[0], &self->held[1],
+			(LOCK_PROF_DEPTH - 1) * sizeof(self->held[0]));
+		self->depth--;
+	}
+	self->held[self->depth].lock = lock;
+	self->held[self->depth].id = id;
+	self->held[self->depth].since = now;
+	self->depth++;
+}
+
+/**
+ * @brief Record a release
+ *
+ * @param[in] lock The lock about to be released
+ */
+void lock_prof_released(void *lock)
+{
+	struct lock_prof_thread *self = lock_prof_self;
+	struct lock_prof_stats *st;
+	uint64_t hold;
+	uint32_t ix;
+
+	if (self == NULL)
+		return;
+
+	for (ix = self->depth; ix-- > 0;) {
+		if (self->held[ix].lock != lock)
+			continue;
+
+		hold = lock_prof_clock() - self->held[ix].since;
+		st = &self->stats[self->held[ix].id];
+		st->hold_ns += hold;
+		if (hold > st->hold_max)
+			st->hold_max = hold;
+
+		/* Locks need not be released in order */
+		memmove(&self->held[ix], &self->held[ix + 1],
+			(self->depth - ix - 1) * sizeof(self->held[0]));
+		self->depth--;
+		return;
+	}
+}
+
+static int lock_prof_cmp(const void *a, const void *b)
+{
+	const struct lock_prof_report *ra = a, *rb = b;
+
+	if (ra->stats.wait_ns != rb->stats.wait_ns)
+		return ra->stats.wait_ns < rb->stats.wait_ns ? 1 : -1;
+	if (ra->stats.acquired != rb->stats.acquired)
+		return ra->stats.acquired < rb->stats.acquired ? 1 : -1;
+	return 0;
+}
+
+/**
+ * @brief Sum the counters of all threads, per site
+ *
+ * The counters are read while the threads update them, so a report
+ * may be slightly behind.
+ *
+ * @param[out] reports Sites taken at least once, most waited for
+ *                     first, to be freed with gsh_free
+ *
+ * @return Number of reports.
+ */
+uint32_t lock_prof_collect(struct lock_prof_report **reports)
+{
+	uint32_t nsites = atomic_fetch_uint32_t(&lock_prof_nsites);
+	struct lock_prof_report *rep;
+	struct lock_prof_thread *thr;
+	struct lock_prof_stats *st, *src;
+	uint32_t ix, n = 0;
+
+	rep = gsh_calloc(nsites, sizeof(*rep));
+	for (ix = 0; ix < nsites; ix++)
+		rep[ix].site = lock_prof_sites[ix];
+
+	for (thr = atomic_fetch_voidptr((void **)&lock_prof_threads);
+	     thr != NULL;
+	     thr = thr->next) {
+		for (ix = 0; ix < nsites; ix++) {
+			src = &thr->stats[ix];
+			st = &rep[ix].stats;
+			st->acquired += src->acquired;
+			st->contended += src->contended;
+			st->wait_ns += src->wait_ns;
+			st->hold_ns += src->hold_ns;
+			if (src->wait_max > st->wait_max)
+				st->wait_max = src->wait_max;
+			if (src->hold_max > st->hold_max)
+				st->hold_max = src->hold_max;
+		}
+	}
+
+	for (ix = 0; ix < nsites; ix++) {
+		if (rep[ix].stats.acquired != 0)
+			rep[n++] = rep[ix];
+	}
+
+	qsort(rep, n, sizeof(*rep), lock_prof_cmp);
+	*reports = rep;
+	return n;
+}
@@ -0,0 +1,391 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file metrics.c
+ * @brief OpenMetrics exporter
+ *
+ * One thread listens on Metrics_Addr:Metrics_Port and answers
+ * GET /metrics with the server, export and client statistics, the
+ * latency histograms, the request queues, the DRC and MDCACHE as
+ * OpenMetrics text.  Scrapes are served one at a time, from a buffer
+ * kept between them; every few seconds is the expected load, and
+ * nothing here is on the request path.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "log.h"
+#include "abstract_mem.h"
+#include "nfs_core.h"
+#include "gsh_metrics.h"
+
+/* Longest request head read, and how long a client may take to send it */
+#define METRICS_REQ_MAX 4096
+#define METRICS_REQ_TIMEOUT_MS 5000
+
+static int metrics_sock = -1;
+static int metrics_pipe[2] = { -1, -1 };	/*< Written to stop */
+static pthread_t metrics_thrid;
+static struct metrics_buf metrics_body;
+
+/**
+ * @brief Append to a metrics buffer
+ *
+ * @param[in,out] mb  Buffer, grown as needed
+ * @param[in]     fmt Format
+ */
+
+void metrics_printf(struct metrics_buf *mb, const char *fmt, ...)
+{
+	va_list args;
+	int n;
+
+	for (;;) {
+		va_start(args, fmt);
+		n = vsnprintf(mb->buf + mb->len, mb->size - mb->len, fmt, args);
+		va_end(args);
+
+		if (n < 0)
+			return;
+		if (mb->len + n < mb->size) {
+			mb->len += n;
+			return;
+		}
+		mb->size = MAX(2 * mb->size, mb->len + n + 1);
+		mb->buf = gsh_realloc(mb->buf, mb->size);
+	}
+}
+
+/**
+ * @brief Start a metric family
+ *
+ * @param[in,out] mb   Buffer
+ * @param[in]     name Family name, without the _total of counters
+ * @param[in]     type counter, gauge or histogram
+ * @param[in]     help Description
+ */
+
+void metrics_family(struct metrics_buf *mb, const char *name,
+		    const char *type, const char *help)
+{
+	metrics_printf(mb, "# TYPE %s %s\n# HELP %s %s\n",
+		       name, type, name, help);
+}
+
+/**
+ * @brief Escape a label value
+ *
+ * Backslash, double quote and newline are escaped; a value too long
+ * for the buffer is truncated.
+ *
+ * @param[out] dst Buffer
+ * @param[in]  len Size of the buffer
+ * @param[in]  src Value
+ *
+ * @return Length of the escaped value.
+ */
+
+size_t metrics_escape(char *dst, size_t len, const char *src)
+{
+	size_t n = 0;
+
+	for (; *src != '\0' && n + 2 < len; src++) {
+		if (*src == '\\' || *src == '"') {
+			dst[n++] = '\\';
+			dst[n++] = *src;
+		} else if (*src == '\n') {
+			dst[n++] = '\\';
+			dst[n++] = 'n';
+		} else {
+			dst[n++] = *src;
+		}
+	}
+	dst[n] = '\0';
+	return n;
+}
+
+/**
+ * @brief Emit a latency histogram, in seconds
+ *
+ * The buckets are folded to one per power of two of nanoseconds, so
+ * a histogram is about thirty lines however it is filled.  The count is
+ * taken from the buckets rather than h->count so the series stays
+ * consistent against concurrent recording.
+ *
+ * @param[in,out] mb     Buffer
+ * @param[in]     name   Family name
+ * @param[in]     labels Labels of the histogram, comma separated
+ * @param[in]     h      Histogram
+ */
+
+void metrics_histogram(struct metrics_buf *mb, const char *name,
+		       const char *labels, struct gsh_histogram *h)
+{
+	uint64_t cum = 0;
+	uint32_t ix = 0, end;
+	int octave;
+
+	for (octave = 0; octave < GSH_HIST_OCTAVES; octave++) {
+		end = 1 + (octave << GSH_HIST_SUB_BITS);
+		for (; ix < end; ix++)
+			cum += atomic_fetch_uint64_t(&h->buckets[ix]);
+		metrics_printf(mb, "%s_bucket{%s,le=\"%g\"} %" PRIu64 "\n",
+			       name, labels,
+			       gsh_hist_bucket_floor(end) / 1e9, cum);
+	}
+	for (; ix < GSH_HIST_BUCKETS; ix++)
+		cum += atomic_fetch_uint64_t(&h->buckets[ix]);
+
+	metrics_printf(mb, "%s_bucket{%s,le=\"+Inf\"} %" PRIu64 "\n",
+		       name, labels, cum);
+	metrics_printf(mb, "%s_count{%s} %" PRIu64 "\n", name, labels, cum);
+	metrics_printf(mb, "%s_sum{%s} %g\n", name, labels,
+		       atomic_fetch_uint64_t(&h->sum) / 1e9);
+}
+
+static void metrics_render(struct metrics_buf *mb)
+{
+	mb->len = 0;
+	server_stats_metrics(mb);
+	nfs_rpc_queue_metrics(mb);
+	nfs_dupreq_metrics(mb);
+	mdcache_metrics(mb);
+	metrics_printf(mb, "# EOF\n");
+}
+
+static bool metrics_send(int fd, const char *buf, size_t len)
+{
+	ssize_t n;
+
+	while (len > 0) {
+		n = send(fd, buf, len, MSG_NOSIGNAL);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		buf += n;
+		len -= n;
+	}
+	return true;
+}
+
+static void metrics_reply(int fd, const char *status, const char *type,
+			  const char *body, size_t len)
+{
+	char head[256];
+	int n;
+
+	n = snprintf(head, sizeof(head),
+		     "HTTP/1.1 %s\r\nContent-Type: %s\r\n"
+		     "Content-Length: %zu\r\nConnection: close\r\n\r\n",
+		     status, type, len);
+	if (metrics_send(fd, head, n) && body != NULL)
+		(void)metrics_send(fd, body, len);
+}
+
+/**
+ * @brief Serve one scrape
+ *
+ * Only the request line matters; the headers are read and ignored.
+ *
+ * @param[in] fd Accepted connection
+ */
+
+static void metrics_serve(int fd)
+{
+	char req[METRICS_REQ_MAX];
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+	size_t len = 0;
+	ssize_t n;
+	bool head;
+	char *path, *end;
+
+	while (len < sizeof(req) - 1) {
+		if (poll(&pfd, 1, METRICS_REQ_TIMEOUT_MS) <= 0)
+			return;
+		n = recv(fd, req + len, sizeof(req) - 1 - len, 0);
+		if (n <= 0)
+			return;
+		len += n;
+		req[len] = '\0';
+		if (strstr(req, "\r\n\r\n") != NULL ||
+		    strstr(req, "\n\n") != NULL)
+			break;
+	}
+	req[len] = '\0';
+
+	head = strncmp(req, "HEAD ", 5) == 0;
+	if (!head && strncmp(req, "GET ", 4) != 0) {
+		metrics_reply(fd, "405 Method Not Allowed", "text/plain",
+			      NULL, 0);
+		return;
+	}
+
+	path = req + (head ? 5 : 4);
+	end = strpbrk(path, " ?\r\n");
+	if (end != NULL)
+		*end = '\0';
+
+	if (strcmp(path, "/metrics") != 0 && strcmp(path, "/") != 0) {
+		metrics_reply(fd, "404 Not Found", "text/plain", NULL, 0);
+		return;
+	}
+
+	metrics_render(&metrics_body);
+	metrics_reply(fd, "200 OK",
+		      "application/openmetrics-text; version=1.0.0; charset=utf-8",
+		      head ? NULL : metrics_body.buf, metrics_body.len);
+}
+
+static void *metrics_thread(void *arg)
+{
+	struct pollfd pfd[2] = {
+		{ .fd = metrics_sock, .events = POLLIN },
+		{ .fd = metrics_pipe[0], .events = POLLIN },
+	};
+	int fd;
+
+	SetNameFunction("metrics");
+
+	for (;;) {
+		if (poll(pfd, 2, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			LogCrit(COMPONENT_THREAD,
+				"Metrics poll failed: %d (%s)",
+				errno, strerror(errno));
+			break;
+		}
+		if (pfd[1].revents != 0)
+			break;
+		if (!(pfd[0].revents & POLLIN))
+			continue;
+
+		fd = accept(metrics_sock, NULL, NULL);
+		if (fd < 0)
+			continue;
+		metrics_serve(fd);
+		close(fd);
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Start the exporter if Metrics_Port is set
+ *
+ * @return 0 or an errno.
+ */
+
+int metrics_init(void)
+{
+	struct sockaddr_in addr = nfs_param.core_param.metrics_addr;
+	char addrbuf[INET_ADDRSTRLEN];
+	int one = 1;
+	int rc;
+
+	if (nfs_param.core_param.metrics_port == 0)
+		return 0;
+
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(nfs_param.core_param.metrics_port);
+
+	metrics_sock = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (metrics_sock < 0)
+		return errno;
+
+	(void)setsockopt(metrics_sock, SOL_SOCKET, SO_REUSEADDR, &one,
+			 sizeof(one));
+	if (bind(metrics_sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+	    listen(metrics_sock, 16) < 0 ||
+	    pipe(metrics_pipe) < 0) {
+		rc = errno;
+		goto err;
+	}
+
+	metrics_body.size = 64 * 1024;
+	metrics_body.buf = gsh_malloc(metrics_body.size);
+
+	rc = pthread_create(&metrics_thrid, NULL, metrics_thread, NULL);
+	if (rc != 0)
+		goto err;
+
+	LogEvent(COMPONENT_INIT, "Serving OpenMetrics on %s:%u",
+		 inet_ntop(AF_INET, &addr.sin_addr, addrbuf, sizeof(addrbuf)),
+		 nfs_param.core_param.metrics_port);
+	return 0;
+
+ err:
+	LogCrit(COMPONENT_INIT, "Could not serve metrics on port %u: %d (%s)",
+		nfs_param.core_param.metrics_port, rc, strerror(rc));
+	close(metrics_sock);
+	metrics_sock = -1;
+	if (metrics_pipe[0] >= 0) {
+		close(metrics_pipe[0]);
+		close(metrics_pipe[1]);
+		metrics_pipe[0] = metrics_pipe[1] = -1;
+	}
+	gsh_free(metrics_body.buf);
+	metrics_body.buf = NULL;
+	return rc;
+}
+
+/**
+ * @brief Stop the exporter
+ *
+ * @return 0 or an errno.
+ */
+
+int metrics_shutdown(void)
+{
+	char c = 0;
+	int rc;
+
+	if (metrics_sock < 0)
+		return 0;
+
+	if (write(metrics_pipe[1], &c, 1) != 1)
+		return errno;
+
+	rc = pthread_join(metrics_thrid, NULL);
+	if (rc != 0)
+		return rc;
+
+	close(metrics_sock);
+	close(metrics_pipe[0]);
+	close(metrics_pipe[1]);
+	metrics_sock = metrics_pipe[0] = metrics_pipe[1] = -1;
+	gsh_free(metrics_body.buf);
+	metrics_body.buf = NULL;
+	return 0;
+}
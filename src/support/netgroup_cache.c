@@ -19,246 +19,296 @@
 
 #include "config.h"
 #include "log.h"
-#include "config_parsing.h"
 #include <string.h>
-#include <unistd.h>
-#include "gsh_intrinsic.h"
-#include "gsh_types.h"
-#include "common_utils.h"
-#include "avltree.h"
-#include "abstract_atomic.h"
-#include "netdb.h"
+#include <ctype.h>
+#include <errno.h>
+#include <netdb.h>
+#include <sys/param.h>
+#include "gsh_cache.h"
+#include "gsh_hash.h"
+#include "gsh_list.h"
 #include "abstract_mem.h"
+#include "gsh_config.h"
+#include "common_utils.h"
+#include "fridgethr.h"
 #include "netgroup_cache.h"
 
-/* Netgroup cache information */
-struct ng_cache_info {
-	struct avltree_node ng_node;
-	struct gsh_buffdesc ng_group;
-	struct gsh_buffdesc ng_host;
-	time_t ng_epoch;
-};
+/* Hardcoded to 30 minutes for now */
+#define NG_CACHE_TTL (30 * 60)
 
-#define NG_CACHE_SIZE 1009
+/* Longest group and host, with their NULs, the cache holds */
+#define NG_KEY_MAX 256
 
-/* Uses FNV hash */
-#define FNV_PRIME32 16777619
-#define FNV_OFFSET32 2166136261U
-static int ng_hash_key(struct ng_cache_info *info)
-{
-	uint32_t hash = FNV_OFFSET32;
-	char *bp, *end;
-
-	bp = info->ng_host.addr;
-	end = bp + info->ng_host.len;
-	while (bp < end) {
-		hash ^= *bp++;
-		hash *= FNV_PRIME32;
-	}
-	bp = info->ng_group.addr;
-	end = bp + info->ng_group.len;
-	while (bp < end) {
-		hash ^= *bp++;
-		hash *= FNV_PRIME32;
-	}
-	return hash % NG_CACHE_SIZE;
-}
+#define NG_CACHE_BYTES (2 * 1024 * 1024)
+
+/* Positive and negative innetgr() results */
+static struct gsh_cache *ng_cache;
+
+/* With Netgroup_Preload, every netgroup named by an export client is
+ * enumerated in the background, at startup and every Netgroup_Refresh
+ * seconds after, into the set of its hosts.  ng_innetgr() answers
+ * from the set, and only calls innetgr() for a group that is not yet,
+ * or could not be, expanded.  Hosts are matched without regard to
+ * case, as innetgr() does.
+ */
+
+/** Largest NSS entry we make room for */
+#define NG_PRELOAD_MAX_BUFF (1024 * 1024)
+
+/**
+ * @brief The hosts of an expanded netgroup
+ *
+ * An open addressed table of lower cased names.
+ */
+struct ng_hosts {
+	uint32_t mask;		/*< Slots less one */
+	uint32_t count;		/*< Hosts in the table */
+	bool any;		/*< A member with no host matches all */
+	bool complete;		/*< The enumeration ran to its end */
+	char *slots[];
+};
 
-static struct avltree_node *ng_cache[NG_CACHE_SIZE];
+/**
+ * @brief A netgroup named by an export client
+ */
+struct ng_group {
+	struct glist_head list;
+	char *name;
+	uint32_t refcnt;	/*< Client entries naming it */
+	time_t expanded;	/*< When hosts was made, 0 to expand */
+	struct ng_hosts *hosts;	/*< NULL until expanded */
+};
 
-pthread_rwlock_t ng_lock = PTHREAD_RWLOCK_INITIALIZER;
+/* Protects the list and the hosts of every group */
+static pthread_rwlock_t ng_lock = PTHREAD_RWLOCK_INITIALIZER;
+static struct glist_head ng_groups = GLIST_HEAD_INIT(ng_groups);
 
-/* Positive and negative cache trees */
-static struct avltree pos_ng_tree;
-static struct avltree neg_ng_tree;
+static struct fridgethr *ng_fridge;
 
-static inline int buffdesc_comparator(const struct gsh_buffdesc *buff1,
-				      const struct gsh_buffdesc *buff2)
+/**
+ * @brief Initialize the netgroups cache
+ */
+void ng_cache_init(void)
 {
-	if (buff1->len < buff2->len)
-		return -1;
-	if (buff1->len > buff2->len)
-		return 1;
-	return memcmp(buff1->addr, buff2->addr, buff1->len);
+	struct gsh_cache_params params = {
+		.name = "netgroup",
+		.key_max = NG_KEY_MAX,
+		.value_max = 0,
+		.ttl = NG_CACHE_TTL,
+		.negative_ttl = NG_CACHE_TTL,
+		.bytes = NG_CACHE_BYTES,
+	};
+
+	ng_cache = gsh_cache_create(&params);
 }
 
-static int ng_comparator(const struct avltree_node *node1,
-			 const struct avltree_node *node2)
+/**
+ * @brief Make the key of a group and host
+ *
+ * @return The length of the key, 0 if it is too long to cache.
+ */
+static uint32_t ng_key(char *key, const char *group, const char *host)
 {
-	int rc;
-	struct ng_cache_info *info1;
-	struct ng_cache_info *info2;
-
-	info1 = avltree_container_of(node1, struct ng_cache_info, ng_node);
-	info2 = avltree_container_of(node2, struct ng_cache_info, ng_node);
+	size_t glen = strlen(group) + 1;
+	size_t hlen = strlen(host) + 1;
 
-	/* compare host followed by group if needed */
-	rc = buffdesc_comparator(&info1->ng_host, &info2->ng_host);
-	if (rc == 0)
-		rc = buffdesc_comparator(&info1->ng_group, &info2->ng_group);
+	if (glen + hlen > NG_KEY_MAX)
+		return 0;
 
-	return rc;
+	memcpy(key, group, glen);
+	memcpy(key + glen, host, hlen);
+	return glen + hlen;
 }
 
-static bool ng_expired(struct avltree_node *node)
+/**
+ * @brief Lower case a host name
+ *
+ * @return The length of the name, 0 if it does not fit.
+ */
+static size_t ng_lower(char *dst, const char *src, size_t size)
 {
-	struct ng_cache_info *info;
+	size_t len;
+
+	for (len = 0; src[len] != '\0'; len++) {
+		if (len + 1 >= size)
+			return 0;
+		dst[len] = tolower((unsigned char)src[len]);
+	}
 
-	info = avltree_container_of(node, struct ng_cache_info, ng_node);
+	dst[len] = '\0';
+	return len;
+}
 
-	/* Hardcoded to 30 minutes for now */
-	if (time(NULL) - info->ng_epoch > 30 * 60)
-		return true;
+static bool ng_hosts_contain(const struct ng_hosts *hosts, const char *host,
+			     size_t len)
+{
+	uint32_t ix = gsh_hash64(host, len, 0) & hosts->mask;
+
+	for (; hosts->slots[ix] != NULL; ix = (ix + 1) & hosts->mask) {
+		if (strcmp(hosts->slots[ix], host) == 0)
+			return true;
+	}
 
 	return false;
 }
 
+static void ng_hosts_free(struct ng_hosts *hosts)
+{
+	uint32_t ix;
+
+	if (hosts == NULL)
+		return;
 
+	for (ix = 0; ix <= hosts->mask; ix++)
+		gsh_free(hosts->slots[ix]);
+	gsh_free(hosts);
+}
 
 /**
- * @brief Initialize the netgroups cache
+ * @brief Make the host table of the names an enumeration found
+ *
+ * Takes the names, and frees the duplicates.
  */
-void ng_cache_init(void)
+static struct ng_hosts *ng_hosts_make(char **names, size_t nnames)
 {
-	avltree_init(&pos_ng_tree, ng_comparator, 0);
-	avltree_init(&neg_ng_tree, ng_comparator, 0);
-	memset(ng_cache, 0, NG_CACHE_SIZE * sizeof(struct avltree_node *));
-}
+	struct ng_hosts *hosts;
+	uint32_t slots = 8, ix;
+	size_t i, len;
 
-static void ng_free(struct ng_cache_info *info)
-{
-	gsh_free(info->ng_group.addr);
-	gsh_free(info->ng_host.addr);
-	gsh_free(info);
-}
+	while (slots < nnames * 2)
+		slots *= 2;
 
-/* The caller must hold ng_lock for write */
-static void ng_remove(struct ng_cache_info *info, bool negative)
-{
-	if (negative) {
-		avltree_remove(&info->ng_node, &neg_ng_tree);
-	} else {
-		ng_cache[ng_hash_key(info)] = NULL;
-		avltree_remove(&info->ng_node, &pos_ng_tree);
+	hosts = gsh_calloc(1, sizeof(*hosts) + slots * sizeof(char *));
+	hosts->mask = slots - 1;
+
+	for (i = 0; i < nnames; i++) {
+		len = strlen(names[i]);
+
+		if (ng_hosts_contain(hosts, names[i], len)) {
+			gsh_free(names[i]);
+			continue;
+		}
+
+		ix = gsh_hash64(names[i], len, 0) & hosts->mask;
+		while (hosts->slots[ix] != NULL)
+			ix = (ix + 1) & hosts->mask;
+		hosts->slots[ix] = names[i];
+		hosts->count++;
 	}
+
+	return hosts;
 }
 
- /* The caller must hold ng_lock for write */
-static void ng_add(const char *group, const char *host, bool negative)
+/**
+ * @brief Enumerate the hosts of a netgroup
+ *
+ * Only the preload thread calls this, as setnetgrent() keeps its
+ * place in a global.  innetgr() does not use it.
+ *
+ * @return The hosts, or NULL if the group could not be enumerated.
+ */
+static struct ng_hosts *ng_expand(const char *group)
 {
-	struct ng_cache_info *info;
-	struct avltree_node *found_node;
-	struct ng_cache_info *found_info;
-
-	info = gsh_malloc(sizeof(struct ng_cache_info));
-	if (!info)
-		LogFatal(COMPONENT_IDMAPPER, "memory alloc failed");
-
-	info->ng_group.addr = gsh_strdup(group);
-	info->ng_group.len = strlen(group)+1;
-	info->ng_host.addr = gsh_strdup(host);
-	info->ng_host.len = strlen(host)+1;
-	info->ng_epoch = time(NULL);
-
-	if (negative) {
-		/* @todo check positive cache first? */
-		found_node = avltree_insert(&info->ng_node, &neg_ng_tree);
-
-		/* If an already existing entry is found, keep the old
-		 * entry, and free the current entry
-		 */
-		if (found_node) {
-			found_info = avltree_container_of(found_node,
-					struct ng_cache_info, ng_node);
-			found_info->ng_epoch = info->ng_epoch;
-			ng_free(info);
+	char *host, *user, *domain;
+	char *buff, *name;
+	size_t buff_size = 1024, nnames = 0, maxnames = 64;
+	char **names;
+	char lower[MAXHOSTNAMELEN + 1];
+	struct ng_hosts *hosts;
+	bool any = false;
+	int err = 0;
+
+	if (setnetgrent(group) == 0) {
+		endnetgrent();
+		return NULL;
+	}
+
+	buff = gsh_malloc(buff_size);
+	names = gsh_malloc(maxnames * sizeof(char *));
+
+	for (;;) {
+		errno = 0;
+		if (getnetgrent_r(&host, &user, &domain, buff, buff_size)) {
+			if (host == NULL) {
+				any = true;
+				continue;
+			}
+			if (ng_lower(lower, host, sizeof(lower)) == 0)
+				continue;
+			name = gsh_strdup(lower);
+			if (nnames == maxnames) {
+				maxnames *= 2;
+				names = gsh_realloc(names,
+						    maxnames * sizeof(char *));
+			}
+			names[nnames++] = name;
+			continue;
 		}
-	} else {
-		/* @todo delete from negative cache if there? */
-		found_node = avltree_insert(&info->ng_node, &pos_ng_tree);
-
-		/* If an already existing entry is found, keep the old
-		 * entry, and free the current entry
-		 */
-		if (found_node) {
-			found_info = avltree_container_of(found_node,
-					struct ng_cache_info, ng_node);
-			ng_cache[ng_hash_key(found_info)] = found_node;
-			found_info->ng_epoch = info->ng_epoch;
-			ng_free(info);
-		} else {
-			ng_cache[ng_hash_key(info)] = &info->ng_node;
+
+		err = errno;
+		if (err == ERANGE && buff_size < NG_PRELOAD_MAX_BUFF) {
+			buff_size *= 2;
+			buff = gsh_realloc(buff, buff_size);
+			continue;
 		}
+		break;
 	}
-}
 
-/* The caller must hold ng_lock for read */
-static bool ng_lookup(const char *group, const char *host, bool negative)
-{
-	struct ng_cache_info prototype = {
-		.ng_group.addr = (char *)group,
-		.ng_group.len = strlen(group)+1,
-		.ng_host.addr = (char *)host,
-		.ng_host.len = strlen(host)+1
-	};
-	struct avltree_node *node;
-	struct ng_cache_info *info;
-	void **cache_slot;
+	endnetgrent();
+	gsh_free(buff);
 
-	if (negative) {
-		node = avltree_lookup(&prototype.ng_node, &neg_ng_tree);
-		if (!node)
-			return false;
+	hosts = ng_hosts_make(names, nnames);
+	hosts->any = any;
+	/* The end of a group and a failure to read further look alike,
+	 * but only a failure leaves an error behind. */
+	hosts->complete = err == 0 || err == ENOENT;
+	gsh_free(names);
 
-		if (!ng_expired(node))
-			return true;
+	return hosts;
+}
 
-		goto expired;
-	}
+static struct ng_group *ng_find(const char *group)
+{
+	struct glist_head *glist;
+	struct ng_group *ng;
 
-	/* Positive lookups are stored in the cache */
-	cache_slot = (void **)&ng_cache[ng_hash_key(&prototype)];
-	node = atomic_fetch_voidptr(cache_slot);
-	if (node && ng_comparator(node, &prototype.ng_node) == 0) {
-		if (!ng_expired(node))
-			return true;
-		goto expired;
+	glist_for_each(glist, &ng_groups) {
+		ng = glist_entry(glist, struct ng_group, list);
+		if (strcmp(ng->name, group) == 0)
+			return ng;
 	}
 
-	/* cache miss, search AVL tree */
-	node = avltree_lookup(&prototype.ng_node, &pos_ng_tree);
-	if (!node)
-		return false;
-
-	if (ng_expired(node))
-		goto expired;
-
-	atomic_store_voidptr(cache_slot, node);
+	return NULL;
+}
 
-	return true;
+/**
+ * @brief Answer from the hosts of an expanded netgroup
+ *
+ * @return true if it answered, with the answer in member.
+ */
+static bool ng_preloaded(const char *group, const char *host, bool *member)
+{
+	char lower[MAXHOSTNAMELEN + 1];
+	size_t len = ng_lower(lower, host, sizeof(lower));
+	struct ng_group *ng;
+	bool answered = false;
 
-expired:
-	/* entry expired, acquire write mode lock for removal */
-	PTHREAD_RWLOCK_unlock(&ng_lock);
-	PTHREAD_RWLOCK_wrlock(&ng_lock);
+	if (len == 0)
+		return false;
 
-	/* Since we dropped the read mode lock and acquired write mode
-	 * lock, make sure that the entry is still in the tree.
-	 */
-	if (negative)
-		node = avltree_lookup(&prototype.ng_node, &neg_ng_tree);
-	else
-		node = avltree_lookup(&prototype.ng_node, &pos_ng_tree);
+	PTHREAD_RWLOCK_rdlock(&ng_lock);
 
-	if (node) {
-		info = avltree_container_of(node, struct ng_cache_info,
-					    ng_node);
-		ng_remove(info, negative);
-		ng_free(info);
+	ng = ng_find(group);
+	if (ng != NULL && ng->hosts != NULL) {
+		*member = ng->hosts->any ||
+			  ng_hosts_contain(ng->hosts, lower, len);
+		/* A miss in a partial enumeration proves nothing */
+		answered = *member || ng->hosts->complete;
 	}
+
 	PTHREAD_RWLOCK_unlock(&ng_lock);
-	PTHREAD_RWLOCK_rdlock(&ng_lock);
-	return false;
+
+	return answered;
 }
 
 /**
@@ -266,60 +316,309 @@ expired:
  */
 bool ng_innetgr(const char *group, const char *host)
 {
+	char key[NG_KEY_MAX];
+	uint32_t len;
+	bool member;
 	int rc;
 
+	if (ng_preloaded(group, host, &member))
+		return member;
+
+	len = ng_key(key, group, host);
+
 	/* Check positive lookup and then negative lookup.  If absent in
 	 * both, then do a real innetgr call and cache the results.
 	 */
-	PTHREAD_RWLOCK_rdlock(&ng_lock);
-	if (ng_lookup(group, host, false)) { /* positive lookup */
-		PTHREAD_RWLOCK_unlock(&ng_lock);
-		return true;
-	}
-	if (ng_lookup(group, host, true)) { /* negative lookup */
-		PTHREAD_RWLOCK_unlock(&ng_lock);
-		return false;
+	if (len != 0) {
+		switch (gsh_cache_lookup(ng_cache, key, len, NULL, NULL)) {
+		case GSH_CACHE_HIT:
+			return true;
+		case GSH_CACHE_NEGATIVE:
+			return false;
+		case GSH_CACHE_MISS:
+			break;
+		}
 	}
-	PTHREAD_RWLOCK_unlock(&ng_lock);
 
 	rc = innetgr(group, host, NULL, NULL);
 
-	PTHREAD_RWLOCK_wrlock(&ng_lock);
+	if (len == 0)
+		return rc;
+
 	if (rc)
-		ng_add(group, host, false);	/* positive lookup */
+		gsh_cache_insert(ng_cache, key, len, NULL, 0);
 	else
-		ng_add(group, host, true);	/* negative lookup */
-	PTHREAD_RWLOCK_unlock(&ng_lock);
+		gsh_cache_insert_negative(ng_cache, key, len);
 
 	return rc;
 }
 
 /**
  * @brief Wipe out the netgroup cache
+ *
+ * The expanded groups are dropped too, and enumerated again.
  */
 void ng_clear_cache(void)
 {
-	struct avltree_node *node;
-	struct ng_cache_info *info;
+	struct glist_head *glist;
+	struct ng_group *ng;
+
+	gsh_cache_clear(ng_cache);
+
+	PTHREAD_RWLOCK_wrlock(&ng_lock);
+	glist_for_each(glist, &ng_groups) {
+		ng = glist_entry(glist, struct ng_group, list);
+		ng_hosts_free(ng->hosts);
+		ng->hosts = NULL;
+		ng->expanded = 0;
+	}
+	PTHREAD_RWLOCK_unlock(&ng_lock);
+
+	if (ng_fridge != NULL)
+		(void) fridgethr_wake(ng_fridge);
+}
+
+/**
+ * @brief Note a netgroup named by an export client
+ *
+ * With Netgroup_Preload, a new group is enumerated right away.
+ *
+ * @param[in] group The netgroup
+ */
+void ng_register(const char *group)
+{
+	struct ng_group *ng;
 
 	PTHREAD_RWLOCK_wrlock(&ng_lock);
 
-	while ((node = avltree_first(&pos_ng_tree))) {
-		info = avltree_container_of(node, struct ng_cache_info,
-					    ng_node);
-		ng_remove(info, false);
-		ng_free(info);
+	ng = ng_find(group);
+	if (ng != NULL) {
+		ng->refcnt++;
+		PTHREAD_RWLOCK_unlock(&ng_lock);
+		return;
 	}
 
-	while ((node = avltree_first(&neg_ng_tree))) {
-		info = avltree_container_of(node, struct ng_cache_info,
-					    ng_node);
-		ng_remove(info, true);
-		ng_free(info);
+	ng = gsh_calloc(1, sizeof(*ng));
+	ng->name = gsh_strdup(group);
+	ng->refcnt = 1;
+	glist_add_tail(&ng_groups, &ng->list);
+
+	PTHREAD_RWLOCK_unlock(&ng_lock);
+
+	if (ng_fridge != NULL)
+		(void) fridgethr_wake(ng_fridge);
+}
+
+/**
+ * @brief Drop a netgroup an export client no longer names
+ *
+ * @param[in] group The netgroup
+ */
+void ng_unregister(const char *group)
+{
+	struct ng_group *ng;
+
+	PTHREAD_RWLOCK_wrlock(&ng_lock);
+
+	ng = ng_find(group);
+	if (ng == NULL || --ng->refcnt != 0) {
+		PTHREAD_RWLOCK_unlock(&ng_lock);
+		return;
 	}
 
-	assert(avltree_first(&pos_ng_tree) == NULL);
-	assert(avltree_first(&neg_ng_tree) == NULL);
+	glist_del(&ng->list);
+
+	PTHREAD_RWLOCK_unlock(&ng_lock);
+
+	ng_hosts_free(ng->hosts);
+	gsh_free(ng->name);
+	gsh_free(ng);
+}
+
+/**
+ * @brief Whether a group is waiting for its first enumeration
+ */
+static bool ng_pending(void)
+{
+	struct glist_head *glist;
+	bool pending = false;
+
+	PTHREAD_RWLOCK_rdlock(&ng_lock);
+	glist_for_each(glist, &ng_groups) {
+		if (glist_entry(glist, struct ng_group, list)->expanded == 0) {
+			pending = true;
+			break;
+		}
+	}
+	PTHREAD_RWLOCK_unlock(&ng_lock);
+
+	return pending;
+}
+
+/**
+ * @brief Enumerate the netgroups that are new or due
+ *
+ * NSS is not called with ng_lock held: the names are copied out first,
+ * and each group is swapped in as it is done.
+ *
+ * @param[in] ctx  Fridge thread context
+ */
+static void ng_preload_pass(struct fridgethr_context *ctx)
+{
+	time_t refresh = nfs_param.core_param.netgroup_refresh;
+	time_t pass = time(NULL);
+	size_t ngroups = 0, nnames = 0, done = 0, failed = 0, hosts = 0;
+	struct glist_head *glist;
+	struct timespec start, end;
+	struct ng_hosts *expanded, *old;
+	struct ng_group *ng;
+	char **names;
+	size_t i;
+
+	now(&start);
 
+	PTHREAD_RWLOCK_rdlock(&ng_lock);
+	glist_for_each(glist, &ng_groups)
+		ngroups++;
+	names = gsh_calloc(ngroups + 1, sizeof(char *));
+	glist_for_each(glist, &ng_groups) {
+		ng = glist_entry(glist, struct ng_group, list);
+		if (ng->expanded == 0 || pass - ng->expanded >= refresh)
+			names[nnames++] = gsh_strdup(ng->name);
+	}
 	PTHREAD_RWLOCK_unlock(&ng_lock);
+
+	for (i = 0; i < nnames; i++) {
+		if (fridgethr_you_should_break(ctx))
+			break;
+
+		expanded = ng_expand(names[i]);
+		if (expanded == NULL) {
+			LogInfo(COMPONENT_EXPORT,
+				"Could not enumerate netgroup %s, asking innetgr() instead",
+				names[i]);
+			failed++;
+		} else {
+			hosts += expanded->count;
+			done++;
+		}
+
+		PTHREAD_RWLOCK_wrlock(&ng_lock);
+		ng = ng_find(names[i]);
+		if (ng != NULL) {
+			old = ng->hosts;
+			ng->hosts = expanded;
+			ng->expanded = pass;
+		} else {
+			/* Dropped while we were at it */
+			old = expanded;
+		}
+		PTHREAD_RWLOCK_unlock(&ng_lock);
+
+		ng_hosts_free(old);
+	}
+
+	for (i = 0; i < nnames; i++)
+		gsh_free(names[i]);
+	gsh_free(names);
+
+	if (nnames == 0)
+		return;
+
+	now(&end);
+	LogInfo(COMPONENT_EXPORT,
+		"Expanded %zu netgroups into %zu hosts, %zu failed, in %" PRIu64
+		" ms", done, hosts, failed,
+		timespec_diff(&start, &end) / NS_PER_MSEC);
+}
+
+/**
+ * @brief Run the passes of the preload thread
+ *
+ * The looper runs this every Netgroup_Refresh seconds, and when woken
+ * by a new group or a purge.  Groups that came while a pass was
+ * running are done before going back to sleep, as their wake up found
+ * the thread busy.
+ *
+ * @param[in] ctx  Fridge thread context
+ */
+static void ng_preload_run(struct fridgethr_context *ctx)
+{
+	SetNameFunction("netgroup");
+
+	do {
+		ng_preload_pass(ctx);
+	} while (!fridgethr_you_should_break(ctx) && ng_pending());
+}
+
+/**
+ * @brief Start expanding the netgroups of the exports
+ *
+ * Does nothing unless Netgroup_Preload is set.
+ *
+ * @return 0 or an error from the fridge.
+ */
+int ng_preload_init(void)
+{
+	struct fridgethr_params frp;
+	struct fridgethr *fr;
+	int rc;
+
+	if (!nfs_param.core_param.netgroup_preload)
+		return 0;
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = 1;
+	frp.thr_min = 1;
+	frp.thread_delay = nfs_param.core_param.netgroup_refresh;
+	frp.flavor = fridgethr_flavor_looper;
+
+	rc = fridgethr_init(&fr, "netgroup", &frp);
+	if (rc != 0) {
+		LogMajor(COMPONENT_EXPORT,
+			 "Unable to initialize netgroup preload fridge, error code %d.",
+			 rc);
+		return rc;
+	}
+
+	rc = fridgethr_submit(fr, ng_preload_run, NULL);
+	if (rc != 0) {
+		LogMajor(COMPONENT_EXPORT,
+			 "Unable to start netgroup preload thread, error code %d.",
+			 rc);
+		return rc;
+	}
+
+	ng_fridge = fr;
+	return 0;
+}
+
+/**
+ * @brief Stop expanding netgroups
+ *
+ * @return 0 or an error from the fridge.
+ */
+int ng_preload_shutdown(void)
+{
+	struct fridgethr *fr = ng_fridge;
+	int rc;
+
+	if (fr == NULL)
+		return 0;
+
+	ng_fridge = NULL;
+
+	rc = fridgethr_sync_command(fr, fridgethr_comm_stop, 120);
+
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_EXPORT,
+			 "Shutdown timed out, cancelling threads.");
+		fridgethr_cancel(fr);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_EXPORT,
+			 "Failed shutting down netgroup preload thread: %d",
+			 rc);
+	}
+
+	return rc;
 }
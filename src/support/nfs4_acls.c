@@ -4,11 +4,37 @@
 #include "hashtable.h"
 #include "log.h"
 #include "nfs4_acls.h"
-#include "city.h"
+#include "gsh_hash.h"
 #include "common_utils.h"
+#include "abstract_atomic.h"
 
 pool_t *fsal_acl_pool;
 
+/**
+ * ACLs are hash-consed: every FSAL asking for an ACL with the same
+ * ACEs gets the same fsal_acl_t, found in fsal_acl_hash under its
+ * partition latch.  In front of the hash table sits a direct mapped
+ * table of the last ACL made or found for each slot of fingerprints,
+ * looked up without any lock.
+ *
+ * A lookup there takes a reference only if the count is not zero,
+ * then checks the slot still holds the ACL and compares the ACEs.
+ * That is safe because an fsal_acl_t is never given back to the
+ * system: a freed one goes on acl_free_list for reuse, so a stale
+ * pointer from the table always points at an fsal_acl_t, whose
+ * count is zero unless it has been reused.
+ */
+
+#define ACL_FRONT_SIZE 1024
+
+static fsal_acl_t *acl_front[ACL_FRONT_SIZE];
+
+static fsal_acl_t *acl_free_list;
+static pthread_mutex_t acl_free_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+/* The next free ACL is kept in its aces pointer */
+#define ACL_NEXT_FREE(acl) (*(fsal_acl_t **)&(acl)->aces)
+
 static int fsal_acl_hash_both(hash_parameter_t *, struct gsh_buffdesc *,
 			      uint32_t *, uint64_t *);
 static int compare_fsal_acl(struct gsh_buffdesc *, struct gsh_buffdesc *);
@@ -34,7 +60,7 @@ static int fsal_acl_hash_both(hash_parameter_t *hparam,
 			      struct gsh_buffdesc *key, uint32_t *index,
 			      uint64_t *rbthash)
 {
-	*rbthash = CityHash64(key->addr, key->len);
+	*rbthash = gsh_hash64(key->addr, key->len, 0);
 	*index = *rbthash % hparam->index_size;
 
 	return 1;
@@ -59,7 +85,31 @@ fsal_ace_t *nfs4_ace_alloc(int nace)
 
 fsal_acl_t *nfs4_acl_alloc()
 {
-	return pool_alloc(fsal_acl_pool);
+	fsal_acl_t *acl;
+
+	PTHREAD_MUTEX_lock(&acl_free_mtx);
+	acl = acl_free_list;
+	if (acl != NULL)
+		acl_free_list = ACL_NEXT_FREE(acl);
+	PTHREAD_MUTEX_unlock(&acl_free_mtx);
+
+	if (acl == NULL) {
+		acl = pool_alloc(fsal_acl_pool);
+		PTHREAD_RWLOCK_init(&acl->lock, NULL);
+		return acl;
+	}
+
+	/* The lock is kept, and ref is still zero */
+	acl->naces = 0;
+	acl->aces = NULL;
+	acl->fingerprint = 0;
+	acl->xdr = NULL;
+	acl->xdr_len = 0;
+	acl->xdr_gen = 0;
+	acl->xdr_expire = 0;
+	acl->compiled = NULL;
+
+	return acl;
 }
 
 void nfs4_ace_free(fsal_ace_t *ace)
@@ -79,25 +129,99 @@ void nfs4_acl_free(fsal_acl_t *acl)
 
 	if (acl->aces)
 		nfs4_ace_free(acl->aces);
-
-	pool_free(fsal_acl_pool, acl);
+	gsh_free(acl->xdr);
+	acl->xdr = NULL;
+	gsh_free(acl->compiled);
+	acl->compiled = NULL;
+	atomic_store_uint32_t(&acl->ref, 0);
+
+	PTHREAD_MUTEX_lock(&acl_free_mtx);
+	ACL_NEXT_FREE(acl) = acl_free_list;
+	acl_free_list = acl;
+	PTHREAD_MUTEX_unlock(&acl_free_mtx);
 }
 
 void nfs4_acl_entry_inc_ref(fsal_acl_t *acl)
 {
-	/* Increase ref counter */
-	PTHREAD_RWLOCK_wrlock(&acl->lock);
-	acl->ref++;
-	LogDebug(COMPONENT_NFS_V4_ACL, "(acl, ref) = (%p, %u)", acl, acl->ref);
-	PTHREAD_RWLOCK_unlock(&acl->lock);
+	uint32_t ref = atomic_inc_uint32_t(&acl->ref);
+
+	LogDebug(COMPONENT_NFS_V4_ACL, "(acl, ref) = (%p, %u)", acl, ref);
+}
+
+/**
+ * @brief Take a reference unless the count is zero
+ *
+ * @return true if the reference was taken.
+ */
+
+static bool nfs4_acl_entry_get_ref(fsal_acl_t *acl)
+{
+	uint32_t ref = atomic_fetch_uint32_t(&acl->ref);
+
+	while (ref != 0) {
+		if (atomic_cas_uint32_t(&acl->ref, ref, ref + 1))
+			return true;
+		ref = atomic_fetch_uint32_t(&acl->ref);
+	}
+
+	return false;
 }
 
-/* Should be called with lock held. */
-static void nfs4_acl_entry_dec_ref(fsal_acl_t *acl)
+/**
+ * @brief Drop a reference unless it is the last one
+ *
+ * @return true if the reference was dropped.
+ */
+
+static bool nfs4_acl_entry_put_ref(fsal_acl_t *acl)
 {
-	/* Decrease ref counter */
-	acl->ref--;
-	LogDebug(COMPONENT_NFS_V4_ACL, "(acl, ref) = (%p, %u)", acl, acl->ref);
+	uint32_t ref = atomic_fetch_uint32_t(&acl->ref);
+
+	while (ref > 1) {
+		if (atomic_cas_uint32_t(&acl->ref, ref, ref - 1)) {
+			LogDebug(COMPONENT_NFS_V4_ACL, "(acl, ref) = (%p, %u)",
+				 acl, ref - 1);
+			return true;
+		}
+		ref = atomic_fetch_uint32_t(&acl->ref);
+	}
+
+	return false;
+}
+
+static inline fsal_acl_t **acl_front_slot(uint64_t fingerprint)
+{
+	return &acl_front[fingerprint % ACL_FRONT_SIZE];
+}
+
+/**
+ * @brief Look an ACL up in the front table, without a lock
+ *
+ * @return The ACL with a reference taken, or NULL.
+ */
+
+static fsal_acl_t *acl_front_lookup(fsal_acl_data_t *acldata,
+				    uint64_t fingerprint)
+{
+	fsal_acl_t **slot = acl_front_slot(fingerprint);
+	fsal_acl_t *acl = atomic_fetch_voidptr((void **)slot);
+
+	if (acl == NULL || acl->fingerprint != fingerprint)
+		return NULL;
+
+	if (!nfs4_acl_entry_get_ref(acl))
+		return NULL;
+
+	/* Still the one hashed, and the same ACEs */
+	if (atomic_fetch_voidptr((void **)slot) == acl &&
+	    acl->fingerprint == fingerprint &&
+	    acl->naces == acldata->naces &&
+	    memcmp(acl->aces, acldata->aces,
+		   acl->naces * sizeof(fsal_ace_t)) == 0)
+		return acl;
+
+	(void) nfs4_acl_release_entry(acl);
+	return NULL;
 }
 
 fsal_acl_t *nfs4_acl_new_entry(fsal_acl_data_t *acldata,
@@ -109,11 +233,21 @@ fsal_acl_t *nfs4_acl_new_entry(fsal_acl_data_t *acldata,
 	int rc;
 	struct hash_latch latch;
 
+	uint64_t fingerprint;
+
 	/* Set the return default to NFS_V4_ACL_SUCCESS */
 	*status = NFS_V4_ACL_SUCCESS;
 
 	key.addr = acldata->aces;
 	key.len = acldata->naces * sizeof(fsal_ace_t);
+	fingerprint = gsh_hash64(key.addr, key.len, 0);
+
+	acl = acl_front_lookup(acldata, fingerprint);
+	if (acl != NULL) {
+		*status = NFS_V4_ACL_EXISTS;
+		nfs4_ace_free(acldata->aces);
+		return acl;
+	}
 
 	/* Check if the entry already exists */
 	rc = hashtable_getlatch(fsal_acl_hash, &key, &value, true, &latch);
@@ -124,6 +258,7 @@ fsal_acl_t *nfs4_acl_new_entry(fsal_acl_data_t *acldata,
 
 		nfs4_ace_free(acldata->aces);
 		nfs4_acl_entry_inc_ref(acl);
+		atomic_store_voidptr((void **)acl_front_slot(fingerprint), acl);
 		hashtable_releaselatched(fsal_acl_hash, &latch);
 
 		return acl;
@@ -138,22 +273,12 @@ fsal_acl_t *nfs4_acl_new_entry(fsal_acl_data_t *acldata,
 
 	/* Adding the entry in the cache */
 	acl = nfs4_acl_alloc();
-	if (pthread_rwlock_init(&(acl->lock), NULL) != 0) {
-		nfs4_acl_free(acl);
-		LogCrit(COMPONENT_NFS_V4_ACL,
-			"New ACL RW lock init returned %d (%s)", errno,
-			strerror(errno));
-		*status = NFS_V4_ACL_INIT_ENTRY_FAILED;
-
-		nfs4_ace_free(acldata->aces);
-		hashtable_releaselatched(fsal_acl_hash, &latch);
-
-		return NULL;
-	}
-
 	acl->naces = acldata->naces;
 	acl->aces = acldata->aces;
-	acl->ref = 1;		/* We give out one reference */
+	acl->fingerprint = fingerprint;
+
+	/* We give out one reference, and the fields are set before it */
+	atomic_store_uint32_t(&acl->ref, 1);
 
 	/* Build the value */
 	value.addr = acl;
@@ -174,6 +299,8 @@ fsal_acl_t *nfs4_acl_new_entry(fsal_acl_data_t *acldata,
 		return NULL;
 	}
 
+	atomic_store_voidptr((void **)acl_front_slot(fingerprint), acl);
+
 	return acl;
 }
 
@@ -188,19 +315,14 @@ fsal_acl_status_t nfs4_acl_release_entry(fsal_acl_t *acl)
 	if (!acl)
 		return status;
 
-	PTHREAD_RWLOCK_wrlock(&acl->lock);
-	if (acl->ref > 1) {
-		nfs4_acl_entry_dec_ref(acl);
-		PTHREAD_RWLOCK_unlock(&acl->lock);
+	if (nfs4_acl_entry_put_ref(acl))
 		return status;
-	} else
-		LogDebug(COMPONENT_NFS_V4_ACL, "Free ACL %p", acl);
+
+	LogDebug(COMPONENT_NFS_V4_ACL, "Free ACL %p", acl);
 
 	key.addr = acl->aces;
 	key.len = acl->naces * sizeof(fsal_ace_t);
 
-	PTHREAD_RWLOCK_unlock(&acl->lock);
-
 	/* Get the hash table entry and hold latch */
 	rc = hashtable_getlatch(fsal_acl_hash, &key, &old_value, true, &latch);
 
@@ -210,15 +332,26 @@ fsal_acl_status_t nfs4_acl_release_entry(fsal_acl_t *acl)
 		return status;
 
 	case HASHTABLE_SUCCESS:
-		PTHREAD_RWLOCK_wrlock(&acl->lock);
-		nfs4_acl_entry_dec_ref(acl);
-		if (acl->ref != 0) {
-			/* Did not actually release last reference */
+		if (old_value.addr != acl) {
+			/* A private copy of a hashed ACL */
 			hashtable_releaselatched(fsal_acl_hash, &latch);
-			PTHREAD_RWLOCK_unlock(&acl->lock);
 			return status;
 		}
 
+		/* Only the front table can take a reference now, and it
+		 * will not once the count is zero.
+		 */
+		while (!atomic_cas_uint32_t(&acl->ref, 1, 0)) {
+			if (nfs4_acl_entry_put_ref(acl)) {
+				/* Did not actually release last reference */
+				hashtable_releaselatched(fsal_acl_hash, &latch);
+				return status;
+			}
+		}
+
+		(void) atomic_cas_voidptr(
+			(void **)acl_front_slot(acl->fingerprint), acl, NULL);
+
 		/* use the key to delete the entry */
 		hashtable_deletelatched(fsal_acl_hash, &key, &latch,
 					&old_key, &old_value);
@@ -238,8 +371,6 @@ fsal_acl_status_t nfs4_acl_release_entry(fsal_acl_t *acl)
 	 * and is released later in this function */
 	assert(old_value.addr == acl);
 
-	PTHREAD_RWLOCK_unlock(&acl->lock);
-
 	/* Release acl */
 	nfs4_acl_free(acl);
 	return status;
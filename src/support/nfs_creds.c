@@ -576,6 +576,19 @@ nfsstat4 nfs4_export_check_access(struct svc_req *req)
 		return NFS4ERR_ACCESS;
 	}
 
+	/* Check the connection is encrypted if it has to be */
+	if ((op_ctx->export_perms->options & EXPORT_OPTION_TLS_REQUIRED) &&
+	    !gsh_xprt_tls(req->rq_xprt)) {
+		LogInfoAlt(COMPONENT_NFS_V4, COMPONENT_EXPORT,
+			"NFS4 without TLS not allowed on Export_Id %d %s for client %s",
+			op_ctx->ctx_export->export_id,
+			op_ctx->ctx_export->fullpath,
+			op_ctx->client
+				? op_ctx->client->hostaddr_str
+				: "unknown client");
+		return NFS4ERR_ACCESS;
+	}
+
 	/* Check if client is using a privileged port. */
 	if (((op_ctx->export_perms->options &
 	      EXPORT_OPTION_PRIVILEGED_PORT) != 0)
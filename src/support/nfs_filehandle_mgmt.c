@@ -102,6 +102,8 @@ struct fsal_obj_handle *nfs3_FhandleToCache(nfs_fh3 *fh3,
 		*status = nfs3_Errno_status(fsal_status);
 		if (nfs_RetryableError(fsal_status.major))
 			*rc = NFS_REQ_DROP;
+	} else {
+		op_ctx->fileid = obj->fileid;
 	}
 
  badhdl:
@@ -27,155 +27,133 @@
 /**
  * @file    nfs_ip_name.c
  * @brief   The management of the IP/name cache.
+ *
+ * Names are kept in a gsh_cache, for Expiration_Time seconds, and
+ * addresses that could not be resolved for Negative_Expiration_Time.
+ * An address not in the cache is resolved by the resolver threads.
+ * Requests for an address already being resolved wait on that one
+ * resolution, and never wait more than Resolve_Wait milliseconds: a
+ * worker is not held for the length of a slow DNS query.
  */
 
 #include "config.h"
-#include "hashtable.h"
 #include "log.h"
 #include "nfs_core.h"
 #include "nfs_exports.h"
 #include "nfs_ip_stats.h"
 #include "config_parsing.h"
+#include "abstract_mem.h"
+#include "common_utils.h"
+#include "fridgethr.h"
+#include "gsh_cache.h"
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
-/* Hashtable used to cache the hostname, accessed by their IP addess */
-hash_table_t *ht_ip_name;
-unsigned int expiration_time;
-
-/**
- * @name Compute the hash value for the entry in IP/name cache
- *
- * @param[in] hparam    Hash table parameter.
- * @param[in] buffcleff The hash key buffer
- *
- * @return the computed hash value.
- *
- * @see hashtable_init
- *
- */
-uint32_t ip_name_value_hash_func(hash_parameter_t *hparam,
-				 struct gsh_buffdesc *buffclef)
-{
-	return hash_sockaddr(buffclef->addr, true) % hparam->index_size;
-}
+/* Memory budget of the cache */
+#define IP_NAME_CACHE_BYTES (1024 * 1024)
 
 /**
- * @brief Compute the rbt value for the entry in IP/name cache
- *
- * @param[in] hparam   Hash table parameter
- * @param[in] buffclef Hash key buffer
- *
- * @return the computed rbt value.
- *
- * @see hashtable_init
- *
+ * @brief Key of the cache, the address without its port
  */
-uint64_t ip_name_rbt_hash_func(hash_parameter_t *hparam,
-			       struct gsh_buffdesc *buffclef)
-{
-	return hash_sockaddr(buffclef->addr, true);
-}
-
-/**
- *
- * compare_ip_name: compares the ip address stored in the key buffers.
- *
- * compare the ip address stored in the key buffers. This function is to be used
- * as 'compare_key' field in the hashtable storing the nfs duplicated requests.
- *
- * @param buff1 [IN] first key
- * @param buff2 [IN] second key
- *
- * @return 0 if keys are identifical, 1 if they are different.
- *
- */
-int compare_ip_name(struct gsh_buffdesc *buff1, struct gsh_buffdesc *buff2)
-{
-	return (cmp_sockaddr(buff1->addr, buff2->addr, true) !=
-		0) ? 0 : 1;
-}
+struct ip_name_key {
+	sa_family_t family;
+	unsigned char addr[sizeof(struct in6_addr)];
+};
 
 /**
- * @brief Display the ip_name stored in the buffer
- *
- * @param[in]  pbuff Buffer to display
- * @param[out] str   Output string
+ * @brief An address being resolved
  *
- * @return number of character written.
+ * Owned by the resolver and by each request waiting on it.
  */
-int display_ip_name_key(struct gsh_buffdesc *pbuff, char *str)
-{
-	sockaddr_t *addr = (sockaddr_t *) (pbuff->addr);
+struct ip_name_pending {
+	struct glist_head list;
+	struct ip_name_key key;
+	uint32_t key_len;
+	sockaddr_t addr;
+	uint32_t refcnt;
+	bool done;		/*< hostname holds the result */
+	char hostname[MAXHOSTNAMELEN + 1];
+};
 
-	sprint_sockip(addr, str, HASHTABLE_DISPLAY_STRLEN);
-	return strlen(str);
-}
+static struct gsh_cache *ip_name_cache;
+static struct fridgethr *ip_name_fridge;
+
+/* Protects the pending list and every entry on it */
+static pthread_mutex_t ip_name_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ip_name_cond = PTHREAD_COND_INITIALIZER;
+static struct glist_head ip_name_pending_list =
+	GLIST_HEAD_INIT(ip_name_pending_list);
+
+static struct ip_name_params {
+	/** Partitions of the cache.  Defaults to PRIME_IP_NAME, and
+	    settable with Index_Size. */
+	uint32_t index_size;
+	/** Expiration time for ip-name mappings.  Defaults to
+	    IP_NAME_EXPIRATION, and settable with Expiration_Time. */
+	uint32_t expiration_time;
+	/** Expiration time for addresses without a name.  Defaults to
+	    IP_NAME_NEGATIVE_EXPIRATION, and settable with
+	    Negative_Expiration_Time. */
+	uint32_t negative_expiration_time;
+	/** Milliseconds a request waits for a resolution.  Defaults to
+	    IP_NAME_RESOLVE_WAIT, and settable with Resolve_Wait. */
+	uint32_t resolve_wait;
+	/** Threads resolving addresses.  Defaults to
+	    IP_NAME_RESOLVER_THREADS, and settable with
+	    Resolver_Threads. */
+	uint32_t resolver_threads;
+} ip_name_params;
 
 /**
- * @brief Display the ip_name stored in the buffer
- *
- * @param[in]  pbuff Buffer to display
- * @param[out] str   Output string
+ * @brief Make the cache key of an address
  *
- * @return number of character written
+ * @return The length of the key, 0 for an address that is not cached.
  */
-int display_ip_name_val(struct gsh_buffdesc *pbuff, char *str)
+static uint32_t ip_name_key(struct ip_name_key *key, sockaddr_t *ipaddr)
 {
-	nfs_ip_name_t *nfs_ip_name = (pbuff->addr);
-
-	return snprintf(str, HASHTABLE_DISPLAY_STRLEN, "%s",
-			nfs_ip_name->hostname);
+	memset(key, 0, sizeof(*key));
+	key->family = ipaddr->ss_family;
+
+	switch (ipaddr->ss_family) {
+	case AF_INET:
+		memcpy(key->addr, &((struct sockaddr_in *)ipaddr)->sin_addr,
+		       sizeof(struct in_addr));
+		return offsetof(struct ip_name_key, addr) +
+		       sizeof(struct in_addr);
+	case AF_INET6:
+		memcpy(key->addr, &((struct sockaddr_in6 *)ipaddr)->sin6_addr,
+		       sizeof(struct in6_addr));
+		return sizeof(*key);
+	default:
+		return 0;
+	}
 }
 
 /**
+ * @brief Look the name of an address up in DNS
  *
- * nfs_ip_name_add: adds an entry into IP/name cache.
- *
- * Adds an entry in the duplicate requests cache.
- *
- * @param ipaddr           [IN]    the ipaddr to be used as key
- * @param hostname         [OUT]    the hostname added (found by using getnameinfo)
- *
- * @return IP_NAME_SUCCESS if successfull\n.
- * @return IP_NAME_INSERT_MALLOC_ERROR if an error occured during the insertion process \n
- * @return IP_NAME_NETDB_ERROR if an error occured during the netdb query (via gethostbyaddr).
+ * @param[in]  ipaddr   The address
+ * @param[out] hostname The name, or the address if it has none
+ * @param[in]  size     Size of hostname
  *
+ * @return true if a name was found.
  */
-
-int nfs_ip_name_add(sockaddr_t *ipaddr, char *hostname, size_t size)
+static bool ip_name_resolve(sockaddr_t *ipaddr, char *hostname, size_t size)
 {
-	struct gsh_buffdesc buffkey;
-	struct gsh_buffdesc buffdata;
-	nfs_ip_name_t *nfs_ip_name = NULL;
-	sockaddr_t *pipaddr = NULL;
 	struct timeval tv0, tv1, dur;
 	int rc;
 	char ipstring[SOCK_NAME_MAX + 1];
 
-	nfs_ip_name = gsh_malloc(sizeof(nfs_ip_name_t));
-
-	pipaddr = gsh_malloc(sizeof(sockaddr_t));
-
-	/* I have to keep an integer as key, I wil use the pointer buffkey->addr
-	 * for this, this also means that buffkey->len will be 0
-	 */
-	memcpy(pipaddr, ipaddr, sizeof(sockaddr_t));
-
-	buffkey.addr = (caddr_t) pipaddr;
-	buffkey.len = sizeof(sockaddr_t);
-
 	gettimeofday(&tv0, NULL);
-	rc = getnameinfo((struct sockaddr *)pipaddr, sizeof(sockaddr_t),
-			 nfs_ip_name->hostname, sizeof(nfs_ip_name->hostname),
-			 NULL, 0, 0);
+	rc = getnameinfo((struct sockaddr *)ipaddr, sizeof(sockaddr_t),
+			 hostname, size, NULL, 0, 0);
 	gettimeofday(&tv1, NULL);
 	timersub(&tv1, &tv0, &dur);
 
-	sprint_sockip(pipaddr, ipstring, sizeof(ipstring));
+	sprint_sockip(ipaddr, ipstring, sizeof(ipstring));
 
 	/* display warning if DNS resolution took more that 1.0s */
 	if (dur.tv_sec >= 1) {
@@ -185,75 +163,183 @@ int nfs_ip_name_add(sockaddr_t *ipaddr, char *hostname, size_t size)
 			 (unsigned int)dur.tv_usec);
 	}
 
-	/* Ask for the name to be cached */
 	if (rc != 0) {
-		strmaxcpy(nfs_ip_name->hostname, ipstring,
-			sizeof(nfs_ip_name->hostname));
+		strmaxcpy(hostname, ipstring, size);
 		LogEvent(COMPONENT_DISPATCH,
 			 "Cannot resolve address %s, error %s, using %s as hostname",
-			 ipstring, gai_strerror(rc), nfs_ip_name->hostname);
+			 ipstring, gai_strerror(rc), hostname);
+		return false;
 	}
 
 	LogDebug(COMPONENT_DISPATCH, "Inserting %s->%s to addr cache", ipstring,
-		 nfs_ip_name->hostname);
+		 hostname);
+
+	return true;
+}
+
+/**
+ * @brief Drop a reference to a pending resolution
+ *
+ * Called with ip_name_mtx held.
+ */
+static void ip_name_pending_put(struct ip_name_pending *pending)
+{
+	if (--pending->refcnt == 0)
+		gsh_free(pending);
+}
 
-	/* I build the data with the request pointer
-	 * that should be in state 'IN USE'
+/**
+ * @brief Resolve a pending address, and wake its waiters
+ */
+static void ip_name_resolve_pending(struct ip_name_pending *pending)
+{
+	char hostname[MAXHOSTNAMELEN + 1];
+
+	/* Cache the result before it leaves the pending list, so that
+	 * no request in between resolves the address again.
 	 */
-	nfs_ip_name->timestamp = time(NULL);
+	if (ip_name_resolve(&pending->addr, hostname, sizeof(hostname)))
+		gsh_cache_insert(ip_name_cache, &pending->key,
+				 pending->key_len, hostname,
+				 strlen(hostname) + 1);
+	else
+		gsh_cache_insert_negative(ip_name_cache, &pending->key,
+					  pending->key_len);
+
+	PTHREAD_MUTEX_lock(&ip_name_mtx);
+	memcpy(pending->hostname, hostname, sizeof(hostname));
+	pending->done = true;
+	glist_del(&pending->list);
+	pthread_cond_broadcast(&ip_name_cond);
+	ip_name_pending_put(pending);
+	PTHREAD_MUTEX_unlock(&ip_name_mtx);
+}
 
-	buffdata.addr = (caddr_t) nfs_ip_name;
-	buffdata.len = sizeof(nfs_ip_name_t);
+static void ip_name_run(struct fridgethr_context *ctx)
+{
+	ip_name_resolve_pending(ctx->arg);
+}
 
-	if (HashTable_Set(ht_ip_name, &buffkey, &buffdata) != HASHTABLE_SUCCESS)
-		return IP_NAME_INSERT_MALLOC_ERROR;
+/**
+ * @brief Find or start the resolution of an address
+ *
+ * Called with ip_name_mtx held.
+ *
+ * @return The pending resolution, with a reference for the caller.
+ */
+static struct ip_name_pending *ip_name_pending_get(struct ip_name_key *key,
+						   uint32_t key_len,
+						   sockaddr_t *ipaddr)
+{
+	struct glist_head *glist;
+	struct ip_name_pending *pending;
 
-	/* Copy the value for the caller */
-	strmaxcpy(hostname, nfs_ip_name->hostname, size);
+	glist_for_each(glist, &ip_name_pending_list) {
+		pending = glist_entry(glist, struct ip_name_pending, list);
 
-	return IP_NAME_SUCCESS;
-}				/* nfs_ip_name_add */
+		if (pending->key_len == key_len &&
+		    memcmp(&pending->key, key, key_len) == 0) {
+			pending->refcnt++;
+			return pending;
+		}
+	}
+
+	pending = gsh_calloc(1, sizeof(*pending));
+	pending->key = *key;
+	pending->key_len = key_len;
+	pending->addr = *ipaddr;
+	pending->refcnt = 2;	/* The caller and the resolver */
+	glist_add_tail(&ip_name_pending_list, &pending->list);
+
+	if (fridgethr_submit(ip_name_fridge, ip_name_run, pending) != 0) {
+		/* No resolver to hand it to, so resolve it here */
+		PTHREAD_MUTEX_unlock(&ip_name_mtx);
+		ip_name_resolve_pending(pending);
+		PTHREAD_MUTEX_lock(&ip_name_mtx);
+	}
+
+	return pending;
+}
 
 /**
  *
- * nfs_ip_name_get: Tries to get an entry for ip_name cache.
+ * nfs_ip_name_lookup: Get the hostname of an address
  *
- * Tries to get an entry for ip_name cache.
+ * Looks the address up in the IP/name cache, and resolves it if it is
+ * not there.  A request waits at most Resolve_Wait milliseconds for a
+ * resolution, which goes on without it after that.
  *
  * @param ipaddr   [IN]  the ip address requested
- * @param hostname [OUT] the hostname
+ * @param hostname [OUT] the hostname, or the address if it has none
+ * @param size     [IN]  size of hostname
  *
- * @return the result previously set if *pstatus == IP_NAME_SUCCESS
+ * @return IP_NAME_SUCCESS if hostname was set.
+ * @return IP_NAME_PENDING if the address is still being resolved.
  *
  */
-int nfs_ip_name_get(sockaddr_t *ipaddr, char *hostname, size_t size)
+int nfs_ip_name_lookup(sockaddr_t *ipaddr, char *hostname, size_t size)
 {
-	struct gsh_buffdesc buffkey;
-	struct gsh_buffdesc buffval;
-	nfs_ip_name_t *nfs_ip_name;
+	struct ip_name_key key;
+	struct ip_name_pending *pending;
+	struct timespec deadline;
+	char name[MAXHOSTNAMELEN + 1];
 	char ipstring[SOCK_NAME_MAX + 1];
+	uint32_t key_len, len = sizeof(name);
+	int rc = 0;
 
 	sprint_sockip(ipaddr, ipstring, sizeof(ipstring));
 
-	buffkey.addr = (caddr_t) ipaddr;
-	buffkey.len = sizeof(sockaddr_t);
+	key_len = ip_name_key(&key, ipaddr);
 
-	if (HashTable_Get(ht_ip_name,
-			  &buffkey,
-			  &buffval) == HASHTABLE_SUCCESS) {
-		nfs_ip_name = buffval.addr;
-		strmaxcpy(hostname, nfs_ip_name->hostname, size);
+	if (key_len == 0) {
+		(void) ip_name_resolve(ipaddr, hostname, size);
+		return IP_NAME_SUCCESS;
+	}
 
+	switch (gsh_cache_lookup(ip_name_cache, &key, key_len, name, &len)) {
+	case GSH_CACHE_HIT:
+		strmaxcpy(hostname, name, size);
 		LogFullDebug(COMPONENT_DISPATCH, "Cache get hit for %s->%s",
-			     ipstring, nfs_ip_name->hostname);
-
+			     ipstring, hostname);
+		return IP_NAME_SUCCESS;
+	case GSH_CACHE_NEGATIVE:
+		strmaxcpy(hostname, ipstring, size);
+		LogFullDebug(COMPONENT_DISPATCH,
+			     "Cache get negative hit for %s", ipstring);
 		return IP_NAME_SUCCESS;
+	case GSH_CACHE_MISS:
+		break;
 	}
 
 	LogFullDebug(COMPONENT_DISPATCH, "Cache get miss for %s", ipstring);
 
-	return IP_NAME_NOT_FOUND;
-}				/* nfs_ip_name_get */
+	now(&deadline);
+	timespec_add_nsecs(ip_name_params.resolve_wait * NS_PER_MSEC,
+			   &deadline);
+
+	PTHREAD_MUTEX_lock(&ip_name_mtx);
+
+	pending = ip_name_pending_get(&key, key_len, ipaddr);
+
+	while (!pending->done && rc != ETIMEDOUT)
+		rc = pthread_cond_timedwait(&ip_name_cond, &ip_name_mtx,
+					    &deadline);
+
+	if (pending->done) {
+		strmaxcpy(hostname, pending->hostname, size);
+		rc = IP_NAME_SUCCESS;
+	} else {
+		LogDebug(COMPONENT_DISPATCH,
+			 "Address %s is still being resolved", ipstring);
+		rc = IP_NAME_PENDING;
+	}
+
+	ip_name_pending_put(pending);
+
+	PTHREAD_MUTEX_unlock(&ip_name_mtx);
+
+	return rc;
+}				/* nfs_ip_name_lookup */
 
 /**
  *
@@ -263,34 +349,20 @@ int nfs_ip_name_get(sockaddr_t *ipaddr, char *hostname, size_t size)
  *
  * @param ipaddr           [IN]    the ip address to be uncached.
  *
- * @return the result previously set if *pstatus == IP_NAME_SUCCESS
+ * @return IP_NAME_SUCCESS, or IP_NAME_NOT_FOUND if it is never cached.
  *
  */
 int nfs_ip_name_remove(sockaddr_t *ipaddr)
 {
-	struct gsh_buffdesc buffkey, old_value;
-	nfs_ip_name_t *nfs_ip_name = NULL;
-	char ipstring[SOCK_NAME_MAX + 1];
-
-	sprint_sockip(ipaddr, ipstring, sizeof(ipstring));
-
-	buffkey.addr = (caddr_t) ipaddr;
-	buffkey.len = sizeof(sockaddr_t);
+	struct ip_name_key key;
+	uint32_t key_len = ip_name_key(&key, ipaddr);
 
-	if (HashTable_Del(ht_ip_name, &buffkey, NULL, &old_value) ==
-	    HASHTABLE_SUCCESS) {
-		nfs_ip_name = (nfs_ip_name_t *) old_value.addr;
-
-		LogFullDebug(COMPONENT_DISPATCH, "Cache remove hit for %s->%s",
-			     ipstring, nfs_ip_name->hostname);
-
-		gsh_free(nfs_ip_name);
-		return IP_NAME_SUCCESS;
-	}
+	if (key_len == 0)
+		return IP_NAME_NOT_FOUND;
 
-	LogFullDebug(COMPONENT_DISPATCH, "Cache remove miss for %s", ipstring);
+	gsh_cache_remove(ip_name_cache, &key, key_len);
 
-	return IP_NAME_NOT_FOUND;
+	return IP_NAME_SUCCESS;
 }				/* nfs_ip_name_remove */
 
 /**
@@ -309,48 +381,46 @@ int nfs_ip_name_remove(sockaddr_t *ipaddr)
  */
 #define IP_NAME_EXPIRATION 3600
 
-
-/** @} */
+/**
+ * @brief Default value for ip_name_param.negative_expiration_time
+ */
+#define IP_NAME_NEGATIVE_EXPIRATION 60
 
 /**
- * @brief NFS_IP_Name configuration stanza
+ * @brief Default value for ip_name_param.resolve_wait, in milliseconds
  */
+#define IP_NAME_RESOLVE_WAIT 200
 
-struct ip_name_cache {
-	/** Configuration for hash table for NFS Name/IP map.
-	    Defautl index size is PRIME_IP_NAME, settable with
-	    Index_Size. */
-	hash_parameter_t hash_param;
-	/** Expiration time for ip-name mappings.  Defautls to
-	    IP_NAME_Expiration, and settable with Expiration_Time. */
-	uint32_t expiration_time;
-};
+/**
+ * @brief Default value for ip_name_param.resolver_threads
+ */
+#define IP_NAME_RESOLVER_THREADS 4
 
-static struct ip_name_cache ip_name_cache = {
-	.hash_param.hash_func_key = ip_name_value_hash_func,
-	.hash_param.hash_func_rbt = ip_name_rbt_hash_func,
-	.hash_param.compare_key = compare_ip_name,
-	.hash_param.key_to_str = display_ip_name_key,
-	.hash_param.val_to_str = display_ip_name_val,
-	.hash_param.flags = HT_FLAG_NONE,
-};
+/** @} */
 
 /**
  * @brief IP name cache parameters
  */
 
-static struct config_item ip_name_params[] = {
+static struct config_item ip_name_items[] = {
 	CONF_ITEM_UI32("Index_Size", 1, 51, PRIME_IP_NAME,
-		       ip_name_cache, hash_param.index_size),
+		       ip_name_params, index_size),
 	CONF_ITEM_UI32("Expiration_Time", 1, 60*60*24, IP_NAME_EXPIRATION,
-		       ip_name_cache, expiration_time),
+		       ip_name_params, expiration_time),
+	CONF_ITEM_UI32("Negative_Expiration_Time", 1, 60*60*24,
+		       IP_NAME_NEGATIVE_EXPIRATION,
+		       ip_name_params, negative_expiration_time),
+	CONF_ITEM_UI32("Resolve_Wait", 0, 60*1000, IP_NAME_RESOLVE_WAIT,
+		       ip_name_params, resolve_wait),
+	CONF_ITEM_UI32("Resolver_Threads", 1, 64, IP_NAME_RESOLVER_THREADS,
+		       ip_name_params, resolver_threads),
 	CONFIG_EOL
 };
 
 static void *ip_name_init(void *link_mem, void *self_struct)
 {
 	if (self_struct == NULL)
-		return &ip_name_cache;
+		return &ip_name_params;
 	else
 		return NULL;
 }
@@ -358,9 +428,9 @@ static void *ip_name_init(void *link_mem, void *self_struct)
 static int ip_name_commit(void *node, void *link_mem, void *self_struct,
 			  struct config_error_type *err_type)
 {
-	struct ip_name_cache *params = self_struct;
+	struct ip_name_params *params = self_struct;
 
-	if (!is_prime(params->hash_param.index_size)) {
+	if (!is_prime(params->index_size)) {
 		LogCrit(COMPONENT_CONFIG,
 			"IP name cache index size must be a prime.");
 		return 1;
@@ -373,31 +443,73 @@ struct config_block nfs_ip_name = {
 	.blk_desc.name = "NFS_IP_Name",
 	.blk_desc.type = CONFIG_BLOCK,
 	.blk_desc.u.blk.init = ip_name_init,
-	.blk_desc.u.blk.params = ip_name_params,
+	.blk_desc.u.blk.params = ip_name_items,
 	.blk_desc.u.blk.commit = ip_name_commit
 };
 
 /**
  *
- * nfs_Init_ip_name: Init the hashtable for IP/name cache.
+ * nfs_Init_ip_name: Init the IP/name cache and its resolvers.
  *
- * Perform all the required initialization for hashtable IP/name cache
- *
- * @return 0 if successful, -1 otherwise
+ * @return IP_NAME_SUCCESS if successful, -1 otherwise
  *
  */
 int nfs_Init_ip_name(void)
 {
-	ht_ip_name = hashtable_init(&ip_name_cache.hash_param);
+	struct gsh_cache_params params = {
+		.name = "ip_name",
+		.key_max = sizeof(struct ip_name_key),
+		.value_max = MAXHOSTNAMELEN + 1,
+		.ttl = ip_name_params.expiration_time,
+		.negative_ttl = ip_name_params.negative_expiration_time,
+		.bytes = IP_NAME_CACHE_BYTES,
+		.shards = ip_name_params.index_size,
+	};
+	struct fridgethr_params frp;
+	int rc;
+
+	ip_name_cache = gsh_cache_create(&params);
 
-	if (ht_ip_name == NULL) {
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = ip_name_params.resolver_threads;
+	frp.thr_min = 0;
+	frp.flavor = fridgethr_flavor_worker;
+	frp.deferment = fridgethr_defer_queue;
+
+	rc = fridgethr_init(&ip_name_fridge, "ip_name", &frp);
+	if (rc != 0) {
 		LogCrit(COMPONENT_INIT,
-			"NFS IP_NAME: Cannot init IP/name cache");
+			"NFS IP_NAME: Cannot start the resolvers, error %d",
+			rc);
 		return -1;
 	}
 
-	/* Set the expiration time */
-	expiration_time = ip_name_cache.expiration_time;
-
 	return IP_NAME_SUCCESS;
 }				/* nfs_Init_ip_name */
+
+/**
+ * @brief Stop the resolvers
+ *
+ * @return 0 or an error from fridgethr_sync_command.
+ */
+int nfs_ip_name_shutdown(void)
+{
+	struct fridgethr *fr = ip_name_fridge;
+	int rc;
+
+	if (fr == NULL)
+		return 0;
+
+	rc = fridgethr_sync_command(fr, fridgethr_comm_stop, 120);
+
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_DISPATCH,
+			 "Shutdown timed out, cancelling threads.");
+		fridgethr_cancel(fr);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_DISPATCH,
+			 "Failed shutting down IP/name resolvers: %d", rc);
+	}
+
+	return rc;
+}
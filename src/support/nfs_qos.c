@@ -0,0 +1,300 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file nfs_qos.c
+ * @brief Token buckets limiting the request and byte rates
+ *
+ * See nfs_qos.h.
+ */
+
+#include "config.h"
+#include <pthread.h>
+#include <string.h>
+#include "log.h"
+#include "common_utils.h"
+#include "abstract_atomic.h"
+#include "nfs_qos.h"
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#endif
+
+/** Longest time a refill accounts for, bounding its arithmetic */
+#define QOS_REFILL_MAX (10 * NS_PER_SEC)
+
+uint32_t qos_limited_buckets;
+
+/** Most request tokens a bucket holds, in NS_PER_SEC units */
+static inline int64_t qos_iops_full(const struct qos_limits *limits)
+{
+	uint32_t burst = limits->iops_burst ? limits->iops_burst :
+					      limits->iops;
+
+	return (int64_t) burst * (int64_t) NS_PER_SEC;
+}
+
+/** Most byte tokens a bucket holds */
+static inline int64_t qos_bw_full(const struct qos_limits *limits)
+{
+	return limits->bandwidth_burst ? limits->bandwidth_burst :
+					 limits->bandwidth;
+}
+
+/**
+ * @brief Initialize a bucket without limits
+ *
+ * @param[in] bucket Bucket
+ */
+void qos_bucket_init(struct qos_bucket *bucket)
+{
+	memset(bucket, 0, sizeof(*bucket));
+	pthread_spin_init(&bucket->sp, PTHREAD_PROCESS_PRIVATE);
+}
+
+/**
+ * @brief Release a bucket
+ *
+ * @param[in] bucket Bucket
+ */
+void qos_bucket_destroy(struct qos_bucket *bucket)
+{
+	if (qos_limited(&bucket->limits))
+		(void) atomic_dec_uint32_t(&qos_limited_buckets);
+	pthread_spin_destroy(&bucket->sp);
+}
+
+/**
+ * @brief Change the limits of a bucket
+ *
+ * The bucket starts over full, its counters are kept.
+ *
+ * @param[in] bucket Bucket
+ * @param[in] limits New limits, all 0 for none
+ */
+void qos_bucket_set(struct qos_bucket *bucket,
+		    const struct qos_limits *limits)
+{
+	struct timespec ts;
+	bool was, is = qos_limited(limits);
+
+	now(&ts);
+	pthread_spin_lock(&bucket->sp);
+	was = qos_limited(&bucket->limits);
+	bucket->limits = *limits;
+	bucket->iops_tokens = qos_iops_full(limits);
+	bucket->bw_tokens = qos_bw_full(limits);
+	bucket->refilled = timespec_to_nsecs(&ts);
+	pthread_spin_unlock(&bucket->sp);
+
+	if (is && !was)
+		(void) atomic_inc_uint32_t(&qos_limited_buckets);
+	else if (was && !is)
+		(void) atomic_dec_uint32_t(&qos_limited_buckets);
+}
+
+/**
+ * @brief Copy the limits and counters of a bucket
+ *
+ * @param[in]  bucket Bucket
+ * @param[out] copy   Its limits and counters, the lock is not copied
+ */
+void qos_bucket_get(struct qos_bucket *bucket, struct qos_bucket *copy)
+{
+	pthread_spin_lock(&bucket->sp);
+	copy->limits = bucket->limits;
+	copy->iops_tokens = bucket->iops_tokens;
+	copy->bw_tokens = bucket->bw_tokens;
+	copy->refilled = bucket->refilled;
+	copy->admitted = bucket->admitted;
+	copy->deferred = bucket->deferred;
+	copy->bytes = bucket->bytes;
+	pthread_spin_unlock(&bucket->sp);
+}
+
+/**
+ * @brief Add the tokens earned since the last refill
+ *
+ * @note The bucket spinlock MUST be held.
+ */
+static void qos_refill(struct qos_bucket *bucket, nsecs_elapsed_t now)
+{
+	nsecs_elapsed_t elapsed;
+	int64_t full;
+
+	if (now <= bucket->refilled) {
+		/* the clock went back, start over from here */
+		bucket->refilled = now;
+		return;
+	}
+
+	/* tokens are earned by the whole microsecond, the rest of the
+	 * time is left for the next refill
+	 */
+	elapsed = now - bucket->refilled;
+	if (elapsed > QOS_REFILL_MAX)
+		elapsed = QOS_REFILL_MAX;
+	elapsed -= elapsed % NS_PER_USEC;
+
+	if (bucket->limits.iops != 0) {
+		full = qos_iops_full(&bucket->limits);
+		bucket->iops_tokens += elapsed * bucket->limits.iops;
+		if (bucket->iops_tokens > full)
+			bucket->iops_tokens = full;
+	}
+
+	if (bucket->limits.bandwidth != 0) {
+		full = qos_bw_full(&bucket->limits);
+		bucket->bw_tokens += elapsed / NS_PER_USEC *
+				     bucket->limits.bandwidth /
+				     (NS_PER_SEC / NS_PER_USEC);
+		if (bucket->bw_tokens > full)
+			bucket->bw_tokens = full;
+	}
+
+	if (now - bucket->refilled > QOS_REFILL_MAX)
+		bucket->refilled = now;
+	else
+		bucket->refilled += elapsed;
+}
+
+/**
+ * @brief Check whether a bucket lets a request through
+ *
+ * @param[in] bucket Bucket, NULL for none
+ * @param[in] now    Current time
+ *
+ * @return true if the request may be served now.
+ */
+bool qos_bucket_ready(struct qos_bucket *bucket, nsecs_elapsed_t now)
+{
+	bool ready;
+
+	if (bucket == NULL || !qos_limited(&bucket->limits))
+		return true;
+
+	pthread_spin_lock(&bucket->sp);
+	qos_refill(bucket, now);
+	ready = (bucket->limits.iops == 0 ||
+		 bucket->iops_tokens >= (int64_t) NS_PER_SEC) &&
+		(bucket->limits.bandwidth == 0 || bucket->bw_tokens > 0);
+	if (!ready)
+		++(bucket->deferred);
+	pthread_spin_unlock(&bucket->sp);
+
+	return ready;
+}
+
+/**
+ * @brief Charge a bucket for a request let through
+ *
+ * Two workers may both find a bucket ready and take its last token;
+ * the debt is paid from the next refill.
+ *
+ * @param[in] bucket Bucket, NULL for none
+ * @param[in] bytes  Bytes read or written by the request
+ */
+void qos_bucket_charge(struct qos_bucket *bucket, uint64_t bytes)
+{
+	if (bucket == NULL || !qos_limited(&bucket->limits))
+		return;
+
+	pthread_spin_lock(&bucket->sp);
+	if (bucket->limits.iops != 0)
+		bucket->iops_tokens -= NS_PER_SEC;
+	if (bucket->limits.bandwidth != 0)
+		bucket->bw_tokens -= bytes;
+	++(bucket->admitted);
+	bucket->bytes += bytes;
+	pthread_spin_unlock(&bucket->sp);
+}
+
+#ifdef USE_DBUS
+/**
+ * @brief Parse the limits of a SetQoS DBus call
+ *
+ * The arguments are IOPS, IOPS burst, bandwidth and bandwidth burst,
+ * as in the config blocks.
+ *
+ * @param[in]  args     Iterator on the first of them
+ * @param[out] limits   The limits
+ * @param[out] errormsg Reason they are not valid
+ *
+ * @return true if they are valid.
+ */
+bool qos_dbus_limits(DBusMessageIter *args, struct qos_limits *limits,
+		     char **errormsg)
+{
+	uint64_t arg[4];
+	int ix;
+
+	for (ix = 0; ix < 4; ++ix) {
+		if (args == NULL ||
+		    dbus_message_iter_get_arg_type(args) != DBUS_TYPE_UINT64) {
+			*errormsg = "limits are not 4 64 bit integers";
+			return false;
+		}
+		dbus_message_iter_get_basic(args, &arg[ix]);
+		dbus_message_iter_next(args);
+	}
+
+	if (arg[0] > QOS_IOPS_MAX || arg[1] > UINT32_MAX ||
+	    arg[2] > QOS_BANDWIDTH_MAX || arg[3] > QOS_BANDWIDTH_BURST_MAX) {
+		*errormsg = "limit out of range";
+		return false;
+	}
+
+	limits->iops = arg[0];
+	limits->iops_burst = arg[1];
+	limits->bandwidth = arg[2];
+	limits->bandwidth_burst = arg[3];
+	return true;
+}
+
+/**
+ * @brief Append the limits and counters of a bucket, QOS_DBUS_TYPE
+ *
+ * @param[in] struct_iter Struct being built
+ * @param[in] bucket      Bucket
+ */
+void qos_dbus_append(DBusMessageIter *struct_iter,
+		     struct qos_bucket *bucket)
+{
+	struct qos_bucket copy;
+	uint64_t val;
+
+	qos_bucket_get(bucket, &copy);
+
+	val = copy.limits.iops;
+	dbus_message_iter_append_basic(struct_iter, DBUS_TYPE_UINT64, &val);
+	val = copy.limits.iops_burst;
+	dbus_message_iter_append_basic(struct_iter, DBUS_TYPE_UINT64, &val);
+	dbus_message_iter_append_basic(struct_iter, DBUS_TYPE_UINT64,
+				       &copy.limits.bandwidth);
+	dbus_message_iter_append_basic(struct_iter, DBUS_TYPE_UINT64,
+				       &copy.limits.bandwidth_burst);
+	dbus_message_iter_append_basic(struct_iter, DBUS_TYPE_UINT64,
+				       &copy.admitted);
+	dbus_message_iter_append_basic(struct_iter, DBUS_TYPE_UINT64,
+				       &copy.deferred);
+	dbus_message_iter_append_basic(struct_iter, DBUS_TYPE_UINT64,
+				       &copy.bytes);
+}
+#endif /* USE_DBUS */
@@ -71,6 +71,98 @@ static struct config_item_list protocols[] = {
 	CONFIG_LIST_EOL
 };
 
+/**
+ * @brief Init for a Dispatch_Client_Weight sub-block
+ *
+ * Allocate a weight entry for parameter processing, or release it
+ * again on errors.
+ */
+
+static void *client_weight_init(void *link_mem, void *self_struct)
+{
+	struct dispatch_client_weight *cw;
+
+	assert(link_mem != NULL || self_struct != NULL);
+
+	if (link_mem == NULL) {
+		return self_struct;
+	} else if (self_struct == NULL) {
+		cw = gsh_calloc(1, sizeof(struct dispatch_client_weight));
+		glist_init(&cw->link);
+		qos_bucket_init(&cw->qos);
+		return cw;
+	} else {
+		cw = self_struct;
+		qos_bucket_destroy(&cw->qos);
+		if (cw->client != NULL)
+			gsh_free(cw->client);
+		gsh_free(cw);
+		return NULL;
+	}
+}
+
+/**
+ * @brief Validate a Dispatch_Client_Weight block and link it in
+ */
+
+static int client_weight_commit(void *node, void *link_mem, void *self_struct,
+				struct config_error_type *err_type)
+{
+	struct glist_head *weights = link_mem;
+	struct dispatch_client_weight *cw = self_struct;
+
+	if (ipstring_to_sockaddr(cw->client, &cw->addr) != 0) {
+		LogCrit(COMPONENT_CONFIG,
+			"Dispatch_Client_Weight client %s is not an IP address",
+			cw->client);
+		err_type->invalid = true;
+		return 1;
+	}
+	qos_bucket_set(&cw->qos, &cw->qos_limits);
+	glist_add_tail(weights, &cw->link);
+	return 0;
+}
+
+static struct config_item_list huge_page_modes[] = {
+	CONFIG_LIST_TOK("none", HUGE_PAGES_NONE),
+	CONFIG_LIST_TOK("false", HUGE_PAGES_NONE),
+	CONFIG_LIST_TOK("transparent", HUGE_PAGES_TRANSPARENT),
+	CONFIG_LIST_TOK("thp", HUGE_PAGES_TRANSPARENT),
+	CONFIG_LIST_TOK("explicit", HUGE_PAGES_EXPLICIT),
+	CONFIG_LIST_TOK("hugetlb", HUGE_PAGES_EXPLICIT),
+	CONFIG_LIST_EOL
+};
+
+static struct config_item client_weight_params[] = {
+	CONF_MAND_STR("Client", 1, SOCK_NAME_MAX, NULL,
+		      dispatch_client_weight, client),
+	CONF_ITEM_UI32("Weight", 1, 1024, 1,
+		       dispatch_client_weight, weight),
+	CONF_ITEM_UI32("IOPS_Limit", 0, QOS_IOPS_MAX, 0,
+		       dispatch_client_weight, qos_limits.iops),
+	CONF_ITEM_UI32("IOPS_Burst", 0, UINT32_MAX, 0,
+		       dispatch_client_weight, qos_limits.iops_burst),
+	CONF_ITEM_UI64("Bandwidth_Limit", 0, QOS_BANDWIDTH_MAX, 0,
+		       dispatch_client_weight, qos_limits.bandwidth),
+	CONF_ITEM_UI64("Bandwidth_Burst", 0, QOS_BANDWIDTH_BURST_MAX, 0,
+		       dispatch_client_weight, qos_limits.bandwidth_burst),
+	CONFIG_EOL
+};
+
+/**
+ * @brief Init for the NFS_CORE_PARAM block
+ */
+
+static void *core_init(void *link_mem, void *self_struct)
+{
+	struct nfs_core_param *core = self_struct;
+
+	if (link_mem == NULL && core != NULL &&
+	    core->fair.weights.next == NULL)
+		glist_init(&core->fair.weights);
+	return noop_conf_init(link_mem, self_struct);
+}
+
 static struct config_item core_params[] = {
 	CONF_ITEM_UI16("NFS_Port", 0, UINT16_MAX, NFS_PORT,
 		       nfs_core_param, port[P_NFS]),
@@ -92,6 +184,12 @@ static struct config_item core_params[] = {
 		       nfs_core_param, program[P_RQUOTA]),
 	CONF_ITEM_UI32("Nb_Worker", 1, 1024*128, NB_WORKER_THREAD_DEFAULT,
 		       nfs_core_param, nb_worker),
+	CONF_ITEM_BOOL("Adaptive_Workers", false,
+		       nfs_core_param, adaptive_workers),
+	CONF_ITEM_UI32("Nb_Worker_Min", 1, 1024*128, 16,
+		       nfs_core_param, nb_worker_min),
+	CONF_ITEM_UI32("Adaptive_Workers_Interval", 100, 60000, 1000,
+		       nfs_core_param, adaptive_workers_interval),
 	CONF_ITEM_BOOL("Drop_IO_Errors", false,
 		       nfs_core_param, drop_io_errors),
 	CONF_ITEM_BOOL("Drop_Inval_Errors", false,
@@ -102,6 +200,29 @@ static struct config_item core_params[] = {
 		       nfs_core_param, dispatch_max_reqs),
 	CONF_ITEM_UI32("Dispatch_Max_Reqs_Xprt", 1, 2048, 512,
 		       nfs_core_param, dispatch_max_reqs_xprt),
+	CONF_ITEM_UI32("Dispatch_Queue_Shards", 0, 1024, 1,
+		       nfs_core_param, dispatch_queue_shards),
+	CONF_ITEM_UI32("Dispatch_Queue_Ring_Size", 0, 65536, 0,
+		       nfs_core_param, dispatch_queue_ring_size),
+	CONF_ITEM_UI32("Dispatch_Batch_Size", 1, 64, 1,
+		       nfs_core_param, dispatch_batch_size),
+	CONF_ITEM_UI32("Dispatch_Worker_Spin", 0, 1000000, 0,
+		       nfs_core_param, dispatch_worker_spin),
+	CONF_ITEM_BOOL("Dispatch_NUMA_Affinity", false,
+		       nfs_core_param, dispatch_numa_affinity),
+	CONF_ITEM_BOOL("Dispatch_Inline_Low_Latency", false,
+		       nfs_core_param, dispatch_inline),
+	CONF_ITEM_UI32("Dispatch_Inline_Max_Depth", 0, 1024, 0,
+		       nfs_core_param, dispatch_inline_depth),
+	CONF_ITEM_UI32("Dispatch_Inline_Budget_Usecs", 0, 1000000, 1000,
+		       nfs_core_param, dispatch_inline_budget),
+	CONF_ITEM_BOOL("Dispatch_Fair_Queueing", false,
+		       nfs_core_param, fair.enabled),
+	CONF_ITEM_UI32("Dispatch_Fair_Quantum", 1, 1024, 4,
+		       nfs_core_param, fair.quantum),
+	CONF_ITEM_BLOCK("Dispatch_Client_Weight", client_weight_params,
+			client_weight_init, client_weight_commit,
+			nfs_core_param, fair.weights),
 	CONF_ITEM_BOOL("DRC_Disabled", false,
 		       nfs_core_param, drc.disabled),
 	CONF_ITEM_UI32("DRC_TCP_Npart", 1, 20, DRC_TCP_NPART,
@@ -118,6 +239,8 @@ static struct config_item core_params[] = {
 		       nfs_core_param, drc.tcp.recycle_expire_s),
 	CONF_ITEM_BOOL("DRC_TCP_Checksum", DRC_TCP_CHECKSUM,
 		       nfs_core_param, drc.tcp.checksum),
+	CONF_ITEM_BOOL("DRC_TCP_Hash_Table", DRC_TCP_HASH_TABLE,
+		       nfs_core_param, drc.tcp.hash_table),
 	CONF_ITEM_UI32("DRC_UDP_Npart", 1, 100, DRC_UDP_NPART,
 		       nfs_core_param, drc.udp.npart),
 	CONF_ITEM_UI32("DRC_UDP_Size", 512, 32768, DRC_UDP_SIZE,
@@ -142,6 +265,19 @@ static struct config_item core_params[] = {
 		       nfs_core_param, rpc.max_recv_buffer_size),
 	CONF_ITEM_UI32("RPC_Ioq_ThrdMax", 1, 1024*128, 200,
 		       nfs_core_param, rpc.ioq_thrd_max),
+	CONF_ITEM_UI32("RPC_TCP_Listeners", 1, RPC_TCP_LISTENERS_MAX, 1,
+		       nfs_core_param, rpc.tcp_listeners),
+	CONF_ITEM_UI32("RPC_Busy_Poll_Usecs", 0, 100000, 0,
+		       nfs_core_param, rpc.busy_poll_usecs),
+	CONF_ITEM_UI16("NFS_RDMA_Port", 0, UINT16_MAX, NFS_RDMA_PORT,
+		       nfs_core_param, rpc.rdma.port),
+	CONF_ITEM_UI32("NFS_RDMA_Credits", 1, 1024, 30,
+		       nfs_core_param, rpc.rdma.credits),
+	CONF_ITEM_UI32("NFS_RDMA_Inline_Size", 1024, 1048576,
+		       NFS_RDMA_INLINE_SIZE,
+		       nfs_core_param, rpc.rdma.inline_size),
+	CONF_ITEM_UI32("NFS_RDMA_Completion_Threads", 1, 256, 4,
+		       nfs_core_param, rpc.rdma.worker_count),
 	CONF_ITEM_UI32("RPC_GSS_Npart", 1, 1021, 13,
 		       nfs_core_param, rpc.gss.ctx_hash_partitions),
 	CONF_ITEM_UI32("RPC_GSS_Max_Ctx", 1, 1024*1024, 16384,
@@ -160,6 +296,12 @@ static struct config_item core_params[] = {
 		       nfs_core_param, core_options),
 	CONF_ITEM_BOOL("NSM_Use_Caller_Name", false,
 		       nfs_core_param, nsm_use_caller_name),
+	CONF_ITEM_UI32("NSM_Connections", 1, 64, 4,
+		       nfs_core_param, nsm_connections),
+	CONF_ITEM_UI32("RQUOTA_Cache_Time", 0, 3600, 0,
+		       nfs_core_param, rquota_cache_time),
+	CONF_ITEM_BOOL("RQUOTA_Cache_Prefetch", false,
+		       nfs_core_param, rquota_prefetch),
 	CONF_ITEM_BOOL("Clustered", true,
 		       nfs_core_param, clustered),
 	CONF_ITEM_BOOL("Enable_NLM", true,
@@ -168,14 +310,47 @@ static struct config_item core_params[] = {
 		       nfs_core_param, enable_RQUOTA),
 	CONF_ITEM_BOOL("Enable_Fast_Stats", false,
 		       nfs_core_param, enable_FASTSTATS),
+	CONF_ITEM_BOOL("Enable_Latency_Histograms", false,
+		       nfs_core_param, enable_latency_hist),
+	CONF_ITEM_UI16("Metrics_Port", 0, UINT16_MAX, 0,
+		       nfs_core_param, metrics_port),
+	CONF_ITEM_IP_ADDR("Metrics_Addr", "127.0.0.1",
+			  nfs_core_param, metrics_addr),
+	CONF_ITEM_UI32("Hot_Sample_Rate", 0, UINT32_MAX, 0,
+		       nfs_core_param, hot_sample_rate),
+	CONF_ITEM_UI32("Slow_Request_Threshold", 0, UINT32_MAX, 0,
+		       nfs_core_param, slow_request_ms),
 	CONF_ITEM_BOOL("Short_File_Handle", false,
 		       nfs_core_param, short_file_handle),
 	CONF_ITEM_I64("Manage_Gids_Expiration", 0, 7*24*60*60, 30*60,
 			nfs_core_param, manage_gids_expiration),
+	CONF_ITEM_BOOL("Manage_Gids_Preload", false,
+		       nfs_core_param, manage_gids_preload),
+	CONF_ITEM_BOOL("Netgroup_Preload", false,
+		       nfs_core_param, netgroup_preload),
+	CONF_ITEM_UI32("Netgroup_Refresh", 60, 7*24*60*60, 30*60,
+		       nfs_core_param, netgroup_refresh),
 	CONF_ITEM_PATH("Plugins_Dir", 1, MAXPATHLEN, FSAL_MODULE_LOC,
 		       nfs_core_param, ganesha_modules_loc),
 	CONF_ITEM_UI32("heartbeat_freq", 0, 5000, 1000,
 		       nfs_core_param, heartbeat_freq),
+	CONF_ITEM_UI32("IOBuf_High_Water", 0, 1024*1024*1024, 2*1024*1024,
+		       nfs_core_param, iobuf_high_water),
+	CONF_ITEM_UI32("IOBuf_Low_Water", 0, 1024*1024*1024, 1024*1024,
+		       nfs_core_param, iobuf_low_water),
+	CONF_ITEM_UI32("IOBuf_Depot_Size", 0, 1024*1024*1024, 64*1024*1024,
+		       nfs_core_param, iobuf_depot_max),
+	CONF_ITEM_TOKEN("Huge_Pages", HUGE_PAGES_NONE, huge_page_modes,
+			nfs_core_param, huge_pages),
+	CONF_ITEM_STR("Huge_Page_Pools", 1, 1024,
+		      "Request pool, NFSv4.1 session pool, "
+		      "Duplicate Request Pool, TCP DRC Pool, "
+		      "MDCACHE Entry Pool",
+		      nfs_core_param, huge_page_pools),
+	CONF_ITEM_UI32("Export_Init_Threads", 1, 256, 16,
+		       nfs_core_param, export_init_threads),
+	CONF_ITEM_PATH("Handoff_Socket", 1, MAXPATHLEN, NULL,
+		       nfs_core_param, handoff_socket),
 	CONFIG_EOL
 };
 
@@ -183,7 +358,7 @@ struct config_block nfs_core = {
 	.dbus_interface_name = "org.ganesha.nfsd.config.core",
 	.blk_desc.name = "NFS_Core_Param",
 	.blk_desc.type = CONFIG_BLOCK,
-	.blk_desc.u.blk.init = noop_conf_init,
+	.blk_desc.u.blk.init = core_init,
 	.blk_desc.u.blk.params = core_params,
 	.blk_desc.u.blk.commit = noop_conf_commit
 };
@@ -217,6 +392,34 @@ struct config_block krb5_param = {
 };
 #endif
 
+/**
+ * @brief RPC-with-TLS parameters
+ */
+#ifdef USE_RPC_TLS
+static struct config_item tls_params[] = {
+	CONF_ITEM_BOOL("Enable_TLS", false,
+		       nfs_tls_param, enabled),
+	CONF_ITEM_PATH("Certificate", 1, MAXPATHLEN, NULL,
+		       nfs_tls_param, certificate),
+	CONF_ITEM_PATH("Private_Key", 1, MAXPATHLEN, NULL,
+		       nfs_tls_param, private_key),
+	CONF_ITEM_PATH("CA_File", 1, MAXPATHLEN, NULL,
+		       nfs_tls_param, ca_file),
+	CONF_ITEM_UI32("Handshake_Timeout", 1, 300, 10,
+		       nfs_tls_param, handshake_timeout),
+	CONFIG_EOL
+};
+
+struct config_block tls_param = {
+	.dbus_interface_name = "org.ganesha.nfsd.config.tls",
+	.blk_desc.name = "RPC_TLS",
+	.blk_desc.type = CONFIG_BLOCK,
+	.blk_desc.u.blk.init = noop_conf_init,
+	.blk_desc.u.blk.params = tls_params,
+	.blk_desc.u.blk.commit = noop_conf_commit
+};
+#endif
+
 #ifdef USE_NFSIDMAP
 #define GETPWNAMDEF false
 #else
@@ -227,6 +430,13 @@ struct config_block krb5_param = {
  * @brief NFSv4 specific parameters
  */
 
+static struct config_item_list recovery_backends[] = {
+	CONFIG_LIST_TOK("fs", RECOVERY_BACKEND_FS),
+	CONFIG_LIST_TOK("fs_log", RECOVERY_BACKEND_FS_LOG),
+	CONFIG_LIST_TOK("fs_cluster", RECOVERY_BACKEND_FS_CLUSTER),
+	CONFIG_LIST_EOL
+};
+
 static struct config_item version4_params[] = {
 	CONF_ITEM_BOOL("Graceless", false,
 		       nfs_version4_parameter, graceless),
@@ -244,15 +454,40 @@ static struct config_item version4_params[] = {
 		       nfs_version4_parameter, allow_numeric_owners),
 	CONF_ITEM_BOOL("Only_Numeric_Owners", false,
 		       nfs_version4_parameter, only_numeric_owners),
+	CONF_ITEM_UI32("Idmap_Expiration", 0, 7 * 24 * 60 * 60,
+		       IDMAP_EXPIRATION_DEFAULT,
+		       nfs_version4_parameter, idmap_expiration),
+	CONF_ITEM_UI32("Idmap_Negative_Expiration", 1, 24 * 60 * 60,
+		       IDMAP_NEGATIVE_EXPIRATION_DEFAULT,
+		       nfs_version4_parameter, idmap_negative_expiration),
 	CONF_ITEM_BOOL("Delegations", false,
 		       nfs_version4_parameter, allow_delegations),
 	CONF_ITEM_UI32("Deleg_Recall_Retry_Delay", 0, 10,
 			DELEG_RECALL_RETRY_DELAY_DEFAULT,
 			nfs_version4_parameter, deleg_recall_retry_delay),
+	CONF_ITEM_TOKEN("RecoveryBackend", RECOVERY_BACKEND_FS,
+			recovery_backends,
+			nfs_version4_parameter, recovery_backend),
 	CONF_ITEM_BOOL("PNFS_MDS", true,
 		       nfs_version4_parameter, pnfs_mds),
 	CONF_ITEM_BOOL("PNFS_DS", true,
 		       nfs_version4_parameter, pnfs_ds),
+	CONF_ITEM_BOOL("Device_Info_Cache", true,
+		       nfs_version4_parameter, devinfo_cache),
+	CONF_ITEM_BOOL("Parallel_Compound", false,
+		       nfs_version4_parameter, parallel_compound),
+	CONF_ITEM_UI32("Parallel_Compound_Threads", 1, 256, 16,
+		       nfs_version4_parameter, parallel_compound_threads),
+	CONF_ITEM_UI32("Takeover_Threads", 1, 256, 16,
+		       nfs_version4_parameter, takeover_threads),
+	CONF_ITEM_UI32("Layout_Recalls_Per_Client", 1, 1024, 16,
+		       nfs_version4_parameter, layoutrecalls_per_client),
+	CONF_ITEM_STR("Load_Balance_Group", 1, INET_ADDRSTRLEN, NULL,
+		      nfs_version4_parameter, lb_group),
+	CONF_ITEM_UI16("Load_Balance_Port", 1, UINT16_MAX, 20492,
+		       nfs_version4_parameter, lb_port),
+	CONF_ITEM_STR("Load_Balance_Address", 1, 255, NULL,
+		      nfs_version4_parameter, lb_address),
 	CONFIG_EOL
 };
 
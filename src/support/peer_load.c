@@ -0,0 +1,421 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file peer_load.c
+ * @brief Publish the load of this head, and track that of the others
+ *
+ * One looper thread wakes every second, takes in what the other heads
+ * sent, and every PEER_LOAD_INTERVAL seconds multicasts the load of
+ * this head.  A head not heard from for PEER_LOAD_EXPIRE seconds is
+ * forgotten.
+ *
+ * A head's score is its requests per second, plus a thousand per
+ * request waiting for a worker: a head with a backlog is busier than
+ * any head keeping up.
+ */
+
+#include "config.h"
+#include <unistd.h>
+#include <endian.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "log.h"
+#include "nfs_core.h"
+#include "fridgethr.h"
+#include "hashtable.h"
+#include "sal_data.h"
+#include "city.h"
+#include "peer_load.h"
+
+#define PEER_LOAD_MAGIC 0x474c4f44	/* "GLOD" */
+#define PEER_LOAD_EXPIRE (5 * PEER_LOAD_INTERVAL)
+
+/**
+ * @brief What a head multicasts, in network order, followed by its address
+ */
+struct peer_load_msg {
+	uint32_t magic;
+	uint64_t sender;
+	uint32_t ops;
+	uint32_t queued;
+	uint32_t clients;
+	uint16_t addr_len;
+} __attribute__((__packed__));
+
+struct peer_load_head {
+	uint64_t sender;
+	time_t heard;
+	struct peer_load load;
+};
+
+static struct fridgethr *peer_load_fridge;
+static int peer_load_sock = -1;
+static struct sockaddr_in peer_load_addr;
+static uint64_t peer_load_sender;
+
+static pthread_mutex_t peer_load_mtx = PTHREAD_MUTEX_INITIALIZER;
+static struct peer_load_head peer_load_heads[PEER_LOAD_HEADS];
+static uint32_t peer_load_nheads;	/*< Slot 0 is this head */
+
+/* Only used by the thread */
+static time_t peer_load_published;
+static uint32_t peer_load_dequeued;
+
+static inline uint64_t peer_load_score(const struct peer_load *load)
+{
+	return load->ops + 1000ULL * load->queued;
+}
+
+/** Confirmed NFSv4 clients, racy by nature */
+static uint32_t peer_load_clients(void)
+{
+	hash_table_t *ht = ht_confirmed_client_id;
+	uint32_t clients = 0;
+	uint32_t i;
+
+	if (ht == NULL)
+		return 0;
+
+	for (i = 0; i < ht->parameter.index_size; i++)
+		clients += atomic_fetch_size_t(&ht->partitions[i].count);
+
+	return clients;
+}
+
+/**
+ * @brief Record the load of a head
+ *
+ * @note Called with peer_load_mtx held.
+ */
+static void peer_load_record(uint64_t sender, const struct peer_load *load,
+			     time_t now)
+{
+	struct peer_load_head *head;
+	uint32_t ix;
+
+	for (ix = 0; ix < peer_load_nheads; ix++) {
+		if (peer_load_heads[ix].sender == sender)
+			break;
+	}
+
+	if (ix == peer_load_nheads) {
+		if (peer_load_nheads == PEER_LOAD_HEADS) {
+			LogDebug(COMPONENT_DISPATCH,
+				 "Too many heads, ignoring %s",
+				 load->address);
+			return;
+		}
+		peer_load_nheads++;
+		LogInfo(COMPONENT_DISPATCH, "Head %s joined", load->address);
+	}
+
+	head = &peer_load_heads[ix];
+	head->sender = sender;
+	head->heard = now;
+	head->load = *load;
+	head->load.score = peer_load_score(load);
+	head->load.self = ix == 0;
+}
+
+/** Forget the heads not heard from, keeping this one */
+static void peer_load_expire(time_t now)
+{
+	uint32_t ix = 1;
+
+	PTHREAD_MUTEX_lock(&peer_load_mtx);
+	while (ix < peer_load_nheads) {
+		if (now - peer_load_heads[ix].heard < PEER_LOAD_EXPIRE) {
+			ix++;
+			continue;
+		}
+		LogInfo(COMPONENT_DISPATCH, "Head %s left",
+			peer_load_heads[ix].load.address);
+		peer_load_heads[ix] = peer_load_heads[--peer_load_nheads];
+	}
+	PTHREAD_MUTEX_unlock(&peer_load_mtx);
+}
+
+static void peer_load_receive(time_t now)
+{
+	char buf[sizeof(struct peer_load_msg) + PEER_LOAD_ADDR];
+	struct peer_load_msg msg;
+	struct peer_load load;
+	uint16_t addr_len;
+	ssize_t len;
+
+	while ((len = recv(peer_load_sock, buf, sizeof(buf),
+			   MSG_DONTWAIT)) >= 0) {
+		if (len < (ssize_t)sizeof(msg))
+			continue;
+
+		memcpy(&msg, buf, sizeof(msg));
+		addr_len = ntohs(msg.addr_len);
+		if (ntohl(msg.magic) != PEER_LOAD_MAGIC ||
+		    be64toh(msg.sender) == peer_load_sender ||
+		    addr_len == 0 || addr_len >= PEER_LOAD_ADDR ||
+		    sizeof(msg) + addr_len > len)
+			continue;
+
+		memset(&load, 0, sizeof(load));
+		memcpy(load.address, buf + sizeof(msg), addr_len);
+		load.ops = ntohl(msg.ops);
+		load.queued = ntohl(msg.queued);
+		load.clients = ntohl(msg.clients);
+
+		PTHREAD_MUTEX_lock(&peer_load_mtx);
+		peer_load_record(be64toh(msg.sender), &load, now);
+		PTHREAD_MUTEX_unlock(&peer_load_mtx);
+	}
+}
+
+static void peer_load_publish(time_t now)
+{
+	char buf[sizeof(struct peer_load_msg) + PEER_LOAD_ADDR];
+	struct peer_load_msg msg;
+	struct peer_load load;
+	uint32_t dequeued = get_dequeue_count();
+	uint16_t addr_len;
+
+	PTHREAD_MUTEX_lock(&peer_load_mtx);
+	load = peer_load_heads[0].load;
+	PTHREAD_MUTEX_unlock(&peer_load_mtx);
+
+	load.ops = (dequeued - peer_load_dequeued) /
+		   (now - peer_load_published);
+	load.queued = nfs_rpc_queue_depth();
+	load.clients = peer_load_clients();
+	peer_load_dequeued = dequeued;
+	peer_load_published = now;
+
+	PTHREAD_MUTEX_lock(&peer_load_mtx);
+	peer_load_record(peer_load_sender, &load, now);
+	PTHREAD_MUTEX_unlock(&peer_load_mtx);
+
+	addr_len = strlen(load.address);
+	msg.magic = htonl(PEER_LOAD_MAGIC);
+	msg.sender = htobe64(peer_load_sender);
+	msg.ops = htonl(load.ops);
+	msg.queued = htonl(load.queued);
+	msg.clients = htonl(load.clients);
+	msg.addr_len = htons(addr_len);
+	memcpy(buf, &msg, sizeof(msg));
+	memcpy(buf + sizeof(msg), load.address, addr_len);
+
+	if (sendto(peer_load_sock, buf, sizeof(msg) + addr_len, 0,
+		   (struct sockaddr *)&peer_load_addr,
+		   sizeof(peer_load_addr)) < 0)
+		LogDebug(COMPONENT_DISPATCH, "Could not publish load: %s",
+			 strerror(errno));
+}
+
+static void peer_load_thread(struct fridgethr_context *ctx)
+{
+	time_t now = time(NULL);
+
+	SetNameFunction("peer_load");
+
+	peer_load_receive(now);
+	peer_load_expire(now);
+
+	if (now - peer_load_published >= PEER_LOAD_INTERVAL)
+		peer_load_publish(now);
+}
+
+static int peer_load_cmp(const void *a, const void *b)
+{
+	const struct peer_load *la = a, *lb = b;
+
+	if (la->score != lb->score)
+		return la->score < lb->score ? -1 : 1;
+	if (la->clients != lb->clients)
+		return la->clients < lb->clients ? -1 : 1;
+	/* Keep clients where they are */
+	return la->self ? -1 : lb->self ? 1 : 0;
+}
+
+/**
+ * @brief The heads known, least loaded first
+ *
+ * @param[out] heads Filled with the heads
+ * @param[in]  max   Room in @a heads
+ *
+ * @return Number of heads, 0 if not load balancing.
+ */
+uint32_t peer_load_ranked(struct peer_load *heads, uint32_t max)
+{
+	uint32_t ix, n;
+
+	PTHREAD_MUTEX_lock(&peer_load_mtx);
+	n = peer_load_nheads < max ? peer_load_nheads : max;
+	for (ix = 0; ix < n; ix++)
+		heads[ix] = peer_load_heads[ix].load;
+	PTHREAD_MUTEX_unlock(&peer_load_mtx);
+
+	qsort(heads, n, sizeof(*heads), peer_load_cmp);
+	return n;
+}
+
+static int peer_load_socket(void)
+{
+	struct ip_mreq mreq;
+	unsigned char ttl = 1, loop = 0;
+	int one = 1;
+	int fd;
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0)
+		return -errno;
+
+	memset(&mreq, 0, sizeof(mreq));
+	mreq.imr_multiaddr = peer_load_addr.sin_addr;
+	mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) ||
+	    bind(fd, (struct sockaddr *)&peer_load_addr,
+		 sizeof(peer_load_addr)) ||
+	    setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq,
+		       sizeof(mreq)) ||
+	    setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) ||
+	    setsockopt(fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop,
+		       sizeof(loop))) {
+		one = errno;
+		close(fd);
+		return -one;
+	}
+
+	return fd;
+}
+
+/**
+ * @brief Join the load balancing group and start publishing
+ *
+ * @return 0 or an error.
+ */
+int peer_load_init(void)
+{
+	struct nfs_version4_parameter *param = &nfs_param.nfsv4_param;
+	struct fridgethr_params frp;
+	struct peer_load *self;
+	struct {
+		char host[PEER_LOAD_ADDR];
+		pid_t pid;
+		struct timespec ts;
+	} seed;
+	int rc;
+
+	if (!peer_load_enabled())
+		return 0;
+
+	memset(&peer_load_addr, 0, sizeof(peer_load_addr));
+	peer_load_addr.sin_family = AF_INET;
+	peer_load_addr.sin_port = htons(param->lb_port);
+	if (inet_pton(AF_INET, param->lb_group,
+		      &peer_load_addr.sin_addr) != 1 ||
+	    !IN_MULTICAST(ntohl(peer_load_addr.sin_addr.s_addr))) {
+		LogCrit(COMPONENT_INIT,
+			"Load_Balance_Group %s is not an IPv4 multicast address",
+			param->lb_group);
+		return EINVAL;
+	}
+
+	self = &peer_load_heads[0].load;
+	if (param->lb_address != NULL)
+		strncpy(self->address, param->lb_address,
+			sizeof(self->address) - 1);
+	else if (gethostname(self->address, sizeof(self->address) - 1) != 0)
+		return errno;
+
+	memset(&seed, 0, sizeof(seed));
+	memcpy(seed.host, self->address, sizeof(seed.host));
+	seed.pid = getpid();
+	clock_gettime(CLOCK_REALTIME, &seed.ts);
+	peer_load_sender = CityHash64((char *)&seed, sizeof(seed));
+
+	peer_load_published = time(NULL);
+	peer_load_dequeued = get_dequeue_count();
+	peer_load_heads[0].sender = peer_load_sender;
+	peer_load_heads[0].heard = peer_load_published;
+	self->self = true;
+	peer_load_nheads = 1;
+
+	rc = peer_load_socket();
+	if (rc < 0) {
+		LogCrit(COMPONENT_INIT,
+			"Unable to join load balancing group %s:%" PRIu16
+			": %s", param->lb_group, param->lb_port,
+			strerror(-rc));
+		return -rc;
+	}
+	peer_load_sock = rc;
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = 1;
+	frp.thr_min = 1;
+	frp.thread_delay = 1;
+	frp.flavor = fridgethr_flavor_looper;
+
+	rc = fridgethr_init(&peer_load_fridge, "peer_load", &frp);
+	if (rc != 0) {
+		LogMajor(COMPONENT_INIT,
+			 "Unable to initialize load balancing fridge: %d", rc);
+		return rc;
+	}
+
+	rc = fridgethr_submit(peer_load_fridge, peer_load_thread, NULL);
+	if (rc != 0) {
+		LogMajor(COMPONENT_INIT,
+			 "Unable to start load balancing thread: %d", rc);
+		return rc;
+	}
+
+	LogInfo(COMPONENT_INIT,
+		"Balancing load as %s with the heads on %s:%" PRIu16,
+		self->address, param->lb_group, param->lb_port);
+	return 0;
+}
+
+int peer_load_shutdown(void)
+{
+	int rc = 0;
+
+	if (peer_load_fridge != NULL) {
+		rc = fridgethr_sync_command(peer_load_fridge,
+					    fridgethr_comm_stop, 120);
+		if (rc == ETIMEDOUT) {
+			LogMajor(COMPONENT_THREAD,
+				 "Shutdown timed out, cancelling threads.");
+			fridgethr_cancel(peer_load_fridge);
+		} else if (rc != 0) {
+			LogMajor(COMPONENT_THREAD,
+				 "Failed shutting down load balancing thread: %d",
+				 rc);
+		}
+	}
+
+	if (peer_load_sock >= 0) {
+		close(peer_load_sock);
+		peer_load_sock = -1;
+	}
+
+	return rc;
+}
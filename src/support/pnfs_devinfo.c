@@ -0,0 +1,196 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file  pnfs_devinfo.c
+ * @brief Cache of encoded device addresses
+ *
+ * GETDEVICEINFO keeps the da_addr_body an FSAL encoded, by deviceid
+ * and layout type, so a storm of mounts fetching the same devices
+ * costs one encoding each.  An entry is dropped when the FSAL notifies
+ * a change or removal of its device.
+ *
+ * An encoding begun before a notification must not be cached after
+ * it, so each lookup that misses takes the generation of the cache,
+ * which every notification bumps, and the result is only kept if the
+ * generation is unchanged.
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <pthread.h>
+#include "log.h"
+#include "nfs_core.h"
+#include "gsh_hash.h"
+#include "pnfs_utils.h"
+
+#define DEVINFO_BUCKETS 256
+#define DEVINFO_MAX_ENTRIES 4096
+
+struct pnfs_devinfo {
+	struct glist_head node;
+	struct pnfs_deviceid devid;
+	layouttype4 type;
+	size_t len;
+	char addr[];		/*< The encoded da_addr_body */
+};
+
+static struct glist_head devinfo_buckets[DEVINFO_BUCKETS];
+static pthread_rwlock_t devinfo_lock = PTHREAD_RWLOCK_INITIALIZER;
+static uint64_t devinfo_gen;
+static uint32_t devinfo_count;
+static pthread_once_t devinfo_once = PTHREAD_ONCE_INIT;
+
+static void devinfo_init(void)
+{
+	int i;
+
+	for (i = 0; i < DEVINFO_BUCKETS; i++)
+		glist_init(&devinfo_buckets[i]);
+}
+
+static inline struct glist_head *devinfo_bucket(
+					const struct pnfs_deviceid *devid)
+{
+	return &devinfo_buckets[gsh_hash64(devid, sizeof(*devid),
+					   0) % DEVINFO_BUCKETS];
+}
+
+/** Find an entry, called with devinfo_lock held */
+static struct pnfs_devinfo *devinfo_find(layouttype4 type,
+					 const struct pnfs_deviceid *devid)
+{
+	struct glist_head *bucket = devinfo_bucket(devid);
+	struct glist_head *glist;
+	struct pnfs_devinfo *di;
+
+	glist_for_each(glist, bucket) {
+		di = glist_entry(glist, struct pnfs_devinfo, node);
+		if (di->type == type &&
+		    memcmp(&di->devid, devid, sizeof(*devid)) == 0)
+			return di;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Copy out the cached address of a device
+ *
+ * @param[in]  type  Layout type asked for
+ * @param[in]  devid The device
+ * @param[out] buf   Where to copy the encoded address
+ * @param[in]  max   Size of @a buf
+ * @param[out] gen   On a miss, to pass to pnfs_devinfo_put
+ *
+ * @return Length copied, 0 if not cached or larger than @a max.
+ */
+size_t pnfs_devinfo_get(layouttype4 type, const struct pnfs_deviceid *devid,
+			char *buf, size_t max, uint64_t *gen)
+{
+	struct pnfs_devinfo *di;
+	size_t len = 0;
+
+	if (!nfs_param.nfsv4_param.devinfo_cache)
+		return 0;
+
+	(void)pthread_once(&devinfo_once, devinfo_init);
+
+	PTHREAD_RWLOCK_rdlock(&devinfo_lock);
+
+	di = devinfo_find(type, devid);
+	if (di != NULL && di->len <= max) {
+		memcpy(buf, di->addr, di->len);
+		len = di->len;
+	}
+	*gen = devinfo_gen;
+
+	PTHREAD_RWLOCK_unlock(&devinfo_lock);
+
+	return len;
+}
+
+/**
+ * @brief Cache the address an FSAL encoded
+ *
+ * @param[in] type  Layout type
+ * @param[in] devid The device
+ * @param[in] buf   The encoded da_addr_body
+ * @param[in] len   Its length
+ * @param[in] gen   What pnfs_devinfo_get returned before encoding
+ */
+void pnfs_devinfo_put(layouttype4 type, const struct pnfs_deviceid *devid,
+		      const char *buf, size_t len, uint64_t gen)
+{
+	struct pnfs_devinfo *di;
+
+	if (!nfs_param.nfsv4_param.devinfo_cache || len == 0)
+		return;
+
+	di = gsh_malloc(sizeof(*di) + len);
+	di->devid = *devid;
+	di->type = type;
+	di->len = len;
+	memcpy(di->addr, buf, len);
+
+	PTHREAD_RWLOCK_wrlock(&devinfo_lock);
+
+	if (gen != devinfo_gen || devinfo_count >= DEVINFO_MAX_ENTRIES ||
+	    devinfo_find(type, devid) != NULL) {
+		PTHREAD_RWLOCK_unlock(&devinfo_lock);
+		gsh_free(di);
+		return;
+	}
+
+	glist_add_tail(devinfo_bucket(devid), &di->node);
+	devinfo_count++;
+
+	PTHREAD_RWLOCK_unlock(&devinfo_lock);
+}
+
+/**
+ * @brief Drop the cached address of a device
+ *
+ * Called when the FSAL notifies a change or removal of the device.
+ *
+ * @param[in] type  Layout type notified
+ * @param[in] devid The device
+ */
+void pnfs_devinfo_forget(layouttype4 type, const struct pnfs_deviceid *devid)
+{
+	struct pnfs_devinfo *di;
+
+	(void)pthread_once(&devinfo_once, devinfo_init);
+
+	PTHREAD_RWLOCK_wrlock(&devinfo_lock);
+
+	devinfo_gen++;
+	di = devinfo_find(type, devid);
+	if (di != NULL) {
+		glist_del(&di->node);
+		devinfo_count--;
+	}
+
+	PTHREAD_RWLOCK_unlock(&devinfo_lock);
+
+	gsh_free(di);
+}
@@ -60,6 +60,8 @@
 #include "server_stats.h"
 #include <abstract_atomic.h>
 #include "nfs_proto_functions.h"
+#include "gsh_histogram.h"
+#include "gsh_metrics.h"
 
 #define NFS_V3_NB_COMMAND (NFSPROC3_COMMIT + 1)
 #define NFS_V4_NB_COMMAND 2
@@ -72,8 +74,6 @@
 #define NFS_V42_NB_OPERATION (NFS4_OP_WRITE_SAME + 1)
 #define _9P_NB_COMMAND 33
 
-#ifdef USE_DBUS
-
 struct op_name {
 	char *name;
 };
@@ -223,8 +223,6 @@ static const struct op_name optabv4[] = {
 	[NFS4_OP_REMOVEXATTR] = {.name = "OP_REMOVEXATTR",},
 };
 
-#endif
-
 /* Classify protocol ops for stats purposes
  */
 
@@ -406,6 +404,11 @@ struct _9p_stats {
 };
 #endif
 
+/* The global counters are bumped by every request, so each worker
+ * counts into its own slab and the readers add the slabs up.
+ */
+#define GLOBAL_STATS_SLABS 64
+
 struct global_stats {
 	struct nfsv3_stats nfsv3;
 	struct mnt_stats mnt;
@@ -419,7 +422,7 @@ struct global_stats {
 	struct nlm_ops lm;
 	struct mnt_ops mn;
 	struct qta_ops qt;
-};
+} __attribute__((__aligned__(64)));
 
 struct deleg_stats {
 	uint32_t curr_deleg_grants; /* current num of delegations owned by
@@ -428,9 +431,68 @@ struct deleg_stats {
 				       recall */
 	uint32_t failed_recalls;    /* times client failed to process recall */
 	uint32_t num_revokes;	    /* Num revokes for the client */
+	uint32_t tot_grants;	    /* total num of delegations granted to
+				       this client */
 };
 
-static struct global_stats global_st;
+static struct global_stats global_st[GLOBAL_STATS_SLABS];
+static uint32_t global_slab_next;
+static __thread struct global_stats *global_slab;
+
+/* Request stages timed by the latency histograms
+ */
+
+enum req_stage {
+	STAGE_DECODE = 0,	/* decoder picked it up until queued */
+	STAGE_QUEUE,		/* queued until a worker took it */
+	STAGE_EXECUTE,		/* service function */
+	STAGE_ENCODE,		/* reply encoded and sent */
+	STAGE_COUNT
+};
+
+struct latency_hists {
+	struct gsh_histogram v3[NFS_V3_NB_COMMAND][STAGE_COUNT];
+	struct gsh_histogram v4[NFS_V4_NB_COMMAND][STAGE_COUNT];
+	struct gsh_histogram mnt[MNT_V3_NB_COMMAND][STAGE_COUNT];
+	struct gsh_histogram nlm[NLM_V4_NB_OPERATION][STAGE_COUNT];
+	struct gsh_histogram qta[RQUOTA_NB_COMMAND][STAGE_COUNT];
+};
+
+static struct latency_hists latency_st;
+
+#ifdef USE_MEM_ACCOUNTING
+/* General allocations made by services, per operation.  The v4 table
+ * has the COMPOUND as a whole, v4op each operation in it.
+ */
+
+struct alloc_count {
+	uint64_t calls;
+	uint64_t allocs;
+	uint64_t frees;
+};
+
+struct alloc_counts {
+	struct alloc_count v3[NFS_V3_NB_COMMAND];
+	struct alloc_count v4[NFS_V4_NB_COMMAND];
+	struct alloc_count v4op[NFS4_OP_LAST_ONE];
+	struct alloc_count mnt[MNT_V3_NB_COMMAND];
+	struct alloc_count nlm[NLM_V4_NB_OPERATION];
+	struct alloc_count qta[RQUOTA_NB_COMMAND];
+};
+
+static struct alloc_counts alloc_st;
+#endif
+
+static const char *const stage_names[STAGE_COUNT] = {
+	[STAGE_DECODE] = "decode",
+	[STAGE_QUEUE] = "queue",
+	[STAGE_EXECUTE] = "execute",
+	[STAGE_ENCODE] = "encode",
+};
+
+static const char *const v4_proc_names[NFS_V4_NB_COMMAND] = {
+	"NULL", "COMPOUND"
+};
 
 /* include the top level server_stats struct definition
  */
@@ -440,118 +502,110 @@ static struct global_stats global_st;
  * @brief Get stats struct helpers
  *
  * These functions dereference the protocol specific struct
- * silently calloc the struct on first use.
+ * silently calloc the struct on first use.  The new struct is
+ * published with a compare and swap, the loser of a race freeing
+ * its copy, so that no lock is taken on the way to the counters.
  *
  * @param stats [IN] the stats structure to dereference in
- * @param lock  [IN] the lock in the stats owning struct
  *
  * @return pointer to proto struct
- *
- * @TODO make them inlines for release
  */
 
-static struct nfsv3_stats *get_v3(struct gsh_stats *stats,
-				  pthread_rwlock_t *lock)
+static void *get_stats(void **statsp, size_t size)
 {
-	if (unlikely(stats->nfsv3 == NULL)) {
-		PTHREAD_RWLOCK_wrlock(lock);
-		if (stats->nfsv3 == NULL)
-			stats->nfsv3 =
-			    gsh_calloc(1, sizeof(struct nfsv3_stats));
-		PTHREAD_RWLOCK_unlock(lock);
+	void *sp = atomic_fetch_voidptr(statsp);
+
+	if (likely(sp != NULL))
+		return sp;
+
+	sp = gsh_calloc(1, size);
+	if (!atomic_cas_voidptr(statsp, NULL, sp)) {
+		gsh_free(sp);
+		sp = atomic_fetch_voidptr(statsp);
 	}
-	return stats->nfsv3;
+	return sp;
 }
 
-static struct mnt_stats *get_mnt(struct gsh_stats *stats,
-				 pthread_rwlock_t *lock)
+static inline struct nfsv3_stats *get_v3(struct gsh_stats *stats)
 {
-	if (unlikely(stats->mnt == NULL)) {
-		PTHREAD_RWLOCK_wrlock(lock);
-		if (stats->mnt == NULL)
-			stats->mnt = gsh_calloc(1, sizeof(struct mnt_stats));
-		PTHREAD_RWLOCK_unlock(lock);
-	}
-	return stats->mnt;
+	return get_stats((void **)&stats->nfsv3, sizeof(struct nfsv3_stats));
 }
 
-static struct nlmv4_stats *get_nlm4(struct gsh_stats *stats,
-				    pthread_rwlock_t *lock)
+static inline struct mnt_stats *get_mnt(struct gsh_stats *stats)
 {
-	if (unlikely(stats->nlm4 == NULL)) {
-		PTHREAD_RWLOCK_wrlock(lock);
-		if (stats->nlm4 == NULL)
-			stats->nlm4 = gsh_calloc(1, sizeof(struct nlmv4_stats));
-		PTHREAD_RWLOCK_unlock(lock);
-	}
-	return stats->nlm4;
+	return get_stats((void **)&stats->mnt, sizeof(struct mnt_stats));
 }
 
-static struct rquota_stats *get_rquota(struct gsh_stats *stats,
-				       pthread_rwlock_t *lock)
+static inline struct nlmv4_stats *get_nlm4(struct gsh_stats *stats)
 {
-	if (unlikely(stats->rquota == NULL)) {
-		PTHREAD_RWLOCK_wrlock(lock);
-		if (stats->rquota == NULL)
-			stats->rquota =
-			    gsh_calloc(1, sizeof(struct rquota_stats));
-		PTHREAD_RWLOCK_unlock(lock);
-	}
-	return stats->rquota;
+	return get_stats((void **)&stats->nlm4, sizeof(struct nlmv4_stats));
 }
 
-static struct nfsv40_stats *get_v40(struct gsh_stats *stats,
-				    pthread_rwlock_t *lock)
+static inline struct rquota_stats *get_rquota(struct gsh_stats *stats)
 {
-	if (unlikely(stats->nfsv40 == NULL)) {
-		PTHREAD_RWLOCK_wrlock(lock);
-		if (stats->nfsv40 == NULL)
-			stats->nfsv40 =
-			    gsh_calloc(1, sizeof(struct nfsv40_stats));
-		PTHREAD_RWLOCK_unlock(lock);
-	}
-	return stats->nfsv40;
+	return get_stats((void **)&stats->rquota,
+			 sizeof(struct rquota_stats));
 }
 
-static struct nfsv41_stats *get_v41(struct gsh_stats *stats,
-				    pthread_rwlock_t *lock)
+static inline struct nfsv40_stats *get_v40(struct gsh_stats *stats)
 {
-	if (unlikely(stats->nfsv41 == NULL)) {
-		PTHREAD_RWLOCK_wrlock(lock);
-		if (stats->nfsv41 == NULL)
-			stats->nfsv41 =
-			    gsh_calloc(1, sizeof(struct nfsv41_stats));
-		PTHREAD_RWLOCK_unlock(lock);
-	}
-	return stats->nfsv41;
+	return get_stats((void **)&stats->nfsv40,
+			 sizeof(struct nfsv40_stats));
 }
 
-static struct nfsv41_stats *get_v42(struct gsh_stats *stats,
-				    pthread_rwlock_t *lock)
+static inline struct nfsv41_stats *get_v41(struct gsh_stats *stats)
 {
-	if (unlikely(stats->nfsv42 == NULL)) {
-		PTHREAD_RWLOCK_wrlock(lock);
-		if (stats->nfsv42 == NULL)
-			stats->nfsv42 =
-			    gsh_calloc(1, sizeof(struct nfsv41_stats));
-		PTHREAD_RWLOCK_unlock(lock);
-	}
-	return stats->nfsv42;
+	return get_stats((void **)&stats->nfsv41,
+			 sizeof(struct nfsv41_stats));
+}
+
+static inline struct nfsv41_stats *get_v42(struct gsh_stats *stats)
+{
+	return get_stats((void **)&stats->nfsv42,
+			 sizeof(struct nfsv41_stats));
 }
 
 #ifdef _USE_9P
-static struct _9p_stats *get_9p(struct gsh_stats *stats, pthread_rwlock_t *lock)
+static inline struct _9p_stats *get_9p(struct gsh_stats *stats)
 {
-	if (unlikely(stats->_9p == NULL)) {
-		PTHREAD_RWLOCK_wrlock(lock);
-		if (stats->_9p == NULL)
-			stats->_9p = gsh_calloc(1, sizeof(struct _9p_stats));
-		PTHREAD_RWLOCK_unlock(lock);
-	}
-	return stats->_9p;
+	return get_stats((void **)&stats->_9p, sizeof(struct _9p_stats));
 }
 #endif
 
+/**
+ * @brief The calling thread's slab of the global counters
+ *
+ * Threads are dealt slabs in turn when they first count something.
+ */
+
+static inline struct global_stats *global_stats_slab(void)
+{
+	if (unlikely(global_slab == NULL))
+		global_slab = &global_st[atomic_inc_uint32_t(&global_slab_next)
+					 % GLOBAL_STATS_SLABS];
+	return global_slab;
+}
+
+/**
+ * @brief Add up a global counter over the slabs
+ *
+ * @param counter [IN] the counter in the first slab
+ *
+ * @return the total.
+ */
+
+static uint64_t global_sum(const uint64_t *counter)
+{
+	size_t off = (const char *)counter - (const char *)&global_st[0];
+	uint64_t total = 0;
+	int i;
+
+	for (i = 0; i < GLOBAL_STATS_SLABS; i++)
+		total += atomic_fetch_uint64_t(
+			(uint64_t *)((char *)&global_st[i] + off));
+	return total;
+}
+
 /* Functions for recording statistics
  */
 
@@ -625,7 +679,7 @@ static void record_io(struct xfer_op *iop, size_t requested, size_t transferred,
  * @brief record i/o stats by protocol
  */
 
-static void record_io_stats(struct gsh_stats *gsh_st, pthread_rwlock_t *lock,
+static void record_io_stats(struct gsh_stats *gsh_st,
 			    size_t requested,
 			    size_t transferred, bool success, bool is_write)
 {
@@ -633,20 +687,20 @@ static void record_io_stats(struct gsh_stats *gsh_st, pthread_rwlock_t *lock,
 
 	if (op_ctx->req_type == NFS_REQUEST) {
 		if (op_ctx->nfs_vers == NFS_V3) {
-			struct nfsv3_stats *sp = get_v3(gsh_st, lock);
+			struct nfsv3_stats *sp = get_v3(gsh_st);
 
 			iop = is_write ? &sp->write : &sp->read;
 		} else if (op_ctx->nfs_vers == NFS_V4) {
 			if (op_ctx->nfs_minorvers == 0) {
-				struct nfsv40_stats *sp = get_v40(gsh_st, lock);
+				struct nfsv40_stats *sp = get_v40(gsh_st);
 
 				iop = is_write ? &sp->write : &sp->read;
 			} else if (op_ctx->nfs_minorvers == 1) {
-				struct nfsv41_stats *sp = get_v41(gsh_st, lock);
+				struct nfsv41_stats *sp = get_v41(gsh_st);
 
 				iop = is_write ? &sp->write : &sp->read;
 			} else if (op_ctx->nfs_minorvers == 2) {
-				struct nfsv41_stats *sp = get_v42(gsh_st, lock);
+				struct nfsv41_stats *sp = get_v42(gsh_st);
 
 				iop = is_write ? &sp->write : &sp->read;
 			}
@@ -656,7 +710,7 @@ static void record_io_stats(struct gsh_stats *gsh_st, pthread_rwlock_t *lock,
 		}
 #ifdef _USE_9P
 	} else if (op_ctx->req_type == _9P_REQUEST) {
-		struct _9p_stats *sp = get_9p(gsh_st, lock);
+		struct _9p_stats *sp = get_9p(gsh_st);
 
 		iop = is_write ? &sp->write : &sp->read;
 #endif
@@ -728,13 +782,13 @@ static void record_layout(struct nfsv41_stats *sp, int proto_op, int status)
  * @brief Record NFS V4 compound stats
  */
 
-static void record_nfsv4_op(struct gsh_stats *gsh_st, pthread_rwlock_t *lock,
+static void record_nfsv4_op(struct gsh_stats *gsh_st,
 			    int proto_op, int minorversion,
 			    nsecs_elapsed_t request_time,
 			    nsecs_elapsed_t qwait_time, int status)
 {
 	if (minorversion == 0) {
-		struct nfsv40_stats *sp = get_v40(gsh_st, lock);
+		struct nfsv40_stats *sp = get_v40(gsh_st);
 
 		/* record stuff */
 		switch (nfsv40_optype[proto_op]) {
@@ -751,7 +805,7 @@ static void record_nfsv4_op(struct gsh_stats *gsh_st, pthread_rwlock_t *lock,
 				  status == NFS4_OK, false);
 		}
 	} else if (minorversion == 1) {
-		struct nfsv41_stats *sp = get_v41(gsh_st, lock);
+		struct nfsv41_stats *sp = get_v41(gsh_st);
 
 		/* record stuff */
 		switch (nfsv41_optype[proto_op]) {
@@ -771,7 +825,7 @@ static void record_nfsv4_op(struct gsh_stats *gsh_st, pthread_rwlock_t *lock,
 				  status == NFS4_OK, false);
 		}
 	} else if (minorversion == 2) {
-		struct nfsv41_stats *sp = get_v42(gsh_st, lock);
+		struct nfsv41_stats *sp = get_v42(gsh_st);
 
 		/* record stuff */
 		switch (nfsv42_optype[proto_op]) {
@@ -798,28 +852,28 @@ static void record_nfsv4_op(struct gsh_stats *gsh_st, pthread_rwlock_t *lock,
  * @brief Record NFS V4 compound stats
  */
 
-static void record_compound(struct gsh_stats *gsh_st, pthread_rwlock_t *lock,
+static void record_compound(struct gsh_stats *gsh_st,
 			    int minorversion, uint64_t num_ops,
 			    nsecs_elapsed_t request_time,
 			    nsecs_elapsed_t qwait_time, bool success)
 {
 	if (minorversion == 0) {
 
-		struct nfsv40_stats *sp = get_v40(gsh_st, lock);
+		struct nfsv40_stats *sp = get_v40(gsh_st);
 
 		/* record stuff */
 		record_op(&sp->compounds, request_time, qwait_time, success,
 			  false);
 		(void)atomic_add_uint64_t(&sp->ops_per_compound, num_ops);
 	} else if (minorversion == 1) {
-		struct nfsv41_stats *sp = get_v41(gsh_st, lock);
+		struct nfsv41_stats *sp = get_v41(gsh_st);
 
 		/* record stuff */
 		record_op(&sp->compounds, request_time, qwait_time, success,
 			  false);
 		(void)atomic_add_uint64_t(&sp->ops_per_compound, num_ops);
 	} else if (minorversion == 2) {
-		struct nfsv41_stats *sp = get_v42(gsh_st, lock);
+		struct nfsv41_stats *sp = get_v42(gsh_st);
 
 		/* record stuff */
 		record_op(&sp->compounds, request_time, qwait_time, success,
@@ -836,7 +890,6 @@ static void record_compound(struct gsh_stats *gsh_st, pthread_rwlock_t *lock,
  * Once we found the stats block, do the update(s).
  *
  * @param gsh_st       [IN] stats struct from client or export
- * @param lock         [IN] lock on client|export for malloc
  * @param reqdata      [IN] info about the proto request
  * @param success      [IN] the op returned OK (or error)
  * @param request_time [IN] time consumed by request
@@ -844,7 +897,7 @@ static void record_compound(struct gsh_stats *gsh_st, pthread_rwlock_t *lock,
  * @param dup          [IN] detected this was a dup request
  */
 
-static void record_stats(struct gsh_stats *gsh_st, pthread_rwlock_t *lock,
+static void record_stats(struct gsh_stats *gsh_st,
 			 request_data_t *reqdata, nsecs_elapsed_t request_time,
 			 nsecs_elapsed_t qwait_time, bool success, bool dup,
 			 bool global)
@@ -856,12 +909,13 @@ static void record_stats(struct gsh_stats *gsh_st, pthread_rwlock_t *lock,
 		if (proto_op == 0)
 			return;	/* we don't count NULL ops */
 		if (req->rq_vers == NFS_V3) {
-			struct nfsv3_stats *sp = get_v3(gsh_st, lock);
+			struct nfsv3_stats *sp = get_v3(gsh_st);
 
 			/* record stuff */
 			if (global)
-				record_op(&global_st.nfsv3.cmds, request_time,
-					  qwait_time, success, dup);
+				record_op(&global_stats_slab()->nfsv3.cmds,
+					  request_time, qwait_time, success,
+					  dup);
 			switch (nfsv3_optype[proto_op]) {
 			case READ_OP:
 				record_latency(&sp->read.cmd, request_time,
@@ -880,14 +934,14 @@ static void record_stats(struct gsh_stats *gsh_st, pthread_rwlock_t *lock,
 			return;
 		}
 	} else if (req->rq_prog == nfs_param.core_param.program[P_MNT]) {
-		struct mnt_stats *sp = get_mnt(gsh_st, lock);
+		struct mnt_stats *sp = get_mnt(gsh_st);
 
 		if (global && req->rq_vers == MOUNT_V1)
-			record_op(&global_st.mnt.v1_ops, request_time,
-				  qwait_time, success, dup);
+			record_op(&global_stats_slab()->mnt.v1_ops,
+				  request_time, qwait_time, success, dup);
 		else if (global)
-			record_op(&global_st.mnt.v3_ops, request_time,
-				  qwait_time, success, dup);
+			record_op(&global_stats_slab()->mnt.v3_ops,
+				  request_time, qwait_time, success, dup);
 
 		/* record stuff */
 		if (req->rq_vers == MOUNT_V1)
@@ -897,19 +951,19 @@ static void record_stats(struct gsh_stats *gsh_st, pthread_rwlock_t *lock,
 			record_op(&sp->v3_ops, request_time, qwait_time,
 				  success, dup);
 	} else if (req->rq_prog == nfs_param.core_param.program[P_NLM]) {
-		struct nlmv4_stats *sp = get_nlm4(gsh_st, lock);
+		struct nlmv4_stats *sp = get_nlm4(gsh_st);
 
 		if (global)
-			record_op(&global_st.nlm4.ops, request_time,
-				  qwait_time, success, dup);
+			record_op(&global_stats_slab()->nlm4.ops,
+				  request_time, qwait_time, success, dup);
 		/* record stuff */
 		record_op(&sp->ops, request_time, qwait_time, success, dup);
 	} else if (req->rq_prog == nfs_param.core_param.program[P_RQUOTA]) {
-		struct rquota_stats *sp = get_rquota(gsh_st, lock);
+		struct rquota_stats *sp = get_rquota(gsh_st);
 
 		if (global)
-			record_op(&global_st.rquota.ops, request_time,
-				  qwait_time, success, dup);
+			record_op(&global_stats_slab()->rquota.ops,
+				  request_time, qwait_time, success, dup);
 		/* record stuff */
 		if (req->rq_vers == RQUOTAVERS)
 			record_op(&sp->ops, request_time, qwait_time, success,
@@ -957,7 +1011,7 @@ void server_stats_transport_done(struct gsh_client *client,
 {
 	struct server_stats *server_st =
 		container_of(client, struct server_stats, client);
-	struct _9p_stats *sp = get_9p(&server_st->st, &client->lock);
+	struct _9p_stats *sp = get_9p(&server_st->st);
 
 	if (sp != NULL)
 		record_transport_stats(&sp->trans, rx_bytes, rx_pkt, rx_err,
@@ -980,11 +1034,10 @@ void server_stats_9p_done(u8 opc, struct _9p_request_data *req9p)
 		struct server_stats *server_st;
 
 		server_st = container_of(client, struct server_stats, client);
-		sp = get_9p(&server_st->st, &client->lock);
-		if (sp->opcodes[opc] == NULL)
-			sp->opcodes[opc] =
-				gsh_calloc(1, sizeof(struct proto_op));
-		record_op(sp->opcodes[opc], 0, 0, true, false);
+		sp = get_9p(&server_st->st);
+		record_op(get_stats((void **)&sp->opcodes[opc],
+				    sizeof(struct proto_op)),
+			  0, 0, true, false);
 	}
 
 	if (op_ctx->ctx_export) {
@@ -992,11 +1045,10 @@ void server_stats_9p_done(u8 opc, struct _9p_request_data *req9p)
 
 		export = op_ctx->ctx_export;
 		exp_st = container_of(export, struct export_stats, export);
-		sp = get_9p(&exp_st->st, &export->lock);
-		if (sp->opcodes[opc] == NULL)
-			sp->opcodes[opc] =
-				gsh_calloc(1, sizeof(struct proto_op));
-		record_op(sp->opcodes[opc], 0, 0, true, false);
+		sp = get_9p(&exp_st->st);
+		record_op(get_stats((void **)&sp->opcodes[opc],
+				    sizeof(struct proto_op)),
+			  0, 0, true, false);
 	}
 }
 #endif
@@ -1016,13 +1068,17 @@ void server_stats_nfs_done(request_data_t *reqdata, int rc, bool dup)
 	uint32_t proto_op = req->rq_proc;
 
 	if (req->rq_prog == NFS_PROGRAM && op_ctx->nfs_vers == NFS_V3)
-			global_st.v3.op[proto_op]++;
+		(void)atomic_inc_uint64_t(
+			&global_stats_slab()->v3.op[proto_op]);
 	else if (req->rq_prog == nfs_param.core_param.program[P_NLM])
-		global_st.lm.op[proto_op]++;
+		(void)atomic_inc_uint64_t(
+			&global_stats_slab()->lm.op[proto_op]);
 	else if (req->rq_prog == nfs_param.core_param.program[P_MNT])
-		global_st.mn.op[proto_op]++;
+		(void)atomic_inc_uint64_t(
+			&global_stats_slab()->mn.op[proto_op]);
 	else if (req->rq_prog == nfs_param.core_param.program[P_RQUOTA])
-		global_st.qt.op[proto_op]++;
+		(void)atomic_inc_uint64_t(
+			&global_stats_slab()->qt.op[proto_op]);
 
 	if (nfs_param.core_param.enable_FASTSTATS)
 		return;
@@ -1033,7 +1089,7 @@ void server_stats_nfs_done(request_data_t *reqdata, int rc, bool dup)
 		struct server_stats *server_st;
 
 		server_st = container_of(client, struct server_stats, client);
-		record_stats(&server_st->st, &client->lock, reqdata,
+		record_stats(&server_st->st, reqdata,
 			     stop_time - op_ctx->start_time,
 			     op_ctx->queue_wait,
 			     rc == NFS_REQ_OK, dup, true);
@@ -1045,7 +1101,7 @@ void server_stats_nfs_done(request_data_t *reqdata, int rc, bool dup)
 		exp_st =
 		    container_of(op_ctx->ctx_export, struct export_stats,
 			    export);
-		record_stats(&exp_st->st, &op_ctx->ctx_export->lock, reqdata,
+		record_stats(&exp_st->st, reqdata,
 			     stop_time - op_ctx->start_time,
 			     op_ctx->queue_wait, rc == NFS_REQ_OK, dup, false);
 		(void)atomic_store_uint64_t(&op_ctx->ctx_export->last_update,
@@ -1053,6 +1109,151 @@ void server_stats_nfs_done(request_data_t *reqdata, int rc, bool dup)
 	}
 }
 
+/**
+ * @brief Find the latency histograms of a request's operation
+ *
+ * @param[in] req Request
+ *
+ * @return The STAGE_COUNT histograms or NULL if the operation is not
+ *         tracked.
+ */
+
+static struct gsh_histogram *latency_hists_of(struct svc_req *req)
+{
+	uint32_t proc = req->rq_proc;
+
+	if (req->rq_prog == nfs_param.core_param.program[P_NFS]) {
+		if (req->rq_vers == NFS_V3 && proc < NFS_V3_NB_COMMAND)
+			return latency_st.v3[proc];
+		if (req->rq_vers == NFS_V4 && proc < NFS_V4_NB_COMMAND)
+			return latency_st.v4[proc];
+	} else if (req->rq_prog == nfs_param.core_param.program[P_MNT]) {
+		if (proc < MNT_V3_NB_COMMAND)
+			return latency_st.mnt[proc];
+	} else if (req->rq_prog == nfs_param.core_param.program[P_NLM]) {
+		if (proc < NLM_V4_NB_OPERATION)
+			return latency_st.nlm[proc];
+	} else if (req->rq_prog == nfs_param.core_param.program[P_RQUOTA]) {
+		if (proc < RQUOTA_NB_COMMAND)
+			return latency_st.qta[proc];
+	}
+	return NULL;
+}
+
+/**
+ * @brief record the stage latencies of a finished request
+ *
+ * Called from nfs_rpc_execute once the reply has been sent.  Requests
+ * decoded before the histograms were enabled have no decode or dequeue
+ * time and are not recorded.
+ *
+ * @param[in] reqdata  Request
+ * @param[in] svc_done When the service function returned
+ */
+
+void server_stats_stages_done(request_data_t *reqdata,
+			      nsecs_elapsed_t svc_done)
+{
+	struct gsh_histogram *hists;
+	struct timespec current_time;
+	nsecs_elapsed_t queued, stop_time;
+
+	if (reqdata->time_decode == 0 || reqdata->time_dequeued == 0)
+		return;
+
+	hists = latency_hists_of(&reqdata->r_u.req.svc);
+	if (hists == NULL)
+		return;
+
+	now(&current_time);
+	stop_time = timespec_diff(&ServerBootTime, &current_time);
+	queued = timespec_diff(&ServerBootTime, &reqdata->time_queued);
+
+	gsh_hist_record(&hists[STAGE_DECODE], queued - reqdata->time_decode);
+	gsh_hist_record(&hists[STAGE_QUEUE],
+			reqdata->time_dequeued - queued);
+	gsh_hist_record(&hists[STAGE_EXECUTE],
+			svc_done - op_ctx->start_time);
+	gsh_hist_record(&hists[STAGE_ENCODE], stop_time - svc_done);
+}
+
+#ifdef USE_MEM_ACCOUNTING
+/**
+ * @brief Find the allocation counts of a request's operation
+ *
+ * @param[in] req  Request
+ *
+ * @return The counts, NULL if the operation is not tracked.
+ */
+
+static struct alloc_count *alloc_count_of(struct svc_req *req)
+{
+	uint32_t proc = req->rq_proc;
+
+	if (req->rq_prog == nfs_param.core_param.program[P_NFS]) {
+		if (req->rq_vers == NFS_V3 && proc < NFS_V3_NB_COMMAND)
+			return &alloc_st.v3[proc];
+		if (req->rq_vers == NFS_V4 && proc < NFS_V4_NB_COMMAND)
+			return &alloc_st.v4[proc];
+	} else if (req->rq_prog == nfs_param.core_param.program[P_MNT]) {
+		if (proc < MNT_V3_NB_COMMAND)
+			return &alloc_st.mnt[proc];
+	} else if (req->rq_prog == nfs_param.core_param.program[P_NLM]) {
+		if (proc < NLM_V4_NB_OPERATION)
+			return &alloc_st.nlm[proc];
+	} else if (req->rq_prog == nfs_param.core_param.program[P_RQUOTA]) {
+		if (proc < RQUOTA_NB_COMMAND)
+			return &alloc_st.qta[proc];
+	}
+	return NULL;
+}
+
+static void record_allocs(struct alloc_count *ac,
+			  const struct mem_counter *start)
+{
+	struct mem_counter stop;
+
+	mem_acct_thread_total(&stop);
+	(void)atomic_inc_uint64_t(&ac->calls);
+	(void)atomic_add_uint64_t(&ac->allocs, stop.allocs - start->allocs);
+	(void)atomic_add_uint64_t(&ac->frees, stop.frees - start->frees);
+}
+
+/**
+ * @brief record the allocations of a request's service
+ *
+ * Called from nfs_rpc_execute once the service function returned, on
+ * the thread that called it.  Requests whose service went on
+ * asynchronously are not recorded.
+ *
+ * @param[in] req   Request
+ * @param[in] start This thread's totals before the service
+ */
+
+void server_stats_allocs_done(struct svc_req *req,
+			      const struct mem_counter *start)
+{
+	struct alloc_count *ac = alloc_count_of(req);
+
+	if (ac != NULL)
+		record_allocs(ac, start);
+}
+
+/**
+ * @brief record the allocations of an NFSv4 operation
+ *
+ * @param[in] proto_op Operation
+ * @param[in] start    This thread's totals before the operation
+ */
+
+void server_stats_nfsv4_op_allocs_done(int proto_op,
+				       const struct mem_counter *start)
+{
+	if (proto_op >= 0 && proto_op < NFS4_OP_LAST_ONE)
+		record_allocs(&alloc_st.v4op[proto_op], start);
+}
+#endif
+
 /**
  * @brief record NFS V4 compound finished
  *
@@ -1067,7 +1268,8 @@ void server_stats_nfsv4_op_done(int proto_op,
 	nsecs_elapsed_t stop_time;
 
 	if (op_ctx->nfs_vers == NFS_V4)
-		global_st.v4.op[proto_op]++;
+		(void)atomic_inc_uint64_t(
+			&global_stats_slab()->v4.op[proto_op]);
 
 	if (nfs_param.core_param.enable_FASTSTATS)
 		return;
@@ -1079,21 +1281,24 @@ void server_stats_nfsv4_op_done(int proto_op,
 		struct server_stats *server_st;
 
 		server_st = container_of(client, struct server_stats, client);
-		record_nfsv4_op(&server_st->st, &client->lock, proto_op,
+		record_nfsv4_op(&server_st->st, proto_op,
 				op_ctx->nfs_minorvers, stop_time - start_time,
 				op_ctx->queue_wait, status);
 		(void)atomic_store_uint64_t(&client->last_update, stop_time);
 	}
 
 	if (op_ctx->nfs_minorvers == 0)
-		record_op(&global_st.nfsv40.compounds, stop_time - start_time,
-			  op_ctx->queue_wait, status == NFS4_OK, false);
+		record_op(&global_stats_slab()->nfsv40.compounds,
+			  stop_time - start_time, op_ctx->queue_wait,
+			  status == NFS4_OK, false);
 	else if (op_ctx->nfs_minorvers == 1)
-		record_op(&global_st.nfsv41.compounds, stop_time - start_time,
-			  op_ctx->queue_wait, status == NFS4_OK, false);
+		record_op(&global_stats_slab()->nfsv41.compounds,
+			  stop_time - start_time, op_ctx->queue_wait,
+			  status == NFS4_OK, false);
 	else if (op_ctx->nfs_minorvers == 2)
-		record_op(&global_st.nfsv42.compounds, stop_time - start_time,
-			  op_ctx->queue_wait, status == NFS4_OK, false);
+		record_op(&global_stats_slab()->nfsv42.compounds,
+			  stop_time - start_time, op_ctx->queue_wait,
+			  status == NFS4_OK, false);
 
 	if (op_ctx->ctx_export != NULL) {
 		struct export_stats *exp_st;
@@ -1101,7 +1306,7 @@ void server_stats_nfsv4_op_done(int proto_op,
 		exp_st =
 		    container_of(op_ctx->ctx_export, struct export_stats,
 			    export);
-		record_nfsv4_op(&exp_st->st, &op_ctx->ctx_export->lock,
+		record_nfsv4_op(&exp_st->st,
 				proto_op,
 				op_ctx->nfs_minorvers, stop_time - start_time,
 				op_ctx->queue_wait, status);
@@ -1128,7 +1333,7 @@ void server_stats_compound_done(int num_ops, int status)
 		struct server_stats *server_st;
 
 		server_st = container_of(client, struct server_stats, client);
-		record_compound(&server_st->st, &client->lock,
+		record_compound(&server_st->st,
 				op_ctx->nfs_minorvers,
 				num_ops, stop_time - op_ctx->start_time,
 				op_ctx->queue_wait, status == NFS4_OK);
@@ -1140,7 +1345,7 @@ void server_stats_compound_done(int num_ops, int status)
 		exp_st =
 		    container_of(op_ctx->ctx_export, struct export_stats,
 			    export);
-		record_compound(&exp_st->st, &op_ctx->ctx_export->lock,
+		record_compound(&exp_st->st,
 				op_ctx->nfs_minorvers, num_ops,
 				stop_time - op_ctx->start_time,
 				op_ctx->queue_wait, status == NFS4_OK);
@@ -1159,12 +1364,13 @@ void server_stats_compound_done(int num_ops, int status)
 void server_stats_io_done(size_t requested,
 			  size_t transferred, bool success, bool is_write)
 {
+	op_ctx->io_bytes += transferred;
 	if (op_ctx->client != NULL) {
 		struct server_stats *server_st;
 
 		server_st = container_of(op_ctx->client, struct server_stats,
 					 client);
-		record_io_stats(&server_st->st, &op_ctx->client->lock,
+		record_io_stats(&server_st->st,
 				requested, transferred, success,
 				is_write);
 	}
@@ -1174,7 +1380,7 @@ void server_stats_io_done(size_t requested,
 		exp_st =
 		    container_of(op_ctx->ctx_export, struct export_stats,
 			    export);
-		record_io_stats(&exp_st->st, &op_ctx->ctx_export->lock,
+		record_io_stats(&exp_st->st,
 				requested, transferred, success, is_write);
 	}
 }
@@ -1184,15 +1390,9 @@ void server_stats_io_done(size_t requested,
  *
  * Called from a bunch of places.
  */
-void check_deleg_struct(struct gsh_stats *stats, pthread_rwlock_t *lock)
+void check_deleg_struct(struct gsh_stats *stats)
 {
-	if (unlikely(stats->deleg == NULL)) {
-		PTHREAD_RWLOCK_wrlock(lock);
-		if (stats->deleg == NULL)
-			stats->deleg = gsh_calloc(1,
-					sizeof(struct deleg_stats));
-		PTHREAD_RWLOCK_unlock(lock);
-	}
+	(void)get_stats((void **)&stats->deleg, sizeof(struct deleg_stats));
 }
 void inc_grants(struct gsh_client *client)
 {
@@ -1200,8 +1400,9 @@ void inc_grants(struct gsh_client *client)
 		struct server_stats *server_st;
 
 		server_st = container_of(client, struct server_stats, client);
-		check_deleg_struct(&server_st->st, &client->lock);
+		check_deleg_struct(&server_st->st);
 		server_st->st.deleg->curr_deleg_grants++;
+		server_st->st.deleg->tot_grants++;
 	}
 }
 void dec_grants(struct gsh_client *client)
@@ -1210,8 +1411,8 @@ void dec_grants(struct gsh_client *client)
 		struct server_stats *server_st;
 
 		server_st = container_of(client, struct server_stats, client);
-		check_deleg_struct(&server_st->st, &client->lock);
-		server_st->st.deleg->curr_deleg_grants++;
+		check_deleg_struct(&server_st->st);
+		server_st->st.deleg->curr_deleg_grants--;
 	}
 }
 void inc_revokes(struct gsh_client *client)
@@ -1220,7 +1421,7 @@ void inc_revokes(struct gsh_client *client)
 		struct server_stats *server_st;
 
 		server_st = container_of(client, struct server_stats, client);
-		check_deleg_struct(&server_st->st, &client->lock);
+		check_deleg_struct(&server_st->st);
 		server_st->st.deleg->num_revokes++;
 	}
 }
@@ -1230,7 +1431,7 @@ void inc_recalls(struct gsh_client *client)
 		struct server_stats *server_st;
 
 		server_st = container_of(client, struct server_stats, client);
-		check_deleg_struct(&server_st->st, &client->lock);
+		check_deleg_struct(&server_st->st);
 		server_st->st.deleg->tot_recalls++;
 	}
 }
@@ -1240,7 +1441,7 @@ void inc_failed_recalls(struct gsh_client *client)
 		struct server_stats *server_st;
 
 		server_st = container_of(client, struct server_stats, client);
-		check_deleg_struct(&server_st->st, &client->lock);
+		check_deleg_struct(&server_st->st);
 		server_st->st.deleg->failed_recalls++;
 	}
 }
@@ -1442,6 +1643,7 @@ void global_dbus_total(DBusMessageIter *iter)
 {
 	DBusMessageIter struct_iter;
 	char *version;
+	uint64_t total;
 
 	dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL,
 					 &struct_iter);
@@ -1449,43 +1651,51 @@ void global_dbus_total(DBusMessageIter *iter)
 	version = "NFSv3";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
+	total = global_sum(&global_st[0].nfsv3.cmds.total);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-					&global_st.nfsv3.cmds.total);
+				       &total);
 	version = "NFSv40";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
+	total = global_sum(&global_st[0].nfsv40.compounds.total);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-					&global_st.nfsv40.compounds.total);
+				       &total);
 	version = "NFSv41";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
+	total = global_sum(&global_st[0].nfsv41.compounds.total);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-					&global_st.nfsv41.compounds.total);
+				       &total);
 	version = "NFSv42";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
+	total = global_sum(&global_st[0].nfsv42.compounds.total);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-					&global_st.nfsv42.compounds.total);
+				       &total);
 	version = "NLM4";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
+	total = global_sum(&global_st[0].nlm4.ops.total);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-					&global_st.nlm4.ops.total);
+				       &total);
 	version = "MNTv1";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
+	total = global_sum(&global_st[0].mnt.v1_ops.total);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-					&global_st.mnt.v1_ops.total);
+				       &total);
 	version = "MNTv3";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
+	total = global_sum(&global_st[0].mnt.v3_ops.total);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-					&global_st.mnt.v3_ops.total);
+				       &total);
 	version = "RQUOTA";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
+	total = global_sum(&global_st[0].rquota.ops.total);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-					&global_st.rquota.ops.total);
+				       &total);
 	dbus_message_iter_close_container(iter, &struct_iter);
 }
 
@@ -1494,6 +1704,7 @@ void global_dbus_fast(DBusMessageIter *iter)
 	DBusMessageIter struct_iter;
 	char *version;
 	char *op;
+	uint64_t cnt;
 	int i;
 
 	dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL,
@@ -1503,60 +1714,65 @@ void global_dbus_fast(DBusMessageIter *iter)
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
 	for (i = 0; i < NFSPROC3_COMMIT; i++) {
-		if (global_st.v3.op[i] > 0) {
+		cnt = global_sum(&global_st[0].v3.op[i]);
+		if (cnt > 0) {
 			op = optabv3[i].name;
 			dbus_message_iter_append_basic(&struct_iter,
 					DBUS_TYPE_STRING, &op);
 			dbus_message_iter_append_basic(&struct_iter,
-					DBUS_TYPE_UINT64, &global_st.v3.op[i]);
+					DBUS_TYPE_UINT64, &cnt);
 		}
 	}
 	version = "\nNFSv4:";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
 	for (i = 0; i < NFS4_OP_LAST_ONE; i++) {
-		if (global_st.v4.op[i] > 0) {
+		cnt = global_sum(&global_st[0].v4.op[i]);
+		if (cnt > 0) {
 			op = optabv4[i].name;
 			dbus_message_iter_append_basic(&struct_iter,
 					DBUS_TYPE_STRING, &op);
 			dbus_message_iter_append_basic(&struct_iter,
-					DBUS_TYPE_UINT64, &global_st.v4.op[i]);
+					DBUS_TYPE_UINT64, &cnt);
 		}
 	}
 	version = "\nNLM:";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
 	for (i = 0; i < NLM4_FAILED; i++) {
-		if (global_st.lm.op[i] > 0) {
+		cnt = global_sum(&global_st[0].lm.op[i]);
+		if (cnt > 0) {
 			op = optnlm[i].name;
 			dbus_message_iter_append_basic(&struct_iter,
 					DBUS_TYPE_STRING, &op);
 			dbus_message_iter_append_basic(&struct_iter,
-					DBUS_TYPE_UINT64, &global_st.lm.op[i]);
+					DBUS_TYPE_UINT64, &cnt);
 		}
 	}
 	version = "\nMNT:";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
 	for (i = 0; i < MOUNTPROC3_EXPORT; i++) {
-		if (global_st.mn.op[i] > 0) {
+		cnt = global_sum(&global_st[0].mn.op[i]);
+		if (cnt > 0) {
 			op = optmnt[i].name;
 			dbus_message_iter_append_basic(&struct_iter,
 					DBUS_TYPE_STRING, &op);
 			dbus_message_iter_append_basic(&struct_iter,
-					DBUS_TYPE_UINT64, &global_st.mn.op[i]);
+					DBUS_TYPE_UINT64, &cnt);
 		}
 	}
 	version = "\nQUOTA:";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
 	for (i = 0; i < RQUOTAPROC_SETACTIVEQUOTA; i++) {
-		if (global_st.qt.op[i] > 0) {
+		cnt = global_sum(&global_st[0].qt.op[i]);
+		if (cnt > 0) {
 			op = optqta[i].name;
 			dbus_message_iter_append_basic(&struct_iter,
 					DBUS_TYPE_STRING, &op);
 			dbus_message_iter_append_basic(&struct_iter,
-					DBUS_TYPE_UINT64, &global_st.qt.op[i]);
+					DBUS_TYPE_UINT64, &cnt);
 		}
 	}
 	dbus_message_iter_close_container(iter, &struct_iter);
@@ -1676,6 +1892,153 @@ void server_dbus_all_iostats(struct export_stats *export_statistics,
 	}
 }
 
+/* Offset of the record count in a snapshot */
+#define SNAPSHOT_COUNT_OFFSET 24
+
+static void snapshot_put(struct stats_snapshot *snap, const void *val,
+			 size_t len)
+{
+	if (snap->len + len > snap->size) {
+		snap->size = MAX(2 * snap->size, snap->len + len);
+		snap->buf = gsh_realloc(snap->buf, snap->size);
+	}
+	memcpy(snap->buf + snap->len, val, len);
+	snap->len += len;
+}
+
+static void snapshot_put_proto(struct stats_snapshot *snap,
+			       struct proto_op *ops, struct xfer_op *read,
+			       struct xfer_op *write)
+{
+	uint64_t val[14] = {
+		ops->total, ops->errors,
+		read->requested, read->transferred, read->cmd.total,
+		read->cmd.errors, read->cmd.latency.latency,
+		read->cmd.queue_latency.latency,
+		write->requested, write->transferred, write->cmd.total,
+		write->cmd.errors, write->cmd.latency.latency,
+		write->cmd.queue_latency.latency
+	};
+
+	snapshot_put(snap, val, sizeof(val));
+}
+
+static void snapshot_put_stats(struct stats_snapshot *snap,
+			       struct gsh_stats *st)
+{
+	struct nfsv3_stats *v3 = atomic_fetch_voidptr((void **)&st->nfsv3);
+	struct nfsv40_stats *v40 = atomic_fetch_voidptr((void **)&st->nfsv40);
+	struct nfsv41_stats *v41 = atomic_fetch_voidptr((void **)&st->nfsv41);
+	struct nfsv41_stats *v42 = atomic_fetch_voidptr((void **)&st->nfsv42);
+	uint8_t mask = (v3 != NULL) | (v40 != NULL) << 1 |
+		       (v41 != NULL) << 2 | (v42 != NULL) << 3;
+
+	snapshot_put(snap, &mask, sizeof(mask));
+	if (v3 != NULL)
+		snapshot_put_proto(snap, &v3->cmds, &v3->read, &v3->write);
+	if (v40 != NULL)
+		snapshot_put_proto(snap, &v40->compounds, &v40->read,
+				   &v40->write);
+	if (v41 != NULL)
+		snapshot_put_proto(snap, &v41->compounds, &v41->read,
+				   &v41->write);
+	if (v42 != NULL)
+		snapshot_put_proto(snap, &v42->compounds, &v42->read,
+				   &v42->write);
+	snap->count++;
+}
+
+/**
+ * @brief Start a stats snapshot
+ *
+ * @param snap [OUT] The snapshot
+ * @param kind [IN]  What it is of
+ */
+
+void server_stats_snapshot_init(struct stats_snapshot *snap,
+				enum stats_snapshot_kind kind)
+{
+	uint32_t magic = STATS_SNAPSHOT_MAGIC;
+	uint16_t version = STATS_SNAPSHOT_VERSION;
+	uint16_t kind16 = kind;
+	struct timespec timestamp;
+	uint64_t sec, nsec;
+
+	memset(snap, 0, sizeof(*snap));
+	now(&timestamp);
+	sec = timestamp.tv_sec;
+	nsec = timestamp.tv_nsec;
+
+	snapshot_put(snap, &magic, sizeof(magic));
+	snapshot_put(snap, &version, sizeof(version));
+	snapshot_put(snap, &kind16, sizeof(kind16));
+	snapshot_put(snap, &sec, sizeof(sec));
+	snapshot_put(snap, &nsec, sizeof(nsec));
+	assert(snap->len == SNAPSHOT_COUNT_OFFSET);
+	snapshot_put(snap, &snap->count, sizeof(snap->count));
+}
+
+/**
+ * @brief Add an export to a snapshot
+ *
+ * @param snap      [IN] The snapshot
+ * @param export_st [IN] The export's stats
+ */
+
+void server_stats_snapshot_export(struct stats_snapshot *snap,
+				  struct export_stats *export_st)
+{
+	snapshot_put(snap, &export_st->export.export_id,
+		     sizeof(export_st->export.export_id));
+	snapshot_put_stats(snap, &export_st->st);
+}
+
+/**
+ * @brief Add a client to a snapshot
+ *
+ * @param snap      [IN] The snapshot
+ * @param client_st [IN] The client's stats
+ */
+
+void server_stats_snapshot_client(struct stats_snapshot *snap,
+				  struct server_stats *client_st)
+{
+	uint8_t addr_len = client_st->client.addr.len;
+	uint64_t last_update = client_st->client.last_update;
+
+	snapshot_put(snap, &addr_len, sizeof(addr_len));
+	snapshot_put(snap, client_st->client.addr.addr, addr_len);
+	snapshot_put(snap, &last_update, sizeof(last_update));
+	snapshot_put_stats(snap, &client_st->st);
+}
+
+/**
+ * @brief Send a snapshot and free it
+ *
+ * @param snap [IN] The snapshot
+ * @param iter [IN] Iterator in the reply stream to fill
+ */
+
+void server_stats_snapshot_reply(struct stats_snapshot *snap,
+				 DBusMessageIter *iter)
+{
+	DBusMessageIter array_iter;
+	const char *buf = snap->buf;
+
+	memcpy(snap->buf + SNAPSHOT_COUNT_OFFSET, &snap->count,
+	       sizeof(snap->count));
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+					 DBUS_TYPE_BYTE_AS_STRING,
+					 &array_iter);
+	dbus_message_iter_append_fixed_array(&array_iter, DBUS_TYPE_BYTE,
+					     &buf, snap->len);
+	dbus_message_iter_close_container(iter, &array_iter);
+
+	gsh_free(snap->buf);
+	snap->buf = NULL;
+}
+
 void server_dbus_total_ops(struct export_stats *export_st,
 			   DBusMessageIter *iter)
 {
@@ -1695,6 +2058,165 @@ void server_dbus_fast_ops(DBusMessageIter *iter)
 	global_dbus_fast(iter);
 }
 
+/**
+ * @brief Append the histograms of one operation
+ *
+ * Each stage that has seen requests is a struct of program, operation,
+ * stage, count, sum in ns and an array of (bucket floor in ns, count)
+ * for the non-empty buckets.
+ */
+
+static void latency_dbus_op(DBusMessageIter *array_iter, const char *prog,
+			    const char *op, struct gsh_histogram *hists)
+{
+	DBusMessageIter struct_iter, bucket_array, bucket_iter;
+	struct gsh_histogram *h;
+	uint64_t floor, cnt;
+	uint32_t ix;
+	int stage;
+
+	if (op == NULL)
+		return;
+
+	for (stage = 0; stage < STAGE_COUNT; stage++) {
+		h = &hists[stage];
+		cnt = atomic_fetch_uint64_t(&h->count);
+		if (cnt == 0)
+			continue;
+
+		dbus_message_iter_open_container(array_iter, DBUS_TYPE_STRUCT,
+						 NULL, &struct_iter);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &prog);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &op);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &stage_names[stage]);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &cnt);
+		cnt = atomic_fetch_uint64_t(&h->sum);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &cnt);
+		dbus_message_iter_open_container(&struct_iter, DBUS_TYPE_ARRAY,
+						 "(tt)", &bucket_array);
+		for (ix = 0; ix < GSH_HIST_BUCKETS; ix++) {
+			cnt = atomic_fetch_uint64_t(&h->buckets[ix]);
+			if (cnt == 0)
+				continue;
+			floor = gsh_hist_bucket_floor(ix);
+			dbus_message_iter_open_container(&bucket_array,
+							 DBUS_TYPE_STRUCT, NULL,
+							 &bucket_iter);
+			dbus_message_iter_append_basic(&bucket_iter,
+						       DBUS_TYPE_UINT64,
+						       &floor);
+			dbus_message_iter_append_basic(&bucket_iter,
+						       DBUS_TYPE_UINT64, &cnt);
+			dbus_message_iter_close_container(&bucket_array,
+							  &bucket_iter);
+		}
+		dbus_message_iter_close_container(&struct_iter, &bucket_array);
+		dbus_message_iter_close_container(array_iter, &struct_iter);
+	}
+}
+
+void server_dbus_latency_hist(DBusMessageIter *iter)
+{
+	DBusMessageIter array_iter;
+	struct timespec timestamp;
+	int i;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+					 "(ssstta(tt))", &array_iter);
+	for (i = 0; i < NFS_V3_NB_COMMAND; i++)
+		latency_dbus_op(&array_iter, "NFSv3", optabv3[i].name,
+				latency_st.v3[i]);
+	for (i = 0; i < NFS_V4_NB_COMMAND; i++)
+		latency_dbus_op(&array_iter, "NFSv4", v4_proc_names[i],
+				latency_st.v4[i]);
+	for (i = 0; i < MNT_V3_NB_COMMAND; i++)
+		latency_dbus_op(&array_iter, "MNT", optmnt[i].name,
+				latency_st.mnt[i]);
+	for (i = 0; i < NLM_V4_NB_OPERATION; i++)
+		latency_dbus_op(&array_iter, "NLM", optnlm[i].name,
+				latency_st.nlm[i]);
+	for (i = 0; i < RQUOTA_NB_COMMAND; i++)
+		latency_dbus_op(&array_iter, "RQUOTA", optqta[i].name,
+				latency_st.qta[i]);
+	dbus_message_iter_close_container(iter, &array_iter);
+}
+
+#ifdef USE_MEM_ACCOUNTING
+/**
+ * @brief Append the allocation counts of one operation
+ *
+ * A struct of program, operation, calls, allocations and frees, if
+ * the operation has been called.
+ */
+
+static void alloc_dbus_op(DBusMessageIter *array_iter, const char *prog,
+			  const char *op, struct alloc_count *ac)
+{
+	DBusMessageIter struct_iter;
+	uint64_t cnt;
+
+	if (op == NULL)
+		return;
+
+	cnt = atomic_fetch_uint64_t(&ac->calls);
+	if (cnt == 0)
+		return;
+
+	dbus_message_iter_open_container(array_iter, DBUS_TYPE_STRUCT,
+					 NULL, &struct_iter);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &prog);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &op);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &cnt);
+	cnt = atomic_fetch_uint64_t(&ac->allocs);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &cnt);
+	cnt = atomic_fetch_uint64_t(&ac->frees);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &cnt);
+	dbus_message_iter_close_container(array_iter, &struct_iter);
+}
+#endif
+
+void server_dbus_alloc_stats(DBusMessageIter *iter)
+{
+	DBusMessageIter array_iter;
+	struct timespec timestamp;
+#ifdef USE_MEM_ACCOUNTING
+	int i;
+#endif
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+					 "(ssttt)", &array_iter);
+#ifdef USE_MEM_ACCOUNTING
+	for (i = 0; i < NFS_V3_NB_COMMAND; i++)
+		alloc_dbus_op(&array_iter, "NFSv3", optabv3[i].name,
+			      &alloc_st.v3[i]);
+	for (i = 0; i < NFS_V4_NB_COMMAND; i++)
+		alloc_dbus_op(&array_iter, "NFSv4", v4_proc_names[i],
+			      &alloc_st.v4[i]);
+	for (i = 0; i < NFS4_OP_LAST_ONE; i++)
+		alloc_dbus_op(&array_iter, "NFSv4 op", optabv4[i].name,
+			      &alloc_st.v4op[i]);
+	for (i = 0; i < MNT_V3_NB_COMMAND; i++)
+		alloc_dbus_op(&array_iter, "MNT", optmnt[i].name,
+			      &alloc_st.mnt[i]);
+	for (i = 0; i < NLM_V4_NB_OPERATION; i++)
+		alloc_dbus_op(&array_iter, "NLM", optnlm[i].name,
+			      &alloc_st.nlm[i]);
+	for (i = 0; i < RQUOTA_NB_COMMAND; i++)
+		alloc_dbus_op(&array_iter, "RQUOTA", optqta[i].name,
+			      &alloc_st.qta[i]);
+#endif
+	dbus_message_iter_close_container(iter, &array_iter);
+}
+
 void global_dbus_total_ops(DBusMessageIter *iter)
 {
 	struct timespec timestamp;
@@ -1801,6 +2323,10 @@ void server_dbus_delegations(struct deleg_stats *ds, DBusMessageIter *iter)
 {
 	struct timespec timestamp;
 	DBusMessageIter struct_iter;
+	double recall_ratio = 0.0;
+
+	if (ds->tot_grants != 0)
+		recall_ratio = (double) ds->tot_recalls / ds->tot_grants;
 
 	now(&timestamp);
 	dbus_append_timestamp(iter, &timestamp);
@@ -1814,11 +2340,385 @@ void server_dbus_delegations(struct deleg_stats *ds, DBusMessageIter *iter)
 				       &ds->failed_recalls);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
 				       &ds->num_revokes);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+				       &ds->tot_grants);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_DOUBLE,
+				       &recall_ratio);
 	dbus_message_iter_close_container(iter, &struct_iter);
 }
 
 #endif				/* USE_DBUS */
 
+/* Functions for rendering statistics as OpenMetrics
+ */
+
+/**
+ * @brief The proto_op counters reported for each scope
+ */
+
+struct op_family {
+	const char *name;
+	const char *help;
+	size_t off;		/*< In struct proto_op */
+	bool ns;		/*< Reported in seconds */
+};
+
+static const struct op_family op_families[] = {
+	{ "ops", "Requests", offsetof(struct proto_op, total), false },
+	{ "errors", "Requests that failed",
+	  offsetof(struct proto_op, errors), false },
+	{ "dups", "Retransmits answered from the DRC",
+	  offsetof(struct proto_op, dups), false },
+	{ "latency_seconds", "Time spent executing requests",
+	  offsetof(struct proto_op, latency.latency), true },
+	{ "queue_wait_seconds", "Time requests waited for a worker",
+	  offsetof(struct proto_op, queue_latency.latency), true },
+};
+
+#define N_OP_FAMILIES (sizeof(op_families) / sizeof(op_families[0]))
+
+static void metrics_op_value(struct metrics_buf *mb,
+			     const struct op_family *f, uint64_t v)
+{
+	if (f->ns)
+		metrics_printf(mb, " %.9f\n", v / 1e9);
+	else
+		metrics_printf(mb, " %" PRIu64 "\n", v);
+}
+
+/**
+ * @brief One protocol's counters in a gsh_stats
+ */
+
+struct stats_series {
+	const char *proto;
+	const char *kind;
+	struct proto_op *op;
+	struct xfer_op *io;	/*< Byte counts, or NULL */
+};
+
+#define STATS_SERIES_MAX 24
+
+static int stats_series_op(struct stats_series *s, int n, const char *proto,
+			   const char *kind, struct proto_op *op)
+{
+	s[n].proto = proto;
+	s[n].kind = kind;
+	s[n].op = op;
+	s[n].io = NULL;
+	return n + 1;
+}
+
+static int stats_series_io(struct stats_series *s, int n, const char *proto,
+			   struct xfer_op *read, struct xfer_op *write)
+{
+	n = stats_series_op(s, n, proto, "read", &read->cmd);
+	s[n - 1].io = read;
+	n = stats_series_op(s, n, proto, "write", &write->cmd);
+	s[n - 1].io = write;
+	return n;
+}
+
+/**
+ * @brief List the counters of the protocols a client or export used
+ *
+ * @param[in]  st Stats
+ * @param[out] s  Series, STATS_SERIES_MAX of them
+ *
+ * @return Number of series.
+ */
+
+static int stats_series(struct gsh_stats *st, struct stats_series *s)
+{
+	struct nfsv3_stats *v3 = atomic_fetch_voidptr((void **)&st->nfsv3);
+	struct mnt_stats *mnt = atomic_fetch_voidptr((void **)&st->mnt);
+	struct nlmv4_stats *nlm = atomic_fetch_voidptr((void **)&st->nlm4);
+	struct rquota_stats *qta = atomic_fetch_voidptr((void **)&st->rquota);
+	struct nfsv40_stats *v40 = atomic_fetch_voidptr((void **)&st->nfsv40);
+	struct nfsv41_stats *v41 = atomic_fetch_voidptr((void **)&st->nfsv41);
+	struct nfsv41_stats *v42 = atomic_fetch_voidptr((void **)&st->nfsv42);
+#ifdef _USE_9P
+	struct _9p_stats *_9p = atomic_fetch_voidptr((void **)&st->_9p);
+#endif
+	int n = 0;
+
+	if (v3 != NULL) {
+		n = stats_series_op(s, n, "nfsv3", "ops", &v3->cmds);
+		n = stats_series_io(s, n, "nfsv3", &v3->read, &v3->write);
+	}
+	if (mnt != NULL) {
+		n = stats_series_op(s, n, "mntv1", "ops", &mnt->v1_ops);
+		n = stats_series_op(s, n, "mntv3", "ops", &mnt->v3_ops);
+	}
+	if (nlm != NULL)
+		n = stats_series_op(s, n, "nlm4", "ops", &nlm->ops);
+	if (qta != NULL) {
+		n = stats_series_op(s, n, "rquota", "ops", &qta->ops);
+		n = stats_series_op(s, n, "rquota", "ext_ops", &qta->ext_ops);
+	}
+	if (v40 != NULL) {
+		n = stats_series_op(s, n, "nfsv40", "compounds",
+				    &v40->compounds);
+		n = stats_series_io(s, n, "nfsv40", &v40->read, &v40->write);
+	}
+	if (v41 != NULL) {
+		n = stats_series_op(s, n, "nfsv41", "compounds",
+				    &v41->compounds);
+		n = stats_series_io(s, n, "nfsv41", &v41->read, &v41->write);
+	}
+	if (v42 != NULL) {
+		n = stats_series_op(s, n, "nfsv42", "compounds",
+				    &v42->compounds);
+		n = stats_series_io(s, n, "nfsv42", &v42->read, &v42->write);
+	}
+#ifdef _USE_9P
+	if (_9p != NULL) {
+		n = stats_series_op(s, n, "9p", "ops", &_9p->cmds);
+		n = stats_series_io(s, n, "9p", &_9p->read, &_9p->write);
+	}
+#endif
+	return n;
+}
+
+/**
+ * @brief State of a walk of the exports or clients for one family
+ */
+
+struct metrics_walk {
+	struct metrics_buf *mb;
+	const char *scope;		/*< "export" or "client" */
+	const struct op_family *f;	/*< NULL for the byte counts */
+	bool requested;			/*< Bytes requested, not moved */
+};
+
+static void metrics_scope_stats(struct metrics_walk *w, const char *labels,
+				struct gsh_stats *st)
+{
+	struct stats_series s[STATS_SERIES_MAX];
+	uint64_t v;
+	int i, n;
+
+	n = stats_series(st, s);
+	for (i = 0; i < n; i++) {
+		if (w->f != NULL) {
+			v = atomic_fetch_uint64_t(
+				(uint64_t *)((char *)s[i].op + w->f->off));
+			metrics_printf(w->mb,
+				       "ganesha_%s_%s_total{%s,proto=\"%s\",kind=\"%s\"}",
+				       w->scope, w->f->name, labels,
+				       s[i].proto, s[i].kind);
+			metrics_op_value(w->mb, w->f, v);
+		} else if (s[i].io != NULL) {
+			v = atomic_fetch_uint64_t(w->requested
+						  ? &s[i].io->requested
+						  : &s[i].io->transferred);
+			metrics_printf(w->mb,
+				       "ganesha_%s_%s_total{%s,proto=\"%s\",dir=\"%s\"} %"
+				       PRIu64 "\n", w->scope,
+				       w->requested ? "requested_bytes"
+						    : "bytes",
+				       labels, s[i].proto, s[i].kind, v);
+		}
+	}
+}
+
+static bool metrics_export_cb(struct gsh_export *exp, void *state)
+{
+	struct export_stats *exp_st =
+		container_of(exp, struct export_stats, export);
+	char path[MAXPATHLEN * 2];
+	char labels[MAXPATHLEN * 2 + 64];
+
+	(void)metrics_escape(path, sizeof(path),
+			     exp->fullpath ? exp->fullpath : "");
+	(void)snprintf(labels, sizeof(labels),
+		       "export_id=\"%u\",path=\"%s\"", exp->export_id, path);
+	metrics_scope_stats(state, labels, &exp_st->st);
+	return true;
+}
+
+static bool metrics_client_cb(struct gsh_client *cl, void *state)
+{
+	struct server_stats *server_st =
+		container_of(cl, struct server_stats, client);
+	char labels[SOCK_NAME_MAX + 16];
+	char addr[SOCK_NAME_MAX];
+
+	(void)metrics_escape(addr, sizeof(addr),
+			     cl->hostaddr_str ? cl->hostaddr_str : "");
+	(void)snprintf(labels, sizeof(labels), "client=\"%s\"", addr);
+	metrics_scope_stats(state, labels, &server_st->st);
+	return true;
+}
+
+/**
+ * @brief Render the counters of every export or every client
+ *
+ * Each family takes one walk, as OpenMetrics wants a family's
+ * samples together.
+ */
+
+static void metrics_scope(struct metrics_buf *mb, const char *scope)
+{
+	struct metrics_walk w = { .mb = mb, .scope = scope };
+	char name[64], help[128];
+	unsigned int i;
+
+	for (i = 0; i <= N_OP_FAMILIES + 1; i++) {
+		if (i < N_OP_FAMILIES) {
+			w.f = &op_families[i];
+			(void)snprintf(name, sizeof(name), "ganesha_%s_%s",
+				       scope, w.f->name);
+			(void)snprintf(help, sizeof(help), "%s, per %s",
+				       w.f->help, scope);
+		} else {
+			w.f = NULL;
+			w.requested = i > N_OP_FAMILIES;
+			(void)snprintf(name, sizeof(name), "ganesha_%s_%s",
+				       scope, w.requested ? "requested_bytes"
+							  : "bytes");
+			(void)snprintf(help, sizeof(help), "%s, per %s",
+				       w.requested ? "Bytes requested"
+						   : "Bytes read or written",
+				       scope);
+		}
+		metrics_family(mb, name, "counter", help);
+		if (scope[0] == 'e')
+			(void)foreach_gsh_export(metrics_export_cb, &w);
+		else
+			(void)foreach_gsh_client(metrics_client_cb, &w);
+	}
+}
+
+/**
+ * @brief The global counters, one per protocol
+ */
+
+static const struct {
+	const char *proto;
+	size_t off;		/*< Of the proto_op, in struct global_stats */
+} global_series[] = {
+	{ "nfsv3", offsetof(struct global_stats, nfsv3.cmds) },
+	{ "nfsv40", offsetof(struct global_stats, nfsv40.compounds) },
+	{ "nfsv41", offsetof(struct global_stats, nfsv41.compounds) },
+	{ "nfsv42", offsetof(struct global_stats, nfsv42.compounds) },
+	{ "nlm4", offsetof(struct global_stats, nlm4.ops) },
+	{ "mntv1", offsetof(struct global_stats, mnt.v1_ops) },
+	{ "mntv3", offsetof(struct global_stats, mnt.v3_ops) },
+	{ "rquota", offsetof(struct global_stats, rquota.ops) },
+};
+
+#define N_GLOBAL_SERIES (sizeof(global_series) / sizeof(global_series[0]))
+
+static void metrics_global(struct metrics_buf *mb)
+{
+	const struct op_family *f;
+	char name[64];
+	uint64_t v;
+	unsigned int i, j;
+
+	for (i = 0; i < N_OP_FAMILIES; i++) {
+		f = &op_families[i];
+		(void)snprintf(name, sizeof(name), "ganesha_%s", f->name);
+		metrics_family(mb, name, "counter", f->help);
+		for (j = 0; j < N_GLOBAL_SERIES; j++) {
+			v = global_sum((uint64_t *)((char *)&global_st[0] +
+						    global_series[j].off +
+						    f->off));
+			metrics_printf(mb, "%s_total{proto=\"%s\"}", name,
+				       global_series[j].proto);
+			metrics_op_value(mb, f, v);
+		}
+	}
+}
+
+static void metrics_procs(struct metrics_buf *mb, const char *proto,
+			  const struct op_name *names, const uint64_t *ops,
+			  int count)
+{
+	uint64_t v;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (names[i].name == NULL)
+			continue;
+		v = global_sum(&ops[i]);
+		if (v == 0)
+			continue;
+		metrics_printf(mb,
+			       "ganesha_op_calls_total{proto=\"%s\",op=\"%s\"} %"
+			       PRIu64 "\n", proto, names[i].name, v);
+	}
+}
+
+static void latency_metrics_op(struct metrics_buf *mb, const char *prog,
+			       const char *op, struct gsh_histogram *hists)
+{
+	char labels[128];
+	int stage;
+
+	if (op == NULL)
+		return;
+
+	for (stage = 0; stage < STAGE_COUNT; stage++) {
+		if (atomic_fetch_uint64_t(&hists[stage].count) == 0)
+			continue;
+		(void)snprintf(labels, sizeof(labels),
+			       "proto=\"%s\",op=\"%s\",stage=\"%s\"",
+			       prog, op, stage_names[stage]);
+		metrics_histogram(mb, "ganesha_request_stage_seconds", labels,
+				  &hists[stage]);
+	}
+}
+
+/**
+ * @brief Render the server statistics
+ *
+ * The global counters by protocol, the calls of each operation,
+ * the counters of each export and client and the latency histograms.
+ */
+
+void server_stats_metrics(struct metrics_buf *mb)
+{
+	int i;
+
+	metrics_global(mb);
+
+	metrics_family(mb, "ganesha_op_calls", "counter",
+		       "Calls of each operation");
+	metrics_procs(mb, "nfsv3", optabv3, global_st[0].v3.op,
+		      NFSPROC3_COMMIT + 1);
+	metrics_procs(mb, "nfsv4", optabv4, global_st[0].v4.op,
+		      NFS4_OP_LAST_ONE);
+	metrics_procs(mb, "nlm4", optnlm, global_st[0].lm.op,
+		      NLMPROC4_FREE_ALL + 1);
+	metrics_procs(mb, "mnt", optmnt, global_st[0].mn.op,
+		      MOUNTPROC3_EXPORT + 1);
+	metrics_procs(mb, "rquota", optqta, global_st[0].qt.op,
+		      RQUOTAPROC_SETACTIVEQUOTA + 1);
+
+	metrics_scope(mb, "export");
+	metrics_scope(mb, "client");
+
+	metrics_family(mb, "ganesha_request_stage_seconds", "histogram",
+		       "Time requests spent in each stage");
+	for (i = 0; i < NFS_V3_NB_COMMAND; i++)
+		latency_metrics_op(mb, "nfsv3", optabv3[i].name,
+				   latency_st.v3[i]);
+	for (i = 0; i < NFS_V4_NB_COMMAND; i++)
+		latency_metrics_op(mb, "nfsv4", v4_proc_names[i],
+				   latency_st.v4[i]);
+	for (i = 0; i < MNT_V3_NB_COMMAND; i++)
+		latency_metrics_op(mb, "mnt", optmnt[i].name,
+				   latency_st.mnt[i]);
+	for (i = 0; i < NLM_V4_NB_OPERATION; i++)
+		latency_metrics_op(mb, "nlm4", optnlm[i].name,
+				   latency_st.nlm[i]);
+	for (i = 0; i < RQUOTA_NB_COMMAND; i++)
+		latency_metrics_op(mb, "rquota", optqta[i].name,
+				   latency_st.qta[i]);
+}
+
 /**
  * @brief Free statistics storage
  *
@@ -0,0 +1,287 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file slab.c
+ * @brief Fixed size object pool carved from aligned slabs
+ *
+ * See @ref SlabPool.
+ */
+
+#include "config.h"
+#include <pthread.h>
+#include <string.h>
+#include "log.h"
+#include "common_utils.h"
+#include "gsh_list.h"
+#include "gsh_intrinsic.h"
+#include "abstract_mem.h"
+#include "gsh_numa.h"
+
+struct slab_link {
+	struct slab_link *next;
+};
+
+struct slab {
+	struct glist_head list;	/*< On the pool's partial or full list */
+	struct slab_link *free;	/*< Free objects in this slab */
+	uint32_t inuse;		/*< Objects allocated from this slab */
+};
+
+struct slab_pool {
+	char *name;
+	pthread_mutex_t mtx;
+	size_t object_size;	/*< Stride, a multiple of the cache line */
+	size_t first;		/*< Offset of the first object in a slab */
+	uint32_t per_slab;	/*< Objects in each slab */
+	uint32_t node;		/*< NUMA node of the slabs, or
+				    GSH_NUMA_NODE_ANY */
+	struct glist_head partial;	/*< Slabs with free objects */
+	struct glist_head full;	/*< Slabs with none */
+	struct slab *spare;	/*< An empty slab kept back */
+	struct slab_pool_stats stats;
+};
+
+static inline struct slab *slab_of(void *object)
+{
+	uintptr_t mask = ~((uintptr_t) SLAB_SIZE - 1);
+
+	return (struct slab *)((uintptr_t) object & mask);
+}
+
+/**
+ * @brief Set up a new slab with every object free
+ */
+static struct slab *slab_create(slab_pool_t *pool)
+{
+	struct slab *slab;
+	struct slab_link *link;
+	char *object;
+	uint32_t ix;
+
+	if (pool->node == GSH_NUMA_NODE_ANY)
+		slab = gsh_malloc_aligned(SLAB_SIZE, SLAB_SIZE);
+	else
+		slab = gsh_numa_alloc_aligned(SLAB_SIZE, SLAB_SIZE,
+					      pool->node);
+
+	slab->free = NULL;
+	slab->inuse = 0;
+
+	/* Chain in reverse so objects are handed out in address order */
+	object = (char *)slab + pool->first +
+		 (size_t) (pool->per_slab - 1) * pool->object_size;
+	for (ix = 0; ix < pool->per_slab; ++ix) {
+		link = (struct slab_link *)object;
+		link->next = slab->free;
+		slab->free = link;
+		object -= pool->object_size;
+	}
+
+	pool->stats.slabs++;
+	pool->stats.slab_allocs++;
+	return slab;
+}
+
+/**
+ * @brief Create a slab pool
+ *
+ * @param[in] name         Name used in log messages
+ * @param[in] object_size  Size of each object
+ *
+ * @return The new pool.
+ */
+slab_pool_t *slab_pool_init(const char *name, size_t object_size)
+{
+	return slab_pool_init_node(name, object_size, GSH_NUMA_NODE_ANY);
+}
+
+/**
+ * @brief Create a slab pool whose slabs are on a NUMA node
+ *
+ * @param[in] name         Name used in log messages
+ * @param[in] object_size  Size of each object
+ * @param[in] node         Node, GSH_NUMA_NODE_ANY for no placement
+ *
+ * @return The new pool.
+ */
+slab_pool_t *slab_pool_init_node(const char *name, size_t object_size,
+				 uint32_t node)
+{
+	slab_pool_t *pool = gsh_calloc(1, sizeof(*pool));
+	size_t line = GSH_CACHE_LINE_SIZE;
+
+	if (object_size < sizeof(struct slab_link))
+		object_size = sizeof(struct slab_link);
+
+	pool->name = gsh_strdup(name);
+	pool->object_size = (object_size + line - 1) & ~(line - 1);
+	pool->first = (sizeof(struct slab) + line - 1) & ~(line - 1);
+
+	if (pool->first + pool->object_size > SLAB_SIZE) {
+		LogFatal(COMPONENT_INIT,
+			 "Objects of %zu bytes are too large for slab pool %s",
+			 object_size, name);
+	}
+
+	pool->per_slab = (SLAB_SIZE - pool->first) / pool->object_size;
+	pool->node = node;
+	pool->stats.object_size = pool->object_size;
+
+	PTHREAD_MUTEX_init(&pool->mtx, NULL);
+	glist_init(&pool->partial);
+	glist_init(&pool->full);
+
+	LogDebug(COMPONENT_INIT,
+		 "Slab pool %s holds %"PRIu32" objects of %zu bytes per slab",
+		 name, pool->per_slab, pool->object_size);
+
+	return pool;
+}
+
+/**
+ * @brief Destroy a slab pool
+ *
+ * Every object must already have been freed; any slab still holding
+ * objects is leaked rather than pulled out from under its users.
+ *
+ * @param[in] pool  The pool
+ */
+void slab_pool_destroy(slab_pool_t *pool)
+{
+	if (pool == NULL)
+		return;
+
+	if (!glist_empty(&pool->partial) || !glist_empty(&pool->full)) {
+		LogWarn(COMPONENT_INIT,
+			"Slab pool %s destroyed with %"PRIu64" objects in use",
+			pool->name, pool->stats.objects);
+	}
+
+	gsh_free(pool->spare);
+	PTHREAD_MUTEX_destroy(&pool->mtx);
+	gsh_free(pool->name);
+	gsh_free(pool);
+}
+
+/**
+ * @brief Allocate a zeroed object
+ *
+ * @param[in] pool  The pool
+ *
+ * @return The object.
+ */
+void *slab_alloc(slab_pool_t *pool)
+{
+	struct slab *slab;
+	struct slab_link *link;
+
+	PTHREAD_MUTEX_lock(&pool->mtx);
+
+	slab = glist_first_entry(&pool->partial, struct slab, list);
+	if (slab == NULL) {
+		if (pool->spare != NULL) {
+			slab = pool->spare;
+			pool->spare = NULL;
+		} else {
+			slab = slab_create(pool);
+		}
+		glist_add(&pool->partial, &slab->list);
+	}
+
+	link = slab->free;
+	slab->free = link->next;
+	slab->inuse++;
+
+	if (slab->free == NULL) {
+		glist_del(&slab->list);
+		glist_add(&pool->full, &slab->list);
+	}
+
+	pool->stats.objects++;
+	pool->stats.allocs++;
+
+	PTHREAD_MUTEX_unlock(&pool->mtx);
+
+	memset(link, 0, pool->object_size);
+	return link;
+}
+
+/**
+ * @brief Return an object to its pool
+ *
+ * @param[in] pool    The pool it was allocated from
+ * @param[in] object  The object
+ */
+void slab_free(slab_pool_t *pool, void *object)
+{
+	struct slab *slab = slab_of(object);
+	struct slab_link *link = object;
+	struct slab *release = NULL;
+
+	PTHREAD_MUTEX_lock(&pool->mtx);
+
+	if (slab->free == NULL) {
+		/* Coming off the full list; it goes behind the partial
+		 * slabs so they fill up before this one does.
+		 */
+		glist_del(&slab->list);
+		glist_add_tail(&pool->partial, &slab->list);
+	}
+
+	link->next = slab->free;
+	slab->free = link;
+	slab->inuse--;
+	pool->stats.objects--;
+
+	if (slab->inuse == 0) {
+		glist_del(&slab->list);
+		if (pool->spare == NULL) {
+			pool->spare = slab;
+		} else {
+			release = slab;
+			pool->stats.slabs--;
+			pool->stats.slab_releases++;
+		}
+	}
+
+	PTHREAD_MUTEX_unlock(&pool->mtx);
+
+	gsh_free(release);
+}
+
+/**
+ * @brief Snapshot a slab pool's statistics
+ *
+ * @param[in]  pool   The pool, may be NULL
+ * @param[out] stats  The statistics
+ */
+void slab_pool_stats(slab_pool_t *pool, struct slab_pool_stats *stats)
+{
+	if (pool == NULL) {
+		memset(stats, 0, sizeof(*stats));
+		return;
+	}
+
+	PTHREAD_MUTEX_lock(&pool->mtx);
+	*stats = pool->stats;
+	PTHREAD_MUTEX_unlock(&pool->mtx);
+}
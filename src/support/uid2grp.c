@@ -45,6 +45,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "common_utils.h"
+#include "fridgethr.h"
 #include "uid2grp.h"
 
 /* group_data has a reference counter. If it goes to zero, it implies
@@ -345,4 +346,372 @@ void uid2grp_unref(struct group_data *gdata)
 	uid2grp_release_group_data(gdata);
 }
 
+/* With Manage_Gids_Preload, the password and group databases are
+ * enumerated once per pass and inverted into the groups of each user,
+ * instead of asking NSS for them one user at a time as clients show
+ * up.  Each pass stamps the entries that did not change and replaces
+ * those that did, so the cache never sees a preloaded user expire.
+ * Users the enumeration does not return are looked up as before.
+ */
+
+/** Users folded into the cache per hold of uid2grp_user_lock */
+#define UID2GRP_PRELOAD_BATCH 256
+
+/** Largest NSS entry we make room for */
+#define UID2GRP_PRELOAD_MAX_BUFF (16 * 1024 * 1024)
+
+/**
+ * @brief A user found enumerating the password database
+ */
+struct preload_user {
+	char *name;
+	uid_t uid;
+	/** Position in the enumeration, the first of a name wins */
+	size_t order;
+	int nbgroups;
+	int maxgroups;
+	/** Primary group first, as getgrouplist() does */
+	gid_t *groups;
+};
+
+static struct fridgethr *uid2grp_fridge;
+
+static int preload_user_cmp(const void *a, const void *b)
+{
+	const struct preload_user *ua = a;
+	const struct preload_user *ub = b;
+	int rc = strcmp(ua->name, ub->name);
+
+	if (rc != 0)
+		return rc;
+
+	return ua->order < ub->order ? -1 : ua->order > ub->order;
+}
+
+static int preload_name_cmp(const void *key, const void *elt)
+{
+	return strcmp(key, ((const struct preload_user *)elt)->name);
+}
+
+static int preload_gid_cmp(const void *a, const void *b)
+{
+	gid_t ga = *(const gid_t *)a;
+	gid_t gb = *(const gid_t *)b;
+
+	return ga < gb ? -1 : ga > gb;
+}
+
+static void preload_add_gid(struct preload_user *user, gid_t gid)
+{
+	if (user->nbgroups == user->maxgroups) {
+		user->maxgroups *= 2;
+		user->groups = gsh_realloc(user->groups,
+					   user->maxgroups * sizeof(gid_t));
+	}
+	user->groups[user->nbgroups++] = gid;
+}
+
+/**
+ * @brief Make room for a larger NSS entry after ERANGE
+ *
+ * @return false if the entry is larger than we are willing to hold.
+ */
+static bool preload_grow(char **buff, size_t *buff_size)
+{
+	if (*buff_size >= UID2GRP_PRELOAD_MAX_BUFF)
+		return false;
+
+	*buff_size *= 2;
+	*buff = gsh_realloc(*buff, *buff_size);
+	return true;
+}
+
+/**
+ * @brief Enumerate the password database
+ *
+ * @param[out] count  Number of users returned
+ *
+ * @return Users sorted by name, one per name.
+ */
+static struct preload_user *preload_users(size_t *count)
+{
+	size_t buff_size = 1024;
+	char *buff = gsh_malloc(buff_size);
+	struct preload_user *users = NULL;
+	size_t nusers = 0, maxusers = 0, i, j;
+	struct passwd p;
+	struct passwd *pp;
+	int rc;
+
+	setpwent();
+	for (;;) {
+		rc = getpwent_r(&p, buff, buff_size, &pp);
+		if (rc == ERANGE && preload_grow(&buff, &buff_size))
+			continue;
+		if (rc != 0 || pp == NULL) {
+			if (rc != 0 && rc != ENOENT)
+				LogWarn(COMPONENT_IDMAPPER,
+					"getpwent_r failed after %zu users, error %d",
+					nusers, rc);
+			break;
+		}
+
+		if (nusers == maxusers) {
+			maxusers = maxusers ? maxusers * 2 : 1024;
+			users = gsh_realloc(users, maxusers * sizeof(*users));
+		}
+		users[nusers].name = gsh_strdup(p.pw_name);
+		users[nusers].uid = p.pw_uid;
+		users[nusers].order = nusers;
+		users[nusers].nbgroups = 1;
+		users[nusers].maxgroups = 8;
+		users[nusers].groups = gsh_malloc(8 * sizeof(gid_t));
+		users[nusers].groups[0] = p.pw_gid;
+		nusers++;
+	}
+	endpwent();
+	gsh_free(buff);
+
+	if (nusers == 0) {
+		*count = 0;
+		return users;
+	}
+
+	/* Several NSS sources may return the same name, getpwnam()
+	 * would have answered with the first.
+	 */
+	qsort(users, nusers, sizeof(*users), preload_user_cmp);
+	for (i = 0, j = 1; j < nusers; j++) {
+		if (strcmp(users[i].name, users[j].name) == 0) {
+			gsh_free(users[j].name);
+			gsh_free(users[j].groups);
+		} else {
+			users[++i] = users[j];
+		}
+	}
+
+	*count = i + 1;
+	return users;
+}
+
+/**
+ * @brief Enumerate the group database into the groups of each user
+ *
+ * @param[in,out] users   Users sorted by name
+ * @param[in]     nusers  Number of users
+ */
+static void preload_groups(struct preload_user *users, size_t nusers)
+{
+	size_t buff_size = 4096;
+	char *buff = gsh_malloc(buff_size);
+	struct preload_user *user;
+	struct group g;
+	struct group *gp;
+	char **mem;
+	size_t i;
+	int rc;
+
+	setgrent();
+	for (;;) {
+		rc = getgrent_r(&g, buff, buff_size, &gp);
+		if (rc == ERANGE && preload_grow(&buff, &buff_size))
+			continue;
+		if (rc != 0 || gp == NULL) {
+			if (rc != 0 && rc != ENOENT)
+				LogWarn(COMPONENT_IDMAPPER,
+					"getgrent_r failed, error %d", rc);
+			break;
+		}
+
+		for (mem = g.gr_mem; *mem != NULL; mem++) {
+			user = bsearch(*mem, users, nusers, sizeof(*users),
+				       preload_name_cmp);
+			if (user != NULL && g.gr_gid != user->groups[0])
+				preload_add_gid(user, g.gr_gid);
+		}
+	}
+	endgrent();
+	gsh_free(buff);
+
+	/* The same group may come from several NSS sources */
+	for (i = 0; i < nusers; i++) {
+		int n = users[i].nbgroups, k, m;
+		gid_t *groups = users[i].groups;
+
+		if (n < 3)
+			continue;
+
+		qsort(groups + 1, n - 1, sizeof(gid_t), preload_gid_cmp);
+		for (k = 1, m = 2; m < n; m++) {
+			if (groups[m] != groups[k])
+				groups[++k] = groups[m];
+		}
+		users[i].nbgroups = k + 1;
+	}
+}
+
+/**
+ * @brief Fold a preloaded user into the cache
+ *
+ * @note The caller must hold uid2grp_user_lock for write.
+ *
+ * @param[in,out] user  The user, its groups go to the cache if it changed
+ * @param[in]     now   Time of this pass
+ *
+ * @return true if the cache entry was added or replaced.
+ */
+static bool preload_fold(struct preload_user *user, time_t now)
+{
+	struct group_data *gdata;
+	size_t len = strlen(user->name);
+
+	if (uid2grp_lookup_by_uid(user->uid, &gdata) &&
+	    gdata->uname.len == len &&
+	    memcmp(gdata->uname.addr, user->name, len) == 0 &&
+	    gdata->gid == user->groups[0] &&
+	    gdata->nbgroups == user->nbgroups &&
+	    memcmp(gdata->groups, user->groups,
+		   user->nbgroups * sizeof(gid_t)) == 0) {
+		gdata->epoch = now;
+		return false;
+	}
+
+	gdata = gsh_malloc(sizeof(struct group_data) + len);
+
+	gdata->uname.len = len;
+	gdata->uname.addr = (char *)gdata + sizeof(struct group_data);
+	memcpy(gdata->uname.addr, user->name, len);
+	gdata->uid = user->uid;
+	gdata->gid = user->groups[0];
+	gdata->groups = user->groups;
+	gdata->nbgroups = user->nbgroups;
+	user->groups = NULL;
+
+	PTHREAD_MUTEX_init(&gdata->lock, NULL);
+	gdata->epoch = now;
+	gdata->refcount = 0;
+
+	uid2grp_add_user(gdata);
+	return true;
+}
+
+/**
+ * @brief One pass of the uid2grp preload
+ *
+ * @param[in] ctx  Fridge thread context
+ */
+static void uid2grp_preload_run(struct fridgethr_context *ctx)
+{
+	struct preload_user *users;
+	size_t nusers, changed = 0, i;
+	struct timespec start, end;
+	time_t pass;
+
+	SetNameFunction("uid2grp");
+
+	now(&start);
+	pass = time(NULL);
+
+	users = preload_users(&nusers);
+	preload_groups(users, nusers);
+
+	for (i = 0; i < nusers; i++) {
+		if (i % UID2GRP_PRELOAD_BATCH == 0) {
+			/* Let the workers at the cache between batches */
+			if (i != 0)
+				PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
+			if (fridgethr_you_should_break(ctx))
+				break;
+			PTHREAD_RWLOCK_wrlock(&uid2grp_user_lock);
+		}
+
+		if (preload_fold(&users[i], pass))
+			changed++;
+	}
+	if (i == nusers && nusers != 0)
+		PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
+
+	for (i = 0; i < nusers; i++) {
+		gsh_free(users[i].name);
+		gsh_free(users[i].groups);
+	}
+	gsh_free(users);
+
+	now(&end);
+	LogInfo(COMPONENT_IDMAPPER,
+		"Preloaded groups of %zu users, %zu changed, in %" PRIu64 " ms",
+		nusers, changed, timespec_diff(&start, &end) / NS_PER_MSEC);
+}
+
+/**
+ * @brief Start preloading the uid2grp cache
+ *
+ * Does nothing unless Manage_Gids_Preload is set.
+ *
+ * @return 0 or an error from the fridge.
+ */
+int uid2grp_preload_init(void)
+{
+	time_t expiration = nfs_param.core_param.manage_gids_expiration;
+	struct fridgethr_params frp;
+	int rc;
+
+	if (!nfs_param.core_param.manage_gids_preload)
+		return 0;
+
+	if (expiration == 0) {
+		LogWarn(COMPONENT_IDMAPPER,
+			"Manage_Gids_Preload has no effect when Manage_Gids_Expiration is 0");
+		return 0;
+	}
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = 1;
+	frp.thr_min = 1;
+	frp.thread_delay = MAX(expiration / 2, 1);
+	frp.flavor = fridgethr_flavor_looper;
+
+	rc = fridgethr_init(&uid2grp_fridge, "uid2grp", &frp);
+	if (rc != 0) {
+		LogMajor(COMPONENT_IDMAPPER,
+			 "Unable to initialize uid2grp preload fridge, error code %d.",
+			 rc);
+		return rc;
+	}
+
+	rc = fridgethr_submit(uid2grp_fridge, uid2grp_preload_run, NULL);
+	if (rc != 0)
+		LogMajor(COMPONENT_IDMAPPER,
+			 "Unable to start uid2grp preload thread, error code %d.",
+			 rc);
+
+	return rc;
+}
+
+/**
+ * @brief Stop preloading the uid2grp cache
+ *
+ * @return 0 or an error from the fridge.
+ */
+int uid2grp_preload_shutdown(void)
+{
+	int rc;
+
+	if (uid2grp_fridge == NULL)
+		return 0;
+
+	rc = fridgethr_sync_command(uid2grp_fridge, fridgethr_comm_stop, 120);
+
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_IDMAPPER,
+			 "Shutdown timed out, cancelling threads.");
+		fridgethr_cancel(uid2grp_fridge);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_IDMAPPER,
+			 "Failed shutting down uid2grp preload thread: %d", rc);
+	}
+
+	return rc;
+}
+
 /** @} */
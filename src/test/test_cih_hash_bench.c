@@ -0,0 +1,282 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file test_cih_hash_bench.c
+ * @brief Compare the mdcache handle lookup tables
+ *
+ * Fills partitioned tables with N random 32 byte handles, hashed and
+ * compared the way mdcache_hash.h does it, then times inserts, hits,
+ * misses and removes against the AVL trees with their direct-mapped
+ * caches and against the open-addressing tables.  Single threaded, so
+ * only the table is measured, not the partition locks.
+ *
+ * Usage: test_cih_hash_bench [-n entries] [-l lookups] [-p partitions]
+ *			      [-c cache slots]
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "avltree.h"
+#include "city.h"
+#include "gsh_oa_hash.h"
+
+/* This function is dragged in by the use of abstract_mem.h, so
+ * we define a simple version that does a printf rather than
+ * pull in the entirety of log_functions.c into this standalone
+ * program.
+ */
+void LogMallocFailure(const char *file, int line, const char *function,
+		      const char *allocator)
+{
+	printf("Aborting %s due to out of memory", allocator);
+}
+
+#define FH_LEN 32
+
+struct key {
+	uint64_t hk;
+	size_t len;
+	char *addr;
+};
+
+struct entry {
+	struct key key;
+	struct avltree_node node_k;
+};
+
+struct partition {
+	struct avltree t;
+	struct avltree_node **cache;
+	struct gsh_oa_hash oa;
+};
+
+static struct partition *parts;
+static struct entry *entries;
+static struct key *misses;
+
+static uint32_t n_entries = 1000000;
+static uint32_t n_lookups = 10000000;
+static uint32_t n_parts = 7;
+static uint32_t cache_sz = 32633;
+
+static int key_cmp(const struct key *k1, const struct key *k2)
+{
+	if (k1->hk != k2->hk)
+		return (k1->hk < k2->hk) ? -1 : 1;
+	if (k1->len != k2->len)
+		return (k1->len < k2->len) ? -1 : 1;
+	return memcmp(k1->addr, k2->addr, k1->len);
+}
+
+static int avl_cmpf(const struct avltree_node *lhs,
+		    const struct avltree_node *rhs)
+{
+	return key_cmp(&avltree_container_of(lhs, struct entry, node_k)->key,
+		       &avltree_container_of(rhs, struct entry, node_k)->key);
+}
+
+static bool oa_match(const void *item, const void *key)
+{
+	return key_cmp(&((const struct entry *)item)->key, key) == 0;
+}
+
+static void make_key(struct key *key)
+{
+	uint32_t ix;
+
+	key->len = FH_LEN;
+	key->addr = malloc(FH_LEN);
+	for (ix = 0; ix < FH_LEN; ++ix)
+		key->addr[ix] = random();
+	key->hk = CityHash64WithSeed(key->addr, key->len, 557);
+}
+
+static struct partition *part_of(const struct key *key)
+{
+	return &parts[key->hk % n_parts];
+}
+
+/* As cih_get_by_key_latch() */
+static struct entry *avl_lookup(struct key *key)
+{
+	struct partition *p = part_of(key);
+	struct avltree_node **slot = &p->cache[key->hk % cache_sz];
+	struct entry k_entry = { .key = *key };
+	struct avltree_node *node;
+
+	if (*slot && avl_cmpf(&k_entry.node_k, *slot) == 0)
+		return avltree_container_of(*slot, struct entry, node_k);
+
+	node = avltree_lookup(&k_entry.node_k, &p->t);
+	if (!node)
+		return NULL;
+	*slot = node;
+	return avltree_container_of(node, struct entry, node_k);
+}
+
+static struct entry *oa_lookup(struct key *key)
+{
+	return gsh_oa_lookup(&part_of(key)->oa, key->hk, oa_match, key);
+}
+
+static double elapsed(struct timespec *start)
+{
+	struct timespec end;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return ((end.tv_sec - start->tv_sec) * 1e9 +
+		(end.tv_nsec - start->tv_nsec));
+}
+
+static void run(bool oa)
+{
+	struct timespec start;
+	struct partition *p;
+	struct entry *e;
+	uint32_t ix, found = 0;
+
+	for (ix = 0; ix < n_parts; ++ix) {
+		if (oa) {
+			gsh_oa_init(&parts[ix].oa, n_entries / n_parts);
+		} else {
+			avltree_init(&parts[ix].t, avl_cmpf, 0);
+			parts[ix].cache = calloc(cache_sz,
+						 sizeof(struct avltree_node *));
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (ix = 0; ix < n_entries; ++ix) {
+		e = &entries[ix];
+		p = part_of(&e->key);
+		if (oa)
+			gsh_oa_insert(&p->oa, e->key.hk, e);
+		else
+			(void) avltree_insert(&e->node_k, &p->t);
+	}
+	printf("%-5s insert %8.1f ns/op\n", oa ? "oa" : "avl",
+	       elapsed(&start) / n_entries);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (ix = 0; ix < n_lookups; ++ix) {
+		e = &entries[random() % n_entries];
+		if ((oa ? oa_lookup(&e->key) : avl_lookup(&e->key)) == e)
+			++found;
+	}
+	printf("%-5s hit    %8.1f ns/op\n", oa ? "oa" : "avl",
+	       elapsed(&start) / n_lookups);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (ix = 0; ix < n_lookups; ++ix) {
+		if ((oa ? oa_lookup(&misses[ix % n_entries])
+			: avl_lookup(&misses[ix % n_entries])) != NULL)
+			--found;
+	}
+	printf("%-5s miss   %8.1f ns/op\n", oa ? "oa" : "avl",
+	       elapsed(&start) / n_lookups);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (ix = 0; ix < n_entries; ++ix) {
+		e = &entries[ix];
+		p = part_of(&e->key);
+		if (oa) {
+			(void) gsh_oa_remove(&p->oa, e->key.hk, e);
+		} else {
+			avltree_remove(&e->node_k, &p->t);
+			p->cache[e->key.hk % cache_sz] = NULL;
+		}
+	}
+	printf("%-5s remove %8.1f ns/op\n", oa ? "oa" : "avl",
+	       elapsed(&start) / n_entries);
+
+	if (found != n_lookups)
+		fprintf(stderr,
+			"%s: %" PRIu32 " of %" PRIu32 " lookups wrong\n",
+			oa ? "oa" : "avl", n_lookups - found, n_lookups);
+
+	for (ix = 0; ix < n_parts; ++ix) {
+		if (oa)
+			gsh_oa_destroy(&parts[ix].oa);
+		else
+			free(parts[ix].cache);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t ix;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:l:p:c:")) != -1) {
+		switch (opt) {
+		case 'n':
+			n_entries = atoi(optarg);
+			break;
+		case 'l':
+			n_lookups = atoi(optarg);
+			break;
+		case 'p':
+			n_parts = atoi(optarg);
+			break;
+		case 'c':
+			cache_sz = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr,
+				"Usage: %s [-n entries] [-l lookups] [-p partitions] [-c cache slots]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	if (n_entries == 0 || n_parts == 0 || cache_sz == 0) {
+		fprintf(stderr, "%s: counts must be positive\n", argv[0]);
+		return 1;
+	}
+
+	parts = calloc(n_parts, sizeof(struct partition));
+	entries = calloc(n_entries, sizeof(struct entry));
+	misses = calloc(n_entries, sizeof(struct key));
+	for (ix = 0; ix < n_entries; ++ix) {
+		make_key(&entries[ix].key);
+		make_key(&misses[ix]);
+	}
+
+	printf("%" PRIu32 " entries, %" PRIu32 " partitions, %" PRIu32
+	       " cache slots\n", n_entries, n_parts, cache_sz);
+	run(false);
+	run(true);
+
+	for (ix = 0; ix < n_entries; ++ix) {
+		free(entries[ix].key.addr);
+		free(misses[ix].addr);
+	}
+	free(misses);
+	free(entries);
+	free(parts);
+
+	return 0;
+}
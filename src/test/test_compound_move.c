@@ -0,0 +1,124 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file test_compound_move.c
+ * @brief Check the filehandles of a suspended COMPOUND
+ *
+ * nfs4_Compound moves the compound data off the worker's stack when an
+ * op suspends for its I/O.  The op is suspended here with PUTFH and
+ * SAVEFH done, the worker's frame is then reused, and the filehandles
+ * are checked as nfs4_compound_resume would find them.  The frame is
+ * kept on the heap so that reusing it is not optimized away.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sal_data.h"
+#include "nfs_proto_data.h"
+
+static int failures;
+
+static void check(bool ok, const char *what)
+{
+	if (!ok) {
+		printf("FAIL: %s\n", what);
+		failures++;
+	}
+}
+
+static void put_fh(nfs_fh4 *fh, char fill, unsigned int len)
+{
+	memset(fh->nfs_fh4_val, fill, len);
+	fh->nfs_fh4_len = len;
+}
+
+static bool fh_is(const nfs_fh4 *fh, char fill, unsigned int len)
+{
+	unsigned int i;
+
+	if (fh->nfs_fh4_len != len)
+		return false;
+
+	for (i = 0; i < len; i++)
+		if (fh->nfs_fh4_val[i] != fill)
+			return false;
+
+	return true;
+}
+
+/* What the worker does up to the suspension, in its own frame */
+static compound_data_t *suspend(compound_data_t *frame)
+{
+	compound_data_t *moved;
+
+	memset(frame, 0, sizeof(*frame));
+	compound_data_init_fh(frame);
+
+	/* PUTFH; SAVEFH; PUTFH; READ, and READ is suspended */
+	put_fh(&frame->currentFH, 's', 40);
+	memcpy(frame->savedFH.nfs_fh4_val, frame->currentFH.nfs_fh4_val,
+	       frame->currentFH.nfs_fh4_len);
+	frame->savedFH.nfs_fh4_len = frame->currentFH.nfs_fh4_len;
+	put_fh(&frame->currentFH, 'c', 28);
+	frame->oppos = 3;
+	frame->async_pending = true;
+
+	moved = malloc(sizeof(*moved));
+	compound_data_move(moved, frame);
+
+	return moved;
+}
+
+int main(int argc, char *argv[])
+{
+	compound_data_t *frame = malloc(sizeof(*frame));
+	compound_data_t *data = suspend(frame);
+
+	/* The worker is gone, and its frame goes to the next request */
+	memset(frame, 0xa5, sizeof(*frame));
+
+	/* What nfs4_compound_resume goes on with */
+	check(data->currentFH.nfs_fh4_val == data->currentFH_buf,
+	      "currentFH points into the moved data");
+	check(data->savedFH.nfs_fh4_val == data->savedFH_buf,
+	      "savedFH points into the moved data");
+	check(fh_is(&data->currentFH, 'c', 28), "currentFH kept");
+	check(fh_is(&data->savedFH, 's', 40), "savedFH kept");
+	check(data->oppos == 3 && data->async_pending, "op position kept");
+
+	/* RESTOREFH after the resume */
+	memcpy(data->currentFH.nfs_fh4_val, data->savedFH.nfs_fh4_val,
+	       data->savedFH.nfs_fh4_len);
+	data->currentFH.nfs_fh4_len = data->savedFH.nfs_fh4_len;
+	check(fh_is(&data->currentFH, 's', 40), "RESTOREFH after resume");
+
+	free(data);
+	free(frame);
+
+	if (failures != 0)
+		return 1;
+
+	printf("PASS\n");
+	return 0;
+}
@@ -0,0 +1,424 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file test_drc_table_bench.c
+ * @brief Compare the per-connection DRC layouts
+ *
+ * T threads share one connection's DRC and each runs R requests through
+ * what nfs_dupreq_start and nfs_dupreq_finish do to it: look the XID
+ * up, insert it if new, and retire one request once above the high
+ * water mark.  A share of the requests retransmit a recent XID.
+ *
+ * The partitioned layout locks a partition for the lookup and the DRC
+ * for its FIFO, and retires the oldest request.  AVL trees with
+ * direct-mapped caches stand in for the rbtree_x of libntirpc.  The
+ * table layout does everything under the DRC lock in one gsh_oa table
+ * and retires by CLOCK over the same FIFO, giving a replayed request a
+ * second pass.  Both should serve about as many replays.
+ *
+ * Usage: test_drc_table_bench [-t threads] [-r requests] [-s size]
+ *			       [-w hiwat] [-d retransmit percent]
+ *			       [-p partitions]
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include "abstract_atomic.h"
+#include "avltree.h"
+#include "gsh_oa_hash.h"
+
+/* This function is dragged in by the use of abstract_mem.h, so
+ * we define a simple version that does a printf rather than
+ * pull in the entirety of log_functions.c into this standalone
+ * program.
+ */
+void LogMallocFailure(const char *file, int line, const char *function,
+		      const char *allocator)
+{
+	printf("Aborting %s due to out of memory", allocator);
+}
+
+#define CACHE_SZ 127
+
+struct dupreq {
+	uint32_t xid;
+	uint64_t hk;
+	uint32_t refcnt;
+	bool referenced;
+	struct avltree_node node_k;
+	struct dupreq *next;	/* FIFO */
+};
+
+struct partition {
+	pthread_mutex_t mtx;
+	struct avltree t;
+	struct avltree_node *cache[CACHE_SZ];
+};
+
+static struct {
+	pthread_mutex_t mtx;
+	struct partition *parts;
+	struct dupreq *head, *tail;
+	struct gsh_oa_hash xid_t;
+	uint32_t size;
+} drc;
+
+static uint32_t n_threads = 8;
+static uint32_t n_requests = 1000000;
+static uint32_t drc_size = 1024;
+static uint32_t hiwat = 256;
+static uint32_t retrans = 5;
+static uint32_t n_parts = 7;
+static bool use_table;
+
+static uint32_t next_xid;
+static uint64_t hits;
+
+static int avl_cmpf(const struct avltree_node *lhs,
+		    const struct avltree_node *rhs)
+{
+	const struct dupreq *l, *r;
+
+	l = avltree_container_of(lhs, struct dupreq, node_k);
+	r = avltree_container_of(rhs, struct dupreq, node_k);
+
+	if (l->xid != r->xid)
+		return (l->xid < r->xid) ? -1 : 1;
+	if (l->hk != r->hk)
+		return (l->hk < r->hk) ? -1 : 1;
+	return 0;
+}
+
+/* As dupreq_xid_hash() */
+static uint64_t xid_hash(const struct dupreq *dv)
+{
+	uint64_t h = (dv->hk ^ dv->xid) * 0x9E3779B97F4A7C15ULL;
+
+	return h ^ (h >> 29);
+}
+
+static bool xid_match(const void *item, const void *key)
+{
+	const struct dupreq *dv = item, *dk = key;
+
+	return dv->xid == dk->xid && dv->hk == dk->hk;
+}
+
+/* As rbtx_partition_of_scalar() and rbtree_x_cached_lookup() */
+static struct partition *part_of(const struct dupreq *dk)
+{
+	return &drc.parts[dk->hk % n_parts];
+}
+
+static struct dupreq *avl_lookup(struct partition *p, struct dupreq *dk)
+{
+	struct avltree_node **slot = &p->cache[dk->hk % CACHE_SZ];
+	struct avltree_node *node;
+
+	if (*slot && avl_cmpf(&dk->node_k, *slot) == 0)
+		return avltree_container_of(*slot, struct dupreq, node_k);
+
+	node = avltree_lookup(&dk->node_k, &p->t);
+	if (!node)
+		return NULL;
+	*slot = node;
+	return avltree_container_of(node, struct dupreq, node_k);
+}
+
+static void fifo_push(struct dupreq *dv)
+{
+	dv->next = NULL;
+	if (drc.tail)
+		drc.tail->next = dv;
+	else
+		drc.head = dv;
+	drc.tail = dv;
+}
+
+static struct dupreq *fifo_pop(void)
+{
+	struct dupreq *dv = drc.head;
+
+	if (dv) {
+		drc.head = dv->next;
+		if (!drc.head)
+			drc.tail = NULL;
+	}
+	return dv;
+}
+
+/* Retire the oldest request, taking its partition lock first, as a
+ * lookup there could otherwise still find it.
+ */
+static struct dupreq *fifo_retire(struct dupreq *ov, struct partition *p)
+{
+	pthread_mutex_lock(&p->mtx);
+	pthread_mutex_lock(&drc.mtx);
+	if (drc.head != ov || part_of(ov) != p || ov->refcnt > 0) {
+		ov = NULL;
+		goto unlock;
+	}
+	(void) fifo_pop();
+	--drc.size;
+	avltree_remove(&ov->node_k, &p->t);
+	if (p->cache[ov->hk % CACHE_SZ] == &ov->node_k)
+		p->cache[ov->hk % CACHE_SZ] = NULL;
+ unlock:
+	pthread_mutex_unlock(&drc.mtx);
+	pthread_mutex_unlock(&p->mtx);
+	return ov;
+}
+
+/* As nfs_dupreq_start() */
+static struct dupreq *start(struct dupreq *dk)
+{
+	struct partition *p;
+	struct dupreq *dv;
+
+	if (use_table) {
+		uint64_t hash = xid_hash(dk);
+
+		pthread_mutex_lock(&drc.mtx);
+		dv = gsh_oa_lookup(&drc.xid_t, hash, xid_match, dk);
+		if (dv) {
+			dv->referenced = true;
+		} else {
+			gsh_oa_insert(&drc.xid_t, hash, dk);
+			fifo_push(dk);
+			++drc.size;
+			dv = dk;
+		}
+		++dv->refcnt;
+		pthread_mutex_unlock(&drc.mtx);
+		return dv;
+	}
+
+	p = part_of(dk);
+	pthread_mutex_lock(&p->mtx);
+	dv = avl_lookup(p, dk);
+	if (!dv) {
+		(void) avltree_insert(&dk->node_k, &p->t);
+		p->cache[dk->hk % CACHE_SZ] = &dk->node_k;
+		pthread_mutex_lock(&drc.mtx);
+		fifo_push(dk);
+		++drc.size;
+		pthread_mutex_unlock(&drc.mtx);
+		dv = dk;
+	}
+	pthread_mutex_lock(&drc.mtx);
+	++dv->refcnt;
+	pthread_mutex_unlock(&drc.mtx);
+	pthread_mutex_unlock(&p->mtx);
+	return dv;
+}
+
+/* As drc_clock_retire() */
+static struct dupreq *clock_retire(void)
+{
+	struct dupreq *dv;
+	uint32_t n;
+	bool keep;
+
+	for (n = 0; n <= 2 * drc.size; ++n) {
+		dv = fifo_pop();
+		if (!dv)
+			break;
+		keep = dv->refcnt > 0 || dv->referenced;
+		dv->referenced = false;
+		if (keep) {
+			fifo_push(dv);
+			continue;
+		}
+		gsh_oa_remove(&drc.xid_t, xid_hash(dv), dv);
+		--drc.size;
+		return dv;
+	}
+
+	return NULL;
+}
+
+/* As nfs_dupreq_finish() and nfs_dupreq_rele() */
+static void finish(struct dupreq *dv)
+{
+	struct dupreq *ov = NULL;
+	struct partition *p = NULL;
+
+	pthread_mutex_lock(&drc.mtx);
+	--dv->refcnt;
+	if (drc.size > hiwat) {
+		if (use_table)
+			ov = clock_retire();
+		else if (drc.head && drc.head->refcnt == 0) {
+			ov = drc.head;
+			p = part_of(ov);
+		}
+	}
+	pthread_mutex_unlock(&drc.mtx);
+
+	if (ov && !use_table)
+		ov = fifo_retire(ov, p);
+	free(ov);
+}
+
+static void *worker(void *arg)
+{
+	unsigned int seed = (uintptr_t) arg;
+	uint64_t my_hits = 0;
+	struct dupreq *dk, *dv;
+	uint32_t ix, xid;
+
+	for (ix = 0; ix < n_requests; ++ix) {
+		xid = atomic_inc_uint32_t(&next_xid);
+		if (rand_r(&seed) % 100 < retrans)
+			xid -= rand_r(&seed) % hiwat + 1;
+
+		dk = calloc(1, sizeof(*dk));
+		dk->xid = xid;
+		dk->hk = xid * 0x2545F4914F6CDD1DULL;	/* checksum */
+
+		dv = start(dk);
+		if (dv != dk) {
+			++my_hits;
+			free(dk);
+		}
+		finish(dv);
+	}
+
+	(void) atomic_add_uint64_t(&hits, my_hits);
+	return NULL;
+}
+
+static double elapsed(struct timespec *start)
+{
+	struct timespec end;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return ((end.tv_sec - start->tv_sec) * 1e9 +
+		(end.tv_nsec - start->tv_nsec));
+}
+
+static void run(bool table)
+{
+	pthread_t *threads = calloc(n_threads, sizeof(pthread_t));
+	struct timespec start;
+	struct dupreq *dv;
+	uint32_t ix;
+
+	use_table = table;
+	next_xid = 0;
+	hits = 0;
+	pthread_mutex_init(&drc.mtx, NULL);
+	if (table) {
+		gsh_oa_init(&drc.xid_t, drc_size);
+	} else {
+		drc.parts = calloc(n_parts, sizeof(struct partition));
+		for (ix = 0; ix < n_parts; ++ix) {
+			pthread_mutex_init(&drc.parts[ix].mtx, NULL);
+			avltree_init(&drc.parts[ix].t, avl_cmpf, 0);
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (ix = 0; ix < n_threads; ++ix)
+		pthread_create(&threads[ix], NULL, worker,
+			       (void *)(uintptr_t) (ix + 1));
+	for (ix = 0; ix < n_threads; ++ix)
+		pthread_join(threads[ix], NULL);
+
+	printf("%-5s %8.1f ns/request, %.2f%% replayed\n",
+	       table ? "table" : "part",
+	       elapsed(&start) / ((double)n_threads * n_requests),
+	       100.0 * hits / ((double)n_threads * n_requests));
+
+	if (table) {
+		while ((ix = gsh_oa_next(&drc.xid_t, 0)) != UINT32_MAX) {
+			dv = drc.xid_t.slots[ix].item;
+			gsh_oa_remove(&drc.xid_t, drc.xid_t.slots[ix].hash, dv);
+			free(dv);
+		}
+		gsh_oa_destroy(&drc.xid_t);
+		drc.head = drc.tail = NULL;
+	} else {
+		while ((dv = drc.head) != NULL) {
+			drc.head = dv->next;
+			free(dv);
+		}
+		drc.tail = NULL;
+		for (ix = 0; ix < n_parts; ++ix)
+			pthread_mutex_destroy(&drc.parts[ix].mtx);
+		free(drc.parts);
+	}
+	drc.size = 0;
+	pthread_mutex_destroy(&drc.mtx);
+	free(threads);
+}
+
+int main(int argc, char *argv[])
+{
+	int opt;
+
+	while ((opt = getopt(argc, argv, "t:r:s:w:d:p:")) != -1) {
+		switch (opt) {
+		case 't':
+			n_threads = atoi(optarg);
+			break;
+		case 'r':
+			n_requests = atoi(optarg);
+			break;
+		case 's':
+			drc_size = atoi(optarg);
+			break;
+		case 'w':
+			hiwat = atoi(optarg);
+			break;
+		case 'd':
+			retrans = atoi(optarg);
+			break;
+		case 'p':
+			n_parts = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr,
+				"Usage: %s [-t threads] [-r requests] [-s size] [-w hiwat] [-d retransmit percent] [-p partitions]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	if (n_threads == 0 || hiwat == 0 || n_parts == 0) {
+		fprintf(stderr, "%s: counts must be positive\n", argv[0]);
+		return 1;
+	}
+
+	printf("%" PRIu32 " threads, %" PRIu32 " requests each, hiwat %"
+	       PRIu32 ", %" PRIu32 "%% retransmitted\n",
+	       n_threads, n_requests, hiwat, retrans);
+	run(false);
+	run(true);
+
+	return 0;
+}
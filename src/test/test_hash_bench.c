@@ -0,0 +1,210 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file test_hash_bench.c
+ * @brief Compare the hash functions on the keys of the tables
+ *
+ * Times gsh_hash64, as dispatched and with its tables, against
+ * CityHash64WithSeed and MurmurHash3_x64_128 on keys of 8 bytes (ids),
+ * 16 to 64 bytes (file handles) and 128 bytes, and gsh_hash_u64 on
+ * the ids.  Checks first that the dispatched gsh_hash64 gives the
+ * hashes of the tables, and reports how evenly each spreads
+ * sequential ids over the buckets of a table.
+ *
+ * Usage: test_hash_bench [-n hashes] [-b buckets]
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include "city.h"
+#include "murmur3.h"
+#include "gsh_hash.h"
+
+#define NKEYS 1024
+#define MAX_KEY 128
+
+static const size_t key_sizes[] = { 8, 16, 24, 32, 64, 128 };
+
+static unsigned char keys[NKEYS][MAX_KEY];
+static uint32_t n_hashes = 10000000;
+static uint32_t n_buckets = 4093;
+
+/* Keep the results live */
+static volatile uint64_t sink;
+
+static uint64_t city(const void *buf, size_t len)
+{
+	return CityHash64WithSeed(buf, len, 557);
+}
+
+static uint64_t murmur(const void *buf, size_t len)
+{
+	uint64_t out[2];
+
+	MurmurHash3_x64_128(buf, len, 557, out);
+	return out[0];
+}
+
+static uint64_t gsh(const void *buf, size_t len)
+{
+	return gsh_hash64(buf, len, 557);
+}
+
+static uint64_t gsh_generic(const void *buf, size_t len)
+{
+	return gsh_hash64_generic(buf, len, 557);
+}
+
+static uint64_t gsh_u64(const void *buf, size_t len)
+{
+	uint64_t v;
+
+	memcpy(&v, buf, sizeof(v));
+	return gsh_hash_u64(v, 557);
+}
+
+static const struct {
+	const char *name;
+	uint64_t (*fn)(const void *, size_t);
+	bool ids_only;
+} funcs[] = {
+	{ "gsh_hash64", gsh, false },
+	{ "generic", gsh_generic, false },
+	{ "city", city, false },
+	{ "murmur3", murmur, false },
+	{ "gsh_hash_u64", gsh_u64, true },
+};
+
+static double elapsed(const struct timespec *start)
+{
+	struct timespec end;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return ((end.tv_sec - start->tv_sec) * 1e9 +
+		(end.tv_nsec - start->tv_nsec));
+}
+
+static double bench(uint64_t (*fn)(const void *, size_t), size_t len)
+{
+	struct timespec start;
+	uint64_t h = 0;
+	uint32_t ix;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (ix = 0; ix < n_hashes; ++ix)
+		h += fn(keys[ix % NKEYS], len);
+	sink = h;
+
+	return elapsed(&start) / n_hashes;
+}
+
+/* Largest bucket over the mean, for n_buckets * 16 sequential ids */
+static double spread(uint64_t (*fn)(const void *, size_t))
+{
+	uint32_t *count = calloc(n_buckets, sizeof(*count));
+	uint64_t id, n = (uint64_t)n_buckets * 16;
+	uint32_t max = 0, ix;
+
+	for (id = 0; id < n; ++id)
+		++count[fn(&id, sizeof(id)) % n_buckets];
+
+	for (ix = 0; ix < n_buckets; ++ix)
+		if (count[ix] > max)
+			max = count[ix];
+
+	free(count);
+	return max / 16.0;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int f, s;
+	uint32_t ix, jx;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:b:")) != -1) {
+		switch (opt) {
+		case 'n':
+			n_hashes = atoi(optarg);
+			break;
+		case 'b':
+			n_buckets = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr,
+				"Usage: %s [-n hashes] [-b buckets]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	if (n_hashes == 0 || n_buckets == 0) {
+		fprintf(stderr, "%s: counts must be positive\n", argv[0]);
+		return 1;
+	}
+
+	for (ix = 0; ix < NKEYS; ++ix)
+		for (jx = 0; jx < MAX_KEY; ++jx)
+			keys[ix][jx] = random();
+
+	for (ix = 0; ix < NKEYS; ++ix)
+		for (jx = 0; jx <= MAX_KEY; ++jx)
+			if (gsh_hash64(keys[ix], jx, ix) !=
+			    gsh_hash64_generic(keys[ix], jx, ix)) {
+				fprintf(stderr,
+					"%s hash of %" PRIu32
+					" bytes differs from the generic one\n",
+					gsh_hash_impl(), jx);
+				return 1;
+			}
+
+	printf("gsh_hash64 uses %s, %" PRIu32 " hashes per figure\n",
+	       gsh_hash_impl(), n_hashes);
+
+	printf("%-13s", "bytes");
+	for (s = 0; s < sizeof(key_sizes) / sizeof(key_sizes[0]); ++s)
+		printf(" %7zu", key_sizes[s]);
+	printf("  worst bucket\n");
+
+	for (f = 0; f < sizeof(funcs) / sizeof(funcs[0]); ++f) {
+		printf("%-13s", funcs[f].name);
+		for (s = 0; s < sizeof(key_sizes) / sizeof(key_sizes[0]);
+		     ++s) {
+			if (funcs[f].ids_only && key_sizes[s] != 8)
+				printf(" %7s", "-");
+			else
+				printf(" %7.2f",
+				       bench(funcs[f].fn, key_sizes[s]));
+		}
+		printf("  %5.2fx mean\n", spread(funcs[f].fn));
+	}
+
+	printf("(ns per hash)\n");
+
+	return 0;
+}
@@ -0,0 +1,210 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file test_lock_tree_bench.c
+ * @brief Compare lock range lookup in a list and in the interval tree
+ *
+ * Holds N non-overlapping byte ranges on one file, with a gap between
+ * each, inserted in random order the way SAL keeps a file's locks.
+ * Then times the conflict search state_lock() makes for a new lock,
+ * once walking every range as a glist of locks must, and once through
+ * gsh_itree.h, followed by the touching-range search merge_lock_entry()
+ * makes and the removal of every range.  The list is only searched L
+ * times, since a full pass costs N squared.
+ *
+ * Usage: test_lock_tree_bench [-n ranges] [-l list lookups]
+ *			       [-s range size]
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <inttypes.h>
+#include "gsh_list.h"
+#include "gsh_itree.h"
+
+struct range {
+	struct glist_head list;
+	struct itree_node node;
+};
+
+static struct range *ranges;
+static uint32_t *order;
+
+static uint32_t n_ranges = 100000;
+static uint32_t n_list_lookups = 1000;
+static uint64_t range_size = 4096;
+
+static double elapsed(struct timespec *start)
+{
+	struct timespec end;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return ((end.tv_sec - start->tv_sec) * 1e9 +
+		(end.tv_nsec - start->tv_nsec));
+}
+
+/* Range ix starts after ix ranges and their gaps */
+static uint64_t range_start(uint32_t ix)
+{
+	return (uint64_t) ix * range_size * 2;
+}
+
+static uint32_t list_overlaps(struct glist_head *head, uint64_t start,
+			      uint64_t end)
+{
+	struct glist_head *glist;
+	struct range *r;
+	uint32_t found = 0;
+
+	glist_for_each(glist, head) {
+		r = glist_entry(glist, struct range, list);
+		if (r->node.end >= start && r->node.start <= end)
+			++found;
+	}
+
+	return found;
+}
+
+static uint32_t tree_overlaps(struct itree *tree, uint64_t start,
+			      uint64_t end)
+{
+	struct itree_node *node;
+	uint32_t found = 0;
+
+	itree_for_each_overlap(node, tree, start, end)
+		++found;
+
+	return found;
+}
+
+int main(int argc, char *argv[])
+{
+	struct glist_head head;
+	struct itree tree;
+	struct timespec start;
+	uint32_t ix, jx, tmp, found, wrong = 0;
+	uint64_t s;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:l:s:")) != -1) {
+		switch (opt) {
+		case 'n':
+			n_ranges = atoi(optarg);
+			break;
+		case 'l':
+			n_list_lookups = atoi(optarg);
+			break;
+		case 's':
+			range_size = strtoull(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr,
+				"Usage: %s [-n ranges] [-l list lookups] [-s range size]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	if (n_ranges == 0 || n_list_lookups == 0 || range_size < 2) {
+		fprintf(stderr, "%s: counts must be positive\n", argv[0]);
+		return 1;
+	}
+
+	ranges = calloc(n_ranges, sizeof(struct range));
+	order = calloc(n_ranges, sizeof(uint32_t));
+	for (ix = 0; ix < n_ranges; ++ix)
+		order[ix] = ix;
+	for (ix = n_ranges - 1; ix > 0; --ix) {
+		jx = random() % (ix + 1);
+		tmp = order[ix];
+		order[ix] = order[jx];
+		order[jx] = tmp;
+	}
+
+	printf("%" PRIu32 " ranges of %" PRIu64 " bytes\n",
+	       n_ranges, range_size);
+
+	glist_init(&head);
+	itree_init(&tree);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (ix = 0; ix < n_ranges; ++ix) {
+		struct range *r = &ranges[order[ix]];
+
+		r->node.start = range_start(order[ix]);
+		r->node.end = r->node.start + range_size - 1;
+		glist_add_tail(&head, &r->list);
+	}
+	printf("list insert   %10.1f ns/op\n", elapsed(&start) / n_ranges);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (ix = 0; ix < n_ranges; ++ix)
+		itree_insert(&tree, &ranges[order[ix]].node);
+	printf("tree insert   %10.1f ns/op\n", elapsed(&start) / n_ranges);
+
+	/* A lock over the second half of one range and the gap after it
+	 * conflicts with exactly that range.
+	 */
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (ix = 0; ix < n_list_lookups; ++ix) {
+		s = range_start(order[ix % n_ranges]) + range_size / 2;
+		if (list_overlaps(&head, s, s + range_size) != 1)
+			++wrong;
+	}
+	printf("list conflict %10.1f ns/op\n",
+	       elapsed(&start) / n_list_lookups);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (ix = 0; ix < n_ranges; ++ix) {
+		s = range_start(order[ix]) + range_size / 2;
+		if (tree_overlaps(&tree, s, s + range_size) != 1)
+			++wrong;
+	}
+	printf("tree conflict %10.1f ns/op\n", elapsed(&start) / n_ranges);
+
+	/* Filling a gap exactly touches the ranges on both sides of it */
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (ix = 0; ix < n_ranges; ++ix) {
+		s = range_start(order[ix]) + range_size;
+		found = tree_overlaps(&tree, s - 1, s + range_size);
+		if (found != (order[ix] == n_ranges - 1 ? 1 : 2))
+			++wrong;
+	}
+	printf("tree merge    %10.1f ns/op\n", elapsed(&start) / n_ranges);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (ix = 0; ix < n_ranges; ++ix)
+		itree_remove(&tree, &ranges[order[ix]].node);
+	printf("tree remove   %10.1f ns/op\n", elapsed(&start) / n_ranges);
+
+	if (wrong != 0 || !itree_empty(&tree))
+		fprintf(stderr, "%" PRIu32 " lookups wrong\n", wrong);
+
+	free(order);
+	free(ranges);
+
+	return wrong != 0;
+}
@@ -0,0 +1,241 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file test_req_queue_bench.c
+ * @brief Compare the request queue backends
+ *
+ * Runs N producer ("decoder") threads against M consumer ("worker")
+ * threads, passing a fixed number of items through either the
+ * spinlocked producer/consumer list pair used by nfs_rpc_enqueue_req()
+ * or the lock-free ring, and reports the throughput of each.
+ *
+ * Usage: test_req_queue_bench [-p producers] [-c consumers]
+ *				[-n items per producer] [-r ring slots]
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include "gsh_list.h"
+#include "gsh_mpmc_ring.h"
+
+/* This function is dragged in by the use of abstract_mem.h, so
+ * we define a simple version that does a printf rather than
+ * pull in the entirety of log_functions.c into this standalone
+ * program.
+ */
+void LogMallocFailure(const char *file, int line, const char *function,
+		      const char *allocator)
+{
+	printf("Aborting %s due to out of memory", allocator);
+}
+
+struct item {
+	struct glist_head q;
+	uint64_t seq;
+};
+
+struct list_q {
+	pthread_spinlock_t sp;
+	struct glist_head q;
+	uint32_t size;
+};
+
+struct list_pair {
+	struct list_q producer;
+	GSH_CACHE_PAD(0);
+	struct list_q consumer;
+};
+
+static struct list_pair lp;
+static struct gsh_mpmc_ring ring;
+static bool use_ring;
+
+static uint32_t n_producers = 4;
+static uint32_t n_consumers = 4;
+static uint64_t n_items = 1000000;
+static uint32_t ring_slots = 1024;
+
+static uint64_t consumed;
+static uint64_t total;
+
+static void list_q_init(struct list_q *q)
+{
+	pthread_spin_init(&q->sp, PTHREAD_PROCESS_PRIVATE);
+	glist_init(&q->q);
+	q->size = 0;
+}
+
+static void list_push(struct item *it)
+{
+	pthread_spin_lock(&lp.producer.sp);
+	glist_add_tail(&lp.producer.q, &it->q);
+	++(lp.producer.size);
+	pthread_spin_unlock(&lp.producer.sp);
+}
+
+/* same splice protocol as nfs_rpc_consume_req() */
+static struct item *list_pop(void)
+{
+	struct item *it = NULL;
+
+	pthread_spin_lock(&lp.consumer.sp);
+	if (lp.consumer.size == 0) {
+		pthread_spin_lock(&lp.producer.sp);
+		if (lp.producer.size > 0) {
+			glist_splice_tail(&lp.consumer.q, &lp.producer.q);
+			lp.consumer.size = lp.producer.size;
+			lp.producer.size = 0;
+		}
+		pthread_spin_unlock(&lp.producer.sp);
+	}
+	if (lp.consumer.size > 0) {
+		it = glist_first_entry(&lp.consumer.q, struct item, q);
+		glist_del(&it->q);
+		--(lp.consumer.size);
+	}
+	pthread_spin_unlock(&lp.consumer.sp);
+	return it;
+}
+
+static void *producer(void *arg)
+{
+	struct item *items = arg;
+	uint64_t ix;
+
+	for (ix = 0; ix < n_items; ++ix) {
+		if (use_ring) {
+			while (!gsh_mpmc_ring_push(&ring, &items[ix]))
+				sched_yield();
+		} else {
+			list_push(&items[ix]);
+		}
+	}
+	return NULL;
+}
+
+static void *consumer(void *arg)
+{
+	struct item *it;
+
+	while (atomic_fetch_uint64_t(&consumed) < total) {
+		if (use_ring)
+			it = gsh_mpmc_ring_pop(&ring);
+		else
+			it = list_pop();
+		if (it)
+			(void) atomic_inc_uint64_t(&consumed);
+		else
+			sched_yield();
+	}
+	return NULL;
+}
+
+static double run(bool ring_backend)
+{
+	pthread_t *thr;
+	struct item **items;
+	struct timespec start, end;
+	uint32_t ix;
+	double secs;
+
+	use_ring = ring_backend;
+	consumed = 0;
+	total = n_items * n_producers;
+
+	thr = calloc(n_producers + n_consumers, sizeof(pthread_t));
+	items = calloc(n_producers, sizeof(struct item *));
+	for (ix = 0; ix < n_producers; ++ix)
+		items[ix] = calloc(n_items, sizeof(struct item));
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (ix = 0; ix < n_consumers; ++ix)
+		pthread_create(&thr[ix], NULL, consumer, NULL);
+	for (ix = 0; ix < n_producers; ++ix)
+		pthread_create(&thr[n_consumers + ix], NULL, producer,
+			       items[ix]);
+	for (ix = 0; ix < n_producers + n_consumers; ++ix)
+		pthread_join(thr[ix], NULL);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	secs = (end.tv_sec - start.tv_sec) +
+	       (end.tv_nsec - start.tv_nsec) / 1e9;
+
+	for (ix = 0; ix < n_producers; ++ix)
+		free(items[ix]);
+	free(items);
+	free(thr);
+
+	return secs;
+}
+
+int main(int argc, char *argv[])
+{
+	double secs;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "p:c:n:r:")) != -1) {
+		switch (opt) {
+		case 'p':
+			n_producers = atoi(optarg);
+			break;
+		case 'c':
+			n_consumers = atoi(optarg);
+			break;
+		case 'n':
+			n_items = strtoull(optarg, NULL, 10);
+			break;
+		case 'r':
+			ring_slots = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr,
+				"Usage: %s [-p producers] [-c consumers] [-n items] [-r ring slots]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	if (n_producers == 0 || n_consumers == 0) {
+		fprintf(stderr, "Need at least one producer and consumer\n");
+		return 1;
+	}
+
+	list_q_init(&lp.producer);
+	list_q_init(&lp.consumer);
+	gsh_mpmc_ring_init(&ring, ring_slots);
+
+	printf("%u producers x %u consumers, %" PRIu64 " items each\n",
+	       n_producers, n_consumers, n_items);
+
+	secs = run(false);
+	printf("list: %8.3f s %12.0f ops/s\n", secs, total / secs);
+
+	secs = run(true);
+	printf("ring: %8.3f s %12.0f ops/s\n", secs, total / secs);
+
+	gsh_mpmc_ring_destroy(&ring);
+	return 0;
+}
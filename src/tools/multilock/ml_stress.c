@@ -0,0 +1,291 @@
+/*
+ * This software is a server that implements the NFS protocol.
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include "ml_stress.h"
+
+struct ml_thread {
+	struct ml_stress *stress;
+	uint32_t index;
+	uint32_t nowners;
+	pthread_t thread;
+	struct ml_hist lock;
+	struct ml_hist unlock;
+};
+
+static const char * const pattern_names[] = {
+	[ML_PATTERN_DISJOINT] = "disjoint",
+	[ML_PATTERN_OVERLAP] = "overlap",
+	[ML_PATTERN_SPLIT] = "split",
+	[ML_PATTERN_MERGE] = "merge",
+	[ML_PATTERN_STORM] = "storm",
+};
+
+const char *ml_pattern_name(enum ml_pattern pattern)
+{
+	return pattern_names[pattern];
+}
+
+int ml_pattern_parse(const char *name, enum ml_pattern *pattern)
+{
+	int i;
+
+	for (i = 0; i <= ML_PATTERN_STORM; i++) {
+		if (strcasecmp(name, pattern_names[i]) == 0) {
+			*pattern = i;
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+static uint64_t ml_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void hist_add(struct ml_hist *hist, int rc, uint64_t ns)
+{
+	int b;
+
+	if (rc == EAGAIN) {
+		hist->conflicts++;
+		return;
+	}
+	if (rc != 0) {
+		hist->errors++;
+		return;
+	}
+
+	b = ns == 0 ? 0 : 64 - __builtin_clzll(ns);
+	if (b >= ML_HIST_BUCKETS)
+		b = ML_HIST_BUCKETS - 1;
+
+	hist->count++;
+	hist->total_ns += ns;
+	if (ns > hist->max_ns)
+		hist->max_ns = ns;
+	hist->bucket[b]++;
+}
+
+static void hist_merge(struct ml_hist *to, struct ml_hist *from)
+{
+	int b;
+
+	to->count += from->count;
+	to->conflicts += from->conflicts;
+	to->errors += from->errors;
+	to->total_ns += from->total_ns;
+	if (from->max_ns > to->max_ns)
+		to->max_ns = from->max_ns;
+	for (b = 0; b < ML_HIST_BUCKETS; b++)
+		to->bucket[b] += from->bucket[b];
+}
+
+/* Upper bound of the bucket holding the given fraction of the counts */
+static uint64_t hist_pct(struct ml_hist *hist, double pct)
+{
+	uint64_t want = hist->count * pct, seen = 0;
+	int b;
+
+	for (b = 0; b < ML_HIST_BUCKETS - 1; b++) {
+		seen += hist->bucket[b];
+		if (seen > want)
+			return 1ULL << b;
+	}
+
+	return hist->max_ns;
+}
+
+void ml_hist_print(FILE *out, const char *name, struct ml_hist *hist,
+		   double seconds)
+{
+	int b;
+
+	fprintf(out,
+		"%s: %llu ok (%.0f/s) %llu conflicts %llu errors, avg %llu ns max %llu ns\n",
+		name, (unsigned long long) hist->count,
+		seconds > 0 ? hist->count / seconds : 0.0,
+		(unsigned long long) hist->conflicts,
+		(unsigned long long) hist->errors,
+		(unsigned long long) (hist->count
+				      ? hist->total_ns / hist->count : 0),
+		(unsigned long long) hist->max_ns);
+
+	if (hist->count == 0)
+		return;
+
+	fprintf(out, "  p50 < %llu ns, p99 < %llu ns, p99.9 < %llu ns\n",
+		(unsigned long long) hist_pct(hist, 0.50),
+		(unsigned long long) hist_pct(hist, 0.99),
+		(unsigned long long) hist_pct(hist, 0.999));
+
+	for (b = 0; b < ML_HIST_BUCKETS; b++) {
+		if (hist->bucket[b] == 0)
+			continue;
+		fprintf(out, "  < %12llu ns %10llu\n",
+			b == ML_HIST_BUCKETS - 1
+				? (unsigned long long) hist->max_ns
+				: 1ULL << b,
+			(unsigned long long) hist->bucket[b]);
+	}
+}
+
+static int timed_lock(struct ml_thread *me, uint32_t owner, bool write,
+		      bool wait, uint64_t start, uint64_t len)
+{
+	struct ml_backend *backend = me->stress->backend;
+	uint64_t t = ml_now();
+	int rc;
+
+	rc = backend->lock(backend->ctx, owner, write, wait, start, len);
+	hist_add(&me->lock, rc, ml_now() - t);
+	return rc;
+}
+
+static int timed_unlock(struct ml_thread *me, uint32_t owner, uint64_t start,
+			uint64_t len)
+{
+	struct ml_backend *backend = me->stress->backend;
+	uint64_t t = ml_now();
+	int rc;
+
+	rc = backend->unlock(backend->ctx, owner, start, len);
+	hist_add(&me->unlock, rc, ml_now() - t);
+	return rc;
+}
+
+/*
+ * Thread t drives owners t, t + threads, ..., in turn, so that no
+ * owner is used by two threads.  Owner o has [4 * o * range, 4 * range)
+ * to itself, except for OVERLAP and STORM.
+ */
+static void *ml_stress_thread(void *arg)
+{
+	struct ml_thread *me = arg;
+	struct ml_stress *stress = me->stress;
+	uint64_t r = stress->range, base, start;
+	unsigned int seed = me->index + 1;
+	uint32_t i, owner;
+	bool write;
+
+	if (stress->backend->thread_init != NULL)
+		stress->backend->thread_init(stress->backend->ctx);
+
+	for (i = 0; i < stress->iterations; i++) {
+		owner = me->index + (i % me->nowners) * stress->threads;
+		base = (uint64_t) owner * 4 * r;
+
+		switch (stress->pattern) {
+		case ML_PATTERN_DISJOINT:
+			if (timed_lock(me, owner, true, false, base, r) == 0)
+				timed_unlock(me, owner, base, r);
+			break;
+
+		case ML_PATTERN_OVERLAP:
+			/* Half a range apart, so each overlaps two others */
+			start = (rand_r(&seed) % stress->owners) * (r / 2);
+			write = (unsigned int) (rand_r(&seed) % 100)
+							< stress->write_pct;
+			if (timed_lock(me, owner, write, false, start, r) == 0)
+				timed_unlock(me, owner, start, r);
+			break;
+
+		case ML_PATTERN_SPLIT:
+			if (timed_lock(me, owner, true, false, base, 3 * r)
+			    != 0)
+				break;
+			timed_unlock(me, owner, base + r, r);
+			timed_unlock(me, owner, base, 3 * r);
+			break;
+
+		case ML_PATTERN_MERGE:
+			timed_lock(me, owner, true, false, base, r);
+			timed_lock(me, owner, true, false, base + 2 * r, r);
+			timed_lock(me, owner, true, false, base + r, r);
+			timed_unlock(me, owner, base, 3 * r);
+			break;
+
+		case ML_PATTERN_STORM:
+			if (timed_lock(me, owner, true, true, 0, r) == 0)
+				timed_unlock(me, owner, 0, r);
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Run the stress, leaving the merged histograms in stress.
+ *
+ * Returns 0, or an errno if the threads could not be started.
+ */
+int ml_stress_run(struct ml_stress *stress)
+{
+	struct ml_thread *threads;
+	uint64_t start;
+	uint32_t t;
+	int rc = 0;
+
+	if (stress->threads == 0 || stress->owners < stress->threads ||
+	    stress->range < 2)
+		return EINVAL;
+
+	threads = calloc(stress->threads, sizeof(*threads));
+	if (threads == NULL)
+		return ENOMEM;
+
+	memset(&stress->lock, 0, sizeof(stress->lock));
+	memset(&stress->unlock, 0, sizeof(stress->unlock));
+
+	start = ml_now();
+
+	for (t = 0; t < stress->threads; t++) {
+		threads[t].stress = stress;
+		threads[t].index = t;
+		threads[t].nowners = (stress->owners - t + stress->threads - 1)
+							/ stress->threads;
+		rc = pthread_create(&threads[t].thread, NULL,
+				    ml_stress_thread, &threads[t]);
+		if (rc != 0)
+			break;
+	}
+
+	while (t-- > 0) {
+		pthread_join(threads[t].thread, NULL);
+		hist_merge(&stress->lock, &threads[t].lock);
+		hist_merge(&stress->unlock, &threads[t].unlock);
+	}
+
+	stress->seconds = (ml_now() - start) / 1e9;
+	free(threads);
+	return rc;
+}
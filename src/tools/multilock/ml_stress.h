@@ -0,0 +1,90 @@
+/*
+ * This software is a server that implements the NFS protocol.
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ *
+ */
+
+/*
+ * Lock load generator
+ *
+ * Drives many lock owners through a lock pattern from a number of
+ * threads, and keeps histograms of the lock and unlock latencies.  The
+ * locks are taken through a backend, fcntl OFD locks for ml_stress, or
+ * anything else that can name owners by number, so that the same
+ * patterns can be run against SAL in-process.
+ */
+
+#ifndef _ML_STRESS_H
+#define _ML_STRESS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+enum ml_pattern {
+	ML_PATTERN_DISJOINT,	/* each owner locks its own range */
+	ML_PATTERN_OVERLAP,	/* owners lock ranges overlapping others' */
+	ML_PATTERN_SPLIT,	/* unlock the middle of a lock, then all */
+	ML_PATTERN_MERGE,	/* lock three adjacent ranges, then unlock */
+	ML_PATTERN_STORM,	/* every owner waits on the same range */
+};
+
+struct ml_backend {
+	void *ctx;
+	/* Called first in each thread, may be NULL */
+	void (*thread_init)(void *ctx);
+	/* Return 0, EAGAIN on a conflict, or another errno */
+	int (*lock)(void *ctx, uint32_t owner, bool write, bool wait,
+		    uint64_t start, uint64_t len);
+	int (*unlock)(void *ctx, uint32_t owner, uint64_t start,
+		      uint64_t len);
+};
+
+/* Buckets of powers of two nanoseconds, the last takes the rest */
+#define ML_HIST_BUCKETS 40
+
+struct ml_hist {
+	uint64_t count;		/* operations done */
+	uint64_t conflicts;	/* locks refused with EAGAIN */
+	uint64_t errors;	/* other failures */
+	uint64_t total_ns;
+	uint64_t max_ns;
+	uint64_t bucket[ML_HIST_BUCKETS];
+};
+
+struct ml_stress {
+	enum ml_pattern pattern;
+	uint32_t owners;	/* at least threads */
+	uint32_t threads;
+	uint32_t iterations;	/* per thread */
+	uint64_t range;		/* bytes in each lock */
+	unsigned int write_pct;	/* of OVERLAP locks that are write locks */
+	struct ml_backend *backend;
+	/* results */
+	struct ml_hist lock;
+	struct ml_hist unlock;
+	double seconds;
+};
+
+int ml_stress_run(struct ml_stress *stress);
+void ml_hist_print(FILE *out, const char *name, struct ml_hist *hist,
+		   double seconds);
+const char *ml_pattern_name(enum ml_pattern pattern);
+int ml_pattern_parse(const char *name, enum ml_pattern *pattern);
+
+#endif				/* _ML_STRESS_H */
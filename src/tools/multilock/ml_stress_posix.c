@@ -0,0 +1,164 @@
+/*
+ * This software is a server that implements the NFS protocol.
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ *
+ */
+
+#include "multilock.h"
+#include "ml_stress.h"
+
+/* command line syntax */
+
+char options[] = "f:o:t:i:p:r:w:h?";
+char usage[] =
+	"Usage: ml_stress -f file [-o owners] [-t threads] [-i iterations]\n"
+	"                 [-p pattern] [-r range] [-w write_pct]\n"
+	"\n"
+	"  -f file       file to lock, created if need be\n"
+	"  -o owners     lock owners, each an open of the file (default 1000)\n"
+	"  -t threads    threads driving the owners (default 16)\n"
+	"  -i iterations lock operations per thread (default 10000)\n"
+	"  -p pattern    disjoint, overlap, split, merge or storm\n"
+	"                (default disjoint)\n"
+	"  -r range      bytes in each lock (default 4096)\n"
+	"  -w write_pct  percent of write locks for overlap (default 50)\n";
+
+bool duperrors;
+FILE *output;
+
+/* One open file description per owner, for OFD locks */
+static int *fds;
+
+static int posix_lock(void *ctx, uint32_t owner, bool write, bool wait,
+		      uint64_t start, uint64_t len)
+{
+	struct flock lock;
+
+	memset(&lock, 0, sizeof(lock));
+	lock.l_type = write ? F_WRLCK : F_RDLCK;
+	lock.l_whence = SEEK_SET;
+	lock.l_start = start;
+	lock.l_len = len;
+
+	if (fcntl(fds[owner], wait ? F_OFD_SETLKW : F_OFD_SETLK, &lock) == 0)
+		return 0;
+
+	return errno == EACCES ? EAGAIN : errno;
+}
+
+static int posix_unlock(void *ctx, uint32_t owner, uint64_t start,
+			uint64_t len)
+{
+	struct flock lock;
+
+	memset(&lock, 0, sizeof(lock));
+	lock.l_type = F_UNLCK;
+	lock.l_whence = SEEK_SET;
+	lock.l_start = start;
+	lock.l_len = len;
+
+	if (fcntl(fds[owner], F_OFD_SETLK, &lock) == 0)
+		return 0;
+
+	return errno;
+}
+
+static struct ml_backend posix_backend = {
+	.lock = posix_lock,
+	.unlock = posix_unlock,
+};
+
+int main(int argc, char **argv)
+{
+	struct ml_stress stress = {
+		.pattern = ML_PATTERN_DISJOINT,
+		.owners = 1000,
+		.threads = 16,
+		.iterations = 10000,
+		.range = 4096,
+		.write_pct = 50,
+		.backend = &posix_backend,
+	};
+	char *file = NULL;
+	uint32_t i;
+	int opt, rc;
+
+	while ((opt = getopt(argc, argv, options)) != EOF) {
+		switch (opt) {
+		case 'f':
+			file = optarg;
+			break;
+		case 'o':
+			stress.owners = atoi(optarg);
+			break;
+		case 't':
+			stress.threads = atoi(optarg);
+			break;
+		case 'i':
+			stress.iterations = atoi(optarg);
+			break;
+		case 'p':
+			if (ml_pattern_parse(optarg, &stress.pattern) != 0)
+				show_usage(1, "Unknown pattern %s\n", optarg);
+			break;
+		case 'r':
+			stress.range = strtoull(optarg, NULL, 0);
+			break;
+		case 'w':
+			stress.write_pct = atoi(optarg);
+			break;
+		case '?':
+		case 'h':
+		default:
+			show_usage(0, "Help\n");
+		}
+	}
+
+	if (file == NULL)
+		show_usage(1, "Must specify -f\n");
+
+	if (stress.threads == 0 || stress.owners < stress.threads)
+		show_usage(1, "Need at least one owner per thread\n");
+
+	fds = calloc(stress.owners, sizeof(*fds));
+	if (fds == NULL)
+		fatal("Could not allocate %u owners\n", stress.owners);
+
+	for (i = 0; i < stress.owners; i++) {
+		fds[i] = open(file, O_RDWR | O_CREAT, 0666);
+		if (fds[i] < 0)
+			fatal("Could not open %s for owner %u: %s\n",
+			      file, i, strerror(errno));
+	}
+
+	rc = ml_stress_run(&stress);
+	if (rc != 0)
+		fatal("Stress failed: %s\n", strerror(rc));
+
+	printf("%s: %u owners, %u threads, %u iterations, %.3f s\n",
+	       ml_pattern_name(stress.pattern), stress.owners,
+	       stress.threads, stress.iterations, stress.seconds);
+	ml_hist_print(stdout, "lock", &stress.lock, stress.seconds);
+	ml_hist_print(stdout, "unlock", &stress.unlock, stress.seconds);
+
+	for (i = 0; i < stress.owners; i++)
+		close(fds[i]);
+	free(fds);
+
+	return 0;
+}
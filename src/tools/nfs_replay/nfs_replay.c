@@ -0,0 +1,590 @@
+/*
+ * This software is a server that implements the NFS protocol.
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "nfs_replay.h"
+
+/* command line syntax */
+
+char options[] = "f:s:p:c:x:n:w:h?";
+char usage[] =
+	"Usage: nfs_replay -f capture -s server [-p port] [-c capture_port]\n"
+	"                  [-x speed] [-n connections] [-w wait]\n"
+	"\n"
+	"  -f capture      pcap capture of the traffic to replay\n"
+	"  -s server       server to replay it to\n"
+	"  -p port         server port (default 2049)\n"
+	"  -c capture_port server port in the capture (default the -p port)\n"
+	"  -x speed        1 for the captured pace, 2 for twice as fast, 0 for\n"
+	"                  as fast as possible (default 1)\n"
+	"  -n connections  at most this many connections, the captured\n"
+	"                  clients sharing them (default one per client)\n"
+	"  -w wait         seconds to wait for replies after the last call\n"
+	"                  (default 30)\n";
+
+#define MAX_CONNS 1024
+
+struct op_stats {
+	char name[40];
+	uint64_t count;
+	uint64_t rpc_errors;	/* denied, or not SUCCESS */
+	uint64_t nfs_errors;	/* NFS status not OK */
+	uint64_t *lat;		/* ns, of the replies */
+	uint64_t nlat;
+};
+
+struct conn {
+	int fd;
+	pthread_t thread;
+};
+
+static struct replay_capture cap;
+static struct conn *conns;
+static uint32_t nconns;
+
+static struct op_stats *ops;
+static uint32_t nops;
+static uint32_t *call_op;	/* ops index of each call */
+static uint64_t *sent;		/* ns, 0 until sent */
+
+static uint32_t xid_base;
+static uint64_t replied;
+static uint64_t unmatched;
+static pthread_mutex_t stats_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+static const char * const v3_procs[] = {
+	"NULL", "GETATTR", "SETATTR", "LOOKUP", "ACCESS", "READLINK", "READ",
+	"WRITE", "CREATE", "MKDIR", "SYMLINK", "MKNOD", "REMOVE", "RMDIR",
+	"RENAME", "LINK", "READDIR", "READDIRPLUS", "FSSTAT", "FSINFO",
+	"PATHCONF", "COMMIT",
+};
+
+static const char * const mnt_procs[] = {
+	"NULL", "MNT", "DUMP", "UMNT", "UMNTALL", "EXPORT",
+};
+
+static const char * const v4_ops[] = {
+	[3] = "ACCESS", "CLOSE", "COMMIT", "CREATE", "DELEGPURGE",
+	"DELEGRETURN", "GETATTR", "GETFH", "LINK", "LOCK", "LOCKT", "LOCKU",
+	"LOOKUP", "LOOKUPP", "NVERIFY", "OPEN", "OPENATTR", "OPEN_CONFIRM",
+	"OPEN_DOWNGRADE", "PUTFH", "PUTPUBFH", "PUTROOTFH", "READ", "READDIR",
+	"READLINK", "REMOVE", "RENAME", "RENEW", "RESTOREFH", "SAVEFH",
+	"SECINFO", "SETATTR", "SETCLIENTID", "SETCLIENTID_CONFIRM", "VERIFY",
+	"WRITE", "RELEASE_LOCKOWNER", "BACKCHANNEL_CTL",
+	"BIND_CONN_TO_SESSION", "EXCHANGE_ID", "CREATE_SESSION",
+	"DESTROY_SESSION", "FREE_STATEID", "GET_DIR_DELEGATION",
+	"GETDEVICEINFO", "GETDEVICELIST", "LAYOUTCOMMIT", "LAYOUTGET",
+	"LAYOUTRETURN", "SECINFO_NO_NAME", "SEQUENCE", "SET_SSV",
+	"TEST_STATEID", "WANT_DELEGATION", "DESTROY_CLIENTID",
+	"RECLAIM_COMPLETE", "ALLOCATE", "COPY", "COPY_NOTIFY", "DEALLOCATE",
+	"IO_ADVISE", "LAYOUTERROR", "LAYOUTSTATS", "OFFLOAD_CANCEL",
+	"OFFLOAD_STATUS", "READ_PLUS", "SEEK", "WRITE_SAME", "CLONE",
+};
+
+#define NFS4_OP_PUTFH		22
+#define NFS4_OP_PUTPUBFH	23
+#define NFS4_OP_PUTROOTFH	24
+#define NFS4_OP_SEQUENCE	53
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint32_t xdr_len(uint32_t len)
+{
+	return (len + 3) & ~3;
+}
+
+/*
+ * Name a COMPOUND by its first op past SEQUENCE and the PUTFH family,
+ * which is what the compound is for.
+ */
+static void v4_name(const uint8_t *args, uint32_t len, char *name,
+		    size_t size)
+{
+	uint32_t off, count, op = 0, i;
+
+	snprintf(name, size, "v4.COMPOUND");
+
+	if (len < 4)
+		return;
+	off = 4 + xdr_len(get_be32(args));	/* tag */
+	off += 4;				/* minorversion */
+	if (off + 4 > len)
+		return;
+	count = get_be32(args + off);
+	off += 4;
+
+	for (i = 0; i < count && off + 4 <= len; i++) {
+		op = get_be32(args + off);
+		off += 4;
+
+		if (op == NFS4_OP_SEQUENCE)
+			off += 32;
+		else if (op == NFS4_OP_PUTFH && off + 4 <= len)
+			off += 4 + xdr_len(get_be32(args + off));
+		else if (op != NFS4_OP_PUTPUBFH && op != NFS4_OP_PUTROOTFH)
+			break;
+	}
+
+	if (op < ARRAY_SIZE(v4_ops) && v4_ops[op] != NULL)
+		snprintf(name, size, "v4.%s", v4_ops[op]);
+}
+
+static void call_name(const uint8_t *msg, uint32_t len, char *name,
+		      size_t size)
+{
+	uint32_t prog = get_be32(msg + 12);
+	uint32_t vers = get_be32(msg + 16);
+	uint32_t proc = get_be32(msg + 20);
+	uint32_t off = 24;
+
+	/* credential and verifier */
+	if (off + 8 <= len)
+		off += 8 + xdr_len(get_be32(msg + off + 4));
+	if (off + 8 <= len)
+		off += 8 + xdr_len(get_be32(msg + off + 4));
+
+	if (prog == NFS_PROGRAM && vers == 3 && proc < ARRAY_SIZE(v3_procs))
+		snprintf(name, size, "v3.%s", v3_procs[proc]);
+	else if (prog == NFS_PROGRAM && vers == 4 && proc == 1 && off <= len)
+		v4_name(msg + off, len - off, name, size);
+	else if (prog == NFS_PROGRAM && vers == 4 && proc == 0)
+		snprintf(name, size, "v4.NULL");
+	else if (prog == MOUNT_PROGRAM && proc < ARRAY_SIZE(mnt_procs))
+		snprintf(name, size, "mnt.%s", mnt_procs[proc]);
+	else
+		snprintf(name, size, "%u.%u.%u", prog, vers, proc);
+}
+
+static uint32_t find_op(const char *name)
+{
+	uint32_t i;
+
+	for (i = 0; i < nops; i++)
+		if (strcmp(ops[i].name, name) == 0)
+			return i;
+
+	ops = realloc(ops, (nops + 1) * sizeof(*ops));
+	if (ops == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	memset(&ops[nops], 0, sizeof(*ops));
+	snprintf(ops[nops].name, sizeof(ops[nops].name), "%s", name);
+	return nops++;
+}
+
+/* Sort the calls into ops, with room for their latencies */
+static void classify(void)
+{
+	char name[40];
+	uint32_t i;
+
+	call_op = calloc(cap.ncalls, sizeof(*call_op));
+	sent = calloc(cap.ncalls, sizeof(*sent));
+	if (call_op == NULL || sent == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+
+	for (i = 0; i < cap.ncalls; i++) {
+		call_name(cap.calls[i].msg, cap.calls[i].len, name,
+			  sizeof(name));
+		call_op[i] = find_op(name);
+		ops[call_op[i]].count++;
+	}
+
+	for (i = 0; i < nops; i++) {
+		ops[i].lat = calloc(ops[i].count, sizeof(*ops[i].lat));
+		if (ops[i].lat == NULL) {
+			fprintf(stderr, "Out of memory\n");
+			exit(1);
+		}
+	}
+}
+
+static int read_all(int fd, uint8_t *buf, uint32_t len)
+{
+	ssize_t n;
+
+	while (len > 0) {
+		n = read(fd, buf, len);
+		if (n <= 0)
+			return -1;
+		buf += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+static int write_all(int fd, const uint8_t *buf, uint32_t len)
+{
+	ssize_t n;
+
+	while (len > 0) {
+		n = write(fd, buf, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		buf += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+static void reply(const uint8_t *msg, uint32_t len, uint64_t when)
+{
+	uint32_t idx, off, verf_len;
+	struct op_stats *op;
+
+	if (len < 12 || get_be32(msg + 4) != RPC_REPLY)
+		return;
+
+	idx = get_be32(msg) - xid_base;
+
+	pthread_mutex_lock(&stats_mtx);
+
+	if (idx >= cap.ncalls || sent[idx] == 0) {
+		unmatched++;
+		goto out;
+	}
+
+	op = &ops[call_op[idx]];
+	op->lat[op->nlat++] = when - sent[idx];
+	sent[idx] = 0;
+	replied++;
+
+	/* accepted, then verifier, accept_stat and the NFS status */
+	if (get_be32(msg + 8) != 0 || len < 20) {
+		op->rpc_errors++;
+		goto out;
+	}
+	verf_len = xdr_len(get_be32(msg + 16));
+	off = 20 + verf_len;
+	if (off + 4 > len || get_be32(msg + off) != 0)
+		op->rpc_errors++;
+	else if (off + 8 <= len && get_be32(msg + off + 4) != 0)
+		op->nfs_errors++;
+
+ out:
+	pthread_mutex_unlock(&stats_mtx);
+}
+
+/* Take the replies off a connection until it is shut down */
+static void *receiver(void *arg)
+{
+	struct conn *c = arg;
+	uint8_t mark[4], *rec = NULL;
+	uint32_t rec_len = 0, rec_cap = 0, flen;
+
+	while (read_all(c->fd, mark, 4) == 0) {
+		flen = get_be32(mark) & 0x7fffffff;
+		if (rec_len + flen > rec_cap) {
+			rec_cap = rec_len + flen;
+			rec = realloc(rec, rec_cap);
+			if (rec == NULL) {
+				fprintf(stderr, "Out of memory\n");
+				exit(1);
+			}
+		}
+		if (read_all(c->fd, rec + rec_len, flen) != 0)
+			break;
+		rec_len += flen;
+
+		if (get_be32(mark) & 0x80000000) {
+			reply(rec, rec_len, now_ns());
+			rec_len = 0;
+		}
+	}
+
+	free(rec);
+	return NULL;
+}
+
+static int connect_server(const char *server, const char *port)
+{
+	struct addrinfo hints, *res, *ai;
+	int fd = -1, one = 1, rc;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	rc = getaddrinfo(server, port, &hints, &res);
+	if (rc != 0) {
+		fprintf(stderr, "Can not resolve %s: %s\n", server,
+			gai_strerror(rc));
+		return -1;
+	}
+
+	for (ai = res; ai != NULL; ai = ai->ai_next) {
+		fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (fd < 0)
+			continue;
+		if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+			break;
+		close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(res);
+
+	if (fd >= 0)
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	return fd;
+}
+
+/* Send every call at its time, on the connection of its client */
+static void replay(double speed)
+{
+	uint8_t *buf = NULL;
+	uint32_t buf_cap = 0, i;
+	struct replay_call *call;
+	struct timespec ts;
+	uint64_t start = now_ns(), at;
+
+	for (i = 0; i < cap.ncalls; i++) {
+		call = &cap.calls[i];
+
+		if (speed > 0) {
+			at = start + call->when / speed;
+			ts.tv_sec = at / 1000000000ULL;
+			ts.tv_nsec = at % 1000000000ULL;
+			while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+					       &ts, NULL) == EINTR)
+				;
+		}
+
+		if (call->len + 4 > buf_cap) {
+			buf_cap = call->len + 4;
+			buf = realloc(buf, buf_cap);
+			if (buf == NULL) {
+				fprintf(stderr, "Out of memory\n");
+				exit(1);
+			}
+		}
+
+		/* A fresh xid, the capture may reuse its own */
+		put_be32(buf, 0x80000000 | call->len);
+		memcpy(buf + 4, call->msg, call->len);
+		put_be32(buf + 4, xid_base + i);
+
+		pthread_mutex_lock(&stats_mtx);
+		sent[i] = now_ns();
+		pthread_mutex_unlock(&stats_mtx);
+
+		if (write_all(conns[call->flow % nconns].fd, buf,
+			      call->len + 4) != 0) {
+			fprintf(stderr, "Lost the connection to the server\n");
+			break;
+		}
+	}
+
+	free(buf);
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static double pct_us(struct op_stats *op, double pct)
+{
+	return op->lat[(uint64_t) (pct * (op->nlat - 1))] / 1000.0;
+}
+
+static void report(double seconds)
+{
+	struct op_stats *op;
+	uint64_t total_ns;
+	uint32_t i, j;
+
+	printf("%u calls from %u clients replayed in %.3f s, %llu replies, %llu unmatched\n",
+	       cap.ncalls, cap.nflows, seconds, (unsigned long long) replied,
+	       (unsigned long long) unmatched);
+	printf("%-28s %9s %9s %7s %7s %10s %10s %10s %10s %10s\n",
+	       "op", "calls", "replies", "rpcerr", "nfserr", "avg us",
+	       "p50 us", "p99 us", "p99.9 us", "max us");
+
+	for (i = 0; i < nops; i++) {
+		op = &ops[i];
+		printf("%-28s %9llu %9llu %7llu %7llu", op->name,
+		       (unsigned long long) op->count,
+		       (unsigned long long) op->nlat,
+		       (unsigned long long) op->rpc_errors,
+		       (unsigned long long) op->nfs_errors);
+
+		if (op->nlat == 0) {
+			printf("\n");
+			continue;
+		}
+
+		qsort(op->lat, op->nlat, sizeof(*op->lat), cmp_u64);
+		for (total_ns = 0, j = 0; j < op->nlat; j++)
+			total_ns += op->lat[j];
+
+		printf(" %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+		       total_ns / 1000.0 / op->nlat, pct_us(op, 0.50),
+		       pct_us(op, 0.99), pct_us(op, 0.999),
+		       op->lat[op->nlat - 1] / 1000.0);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	char *capture = NULL, *server = NULL, *port = "2049";
+	uint32_t max_conns = 0, wait = 30, i;
+	long capture_port = -1;
+	double speed = 1.0;
+	uint64_t start, deadline;
+	int opt, rc;
+
+	while ((opt = getopt(argc, argv, options)) != EOF) {
+		switch (opt) {
+		case 'f':
+			capture = optarg;
+			break;
+		case 's':
+			server = optarg;
+			break;
+		case 'p':
+			port = optarg;
+			break;
+		case 'c':
+			capture_port = atol(optarg);
+			break;
+		case 'x':
+			speed = atof(optarg);
+			break;
+		case 'n':
+			max_conns = atoi(optarg);
+			break;
+		case 'w':
+			wait = atoi(optarg);
+			break;
+		case '?':
+		case 'h':
+		default:
+			fprintf(stderr, "%s", usage);
+			exit(opt == 'h' ? 0 : 1);
+		}
+	}
+
+	if (capture == NULL || server == NULL) {
+		fprintf(stderr, "Must specify -f and -s\n%s", usage);
+		exit(1);
+	}
+	if (capture_port < 0)
+		capture_port = atol(port);
+
+	rc = replay_read_pcap(capture, capture_port, &cap);
+	if (rc != 0) {
+		fprintf(stderr, "Can not read %s: %s\n", capture,
+			strerror(rc));
+		exit(1);
+	}
+
+	printf("%s: %llu packets, %u calls from %u clients, skipped %llu IP fragments, %llu stream gaps, %llu non-call messages\n",
+	       capture, (unsigned long long) cap.packets, cap.ncalls,
+	       cap.nflows, (unsigned long long) cap.fragments,
+	       (unsigned long long) cap.gaps,
+	       (unsigned long long) cap.not_calls);
+
+	if (cap.ncalls == 0)
+		exit(0);
+
+	classify();
+
+	nconns = cap.nflows;
+	if (max_conns != 0 && nconns > max_conns)
+		nconns = max_conns;
+	if (nconns > MAX_CONNS)
+		nconns = MAX_CONNS;
+
+	conns = calloc(nconns, sizeof(*conns));
+	if (conns == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+
+	for (i = 0; i < nconns; i++) {
+		conns[i].fd = connect_server(server, port);
+		if (conns[i].fd < 0) {
+			fprintf(stderr, "Can not connect to %s port %s\n",
+				server, port);
+			exit(1);
+		}
+		rc = pthread_create(&conns[i].thread, NULL, receiver,
+				    &conns[i]);
+		if (rc != 0) {
+			fprintf(stderr, "Can not start a receiver: %s\n",
+				strerror(rc));
+			exit(1);
+		}
+	}
+
+	xid_base = (uint32_t) time(NULL) << 8;
+
+	start = now_ns();
+	replay(speed);
+
+	/* Give the last calls their replies */
+	deadline = now_ns() + wait * 1000000000ULL;
+	while (now_ns() < deadline) {
+		pthread_mutex_lock(&stats_mtx);
+		rc = replied == cap.ncalls;
+		pthread_mutex_unlock(&stats_mtx);
+		if (rc)
+			break;
+		usleep(10000);
+	}
+
+	for (i = 0; i < nconns; i++) {
+		shutdown(conns[i].fd, SHUT_RDWR);
+		pthread_join(conns[i].thread, NULL);
+		close(conns[i].fd);
+	}
+
+	report((now_ns() - start) / 1e9);
+	return 0;
+}
@@ -0,0 +1,83 @@
+/*
+ * This software is a server that implements the NFS protocol.
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ *
+ */
+
+/*
+ * Replay of captured NFS traffic
+ *
+ * The RPC calls sent to the server port are pulled out of a pcap
+ * capture, TCP streams being reassembled and their record marks
+ * removed, and are then sent again to a server with the original
+ * spacing, scaled, each on a connection standing for its original
+ * client.
+ */
+
+#ifndef _NFS_REPLAY_H
+#define _NFS_REPLAY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define RPC_CALL 0
+#define RPC_REPLY 1
+#define NFS_PROGRAM 100003
+#define MOUNT_PROGRAM 100005
+
+struct replay_call {
+	uint64_t when;		/* ns since the first call */
+	uint32_t flow;		/* original client connection */
+	uint32_t len;
+	uint8_t *msg;		/* the call, without record mark */
+};
+
+struct replay_capture {
+	struct replay_call *calls;
+	uint32_t ncalls;
+	uint32_t nflows;
+	/* what was skipped */
+	uint64_t packets;
+	uint64_t fragments;	/* IP fragments */
+	uint64_t gaps;		/* TCP data lost from the capture */
+	uint64_t not_calls;	/* messages that were not RPC calls */
+};
+
+int replay_read_pcap(const char *path, uint16_t port,
+		     struct replay_capture *cap);
+
+static inline uint32_t get_be32(const uint8_t *p)
+{
+	return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) |
+	       ((uint32_t) p[2] << 8) | p[3];
+}
+
+static inline uint16_t get_be16(const uint8_t *p)
+{
+	return ((uint16_t) p[0] << 8) | p[1];
+}
+
+static inline void put_be32(uint8_t *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+#endif				/* _NFS_REPLAY_H */
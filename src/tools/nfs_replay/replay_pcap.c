@@ -0,0 +1,478 @@
+/*
+ * This software is a server that implements the NFS protocol.
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ *
+ */
+
+/*
+ * Pull the RPC calls out of a pcap capture
+ *
+ * Only the traffic to the server port is kept.  TCP streams are
+ * reassembled in sequence order; retransmissions are trimmed, and a
+ * stream that loses data, or was captured from its middle, is picked up
+ * again at the next segment that starts with a record mark followed by
+ * an RPC call.  IP fragments are skipped.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "nfs_replay.h"
+
+#define PCAP_MAGIC		0xa1b2c3d4
+#define PCAP_MAGIC_NSEC		0xa1b23c4d
+
+#define LINKTYPE_NULL		0
+#define LINKTYPE_ETHERNET	1
+#define LINKTYPE_RAW		101
+#define LINKTYPE_LINUX_SLL	113
+#define LINKTYPE_IPV4		228
+#define LINKTYPE_IPV6		229
+#define LINKTYPE_LINUX_SLL2	276
+
+#define ETHERTYPE_IP		0x0800
+#define ETHERTYPE_VLAN		0x8100
+#define ETHERTYPE_IPV6		0x86dd
+
+#define PROTO_TCP		6
+#define PROTO_UDP		17
+
+#define TCP_SYN			0x02
+
+/* Larger records are taken as garbage, as the server would */
+#define MAX_RECORD		(16 * 1024 * 1024)
+
+#define FLOW_BUCKETS		4096
+
+struct flow {
+	struct flow *next;
+	uint8_t key[36];	/* addresses and ports */
+	uint32_t id;
+	bool tcp;
+	bool synced;		/* next_seq is known */
+	uint32_t next_seq;
+	/* stream not yet split into records */
+	uint8_t *stream;
+	uint32_t stream_len;
+	uint32_t stream_cap;
+	/* fragments of the record being put together */
+	uint8_t *rec;
+	uint32_t rec_len;
+	uint32_t rec_cap;
+};
+
+struct pcap_state {
+	struct replay_capture *cap;
+	struct flow *flows[FLOW_BUCKETS];
+	uint16_t port;
+	bool swapped;
+	bool nsec;
+	uint32_t linktype;
+	bool have_base;
+	uint64_t base;
+};
+
+static uint32_t get32(struct pcap_state *ps, const uint8_t *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return ps->swapped ? __builtin_bswap32(v) : v;
+}
+
+static void append(uint8_t **buf, uint32_t *len, uint32_t *cap,
+		   const uint8_t *data, uint32_t n)
+{
+	if (*len + n > *cap) {
+		*cap = (*len + n) * 2;
+		*buf = realloc(*buf, *cap);
+		if (*buf == NULL) {
+			fprintf(stderr, "Out of memory\n");
+			exit(1);
+		}
+	}
+	memcpy(*buf + *len, data, n);
+	*len += n;
+}
+
+static struct flow *get_flow(struct pcap_state *ps, const uint8_t *key,
+			     bool tcp)
+{
+	uint32_t h = 0, i;
+	struct flow *f;
+
+	for (i = 0; i < sizeof(f->key); i++)
+		h = h * 31 + key[i];
+	h %= FLOW_BUCKETS;
+
+	for (f = ps->flows[h]; f != NULL; f = f->next)
+		if (f->tcp == tcp && memcmp(f->key, key, sizeof(f->key)) == 0)
+			return f;
+
+	f = calloc(1, sizeof(*f));
+	if (f == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	memcpy(f->key, key, sizeof(f->key));
+	f->tcp = tcp;
+	f->id = ps->cap->nflows++;
+	f->next = ps->flows[h];
+	ps->flows[h] = f;
+	return f;
+}
+
+static bool is_call(const uint8_t *msg, uint32_t len)
+{
+	return len >= 24 && get_be32(msg + 4) == RPC_CALL &&
+	       get_be32(msg + 8) == 2;
+}
+
+static void add_call(struct pcap_state *ps, struct flow *f, uint64_t ts,
+		     const uint8_t *msg, uint32_t len)
+{
+	struct replay_capture *cap = ps->cap;
+	struct replay_call *call;
+
+	if (!is_call(msg, len)) {
+		cap->not_calls++;
+		return;
+	}
+
+	if (!ps->have_base) {
+		ps->base = ts;
+		ps->have_base = true;
+	}
+
+	if ((cap->ncalls & (cap->ncalls - 1)) == 0) {
+		cap->calls = realloc(cap->calls, (cap->ncalls ? cap->ncalls * 2
+						  : 1) * sizeof(*cap->calls));
+		if (cap->calls == NULL) {
+			fprintf(stderr, "Out of memory\n");
+			exit(1);
+		}
+	}
+
+	call = &cap->calls[cap->ncalls++];
+	call->when = ts > ps->base ? ts - ps->base : 0;
+	call->flow = f->id;
+	call->len = len;
+	call->msg = malloc(len);
+	if (call->msg == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	memcpy(call->msg, msg, len);
+}
+
+/* A segment we can pick a lost stream up at */
+static bool starts_record(const uint8_t *data, uint32_t len)
+{
+	return len >= 16 && (get_be32(data) & 0x7fffffff) <= MAX_RECORD &&
+	       is_call(data + 4, len - 4);
+}
+
+static void lose_stream(struct pcap_state *ps, struct flow *f)
+{
+	ps->cap->gaps++;
+	f->synced = false;
+	f->stream_len = 0;
+	f->rec_len = 0;
+}
+
+/* Split what has come in on the stream into records */
+static void split_records(struct pcap_state *ps, struct flow *f, uint64_t ts)
+{
+	uint32_t off = 0, mark, flen;
+
+	while (f->stream_len - off >= 4) {
+		mark = get_be32(f->stream + off);
+		flen = mark & 0x7fffffff;
+
+		if (flen > MAX_RECORD || f->rec_len + flen > MAX_RECORD) {
+			lose_stream(ps, f);
+			return;
+		}
+		if (f->stream_len - off - 4 < flen)
+			break;
+
+		append(&f->rec, &f->rec_len, &f->rec_cap,
+		       f->stream + off + 4, flen);
+		off += 4 + flen;
+
+		if (mark & 0x80000000) {
+			add_call(ps, f, ts, f->rec, f->rec_len);
+			f->rec_len = 0;
+		}
+	}
+
+	memmove(f->stream, f->stream + off, f->stream_len - off);
+	f->stream_len -= off;
+}
+
+static void tcp_segment(struct pcap_state *ps, struct flow *f, uint64_t ts,
+			uint32_t seq, uint8_t flags, const uint8_t *data,
+			uint32_t len)
+{
+	int32_t ahead;
+
+	if (flags & TCP_SYN) {
+		f->synced = true;
+		f->next_seq = seq + 1;
+		f->stream_len = 0;
+		f->rec_len = 0;
+		return;
+	}
+
+	if (len == 0)
+		return;
+
+	if (f->synced) {
+		ahead = (int32_t) (seq - f->next_seq);
+		if (ahead > 0) {
+			lose_stream(ps, f);
+		} else if (ahead < 0) {
+			/* retransmitted, keep what is new */
+			if ((uint32_t) -ahead >= len)
+				return;
+			data += -ahead;
+			len -= -ahead;
+			seq = f->next_seq;
+		}
+	}
+
+	if (!f->synced) {
+		if (!starts_record(data, len))
+			return;
+		f->synced = true;
+	}
+
+	f->next_seq = seq + len;
+	append(&f->stream, &f->stream_len, &f->stream_cap, data, len);
+	split_records(ps, f, ts);
+}
+
+/* Handle an IP packet, keeping what is sent to the server port */
+static void ip_packet(struct pcap_state *ps, uint64_t ts, const uint8_t *p,
+		      uint32_t len)
+{
+	uint8_t key[36];
+	uint32_t hlen, plen;
+	uint8_t proto;
+	struct flow *f;
+
+	memset(key, 0, sizeof(key));
+
+	if (len < 1)
+		return;
+
+	if ((p[0] >> 4) == 4) {
+		if (len < 20)
+			return;
+		hlen = (p[0] & 0xf) * 4;
+		plen = get_be16(p + 2);
+		if ((get_be16(p + 6) & 0x3fff) != 0) {
+			/* more fragments, or not the first */
+			ps->cap->fragments++;
+			return;
+		}
+		proto = p[9];
+		memcpy(key, p + 12, 8);
+	} else if ((p[0] >> 4) == 6) {
+		if (len < 40)
+			return;
+		hlen = 40;
+		plen = 40 + get_be16(p + 4);
+		proto = p[6];
+		memcpy(key, p + 8, 32);
+	} else {
+		return;
+	}
+
+	if (plen > len)
+		plen = len;	/* snapped */
+	if (hlen > plen)
+		return;
+	p += hlen;
+	plen -= hlen;
+
+	if (proto == PROTO_TCP && plen >= 20) {
+		hlen = (p[12] >> 4) * 4;
+		if (hlen > plen || get_be16(p + 2) != ps->port)
+			return;
+		memcpy(key + 32, p, 4);
+		f = get_flow(ps, key, true);
+		tcp_segment(ps, f, ts, get_be32(p + 4), p[13], p + hlen,
+			    plen - hlen);
+	} else if (proto == PROTO_UDP && plen >= 8) {
+		if (get_be16(p + 2) != ps->port)
+			return;
+		memcpy(key + 32, p, 4);
+		f = get_flow(ps, key, false);
+		add_call(ps, f, ts, p + 8, plen - 8);
+	}
+}
+
+static void link_packet(struct pcap_state *ps, uint64_t ts, const uint8_t *p,
+			uint32_t len)
+{
+	uint16_t type;
+
+	switch (ps->linktype) {
+	case LINKTYPE_NULL:
+		if (len >= 4)
+			ip_packet(ps, ts, p + 4, len - 4);
+		return;
+
+	case LINKTYPE_RAW:
+	case LINKTYPE_IPV4:
+	case LINKTYPE_IPV6:
+		ip_packet(ps, ts, p, len);
+		return;
+
+	case LINKTYPE_LINUX_SLL:
+		if (len < 16)
+			return;
+		type = get_be16(p + 14);
+		p += 16;
+		len -= 16;
+		break;
+
+	case LINKTYPE_LINUX_SLL2:
+		if (len < 20)
+			return;
+		type = get_be16(p);
+		p += 20;
+		len -= 20;
+		break;
+
+	case LINKTYPE_ETHERNET:
+		if (len < 14)
+			return;
+		type = get_be16(p + 12);
+		p += 14;
+		len -= 14;
+		while (type == ETHERTYPE_VLAN && len >= 4) {
+			type = get_be16(p + 2);
+			p += 4;
+			len -= 4;
+		}
+		break;
+
+	default:
+		return;
+	}
+
+	if (type == ETHERTYPE_IP || type == ETHERTYPE_IPV6)
+		ip_packet(ps, ts, p, len);
+}
+
+static void free_flows(struct pcap_state *ps)
+{
+	struct flow *f, *next;
+	int i;
+
+	for (i = 0; i < FLOW_BUCKETS; i++) {
+		for (f = ps->flows[i]; f != NULL; f = next) {
+			next = f->next;
+			free(f->stream);
+			free(f->rec);
+			free(f);
+		}
+	}
+}
+
+/**
+ * Read the calls sent to port out of the capture in path
+ *
+ * Returns 0, or an errno.
+ */
+int replay_read_pcap(const char *path, uint16_t port,
+		     struct replay_capture *cap)
+{
+	struct pcap_state *ps;
+	uint8_t hdr[24], *pkt = NULL;
+	uint32_t magic, caplen, pkt_cap = 0;
+	uint64_t ts;
+	FILE *fp;
+	int rc = 0;
+
+	fp = fopen(path, "r");
+	if (fp == NULL)
+		return errno;
+
+	ps = calloc(1, sizeof(*ps));
+	if (ps == NULL) {
+		fclose(fp);
+		return ENOMEM;
+	}
+	ps->cap = cap;
+	ps->port = port;
+
+	if (fread(hdr, 24, 1, fp) != 1) {
+		rc = EINVAL;
+		goto out;
+	}
+
+	memcpy(&magic, hdr, sizeof(magic));
+	if (magic == PCAP_MAGIC || magic == PCAP_MAGIC_NSEC) {
+		ps->swapped = false;
+	} else if (__builtin_bswap32(magic) == PCAP_MAGIC ||
+		   __builtin_bswap32(magic) == PCAP_MAGIC_NSEC) {
+		ps->swapped = true;
+	} else {
+		/* pcapng is not read, tcpdump -r can convert it */
+		rc = EINVAL;
+		goto out;
+	}
+	ps->nsec = get32(ps, hdr) == PCAP_MAGIC_NSEC;
+	ps->linktype = get32(ps, hdr + 20) & 0xffff;
+
+	while (fread(hdr, 16, 1, fp) == 1) {
+		ts = get32(ps, hdr) * 1000000000ULL +
+		     get32(ps, hdr + 4) * (ps->nsec ? 1 : 1000);
+		caplen = get32(ps, hdr + 8);
+
+		if (caplen > MAX_RECORD) {
+			rc = EINVAL;
+			goto out;
+		}
+		if (caplen > pkt_cap) {
+			pkt_cap = caplen;
+			free(pkt);
+			pkt = malloc(pkt_cap);
+			if (pkt == NULL) {
+				rc = ENOMEM;
+				goto out;
+			}
+		}
+		if (fread(pkt, caplen, 1, fp) != 1 && caplen != 0)
+			break;	/* truncated capture */
+
+		cap->packets++;
+		link_packet(ps, ts, pkt, caplen);
+	}
+
+ out:
+	free(pkt);
+	free_flows(ps);
+	free(ps);
+	fclose(fp);
+	return rc;
+}
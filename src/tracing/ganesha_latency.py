@@ -0,0 +1,141 @@
+#!/usr/bin/env python3
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public
+# License as published by the Free Software Foundation; either
+# version 3 of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public
+# License along with this library; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+# 02110-1301 USA
+
+"""Summarize the latencies in an LTTng trace of ganesha.
+
+Pairs the start and end tracepoints and prints, for each kind of
+interval, the count and the mean, median, 99th percentile and maximum
+latency in microseconds:
+
+  rpc            nfs_rpc:start .. nfs_rpc:end
+  op <name>      nfs_rpc:op_start .. nfs_rpc:op_end
+  queue <name>   nfs_rpc:enqueue .. nfs_rpc:dequeue
+  fsal <func>    mdcache:subcall_start .. mdcache:subcall_end
+  lock wait      state:lock_start .. state:lock_acquired
+  lock           state:lock_start .. state:lock_end
+
+and the counts of the mdcache hash hits and misses, of the entries
+reaped and allocated, and of the duplicate request cache results.
+
+The FSAL and lock intervals are matched per thread, so the trace needs
+the vtid context:
+
+  lttng create
+  lttng enable-event -u 'nfs_rpc:*,mdcache:*,state:*'
+  lttng add-context -u -t vtid
+  lttng start
+
+Usage: ganesha_latency.py <trace directory>
+"""
+
+import sys
+from collections import defaultdict
+
+import babeltrace
+
+# dupreq_status_t, as in nfs_dupreq.h
+DUPREQ_STATUS = ["SUCCESS", "INSERT_MALLOC_ERROR", "BEING_PROCESSED",
+                 "EXISTS", "ERROR"]
+
+
+def report(title, samples):
+    print(title)
+    print("  %-32s %9s %10s %10s %10s %10s" %
+          ("", "count", "mean", "p50", "p99", "max"))
+    for name in sorted(samples):
+        lat = sorted(samples[name])
+        n = len(lat)
+        print("  %-32s %9d %10.1f %10.1f %10.1f %10.1f" %
+              (name, n, sum(lat) / n, lat[n // 2],
+               lat[min(n - 1, n * 99 // 100)], lat[-1]))
+    print()
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit("Usage: %s <trace directory>" % sys.argv[0])
+
+    traces = babeltrace.TraceCollection()
+    if traces.add_traces_recursive(sys.argv[1], "ctf") is None:
+        sys.exit("No trace found in %s" % sys.argv[1])
+
+    samples = defaultdict(list)
+    counts = defaultdict(int)
+    started = {}
+
+    def begin(key, ts, name=None):
+        started[key] = (ts, name)
+
+    def end(key, ts, name):
+        start = started.pop(key, None)
+        if start is not None:
+            samples[name or start[1]].append((ts - start[0]) / 1000.0)
+
+    for event in traces.events:
+        ev = event.name
+        ts = event.timestamp
+        tid = event.get("vtid")
+
+        if ev == "nfs_rpc:start":
+            begin(("rpc", event["req"]), ts, "rpc")
+        elif ev == "nfs_rpc:end":
+            end(("rpc", event["req"]), ts, None)
+        elif ev == "nfs_rpc:op_start":
+            begin(("op", event["req"]), ts, "op " + event["op_name"])
+        elif ev == "nfs_rpc:op_end":
+            end(("op", event["req"]), ts, None)
+        elif ev == "nfs_rpc:enqueue":
+            begin(("queue", event["req"]), ts, "queue " + event["queue"])
+        elif ev == "nfs_rpc:dequeue":
+            end(("queue", event["req"]), ts, None)
+        elif ev == "nfs_rpc:dupreq":
+            status = event["status"]
+            if status < len(DUPREQ_STATUS):
+                status = DUPREQ_STATUS[status]
+            counts["drc " + str(status)] += 1
+        elif ev == "mdcache:subcall_start":
+            begin(("fsal", tid, event["func"]), ts,
+                  "fsal " + event["func"])
+        elif ev == "mdcache:subcall_end":
+            end(("fsal", tid, event["func"]), ts, None)
+        elif ev == "mdcache:cih_hit":
+            counts["mdcache hit" + (" slot" if event["slot"] else "")] += 1
+        elif ev == "mdcache:cih_miss":
+            counts["mdcache miss"] += 1
+        elif ev == "mdcache:lru_reap":
+            counts["mdcache reap"] += 1
+        elif ev == "mdcache:lru_alloc":
+            counts["mdcache alloc"] += 1
+        elif ev == "state:lock_start":
+            begin(("lock wait", tid), ts, "lock wait")
+            begin(("lock", tid), ts, "lock")
+        elif ev == "state:lock_acquired":
+            end(("lock wait", tid), ts, None)
+        elif ev == "state:lock_end":
+            end(("lock", tid), ts, None)
+
+    if samples:
+        report("Latency (us)", samples)
+
+    if counts:
+        print("Counts")
+        for name in sorted(counts):
+            print("  %-32s %9d" % (name, counts[name]))
+
+
+if __name__ == "__main__":
+    main()